@@ -51,25 +51,32 @@ def aspect_function(internal_loop, tainted):
     return value
 
 
-def new_request(enable_propagation):
+def new_request(enable_propagation, tainted_objects):
     tainted = b"my_string".decode("ascii")
     reset_context()
     create_context()
 
+    # Other objects tainted in the same request, which stay alive in the taint map until the next one
+    live_objects = [("param_%d" % i).encode("ascii").decode("ascii") for i in range(tainted_objects)]
     if enable_propagation:
         taint_pyobject_with_ranges(tainted, (CHECK_RANGES[0],))
-    return tainted
+        for live_object in live_objects:
+            taint_pyobject_with_ranges(live_object, (CHECK_RANGES[0],))
+    return tainted, live_objects
 
 
-def launch_function(enable_propagation, func, internal_loop, caller_loop):
+def launch_function(enable_propagation, func, internal_loop, caller_loop, tainted_objects):
     for _ in range(caller_loop):
-        tainted_value = new_request(enable_propagation)
+        tainted_value, live_objects = new_request(enable_propagation, tainted_objects)
         func(internal_loop, tainted_value)
+        for live_object in live_objects:
+            func(1, live_object)
 
 
 class IastPropagation(bm.Scenario):
     iast_enabled = bm.var(type=int)
     internal_loop = bm.var(type=int)
+    tainted_objects = bm.var(type=int)
 
     def run(self):
         caller_loop = 10
@@ -80,6 +87,6 @@ class IastPropagation(bm.Scenario):
 
         def _(loops):
             for _ in range(loops):
-                launch_function(self.iast_enabled, func, self.internal_loop, caller_loop)
+                launch_function(self.iast_enabled, func, self.internal_loop, caller_loop, self.tainted_objects)
 
         yield _
@@ -5,6 +5,7 @@ import attr
 import pyperf
 import six
 
+from . import perf_counters
 from ._to_bool import to_bool
 
 
@@ -72,9 +73,14 @@ class Scenario(six.with_metaclass(ScenarioMeta)):
     def _pyperf(self, loops):
         rungen = self.run()
         run = next(rungen)
+        counters = perf_counters.PerfCounters()
+        counters.start()
         t0 = time.perf_counter()
         run(loops)
         dt = time.perf_counter() - t0
+        counts = counters.stop()
+        counters.close()
+        perf_counters.record(self.scenario_name, loops, counts)
         try:
             # perform any teardown
             next(rungen)
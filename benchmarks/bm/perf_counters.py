@@ -0,0 +1,162 @@
+"""Hardware counters of the scenarios, read with perf_event_open.
+
+Wall time is too noisy to judge micro-optimizations, so when ``DD_BENCH_PERF_COUNTERS`` is set to a non-empty value
+other than 0, every run of a scenario also counts the instructions, cycles, cache misses and branch misses of the
+thread running it, the same counters that the native benchmark suites report (see
+``benchmarks/native/perf_counters.h``). pyperf only records times, so the counters per loop are appended as JSON lines
+to the file named by ``DD_BENCH_PERF_COUNTERS_FILE``, ``perf_counters.jsonl`` by default. The calibration and warmup
+runs of pyperf are recorded too, with their number of loops.
+
+Where the counters can't be opened (another OS, a container without the capability, a VM without a virtual PMU), the
+scenarios run as usual; the reason is printed once.
+"""
+import ctypes
+import ctypes.util
+import json
+import os
+import platform
+import struct
+import sys
+
+
+_ENV = os.environ.get("DD_BENCH_PERF_COUNTERS", "")
+ENABLED = _ENV not in ("", "0") and sys.platform.startswith("linux")
+OUTPUT = os.environ.get("DD_BENCH_PERF_COUNTERS_FILE", "perf_counters.jsonl")
+
+# The number of the perf_event_open system call, which has no wrapper in the C library
+_SYS_PERF_EVENT_OPEN = {"x86_64": 298, "aarch64": 241, "i686": 336, "i386": 336}.get(platform.machine())
+
+_PERF_TYPE_HARDWARE = 0
+EVENTS = (
+    ("instructions", 1),  # PERF_COUNT_HW_INSTRUCTIONS
+    ("cycles", 0),  # PERF_COUNT_HW_CPU_CYCLES
+    ("cache_misses", 3),  # PERF_COUNT_HW_CACHE_MISSES
+    ("branch_misses", 5),  # PERF_COUNT_HW_BRANCH_MISSES
+)
+
+_PERF_FORMAT_TOTAL_TIME_ENABLED = 1 << 0
+_PERF_FORMAT_TOTAL_TIME_RUNNING = 1 << 1
+_PERF_FORMAT_GROUP = 1 << 3
+
+# The bits of the flags of perf_event_attr
+_DISABLED = 1 << 0
+_EXCLUDE_KERNEL = 1 << 5
+_EXCLUDE_HV = 1 << 6
+
+_PERF_EVENT_IOC_ENABLE = 0x2400
+_PERF_EVENT_IOC_DISABLE = 0x2401
+_PERF_EVENT_IOC_RESET = 0x2403
+_PERF_IOC_FLAG_GROUP = 1
+
+
+class _PerfEventAttr(ctypes.Structure):
+    # The fields up to PERF_ATTR_SIZE_VER5, which all the supported kernels know
+    _fields_ = [
+        ("type", ctypes.c_uint32),
+        ("size", ctypes.c_uint32),
+        ("config", ctypes.c_uint64),
+        ("sample_period", ctypes.c_uint64),
+        ("sample_type", ctypes.c_uint64),
+        ("read_format", ctypes.c_uint64),
+        ("flags", ctypes.c_uint64),
+        ("wakeup_events", ctypes.c_uint32),
+        ("bp_type", ctypes.c_uint32),
+        ("config1", ctypes.c_uint64),
+        ("config2", ctypes.c_uint64),
+        ("branch_sample_type", ctypes.c_uint64),
+        ("sample_regs_user", ctypes.c_uint64),
+        ("sample_stack_user", ctypes.c_uint32),
+        ("clockid", ctypes.c_int32),
+        ("sample_regs_intr", ctypes.c_uint64),
+        ("aux_watermark", ctypes.c_uint32),
+        ("sample_max_stack", ctypes.c_uint16),
+        ("reserved_2", ctypes.c_uint16),
+    ]
+
+
+_libc = None
+_warned = False
+
+
+def _warn(reason):
+    global _warned
+
+    if not _warned:
+        _warned = True
+        print("perf counters disabled, {}".format(reason), file=sys.stderr)
+
+
+def _open(config, group_fd):
+    attr = _PerfEventAttr()
+    attr.type = _PERF_TYPE_HARDWARE
+    attr.size = ctypes.sizeof(attr)
+    attr.config = config
+    attr.read_format = _PERF_FORMAT_GROUP | _PERF_FORMAT_TOTAL_TIME_ENABLED | _PERF_FORMAT_TOTAL_TIME_RUNNING
+    attr.flags = _EXCLUDE_KERNEL | _EXCLUDE_HV | (_DISABLED if group_fd < 0 else 0)
+    # The calling thread, on any CPU
+    return _libc.syscall(_SYS_PERF_EVENT_OPEN, ctypes.byref(attr), 0, -1, group_fd, 0)
+
+
+class PerfCounters(object):
+    """The group of counters of the calling thread, which is empty when the counters can't be opened."""
+
+    def __init__(self):
+        global _libc
+
+        self._fds = []
+        if not ENABLED:
+            return
+        if _SYS_PERF_EVENT_OPEN is None:
+            _warn("unsupported machine {}".format(platform.machine()))
+            return
+        if _libc is None:
+            _libc = ctypes.CDLL(ctypes.util.find_library("c"), use_errno=True)
+
+        for name, config in EVENTS:
+            fd = _open(config, self._fds[0] if self._fds else -1)
+            if fd < 0:
+                _warn("cannot open {}: {}".format(name, os.strerror(ctypes.get_errno())))
+                self.close()
+                return
+            self._fds.append(fd)
+
+    def __bool__(self):
+        return bool(self._fds)
+
+    def start(self):
+        if self._fds:
+            _libc.ioctl(self._fds[0], _PERF_EVENT_IOC_RESET, _PERF_IOC_FLAG_GROUP)
+            _libc.ioctl(self._fds[0], _PERF_EVENT_IOC_ENABLE, _PERF_IOC_FLAG_GROUP)
+
+    def stop(self):
+        """Stops counting and returns the counts by name, scaled when the group was multiplexed with other events."""
+        if not self._fds:
+            return {}
+        _libc.ioctl(self._fds[0], _PERF_EVENT_IOC_DISABLE, _PERF_IOC_FLAG_GROUP)
+
+        # nr, time_enabled, time_running, then the values in the order the events were added to the group
+        size = 8 * (3 + len(EVENTS))
+        data = os.read(self._fds[0], size)
+        if len(data) != size:
+            return {}
+        nr, enabled, running = struct.unpack_from("=3Q", data)
+        if nr != len(EVENTS) or running == 0:
+            return {}
+        scale = enabled / running
+        values = struct.unpack_from("={}Q".format(nr), data, 24)
+        return {name: value * scale for (name, _), value in zip(EVENTS, values)}
+
+    def close(self):
+        for fd in self._fds:
+            os.close(fd)
+        self._fds = []
+
+
+def record(scenario_name, loops, counts):
+    """Appends the counts of a run of a scenario, per loop, to the output file."""
+    if not counts:
+        return
+    line = dict(scenario=scenario_name, loops=loops)
+    line.update((name, value / loops) for name, value in counts.items())
+    with open(OUTPUT, "a") as f:
+        f.write(json.dumps(line) + "\n")
@@ -0,0 +1,97 @@
+#include "kernels.h"
+#include "traces.h"
+#include "perf_counters.h"
+
+#include <benchmark/benchmark.h>
+
+namespace {
+
+// Traces of a payload, the writer flushes about a second of traces of an application at a time
+constexpr size_t NUM_TRACES = 100;
+
+/**
+ * Payloads are packed into buffers sized from the previous payloads like the encoders do, so that the benchmarks
+ * measure the packing and not the growth of the buffers.
+ */
+class Payload
+{
+  public:
+    Payload()
+      : table_(bench_packer_new(64 * 1024))
+      , pk_(bench_packer_new(64 * 1024))
+    {
+    }
+    ~Payload()
+    {
+        bench_packer_free(table_);
+        bench_packer_free(pk_);
+    }
+
+    Payload(const Payload&) = delete;
+    Payload& operator=(const Payload&) = delete;
+
+    bench_packer* table()
+    {
+        bench_packer_reset(table_);
+        return table_;
+    }
+    bench_packer* pk()
+    {
+        bench_packer_reset(pk_);
+        return pk_;
+    }
+    [[nodiscard]] size_t size() const { return bench_packer_length(table_) + bench_packer_length(pk_); }
+
+  private:
+    bench_packer* table_;
+    bench_packer* pk_;
+};
+
+void
+finish(benchmark::State& state, const TraceSet& traces, const Payload& payload)
+{
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * payload.size()));
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * traces.num_spans()));
+    state.counters["payload_bytes"] = static_cast<double>(payload.size());
+    state.counters["spans"] = static_cast<double>(traces.num_spans());
+}
+
+void
+BM_EncodeV03(benchmark::State& state, TraceShape shape)
+{
+    const TraceSet traces(shape, NUM_TRACES);
+    Payload payload;
+    bench::PerfCountersScope perf_counters(state);
+    for (auto _ : state) {
+        if (bench_pack_traces_v03(payload.pk(), traces.traces(), traces.size())) {
+            state.SkipWithError("packing failed");
+            break;
+        }
+        benchmark::ClobberMemory();
+    }
+    finish(state, traces, payload);
+}
+BENCHMARK_CAPTURE(BM_EncodeV03, web, TraceShape::web);
+BENCHMARK_CAPTURE(BM_EncodeV03, batch, TraceShape::batch);
+BENCHMARK_CAPTURE(BM_EncodeV03, tag_heavy, TraceShape::tag_heavy);
+
+void
+BM_EncodeV05(benchmark::State& state, TraceShape shape)
+{
+    const TraceSet traces(shape, NUM_TRACES);
+    Payload payload;
+    bench::PerfCountersScope perf_counters(state);
+    for (auto _ : state) {
+        if (bench_pack_traces_v05(payload.table(), payload.pk(), traces.traces(), traces.size())) {
+            state.SkipWithError("packing failed");
+            break;
+        }
+        benchmark::ClobberMemory();
+    }
+    finish(state, traces, payload);
+}
+BENCHMARK_CAPTURE(BM_EncodeV05, web, TraceShape::web);
+BENCHMARK_CAPTURE(BM_EncodeV05, batch, TraceShape::batch);
+BENCHMARK_CAPTURE(BM_EncodeV05, tag_heavy, TraceShape::tag_heavy);
+
+} // namespace
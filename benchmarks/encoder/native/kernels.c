@@ -0,0 +1,350 @@
+#include "kernels.h"
+
+#include "pack.h"
+
+// Same limit as the encoders in _encoding.pyx
+#define ITEM_LIMIT ((2LL << 31) - 1)
+
+struct bench_packer
+{
+    msgpack_packer pk;
+};
+
+bench_packer*
+bench_packer_new(size_t buf_size)
+{
+    bench_packer* pk = (bench_packer*)PyMem_Malloc(sizeof(bench_packer));
+    if (pk == NULL)
+        return NULL;
+
+    pk->pk.buf = (char*)PyMem_Malloc(buf_size);
+    if (pk->pk.buf == NULL) {
+        PyMem_Free(pk);
+        return NULL;
+    }
+    pk->pk.buf_size = buf_size;
+    pk->pk.length = 0;
+    return pk;
+}
+
+void
+bench_packer_free(bench_packer* pk)
+{
+    PyMem_Free(pk->pk.buf);
+    PyMem_Free(pk);
+}
+
+void
+bench_packer_reset(bench_packer* pk)
+{
+    pk->pk.length = 0;
+}
+
+size_t
+bench_packer_length(const bench_packer* pk)
+{
+    return pk->pk.length;
+}
+
+int
+bench_pack_uint64(bench_packer* pk, const uint64_t* values, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        if (msgpack_pack_uint64(&pk->pk, values[i]))
+            return -1;
+    }
+    return 0;
+}
+
+int
+bench_pack_int64(bench_packer* pk, const int64_t* values, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        if (msgpack_pack_int64(&pk->pk, values[i]))
+            return -1;
+    }
+    return 0;
+}
+
+int
+bench_pack_double(bench_packer* pk, const double* values, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        if (msgpack_pack_double(&pk->pk, values[i]))
+            return -1;
+    }
+    return 0;
+}
+
+int
+bench_pack_map_headers(bench_packer* pk, const uint32_t* sizes, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        if (msgpack_pack_map(&pk->pk, sizes[i]))
+            return -1;
+    }
+    return 0;
+}
+
+int
+bench_pack_raw(bench_packer* pk, const char* data, size_t length, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        if (msgpack_pack_raw(&pk->pk, length) || msgpack_pack_raw_body(&pk->pk, data, length))
+            return -1;
+    }
+    return 0;
+}
+
+int
+bench_pack_unicode(bench_packer* pk, PyObject* const* strings, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        if (msgpack_pack_unicode(&pk->pk, strings[i], ITEM_LIMIT))
+            return -1;
+    }
+    return 0;
+}
+
+// Same as pack_bytes in _encoding.pyx, which the encoders use for the keys of the span maps
+static inline int
+pack_key(msgpack_packer* pk, const char* key, size_t length)
+{
+    int ret = msgpack_pack_raw(pk, length);
+    if (ret == 0)
+        ret = msgpack_pack_raw_body(pk, key, length);
+    return ret;
+}
+
+#define PACK_KEY(pk, key) pack_key(pk, key, sizeof(key) - 1)
+#define PUT_KEY(dst, key) msgpack_put_fixstr(dst, key, sizeof(key) - 1)
+// Room taken by a key and its header, the size of the literal counting the header in place of the terminator
+#define PUT_KEY_SIZE(key) sizeof(key)
+
+static int
+pack_span_v03(msgpack_packer* pk, const bench_span* span)
+{
+    const int has_type = span->span_type != NULL;
+    const size_t L = 7 + (span->parent_id != 0) + (span->error != 0) + has_type + (span->ntags > 0) +
+                     (span->nmetrics > 0);
+
+    if (msgpack_pack_map(pk, L))
+        return -1;
+
+    // The ids and their keys, reserved at once like in _encoding.pyx
+    char* dst = msgpack_pack_reserve(
+      pk, 3 * MSGPACK_MAX_NUMBER_SIZE + PUT_KEY_SIZE("trace_id") + PUT_KEY_SIZE("parent_id") + PUT_KEY_SIZE("span_id"));
+    if (!dst)
+        return -1;
+    char* end = PUT_KEY(dst, "trace_id");
+    end = msgpack_put_uint64(end, span->trace_id);
+    if (span->parent_id) {
+        end = PUT_KEY(end, "parent_id");
+        end = msgpack_put_uint64(end, span->parent_id);
+    }
+    end = PUT_KEY(end, "span_id");
+    end = msgpack_put_uint64(end, span->span_id);
+    pk->length += end - dst;
+
+    if (PACK_KEY(pk, "service") || msgpack_pack_unicode(pk, span->service, ITEM_LIMIT))
+        return -1;
+    if (PACK_KEY(pk, "resource") || msgpack_pack_unicode(pk, span->resource, ITEM_LIMIT))
+        return -1;
+    if (PACK_KEY(pk, "name") || msgpack_pack_unicode(pk, span->name, ITEM_LIMIT))
+        return -1;
+    dst = msgpack_pack_reserve(pk, 2 * MSGPACK_MAX_NUMBER_SIZE + PUT_KEY_SIZE("start") + PUT_KEY_SIZE("duration"));
+    if (!dst)
+        return -1;
+    end = PUT_KEY(dst, "start");
+    end = msgpack_put_int64(end, span->start_ns);
+    end = PUT_KEY(end, "duration");
+    end = msgpack_put_int64(end, span->duration_ns);
+    pk->length += end - dst;
+
+    if (span->error) {
+        if (PACK_KEY(pk, "error") || msgpack_pack_int32(pk, span->error))
+            return -1;
+    }
+    if (has_type) {
+        if (PACK_KEY(pk, "type") || msgpack_pack_unicode(pk, span->span_type, ITEM_LIMIT))
+            return -1;
+    }
+    if (span->ntags > 0) {
+        if (PACK_KEY(pk, "meta") || msgpack_pack_map(pk, span->ntags))
+            return -1;
+        for (size_t i = 0; i < span->ntags; i++) {
+            if (msgpack_pack_unicode(pk, span->tag_keys[i], ITEM_LIMIT) ||
+                msgpack_pack_unicode(pk, span->tag_values[i], ITEM_LIMIT))
+                return -1;
+        }
+    }
+    if (span->nmetrics > 0) {
+        if (PACK_KEY(pk, "metrics") || msgpack_pack_map(pk, span->nmetrics))
+            return -1;
+        for (size_t i = 0; i < span->nmetrics; i++) {
+            if (msgpack_pack_unicode(pk, span->metric_keys[i], ITEM_LIMIT) ||
+                msgpack_pack_double(pk, span->metric_values[i]))
+                return -1;
+        }
+    }
+    return 0;
+}
+
+int
+bench_pack_traces_v03(bench_packer* pk, const bench_trace* traces, size_t n)
+{
+    if (msgpack_pack_array(&pk->pk, n))
+        return -1;
+
+    for (size_t i = 0; i < n; i++) {
+        if (msgpack_pack_array(&pk->pk, traces[i].nspans))
+            return -1;
+        for (size_t j = 0; j < traces[i].nspans; j++) {
+            if (pack_span_v03(&pk->pk, &traces[i].spans[j]))
+                return -1;
+        }
+    }
+    return 0;
+}
+
+// String table of the v0.5 payloads, keyed by the string objects like the tables of the encoders, whose strings
+// mostly come from the same objects.
+typedef struct string_table
+{
+    PyObject** keys;
+    uint32_t* ids;
+    size_t capacity;
+    uint32_t size;
+    msgpack_packer* pk;
+} string_table;
+
+static int
+string_table_init(string_table* table, msgpack_packer* pk)
+{
+    table->capacity = 1024;
+    table->keys = (PyObject**)PyMem_Calloc(table->capacity, sizeof(PyObject*));
+    table->ids = (uint32_t*)PyMem_Malloc(table->capacity * sizeof(uint32_t));
+    table->size = 0;
+    table->pk = pk;
+    return table->keys == NULL || table->ids == NULL ? -1 : 0;
+}
+
+static void
+string_table_free(string_table* table)
+{
+    PyMem_Free(table->keys);
+    PyMem_Free(table->ids);
+}
+
+static inline size_t
+string_table_slot(const string_table* table, PyObject* key)
+{
+    const size_t mask = table->capacity - 1;
+    size_t i = ((uintptr_t)key >> 4) & mask;
+    while (table->keys[i] != NULL && table->keys[i] != key)
+        i = (i + 1) & mask;
+    return i;
+}
+
+static int
+string_table_grow(string_table* table)
+{
+    PyObject** keys = table->keys;
+    uint32_t* ids = table->ids;
+    const size_t capacity = table->capacity;
+
+    table->capacity *= 2;
+    table->keys = (PyObject**)PyMem_Calloc(table->capacity, sizeof(PyObject*));
+    table->ids = (uint32_t*)PyMem_Malloc(table->capacity * sizeof(uint32_t));
+    if (table->keys == NULL || table->ids == NULL)
+        return -1;
+
+    for (size_t i = 0; i < capacity; i++) {
+        if (keys[i] != NULL) {
+            const size_t slot = string_table_slot(table, keys[i]);
+            table->keys[slot] = keys[i];
+            table->ids[slot] = ids[i];
+        }
+    }
+    PyMem_Free(keys);
+    PyMem_Free(ids);
+    return 0;
+}
+
+static inline int
+pack_string_v05(msgpack_packer* pk, string_table* table, PyObject* string)
+{
+    size_t slot = string_table_slot(table, string);
+    if (table->keys[slot] == NULL) {
+        if (msgpack_pack_unicode(table->pk, string, ITEM_LIMIT))
+            return -1;
+        if ((size_t)(table->size + 1) * 2 > table->capacity) {
+            if (string_table_grow(table))
+                return -1;
+            slot = string_table_slot(table, string);
+        }
+        table->keys[slot] = string;
+        table->ids[slot] = table->size++;
+    }
+    return msgpack_pack_uint32(pk, table->ids[slot]);
+}
+
+static int
+pack_span_v05(msgpack_packer* pk, string_table* table, const bench_span* span)
+{
+    if (msgpack_pack_array(pk, 12))
+        return -1;
+
+    if (pack_string_v05(pk, table, span->service) || pack_string_v05(pk, table, span->name) ||
+        pack_string_v05(pk, table, span->resource))
+        return -1;
+    // The ids, the times and the error, reserved at once like in _encoding.pyx
+    char* dst = msgpack_pack_reserve(pk, 6 * MSGPACK_MAX_NUMBER_SIZE);
+    if (!dst)
+        return -1;
+    char* end = msgpack_put_uint64(dst, span->trace_id);
+    end = msgpack_put_uint64(end, span->span_id);
+    end = msgpack_put_uint64(end, span->parent_id);
+    end = msgpack_put_int64(end, span->start_ns);
+    end = msgpack_put_int64(end, span->duration_ns);
+    end = msgpack_put_int64(end, span->error);
+    pk->length += end - dst;
+
+    if (msgpack_pack_map(pk, span->ntags))
+        return -1;
+    for (size_t i = 0; i < span->ntags; i++) {
+        if (pack_string_v05(pk, table, span->tag_keys[i]) || pack_string_v05(pk, table, span->tag_values[i]))
+            return -1;
+    }
+
+    if (msgpack_pack_map(pk, span->nmetrics))
+        return -1;
+    for (size_t i = 0; i < span->nmetrics; i++) {
+        if (pack_string_v05(pk, table, span->metric_keys[i]) || msgpack_pack_double(pk, span->metric_values[i]))
+            return -1;
+    }
+
+    if (span->span_type == NULL)
+        return msgpack_pack_uint32(pk, 0);
+    return pack_string_v05(pk, table, span->span_type);
+}
+
+int
+bench_pack_traces_v05(bench_packer* table_pk, bench_packer* pk, const bench_trace* traces, size_t n)
+{
+    string_table table;
+    int ret = string_table_init(&table, &table_pk->pk);
+
+    if (ret == 0)
+        ret = msgpack_pack_array(&pk->pk, n);
+
+    for (size_t i = 0; ret == 0 && i < n; i++) {
+        ret = msgpack_pack_array(&pk->pk, traces[i].nspans);
+        for (size_t j = 0; ret == 0 && j < traces[i].nspans; j++) {
+            ret = pack_span_v05(&pk->pk, &table, &traces[i].spans[j]);
+        }
+    }
+
+    string_table_free(&table);
+    return ret;
+}
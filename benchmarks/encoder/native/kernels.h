@@ -0,0 +1,63 @@
+#pragma once
+
+#include <Python.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Packing loops over pack.h, which is a C header. Each kernel packs a whole batch, so that the cost of calling it
+// from the benchmarks is negligible.
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    typedef struct bench_span
+    {
+        PyObject* service;
+        PyObject* name;
+        PyObject* resource;
+        PyObject* span_type; // NULL when the span has no type
+        uint64_t trace_id;
+        uint64_t span_id;
+        uint64_t parent_id;
+        int64_t start_ns;
+        int64_t duration_ns;
+        int32_t error;
+        size_t ntags;
+        PyObject** tag_keys;
+        PyObject** tag_values;
+        size_t nmetrics;
+        PyObject** metric_keys;
+        double* metric_values;
+    } bench_span;
+
+    typedef struct bench_trace
+    {
+        size_t nspans;
+        const bench_span* spans;
+    } bench_trace;
+
+    typedef struct bench_packer bench_packer;
+
+    bench_packer* bench_packer_new(size_t buf_size);
+    void bench_packer_free(bench_packer* pk);
+    void bench_packer_reset(bench_packer* pk);
+    size_t bench_packer_length(const bench_packer* pk);
+
+    int bench_pack_uint64(bench_packer* pk, const uint64_t* values, size_t n);
+    int bench_pack_int64(bench_packer* pk, const int64_t* values, size_t n);
+    int bench_pack_double(bench_packer* pk, const double* values, size_t n);
+    int bench_pack_map_headers(bench_packer* pk, const uint32_t* sizes, size_t n);
+    int bench_pack_raw(bench_packer* pk, const char* data, size_t length, size_t n);
+    int bench_pack_unicode(bench_packer* pk, PyObject* const* strings, size_t n);
+
+    // Pack the traces as a v0.3/v0.4 payload: an array of traces, each one an array of span maps
+    int bench_pack_traces_v03(bench_packer* pk, const bench_trace* traces, size_t n);
+
+    // Pack the traces as a v0.5 payload: the string table goes to table and the traces to pk
+    int bench_pack_traces_v05(bench_packer* table, bench_packer* pk, const bench_trace* traces, size_t n);
+
+#ifdef __cplusplus
+}
+#endif
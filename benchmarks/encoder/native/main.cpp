@@ -0,0 +1,21 @@
+#include <Python.h>
+
+#include <benchmark/benchmark.h>
+
+// The string objects of the benchmarks need the interpreter, which runs for the whole process
+int
+main(int argc, char** argv)
+{
+    Py_Initialize();
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+        Py_Finalize();
+        return 1;
+    }
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+
+    Py_Finalize();
+    return 0;
+}
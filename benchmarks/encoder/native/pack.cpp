@@ -0,0 +1,175 @@
+#include "kernels.h"
+#include "traces.h"
+#include "perf_counters.h"
+
+#include <benchmark/benchmark.h>
+
+#include <random>
+#include <vector>
+
+namespace {
+
+constexpr size_t BATCH = 1024;
+
+/**
+ * Packer reset before each batch, so that the benchmarks measure the packing and not the growth of the buffer.
+ */
+class Packer
+{
+  public:
+    Packer()
+      : pk_(bench_packer_new(1 << 20))
+    {
+    }
+    ~Packer() { bench_packer_free(pk_); }
+
+    Packer(const Packer&) = delete;
+    Packer& operator=(const Packer&) = delete;
+
+    bench_packer* get()
+    {
+        bench_packer_reset(pk_);
+        return pk_;
+    }
+
+  private:
+    bench_packer* pk_;
+};
+
+// Integers of all the widths of msgpack, the ids are 64 bits wide while the counts fit in a byte
+template<class T>
+std::vector<T>
+make_integers()
+{
+    std::mt19937_64 rng(42);
+    std::vector<T> values;
+    for (size_t i = 0; i < BATCH; i++) {
+        const unsigned bits = 1 + rng() % (sizeof(T) * 8 - 1);
+        values.push_back(static_cast<T>(rng() & ((uint64_t{ 1 } << bits) - 1)));
+    }
+    return values;
+}
+
+void
+finish(benchmark::State& state, bench_packer* pk)
+{
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * BATCH));
+    state.counters["bytes_per_item"] = static_cast<double>(bench_packer_length(pk)) / BATCH;
+}
+
+void
+BM_PackUInt64(benchmark::State& state)
+{
+    const auto values = make_integers<uint64_t>();
+    Packer packer;
+    bench_packer* pk = nullptr;
+    bench::PerfCountersScope perf_counters(state);
+    for (auto _ : state) {
+        pk = packer.get();
+        bench_pack_uint64(pk, values.data(), BATCH);
+        benchmark::ClobberMemory();
+    }
+    finish(state, pk);
+}
+BENCHMARK(BM_PackUInt64);
+
+void
+BM_PackInt64(benchmark::State& state)
+{
+    auto values = make_integers<int64_t>();
+    for (size_t i = 0; i < BATCH; i += 2) {
+        values[i] = -values[i];
+    }
+    Packer packer;
+    bench_packer* pk = nullptr;
+    bench::PerfCountersScope perf_counters(state);
+    for (auto _ : state) {
+        pk = packer.get();
+        bench_pack_int64(pk, values.data(), BATCH);
+        benchmark::ClobberMemory();
+    }
+    finish(state, pk);
+}
+BENCHMARK(BM_PackInt64);
+
+void
+BM_PackDouble(benchmark::State& state)
+{
+    std::mt19937_64 rng(42);
+    std::vector<double> values;
+    for (size_t i = 0; i < BATCH; i++) {
+        values.push_back(std::uniform_real_distribution<double>(0, 1000)(rng));
+    }
+    Packer packer;
+    bench_packer* pk = nullptr;
+    bench::PerfCountersScope perf_counters(state);
+    for (auto _ : state) {
+        pk = packer.get();
+        bench_pack_double(pk, values.data(), BATCH);
+        benchmark::ClobberMemory();
+    }
+    finish(state, pk);
+}
+BENCHMARK(BM_PackDouble);
+
+void
+BM_PackMapHeader(benchmark::State& state)
+{
+    auto values = make_integers<uint32_t>();
+    for (auto& value : values) {
+        value %= 100;
+    }
+    Packer packer;
+    bench_packer* pk = nullptr;
+    bench::PerfCountersScope perf_counters(state);
+    for (auto _ : state) {
+        pk = packer.get();
+        bench_pack_map_headers(pk, values.data(), BATCH);
+        benchmark::ClobberMemory();
+    }
+    finish(state, pk);
+}
+BENCHMARK(BM_PackMapHeader);
+
+void
+BM_PackRaw(benchmark::State& state)
+{
+    const std::vector<char> data(static_cast<size_t>(state.range(0)), 'x');
+    Packer packer;
+    bench_packer* pk = nullptr;
+    bench::PerfCountersScope perf_counters(state);
+    for (auto _ : state) {
+        pk = packer.get();
+        bench_pack_raw(pk, data.data(), data.size(), BATCH);
+        benchmark::ClobberMemory();
+    }
+    finish(state, pk);
+}
+BENCHMARK(BM_PackRaw)->Arg(8)->Arg(64)->Arg(512);
+
+void
+BM_PackUnicode(benchmark::State& state, StringKind kind)
+{
+    const auto strings = make_strings(kind, static_cast<size_t>(state.range(0)), BATCH);
+    Packer packer;
+    bench_packer* pk = nullptr;
+    bench::PerfCountersScope perf_counters(state);
+    for (auto _ : state) {
+        pk = packer.get();
+        if (bench_pack_unicode(pk, strings.data(), BATCH)) {
+            state.SkipWithError("msgpack_pack_unicode failed");
+            break;
+        }
+        benchmark::ClobberMemory();
+    }
+    finish(state, pk);
+    for (PyObject* string : strings) {
+        Py_DECREF(string);
+    }
+}
+BENCHMARK_CAPTURE(BM_PackUnicode, ascii, StringKind::ascii)->Arg(8)->Arg(64)->Arg(512);
+BENCHMARK_CAPTURE(BM_PackUnicode, latin1, StringKind::latin1)->Arg(8)->Arg(64)->Arg(512);
+BENCHMARK_CAPTURE(BM_PackUnicode, ucs2, StringKind::ucs2)->Arg(8)->Arg(64)->Arg(512);
+BENCHMARK_CAPTURE(BM_PackUnicode, astral, StringKind::astral)->Arg(8)->Arg(64)->Arg(512);
+
+} // namespace
@@ -0,0 +1,353 @@
+#include "traces.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+namespace {
+
+// Tag names of the integrations, the tags of a span are drawn from them
+const char* const TAG_KEYS[] = {
+    "component",         "span.kind",        "http.method",       "http.url",          "http.status_code",
+    "http.route",        "http.useragent",   "http.client_ip",    "network.client.ip", "out.host",
+    "out.port",          "peer.service",     "db.system",         "db.name",           "db.user",
+    "db.statement",      "db.row_count",     "sql.query",         "redis.raw_command", "cache.key",
+    "messaging.system",  "kafka.topic",      "kafka.partition",   "grpc.method.name",  "grpc.status.code",
+    "rpc.service",       "language",         "runtime-id",        "process_id",        "_dd.p.dm",
+    "_dd.p.tid",         "_dd.base_service", "_dd.origin",        "env",               "version",
+    "django.user.name",  "django.view",      "flask.endpoint",    "flask.url_rule",    "celery.task_name",
+    "celery.action",     "celery.id",        "error.type",        "error.message",     "error.stack",
+    "aws.region",        "aws.operation",    "aws.agent",         "aws.s3.bucket_name", "aws.sqs.queue_name",
+    "elasticsearch.url", "elasticsearch.method", "mongodb.collection", "mongodb.query", "graphql.operation.name",
+    "graphql.source",    "user.id",          "session.id",        "tenant",            "region",
+    "deployment",        "pod.name",         "container.id",      "host.hostname",
+};
+constexpr size_t NUM_TAG_KEYS = sizeof(TAG_KEYS) / sizeof(TAG_KEYS[0]);
+
+const char* const METRIC_KEYS[] = {
+    "_dd.measured", "_dd.top_level", "_sampling_priority_v1", "_dd.agent_psr", "_dd.rule_psr",
+    "_dd.limit_psr", "process_id",   "db.row_count",          "http.response.content_length",
+};
+constexpr size_t NUM_METRIC_KEYS = sizeof(METRIC_KEYS) / sizeof(METRIC_KEYS[0]);
+
+const char* const SERVICES[] = { "web-store", "auth-service", "postgres", "redis", "checkout", "kafka" };
+const char* const NAMES[] = { "django.request", "flask.request", "postgres.query", "redis.command",
+                              "requests.request", "celery.run",   "grpc.client",    "kafka.produce" };
+const char* const TYPES[] = { "web", "sql", "cache", "http", "worker" };
+
+const char ALPHABET[] = "abcdefghijklmnopqrstuvwxyz0123456789-_/.";
+
+class Generator
+{
+  public:
+    explicit Generator(uint64_t seed)
+      : rng_(seed)
+    {
+    }
+
+    size_t uniform(size_t n) { return std::uniform_int_distribution<size_t>(0, n - 1)(rng_); }
+    uint64_t id() { return std::uniform_int_distribution<uint64_t>(1, UINT64_MAX)(rng_); }
+    bool chance(double p) { return std::bernoulli_distribution(p)(rng_); }
+
+    // Most tag values are short identifiers, a few are URLs, queries or stacks of a few hundred bytes
+    size_t value_length()
+    {
+        const double length = std::lognormal_distribution<double>(2.5, 1.0)(rng_);
+        return std::clamp<size_t>(static_cast<size_t>(length), 1, 2048);
+    }
+
+    size_t span_count(size_t mean)
+    {
+        return 1 + std::geometric_distribution<size_t>(1.0 / static_cast<double>(mean))(rng_);
+    }
+
+    std::string ascii(size_t length)
+    {
+        std::string s(length, ' ');
+        for (auto& c : s) {
+            c = ALPHABET[uniform(sizeof(ALPHABET) - 1)];
+        }
+        return s;
+    }
+
+    std::string url(size_t length)
+    {
+        return "https://api.example.com/v2/" + ascii(std::max<size_t>(length, 8)) + "?page=" +
+               std::to_string(uniform(100));
+    }
+
+    // Code point in [first, last] appended in UTF-8
+    void append_code_point(std::string& s, uint32_t first, uint32_t last)
+    {
+        const auto c = static_cast<uint32_t>(first + uniform(last - first + 1));
+        if (c < 0x80) {
+            s += static_cast<char>(c);
+        } else if (c < 0x800) {
+            s += static_cast<char>(0xC0 | (c >> 6));
+            s += static_cast<char>(0x80 | (c & 0x3F));
+        } else if (c < 0x10000) {
+            s += static_cast<char>(0xE0 | (c >> 12));
+            s += static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+            s += static_cast<char>(0x80 | (c & 0x3F));
+        } else {
+            s += static_cast<char>(0xF0 | (c >> 18));
+            s += static_cast<char>(0x80 | ((c >> 12) & 0x3F));
+            s += static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+            s += static_cast<char>(0x80 | (c & 0x3F));
+        }
+    }
+
+    // Mostly ASCII text with accented letters, kept to Latin-1 so that Python stores it in one byte per character
+    std::string latin1(size_t length)
+    {
+        std::string s;
+        for (size_t i = 0; i < length; i++) {
+            if (chance(0.2)) {
+                append_code_point(s, 0xC0, 0xFF);
+            } else {
+                s += ALPHABET[uniform(26)];
+            }
+        }
+        return s;
+    }
+
+    std::string cjk(size_t length)
+    {
+        std::string s;
+        for (size_t i = 0; i < length; i++) {
+            append_code_point(s, 0x4E00, 0x9FFF);
+        }
+        return s;
+    }
+
+    std::string emoji(size_t length)
+    {
+        std::string s;
+        for (size_t i = 0; i < length; i++) {
+            if (chance(0.25)) {
+                append_code_point(s, 0x1F600, 0x1F64F);
+            } else {
+                s += ALPHABET[uniform(26)];
+            }
+        }
+        return s;
+    }
+
+  private:
+    std::mt19937_64 rng_;
+};
+
+struct ShapeParams
+{
+    size_t mean_spans;
+    size_t min_tags;
+    size_t max_tags;
+    size_t max_metrics;
+    double url_rate;
+    double latin1_rate;
+    double cjk_rate;
+    double error_rate;
+};
+
+ShapeParams
+shape_params(TraceShape shape)
+{
+    switch (shape) {
+        case TraceShape::batch:
+            return { 500, 1, 4, 2, 0.0, 0.0, 0.0, 0.001 };
+        case TraceShape::tag_heavy:
+            return { 5, 48, 64, 8, 0.05, 0.03, 0.01, 0.01 };
+        case TraceShape::web:
+        default:
+            return { 8, 6, 18, 4, 0.1, 0.03, 0.01, 0.02 };
+    }
+}
+
+} // namespace
+
+const char*
+trace_shape_name(TraceShape shape)
+{
+    switch (shape) {
+        case TraceShape::batch:
+            return "batch";
+        case TraceShape::tag_heavy:
+            return "tag_heavy";
+        case TraceShape::web:
+        default:
+            return "web";
+    }
+}
+
+PyObject*
+TraceSet::own(PyObject* string)
+{
+    objects_.push_back(string);
+    return string;
+}
+
+PyObject*
+TraceSet::own(const std::string& utf8)
+{
+    return own(PyUnicode_FromStringAndSize(utf8.data(), static_cast<Py_ssize_t>(utf8.size())));
+}
+
+TraceSet::TraceSet(const TraceShape shape, const size_t ntraces, const uint64_t seed)
+{
+    Generator gen(seed);
+    const ShapeParams params = shape_params(shape);
+
+    // The names come from the interned strings of the integrations, like the keys of the spans
+    std::vector<PyObject*> tag_keys;
+    for (const char* key : TAG_KEYS) {
+        tag_keys.push_back(own(PyUnicode_InternFromString(key)));
+    }
+    std::vector<PyObject*> metric_keys;
+    for (const char* key : METRIC_KEYS) {
+        metric_keys.push_back(own(PyUnicode_InternFromString(key)));
+    }
+    std::vector<PyObject*> services;
+    for (const char* service : SERVICES) {
+        services.push_back(own(PyUnicode_InternFromString(service)));
+    }
+    std::vector<PyObject*> names;
+    for (const char* name : NAMES) {
+        names.push_back(own(PyUnicode_InternFromString(name)));
+    }
+    std::vector<PyObject*> types;
+    for (const char* type : TYPES) {
+        types.push_back(own(PyUnicode_InternFromString(type)));
+    }
+
+    std::vector<size_t> trace_sizes;
+    for (size_t i = 0; i < ntraces; i++) {
+        trace_sizes.push_back(shape == TraceShape::batch ? params.mean_spans : gen.span_count(params.mean_spans));
+    }
+
+    size_t total = 0;
+    for (const auto size : trace_sizes) {
+        total += size;
+    }
+    spans_.reserve(total);
+
+    int64_t start_ns = 1700000000000000000;
+    for (const auto size : trace_sizes) {
+        const uint64_t trace_id = gen.id();
+        const uint64_t root_id = gen.id();
+        // Spans of a trace share the resource of the request
+        PyObject* resource = own("GET /api/v2/" + gen.ascii(gen.uniform(24) + 4));
+
+        for (size_t i = 0; i < size; i++) {
+            auto storage = std::make_unique<SpanStorage>();
+            const size_t ntags =
+                std::min(NUM_TAG_KEYS, params.min_tags + gen.uniform(params.max_tags - params.min_tags + 1));
+
+            // Distinct tag names within a span, as its tags are a dict
+            std::vector<size_t> keys(NUM_TAG_KEYS);
+            for (size_t k = 0; k < NUM_TAG_KEYS; k++) {
+                keys[k] = k;
+            }
+            for (size_t k = 0; k < ntags; k++) {
+                std::swap(keys[k], keys[k + gen.uniform(NUM_TAG_KEYS - k)]);
+                storage->tag_keys.push_back(tag_keys[keys[k]]);
+
+                const size_t length = gen.value_length();
+                std::string value;
+                if (gen.chance(params.url_rate)) {
+                    value = gen.url(length);
+                } else if (gen.chance(params.latin1_rate)) {
+                    value = gen.latin1(length);
+                } else if (gen.chance(params.cjk_rate)) {
+                    value = gen.cjk(length);
+                } else {
+                    value = gen.ascii(length);
+                }
+                storage->tag_values.push_back(own(value));
+            }
+
+            const size_t nmetrics = gen.uniform(params.max_metrics + 1);
+            for (size_t k = 0; k < nmetrics; k++) {
+                storage->metric_keys.push_back(metric_keys[(k * 3 + i) % NUM_METRIC_KEYS]);
+                storage->metric_values.push_back(static_cast<double>(gen.uniform(1000)) / 7.0);
+            }
+
+            bench_span span{};
+            span.service = services[gen.uniform(services.size())];
+            span.name = names[gen.uniform(names.size())];
+            span.resource = resource;
+            span.span_type = gen.chance(0.9) ? types[gen.uniform(types.size())] : nullptr;
+            span.trace_id = trace_id;
+            span.span_id = i == 0 ? root_id : gen.id();
+            span.parent_id = i == 0 ? 0 : root_id;
+            span.start_ns = start_ns + static_cast<int64_t>(gen.uniform(1000000));
+            span.duration_ns = static_cast<int64_t>(gen.uniform(50000000)) + 1000;
+            span.error = gen.chance(params.error_rate) ? 1 : 0;
+            span.ntags = storage->tag_keys.size();
+            span.tag_keys = storage->tag_keys.data();
+            span.tag_values = storage->tag_values.data();
+            span.nmetrics = storage->metric_keys.size();
+            span.metric_keys = storage->metric_keys.data();
+            span.metric_values = storage->metric_values.data();
+
+            spans_.push_back(span);
+            storage_.push_back(std::move(storage));
+        }
+        start_ns += 1000000000;
+    }
+
+    size_t offset = 0;
+    for (const auto size : trace_sizes) {
+        traces_.push_back(bench_trace{ size, spans_.data() + offset });
+        offset += size;
+    }
+}
+
+TraceSet::~TraceSet()
+{
+    for (PyObject* object : objects_) {
+        Py_XDECREF(object);
+    }
+}
+
+const char*
+string_kind_name(StringKind kind)
+{
+    switch (kind) {
+        case StringKind::latin1:
+            return "latin1";
+        case StringKind::ucs2:
+            return "ucs2";
+        case StringKind::astral:
+            return "astral";
+        case StringKind::ascii:
+        default:
+            return "ascii";
+    }
+}
+
+std::vector<PyObject*>
+make_strings(const StringKind kind, const size_t length, const size_t count, const uint64_t seed)
+{
+    Generator gen(seed);
+    std::vector<PyObject*> strings;
+    for (size_t i = 0; i < count; i++) {
+        std::string utf8;
+        switch (kind) {
+            case StringKind::latin1:
+                utf8 = gen.latin1(length);
+                break;
+            case StringKind::ucs2:
+                utf8 = gen.cjk(length);
+                break;
+            case StringKind::astral:
+                utf8 = gen.emoji(length);
+                break;
+            case StringKind::ascii:
+            default:
+                utf8 = gen.ascii(length);
+                break;
+        }
+        strings.push_back(PyUnicode_FromStringAndSize(utf8.data(), static_cast<Py_ssize_t>(utf8.size())));
+    }
+    return strings;
+}
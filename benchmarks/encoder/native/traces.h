@@ -0,0 +1,79 @@
+#pragma once
+
+#include "kernels.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * Shapes of the traces sent by applications, the span counts and the tag sizes follow the payloads seen in
+ * production:
+ *
+ * - web: requests of a web service, a few to a few dozen spans with a dozen tags, some of them URLs and SQL queries,
+ *   and a few non-ASCII values.
+ * - batch: long jobs with hundreds of spans of few tags.
+ * - tag_heavy: few spans carrying many tags, like the spans of the integrations of the AI products.
+ */
+enum class TraceShape
+{
+    web,
+    batch,
+    tag_heavy,
+};
+
+const char*
+trace_shape_name(TraceShape shape);
+
+/**
+ * Traces of a shape, generated from a fixed seed so that the runs are comparable. Owns the string objects of the
+ * spans, which must be created and released with the interpreter initialized.
+ */
+class TraceSet
+{
+  public:
+    TraceSet(TraceShape shape, size_t ntraces, uint64_t seed = 42);
+    ~TraceSet();
+
+    TraceSet(const TraceSet&) = delete;
+    TraceSet& operator=(const TraceSet&) = delete;
+
+    [[nodiscard]] const bench_trace* traces() const { return traces_.data(); }
+    [[nodiscard]] size_t size() const { return traces_.size(); }
+    [[nodiscard]] size_t num_spans() const { return spans_.size(); }
+
+  private:
+    struct SpanStorage
+    {
+        std::vector<PyObject*> tag_keys;
+        std::vector<PyObject*> tag_values;
+        std::vector<PyObject*> metric_keys;
+        std::vector<double> metric_values;
+    };
+
+    PyObject* own(PyObject* string);
+    PyObject* own(const std::string& utf8);
+
+    std::vector<PyObject*> objects_;
+    std::vector<std::unique_ptr<SpanStorage>> storage_;
+    std::vector<bench_span> spans_;
+    std::vector<bench_trace> traces_;
+};
+
+/**
+ * Strings of a kind, for the benchmarks of the packing of the strings.
+ */
+enum class StringKind
+{
+    ascii,
+    latin1,
+    ucs2,
+    astral,
+};
+
+const char*
+string_kind_name(StringKind kind);
+
+std::vector<PyObject*>
+make_strings(StringKind kind, size_t length, size_t count, uint64_t seed = 42);
@@ -0,0 +1,146 @@
+#pragma once
+
+// Hardware counters for the Google Benchmark suites of the native code, read with perf_event_open.
+//
+// Wall time is too noisy to judge micro-optimizations, so when DD_BENCH_PERF_COUNTERS is set to a non-empty value
+// other than 0, the benchmarks which open a PerfCountersScope report the instructions, cycles, cache misses and
+// branch misses per iteration as user counters. The counters follow the calling thread only, which fits the
+// threaded benchmarks: each thread opens its own group and Google Benchmark adds up the counters of the threads
+// before dividing by the iterations.
+//
+// The counters exclude the kernel, so they can be opened with the default perf_event_paranoid level of 2. Where they
+// can't be opened (another OS, a container without the capability, a VM without a virtual PMU), the benchmarks run
+// as usual, without the counters; the reason is printed once.
+
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cerrno>
+#endif
+
+namespace bench {
+
+class PerfCountersScope
+{
+  public:
+    // Open the counters right before the benchmark loop: everything between the construction and the destruction
+    // is counted, including the regions where the timing is paused
+    explicit PerfCountersScope(benchmark::State& state)
+      : state_(state)
+    {
+#if defined(__linux__)
+        if (!enabled()) {
+            return;
+        }
+        for (size_t i = 0; i < COUNT; i++) {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.size = sizeof(attr);
+            attr.config = EVENTS[i].config;
+            attr.disabled = i == 0;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+            const int fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, i == 0 ? -1 : fds_[0], 0));
+            if (fd < 0) {
+                warn_once(EVENTS[i].name, errno);
+                close_all();
+                return;
+            }
+            fds_[i] = fd;
+        }
+        ioctl(fds_[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(fds_[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#endif
+    }
+
+    ~PerfCountersScope()
+    {
+#if defined(__linux__)
+        if (fds_[0] < 0) {
+            return;
+        }
+        ioctl(fds_[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+
+        // nr, time_enabled, time_running, then the values in the order the events were added to the group
+        uint64_t data[3 + COUNT];
+        const ssize_t size = read(fds_[0], data, sizeof(data));
+        close_all();
+        if (size != static_cast<ssize_t>(sizeof(data)) || data[0] != COUNT || data[2] == 0) {
+            return;
+        }
+
+        // The group is scaled when it was multiplexed with other events
+        const double scale = static_cast<double>(data[1]) / static_cast<double>(data[2]);
+        for (size_t i = 0; i < COUNT; i++) {
+            state_.counters[EVENTS[i].name] =
+              benchmark::Counter(static_cast<double>(data[3 + i]) * scale, benchmark::Counter::kAvgIterations);
+        }
+#endif
+    }
+
+    PerfCountersScope(const PerfCountersScope&) = delete;
+    PerfCountersScope& operator=(const PerfCountersScope&) = delete;
+
+  private:
+#if defined(__linux__)
+    struct Event
+    {
+        const char* name;
+        uint64_t config;
+    };
+
+    static constexpr size_t COUNT = 4;
+    static constexpr Event EVENTS[COUNT] = {
+        { "instructions", PERF_COUNT_HW_INSTRUCTIONS },
+        { "cycles", PERF_COUNT_HW_CPU_CYCLES },
+        { "cache_misses", PERF_COUNT_HW_CACHE_MISSES },
+        { "branch_misses", PERF_COUNT_HW_BRANCH_MISSES },
+    };
+
+    static bool enabled()
+    {
+        static const bool value = [] {
+            const char* env = std::getenv("DD_BENCH_PERF_COUNTERS");
+            return env != nullptr && env[0] != '\0' && std::strcmp(env, "0") != 0;
+        }();
+        return value;
+    }
+
+    static void warn_once(const char* name, int error)
+    {
+        static std::atomic<bool> warned{ false };
+        if (!warned.exchange(true)) {
+            std::fprintf(stderr, "perf counters disabled, cannot open %s: %s\n", name, std::strerror(error));
+        }
+    }
+
+    void close_all()
+    {
+        for (int& fd : fds_) {
+            if (fd >= 0) {
+                close(fd);
+                fd = -1;
+            }
+        }
+    }
+
+    int fds_[COUNT] = { -1, -1, -1, -1 };
+#endif
+    benchmark::State& state_;
+};
+
+} // namespace bench
@@ -0,0 +1,55 @@
+import os
+import tempfile
+
+import bm
+import utils
+
+
+class Profiler(bm.Scenario):
+    workload = bm.var(type=str)
+    profiler_enabled = bm.var_bool()
+    stack_v2_enabled = bm.var_bool()
+    memory_enabled = bm.var_bool()
+    lock_enabled = bm.var_bool()
+    max_nframes = bm.var(type=int)
+
+    def run(self):
+        # The profiler settings are read when it is imported, so the environment is set first
+        if self.profiler_enabled:
+            os.environ.update(
+                {
+                    "DD_PROFILING_STACK_V2_ENABLED": str(self.stack_v2_enabled),
+                    "DD_PROFILING_MEMORY_ENABLED": str(self.memory_enabled),
+                    "DD_PROFILING_LOCK_ENABLED": str(self.lock_enabled),
+                    "DD_PROFILING_MAX_FRAMES": str(self.max_nframes),
+                    "DD_PROFILING_UPLOAD_INTERVAL": "10",
+                    # Profiles are written to files so that exporting them is measured without an agent
+                    "DD_PROFILING_OUTPUT_PPROF": os.path.join(tempfile.mkdtemp(), "profile"),
+                }
+            )
+
+        workload = utils.WORKLOADS[self.workload]()
+
+        profiler = None
+        if self.profiler_enabled:
+            from ddtrace.profiling import Profiler
+            from ddtrace.settings.profiling import config
+
+            if self.stack_v2_enabled and not config.stack.v2.enabled:
+                raise RuntimeError("The v2 stack profiler is not available")
+
+            profiler = Profiler()
+            profiler.start()
+
+        # Things profiled when they are created, like the locks, are created once the profiler is started
+        workload.setup()
+
+        def _(loops):
+            for _ in range(loops):
+                workload.run()
+
+        yield _
+
+        workload.teardown()
+        if profiler is not None:
+            profiler.stop(flush=False)
@@ -0,0 +1,122 @@
+import asyncio
+import threading
+
+
+# Depth of the stacks of the samples, so that the number of frames captured is up to max_nframes
+STACK_DEPTH = 128
+
+
+def _deep(depth, f):
+    if depth <= 0:
+        return f()
+    return _deep(depth - 1, f)
+
+
+def _fib(n):
+    return n if n < 2 else _fib(n - 1) + _fib(n - 2)
+
+
+class Workload(object):
+    def setup(self):
+        pass
+
+    def run(self):
+        raise NotImplementedError
+
+    def teardown(self):
+        pass
+
+
+class CPUBound(Workload):
+    """Pure Python computation in deep stacks"""
+
+    def run(self):
+        _deep(STACK_DEPTH, lambda: _fib(18))
+
+
+class IdleThreads(Workload):
+    """Computation in the main thread while many other threads are waiting, which are sampled too"""
+
+    nthreads = 100
+
+    def setup(self):
+        self.stop = threading.Event()
+        self.threads = [
+            threading.Thread(target=_deep, args=(STACK_DEPTH, self.stop.wait), daemon=True)
+            for _ in range(self.nthreads)
+        ]
+        for thread in self.threads:
+            thread.start()
+
+    def run(self):
+        _fib(18)
+
+    def teardown(self):
+        self.stop.set()
+        for thread in self.threads:
+            thread.join()
+
+
+class AsyncioFanOut(Workload):
+    """Requests fanned out to many concurrent tasks, which are sampled with the stacks of their thread"""
+
+    ntasks = 100
+
+    def setup(self):
+        self.loop = asyncio.new_event_loop()
+
+    async def task(self):
+        for _ in range(10):
+            await asyncio.sleep(0)
+        return _fib(10)
+
+    async def fan_out(self):
+        return await asyncio.gather(*(self.task() for _ in range(self.ntasks)))
+
+    def run(self):
+        self.loop.run_until_complete(self.fan_out())
+
+    def teardown(self):
+        self.loop.close()
+
+
+class AllocationHeavy(Workload):
+    """Allocation of many small objects, most of which are freed right away"""
+
+    def run(self):
+        kept = []
+        for i in range(1000):
+            item = {"id": i, "name": "item-%d" % i, "tags": [str(i)] * 4}
+            if i % 10 == 0:
+                kept.append(item)
+        return kept
+
+
+class LockHeavy(Workload):
+    """Locks acquired and released by several threads, with some contention"""
+
+    nthreads = 4
+
+    def setup(self):
+        self.locks = [threading.Lock() for _ in range(8)]
+
+    def _work(self):
+        for i in range(1000):
+            with self.locks[i % len(self.locks)]:
+                pass
+
+    def run(self):
+        threads = [threading.Thread(target=self._work) for _ in range(self.nthreads)]
+        for thread in threads:
+            thread.start()
+        for thread in threads:
+            thread.join()
+
+
+WORKLOADS = {
+    "cpu": CPUBound,
+    "idle-threads": IdleThreads,
+    "asyncio": AsyncioFanOut,
+    "alloc": AllocationHeavy,
+    "lock": LockHeavy,
+}
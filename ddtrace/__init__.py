@@ -3,6 +3,11 @@ import warnings
 
 LOADED_MODULES = frozenset(sys.modules.keys())
 
+# Find the native extensions in their bundle, if ddtrace was built with one, before any of them is imported
+from ddtrace.internal import _bundle
+
+_bundle.install()
+
 from ddtrace.internal.module import ModuleWatchdog
 
 ModuleWatchdog.install()
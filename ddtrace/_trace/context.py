@@ -10,6 +10,7 @@ from ddtrace._trace._span_link import SpanLink  # noqa:F401
 from ddtrace.constants import ORIGIN_KEY
 from ddtrace.constants import SAMPLING_PRIORITY_KEY
 from ddtrace.constants import USER_ID_KEY
+from ddtrace.internal._propagation import format_traceparent
 from ddtrace.internal.compat import NumericType
 from ddtrace.internal.constants import MAX_UINT_64BITS as _MAX_UINT_64BITS
 from ddtrace.internal.constants import W3C_TRACEPARENT_KEY
@@ -150,14 +151,13 @@ class Context(object):
             # if we don't have a span id or trace id value we can't build a valid traceparent
             return tp or ""
 
-        # determine the trace_id value
-        if tp:
-            # grab the original traceparent trace id, not the converted value
-            trace_id = tp.split("-")[1]
-        else:
-            trace_id = "{:032x}".format(self.trace_id)
-
-        return "00-{}-{:016x}-{}".format(trace_id, self.span_id, self._traceflags)
+        # grab the original traceparent trace id, not the converted value
+        return format_traceparent(
+            tp.split("-")[1] if tp else None,
+            self.trace_id,
+            self.span_id,
+            self._traceflags == "01",
+        )
 
     @property
     def _traceflags(self):
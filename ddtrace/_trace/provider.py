@@ -1,5 +1,5 @@
 import abc
-import contextvars
+import contextvars  # noqa:F401
 from typing import Any  # noqa:F401
 from typing import Callable  # noqa:F401
 from typing import Optional  # noqa:F401
@@ -8,15 +8,15 @@ from typing import Union  # noqa:F401
 from ddtrace import _hooks
 from ddtrace._trace.context import Context  # noqa:F401
 from ddtrace._trace.span import Span
+from ddtrace.internal import _active
 from ddtrace.internal.logger import get_logger
 
 
 log = get_logger(__name__)
 
 
-_DD_CONTEXTVAR = contextvars.ContextVar(
-    "datadog_contextvar", default=None
-)  # type: contextvars.ContextVar[Optional[Union[Context, Span]]]
+# Created natively, so that the default provider gets and sets it with the C API
+_DD_CONTEXTVAR = _active.contextvar  # type: contextvars.ContextVar[Optional[Union[Context, Span]]]
 
 
 class BaseContextProvider(metaclass=abc.ABCMeta):
@@ -107,7 +107,9 @@ class DefaultContextProvider(BaseContextProvider, DatadogContextMixin):
     """Context provider that retrieves contexts from a context variable.
 
     It is suitable for synchronous programming and for asynchronous executors
-    that support contextvars.
+    that support contextvars. The context variable is read and written
+    natively, which also records the span last activated on each thread for
+    the profiler.
     """
 
     def __init__(self):
@@ -117,19 +119,17 @@ class DefaultContextProvider(BaseContextProvider, DatadogContextMixin):
     def _has_active_context(self):
         # type: () -> bool
         """Returns whether there is an active context in the current execution."""
-        ctx = _DD_CONTEXTVAR.get()
-        return ctx is not None
+        return _active.get() is not None
 
     def activate(self, ctx):
         # type: (Optional[Union[Span, Context]]) -> None
         """Makes the given context active in the current execution."""
-        _DD_CONTEXTVAR.set(ctx)
+        _active.set(ctx)
         super(DefaultContextProvider, self).activate(ctx)
 
     def active(self):
         # type: () -> Optional[Union[Context, Span]]
         """Returns the active span or context for the current execution."""
-        item = _DD_CONTEXTVAR.get()
-        if isinstance(item, Span):
-            return self._update_active(item)
-        return item
+        # Same as _update_active, natively: a finished span is replaced by its closest unfinished parent, which is
+        # activated through self.activate
+        return _active.active(self)
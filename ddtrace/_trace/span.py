@@ -30,8 +30,9 @@ from ddtrace.constants import USER_REJECT
 from ddtrace.constants import VERSION_KEY
 from ddtrace.ext import http
 from ddtrace.ext import net
-from ddtrace.internal._rand import rand64bits as _rand64bits
-from ddtrace.internal._rand import rand128bits as _rand128bits
+from ddtrace.internal._encoding import TagMap
+from ddtrace.internal._rand import span_finish as _span_finish
+from ddtrace.internal._rand import span_start as _span_start
 from ddtrace.internal.compat import NumericType
 from ddtrace.internal.compat import StringIO
 from ddtrace.internal.compat import ensure_text
@@ -166,25 +167,20 @@ class Span(object):
         self._span_api = span_api
 
         # tags / metadata
-        self._meta = {}  # type: _MetaDictType
+        native_tags = config._trace_native_tag_maps
+        self._meta = TagMap() if native_tags else {}  # type: _MetaDictType
         self.error = 0
-        self._metrics = {}  # type: _MetricDictType
+        self._metrics = TagMap() if native_tags else {}  # type: _MetricDictType
 
         self._meta_struct: Dict[str, Dict[str, Any]] = {}
 
-        # timing
-        self.start_ns = time_ns() if start is None else int(start * 1e9)  # type: int
-        self.duration_ns = None  # type: Optional[int]
-
-        # tracing
-        if trace_id is not None:
-            self.trace_id = trace_id  # type: int
-        elif config._128_bit_trace_id_enabled:
-            self.trace_id = _rand128bits()
-        else:
-            self.trace_id = _rand64bits()
-        self.span_id = span_id or _rand64bits()  # type: int
-        self.parent_id = parent_id  # type: Optional[int]
+        # timing and tracing: sets start_ns, duration_ns, trace_id, span_id and parent_id in one native call
+        self.start_ns: int
+        self.duration_ns: Optional[int]
+        self.trace_id: int
+        self.span_id: int
+        self.parent_id: Optional[int]
+        _span_start(self, trace_id, span_id, parent_id, start, config._128_bit_trace_id_enabled)
         self._on_finish_callbacks = [] if on_finish is None else on_finish
 
         self._context = context._with_span(self) if context else None  # type: Optional[Context]
@@ -309,21 +305,16 @@ class Span(object):
 
         :param finish_time: The end time of the span, in seconds. Defaults to ``now``.
         """
-        if finish_time is None:
-            self._finish_ns(time_ns())
-        else:
-            self._finish_ns(int(finish_time * 1e9))
+        # The clock is read natively when the finish time isn't given
+        if _span_finish(self, None if finish_time is None else int(finish_time * 1e9)):
+            for cb in self._on_finish_callbacks:
+                cb(self)
 
     def _finish_ns(self, finish_time_ns):
         # type: (int) -> None
-        if self.duration_ns is not None:
-            return
-
-        # be defensive so we don't die if start isn't set
-        self.duration_ns = finish_time_ns - (self.start_ns or finish_time_ns)
-
-        for cb in self._on_finish_callbacks:
-            cb(self)
+        if _span_finish(self, finish_time_ns):
+            for cb in self._on_finish_callbacks:
+                cb(self)
 
     def _override_sampling_decision(self, decision):
         self.context.sampling_priority = decision
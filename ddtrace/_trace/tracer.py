@@ -159,7 +159,7 @@ def _default_span_processors_factory(
         span_processors.append(AppSecIastSpanProcessor())
 
     if compute_stats_enabled:
-        # Inline the import to avoid pulling in ddsketch or protobuf
+        # Inline the import to avoid loading the stats processor
         # when importing ddtrace.
         from ddtrace.internal.processor.stats import SpanStatsProcessorV06
 
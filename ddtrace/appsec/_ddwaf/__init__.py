@@ -14,6 +14,10 @@ LOGGER = get_logger(__name__)
 
 if asm_config._asm_libddwaf_available:
     try:
+        from .ddwaf_types import Arena
+        from .ddwaf_types import DDWAF_MAX_CONTAINER_DEPTH
+        from .ddwaf_types import DDWAF_MAX_CONTAINER_SIZE
+        from .ddwaf_types import DDWAF_MAX_STRING_LENGTH
         from .ddwaf_types import DDWafRulesType
         from .ddwaf_types import _observator
         from .ddwaf_types import ddwaf_config
@@ -21,6 +25,7 @@ if asm_config._asm_libddwaf_available:
         from .ddwaf_types import ddwaf_get_version
         from .ddwaf_types import ddwaf_object
         from .ddwaf_types import ddwaf_object_free
+        from .ddwaf_types import ddwaf_object_free_fn
         from .ddwaf_types import ddwaf_result
         from .ddwaf_types import ddwaf_run
         from .ddwaf_types import py_ddwaf_context_init
@@ -92,8 +97,11 @@ if _DDWAF_LOADED:
             obfuscation_parameter_key_regexp: bytes,
             obfuscation_parameter_value_regexp: bytes,
         ):
+            # The objects converted natively belong to the arenas of the context, so the WAF must not free them
             config = ddwaf_config(
-                key_regex=obfuscation_parameter_key_regexp, value_regex=obfuscation_parameter_value_regexp
+                key_regex=obfuscation_parameter_key_regexp,
+                value_regex=obfuscation_parameter_value_regexp,
+                free_fn=ddwaf_object_free if Arena is None else ddwaf_object_free_fn(),
             )
             diagnostics = ddwaf_object()
             ruleset_map_object = ddwaf_object.create_without_limits(ruleset_map)
@@ -167,9 +175,16 @@ if _DDWAF_LOADED:
 
             result = ddwaf_result()
             observator = _observator()
-            wrapper = ddwaf_object(data, observator=observator)
-            wrapper_ephemeral = ddwaf_object(ephemeral_data, observator=observator) if ephemeral_data else None
+            if ctx.persistent is None:
+                wrapper = ddwaf_object(data, observator=observator)
+                wrapper_ephemeral = ddwaf_object(ephemeral_data, observator=observator) if ephemeral_data else None
+            else:
+                wrapper = self._convert(ctx.persistent, self._unsent(ctx, data), observator)
+                wrapper_ephemeral = self._convert(ctx.ephemeral, ephemeral_data, observator) if ephemeral_data else None
             error = ddwaf_run(ctx.ctx, wrapper, wrapper_ephemeral, ctypes.byref(result), int(timeout_ms * 1000))
+            if ctx.ephemeral is not None:
+                # The WAF is done with the ephemeral addresses once the run is over
+                ctx.ephemeral.reset()
             if error < 0:
                 LOGGER.debug("run DDWAF error: %d\ninput %s\nerror %s", error, wrapper.struct, self.info.errors)
             return DDWaf_result(
@@ -182,6 +197,28 @@ if _DDWAF_LOADED:
                 result.derivatives.struct,
             )
 
+        @staticmethod
+        def _unsent(ctx: ddwaf_context_capsule, data: DDWafRulesType) -> DDWafRulesType:
+            """Drop the persistent addresses whose value was already sent to the context.
+
+            The WAF keeps the persistent addresses for the whole request, so the same value needs neither to be
+            converted again nor to be evaluated again. A value is sent again if it is another object.
+            """
+            if not isinstance(data, dict):
+                return data
+            sent = ctx.sent
+            unsent = {key: value for key, value in data.items() if key not in sent or sent[key] is not value}
+            sent.update(unsent)
+            return unsent
+
+        @staticmethod
+        def _convert(arena: Arena, data: DDWafRulesType, observator: _observator) -> ddwaf_object:
+            address, truncation = arena.convert(
+                data, DDWAF_MAX_CONTAINER_SIZE, DDWAF_MAX_CONTAINER_DEPTH, DDWAF_MAX_STRING_LENGTH
+            )
+            observator.truncation |= truncation
+            return ddwaf_object.from_address(address)
+
     def version() -> str:
         return ddwaf_get_version().decode("UTF-8")
 
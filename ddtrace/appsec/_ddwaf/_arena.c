@@ -0,0 +1,639 @@
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+/* Native conversion of the WAF addresses to ddwaf_object trees, and of the results of the WAF back to Python objects.
+
+   The trees are built directly in the memory of an arena, without a call into libddwaf per node, and with the same
+   types, limits and truncations as the ddwaf_object constructor of ddwaf_types.py. The arena owns all the memory of the
+   trees it converted, which is released in one go when it is reset or freed, so the WAF must be configured not to free
+   the objects it is given.
+
+   The results, like the schemas extracted for API security, are read as the struct property of ddwaf_object reads them,
+   without a ctypes access per field. */
+
+/* The layout of ddwaf_object in ddwaf.h */
+typedef struct _ddwaf_object ddwaf_object;
+
+struct _ddwaf_object
+{
+    const char* parameterName;
+    uint64_t parameterNameLength;
+    union
+    {
+        const char* stringValue;
+        uint64_t uintValue;
+        int64_t intValue;
+        ddwaf_object* array;
+        bool boolean;
+        double f64;
+    };
+    uint64_t nbEntries;
+    int type;
+};
+
+#define DDWAF_OBJ_SIGNED (1 << 0)
+#define DDWAF_OBJ_UNSIGNED (1 << 1)
+#define DDWAF_OBJ_STRING (1 << 2)
+#define DDWAF_OBJ_ARRAY (1 << 3)
+#define DDWAF_OBJ_MAP (1 << 4)
+#define DDWAF_OBJ_BOOL (1 << 5)
+#define DDWAF_OBJ_FLOAT (1 << 6)
+#define DDWAF_OBJ_NULL (1 << 7)
+
+/* The truncation flags of the observator */
+#define TRUNC_STRING_LENGTH 1
+#define TRUNC_CONTAINER_DEPTH 4
+#define TRUNC_CONTAINER_SIZE 2
+
+/* Most requests fit in a chunk or two. Larger allocations get a chunk of their own. */
+#define CHUNK_SIZE (16 * 1024)
+
+typedef struct chunk
+{
+    struct chunk* next;
+    size_t size;
+    size_t used;
+    char data[];
+} chunk_t;
+
+typedef struct
+{
+    PyObject_HEAD
+
+    /* The chunk being filled, which heads the list of all the chunks */
+    chunk_t* head;
+    size_t allocated;
+} Arena;
+
+static void*
+arena_alloc(Arena* self, size_t size)
+{
+    chunk_t* chunk;
+    void* ptr;
+
+    size = (size + 7) & ~(size_t)7;
+
+    if (self->head != NULL && self->head->size - self->head->used >= size) {
+        ptr = self->head->data + self->head->used;
+        self->head->used += size;
+        return ptr;
+    }
+
+    if (size > CHUNK_SIZE / 4) {
+        /* Kept behind the head, so that the room left in the head is still used */
+        if ((chunk = PyMem_RawMalloc(sizeof(chunk_t) + size)) == NULL) {
+            PyErr_NoMemory();
+            return NULL;
+        }
+        chunk->size = chunk->used = size;
+        if (self->head != NULL) {
+            chunk->next = self->head->next;
+            self->head->next = chunk;
+        } else {
+            chunk->next = NULL;
+            self->head = chunk;
+        }
+        self->allocated += size;
+        return chunk->data;
+    }
+
+    if ((chunk = PyMem_RawMalloc(sizeof(chunk_t) + CHUNK_SIZE)) == NULL) {
+        PyErr_NoMemory();
+        return NULL;
+    }
+    chunk->size = CHUNK_SIZE;
+    chunk->used = size;
+    chunk->next = self->head;
+    self->head = chunk;
+    self->allocated += CHUNK_SIZE;
+    return chunk->data;
+}
+
+static void
+arena_free(Arena* self)
+{
+    chunk_t* chunk = self->head;
+
+    while (chunk != NULL) {
+        chunk_t* next = chunk->next;
+        PyMem_RawFree(chunk);
+        chunk = next;
+    }
+    self->head = NULL;
+    self->allocated = 0;
+}
+
+/* Frees all the chunks but one, which is kept for the next conversions */
+static void
+arena_reset(Arena* self)
+{
+    chunk_t* keep = NULL;
+    chunk_t* chunk = self->head;
+
+    while (chunk != NULL) {
+        chunk_t* next = chunk->next;
+        if (keep == NULL && chunk->size == CHUNK_SIZE)
+            keep = chunk;
+        else
+            PyMem_RawFree(chunk);
+        chunk = next;
+    }
+    if (keep != NULL) {
+        keep->next = NULL;
+        keep->used = 0;
+    }
+    self->head = keep;
+    self->allocated = keep != NULL ? CHUNK_SIZE : 0;
+}
+
+typedef struct
+{
+    Arena* arena;
+    long long max_string_length;
+    long truncation;
+} converter_t;
+
+/* Copy a string to the arena, truncated to the limit, and up to its first null character, as libddwaf would copy it
+   from a C string */
+static int
+copy_string(converter_t* conv, const char* data, Py_ssize_t size, const char** out, uint64_t* length)
+{
+    long long limit = conv->max_string_length - 1;
+    const char* nul;
+    char* copy;
+
+    if (size > limit) {
+        conv->truncation |= TRUNC_STRING_LENGTH;
+        /* As the slice [:limit] would */
+        size = limit >= 0 ? (Py_ssize_t)limit : (size + limit > 0 ? (Py_ssize_t)(size + limit) : 0);
+    }
+    if ((nul = memchr(data, 0, (size_t)size)) != NULL)
+        size = nul - data;
+
+    if ((copy = arena_alloc(conv->arena, (size_t)size + 1)) == NULL)
+        return -1;
+    memcpy(copy, data, (size_t)size);
+    copy[size] = '\0';
+
+    *out = copy;
+    *length = (uint64_t)size;
+    return 0;
+}
+
+/* Copy the UTF-8 encoding of a str or the content of a bytes, dropping what can't be encoded */
+static int
+copy_text(converter_t* conv, PyObject* text, const char** out, uint64_t* length)
+{
+    PyObject* encoded;
+    int result;
+
+    if (PyBytes_Check(text))
+        return copy_string(conv, PyBytes_AS_STRING(text), PyBytes_GET_SIZE(text), out, length);
+
+#if PY_VERSION_HEX < 0x030c0000
+    if (PyUnicode_READY(text) < 0)
+        return -1;
+#endif
+    /* The ASCII strings are their own UTF-8 encoding */
+    if (PyUnicode_IS_ASCII(text))
+        return copy_string(conv, (const char*)PyUnicode_DATA(text), PyUnicode_GET_LENGTH(text), out, length);
+
+    if ((encoded = PyUnicode_AsEncodedString(text, "utf-8", "ignore")) == NULL)
+        return -1;
+    result = copy_string(conv, PyBytes_AS_STRING(encoded), PyBytes_GET_SIZE(encoded), out, length);
+    Py_DECREF(encoded);
+    return result;
+}
+
+static int
+convert(converter_t* conv, PyObject* obj, ddwaf_object* out, long long max_objects, long long max_depth);
+
+static int
+convert_string(converter_t* conv, PyObject* text, ddwaf_object* out)
+{
+    out->type = DDWAF_OBJ_STRING;
+    return copy_text(conv, text, &out->stringValue, &out->nbEntries);
+}
+
+static int
+convert_list(converter_t* conv, PyObject* list, ddwaf_object* out, long long max_objects, long long max_depth)
+{
+    Py_ssize_t i;
+    Py_ssize_t capacity;
+
+    if (max_depth <= 0) {
+        conv->truncation |= TRUNC_CONTAINER_DEPTH;
+        max_objects = 0;
+    }
+
+    out->type = DDWAF_OBJ_ARRAY;
+    out->array = NULL;
+    out->nbEntries = 0;
+
+    capacity = PyList_GET_SIZE(list) < max_objects ? PyList_GET_SIZE(list) : (Py_ssize_t)max_objects;
+    if (capacity > 0 && (out->array = arena_alloc(conv->arena, sizeof(ddwaf_object) * (size_t)capacity)) == NULL)
+        return -1;
+
+    /* The conversion of the items can run Python code, which could change the list */
+    for (i = 0; i < PyList_GET_SIZE(list); i++) {
+        PyObject* item;
+        int result;
+
+        if (i >= max_objects || i >= capacity) {
+            conv->truncation |= TRUNC_CONTAINER_SIZE;
+            break;
+        }
+
+        item = PyList_GET_ITEM(list, i);
+        Py_INCREF(item);
+        result = convert(conv, item, &out->array[i], max_objects, max_depth - 1);
+        Py_DECREF(item);
+        if (result < 0)
+            return -1;
+        out->nbEntries++;
+    }
+
+    return 0;
+}
+
+/* Add an entry to a map, whose keys that are neither str nor bytes are skipped, as they are by ddwaf_object */
+static int
+convert_entry(converter_t* conv,
+              PyObject* key,
+              PyObject* value,
+              Py_ssize_t index,
+              ddwaf_object* out,
+              Py_ssize_t* capacity,
+              long long max_objects,
+              long long max_depth,
+              int* stop)
+{
+    ddwaf_object* entry;
+
+    if (!PyUnicode_Check(key) && !PyBytes_Check(key))
+        return 0;
+
+    if (index >= max_objects) {
+        conv->truncation |= TRUNC_CONTAINER_SIZE;
+        *stop = 1;
+        return 0;
+    }
+
+    if ((Py_ssize_t)out->nbEntries == *capacity) {
+        /* Only the mappings whose items() yield more entries than their size get here */
+        Py_ssize_t grown = *capacity > 0 ? *capacity * 2 : 8;
+        ddwaf_object* array = arena_alloc(conv->arena, sizeof(ddwaf_object) * (size_t)grown);
+
+        if (array == NULL)
+            return -1;
+        if (out->nbEntries > 0)
+            memcpy(array, out->array, sizeof(ddwaf_object) * out->nbEntries);
+        out->array = array;
+        *capacity = grown;
+    }
+
+    entry = &out->array[out->nbEntries];
+    if (convert(conv, value, entry, max_objects, max_depth - 1) < 0 ||
+        copy_text(conv, key, &entry->parameterName, &entry->parameterNameLength) < 0)
+        return -1;
+    out->nbEntries++;
+
+    return 0;
+}
+
+static int
+convert_dict(converter_t* conv, PyObject* dict, ddwaf_object* out, long long max_objects, long long max_depth)
+{
+    Py_ssize_t capacity;
+    Py_ssize_t size;
+    Py_ssize_t index = 0;
+    int stop = 0;
+
+    if (max_depth <= 0) {
+        conv->truncation |= TRUNC_CONTAINER_DEPTH;
+        max_objects = 0;
+    }
+
+    out->type = DDWAF_OBJ_MAP;
+    out->array = NULL;
+    out->nbEntries = 0;
+
+    size = PyDict_GET_SIZE(dict);
+    capacity = size < max_objects ? size : (Py_ssize_t)max_objects;
+    if (capacity > 0 && (out->array = arena_alloc(conv->arena, sizeof(ddwaf_object) * (size_t)capacity)) == NULL)
+        return -1;
+
+    if (PyDict_CheckExact(dict)) {
+        Py_ssize_t pos = 0;
+        PyObject *key, *value;
+
+        while (!stop && PyDict_Next(dict, &pos, &key, &value)) {
+            int result;
+
+            Py_INCREF(key);
+            Py_INCREF(value);
+            result = convert_entry(conv, key, value, index++, out, &capacity, max_objects, max_depth, &stop);
+            Py_DECREF(key);
+            Py_DECREF(value);
+            if (result < 0)
+                return -1;
+            if (PyDict_GET_SIZE(dict) != size) {
+                PyErr_SetString(PyExc_RuntimeError, "dictionary changed size during iteration");
+                return -1;
+            }
+        }
+    } else {
+        /* The subclasses, like the multi-value dicts, can have items that differ from what they store */
+        PyObject* items = PyObject_CallMethod(dict, "items", NULL);
+        PyObject* iterator = items != NULL ? PyObject_GetIter(items) : NULL;
+        PyObject* item;
+
+        Py_XDECREF(items);
+        if (iterator == NULL)
+            return -1;
+
+        while (!stop && (item = PyIter_Next(iterator)) != NULL) {
+            int result = -1;
+
+            if (!PyTuple_Check(item) || PyTuple_GET_SIZE(item) != 2)
+                PyErr_SetString(PyExc_ValueError, "items() must yield pairs");
+            else
+                result = convert_entry(conv,
+                                       PyTuple_GET_ITEM(item, 0),
+                                       PyTuple_GET_ITEM(item, 1),
+                                       index++,
+                                       out,
+                                       &capacity,
+                                       max_objects,
+                                       max_depth,
+                                       &stop);
+            Py_DECREF(item);
+            if (result < 0) {
+                Py_DECREF(iterator);
+                return -1;
+            }
+        }
+        Py_DECREF(iterator);
+        if (PyErr_Occurred())
+            return -1;
+    }
+
+    return 0;
+}
+
+static int
+convert(converter_t* conv, PyObject* obj, ddwaf_object* out, long long max_objects, long long max_depth)
+{
+    out->parameterName = NULL;
+    out->parameterNameLength = 0;
+    out->nbEntries = 0;
+
+    if (PyBool_Check(obj)) {
+        out->type = DDWAF_OBJ_BOOL;
+        out->boolean = obj == Py_True;
+        return 0;
+    }
+
+    if (PyLong_Check(obj)) {
+        int overflow = 0;
+        long long value = PyLong_AsLongLongAndOverflow(obj, &overflow);
+
+        if (overflow)
+            /* Wrapped around, as ctypes converts the integers to int64_t */
+            value = (long long)PyLong_AsUnsignedLongLongMask(obj);
+        else if (value == -1 && PyErr_Occurred())
+            return -1;
+        out->type = DDWAF_OBJ_SIGNED;
+        out->intValue = value;
+        return 0;
+    }
+
+    if (PyUnicode_Check(obj) || PyBytes_Check(obj))
+        return convert_string(conv, obj, out);
+
+    if (PyFloat_Check(obj)) {
+        out->type = DDWAF_OBJ_FLOAT;
+        out->f64 = PyFloat_AS_DOUBLE(obj);
+        return 0;
+    }
+
+    if (PyList_Check(obj))
+        return convert_list(conv, obj, out, max_objects, max_depth);
+
+    if (PyDict_Check(obj))
+        return convert_dict(conv, obj, out, max_objects, max_depth);
+
+    if (obj != Py_None) {
+        PyObject* text = PyObject_Str(obj);
+        int result;
+
+        if (text == NULL)
+            return -1;
+        result = convert_string(conv, text, out);
+        Py_DECREF(text);
+        return result;
+    }
+
+    out->type = DDWAF_OBJ_NULL;
+    return 0;
+}
+
+/* Read a ddwaf_object as ddwaf_object.struct does. The nodes deeper than max_depth are read as None. */
+static PyObject*
+read_object(const ddwaf_object* obj, long long max_depth)
+{
+    uint64_t i;
+
+    switch (obj->type) {
+        case DDWAF_OBJ_STRING:
+            /* Up to the null character, as ctypes reads a c_char_p */
+            if (obj->stringValue == NULL)
+                return PyUnicode_FromStringAndSize("", 0);
+            return PyUnicode_DecodeUTF8(obj->stringValue, (Py_ssize_t)strlen(obj->stringValue), "ignore");
+
+        case DDWAF_OBJ_MAP: {
+            PyObject* dict;
+
+            if (max_depth <= 0)
+                Py_RETURN_NONE;
+            if ((dict = PyDict_New()) == NULL)
+                return NULL;
+            for (i = 0; i < obj->nbEntries; i++) {
+                const ddwaf_object* entry = &obj->array[i];
+                const char* name = entry->parameterName != NULL ? entry->parameterName : "";
+                PyObject* key = PyUnicode_DecodeUTF8(name, (Py_ssize_t)strlen(name), "ignore");
+                PyObject* value = key != NULL ? read_object(entry, max_depth - 1) : NULL;
+                int result = value != NULL ? PyDict_SetItem(dict, key, value) : -1;
+
+                Py_XDECREF(key);
+                Py_XDECREF(value);
+                if (result < 0) {
+                    Py_DECREF(dict);
+                    return NULL;
+                }
+            }
+            return dict;
+        }
+
+        case DDWAF_OBJ_ARRAY: {
+            PyObject* list;
+
+            if (max_depth <= 0)
+                Py_RETURN_NONE;
+            if ((list = PyList_New((Py_ssize_t)obj->nbEntries)) == NULL)
+                return NULL;
+            for (i = 0; i < obj->nbEntries; i++) {
+                PyObject* item = read_object(&obj->array[i], max_depth - 1);
+
+                if (item == NULL) {
+                    Py_DECREF(list);
+                    return NULL;
+                }
+                PyList_SET_ITEM(list, (Py_ssize_t)i, item);
+            }
+            return list;
+        }
+
+        case DDWAF_OBJ_SIGNED:
+            return PyLong_FromLongLong(obj->intValue);
+
+        case DDWAF_OBJ_UNSIGNED:
+            return PyLong_FromUnsignedLongLong(obj->uintValue);
+
+        case DDWAF_OBJ_BOOL:
+            return PyBool_FromLong(obj->boolean);
+
+        case DDWAF_OBJ_FLOAT:
+            return PyFloat_FromDouble(obj->f64);
+
+        default:
+            Py_RETURN_NONE;
+    }
+}
+
+static PyObject*
+to_python(PyObject* Py_UNUSED(module), PyObject* args)
+{
+    PyObject* address;
+    long long max_depth;
+    const ddwaf_object* obj;
+
+    if (!PyArg_ParseTuple(args, "OL:to_python", &address, &max_depth))
+        return NULL;
+
+    if ((obj = PyLong_AsVoidPtr(address)) == NULL) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_ValueError, "null ddwaf_object");
+        return NULL;
+    }
+
+    return read_object(obj, max_depth);
+}
+
+static PyObject*
+Arena_convert(Arena* self, PyObject* args)
+{
+    PyObject* obj;
+    long long max_objects, max_depth, max_string_length;
+    converter_t conv;
+    ddwaf_object* root;
+
+    if (!PyArg_ParseTuple(args, "OLLL:convert", &obj, &max_objects, &max_depth, &max_string_length))
+        return NULL;
+
+    conv.arena = self;
+    conv.max_string_length = max_string_length;
+    conv.truncation = 0;
+
+    if ((root = arena_alloc(self, sizeof(ddwaf_object))) == NULL)
+        return NULL;
+    if (convert(&conv, obj, root, max_objects, max_depth) < 0)
+        return NULL;
+
+    return Py_BuildValue("(Nl)", PyLong_FromVoidPtr(root), conv.truncation);
+}
+
+static PyObject*
+Arena_reset(Arena* self, PyObject* Py_UNUSED(args))
+{
+    arena_reset(self);
+    Py_RETURN_NONE;
+}
+
+static PyObject*
+Arena_get_allocated(Arena* self, void* Py_UNUSED(closure))
+{
+    return PyLong_FromSize_t(self->allocated);
+}
+
+static void
+Arena_dealloc(Arena* self)
+{
+    arena_free(self);
+    Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+static PyMethodDef Arena_methods[] = {
+    { "convert",
+      (PyCFunction)Arena_convert,
+      METH_VARARGS,
+      "Convert an object to a ddwaf_object in the arena, within the limits given, and return its address along with "
+      "the truncation flags" },
+    { "reset", (PyCFunction)Arena_reset, METH_NOARGS, "Release the memory of all the objects converted so far" },
+    { NULL, NULL, 0, NULL }
+};
+
+static PyGetSetDef Arena_getset[] = {
+    { "allocated", (getter)Arena_get_allocated, NULL, "The number of bytes held by the arena", NULL },
+    { NULL, NULL, NULL, NULL, NULL }
+};
+
+static PyTypeObject ArenaType = {
+    PyVarObject_HEAD_INIT(NULL, 0).tp_name = "ddtrace.appsec._ddwaf._arena.Arena",
+    .tp_doc = "Memory of the ddwaf_object trees sent to a WAF context",
+    .tp_basicsize = sizeof(Arena),
+    .tp_itemsize = 0,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_new = PyType_GenericNew,
+    .tp_dealloc = (destructor)Arena_dealloc,
+    .tp_methods = Arena_methods,
+    .tp_getset = Arena_getset,
+};
+
+static PyMethodDef arena_methods[] = {
+    { "to_python",
+      (PyCFunction)to_python,
+      METH_VARARGS,
+      "Read the ddwaf_object at the given address as a Python object, down to the given depth" },
+    { NULL, NULL, 0, NULL }
+};
+
+static struct PyModuleDef arena_module = {
+    PyModuleDef_HEAD_INIT, "ddtrace.appsec._ddwaf._arena", "native conversion of the WAF objects", -1, arena_methods
+};
+
+PyMODINIT_FUNC
+PyInit__arena(void)
+{
+    PyObject* m;
+
+    if (PyType_Ready(&ArenaType) < 0)
+        return NULL;
+
+    m = PyModule_Create(&arena_module);
+    if (m == NULL)
+        return NULL;
+
+    Py_INCREF(&ArenaType);
+    if (PyModule_AddObject(m, "Arena", (PyObject*)&ArenaType) < 0) {
+        Py_DECREF(&ArenaType);
+        Py_DECREF(m);
+        return NULL;
+    }
+
+    return m;
+}
@@ -0,0 +1,10 @@
+import typing as t
+
+class Arena:
+    allocated: int
+    def convert(
+        self, obj: t.Any, max_objects: int, max_depth: int, max_string_length: int
+    ) -> t.Tuple[int, int]: ...
+    def reset(self) -> None: ...
+
+def to_python(address: int, max_depth: int) -> t.Any: ...
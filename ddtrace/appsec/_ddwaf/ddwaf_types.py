@@ -12,6 +12,14 @@ from ddtrace.internal.logger import get_logger
 from ddtrace.settings.asm import config as asm_config
 
 
+try:
+    from ddtrace.appsec._ddwaf._arena import Arena
+    from ddtrace.appsec._ddwaf._arena import to_python
+except ImportError:
+    Arena = None  # type: ignore[assignment,misc]
+    to_python = None
+
+
 DDWafRulesType = Union[None, int, str, List[Any], Dict[str, Any]]
 
 log = get_logger(__name__)
@@ -180,6 +188,8 @@ class ddwaf_object(ctypes.Structure):
     @property
     def struct(self) -> DDWafRulesType:
         """Generate a python structure from ddwaf_object"""
+        if to_python is not None:
+            return to_python(ctypes.addressof(self), DDWAF_DEPTH_NO_LIMIT)
         if self.type == DDWAF_OBJ_TYPE.DDWAF_OBJ_STRING:
             return self.value.stringValue.decode("UTF-8", errors="ignore")
         if self.type == DDWAF_OBJ_TYPE.DDWAF_OBJ_MAP:
@@ -331,6 +341,11 @@ class ddwaf_context_capsule:
     def __init__(self, ctx: ddwaf_context) -> None:
         self.ctx = ctx
         self.free_fn = ddwaf_context_destroy
+        # When the addresses are converted natively, the context owns the memory of the objects sent to the WAF,
+        # which is released after the WAF context is destroyed, along with the persistent values already sent.
+        self.persistent = Arena() if Arena is not None else None
+        self.ephemeral = Arena() if Arena is not None else None
+        self.sent: Dict[str, Any] = {}
 
     def __del__(self):
         if self.ctx:
@@ -339,6 +354,8 @@ class ddwaf_context_capsule:
             except TypeError:
                 pass
             self.ctx = None
+        self.persistent = self.ephemeral = None
+        self.sent = {}
 
     def __bool__(self):
         return bool(self.ctx)
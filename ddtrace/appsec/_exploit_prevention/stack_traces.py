@@ -12,6 +12,12 @@ from ddtrace.settings.asm import config as asm_config
 import ddtrace.tracer
 
 
+try:
+    from ddtrace.appsec._iast._stacktrace import get_stack_frames
+except ImportError:
+    get_stack_frames = None
+
+
 # remove_top default value of 8
 # report_stack/_waf_action/waf_callable/call_waf_callback
 # wrapped_open/rasp/_wrap_call/patch_func
@@ -39,24 +45,37 @@ def report_stack(
     if asm_config._ep_max_stack_traces and len(exploit) >= asm_config._ep_max_stack_traces:
         return None
 
-    stack = inspect.stack()
-    if crop_stack is not None:
-        for i, frame in enumerate(stack):
-            if stack[i].frame.f_code.co_name == crop_stack:
-                stack = stack[i + 1 :]
-                break
     res: Dict[str, Any] = {
         "language": "python",
         "id": stack_id,
         "message": message,
     }
+    if get_stack_frames is not None:
+        res["frames"] = [
+            {"id": i, "function": function, "file": filename, "line": line}
+            for i, filename, function, line in get_stack_frames(crop_stack, asm_config._ep_max_stack_trace_depth)
+        ]
+    else:
+        res["frames"] = _stack_frames(crop_stack)
+    exploit.append(res)
+    appsec_traces["exploit"] = exploit
+    root_span.set_struct_tag(EXPLOIT_PREVENTION.STACK_TRACES, appsec_traces)
+
+
+def _stack_frames(crop_stack: Optional[str]) -> List[Dict[str, Any]]:
+    stack = inspect.stack(0)[1:]
+    if crop_stack is not None:
+        for i, frame in enumerate(stack):
+            if stack[i].frame.f_code.co_name == crop_stack:
+                stack = stack[i + 1 :]
+                break
     if asm_config._ep_max_stack_trace_depth and len(stack) > asm_config._ep_max_stack_trace_depth:
         top_stack = asm_config._ep_max_stack_trace_depth // 4
         bottom_stack = asm_config._ep_max_stack_trace_depth - top_stack
         iterator: Iterable[int] = chain(range(top_stack), range(len(stack) - bottom_stack, len(stack)))
     else:
         iterator = range(len(stack))
-    frames = [
+    return [
         {
             "id": i,
             "function": getattr(stack[i].frame.f_code, "co_qualname", stack[i].frame.f_code.co_name),
@@ -65,7 +84,3 @@ def report_stack(
         }
         for i in iterator
     ]
-    res["frames"] = frames
-    exploit.append(res)
-    appsec_traces["exploit"] = exploit
-    root_span.set_struct_tag(EXPLOIT_PREVENTION.STACK_TRACES, appsec_traces)
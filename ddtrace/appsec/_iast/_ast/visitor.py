@@ -65,6 +65,12 @@ _ASPECTS_SPEC: Dict[Text, Any] = {
         "split": "ddtrace_aspects.split_aspect",
         "rsplit": "ddtrace_aspects.rsplit_aspect",
         "splitlines": "ddtrace_aspects.splitlines_aspect",
+        # re.sub and Pattern.sub, the receiver being the re module or the pattern
+        "sub": "ddtrace_aspects.re_sub_aspect",
+        "subn": "ddtrace_aspects.re_subn_aspect",
+        "group": "ddtrace_aspects.re_group_aspect",
+        "groups": "ddtrace_aspects.re_groups_aspect",
+        "groupdict": "ddtrace_aspects.re_groupdict_aspect",
     },
     # Replacement function for indexes and ranges
     "slices": {
@@ -100,11 +100,11 @@ def _set_metric_iast_instrumented_sink(vulnerability_type, counter=1):
 
 
 @metric_verbosity(TELEMETRY_INFORMATION_VERBOSITY)
-def _set_metric_iast_executed_source(source_type):
+def _set_metric_iast_executed_source(source_type, counter=1):
     from ._taint_tracking._native.taint_tracking import origin_to_str  # noqa: F401
 
     telemetry.telemetry_writer.add_count_metric(
-        TELEMETRY_NAMESPACE_TAG_IAST, "executed.source", 1, (("source_type", origin_to_str(source_type)),)
+        TELEMETRY_NAMESPACE_TAG_IAST, "executed.source", counter, (("source_type", origin_to_str(source_type)),)
     )
 
 
@@ -62,19 +62,21 @@ def if_iast_taint_returned_object_for(origin, wrapped, instance, args, kwargs):
 
 def if_iast_taint_yield_tuple_for(origins, wrapped, instance, args, kwargs):
     if _is_iast_enabled():
-        from ._taint_tracking import taint_pyobject
+        from ._taint_tracking import taint_pyobjects
         from .processor import AppSecIastSpanProcessor
 
         if not AppSecIastSpanProcessor.is_span_analyzed():
             for key, value in wrapped(*args, **kwargs):
                 yield key, value
         else:
+            # Taint all the pairs in a single call
+            to_taint = []
             for key, value in wrapped(*args, **kwargs):
-                new_key = taint_pyobject(pyobject=key, source_name=key, source_value=key, source_origin=origins[0])
-                new_value = taint_pyobject(
-                    pyobject=value, source_name=key, source_value=value, source_origin=origins[1]
-                )
-                yield new_key, new_value
+                to_taint.append((key, key, origins[0]))
+                to_taint.append((value, key, origins[1]))
+            tainted = iter(taint_pyobjects(to_taint))
+            for new_key in tainted:
+                yield new_key, next(tainted)
 
     else:
         for key, value in wrapped(*args, **kwargs):
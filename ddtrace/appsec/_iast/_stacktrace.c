@@ -3,17 +3,41 @@
 #include <patchlevel.h>
 
 #ifdef _WIN32
-#define DD_TRACE_INSTALLED_PREFIX "\\ddtrace\\"
-#define TESTS_PREFIX "\\tests\\"
-#define SITE_PACKAGES_PREFIX "\\site-packages\\"
+#include <windows.h>
 #else
-#define DD_TRACE_INSTALLED_PREFIX "/ddtrace/"
-#define TESTS_PREFIX "/tests/"
-#define SITE_PACKAGES_PREFIX "/site-packages/"
+#include <time.h>
 #endif
 
-#if PY_MAJOR_VERSION == 3 && PY_MINOR_VERSION >= 11
+#ifdef _WIN32
+#define PATH_SEPARATOR '\\'
+#else
+#define PATH_SEPARATOR '/'
+#endif
+
+#if PY_VERSION_HEX >= 0x030B0000 && PY_VERSION_HEX < 0x030D0000
 #include <internal/pycore_frame.h>
+/* The interpreter frames are walked without creating their frame objects, see PyFrame_GetBack() */
+typedef _PyInterpreterFrame stack_frame_t;
+static inline _PyInterpreterFrame*
+first_complete_frame(_PyInterpreterFrame* frame)
+{
+    while (frame && _PyFrame_IsIncomplete(frame)) {
+        frame = frame->previous;
+    }
+    return frame;
+}
+#define GET_LINENO(frame) PyCode_Addr2Line(frame->f_code, _PyInterpreterFrame_LASTI(frame) * sizeof(_Py_CODEUNIT))
+#define GET_FRAME(tstate) first_complete_frame(tstate->cframe->current_frame)
+#define GET_PREVIOUS(frame) first_complete_frame(frame->previous)
+#define GET_FILENAME(frame) frame->f_code->co_filename
+#define FRAME_DECREF(frame)
+#define FRAME_XDECREF(frame)
+#define FILENAME_DECREF(filename)
+#define FILENAME_XDECREF(filename)
+#define GET_CODE(frame) frame->f_code
+#define CODE_DECREF(code)
+#elif PY_MAJOR_VERSION == 3 && PY_MINOR_VERSION >= 11
+typedef PyFrameObject stack_frame_t;
 #define GET_LINENO(frame) PyFrame_GetLineNumber((PyFrameObject*)frame)
 #define GET_FRAME(tstate) PyThreadState_GetFrame(tstate)
 #define GET_PREVIOUS(frame) PyFrame_GetBack(frame)
@@ -23,6 +47,8 @@
 #define FILENAME_XDECREF(filename)                                                                                     \
     if (filename)                                                                                                      \
     Py_DecRef(filename)
+#define GET_CODE(frame) PyFrame_GetCode(frame)
+#define CODE_DECREF(code) Py_DecRef((PyObject*)code)
 static inline PyObject*
 GET_FILENAME(PyFrameObject* frame)
 {
@@ -30,11 +56,13 @@ GET_FILENAME(PyFrameObject* frame)
     if (!code) {
         return NULL;
     }
-    PyObject* filename = PyObject_GetAttrString((PyObject*)code, "co_filename");
-    Py_DecRef(code);
+    PyObject* filename = code->co_filename;
+    Py_IncRef(filename);
+    Py_DecRef((PyObject*)code);
     return filename;
 }
 #else
+typedef PyFrameObject stack_frame_t;
 #define GET_FRAME(tstate) tstate->frame
 #define GET_PREVIOUS(frame) frame->f_back
 #define GET_FILENAME(frame) frame->f_code->co_filename
@@ -42,6 +70,8 @@ GET_FILENAME(PyFrameObject* frame)
 #define FRAME_XDECREF(frame)
 #define FILENAME_DECREF(filename)
 #define FILENAME_XDECREF(filename)
+#define GET_CODE(frame) frame->f_code
+#define CODE_DECREF(code)
 #if PY_MAJOR_VERSION >= 3 && PY_MINOR_VERSION >= 10
 /* See: https://bugs.python.org/issue44964 */
 #define GET_LINENO(frame) PyCode_Addr2Line(frame->f_code, frame->f_lasti * 2)
@@ -50,16 +80,201 @@ GET_FILENAME(PyFrameObject* frame)
 #endif
 #endif
 
+// Number of the classifications of filenames which are cached, a power of 2
+#define USER_CODE_CACHE_SIZE 1024
+
+// A filename, referenced, and whether the frames of the file are user code
+typedef struct
+{
+    PyObject* filename;
+    int user_code;
+} user_code_entry_t;
+
+// Direct-mapped, for the current working directory
+static user_code_entry_t user_code_cache[USER_CODE_CACHE_SIZE];
+static PyObject* user_code_cwd = NULL;
+static PyObject* user_code_cwd_bytes = NULL;
+
+static void
+clear_user_code_cache(void)
+{
+    for (size_t i = 0; i < USER_CODE_CACHE_SIZE; i++) {
+        Py_CLEAR(user_code_cache[i].filename);
+    }
+}
+
+// Whether the path has a directory of that name
+static int
+has_directory(const char* path, size_t size, const char* name)
+{
+    size_t name_size = strlen(name);
+    const char* end = path + size;
+
+    for (const char* separator = memchr(path, PATH_SEPARATOR, size); separator != NULL;
+         separator = memchr(separator + 1, PATH_SEPARATOR, end - separator - 1)) {
+        const char* directory = separator + 1;
+        if ((size_t)(end - directory) > name_size && directory[name_size] == PATH_SEPARATOR &&
+            memcmp(directory, name, name_size) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * classify_filename
+ *
+ * Whether a file is user code: it's under the current working directory and
+ * neither in ddtrace (except its tests) nor in site-packages.
+ **/
+static int
+classify_filename(const char* filename, size_t size, const char* cwd, size_t cwd_size)
+{
+    if (size <= cwd_size || memcmp(filename, cwd, cwd_size) != 0 ||
+        (cwd_size > 0 && cwd[cwd_size - 1] != PATH_SEPARATOR && filename[cwd_size] != PATH_SEPARATOR)) {
+        return 0;
+    }
+    if (has_directory(filename, size, "site-packages")) {
+        return 0;
+    }
+    return !has_directory(filename, size, "ddtrace") || has_directory(filename, size, "tests");
+}
+
 /**
- * get_file_and_line
+ * is_user_code
+ *
+ * Whether the frames of a file are user code, i.e. the file is in the current
+ * working directory and neither in ddtrace (except its tests) nor in site-packages.
+ * The classification is cached per filename object, which is shared by all the
+ * code objects of a module, so that walking the stack is mostly pointer comparisons.
+ *
+ * @return 1 for user code, 0 otherwise and -1 on error.
+ **/
+static int
+is_user_code(PyObject* filename_o, PyObject* cwd_obj)
+{
+    if (cwd_obj != user_code_cwd) {
+        int same = user_code_cwd != NULL ? PyObject_RichCompareBool(cwd_obj, user_code_cwd, Py_EQ) : 0;
+        if (same < 0) {
+            return -1;
+        }
+        if (!same) {
+            PyObject* cwd_bytes = NULL;
+            if (!PyUnicode_FSConverter(cwd_obj, &cwd_bytes)) {
+                return -1;
+            }
+            Py_XDECREF(user_code_cwd_bytes);
+            user_code_cwd_bytes = cwd_bytes;
+            clear_user_code_cache();
+        }
+        Py_IncRef(cwd_obj);
+        Py_XDECREF(user_code_cwd);
+        user_code_cwd = cwd_obj;
+    }
+
+    uintptr_t address = (uintptr_t)filename_o;
+    user_code_entry_t* entry = &user_code_cache[((address >> 4) ^ (address >> 14)) & (USER_CODE_CACHE_SIZE - 1)];
+    if (entry->filename == filename_o) {
+        return entry->user_code;
+    }
+
+    Py_ssize_t size;
+    const char* filename = PyUnicode_AsUTF8AndSize(filename_o, &size);
+    if (!filename) {
+        return -1;
+    }
+    int user_code = classify_filename(
+      filename, (size_t)size, PyBytes_AS_STRING(user_code_cwd_bytes), (size_t)PyBytes_GET_SIZE(user_code_cwd_bytes));
+
+    Py_IncRef(filename_o);
+    Py_XDECREF(entry->filename);
+    entry->filename = filename_o;
+    entry->user_code = user_code;
+    return user_code;
+}
+
+// Number of the locations of recently reported vulnerabilities which are remembered, a power of 2
+#define REPORTED_LOCATIONS_SIZE 1024
+
+// A vulnerability type reported from a line of a code object, both referenced
+typedef struct
+{
+    PyObject* vulnerability_type;
+    PyObject* code;
+    int line;
+    double reported_at;
+} reported_location_t;
+
+// Direct-mapped: a location takes the slot of the one it collides with, which may then be reported again
+static reported_location_t reported_locations[REPORTED_LOCATIONS_SIZE];
+
+static double
+monotonic_seconds(void)
+{
+#ifdef _WIN32
+    return (double)GetTickCount64() / 1000.0;
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+#endif
+}
+
+/**
+ * was_reported
+ *
+ * Whether a vulnerability of the type was reported from the line of the code
+ * object less than time_lapse seconds ago. If it wasn't, the location is
+ * remembered as reported now. Checked on the frame found by the stack walk,
+ * before the location and the evidence of the vulnerability are built.
+ *
+ * @return 1 if it was, 0 if it wasn't and -1 on error.
+ **/
+static int
+was_reported(PyObject* vulnerability_type, PyObject* code, int line, double time_lapse)
+{
+    Py_hash_t type_hash = PyObject_Hash(vulnerability_type);
+    if (type_hash == -1) {
+        return -1;
+    }
+    uint64_t hash = ((uint64_t)type_hash ^ ((uint64_t)(uintptr_t)code >> 4) ^ ((uint64_t)line << 32)) *
+                    0x9E3779B97F4A7C15ULL;
+    reported_location_t* location = &reported_locations[(hash >> 32) & (REPORTED_LOCATIONS_SIZE - 1)];
+    double now = monotonic_seconds();
+
+    if (location->code == code && location->line == line && location->vulnerability_type != NULL) {
+        int same_type = PyObject_RichCompareBool(location->vulnerability_type, vulnerability_type, Py_EQ);
+        if (same_type < 0) {
+            return -1;
+        }
+        if (same_type && now <= location->reported_at + time_lapse) {
+            return 1;
+        }
+    }
+
+    Py_IncRef(vulnerability_type);
+    Py_IncRef(code);
+    Py_XDECREF(location->vulnerability_type);
+    Py_XDECREF(location->code);
+    location->vulnerability_type = vulnerability_type;
+    location->code = code;
+    location->line = line;
+    location->reported_at = now;
+    return 0;
+}
+
+/**
+ * find_file_and_line
  *
  * Get the filename (path + filename) and line number of the original wrapped
- *function to report it.
+ * function to report it. With a vulnerability type, returns None instead when
+ * a vulnerability of the type was reported from the same location less than
+ * time_lapse seconds ago.
  *
- * @return Tuple, string and integer.
+ * @return Tuple, string and integer, or None.
  **/
 static PyObject*
-get_file_and_line(PyObject* Py_UNUSED(module), PyObject* cwd_obj)
+find_file_and_line(PyObject* cwd_obj, PyObject* vulnerability_type, double time_lapse)
 {
     PyThreadState* tstate = PyThreadState_Get();
     if (!tstate) {
@@ -69,18 +284,8 @@ get_file_and_line(PyObject* Py_UNUSED(module), PyObject* cwd_obj)
     int line;
     PyObject* filename_o = NULL;
     PyObject* result = NULL;
-    PyObject* cwd_bytes = NULL;
-    char* cwd = NULL;
 
-    if (!PyUnicode_FSConverter(cwd_obj, &cwd_bytes)) {
-        goto exit_0;
-    }
-    cwd = PyBytes_AsString(cwd_bytes);
-    if (!cwd) {
-        goto exit_0;
-    }
-
-    PyFrameObject* frame = GET_FRAME(tstate);
+    stack_frame_t* frame = GET_FRAME(tstate);
     if (!frame) {
         goto exit_0;
     }
@@ -90,10 +295,14 @@ get_file_and_line(PyObject* Py_UNUSED(module), PyObject* cwd_obj)
         if (!filename_o) {
             goto exit;
         }
-        const char* filename = PyUnicode_AsUTF8(filename_o);
-        if (((strstr(filename, DD_TRACE_INSTALLED_PREFIX) != NULL && strstr(filename, TESTS_PREFIX) == NULL)) ||
-            (strstr(filename, SITE_PACKAGES_PREFIX) != NULL || strstr(filename, cwd) == NULL)) {
-            PyFrameObject* prev_frame = GET_PREVIOUS(frame);
+        int user_code = is_user_code(filename_o, cwd_obj);
+        if (user_code < 0) {
+            PyErr_Clear();
+            FILENAME_DECREF(filename_o);
+            goto exit_0;
+        }
+        if (!user_code) {
+            stack_frame_t* prev_frame = GET_PREVIOUS(frame);
             FRAME_DECREF(frame);
             FILENAME_DECREF(filename_o);
             frame = prev_frame;
@@ -104,6 +313,21 @@ get_file_and_line(PyObject* Py_UNUSED(module), PyObject* cwd_obj)
          you need to call PyCode_Addr2Line().
         */
         line = GET_LINENO(frame);
+        if (vulnerability_type != NULL) {
+            PyCodeObject* code = GET_CODE(frame);
+            int reported = code != NULL ? was_reported(vulnerability_type, (PyObject*)code, line, time_lapse) : 0;
+            if (code != NULL) {
+                CODE_DECREF(code);
+            }
+            if (reported < 0) {
+                // Not deduplicated then
+                PyErr_Clear();
+            } else if (reported) {
+                Py_IncRef(Py_None);
+                result = Py_None;
+                break;
+            }
+        }
         PyObject* line_obj = Py_BuildValue("i", line);
         if (!line_obj) {
             goto exit;
@@ -116,7 +340,6 @@ get_file_and_line(PyObject* Py_UNUSED(module), PyObject* cwd_obj)
     }
 
 exit:
-    Py_DecRef(cwd_bytes);
     FRAME_XDECREF(frame);
     FILENAME_XDECREF(filename_o);
     return result;
@@ -126,15 +349,152 @@ exit_0:; // fix: "a label can only be part of a statement and a declaration is n
     PyObject* line_obj = Py_BuildValue("i", -1);
     filename_o = PyUnicode_FromString("");
     result = PyTuple_Pack(2, filename_o, line_obj);
-    Py_DecRef(cwd_bytes);
     FRAME_XDECREF(frame);
     FILENAME_XDECREF(filename_o);
     Py_DecRef(line_obj);
     return result;
 }
 
+static PyObject*
+get_file_and_line(PyObject* Py_UNUSED(module), PyObject* cwd_obj)
+{
+    return find_file_and_line(cwd_obj, NULL, 0);
+}
+
+static PyObject*
+get_file_and_line_if_not_reported(PyObject* Py_UNUSED(module), PyObject* args)
+{
+    PyObject* cwd_obj;
+    PyObject* vulnerability_type;
+    double time_lapse;
+
+    if (!PyArg_ParseTuple(args, "OOd", &cwd_obj, &vulnerability_type, &time_lapse)) {
+        return NULL;
+    }
+    return find_file_and_line(cwd_obj, vulnerability_type, time_lapse);
+}
+
+static PyObject*
+reset_reported_locations(PyObject* Py_UNUSED(module), PyObject* Py_UNUSED(args))
+{
+    for (size_t i = 0; i < REPORTED_LOCATIONS_SIZE; i++) {
+        Py_CLEAR(reported_locations[i].vulnerability_type);
+        Py_CLEAR(reported_locations[i].code);
+    }
+    Py_RETURN_NONE;
+}
+
+#if PY_VERSION_HEX >= 0x030B0000
+#define GET_FUNCTION_NAME(code) (code)->co_qualname
+#else
+#define GET_FUNCTION_NAME(code) (code)->co_name
+#endif
+
+/**
+ * get_stack_frames
+ *
+ * The frames of the current thread, from the caller outwards, as (id, filename,
+ * function, line) tuples sharing the strings of the code objects. With a crop
+ * name, the frames up to the first one of a function of that name are dropped.
+ * With a max depth, only the innermost quarter and the outermost three quarters
+ * of that many frames are kept, with their ids in the whole (cropped) stack.
+ *
+ * The stack is walked twice, once to find its depth and where it's cropped, so
+ * that no more frames than returned are ever held.
+ *
+ * @return List of tuples.
+ **/
+static PyObject*
+get_stack_frames(PyObject* Py_UNUSED(module), PyObject* args)
+{
+    PyObject* crop_name;
+    Py_ssize_t max_depth;
+
+    if (!PyArg_ParseTuple(args, "On", &crop_name, &max_depth)) {
+        return NULL;
+    }
+    if (crop_name != Py_None && !PyUnicode_Check(crop_name)) {
+        PyErr_SetString(PyExc_TypeError, "crop name must be a str or None");
+        return NULL;
+    }
+
+    PyThreadState* tstate = PyThreadState_Get();
+    Py_ssize_t depth = 0;
+    Py_ssize_t start = 0;
+
+    for (stack_frame_t* frame = GET_FRAME(tstate); frame != NULL; depth++) {
+        if (crop_name != Py_None && start == 0) {
+            PyCodeObject* code = GET_CODE(frame);
+            if (code != NULL) {
+                if (PyUnicode_Compare(code->co_name, crop_name) == 0) {
+                    start = depth + 1;
+                }
+                CODE_DECREF(code);
+            }
+        }
+        stack_frame_t* prev_frame = GET_PREVIOUS(frame);
+        FRAME_DECREF(frame);
+        frame = prev_frame;
+    }
+    if (PyErr_Occurred()) {
+        return NULL;
+    }
+
+    Py_ssize_t count = depth - start;
+    Py_ssize_t top = count;
+    Py_ssize_t outer = count;
+    if (max_depth > 0 && count > max_depth) {
+        top = max_depth / 4;
+        outer = count - (max_depth - top);
+    }
+
+    PyObject* frames = PyList_New(0);
+    if (frames == NULL) {
+        return NULL;
+    }
+
+    stack_frame_t* frame = GET_FRAME(tstate);
+    for (Py_ssize_t i = 0; frame != NULL && i < depth; i++) {
+        Py_ssize_t id = i - start;
+        if (id >= 0 && (id < top || id >= outer)) {
+            PyCodeObject* code = GET_CODE(frame);
+            PyObject* item =
+              code != NULL ? Py_BuildValue("(nOOi)", id, code->co_filename, GET_FUNCTION_NAME(code), GET_LINENO(frame))
+                           : NULL;
+            if (code != NULL) {
+                CODE_DECREF(code);
+            }
+            if (item == NULL || PyList_Append(frames, item) < 0) {
+                Py_XDECREF(item);
+                FRAME_DECREF(frame);
+                Py_DECREF(frames);
+                return NULL;
+            }
+            Py_DECREF(item);
+        }
+        stack_frame_t* prev_frame = GET_PREVIOUS(frame);
+        FRAME_DECREF(frame);
+        frame = prev_frame;
+    }
+    FRAME_XDECREF(frame);
+
+    return frames;
+}
+
 static PyMethodDef StacktraceMethods[] = {
     { "get_info_frame", (PyCFunction)get_file_and_line, METH_O, "stacktrace functions" },
+    { "get_info_frame_if_not_reported",
+      (PyCFunction)get_file_and_line_if_not_reported,
+      METH_VARARGS,
+      "get_info_frame, or None when the vulnerability type was reported from the location within the time lapse" },
+    { "reset_reported_locations",
+      (PyCFunction)reset_reported_locations,
+      METH_NOARGS,
+      "Forget the locations of the vulnerabilities reported" },
+    { "get_stack_frames",
+      (PyCFunction)get_stack_frames,
+      METH_VARARGS,
+      "The (id, filename, function, line) of the frames of the current thread, cropped and bounded in depth" },
     { NULL, NULL, 0, NULL }
 };
 
@@ -0,0 +1,111 @@
+#include "AspectCommonReplace.h"
+
+#include "Helpers.h"
+
+#include <algorithm>
+
+/**
+ * Calls a method of a text object returning a transformed text of the same length, like upper(), and copies the
+ * taint ranges of the text object to the result.
+ *
+ * This is the native version of the aspects of aspects.py built on common_replace, with the same arguments: the
+ * original function (or None), the number of arguments added by the AST patching, the text object, and the
+ * arguments of the method.
+ *
+ * @param method_name The name of the method, interned.
+ * @param args The arguments of the aspect, in the vectorcall layout.
+ * @param nargs The number of positional arguments in args.
+ * @param kwnames The names of the keyword arguments, or nullptr.
+ */
+static PyObject*
+common_replace_aspect(PyObject* method_name, PyObject* const* args, const Py_ssize_t nargs, PyObject* kwnames)
+{
+    if (nargs < 2) {
+        py::set_error(PyExc_ValueError, MSG_ERROR_N_PARAMS);
+        return nullptr;
+    }
+
+    PyObject* orig_function = args[0];
+    const long flag_added_args = PyLong_AsLong(args[1]);
+    if (flag_added_args == -1 and PyErr_Occurred()) {
+        return nullptr;
+    }
+    PyObject* const* aspect_args = args + 2;
+    const Py_ssize_t n_aspect_args = nargs - 2;
+    // Same as slicing the arguments in Python
+    const Py_ssize_t n_added_args = std::clamp<Py_ssize_t>(flag_added_args, 0, n_aspect_args);
+    PyObject* const* method_args = aspect_args + n_added_args;
+    const Py_ssize_t n_method_args = n_aspect_args - n_added_args;
+
+    if (orig_function != Py_None and (not PyCFunction_Check(orig_function) or n_aspect_args == 0)) {
+        // Not a method of a builtin type, nothing to propagate
+        return call_function(orig_function, method_args, n_method_args, kwnames);
+    }
+    if (n_aspect_args == 0) {
+        py::set_error(PyExc_ValueError, MSG_ERROR_N_PARAMS);
+        return nullptr;
+    }
+
+    PyObject* candidate_text = aspect_args[0];
+    PyObject* method = PyObject_GetAttr(candidate_text, method_name);
+    if (method == nullptr) {
+        return nullptr;
+    }
+    PyObject* result = call_function(method, method_args, n_method_args, kwnames);
+    Py_DECREF(method);
+    if (result == nullptr or not is_text(candidate_text) or not is_text(result)) {
+        return result;
+    }
+
+    const auto tx_map = initializer->get_tainting_map();
+    if (not tx_map or tx_map->empty()) {
+        return result;
+    }
+    // The result has the ranges of the text, it shares them rather than having a copy
+    if (const auto to_candidate_text = get_tainted_object(candidate_text, tx_map)) {
+        set_tainted_object(result, to_candidate_text, tx_map);
+    }
+    return result;
+}
+
+PyObject*
+api_upper_aspect(PyObject* self, PyObject* const* args, const Py_ssize_t nargs, PyObject* kwnames)
+{
+    static PyObject* method_name = PyUnicode_InternFromString("upper");
+    return common_replace_aspect(method_name, args, nargs, kwnames);
+}
+
+PyObject*
+api_lower_aspect(PyObject* self, PyObject* const* args, const Py_ssize_t nargs, PyObject* kwnames)
+{
+    static PyObject* method_name = PyUnicode_InternFromString("lower");
+    return common_replace_aspect(method_name, args, nargs, kwnames);
+}
+
+PyObject*
+api_swapcase_aspect(PyObject* self, PyObject* const* args, const Py_ssize_t nargs, PyObject* kwnames)
+{
+    static PyObject* method_name = PyUnicode_InternFromString("swapcase");
+    return common_replace_aspect(method_name, args, nargs, kwnames);
+}
+
+PyObject*
+api_title_aspect(PyObject* self, PyObject* const* args, const Py_ssize_t nargs, PyObject* kwnames)
+{
+    static PyObject* method_name = PyUnicode_InternFromString("title");
+    return common_replace_aspect(method_name, args, nargs, kwnames);
+}
+
+PyObject*
+api_capitalize_aspect(PyObject* self, PyObject* const* args, const Py_ssize_t nargs, PyObject* kwnames)
+{
+    static PyObject* method_name = PyUnicode_InternFromString("capitalize");
+    return common_replace_aspect(method_name, args, nargs, kwnames);
+}
+
+PyObject*
+api_translate_aspect(PyObject* self, PyObject* const* args, const Py_ssize_t nargs, PyObject* kwnames)
+{
+    static PyObject* method_name = PyUnicode_InternFromString("translate");
+    return common_replace_aspect(method_name, args, nargs, kwnames);
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include "Initializer/Initializer.h"
+
+PyObject*
+api_upper_aspect(PyObject* self, PyObject* const* args, Py_ssize_t nargs, PyObject* kwnames);
+
+PyObject*
+api_lower_aspect(PyObject* self, PyObject* const* args, Py_ssize_t nargs, PyObject* kwnames);
+
+PyObject*
+api_swapcase_aspect(PyObject* self, PyObject* const* args, Py_ssize_t nargs, PyObject* kwnames);
+
+PyObject*
+api_title_aspect(PyObject* self, PyObject* const* args, Py_ssize_t nargs, PyObject* kwnames);
+
+PyObject*
+api_capitalize_aspect(PyObject* self, PyObject* const* args, Py_ssize_t nargs, PyObject* kwnames);
+
+PyObject*
+api_translate_aspect(PyObject* self, PyObject* const* args, Py_ssize_t nargs, PyObject* kwnames);
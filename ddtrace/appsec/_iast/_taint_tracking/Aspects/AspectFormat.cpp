@@ -1,68 +1,655 @@
 #include "Aspects/AspectFormat.h"
 
-/**
- * @brief This function is used to format the candidate_text with the given parameter_list, args and kwargs.
+#include <algorithm>
+
+/*
+ * Native str.format for tainted templates and arguments.
+ *
+ * The template is parsed like CPython's unicode_format.h does and every replacement field is formatted with
+ * PyObject_Format, so the output offset of each literal chunk and each field is known while the result is built and
+ * the ranges are placed there directly, without formatting escaped evidence of the texts and parsing it back.
  *
- * @tparam StrType
- * @param candidate_text
- * @param parameter_list
- * @param args
- * @param kwargs
- * @return StrType
+ * The functions return false (or nullptr) when the template or its arguments are wrong, leaving the error to
+ * str.format, which reports it with its own messages.
  */
-template<class StrType>
-StrType
-api_format_aspect(StrType& candidate_text,
-                  const py::tuple& parameter_list,
-                  const py::args& args,
-                  const py::kwargs& kwargs)
+
+// Levels of format specs nested in format specs, as in CPython
+static constexpr int FORMAT_RECURSION_DEPTH = 2;
+
+// A piece of the result: a chunk of the template or the formatted value of a field
+struct FormatPiece
 {
-    const auto tx_map = initializer->get_tainting_map();
+    // New reference to the formatted value, nullptr for a chunk of the template
+    PyObject* text = nullptr;
+    Py_ssize_t template_start = 0;
+    Py_ssize_t length = 0;
+    // Ranges of the formatted value, relative to it
+    TaintRangeRefs ranges;
+    // Source of the template range over the field, for the characters the value ranges don't cover
+    std::optional<SourceId> template_source;
+};
+
+class FormatPieces
+{
+  public:
+    std::vector<FormatPiece> pieces;
+
+    ~FormatPieces()
+    {
+        for (const auto& piece : pieces) {
+            Py_XDECREF(piece.text);
+        }
+    }
+};
+
+// Adds a range to the ones of the result, merged with the previous one when they continue each other
+static void
+append_range(TaintRangeRefs& ranges, const Py_ssize_t start, const Py_ssize_t length, const SourceId& source)
+{
+    if (length <= 0) {
+        return;
+    }
+    if (not ranges.empty()) {
+        if (auto& last = ranges.back(); last.source == source and last.start + last.length == start) {
+            last.length += length;
+            return;
+        }
+    }
+    ranges.emplace_back(start, length, source);
+}
 
-    if (not tx_map or tx_map->empty()) {
-        return py::getattr(candidate_text, "format")(*args, **kwargs);
+static bool
+is_ascii_digits(const TextChars& chars, const Py_ssize_t start, const Py_ssize_t end)
+{
+    if (start == end) {
+        return false;
+    }
+    for (auto i = start; i < end; i++) {
+        if (chars[i] < '0' or chars[i] > '9') {
+            return false;
+        }
     }
+    return true;
+}
 
-    auto [ranges_orig, candidate_text_ranges] = are_all_text_all_ranges(candidate_text.ptr(), parameter_list);
+static Py_ssize_t
+to_index(const TextChars& chars, const Py_ssize_t start, const Py_ssize_t end)
+{
+    Py_ssize_t index = 0;
+    for (auto i = start; i < end; i++) {
+        index = index * 10 + (chars[i] - '0');
+    }
+    return index;
+}
 
-    if (!ranges_orig.empty() or !candidate_text_ranges.empty()) {
-        auto new_template =
-          int_as_formatted_evidence<StrType>(candidate_text, candidate_text_ranges, TagMappingMode::Mapper);
+/**
+ * Returns a new reference to the object a field name refers to: an argument (by position, automatic numbering or
+ * keyword) followed by .attribute and [key] accessors. nullptr with an error set if the lookup fails, and without
+ * one if the field name is one that str.format rejects or that is left to it.
+ */
+static PyObject*
+get_field_object(PyObject* text,
+                 const Py_ssize_t start,
+                 const Py_ssize_t end,
+                 PyObject* args,
+                 PyObject* kwargs,
+                 Py_ssize_t& auto_number)
+{
+    const TextChars chars(text);
+    auto first_end = start;
+    while (first_end < end and chars[first_end] != '.' and chars[first_end] != '[') {
+        first_end++;
+    }
 
-        py::list new_args;
-        py::dict new_kwargs;
-        for (const auto arg : args) {
-            if (is_text(arg.ptr())) {
-                auto str_arg = py::cast<py::str>(arg);
-                auto n_arg = all_as_formatted_evidence<py::str>(str_arg, TagMappingMode::Mapper);
-                new_args.append(n_arg);
-            } else {
-                new_args.append(arg);
+    PyObject* object;
+    if (first_end == start or is_ascii_digits(chars, start, first_end)) {
+        // auto_number is -1 once the template numbers its fields, which can't be mixed with automatic numbering
+        Py_ssize_t index;
+        if (first_end == start) {
+            if (auto_number < 0) {
+                return nullptr;
             }
+            index = auto_number++;
+        } else {
+            if (auto_number > 0 or first_end - start > 9) {
+                return nullptr;
+            }
+            auto_number = -1;
+            index = to_index(chars, start, first_end);
+        }
+        if (index >= PyTuple_GET_SIZE(args)) {
+            return nullptr;
+        }
+        object = PyTuple_GET_ITEM(args, index);
+        Py_INCREF(object);
+    } else {
+        if (kwargs == nullptr) {
+            return nullptr;
+        }
+        PyObject* key = PyUnicode_Substring(text, start, first_end);
+        if (key == nullptr) {
+            return nullptr;
+        }
+        object = PyDict_GetItemWithError(kwargs, key);
+        Py_DECREF(key);
+        if (object == nullptr) {
+            return nullptr;
+        }
+        Py_INCREF(object);
+    }
+
+    auto position = first_end;
+    while (position < end) {
+        const bool is_attribute = chars[position] == '.';
+        if (not is_attribute and chars[position] != '[') {
+            Py_DECREF(object);
+            return nullptr;
+        }
+        const auto name_start = ++position;
+        while (position < end and chars[position] != (is_attribute ? '.' : ']') and
+               (not is_attribute or chars[position] != '[')) {
+            position++;
+        }
+        const auto name_end = position;
+        if (name_start == name_end or (not is_attribute and position == end)) {
+            Py_DECREF(object);
+            return nullptr;
         }
-        for (auto [key, value] : kwargs) {
-            if (is_text(value.ptr())) {
-                auto str_value = py::cast<py::str>(value);
-                auto n_value = all_as_formatted_evidence<py::str>(str_value, TagMappingMode::Mapper);
-                new_kwargs[key] = n_value;
+        if (not is_attribute) {
+            position++;
+        }
+
+        PyObject* next;
+        if (not is_attribute and is_ascii_digits(chars, name_start, name_end)) {
+            if (name_end - name_start > 9) {
+                Py_DECREF(object);
+                return nullptr;
+            }
+            PyObject* key = PyLong_FromSsize_t(to_index(chars, name_start, name_end));
+            next = key ? PyObject_GetItem(object, key) : nullptr;
+            Py_XDECREF(key);
+        } else {
+            PyObject* name = PyUnicode_Substring(text, name_start, name_end);
+            next = name ? (is_attribute ? PyObject_GetAttr(object, name) : PyObject_GetItem(object, name)) : nullptr;
+            Py_XDECREF(name);
+        }
+        Py_DECREF(object);
+        if (next == nullptr) {
+            return nullptr;
+        }
+        object = next;
+    }
+    return object;
+}
+
+/**
+ * Locates the characters of a formatted str value in the output of its standard format spec: the value, cut to the
+ * precision, padded to the width according to the alignment. Returns false for the specs it doesn't parse.
+ */
+static bool
+locate_formatted_str(PyObject* spec,
+                     const Py_ssize_t value_length,
+                     const Py_ssize_t formatted_length,
+                     Py_ssize_t& offset,
+                     Py_ssize_t& length)
+{
+    const TextChars chars(spec);
+    const auto spec_length = PyUnicode_GET_LENGTH(spec);
+    const auto is_align = [](const Py_UCS4 c) { return c == '<' or c == '>' or c == '^' or c == '='; };
+    Py_ssize_t i = 0;
+    Py_UCS4 align = '<';
+    if (spec_length >= 2 and is_align(chars[1])) {
+        align = chars[1];
+        i = 2;
+    } else if (spec_length >= 1 and is_align(chars[0])) {
+        align = chars[0];
+        i = 1;
+    }
+    while (i < spec_length and chars[i] >= '0' and chars[i] <= '9') {
+        i++;
+    }
+    if (i < spec_length and (chars[i] == ',' or chars[i] == '_')) {
+        i++;
+    }
+    length = value_length;
+    if (i < spec_length and chars[i] == '.') {
+        const auto precision_start = ++i;
+        while (i < spec_length and chars[i] >= '0' and chars[i] <= '9') {
+            i++;
+        }
+        if (i == precision_start or i - precision_start > 9) {
+            return false;
+        }
+        length = std::min(length, to_index(chars, precision_start, i));
+    }
+    if (i < spec_length and chars[i] == 's') {
+        i++;
+    }
+    if (i != spec_length or align == '=' or formatted_length < length) {
+        return false;
+    }
+    const auto padding = formatted_length - length;
+    offset = align == '>' ? padding : (align == '^' ? padding / 2 : 0);
+    return true;
+}
+
+// Whether formatted[offset:offset + length] holds the first length characters of value
+static bool
+same_characters(PyObject* formatted, const Py_ssize_t offset, PyObject* value, const Py_ssize_t length)
+{
+    const TextChars formatted_chars(formatted);
+    const TextChars value_chars(value);
+    for (Py_ssize_t i = 0; i < length; i++) {
+        if (formatted_chars[offset + i] != value_chars[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Formats a field and works out where the ranges of its value land in the formatted text. The conversions !r and
+ * !a keep the ranges of a str value when its repr only adds the quotes. When the characters of a tainted value
+ * can't be located (an escaped repr, a value that isn't an exact str), the whole field is tainted with its first
+ * source.
+ */
+static bool
+format_field(PyObject* value,
+             const Py_UCS4 conversion,
+             PyObject* spec,
+             const TaintRangeMapTypePtr& tx_map,
+             FormatPiece& piece)
+{
+    PyObject* converted;
+    // Offset of the characters of value in the converted object
+    Py_ssize_t value_offset = 0;
+    switch (conversion) {
+        case 0:
+            converted = value;
+            Py_INCREF(converted);
+            break;
+        case 's':
+            converted = PyObject_Str(value);
+            break;
+        case 'r':
+            converted = PyObject_Repr(value);
+            value_offset = 1;
+            break;
+        case 'a':
+            converted = PyObject_ASCII(value);
+            value_offset = 1;
+            break;
+        default:
+            return false;
+    }
+    if (converted == nullptr) {
+        return false;
+    }
+
+    const auto to_value = is_text(value) ? get_tainted_object(value, tx_map) : nullptr;
+    piece.text = PyObject_Format(converted, spec);
+    if (piece.text == nullptr) {
+        Py_DECREF(converted);
+        return false;
+    }
+    piece.length = PyUnicode_GET_LENGTH(piece.text);
+    if (not to_value) {
+        Py_DECREF(converted);
+        return true;
+    }
+
+    // The characters of the value in the converted object, and of these in the formatted text
+    const auto value_length = PyUnicode_Check(value) ? PyUnicode_GET_LENGTH(value) : -1;
+    bool located = PyUnicode_CheckExact(value) and
+                   (converted == value or (PyUnicode_Check(converted) and
+                                           PyUnicode_GET_LENGTH(converted) == value_length + 2 * value_offset and
+                                           same_characters(converted, value_offset, value, value_length)));
+    Py_ssize_t offset = 0;
+    auto length = value_length;
+    if (located and piece.text != converted) {
+        located = locate_formatted_str(spec, PyUnicode_GET_LENGTH(converted), piece.length, offset, length) and
+                  same_characters(piece.text, offset, converted, length);
+        // Offset and length of the value characters, out of the formatted ones of the converted object
+        const auto end = std::min(offset + length, offset + value_offset + value_length);
+        offset += value_offset;
+        length = std::max<Py_ssize_t>(end - offset, 0);
+    } else {
+        offset = value_offset;
+    }
+    Py_DECREF(converted);
+    const auto value_ranges = to_value->get_ranges();
+    if (not located) {
+        if (not value_ranges.empty()) {
+            append_range(piece.ranges, 0, piece.length, value_ranges[0].source);
+        }
+        return true;
+    }
+
+    for (const auto& range : value_ranges.intersecting(0, length)) {
+        const auto range_end = std::min<Py_ssize_t>(range.start + range.length, length);
+        append_range(piece.ranges, offset + range.start, range_end - range.start, range.source);
+    }
+    return true;
+}
+
+static PyObject*
+join_pieces(PyObject* text, const FormatPieces& pieces, const TaintedObject* to_text, TaintRangeRefs& result_ranges);
+
+/**
+ * Parses text[start:end] into pieces, formatting its fields. Follows MarkupIterator_next, parse_field and
+ * output_markup of CPython: the format specs with fields are parsed the same way one level down, sharing the
+ * automatic numbering of the fields.
+ */
+static bool
+parse_template(PyObject* text,
+               const Py_ssize_t start,
+               const Py_ssize_t text_length,
+               PyObject* args,
+               PyObject* kwargs,
+               const TaintedObject* to_text,
+               const TaintRangeMapTypePtr& tx_map,
+               Py_ssize_t& auto_number,
+               const int recursion_depth,
+               FormatPieces& pieces)
+{
+    if (recursion_depth <= 0) {
+        return false;
+    }
+    const TextChars chars(text);
+    Py_ssize_t position = start;
+
+    while (position < text_length) {
+        // Literal text up to a brace, a doubled brace being one literal brace
+        const auto literal_start = position;
+        Py_UCS4 c = 0;
+        while (position < text_length) {
+            c = chars[position++];
+            if (c == '{' or c == '}') {
+                break;
+            }
+        }
+        const bool at_end = position >= text_length;
+        auto literal_end = position;
+        bool field_follows = c == '{' or c == '}';
+        if (field_follows) {
+            if (at_end or chars[position] != c) {
+                if (c == '}' or at_end) {
+                    return false;
+                }
+                literal_end--;
             } else {
-                new_kwargs[key] = value;
+                position++;
+                field_follows = false;
+            }
+        }
+        if (literal_end > literal_start) {
+            pieces.pieces.push_back({ nullptr, literal_start, literal_end - literal_start, {}, std::nullopt });
+        }
+        if (not field_follows) {
+            continue;
+        }
+
+        // The field: a name, a conversion and a format spec
+        const auto field_start = position - 1;
+        const auto name_start = position;
+        while (position < text_length) {
+            c = chars[position++];
+            if (c == '{') {
+                return false;
+            }
+            if (c == '[') {
+                while (position < text_length and chars[position] != ']') {
+                    position++;
+                }
+                continue;
+            }
+            if (c == '}' or c == ':' or c == '!') {
+                break;
+            }
+        }
+        if (c != '}' and c != ':' and c != '!') {
+            return false;
+        }
+        const auto name_end = position - 1;
+        Py_UCS4 conversion = 0;
+        auto spec_start = position;
+        auto spec_end = position;
+        bool spec_has_fields = false;
+        if (c == '!') {
+            if (position + 1 >= text_length) {
+                return false;
+            }
+            conversion = chars[position++];
+            c = chars[position++];
+            if (c != '}' and c != ':') {
+                return false;
+            }
+            spec_start = spec_end = position;
+        }
+        if (c == ':') {
+            int braces = 1;
+            while (position < text_length and braces > 0) {
+                c = chars[position++];
+                if (c == '{') {
+                    spec_has_fields = true;
+                    braces++;
+                } else if (c == '}') {
+                    braces--;
+                }
+            }
+            if (braces > 0) {
+                return false;
+            }
+            spec_end = position - 1;
+        }
+
+        PyObject* value = get_field_object(text, name_start, name_end, args, kwargs, auto_number);
+        if (value == nullptr) {
+            return false;
+        }
+        PyObject* spec;
+        if (spec_has_fields) {
+            FormatPieces spec_pieces;
+            TaintRangeRefs spec_ranges;
+            spec = parse_template(text,
+                                  spec_start,
+                                  spec_end,
+                                  args,
+                                  kwargs,
+                                  nullptr,
+                                  tx_map,
+                                  auto_number,
+                                  recursion_depth - 1,
+                                  spec_pieces)
+                     ? join_pieces(text, spec_pieces, nullptr, spec_ranges)
+                     : nullptr;
+        } else {
+            spec = PyUnicode_Substring(text, spec_start, spec_end);
+        }
+        if (spec == nullptr) {
+            Py_DECREF(value);
+            return false;
+        }
+        FormatPiece piece;
+        const bool formatted = format_field(value, conversion, spec, tx_map, piece);
+        Py_DECREF(value);
+        Py_DECREF(spec);
+        pieces.pieces.push_back(std::move(piece));
+        if (not formatted) {
+            return false;
+        }
+
+        // A template range over the field taints what the value doesn't
+        if (to_text) {
+            if (const auto template_ranges = to_text->get_ranges().intersecting(field_start, position);
+                not template_ranges.empty()) {
+                pieces.pieces.back().template_source = template_ranges[0].source;
+            }
+        }
+    }
+    return true;
+}
+
+/**
+ * Copies characters of the template to the result. PyUnicode_CopyCharacters checks the characters from the start of a
+ * Latin-1 text instead of the copied ones before writing them to an ASCII string, so texts of the same kind are copied
+ * directly: the result was created for the characters it gets.
+ */
+static void
+copy_template_chars(PyObject* result,
+                    const Py_ssize_t position,
+                    PyObject* text,
+                    const Py_ssize_t start,
+                    const Py_ssize_t length)
+{
+    if (const auto kind = PyUnicode_KIND(text); kind == PyUnicode_KIND(result)) {
+        memcpy(static_cast<char*>(PyUnicode_DATA(result)) + position * kind,
+               static_cast<const char*>(PyUnicode_DATA(text)) + start * kind,
+               length * kind);
+    } else {
+        PyUnicode_CopyCharacters(result, position, text, start, length);
+    }
+}
+
+// New text with the pieces, and their ranges
+static PyObject*
+join_pieces(PyObject* text, const FormatPieces& pieces, const TaintedObject* to_text, TaintRangeRefs& result_ranges)
+{
+    const TextChars chars(text);
+    const bool text_is_ascii = PyUnicode_IS_ASCII(text);
+    Py_ssize_t length = 0;
+    Py_UCS4 max_char = 0;
+    for (const auto& piece : pieces.pieces) {
+        length += piece.length;
+        if (piece.text) {
+            max_char = std::max(max_char, PyUnicode_MAX_CHAR_VALUE(piece.text));
+        } else if (not text_is_ascii) {
+            for (auto i = piece.template_start; i < piece.template_start + piece.length; i++) {
+                max_char = std::max(max_char, chars[i]);
+            }
+        }
+    }
+    PyObject* result = PyUnicode_New(length, max_char);
+    if (result == nullptr) {
+        return nullptr;
+    }
+
+    Py_ssize_t position = 0;
+    for (const auto& piece : pieces.pieces) {
+        if (piece.text) {
+            PyUnicode_CopyCharacters(result, position, piece.text, 0, piece.length);
+            auto covered = position;
+            for (const auto& range : piece.ranges) {
+                if (piece.template_source) {
+                    append_range(result_ranges, covered, position + range.start - covered, *piece.template_source);
+                }
+                append_range(result_ranges, position + range.start, range.length, range.source);
+                covered = position + range.start + range.length;
+            }
+            if (piece.template_source) {
+                append_range(result_ranges, covered, position + piece.length - covered, *piece.template_source);
+            }
+        } else {
+            copy_template_chars(result, position, text, piece.template_start, piece.length);
+            if (to_text) {
+                const auto end = piece.template_start + piece.length;
+                for (const auto& range : to_text->get_ranges().intersecting(piece.template_start, end)) {
+                    const auto range_start = std::max<Py_ssize_t>(range.start, piece.template_start);
+                    const auto range_end = std::min<Py_ssize_t>(range.start + range.length, end);
+                    append_range(result_ranges,
+                                 position + range_start - piece.template_start,
+                                 range_end - range_start,
+                                 range.source);
+                }
             }
         }
-        StrType new_template_format =
-          py::getattr(new_template, "format")(*(py::cast<py::tuple>(new_args)), **new_kwargs);
-        std::tuple result = convert_escaped_text_to_taint_text<StrType>(new_template_format, ranges_orig);
-        StrType result_text = get<0>(result);
-        TaintRangeRefs result_ranges = get<1>(result);
-        PyObject* new_result = new_pyobject_id(result_text.ptr());
-        set_ranges(new_result, result_ranges, tx_map);
-        return py::reinterpret_steal<StrType>(new_result);
+        position += piece.length;
+    }
+    return result;
+}
+
+static PyObject*
+format_text(PyObject* text, PyObject* args, PyObject* kwargs, const TaintRangeMapTypePtr& tx_map)
+{
+    const auto to_text = get_tainted_object(text, tx_map);
+    FormatPieces pieces;
+    Py_ssize_t auto_number = 0;
+    if (not parse_template(text,
+                           0,
+                           PyUnicode_GET_LENGTH(text),
+                           args,
+                           kwargs,
+                           to_text,
+                           tx_map,
+                           auto_number,
+                           FORMAT_RECURSION_DEPTH,
+                           pieces)) {
+        return nullptr;
+    }
+    TaintRangeRefs result_ranges;
+    PyObject* result = join_pieces(text, pieces, to_text, result_ranges);
+    if (result != nullptr and not result_ranges.empty()) {
+        set_ranges(result, result_ranges, tx_map);
     }
-    return py::getattr(candidate_text, "format")(*args, **kwargs);
+    return result;
+}
+
+// Whether the template or one of the arguments is tainted
+static bool
+has_tainted_operand(PyObject* text, PyObject* args, PyObject* kwargs, const TaintRangeMapTypePtr& tx_map)
+{
+    if (get_tainted_object(text, tx_map)) {
+        return true;
+    }
+    for (Py_ssize_t i = 0; i < PyTuple_GET_SIZE(args); i++) {
+        if (PyObject* arg = PyTuple_GET_ITEM(args, i); is_text(arg) and get_tainted_object(arg, tx_map)) {
+            return true;
+        }
+    }
+    if (kwargs) {
+        Py_ssize_t pos = 0;
+        PyObject* key;
+        PyObject* value;
+        while (PyDict_Next(kwargs, &pos, &key, &value)) {
+            if (is_text(value) and get_tainted_object(value, tx_map)) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/**
+ * Formats a template, with the ranges of the template and of the arguments on the result.
+ *
+ * @return The formatted text, or None if the template or its arguments are wrong, leaving the exception to
+ * str.format.
+ */
+template<class StrType>
+py::object
+api_format_aspect(StrType& candidate_text, const py::args& args, const py::kwargs& kwargs)
+{
+    const auto tx_map = initializer->get_tainting_map();
+    PyObject* kwargs_dict = kwargs.empty() ? nullptr : kwargs.ptr();
+
+    PyObject* result;
+    if (not tx_map or tx_map->empty() or
+        not has_tainted_operand(candidate_text.ptr(), args.ptr(), kwargs_dict, tx_map)) {
+        PyObject* format = PyObject_GetAttrString(candidate_text.ptr(), "format");
+        result = format ? PyObject_Call(format, args.ptr(), kwargs_dict) : nullptr;
+        Py_XDECREF(format);
+    } else {
+        result = format_text(candidate_text.ptr(), args.ptr(), kwargs_dict, tx_map);
+    }
+    if (result == nullptr) {
+        PyErr_Clear();
+        return py::none();
+    }
+    return py::reinterpret_steal<py::object>(result);
 }
 
 void
 pyexport_format_aspect(py::module& m)
 {
-    m.def("_format_aspect", &api_format_aspect<py::str>, "candidate_text"_a, "parameter_list"_a);
-}
\ No newline at end of file
+    m.def("_format_aspect", &api_format_aspect<py::str>, "candidate_text"_a);
+}
@@ -3,11 +3,8 @@
 #include "Initializer/Initializer.h"
 
 template<class StrType>
-StrType
-api_format_aspect(StrType& candidate_text,
-                  const py::tuple& parameter_list,
-                  const py::args& args,
-                  const py::kwargs& kwargs);
+py::object
+api_format_aspect(StrType& candidate_text, const py::args& args, const py::kwargs& kwargs);
 
 void
 pyexport_format_aspect(py::module& m);
\ No newline at end of file
@@ -15,14 +15,13 @@ index_aspect(PyObject* result_o, PyObject* candidate_text, PyObject* idx, const
 {
     const auto idx_long = PyLong_AsLong(idx);
     TaintRangeRefs ranges_to_set;
-    auto [ranges, ranges_error] = get_ranges(candidate_text, tx_taint_map);
-    if (ranges_error) {
+    if (not is_text(candidate_text)) {
         return result_o;
     }
-    for (const auto& current_range : ranges) {
-        if (current_range->start <= idx_long and idx_long < (current_range->start + current_range->length)) {
-            ranges_to_set.emplace_back(initializer->allocate_taint_range(0l, 1l, current_range->source));
-            break;
+    if (const auto& to_candidate_text = get_tainted_object(candidate_text, tx_taint_map)) {
+        if (const auto ranges = to_candidate_text->get_ranges().intersecting(idx_long, idx_long + 1);
+            not ranges.empty()) {
+            ranges_to_set.emplace_back(0l, 1l, ranges[0].source);
         }
     }
 
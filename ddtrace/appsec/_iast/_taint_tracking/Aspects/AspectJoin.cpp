@@ -2,6 +2,15 @@
 
 #include "Helpers.h"
 
+/**
+ * Counts the ranges a join adds, stopping at the limit of ranges of a tainted object since no more are kept.
+ */
+static size_t
+add_capped(const size_t total, const size_t count)
+{
+    return min(total + count, static_cast<size_t>(TaintedObject::TAINT_RANGE_LIMIT));
+}
+
 PyObject*
 aspect_join_str(PyObject* sep,
                 PyObject* result,
@@ -21,34 +30,42 @@ aspect_join_str(PyObject* sep,
 
     const size_t& len_sep = PyUnicode_GET_LENGTH(sep);
     const size_t& element_len = 1;
-    unsigned long current_pos{ 0L };
+    const size_t joiner_ranges = (len_sep > 0 and to_joiner) ? to_joiner->get_ranges().size() : 0;
     TaintedObjectPtr result_to;
 
     if (len_sep == 0 and to_iterable_str) {
         // Empty separator: the result is identical to iterable_str
         result_to = initializer->allocate_tainted_object_copy(to_iterable_str);
-    } else if (len_sep > 0 and to_joiner and to_iterable_str == nullptr) {
-        // Iterable str is not tainted, only add n-times the joiner taints
-        result_to = initializer->allocate_tainted_object();
-        for (size_t i = 0; i < len_iterable - 1; i++) {
-            current_pos += element_len;
-            result_to->add_ranges_shifted(to_joiner, current_pos);
-            current_pos += len_sep;
-        }
     } else {
-        // General case, iterable and joiner may be tainted
+        // Every character covered by a range of iterable_str gets a range of its own, then the joiner ranges follow
+        // it. Counting them first sizes the storage of the result once.
+        size_t total_ranges = add_capped(0, joiner_ranges * (len_iterable - 1));
+        // Only the characters between the first start and the last end of the ranges of iterable_str are tainted
+        size_t tainted_begin = len_iterable;
+        size_t tainted_end = 0;
+        if (to_iterable_str) {
+            for (const auto& range : to_iterable_str->get_ranges()) {
+                const auto range_begin = min(static_cast<size_t>(range.start), len_iterable);
+                const auto range_end = min(static_cast<size_t>(range.start + range.length), len_iterable);
+                total_ranges = add_capped(total_ranges, range_end - range_begin);
+                tainted_begin = min(tainted_begin, range_begin);
+                tainted_end = max(tainted_end, range_end);
+            }
+        }
+
         result_to = initializer->allocate_tainted_object();
-        for (size_t i = 0; i < len_iterable; i++) {
-            if (to_iterable_str) {
+        result_to->reserve_ranges(total_ranges);
+
+        // Without joiner ranges, the characters outside of the tainted ones have nothing to add
+        const size_t first = joiner_ranges > 0 ? 0 : tainted_begin;
+        const size_t last = joiner_ranges > 0 ? len_iterable : tainted_end;
+        for (size_t i = first; i < last and not result_to->has_full_ranges(); i++) {
+            const unsigned long current_pos = i * (element_len + len_sep);
+            if (i >= tainted_begin and i < tainted_end) {
                 result_to->add_ranges_shifted(to_iterable_str, current_pos, element_len, i);
             }
-
-            current_pos += element_len;
-            if (i < len_iterable - 1) {
-                if (to_joiner) {
-                    result_to->add_ranges_shifted(to_joiner, current_pos);
-                }
-                current_pos += len_sep;
+            if (joiner_ranges > 0 and i < len_iterable - 1) {
+                result_to->add_ranges_shifted(to_joiner, current_pos + element_len);
             }
         }
     }
@@ -79,11 +96,44 @@ aspect_join(PyObject* sep, PyObject* result, PyObject* iterable_elements, const
             return result; // Empty string is returned if empty iterable, so no tainted
     }
 
+    const auto& to_joiner = get_tainted_object(sep, tx_taint_map);
+    const size_t joiner_ranges = (len_sep > 0 and to_joiner) ? to_joiner->get_ranges().size() : 0;
+
+    // First pass: count the ranges of the result, so that its storage is sized once instead of growing as the
+    // ranges of every element are added. When nothing is tainted, this is the only pass. The second one only looks
+    // up the elements from the first to the last tainted one seen here.
+    size_t total_ranges = 0;
+    size_t first_tainted = len_iterable;
+    size_t last_tainted = 0;
+    for (size_t i = 0; i < len_iterable and total_ranges < TaintedObject::TAINT_RANGE_LIMIT; i++) {
+        PyObject* element = GetElement(iterable_elements, i);
+        if (!element) {
+            break;
+        }
+        if (get_pyobject_size(element) > 0) {
+            if (const auto& to_element = get_tainted_object(element, tx_taint_map)) {
+                total_ranges = add_capped(total_ranges, to_element->get_ranges().size());
+                first_tainted = min(first_tainted, i);
+                last_tainted = i;
+            }
+        }
+        if (i < len_iterable - 1) {
+            total_ranges = add_capped(total_ranges, joiner_ranges);
+        }
+    }
+
+    if (total_ranges == 0) {
+        // No taints at all
+        return result;
+    }
+
     unsigned long current_pos{ 0L };
     TaintedObjectPtr result_to = nullptr;
-    TaintedObjectPtr first_tainted_to = nullptr;
-
-    const auto& to_joiner = get_tainted_object(sep, tx_taint_map);
+    const auto allocate_result_to = [total_ranges]() {
+        const auto to = initializer->allocate_tainted_object();
+        to->reserve_ranges(total_ranges);
+        return to;
+    };
 
     for (size_t i = 0; i < len_iterable; i++) {
         PyObject* element = GetElement(iterable_elements, i);
@@ -96,39 +146,34 @@ aspect_join(PyObject* sep, PyObject* result, PyObject* iterable_elements, const
         // b"a".join(u"c", u"d") -> unicode
         // b"a".join(u"c", b"d") -> unicode
         const size_t& element_len = get_pyobject_size(element);
-        if (element_len > 0) {
+        if (element_len > 0 and i >= first_tainted and i <= last_tainted) {
             if (const auto& to_element = get_tainted_object(element, tx_taint_map)) {
-                if (current_pos == 0 and !first_tainted_to) {
-                    first_tainted_to = to_element;
+                if (result_to == nullptr and current_pos == 0) {
+                    // The result starts with the ranges of the first element: take them without copying
+                    result_to = initializer->allocate_tainted_object_copy(to_element);
+                    if (const auto taken = to_element->get_ranges().size(); total_ranges > taken) {
+                        result_to->reserve_ranges(total_ranges - taken);
+                    }
                 } else {
                     if (result_to == nullptr) {
-                        // If first_tainted_to is null, it's ranges won't be copied
-                        result_to = initializer->allocate_tainted_object_copy(first_tainted_to);
-                        first_tainted_to = nullptr;
+                        result_to = allocate_result_to();
                     }
                     result_to->add_ranges_shifted(to_element, current_pos);
                 }
             }
 
-            current_pos += element_len;
         }
-        if (len_sep > 0 and i < len_iterable - 1 and to_joiner) {
+        current_pos += element_len;
+        if (joiner_ranges > 0 and i < len_iterable - 1) {
             if (result_to == nullptr) {
-                // If first_tainted_to is null, it's ranges won't be copied
-                result_to = initializer->allocate_tainted_object_copy(first_tainted_to);
-                first_tainted_to = nullptr;
+                result_to = allocate_result_to();
             }
             result_to->add_ranges_shifted(to_joiner, current_pos);
         }
         current_pos += len_sep;
-    }
 
-    if (result_to == nullptr) {
-        if (first_tainted_to) {
-            result_to = initializer->allocate_tainted_object_copy(first_tainted_to);
-        } else {
-            // No taints at all
-            return result;
+        if ((joiner_ranges == 0 and i >= last_tainted) or (result_to and result_to->has_full_ranges())) {
+            break;
         }
     }
 
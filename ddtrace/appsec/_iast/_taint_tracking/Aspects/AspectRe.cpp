@@ -0,0 +1,811 @@
+#include "AspectRe.h"
+#include "Initializer/Initializer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <initializer_list>
+#include <vector>
+
+/**
+ * Aspects of the re module: the substitutions and the splits with a pattern, and the groups of a match.
+ *
+ * The ranges of the results follow from the offsets of the matches, which Match.span() and Match.regs give from the
+ * offsets the _sre objects keep, so no part of a result is searched back in the text. Substitutions and splits are
+ * made here from the matches of Pattern.finditer(), which finds them as the methods do, so that each piece of the
+ * result is known along with where it comes from. The calls on other objects, or with no tainted text, are left to
+ * the methods.
+ */
+
+using Span = std::pair<Py_ssize_t, Py_ssize_t>;
+
+static PyObject* re_module = nullptr;
+static PyObject* re_pattern_type = nullptr;
+static PyObject* re_match_type = nullptr;
+
+static bool
+load_re()
+{
+    if (re_module != nullptr) {
+        return true;
+    }
+    PyObject* module = PyImport_ImportModule("re");
+    if (module == nullptr) {
+        PyErr_Clear();
+        return false;
+    }
+    PyObject* pattern_type = PyObject_GetAttrString(module, "Pattern");
+    PyObject* match_type = pattern_type == nullptr ? nullptr : PyObject_GetAttrString(module, "Match");
+    if (match_type == nullptr) {
+        PyErr_Clear();
+        Py_XDECREF(pattern_type);
+        Py_DECREF(module);
+        return false;
+    }
+    re_module = module;
+    re_pattern_type = pattern_type;
+    re_match_type = match_type;
+    return true;
+}
+
+static bool
+is_re_module(PyObject* obj)
+{
+    return load_re() and obj == re_module;
+}
+
+static bool
+is_re_pattern(PyObject* obj)
+{
+    return load_re() and Py_TYPE(obj) == reinterpret_cast<PyTypeObject*>(re_pattern_type);
+}
+
+static bool
+is_re_match(PyObject* obj)
+{
+    return load_re() and Py_TYPE(obj) == reinterpret_cast<PyTypeObject*>(re_match_type);
+}
+
+bool
+is_re_split_receiver(PyObject* receiver)
+{
+    return is_re_module(receiver) or is_re_pattern(receiver);
+}
+
+static PyObject*
+call_method(PyObject* receiver, PyObject* method_name, PyObject* const* args, const Py_ssize_t nargs, PyObject* kwnames)
+{
+    PyObject* method = PyObject_GetAttr(receiver, method_name);
+    if (method == nullptr) {
+        return nullptr;
+    }
+    PyObject* result = call_function(method, args, nargs, kwnames);
+    Py_DECREF(method);
+    return result;
+}
+
+/**
+ * Binds the arguments of a call, in the vectorcall layout, to the parameters with the given names. Returns false if
+ * they don't bind or one of the first `required` parameters is missing, in which case the method itself is called,
+ * and raises the error if there is one.
+ */
+static bool
+bind_arguments(PyObject* const* args,
+               const Py_ssize_t nargs,
+               PyObject* kwnames,
+               const std::initializer_list<const char*> names,
+               const size_t required,
+               PyObject** bound)
+{
+    if (static_cast<size_t>(nargs) > names.size()) {
+        return false;
+    }
+    std::fill(bound, bound + names.size(), nullptr);
+    std::copy(args, args + nargs, bound);
+    const Py_ssize_t nkwargs = kwnames == nullptr ? 0 : PyTuple_GET_SIZE(kwnames);
+    for (Py_ssize_t i = 0; i < nkwargs; i++) {
+        PyObject* keyword = PyTuple_GET_ITEM(kwnames, i);
+        const auto name = std::find_if(names.begin(), names.end(), [keyword](const char* name) {
+            return PyUnicode_CompareWithASCIIString(keyword, name) == 0;
+        });
+        if (name == names.end() or bound[name - names.begin()] != nullptr) {
+            return false;
+        }
+        bound[name - names.begin()] = args[nargs + i];
+    }
+    return std::all_of(bound, bound + required, [](PyObject* arg) { return arg != nullptr; });
+}
+
+// Reads an optional integer argument, or returns false, without an error, if it isn't one
+static bool
+ssize_argument(PyObject* arg, Py_ssize_t& value)
+{
+    value = 0;
+    if (arg == nullptr) {
+        return true;
+    }
+    value = PyNumber_AsSsize_t(arg, PyExc_OverflowError);
+    if (value == -1 and PyErr_Occurred()) {
+        PyErr_Clear();
+        return false;
+    }
+    return true;
+}
+
+// The pattern of a call on the re module, compiled as re.sub(pattern, ..., flags) compiles it
+static PyObject*
+compile_pattern(PyObject* pattern, PyObject* flags)
+{
+    static PyObject* compile = PyUnicode_InternFromString("compile");
+    if (flags == nullptr) {
+        return PyObject_CallMethodObjArgs(re_module, compile, pattern, nullptr);
+    }
+    return PyObject_CallMethodObjArgs(re_module, compile, pattern, flags, nullptr);
+}
+
+// A slice of a text, as _sre slices the text it matches: pieces of bytes-like texts are bytes
+static PyObject*
+text_slice(PyObject* text, const Py_ssize_t start, const Py_ssize_t end)
+{
+    if (PyUnicode_Check(text)) {
+        return PyUnicode_Substring(text, start, end);
+    }
+    if (PyBytes_CheckExact(text) and start == 0 and end == PyBytes_GET_SIZE(text)) {
+        Py_INCREF(text);
+        return text;
+    }
+    const char* data = PyBytes_Check(text) ? PyBytes_AS_STRING(text) : PyByteArray_AS_STRING(text);
+    return PyBytes_FromStringAndSize(data + start, end - start);
+}
+
+// Appends the ranges of the characters [start, end) of a text, moved to start at offset
+static void
+append_ranges(TaintRangeRefs& out,
+              const TaintRangesView& ranges,
+              const Py_ssize_t start,
+              const Py_ssize_t end,
+              const Py_ssize_t offset)
+{
+    if (start >= end) {
+        return;
+    }
+    for (const auto& range : ranges.intersecting(start, end)) {
+        const RANGE_START range_start = std::max<RANGE_START>(range.start, start);
+        const RANGE_START range_end = std::min<RANGE_START>(range.start + range.length, end);
+        out.emplace_back(offset + range_start - start, range_end - range_start, range.source);
+    }
+}
+
+/**
+ * Sets ranges on a new piece of a result. One-character strings may be shared by the interpreter, so a piece of one
+ * character is replaced by a copy of its own.
+ */
+static bool
+taint_piece(PyObject*& piece, const TaintRangeRefs& ranges, const TaintRangeMapTypePtr& tx_map)
+{
+    if (ranges.empty()) {
+        return true;
+    }
+    if ((PyUnicode_Check(piece) or PyBytes_Check(piece)) and PyObject_Length(piece) == 1) {
+        PyObject* copy = new_pyobject_id(piece);
+        if (copy == nullptr) {
+            return false;
+        }
+        Py_DECREF(piece);
+        piece = copy;
+    }
+    set_ranges(piece, ranges, tx_map);
+    return true;
+}
+
+// The slice [start, end) of text, with its ranges
+static PyObject*
+tainted_slice(PyObject* text,
+              const TaintRangesView& ranges,
+              const Py_ssize_t start,
+              const Py_ssize_t end,
+              const TaintRangeMapTypePtr& tx_map)
+{
+    PyObject* piece = text_slice(text, start, end);
+    if (piece == nullptr or piece == text) {
+        return piece;
+    }
+    TaintRangeRefs piece_ranges;
+    append_ranges(piece_ranges, ranges, start, end, 0);
+    if (not taint_piece(piece, piece_ranges, tx_map)) {
+        Py_DECREF(piece);
+        return nullptr;
+    }
+    return piece;
+}
+
+static bool
+parse_span(PyObject* span_tuple, Span& span)
+{
+    if (not PyTuple_Check(span_tuple) or PyTuple_GET_SIZE(span_tuple) != 2) {
+        PyErr_SetString(PyExc_TypeError, "invalid match span");
+        return false;
+    }
+    span.first = PyLong_AsSsize_t(PyTuple_GET_ITEM(span_tuple, 0));
+    span.second = PyLong_AsSsize_t(PyTuple_GET_ITEM(span_tuple, 1));
+    return not PyErr_Occurred();
+}
+
+static bool
+match_span(PyObject* match, Span& span)
+{
+    static PyObject* span_name = PyUnicode_InternFromString("span");
+    PyObject* span_tuple = PyObject_CallMethodObjArgs(match, span_name, nullptr);
+    if (span_tuple == nullptr) {
+        return false;
+    }
+    const bool parsed = parse_span(span_tuple, span);
+    Py_DECREF(span_tuple);
+    return parsed;
+}
+
+// The spans of all the groups of a match, the whole match first; those of the groups which didn't match are (-1, -1)
+static bool
+match_spans(PyObject* match, std::vector<Span>& spans)
+{
+    static PyObject* regs_name = PyUnicode_InternFromString("regs");
+    PyObject* regs = PyObject_GetAttr(match, regs_name);
+    if (regs == nullptr) {
+        return false;
+    }
+    if (not PyTuple_Check(regs)) {
+        Py_DECREF(regs);
+        PyErr_SetString(PyExc_TypeError, "invalid match spans");
+        return false;
+    }
+    spans.resize(PyTuple_GET_SIZE(regs));
+    for (Py_ssize_t i = 0; i < PyTuple_GET_SIZE(regs); i++) {
+        if (not parse_span(PyTuple_GET_ITEM(regs, i), spans[i])) {
+            Py_DECREF(regs);
+            return false;
+        }
+    }
+    Py_DECREF(regs);
+    return true;
+}
+
+static bool
+has_backslash(PyObject* text)
+{
+    if (PyUnicode_Check(text)) {
+        return PyUnicode_FindChar(text, '\\', 0, PyUnicode_GET_LENGTH(text), 1) >= 0;
+    }
+    const char* data = PyBytes_Check(text) ? PyBytes_AS_STRING(text) : PyByteArray_AS_STRING(text);
+    return memchr(data, '\\', PyObject_Length(text)) != nullptr;
+}
+
+static TaintRangeRefs
+ranges_copy(PyObject* obj, const TaintRangeMapTypePtr& tx_map)
+{
+    if (not is_text(obj)) {
+        return {};
+    }
+    const auto* tainted = get_tainted_object(obj, tx_map);
+    return tainted ? tainted->get_ranges_copy() : TaintRangeRefs{};
+}
+
+static PyObject*
+join_pieces(PyObject* text, PyObject* pieces)
+{
+    if (PyUnicode_Check(text)) {
+        PyObject* empty = PyUnicode_New(0, 0);
+        if (empty == nullptr) {
+            return nullptr;
+        }
+        PyObject* result = PyUnicode_Join(empty, pieces);
+        Py_DECREF(empty);
+        return result;
+    }
+    static PyObject* join_name = PyUnicode_InternFromString("join");
+    PyObject* empty = PyBytes_FromStringAndSize(nullptr, 0);
+    if (empty == nullptr) {
+        return nullptr;
+    }
+    PyObject* result = PyObject_CallMethodObjArgs(empty, join_name, pieces, nullptr);
+    Py_DECREF(empty);
+    return result;
+}
+
+/**
+ * Substitutes the matches of a pattern in a text, as re.sub and Pattern.sub do, or subn if with_count is true. The
+ * ranges of the text around the matches are moved to where the text ends up, and a replacement keeps its own ranges.
+ * A replacement expanded from a template may take the text of any group of the match, so it is tainted as a whole,
+ * with the source of the template if it is tainted, or else of the match.
+ */
+static PyObject*
+re_sub(PyObject* receiver,
+       PyObject* method_name,
+       PyObject* const* args,
+       const Py_ssize_t nargs,
+       PyObject* kwnames,
+       const bool with_count)
+{
+    const auto tx_map = initializer->get_tainting_map();
+    const bool module = is_re_module(receiver);
+    if (not tx_map or tx_map->empty() or not(module or is_re_pattern(receiver))) {
+        return call_method(receiver, method_name, args, nargs, kwnames);
+    }
+
+    PyObject* bound[5];
+    const bool is_bound =
+      module ? bind_arguments(args, nargs, kwnames, { "pattern", "repl", "string", "count", "flags" }, 3, bound)
+             : bind_arguments(args, nargs, kwnames, { "repl", "string", "count" }, 2, bound);
+    if (not is_bound) {
+        return call_method(receiver, method_name, args, nargs, kwnames);
+    }
+    PyObject* repl = bound[module ? 1 : 0];
+    PyObject* text = bound[module ? 2 : 1];
+    Py_ssize_t count;
+    if (not ssize_argument(bound[module ? 3 : 2], count) or not is_text(text)) {
+        return call_method(receiver, method_name, args, nargs, kwnames);
+    }
+    const bool callable = PyCallable_Check(repl);
+    // The methods raise the errors of the replacements which are neither callable nor of the type of the text
+    if (not callable and (not is_text(repl) or PyUnicode_Check(repl) != PyUnicode_Check(text))) {
+        return call_method(receiver, method_name, args, nargs, kwnames);
+    }
+    // Copied, as a callable replacement may set the ranges of the text again
+    const auto text_ranges = ranges_copy(text, tx_map);
+    const auto repl_ranges = callable ? TaintRangeRefs{} : ranges_copy(repl, tx_map);
+    if (text_ranges.empty() and repl_ranges.empty()) {
+        return call_method(receiver, method_name, args, nargs, kwnames);
+    }
+    const bool literal = not callable and not has_backslash(repl);
+
+    PyObject* pattern = module ? compile_pattern(bound[0], bound[4]) : (Py_INCREF(receiver), receiver);
+    if (pattern == nullptr) {
+        return nullptr;
+    }
+    static PyObject* finditer_name = PyUnicode_InternFromString("finditer");
+    static PyObject* expand_name = PyUnicode_InternFromString("expand");
+    PyObject* matches = PyObject_CallMethodObjArgs(pattern, finditer_name, text, nullptr);
+    Py_DECREF(pattern);
+    if (matches == nullptr) {
+        return nullptr;
+    }
+    PyObject* pieces = PyList_New(0);
+    if (pieces == nullptr) {
+        Py_DECREF(matches);
+        return nullptr;
+    }
+
+    TaintRangeRefs result_ranges;
+    Py_ssize_t last = 0;
+    Py_ssize_t position = 0;
+    Py_ssize_t n = 0;
+    PyObject* result = nullptr;
+    // No substitution for a negative count, as with the methods
+    while (count == 0 or n < count) {
+        PyObject* match = PyIter_Next(matches);
+        if (match == nullptr) {
+            break;
+        }
+        Span span;
+        PyObject* before = nullptr;
+        PyObject* replacement = nullptr;
+        if (match_span(match, span) and (before = text_slice(text, last, span.first)) != nullptr) {
+            if (callable) {
+                replacement = PyObject_CallFunctionObjArgs(repl, match, nullptr);
+            } else if (literal) {
+                Py_INCREF(repl);
+                replacement = repl;
+            } else {
+                replacement = PyObject_CallMethodObjArgs(match, expand_name, repl, nullptr);
+            }
+        }
+        if (replacement == nullptr or PyList_Append(pieces, before) != 0) {
+            Py_XDECREF(replacement);
+            Py_XDECREF(before);
+            Py_DECREF(match);
+            goto exit;
+        }
+        append_ranges(result_ranges, text_ranges, last, span.first, position);
+        position += span.first - last;
+        Py_DECREF(before);
+
+        if (replacement != Py_None) {
+            // Left to the join to raise the error if it isn't a text
+            const Py_ssize_t length = is_text(replacement) ? PyObject_Length(replacement) : 0;
+            if (literal) {
+                append_ranges(result_ranges, repl_ranges, 0, length, position);
+            } else if (callable) {
+                const auto replacement_ranges = ranges_copy(replacement, tx_map);
+                append_ranges(result_ranges, replacement_ranges, 0, length, position);
+            } else if (length > 0) {
+                const auto match_ranges = TaintRangesView(text_ranges).intersecting(span.first, span.second);
+                if (not repl_ranges.empty()) {
+                    result_ranges.emplace_back(position, length, repl_ranges[0].source);
+                } else if (not match_ranges.empty()) {
+                    result_ranges.emplace_back(position, length, match_ranges[0].source);
+                }
+            }
+            position += length;
+            if (PyList_Append(pieces, replacement) != 0) {
+                Py_DECREF(replacement);
+                Py_DECREF(match);
+                goto exit;
+            }
+        }
+        Py_DECREF(replacement);
+        Py_DECREF(match);
+        last = span.second;
+        n++;
+    }
+    if (PyErr_Occurred()) {
+        goto exit;
+    }
+    // Without a match, the template isn't compiled, and it is up to the method to raise its errors
+    if (n == 0 and not callable and not literal) {
+        result = call_method(receiver, method_name, args, nargs, kwnames);
+        goto exit;
+    }
+
+    {
+        PyObject* after = text_slice(text, last, PyObject_Length(text));
+        if (after == nullptr or PyList_Append(pieces, after) != 0) {
+            Py_XDECREF(after);
+            goto exit;
+        }
+        append_ranges(result_ranges, text_ranges, last, PyObject_Length(text), position);
+        Py_DECREF(after);
+    }
+
+    result = join_pieces(text, pieces);
+    if (result != nullptr and result != text and not result_ranges.empty()) {
+        set_ranges(result, result_ranges, tx_map);
+    }
+    if (result != nullptr and with_count) {
+        result = Py_BuildValue("(Nn)", result, n);
+    }
+
+exit:
+    Py_DECREF(matches);
+    Py_DECREF(pieces);
+    return result;
+}
+
+PyObject*
+re_split(PyObject* receiver, PyObject* const* args, const Py_ssize_t nargs, PyObject* kwnames)
+{
+    static PyObject* method_name = PyUnicode_InternFromString("split");
+    const auto tx_map = initializer->get_tainting_map();
+    const bool module = is_re_module(receiver);
+    if (not tx_map or tx_map->empty()) {
+        return call_method(receiver, method_name, args, nargs, kwnames);
+    }
+
+    PyObject* bound[4];
+    const bool is_bound =
+      module ? bind_arguments(args, nargs, kwnames, { "pattern", "string", "maxsplit", "flags" }, 2, bound)
+             : bind_arguments(args, nargs, kwnames, { "string", "maxsplit" }, 1, bound);
+    if (not is_bound) {
+        return call_method(receiver, method_name, args, nargs, kwnames);
+    }
+    PyObject* text = bound[module ? 1 : 0];
+    Py_ssize_t maxsplit;
+    if (not ssize_argument(bound[module ? 2 : 1], maxsplit) or not is_text(text)) {
+        return call_method(receiver, method_name, args, nargs, kwnames);
+    }
+    const auto text_ranges = ranges_copy(text, tx_map);
+    if (text_ranges.empty()) {
+        return call_method(receiver, method_name, args, nargs, kwnames);
+    }
+
+    PyObject* pattern = module ? compile_pattern(bound[0], bound[3]) : (Py_INCREF(receiver), receiver);
+    if (pattern == nullptr) {
+        return nullptr;
+    }
+    static PyObject* finditer_name = PyUnicode_InternFromString("finditer");
+    PyObject* matches = PyObject_CallMethodObjArgs(pattern, finditer_name, text, nullptr);
+    Py_DECREF(pattern);
+    if (matches == nullptr) {
+        return nullptr;
+    }
+    PyObject* parts = PyList_New(0);
+    if (parts == nullptr) {
+        Py_DECREF(matches);
+        return nullptr;
+    }
+
+    std::vector<Span> spans;
+    Py_ssize_t last = 0;
+    Py_ssize_t n = 0;
+    bool failed = false;
+    // No split for a negative maxsplit, as with the methods
+    while (not failed and (maxsplit == 0 or n < maxsplit)) {
+        PyObject* match = PyIter_Next(matches);
+        if (match == nullptr) {
+            break;
+        }
+        failed = not match_spans(match, spans);
+        Py_DECREF(match);
+        // The text before the match, then the groups of the pattern
+        for (size_t i = 0; not failed and i < spans.size(); i++) {
+            const auto [start, end] = i == 0 ? Span(last, spans[0].first) : spans[i];
+            PyObject* part =
+              start < 0 ? (Py_INCREF(Py_None), Py_None) : tainted_slice(text, text_ranges, start, end, tx_map);
+            failed = part == nullptr or PyList_Append(parts, part) != 0;
+            Py_XDECREF(part);
+        }
+        if (not failed) {
+            last = spans[0].second;
+            n++;
+        }
+    }
+    if (not failed and not PyErr_Occurred()) {
+        PyObject* part = tainted_slice(text, text_ranges, last, PyObject_Length(text), tx_map);
+        failed = part == nullptr or PyList_Append(parts, part) != 0;
+        Py_XDECREF(part);
+    }
+    Py_DECREF(matches);
+    if (failed or PyErr_Occurred()) {
+        Py_DECREF(parts);
+        return nullptr;
+    }
+    return parts;
+}
+
+// The number of a group of a match given by its number or its name, or -1 if there is no such group
+static Py_ssize_t
+group_number(PyObject* match, PyObject* group)
+{
+    if (PyIndex_Check(group)) {
+        const auto number = PyNumber_AsSsize_t(group, nullptr);
+        if (number == -1 and PyErr_Occurred()) {
+            PyErr_Clear();
+        }
+        return number;
+    }
+    static PyObject* re_name = PyUnicode_InternFromString("re");
+    static PyObject* groupindex_name = PyUnicode_InternFromString("groupindex");
+    PyObject* pattern = PyObject_GetAttr(match, re_name);
+    PyObject* groupindex = pattern == nullptr ? nullptr : PyObject_GetAttr(pattern, groupindex_name);
+    PyObject* number = groupindex == nullptr ? nullptr : PyObject_GetItem(groupindex, group);
+    Py_XDECREF(pattern);
+    Py_XDECREF(groupindex);
+    if (number == nullptr) {
+        PyErr_Clear();
+        return -1;
+    }
+    const auto result = PyLong_AsSsize_t(number);
+    Py_DECREF(number);
+    if (result == -1 and PyErr_Occurred()) {
+        PyErr_Clear();
+    }
+    return result;
+}
+
+// The value of a group with the ranges of the text it spans, as a new reference
+static PyObject*
+tainted_group(PyObject* value,
+              const TaintRangesView& ranges,
+              const std::vector<Span>& spans,
+              const Py_ssize_t group,
+              const TaintRangeMapTypePtr& tx_map)
+{
+    Py_INCREF(value);
+    if (group < 0 or static_cast<size_t>(group) >= spans.size() or spans[group].first < 0 or not is_text(value) or
+        PyObject_Length(value) != spans[group].second - spans[group].first) {
+        return value;
+    }
+    TaintRangeRefs group_ranges;
+    append_ranges(group_ranges, ranges, spans[group].first, spans[group].second, 0);
+    if (not taint_piece(value, group_ranges, tx_map)) {
+        Py_DECREF(value);
+        return nullptr;
+    }
+    return value;
+}
+
+using SetRangesOnGroups = PyObject* (*)(PyObject* match,
+                                        PyObject* const* args,
+                                        Py_ssize_t nargs,
+                                        PyObject* result,
+                                        const TaintRangesView& ranges,
+                                        const std::vector<Span>& spans,
+                                        const TaintRangeMapTypePtr& tx_map);
+
+// Match.group(): a single value for zero or one group, or a tuple of them
+static PyObject*
+set_ranges_on_group(PyObject* match,
+                    PyObject* const* args,
+                    const Py_ssize_t nargs,
+                    PyObject* result,
+                    const TaintRangesView& ranges,
+                    const std::vector<Span>& spans,
+                    const TaintRangeMapTypePtr& tx_map)
+{
+    if (nargs <= 1) {
+        return tainted_group(result, ranges, spans, nargs == 0 ? 0 : group_number(match, args[0]), tx_map);
+    }
+    if (not PyTuple_Check(result) or PyTuple_GET_SIZE(result) != nargs) {
+        Py_INCREF(result);
+        return result;
+    }
+    PyObject* values = PyTuple_New(nargs);
+    for (Py_ssize_t i = 0; values != nullptr and i < nargs; i++) {
+        PyObject* value =
+          tainted_group(PyTuple_GET_ITEM(result, i), ranges, spans, group_number(match, args[i]), tx_map);
+        if (value == nullptr) {
+            Py_CLEAR(values);
+            break;
+        }
+        PyTuple_SET_ITEM(values, i, value);
+    }
+    return values;
+}
+
+// Match.groups(): a tuple with the values of all the groups
+static PyObject*
+set_ranges_on_groups(PyObject*,
+                     PyObject* const*,
+                     Py_ssize_t,
+                     PyObject* result,
+                     const TaintRangesView& ranges,
+                     const std::vector<Span>& spans,
+                     const TaintRangeMapTypePtr& tx_map)
+{
+    if (not PyTuple_Check(result)) {
+        Py_INCREF(result);
+        return result;
+    }
+    const auto size = PyTuple_GET_SIZE(result);
+    PyObject* values = PyTuple_New(size);
+    for (Py_ssize_t i = 0; values != nullptr and i < size; i++) {
+        PyObject* value = tainted_group(PyTuple_GET_ITEM(result, i), ranges, spans, i + 1, tx_map);
+        if (value == nullptr) {
+            Py_CLEAR(values);
+            break;
+        }
+        PyTuple_SET_ITEM(values, i, value);
+    }
+    return values;
+}
+
+// Match.groupdict(): a new dict of the values of the named groups, whose values are replaced in place
+static PyObject*
+set_ranges_on_groupdict(PyObject* match,
+                        PyObject* const*,
+                        Py_ssize_t,
+                        PyObject* result,
+                        const TaintRangesView& ranges,
+                        const std::vector<Span>& spans,
+                        const TaintRangeMapTypePtr& tx_map)
+{
+    Py_INCREF(result);
+    if (not PyDict_Check(result)) {
+        return result;
+    }
+    Py_ssize_t pos = 0;
+    PyObject* name;
+    PyObject* value;
+    while (PyDict_Next(result, &pos, &name, &value)) {
+        PyObject* tainted = tainted_group(value, ranges, spans, group_number(match, name), tx_map);
+        // Replacing the value of an existing key doesn't change the dict as it is iterated
+        if (tainted == nullptr or PyDict_SetItem(result, name, tainted) != 0) {
+            Py_XDECREF(tainted);
+            Py_DECREF(result);
+            return nullptr;
+        }
+        Py_DECREF(tainted);
+    }
+    return result;
+}
+
+/**
+ * Calls the original function, if the AST patching passed one, as split_aspect does, and returns whether it did. The
+ * arguments are those of the aspects of aspects.py: the original function (or None), the number of arguments added
+ * by the patching, the object the method is called on, and the arguments of the method.
+ */
+static bool
+call_original(PyObject* const* args, const Py_ssize_t nargs, PyObject* kwnames, PyObject** result)
+{
+    PyObject* orig_function = args[0];
+    if (orig_function == Py_None) {
+        return false;
+    }
+    const long flag_added_args = PyLong_AsLong(args[1]);
+    if (flag_added_args == -1 and PyErr_Occurred()) {
+        *result = nullptr;
+        return true;
+    }
+    const Py_ssize_t n_added_args = std::clamp<Py_ssize_t>(flag_added_args, 0, nargs - 2);
+    *result = call_function(orig_function, args + 2 + n_added_args, nargs - 2 - n_added_args, kwnames);
+    return true;
+}
+
+static PyObject*
+re_match_aspect(PyObject* method_name,
+                PyObject* const* args,
+                const Py_ssize_t nargs,
+                PyObject* kwnames,
+                SetRangesOnGroups set_ranges_on_groups_of)
+{
+    if (nargs < 3) {
+        py::set_error(PyExc_ValueError, MSG_ERROR_N_PARAMS);
+        return nullptr;
+    }
+    PyObject* result;
+    if (call_original(args, nargs, kwnames, &result)) {
+        return result;
+    }
+    PyObject* match = args[2];
+    result = call_method(match, method_name, args + 3, nargs - 3, kwnames);
+    if (result == nullptr or not is_re_match(match)) {
+        return result;
+    }
+    const auto tx_map = initializer->get_tainting_map();
+    if (not tx_map or tx_map->empty()) {
+        return result;
+    }
+
+    static PyObject* string_name = PyUnicode_InternFromString("string");
+    PyObject* text = PyObject_GetAttr(match, string_name);
+    if (text == nullptr) {
+        PyErr_Clear();
+        return result;
+    }
+    const auto text_ranges = ranges_copy(text, tx_map);
+    Py_DECREF(text);
+    std::vector<Span> spans;
+    if (text_ranges.empty() or not match_spans(match, spans)) {
+        PyErr_Clear();
+        return result;
+    }
+    PyObject* tainted = set_ranges_on_groups_of(match, args + 3, nargs - 3, result, text_ranges, spans, tx_map);
+    Py_DECREF(result);
+    return tainted;
+}
+
+static PyObject*
+re_sub_aspect(PyObject* method_name, PyObject* const* args, const Py_ssize_t nargs, PyObject* kwnames, bool with_count)
+{
+    if (nargs < 3) {
+        py::set_error(PyExc_ValueError, MSG_ERROR_N_PARAMS);
+        return nullptr;
+    }
+    PyObject* result;
+    if (call_original(args, nargs, kwnames, &result)) {
+        return result;
+    }
+    return re_sub(args[2], method_name, args + 3, nargs - 3, kwnames, with_count);
+}
+
+PyObject*
+api_re_sub_aspect(PyObject* self, PyObject* const* args, const Py_ssize_t nargs, PyObject* kwnames)
+{
+    static PyObject* method_name = PyUnicode_InternFromString("sub");
+    return re_sub_aspect(method_name, args, nargs, kwnames, false);
+}
+
+PyObject*
+api_re_subn_aspect(PyObject* self, PyObject* const* args, const Py_ssize_t nargs, PyObject* kwnames)
+{
+    static PyObject* method_name = PyUnicode_InternFromString("subn");
+    return re_sub_aspect(method_name, args, nargs, kwnames, true);
+}
+
+PyObject*
+api_re_group_aspect(PyObject* self, PyObject* const* args, const Py_ssize_t nargs, PyObject* kwnames)
+{
+    static PyObject* method_name = PyUnicode_InternFromString("group");
+    return re_match_aspect(method_name, args, nargs, kwnames, set_ranges_on_group);
+}
+
+PyObject*
+api_re_groups_aspect(PyObject* self, PyObject* const* args, const Py_ssize_t nargs, PyObject* kwnames)
+{
+    static PyObject* method_name = PyUnicode_InternFromString("groups");
+    return re_match_aspect(method_name, args, nargs, kwnames, set_ranges_on_groups);
+}
+
+PyObject*
+api_re_groupdict_aspect(PyObject* self, PyObject* const* args, const Py_ssize_t nargs, PyObject* kwnames)
+{
+    static PyObject* method_name = PyUnicode_InternFromString("groupdict");
+    return re_match_aspect(method_name, args, nargs, kwnames, set_ranges_on_groupdict);
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "Helpers.h"
+
+// Whether a split call on the object is one of the re module, as re.split or Pattern.split
+bool
+is_re_split_receiver(PyObject* receiver);
+
+// Splits with the re module, args being the arguments of re.split or Pattern.split depending on the receiver
+PyObject*
+re_split(PyObject* receiver, PyObject* const* args, Py_ssize_t nargs, PyObject* kwnames);
+
+PyObject*
+api_re_sub_aspect(PyObject* self, PyObject* const* args, Py_ssize_t nargs, PyObject* kwnames);
+
+PyObject*
+api_re_subn_aspect(PyObject* self, PyObject* const* args, Py_ssize_t nargs, PyObject* kwnames);
+
+PyObject*
+api_re_group_aspect(PyObject* self, PyObject* const* args, Py_ssize_t nargs, PyObject* kwnames);
+
+PyObject*
+api_re_groups_aspect(PyObject* self, PyObject* const* args, Py_ssize_t nargs, PyObject* kwnames);
+
+PyObject*
+api_re_groupdict_aspect(PyObject* self, PyObject* const* args, Py_ssize_t nargs, PyObject* kwnames);
@@ -1,115 +1,82 @@
 #include "AspectSlice.h"
 
+#include <iterator>
+
 /**
- * This function reduces the taint ranges from the given index range map.
+ * This function computes the taint ranges of a slice of a tainted text.
+ *
+ * The characters of the slice come from the positions start, start + step, start + 2 * step... of the text, so the
+ * characters taken from each range of the text are contiguous in the slice. Only the ranges intersecting the
+ * positions taken are visited.
  *
- * @param index_range_map The index range map from which the taint ranges are to be reduced.
+ * @param ranges The ranges of the sliced text.
+ * @param start The first position taken, adjusted to the length of the text.
+ * @param step The step of the slice, not 0.
+ * @param slice_length The number of characters of the slice.
  *
- * @return A map of taint ranges for the given index range map.
+ * @return The taint ranges of the slice.
  */
-TaintRangeRefs
-reduce_ranges_from_index_range_map(const TaintRangeRefs& index_range_map)
+static TaintRangeRefs
+slice_ranges(const TaintRangesView& ranges,
+             const Py_ssize_t start,
+             const Py_ssize_t step,
+             const Py_ssize_t slice_length)
 {
     TaintRangeRefs new_ranges;
-    TaintRangePtr current_range;
-    size_t current_start = 0;
-    size_t index;
-
-    for (index = 0; index < index_range_map.size(); ++index) {
-        if (const auto& taint_range{ index_range_map.at(index) }; taint_range != current_range) {
-            if (current_range) {
-                new_ranges.emplace_back(
-                  initializer->allocate_taint_range(current_start, index - current_start, current_range->source));
-            }
-            current_range = taint_range;
-            current_start = index;
-        }
+    if (slice_length <= 0) {
+        return new_ranges;
     }
-    if (current_range != nullptr) {
-        new_ranges.emplace_back(
-          initializer->allocate_taint_range(current_start, index - current_start, current_range->source));
-    }
-    return new_ranges;
-}
+    const Py_ssize_t last = start + (slice_length - 1) * step;
+    const auto window = step > 0 ? ranges.intersecting(start, last + 1) : ranges.intersecting(last, start + 1);
+    new_ranges.reserve(window.size());
 
-/**
- * This function builds a map of taint ranges for the given text object.
- *
- * @param text The text object for which the taint ranges are to be built.
- * @param ranges The taint range map that stores taint information.
- * @param start The start index of the text object.
- * @param stop The stop index of the text object.
- * @param step The step index of the text object.
- *
- * @return A map of taint ranges for the given text object.
- */
-TaintRangeRefs
-build_index_range_map(PyObject* text, TaintRangeRefs& ranges, PyObject* start, PyObject* stop, PyObject* step)
-{
-    TaintRangeRefs index_range_map;
-    long long index = 0;
-    for (const auto& taint_range : ranges) {
-        auto shared_range = taint_range;
-        while (index < taint_range->start) {
-            index_range_map.emplace_back(nullptr);
-            index++;
-        }
-        while (index < (taint_range->start + taint_range->length)) {
-            index_range_map.emplace_back(shared_range);
-            index++;
+    const auto add_range = [&](const TaintRange& range) {
+        const Py_ssize_t range_end = range.start + range.length;
+        Py_ssize_t first_taken;
+        Py_ssize_t end_taken;
+        if (step > 0) {
+            first_taken = (std::max<Py_ssize_t>(range.start, start) - start + step - 1) / step;
+            end_taken = (range_end - start + step - 1) / step;
+        } else {
+            first_taken = start >= range_end ? (start - range_end) / -step + 1 : 0;
+            end_taken = (start - range.start) / -step + 1;
         }
-    }
-    long length_text = static_cast<long long>(py::len(text));
-    while (index < length_text) {
-        index_range_map.emplace_back(nullptr);
-        index++;
-    }
-    TaintRangeRefs index_range_map_result;
-    long start_int = PyLong_AsLong(start);
-    if (start_int < 0) {
-        start_int = length_text + start_int;
-        if (start_int < 0) {
-            start_int = 0;
+        end_taken = std::min(end_taken, slice_length);
+        if (first_taken < end_taken) {
+            new_ranges.emplace_back(first_taken, end_taken - first_taken, range.source);
         }
+    };
+    // With a negative step the last ranges of the text come first in the slice
+    if (step > 0) {
+        std::for_each(window.begin(), window.end(), add_range);
+    } else {
+        std::for_each(
+          std::make_reverse_iterator(window.end()), std::make_reverse_iterator(window.begin()), add_range);
     }
-    long stop_int = length_text;
-    if (stop != nullptr) {
-        stop_int = PyLong_AsLong(stop);
-        if (stop_int > length_text) {
-            stop_int = length_text;
-        } else if (stop_int < 0) {
-            stop_int = length_text + stop_int;
-            if (stop_int < 0) {
-                stop_int = 0;
-            }
-        }
-    }
-    long step_int = 1;
-    if (step != nullptr) {
-        step_int = PyLong_AsLong(step);
-    }
-    for (auto i = start_int; i < stop_int; i += step_int) {
-        index_range_map_result.emplace_back(index_range_map[i]);
-    }
-
-    return index_range_map_result;
+    return new_ranges;
 }
 
 PyObject*
-slice_aspect(PyObject* result_o, PyObject* candidate_text, PyObject* start, PyObject* stop, PyObject* step)
+slice_aspect(PyObject* result_o, PyObject* candidate_text, PyObject* slice)
 {
     auto ctx_map = initializer->get_tainting_map();
 
-    if (not ctx_map or ctx_map->empty()) {
+    if (not result_o or not ctx_map or ctx_map->empty() or not is_text(candidate_text)) {
         return result_o;
     }
-    auto [ranges, ranges_error] = get_ranges(candidate_text, ctx_map);
-    if (ranges_error or ranges.empty()) {
+    const auto& to_candidate_text = get_tainted_object(candidate_text, ctx_map);
+    if (not to_candidate_text) {
         return result_o;
     }
-    set_ranges(result_o,
-               reduce_ranges_from_index_range_map(build_index_range_map(candidate_text, ranges, start, stop, step)),
-               ctx_map);
+    Py_ssize_t start;
+    Py_ssize_t stop;
+    Py_ssize_t step;
+    if (PySlice_Unpack(slice, &start, &stop, &step) < 0) {
+        PyErr_Clear();
+        return result_o;
+    }
+    const auto slice_length = PySlice_AdjustIndices(PyObject_Length(candidate_text), &start, &stop, step);
+    set_ranges(result_o, slice_ranges(to_candidate_text->get_ranges(), start, step, slice_length), ctx_map);
     return result_o;
 }
 
@@ -120,8 +87,8 @@ api_slice_aspect(PyObject* self, PyObject* const* args, Py_ssize_t nargs)
         return nullptr;
     }
     PyObject* candidate_text = args[0];
-    PyObject* start = PyLong_FromLong(0);
-
+    // None, as for a missing stop, so that a negative step starts from the end
+    PyObject* start = nullptr;
     if (PyNumber_Check(args[1])) {
         start = PyNumber_Long(args[1]);
     }
@@ -152,7 +119,7 @@ api_slice_aspect(PyObject* self, PyObject* const* args, Py_ssize_t nargs)
     }
     PyObject* result = PyObject_GetItem(candidate_text, slice);
 
-    auto res = slice_aspect(result, candidate_text, start, stop, step);
+    auto res = slice_aspect(result, candidate_text, slice);
 
     if (start != nullptr) {
         Py_DecRef(start);
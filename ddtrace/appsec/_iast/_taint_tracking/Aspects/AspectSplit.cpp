@@ -1,72 +1,269 @@
 #include "AspectSplit.h"
+#include "AspectRe.h"
 #include "Initializer/Initializer.h"
 
-template<class StrType>
-py::list
-api_split_text(const StrType& text, const optional<StrType>& separator, const optional<int> maxsplit)
+#include <algorithm>
+
+/**
+ * Sets on each part of a split text the ranges of the text it covers.
+ *
+ * The parts are in the order of the text and the split knows what separates them, so part_start(position, part,
+ * first) returns where a part starts from the end of the previous one (0 for the first part) without searching
+ * the part in the text. The ranges of the text are sorted, so they are swept once along the parts.
+ */
+template<class PartStart>
+static void
+set_ranges_on_parts(PyObject* text,
+                    const TaintRangesView& ranges,
+                    PyObject* parts,
+                    const TaintRangeMapTypePtr& tx_map,
+                    PartStart part_start)
 {
-    const auto split = text.attr("split");
-    const auto split_result = split(separator, maxsplit);
+    const auto text_length = PyObject_Length(text);
+    const auto num_parts = PyList_GET_SIZE(parts);
+    auto range = ranges.begin();
+    Py_ssize_t position = 0;
+    TaintRangeRefs part_ranges;
 
-    const auto tx_map = initializer->get_tainting_map();
-    if (not tx_map or tx_map->empty()) {
-        return split_result;
+    for (Py_ssize_t i = 0; i < num_parts and range != ranges.end(); i++) {
+        PyObject* part = PyList_GET_ITEM(parts, i);
+        const auto start = part_start(position, part, i == 0);
+        const auto end = start + PyObject_Length(part);
+        if (end > text_length) {
+            break;
+        }
+        position = end;
+        // A text that isn't split is its own only part, and keeps its ranges
+        if (start == end or part == text) {
+            continue;
+        }
+
+        while (range != ranges.end() and range->start + range->length <= start) {
+            ++range;
+        }
+        part_ranges.clear();
+        for (auto r = range; r != ranges.end() and r->start < end; ++r) {
+            const auto range_start = std::max<RANGE_START>(r->start, start);
+            const auto range_end = std::min<RANGE_START>(r->start + r->length, end);
+            part_ranges.emplace_back(range_start - start, range_end - range_start, r->source);
+        }
+        if (not part_ranges.empty()) {
+            set_ranges(part, part_ranges, tx_map);
+        }
     }
+}
 
-    if (auto ranges = api_get_ranges(text); not ranges.empty()) {
-        set_ranges_on_splitted(text, ranges, split_result, tx_map, false);
+static bool
+is_split_whitespace(const bool is_unicode, const Py_UCS4 c)
+{
+    if (is_unicode) {
+        return Py_UNICODE_ISSPACE(c);
     }
+    return c < 128 and Py_ISSPACE(c);
+}
 
-    return split_result;
+/**
+ * Returns the argument of a method call in the vectorcall layout given by its position or its keyword, or nullptr if
+ * the call doesn't pass it.
+ */
+static PyObject*
+get_argument(PyObject* const* args,
+             const Py_ssize_t nargs,
+             PyObject* kwnames,
+             const Py_ssize_t position,
+             const char* keyword)
+{
+    if (position < nargs) {
+        return args[position];
+    }
+    if (kwnames == nullptr) {
+        return nullptr;
+    }
+    for (Py_ssize_t i = 0; i < PyTuple_GET_SIZE(kwnames); i++) {
+        if (PyUnicode_CompareWithASCIIString(PyTuple_GET_ITEM(kwnames, i), keyword) == 0) {
+            return args[nargs + i];
+        }
+    }
+    return nullptr;
 }
 
-template<class StrType>
-py::list
-api_rsplit_text(const StrType& text, const optional<StrType>& separator, const optional<int> maxsplit)
+/**
+ * Sets the ranges of the parts of text split by the separator of the call, or by runs of whitespace if there is no
+ * separator. split and rsplit take the same arguments.
+ */
+static void
+set_ranges_on_split(PyObject* text,
+                    PyObject* const* args,
+                    const Py_ssize_t nargs,
+                    PyObject* kwnames,
+                    PyObject* parts,
+                    const TaintRangeMapTypePtr& tx_map)
 {
-    const auto rsplit = text.attr("rsplit");
-    const auto split_result = rsplit(separator, maxsplit);
-    const auto tx_map = initializer->get_tainting_map();
-    if (not tx_map or tx_map->empty()) {
-        return split_result;
+    const auto& to_text = get_tainted_object(text, tx_map);
+    if (not to_text) {
+        return;
     }
+    const auto ranges = to_text->get_ranges();
 
-    if (auto ranges = api_get_ranges(text); not ranges.empty()) {
-        set_ranges_on_splitted(text, ranges, split_result, tx_map, false);
+    if (PyObject* separator = get_argument(args, nargs, kwnames, 0, "sep");
+        separator != nullptr and separator != Py_None) {
+        const auto separator_length = PyObject_Length(separator);
+        set_ranges_on_parts(text, ranges, parts, tx_map, [&](Py_ssize_t position, PyObject*, bool first) {
+            return first ? 0 : position + separator_length;
+        });
+        return;
     }
-    return split_result;
+    const bool is_unicode = PyUnicode_Check(text);
+    const TextChars chars(text);
+    const auto text_length = PyObject_Length(text);
+    set_ranges_on_parts(text, ranges, parts, tx_map, [&](Py_ssize_t position, PyObject* part, bool) {
+        // Only the rest of the text left unsplit by maxsplit may start with whitespace, and it starts right away
+        if (PyObject_Length(part) > 0 and is_split_whitespace(is_unicode, TextChars(part)[0])) {
+            return position;
+        }
+        while (position < text_length and is_split_whitespace(is_unicode, chars[position])) {
+            position++;
+        }
+        return position;
+    });
 }
 
-template<class StrType>
-py::list
-api_splitlines_text(const StrType& text, bool keepends)
+static void
+set_ranges_on_splitlines(PyObject* text,
+                         PyObject* const* args,
+                         const Py_ssize_t nargs,
+                         PyObject* kwnames,
+                         PyObject* parts,
+                         const TaintRangeMapTypePtr& tx_map)
 {
-    const auto splitlines = text.attr("splitlines");
-    const auto split_result = splitlines(keepends);
+    const auto& to_text = get_tainted_object(text, tx_map);
+    if (not to_text) {
+        return;
+    }
+    PyObject* keepends_arg = get_argument(args, nargs, kwnames, 0, "keepends");
+    const bool keepends = keepends_arg != nullptr and PyObject_IsTrue(keepends_arg) == 1;
+    const TextChars chars(text);
+    const auto text_length = PyObject_Length(text);
+    set_ranges_on_parts(text, to_text->get_ranges(), parts, tx_map, [&](Py_ssize_t position, PyObject*, bool first) {
+        if (first or keepends) {
+            return position;
+        }
+        // Lines end with a single character, except for \r\n
+        if (chars[position] == '\r' and position + 1 < text_length and chars[position + 1] == '\n') {
+            return position + 2;
+        }
+        return position + 1;
+    });
+}
+
+using SetRangesOnParts = void (*)(PyObject*, PyObject* const*, Py_ssize_t, PyObject*, PyObject*,
+                                  const TaintRangeMapTypePtr&);
+
+/**
+ * Calls a splitting method of a text object, args[0], with the rest of the arguments and sets on the parts the ranges
+ * of the text they cover.
+ */
+static PyObject*
+split_text(PyObject* method_name,
+           PyObject* const* args,
+           const Py_ssize_t nargs,
+           PyObject* kwnames,
+           SetRangesOnParts set_ranges_on_parts_of)
+{
+    if (nargs < 1) {
+        py::set_error(PyExc_ValueError, MSG_ERROR_N_PARAMS);
+        return nullptr;
+    }
+    PyObject* text = args[0];
+    PyObject* method = PyObject_GetAttr(text, method_name);
+    if (method == nullptr) {
+        return nullptr;
+    }
+    PyObject* parts = call_function(method, args + 1, nargs - 1, kwnames);
+    Py_DECREF(method);
+    if (parts == nullptr or not is_text(text) or not PyList_Check(parts)) {
+        return parts;
+    }
+
     const auto tx_map = initializer->get_tainting_map();
     if (not tx_map or tx_map->empty()) {
-        return split_result;
+        return parts;
+    }
+    set_ranges_on_parts_of(text, args + 1, nargs - 1, kwnames, parts, tx_map);
+    return parts;
+}
+
+/**
+ * The same as split_text with the arguments of the aspects of aspects.py: the original function (or None), the number
+ * of arguments added by the AST patching, the text object, and the arguments of the method.
+ */
+static PyObject*
+split_aspect(PyObject* method_name,
+             PyObject* const* args,
+             const Py_ssize_t nargs,
+             PyObject* kwnames,
+             SetRangesOnParts set_ranges_on_parts_of)
+{
+    if (nargs < 2) {
+        py::set_error(PyExc_ValueError, MSG_ERROR_N_PARAMS);
+        return nullptr;
     }
 
-    if (auto ranges = api_get_ranges(text); not ranges.empty()) {
-        set_ranges_on_splitted(text, ranges, split_result, tx_map, keepends);
+    PyObject* orig_function = args[0];
+    if (orig_function != Py_None and orig_function != reinterpret_cast<PyObject*>(&PyUnicode_Type)) {
+        const long flag_added_args = PyLong_AsLong(args[1]);
+        if (flag_added_args == -1 and PyErr_Occurred()) {
+            return nullptr;
+        }
+        // Same as slicing the arguments in Python
+        const Py_ssize_t n_added_args = std::clamp<Py_ssize_t>(flag_added_args, 0, nargs - 2);
+        return call_function(orig_function, args + 2 + n_added_args, nargs - 2 - n_added_args, kwnames);
+    }
+    // Pattern.split() and re.split() split with the matches of a pattern
+    if (PyUnicode_CompareWithASCIIString(method_name, "split") == 0 and is_re_split_receiver(args[2])) {
+        return re_split(args[2], args + 3, nargs - 3, kwnames);
     }
-    return split_result;
+    return split_text(method_name, args + 2, nargs - 2, kwnames, set_ranges_on_parts_of);
+}
+
+PyObject*
+api_split_text(PyObject* self, PyObject* const* args, const Py_ssize_t nargs, PyObject* kwnames)
+{
+    static PyObject* method_name = PyUnicode_InternFromString("split");
+    return split_text(method_name, args, nargs, kwnames, set_ranges_on_split);
+}
+
+PyObject*
+api_rsplit_text(PyObject* self, PyObject* const* args, const Py_ssize_t nargs, PyObject* kwnames)
+{
+    static PyObject* method_name = PyUnicode_InternFromString("rsplit");
+    return split_text(method_name, args, nargs, kwnames, set_ranges_on_split);
 }
 
-void
-pyexport_aspect_split(py::module& m)
+PyObject*
+api_splitlines_text(PyObject* self, PyObject* const* args, const Py_ssize_t nargs, PyObject* kwnames)
 {
-    m.def("_aspect_split", &api_split_text<py::str>, "text"_a, "separator"_a = py::none(), "maxsplit"_a = -1);
-    m.def("_aspect_split", &api_split_text<py::bytes>, "text"_a, "separator"_a = py::none(), "maxsplit"_a = -1);
-    m.def("_aspect_split", &api_split_text<py::bytearray>, "text"_a, "separator"_a = py::none(), "maxsplit"_a = -1);
-    m.def("_aspect_rsplit", &api_rsplit_text<py::str>, "text"_a, "separator"_a = py::none(), "maxsplit"_a = -1);
-    m.def("_aspect_rsplit", &api_rsplit_text<py::bytes>, "text"_a, "separator"_a = py::none(), "maxsplit"_a = -1);
-    m.def("_aspect_rsplit", &api_rsplit_text<py::bytearray>, "text"_a, "separator"_a = py::none(), "maxsplit"_a = -1);
-    // cppcheck-suppress assignBoolToPointer
-    m.def("_aspect_splitlines", &api_splitlines_text<py::str>, "text"_a, "keepends"_a = false);
-    // cppcheck-suppress assignBoolToPointer
-    m.def("_aspect_splitlines", &api_splitlines_text<py::bytes>, "text"_a, "keepends"_a = false);
-    // cppcheck-suppress assignBoolToPointer
-    m.def("_aspect_splitlines", &api_splitlines_text<py::bytearray>, "text"_a, "keepends"_a = false);
-}
\ No newline at end of file
+    static PyObject* method_name = PyUnicode_InternFromString("splitlines");
+    return split_text(method_name, args, nargs, kwnames, set_ranges_on_splitlines);
+}
+
+PyObject*
+api_split_aspect(PyObject* self, PyObject* const* args, const Py_ssize_t nargs, PyObject* kwnames)
+{
+    static PyObject* method_name = PyUnicode_InternFromString("split");
+    return split_aspect(method_name, args, nargs, kwnames, set_ranges_on_split);
+}
+
+PyObject*
+api_rsplit_aspect(PyObject* self, PyObject* const* args, const Py_ssize_t nargs, PyObject* kwnames)
+{
+    static PyObject* method_name = PyUnicode_InternFromString("rsplit");
+    return split_aspect(method_name, args, nargs, kwnames, set_ranges_on_split);
+}
+
+PyObject*
+api_splitlines_aspect(PyObject* self, PyObject* const* args, const Py_ssize_t nargs, PyObject* kwnames)
+{
+    static PyObject* method_name = PyUnicode_InternFromString("splitlines");
+    return split_aspect(method_name, args, nargs, kwnames, set_ranges_on_splitlines);
+}
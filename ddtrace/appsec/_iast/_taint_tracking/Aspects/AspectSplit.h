@@ -2,17 +2,20 @@
 
 #include "Helpers.h"
 
-template<class StrType>
-py::list
-api_split_text(const StrType& text, const optional<StrType>& separator, optional<int> maxsplit);
+PyObject*
+api_split_text(PyObject* self, PyObject* const* args, Py_ssize_t nargs, PyObject* kwnames);
 
-template<class StrType>
-py::list
-api_rsplit_text(const StrType& text, const optional<StrType>& separator, optional<int> maxsplit);
+PyObject*
+api_rsplit_text(PyObject* self, PyObject* const* args, Py_ssize_t nargs, PyObject* kwnames);
 
-template<class StrType>
-py::list
-api_splitlines_text(const StrType& text, bool keepends);
+PyObject*
+api_splitlines_text(PyObject* self, PyObject* const* args, Py_ssize_t nargs, PyObject* kwnames);
 
-void
-pyexport_aspect_split(py::module& m);
\ No newline at end of file
+PyObject*
+api_split_aspect(PyObject* self, PyObject* const* args, Py_ssize_t nargs, PyObject* kwnames);
+
+PyObject*
+api_rsplit_aspect(PyObject* self, PyObject* const* args, Py_ssize_t nargs, PyObject* kwnames);
+
+PyObject*
+api_splitlines_aspect(PyObject* self, PyObject* const* args, Py_ssize_t nargs, PyObject* kwnames);
@@ -1,8 +1,300 @@
 #include "AspectsOsPath.h"
+#include <algorithm>
+#include <optional>
 #include <string>
 
 #include "Helpers.h"
 
+/*
+ * On POSIX os.path is posixpath: the paths are split on '/' only and have no drive, so the aspects below compute the
+ * results and their ranges from the characters of the paths instead of calling the Python functions and searching
+ * their results in the inputs. They return nullptr without an error set for the cases they leave to the generic
+ * implementations further down (other platforms, or mixed argument types for join).
+ */
+static constexpr Py_UCS4 POSIX_SEP = '/';
+static constexpr Py_UCS4 POSIX_EXTSEP = '.';
+
+static Py_ssize_t
+text_length(PyObject* text)
+{
+    return PyUnicode_Check(text) ? PyUnicode_GET_LENGTH(text) : PyBytes_GET_SIZE(text);
+}
+
+// Position of the last separator of the path, or -1
+static Py_ssize_t
+rfind_char(PyObject* path, const Py_UCS4 c)
+{
+    const TextChars chars(path);
+    for (auto i = text_length(path) - 1; i >= 0; i--) {
+        if (chars[i] == c) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Returns path[start:end], tainted with the ranges of the path over those characters.
+ *
+ * The path itself is returned for the whole of it. A part of a single character is a new object, as CPython caches
+ * those and they must not carry the ranges of a path.
+ */
+static PyObject*
+new_path_part(PyObject* path, const Py_ssize_t start, const Py_ssize_t end, const TaintRangeMapTypePtr& tx_map)
+{
+    if (start == 0 and end == text_length(path)) {
+        Py_INCREF(path);
+        return path;
+    }
+    PyObject* part = PyUnicode_Check(path) ? PyUnicode_Substring(path, start, end)
+                                           : PyBytes_FromStringAndSize(PyBytes_AS_STRING(path) + start, end - start);
+    if (part == nullptr or start == end or not tx_map or tx_map->empty()) {
+        return part;
+    }
+    const auto to_path = get_tainted_object(path, tx_map);
+    if (not to_path) {
+        return part;
+    }
+
+    TaintRangeRefs part_ranges;
+    for (const auto& range : to_path->get_ranges().intersecting(start, end)) {
+        const auto range_start = std::max<RANGE_START>(range.start, start);
+        const auto range_end = std::min<RANGE_START>(range.start + range.length, end);
+        part_ranges.emplace_back(range_start - start, range_end - range_start, range.source);
+    }
+    if (part_ranges.empty()) {
+        return part;
+    }
+    if (end - start == 1) {
+        PyObject* new_part = new_pyobject_id(part);
+        Py_DECREF(part);
+        if (new_part == nullptr) {
+            return nullptr;
+        }
+        part = new_part;
+    }
+    set_ranges(part, part_ranges, tx_map);
+    return part;
+}
+
+// End of the head of a path split at position: its trailing separators are removed unless it is only separators
+static Py_ssize_t
+head_end(PyObject* path, const Py_ssize_t position)
+{
+    const TextChars chars(path);
+    auto end = position;
+    while (end > 0 and chars[end - 1] == POSIX_SEP) {
+        end--;
+    }
+    return end == 0 ? position : end;
+}
+
+static PyObject*
+new_path_parts(PyObject* path,
+               const Py_ssize_t first_end,
+               const Py_ssize_t second_start,
+               const TaintRangeMapTypePtr& tx_map)
+{
+    PyObject* first = new_path_part(path, 0, first_end, tx_map);
+    if (first == nullptr) {
+        return nullptr;
+    }
+    PyObject* second = new_path_part(path, second_start, text_length(path), tx_map);
+    if (second == nullptr) {
+        Py_DECREF(first);
+        return nullptr;
+    }
+    PyObject* result = PyTuple_Pack(2, first, second);
+    Py_DECREF(first);
+    Py_DECREF(second);
+    return result;
+}
+
+static PyObject*
+posix_join(PyObject* first_part, PyObject* args)
+{
+#ifdef _WIN32
+    return nullptr;
+#else
+    const bool is_unicode = PyUnicode_Check(first_part);
+    const auto num_args = PyTuple_GET_SIZE(args);
+    for (Py_ssize_t i = 0; i < num_args; i++) {
+        PyObject* arg = PyTuple_GET_ITEM(args, i);
+        if (is_unicode ? not PyUnicode_Check(arg) : not PyBytes_Check(arg)) {
+            return nullptr;
+        }
+    }
+
+    // The non empty parts of the result and where they go. An absolute part drops everything before it, and a
+    // separator goes before a part unless the path so far is empty or ends with one
+    std::vector<std::pair<PyObject*, Py_ssize_t>> parts;
+    parts.reserve(num_args + 1);
+    Py_ssize_t length = text_length(first_part);
+    Py_UCS4 last_char = length > 0 ? TextChars(first_part)[length - 1] : 0;
+    if (length > 0) {
+        parts.emplace_back(first_part, 0);
+    }
+    for (Py_ssize_t i = 0; i < num_args; i++) {
+        PyObject* arg = PyTuple_GET_ITEM(args, i);
+        const auto arg_length = text_length(arg);
+        if (arg_length > 0 and TextChars(arg)[0] == POSIX_SEP) {
+            parts.clear();
+            length = 0;
+        } else if (length > 0 and last_char != POSIX_SEP) {
+            length++;
+            last_char = POSIX_SEP;
+        }
+        if (arg_length > 0) {
+            parts.emplace_back(arg, length);
+            length += arg_length;
+            last_char = TextChars(arg)[arg_length - 1];
+        }
+    }
+    // A single part that is the whole result is returned as it is, like posixpath does
+    if (parts.size() == 1 and length == text_length(parts[0].first)) {
+        Py_INCREF(parts[0].first);
+        return parts[0].first;
+    }
+    if (parts.empty() and length == 0) {
+        Py_INCREF(first_part);
+        return first_part;
+    }
+
+    PyObject* joined;
+    if (is_unicode) {
+        Py_UCS4 max_char = POSIX_SEP;
+        for (const auto& [part, position] : parts) {
+            max_char = std::max(max_char, PyUnicode_MAX_CHAR_VALUE(part));
+        }
+        joined = PyUnicode_New(length, max_char);
+        if (joined == nullptr) {
+            return nullptr;
+        }
+        // Every gap between the parts is a separator
+        const auto kind = PyUnicode_KIND(joined);
+        void* data = PyUnicode_DATA(joined);
+        Py_ssize_t position = 0;
+        for (const auto& [part, part_position] : parts) {
+            for (; position < part_position; position++) {
+                PyUnicode_WRITE(kind, data, position, POSIX_SEP);
+            }
+            const auto part_length = PyUnicode_GET_LENGTH(part);
+            PyUnicode_CopyCharacters(joined, position, part, 0, part_length);
+            position += part_length;
+        }
+        for (; position < length; position++) {
+            PyUnicode_WRITE(kind, data, position, POSIX_SEP);
+        }
+    } else {
+        joined = PyBytes_FromStringAndSize(nullptr, length);
+        if (joined == nullptr) {
+            return nullptr;
+        }
+        char* data = PyBytes_AS_STRING(joined);
+        memset(data, POSIX_SEP, length);
+        for (const auto& [part, position] : parts) {
+            memcpy(data + position, PyBytes_AS_STRING(part), PyBytes_GET_SIZE(part));
+        }
+    }
+
+    const auto tx_map = initializer->get_tainting_map();
+    if (not tx_map or tx_map->empty()) {
+        return joined;
+    }
+    TaintRangeRefs result_ranges;
+    for (const auto& [part, position] : parts) {
+        if (const auto to_part = get_tainted_object(part, tx_map)) {
+            for (const auto& range : to_part->get_ranges()) {
+                result_ranges.emplace_back(range.start + position, range.length, range.source);
+            }
+        }
+    }
+    if (not result_ranges.empty()) {
+        set_ranges(joined, result_ranges, tx_map);
+    }
+    return joined;
+#endif
+}
+
+static PyObject*
+posix_basename(PyObject* path)
+{
+#ifdef _WIN32
+    return nullptr;
+#else
+    return new_path_part(path, rfind_char(path, POSIX_SEP) + 1, text_length(path), initializer->get_tainting_map());
+#endif
+}
+
+static PyObject*
+posix_dirname(PyObject* path)
+{
+#ifdef _WIN32
+    return nullptr;
+#else
+    return new_path_part(path, 0, head_end(path, rfind_char(path, POSIX_SEP) + 1), initializer->get_tainting_map());
+#endif
+}
+
+static PyObject*
+posix_split(PyObject* path)
+{
+#ifdef _WIN32
+    return nullptr;
+#else
+    const auto tail_start = rfind_char(path, POSIX_SEP) + 1;
+    return new_path_parts(path, head_end(path, tail_start), tail_start, initializer->get_tainting_map());
+#endif
+}
+
+static PyObject*
+posix_splitext(PyObject* path)
+{
+#ifdef _WIN32
+    return nullptr;
+#else
+    const auto length = text_length(path);
+    const auto sep_index = rfind_char(path, POSIX_SEP);
+    const auto dot_index = rfind_char(path, POSIX_EXTSEP);
+    // Like genericpath._splitext, leading dots of the file name don't start an extension
+    if (dot_index > sep_index) {
+        const TextChars chars(path);
+        for (auto i = sep_index + 1; i < dot_index; i++) {
+            if (chars[i] != POSIX_EXTSEP) {
+                return new_path_parts(path, dot_index, dot_index, initializer->get_tainting_map());
+            }
+        }
+    }
+    return new_path_parts(path, length, length, initializer->get_tainting_map());
+#endif
+}
+
+// posixpath.normcase returns the path it gets
+static PyObject*
+posix_normcase(PyObject* path)
+{
+#ifdef _WIN32
+    return nullptr;
+#else
+    Py_INCREF(path);
+    return path;
+#endif
+}
+
+// The result of a native aspect, or nullptr to use the generic implementation
+template<class ResultType>
+static std::optional<ResultType>
+native_result(PyObject* result)
+{
+    if (result == nullptr) {
+        if (PyErr_Occurred()) {
+            throw py::error_already_set();
+        }
+        return std::nullopt;
+    }
+    return py::reinterpret_steal<ResultType>(result);
+}
+
 static bool
 starts_with_separator(const py::handle& arg, const std::string& separator)
 {
@@ -14,6 +306,9 @@ template<class StrType>
 StrType
 api_ospathjoin_aspect(StrType& first_part, const py::args& args)
 {
+    if (auto joined = native_result<StrType>(posix_join(first_part.ptr(), args.ptr()))) {
+        return *joined;
+    }
     const auto ospath = py::module_::import("os.path");
     auto join = ospath.attr("join");
     auto joined = join(first_part, *args);
@@ -53,7 +348,7 @@ api_ospathjoin_aspect(StrType& first_part, const py::args& args)
     if (not root_is_after_first) {
         // Get the ranges of first_part and set them to the result, skipping the first character position
         // if it's a separator
-        auto [ranges, ranges_error] = get_ranges(first_part.ptr(), tx_map);
+        auto [ranges, ranges_error] = get_ranges_view(first_part.ptr(), tx_map);
         if (not ranges_error and not ranges.empty()) {
             for (auto& range : ranges) {
                 result_ranges.emplace_back(shift_taint_range(range, current_offset, first_part_len));
@@ -74,7 +369,7 @@ api_ospathjoin_aspect(StrType& first_part, const py::args& args)
     for (unsigned long i = 0; i < args.size(); i++) {
         if (i >= unsigned_initial_arg_pos) {
             // Set the ranges from the corresponding argument
-            if (auto [ranges, ranges_error] = get_ranges(args[i].ptr(), tx_map);
+            if (auto [ranges, ranges_error] = get_ranges_view(args[i].ptr(), tx_map);
                 not ranges_error and not ranges.empty()) {
                 const auto len_args_i = py::len(args[i]);
                 for (auto& range : ranges) {
@@ -99,6 +394,9 @@ template<class StrType>
 StrType
 api_ospathbasename_aspect(const StrType& path)
 {
+    if (auto result = native_result<StrType>(posix_basename(path.ptr()))) {
+        return *result;
+    }
     const auto ospath = py::module_::import("os.path");
     auto basename = ospath.attr("basename");
     auto basename_result = basename(path);
@@ -108,7 +406,7 @@ api_ospathbasename_aspect(const StrType& path)
         return basename_result;
     }
 
-    auto [ranges, ranges_error] = get_ranges(path.ptr(), tx_map);
+    auto [ranges, ranges_error] = get_ranges_view(path.ptr(), tx_map);
     if (ranges_error or ranges.empty()) {
         return basename_result;
     }
@@ -130,6 +428,9 @@ template<class StrType>
 StrType
 api_ospathdirname_aspect(const StrType& path)
 {
+    if (auto result = native_result<StrType>(posix_dirname(path.ptr()))) {
+        return *result;
+    }
     const auto ospath = py::module_::import("os.path");
     auto dirname = ospath.attr("dirname");
     auto dirname_result = dirname(path);
@@ -139,7 +440,7 @@ api_ospathdirname_aspect(const StrType& path)
         return dirname_result;
     }
 
-    auto [ranges, ranges_error] = get_ranges(path.ptr(), tx_map);
+    auto [ranges, ranges_error] = get_ranges_view(path.ptr(), tx_map);
     if (ranges_error or ranges.empty()) {
         return dirname_result;
     }
@@ -170,7 +471,7 @@ forward_to_set_ranges_on_splitted(const char* function_name, const StrType& path
         return function_result;
     }
 
-    auto [ranges, ranges_error] = get_ranges(path.ptr(), tx_map);
+    auto [ranges, ranges_error] = get_ranges_view(path.ptr(), tx_map);
     if (ranges_error or ranges.empty()) {
         return function_result;
     }
@@ -183,6 +484,9 @@ template<class StrType>
 py::tuple
 api_ospathsplit_aspect(const StrType& path)
 {
+    if (auto result = native_result<py::tuple>(posix_split(path.ptr()))) {
+        return *result;
+    }
     return forward_to_set_ranges_on_splitted("split", path);
 }
 
@@ -190,6 +494,9 @@ template<class StrType>
 py::tuple
 api_ospathsplitext_aspect(const StrType& path)
 {
+    if (auto result = native_result<py::tuple>(posix_splitext(path.ptr()))) {
+        return *result;
+    }
     return forward_to_set_ranges_on_splitted("splitext", path, true);
 }
 
@@ -211,6 +518,9 @@ template<class StrType>
 StrType
 api_ospathnormcase_aspect(const StrType& path)
 {
+    if (auto result = native_result<StrType>(posix_normcase(path.ptr()))) {
+        return *result;
+    }
     const auto ospath = py::module_::import("os.path");
     auto normcase = ospath.attr("normcase");
     auto normcased = normcase(path);
@@ -220,14 +530,13 @@ api_ospathnormcase_aspect(const StrType& path)
         return normcased;
     }
 
-    auto [ranges, ranges_error] = get_ranges(path.ptr(), tx_map);
-    if (ranges_error or ranges.empty()) {
+    const auto to_path = get_tainted_object(path.ptr(), tx_map);
+    if (not to_path) {
         return normcased;
     }
 
-    const TaintRangeRefs result_ranges = ranges;
     if (PyObject* new_result = new_pyobject_id(normcased.ptr())) {
-        set_ranges(new_result, result_ranges, tx_map);
+        set_tainted_object(new_result, to_path, tx_map);
         return py::reinterpret_steal<StrType>(new_result);
     }
 
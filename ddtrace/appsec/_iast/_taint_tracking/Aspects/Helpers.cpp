@@ -1,7 +1,8 @@
 #include "Helpers.h"
 #include "Initializer/Initializer.h"
 #include <algorithm>
-#include <regex>
+#include <cstring>
+#include <string_view>
 
 using namespace pybind11::literals;
 namespace py = pybind11;
@@ -27,13 +28,9 @@ api_common_replace(const py::str& string_method,
     if (not tx_map or tx_map->empty()) {
         return res;
     }
-    auto [candidate_text_ranges, ranges_error] = get_ranges(candidate_text.ptr(), tx_map);
-
-    if (ranges_error or candidate_text_ranges.empty()) {
-        return res;
+    if (const auto to_candidate_text = get_tainted_object(candidate_text.ptr(), tx_map)) {
+        set_tainted_object(res.ptr(), to_candidate_text, tx_map);
     }
-
-    set_ranges(res.ptr(), shift_taint_ranges(candidate_text_ranges, 0, -1), tx_map);
     return res;
 }
 
@@ -63,9 +60,9 @@ get_tag(const py::object& content)
 // TODO OPTIMIZATION: check if we can use instead a struct object with range_guid_map, new_ranges and default members so
 // we dont have to get the keys by string
 static py::object
-mapper_replace(const TaintRangePtr& taint_range, const optional<const py::dict>& new_ranges)
+mapper_replace(const TaintRange& taint_range, const optional<const py::dict>& new_ranges)
 {
-    if (!taint_range or !new_ranges) {
+    if (!new_ranges) {
         return py::none{};
     }
     py::object o = py::cast(taint_range);
@@ -78,19 +75,19 @@ mapper_replace(const TaintRangePtr& taint_range, const optional<const py::dict>&
 }
 
 py::object
-get_default_content(const TaintRangePtr& taint_range)
+get_default_content(const TaintRange& taint_range)
 {
-    if (!taint_range->source.name.empty()) {
-        return py::str(taint_range->source.name);
+    if (const auto& source = taint_range.get_source(); !source.name.empty()) {
+        return py::str(source.name);
     }
 
     return py::cast<py::none>(Py_None);
 }
 
 bool
-range_sort(const TaintRangePtr& t1, const TaintRangePtr& t2)
+range_sort(const TaintRange& t1, const TaintRange& t2)
 {
-    return t1->start < t2->start;
+    return t1.start < t2.start;
 }
 
 template<class StrType>
@@ -130,7 +127,7 @@ as_formatted_evidence(StrType& text,
         } else
             switch (*tag_mapping_mode) {
                 case TagMappingMode::Mapper:
-                    content = py::int_(taint_range->get_hash());
+                    content = py::int_(taint_range.get_hash());
                     break;
                 case TagMappingMode::Mapper_Replace:
                     content = mapper_replace(taint_range, new_ranges);
@@ -141,12 +138,12 @@ as_formatted_evidence(StrType& text,
             }
         const auto tag = get_tag<StrType>(content);
 
-        const auto range_end = taint_range->start + taint_range->length;
+        const auto range_end = taint_range.start + taint_range.length;
 
-        res_vector.push_back(text[py::slice(py::int_{ index }, py::int_{ taint_range->start }, nullptr)]);
+        res_vector.push_back(text[py::slice(py::int_{ index }, py::int_{ taint_range.start }, nullptr)]);
         res_vector.push_back(StrType(EVIDENCE_MARKS::START_EVIDENCE));
         res_vector.push_back(tag);
-        res_vector.push_back(text[py::slice(py::int_{ taint_range->start }, py::int_{ range_end }, nullptr)]);
+        res_vector.push_back(text[py::slice(py::int_{ taint_range.start }, py::int_{ range_end }, nullptr)]);
         res_vector.push_back(tag);
         res_vector.push_back(StrType(EVIDENCE_MARKS::END_EVIDENCE));
 
@@ -172,17 +169,85 @@ api_as_formatted_evidence(StrType& text,
     return as_formatted_evidence<StrType>(text, _ranges, tag_mapping_mode, new_ranges);
 }
 
-vector<string>
-split_taints(const string& str_to_split)
+// Characters of the range ids of the evidence marks, as in <[0-9.a-z\-]+>
+static bool
+is_evidence_id_char(const char c)
 {
-    const std::regex rgx(R"((:\+-(<[0-9.a-z\-]+>)?|(<[0-9.a-z\-]+>)?-\+:))");
-    std::sregex_token_iterator iter(str_to_split.begin(), str_to_split.end(), rgx, { -1, 0 });
-    vector<string> res;
+    return (c >= '0' and c <= '9') or (c >= 'a' and c <= 'z') or c == '.' or c == '-';
+}
 
-    for (const std::sregex_token_iterator end; iter != end; ++iter) {
-        res.push_back(*iter);
+// Length of the <id> tag starting at pos, or 0 when there is none
+static size_t
+evidence_tag_length(const std::string_view str, const size_t pos)
+{
+    if (pos >= str.size() or str[pos] != '<') {
+        return 0;
     }
+    size_t i = pos + 1;
+    while (i < str.size() and is_evidence_id_char(str[i])) {
+        ++i;
+    }
+    if (i == pos + 1 or i >= str.size() or str[i] != '>') {
+        return 0;
+    }
+    return i + 1 - pos;
+}
 
+/**
+ * Splits the text around the evidence marks ":+-<id>" and "<id>-+:", where the ids are optional, alternating the
+ * text between marks (maybe empty) and the marks. Same tokens as the regex (:\+-(<id>)?|(<id>)?-\+:), in a single
+ * pass: both marks have a '+' in the middle, so only the '+' characters found by memchr are checked.
+ */
+static vector<std::string_view>
+split_taints(const std::string_view str_to_split)
+{
+    vector<std::string_view> res;
+    const char* const data = str_to_split.data();
+    const size_t size = str_to_split.size();
+    // Start of the text not yet split off
+    size_t text_start = 0;
+    // Position from which to look for the next '+'
+    size_t search = 1;
+
+    while (search + 1 < size) {
+        const auto plus = static_cast<const char*>(memchr(data + search, '+', size - search - 1));
+        if (plus == nullptr) {
+            break;
+        }
+        const auto pos = static_cast<size_t>(plus - data);
+        size_t mark_start = pos - 1;
+        size_t mark_end;
+
+        if (data[pos - 1] == ':' and data[pos + 1] == '-') {
+            mark_end = pos + 2;
+            mark_end += evidence_tag_length(str_to_split, mark_end);
+        } else if (data[pos - 1] == '-' and data[pos + 1] == ':') {
+            mark_end = pos + 2;
+            // The <id> tag before the mark is made of id characters back to its '<', none of which is a '+'
+            if (mark_start > text_start and data[mark_start - 1] == '>') {
+                size_t tag_start = mark_start - 1;
+                while (tag_start > text_start and is_evidence_id_char(data[tag_start - 1])) {
+                    --tag_start;
+                }
+                if (tag_start > text_start and data[tag_start - 1] == '<' and tag_start < mark_start - 1) {
+                    mark_start = tag_start - 1;
+                }
+            }
+        } else {
+            search = pos + 1;
+            continue;
+        }
+
+        res.push_back(str_to_split.substr(text_start, mark_start - text_start));
+        res.push_back(str_to_split.substr(mark_start, mark_end - mark_start));
+        text_start = mark_end;
+        search = mark_end + 1;
+    }
+
+    // Like the token iterator, a text without marks is a single token, even when empty
+    if (text_start < size or res.empty()) {
+        res.push_back(str_to_split.substr(text_start));
+    }
     return res;
 }
 
@@ -238,7 +303,7 @@ convert_escaped_text_to_taint_text(const StrType& taint_escaped_text, TaintRange
     string startswith_element{ ":" };
 
     string taint_escaped_string = py::cast<string>(taint_escaped_text);
-    vector<string> texts_and_marks = split_taints(taint_escaped_string);
+    const vector<std::string_view> texts_and_marks = split_taints(taint_escaped_string);
     optional<TaintRangeRefs> optional_ranges_orig = ranges_orig;
 
     vector<tuple<string, int>> context_stack;
@@ -251,7 +316,7 @@ convert_escaped_text_to_taint_text(const StrType& taint_escaped_text, TaintRange
     int prev_context_pos;
     string id_evidence;
 
-    for (string const& element : texts_and_marks) {
+    for (const std::string_view element : texts_and_marks) {
         if (index % 2 == 0) {
             result += element;
             length = py::len(StrType(element));
@@ -261,8 +326,7 @@ convert_escaped_text_to_taint_text(const StrType& taint_escaped_text, TaintRange
         }
         if (element.rfind(startswith_element, 0) == 0) {
             id_evidence = element.substr(4, element.length() - 5);
-            if (auto range_by_id = get_range_by_hash(getNum(id_evidence), optional_ranges_orig);
-                range_by_id == nullptr) {
+            if (auto range_by_id = get_range_by_hash(getNum(id_evidence), optional_ranges_orig); !range_by_id) {
                 result += element;
                 length = py::len(StrType(element));
                 end += length;
@@ -282,9 +346,8 @@ convert_escaped_text_to_taint_text(const StrType& taint_escaped_text, TaintRange
 
                 if (start != end) {
                     id_evidence = get<0>(previous_context);
-                    const shared_ptr<TaintRange>& original_range =
-                      get_range_by_hash(getNum(id_evidence), optional_ranges_orig);
-                    ranges.emplace_back(initializer->allocate_taint_range(start, length, original_range->source));
+                    const auto original_range = get_range_by_hash(getNum(id_evidence), optional_ranges_orig);
+                    ranges.emplace_back(start, length, original_range->source);
                 }
                 latest_end = end;
             }
@@ -293,8 +356,7 @@ convert_escaped_text_to_taint_text(const StrType& taint_escaped_text, TaintRange
             context_stack.emplace_back(id_evidence, start);
         } else {
             id_evidence = element.substr(1, element.length() - 5);
-            if (auto range_by_id = get_range_by_hash(getNum(id_evidence), optional_ranges_orig);
-                range_by_id == nullptr) {
+            if (auto range_by_id = get_range_by_hash(getNum(id_evidence), optional_ranges_orig); !range_by_id) {
                 result += element;
                 length = py::len(StrType(element));
                 end += length;
@@ -313,9 +375,8 @@ convert_escaped_text_to_taint_text(const StrType& taint_escaped_text, TaintRange
 
             if (start != end) {
                 id_evidence = get<0>(context);
-                const shared_ptr<TaintRange>& original_range =
-                  get_range_by_hash(getNum(id_evidence), optional_ranges_orig);
-                ranges.emplace_back(initializer->allocate_taint_range(start, end - start, original_range->source));
+                const auto original_range = get_range_by_hash(getNum(id_evidence), optional_ranges_orig);
+                ranges.emplace_back(start, end - start, original_range->source);
             }
             latest_end = end;
         }
@@ -337,7 +398,7 @@ convert_escaped_text_to_taint_text(const StrType& taint_escaped_text, TaintRange
 template<class StrType>
 bool
 set_ranges_on_splitted(const StrType& source_str,
-                       const TaintRangeRefs& source_ranges,
+                       const TaintRangesView& source_ranges,
                        const py::list& split_result,
                        const TaintRangeMapTypePtr& tx_map,
                        bool include_separator)
@@ -358,6 +419,11 @@ set_ranges_on_splitted(const StrType& source_str,
         if (not is_text(item.ptr()) or py::len(item) == 0) {
             continue;
         }
+        // A text that isn't split is its own only part, and keeps its ranges, which may be those viewed here
+        if (item.ptr() == source_str.ptr()) {
+            offset += py::len(item) + separator_increase;
+            continue;
+        }
         auto c_item = py::cast<std::string>(item);
         TaintRangeRefs item_ranges;
 
@@ -370,13 +436,12 @@ set_ranges_on_splitted(const StrType& source_str,
 
         // Find what source_ranges match these positions and create a new range with the start and len updated.
         for (const auto& range : source_ranges) {
-            if (const auto range_end_abs = range->start + range->length; range->start < end && range_end_abs > start) {
+            if (const auto range_end_abs = range.start + range.length; range.start < end && range_end_abs > start) {
                 // Create a new range with the updated start
-                const auto new_range_start = std::max(range->start - offset, 0L);
+                const auto new_range_start = std::max(range.start - offset, 0L);
                 const auto new_range_length =
-                  std::min(end - start, (range->length - std::max(0L, offset - range->start)));
-                item_ranges.emplace_back(
-                  initializer->allocate_taint_range(new_range_start, new_range_length, range->source));
+                  std::min(end - start, (range.length - std::max(0L, offset - range.start)));
+                item_ranges.emplace_back(new_range_start, new_range_length, range.source);
             }
         }
         if (not item_ranges.empty()) {
@@ -438,6 +503,372 @@ has_pyerr()
     return false;
 }
 
+// Single pass lexer of the SQL literals and comments redacted from the evidences. It matches what the regular
+// expressions of sql_sensitive_analyzer.py did, case insensitively too, quirks included.
+class SqlLexer
+{
+  private:
+    // Returned when reading past the end of the query, it isn't a valid code point
+    static constexpr Py_UCS4 END = 0xFFFFFFFF;
+
+    const TextChars chars;
+    const Py_ssize_t length;
+    const SqlDialect dialect;
+    // Position of the last quote of each kind, where the string literals opened after them can't be closed
+    Py_ssize_t last_single_quote = -1;
+    Py_ssize_t last_double_quote = -1;
+    // The block comments opened from there aren't closed
+    Py_ssize_t unclosed_block_comments = PY_SSIZE_T_MAX;
+
+    Py_UCS4 at(const Py_ssize_t index) const { return index < length ? chars[index] : END; }
+
+    static Py_UCS4 lower(const Py_UCS4 c) { return c >= 'A' and c <= 'Z' ? c + ('a' - 'A') : c; }
+
+    static bool is_digit(const Py_UCS4 c)
+    {
+        return c < 128 ? c >= '0' and c <= '9' : c != END and Py_UNICODE_ISDECIMAL(c);
+    }
+
+    static bool is_word(const Py_UCS4 c)
+    {
+        if (c < 128) {
+            const auto l = lower(c);
+            return c == '_' or (c >= '0' and c <= '9') or (l >= 'a' and l <= 'z');
+        }
+        return c != END and Py_UNICODE_ISALNUM(c);
+    }
+
+    // Whether a token can start with an ASCII character
+    static bool can_start_token(const Py_UCS4 c)
+    {
+        switch (c) {
+            case '-':
+            case '+':
+            case '.':
+            case 'x':
+            case 'X':
+            case 'b':
+            case 'B':
+            case '\'':
+            case '"':
+            case '/':
+            case '$':
+                return true;
+            default:
+                return c >= '0' and c <= '9';
+        }
+    }
+
+    static bool is_hex(const Py_UCS4 c)
+    {
+        const auto l = lower(c);
+        return (c >= '0' and c <= '9') or (l >= 'a' and l <= 'f');
+    }
+
+    // x'1f' or b'01'
+    Py_ssize_t quoted_number(const Py_ssize_t pos, const Py_UCS4 prefix) const
+    {
+        if (lower(at(pos)) != prefix or at(pos + 1) != '\'') {
+            return -1;
+        }
+        Py_ssize_t end = pos + 2;
+        while (is_hex(at(end))) {
+            end++;
+        }
+        return end > pos + 2 and at(end) == '\'' ? end + 1 : -1;
+    }
+
+    // 0x1f or 0b01
+    Py_ssize_t prefixed_number(const Py_ssize_t pos, const Py_UCS4 prefix) const
+    {
+        if (at(pos) != '0' or lower(at(pos + 1)) != prefix) {
+            return -1;
+        }
+        Py_ssize_t end = pos + 2;
+        while (is_hex(at(end))) {
+            end++;
+        }
+        return end > pos + 2 ? end : -1;
+    }
+
+    // The optional exponent of the decimal and integer numbers, which has to be spelled E\d (with a backslash) to
+    // match, like in the original expression
+    Py_ssize_t exponent(const Py_ssize_t pos) const
+    {
+        if (lower(at(pos)) != 'e') {
+            return pos;
+        }
+        Py_ssize_t end = pos + 1;
+        if (at(end) == '-' or at(end) == '+') {
+            end++;
+        }
+        if (at(end) != '\\' or lower(at(end + 1)) != 'd') {
+            return pos;
+        }
+        end += 2;
+        while (lower(at(end)) == 'd') {
+            end++;
+        }
+        return lower(at(end)) == 'f' ? end + 1 : end;
+    }
+
+    Py_ssize_t decimal_number(const Py_ssize_t pos) const
+    {
+        Py_ssize_t end = pos;
+        while (is_digit(at(end))) {
+            end++;
+        }
+        if (at(end) != '.' or not is_digit(at(end + 1))) {
+            return -1;
+        }
+        end += 2;
+        while (is_digit(at(end))) {
+            end++;
+        }
+        return exponent(end);
+    }
+
+    // Integers are only matched at the start of a word
+    Py_ssize_t integer_number(const Py_ssize_t pos) const
+    {
+        if ((pos > 0 and is_word(at(pos - 1))) or not is_digit(at(pos))) {
+            return -1;
+        }
+        Py_ssize_t end = pos + 1;
+        while (is_digit(at(end))) {
+            end++;
+        }
+        return exponent(end);
+    }
+
+    Py_ssize_t number(const Py_ssize_t pos) const
+    {
+        const Py_ssize_t start = at(pos) == '-' or at(pos) == '+' ? pos + 1 : pos;
+        Py_ssize_t end;
+        if ((end = quoted_number(start, 'x')) >= 0 or (end = prefixed_number(start, 'x')) >= 0 or
+            (end = quoted_number(start, 'b')) >= 0 or (end = prefixed_number(start, 'b')) >= 0 or
+            (end = decimal_number(start)) >= 0) {
+            return end;
+        }
+        return integer_number(start);
+    }
+
+    // Strings whose quotes can be escaped, like 'it''s' or, for MySQL, "say \\"hi\\"" (with two backslashes). When
+    // there's no unescaped closing quote, the string is closed by the quote of the last escape.
+    Py_ssize_t string_literal(const Py_ssize_t pos) const
+    {
+        const Py_UCS4 quote = at(pos);
+        if ((quote == '\'' ? last_single_quote : last_double_quote) <= pos) {
+            return -1;
+        }
+
+        const bool backslashes = dialect == SqlDialect::MYSQL;
+        const Py_ssize_t escape_length = backslashes ? 3 : 2;
+        Py_ssize_t last_escape = -1;
+        Py_ssize_t end = pos + 1;
+        while (end < length) {
+            const Py_UCS4 c = at(end);
+            if (backslashes ? c == '\\' and at(end + 1) == '\\' and at(end + 2) == quote
+                            : c == quote and at(end + 1) == quote) {
+                last_escape = end;
+                end += escape_length;
+            } else if (c == quote) {
+                return end + 1;
+            } else {
+                end++;
+            }
+        }
+        if (last_escape < 0) {
+            return -1;
+        }
+        // The first quote of '' or the quote of \\" then
+        return backslashes ? last_escape + 3 : last_escape + 1;
+    }
+
+    // $tag$ ... $tag$, on a single line
+    Py_ssize_t dollar_quoted_literal(const Py_ssize_t pos, Py_ssize_t& tag_end) const
+    {
+        tag_end = pos + 1;
+        while (tag_end < length and at(tag_end) != '$') {
+            tag_end++;
+        }
+        if (tag_end == length) {
+            return -1;
+        }
+
+        const Py_ssize_t tag_length = tag_end - pos - 1;
+        for (Py_ssize_t end = tag_end + 1; end < length and at(end) != '\n'; end++) {
+            if (at(end) != '$' or at(end + tag_length + 1) != '$') {
+                continue;
+            }
+            Py_ssize_t i = 0;
+            while (i < tag_length and
+                   Py_UNICODE_TOLOWER(at(end + 1 + i)) == Py_UNICODE_TOLOWER(at(pos + 1 + i))) {
+                i++;
+            }
+            if (i == tag_length) {
+                return end + tag_length + 2;
+            }
+        }
+        return -1;
+    }
+
+    Py_ssize_t line_comment(const Py_ssize_t pos) const
+    {
+        if (at(pos) != '-' or at(pos + 1) != '-') {
+            return -1;
+        }
+        Py_ssize_t end = pos + 2;
+        while (end < length and at(end) != '\n') {
+            end++;
+        }
+        return end;
+    }
+
+    Py_ssize_t block_comment(const Py_ssize_t pos)
+    {
+        if (at(pos) != '/' or at(pos + 1) != '*' or pos + 2 >= unclosed_block_comments) {
+            return -1;
+        }
+        for (Py_ssize_t end = pos + 2; end + 1 < length; end++) {
+            if (at(end) == '*' and at(end + 1) == '/') {
+                return end + 2;
+            }
+        }
+        unclosed_block_comments = pos + 2;
+        return -1;
+    }
+
+  public:
+    SqlLexer(const py::str& query, const SqlDialect dialect)
+      : chars(query.ptr())
+      , length(PyUnicode_GET_LENGTH(query.ptr()))
+      , dialect(dialect)
+    {
+        for (Py_ssize_t i = 0; i < length; i++) {
+            const Py_UCS4 c = chars[i];
+            if (c == '\'') {
+                last_single_quote = i;
+            } else if (c == '"') {
+                last_double_quote = i;
+            }
+        }
+        if (dialect != SqlDialect::MYSQL) {
+            // Only single quoted strings are literals there
+            last_double_quote = -1;
+        }
+    }
+
+    std::vector<std::pair<Py_ssize_t, Py_ssize_t>> tokenize()
+    {
+        std::vector<std::pair<Py_ssize_t, Py_ssize_t>> tokens;
+
+        Py_ssize_t pos = 0;
+        while (pos < length) {
+            const Py_UCS4 c = at(pos);
+            if (c < 128 and not can_start_token(c)) {
+                pos++;
+                continue;
+            }
+
+            Py_ssize_t tag_end = -1;
+            Py_ssize_t end = number(pos);
+            if (end < 0 and c == '$' and dialect == SqlDialect::POSTGRESQL) {
+                end = dollar_quoted_literal(pos, tag_end);
+            }
+            if (end < 0 and (c == '\'' or c == '"')) {
+                end = string_literal(pos);
+            }
+            if (end < 0) {
+                end = line_comment(pos);
+            }
+            if (end < 0) {
+                end = block_comment(pos);
+            }
+            if (end < 0) {
+                pos++;
+                continue;
+            }
+
+            // Only the contents of the literals and comments are kept
+            Py_ssize_t start = pos;
+            Py_ssize_t stop = end;
+            if (c == '\'' or c == '"') {
+                start++;
+                stop--;
+            } else if (end > pos + 1) {
+                if (c == '/' and at(pos + 1) == '*') {
+                    start += 2;
+                    stop -= 2;
+                } else if (c == '-' and at(pos + 1) == '-') {
+                    start += 2;
+                } else if (c == '$') {
+                    start += tag_end - pos + 1;
+                    stop -= tag_end - pos + 1;
+                }
+            }
+            tokens.emplace_back(start, stop);
+            pos = end;
+        }
+
+        return tokens;
+    }
+};
+
+/**
+ * Tokenizes a query in a single pass, returning the sorted spans of its literals and comments to be intersected
+ * with its taint ranges when redacting the evidence.
+ *
+ * @param query The query to tokenize.
+ * @param dialect The dialect of the quotes of the query.
+ */
+std::vector<std::pair<Py_ssize_t, Py_ssize_t>>
+sql_tokenize(const py::str& query, const SqlDialect dialect)
+{
+    return SqlLexer(query, dialect).tokenize();
+}
+
+/**
+ * Calls a function with arguments in the vectorcall layout: the positional arguments followed by the values of the
+ * keyword arguments, whose names are in kwnames.
+ */
+PyObject*
+call_function(PyObject* function, PyObject* const* args, const Py_ssize_t nargs, PyObject* kwnames)
+{
+#if PY_VERSION_HEX >= 0x03090000
+    return PyObject_Vectorcall(function, args, nargs, kwnames);
+#else
+    PyObject* args_tuple = PyTuple_New(nargs);
+    if (args_tuple == nullptr) {
+        return nullptr;
+    }
+    for (Py_ssize_t i = 0; i < nargs; i++) {
+        Py_INCREF(args[i]);
+        PyTuple_SET_ITEM(args_tuple, i, args[i]);
+    }
+
+    PyObject* kwargs = nullptr;
+    if (kwnames != nullptr and PyTuple_GET_SIZE(kwnames) > 0) {
+        kwargs = PyDict_New();
+        for (Py_ssize_t i = 0; kwargs != nullptr and i < PyTuple_GET_SIZE(kwnames); i++) {
+            if (PyDict_SetItem(kwargs, PyTuple_GET_ITEM(kwnames, i), args[nargs + i]) != 0) {
+                Py_DECREF(kwargs);
+                kwargs = nullptr;
+            }
+        }
+        if (kwargs == nullptr) {
+            Py_DECREF(args_tuple);
+            return nullptr;
+        }
+    }
+
+    PyObject* result = PyObject_Call(function, args_tuple, kwargs);
+    Py_DECREF(args_tuple);
+    Py_XDECREF(kwargs);
+    return result;
+#endif
+}
+
 void
 pyexport_aspect_helpers(py::module& m)
 {
@@ -510,5 +941,10 @@ pyexport_aspect_helpers(py::module& m)
           "taint_escaped_text"_a,
           "ranges_orig"_a);
     m.def("parse_params", &parse_params);
+    py::enum_<SqlDialect>(m, "SqlDialect")
+      .value("MYSQL", SqlDialect::MYSQL)
+      .value("POSTGRESQL", SqlDialect::POSTGRESQL)
+      .export_values();
+    m.def("sql_tokenize", &sql_tokenize, "query"_a, "dialect"_a = SqlDialect::MYSQL);
     m.def("has_pyerr", &has_pyerr);
 }
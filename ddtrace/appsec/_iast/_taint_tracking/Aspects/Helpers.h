@@ -54,7 +54,7 @@ convert_escaped_text_to_taint_text(const StrType& taint_escaped_text, TaintRange
 template<class StrType>
 bool
 set_ranges_on_splitted(const StrType& source_str,
-                       const TaintRangeRefs& source_ranges,
+                       const TaintRangesView& source_ranges,
                        const py::list& split_result,
                        const TaintRangeMapTypePtr& tx_map,
                        bool include_separator = false);
@@ -66,6 +66,44 @@ api_set_ranges_on_splitted(const StrType& source_str,
                            const py::list& split_result,
                            bool include_separator = false);
 
+// Reads the characters of a str, bytes or bytearray object
+class TextChars
+{
+  private:
+    int kind = PyUnicode_1BYTE_KIND;
+    const void* data;
+
+  public:
+    explicit TextChars(PyObject* text)
+    {
+        if (PyUnicode_Check(text)) {
+            kind = PyUnicode_KIND(text);
+            data = PyUnicode_DATA(text);
+        } else if (PyBytes_Check(text)) {
+            data = PyBytes_AS_STRING(text);
+        } else {
+            data = PyByteArray_AS_STRING(text);
+        }
+    }
+
+    Py_UCS4 operator[](const Py_ssize_t index) const { return PyUnicode_READ(kind, data, index); }
+};
+
+// Dialects of the queries tokenized by sql_tokenize()
+enum class SqlDialect
+{
+    MYSQL = 0,
+    POSTGRESQL
+};
+
+// Returns the spans of the literals and comments of a query, without their quotes and comment markers
+std::vector<std::pair<Py_ssize_t, Py_ssize_t>>
+sql_tokenize(const py::str& query, SqlDialect dialect);
+
+// Calls a function with arguments in the vectorcall layout, also on Python versions without PyObject_Vectorcall
+PyObject*
+call_function(PyObject* function, PyObject* const* args, Py_ssize_t nargs, PyObject* kwnames);
+
 bool
 has_pyerr();
 
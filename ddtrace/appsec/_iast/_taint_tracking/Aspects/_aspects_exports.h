@@ -1,6 +1,5 @@
 #pragma once
 #include "AspectFormat.h"
-#include "AspectSplit.h"
 #include "AspectsOsPath.h"
 #include "Helpers.h"
 #include <pybind11/pybind11.h>
@@ -15,6 +14,4 @@ pyexport_m_aspect_helpers(py::module& m)
 
     py::module m_aspects_ospath = m.def_submodule("aspects_ospath", "Aspect os.path.join");
     pyexport_ospath_aspects(m_aspects_ospath);
-    py::module m_aspect_split = m.def_submodule("aspect_split", "Aspect split");
-    pyexport_aspect_split(m_aspect_split);
 }
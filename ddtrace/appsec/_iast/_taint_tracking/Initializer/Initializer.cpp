@@ -1,32 +1,90 @@
 #include "Initializer.h"
 
-#include <thread>
+#include <array>
+#include <cstdlib>
 
 using namespace std;
 using namespace pybind11::literals;
 
-thread_local struct ThreadContextCache_
+// Size classes of the range blocks, by powers of 2 of their capacity
+static constexpr size_t RANGE_BLOCK_CLASSES = 32;
+
+/**
+ * State of a taint tracking context. It starts in the thread handling a request, and the worker threads running part
+ * of the request attach to it (see Initializer::attach_context), so it is shared by pointer. The GIL serializes all
+ * the uses of a context, as nothing in the module releases it.
+ */
+struct TaintContext
 {
     TaintRangeMapTypePtr tx_map = nullptr;
+    // Map of the previous context, cleared but keeping its storage for the next one
+    TaintRangeMapTypePtr spare_tx_map = nullptr;
+    SourceTable sources;
+    // Ranges of the objects tainted in the context, accounted in the taint budget
+    size_t taint_ranges = 0;
+    bool taint_budget_exceeded = false;
+    // Tainted objects and range blocks of the context, all released at once when it ends. Its chunks are only
+    // allocated once the context taints something
+    Arena arena{ initializer ? initializer->get_max_retained_taint_memory() : Arena::DEFAULT_MAX_RETAINED_SIZE };
+    // Released tainted objects and range blocks of the arena, reused before allocating new ones in it
+    vector<TaintedObjectPtr> tainted_objects;
+    array<TaintRangeBlock*, RANGE_BLOCK_CLASSES> range_blocks{};
+
+    void reset_arena()
+    {
+        tainted_objects.clear();
+        range_blocks.fill(nullptr);
+        arena.reset();
+    }
+};
+
+thread_local struct ThreadContextCache_
+{
+    // Context of the thread, never null: a thread out of any context has one without taint map
+    TaintContextPtr context = make_shared<TaintContext>();
+    // Context of the thread itself while it is attached to the context of another one
+    TaintContextPtr own_context = nullptr;
 } ThreadContextCache;
 
-Initializer::Initializer()
+static TaintContext&
+current_context()
+{
+    return *ThreadContextCache.context;
+}
+
+static size_t
+get_env_size(const char* name, const size_t default_size)
 {
-    // Fill the taintedobjects stack
-    for (int i = 0; i < TAINTEDOBJECTS_STACK_SIZE; i++) {
-        available_taintedobjects_stack.push(new TaintedObject());
+    const char* env_size = std::getenv(name);
+    if (env_size == nullptr or *env_size == '\0') {
+        return default_size;
     }
 
-    // Fill the ranges stack
-    for (int i = 0; i < TAINTRANGES_STACK_SIZE; i++) {
-        available_ranges_stack.push(make_shared<TaintRange>());
+    char* end = nullptr;
+    const long long size = std::strtoll(env_size, &end, 10);
+    if (*end != '\0' or size < 0) {
+        return default_size;
     }
+    return static_cast<size_t>(size);
+}
+
+Initializer::Initializer()
+  : max_tainted_objects(get_env_size("DD_IAST_MAX_TAINTED_OBJECTS_PER_REQUEST", MAX_TAINTED_OBJECTS_PER_REQUEST))
+  , max_taint_ranges(get_env_size("DD_IAST_MAX_TAINT_RANGES_PER_REQUEST", MAX_TAINT_RANGES_PER_REQUEST))
+  , max_retained_taint_memory(get_env_size("DD_IAST_MAX_RETAINED_TAINT_MEMORY", Arena::DEFAULT_MAX_RETAINED_SIZE))
+{
 }
 
 TaintRangeMapTypePtr
 Initializer::create_tainting_map()
 {
-    auto map_ptr = make_shared<TaintRangeMapType>();
+    auto map_ptr = std::move(current_context().spare_tx_map);
+    if (not map_ptr or map_ptr.use_count() != 1 or not map_ptr->empty()) {
+        map_ptr = make_shared<TaintRangeMapType>();
+    } else {
+        // Entries erased one by one are still in the filter
+        map_ptr->clear();
+    }
     active_map_addreses[map_ptr.get()] = map_ptr;
     return map_ptr;
 }
@@ -42,10 +100,7 @@ Initializer::clear_tainting_map(const TaintRangeMapTypePtr& tx_map)
         return;
     }
 
-    for (const auto& [fst, snd] : *tx_map) {
-        snd.second->decref();
-    }
-
+    // The tainted objects aren't released one by one, they are in the arena of the context
     tx_map->clear();
 }
 
@@ -53,7 +108,7 @@ Initializer::clear_tainting_map(const TaintRangeMapTypePtr& tx_map)
 TaintRangeMapTypePtr
 Initializer::get_tainting_map()
 {
-    return ThreadContextCache.tx_map;
+    return current_context().tx_map;
 }
 
 void
@@ -94,6 +149,43 @@ Initializer::debug_taint_map()
     return output.str();
 }
 
+SourceId
+Initializer::intern_source(const Source& source)
+{
+    return current_context().sources.intern(source);
+}
+
+const Source&
+Initializer::get_source(const SourceId source_id)
+{
+    return current_context().sources.get(source_id);
+}
+
+int
+Initializer::get_source_hash(const SourceId source_id)
+{
+    return current_context().sources.get_hash(source_id);
+}
+
+bool
+Initializer::consume_taint_budget(const TaintRangeMapTypePtr& tx_map, const size_t num_ranges) const
+{
+    auto& cache = current_context();
+    if ((max_tainted_objects != 0 and tx_map->size() >= max_tainted_objects) or
+        (max_taint_ranges != 0 and cache.taint_ranges + num_ranges > max_taint_ranges)) {
+        cache.taint_budget_exceeded = true;
+        return false;
+    }
+    cache.taint_ranges += num_ranges;
+    return true;
+}
+
+bool
+Initializer::taint_budget_exceeded()
+{
+    return current_context().taint_budget_exceeded;
+}
+
 int
 Initializer::initializer_size() const
 {
@@ -109,20 +201,19 @@ Initializer::active_map_addreses_size() const
 TaintedObjectPtr
 Initializer::allocate_tainted_object()
 {
-    if (!available_taintedobjects_stack.empty()) {
-        const auto& toptr = available_taintedobjects_stack.top();
-        available_taintedobjects_stack.pop();
+    if (auto& tainted_objects = current_context().tainted_objects; !tainted_objects.empty()) {
+        const auto toptr = tainted_objects.back();
+        tainted_objects.pop_back();
         return toptr;
     }
-    // Stack is empty, create new object
-    return new TaintedObject();
+    return current_context().arena.create<TaintedObject>();
 }
 
 TaintedObjectPtr
-Initializer::allocate_ranges_into_taint_object(TaintRangeRefs ranges)
+Initializer::allocate_ranges_into_taint_object(const TaintRangeRefs& ranges)
 {
     const auto toptr = allocate_tainted_object();
-    toptr->set_values(std::move(ranges));
+    toptr->copy_values(ranges);
     return toptr;
 }
 
@@ -140,7 +231,9 @@ Initializer::allocate_tainted_object_copy(const TaintedObjectPtr& from)
     if (!from) {
         return allocate_tainted_object();
     }
-    return allocate_ranges_into_taint_object_copy(from->ranges_);
+    const auto toptr = allocate_tainted_object();
+    toptr->share_values(*from);
+    return toptr;
 }
 
 void
@@ -151,68 +244,105 @@ Initializer::release_tainted_object(TaintedObjectPtr tobj)
     }
 
     tobj->reset();
-    if (available_taintedobjects_stack.size() < TAINTEDOBJECTS_STACK_SIZE) {
-        available_taintedobjects_stack.push(tobj);
-        return;
-    }
+    current_context().tainted_objects.push_back(tobj);
+}
 
-    // Stack full, just delete the object (but to a reset before so ranges are
-    // reused or freed)
-    delete tobj;
+static size_t
+range_block_class(const size_t capacity)
+{
+    // Smallest power of 2 holding the capacity
+    return capacity <= 1 ? 0 : static_cast<size_t>(64 - __builtin_clzll(capacity - 1));
 }
 
-TaintRangePtr
-Initializer::allocate_taint_range(const RANGE_START start, const RANGE_LENGTH length, const Source& origin)
+TaintRangeBlock*
+Initializer::allocate_range_block(const size_t capacity)
 {
-    if (!available_ranges_stack.empty()) {
-        auto rptr = available_ranges_stack.top();
-        available_ranges_stack.pop();
-        rptr->set_values(start, length, origin);
-        return rptr;
+    auto& context = current_context();
+    const size_t block_class = range_block_class(capacity);
+    TaintRangeBlock* block = context.range_blocks[block_class];
+    if (block) {
+        context.range_blocks[block_class] = block->next_free;
+    } else {
+        const size_t block_capacity = size_t{ 1 } << block_class;
+        const size_t block_size = sizeof(TaintRangeBlock) + block_capacity * sizeof(TaintRange);
+        void* memory = context.arena.allocate(block_size, alignof(TaintRangeBlock));
+        block = new (memory) TaintRangeBlock{ static_cast<uint32_t>(block_capacity), 0, 0, nullptr };
     }
-
-    // Stack is empty, create new object
-    return make_shared<TaintRange>(start, length, origin);
+    block->size = 0;
+    block->refs = 1;
+    block->next_free = nullptr;
+    return block;
 }
 
 void
-Initializer::release_taint_range(TaintRangePtr rangeptr)
+Initializer::release_range_block(TaintRangeBlock* block)
 {
-    if (!rangeptr)
-        return;
-
-    if (rangeptr.use_count() == 1) {
-        rangeptr->reset();
-        if (available_ranges_stack.size() < TAINTRANGES_STACK_SIZE) {
-            // Move the range to the allocated ranges stack
-            available_ranges_stack.push(rangeptr);
-            return;
-        }
-
-        // Stack full or initializer already cleared (interpreter finishing), just
-        // release the object
-        rangeptr.reset(); // Not duplicated or typo, calling reset on the shared_ptr, not the TaintRange
-    }
+    auto& context = current_context();
+    const size_t block_class = range_block_class(block->capacity);
+    block->next_free = context.range_blocks[block_class];
+    context.range_blocks[block_class] = block;
 }
 
 void
 Initializer::create_context()
 {
-    if (ThreadContextCache.tx_map != nullptr) {
+    if (ThreadContextCache.context.use_count() > 1) {
+        // Other threads are attached to the current context and keep it, the new one belongs to this thread only
+        ThreadContextCache.context = make_shared<TaintContext>();
+    } else if (current_context().tx_map != nullptr) {
         // Reset the current context
         reset_context();
     }
 
     // Create a new taint_map
     auto map_ptr = create_tainting_map();
-    ThreadContextCache.tx_map = map_ptr;
+    current_context().tx_map = map_ptr;
 }
 
 void
 Initializer::reset_context()
 {
+    auto& context = current_context();
     clear_tainting_maps();
-    ThreadContextCache.tx_map = nullptr;
+    context.spare_tx_map = std::move(context.tx_map);
+    context.tx_map = nullptr;
+    context.sources.clear();
+    context.taint_ranges = 0;
+    context.taint_budget_exceeded = false;
+    // The maps don't point to the tainted objects of the arena any more
+    context.reset_arena();
+}
+
+TaintContextPtr
+Initializer::get_context()
+{
+    if (current_context().tx_map == nullptr) {
+        return nullptr;
+    }
+    return ThreadContextCache.context;
+}
+
+void
+Initializer::attach_context(const TaintContextPtr& context)
+{
+    auto& cache = ThreadContextCache;
+    if (not context or context == cache.context) {
+        return;
+    }
+    if (not cache.own_context) {
+        cache.own_context = std::move(cache.context);
+    }
+    cache.context = context;
+}
+
+void
+Initializer::detach_context()
+{
+    auto& cache = ThreadContextCache;
+    if (cache.own_context) {
+        cache.context = std::move(cache.own_context);
+        cache.own_context = nullptr;
+    }
 }
 
 // Created in the PYBIND11_MODULE in _native.cpp
@@ -225,10 +355,17 @@ pyexport_initializer(py::module& m)
     m.def("debug_taint_map", [] { return initializer->debug_taint_map(); });
 
     m.def("num_objects_tainted", [] { return initializer->num_objects_tainted(); });
+    m.def("taint_budget_exceeded", [] { return initializer->taint_budget_exceeded(); });
     m.def("initializer_size", [] { return initializer->initializer_size(); });
     m.def("active_map_addreses_size", [] { return initializer->active_map_addreses_size(); });
 
     m.def(
       "create_context", []() { return initializer->create_context(); }, py::return_value_policy::reference);
     m.def("reset_context", [] { initializer->reset_context(); });
+
+    // Opaque to Python, only passed from the thread of a request to the threads working for it
+    py::class_<TaintContext, TaintContextPtr>(m, "TaintContext");
+    m.def("get_context", [] { return initializer->get_context(); });
+    m.def("attach_context", [](const TaintContextPtr& context) { initializer->attach_context(context); }, "context"_a);
+    m.def("detach_context", [] { initializer->detach_context(); });
 }
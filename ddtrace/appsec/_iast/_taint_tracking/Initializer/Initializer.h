@@ -4,23 +4,32 @@
 
 #include "TaintTracking/TaintRange.h"
 #include "TaintTracking/TaintedObject.h"
+#include "Utils/Arena.h"
 
-#include <stack>
+#include <memory>
 #include <unordered_map>
 
 using namespace std;
 
 namespace py = pybind11;
 
+struct TaintContext;
+using TaintContextPtr = shared_ptr<TaintContext>;
+
 class Initializer
 {
   private:
     py::object pyfunc_get_settings;
     py::object pyfunc_get_python_lib;
-    static constexpr int TAINTRANGES_STACK_SIZE = 4096;
-    static constexpr int TAINTEDOBJECTS_STACK_SIZE = 4096;
-    stack<TaintedObjectPtr> available_taintedobjects_stack;
-    stack<TaintRangePtr> available_ranges_stack;
+    // Maximum number of tainted objects and of ranges in each context, 0 for no limit. They can be changed with
+    // DD_IAST_MAX_TAINTED_OBJECTS_PER_REQUEST and DD_IAST_MAX_TAINT_RANGES_PER_REQUEST
+    static constexpr size_t MAX_TAINTED_OBJECTS_PER_REQUEST = 10000;
+    static constexpr size_t MAX_TAINT_RANGES_PER_REQUEST = 100000;
+    size_t max_tainted_objects;
+    size_t max_taint_ranges;
+    // Bytes of the arena of a thread kept for its next context, see Arena. Can be changed with
+    // DD_IAST_MAX_RETAINED_TAINT_MEMORY
+    size_t max_retained_taint_memory;
     // This is a map instead of a set so we can change the contents on iteration; otherwise
     // keys and values are the same pointer.
     unordered_map<TaintRangeMapType*, TaintRangeMapTypePtr> active_map_addreses;
@@ -66,6 +75,50 @@ class Initializer
 
     static string debug_taint_map();
 
+    /**
+     * Interns a source in the source table of the current context.
+     *
+     * @param source The source to intern.
+     * @return The id of the source, valid until the context is reset.
+     */
+    static SourceId intern_source(const Source& source);
+
+    /**
+     * Gets a source interned in the current context.
+     *
+     * @param source_id The id returned by intern_source.
+     * @return The source, or an empty one if the id doesn't belong to the current context.
+     */
+    static const Source& get_source(SourceId source_id);
+
+    /**
+     * Gets the hash of a source interned in the current context, computed once when it was interned.
+     *
+     * @param source_id The id returned by intern_source.
+     * @return The hash of the source, as Source::get_hash computes it.
+     */
+    static int get_source_hash(SourceId source_id);
+
+    /**
+     * Gets the number of bytes of the arena of a thread kept for its next context once the current one ends.
+     */
+    [[nodiscard]] size_t get_max_retained_taint_memory() const { return max_retained_taint_memory; }
+
+    /**
+     * Accounts a new tainted object with num_ranges ranges in the taint budget of the current context. Once the
+     * budget is spent, no more objects are tainted in the context, so its cost is bounded whatever the request does.
+     *
+     * @param tx_map The taint map of the current context.
+     * @param num_ranges The number of ranges of the object.
+     * @return false if the object doesn't fit in the budget and must not be tainted.
+     */
+    bool consume_taint_budget(const TaintRangeMapTypePtr& tx_map, size_t num_ranges) const;
+
+    /**
+     * Whether a tainted object was left untainted in the current context because the budget was spent.
+     */
+    static bool taint_budget_exceeded();
+
     /**
      * Gets the size of the Initializer object.
      *
@@ -91,26 +144,44 @@ class Initializer
     void reset_context();
 
     /**
-     * Allocates a new tainted object.
+     * Gets the current taint tracking context, to attach other threads to it.
+     *
+     * @return The context, or nullptr if there is no current context.
+     */
+    static TaintContextPtr get_context();
 
-     * IMPORTANT: if the returned object is not assigned to the map, you have responsibility of calling
-     * release_tainted_object on it or you'll have a leak.
+    /**
+     * Makes a context the current one of the calling thread, until detach_context. The objects tainted by the thread
+     * are then tracked in the context, and reset with it, as if the thread that created it had tainted them.
      *
-     * IMPORTANT2: allocate_ranges_into_taint_object moves the owner of the ranges, if you know the ranges of the
-     original
-     * tainted object should be used more times, use instead allocate_ranges_into_taint_object_copy.
+     * @param context The context returned by get_context in another thread.
+     */
+    static void attach_context(const TaintContextPtr& context);
+
+    /**
+     * Makes the context the thread had before attach_context the current one again, leaving the attached context
+     * to the threads still using it.
+     */
+    static void detach_context();
+
+    /**
+     * Allocates a new tainted object in the arena of the context of the current thread, reusing a released one if
+     * any. Like everything else in the arena, it must not be used after the context is reset.
+
+     * IMPORTANT: if the returned object is not assigned to the map, you have responsibility of calling
+     * release_tainted_object on it, or it won't be reused until the context ends.
      *
      * @return A pointer to the allocated tainted object.
      */
-    TaintedObjectPtr allocate_tainted_object();
+    static TaintedObjectPtr allocate_tainted_object();
 
     /**
-     * Allocates taint ranges into new tainted object.
+     * Allocates and copy taint ranges into new tainted object.
      *
      * @param ranges The taint ranges to assign to the allocated object.
      * @return A pointer to the allocated tainted object.
      */
-    TaintedObjectPtr allocate_ranges_into_taint_object(TaintRangeRefs ranges);
+    static TaintedObjectPtr allocate_ranges_into_taint_object(const TaintRangeRefs& ranges);
 
     /**
      * Allocates and copy taint ranges into new tainted object.
@@ -118,24 +189,33 @@ class Initializer
      * @param ranges The taint ranges to assign to the allocated object.
      * @return A pointer to the allocated tainted object.
      */
-    TaintedObjectPtr allocate_ranges_into_taint_object_copy(const TaintRangeRefs& ranges);
+    static TaintedObjectPtr allocate_ranges_into_taint_object_copy(const TaintRangeRefs& ranges);
 
     /**
-     * Allocates and copy taint ranges from a Tainted Object into new tainted object.
+     * Allocates a new tainted object sharing the ranges of an existing one.
      *
      * @param from The existing tainted object to copy.
      * @return A pointer to the allocated tainted object.
      */
-    TaintedObjectPtr allocate_tainted_object_copy(const TaintedObjectPtr& from);
+    static TaintedObjectPtr allocate_tainted_object_copy(const TaintedObjectPtr& from);
 
-    void release_tainted_object(TaintedObjectPtr tobj);
+    /**
+     * Releases a tainted object, keeping it for reuse until the context ends.
+     *
+     * @param tobj The tainted object to release.
+     */
+    static void release_tainted_object(TaintedObjectPtr tobj);
 
-    // FIXME: these should be static functions of TaintRange
-    // IMPORTANT: if the returned object is not assigned to the map, you have
-    // responsibility of calling release_taint_range on it or you'll have a leak.
-    TaintRangePtr allocate_taint_range(RANGE_START start, RANGE_LENGTH length, const Source& source);
+    /**
+     * Allocates storage for at least capacity ranges in the arena of the context of the current thread, reusing a
+     * released block if any.
+     */
+    static TaintRangeBlock* allocate_range_block(size_t capacity);
 
-    void release_taint_range(TaintRangePtr rangeptr);
+    /**
+     * Releases the storage of ranges no tainted object uses any more, keeping it for reuse until the context ends.
+     */
+    static void release_range_block(TaintRangeBlock* block);
 };
 
 extern unique_ptr<Initializer> initializer;
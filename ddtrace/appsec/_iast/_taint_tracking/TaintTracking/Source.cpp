@@ -1,3 +1,5 @@
+#include <atomic>
+
 #include <pybind11/pybind11.h>
 
 #include "Source.h"
@@ -40,6 +42,60 @@ Source::get_hash() const
     return std::hash<size_t>()(std::hash<string>()(name) ^ static_cast<long>(origin) ^ std::hash<string>()(value));
 };
 
+// Shared by the tables of all threads, so a SourceId never resolves in a table it doesn't come from
+static atomic<uint32_t> next_source_table_generation{ 1 };
+
+static const Source empty_source("", "", OriginType::EMPTY);
+
+SourceTable::SourceTable()
+  : generation_(next_source_table_generation++)
+{}
+
+SourceId
+SourceTable::intern(const Source& source)
+{
+    const auto hash = source.get_hash();
+    for (auto [it, end] = indexes_.equal_range(hash); it != end; ++it) {
+        if (const auto& interned = sources_[it->second].source; interned.origin == source.origin and
+                                                                 interned.name == source.name and
+                                                                 interned.value == source.value) {
+            return { generation_, it->second };
+        }
+    }
+
+    const auto index = static_cast<uint32_t>(sources_.size());
+    sources_.push_back({ source, hash });
+    indexes_.emplace(hash, index);
+    return { generation_, index };
+}
+
+const Source&
+SourceTable::get(const SourceId source_id) const
+{
+    if (source_id.table != generation_ or source_id.index >= sources_.size()) {
+        return empty_source;
+    }
+    return sources_[source_id.index].source;
+}
+
+int
+SourceTable::get_hash(const SourceId source_id) const
+{
+    if (source_id.table != generation_ or source_id.index >= sources_.size()) {
+        static const int empty_source_hash = empty_source.get_hash();
+        return empty_source_hash;
+    }
+    return sources_[source_id.index].hash;
+}
+
+void
+SourceTable::clear()
+{
+    indexes_.clear();
+    sources_.clear();
+    generation_ = next_source_table_generation++;
+}
+
 void
 pyexport_source(py::module& m)
 {
@@ -1,5 +1,8 @@
 #pragma once
+#include <deque>
+#include <functional>
 #include <sstream>
+#include <unordered_map>
 
 #include "../Constants.h"
 
@@ -65,6 +68,67 @@ struct Source
     explicit operator std::string() const;
 };
 
+/**
+ * Reference to a Source interned in a SourceTable. Taint ranges carry this instead of
+ * the Source itself, so copying them doesn't copy (or refcount) the source strings.
+ */
+struct SourceId
+{
+    // Generation of the table the source was interned in, 0 means no source
+    uint32_t table = 0;
+    // Position of the source in that table
+    uint32_t index = 0;
+
+    // Sources are interned, so the same source always gets the same id within a table
+    bool operator==(const SourceId& other) const { return table == other.table and index == other.index; }
+};
+
+/**
+ * Table of the distinct sources of a taint tracking context.
+ *
+ * Sources are only appended, and the whole table is dropped at once when the context is reset. Each clear()
+ * starts a new generation, so the SourceIds of the previous one are no longer resolved instead of pointing to
+ * another source.
+ */
+class SourceTable
+{
+  private:
+    struct InternedSource
+    {
+        Source source;
+        // Hashing a source hashes its value, which can be a whole request body, so it's done once when interning
+        int hash;
+    };
+
+    uint32_t generation_;
+    // A deque so the sources stay in place while appending
+    deque<InternedSource> sources_;
+    // Positions of the sources by hash, so that growing the index doesn't hash the sources again
+    unordered_multimap<int, uint32_t> indexes_;
+
+  public:
+    SourceTable();
+
+    /**
+     * Gets the id of a source, adding it to the table if it wasn't there yet.
+     */
+    SourceId intern(const Source& source);
+
+    /**
+     * Gets an interned source, or an empty one if the id comes from another table or generation.
+     */
+    [[nodiscard]] const Source& get(SourceId source_id) const;
+
+    /**
+     * Gets the hash of an interned source, as Source::get_hash computes it, without hashing its strings again.
+     */
+    [[nodiscard]] int get_hash(SourceId source_id) const;
+
+    void clear();
+
+    [[nodiscard]] size_t size() const { return sources_.size(); }
+};
+
 inline string
 origin_to_str(const OriginType origin_type)
 {
@@ -0,0 +1,103 @@
+#include "TaintMap.h"
+
+#include <cstring>
+
+size_t
+TaintMap::find_free_slot(const size_t hash) const
+{
+    size_t group = (hash >> H2_BITS) & group_mask();
+    for (size_t probe = 1;; ++probe) {
+        if (const uint32_t mask = Group(ctrl_.get() + group * GROUP_SIZE).match_free(); mask != 0) {
+            return group * GROUP_SIZE + __builtin_ctz(mask);
+        }
+        group = (group + probe) & group_mask();
+    }
+}
+
+std::pair<TaintMap::iterator, bool>
+TaintMap::insert(const value_type& value)
+{
+    if (const auto it = find(value.first); it != end()) {
+        return { it, false };
+    }
+
+    if (growth_left_ == 0) {
+        // Rehashing at the same capacity is enough to drop the deleted slots when they take most of the room
+        rehash(size_ < max_load(capacity_) / 2 ? capacity_ : capacity_ * 2);
+    }
+
+    const size_t hash = hash_key(value.first);
+    const size_t index = find_free_slot(hash);
+    if (ctrl_[index] == EMPTY) {
+        --growth_left_;
+    }
+    ctrl_[index] = static_cast<int8_t>(hash & H2_MASK);
+    slots_[index] = value;
+    ++size_;
+    filter_[filter_index(hash)] |= filter_bits(hash);
+    return { iterator_at(index), true };
+}
+
+void
+TaintMap::erase(const iterator it)
+{
+    const auto index = static_cast<size_t>(it.slot_ - slots_.get());
+
+    // No probe sequence goes past a group which has an empty slot, so the slot can be made empty again. Otherwise
+    // the lookups of the keys inserted after this group was full must keep probing past it.
+    if (Group(ctrl_.get() + (index & ~(GROUP_SIZE - 1))).match(EMPTY) != 0) {
+        ctrl_[index] = EMPTY;
+        ++growth_left_;
+    } else {
+        ctrl_[index] = DELETED;
+    }
+    --size_;
+}
+
+void
+TaintMap::clear()
+{
+    if (capacity_ > MAX_RETAINED_CAPACITY) {
+        ctrl_.reset();
+        slots_.reset();
+        capacity_ = 0;
+        growth_left_ = 0;
+    } else if (capacity_ != 0) {
+        // The entries are left as they are, only a full control byte marks an entry as valid
+        memset(ctrl_.get(), EMPTY, capacity_);
+        growth_left_ = max_load(capacity_);
+    }
+    size_ = 0;
+    sweep_index_ = 0;
+    sweep_interval_ = 1;
+    sweep_countdown_ = 1;
+    filter_.fill(0);
+}
+
+void
+TaintMap::rehash(size_t new_capacity)
+{
+    if (new_capacity < MIN_CAPACITY) {
+        new_capacity = MIN_CAPACITY;
+    }
+
+    auto old_ctrl = std::move(ctrl_);
+    auto old_slots = std::move(slots_);
+    const size_t old_capacity = capacity_;
+
+    ctrl_ = std::make_unique<int8_t[]>(new_capacity);
+    memset(ctrl_.get(), EMPTY, new_capacity);
+    slots_ = std::make_unique<value_type[]>(new_capacity);
+    capacity_ = new_capacity;
+    growth_left_ = max_load(new_capacity) - size_;
+
+    for (size_t i = 0; i < old_capacity; ++i) {
+        if (old_ctrl[i] < 0) {
+            continue;
+        }
+        const size_t hash = hash_key(old_slots[i].first);
+        const size_t index = find_free_slot(hash);
+        ctrl_[index] = static_cast<int8_t>(hash & H2_MASK);
+        slots_[index] = old_slots[i];
+    }
+}
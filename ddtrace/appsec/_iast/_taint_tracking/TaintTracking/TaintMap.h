@@ -0,0 +1,305 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <utility>
+
+#include <Python.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Forward declarations
+class TaintedObject;
+
+// Alias
+using TaintedObjectPtr = TaintedObject*;
+
+/**
+ * Hash map from the address of a tainted object to its hash and its TaintedObject.
+ *
+ * The entries are stored inline in a single array and looked up the way Swiss tables do: every slot has a control
+ * byte holding 7 bits of the hash of its key, and the slots are probed by groups of 16, so a lookup compares the
+ * control bytes of a whole group at once (with SSE2 when available) and only reads the entries whose bits match.
+ *
+ * Clearing the map keeps its storage, up to MAX_RETAINED_CAPACITY slots, and only resets the control bytes: a map
+ * reused by the next context of the same thread doesn't allocate again until it grows past its previous size.
+ *
+ * A small Bloom filter of the keys inserted since the last clear tells with a single memory access that most of the
+ * objects aren't in the map, since most of the objects an aspect sees are not tainted.
+ */
+class TaintMap
+{
+  public:
+    using key_type = uintptr_t;
+    using mapped_type = std::pair<Py_hash_t, TaintedObjectPtr>;
+    using value_type = std::pair<key_type, mapped_type>;
+
+    class iterator
+    {
+      public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = TaintMap::value_type;
+        using difference_type = std::ptrdiff_t;
+        using pointer = value_type*;
+        using reference = value_type&;
+
+        iterator() = default;
+
+        iterator(const int8_t* ctrl, const int8_t* ctrl_end, value_type* slot)
+          : ctrl_(ctrl)
+          , ctrl_end_(ctrl_end)
+          , slot_(slot)
+        {
+        }
+
+        reference operator*() const { return *slot_; }
+        pointer operator->() const { return slot_; }
+
+        iterator& operator++()
+        {
+            ++ctrl_;
+            ++slot_;
+            skip_free_slots();
+            return *this;
+        }
+
+        bool operator==(const iterator& other) const { return slot_ == other.slot_; }
+        bool operator!=(const iterator& other) const { return slot_ != other.slot_; }
+
+      private:
+        friend class TaintMap;
+
+        void skip_free_slots()
+        {
+            while (ctrl_ != ctrl_end_ and *ctrl_ < 0) {
+                ++ctrl_;
+                ++slot_;
+            }
+        }
+
+        const int8_t* ctrl_ = nullptr;
+        const int8_t* ctrl_end_ = nullptr;
+        value_type* slot_ = nullptr;
+    };
+
+    TaintMap() = default;
+
+    TaintMap(const TaintMap&) = delete;
+    TaintMap& operator=(const TaintMap&) = delete;
+
+    iterator begin()
+    {
+        iterator it(ctrl_.get(), ctrl_.get() + capacity_, slots_.get());
+        it.skip_free_slots();
+        return it;
+    }
+
+    iterator end() { return { ctrl_.get() + capacity_, ctrl_.get() + capacity_, slots_.get() + capacity_ }; }
+
+    [[nodiscard]] bool empty() const { return size_ == 0; }
+
+    [[nodiscard]] size_t size() const { return size_; }
+
+    [[nodiscard]] size_t capacity() const { return capacity_; }
+
+    /**
+     * Whether the key may be in the map. False means that it isn't, without probing the entries. Erasing a key
+     * doesn't remove it from the filter, only clearing the map does.
+     */
+    [[nodiscard]] bool may_contain(const key_type key) const
+    {
+        const size_t hash = hash_key(key);
+        const uint64_t bits = filter_bits(hash);
+        return (filter_[filter_index(hash)] & bits) == bits;
+    }
+
+    // Defined here since it's called for every operand of every aspect
+    iterator find(const key_type key)
+    {
+        if (size_ == 0) {
+            return end();
+        }
+
+        const size_t hash = hash_key(key);
+        const auto h2 = static_cast<int8_t>(hash & H2_MASK);
+        size_t group = (hash >> H2_BITS) & group_mask();
+        for (size_t probe = 1;; ++probe) {
+            const Group ctrl_group(ctrl_.get() + group * GROUP_SIZE);
+            for (uint32_t mask = ctrl_group.match(h2); mask != 0; mask &= mask - 1) {
+                const size_t index = group * GROUP_SIZE + __builtin_ctz(mask);
+                if (slots_[index].first == key) {
+                    return iterator_at(index);
+                }
+            }
+            if (ctrl_group.match(EMPTY) != 0) {
+                return end();
+            }
+            // Triangular probing visits every group, since the number of groups is a power of 2
+            group = (group + probe) & group_mask();
+        }
+    }
+
+    /**
+     * Inserts an entry, unless the key is already in the map.
+     *
+     * @return The entry with the key, and whether it was inserted.
+     */
+    std::pair<iterator, bool> insert(const value_type& value);
+
+    /**
+     * Removes an entry. Invalidates no other iterator.
+     */
+    void erase(iterator it);
+
+    /**
+     * Removes all the entries, in time proportional to the capacity in control bytes rather than to the entries.
+     */
+    void clear();
+
+    /**
+     * Visits the entries following those visited by the previous sweep, wrapping around at the end of the slots, up
+     * to max_entries entries or max_slots slots, and erases those for which is_stale returns true. Sweeping a few
+     * entries on every insertion eventually visits all of them, entries inserted meanwhile included.
+     *
+     * The calls following a sweep which erased nothing are skipped, more of them every time up to
+     * MAX_SWEEP_INTERVAL - 1, so that a map whose entries all stay valid is rarely swept.
+     *
+     * @return The number of entries erased.
+     */
+    template<typename Predicate>
+    size_t sweep(const size_t max_entries, const size_t max_slots, Predicate&& is_stale)
+    {
+        if (--sweep_countdown_ > 0) {
+            return 0;
+        }
+
+        size_t erased = 0;
+        size_t entries = 0;
+        for (size_t slots = 0; slots < max_slots and slots < capacity_ and entries < max_entries; ++slots) {
+            if (sweep_index_ >= capacity_) {
+                sweep_index_ = 0;
+            }
+            const size_t index = sweep_index_++;
+            if (ctrl_[index] < 0) {
+                continue;
+            }
+            ++entries;
+            if (is_stale(slots_[index])) {
+                erase(iterator_at(index));
+                ++erased;
+            }
+        }
+        sweep_interval_ = erased != 0 ? 1 : std::min(sweep_interval_ * 2, MAX_SWEEP_INTERVAL);
+        sweep_countdown_ = sweep_interval_;
+        return erased;
+    }
+
+  private:
+    static constexpr size_t GROUP_SIZE = 16;
+    static constexpr size_t MIN_CAPACITY = GROUP_SIZE;
+    // Larger storage is freed on clear() instead of being kept for the next context
+    static constexpr size_t MAX_RETAINED_CAPACITY = 16384;
+    static constexpr size_t H2_BITS = 7;
+    static constexpr size_t H2_MASK = (1 << H2_BITS) - 1;
+    // Control bytes of the slots without entry, the full ones hold 7 bits of the hash of their key
+    static constexpr int8_t EMPTY = -128;
+    static constexpr int8_t DELETED = -2;
+    // 64K bits, which keep false positives under 1% up to a few thousand tainted objects
+    static constexpr size_t FILTER_WORDS = 1024;
+    static constexpr size_t MAX_SWEEP_INTERVAL = 64;
+
+    /**
+     * Control bytes of GROUP_SIZE consecutive slots, matched to a pattern into a bit mask of the slots.
+     */
+    class Group
+    {
+      public:
+        explicit Group(const int8_t* ctrl)
+#if defined(__SSE2__)
+          : ctrl_(_mm_loadu_si128(reinterpret_cast<const __m128i*>(ctrl)))
+#else
+          : ctrl_(ctrl)
+#endif
+        {
+        }
+
+        [[nodiscard]] uint32_t match(const int8_t pattern) const
+        {
+#if defined(__SSE2__)
+            return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(pattern), ctrl_)));
+#else
+            uint32_t mask = 0;
+            for (size_t i = 0; i < GROUP_SIZE; ++i) {
+                mask |= static_cast<uint32_t>(ctrl_[i] == pattern) << i;
+            }
+            return mask;
+#endif
+        }
+
+        // Slots either empty or deleted, the only control bytes with the sign bit set
+        [[nodiscard]] uint32_t match_free() const
+        {
+#if defined(__SSE2__)
+            return static_cast<uint32_t>(_mm_movemask_epi8(ctrl_));
+#else
+            uint32_t mask = 0;
+            for (size_t i = 0; i < GROUP_SIZE; ++i) {
+                mask |= static_cast<uint32_t>(ctrl_[i] < 0) << i;
+            }
+            return mask;
+#endif
+        }
+
+      private:
+#if defined(__SSE2__)
+        __m128i ctrl_;
+#else
+        const int8_t* ctrl_;
+#endif
+    };
+
+    static size_t hash_key(const key_type key)
+    {
+        // Object addresses are aligned, so their low bits are mixed with the high bits of the product
+        const uint64_t hash = static_cast<uint64_t>(key) * 0x9E3779B97F4A7C15ULL;
+        return static_cast<size_t>(hash ^ (hash >> 32));
+    }
+
+    // Two bits of a single word of the filter, taken from the high bits of the hash, which the probing doesn't use
+    static size_t filter_index(const size_t hash) { return (hash >> 52) & (FILTER_WORDS - 1); }
+
+    static uint64_t filter_bits(const size_t hash)
+    {
+        return (uint64_t{ 1 } << ((hash >> 40) & 63)) | (uint64_t{ 1 } << ((hash >> 46) & 63));
+    }
+
+    // At most 7/8 of the slots are used, so every probe sequence ends on an empty slot
+    static size_t max_load(const size_t capacity) { return capacity - capacity / 8; }
+
+    [[nodiscard]] size_t group_mask() const { return capacity_ / GROUP_SIZE - 1; }
+
+    iterator iterator_at(const size_t index)
+    {
+        return { ctrl_.get() + index, ctrl_.get() + capacity_, slots_.get() + index };
+    }
+
+    size_t find_free_slot(size_t hash) const;
+
+    void rehash(size_t new_capacity);
+
+    std::unique_ptr<int8_t[]> ctrl_;
+    std::unique_ptr<value_type[]> slots_;
+    size_t capacity_ = 0;
+    size_t size_ = 0;
+    // Empty slots which can still be used before growing
+    size_t growth_left_ = 0;
+    // Next slot visited by sweep(), which runs when the countdown reaches 0
+    size_t sweep_index_ = 0;
+    size_t sweep_interval_ = 1;
+    size_t sweep_countdown_ = 1;
+    std::array<uint64_t, FILTER_WORDS> filter_{};
+};
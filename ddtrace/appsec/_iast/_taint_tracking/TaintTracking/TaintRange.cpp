@@ -2,22 +2,32 @@
 #include "Initializer/Initializer.h"
 #include "Utils/StringUtils.h"
 
+#include <array>
+#include <cerrno>
+
+#if defined(__linux__)
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
 namespace py = pybind11;
 
-void
-TaintRange::reset()
+TaintRange::TaintRange(const RANGE_START start, const RANGE_LENGTH length, const Source& source)
+  : TaintRange(start, length, Initializer::intern_source(source))
+{}
+
+const Source&
+TaintRange::get_source() const
 {
-    source.reset();
-    start = 0;
-    length = 0;
-};
+    return Initializer::get_source(source);
+}
 
 string
 TaintRange::toString() const
 {
     ostringstream ret;
     ret << "TaintRange at " << this << " "
-        << "[start=" << start << ", length=" << length << " source=" << source.toString() << "]";
+        << "[start=" << start << ", length=" << length << " source=" << get_source().toString() << "]";
     return ret.str();
 }
 
@@ -28,27 +38,61 @@ TaintRange::operator std::string() const
 
 // Note: don't use size_t or long, if the hash is bigger than an int, Python
 // will re-hash it!
+static uint
+taint_range_hash(const RANGE_START start, const RANGE_LENGTH length, const int source_hash)
+{
+    const uint hstart = hash<uint>()(start);
+    const uint hlength = hash<uint>()(length);
+    const uint hsource = hash<uint>()(source_hash);
+    return hstart ^ hlength ^ hsource;
+}
+
 uint
 TaintRange::get_hash() const
 {
-    const uint hstart = hash<uint>()(this->start);
-    const uint hlength = hash<uint>()(this->length);
-    const uint hsource = hash<uint>()(this->source.get_hash());
-    return hstart ^ hlength ^ hsource;
+    return taint_range_hash(start, length, Initializer::get_source_hash(source));
 };
 
-TaintRangePtr
-shift_taint_range(const TaintRangePtr& source_taint_range, const RANGE_START offset, const RANGE_LENGTH new_length = -1)
+PyTaintRange::PyTaintRange(const RANGE_START start, const RANGE_LENGTH length, Source source)
+  : start(start)
+  , length(length)
+  , source(std::move(source))
+{
+    if (length <= 0) {
+        throw std::invalid_argument("Error: Length cannot be set to 0.");
+    }
+}
+
+PyTaintRange::PyTaintRange(const TaintRange& range)
+  : start(range.start)
+  , length(range.length)
+  , source(range.get_source())
+{}
+
+string
+PyTaintRange::toString() const
 {
-    const auto new_length_to_use = new_length == -1 ? source_taint_range->length : new_length;
-    auto tptr = initializer->allocate_taint_range(source_taint_range->start + offset, // start
-                                                  new_length_to_use,                  // length
-                                                  source_taint_range->source);        // origin
-    return tptr;
+    ostringstream ret;
+    ret << "TaintRange at " << this << " "
+        << "[start=" << start << ", length=" << length << " source=" << source.toString() << "]";
+    return ret.str();
+}
+
+uint
+PyTaintRange::get_hash() const
+{
+    return taint_range_hash(start, length, source.get_hash());
+}
+
+TaintRange
+shift_taint_range(const TaintRange& source_taint_range, const RANGE_START offset, const RANGE_LENGTH new_length = -1)
+{
+    const auto new_length_to_use = new_length == -1 ? source_taint_range.length : new_length;
+    return { source_taint_range.start + offset, new_length_to_use, source_taint_range.source };
 }
 
 TaintRangeRefs
-shift_taint_ranges(const TaintRangeRefs& source_taint_ranges,
+shift_taint_ranges(const TaintRangesView& source_taint_ranges,
                    const RANGE_START offset,
                    const RANGE_LENGTH new_length = -1)
 {
@@ -56,7 +100,7 @@ shift_taint_ranges(const TaintRangeRefs& source_taint_ranges,
     new_ranges.reserve(source_taint_ranges.size());
 
     for (const auto& trange : source_taint_ranges) {
-        new_ranges.emplace_back(shift_taint_range(trange, offset, new_length));
+        new_ranges.push_back(shift_taint_range(trange, offset, new_length));
     }
     return new_ranges;
 }
@@ -125,8 +169,7 @@ api_set_ranges_from_values(PyObject* self, PyObject* const* args, const Py_ssize
             if (const string source_value = PyObjectToString(args[3]); not source_value.empty()) {
                 const auto source_origin = static_cast<OriginType>(PyLong_AsLong(args[4]));
                 const auto source = Source(source_name, source_value, source_origin);
-                const auto range = initializer->allocate_taint_range(0, len_pyobject, source);
-                const auto ranges = vector{ range };
+                const auto ranges = TaintRangeRefs{ TaintRange(0, len_pyobject, source) };
                 result = set_ranges(pyobject_n, ranges, tx_map);
                 if (not result) {
                     result_error_msg = MSG_ERROR_SET_RANGES;
@@ -146,29 +189,263 @@ api_set_ranges_from_values(PyObject* self, PyObject* const* args, const Py_ssize
     return pyobject_n;
 }
 
-std::pair<TaintRangeRefs, bool>
-get_ranges(PyObject* string_input, const TaintRangeMapTypePtr& tx_map)
+// UTF-8 text of a source name or value given as str or bytes, undecodable bytes are dropped. Empty if the object
+// isn't text or can't be encoded.
+static string
+source_text(PyObject* obj)
+{
+    if (PyUnicode_Check(obj)) {
+        Py_ssize_t size;
+        if (const char* data = PyUnicode_AsUTF8AndSize(obj, &size)) {
+            return { data, static_cast<size_t>(size) };
+        }
+        PyErr_Clear();
+        return {};
+    }
+    if (PyBytes_Check(obj) or PyByteArray_Check(obj)) {
+        const auto decoded = py::reinterpret_steal<py::object>(
+          PyUnicode_DecodeUTF8(PyBytes_Check(obj) ? PyBytes_AS_STRING(obj) : PyByteArray_AS_STRING(obj),
+                               PyBytes_Check(obj) ? PyBytes_GET_SIZE(obj) : PyByteArray_GET_SIZE(obj),
+                               "ignore"));
+        if (decoded) {
+            return source_text(decoded.ptr());
+        }
+        PyErr_Clear();
+    }
+    return {};
+}
+
+/**
+ * taint_pyobjects.
+ *
+ * Taints a batch of objects in a single call, as set_ranges_from_values does for each of them with the object as
+ * the source value. Used when a request comes in to taint its headers, parameters or cookies at once.
+ *
+ * @param self The Python extension module.
+ * @param args An array of Python objects.
+ *   @param args[0] list of (pyobject, source name, origin type) tuples. The source name can also be bytes or an
+ *   origin type, taken as its name.
+ * @param nargs The number of arguments in the 'args' array.
+ * @return A list with the tainted copy of each object, or the object itself if it isn't a non-empty text or can't
+ * be tainted.
+ */
+PyObject*
+api_taint_pyobjects(PyObject* self, PyObject* const* args, const Py_ssize_t nargs)
+{
+    if (nargs != 1 or not PyList_Check(args[0])) {
+        py::set_error(PyExc_ValueError, MSG_ERROR_N_PARAMS);
+        return nullptr;
+    }
+    const auto tx_map = initializer->get_tainting_map();
+    if (not tx_map) {
+        py::set_error(PyExc_ValueError, MSG_ERROR_TAINT_MAP);
+        return nullptr;
+    }
+
+    // Converting an OriginType calls into pybind11, and the items of a batch share a few origins
+    std::array<std::pair<PyObject*, long>, 4> origins{};
+    size_t num_origins = 0;
+    const auto origin_value = [&](PyObject* origin_object) {
+        for (size_t i = 0; i < num_origins; i++) {
+            if (origins[i].first == origin_object) {
+                return origins[i].second;
+            }
+        }
+        const long origin = PyLong_AsLong(origin_object);
+        if (origin >= 0) {
+            origins[num_origins % origins.size()] = { origin_object, origin };
+            num_origins = std::min(num_origins + 1, origins.size());
+        }
+        return origin;
+    };
+
+    PyObject* items = args[0];
+    const auto num_items = PyList_GET_SIZE(items);
+    PyObject* results = PyList_New(num_items);
+    if (results == nullptr) {
+        return nullptr;
+    }
+    for (Py_ssize_t i = 0; i < num_items; i++) {
+        PyObject* item = PyList_GET_ITEM(items, i);
+        if (not PyTuple_Check(item) or PyTuple_GET_SIZE(item) != 3) {
+            Py_DecRef(results);
+            py::set_error(PyExc_ValueError, MSG_ERROR_N_PARAMS);
+            return nullptr;
+        }
+        PyObject* pyobject = PyTuple_GET_ITEM(item, 0);
+        PyObject* result = pyobject;
+
+        if (const auto length = static_cast<long>(get_pyobject_size(pyobject)); length > 0) {
+            PyObject* name_object = PyTuple_GET_ITEM(item, 1);
+            string name;
+            if (PyUnicode_Check(name_object) or PyBytes_Check(name_object) or PyByteArray_Check(name_object)) {
+                name = source_text(name_object);
+            } else if (not PyLong_Check(name_object)) {
+                // An OriginType
+                if (const long name_origin = origin_value(name_object); name_origin >= 0) {
+                    name = origin_to_str(static_cast<OriginType>(name_origin));
+                }
+            }
+            const long origin = origin_value(PyTuple_GET_ITEM(item, 2));
+            PyErr_Clear();
+
+            if (string value = source_text(pyobject); not name.empty() and not value.empty() and origin >= 0) {
+                PyObject* pyobject_n = new_pyobject_id(pyobject);
+                if (set_ranges(pyobject_n,
+                               { TaintRange(0, length, Source(std::move(name), std::move(value), OriginType(origin))) },
+                               tx_map)) {
+                    result = pyobject_n;
+                } else {
+                    Py_DecRef(pyobject_n);
+                }
+            }
+        }
+        if (result == pyobject) {
+            Py_IncRef(pyobject);
+        }
+        PyList_SET_ITEM(results, i, result);
+    }
+    return results;
+}
+
+std::pair<TaintRangesView, bool>
+get_ranges_view(PyObject* string_input, const TaintRangeMapTypePtr& tx_map)
 {
-    TaintRangeRefs result;
     if (not is_text(string_input))
-        return std::make_pair(result, true);
+        return std::make_pair(TaintRangesView(), true);
 
-    if (tx_map->empty()) {
-        return std::make_pair(result, false);
+    const auto obj_id = get_unique_id(string_input);
+    // Not checking the fast taint mark, interned strings are tainted too when set explicitly
+    if (not tx_map->may_contain(obj_id)) {
+        return std::make_pair(TaintRangesView(), false);
     }
-    const auto it = tx_map->find(get_unique_id(string_input));
+    const auto it = tx_map->find(obj_id);
     if (it == tx_map->end()) {
-        return std::make_pair(result, false);
+        return std::make_pair(TaintRangesView(), false);
     }
 
     if (get_internal_hash(string_input) != it->second.first) {
         tx_map->erase(it);
-        return std::make_pair(result, false);
+        return std::make_pair(TaintRangesView(), false);
     }
 
     return std::make_pair(it->second.second->get_ranges(), false);
 }
 
+std::pair<TaintRangeRefs, bool>
+get_ranges(PyObject* string_input, const TaintRangeMapTypePtr& tx_map)
+{
+    const auto [ranges, ranges_error] = get_ranges_view(string_input, tx_map);
+    return std::make_pair(TaintRangeRefs(ranges.begin(), ranges.end()), ranges_error);
+}
+
+// Entries checked, and slots visited at most, by a sweep of a taint map
+constexpr size_t SWEEP_ENTRIES = 4;
+constexpr size_t SWEEP_SLOTS = 64;
+
+#if defined(__linux__)
+// Set when process_vm_readv() isn't allowed here, e.g. by a seccomp filter
+static bool sweep_unavailable = false;
+
+// Copies memory which may have been freed, and unmapped, since. Returns false if it couldn't be read.
+static bool
+read_memory(void* dest, const uintptr_t src, const size_t size)
+{
+    iovec local{ dest, size };
+    iovec remote{ reinterpret_cast<void*>(src), size };
+    if (process_vm_readv(getpid(), &local, 1, &remote, 1, 0) == static_cast<ssize_t>(size)) {
+        return true;
+    }
+    if (errno == ENOSYS or errno == EPERM) {
+        sweep_unavailable = true;
+    }
+    return false;
+}
+
+// The allocator of small objects keeps its free blocks in lists linked through their first word, the reference count
+constexpr uintptr_t FREE_LIST_SPAN = 1 << 20;
+
+/**
+ * Whether the object the entry was inserted for is gone: the memory at its address isn't mapped anymore, or is free,
+ * or holds something else than text, or a str or bytes object with another hash than the one of the entry. This is
+ * the check of get_internal_hash() on lookup, made without calling into an object which may have been freed: the hash
+ * of str and bytes objects is cached in the object once computed, which it was when the entry was inserted. Bytearrays
+ * and the subclasses of the text types may compute their hash, so their entries are only dropped when looked up.
+ */
+static bool
+is_stale_entry(const uintptr_t obj_id, const Py_hash_t hash)
+{
+    // The header of str and bytes objects, both followed by their cached hash (PyBytesObject::ob_shash is deprecated
+    // but still cached), read at once
+    struct
+    {
+        PyVarObject header;
+        Py_hash_t hash;
+    } object;
+    static_assert(offsetof(PyASCIIObject, hash) == sizeof(PyVarObject), "The hash of a str follows its header");
+    if (not read_memory(&object, obj_id, sizeof(object))) {
+        // Unless the memory just can't be read here, the object was freed along with the memory it was in
+        return not sweep_unavailable;
+    }
+
+#if !defined(Py_GIL_DISABLED)
+    // Either the end of a free list or the next free block, which is close by, rather than a reference count
+    const auto refcnt = static_cast<uintptr_t>(object.header.ob_base.ob_refcnt);
+    if (refcnt == 0 or (refcnt ^ obj_id) < FREE_LIST_SPAN) {
+        return true;
+    }
+#endif
+
+    const PyTypeObject* type = object.header.ob_base.ob_type;
+    if (type == &PyUnicode_Type or type == &PyBytes_Type) {
+        // The hash of a str is never reset once computed, so a str without one is another str. Bytes are only told
+        // apart by their hash when they cache it.
+        if (object.hash == -1) {
+            return type == &PyUnicode_Type;
+        }
+        return object.hash != hash;
+    }
+    if (type == &PyByteArray_Type) {
+        return false;
+    }
+
+    // Whatever is there now, the type is only read the same way
+    const auto type_address = reinterpret_cast<uintptr_t>(type);
+    unsigned long flags = 0;
+    PyTypeObject* base = nullptr;
+    if (not read_memory(&flags, type_address + offsetof(PyTypeObject, tp_flags), sizeof(flags)) or
+        not read_memory(&base, type_address + offsetof(PyTypeObject, tp_base), sizeof(base))) {
+        return true;
+    }
+    return not(flags & (Py_TPFLAGS_UNICODE_SUBCLASS | Py_TPFLAGS_BYTES_SUBCLASS)) and base != &PyByteArray_Type;
+}
+#endif
+
+/**
+ * Drops a few of the entries of the map whose objects are gone, which are otherwise only dropped when a new object
+ * at the same address is looked up, or when the context ends. Called before inserting an entry, so that long lived
+ * contexts keep a map proportional to their live tainted objects, and that the gone ones don't count in the budget
+ * of tainted objects. Linux only, where the memory of the objects which may be gone can be read safely.
+ */
+static void
+sweep_stale_entries(const TaintRangeMapTypePtr& tx_map)
+{
+#if defined(__linux__)
+    if (sweep_unavailable) {
+        return;
+    }
+    tx_map->sweep(SWEEP_ENTRIES, SWEEP_SLOTS, [](TaintRangeMapType::value_type& entry) {
+        if (not is_stale_entry(entry.first, entry.second.first)) {
+            return false;
+        }
+        entry.second.second->decref();
+        return true;
+    });
+#else
+    (void)tx_map;
+#endif
+}
+
 bool
 set_ranges(PyObject* str, const TaintRangeRefs& ranges, const TaintRangeMapTypePtr& tx_map)
 {
@@ -177,6 +454,12 @@ set_ranges(PyObject* str, const TaintRangeRefs& ranges, const TaintRangeMapTypeP
     }
     auto obj_id = get_unique_id(str);
     const auto it = tx_map->find(obj_id);
+    if (it == tx_map->end()) {
+        sweep_stale_entries(tx_map);
+        if (not initializer->consume_taint_budget(tx_map, ranges.size())) {
+            return false;
+        }
+    }
     auto new_tainted_object = initializer->allocate_ranges_into_taint_object(ranges);
 
     set_fast_tainted_if_notinterned_unicode(str);
@@ -206,35 +489,34 @@ are_all_text_all_ranges(PyObject* candidate_text, const py::tuple& parameter_lis
         return { {}, {} };
     }
 
-    auto [candidate_text_ranges, ranges_error] = get_ranges(candidate_text, tx_map);
+    auto [candidate_text_ranges, ranges_error] = get_ranges_view(candidate_text, tx_map);
     if (not ranges_error) {
         for (const auto& param_handler : parameter_list) {
             if (const auto param = param_handler.cast<py::object>().ptr(); is_text(param)) {
-                if (auto [ranges, ranges_error] = get_ranges(param, tx_map); not ranges_error) {
+                if (auto [ranges, ranges_error] = get_ranges_view(param, tx_map); not ranges_error) {
                     all_ranges.insert(all_ranges.end(), ranges.begin(), ranges.end());
                 }
             }
         }
         all_ranges.insert(all_ranges.end(), candidate_text_ranges.begin(), candidate_text_ranges.end());
     }
-    return { all_ranges, candidate_text_ranges };
+    return { all_ranges, TaintRangeRefs(candidate_text_ranges.begin(), candidate_text_ranges.end()) };
 }
 
-TaintRangePtr
+optional<TaintRange>
 get_range_by_hash(const size_t range_hash, optional<TaintRangeRefs>& taint_ranges)
 {
     if (not taint_ranges or taint_ranges->empty()) {
-        return nullptr;
+        return nullopt;
     }
     // TODO: Replace this loop with a efficient function, vector.find() is O(n)
     // too.
-    TaintRangePtr null_range = nullptr;
     for (const auto& range : taint_ranges.value()) {
-        if (range_hash == range->get_hash()) {
+        if (range_hash == range.get_hash()) {
             return range;
         }
     }
-    return null_range;
+    return nullopt;
 }
 
 TaintRangeRefs
@@ -284,7 +566,7 @@ api_copy_and_shift_ranges_from_strings(py::object& str_1,
         py::set_error(PyExc_ValueError, MSG_ERROR_TAINT_MAP);
         return;
     }
-    auto [ranges, ranges_error] = get_ranges(str_1.ptr(), tx_map);
+    auto [ranges, ranges_error] = get_ranges_view(str_1.ptr(), tx_map);
     if (ranges_error) {
         py::set_error(PyExc_TypeError, MSG_ERROR_TAINT_MAP);
         return;
@@ -301,11 +583,12 @@ get_tainted_object(PyObject* str, const TaintRangeMapTypePtr& tx_map)
     if (not str)
         return nullptr;
 
-    if (is_notinterned_notfasttainted_unicode(str) or tx_map->empty()) {
+    const auto obj_id = get_unique_id(str);
+    if (is_notinterned_notfasttainted_unicode(str) or not tx_map->may_contain(obj_id)) {
         return nullptr;
     }
 
-    const auto it = tx_map->find(get_unique_id(str));
+    const auto it = tx_map->find(obj_id);
     if (it == tx_map->end()) {
         return nullptr;
     }
@@ -359,6 +642,11 @@ set_tainted_object(PyObject* str, TaintedObjectPtr tainted_object, const TaintRa
         it->second.first = get_internal_hash(str);
         return;
     }
+    sweep_stale_entries(tx_map);
+    if (not initializer->consume_taint_budget(tx_map, tainted_object->get_ranges().size())) {
+        // Not referenced by the map, it stays in the arena until the context ends
+        return;
+    }
     tainted_object->incref();
     tx_map->insert({ obj_id, std::make_pair(get_internal_hash(str), tainted_object) });
 }
@@ -417,34 +705,34 @@ pyexport_taintrange(py::module& m)
 
     m.def("get_range_by_hash", &get_range_by_hash, "range_hash"_a, "taint_ranges"_a);
 
-    // Fake constructor, used to force calling allocate_taint_range for performance reasons
+    // Fake constructor, kept so the Python API doesn't change
     m.def(
       "taint_range",
       [](const RANGE_START start, const RANGE_LENGTH length, const Source& source) {
-          return initializer->allocate_taint_range(start, length, source);
+          return PyTaintRange(start, length, source);
       },
       "start"_a,
       "length"_a,
       "source"_a);
 
-    py::class_<TaintRange, shared_ptr<TaintRange>>(m, "TaintRange_")
+    py::class_<PyTaintRange>(m, "TaintRange_")
       // Normal constructor disabled on the Python side, see above
-      .def_readonly("start", &TaintRange::start)
-      .def_readonly("length", &TaintRange::length)
-      .def_readonly("source", &TaintRange::source)
-      .def("__str__", &TaintRange::toString)
-      .def("__repr__", &TaintRange::toString)
-      .def("__hash__", &TaintRange::get_hash)
-      .def("get_hash", &TaintRange::get_hash)
+      .def_readonly("start", &PyTaintRange::start)
+      .def_readonly("length", &PyTaintRange::length)
+      .def_readonly("source", &PyTaintRange::source)
+      .def("__str__", &PyTaintRange::toString)
+      .def("__repr__", &PyTaintRange::toString)
+      .def("__hash__", &PyTaintRange::get_hash)
+      .def("get_hash", &PyTaintRange::get_hash)
       .def("__eq__",
-           [](const TaintRangePtr& self, const TaintRangePtr& other) {
+           [](const PyTaintRange& self, const PyTaintRange* other) {
                if (other == nullptr)
                    return false;
-               return self->start == other->start && self->length == other->length;
+               return self.start == other->start && self.length == other->length;
            })
-      .def("__ne__", [](const TaintRangePtr& self, const TaintRangePtr& other) {
+      .def("__ne__", [](const PyTaintRange& self, const PyTaintRange* other) {
           if (other == nullptr)
               return true;
-          return self->start != other->start || self->length != other->length;
+          return self.start != other->start || self.length != other->length;
       });
 }
@@ -1,4 +1,6 @@
 #pragma once
+#include <algorithm>
+#include <type_traits>
 #include <utility>
 
 #include <pybind11/stl.h>
@@ -7,61 +9,46 @@
 
 #include "Constants.h"
 #include "TaintTracking/Source.h"
+#include "TaintTracking/TaintMap.h"
 #include "Utils/StringUtils.h"
 
 using namespace std;
 namespace py = pybind11;
 
-// Forward declarations
-class TaintedObject;
-
-// Alias
-using TaintedObjectPtr = TaintedObject*;
-
-#ifdef NDEBUG // Decide wether to use abseil
-
-#include "absl/container/node_hash_map.h"
-using TaintRangeMapType = absl::node_hash_map<uintptr_t, std::pair<Py_hash_t, TaintedObjectPtr>>;
-
-#else
-
-#include <unordered_map>
-using TaintRangeMapType = std::map<uintptr_t, std::pair<Py_hash_t, TaintedObjectPtr>>;
-
-#endif // NDEBUG
+using TaintRangeMapType = TaintMap;
 
 using TaintRangeMapTypePtr = shared_ptr<TaintRangeMapType>;
 // using TaintRangeMapTypePtr = TaintRangeMapType*;
 
+/**
+ * A tainted slice of a text object.
+ *
+ * Ranges are small values: the source is interned in the SourceTable of the current context and only referenced
+ * here, so propagating ranges (shifting, concatenating, slicing) copies a few integers. On the Python side they
+ * are PyTaintRange objects, see below.
+ */
 struct TaintRange
 {
     RANGE_START start = 0;
     RANGE_LENGTH length = 0;
-    Source source;
+    SourceId source;
 
     TaintRange() = default;
 
-    TaintRange(const RANGE_START start, const RANGE_LENGTH length, Source source)
+    TaintRange(const RANGE_START start, const RANGE_LENGTH length, const SourceId source)
       : start(start)
       , length(length)
-      , source(std::move(source))
+      , source(source)
     {
         if (length <= 0) {
             throw std::invalid_argument("Error: Length cannot be set to 0.");
         }
     }
 
-    inline void set_values(const RANGE_START start_, const RANGE_LENGTH length_, Source source_)
-    {
-        if (length_ <= 0) {
-            throw std::invalid_argument("Error: Length cannot be set to 0.");
-        }
-        start = start_;
-        length = length_;
-        source = std::move(source_);
-    }
+    // Interns source in the table of the current context
+    TaintRange(RANGE_START start, RANGE_LENGTH length, const Source& source);
 
-    void reset();
+    [[nodiscard]] const Source& get_source() const;
 
     [[nodiscard]] string toString() const;
 
@@ -70,20 +57,115 @@ struct TaintRange
     explicit operator std::string() const;
 };
 
-using TaintRangePtr = shared_ptr<TaintRange>;
-using TaintRangeRefs = vector<TaintRangePtr>;
+static_assert(std::is_trivially_copyable_v<TaintRange>, "TaintRange must stay a plain value");
+
+/**
+ * A TaintRange as seen from Python. It holds a copy of its source, so it stays valid after the context it comes
+ * from is reset. Converting it back to a TaintRange interns the source in the current context.
+ */
+struct PyTaintRange
+{
+    RANGE_START start = 0;
+    RANGE_LENGTH length = 0;
+    Source source;
+
+    PyTaintRange(RANGE_START start, RANGE_LENGTH length, Source source);
+
+    explicit PyTaintRange(const TaintRange& range);
+
+    [[nodiscard]] TaintRange to_range() const { return { start, length, source }; }
+
+    [[nodiscard]] string toString() const;
+
+    [[nodiscard]] uint get_hash() const;
+};
+
+namespace pybind11::detail {
+// Converts TaintRange values (and containers of them) from and to PyTaintRange objects
+template<>
+struct type_caster<TaintRange>
+{
+    PYBIND11_TYPE_CASTER(TaintRange, const_name("TaintRange_"));
+
+    bool load(const handle src, const bool convert)
+    {
+        make_caster<PyTaintRange> caster;
+        if (not caster.load(src, convert)) {
+            return false;
+        }
+        value = cast_op<const PyTaintRange&>(caster).to_range();
+        return true;
+    }
+
+    static handle cast(const TaintRange& src, return_value_policy /* policy */, const handle parent)
+    {
+        return make_caster<PyTaintRange>::cast(PyTaintRange(src), return_value_policy::move, parent);
+    }
+};
+} // namespace pybind11::detail
+
+using TaintRangeRefs = vector<TaintRange>;
+
+/**
+ * Read-only view of ranges, those of a tainted object or of a TaintRangeRefs, which it doesn't copy. The ranges of a
+ * tainted object stay where they are as long as the object is in the taint map: a view of them is valid until the
+ * ranges of the tainted string are set again or the context ends, which is for the duration of an aspect.
+ */
+class TaintRangesView
+{
+  private:
+    const TaintRange* begin_ = nullptr;
+    const TaintRange* end_ = nullptr;
+
+  public:
+    TaintRangesView() = default;
+
+    TaintRangesView(const TaintRange* begin, const TaintRange* end)
+      : begin_(begin)
+      , end_(end)
+    {
+    }
+
+    // Implicit, so that the functions taking a view take a TaintRangeRefs as well
+    TaintRangesView(const TaintRangeRefs& ranges)
+      : begin_(ranges.data())
+      , end_(ranges.data() + ranges.size())
+    {
+    }
+
+    [[nodiscard]] const TaintRange* begin() const { return begin_; }
+
+    [[nodiscard]] const TaintRange* end() const { return end_; }
+
+    [[nodiscard]] size_t size() const { return end_ - begin_; }
+
+    [[nodiscard]] bool empty() const { return begin_ == end_; }
+
+    const TaintRange& operator[](const size_t index) const { return begin_[index]; }
 
-TaintRangePtr
-shift_taint_range(const TaintRangePtr& source_taint_range, RANGE_START offset, RANGE_LENGTH new_length);
+    // Ranges intersecting the characters [start, stop). The ranges of a tainted object are sorted by start and
+    // don't overlap, so both ends are binary searched and only the ranges in between are visited.
+    [[nodiscard]] TaintRangesView intersecting(const RANGE_START start, const RANGE_START stop) const
+    {
+        const auto first = std::partition_point(
+          begin_, end_, [start](const TaintRange& range) { return range.start + range.length <= start; });
+        const auto last =
+          std::partition_point(first, end_, [stop](const TaintRange& range) { return range.start < stop; });
+        return { first, last };
+    }
+};
+
+TaintRange
+shift_taint_range(const TaintRange& source_taint_range, RANGE_START offset, RANGE_LENGTH new_length);
 
-inline TaintRangePtr
-api_shift_taint_range(const TaintRangePtr& source_taint_range, const RANGE_START offset, const RANGE_LENGTH new_length)
+inline TaintRange
+api_shift_taint_range(const TaintRange& source_taint_range, const RANGE_START offset, const RANGE_LENGTH new_length)
 {
     return shift_taint_range(source_taint_range, offset, new_length);
 }
 
 TaintRangeRefs
-shift_taint_ranges(const TaintRangeRefs& source_taint_ranges, RANGE_START offset, RANGE_LENGTH new_length);
+shift_taint_ranges(const TaintRangesView& source_taint_ranges, RANGE_START offset, RANGE_LENGTH new_length);
 
 TaintRangeRefs
 api_shift_taint_ranges(const TaintRangeRefs&, RANGE_START offset, RANGE_LENGTH new_length);
@@ -91,6 +173,14 @@ api_shift_taint_ranges(const TaintRangeRefs&, RANGE_START offset, RANGE_LENGTH n
 std::pair<TaintRangeRefs, bool>
 get_ranges(PyObject* string_input, const TaintRangeMapTypePtr& tx_map);
 
+/**
+ * Same as get_ranges(), borrowing the ranges of the tainted object instead of copying them.
+ *
+ * @return The ranges of the string, empty if it isn't tainted, and whether it isn't text, an error.
+ */
+std::pair<TaintRangesView, bool>
+get_ranges_view(PyObject* string_input, const TaintRangeMapTypePtr& tx_map);
+
 bool
 set_ranges(PyObject* str, const TaintRangeRefs& ranges, const TaintRangeMapTypePtr& tx_map);
 
@@ -109,6 +199,9 @@ api_copy_and_shift_ranges_from_strings(py::object& str_1, py::object& str_2, int
 PyObject*
 api_set_ranges_from_values(PyObject* self, PyObject* const* args, Py_ssize_t nargs);
 
+PyObject*
+api_taint_pyobjects(PyObject* self, PyObject* const* args, Py_ssize_t nargs);
+
 // Returns a tuple with (all ranges, ranges of candidate_text)
 std::tuple<TaintRangeRefs, TaintRangeRefs>
 are_all_text_all_ranges(PyObject* candidate_text, const py::tuple& parameter_list);
@@ -118,7 +211,7 @@ api_are_all_text_all_ranges(py::object& candidate_text, const py::tuple& paramet
     return are_all_text_all_ranges(candidate_text.ptr(), parameter_list);
 }
 
-TaintRangePtr
+optional<TaintRange>
 get_range_by_hash(size_t range_hash, optional<TaintRangeRefs>& taint_ranges);
 
 inline void
@@ -1,9 +1,11 @@
 #include "Initializer/Initializer.h"
 
+#include <algorithm>
+
 namespace py = pybind11;
 
 /**
- * This function allocates a new taint range with the given offset and maximum length.
+ * This function creates a new taint range with the given offset and maximum length.
  *
  * @param source_taint_range The source taint range.
  * @param offset The offset to be applied.
@@ -11,21 +13,18 @@ namespace py = pybind11;
  *
  * @return A new taint range with the given offset and maximum length.
  */
-TaintRangePtr
-allocate_limited_taint_range_with_offset(const TaintRangePtr& source_taint_range,
-                                         const RANGE_START offset,
-                                         const RANGE_LENGTH max_length)
+TaintRange
+limited_taint_range_with_offset(const TaintRange& source_taint_range,
+                                const RANGE_START offset,
+                                const RANGE_LENGTH max_length)
 {
     RANGE_LENGTH length;
     if (max_length != -1)
-        length = min(max_length, source_taint_range->length);
+        length = min(max_length, source_taint_range.length);
     else
-        length = source_taint_range->length;
+        length = source_taint_range.length;
 
-    auto tptr = initializer->allocate_taint_range(offset,                      // start
-                                                  length,                      // length
-                                                  source_taint_range->source); // source
-    return tptr;
+    return { offset, length, source_taint_range.source };
 }
 
 /**
@@ -33,13 +32,76 @@ allocate_limited_taint_range_with_offset(const TaintRangePtr& source_taint_range
  * @param source_taint_range The source taint range.
  * @param offset The offset to be applied.
  */
-TaintRangePtr
-shift_taint_range(const TaintRangePtr& source_taint_range, const RANGE_START offset)
+TaintRange
+shift_taint_range(const TaintRange& source_taint_range, const RANGE_START offset)
+{
+    return { source_taint_range.start + offset, source_taint_range.length, source_taint_range.source };
+}
+
+void
+TaintedObject::copy_values(const TaintRangeRefs& ranges)
+{
+    if (ranges.size() <= INLINE_RANGES) {
+        release_storage();
+    } else if (ranges_ and ranges_->refs == 1 and ranges_->capacity >= ranges.size()) {
+        // Ranges are plain values, so this keeps the storage and copies them over
+        ranges_->size = static_cast<uint32_t>(ranges.size());
+    } else {
+        release_storage();
+        ranges_ = initializer->allocate_range_block(ranges.size());
+        ranges_->size = static_cast<uint32_t>(ranges.size());
+    }
+    std::copy(ranges.begin(), ranges.end(), data());
+    size_ = static_cast<uint32_t>(ranges.size());
+}
+
+void
+TaintedObject::share_values(const TaintedObject& from)
+{
+    if (not from.ranges_) {
+        // Inline ranges are copied, there are too few of them to be worth sharing
+        release_storage();
+        std::copy(from.inline_ranges_, from.inline_ranges_ + from.size_, inline_ranges_);
+    } else if (from.ranges_ != ranges_) {
+        release_storage();
+        ranges_ = from.ranges_;
+        ranges_->refs++;
+    }
+    size_ = from.size_;
+}
+
+void
+TaintedObject::release_storage()
 {
-    auto tptr = initializer->allocate_taint_range(source_taint_range->start + offset, // start
-                                                  source_taint_range->length,         // length
-                                                  source_taint_range->source);        // source
-    return tptr;
+    if (ranges_ and --ranges_->refs == 0) {
+        initializer->release_range_block(ranges_);
+    }
+    ranges_ = nullptr;
+}
+
+void
+TaintedObject::prepare_append(const size_t to_add)
+{
+    if (ranges_ ? ranges_->size == size_ and ranges_->capacity >= size_ + to_add : size_ + to_add <= INLINE_RANGES) {
+        return;
+    }
+
+    // Doubling the capacity, so that appending one range at a time keeps the amortized growth
+    const auto storage = initializer->allocate_range_block(
+      max({ static_cast<size_t>(RANGES_INITIAL_RESERVE), static_cast<size_t>(size_) * 2, size_ + to_add }));
+    std::copy(data(), data() + size_, storage->data());
+    storage->size = size_;
+    release_storage();
+    ranges_ = storage;
+}
+
+void
+TaintedObject::reserve_ranges(const size_t to_add)
+{
+    if (to_add == 0 or size_ >= TAINT_RANGE_LIMIT) {
+        return;
+    }
+    prepare_append(min<size_t>(to_add, TAINT_RANGE_LIMIT - size_));
 }
 
 /**
@@ -56,8 +118,16 @@ TaintedObject::add_ranges_shifted(const TaintedObjectPtr tainted_object,
                                   const RANGE_LENGTH max_length,
                                   const RANGE_START orig_offset)
 {
-    const auto& ranges = tainted_object->get_ranges();
-    add_ranges_shifted(ranges, offset, max_length, orig_offset);
+    const auto ranges = tainted_object->get_ranges();
+    if (tainted_object == this or (ranges_ != nullptr and tainted_object->ranges_ == ranges_)) {
+        // Both objects share the storage, as adding a tainted object to itself does: coalescing may extend one of
+        // the ranges iterated, so iterate over a copy of them
+        const TaintRangeRefs copy(ranges.begin(), ranges.end());
+        add_ranges_shifted(copy, offset, max_length, orig_offset);
+        return;
+    }
+    // A block left for a larger one stays as it is until it is reused, so the ranges iterated remain valid
+    add_ranges_shifted(ranges.begin(), ranges.end(), offset, max_length, orig_offset);
 }
 
 /**
@@ -69,35 +139,84 @@ TaintedObject::add_ranges_shifted(const TaintedObjectPtr tainted_object,
  * @param orig_offset The offset to be applied at the beginning.
  */
 void
-TaintedObject::add_ranges_shifted(TaintRangeRefs ranges,
+TaintedObject::add_ranges_shifted(const TaintRangeRefs& ranges,
                                   const RANGE_START offset,
                                   const RANGE_LENGTH max_length,
                                   const RANGE_START orig_offset)
 {
-    if (const auto to_add = static_cast<long>(min(ranges.size(), TAINT_RANGE_LIMIT - ranges_.size()));
-        !ranges.empty() and to_add > 0) {
-        ranges_.reserve(ranges_.size() + to_add);
-        if (offset == 0 and max_length == -1) {
-            ranges_.insert(ranges_.end(), ranges.begin(), ranges.end());
-        } else {
-            int i = 0;
-            for (const auto& trange : ranges) {
-                if (max_length != -1 and orig_offset != -1) {
-                    // Make sure original position (orig_offset) is covered by the range
-                    if (trange->start <= orig_offset and
-                        ((trange->start + trange->length) >= orig_offset + max_length)) {
-                        ranges_.emplace_back(allocate_limited_taint_range_with_offset(trange, offset, max_length));
-                        i++;
-                    }
-                } else {
-                    ranges_.emplace_back(shift_taint_range(trange, offset));
-                    i++;
-                }
-                if (i >= to_add) {
-                    break;
-                }
+    add_ranges_shifted(ranges.data(), ranges.data() + ranges.size(), offset, max_length, orig_offset);
+}
+
+bool
+TaintedObject::coalesce_range(const size_t count, const TaintRange& range)
+{
+    if (count == 0) {
+        return false;
+    }
+
+    const auto& previous = data()[count - 1];
+    const auto previous_end = previous.start + previous.length;
+    if (not(previous.source == range.source) or range.start < previous.start or range.start > previous_end) {
+        return false;
+    }
+    if (range.start + range.length <= previous_end) {
+        // Already covered
+        return true;
+    }
+
+    if (count <= size_ and ranges_ and ranges_->refs > 1) {
+        // The range to extend is one of the ranges of this object, which the other objects sharing the storage see
+        // as well. Only the ranges appended after size_ are private.
+        const auto storage = initializer->allocate_range_block(ranges_->capacity);
+        std::copy(ranges_->data(), ranges_->data() + size_, storage->data());
+        storage->size = size_;
+        release_storage();
+        ranges_ = storage;
+    }
+    auto& extended = data()[count - 1];
+    extended.length = range.start + range.length - extended.start;
+    return true;
+}
+
+void
+TaintedObject::add_ranges_shifted(const TaintRange* first,
+                                  const TaintRange* last,
+                                  const RANGE_START offset,
+                                  const RANGE_LENGTH max_length,
+                                  const RANGE_START orig_offset)
+{
+    if (first == last or size_ >= TAINT_RANGE_LIMIT) {
+        return;
+    }
+
+    const auto to_add = min<size_t>(last - first, TAINT_RANGE_LIMIT - size_);
+    prepare_append(to_add);
+    // Contiguous ranges with the same source, as repeated concatenations of one tainted value give, are coalesced
+    // into one, so that they don't take as many of the ranges an object can have
+    size_t count = size_;
+    for (auto trange = first; trange != last; ++trange) {
+        TaintRange range;
+        if (max_length != -1 and orig_offset != -1) {
+            // Make sure original position (orig_offset) is covered by the range
+            if (trange->start > orig_offset or ((trange->start + trange->length) < orig_offset + max_length)) {
+                continue;
             }
+            range = limited_taint_range_with_offset(*trange, offset, max_length);
+        } else {
+            range = shift_taint_range(*trange, offset);
+        }
+
+        if (coalesce_range(count, range)) {
+            continue;
+        }
+        if (count - size_ >= to_add) {
+            break;
         }
+        data()[count++] = range;
+    }
+    size_ = static_cast<uint32_t>(count);
+    if (ranges_) {
+        ranges_->size = size_;
     }
 }
 
@@ -107,10 +226,10 @@ TaintedObject::toString() const
     stringstream ss;
 
     ss << "TaintedObject [";
-    if (not ranges_.empty()) {
+    if (const auto ranges = get_ranges(); not ranges.empty()) {
         ss << ", ranges=[";
-        for (const auto& range : ranges_) {
-            ss << range->toString() << ", ";
+        for (const auto& range : ranges) {
+            ss << range.toString() << ", ";
         }
         ss << "]";
     }
@@ -124,26 +243,12 @@ TaintedObject::operator string() const
     return toString();
 }
 
-void
-TaintedObject::move_ranges_to_stack()
-{
-    for (const auto& range_ptr : ranges_) {
-        if (!range_ptr) {
-            continue;
-        }
-        initializer->release_taint_range(range_ptr);
-    }
-    ranges_.clear();
-}
-
 void
 TaintedObject::reset()
 {
-    move_ranges_to_stack();
+    release_storage();
+    size_ = 0;
     rc_ = 0;
-    if (initializer) {
-        ranges_.reserve(RANGES_INITIAL_RESERVE);
-    }
 }
 
 void
@@ -2,46 +2,93 @@
 #include "TaintTracking/TaintRange.h"
 #include <Python.h>
 
+/**
+ * Storage of the ranges of one or more tainted objects, allocated in the arena of the context of the thread. The
+ * ranges follow this header in memory.
+ */
+struct TaintRangeBlock
+{
+    uint32_t capacity;
+    uint32_t size;
+    // Tainted objects using this storage, when none is left it is kept for reuse until the context ends
+    uint32_t refs;
+    TaintRangeBlock* next_free;
+
+    TaintRange* data() { return reinterpret_cast<TaintRange*>(this + 1); }
+};
+
+static_assert(sizeof(TaintRangeBlock) % alignof(TaintRange) == 0, "The ranges must be aligned after the header");
+
 class TaintedObject
 {
     friend class Initializer;
 
-  private:
-    TaintRangeRefs ranges_;
-    size_t rc_{};
-
   public:
     constexpr static int TAINT_RANGE_LIMIT = 100;
-    constexpr static int RANGES_INITIAL_RESERVE = 16;
+    constexpr static int RANGES_INITIAL_RESERVE = 4;
+    // Ranges kept in the object itself rather than in a block: most tainted objects have a single range, a whole
+    // source or a part of one, and they are then a single allocation read from a single place
+    constexpr static int INLINE_RANGES = 1;
+
+  private:
+    // Storage shared with the tainted objects copied from this one or the other way around, which only ever
+    // append to it: the ranges of this object are the first size_ ones, whatever the others append after them.
+    // Building a result by appending to the ranges of the left operand, as repeated concatenations do, doesn't
+    // copy the ranges it starts with. Null while the ranges fit in inline_ranges_, which isn't shared.
+    TaintRangeBlock* ranges_ = nullptr;
+    uint32_t size_{};
+    uint32_t rc_{};
+    TaintRange inline_ranges_[INLINE_RANGES];
+
+    TaintRange* data() { return ranges_ ? ranges_->data() : inline_ranges_; }
+
+    [[nodiscard]] const TaintRange* data() const { return ranges_ ? ranges_->data() : inline_ranges_; }
 
-    TaintedObject() { ranges_.reserve(RANGES_INITIAL_RESERVE); };
+    // Makes the storage able to take to_add more ranges appended by this object, copying the ranges if another
+    // object appended after them or if there is no room left
+    void prepare_append(size_t to_add);
+
+    void release_storage();
+
+    // Extends the last of the count first ranges with range when it has the same source and range starts within or
+    // right after it, copying the storage first if the ranges extended are shared with another object
+    bool coalesce_range(size_t count, const TaintRange& range);
+
+    void add_ranges_shifted(const TaintRange* first,
+                            const TaintRange* last,
+                            RANGE_START offset,
+                            RANGE_LENGTH max_length,
+                            RANGE_START orig_offset);
+
+  public:
+    TaintedObject() = default;
 
     TaintedObject& operator=(const TaintedObject&) = delete;
 
-    inline void set_values(TaintRangeRefs ranges)
-    {
-        // Move back the ranges to the ranges stack
-        move_ranges_to_stack();
-        ranges_ = std::move(ranges);
-    }
+    void copy_values(const TaintRangeRefs& ranges);
+
+    // Takes the ranges of another tainted object without copying them
+    void share_values(const TaintedObject& from);
 
-    inline void copy_values(const TaintRangeRefs& ranges)
+    [[nodiscard]] TaintRangesView get_ranges() const { return { data(), data() + size_ }; }
+
+    [[nodiscard]] TaintRangeRefs get_ranges_copy() const
     {
-        // Move back the ranges to the ranges stack
-        move_ranges_to_stack();
-        ranges_ = ranges;
+        const auto ranges = get_ranges();
+        return { ranges.begin(), ranges.end() };
     }
 
-    [[nodiscard]] const TaintRangeRefs& get_ranges() const { return ranges_; }
+    // Makes room for to_add more ranges, up to the limit, so that adding them doesn't grow the storage again
+    void reserve_ranges(size_t to_add);
 
-    [[nodiscard]] TaintRangeRefs get_ranges_copy() const { return ranges_; }
+    [[nodiscard]] bool has_full_ranges() const { return size_ >= TAINT_RANGE_LIMIT; }
 
     void add_ranges_shifted(TaintedObject* tainted_object,
                             RANGE_START offset,
                             RANGE_LENGTH max_length = -1,
                             RANGE_START orig_offset = -1);
 
-    void add_ranges_shifted(TaintRangeRefs ranges,
+    void add_ranges_shifted(const TaintRangeRefs& ranges,
                             RANGE_START offset,
                             RANGE_LENGTH max_length = -1,
                             RANGE_START orig_offset = -1);
@@ -50,8 +97,6 @@ class TaintedObject
 
     explicit operator string() const;
 
-    void move_ranges_to_stack();
-
     void reset();
 
     void incref();
@@ -20,27 +20,26 @@ is_tainted(PyObject* tainted_object, const TaintRangeMapTypePtr& tx_taint_map)
     return false;
 }
 
-bool
-api_is_tainted(py::object tainted_object)
+PyObject*
+api_is_tainted(PyObject* self, PyObject* const* args, const Py_ssize_t nargs)
 {
-    if (tainted_object) {
-        const auto tx_map = initializer->get_tainting_map();
-        if (not tx_map or tx_map->empty()) {
-            return false;
-        }
-
-        if (is_tainted(tainted_object.ptr(), tx_map)) {
-            return true;
-        }
+    if (nargs != 1) {
+        py::set_error(PyExc_ValueError, MSG_ERROR_N_PARAMS);
+        return nullptr;
     }
-
-    return false;
+    const auto tx_map = initializer->get_tainting_map();
+    if (not tx_map or tx_map->empty()) {
+        Py_RETURN_FALSE;
+    }
+    if (is_tainted(args[0], tx_map)) {
+        Py_RETURN_TRUE;
+    }
+    Py_RETURN_FALSE;
 }
 
 void
 pyexport_tainted_ops(py::module& m)
 {
-    m.def("is_tainted", &api_is_tainted, "tainted_object"_a, py::return_value_policy::move);
     m.def("are_all_text_all_ranges",
           &are_all_text_all_ranges,
           "candidate_text"_a,
@@ -12,8 +12,8 @@ api_new_pyobject_id(PyObject* self, PyObject* const* args, Py_ssize_t nargs);
 bool
 is_tainted(PyObject* tainted_object, const TaintRangeMapTypePtr& tx_taint_map);
 
-bool
-api_is_tainted(py::object tainted_object);
+PyObject*
+api_is_tainted(PyObject* self, PyObject* const* args, Py_ssize_t nargs);
 
 void
 pyexport_tainted_ops(py::module& m);
\ No newline at end of file
@@ -0,0 +1,73 @@
+#include "Arena.h"
+
+#include <algorithm>
+#include <cstdint>
+
+static char*
+align_up(char* const ptr, const size_t alignment)
+{
+    const auto address = reinterpret_cast<uintptr_t>(ptr);
+    return reinterpret_cast<char*>((address + alignment - 1) & ~(alignment - 1));
+}
+
+void*
+Arena::allocate(const size_t size, const size_t alignment)
+{
+    char* start = align_up(ptr_, alignment);
+    if (ptr_ == nullptr or start + size > end_) {
+        next_chunk(size, alignment);
+        start = align_up(ptr_, alignment);
+    }
+    ptr_ = start + size;
+    return start;
+}
+
+void
+Arena::next_chunk(const size_t size, const size_t alignment)
+{
+    const size_t needed = size + alignment;
+    if (ptr_ != nullptr) {
+        ++current_;
+    }
+
+    // A free chunk too small for the allocation stays for the next ones, the new chunk is used before it
+    if (current_ >= chunks_.size() or chunks_[current_].size < needed) {
+        const size_t chunk_size = std::max(next_chunk_size_, needed);
+        if (chunk_size <= MAX_CHUNK_SIZE) {
+            next_chunk_size_ = std::min(chunk_size * 2, MAX_CHUNK_SIZE);
+        }
+        chunks_.insert(chunks_.begin() + static_cast<std::ptrdiff_t>(current_),
+                       Chunk{ std::unique_ptr<char[]>(new char[chunk_size]), chunk_size });
+    }
+    ptr_ = chunks_[current_].data.get();
+    end_ = ptr_ + chunks_[current_].size;
+}
+
+void
+Arena::reset()
+{
+    // Oversized chunks were allocated for a single large allocation, they aren't worth keeping
+    size_t retained = 0;
+    size_t retained_size = 0;
+    for (auto& chunk : chunks_) {
+        if (chunk.size <= MAX_CHUNK_SIZE and retained_size + chunk.size <= max_retained_size_) {
+            retained_size += chunk.size;
+            chunks_[retained++] = std::move(chunk);
+        }
+    }
+    chunks_.resize(retained);
+
+    current_ = 0;
+    ptr_ = nullptr;
+    end_ = nullptr;
+}
+
+size_t
+Arena::capacity() const
+{
+    size_t size = 0;
+    for (const auto& chunk : chunks_) {
+        size += chunk.size;
+    }
+    return size;
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+ * Bump allocator for the taint tracking state of a context.
+ *
+ * Memory is handed out from chunks in allocation order and is never freed on its own: reset() releases everything
+ * at once when the context ends, keeping up to max_retained_size bytes of chunks for the next context of the same
+ * thread. The chunks start small and double in size up to MAX_CHUNK_SIZE, so that a thread which taints little
+ * doesn't hold much memory. Only trivially destructible objects are created here, since no destructor runs on
+ * reset().
+ */
+class Arena
+{
+  public:
+    static constexpr size_t MIN_CHUNK_SIZE = 1024;
+    static constexpr size_t MAX_CHUNK_SIZE = 16 * 1024;
+    static constexpr size_t DEFAULT_MAX_RETAINED_SIZE = 1024 * 1024;
+
+    explicit Arena(size_t max_retained_size = DEFAULT_MAX_RETAINED_SIZE)
+      : max_retained_size_(max_retained_size)
+    {
+    }
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    void* allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+
+    template<class T, class... Args>
+    T* create(Args&&... args)
+    {
+        static_assert(std::is_trivially_destructible_v<T>, "No destructor runs for the objects of an arena");
+        return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    /**
+     * Releases all the allocations. Invalidates every pointer returned by allocate() and create().
+     */
+    void reset();
+
+    [[nodiscard]] size_t num_chunks() const { return chunks_.size(); }
+
+    // Bytes held by the chunks, used or not
+    [[nodiscard]] size_t capacity() const;
+
+  private:
+    struct Chunk
+    {
+        std::unique_ptr<char[]> data;
+        size_t size;
+    };
+
+    // Starts allocating from the next chunk able to hold size bytes, after the ones already used
+    void next_chunk(size_t size, size_t alignment);
+
+    std::vector<Chunk> chunks_;
+    size_t max_retained_size_;
+    // Size of the next chunk allocated that isn't for a larger allocation
+    size_t next_chunk_size_ = MIN_CHUNK_SIZE;
+    // Chunk allocations are taken from, the ones after it are free
+    size_t current_ = 0;
+    char* ptr_ = nullptr;
+    char* end_ = nullptr;
+};
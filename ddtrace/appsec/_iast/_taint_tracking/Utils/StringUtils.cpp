@@ -6,6 +6,8 @@
 // if CLion tells it's not used!
 #include "StringUtils.h"
 
+#include <cstring>
+
 using namespace pybind11::literals;
 
 using namespace std;
@@ -75,35 +77,38 @@ PyObjectToString(PyObject* obj)
     return str;
 }
 
+// The copies are built directly instead of joining the object with an empty one, which allocated a tuple and
+// looked up the join method of bytes and bytearray on every call. Allocating with a NULL buffer also gets a new
+// object for a single byte, where PyBytes_FromStringAndSize would return a cached one.
 PyObject*
 new_pyobject_id(PyObject* tainted_object)
 {
     if (PyUnicode_Check(tainted_object)) {
-        PyObject* empty_unicode = PyUnicode_New(0, 127);
-        PyObject* val = Py_BuildValue("(OO)", tainted_object, empty_unicode);
-        PyObject* result = PyUnicode_Join(empty_unicode, val);
-        Py_DecRef(empty_unicode);
-        Py_DecRef(val);
+#if PY_VERSION_HEX < 0x030C0000
+        if (PyUnicode_READY(tainted_object) == -1) {
+            return nullptr;
+        }
+#endif
+        const Py_ssize_t length = PyUnicode_GET_LENGTH(tainted_object);
+        // Same kind as the original, so the characters can be copied as they are
+        PyObject* result = PyUnicode_New(length, PyUnicode_MAX_CHAR_VALUE(tainted_object));
+        if (result == nullptr or length == 0) {
+            return result;
+        }
+        memcpy(PyUnicode_DATA(result), PyUnicode_DATA(tainted_object), length * PyUnicode_KIND(tainted_object));
         return result;
     }
     if (PyBytes_Check(tainted_object)) {
-        PyObject* empty_bytes = PyBytes_FromString("");
-        const auto bytes_join_ptr = py::reinterpret_borrow<py::bytes>(empty_bytes).attr("join");
-        const auto val = Py_BuildValue("(OO)", tainted_object, empty_bytes);
-        const auto res = PyObject_CallFunctionObjArgs(bytes_join_ptr.ptr(), val, NULL);
-        Py_DecRef(val);
-        Py_DecRef(empty_bytes);
-        return res;
+        const Py_ssize_t length = PyBytes_GET_SIZE(tainted_object);
+        PyObject* result = PyBytes_FromStringAndSize(nullptr, length);
+        if (result == nullptr or length == 0) {
+            return result;
+        }
+        memcpy(PyBytes_AS_STRING(result), PyBytes_AS_STRING(tainted_object), length);
+        return result;
     } else if (PyByteArray_Check(tainted_object)) {
-        PyObject* empty_bytes = PyBytes_FromString("");
-        PyObject* empty_bytearray = PyByteArray_FromObject(empty_bytes);
-        const auto bytearray_join_ptr = py::reinterpret_borrow<py::bytes>(empty_bytearray).attr("join");
-        const auto val = Py_BuildValue("(OO)", tainted_object, empty_bytearray);
-        const auto res = PyObject_CallFunctionObjArgs(bytearray_join_ptr.ptr(), val, NULL);
-        Py_DecRef(val);
-        Py_DecRef(empty_bytes);
-        Py_DecRef(empty_bytearray);
-        return res;
+        return PyByteArray_FromStringAndSize(PyByteArray_AS_STRING(tainted_object),
+                                             PyByteArray_GET_SIZE(tainted_object));
     }
     return tainted_object;
 }
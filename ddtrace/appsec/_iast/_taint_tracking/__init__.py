@@ -1,5 +1,6 @@
 import os
 from typing import Any
+from typing import List
 from typing import Tuple
 
 from ddtrace.internal.logger import get_logger
@@ -14,16 +15,16 @@ from .._utils import _is_python_version_supported
 log = get_logger(__name__)
 
 if _is_python_version_supported():
+    from ._native import aspects
     from ._native import ops
     from ._native.aspect_format import _format_aspect
+    from ._native.aspect_helpers import SqlDialect
     from ._native.aspect_helpers import _convert_escaped_text_to_tainted_text
     from ._native.aspect_helpers import as_formatted_evidence
     from ._native.aspect_helpers import common_replace
     from ._native.aspect_helpers import parse_params
     from ._native.aspect_helpers import set_ranges_on_splitted
-    from ._native.aspect_split import _aspect_rsplit
-    from ._native.aspect_split import _aspect_split
-    from ._native.aspect_split import _aspect_splitlines
+    from ._native.aspect_helpers import sql_tokenize
     from ._native.aspects_ospath import _aspect_ospathbasename
     from ._native.aspects_ospath import _aspect_ospathdirname
     from ._native.aspects_ospath import _aspect_ospathjoin
@@ -33,11 +34,15 @@ if _is_python_version_supported():
     from ._native.aspects_ospath import _aspect_ospathsplitext
     from ._native.aspects_ospath import _aspect_ospathsplitroot
     from ._native.initializer import active_map_addreses_size
+    from ._native.initializer import attach_context
     from ._native.initializer import create_context
     from ._native.initializer import debug_taint_map
+    from ._native.initializer import detach_context
+    from ._native.initializer import get_context
     from ._native.initializer import initializer_size
     from ._native.initializer import num_objects_tainted
     from ._native.initializer import reset_context
+    from ._native.initializer import taint_budget_exceeded
     from ._native.taint_tracking import OriginType
     from ._native.taint_tracking import Source
     from ._native.taint_tracking import TagMappingMode
@@ -47,7 +52,6 @@ if _is_python_version_supported():
     from ._native.taint_tracking import get_range_by_hash
     from ._native.taint_tracking import get_ranges
     from ._native.taint_tracking import is_notinterned_notfasttainted_unicode
-    from ._native.taint_tracking import is_tainted
     from ._native.taint_tracking import origin_to_str
     from ._native.taint_tracking import set_fast_tainted_if_notinterned_unicode
     from ._native.taint_tracking import set_ranges
@@ -58,6 +62,11 @@ if _is_python_version_supported():
 
     new_pyobject_id = ops.new_pyobject_id
     set_ranges_from_values = ops.set_ranges_from_values
+    _taint_pyobjects = ops.taint_pyobjects
+    is_tainted = ops.is_tainted
+    _aspect_split = aspects.split_text
+    _aspect_rsplit = aspects.rsplit_text
+    _aspect_splitlines = aspects.splitlines_text
 
 
 __all__ = [
@@ -83,6 +92,9 @@ __all__ = [
     "initializer_size",
     "active_map_addreses_size",
     "create_context",
+    "get_context",
+    "attach_context",
+    "detach_context",
     "str_to_origin",
     "origin_to_str",
     "common_replace",
@@ -101,7 +113,10 @@ __all__ = [
     "as_formatted_evidence",
     "parse_params",
     "set_ranges_on_splitted",
+    "SqlDialect",
+    "sql_tokenize",
     "num_objects_tainted",
+    "taint_budget_exceeded",
     "debug_taint_map",
     "iast_taint_log_error",
 ]
@@ -156,6 +171,26 @@ def taint_pyobject(pyobject: Any, source_name: Any, source_value: Any, source_or
     return pyobject
 
 
+def taint_pyobjects(items: List[Tuple[Any, Any, Any]]) -> List[Any]:
+    """Taint (pyobject, source_name, source_origin) items in a single native call, the source value of each one
+    being the object itself. Returns the tainted objects, with the objects that can't be tainted left as they are.
+    """
+    try:
+        results = _taint_pyobjects(items)
+    except ValueError as e:
+        iast_taint_log_error("Tainting objects error: %s" % e)
+        return [item[0] for item in items]
+
+    executed_sources = {}
+    for item, result in zip(items, results):
+        if result is not item[0]:
+            origin = item[2]
+            executed_sources[origin] = executed_sources.get(origin, 0) + 1
+    for origin, counter in executed_sources.items():
+        _set_metric_iast_executed_source(origin, counter)
+    return results
+
+
 def taint_pyobject_with_ranges(pyobject: Any, ranges: Tuple) -> bool:
     if not isinstance(pyobject, IAST.TEXT_TYPES):
         return False
@@ -8,11 +8,14 @@
 #include <memory>
 #include <pybind11/pybind11.h>
 
+#include "Aspects/AspectCommonReplace.h"
 #include "Aspects/AspectExtend.h"
 #include "Aspects/AspectIndex.h"
 #include "Aspects/AspectJoin.h"
 #include "Aspects/AspectOperatorAdd.h"
+#include "Aspects/AspectRe.h"
 #include "Aspects/AspectSlice.h"
+#include "Aspects/AspectSplit.h"
 #include "Aspects/_aspects_exports.h"
 #include "Constants.h"
 #include "Initializer/_initializer.h"
@@ -32,6 +35,56 @@ static PyMethodDef AspectsMethods[] = {
     { "index_aspect", ((PyCFunction)api_index_aspect), METH_FASTCALL, "aspect index" },
     { "join_aspect", ((PyCFunction)api_join_aspect), METH_FASTCALL, "aspect join" },
     { "slice_aspect", ((PyCFunction)api_slice_aspect), METH_FASTCALL, "aspect slice" },
+    { "split_aspect", ((PyCFunction)(void (*)(void))api_split_aspect), METH_FASTCALL | METH_KEYWORDS, "aspect split" },
+    { "rsplit_aspect",
+      ((PyCFunction)(void (*)(void))api_rsplit_aspect),
+      METH_FASTCALL | METH_KEYWORDS,
+      "aspect rsplit" },
+    { "splitlines_aspect",
+      ((PyCFunction)(void (*)(void))api_splitlines_aspect),
+      METH_FASTCALL | METH_KEYWORDS,
+      "aspect splitlines" },
+    { "split_text", ((PyCFunction)(void (*)(void))api_split_text), METH_FASTCALL | METH_KEYWORDS, "split text" },
+    { "rsplit_text", ((PyCFunction)(void (*)(void))api_rsplit_text), METH_FASTCALL | METH_KEYWORDS, "rsplit text" },
+    { "splitlines_text",
+      ((PyCFunction)(void (*)(void))api_splitlines_text),
+      METH_FASTCALL | METH_KEYWORDS,
+      "splitlines text" },
+    { "upper_aspect", ((PyCFunction)(void (*)(void))api_upper_aspect), METH_FASTCALL | METH_KEYWORDS, "aspect upper" },
+    { "lower_aspect", ((PyCFunction)(void (*)(void))api_lower_aspect), METH_FASTCALL | METH_KEYWORDS, "aspect lower" },
+    { "swapcase_aspect",
+      ((PyCFunction)(void (*)(void))api_swapcase_aspect),
+      METH_FASTCALL | METH_KEYWORDS,
+      "aspect swapcase" },
+    { "title_aspect", ((PyCFunction)(void (*)(void))api_title_aspect), METH_FASTCALL | METH_KEYWORDS, "aspect title" },
+    { "capitalize_aspect",
+      ((PyCFunction)(void (*)(void))api_capitalize_aspect),
+      METH_FASTCALL | METH_KEYWORDS,
+      "aspect capitalize" },
+    { "translate_aspect",
+      ((PyCFunction)(void (*)(void))api_translate_aspect),
+      METH_FASTCALL | METH_KEYWORDS,
+      "aspect translate" },
+    { "re_sub_aspect",
+      ((PyCFunction)(void (*)(void))api_re_sub_aspect),
+      METH_FASTCALL | METH_KEYWORDS,
+      "aspect re sub" },
+    { "re_subn_aspect",
+      ((PyCFunction)(void (*)(void))api_re_subn_aspect),
+      METH_FASTCALL | METH_KEYWORDS,
+      "aspect re subn" },
+    { "re_group_aspect",
+      ((PyCFunction)(void (*)(void))api_re_group_aspect),
+      METH_FASTCALL | METH_KEYWORDS,
+      "aspect re match group" },
+    { "re_groups_aspect",
+      ((PyCFunction)(void (*)(void))api_re_groups_aspect),
+      METH_FASTCALL | METH_KEYWORDS,
+      "aspect re match groups" },
+    { "re_groupdict_aspect",
+      ((PyCFunction)(void (*)(void))api_re_groupdict_aspect),
+      METH_FASTCALL | METH_KEYWORDS,
+      "aspect re match groupdict" },
     { nullptr, nullptr, 0, nullptr }
 };
 
@@ -44,6 +97,8 @@ static struct PyModuleDef aspects = { PyModuleDef_HEAD_INIT,
 static PyMethodDef OpsMethods[] = {
     { "new_pyobject_id", (PyCFunction)api_new_pyobject_id, METH_FASTCALL, "new pyobject id" },
     { "set_ranges_from_values", ((PyCFunction)api_set_ranges_from_values), METH_FASTCALL, "set_ranges_from_values" },
+    { "taint_pyobjects", ((PyCFunction)api_taint_pyobjects), METH_FASTCALL, "taint_pyobjects" },
+    { "is_tainted", ((PyCFunction)api_is_tainted), METH_FASTCALL, "is_tainted" },
     { nullptr, nullptr, 0, nullptr }
 };
 
@@ -24,9 +24,6 @@ from .._taint_tracking import _aspect_ospathsplit
 from .._taint_tracking import _aspect_ospathsplitdrive
 from .._taint_tracking import _aspect_ospathsplitext
 from .._taint_tracking import _aspect_ospathsplitroot
-from .._taint_tracking import _aspect_rsplit
-from .._taint_tracking import _aspect_split
-from .._taint_tracking import _aspect_splitlines
 from .._taint_tracking import _convert_escaped_text_to_tainted_text
 from .._taint_tracking import _format_aspect
 from .._taint_tracking import are_all_text_all_ranges
@@ -54,6 +51,24 @@ _extend_aspect = aspects.extend_aspect
 _index_aspect = aspects.index_aspect
 _join_aspect = aspects.join_aspect
 _slice_aspect = aspects.slice_aspect
+split_aspect = aspects.split_aspect
+rsplit_aspect = aspects.rsplit_aspect
+splitlines_aspect = aspects.splitlines_aspect
+
+# Aspects of the re module, mapping the spans of the matches onto the ranges of the text, implemented natively
+re_sub_aspect = aspects.re_sub_aspect
+re_subn_aspect = aspects.re_subn_aspect
+re_group_aspect = aspects.re_group_aspect
+re_groups_aspect = aspects.re_groups_aspect
+re_groupdict_aspect = aspects.re_groupdict_aspect
+
+# Aspects copying the ranges of the text to the result of the method, implemented natively
+upper_aspect = aspects.upper_aspect
+lower_aspect = aspects.lower_aspect
+swapcase_aspect = aspects.swapcase_aspect
+title_aspect = aspects.title_aspect
+capitalize_aspect = aspects.capitalize_aspect
+translate_aspect = aspects.translate_aspect
 
 __all__ = [
     "add_aspect",
@@ -62,9 +77,6 @@ __all__ = [
     "decode_aspect",
     "encode_aspect",
     "_aspect_ospathjoin",
-    "_aspect_split",
-    "_aspect_rsplit",
-    "_aspect_splitlines",
     "_aspect_ospathbasename",
     "_aspect_ospathdirname",
     "_aspect_ospathnormcase",
@@ -87,45 +99,6 @@ def add_aspect(op1, op2):
     return op1 + op2
 
 
-def split_aspect(orig_function: Optional[Callable], flag_added_args: int, *args: Any, **kwargs: Any) -> str:
-    if orig_function is not None:
-        if orig_function != builtin_str:
-            if flag_added_args > 0:
-                args = args[flag_added_args:]
-            return orig_function(*args, **kwargs)
-    try:
-        return _aspect_split(*args, **kwargs)
-    except Exception as e:
-        iast_taint_log_error("IAST propagation error. split_aspect. {}".format(e))
-        return args[0].split(*args[1:], **kwargs)
-
-
-def rsplit_aspect(orig_function: Optional[Callable], flag_added_args: int, *args: Any, **kwargs: Any) -> str:
-    if orig_function is not None:
-        if orig_function != builtin_str:
-            if flag_added_args > 0:
-                args = args[flag_added_args:]
-            return orig_function(*args, **kwargs)
-    try:
-        return _aspect_rsplit(*args, **kwargs)
-    except Exception as e:
-        iast_taint_log_error("IAST propagation error. rsplit_aspect. {}".format(e))
-        return args[0].rsplit(*args[1:], **kwargs)
-
-
-def splitlines_aspect(orig_function: Optional[Callable], flag_added_args: int, *args: Any, **kwargs: Any) -> str:
-    if orig_function:
-        if orig_function != builtin_str:
-            if flag_added_args > 0:
-                args = args[flag_added_args:]
-            return orig_function(*args, **kwargs)
-    try:
-        return _aspect_splitlines(*args, **kwargs)
-    except Exception as e:
-        iast_taint_log_error("IAST propagation error. splitlines_aspect. {}".format(e))
-        return args[0].splitlines(*args[1:], **kwargs)
-
-
 def str_aspect(orig_function: Optional[Callable], flag_added_args: int, *args: Any, **kwargs: Any) -> str:
     if orig_function is not None:
         if orig_function != builtin_str:
@@ -136,6 +109,10 @@ def str_aspect(orig_function: Optional[Callable], flag_added_args: int, *args: A
     else:
         result = args[0].str(*args[1:], **kwargs)
 
+    # str() of a str object is the object itself, which already has its ranges
+    if args and result is args[0]:
+        return result
+
     if args and is_pyobject_tainted(args[0]):
         try:
             if isinstance(args[0], (bytes, bytearray)):
@@ -297,7 +274,12 @@ def modulo_aspect(candidate_text: Text, candidate_tuple: Any) -> Any:
 
 
 def build_string_aspect(*args: List[Any]) -> TEXT_TYPES:
-    return join_aspect("".join, 1, "", args)
+    # BUILD_STRING only joins str objects with an empty separator, so the native aspect is called directly
+    try:
+        return _join_aspect("", args)
+    except Exception as e:
+        iast_taint_log_error("IAST propagation error. build_string_aspect. {}".format(e))
+        return "".join(args)
 
 
 def ljust_aspect(
@@ -395,15 +377,12 @@ def format_aspect(
     candidate_text: Text = args[0]
     args = args[flag_added_args:]
 
-    result = candidate_text.format(*args, **kwargs)
-
-    if not isinstance(candidate_text, IAST.TEXT_TYPES):
-        return result
-
     if isinstance(candidate_text, IAST.TEXT_TYPES):
         try:
-            params = tuple(args) + tuple(kwargs.values())
-            return _format_aspect(candidate_text, params, *args, **kwargs)
+            # None when the template or its arguments are wrong, str.format raises the error below
+            result = _format_aspect(candidate_text, *args, **kwargs)
+            if result is not None:
+                return result
         except Exception as e:
             iast_taint_log_error("IAST propagation error. format_aspect. {}".format(e))
 
@@ -705,46 +684,6 @@ def encode_aspect(
     return result
 
 
-def upper_aspect(
-    orig_function: Optional[Callable], flag_added_args: int, *args: Any, **kwargs: Any
-) -> Union[TEXT_TYPES]:
-    if orig_function is not None and (not isinstance(orig_function, BuiltinFunctionType) or not args):
-        if flag_added_args > 0:
-            args = args[flag_added_args:]
-        return orig_function(*args, **kwargs)
-
-    candidate_text = args[0]
-    args = args[flag_added_args:]
-    if not isinstance(candidate_text, IAST.TEXT_TYPES):
-        return candidate_text.upper(*args, **kwargs)
-
-    try:
-        return common_replace("upper", candidate_text, *args, **kwargs)
-    except Exception as e:
-        iast_taint_log_error("IAST propagation error. upper_aspect. {}".format(e))
-        return candidate_text.upper(*args, **kwargs)
-
-
-def lower_aspect(
-    orig_function: Optional[Callable], flag_added_args: int, *args: Any, **kwargs: Any
-) -> Union[TEXT_TYPES]:
-    if orig_function is not None and (not isinstance(orig_function, BuiltinFunctionType) or not args):
-        if flag_added_args > 0:
-            args = args[flag_added_args:]
-        return orig_function(*args, **kwargs)
-
-    candidate_text = args[0]
-    args = args[flag_added_args:]
-    if not isinstance(candidate_text, IAST.TEXT_TYPES):
-        return candidate_text.lower(*args, **kwargs)
-
-    try:
-        return common_replace("lower", candidate_text, *args, **kwargs)
-    except Exception as e:
-        iast_taint_log_error("IAST propagation error. lower_aspect. {}".format(e))
-        return candidate_text.lower(*args, **kwargs)
-
-
 def _distribute_ranges_and_escape(
     split_elements: List[Optional[TEXT_TYPES]],
     len_separator: int,
@@ -964,64 +903,6 @@ def replace_aspect(
         return orig_result
 
 
-def swapcase_aspect(
-    orig_function: Optional[Callable], flag_added_args: int, *args: Any, **kwargs: Any
-) -> Union[TEXT_TYPES]:
-    if orig_function is not None and (not isinstance(orig_function, BuiltinFunctionType) or not args):
-        if flag_added_args > 0:
-            args = args[flag_added_args:]
-        return orig_function(*args, **kwargs)
-
-    candidate_text = args[0]
-    args = args[flag_added_args:]
-    if not isinstance(candidate_text, IAST.TEXT_TYPES):
-        return candidate_text.swapcase(*args, **kwargs)
-    try:
-        return common_replace("swapcase", candidate_text, *args, **kwargs)
-    except Exception as e:
-        iast_taint_log_error("IAST propagation error. swapcase_aspect. {}".format(e))
-        return candidate_text.swapcase(*args, **kwargs)
-
-
-def title_aspect(
-    orig_function: Optional[Callable], flag_added_args: int, *args: Any, **kwargs: Any
-) -> Union[TEXT_TYPES]:
-    if orig_function is not None and (not isinstance(orig_function, BuiltinFunctionType) or not args):
-        if flag_added_args > 0:
-            args = args[flag_added_args:]
-        return orig_function(*args, **kwargs)
-
-    candidate_text = args[0]
-    args = args[flag_added_args:]
-    if not isinstance(candidate_text, IAST.TEXT_TYPES):
-        return candidate_text.title(*args, **kwargs)
-    try:
-        return common_replace("title", candidate_text, *args, **kwargs)
-    except Exception as e:
-        iast_taint_log_error("IAST propagation error. title_aspect. {}".format(e))
-        return candidate_text.title(*args, **kwargs)
-
-
-def capitalize_aspect(
-    orig_function: Optional[Callable], flag_added_args: int, *args: Any, **kwargs: Any
-) -> Union[TEXT_TYPES]:
-    if orig_function is not None and (not isinstance(orig_function, BuiltinFunctionType) or not args):
-        if flag_added_args > 0:
-            args = args[flag_added_args:]
-        return orig_function(*args, **kwargs)
-
-    candidate_text = args[0]
-    args = args[flag_added_args:]
-    if not isinstance(candidate_text, IAST.TEXT_TYPES):
-        return candidate_text.capitalize(*args, **kwargs)
-
-    try:
-        return common_replace("capitalize", candidate_text, *args, **kwargs)
-    except Exception as e:
-        iast_taint_log_error("IAST propagation error. capitalize_aspect. {}".format(e))
-        return candidate_text.capitalize(*args, **kwargs)
-
-
 def casefold_aspect(
     orig_function: Optional[Callable], flag_added_args: int, *args: Any, **kwargs: Any
 ) -> Union[TEXT_TYPES]:
@@ -1055,24 +936,5 @@ def casefold_aspect(
         return candidate_text.casefold(*args, **kwargs)  # type: ignore[union-attr]
 
 
-def translate_aspect(
-    orig_function: Optional[Callable], flag_added_args: int, *args: Any, **kwargs: Any
-) -> Union[TEXT_TYPES]:
-    if orig_function is not None and (not isinstance(orig_function, BuiltinFunctionType) or not args):
-        if flag_added_args > 0:
-            args = args[flag_added_args:]
-        return orig_function(*args, **kwargs)
-
-    candidate_text = args[0]
-    args = args[flag_added_args:]
-    if not isinstance(candidate_text, IAST.TEXT_TYPES):
-        return candidate_text.translate(*args, **kwargs)
-    try:
-        return common_replace("translate", candidate_text, *args, **kwargs)
-    except Exception as e:
-        iast_taint_log_error("IAST propagation error. translate_aspect. {}".format(e))
-        return candidate_text.translate(*args, **kwargs)
-
-
 def empty_func(*args, **kwargs):
     pass
@@ -0,0 +1,153 @@
+#include "texts.h"
+#include "perf_counters.h"
+
+#include "Aspects/AspectFormat.h"
+#include "Aspects/AspectJoin.h"
+#include "Aspects/AspectOperatorAdd.h"
+#include "Aspects/AspectSlice.h"
+#include "Aspects/AspectSplit.h"
+
+#include <benchmark/benchmark.h>
+
+#include <vector>
+
+namespace {
+
+// Parts of the joined texts, as when rebuilding a query string or a path
+constexpr size_t JOIN_PARTS = 8;
+
+// Arguments of the benchmarks: the number of ranges of the tainted texts and their length
+void
+range_distributions(benchmark::internal::Benchmark* bench)
+{
+    bench->ArgNames({ "ranges", "length" });
+    for (const auto length : { SHORT_TEXT, LONG_TEXT }) {
+        for (const size_t num_ranges : { 1, 10, 100 }) {
+            if (num_ranges * 2 <= length) {
+                bench->Args({ static_cast<int64_t>(num_ranges), static_cast<int64_t>(length) });
+            }
+        }
+    }
+}
+
+size_t
+num_ranges(const benchmark::State& state)
+{
+    return static_cast<size_t>(state.range(0));
+}
+
+size_t
+text_length(const benchmark::State& state)
+{
+    return static_cast<size_t>(state.range(1));
+}
+
+// Calls an aspect returning a new reference for every iteration
+template<class Aspect>
+void
+run_aspect(benchmark::State& state, const size_t bytes_per_call, Aspect aspect)
+{
+    bench::PerfCountersScope perf_counters(state);
+    for (auto _ : state) {
+        PyObject* result = aspect();
+        if (result == nullptr) {
+            PyErr_Clear();
+            state.SkipWithError("the aspect failed");
+            break;
+        }
+        Py_DECREF(result);
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * bytes_per_call));
+}
+
+void
+BM_AddAspect(benchmark::State& state)
+{
+    const auto left = py::reinterpret_steal<py::object>(make_tainted_text(text_length(state), num_ranges(state)));
+    const auto right = py::reinterpret_steal<py::object>(make_tainted_text(text_length(state), num_ranges(state)));
+    PyObject* args[] = { left.ptr(), right.ptr() };
+    run_aspect(state, 2 * text_length(state), [&] { return api_add_aspect(nullptr, args, 2); });
+}
+BENCHMARK(BM_AddAspect)->Apply(range_distributions);
+
+void
+BM_JoinAspect(benchmark::State& state)
+{
+    const auto separator = py::str(", ");
+    py::list parts;
+    for (size_t i = 0; i < JOIN_PARTS; i++) {
+        parts.append(py::reinterpret_steal<py::object>(make_tainted_text(text_length(state), num_ranges(state))));
+    }
+    PyObject* args[] = { separator.ptr(), parts.ptr() };
+    run_aspect(state, JOIN_PARTS * text_length(state), [&] { return api_join_aspect(nullptr, args, 2); });
+}
+BENCHMARK(BM_JoinAspect)->Apply(range_distributions);
+
+void
+BM_SliceAspect(benchmark::State& state)
+{
+    const auto text = py::reinterpret_steal<py::object>(make_tainted_text(text_length(state), num_ranges(state)));
+    // The middle half of the text
+    const auto start = py::int_(text_length(state) / 4);
+    const auto stop = py::int_(3 * text_length(state) / 4);
+    PyObject* args[] = { text.ptr(), start.ptr(), stop.ptr() };
+    run_aspect(state, text_length(state) / 2, [&] { return api_slice_aspect(nullptr, args, 3); });
+}
+BENCHMARK(BM_SliceAspect)->Apply(range_distributions);
+
+void
+BM_SplitAspect(benchmark::State& state)
+{
+    const auto text = py::reinterpret_steal<py::object>(make_tainted_text(text_length(state), num_ranges(state), ','));
+    const auto separator = py::str(",");
+    PyObject* args[] = { text.ptr(), separator.ptr() };
+    run_aspect(state, text_length(state), [&] { return api_split_text(nullptr, args, 2, nullptr); });
+}
+BENCHMARK(BM_SplitAspect)->Apply(range_distributions);
+
+void
+BM_FormatAspect(benchmark::State& state)
+{
+    auto candidate_text = py::str("{} and {}");
+    const auto first = py::reinterpret_steal<py::object>(make_tainted_text(text_length(state), num_ranges(state)));
+    const auto second = py::reinterpret_steal<py::object>(make_tainted_text(text_length(state), num_ranges(state)));
+    const py::args args(py::make_tuple(first, second));
+    const py::kwargs kwargs;
+    bench::PerfCountersScope perf_counters(state);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(api_format_aspect<py::str>(candidate_text, args, kwargs).ptr());
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * 2 * text_length(state)));
+}
+BENCHMARK(BM_FormatAspect)->Apply(range_distributions);
+
+void
+BM_GetTaintedObject(benchmark::State& state)
+{
+    const auto text = py::reinterpret_steal<py::object>(make_tainted_text(text_length(state), num_ranges(state)));
+    const auto tx_map = initializer->get_tainting_map();
+    bench::PerfCountersScope perf_counters(state);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(get_tainted_object(text.ptr(), tx_map));
+    }
+}
+BENCHMARK(BM_GetTaintedObject)->Apply(range_distributions);
+
+// Most of the operands of the aspects are not tainted
+void
+BM_GetTaintedObjectNotTainted(benchmark::State& state)
+{
+    std::vector<py::object> texts;
+    for (size_t i = 0; i < 64; i++) {
+        texts.push_back(py::reinterpret_steal<py::object>(make_text(SHORT_TEXT)));
+    }
+    const auto tx_map = initializer->get_tainting_map();
+    size_t i = 0;
+    bench::PerfCountersScope perf_counters(state);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(get_tainted_object(texts[i++ % texts.size()].ptr(), tx_map));
+    }
+}
+BENCHMARK(BM_GetTaintedObjectNotTainted);
+
+} // namespace
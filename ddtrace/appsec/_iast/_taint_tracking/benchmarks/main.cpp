@@ -0,0 +1,31 @@
+#include "Initializer/Initializer.h"
+
+#include <benchmark/benchmark.h>
+#include <pybind11/embed.h>
+
+#include <cstdlib>
+
+// The aspects need the interpreter and the initializer of the module, which the benchmarks share for the whole
+// process, in a single context
+int
+main(int argc, char** argv)
+{
+    // The benchmarks create many tainted objects in their context, the budget of a request would stop tainting them
+    setenv("DD_IAST_MAX_TAINTED_OBJECTS_PER_REQUEST", "0", 1);
+    setenv("DD_IAST_MAX_TAINT_RANGES_PER_REQUEST", "0", 1);
+
+    py::scoped_interpreter interpreter;
+    initializer = make_unique<Initializer>();
+    initializer->create_context();
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+        return 1;
+    }
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+
+    initializer->reset_context();
+    initializer.reset();
+    return 0;
+}
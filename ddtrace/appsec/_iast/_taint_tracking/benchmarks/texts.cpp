@@ -0,0 +1,37 @@
+#include "texts.h"
+
+#include "Initializer/Initializer.h"
+
+#include <string>
+
+static constexpr size_t NUM_SOURCES = 3;
+static constexpr size_t SEPARATOR_EVERY = 16;
+
+PyObject*
+make_text(const size_t length, const char separator)
+{
+    std::string chars(length, ' ');
+    for (size_t i = 0; i < length; i++) {
+        chars[i] = static_cast<char>('a' + i % 26);
+        if (separator != 0 and i % SEPARATOR_EVERY == SEPARATOR_EVERY - 1) {
+            chars[i] = separator;
+        }
+    }
+    return PyUnicode_FromStringAndSize(chars.data(), static_cast<Py_ssize_t>(chars.size()));
+}
+
+PyObject*
+make_tainted_text(const size_t length, const size_t num_ranges, const char separator)
+{
+    PyObject* text = make_text(length, separator);
+    const size_t share = length / num_ranges;
+    TaintRangeRefs ranges;
+    for (size_t i = 0; i < num_ranges; i++) {
+        const auto source_index = std::to_string(i % NUM_SOURCES);
+        const Source source("param" + source_index, "value" + source_index, OriginType::PARAMETER);
+        const auto range_length = std::max<size_t>(1, share / 2);
+        ranges.emplace_back(static_cast<RANGE_START>(i * share), static_cast<RANGE_LENGTH>(range_length), source);
+    }
+    set_ranges(text, ranges, initializer->get_tainting_map());
+    return text;
+}
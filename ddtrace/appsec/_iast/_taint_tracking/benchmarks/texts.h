@@ -0,0 +1,30 @@
+#pragma once
+
+#include <Python.h>
+
+#include <cstddef>
+
+/**
+ * Texts tainted the way the values of a request end up: a few sources, and ranges spread over the text.
+ */
+
+// Lengths of the texts: a header or a parameter, and a body or a rendered template
+constexpr size_t SHORT_TEXT = 32;
+constexpr size_t LONG_TEXT = 4096;
+
+/**
+ * Creates a str of length characters with num_ranges ranges spread evenly over it, each covering half of its share
+ * of the text, taken from a few sources in turn. If separator isn't 0, it is every 16th character of the text.
+ *
+ * @return A new reference.
+ */
+PyObject*
+make_tainted_text(size_t length, size_t num_ranges, char separator = 0);
+
+/**
+ * Creates a str of length characters without ranges.
+ *
+ * @return A new reference.
+ */
+PyObject*
+make_text(size_t length, char separator = 0);
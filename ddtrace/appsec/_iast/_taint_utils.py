@@ -38,6 +38,8 @@ class _DeepTaintCommand:
         self.key = key
         self.struct = struct
         self.is_key = is_key
+        # Set when obj is a text already tainted along with its siblings
+        self.tainted = False
 
     def store(self, value):
         if isinstance(self.store_struct, list):
@@ -52,6 +54,31 @@ class _DeepTaintCommand:
         return self.__class__(False, self.source_key, self.obj, self.store_struct, self.key, struct)
 
 
+def _taint_text_commands(commands, source_key, source_value, override_pyobject_tainted):
+    """Taint at once the texts of the commands for the elements of a structure, instead of one by one"""
+    from ._taint_tracking import is_pyobject_tainted
+    from ._taint_tracking import taint_pyobjects
+
+    to_taint = [
+        command
+        for command in commands
+        if command.obj
+        and isinstance(command.obj, (str, bytes, bytearray))
+        and (override_pyobject_tainted or not is_pyobject_tainted(command.obj))
+    ]
+    if not to_taint:
+        return
+    results = taint_pyobjects(
+        [
+            (command.obj, command.source_key, source_key if command.is_key else source_value)
+            for command in to_taint
+        ]
+    )
+    for command, result in zip(to_taint, results):
+        command.obj = result
+        command.tainted = True
+
+
 def build_new_tainted_object_from_generic_object(initial_object, wanted_object):
     if initial_object.__class__ is wanted_object.__class__:
         return wanted_object
@@ -104,7 +131,9 @@ def taint_structure(main_obj, source_key, source_value, override_pyobject_tainte
                 if not command.obj:
                     command.store(command.obj)
                 elif isinstance(command.obj, (str, bytes, bytearray)):
-                    if override_pyobject_tainted or not is_pyobject_tainted(command.obj):
+                    if command.tainted:
+                        command.store(command.obj)
+                    elif override_pyobject_tainted or not is_pyobject_tainted(command.obj):
                         new_obj = taint_pyobject(
                             pyobject=command.obj,
                             source_name=command.source_key,
@@ -124,11 +153,13 @@ def taint_structure(main_obj, source_key, source_value, override_pyobject_tainte
                         key_store = []
                         todo.append(_DeepTaintCommand(True, str(k), k, key_store, is_key=True))
                         todo.append(_DeepTaintCommand(True, str(k), v, res, key_store))
+                    _taint_text_commands(todo, source_key, source_value, override_pyobject_tainted)
                     stack.extend(reversed(todo))
                 elif isinstance(command.obj, abc.Sequence):
                     res = []
                     stack.append(command.post(res))
                     todo = [_DeepTaintCommand(True, command.source_key, v, res) for v in command.obj]
+                    _taint_text_commands(todo, source_key, source_value, override_pyobject_tainted)
                     stack.extend(reversed(todo))
                 else:
                     command.store(command.obj)
@@ -43,12 +43,12 @@ class AppSecIastSpanProcessor(SpanProcessor):
         if not _is_iast_enabled():
             return
 
-        from ._taint_tracking import create_context
-
-        create_context()
-
         request_iast_enabled = False
         if oce.acquire_request(span):
+            from ._taint_tracking import create_context
+
+            # Only the sampled requests get a context, nothing is tainted in the others
+            create_context()
             request_iast_enabled = True
 
         core.set_item(IAST.REQUEST_IAST_ENABLED, request_iast_enabled, span=span)
@@ -69,6 +69,7 @@ class AppSecIastSpanProcessor(SpanProcessor):
             return
 
         from ._taint_tracking import reset_context  # noqa: F401
+        from ._taint_tracking import taint_budget_exceeded
 
         span.set_metric(IAST.ENABLED, 1.0)
 
@@ -82,6 +83,8 @@ class AppSecIastSpanProcessor(SpanProcessor):
         _set_metric_iast_request_tainted()
         _set_span_tag_iast_request_tainted(span)
         _set_span_tag_iast_executed_sink(span)
+        if taint_budget_exceeded():
+            log.debug("IAST taint budget of the request exceeded, some values were not tainted")
         reset_context()
 
         if span.get_tag(ORIGIN_KEY) is None:
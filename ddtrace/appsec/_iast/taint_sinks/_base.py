@@ -9,10 +9,13 @@ from ddtrace.appsec._constants import IAST
 from ddtrace.internal import core
 from ddtrace.internal.logger import get_logger
 from ddtrace.internal.utils.cache import LFUCache
+from ddtrace.settings.asm import config as asm_config
 
 from ..._deduplications import deduplication
 from .._overhead_control_engine import Operation
 from .._stacktrace import get_info_frame
+from .._stacktrace import get_info_frame_if_not_reported
+from .._stacktrace import reset_reported_locations
 from ..processor import AppSecIastSpanProcessor
 from ..reporter import Evidence
 from ..reporter import IastSpanReporter
@@ -30,6 +33,10 @@ class taint_sink_deduplication(deduplication):
         # We skip positions 0 and 1 because they represent the 'cls' and 'span' respectively
         return args[2:]
 
+    def _reset_cache(self):
+        super()._reset_cache()
+        reset_reported_locations()
+
 
 def _check_positions_contained(needle, container):
     needle_start, needle_end = needle
@@ -112,7 +119,14 @@ class VulnerabilityBase(Operation):
 
             skip_location = getattr(cls, "skip_location", False)
             if not skip_location:
-                frame_info = get_info_frame(CWD)
+                if asm_config._deduplication_enabled:
+                    # Checked natively on the frame of the location before anything else is built for the report
+                    frame_info = get_info_frame_if_not_reported(CWD, cls.vulnerability_type, deduplication._time_lapse)
+                    if frame_info is None:
+                        cls.increment_quota()
+                        return None
+                else:
+                    frame_info = get_info_frame(CWD)
                 if not frame_info or frame_info[0] == "" or frame_info[0] == -1:
                     return None
 
@@ -1,4 +1,5 @@
 import ddtrace
+from ddtrace.settings.asm import config as asm_config
 
 
 def _wrap_submit(func, args, kwargs):
@@ -21,6 +22,16 @@ def _wrap_submit(func, args, kwargs):
     if ddtrace.tracer.context_provider._has_active_context():
         current_ctx = ddtrace.tracer.context_provider.active()
 
+    # The taint tracking context of the request, so that the work keeps tracking the tainted values it receives
+    iast_ctx = None
+    if asm_config._iast_enabled:
+        try:
+            from ddtrace.appsec._iast._taint_tracking import get_context
+
+            iast_ctx = get_context()
+        except ImportError:
+            pass
+
     # The target function can be provided as a kwarg argument "fn" or the first positional argument
     self = args[0]
     if "fn" in kwargs:
@@ -28,10 +39,10 @@ def _wrap_submit(func, args, kwargs):
         fn_args = args[1:]
     else:
         fn, fn_args = args[1], args[2:]
-    return func(self, _wrap_execution, current_ctx, fn, fn_args, kwargs)
+    return func(self, _wrap_execution, current_ctx, iast_ctx, fn, fn_args, kwargs)
 
 
-def _wrap_execution(ctx, fn, args, kwargs):
+def _wrap_execution(ctx, iast_ctx, fn, args, kwargs):
     """
     Intermediate target function that is executed in a new thread;
     it receives the original function with arguments and keyword
@@ -41,4 +52,14 @@ def _wrap_execution(ctx, fn, args, kwargs):
     """
     if ctx is not None:
         ddtrace.tracer.context_provider.activate(ctx)
-    return fn(*args, **kwargs)
+    if iast_ctx is None:
+        return fn(*args, **kwargs)
+
+    from ddtrace.appsec._iast._taint_tracking import attach_context
+    from ddtrace.appsec._iast._taint_tracking import detach_context
+
+    attach_context(iast_ctx)
+    try:
+        return fn(*args, **kwargs)
+    finally:
+        detach_context()
@@ -5,6 +5,7 @@ import attr
 import ddtrace
 from ddtrace import config
 
+from ...internal import _log_injection
 from ...internal.utils import get_argument_value
 from ...vendor.wrapt import wrap_function_wrapper as _w
 from ..trace_utils import unwrap as _u
@@ -65,10 +66,6 @@ def _w_makeRecord(func, instance, args, kwargs):
     # Get the LogRecord instance for this log
     record = func(*args, **kwargs)
 
-    setattr(record, RECORD_ATTR_VERSION, config.version or RECORD_ATTR_VALUE_EMPTY)
-    setattr(record, RECORD_ATTR_ENV, config.env or RECORD_ATTR_VALUE_EMPTY)
-    setattr(record, RECORD_ATTR_SERVICE, config.service or RECORD_ATTR_VALUE_EMPTY)
-
     # logs from internal logger may explicitly pass the current span to
     # avoid deadlocks in getting the current span while already in locked code.
     span_from_log = getattr(record, _LOG_SPAN_KEY, None)
@@ -77,15 +74,15 @@ def _w_makeRecord(func, instance, args, kwargs):
     else:
         span = _get_current_span(tracer=config.logging.tracer)
 
-    if span:
-        trace_id = span.trace_id
-        if config._128_bit_trace_id_enabled and not config._128_bit_trace_id_logging_enabled:
-            trace_id = span._trace_id_64bits
-        setattr(record, RECORD_ATTR_TRACE_ID, str(trace_id))
-        setattr(record, RECORD_ATTR_SPAN_ID, str(span.span_id))
-    else:
-        setattr(record, RECORD_ATTR_TRACE_ID, RECORD_ATTR_VALUE_ZERO)
-        setattr(record, RECORD_ATTR_SPAN_ID, RECORD_ATTR_VALUE_ZERO)
+    # Sets the RECORD_ATTR_* attributes natively, formatting the ids of a span once for all its records
+    _log_injection.inject(
+        record,
+        span or None,
+        config.service,
+        config.version,
+        config.env,
+        config._128_bit_trace_id_enabled and not config._128_bit_trace_id_logging_enabled,
+    )
 
     return record
 
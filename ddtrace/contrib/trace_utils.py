@@ -22,6 +22,7 @@ from ddtrace import config
 from ddtrace.ext import http
 from ddtrace.ext import net
 from ddtrace.ext import user
+from ddtrace.internal import _http_headers
 from ddtrace.internal import core
 from ddtrace.internal.compat import ensure_text
 from ddtrace.internal.compat import ip_is_global
@@ -34,13 +35,13 @@ from ddtrace.internal.utils.http import strip_query_string
 import ddtrace.internal.utils.wrappers
 from ddtrace.propagation.http import HTTPPropagator
 from ddtrace.settings.asm import config as asm_config
+from ddtrace.settings.integration import IntegrationConfig
 from ddtrace.vendor import wrapt
 
 
 if TYPE_CHECKING:  # pragma: no cover
     from ddtrace import Span  # noqa:F401
     from ddtrace import Tracer  # noqa:F401
-    from ddtrace.settings import IntegrationConfig  # noqa:F401
 
 
 log = get_logger(__name__)
@@ -52,6 +53,12 @@ iswrapped = ddtrace.internal.utils.wrappers.iswrapped
 REQUEST = "request"
 RESPONSE = "response"
 
+# The prefixes of the default header tags, see _normalize_tag_name
+_HEADER_TAG_PREFIXES = {
+    REQUEST: "http.request.headers.",
+    RESPONSE: "http.response.headers.",
+}
+
 # Tag normalization based on: https://docs.datadoghq.com/tagging/#defining-tags
 # With the exception of '.' in header names which are replaced with '_' to avoid
 # starting a "new object" on the UI.
@@ -133,7 +140,7 @@ def _store_headers(headers, span, integration_config, request_or_response):
     :param integration_config: An integration specific config object.
     :type integration_config: ddtrace.settings.IntegrationConfig
     """
-    if not isinstance(headers, dict):
+    if type(headers) is not dict:
         try:
             headers = dict(headers)
         except Exception:
@@ -143,6 +150,18 @@ def _store_headers(headers, span, integration_config, request_or_response):
         log.debug("Skipping headers tracing as no integration config was provided")
         return
 
+    if isinstance(integration_config, IntegrationConfig):
+        # The lookups, the normalization of the names and the tags are done natively, with the same precedence as
+        # IntegrationConfig._header_tag_name
+        _http_headers.store(
+            span,
+            headers,
+            integration_config.http._header_tags,
+            integration_config.global_config.http._header_tags,
+            _HEADER_TAG_PREFIXES[request_or_response],
+        )
+        return
+
     for header_name, header_value in headers.items():
         """config._header_tag_name gets an element of the dictionary in config.http._header_tags
         which gets the value from DD_TRACE_HEADER_TAGS environment variable."""
@@ -504,10 +523,10 @@ def set_http_meta(
             """We should store both http.<request_or_response>.headers.<header_name> and
             http.<key>. The last one
             is the DD standardized tag for user-agent"""
-            _store_request_headers(dict(request_headers), span, integration_config)
+            _store_request_headers(request_headers, span, integration_config)
 
     if response_headers is not None and integration_config.is_header_tracing_configured:
-        _store_response_headers(dict(response_headers), span, integration_config)
+        _store_response_headers(response_headers, span, integration_config)
 
     if retries_remain is not None:
         span.set_tag_str(http.RETRIES_REMAIN, str(retries_remain))
@@ -28,6 +28,7 @@ from ddtrace.debugging._encoding import LogSignalJsonEncoder
 from ddtrace.debugging._encoding import SignalQueue
 from ddtrace.debugging._exception.auto_instrument import SpanExceptionProcessor
 from ddtrace.debugging._function.discovery import FunctionDiscovery
+from ddtrace.debugging._function.monitor import LineMonitor
 from ddtrace.debugging._function.store import FullyNamedWrappedFunction
 from ddtrace.debugging._function.store import FunctionStore
 from ddtrace.debugging._metrics import metrics
@@ -359,7 +360,12 @@ class Debugger(Service):
         self._collector = self.__collector__(self._signal_queue)
         self._services = [self._uploader]
 
-        self._function_store = FunctionStore(extra_attrs=["__dd_wrappers__"])
+        # The line probes are called from the sys.monitoring LINE events when available, instead of being injected
+        self._line_monitor = LineMonitor.acquire() if di_config.monitoring else None
+        if self._line_monitor is not None:
+            self._services.append(self._line_monitor)
+
+        self._function_store = FunctionStore(extra_attrs=["__dd_wrappers__"], monitor=self._line_monitor)
 
         log_limiter = RateLimiter(limit_rate=1.0, raise_on_exceed=False)
         self._global_rate_limiter = RateLimiter(
@@ -396,13 +402,16 @@ class Debugger(Service):
         # Send upload request
         self._uploader.upload()
 
-    def _dd_debugger_hook(self, probe: Probe) -> None:
+    def _dd_debugger_hook(self, probe: Probe) -> Optional[float]:
         """Debugger probe hook.
 
         This gets called with a reference to the probe. We only check whether
         the probe is active. If so, we push the collected data to the collector
         for bulk processing. This way we avoid adding delay while the
         instrumented code is running.
+
+        When the probe is rate limited, the hook returns the number of seconds
+        the line monitor can skip it for.
         """
         try:
             actual_frame = sys._getframe(1)
@@ -419,7 +428,7 @@ class Debugger(Service):
                 if probe.take_snapshot:
                     # TODO: Global limit evaluated before probe conditions
                     if self._global_rate_limiter.limit() is RateLimitExceeded:
-                        return
+                        return self._global_rate_limiter.cooldown()
 
                 signal = Snapshot(
                     probe=probe,
@@ -435,7 +444,7 @@ class Debugger(Service):
                 )
             else:
                 log.error("Unsupported probe type: %r", type(probe))
-                return
+                return None
 
             signal.line()
 
@@ -445,9 +454,15 @@ class Debugger(Service):
             if signal.state is SignalState.DONE:
                 self._probe_registry.set_emitting(probe)
 
+            if isinstance(probe, LogLineProbe) and probe.take_snapshot:
+                # Only the snapshot probes are rate limited on lines
+                return probe.limiter.cooldown()
+
         except Exception:
             log.error("Failed to execute probe hook", exc_info=True)
 
+        return None
+
     def _probe_injection_hook(self, module: ModuleType) -> None:
         # This hook is invoked by the ModuleWatchdog or the post run module hook
         # to inject probes.
@@ -697,6 +712,8 @@ class Debugger(Service):
                         log.error("Modified probe %r was not found in registry.", probe)
                         continue
                     self._probe_registry.update(probe)
+                    if isinstance(registered_probe, LineLocationMixin):
+                        self._function_store.update_hooks(registered_probe)
 
             return
 
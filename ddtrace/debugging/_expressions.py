@@ -376,6 +376,8 @@ class DDExpression(object):
 
     dsl = attr.ib(type=str)
     callable = attr.ib(type=Callable[[Dict[str, Any]], Any])
+    # The AST the callable was compiled from, if it compiled
+    ast = attr.ib(type=Optional[DDASTType], default=None, eq=False)
 
     def eval(self, _locals):
         try:
@@ -399,6 +401,6 @@ class DDExpression(object):
         try:
             compiled = cls.__compiler__(ast)
         except Exception as e:
-            compiled = cls.on_compiler_error(dsl, e)
+            return cls(dsl=dsl, callable=cls.on_compiler_error(dsl, e))
 
-        return cls(dsl=dsl, callable=compiled)
+        return cls(dsl=dsl, callable=compiled, ast=ast)
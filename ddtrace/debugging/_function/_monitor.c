@@ -0,0 +1,805 @@
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Native sys.monitoring (PEP 669) LINE callback of the line probes.
+
+   The callback finds the probes of a line in a dictionary of the lines of the monitored code objects, and only calls
+   their hooks from the line when their native pre-checks pass: the probes the hook asked to hold off with a cooldown
+   are skipped until it is over, and the simple conditions compiled from the expression AST, which compare locals of
+   builtin scalar types with literals, skip the hook when they are definitely false. Anything the native evaluation
+   cannot decide without side effects, like the locals of other types or the other operations of the expression
+   language, is left to the hook, which still evaluates the whole condition in Python.
+
+   When all the probes of a line hold off, the callback returns DISABLE, so that the line costs nothing until the
+   monitoring events are restarted once the earliest cooldown is over. */
+
+#define SUPPORTED_VERSION (PY_VERSION_HEX >= 0x030c0000)
+
+#if SUPPORTED_VERSION
+
+static PyObject* DISABLE = NULL;
+
+static inline int64_t
+monotonic_ns(void)
+{
+#if PY_VERSION_HEX >= 0x030d0000
+    PyTime_t t;
+    if (PyTime_MonotonicRaw(&t) < 0)
+        return 0;
+    return (int64_t)t;
+#else
+    return (int64_t)_PyTime_GetMonotonicClock();
+#endif
+}
+
+/* Simple conditions */
+
+typedef enum
+{
+    COND_OPAQUE,
+    COND_LITERAL,
+    COND_REF,
+    COND_DEFINED,
+    COND_NOT,
+    COND_AND,
+    COND_OR,
+    COND_COMPARE,
+} CondKind;
+
+typedef enum
+{
+    COND_FALSE,
+    COND_TRUE,
+    COND_UNKNOWN,
+} CondResult;
+
+typedef struct Cond
+{
+    CondKind kind;
+    int op;
+    /* The literal, or the name of the local */
+    PyObject* value;
+    struct Cond* a;
+    struct Cond* b;
+} Cond;
+
+static void
+cond_free(Cond* cond)
+{
+    if (cond == NULL)
+        return;
+    Py_XDECREF(cond->value);
+    cond_free(cond->a);
+    cond_free(cond->b);
+    PyMem_Free(cond);
+}
+
+static Cond*
+cond_new(CondKind kind)
+{
+    Cond* cond = PyMem_Calloc(1, sizeof(Cond));
+    if (cond == NULL) {
+        PyErr_NoMemory();
+        return NULL;
+    }
+    cond->kind = kind;
+    return cond;
+}
+
+/* The values whose comparisons and truth run no Python code */
+static inline int
+is_scalar(PyObject* value)
+{
+    return value == Py_None || PyBool_Check(value) || PyLong_CheckExact(value) || PyFloat_CheckExact(value) ||
+           PyUnicode_CheckExact(value);
+}
+
+static Cond* cond_compile(PyObject* ast);
+
+static int
+compile_args(PyObject* args, Cond** a, Cond** b)
+{
+    if (!(PyList_Check(args) || PyTuple_Check(args)) || PySequence_Fast_GET_SIZE(args) != 2)
+        return 0;
+    if ((*a = cond_compile(PySequence_Fast_GET_ITEM(args, 0))) == NULL)
+        return -1;
+    if ((*b = cond_compile(PySequence_Fast_GET_ITEM(args, 1))) == NULL)
+        return -1;
+    return 1;
+}
+
+static int
+compare_op(PyObject* key)
+{
+    static const struct
+    {
+        const char* name;
+        int op;
+    } ops[] = { { "eq", Py_EQ }, { "ne", Py_NE }, { "gt", Py_GT }, { "ge", Py_GE }, { "lt", Py_LT }, { "le", Py_LE } };
+    size_t i;
+
+    for (i = 0; i < sizeof(ops) / sizeof(ops[0]); i++)
+        if (PyUnicode_CompareWithASCIIString(key, ops[i].name) == 0)
+            return ops[i].op;
+    return -1;
+}
+
+static inline int
+is_value(Cond* cond)
+{
+    return cond->kind == COND_LITERAL || cond->kind == COND_REF;
+}
+
+/* Compile the predicate AST, the parts which are not simple conditions become opaque */
+static Cond*
+cond_compile(PyObject* ast)
+{
+    PyObject* key;
+    PyObject* arg;
+    Py_ssize_t pos = 0;
+    Cond* cond;
+    int op;
+    int compiled;
+
+    if (is_scalar(ast)) {
+        if ((cond = cond_new(COND_LITERAL)) != NULL)
+            cond->value = Py_NewRef(ast);
+        return cond;
+    }
+
+    /* The expressions have the operation as their first key */
+    if (!PyDict_Check(ast) || !PyDict_Next(ast, &pos, &key, &arg) || !PyUnicode_Check(key))
+        return cond_new(COND_OPAQUE);
+
+    if (PyUnicode_CompareWithASCIIString(key, "ref") == 0) {
+        if (!PyUnicode_CheckExact(arg) || PyUnicode_CompareWithASCIIString(arg, "@it") == 0)
+            return cond_new(COND_OPAQUE);
+        if ((cond = cond_new(COND_REF)) != NULL)
+            cond->value = Py_NewRef(arg);
+        return cond;
+    }
+
+    if (PyUnicode_CompareWithASCIIString(key, "isDefined") == 0) {
+        if (!PyUnicode_CheckExact(arg))
+            return cond_new(COND_OPAQUE);
+        if ((cond = cond_new(COND_DEFINED)) != NULL)
+            cond->value = Py_NewRef(arg);
+        return cond;
+    }
+
+    if (PyUnicode_CompareWithASCIIString(key, "not") == 0) {
+        if ((cond = cond_new(COND_NOT)) == NULL)
+            return NULL;
+        if ((cond->a = cond_compile(arg)) == NULL) {
+            cond_free(cond);
+            return NULL;
+        }
+        return cond;
+    }
+
+    if (PyUnicode_CompareWithASCIIString(key, "and") == 0 || PyUnicode_CompareWithASCIIString(key, "or") == 0) {
+        if ((cond = cond_new(PyUnicode_CompareWithASCIIString(key, "and") == 0 ? COND_AND : COND_OR)) == NULL)
+            return NULL;
+    } else if ((op = compare_op(key)) >= 0) {
+        if ((cond = cond_new(COND_COMPARE)) == NULL)
+            return NULL;
+        cond->op = op;
+    } else {
+        return cond_new(COND_OPAQUE);
+    }
+
+    compiled = compile_args(arg, &cond->a, &cond->b);
+    if (compiled < 0) {
+        cond_free(cond);
+        return NULL;
+    }
+    /* Only literals and locals are compared natively */
+    if (compiled == 0 || (cond->kind == COND_COMPARE && !(is_value(cond->a) && is_value(cond->b)))) {
+        cond_free(cond);
+        return cond_new(COND_OPAQUE);
+    }
+    return cond;
+}
+
+/* The value of a literal or of a scalar local, NULL if it is unknown */
+static PyObject*
+cond_value(Cond* cond, PyFrameObject* frame)
+{
+    PyObject* value;
+
+    if (cond->kind == COND_LITERAL)
+        return Py_NewRef(cond->value);
+
+    if (frame == NULL)
+        return NULL;
+    value = PyFrame_GetVar(frame, cond->value);
+    if (value == NULL) {
+        PyErr_Clear();
+        return NULL;
+    }
+    if (!is_scalar(value)) {
+        Py_DECREF(value);
+        return NULL;
+    }
+    return value;
+}
+
+static CondResult
+cond_truth(PyObject* value)
+{
+    int truth = PyObject_IsTrue(value);
+
+    Py_DECREF(value);
+    if (truth < 0) {
+        PyErr_Clear();
+        return COND_UNKNOWN;
+    }
+    return truth ? COND_TRUE : COND_FALSE;
+}
+
+/* Evaluate the condition in the order of the compiled expression, so that it is unknown as soon as the expression
+   would evaluate something that is not a simple condition */
+static CondResult
+cond_eval(Cond* cond, PyFrameObject* frame)
+{
+    PyObject* a;
+    PyObject* b;
+    PyObject* result;
+    CondResult r;
+
+    switch (cond->kind) {
+        case COND_LITERAL:
+        case COND_REF:
+            a = cond_value(cond, frame);
+            return a == NULL ? COND_UNKNOWN : cond_truth(a);
+
+        case COND_DEFINED:
+            if (frame == NULL)
+                return COND_UNKNOWN;
+            a = PyFrame_GetVar(frame, cond->value);
+            if (a != NULL) {
+                Py_DECREF(a);
+                return COND_TRUE;
+            }
+            r = PyErr_ExceptionMatches(PyExc_NameError) ? COND_FALSE : COND_UNKNOWN;
+            PyErr_Clear();
+            return r;
+
+        case COND_NOT:
+            r = cond_eval(cond->a, frame);
+            return r == COND_UNKNOWN ? r : (r == COND_TRUE ? COND_FALSE : COND_TRUE);
+
+        case COND_AND:
+            r = cond_eval(cond->a, frame);
+            return r == COND_TRUE ? cond_eval(cond->b, frame) : r;
+
+        case COND_OR:
+            r = cond_eval(cond->a, frame);
+            return r == COND_FALSE ? cond_eval(cond->b, frame) : r;
+
+        case COND_COMPARE:
+            if ((a = cond_value(cond->a, frame)) == NULL)
+                return COND_UNKNOWN;
+            if ((b = cond_value(cond->b, frame)) == NULL) {
+                Py_DECREF(a);
+                return COND_UNKNOWN;
+            }
+            result = PyObject_RichCompare(a, b, cond->op);
+            Py_DECREF(a);
+            Py_DECREF(b);
+            if (result == NULL) {
+                PyErr_Clear();
+                return COND_UNKNOWN;
+            }
+            return cond_truth(result);
+
+        default:
+            return COND_UNKNOWN;
+    }
+}
+
+/* Probes */
+
+typedef struct
+{
+    PyObject_HEAD
+
+    PyObject* hook;
+    PyObject* arg;
+    Cond* condition;
+    /* Time before which the hook asked not to be called */
+    int64_t hold_until;
+} Probe;
+
+static int
+Probe_traverse(Probe* self, visitproc visit, void* arg)
+{
+    Py_VISIT(self->hook);
+    Py_VISIT(self->arg);
+    return 0;
+}
+
+static int
+Probe_clear(Probe* self)
+{
+    Py_CLEAR(self->hook);
+    Py_CLEAR(self->arg);
+    return 0;
+}
+
+static void
+Probe_dealloc(Probe* self)
+{
+    PyObject_GC_UnTrack(self);
+    Probe_clear(self);
+    cond_free(self->condition);
+    Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+static PyTypeObject ProbeType = {
+    PyVarObject_HEAD_INIT(NULL, 0).tp_name = "ddtrace.debugging._function._monitor.Probe",
+    .tp_doc = "A hook called from a monitored line",
+    .tp_basicsize = sizeof(Probe),
+    .tp_itemsize = 0,
+    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_GC,
+    .tp_dealloc = (destructor)Probe_dealloc,
+    .tp_traverse = (traverseproc)Probe_traverse,
+    .tp_clear = (inquiry)Probe_clear,
+};
+
+/* Hold the probe off for the cooldown returned by its hook, if any */
+static void
+probe_hold(Probe* probe, PyObject* cooldown)
+{
+    double seconds;
+    int64_t now;
+
+    if (cooldown == Py_None || !(PyFloat_Check(cooldown) || PyLong_Check(cooldown)))
+        return;
+    seconds = PyFloat_AsDouble(cooldown);
+    if (seconds == -1.0 && PyErr_Occurred()) {
+        PyErr_Clear();
+        return;
+    }
+    if (!(seconds > 0))
+        return;
+
+    now = monotonic_ns();
+    probe->hold_until = seconds * 1e9 < (double)(INT64_MAX - now) ? now + (int64_t)(seconds * 1e9) : INT64_MAX;
+}
+
+/* The line monitor */
+
+typedef struct
+{
+    PyObject_HEAD
+
+    /* The tuples of the probes of the lines of the code objects */
+    PyObject* codes;
+    /* Earliest end of a cooldown of the disabled lines, 0 if there is none */
+    int64_t rearm_at;
+    vectorcallfunc vectorcall;
+} LineMonitor;
+
+static PyObject*
+LineMonitor_vectorcall(LineMonitor* self, PyObject* const* args, size_t nargsf, PyObject* kwnames)
+{
+    PyObject* lines;
+    PyObject* probes;
+    PyCodeObject* code;
+    PyFrameObject* frame = NULL;
+    int frame_loaded = 0;
+    int64_t now;
+    int64_t rearm_at = INT64_MAX;
+    Py_ssize_t i;
+
+    if (PyVectorcall_NARGS(nargsf) != 2 || kwnames != NULL) {
+        PyErr_SetString(PyExc_TypeError, "the line monitor takes the code and the line");
+        return NULL;
+    }
+
+    lines = PyDict_GetItemWithError(self->codes, args[0]);
+    if (lines == NULL)
+        return PyErr_Occurred() ? NULL : Py_NewRef(DISABLE);
+    probes = PyDict_GetItemWithError(lines, args[1]);
+    if (probes == NULL)
+        return PyErr_Occurred() ? NULL : Py_NewRef(DISABLE);
+
+    /* The probes of the line can change while the hooks run */
+    Py_INCREF(probes);
+    code = (PyCodeObject*)args[0];
+    now = monotonic_ns();
+
+    for (i = 0; i < PyTuple_GET_SIZE(probes); i++) {
+        Probe* probe = (Probe*)PyTuple_GET_ITEM(probes, i);
+        PyObject* result;
+
+        if (probe->hold_until > now)
+            continue;
+
+        if (probe->condition != NULL) {
+            /* The locals of the frames which are not of functions are not the fast ones */
+            if (!frame_loaded) {
+                frame = (code->co_flags & CO_OPTIMIZED) ? PyEval_GetFrame() : NULL;
+                frame_loaded = 1;
+            }
+            if (cond_eval(probe->condition, frame) == COND_FALSE)
+                continue;
+        }
+
+        result = PyObject_CallOneArg(probe->hook, probe->arg);
+        if (result == NULL) {
+            /* The hooks report their own errors, which must not reach the monitored code */
+            PyErr_Clear();
+            continue;
+        }
+        probe_hold(probe, result);
+        Py_DECREF(result);
+    }
+
+    for (i = 0; i < PyTuple_GET_SIZE(probes); i++) {
+        Probe* probe = (Probe*)PyTuple_GET_ITEM(probes, i);
+
+        if (probe->hold_until <= now) {
+            Py_DECREF(probes);
+            Py_RETURN_NONE;
+        }
+        if (probe->hold_until < rearm_at)
+            rearm_at = probe->hold_until;
+    }
+    Py_DECREF(probes);
+
+    if (self->rearm_at == 0 || rearm_at < self->rearm_at)
+        self->rearm_at = rearm_at;
+    return Py_NewRef(DISABLE);
+}
+
+static int
+LineMonitor_init(LineMonitor* self, PyObject* args, PyObject* kwargs)
+{
+    static char* kwlist[] = { NULL };
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, ":LineMonitor", kwlist))
+        return -1;
+
+    Py_XSETREF(self->codes, PyDict_New());
+    if (self->codes == NULL)
+        return -1;
+    self->rearm_at = 0;
+    self->vectorcall = (vectorcallfunc)LineMonitor_vectorcall;
+    return 0;
+}
+
+static int
+LineMonitor_traverse(LineMonitor* self, visitproc visit, void* arg)
+{
+    Py_VISIT(self->codes);
+    return 0;
+}
+
+static int
+LineMonitor_clear(LineMonitor* self)
+{
+    Py_CLEAR(self->codes);
+    return 0;
+}
+
+static void
+LineMonitor_dealloc(LineMonitor* self)
+{
+    PyObject_GC_UnTrack(self);
+    LineMonitor_clear(self);
+    Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+static int
+check_initialized(LineMonitor* self)
+{
+    if (self->codes == NULL) {
+        PyErr_SetString(PyExc_RuntimeError, "the line monitor is not initialized");
+        return -1;
+    }
+    return 0;
+}
+
+static PyObject*
+LineMonitor_add(LineMonitor* self, PyObject* args)
+{
+    PyObject* code;
+    PyObject* line;
+    PyObject* hook;
+    PyObject* arg;
+    PyObject* condition = Py_None;
+    PyObject* lines;
+    PyObject* probes;
+    PyObject* new_probes;
+    Probe* probe;
+    Py_ssize_t n = 0;
+    Py_ssize_t i;
+    int result;
+
+    if (!PyArg_ParseTuple(args, "O!O!OO|O:add", &PyCode_Type, &code, &PyLong_Type, &line, &hook, &arg, &condition))
+        return NULL;
+    if (check_initialized(self) < 0)
+        return NULL;
+
+    probe = PyObject_GC_New(Probe, &ProbeType);
+    if (probe == NULL)
+        return NULL;
+    probe->hook = Py_NewRef(hook);
+    probe->arg = Py_NewRef(arg);
+    probe->condition = NULL;
+    probe->hold_until = 0;
+    PyObject_GC_Track(probe);
+
+    if (condition != Py_None && (probe->condition = cond_compile(condition)) == NULL) {
+        Py_DECREF(probe);
+        return NULL;
+    }
+
+    lines = PyDict_GetItemWithError(self->codes, code);
+    if (lines == NULL) {
+        if (PyErr_Occurred() || (lines = PyDict_New()) == NULL) {
+            Py_DECREF(probe);
+            return NULL;
+        }
+        result = PyDict_SetItem(self->codes, code, lines);
+        Py_DECREF(lines);
+        if (result < 0) {
+            Py_DECREF(probe);
+            return NULL;
+        }
+    }
+
+    probes = PyDict_GetItemWithError(lines, line);
+    if (probes == NULL && PyErr_Occurred()) {
+        Py_DECREF(probe);
+        return NULL;
+    }
+    if (probes != NULL)
+        n = PyTuple_GET_SIZE(probes);
+
+    /* The probes are replaced rather than changed in place, for the callbacks iterating over them */
+    new_probes = PyTuple_New(n + 1);
+    if (new_probes == NULL) {
+        Py_DECREF(probe);
+        return NULL;
+    }
+    for (i = 0; i < n; i++)
+        PyTuple_SET_ITEM(new_probes, i, Py_NewRef(PyTuple_GET_ITEM(probes, i)));
+    PyTuple_SET_ITEM(new_probes, n, (PyObject*)probe);
+
+    result = PyDict_SetItem(lines, line, new_probes);
+    Py_DECREF(new_probes);
+    if (result < 0)
+        return NULL;
+    Py_RETURN_NONE;
+}
+
+static PyObject*
+LineMonitor_remove(LineMonitor* self, PyObject* args)
+{
+    PyObject* code;
+    PyObject* line;
+    PyObject* hook;
+    PyObject* arg;
+    PyObject* lines;
+    PyObject* probes;
+    PyObject* new_probes;
+    Py_ssize_t found = -1;
+    Py_ssize_t n;
+    Py_ssize_t i;
+    int result;
+
+    if (!PyArg_ParseTuple(args, "O!O!OO:remove", &PyCode_Type, &code, &PyLong_Type, &line, &hook, &arg))
+        return NULL;
+    if (check_initialized(self) < 0)
+        return NULL;
+
+    lines = PyDict_GetItemWithError(self->codes, code);
+    if (lines == NULL)
+        return PyErr_Occurred() ? NULL : Py_NewRef(Py_False);
+    probes = PyDict_GetItemWithError(lines, line);
+    if (probes == NULL)
+        return PyErr_Occurred() ? NULL : Py_NewRef(Py_False);
+
+    /* The hooks are matched like the injected ones, by equality, and their argument by identity */
+    n = PyTuple_GET_SIZE(probes);
+    for (i = 0; i < n && found < 0; i++) {
+        Probe* probe = (Probe*)PyTuple_GET_ITEM(probes, i);
+
+        if (probe->arg != arg)
+            continue;
+        result = PyObject_RichCompareBool(probe->hook, hook, Py_EQ);
+        if (result < 0)
+            return NULL;
+        if (result)
+            found = i;
+    }
+    if (found < 0)
+        Py_RETURN_FALSE;
+
+    Py_INCREF(lines);
+    if (n == 1) {
+        result = PyDict_DelItem(lines, line);
+        if (result == 0 && PyDict_GET_SIZE(lines) == 0)
+            result = PyDict_DelItem(self->codes, code);
+    } else {
+        new_probes = PyTuple_New(n - 1);
+        if (new_probes == NULL) {
+            Py_DECREF(lines);
+            return NULL;
+        }
+        for (i = 0; i < n - 1; i++)
+            PyTuple_SET_ITEM(new_probes, i, Py_NewRef(PyTuple_GET_ITEM(probes, i < found ? i : i + 1)));
+        result = PyDict_SetItem(lines, line, new_probes);
+        Py_DECREF(new_probes);
+    }
+    Py_DECREF(lines);
+    if (result < 0)
+        return NULL;
+    Py_RETURN_TRUE;
+}
+
+static PyObject*
+LineMonitor_update(LineMonitor* self, PyObject* args)
+{
+    PyObject* arg;
+    PyObject* condition = Py_None;
+    PyObject* lines;
+    PyObject* probes;
+    Py_ssize_t code_pos = 0;
+    Py_ssize_t i;
+
+    if (!PyArg_ParseTuple(args, "O|O:update", &arg, &condition))
+        return NULL;
+    if (check_initialized(self) < 0)
+        return NULL;
+
+    while (PyDict_Next(self->codes, &code_pos, NULL, &lines)) {
+        Py_ssize_t line_pos = 0;
+
+        while (PyDict_Next(lines, &line_pos, NULL, &probes)) {
+            for (i = 0; i < PyTuple_GET_SIZE(probes); i++) {
+                Probe* probe = (Probe*)PyTuple_GET_ITEM(probes, i);
+                Cond* compiled = NULL;
+
+                if (probe->arg != arg)
+                    continue;
+                if (condition != Py_None && (compiled = cond_compile(condition)) == NULL)
+                    return NULL;
+                cond_free(probe->condition);
+                probe->condition = compiled;
+                probe->hold_until = 0;
+            }
+        }
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject*
+LineMonitor_lines(LineMonitor* self, PyObject* code)
+{
+    PyObject* lines;
+
+    if (check_initialized(self) < 0)
+        return NULL;
+
+    lines = PyDict_GetItemWithError(self->codes, code);
+    if (lines == NULL)
+        return PyErr_Occurred() ? NULL : PyFrozenSet_New(NULL);
+    return PyFrozenSet_New(lines);
+}
+
+static PyObject*
+LineMonitor_codes(LineMonitor* self, PyObject* Py_UNUSED(args))
+{
+    if (check_initialized(self) < 0)
+        return NULL;
+    return PyDict_Keys(self->codes);
+}
+
+static PyObject*
+LineMonitor_clear_probes(LineMonitor* self, PyObject* Py_UNUSED(args))
+{
+    if (check_initialized(self) < 0)
+        return NULL;
+    PyDict_Clear(self->codes);
+    self->rearm_at = 0;
+    Py_RETURN_NONE;
+}
+
+static PyObject*
+LineMonitor_rearm(LineMonitor* self, PyObject* Py_UNUSED(args))
+{
+    if (self->rearm_at == 0 || monotonic_ns() < self->rearm_at)
+        Py_RETURN_FALSE;
+    /* The lines still holding off are disabled again, and set the next time */
+    self->rearm_at = 0;
+    Py_RETURN_TRUE;
+}
+
+static PyMethodDef LineMonitor_methods[] = {
+    { "add",
+      (PyCFunction)LineMonitor_add,
+      METH_VARARGS,
+      "Call the hook with the argument from the line of the code, when the condition AST does not rule it out" },
+    { "remove",
+      (PyCFunction)LineMonitor_remove,
+      METH_VARARGS,
+      "Stop calling the hook with the argument from the line of the code, return whether it was called" },
+    { "update",
+      (PyCFunction)LineMonitor_update,
+      METH_VARARGS,
+      "Replace the condition AST of the hooks called with the argument, and stop them holding off" },
+    { "lines", (PyCFunction)LineMonitor_lines, METH_O, "Return the lines of the code with hooks" },
+    { "codes", (PyCFunction)LineMonitor_codes, METH_NOARGS, "Return the code objects with hooks" },
+    { "clear", (PyCFunction)LineMonitor_clear_probes, METH_NOARGS, "Remove all the hooks" },
+    { "rearm",
+      (PyCFunction)LineMonitor_rearm,
+      METH_NOARGS,
+      "Return whether the monitoring events should be restarted for lines whose hooks are ready again" },
+    { NULL, NULL, 0, NULL }
+};
+
+static PyTypeObject LineMonitorType = {
+    PyVarObject_HEAD_INIT(NULL, 0).tp_name = "ddtrace.debugging._function._monitor.LineMonitor",
+    .tp_doc = "The sys.monitoring LINE callback of the line probes",
+    .tp_basicsize = sizeof(LineMonitor),
+    .tp_itemsize = 0,
+    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_GC | Py_TPFLAGS_HAVE_VECTORCALL,
+    .tp_new = PyType_GenericNew,
+    .tp_init = (initproc)LineMonitor_init,
+    .tp_call = PyVectorcall_Call,
+    .tp_vectorcall_offset = offsetof(LineMonitor, vectorcall),
+    .tp_dealloc = (destructor)LineMonitor_dealloc,
+    .tp_traverse = (traverseproc)LineMonitor_traverse,
+    .tp_clear = (inquiry)LineMonitor_clear,
+    .tp_methods = LineMonitor_methods,
+};
+
+static struct PyModuleDef monitor_module = {
+    PyModuleDef_HEAD_INIT, "ddtrace.debugging._function._monitor", "native sys.monitoring callback of line probes", -1,
+    NULL
+};
+#endif
+
+PyMODINIT_FUNC
+PyInit__monitor(void)
+{
+#if SUPPORTED_VERSION
+    PyObject* m;
+
+    if (PyType_Ready(&ProbeType) < 0 || PyType_Ready(&LineMonitorType) < 0)
+        return NULL;
+
+    if (DISABLE == NULL) {
+        PyObject* monitoring = PySys_GetObject("monitoring");
+        if (monitoring == NULL) {
+            PyErr_SetString(PyExc_ImportError, "sys.monitoring is not available");
+            return NULL;
+        }
+        if ((DISABLE = PyObject_GetAttrString(monitoring, "DISABLE")) == NULL)
+            return NULL;
+    }
+
+    m = PyModule_Create(&monitor_module);
+    if (m == NULL)
+        return NULL;
+
+    Py_INCREF(&LineMonitorType);
+    if (PyModule_AddObject(m, "LineMonitor", (PyObject*)&LineMonitorType) < 0) {
+        Py_DECREF(&LineMonitorType);
+        Py_DECREF(m);
+        return NULL;
+    }
+
+    return m;
+#else
+    PyErr_SetString(PyExc_ImportError, "the native line monitor needs sys.monitoring (Python 3.12+)");
+    return NULL;
+#endif
+}
@@ -0,0 +1,18 @@
+from types import CodeType
+from typing import Any
+from typing import Callable
+from typing import FrozenSet
+from typing import List
+from typing import Optional
+
+class LineMonitor:
+    def __call__(self, code: CodeType, line: int) -> Any: ...
+    def add(
+        self, code: CodeType, line: int, hook: Callable[[Any], Optional[float]], arg: Any, condition: Any = None
+    ) -> None: ...
+    def remove(self, code: CodeType, line: int, hook: Callable[[Any], Optional[float]], arg: Any) -> bool: ...
+    def update(self, arg: Any, condition: Any = None) -> None: ...
+    def lines(self, code: CodeType) -> FrozenSet[int]: ...
+    def codes(self) -> List[CodeType]: ...
+    def clear(self) -> None: ...
+    def rearm(self) -> bool: ...
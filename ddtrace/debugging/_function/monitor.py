@@ -0,0 +1,121 @@
+from dis import findlinestarts
+import sys
+from types import CodeType
+from typing import Any
+from typing import List
+from typing import Optional
+
+from ddtrace.internal.injection import HookInfoType
+from ddtrace.internal.logger import get_logger
+from ddtrace.internal.periodic import PeriodicService
+
+
+try:
+    from ddtrace.debugging._function import _monitor
+except ImportError:
+    _monitor = None  # type: ignore[assignment]
+
+
+log = get_logger(__name__)
+
+
+class LineMonitor(PeriodicService):
+    """sys.monitoring backend of the line hooks (Python 3.12+).
+
+    Instead of being injected into the bytecode, the hooks are called by the
+    native LINE callback of the debugger tool, which only calls them when the
+    simple conditions of their probes do not rule the call out, and while they
+    are not holding off. A hook can return the number of seconds to hold off
+    for, after which the periodic service restarts the monitoring events of the
+    lines which got disabled in the meantime.
+    """
+
+    REARM_INTERVAL = 0.1
+
+    def __init__(self, tool_id: int) -> None:
+        super().__init__(self.REARM_INTERVAL)
+
+        self._tool_id = tool_id
+        self._lines = _monitor.LineMonitor()
+
+        monitoring = sys.monitoring  # type: ignore[attr-defined]
+        monitoring.register_callback(tool_id, monitoring.events.LINE, self._lines)
+
+    @classmethod
+    def acquire(cls) -> Optional["LineMonitor"]:
+        """Return a line monitor if the debugger sys.monitoring tool is available."""
+        if _monitor is None:
+            return None
+
+        monitoring = sys.monitoring  # type: ignore[attr-defined]
+        try:
+            monitoring.use_tool_id(monitoring.DEBUGGER_ID, "datadog")
+        except ValueError:
+            log.debug("sys.monitoring debugger tool already in use, injecting the line probes instead")
+            return None
+
+        return cls(monitoring.DEBUGGER_ID)
+
+    def inject_hooks(self, code: CodeType, hooks: List[HookInfoType]) -> List[HookInfoType]:
+        """Call the hooks from the lines of the code.
+
+        Returns the list of hooks whose lines the code lacks.
+        """
+        lines = {line for _, line in findlinestarts(code)}
+        failed = []
+        for hook_info in hooks:
+            hook, line, arg = hook_info
+            if line not in lines:
+                failed.append(hook_info)
+                continue
+
+            # The simple conditions of the probes are pre-checked natively
+            condition = getattr(arg, "condition", None)
+            self._lines.add(code, line, hook, arg, getattr(condition, "ast", None))
+
+        if len(failed) < len(hooks):
+            monitoring = sys.monitoring  # type: ignore[attr-defined]
+            monitoring.set_local_events(self._tool_id, code, monitoring.events.LINE)
+            # The lines of the code that had no hooks so far might have been disabled
+            monitoring.restart_events()
+
+        return failed
+
+    def update_hooks(self, arg: Any) -> None:
+        """Take the changes of the condition of the probe the hooks are called with into account."""
+        condition = getattr(arg, "condition", None)
+        self._lines.update(arg, getattr(condition, "ast", None))
+        # The lines of the probe might have been disabled while it held off
+        sys.monitoring.restart_events()  # type: ignore[attr-defined]
+
+    def eject_hooks(self, code: CodeType, hooks: List[HookInfoType]) -> List[HookInfoType]:
+        """Stop calling the hooks from the lines of the code.
+
+        Returns the list of hooks that were not called from the code.
+        """
+        failed = [(hook, line, arg) for hook, line, arg in hooks if not self._lines.remove(code, line, hook, arg)]
+
+        if not self._lines.lines(code):
+            monitoring = sys.monitoring  # type: ignore[attr-defined]
+            monitoring.set_local_events(self._tool_id, code, monitoring.events.NO_EVENTS)
+
+        return failed
+
+    def restore_all(self) -> None:
+        """Stop calling all the hooks."""
+        monitoring = sys.monitoring  # type: ignore[attr-defined]
+        for code in self._lines.codes():
+            monitoring.set_local_events(self._tool_id, code, monitoring.events.NO_EVENTS)
+        self._lines.clear()
+
+    def periodic(self) -> None:
+        if self._lines.rearm():
+            sys.monitoring.restart_events()  # type: ignore[attr-defined]
+
+    def _stop_service(self, *args, **kwargs) -> None:
+        super()._stop_service(*args, **kwargs)
+
+        self.restore_all()
+        monitoring = sys.monitoring  # type: ignore[attr-defined]
+        monitoring.register_callback(self._tool_id, monitoring.events.LINE, None)
+        monitoring.free_tool_id(self._tool_id)
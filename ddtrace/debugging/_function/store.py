@@ -9,6 +9,7 @@ from typing import Set
 from typing import cast
 
 from ddtrace.debugging._function.discovery import FullyNamed
+from ddtrace.debugging._function.monitor import LineMonitor
 from ddtrace.internal.injection import HookInfoType
 from ddtrace.internal.injection import HookType
 from ddtrace.internal.injection import eject_hooks
@@ -35,11 +36,15 @@ class FunctionStore(object):
 
     If extra attributes are defined during the patching process, they will get
     removed when the functions are restored.
+
+    When a line monitor is given, the hooks are called by it instead of being
+    injected into the code of the functions.
     """
 
-    def __init__(self, extra_attrs: Optional[List[str]] = None) -> None:
+    def __init__(self, extra_attrs: Optional[List[str]] = None, monitor: Optional[LineMonitor] = None) -> None:
         self._code_map: Dict[FunctionType, CodeType] = {}
         self._wrapper_map: Dict[FunctionType, WrappingContext] = {}
+        self._monitor = monitor
         self._extra_attrs = ["__dd_context_wrapped__"]
         if extra_attrs:
             self._extra_attrs.extend(extra_attrs)
@@ -63,6 +68,8 @@ class FunctionStore(object):
             return self.inject_hooks(cast(FullyNamedWrappedFunction, function.__dd_wrapped__), hooks)
         except AttributeError:
             f = cast(FunctionType, function)
+            if self._monitor is not None:
+                return {p.probe_id for _, _, p in self._monitor.inject_hooks(f.__code__, hooks)}
             self._store(f)
             return {p.probe_id for _, _, p in inject_hooks(f, hooks)}
 
@@ -75,11 +82,22 @@ class FunctionStore(object):
             wrapped = cast(FullyNamedWrappedFunction, function).__dd_wrapped__
         except AttributeError:
             # Not a wrapped function so we can actually eject from it
+            if self._monitor is not None:
+                return {p.probe_id for _, _, p in self._monitor.eject_hooks(function.__code__, hooks)}
             return {p.probe_id for _, _, p in eject_hooks(function, hooks)}
         else:
             # Try on the wrapped function.
             return self.eject_hooks(cast(FunctionType, wrapped), hooks)
 
+    def update_hooks(self, arg: Any) -> None:
+        """Take the changes of the argument of the hooks into account.
+
+        The injected hooks look the argument up when they are called, but the
+        line monitor pre-checks the conditions of the probes natively.
+        """
+        if self._monitor is not None:
+            self._monitor.update_hooks(arg)
+
     def inject_hook(self, function: FullyNamedWrappedFunction, hook: HookType, line: int, arg: Any) -> bool:
         """Inject a hook into a function."""
         return not not self.inject_hooks(function, [(hook, line, arg)])
@@ -100,6 +118,8 @@ class FunctionStore(object):
 
     def restore_all(self) -> None:
         """Restore all the patched functions to their original form."""
+        if self._monitor is not None:
+            self._monitor.restore_all()
         for function, code in self._code_map.items():
             function.__code__ = code
             for attr in self._extra_attrs:
@@ -0,0 +1,1108 @@
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <stdint.h>
+#include <string.h>
+
+/* Native capture of the values of the snapshots.
+
+   The values are walked within the depth, size and field limits of the probes, with the same redaction of the
+   identifiers and of the types, into the same captured dictionaries as capture_value in utils.py, which remains the
+   reference of the format. The time budget of the capture is a deadline on the monotonic clock rather than a stopping
+   condition to call for every value.
+
+   The redacted identifiers are looked up in a perfect hash table built when the capturer is created, after the ASCII
+   normalization of the identifiers, so that checking a name takes no allocation. The identifiers of the other kinds
+   are checked by the redact function of _redaction.py. */
+
+#if PY_VERSION_HEX < 0x030a0000
+static inline PyObject*
+Py_NewRef(PyObject* o)
+{
+    Py_INCREF(o);
+    return o;
+}
+#endif
+
+static inline int64_t
+monotonic_ns(void)
+{
+#if PY_VERSION_HEX >= 0x030d0000
+    PyTime_t t;
+    if (PyTime_Monotonic(&t) < 0) {
+        PyErr_Clear();
+        return 0;
+    }
+    return (int64_t)t;
+#else
+    return (int64_t)_PyTime_GetMonotonicClock();
+#endif
+}
+
+/* serialize truncates the representation of the simple values, as the Python serializer does with its defaults */
+#define SERIALIZE_MAXLEN 255
+
+/* Bound of the types whose qualified names are cached */
+#define QUALNAME_CACHE_SIZE 1024
+
+/* Perfect hash table of the redacted identifiers, with the hash-and-displace construction: the identifiers are
+   split into buckets by a first hash, and each bucket gets the seed of a second hash which sends all its identifiers
+   to free slots. */
+
+#define KEYS_PER_BUCKET 4
+#define MAX_DISPLACEMENT (1 << 20)
+
+typedef struct
+{
+    char* data;
+    Py_ssize_t size;
+} Key;
+
+typedef struct
+{
+    Key* keys;
+    Py_ssize_t n_keys;
+    Py_ssize_t max_key_size;
+    /* Index of the key in each slot, -1 for the free ones */
+    int32_t* slots;
+    Py_ssize_t n_slots;
+    uint32_t* displacements;
+    Py_ssize_t n_buckets;
+} PerfectHash;
+
+static inline uint64_t
+fnv1a_64(const char* data, Py_ssize_t size, uint64_t seed)
+{
+    uint64_t h = 0xcbf29ce484222325ULL ^ (seed * 0x9e3779b97f4a7c15ULL);
+    Py_ssize_t i;
+
+    for (i = 0; i < size; i++) {
+        h ^= (unsigned char)data[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+static void
+perfect_hash_free(PerfectHash* ph)
+{
+    Py_ssize_t i;
+
+    for (i = 0; i < ph->n_keys; i++)
+        PyMem_Free(ph->keys[i].data);
+    PyMem_Free(ph->keys);
+    PyMem_Free(ph->slots);
+    PyMem_Free(ph->displacements);
+    memset(ph, 0, sizeof(*ph));
+}
+
+typedef struct
+{
+    Py_ssize_t bucket;
+    Py_ssize_t size;
+} BucketSize;
+
+static int
+compare_bucket_sizes(const void* a, const void* b)
+{
+    return (int)(((const BucketSize*)b)->size - ((const BucketSize*)a)->size);
+}
+
+static int
+perfect_hash_place(PerfectHash* ph, Py_ssize_t* bucket_keys, Py_ssize_t n, Py_ssize_t* placed)
+{
+    uint32_t d;
+    Py_ssize_t i;
+    Py_ssize_t j;
+
+    /* Fill the bucket with the first displacement which finds free slots for all its keys */
+    for (d = 1; d < MAX_DISPLACEMENT; d++) {
+        for (i = 0; i < n; i++) {
+            Key* key = &ph->keys[bucket_keys[i]];
+            placed[i] = (Py_ssize_t)(fnv1a_64(key->data, key->size, d) % (uint64_t)ph->n_slots);
+            if (ph->slots[placed[i]] >= 0)
+                break;
+            for (j = 0; j < i; j++)
+                if (placed[j] == placed[i])
+                    break;
+            if (j < i)
+                break;
+        }
+        if (i == n) {
+            for (i = 0; i < n; i++)
+                ph->slots[placed[i]] = (int32_t)bucket_keys[i];
+            return (int)d;
+        }
+    }
+    return -1;
+}
+
+static int
+perfect_hash_build(PerfectHash* ph, PyObject* identifiers)
+{
+    PyObject* iterator;
+    PyObject* ident;
+    Py_ssize_t* key_buckets = NULL;
+    Py_ssize_t* bucket_keys = NULL;
+    Py_ssize_t placed[64];
+    BucketSize* sizes = NULL;
+    Py_ssize_t n;
+    Py_ssize_t i;
+    Py_ssize_t b;
+    int result = -1;
+
+    memset(ph, 0, sizeof(*ph));
+
+    n = PyObject_Size(identifiers);
+    if (n < 0)
+        return -1;
+    ph->keys = PyMem_Calloc(n ? n : 1, sizeof(Key));
+    if (ph->keys == NULL) {
+        PyErr_NoMemory();
+        return -1;
+    }
+
+    /* The identifiers which are not ASCII can't be equal to the normalization of an ASCII identifier */
+    iterator = PyObject_GetIter(identifiers);
+    if (iterator == NULL)
+        goto done;
+    while ((ident = PyIter_Next(iterator)) != NULL) {
+        if (PyUnicode_Check(ident) && PyUnicode_IS_ASCII(ident) && ph->n_keys < n) {
+            Key* key = &ph->keys[ph->n_keys];
+            key->size = PyUnicode_GET_LENGTH(ident);
+            key->data = PyMem_Malloc(key->size ? key->size : 1);
+            if (key->data == NULL) {
+                Py_DECREF(ident);
+                Py_DECREF(iterator);
+                PyErr_NoMemory();
+                goto done;
+            }
+            memcpy(key->data, PyUnicode_DATA(ident), key->size);
+            if (key->size > ph->max_key_size)
+                ph->max_key_size = key->size;
+            ph->n_keys++;
+        }
+        Py_DECREF(ident);
+    }
+    Py_DECREF(iterator);
+    if (PyErr_Occurred())
+        goto done;
+    if (ph->n_keys == 0) {
+        result = 0;
+        goto done;
+    }
+
+    ph->n_buckets = (ph->n_keys + KEYS_PER_BUCKET - 1) / KEYS_PER_BUCKET;
+    ph->n_slots = 2 * ph->n_keys;
+    ph->slots = PyMem_Malloc(ph->n_slots * sizeof(int32_t));
+    ph->displacements = PyMem_Calloc(ph->n_buckets, sizeof(uint32_t));
+    key_buckets = PyMem_Malloc(ph->n_keys * sizeof(Py_ssize_t));
+    bucket_keys = PyMem_Malloc(ph->n_keys * sizeof(Py_ssize_t));
+    sizes = PyMem_Calloc(ph->n_buckets, sizeof(BucketSize));
+    if (ph->slots == NULL || ph->displacements == NULL || key_buckets == NULL || bucket_keys == NULL ||
+        sizes == NULL) {
+        PyErr_NoMemory();
+        goto done;
+    }
+    for (i = 0; i < ph->n_slots; i++)
+        ph->slots[i] = -1;
+
+    for (b = 0; b < ph->n_buckets; b++)
+        sizes[b].bucket = b;
+    for (i = 0; i < ph->n_keys; i++) {
+        key_buckets[i] = (Py_ssize_t)(fnv1a_64(ph->keys[i].data, ph->keys[i].size, 0) % (uint64_t)ph->n_buckets);
+        sizes[key_buckets[i]].size++;
+    }
+
+    /* The largest buckets are the hardest to place, so they go first */
+    qsort(sizes, ph->n_buckets, sizeof(BucketSize), compare_bucket_sizes);
+    for (b = 0; b < ph->n_buckets && sizes[b].size > 0; b++) {
+        Py_ssize_t bucket = sizes[b].bucket;
+        Py_ssize_t count = 0;
+        int d;
+
+        for (i = 0; i < ph->n_keys; i++)
+            if (key_buckets[i] == bucket)
+                bucket_keys[count++] = i;
+
+        /* Equal identifiers would collide for any displacement */
+        d = -1;
+        if (count <= (Py_ssize_t)(sizeof(placed) / sizeof(placed[0])))
+            d = perfect_hash_place(ph, bucket_keys, count, placed);
+        if (d < 0) {
+            PyErr_SetString(PyExc_ValueError, "cannot build the perfect hash table of the redacted identifiers");
+            goto done;
+        }
+        ph->displacements[bucket] = (uint32_t)d;
+    }
+    result = 0;
+
+done:
+    PyMem_Free(key_buckets);
+    PyMem_Free(bucket_keys);
+    PyMem_Free(sizes);
+    if (result < 0)
+        perfect_hash_free(ph);
+    return result;
+}
+
+static int
+perfect_hash_contains(PerfectHash* ph, const char* data, Py_ssize_t size)
+{
+    uint64_t bucket;
+    int32_t slot;
+
+    if (ph->n_keys == 0 || size > ph->max_key_size)
+        return 0;
+    bucket = fnv1a_64(data, size, 0) % (uint64_t)ph->n_buckets;
+    slot = ph->slots[fnv1a_64(data, size, ph->displacements[bucket]) % (uint64_t)ph->n_slots];
+    return slot >= 0 && ph->keys[slot].size == size && memcmp(ph->keys[slot].data, data, size) == 0;
+}
+
+/* The capturer */
+
+typedef struct
+{
+    PyObject_HEAD
+
+    PerfectHash redacted;
+    /* The fallbacks of _redaction.py, utils.py and _safety.py */
+    PyObject* redact;
+    PyObject* redact_type;
+    PyObject* qualname;
+    PyObject* get_fields;
+    PyObject* qualnames;
+} Capturer;
+
+static PyObject* defaultdict_type = NULL;
+static PyObject* counter_type = NULL;
+static PyObject* ordereddict_type = NULL;
+static PyObject* deque_type = NULL;
+
+static PyObject* s_type;
+static PyObject* s_value;
+static PyObject* s_truncated;
+static PyObject* s_size;
+static PyObject* s_is_null;
+static PyObject* s_not_captured_reason;
+static PyObject* s_entries;
+static PyObject* s_elements;
+static PyObject* s_fields;
+static PyObject* s_none_type;
+static PyObject* s_depth;
+static PyObject* s_timeout;
+static PyObject* s_collection_size;
+static PyObject* s_field_count;
+static PyObject* s_redacted_ident;
+static PyObject* s_redacted_type;
+static PyObject* s_dict;
+static PyObject* s_items;
+
+typedef struct
+{
+    int level;
+    Py_ssize_t maxlen;
+    Py_ssize_t maxsize;
+    Py_ssize_t maxfields;
+    int64_t deadline;
+} Limits;
+
+static inline int
+timed_out(Limits* limits)
+{
+    return limits->deadline >= 0 && monotonic_ns() >= limits->deadline;
+}
+
+static inline int
+is_simple_type(PyTypeObject* type)
+{
+    return type == &PyLong_Type || type == &PyFloat_Type || type == &PyUnicode_Type || type == &PyBytes_Type ||
+           type == &PyBool_Type || type == Py_TYPE(Py_None) || type == &PyType_Type || type == &PyComplex_Type;
+}
+
+static inline int
+is_mapping_type(PyTypeObject* type)
+{
+    return type == &PyDict_Type || (PyObject*)type == defaultdict_type || (PyObject*)type == counter_type ||
+           (PyObject*)type == ordereddict_type;
+}
+
+static inline int
+is_sequence_type(PyTypeObject* type)
+{
+    return type == &PyList_Type || type == &PyTuple_Type || type == &PySet_Type || type == &PyFrozenSet_Type ||
+           (PyObject*)type == deque_type;
+}
+
+static inline int
+is_ascii_space(unsigned char c)
+{
+    /* The ASCII characters str.strip strips */
+    return (c >= 0x09 && c <= 0x0d) || (c >= 0x1c && c <= 0x20);
+}
+
+/* Whether the identifier is redacted, -1 on error */
+static int
+capturer_redact(Capturer* self, PyObject* ident)
+{
+    char normalized[256];
+    const char* data;
+    Py_ssize_t start;
+    Py_ssize_t end;
+    Py_ssize_t size = 0;
+    Py_ssize_t i;
+    PyObject* result;
+    int redacted;
+
+    /* The normalization of normalize_ident, for the ASCII identifiers */
+    if (PyUnicode_CheckExact(ident) && PyUnicode_IS_ASCII(ident)) {
+        data = (const char*)PyUnicode_DATA(ident);
+        start = 0;
+        end = PyUnicode_GET_LENGTH(ident);
+        while (start < end && is_ascii_space((unsigned char)data[start]))
+            start++;
+        while (end > start && is_ascii_space((unsigned char)data[end - 1]))
+            end--;
+        for (i = start; i < end; i++) {
+            char c = data[i];
+            if (c == '_')
+                continue;
+            if (size >= self->redacted.max_key_size)
+                return 0;
+            if (size >= (Py_ssize_t)sizeof(normalized))
+                goto fallback;
+            normalized[size++] = (c >= 'A' && c <= 'Z') ? (char)(c - 'A' + 'a') : c;
+        }
+        return perfect_hash_contains(&self->redacted, normalized, size);
+    }
+
+fallback:
+    result = PyObject_CallFunctionObjArgs(self->redact, ident, NULL);
+    if (result == NULL)
+        return -1;
+    redacted = PyObject_IsTrue(result);
+    Py_DECREF(result);
+    return redacted;
+}
+
+static PyObject*
+capturer_qualname(Capturer* self, PyTypeObject* type)
+{
+    PyObject* name = PyDict_GetItemWithError(self->qualnames, (PyObject*)type);
+
+    if (name != NULL)
+        return Py_NewRef(name);
+    if (PyErr_Occurred())
+        return NULL;
+
+    name = PyObject_CallFunctionObjArgs(self->qualname, (PyObject*)type, NULL);
+    if (name == NULL)
+        return NULL;
+    if (PyDict_GET_SIZE(self->qualnames) >= QUALNAME_CACHE_SIZE)
+        PyDict_Clear(self->qualnames);
+    if (PyDict_SetItem(self->qualnames, (PyObject*)type, name) < 0) {
+        Py_DECREF(name);
+        return NULL;
+    }
+    return name;
+}
+
+/* A dictionary with the qualified name of the type of the value and the given items */
+static PyObject*
+typed_dict(Capturer* self, PyTypeObject* type)
+{
+    PyObject* data;
+    PyObject* name = capturer_qualname(self, type);
+
+    if (name == NULL)
+        return NULL;
+    data = PyDict_New();
+    if (data == NULL || PyDict_SetItem(data, s_type, name) < 0) {
+        Py_DECREF(name);
+        Py_XDECREF(data);
+        return NULL;
+    }
+    Py_DECREF(name);
+    return data;
+}
+
+static PyObject*
+not_captured(Capturer* self, PyTypeObject* type, PyObject* reason, Py_ssize_t size)
+{
+    PyObject* data = typed_dict(self, type);
+    PyObject* length;
+
+    if (data == NULL)
+        return NULL;
+    if (PyDict_SetItem(data, s_not_captured_reason, reason) < 0)
+        goto error;
+    if (size >= 0) {
+        if ((length = PyLong_FromSsize_t(size)) == NULL)
+            goto error;
+        if (PyDict_SetItem(data, s_size, length) < 0) {
+            Py_DECREF(length);
+            goto error;
+        }
+        Py_DECREF(length);
+    }
+    return data;
+
+error:
+    Py_DECREF(data);
+    return NULL;
+}
+
+static inline PyObject*
+redacted_value(Capturer* self, PyObject* value)
+{
+    return not_captured(self, Py_TYPE(value), s_redacted_ident, -1);
+}
+
+static PyObject* capture_value(Capturer* self, PyObject* value, Limits* limits, int level);
+
+/* The capture of the value, unless the identifier it is bound to is redacted */
+static PyObject*
+capture_bound_value(Capturer* self, PyObject* ident, PyObject* value, Limits* limits, int level, int is_key)
+{
+    int redacted = (is_key && !PyUnicode_Check(ident)) ? 0 : capturer_redact(self, ident);
+
+    if (redacted < 0)
+        return NULL;
+    return redacted ? redacted_value(self, value) : capture_value(self, value, limits, level);
+}
+
+static PyObject*
+capture_simple(Capturer* self, PyObject* value, Limits* limits)
+{
+    PyObject* data;
+    PyObject* repr;
+    PyObject* serialized;
+    PyObject* size;
+    Py_ssize_t length;
+
+    if (limits->deadline >= 0 && timed_out(limits))
+        return not_captured(self, Py_TYPE(value), s_timeout, -1);
+
+    if ((repr = PyObject_Repr(value)) == NULL)
+        return NULL;
+
+    /* serialize */
+    length = PyUnicode_GET_LENGTH(repr);
+    if (length > SERIALIZE_MAXLEN) {
+        PyObject* head = PyUnicode_Substring(repr, 0, SERIALIZE_MAXLEN);
+        int quoted = PyUnicode_READ_CHAR(repr, 0) == '\'';
+
+        serialized = head == NULL ? NULL : PyUnicode_FromFormat("%U%s", head, quoted ? "...'" : "...");
+        Py_XDECREF(head);
+        Py_DECREF(repr);
+        if (serialized == NULL)
+            return NULL;
+    } else {
+        serialized = repr;
+    }
+
+    if ((data = typed_dict(self, Py_TYPE(value))) == NULL) {
+        Py_DECREF(serialized);
+        return NULL;
+    }
+
+    length = PyUnicode_GET_LENGTH(serialized);
+    if (length <= limits->maxlen) {
+        if (PyDict_SetItem(data, s_value, serialized) < 0)
+            goto error;
+        Py_DECREF(serialized);
+        return data;
+    }
+
+    repr = PyUnicode_Substring(serialized, 0, limits->maxlen < 0 ? 0 : limits->maxlen);
+    if (repr == NULL)
+        goto error;
+    if (PyDict_SetItem(data, s_value, repr) < 0) {
+        Py_DECREF(repr);
+        goto error;
+    }
+    Py_DECREF(repr);
+    if (PyDict_SetItem(data, s_truncated, Py_True) < 0 || (size = PyLong_FromSsize_t(length)) == NULL)
+        goto error;
+    if (PyDict_SetItem(data, s_size, size) < 0) {
+        Py_DECREF(size);
+        goto error;
+    }
+    Py_DECREF(size);
+    Py_DECREF(serialized);
+    return data;
+
+error:
+    Py_DECREF(serialized);
+    Py_DECREF(data);
+    return NULL;
+}
+
+static PyObject*
+capture_entry(Capturer* self, PyObject* key, PyObject* value, Limits* limits, int level)
+{
+    PyObject* k = capture_value(self, key, limits, level);
+    PyObject* v;
+    PyObject* entry;
+
+    if (k == NULL)
+        return NULL;
+    if ((v = capture_bound_value(self, key, value, limits, level, 1)) == NULL) {
+        Py_DECREF(k);
+        return NULL;
+    }
+    entry = PyTuple_Pack(2, k, v);
+    Py_DECREF(k);
+    Py_DECREF(v);
+    return entry;
+}
+
+static int
+append_new(PyObject* list, PyObject* item)
+{
+    int result;
+
+    if (item == NULL)
+        return -1;
+    result = PyList_Append(list, item);
+    Py_DECREF(item);
+    return result;
+}
+
+/* Set the reason why the collection, or the fields, were not all captured */
+static int
+set_incomplete(PyObject* data, Py_ssize_t captured, Py_ssize_t total, Py_ssize_t max, PyObject* limit_reason)
+{
+    if (captured < (max < total ? max : total))
+        return PyDict_SetItem(data, s_not_captured_reason, s_timeout);
+    if (total > max)
+        return PyDict_SetItem(data, s_not_captured_reason, limit_reason);
+    return 0;
+}
+
+static PyObject*
+capture_container(Capturer* self, PyObject* value, Limits* limits, int level)
+{
+    PyTypeObject* type = Py_TYPE(value);
+    PyObject* collection = NULL;
+    PyObject* data = NULL;
+    PyObject* size = NULL;
+    Py_ssize_t length = PyObject_Size(value);
+    Py_ssize_t count = 0;
+    int mapping = is_mapping_type(type);
+
+    if (length < 0)
+        return NULL;
+    if (level < 0)
+        return not_captured(self, type, s_depth, length);
+    if (limits->deadline >= 0 && timed_out(limits))
+        return not_captured(self, type, s_timeout, length);
+
+    if ((collection = PyList_New(0)) == NULL)
+        return NULL;
+
+    if (mapping && type != (PyTypeObject*)ordereddict_type) {
+        PyObject* k;
+        PyObject* v;
+        Py_ssize_t pos = 0;
+
+        while (count < limits->maxsize && PyDict_Next(value, &pos, &k, &v)) {
+            if (limits->deadline >= 0 && timed_out(limits))
+                break;
+            Py_INCREF(k);
+            Py_INCREF(v);
+            if (append_new(collection, capture_entry(self, k, v, limits, level - 1)) < 0) {
+                Py_DECREF(k);
+                Py_DECREF(v);
+                goto error;
+            }
+            Py_DECREF(k);
+            Py_DECREF(v);
+            count++;
+        }
+    } else if (type == &PyList_Type || type == &PyTuple_Type) {
+        PyObject* fast = PySequence_Fast(value, "");
+
+        if (fast == NULL)
+            goto error;
+        for (; count < limits->maxsize && count < PySequence_Fast_GET_SIZE(fast); count++) {
+            if (limits->deadline >= 0 && timed_out(limits))
+                break;
+            if (append_new(collection, capture_value(self, PySequence_Fast_GET_ITEM(fast, count), limits, level - 1)) <
+                0) {
+                Py_DECREF(fast);
+                goto error;
+            }
+        }
+        Py_DECREF(fast);
+    } else {
+        /* The ordered dictionaries are iterated over in their own order */
+        PyObject* iterable = mapping ? PyObject_CallMethodObjArgs(value, s_items, NULL) : Py_NewRef(value);
+        PyObject* iterator = iterable == NULL ? NULL : PyObject_GetIter(iterable);
+        PyObject* item;
+
+        Py_XDECREF(iterable);
+        if (iterator == NULL)
+            goto error;
+        while (count < limits->maxsize && (item = PyIter_Next(iterator)) != NULL) {
+            PyObject* captured;
+
+            if (limits->deadline >= 0 && timed_out(limits)) {
+                Py_DECREF(item);
+                break;
+            }
+            captured = mapping ? capture_entry(self, PyTuple_GET_ITEM(item, 0), PyTuple_GET_ITEM(item, 1), limits,
+                                               level - 1)
+                               : capture_value(self, item, limits, level - 1);
+            Py_DECREF(item);
+            if (append_new(collection, captured) < 0) {
+                Py_DECREF(iterator);
+                goto error;
+            }
+            count++;
+        }
+        Py_DECREF(iterator);
+        if (PyErr_Occurred())
+            goto error;
+    }
+
+    if ((data = typed_dict(self, type)) == NULL)
+        goto error;
+    if (PyDict_SetItem(data, mapping ? s_entries : s_elements, collection) < 0)
+        goto error;
+    if ((size = PyLong_FromSsize_t(length)) == NULL || PyDict_SetItem(data, s_size, size) < 0)
+        goto error;
+    if (set_incomplete(data, count, length, limits->maxsize, s_collection_size) < 0)
+        goto error;
+
+    Py_DECREF(size);
+    Py_DECREF(collection);
+    return data;
+
+error:
+    Py_XDECREF(size);
+    Py_XDECREF(data);
+    Py_DECREF(collection);
+    return NULL;
+}
+
+/* The fields of get_fields in _safety.py, with the instance dictionary without a call */
+static PyObject*
+get_fields(Capturer* self, PyObject* value)
+{
+    PyObject* fields = PyObject_GenericGetAttr(value, s_dict);
+
+    if (fields != NULL) {
+        if (PyDict_CheckExact(fields))
+            return fields;
+        Py_DECREF(fields);
+    } else {
+        PyErr_Clear();
+    }
+    return PyObject_CallFunctionObjArgs(self->get_fields, value, NULL);
+}
+
+static PyObject*
+capture_object(Capturer* self, PyObject* value, Limits* limits, int level)
+{
+    PyTypeObject* type = Py_TYPE(value);
+    PyObject* name;
+    PyObject* result;
+    PyObject* fields;
+    PyObject* captured = NULL;
+    PyObject* data = NULL;
+    PyObject* k;
+    PyObject* v;
+    Py_ssize_t pos = 0;
+    Py_ssize_t count = 0;
+    Py_ssize_t length;
+    int redacted;
+
+    if (level < 0)
+        return not_captured(self, type, s_depth, -1);
+
+    if ((name = capturer_qualname(self, type)) == NULL)
+        return NULL;
+    result = PyObject_CallFunctionObjArgs(self->redact_type, name, NULL);
+    Py_DECREF(name);
+    if (result == NULL)
+        return NULL;
+    redacted = PyObject_IsTrue(result);
+    Py_DECREF(result);
+    if (redacted < 0)
+        return NULL;
+    if (redacted)
+        return not_captured(self, type, s_redacted_type, -1);
+
+    if (limits->deadline >= 0 && timed_out(limits))
+        return not_captured(self, type, s_timeout, -1);
+
+    if ((fields = get_fields(self, value)) == NULL)
+        return NULL;
+    if (!PyDict_Check(fields)) {
+        PyErr_SetString(PyExc_TypeError, "the fields of an object must be a dictionary");
+        goto error;
+    }
+    length = PyDict_GET_SIZE(fields);
+
+    if ((captured = PyDict_New()) == NULL)
+        goto error;
+    while (count < limits->maxfields && PyDict_Next(fields, &pos, &k, &v)) {
+        PyObject* field;
+
+        if (limits->deadline >= 0 && timed_out(limits))
+            break;
+        Py_INCREF(k);
+        Py_INCREF(v);
+        field = capture_bound_value(self, k, v, limits, level - 1, 0);
+        if (field == NULL || PyDict_SetItem(captured, k, field) < 0) {
+            Py_XDECREF(field);
+            Py_DECREF(k);
+            Py_DECREF(v);
+            goto error;
+        }
+        Py_DECREF(field);
+        Py_DECREF(k);
+        Py_DECREF(v);
+        count++;
+    }
+
+    if ((data = typed_dict(self, type)) == NULL || PyDict_SetItem(data, s_fields, captured) < 0)
+        goto error;
+    if (set_incomplete(data, PyDict_GET_SIZE(captured), length, limits->maxfields, s_field_count) < 0)
+        goto error;
+
+    Py_DECREF(captured);
+    Py_DECREF(fields);
+    return data;
+
+error:
+    Py_XDECREF(data);
+    Py_XDECREF(captured);
+    Py_DECREF(fields);
+    return NULL;
+}
+
+static PyObject*
+capture_value(Capturer* self, PyObject* value, Limits* limits, int level)
+{
+    PyTypeObject* type = Py_TYPE(value);
+    PyObject* data;
+
+    if (is_simple_type(type)) {
+        if (value == Py_None) {
+            data = PyDict_New();
+            if (data == NULL)
+                return NULL;
+            if (PyDict_SetItem(data, s_type, s_none_type) < 0 || PyDict_SetItem(data, s_is_null, Py_True) < 0) {
+                Py_DECREF(data);
+                return NULL;
+            }
+            return data;
+        }
+        return capture_simple(self, value, limits);
+    }
+
+    if (Py_EnterRecursiveCall(" while capturing a value"))
+        return NULL;
+    if (is_mapping_type(type) || is_sequence_type(type))
+        data = capture_container(self, value, limits, level);
+    else
+        data = capture_object(self, value, limits, level);
+    Py_LeaveRecursiveCall();
+    return data;
+}
+
+static int
+parse_limits(PyObject* args, PyObject* kwargs, const char* format, char** kwlist, PyObject** target, Limits* limits)
+{
+    long long deadline = -1;
+
+    limits->level = 2;
+    limits->maxlen = 255;
+    limits->maxsize = 100;
+    limits->maxfields = 20;
+    if (!PyArg_ParseTupleAndKeywords(args,
+                                     kwargs,
+                                     format,
+                                     kwlist,
+                                     target,
+                                     &limits->level,
+                                     &limits->maxlen,
+                                     &limits->maxsize,
+                                     &limits->maxfields,
+                                     &deadline))
+        return -1;
+    limits->deadline = deadline;
+    return 0;
+}
+
+static PyObject*
+Capturer_capture_value(Capturer* self, PyObject* args, PyObject* kwargs)
+{
+    static char* kwlist[] = { "value", "level", "maxlen", "maxsize", "maxfields", "deadline", NULL };
+    PyObject* value;
+    Limits limits;
+
+    if (parse_limits(args, kwargs, "O|innnL:capture_value", kwlist, &value, &limits) < 0)
+        return NULL;
+    return capture_value(self, value, &limits, limits.level);
+}
+
+static PyObject*
+Capturer_capture_pairs(Capturer* self, PyObject* args, PyObject* kwargs)
+{
+    static char* kwlist[] = { "pairs", "level", "maxlen", "maxsize", "maxfields", "deadline", NULL };
+    PyObject* pairs;
+    PyObject* iterator;
+    PyObject* item;
+    PyObject* captured;
+    Limits limits;
+
+    if (parse_limits(args, kwargs, "O|innnL:capture_pairs", kwlist, &pairs, &limits) < 0)
+        return NULL;
+
+    if ((captured = PyDict_New()) == NULL)
+        return NULL;
+    if ((iterator = PyObject_GetIter(pairs)) == NULL) {
+        Py_DECREF(captured);
+        return NULL;
+    }
+    while ((item = PyIter_Next(iterator)) != NULL) {
+        PyObject* pair = PySequence_Fast(item, "the pairs must be sequences of a name and a value");
+        PyObject* value;
+
+        Py_DECREF(item);
+        if (pair == NULL)
+            goto error;
+        if (PySequence_Fast_GET_SIZE(pair) != 2) {
+            PyErr_SetString(PyExc_ValueError, "the pairs must be sequences of a name and a value");
+            Py_DECREF(pair);
+            goto error;
+        }
+        value = capture_bound_value(
+          self, PySequence_Fast_GET_ITEM(pair, 0), PySequence_Fast_GET_ITEM(pair, 1), &limits, limits.level, 0);
+        if (value == NULL || PyDict_SetItem(captured, PySequence_Fast_GET_ITEM(pair, 0), value) < 0) {
+            Py_XDECREF(value);
+            Py_DECREF(pair);
+            goto error;
+        }
+        Py_DECREF(value);
+        Py_DECREF(pair);
+    }
+    Py_DECREF(iterator);
+    if (PyErr_Occurred()) {
+        Py_DECREF(captured);
+        return NULL;
+    }
+    return captured;
+
+error:
+    Py_DECREF(iterator);
+    Py_DECREF(captured);
+    return NULL;
+}
+
+static PyObject*
+Capturer_redact(Capturer* self, PyObject* ident)
+{
+    int redacted = capturer_redact(self, ident);
+
+    if (redacted < 0)
+        return NULL;
+    return PyBool_FromLong(redacted);
+}
+
+static int
+Capturer_init(Capturer* self, PyObject* args, PyObject* kwargs)
+{
+    static char* kwlist[] = { "redacted_identifiers", "redact", "redact_type", "qualname", "get_fields", NULL };
+    PyObject* identifiers;
+    PyObject* redact;
+    PyObject* redact_type;
+    PyObject* qualname;
+    PyObject* get_fields;
+
+    if (!PyArg_ParseTupleAndKeywords(
+          args, kwargs, "OOOOO:Capturer", kwlist, &identifiers, &redact, &redact_type, &qualname, &get_fields))
+        return -1;
+
+    perfect_hash_free(&self->redacted);
+    if (perfect_hash_build(&self->redacted, identifiers) < 0)
+        return -1;
+
+    Py_XSETREF(self->qualnames, PyDict_New());
+    if (self->qualnames == NULL)
+        return -1;
+    Py_XSETREF(self->redact, Py_NewRef(redact));
+    Py_XSETREF(self->redact_type, Py_NewRef(redact_type));
+    Py_XSETREF(self->qualname, Py_NewRef(qualname));
+    Py_XSETREF(self->get_fields, Py_NewRef(get_fields));
+    return 0;
+}
+
+static int
+Capturer_traverse(Capturer* self, visitproc visit, void* arg)
+{
+    Py_VISIT(self->redact);
+    Py_VISIT(self->redact_type);
+    Py_VISIT(self->qualname);
+    Py_VISIT(self->get_fields);
+    Py_VISIT(self->qualnames);
+    return 0;
+}
+
+static int
+Capturer_clear(Capturer* self)
+{
+    Py_CLEAR(self->redact);
+    Py_CLEAR(self->redact_type);
+    Py_CLEAR(self->qualname);
+    Py_CLEAR(self->get_fields);
+    Py_CLEAR(self->qualnames);
+    return 0;
+}
+
+static void
+Capturer_dealloc(Capturer* self)
+{
+    PyObject_GC_UnTrack(self);
+    Capturer_clear(self);
+    perfect_hash_free(&self->redacted);
+    Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+static int
+check_initialized(Capturer* self)
+{
+    if (self->qualnames == NULL) {
+        PyErr_SetString(PyExc_RuntimeError, "the capturer is not initialized");
+        return -1;
+    }
+    return 0;
+}
+
+static PyObject*
+Capturer_checked_capture_value(Capturer* self, PyObject* args, PyObject* kwargs)
+{
+    return check_initialized(self) < 0 ? NULL : Capturer_capture_value(self, args, kwargs);
+}
+
+static PyObject*
+Capturer_checked_capture_pairs(Capturer* self, PyObject* args, PyObject* kwargs)
+{
+    return check_initialized(self) < 0 ? NULL : Capturer_capture_pairs(self, args, kwargs);
+}
+
+static PyObject*
+Capturer_checked_redact(Capturer* self, PyObject* ident)
+{
+    return check_initialized(self) < 0 ? NULL : Capturer_redact(self, ident);
+}
+
+static PyMethodDef Capturer_methods[] = {
+    { "capture_value",
+      (PyCFunction)(void (*)(void))Capturer_checked_capture_value,
+      METH_VARARGS | METH_KEYWORDS,
+      "Capture the value within the limits, until the monotonic deadline in nanoseconds if it is not negative" },
+    { "capture_pairs",
+      (PyCFunction)(void (*)(void))Capturer_checked_capture_pairs,
+      METH_VARARGS | METH_KEYWORDS,
+      "Capture the values of the (name, value) pairs within the limits, redacting the values of the redacted names" },
+    { "redact", (PyCFunction)Capturer_checked_redact, METH_O, "Whether the identifier is redacted" },
+    { NULL, NULL, 0, NULL }
+};
+
+static PyTypeObject CapturerType = {
+    PyVarObject_HEAD_INIT(NULL, 0).tp_name = "ddtrace.debugging._signal._capture.Capturer",
+    .tp_doc = "Native capture of the values of the snapshots",
+    .tp_basicsize = sizeof(Capturer),
+    .tp_itemsize = 0,
+    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_GC,
+    .tp_new = PyType_GenericNew,
+    .tp_init = (initproc)Capturer_init,
+    .tp_dealloc = (destructor)Capturer_dealloc,
+    .tp_traverse = (traverseproc)Capturer_traverse,
+    .tp_clear = (inquiry)Capturer_clear,
+    .tp_methods = Capturer_methods,
+};
+
+static int
+load_collections(void)
+{
+    PyObject* collections = PyImport_ImportModule("collections");
+
+    if (collections == NULL)
+        return -1;
+    defaultdict_type = PyObject_GetAttrString(collections, "defaultdict");
+    counter_type = PyObject_GetAttrString(collections, "Counter");
+    ordereddict_type = PyObject_GetAttrString(collections, "OrderedDict");
+    deque_type = PyObject_GetAttrString(collections, "deque");
+    Py_DECREF(collections);
+    return defaultdict_type == NULL || counter_type == NULL || ordereddict_type == NULL || deque_type == NULL ? -1 : 0;
+}
+
+static int
+intern_strings(void)
+{
+    struct
+    {
+        PyObject** target;
+        const char* value;
+    } strings[] = {
+        { &s_type, "type" },
+        { &s_value, "value" },
+        { &s_truncated, "truncated" },
+        { &s_size, "size" },
+        { &s_is_null, "isNull" },
+        { &s_not_captured_reason, "notCapturedReason" },
+        { &s_entries, "entries" },
+        { &s_elements, "elements" },
+        { &s_fields, "fields" },
+        { &s_none_type, "NoneType" },
+        { &s_depth, "depth" },
+        { &s_timeout, "timeout" },
+        { &s_collection_size, "collectionSize" },
+        { &s_field_count, "fieldCount" },
+        { &s_redacted_ident, "redactedIdent" },
+        { &s_redacted_type, "redactedType" },
+        { &s_dict, "__dict__" },
+        { &s_items, "items" },
+    };
+    size_t i;
+
+    for (i = 0; i < sizeof(strings) / sizeof(strings[0]); i++)
+        if (*strings[i].target == NULL && (*strings[i].target = PyUnicode_InternFromString(strings[i].value)) == NULL)
+            return -1;
+    return 0;
+}
+
+static struct PyModuleDef capture_module = {
+    PyModuleDef_HEAD_INIT, "ddtrace.debugging._signal._capture", "native capture of snapshot values", -1, NULL
+};
+
+PyMODINIT_FUNC
+PyInit__capture(void)
+{
+    PyObject* m;
+
+    if (PyType_Ready(&CapturerType) < 0)
+        return NULL;
+    if (deque_type == NULL && load_collections() < 0)
+        return NULL;
+    if (intern_strings() < 0)
+        return NULL;
+
+    m = PyModule_Create(&capture_module);
+    if (m == NULL)
+        return NULL;
+
+    Py_INCREF(&CapturerType);
+    if (PyModule_AddObject(m, "Capturer", (PyObject*)&CapturerType) < 0) {
+        Py_DECREF(&CapturerType);
+        Py_DECREF(m);
+        return NULL;
+    }
+
+    return m;
+}
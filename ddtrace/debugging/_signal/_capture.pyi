@@ -0,0 +1,35 @@
+from typing import Any
+from typing import Callable
+from typing import Dict
+from typing import Iterable
+from typing import Tuple
+from typing import Type
+
+class Capturer:
+    def __init__(
+        self,
+        redacted_identifiers: Iterable[str],
+        redact: Callable[[Any], bool],
+        redact_type: Callable[[str], bool],
+        qualname: Callable[[Type], str],
+        get_fields: Callable[[Any], Dict[str, Any]],
+    ) -> None: ...
+    def capture_value(
+        self,
+        value: Any,
+        level: int = ...,
+        maxlen: int = ...,
+        maxsize: int = ...,
+        maxfields: int = ...,
+        deadline: int = ...,
+    ) -> Dict[str, Any]: ...
+    def capture_pairs(
+        self,
+        pairs: Iterable[Tuple[str, Any]],
+        level: int = ...,
+        maxlen: int = ...,
+        maxsize: int = ...,
+        maxfields: int = ...,
+        deadline: int = ...,
+    ) -> Dict[str, Any]: ...
+    def redact(self, ident: Any) -> bool: ...
@@ -28,6 +28,7 @@ from ddtrace.debugging._signal.model import LogSignal
 from ddtrace.debugging._signal.model import SignalState
 from ddtrace.debugging._signal.utils import serialize
 from ddtrace.internal.compat import ExcInfoType
+from ddtrace.internal.compat import monotonic_ns
 from ddtrace.internal.rate_limiter import RateLimitExceeded
 from ddtrace.internal.utils.time import HourGlass
 
@@ -42,6 +43,29 @@ def _capture_context(
     throwable: ExcInfoType,
     limits: CaptureLimits = DEFAULT_CAPTURE_LIMITS,
 ) -> Dict[str, Any]:
+    capturer = utils.capturer
+    if capturer is not None:
+        # The native capture checks the time budget against a deadline instead
+        deadline = monotonic_ns() + int(CAPTURE_TIME_BUDGET * 1e9)
+        return {
+            "arguments": capturer.capture_pairs(
+                arguments, limits.max_level, limits.max_len, limits.max_size, limits.max_fields, deadline
+            )
+            if arguments
+            else {},
+            "locals": capturer.capture_pairs(
+                _locals, limits.max_level, limits.max_len, limits.max_size, limits.max_fields, deadline
+            )
+            if _locals
+            else {},
+            "staticFields": capturer.capture_pairs(
+                _globals, limits.max_level, limits.max_len, limits.max_size, limits.max_fields, deadline
+            )
+            if _globals
+            else {},
+            "throwable": utils.capture_exc_info(throwable),
+        }
+
     with HourGlass(duration=CAPTURE_TIME_BUDGET) as hg:
 
         def timeout(_):
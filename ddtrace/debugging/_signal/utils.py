@@ -14,6 +14,7 @@ from ddtrace.debugging._probe.model import MAXFIELDS
 from ddtrace.debugging._probe.model import MAXLEN
 from ddtrace.debugging._probe.model import MAXLEVEL
 from ddtrace.debugging._probe.model import MAXSIZE
+from ddtrace.debugging._redaction import REDACTED_IDENTIFIERS
 from ddtrace.debugging._redaction import REDACTED_PLACEHOLDER
 from ddtrace.debugging._redaction import redact
 from ddtrace.debugging._redaction import redact_type
@@ -142,6 +143,15 @@ def capture_exc_info(exc_info: ExcInfoType) -> Optional[Dict[str, Any]]:
     }
 
 
+# The native capture of the values, which produces the same data as capture_pairs
+try:
+    from ddtrace.debugging._signal._capture import Capturer
+except ImportError:
+    capturer = None
+else:
+    capturer = Capturer(REDACTED_IDENTIFIERS, redact, redact_type, qualname, get_fields)
+
+
 def redacted_value(v: Any) -> dict:
     return {"type": qualname(type(v)), "notCapturedReason": "redactedIdent"}
 
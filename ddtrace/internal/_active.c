@@ -0,0 +1,430 @@
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <pythread.h>
+
+#include "_active.h"
+
+/* The active span or context of the tracer.
+
+   It is kept in a context variable created by this module, so that getting and setting it are calls of the C API of
+   the contextvars, without going through the methods of a ContextVar object. The C API caches the value last read
+   by each thread for as long as its context doesn't change, so a lookup is a couple of loads.
+
+   Setting a span also records its ids in a slot of the thread: the slot of each thread is cached in a thread-local
+   pointer, so this is a few stores, and the profiler reads the slots of all the threads from its sampling thread,
+   without the GIL. Like the links the profiler used to keep itself, a slot holds the span last activated on the
+   thread, whichever of its contexts activated it. */
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#define ACTIVE_THREAD_LOCAL __declspec(thread)
+#define ACTIVE_LOAD(p) ((uint64_t)_InterlockedOr64((volatile __int64*)(p), 0))
+#define ACTIVE_STORE(p, v) ((void)_InterlockedExchange64((volatile __int64*)(p), (__int64)(v)))
+#define ACTIVE_CAS(p, expected, desired)                                                                              \
+    ((uint64_t)_InterlockedCompareExchange64((volatile __int64*)(p), (__int64)(desired), (__int64)(expected)) ==     \
+     (uint64_t)(expected))
+#else
+#define ACTIVE_THREAD_LOCAL __thread
+#define ACTIVE_LOAD(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define ACTIVE_STORE(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define ACTIVE_CAS(p, expected, desired)                                                                              \
+    __extension__({                                                                                                    \
+        uint64_t _expected = (expected);                                                                               \
+        __atomic_compare_exchange_n((p), &_expected, (desired), 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);                \
+    })
+#endif
+
+/* Threads beyond this many at once don't get a slot, and the profiler doesn't link their samples to spans */
+#define ACTIVE_THREADS_MAX 1024
+/* Attempts of a reader at a consistent copy of a slot which is being written */
+#define ACTIVE_READ_RETRIES 8
+
+typedef struct
+{
+    /* Identifier of the thread which owns the slot, 0 if the slot is free */
+    uint64_t thread_id;
+    /* Odd while the ids are being written */
+    uint64_t seq;
+    uint64_t span_id;
+    uint64_t local_root_span_id;
+} active_thread_t;
+
+static active_thread_t active_threads[ACTIVE_THREADS_MAX];
+static ACTIVE_THREAD_LOCAL active_thread_t* active_thread = NULL;
+
+static PyObject* contextvar = NULL;
+/* ddtrace._trace.span.Span, imported on first use as the spans module imports the provider */
+static PyObject* span_type = NULL;
+
+static PyObject* str_activate = NULL;
+static PyObject* str_duration_ns = NULL;
+static PyObject* str_finished = NULL;
+static PyObject* str_local_root = NULL;
+static PyObject* str_parent = NULL;
+static PyObject* str_span_id = NULL;
+
+/* Slot of the calling thread, claimed on first use, or NULL if all of them are taken */
+static active_thread_t*
+active_thread_slot(void)
+{
+    uint64_t thread_id = (uint64_t)PyThread_get_thread_ident();
+    active_thread_t* slot = active_thread;
+
+    /* The slots of the threads which are gone are freed by clear_threads, which may race with a new thread that
+       reuses an identifier, so the owner is checked on each use */
+    if (slot != NULL && ACTIVE_LOAD(&slot->thread_id) == thread_id)
+        return slot;
+
+    active_thread = NULL;
+    /* A slot left by a thread which had the same identifier is reused first */
+    for (size_t i = 0; i < ACTIVE_THREADS_MAX; i++) {
+        if (ACTIVE_LOAD(&active_threads[i].thread_id) == thread_id)
+            return active_thread = &active_threads[i];
+    }
+    for (size_t i = 0; i < ACTIVE_THREADS_MAX; i++) {
+        if (ACTIVE_CAS(&active_threads[i].thread_id, 0, thread_id))
+            return active_thread = &active_threads[i];
+    }
+
+    return NULL;
+}
+
+static void
+active_thread_write(active_thread_t* slot, uint64_t span_id, uint64_t local_root_span_id)
+{
+    uint64_t seq = ACTIVE_LOAD(&slot->seq);
+
+    ACTIVE_STORE(&slot->seq, seq + 1);
+    ACTIVE_STORE(&slot->span_id, span_id);
+    ACTIVE_STORE(&slot->local_root_span_id, local_root_span_id);
+    ACTIVE_STORE(&slot->seq, seq + 2);
+}
+
+static int
+active_thread_span_ids(unsigned long thread_id, uint64_t* span_id, uint64_t* local_root_span_id)
+{
+    for (size_t i = 0; i < ACTIVE_THREADS_MAX; i++) {
+        active_thread_t* slot = &active_threads[i];
+
+        if (ACTIVE_LOAD(&slot->thread_id) != (uint64_t)thread_id)
+            continue;
+
+        for (int attempt = 0; attempt < ACTIVE_READ_RETRIES; attempt++) {
+            uint64_t seq = ACTIVE_LOAD(&slot->seq);
+            uint64_t read_span_id, read_local_root_span_id;
+
+            if (seq & 1)
+                continue;
+            read_span_id = ACTIVE_LOAD(&slot->span_id);
+            read_local_root_span_id = ACTIVE_LOAD(&slot->local_root_span_id);
+            if (ACTIVE_LOAD(&slot->seq) != seq)
+                continue;
+            if (read_span_id == 0)
+                return 0;
+
+            *span_id = read_span_id;
+            *local_root_span_id = read_local_root_span_id;
+            return 1;
+        }
+
+        return 0;
+    }
+
+    return 0;
+}
+
+static const active_capi_t active_capi = { ACTIVE_CAPI_VERSION, active_thread_span_ids };
+
+static int
+is_span(PyObject* item)
+{
+    if (span_type == NULL) {
+        PyObject* span_module = PyImport_ImportModule("ddtrace._trace.span");
+        if (span_module == NULL)
+            return -1;
+        span_type = PyObject_GetAttrString(span_module, "Span");
+        Py_DECREF(span_module);
+        if (span_type == NULL)
+            return -1;
+    }
+
+    return PyObject_TypeCheck(item, (PyTypeObject*)span_type);
+}
+
+/* The id of a span, or 0 if it can't be read as one */
+static uint64_t
+span_id_of(PyObject* span)
+{
+    PyObject* value;
+    uint64_t span_id;
+
+    if (span == Py_None)
+        return 0;
+
+    value = PyObject_GetAttr(span, str_span_id);
+    if (value == NULL) {
+        PyErr_Clear();
+        return 0;
+    }
+    span_id = PyLong_Check(value) ? PyLong_AsUnsignedLongLong(value) : 0;
+    Py_DECREF(value);
+    if (span_id == (uint64_t)-1 && PyErr_Occurred()) {
+        PyErr_Clear();
+        return 0;
+    }
+
+    return span_id;
+}
+
+static int
+record_span(PyObject* item)
+{
+    active_thread_t* slot = active_thread_slot();
+    uint64_t span_id = 0, local_root_span_id = 0;
+
+    if (slot == NULL)
+        return 0;
+
+    if (item != Py_None) {
+        int span = is_span(item);
+        if (span < 0)
+            return -1;
+        if (span) {
+            PyObject* local_root = PyObject_GetAttr(item, str_local_root);
+            if (local_root == NULL)
+                PyErr_Clear();
+            span_id = span_id_of(item);
+            if (local_root != NULL) {
+                local_root_span_id = span_id_of(local_root);
+                Py_DECREF(local_root);
+            }
+        }
+    }
+
+    active_thread_write(slot, span_id, local_root_span_id);
+    return 0;
+}
+
+/* 1 if the span is finished, 0 if not, -1 on error */
+static int
+span_finished(PyObject* span)
+{
+    PyObject* value;
+    int finished;
+
+    /* A subclass may tell otherwise whether it is finished */
+    if (Py_TYPE(span) == (PyTypeObject*)span_type) {
+        value = PyObject_GetAttr(span, str_duration_ns);
+        if (value == NULL)
+            return -1;
+        finished = value != Py_None;
+        Py_DECREF(value);
+        return finished;
+    }
+
+    value = PyObject_GetAttr(span, str_finished);
+    if (value == NULL)
+        return -1;
+    finished = PyObject_IsTrue(value);
+    Py_DECREF(value);
+    return finished;
+}
+
+static PyObject*
+active_get(PyObject* Py_UNUSED(module), PyObject* Py_UNUSED(args))
+{
+    PyObject* item;
+
+    if (PyContextVar_Get(contextvar, Py_None, &item) < 0)
+        return NULL;
+
+    return item;
+}
+
+static PyObject*
+active_set(PyObject* Py_UNUSED(module), PyObject* item)
+{
+    PyObject* token = PyContextVar_Set(contextvar, item);
+
+    if (token == NULL)
+        return NULL;
+    Py_DECREF(token);
+
+    if (record_span(item) < 0)
+        return NULL;
+
+    Py_RETURN_NONE;
+}
+
+static PyObject*
+active_active(PyObject* Py_UNUSED(module), PyObject* provider)
+{
+    PyObject* item;
+    PyObject* result;
+    int span, finished;
+
+    if (PyContextVar_Get(contextvar, Py_None, &item) < 0)
+        return NULL;
+    if (item == Py_None)
+        return item;
+
+    span = is_span(item);
+    if (span < 0) {
+        Py_DECREF(item);
+        return NULL;
+    }
+    if (!span)
+        return item;
+
+    finished = span_finished(item);
+    if (finished < 0) {
+        Py_DECREF(item);
+        return NULL;
+    }
+    if (!finished)
+        return item;
+
+    /* The active span is finished, so the closest of its parents which isn't becomes the active one */
+    while (item != Py_None && (finished = span_finished(item)) != 0) {
+        PyObject* parent;
+
+        if (finished < 0) {
+            Py_DECREF(item);
+            return NULL;
+        }
+        parent = PyObject_GetAttr(item, str_parent);
+        Py_DECREF(item);
+        if (parent == NULL)
+            return NULL;
+        item = parent;
+    }
+
+    /* Activated through the provider, which runs the hooks registered on activations */
+    result = PyObject_CallMethodObjArgs(provider, str_activate, item, NULL);
+    if (result == NULL) {
+        Py_DECREF(item);
+        return NULL;
+    }
+    Py_DECREF(result);
+
+    return item;
+}
+
+static PyObject*
+active_thread_span_ids_py(PyObject* Py_UNUSED(module), PyObject* thread_id)
+{
+    unsigned long id = PyLong_AsUnsignedLong(thread_id);
+    uint64_t span_id, local_root_span_id;
+
+    if (id == (unsigned long)-1 && PyErr_Occurred())
+        return NULL;
+
+    if (!active_thread_span_ids(id, &span_id, &local_root_span_id))
+        Py_RETURN_NONE;
+
+    return Py_BuildValue("(KK)", (unsigned long long)span_id, (unsigned long long)local_root_span_id);
+}
+
+static PyObject*
+active_clear_threads(PyObject* Py_UNUSED(module), PyObject* existing_thread_ids)
+{
+    for (size_t i = 0; i < ACTIVE_THREADS_MAX; i++) {
+        uint64_t thread_id = ACTIVE_LOAD(&active_threads[i].thread_id);
+        PyObject* key;
+        int exists;
+
+        if (thread_id == 0)
+            continue;
+
+        key = PyLong_FromUnsignedLongLong((unsigned long long)thread_id);
+        if (key == NULL)
+            return NULL;
+        exists = PySequence_Contains(existing_thread_ids, key);
+        Py_DECREF(key);
+        if (exists < 0)
+            return NULL;
+
+        if (!exists) {
+            active_thread_write(&active_threads[i], 0, 0);
+            ACTIVE_CAS(&active_threads[i].thread_id, thread_id, 0);
+        }
+    }
+
+    Py_RETURN_NONE;
+}
+
+static PyMethodDef active_methods[] = {
+    { "get", active_get, METH_NOARGS, "Return the active span or context of the current execution" },
+    { "set", active_set, METH_O, "Make the given span or context the active one of the current execution" },
+    { "active",
+      active_active,
+      METH_O,
+      "Return the active span or context, after activating the closest unfinished parent through the given provider "
+      "if the active span is finished" },
+    { "thread_span_ids",
+      active_thread_span_ids_py,
+      METH_O,
+      "Return the span id and the local root span id of the span last activated on the given thread, or None" },
+    { "clear_threads",
+      active_clear_threads,
+      METH_O,
+      "Free the slots of the threads whose identifiers are not in the given collection" },
+    { NULL, NULL, 0, NULL }
+};
+
+static struct PyModuleDef active_module = {
+    PyModuleDef_HEAD_INIT, "ddtrace.internal._active", "native active span of the tracer", -1, active_methods
+};
+
+static int
+intern_strings(void)
+{
+#define INTERN(name, value)                                                                                            \
+    if (name == NULL && (name = PyUnicode_InternFromString(value)) == NULL)                                            \
+        return -1;
+    INTERN(str_activate, "activate");
+    INTERN(str_duration_ns, "duration_ns");
+    INTERN(str_finished, "finished");
+    INTERN(str_local_root, "_local_root");
+    INTERN(str_parent, "_parent");
+    INTERN(str_span_id, "span_id");
+#undef INTERN
+    return 0;
+}
+
+PyMODINIT_FUNC
+PyInit__active(void)
+{
+    PyObject* m;
+    PyObject* capsule;
+
+    if (intern_strings() < 0)
+        return NULL;
+
+    if (contextvar == NULL && (contextvar = PyContextVar_New("datadog_contextvar", Py_None)) == NULL)
+        return NULL;
+
+    m = PyModule_Create(&active_module);
+    if (m == NULL)
+        return NULL;
+
+    Py_INCREF(contextvar);
+    if (PyModule_AddObject(m, "contextvar", contextvar) < 0) {
+        Py_DECREF(contextvar);
+        Py_DECREF(m);
+        return NULL;
+    }
+
+    capsule = PyCapsule_New((void*)&active_capi, ACTIVE_CAPSULE_NAME, NULL);
+    if (capsule == NULL) {
+        Py_DECREF(m);
+        return NULL;
+    }
+    if (PyModule_AddObject(m, "_C_API", capsule) < 0) {
+        Py_DECREF(capsule);
+        Py_DECREF(m);
+        return NULL;
+    }
+
+    return m;
+}
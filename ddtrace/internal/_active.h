@@ -0,0 +1,24 @@
+#ifndef DDTRACE_ACTIVE_H
+#define DDTRACE_ACTIVE_H
+
+#include "_stdint.h"
+
+/*
+ * C API of ddtrace.internal._active, exported as the ddtrace.internal._active._C_API capsule for the native parts of
+ * the profiler. Get it once with PyCapsule_Import(ACTIVE_CAPSULE_NAME, 0) while holding the GIL; the functions can
+ * then be called from any thread without it.
+ */
+#define ACTIVE_CAPSULE_NAME "ddtrace.internal._active._C_API"
+
+typedef struct
+{
+    /* Increased when the layout of this structure changes */
+    int version;
+    /* Fill the ids of the span last activated on the thread with the given identifier, as returned by
+       PyThread_get_thread_ident(), and return 1, or return 0 if no span was activated on it */
+    int (*thread_span_ids)(unsigned long thread_id, uint64_t* span_id, uint64_t* local_root_span_id);
+} active_capi_t;
+
+#define ACTIVE_CAPI_VERSION 1
+
+#endif
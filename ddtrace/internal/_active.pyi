@@ -0,0 +1,10 @@
+import contextvars
+import typing as t
+
+contextvar: contextvars.ContextVar[t.Any]
+
+def get() -> t.Any: ...
+def set(item: t.Any) -> None: ...
+def active(provider: t.Any) -> t.Any: ...
+def thread_span_ids(thread_id: int) -> t.Optional[t.Tuple[int, int]]: ...
+def clear_threads(existing_thread_ids: t.Collection[int]) -> None: ...
@@ -0,0 +1,105 @@
+"""Loader of the native extensions bundled in a single shared object.
+
+When built with ``DD_BUNDLE_EXTENSIONS``, the C and Cython extensions listed in
+``MODULES`` are linked together into ``ddtrace.internal._native_bundle``, so
+that the dynamic loader maps and relocates one shared object instead of one per
+extension. Each extension keeps its own ``PyInit_<name>`` entry point in the
+bundle and is still initialized only when its module is first imported.
+
+This module is also read by ``setup.py`` and must only depend on the standard
+library.
+"""
+from importlib.machinery import EXTENSION_SUFFIXES
+from importlib.machinery import ExtensionFileLoader
+from importlib.machinery import ModuleSpec
+import os
+import sys
+import typing as t
+
+
+BUNDLE = "ddtrace.internal._native_bundle"
+
+# The extensions which can be bundled. The last component of their names must
+# be unique, as it is the name of their entry point in the bundle.
+MODULES = (
+    "ddtrace.internal._rand",
+    "ddtrace.internal._active",
+    "ddtrace.internal._log_injection",
+    "ddtrace.internal._http_headers",
+    "ddtrace.internal._tagset",
+    "ddtrace.internal._propagation",
+    "ddtrace.internal._rule_matcher",
+    "ddtrace.internal._rate_limiter",
+    "ddtrace.internal._injection",
+    "ddtrace.internal._encoding",
+    "ddtrace.internal._dogstatsd",
+    "ddtrace.internal.processor._stats",
+    "ddtrace.internal.datastreams._pathway",
+    "ddtrace.internal.coverage._native",
+    "ddtrace.internal.runtime._gcstats",
+    "ddtrace.internal.symbol_db._scan",
+    "ddtrace.internal.wrapping._context",
+    "ddtrace.internal.telemetry._counters",
+    "ddtrace.appsec._iast._stacktrace",
+    "ddtrace.appsec._ddwaf._arena",
+    "ddtrace.debugging._function._monitor",
+    "ddtrace.debugging._signal._capture",
+    "ddtrace.profiling._build",
+    "ddtrace.profiling._threading",
+    "ddtrace.profiling.collector._exception",
+    "ddtrace.profiling.collector._memalloc",
+    "ddtrace.profiling.collector._sampler",
+    "ddtrace.profiling.collector._task",
+    "ddtrace.profiling.collector._traceback",
+    "ddtrace.profiling.exporter.pprof",
+)
+
+
+def bundle_path():
+    # type: () -> t.Optional[str]
+    """Return the path of the bundle if ddtrace was built with one."""
+    here = os.path.dirname(os.path.abspath(__file__))
+    name = BUNDLE.rpartition(".")[-1]
+    for suffix in EXTENSION_SUFFIXES:
+        path = os.path.join(here, name + suffix)
+        if os.path.isfile(path):
+            return path
+    return None
+
+
+class BundleFinder(object):
+    """Finds the bundled extensions in the bundle."""
+
+    def __init__(self, path):
+        # type: (str) -> None
+        self.path = path
+        self.modules = frozenset(MODULES)
+
+    def find_spec(self, fullname, path=None, target=None):
+        # type: (str, t.Any, t.Any) -> t.Optional[ModuleSpec]
+        if fullname not in self.modules:
+            return None
+
+        spec = ModuleSpec(fullname, ExtensionFileLoader(fullname, self.path), origin=self.path)
+        spec.has_location = True
+        return spec
+
+    def invalidate_caches(self):
+        # type: () -> None
+        pass
+
+
+def install():
+    # type: () -> t.Optional[BundleFinder]
+    """Make the bundled extensions importable, if there is a bundle."""
+    for finder in sys.meta_path:
+        if isinstance(finder, BundleFinder):
+            return finder
+
+    path = bundle_path()
+    if path is None:
+        return None
+
+    finder = BundleFinder(path)
+    sys.meta_path.insert(0, finder)
+    return finder
@@ -0,0 +1,37 @@
+#ifndef DDTRACE_CLOCK_H
+#define DDTRACE_CLOCK_H
+
+#include "_stdint.h"
+
+#ifdef _MSC_VER
+#include <windows.h>
+#define inline __inline
+#else
+#include <time.h>
+#endif
+
+/*
+ * Nanoseconds since the Unix epoch, as time.time_ns() returns, read straight from the clock: clock_gettime() is
+ * served by the vDSO on Linux, so this doesn't enter the kernel, nor go through the time module.
+ */
+static inline uint64_t
+clock_wall_ns(void)
+{
+#ifdef _MSC_VER
+    FILETIME ft;
+    ULARGE_INTEGER ticks;
+
+    GetSystemTimePreciseAsFileTime(&ft);
+    ticks.LowPart = ft.dwLowDateTime;
+    ticks.HighPart = ft.dwHighDateTime;
+    // 100ns ticks since 1601-01-01
+    return (ticks.QuadPart - (uint64_t)116444736000000000ULL) * 100;
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * (uint64_t)1000000000ULL + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+#endif
@@ -0,0 +1,89 @@
+#define _GNU_SOURCE
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+/* Datagrams handed to the kernel by each call to sendmmsg() */
+#define DATAGRAMS_PER_CALL 64
+
+/* Sends the payloads (bytes) on the connected socket fd with as few system calls as possible, one datagram each.
+   Returns how many were sent: the first one not sent hit an error, which is left to the caller to handle, e.g. by
+   sending it again the usual way. */
+static PyObject*
+send_datagrams(PyObject* Py_UNUSED(module), PyObject* args)
+{
+    int fd;
+    PyObject* payloads;
+    PyObject* seq;
+    Py_ssize_t count;
+    Py_ssize_t sent = 0;
+    struct mmsghdr msgs[DATAGRAMS_PER_CALL];
+    struct iovec iovs[DATAGRAMS_PER_CALL];
+
+    if (!PyArg_ParseTuple(args, "iO:send_datagrams", &fd, &payloads))
+        return NULL;
+
+    seq = PySequence_Fast(payloads, "payloads must be a sequence of bytes");
+    if (seq == NULL)
+        return NULL;
+
+    count = PySequence_Fast_GET_SIZE(seq);
+    for (Py_ssize_t i = 0; i < count; i++) {
+        if (!PyBytes_Check(PySequence_Fast_GET_ITEM(seq, i))) {
+            PyErr_SetString(PyExc_TypeError, "payloads must be a sequence of bytes");
+            Py_DECREF(seq);
+            return NULL;
+        }
+    }
+
+    while (sent < count) {
+        unsigned int batch = (unsigned int)(count - sent < DATAGRAMS_PER_CALL ? count - sent : DATAGRAMS_PER_CALL);
+        int result;
+
+        memset(msgs, 0, sizeof(msgs[0]) * batch);
+        for (unsigned int i = 0; i < batch; i++) {
+            PyObject* payload = PySequence_Fast_GET_ITEM(seq, sent + i);
+
+            iovs[i].iov_base = PyBytes_AS_STRING(payload);
+            iovs[i].iov_len = (size_t)PyBytes_GET_SIZE(payload);
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        /* The payloads are kept alive by seq, and bytes are immutable */
+        Py_BEGIN_ALLOW_THREADS;
+        do {
+            result = sendmmsg(fd, msgs, batch, MSG_DONTWAIT);
+        } while (result < 0 && errno == EINTR);
+        Py_END_ALLOW_THREADS;
+
+        if (result <= 0)
+            break;
+
+        sent += result;
+        if ((unsigned int)result < batch)
+            break;
+    }
+
+    Py_DECREF(seq);
+    return PyLong_FromSsize_t(sent);
+}
+
+static PyMethodDef DogStatsdMethods[] = {
+    { "send_datagrams", (PyCFunction)send_datagrams, METH_VARARGS, "Send each payload as a datagram on the socket" },
+    { NULL, NULL, 0, NULL }
+};
+
+static struct PyModuleDef dogstatsd_module = {
+    PyModuleDef_HEAD_INIT, "ddtrace.internal._dogstatsd", "batched sending of DogStatsD datagrams", -1, DogStatsdMethods
+};
+
+PyMODINIT_FUNC
+PyInit__dogstatsd(void)
+{
+    return PyModule_Create(&dogstatsd_module);
+}
@@ -1,6 +1,8 @@
 from typing import Any
+from typing import Dict
 from typing import List
 from typing import Optional
+from typing import Tuple
 from typing import Union
 
 from ddtrace._trace.span import Span
@@ -16,6 +18,55 @@ class BufferFull(Exception):
 class BufferItemTooLarge(Exception):
     pass
 
+class EncodedPayload(object):
+    def __len__(self) -> int: ...
+    def __bytes__(self) -> bytes: ...
+    def chunks(self, max_chunk_size: int = 0) -> Tuple[memoryview, ...]: ...
+
+class TraceQueue(object):
+    def __init__(self, capacity: int) -> None: ...
+    def __len__(self) -> int: ...
+    @property
+    def capacity(self) -> int: ...
+    def put(self, trace: Trace) -> bool: ...
+    def drain(self) -> List[Trace]: ...
+
+# The API of a TagMap is the one of a dict, which it replaces in spans
+class TagMap(Dict[Any, Any]): ...
+
+class StoredSpan(object):
+    trace_id: int
+    span_id: int
+    parent_id: Optional[int]
+    name: Optional[str]
+    service: Optional[str]
+    resource: Optional[str]
+    span_type: Optional[str]
+    start_ns: int
+    duration_ns: int
+    error: int
+    def finish(self, finish_ns: int) -> None: ...
+    def set_tag(self, key: str, value: str) -> None: ...
+    def get_tag(self, key: str) -> Optional[str]: ...
+    def set_metric(self, key: str, value: float) -> None: ...
+    def get_metric(self, key: str) -> Optional[float]: ...
+
+class SpanStore(object):
+    trace_id: int
+    def __init__(self, trace_id: int) -> None: ...
+    def __len__(self) -> int: ...
+    def __getitem__(self, i: int) -> StoredSpan: ...
+    def add_span(
+        self,
+        name: str,
+        service: Optional[str] = None,
+        resource: Optional[str] = None,
+        span_type: Optional[str] = None,
+        span_id: int = 0,
+        parent_id: Optional[int] = None,
+        start_ns: int = 0,
+    ) -> StoredSpan: ...
+
 class BufferedEncoder(object):
     max_size: int
     max_item_size: int
@@ -23,6 +74,7 @@ class BufferedEncoder(object):
     def __len__(self) -> int: ...
     def put(self, item: Any) -> None: ...
     def encode(self) -> Optional[bytes]: ...
+    def encode_payload(self) -> Optional[Union[bytes, EncodedPayload]]: ...
     @property
     def size(self) -> int: ...
 
@@ -32,6 +84,7 @@ class ListBufferedEncoder(BufferedEncoder):
 
 class MsgpackEncoderBase(BufferedEncoder):
     content_type: str
+    def put_store(self, store: SpanStore) -> None: ...
     def get_bytes(self) -> bytes: ...
     def _decode(self, data: Union[str, bytes]) -> Any: ...
 
@@ -1,8 +1,13 @@
 from cpython cimport *
+from cpython.buffer cimport PyBuffer_FillInfo
 from cpython.bytearray cimport PyByteArray_CheckExact
 from libc cimport stdint
+from libc.string cimport memcpy
+from libc.string cimport memmove
+from libc.string cimport memset
 from libc.string cimport strlen
 
+from collections.abc import MutableMapping
 from json import dumps as json_dumps
 import threading
 from json import dumps as json_dumps
@@ -23,15 +28,28 @@ from ..constants import ORIGIN_KEY
 from .constants import SPAN_LINKS_KEY
 from .constants import SPAN_EVENTS_KEY
 from .constants import MAX_UINT_64BITS
+from .utils.formats import flatten_key_value
 
 
 DEF MSGPACK_ARRAY_LENGTH_PREFIX_SIZE = 5
 DEF MSGPACK_STRING_TABLE_LENGTH_PREFIX_SIZE = 6
+# Initial size of the encoding buffers, which grow as traces are packed
+DEF MSGPACK_BUFFER_SIZE = 64*1024
+DEF MAX_POOLED_BUFFERS = 8
+DEF MAX_POOLED_SIZE = 32*1024*1024
 
 
 cdef extern from "Python.h":
     const char* PyUnicode_AsUTF8(object o)
 
+    ctypedef struct PyMemberDef:
+        Py_ssize_t offset
+
+    ctypedef struct PyMemberDescrObject:
+        PyMemberDef *d_member
+
+    PyTypeObject PyMemberDescr_Type
+
 cdef extern from "pack.h":
     struct msgpack_packer:
         char* buf
@@ -55,6 +73,12 @@ cdef extern from "pack.h":
     int msgpack_pack_int64(msgpack_packer* pk, stdint.int64_t d)
     int msgpack_pack_true(msgpack_packer* pk)
     int msgpack_pack_false(msgpack_packer* pk)
+    # Fast path for the fields of the spans, whose room is reserved at once
+    enum: MSGPACK_MAX_NUMBER_SIZE
+    char* msgpack_pack_reserve(msgpack_packer* pk, size_t l)
+    char* msgpack_put_uint64(char* dst, stdint.uint64_t d)
+    char* msgpack_put_int64(char* dst, stdint.int64_t d)
+    char* msgpack_put_fixstr(char* dst, const char* b, size_t l)
 
 
 cdef long long ITEM_LIMIT = (2**32)-1
@@ -159,53 +183,534 @@ cdef inline int pack_text(msgpack_packer *pk, object text) except? -1:
     raise TypeError("Unhandled text type: %r" % type(text))
 
 
+cdef int pack_object(msgpack_packer *pk, object o, object default) except -1:
+    """Pack the basic Python types supported by Packer, calling default for the others if set"""
+    cdef long long llval
+    cdef unsigned long long ullval
+    cdef long longval
+    cdef double dval
+    cdef char* rawval
+    cdef int ret
+    cdef dict d
+    cdef Py_ssize_t L
+    cdef int default_used = 0
+
+    while True:
+        if o is None:
+            ret = msgpack_pack_nil(pk)
+        elif PyLong_CheckExact(o):
+            # PyInt_Check(long) is True for Python 3.
+            # So we should test long before int.
+            try:
+                if o > 0:
+                    ullval = o
+                    ret = msgpack_pack_unsigned_long_long(pk, ullval)
+                else:
+                    llval = o
+                    ret = msgpack_pack_long_long(pk, llval)
+            except OverflowError as oe:
+                if not default_used and default is not None:
+                    o = default(o)
+                    default_used = True
+                    continue
+                else:
+                    raise OverflowError("Integer value out of range")
+        elif PyInt_CheckExact(o):
+            longval = o
+            ret = msgpack_pack_long(pk, longval)
+        elif PyFloat_CheckExact(o):
+            dval = o
+            ret = msgpack_pack_double(pk, dval)
+        elif PyBytesLike_CheckExact(o):
+            L = len(o)
+            if L > ITEM_LIMIT:
+                PyErr_Format(ValueError, b"%.200s object is too large", Py_TYPE(o).tp_name)
+            rawval = o
+            ret = msgpack_pack_bin(pk, L)
+            if ret == 0:
+                ret = msgpack_pack_raw_body(pk, rawval, L)
+        elif PyUnicode_CheckExact(o):
+            ret = msgpack_pack_unicode(pk, o, ITEM_LIMIT)
+            if ret == -2:
+                raise ValueError("unicode string is too large")
+        elif PyDict_CheckExact(o):
+            d = <dict>o
+            L = len(d)
+            if L > ITEM_LIMIT:
+                raise ValueError("dict is too large")
+            ret = msgpack_pack_map(pk, L)
+            if ret == 0:
+                for k, v in d.items():
+                    ret = pack_object(pk, k, default)
+                    if ret != 0:
+                        break
+                    ret = pack_object(pk, v, default)
+                    if ret != 0:
+                        break
+        elif PyList_CheckExact(o):
+            L = Py_SIZE(o)
+            if L > ITEM_LIMIT:
+                raise ValueError("list is too large")
+            ret = msgpack_pack_array(pk, L)
+            if ret == 0:
+                for v in o:
+                    ret = pack_object(pk, v, default)
+                    if ret != 0:
+                        break
+        elif PyBool_Check(o):
+            if o:
+                ret = msgpack_pack_true(pk)
+            else:
+                ret = msgpack_pack_false(pk)
+        else:
+            PyErr_Format(TypeError, b"can not serialize '%.200s' object", Py_TYPE(o).tp_name)
+        return ret
+
+
+cdef int pack_object_bin(msgpack_packer *pk, object o) except -1:
+    """Pack the object in a bin object, like packing the bytes of packb(o), but packing it in place"""
+    cdef size_t start = pk.length
+    cdef size_t L
+    cdef size_t header_size
+    cdef int ret
+
+    # The object is packed past the largest header, and moved back to its start once the size of the header is
+    # known, which spares packing it in a buffer of its own first
+    if msgpack_pack_reserve(pk, 5) == NULL:
+        return -1
+    pk.length += 5
+
+    ret = pack_object(pk, o, None)
+    if ret != 0:
+        return ret
+
+    L = pk.length - start - 5
+    if L > ITEM_LIMIT:
+        raise ValueError("bin object is too large")
+    header_size = 2 if L < 256 else 3 if L < 65536 else 5
+    if header_size < 5:
+        memmove(pk.buf + start + header_size, pk.buf + start + 5, L)
+
+    # The room of the header is already there, as well as its content
+    pk.length = start
+    ret = msgpack_pack_bin(pk, L)
+    pk.length = start + header_size + L
+    return ret
+
+
+# Offsets of the slots of Span read by the encoders. Spans are packed by reading these slots directly instead of
+# looking up each attribute by name. Instances of other types, like subclasses of Span which may override some of
+# the attributes, are still packed through their attributes.
+cdef struct SpanSlots:
+    Py_ssize_t service
+    Py_ssize_t name
+    Py_ssize_t resource
+    Py_ssize_t trace_id
+    Py_ssize_t span_id
+    Py_ssize_t parent_id
+    Py_ssize_t start_ns
+    Py_ssize_t duration_ns
+    Py_ssize_t error
+    Py_ssize_t span_type
+    Py_ssize_t meta
+    Py_ssize_t meta_struct
+    Py_ssize_t metrics
+    Py_ssize_t links
+    Py_ssize_t events
+
+
+cdef SpanSlots _span_slots
+cdef object _Span = None
+
+
+cdef inline Py_ssize_t _slot_offset(object cls_dict, str name) except -1:
+    descr = cls_dict[name]
+    if Py_TYPE(descr) != &PyMemberDescr_Type:
+        raise TypeError("Span.%s is not a slot" % name)
+    return (<PyMemberDescrObject *> descr).d_member.offset
+
+
+cdef int _init_span_slots() except -1:
+    global _Span
+
+    # Imported on first use, so that importing the encoders never imports the tracer
+    from ddtrace._trace.span import Span
+
+    cls_dict = Span.__dict__
+    _span_slots.service = _slot_offset(cls_dict, "service")
+    _span_slots.name = _slot_offset(cls_dict, "name")
+    _span_slots.resource = _slot_offset(cls_dict, "_resource")
+    _span_slots.trace_id = _slot_offset(cls_dict, "trace_id")
+    _span_slots.span_id = _slot_offset(cls_dict, "span_id")
+    _span_slots.parent_id = _slot_offset(cls_dict, "parent_id")
+    _span_slots.start_ns = _slot_offset(cls_dict, "start_ns")
+    _span_slots.duration_ns = _slot_offset(cls_dict, "duration_ns")
+    _span_slots.error = _slot_offset(cls_dict, "error")
+    _span_slots.span_type = _slot_offset(cls_dict, "span_type")
+    _span_slots.meta = _slot_offset(cls_dict, "_meta")
+    _span_slots.meta_struct = _slot_offset(cls_dict, "_meta_struct")
+    _span_slots.metrics = _slot_offset(cls_dict, "_metrics")
+    _span_slots.links = _slot_offset(cls_dict, "_links")
+    _span_slots.events = _slot_offset(cls_dict, "_events")
+    _Span = Span
+    return 0
+
+
+cdef inline object _span_slot(object span, Py_ssize_t offset):
+    cdef PyObject *value = (<PyObject **> (<char *> <PyObject *> span + offset))[0]
+    if value is NULL:
+        raise AttributeError("span slot at offset %d is not set" % offset)
+    return <object> value
+
+
+cdef inline object _span_field(object span, bint is_span, Py_ssize_t offset, str name):
+    if is_span:
+        return _span_slot(span, offset)
+    return getattr(span, name)
+
+
+cdef inline object _span_resource(object span, bint is_span):
+    if is_span:
+        return (<list> _span_slot(span, _span_slots.resource))[0]
+    return span.resource
+
+
+cdef inline object _span_trace_id_64bits(object span, bint is_span):
+    if is_span:
+        return _span_slot(span, _span_slots.trace_id) & MAX_UINT_64BITS
+    return span._trace_id_64bits
+
+
+cdef inline Py_ssize_t _min_text_size(object text):
+    """Lower bound of the size of packed text: a string has at least as many UTF-8 bytes as characters"""
+    if PyUnicode_Check(text):
+        return 1 + len(<str> text)
+    if PyBytesLike_Check(text):
+        return 1 + len(text)
+    return 1
+
+
+cdef struct PooledBuffer:
+    char *buf
+    size_t size
+
+
+# Buffers of the payloads which were sent, reused by the next payloads. Only accessed with the GIL held.
+cdef PooledBuffer _buffer_pool[MAX_POOLED_BUFFERS]
+cdef int _buffer_pool_len = 0
+cdef size_t _buffer_pool_size = 0
+
+
+cdef inline size_t buffer_size_class(size_t size):
+    """Return the size of the buffers to allocate to hold size bytes"""
+    cdef size_t buf_size = MSGPACK_BUFFER_SIZE
+    while buf_size < size:
+        buf_size <<= 1
+    return buf_size
+
+
+cdef inline size_t next_size_hint(size_t hint, size_t size):
+    """Follow the recent payload sizes: grow with a larger payload at once, shrink by a quarter per smaller one"""
+    return size if size > hint - (hint >> 2) else hint - (hint >> 2)
+
+
+cdef int acquire_buffer(msgpack_packer *pk, size_t buf_size) except -1:
+    """Give the packer an empty buffer of at least buf_size bytes"""
+    global _buffer_pool_len, _buffer_pool_size
+    cdef int i
+    cdef int best = -1
+
+    buf_size = buffer_size_class(buf_size)
+
+    # The smallest buffer large enough is taken, so that the larger ones stay for the larger payloads
+    for i in range(_buffer_pool_len):
+        if _buffer_pool[i].size >= buf_size and (best < 0 or _buffer_pool[i].size < _buffer_pool[best].size):
+            best = i
+            if _buffer_pool[i].size == buf_size:
+                break
+
+    if best >= 0:
+        pk.buf = _buffer_pool[best].buf
+        pk.buf_size = _buffer_pool[best].size
+        _buffer_pool_size -= _buffer_pool[best].size
+        _buffer_pool_len -= 1
+        _buffer_pool[best] = _buffer_pool[_buffer_pool_len]
+        pk.length = 0
+        return 0
+
+    pk.buf = <char*> PyMem_Malloc(buf_size)
+    if pk.buf == NULL:
+        raise MemoryError("Unable to allocate internal buffer.")
+    pk.buf_size = buf_size
+    pk.length = 0
+    return 0
+
+
+cdef void release_buffer(char *buf, size_t size):
+    global _buffer_pool_len, _buffer_pool_size
+    cdef int i
+    cdef int smallest = 0
+
+    if buf == NULL:
+        return
+
+    if _buffer_pool_size + size > MAX_POOLED_SIZE:
+        PyMem_Free(buf)
+        return
+
+    if _buffer_pool_len == MAX_POOLED_BUFFERS:
+        # Replace the smallest buffer, which is the cheapest to allocate again
+        for i in range(1, _buffer_pool_len):
+            if _buffer_pool[i].size < _buffer_pool[smallest].size:
+                smallest = i
+        if _buffer_pool[smallest].size >= size:
+            PyMem_Free(buf)
+            return
+        PyMem_Free(_buffer_pool[smallest].buf)
+        _buffer_pool_size -= _buffer_pool[smallest].size
+        _buffer_pool_len -= 1
+        _buffer_pool[smallest] = _buffer_pool[_buffer_pool_len]
+
+    _buffer_pool[_buffer_pool_len].buf = buf
+    _buffer_pool[_buffer_pool_len].size = size
+    _buffer_pool_len += 1
+    _buffer_pool_size += size
+
+
+cdef class PayloadChunk(object):
+    """Memory an encoded payload was packed into, exported through the buffer protocol."""
+    cdef char *buf
+    cdef size_t buf_size
+    cdef Py_ssize_t offset
+    cdef Py_ssize_t length
+
+    def __dealloc__(self):
+        release_buffer(self.buf, self.buf_size)
+        self.buf = NULL
+
+    def __getbuffer__(self, Py_buffer *buffer, int flags):
+        PyBuffer_FillInfo(buffer, self, self.buf + self.offset, self.length, 1, flags)
+
+    def __releasebuffer__(self, Py_buffer *buffer):
+        pass
+
+    def __len__(self):
+        return self.length
+
+
+cdef PayloadChunk take_packer_buffer(msgpack_packer *pk, size_t offset, size_t buf_size):
+    """Transfer the ownership of the packer buffer to a payload chunk and give the packer a new buffer"""
+    cdef PayloadChunk chunk = PayloadChunk.__new__(PayloadChunk)
+    chunk.buf = pk.buf
+    chunk.buf_size = pk.buf_size
+    chunk.offset = offset
+    chunk.length = pk.length - offset
+
+    pk.buf = NULL
+    acquire_buffer(pk, buf_size)
+    return chunk
+
+
+cdef class EncodedPayload(object):
+    """Encoded traces, made of the chunks of memory they were packed into.
+
+    The chunks can be sent one after the other without being copied. Accessing the payload through the buffer
+    protocol joins them on first use when there are several.
+    """
+    cdef tuple _chunks
+    cdef Py_ssize_t _length
+    cdef bytes _joined
+
+    def __cinit__(self, tuple chunks):
+        cdef PayloadChunk chunk
+        self._chunks = chunks
+        self._length = 0
+        for chunk in chunks:
+            self._length += chunk.length
+        self._joined = None
+
+    def __len__(self):
+        return self._length
+
+    def chunks(self, size_t max_chunk_size=0):
+        """Return the chunks of the payload, in order, as memoryviews.
+
+        Chunks longer than max_chunk_size, when given, are split into views of at most max_chunk_size bytes.
+        """
+        cdef list views = []
+        cdef Py_ssize_t start
+
+        for chunk in self._chunks:
+            view = memoryview(chunk)
+            if max_chunk_size == 0:
+                views.append(view)
+                continue
+            for start in range(0, len(view), max_chunk_size):
+                views.append(view[start:start + max_chunk_size])
+        return tuple(views)
+
+    def __getbuffer__(self, Py_buffer *buffer, int flags):
+        cdef PayloadChunk chunk
+        if len(self._chunks) == 1:
+            chunk = self._chunks[0]
+            PyBuffer_FillInfo(buffer, self, chunk.buf + chunk.offset, chunk.length, 1, flags)
+            return
+
+        if self._joined is None:
+            self._joined = b"".join(self._chunks)
+        PyBuffer_FillInfo(buffer, self, PyBytes_AS_STRING(self._joined), self._length, 1, flags)
+
+    def __releasebuffer__(self, Py_buffer *buffer):
+        pass
+
+    def __bytes__(self):
+        if self._joined is not None:
+            return self._joined
+        return b"".join(self._chunks)
+
+
+cdef struct StringTableEntry:
+    PyObject *string
+    Py_hash_t hash
+
+
+DEF STRING_TABLE_INITIAL_CAPACITY = 64
+
+
 cdef class StringTable(object):
-    cdef dict _table
+    # Open addressing table with linear probing. The entries are stored in the order of their ids and the slots
+    # hold the id + 1 of their entry, 0 marking an empty slot. Nothing is ever removed but the latest entries, so
+    # emptying their slots in the reverse order of their insertion restores the table as it was before them.
+    cdef StringTableEntry *_entries
+    cdef stdint.uint32_t *_slots
+    cdef size_t _capacity
     cdef stdint.uint32_t _next_id
 
+    def __cinit__(self, *args, **kwargs):
+        self._capacity = STRING_TABLE_INITIAL_CAPACITY
+        self._slots = <stdint.uint32_t *> PyMem_Malloc(self._capacity * sizeof(stdint.uint32_t))
+        self._entries = <StringTableEntry *> PyMem_Malloc((self._capacity >> 1) * sizeof(StringTableEntry))
+        if self._slots == NULL or self._entries == NULL:
+            raise MemoryError("Unable to allocate string table.")
+        memset(self._slots, 0, self._capacity * sizeof(stdint.uint32_t))
+        self._next_id = 0
+
     def __init__(self):
-        self._table = {"": 0}
-        self.insert("")
-        self._next_id = 1
+        self._index("")
+
+    def __dealloc__(self):
+        cdef stdint.uint32_t i
+        if self._entries != NULL:
+            for i in range(self._next_id):
+                Py_XDECREF(self._entries[i].string)
+        PyMem_Free(self._entries)
+        self._entries = NULL
+        PyMem_Free(self._slots)
+        self._slots = NULL
 
     cdef insert(self, object string):
         pass
 
+    cdef Py_ssize_t _lookup(self, object string, Py_hash_t h) except -1:
+        """Return the slot of the string, or the empty slot where it would be added"""
+        cdef size_t mask = self._capacity - 1
+        cdef size_t i = <size_t> h & mask
+        cdef StringTableEntry *entry
+
+        while self._slots[i] != 0:
+            entry = &self._entries[self._slots[i] - 1]
+            if entry.string == <PyObject *> string or (
+                entry.hash == h and PyObject_RichCompareBool(<object> entry.string, string, Py_EQ)
+            ):
+                return i
+            i = (i + 1) & mask
+        return i
+
+    cdef int _grow(self) except -1:
+        cdef size_t capacity = self._capacity << 1
+        cdef size_t mask = capacity - 1
+        cdef stdint.uint32_t *slots
+        cdef StringTableEntry *entries
+        cdef size_t i
+        cdef stdint.uint32_t _id
+
+        slots = <stdint.uint32_t *> PyMem_Malloc(capacity * sizeof(stdint.uint32_t))
+        if slots == NULL:
+            raise MemoryError("Unable to grow string table.")
+        memset(slots, 0, capacity * sizeof(stdint.uint32_t))
+        entries = <StringTableEntry *> PyMem_Realloc(self._entries, (capacity >> 1) * sizeof(StringTableEntry))
+        if entries == NULL:
+            PyMem_Free(slots)
+            raise MemoryError("Unable to grow string table.")
+        self._entries = entries
+
+        # Adding the entries in the order of their ids keeps the rollback by insertion order valid
+        for _id in range(self._next_id):
+            i = <size_t> entries[_id].hash & mask
+            while slots[i] != 0:
+                i = (i + 1) & mask
+            slots[i] = _id + 1
+
+        PyMem_Free(self._slots)
+        self._slots = slots
+        self._capacity = capacity
+        return 0
+
     cdef stdint.uint32_t _index(self, object string) except? -1:
         cdef stdint.uint32_t _id
-        cdef int ret
+        cdef Py_hash_t h
+        cdef Py_ssize_t slot
 
         if string is None:
             return 0
 
-        ret = PyDict_Contains(self._table, string)
-        if ret == -1:
-            return ret
-        if ret:
-            return PyLong_AsLong(<object>PyDict_GetItem(self._table, string))
+        h = PyObject_Hash(string)
+        slot = self._lookup(string, h)
+        if self._slots[slot] != 0:
+            return self._slots[slot] - 1
 
-        _id = self._next_id
-        ret = PyDict_SetItem(self._table, string, PyLong_FromLong(_id))
-        if ret == -1:
-            return ret
         self.insert(string)
+
+        # The table is kept at most half full
+        if (<size_t> self._next_id + 1) << 1 > self._capacity:
+            self._grow()
+            slot = self._lookup(string, h)
+
+        _id = self._next_id
+        Py_INCREF(string)
+        self._entries[_id].string = <PyObject *> string
+        self._entries[_id].hash = h
+        self._slots[slot] = _id + 1
         self._next_id += 1
         return _id
 
     cpdef stdint.uint32_t index(self, object string) except? -1:
         return self._index(string)
 
+    cdef truncate(self, stdint.uint32_t size):
+        """Remove the strings with an id greater than or equal to size"""
+        cdef size_t mask = self._capacity - 1
+        cdef size_t i
+        cdef stdint.uint32_t _id
+
+        while self._next_id > size:
+            _id = self._next_id - 1
+            i = <size_t> self._entries[_id].hash & mask
+            while self._slots[i] != _id + 1:
+                i = (i + 1) & mask
+            self._slots[i] = 0
+            Py_XDECREF(self._entries[_id].string)
+            self._next_id = _id
+
     cdef reset(self):
-        PyDict_Clear(self._table)
-        PyDict_SetItem(self._table, "", 0)
+        self.truncate(1)
         self.insert("")
-        self._next_id = 1
 
     def __len__(self):
         return PyLong_FromLong(self._next_id)
 
     def __contains__(self, object string):
-        return PyBool_FromLong(PyDict_Contains(self._table, string))
+        return PyBool_FromLong(self._slots[self._lookup(string, PyObject_Hash(string))] != 0)
 
 
 cdef class ListStringTable(StringTable):
@@ -230,12 +735,11 @@ cdef class MsgpackStringTable(StringTable):
     cdef stdint.uint32_t _sp_id
     cdef object _lock
     cdef size_t _reset_size
+    cdef size_t _size_hint
 
     def __init__(self, max_size):
-        self.pk.buf_size = min(max_size, 1 << 20)
-        self.pk.buf = <char*> PyMem_Malloc(self.pk.buf_size)
-        if self.pk.buf == NULL:
-            raise MemoryError("Unable to allocate internal buffer.")
+        acquire_buffer(&self.pk, MSGPACK_BUFFER_SIZE)
+        self._size_hint = MSGPACK_BUFFER_SIZE
         self.max_size = max_size
         self._max_string_length = int(0.1*max_size)
         self.pk.length = MSGPACK_STRING_TABLE_LENGTH_PREFIX_SIZE
@@ -247,7 +751,7 @@ cdef class MsgpackStringTable(StringTable):
         self._reset_size = self.pk.length
 
     def __dealloc__(self):
-        PyMem_Free(self.pk.buf)
+        release_buffer(self.pk.buf, self.pk.buf_size)
         self.pk.buf = NULL
 
     cdef insert(self, object string):
@@ -276,66 +780,63 @@ cdef class MsgpackStringTable(StringTable):
     cdef rollback(self):
         if self._sp_len > 0:
             self.pk.length = self._sp_len
-            self._next_id = self._sp_id
-
-        # After rolling back the string table next_id we must remove all stale string -> _id pairs
-        # This will resolve two classes of encoding errors:
-        #  - multiple strings referencing the same string table index. In this scenario
-        #    two different strings in the encoded trace could be serialized with the same _id. In this scenario
-        #    two different strings could reference one string in the encoded trace (string swapping).
-        # - when the string table references an index of the string table that is not serialized. The encoded
-        #    trace can not be decoded without accessing an invalid index. In this scenario the agent will
-        #    return a 400 status code.
-        self._table = {s: idx for s, idx in self._table.items() if idx < self._next_id}
+            # The strings added since the savepoint must be removed with the bytes they were serialized to,
+            # otherwise the encoded traces could reference indices beyond the serialized table.
+            self.truncate(self._sp_id)
 
-    cdef get_bytes(self):
+    cdef int _update_prefixes(self):
+        """Update the table and root array size prefixes and return the offset of the payload, or -1 on error"""
         cdef int ret
-        cdef stdint.uint32_t table_size
+        cdef stdint.uint32_t table_size = self._next_id
+        cdef int offset = MSGPACK_STRING_TABLE_LENGTH_PREFIX_SIZE - array_prefix_size(table_size)
+        cdef int old_pos = self.pk.length
+
+        # Update table size prefix
+        self.pk.length = offset
+        ret = msgpack_pack_array(&self.pk, table_size)
+        if ret:
+            return -1
+        # Add root array size prefix
+        self.pk.length = offset = offset - 1
+        ret = msgpack_pack_array(&self.pk, 2)
+        if ret:
+            return -1
+        self.pk.length = old_pos
+        return offset
+
+    cdef get_bytes(self):
         cdef int offset
-        cdef int old_pos
         with self._lock:
-            table_size = self._next_id
-            offset = MSGPACK_STRING_TABLE_LENGTH_PREFIX_SIZE - array_prefix_size(table_size)
-            old_pos = self.pk.length
-
-            # Update table size prefix
-            self.pk.length = offset
-            ret = msgpack_pack_array(&self.pk, table_size)
-            if ret:
+            offset = self._update_prefixes()
+            if offset < 0:
                 return None
-            # Add root array size prefix
-            self.pk.length = offset = offset - 1
-            ret = msgpack_pack_array(&self.pk, 2)
-            if ret:
-                return None
-            self.pk.length = old_pos
 
             return PyBytes_FromStringAndSize(self.pk.buf + offset, self.pk.length - offset)
 
+    cdef PayloadChunk take_chunk(self):
+        """Hand the serialized table over to a payload chunk and reset the table"""
+        cdef int offset
+        cdef PayloadChunk chunk
+        with self._lock:
+            offset = self._update_prefixes()
+            if offset < 0:
+                raise RuntimeError("Couldn't serialize msgpack string table")
+
+            self._size_hint = next_size_hint(self._size_hint, self.pk.length)
+            chunk = take_packer_buffer(&self.pk, offset, self._size_hint)
+            # The strings kept by the reset are serialized at the start of the buffer
+            memcpy(self.pk.buf, chunk.buf, self._reset_size)
+            self.reset()
+            return chunk
+
     @property
     def size(self):
         with self._lock:
             return self.pk.length - MSGPACK_ARRAY_LENGTH_PREFIX_SIZE + array_prefix_size(self._next_id)
 
-    cdef append_raw(self, long src, Py_ssize_t size):
-        cdef int res
-        with self._lock:
-            if self.size + size > self.max_size:
-                raise BufferFull(
-                    "Cannot append raw bytes: string table is full (current size: %d, max size: %d)." % (
-                        self.size, self.max_size
-                    )
-                )
-            res = msgpack_pack_raw_body(&self.pk, <char *>PyLong_AsLong(src), size)
-            if res != 0:
-                raise RuntimeError("Failed to append raw bytes to msgpack string table")
-
     cdef reset(self):
-        StringTable.reset(self)
-        assert self._next_id == 1
-
-        PyDict_SetItem(self._table, ORIGIN_KEY, 1)
-        self._next_id = 2
+        # Keep "" and the origin key, which are serialized first
+        self.truncate(2)
         self.pk.length = self._reset_size
         self._sp_len = 0
 
@@ -347,6 +848,618 @@ cdef class MsgpackStringTable(StringTable):
                 self.reset()
 
 
+cdef class TraceQueue(object):
+    """Ring buffer of the finished traces waiting to be encoded.
+
+    Traces are put by the threads finishing them and drained in batches by the thread of the writer, which
+    is the only consumer. The queue relies on the GIL rather than on a lock: neither put() nor the part of
+    drain() which reads and releases the slots runs any Python code, so both are atomic with respect to
+    the other threads.
+    """
+
+    cdef PyObject **_slots
+    cdef size_t _capacity
+    cdef size_t _mask
+    # Number of traces ever put and ever drained, the slot of a trace being its number modulo the capacity
+    cdef size_t _head
+    cdef size_t _tail
+
+    def __cinit__(self, size_t capacity):
+        self._capacity = 1
+        while self._capacity < capacity:
+            self._capacity <<= 1
+        self._mask = self._capacity - 1
+        self._slots = <PyObject **> PyMem_Malloc(self._capacity * sizeof(PyObject *))
+        if self._slots == NULL:
+            raise MemoryError("Unable to allocate trace queue.")
+        self._head = 0
+        self._tail = 0
+
+    def __dealloc__(self):
+        if self._slots != NULL:
+            while self._tail != self._head:
+                Py_XDECREF(self._slots[self._tail & self._mask])
+                self._tail += 1
+            PyMem_Free(self._slots)
+            self._slots = NULL
+
+    def __len__(self):
+        return self._head - self._tail
+
+    @property
+    def capacity(self):
+        return self._capacity
+
+    cpdef bint put(self, object trace):
+        """Queue a trace, unless the queue is full, which is signaled by returning False."""
+        if self._head - self._tail >= self._capacity:
+            return False
+        Py_INCREF(trace)
+        self._slots[self._head & self._mask] = <PyObject *> trace
+        self._head += 1
+        return True
+
+    cpdef list drain(self):
+        """Take the queued traces, in the order they were put. Must not be called by two threads at once."""
+        cdef size_t head = self._head
+        cdef size_t tail = self._tail
+        cdef Py_ssize_t i
+        # The allocation might run a garbage collection, during which other threads can put more traces.
+        # They go after the snapshotted head, in slots which aren't released until the tail is moved.
+        cdef list traces = PyList_New(<Py_ssize_t> (head - tail))
+
+        for i in range(<Py_ssize_t> (head - tail)):
+            # The list takes over the reference held by the slot
+            PyList_SET_ITEM(traces, i, <object> self._slots[(tail + i) & self._mask])
+        self._tail = head
+        return traces
+
+
+# Number of tags a TagMap stores inline, above which they are moved to a dict
+DEF TAG_MAP_INLINE_SIZE = 16
+
+
+cdef struct TagMapEntry:
+    PyObject *key
+    PyObject *value
+
+
+cdef class TagMap(object):
+    """Mapping of the tags or metrics of a span, with the API of a dict.
+
+    Spans usually have few tags, which are stored inline, in the order they were set, and looked up by
+    identity first, since the tag names are mostly interned constants. Beyond TAG_MAP_INLINE_SIZE tags, the
+    map falls back to a dict. The encoders pack the inline tags directly.
+    """
+
+    cdef TagMapEntry _entries[TAG_MAP_INLINE_SIZE]
+    cdef Py_ssize_t _len
+    cdef dict _spilled
+
+    def __cinit__(self, *args, **kwargs):
+        self._len = 0
+        self._spilled = None
+
+    def __init__(self, mapping=None, **kwargs):
+        if mapping is not None:
+            self.update(mapping)
+        if kwargs:
+            self.update(kwargs)
+
+    def __dealloc__(self):
+        self._clear()
+
+    cdef void _clear(self):
+        cdef Py_ssize_t i
+        cdef Py_ssize_t n = self._len
+
+        self._len = 0
+        for i in range(n):
+            Py_XDECREF(self._entries[i].key)
+            Py_XDECREF(self._entries[i].value)
+
+    cdef Py_ssize_t _find(self, object key) except -2:
+        cdef Py_ssize_t i
+        cdef Py_hash_t h
+
+        for i in range(self._len):
+            if self._entries[i].key == <PyObject *> key:
+                return i
+
+        h = PyObject_Hash(key)
+        for i in range(self._len):
+            if PyObject_Hash(<object> self._entries[i].key) == h and <object> self._entries[i].key == key:
+                return i
+        return -1
+
+    cdef int _spill(self) except -1:
+        cdef Py_ssize_t i
+        cdef dict spilled = {}
+
+        for i in range(self._len):
+            spilled[<object> self._entries[i].key] = <object> self._entries[i].value
+        self._clear()
+        self._spilled = spilled
+        return 0
+
+    cdef int _set(self, object key, object value) except -1:
+        cdef Py_ssize_t i
+        cdef PyObject *old
+
+        if self._spilled is not None:
+            self._spilled[key] = value
+            return 0
+
+        i = self._find(key)
+        if i >= 0:
+            old = self._entries[i].value
+            Py_INCREF(value)
+            self._entries[i].value = <PyObject *> value
+            Py_XDECREF(old)
+            return 0
+
+        if self._len == TAG_MAP_INLINE_SIZE:
+            self._spill()
+            self._spilled[key] = value
+            return 0
+
+        Py_INCREF(key)
+        Py_INCREF(value)
+        self._entries[self._len].key = <PyObject *> key
+        self._entries[self._len].value = <PyObject *> value
+        self._len += 1
+        return 0
+
+    cdef object _remove(self, Py_ssize_t i):
+        """Remove the entry at ``i``, keeping the order of the others, and return its value"""
+        cdef PyObject *key = self._entries[i].key
+        cdef PyObject *value = self._entries[i].value
+
+        self._len -= 1
+        if i < self._len:
+            memmove(&self._entries[i], &self._entries[i + 1], (self._len - i) * sizeof(TagMapEntry))
+        result = <object> value
+        Py_XDECREF(key)
+        Py_XDECREF(value)
+        return result
+
+    def __len__(self):
+        if self._spilled is not None:
+            return len(self._spilled)
+        return self._len
+
+    def __contains__(self, key):
+        if self._spilled is not None:
+            return key in self._spilled
+        return self._find(key) >= 0
+
+    def __getitem__(self, key):
+        cdef Py_ssize_t i
+
+        if self._spilled is not None:
+            return self._spilled[key]
+        i = self._find(key)
+        if i < 0:
+            raise KeyError(key)
+        return <object> self._entries[i].value
+
+    def __setitem__(self, key, value):
+        self._set(key, value)
+
+    def __delitem__(self, key):
+        cdef Py_ssize_t i
+
+        if self._spilled is not None:
+            del self._spilled[key]
+            return
+        i = self._find(key)
+        if i < 0:
+            raise KeyError(key)
+        self._remove(i)
+
+    def __iter__(self):
+        return iter(self.keys())
+
+    def __eq__(self, other):
+        if isinstance(other, TagMap):
+            other = (<TagMap> other)._as_dict()
+        return self._as_dict() == other
+
+    def __ne__(self, other):
+        return not self == other
+
+    def __repr__(self):
+        return "TagMap(%r)" % (self._as_dict(),)
+
+    def __reduce__(self):
+        return (TagMap, (self._as_dict(),))
+
+    cdef dict _as_dict(self):
+        cdef Py_ssize_t i
+        cdef dict d
+
+        if self._spilled is not None:
+            return dict(self._spilled)
+        d = {}
+        for i in range(self._len):
+            d[<object> self._entries[i].key] = <object> self._entries[i].value
+        return d
+
+    def get(self, key, default=None):
+        cdef Py_ssize_t i
+
+        if self._spilled is not None:
+            return self._spilled.get(key, default)
+        i = self._find(key)
+        if i < 0:
+            return default
+        return <object> self._entries[i].value
+
+    def pop(self, key, *default):
+        cdef Py_ssize_t i
+
+        if self._spilled is not None:
+            return self._spilled.pop(key, *default)
+        i = self._find(key)
+        if i >= 0:
+            return self._remove(i)
+        if default:
+            return default[0]
+        raise KeyError(key)
+
+    def setdefault(self, key, default=None):
+        cdef Py_ssize_t i
+
+        if self._spilled is not None:
+            return self._spilled.setdefault(key, default)
+        i = self._find(key)
+        if i >= 0:
+            return <object> self._entries[i].value
+        self._set(key, default)
+        return default
+
+    def update(self, other=(), **kwargs):
+        if hasattr(other, "keys"):
+            for key in other.keys():
+                self._set(key, other[key])
+        else:
+            for key, value in other:
+                self._set(key, value)
+        for key, value in kwargs.items():
+            self._set(key, value)
+
+    def clear(self):
+        self._clear()
+        self._spilled = None
+
+    def copy(self):
+        """Return the tags as a dict"""
+        return self._as_dict()
+
+    def keys(self):
+        cdef Py_ssize_t i
+
+        if self._spilled is not None:
+            return list(self._spilled.keys())
+        return [<object> self._entries[i].key for i in range(self._len)]
+
+    def values(self):
+        cdef Py_ssize_t i
+
+        if self._spilled is not None:
+            return list(self._spilled.values())
+        return [<object> self._entries[i].value for i in range(self._len)]
+
+    def items(self):
+        cdef Py_ssize_t i
+
+        if self._spilled is not None:
+            return list(self._spilled.items())
+        return [(<object> self._entries[i].key, <object> self._entries[i].value) for i in range(self._len)]
+
+
+MutableMapping.register(TagMap)
+
+
+cdef inline object _tags_dict(object tags):
+    """The dict of tags of a TagMap which doesn't store them inline, else ``tags`` as is"""
+    if type(tags) is TagMap and (<TagMap> tags)._spilled is not None:
+        return (<TagMap> tags)._spilled
+    return tags
+
+
+DEF SPAN_STORE_INITIAL_CAPACITY = 8
+DEF NO_TAG = 0xFFFFFFFF
+
+
+cdef struct StoredSpanFields:
+    stdint.uint64_t span_id
+    stdint.uint64_t parent_id
+    stdint.int64_t start_ns
+    stdint.int64_t duration_ns
+    stdint.int32_t error
+    # Ids of the strings in the table of the store, 0 being the empty string, which stands for None
+    stdint.uint32_t service
+    stdint.uint32_t name
+    stdint.uint32_t resource
+    stdint.uint32_t span_type
+    # Last tag and metric set, which are linked to the previous ones
+    stdint.uint32_t meta
+    stdint.uint32_t meta_count
+    stdint.uint32_t metrics
+    stdint.uint32_t metrics_count
+
+
+cdef struct StoredTag:
+    stdint.uint32_t key
+    # Id of the string of a tag, unused by metrics
+    stdint.uint32_t value
+    double number
+    stdint.uint32_t next
+
+
+cdef int _grow_array(void **array, size_t *capacity, size_t item_size) except -1:
+    cdef size_t new_capacity = capacity[0] << 1
+    cdef void *new_array = PyMem_Realloc(array[0], new_capacity * item_size)
+    if new_array == NULL:
+        raise MemoryError("Unable to grow span store.")
+    array[0] = new_array
+    capacity[0] = new_capacity
+    return 0
+
+
+cdef class SpanStore(object):
+    """The spans of a trace, stored as contiguous arrays of fixed fields rather than as Span objects.
+
+    The tags and metrics of all the spans are kept in a single array, and their keys and string values are
+    interned in a string table shared by the spans, so a span costs no allocation but the growth of these
+    arrays. The spans are accessed from Python through StoredSpan handles, and the encoders pack them directly
+    from the arrays with put_store(). A store must not be changed while it is being put in an encoder.
+    """
+
+    cdef readonly stdint.uint64_t trace_id
+    cdef StoredSpanFields *_spans
+    cdef size_t _len
+    cdef size_t _capacity
+    cdef StoredTag *_tags
+    cdef size_t _tags_len
+    cdef size_t _tags_capacity
+    cdef ListStringTable _strings
+
+    def __cinit__(self, object trace_id):
+        # Like the encoders, spans only carry the lower 64 bits of a 128-bit trace id
+        self.trace_id = trace_id & MAX_UINT_64BITS
+        self._capacity = SPAN_STORE_INITIAL_CAPACITY
+        self._tags_capacity = SPAN_STORE_INITIAL_CAPACITY
+        self._spans = <StoredSpanFields *> PyMem_Malloc(self._capacity * sizeof(StoredSpanFields))
+        self._tags = <StoredTag *> PyMem_Malloc(self._tags_capacity * sizeof(StoredTag))
+        if self._spans == NULL or self._tags == NULL:
+            raise MemoryError("Unable to allocate span store.")
+        self._len = 0
+        self._tags_len = 0
+        self._strings = ListStringTable()
+
+    def __dealloc__(self):
+        PyMem_Free(self._spans)
+        self._spans = NULL
+        PyMem_Free(self._tags)
+        self._tags = NULL
+
+    def __len__(self):
+        return self._len
+
+    def __getitem__(self, Py_ssize_t i):
+        if i < 0:
+            i += self._len
+        if not 0 <= i < <Py_ssize_t> self._len:
+            raise IndexError("span store index out of range")
+        return StoredSpan._new(self, i)
+
+    def add_span(
+        self,
+        str name,
+        str service=None,
+        str resource=None,
+        str span_type=None,
+        stdint.uint64_t span_id=0,
+        object parent_id=None,
+        stdint.int64_t start_ns=0,
+    ):
+        """Add a span to the store and return its handle."""
+        cdef StoredSpanFields *span
+        # The strings are interned first, the table may run Python code during which the arrays can be grown
+        cdef stdint.uint32_t name_id = self._strings._index(name)
+        cdef stdint.uint32_t service_id = self._strings._index(service)
+        cdef stdint.uint32_t resource_id = self._strings._index(resource if resource is not None else name)
+        cdef stdint.uint32_t span_type_id = self._strings._index(span_type)
+        cdef stdint.uint64_t parent = parent_id if parent_id is not None else 0
+
+        if self._len == self._capacity:
+            _grow_array(<void **> &self._spans, &self._capacity, sizeof(StoredSpanFields))
+
+        span = &self._spans[self._len]
+        span.span_id = span_id
+        span.parent_id = parent
+        span.start_ns = start_ns
+        span.duration_ns = 0
+        span.error = 0
+        span.service = service_id
+        span.name = name_id
+        span.resource = resource_id
+        span.span_type = span_type_id
+        span.meta = NO_TAG
+        span.meta_count = 0
+        span.metrics = NO_TAG
+        span.metrics_count = 0
+        self._len += 1
+        return StoredSpan._new(self, self._len - 1)
+
+    cdef inline object _string(self, stdint.uint32_t _id):
+        return self._strings._list[_id]
+
+    cdef Py_ssize_t _string_id(self, object string) except -2:
+        """Id of an interned string, or -1 if the table doesn't have it"""
+        cdef Py_ssize_t slot = self._strings._lookup(string, PyObject_Hash(string))
+        return <Py_ssize_t> self._strings._slots[slot] - 1
+
+    cdef StoredTag *_find_tag(self, stdint.uint32_t tag, stdint.uint32_t key):
+        while tag != NO_TAG:
+            if self._tags[tag].key == key:
+                return &self._tags[tag]
+            tag = self._tags[tag].next
+        return NULL
+
+    cdef StoredTag *_add_tag(self, stdint.uint32_t *head, stdint.uint32_t *count, stdint.uint32_t key) except NULL:
+        cdef StoredTag *tag
+
+        if self._tags_len == self._tags_capacity:
+            _grow_array(<void **> &self._tags, &self._tags_capacity, sizeof(StoredTag))
+        tag = &self._tags[self._tags_len]
+        tag.key = key
+        tag.value = 0
+        tag.number = 0
+        tag.next = head[0]
+        head[0] = <stdint.uint32_t> self._tags_len
+        count[0] += 1
+        self._tags_len += 1
+        return tag
+
+    cdef int _set_tag(self, Py_ssize_t i, str key, str value) except -1:
+        cdef stdint.uint32_t key_id = self._strings._index(key)
+        cdef stdint.uint32_t value_id = self._strings._index(value)
+        cdef StoredSpanFields *span = &self._spans[i]
+        cdef StoredTag *tag = self._find_tag(span.meta, key_id)
+
+        if tag == NULL:
+            tag = self._add_tag(&span.meta, &span.meta_count, key_id)
+        tag.value = value_id
+        return 0
+
+    cdef int _set_metric(self, Py_ssize_t i, str key, double value) except -1:
+        cdef stdint.uint32_t key_id = self._strings._index(key)
+        cdef StoredSpanFields *span = &self._spans[i]
+        cdef StoredTag *tag = self._find_tag(span.metrics, key_id)
+
+        if tag == NULL:
+            tag = self._add_tag(&span.metrics, &span.metrics_count, key_id)
+        tag.number = value
+        return 0
+
+    cdef StoredTag *_get(self, stdint.uint32_t head, str key) except? NULL:
+        cdef Py_ssize_t key_id = self._string_id(key)
+        if key_id < 0:
+            return NULL
+        return self._find_tag(head, <stdint.uint32_t> key_id)
+
+    cdef Py_ssize_t _min_size(self):
+        """Lower bound of the size of the packed spans, whatever the encoding"""
+        return 1 + 13 * self._len + 2 * self._tags_len
+
+
+cdef class StoredSpan(object):
+    """Handle on a span of a SpanStore"""
+
+    cdef SpanStore _store
+    cdef Py_ssize_t _i
+
+    @staticmethod
+    cdef StoredSpan _new(SpanStore store, Py_ssize_t i):
+        cdef StoredSpan span = StoredSpan.__new__(StoredSpan)
+        span._store = store
+        span._i = i
+        return span
+
+    cdef inline StoredSpanFields *_fields(self):
+        # The arrays of the store move when it grows, so the fields are looked up again on every access
+        return &self._store._spans[self._i]
+
+    @property
+    def trace_id(self):
+        return self._store.trace_id
+
+    @property
+    def span_id(self):
+        return self._fields().span_id
+
+    @property
+    def parent_id(self):
+        cdef stdint.uint64_t parent_id = self._fields().parent_id
+        return parent_id if parent_id else None
+
+    @property
+    def name(self):
+        return self._store._string(self._fields().name) or None
+
+    @name.setter
+    def name(self, str value):
+        cdef stdint.uint32_t _id = self._store._strings._index(value)
+        self._fields().name = _id
+
+    @property
+    def service(self):
+        return self._store._string(self._fields().service) or None
+
+    @service.setter
+    def service(self, str value):
+        cdef stdint.uint32_t _id = self._store._strings._index(value)
+        self._fields().service = _id
+
+    @property
+    def resource(self):
+        return self._store._string(self._fields().resource) or None
+
+    @resource.setter
+    def resource(self, str value):
+        cdef stdint.uint32_t _id = self._store._strings._index(value)
+        self._fields().resource = _id
+
+    @property
+    def span_type(self):
+        return self._store._string(self._fields().span_type) or None
+
+    @span_type.setter
+    def span_type(self, str value):
+        cdef stdint.uint32_t _id = self._store._strings._index(value)
+        self._fields().span_type = _id
+
+    @property
+    def start_ns(self):
+        return self._fields().start_ns
+
+    @property
+    def duration_ns(self):
+        return self._fields().duration_ns
+
+    @duration_ns.setter
+    def duration_ns(self, stdint.int64_t value):
+        self._fields().duration_ns = value
+
+    @property
+    def error(self):
+        return self._fields().error
+
+    @error.setter
+    def error(self, stdint.int32_t value):
+        self._fields().error = value
+
+    def finish(self, stdint.int64_t finish_ns):
+        self._fields().duration_ns = finish_ns - self._fields().start_ns
+
+    def set_tag(self, str key, str value):
+        self._store._set_tag(self._i, key, value)
+
+    def get_tag(self, str key):
+        cdef StoredTag *tag = self._store._get(self._fields().meta, key)
+        return self._store._string(tag.value) if tag != NULL else None
+
+    def set_metric(self, str key, double value):
+        self._store._set_metric(self._i, key, value)
+
+    def get_metric(self, str key):
+        cdef StoredTag *tag = self._store._get(self._fields().metrics, key)
+        return tag.number if tag != NULL else None
+
+
 cdef class BufferedEncoder(object):
     content_type: str = None
 
@@ -367,6 +1480,10 @@ cdef class BufferedEncoder(object):
     def encode(self):
         raise NotImplementedError()
 
+    def encode_payload(self):
+        """Encode the buffered items, in a form the writers can send without copying it."""
+        return self.encode()
+
 
 cdef class ListBufferedEncoder(BufferedEncoder):
     cdef list _buffer
@@ -417,24 +1534,32 @@ cdef class ListBufferedEncoder(BufferedEncoder):
 cdef class MsgpackEncoderBase(BufferedEncoder):
     content_type = "application/msgpack"
 
+    # Traces are put in the active buffer while the retired one is serialized by encode(), so that the
+    # threads finishing traces only wait for the buffers to be swapped, not for the payload to be built.
     cdef msgpack_packer pk
     cdef stdint.uint32_t _count
+    cdef msgpack_packer _retired_pk
+    cdef stdint.uint32_t _retired_count
+    cdef object _flush_lock
+    cdef size_t _size_hint
 
     def __cinit__(self, size_t max_size, size_t max_item_size):
-        cdef int buf_size = 1024*1024
-        self.pk.buf = <char*> PyMem_Malloc(buf_size)
-        if self.pk.buf == NULL:
-            raise MemoryError("Unable to allocate internal buffer.")
+        acquire_buffer(&self.pk, MSGPACK_BUFFER_SIZE)
+        acquire_buffer(&self._retired_pk, MSGPACK_BUFFER_SIZE)
+        self._size_hint = MSGPACK_BUFFER_SIZE
 
         self.max_size = max_size
-        self.pk.buf_size = buf_size
         self.max_item_size = max_item_size if max_item_size < max_size else max_size
         self._lock = threading.RLock()
+        self._flush_lock = threading.Lock()
         self._reset_buffer()
+        self._reset_retired_buffer()
 
     def __dealloc__(self):
-        PyMem_Free(self.pk.buf)
+        release_buffer(self.pk.buf, self.pk.buf_size)
         self.pk.buf = NULL
+        release_buffer(self._retired_pk.buf, self._retired_pk.buf_size)
+        self._retired_pk.buf = NULL
 
     def __len__(self):  # TODO: Use a better name?
         return self._count
@@ -449,38 +1574,66 @@ cdef class MsgpackEncoderBase(BufferedEncoder):
         self._count = 0
         self.pk.length = MSGPACK_ARRAY_LENGTH_PREFIX_SIZE  # Leave room for array length prefix
 
-    cpdef encode(self):
+    cdef _reset_retired_buffer(self):
+        self._retired_count = 0
+        self._retired_pk.length = MSGPACK_ARRAY_LENGTH_PREFIX_SIZE
+
+    cdef _swap_buffers(self):
+        """Retire the active buffer and start putting traces in an empty one"""
+        cdef msgpack_packer pk
         with self._lock:
-            if not self._count:
-                return None
+            pk = self.pk
+            self.pk = self._retired_pk
+            self._retired_pk = pk
+            self._retired_count = self._count
+            self._reset_buffer()
+
+    cpdef encode_payload(self):
+        with self._flush_lock:
+            with self._lock:
+                if not self._count:
+                    return None
+                self._swap_buffers()
 
-            return self.flush()
+            try:
+                return self.flush_retired()
+            finally:
+                self._reset_retired_buffer()
 
-    cdef inline int _update_array_len(self):
-        """Update traces array size prefix"""
-        cdef int offset = MSGPACK_ARRAY_LENGTH_PREFIX_SIZE - array_prefix_size(self._count)
-        cdef int old_pos = self.pk.length
+    cpdef encode(self):
+        payload = self.encode_payload()
+        if payload is None:
+            return None
+        return bytes(payload)
 
-        with self._lock:
-            self.pk.length = offset
-            msgpack_pack_array(&self.pk, self._count)
-            self.pk.length = old_pos
-            return offset
+    cpdef flush(self):
+        with self._flush_lock:
+            self._swap_buffers()
+            try:
+                return bytes(self.flush_retired())
+            finally:
+                self._reset_retired_buffer()
 
-    cdef get_bytes(self):
-        """Return internal buffer contents as bytes object"""
-        cdef int offset = self._update_array_len()
-        with self._lock:
-            return PyBytes_FromStringAndSize(self.pk.buf + offset, self.pk.length - offset)
+    cdef inline int _update_array_len(self):
+        """Update traces array size prefix of the retired buffer"""
+        cdef int offset = MSGPACK_ARRAY_LENGTH_PREFIX_SIZE - array_prefix_size(self._retired_count)
+        cdef int old_pos = self._retired_pk.length
+
+        self._retired_pk.length = offset
+        msgpack_pack_array(&self._retired_pk, self._retired_count)
+        self._retired_pk.length = old_pos
+        return offset
 
-    cdef char * get_buffer(self):
-        """Return internal buffer."""
-        return self.pk.buf + self._update_array_len()
+    cdef PayloadChunk take_retired_chunk(self):
+        """Hand the retired buffer over to a payload chunk"""
+        # The next traces are packed in the new buffer, sized after the recent payloads to avoid growing it
+        self._size_hint = next_size_hint(self._size_hint, self._retired_pk.length)
+        return take_packer_buffer(&self._retired_pk, self._update_array_len(), self._size_hint)
 
     cdef void * get_dd_origin_ref(self, str dd_origin):
         raise NotImplementedError()
 
-    cdef inline int _pack_trace(self, list trace) except? -1:
+    cdef inline int _pack_trace(self, msgpack_packer *pk, list trace) except? -1:
         cdef int ret
         cdef Py_ssize_t L
         cdef void * dd_origin = NULL
@@ -489,7 +1642,10 @@ cdef class MsgpackEncoderBase(BufferedEncoder):
         if L > ITEM_LIMIT:
             raise ValueError("list is too large")
 
-        ret = msgpack_pack_array(&self.pk, L)
+        if _Span is None:
+            _init_span_slots()
+
+        ret = msgpack_pack_array(pk, L)
         if ret != 0:
             raise RuntimeError("Couldn't pack trace")
 
@@ -498,7 +1654,7 @@ cdef class MsgpackEncoderBase(BufferedEncoder):
 
         for span in trace:
             try:
-                ret = self.pack_span(span, dd_origin)
+                ret = self.pack_span(pk, span, dd_origin)
             except Exception as e:
                 raise RuntimeError("failed to pack span: {!r}. Exception: {}".format(span, e))
 
@@ -508,15 +1664,57 @@ cdef class MsgpackEncoderBase(BufferedEncoder):
 
         return ret
 
+    cdef inline int _pack_item(self, msgpack_packer *pk, object item) except? -1:
+        if type(item) is SpanStore:
+            return self.pack_store(pk, <SpanStore> item)
+        return self._pack_trace(pk, <list> item)
+
+    cdef Py_ssize_t _min_trace_size(self, list trace) except -1:
+        """Lower bound of the size of the packed trace, computed without packing it.
+
+        Traces which are bound to be dropped because they don't fit in the buffer are rejected from it, which
+        spares packing them only to roll them back.
+        """
+        cdef Py_ssize_t size = 1
+
+        if _Span is None:
+            _init_span_slots()
+
+        for span in trace:
+            size += self.min_span_size(span, type(span) is _Span)
+        return size
+
+    cdef int _check_item_size(self, object item, size_t buffer_size) except -1:
+        cdef size_t min_size
+
+        if type(item) is SpanStore:
+            min_size = <size_t> (<SpanStore> item)._min_size()
+        else:
+            min_size = <size_t> self._min_trace_size(<list> item)
+
+        if min_size > self.max_item_size:
+            raise BufferItemTooLarge(min_size)
+        if buffer_size + min_size > self.max_size:
+            raise BufferFull(min_size)
+        return 0
+
     cpdef put(self, list trace):
         """Put a trace (i.e. a list of spans) in the buffer."""
+        self._put(trace)
+
+    cpdef put_store(self, SpanStore store):
+        """Put the spans of a store in the buffer, as one trace."""
+        self._put(store)
+
+    cdef _put(self, object item):
         cdef int ret
 
         with self._lock:
+            self._check_item_size(item, self.size)
             len_before = self.pk.length
             size_before = self.size
             try:
-                ret = self._pack_trace(trace)
+                ret = self._pack_item(&self.pk, item)
                 if ret:  # should not happen.
                     raise RuntimeError("internal error")
 
@@ -545,115 +1743,291 @@ cdef class MsgpackEncoderBase(BufferedEncoder):
 
     # ---- Abstract methods ----
 
-    cpdef flush(self):
+    cdef EncodedPayload flush_retired(self):
+        """Serialize the retired buffer. It is only accessed by one flush at a time, without holding the lock."""
         raise NotImplementedError()
 
-    cdef int pack_span(self, object span, void *dd_origin) except? -1:
+    cdef int pack_span(self, msgpack_packer *pk, object span, void *dd_origin) except? -1:
         raise NotImplementedError()
 
+    cdef Py_ssize_t min_span_size(self, object span, bint is_span) except -1:
+        """Lower bound of the size of the packed span. Spans of other types than Span only get the fixed part."""
+        raise NotImplementedError()
+
+    cdef int pack_store(self, msgpack_packer *pk, SpanStore store) except? -1:
+        raise NotImplementedError()
+
+
+cdef class TraceSegment(object):
+    """Traces put by one thread, appended to the payload when the encoder is flushed."""
+    cdef msgpack_packer pk
+    cdef stdint.uint32_t count
+    cdef bint retired
+    cdef object lock
+
+    def __cinit__(self):
+        acquire_buffer(&self.pk, MSGPACK_BUFFER_SIZE)
+        self.count = 0
+        self.retired = False
+        self.lock = threading.Lock()
+
+    def __dealloc__(self):
+        release_buffer(self.pk.buf, self.pk.buf_size)
+        self.pk.buf = NULL
+
 
 cdef class MsgpackEncoderV03(MsgpackEncoderBase):
-    cpdef flush(self):
+    # Each thread packs its traces in its own segment, so that the threads putting traces don't wait for each
+    # other. The traces of a payload can be concatenated in any order, the segments are merged when flushing.
+    cdef dict _segments
+    cdef size_t _size
+
+    def __cinit__(self, size_t max_size, size_t max_item_size):
+        self._segments = {}
+        self._size = 0
+
+    cdef TraceSegment _segment(self):
+        cdef object ident = threading.get_ident()
+        cdef object segment = self._segments.get(ident)
+        if segment is None:
+            segment = TraceSegment()
+            with self._lock:
+                self._segments[ident] = segment
+        return <TraceSegment> segment
+
+    cdef _put(self, object item):
+        """Put a trace (i.e. a list of spans) in the segment of the calling thread."""
+        cdef TraceSegment segment
+        cdef size_t len_before
+        cdef size_t item_size
+        cdef int ret
+
+        self._check_item_size(item, self._size + array_prefix_size(self._count))
+        while True:
+            segment = self._segment()
+            with segment.lock:
+                if segment.retired:
+                    # Dropped by a flush since it was looked up
+                    continue
+
+                len_before = segment.pk.length
+                try:
+                    ret = self._pack_item(&segment.pk, item)
+                    if ret:  # should not happen.
+                        raise RuntimeError("internal error")
+
+                    item_size = segment.pk.length - len_before
+                    if item_size > self.max_item_size:
+                        raise BufferItemTooLarge(item_size)
+
+                    # DEV: No Python code runs between the check and the update of the totals, which the GIL
+                    # makes atomic with respect to the other threads.
+                    if self._size + item_size + array_prefix_size(self._count) > self.max_size:
+                        raise BufferFull(item_size)
+
+                    self._size += item_size
+                    self._count += 1
+                    segment.count += 1
+                except Exception:
+                    # rollback
+                    segment.pk.length = len_before
+                    raise
+                return
+
+    @property
+    def size(self):
+        """Return the size in bytes of the encoder buffer."""
+        return self._size + array_prefix_size(self._count)
+
+    cdef _swap_buffers(self):
+        cdef TraceSegment segment
+        cdef int ret
+
         with self._lock:
-            try:
-                return self.get_bytes()
-            finally:
-                self._reset_buffer()
+            for ident, segment in list(self._segments.items()):
+                with segment.lock:
+                    if segment.count == 0:
+                        # Segments of the threads which stopped putting traces are not kept around, a thread
+                        # putting traces again gets a new one.
+                        segment.retired = True
+                        del self._segments[ident]
+                        continue
+
+                    ret = msgpack_pack_raw_body(&self._retired_pk, segment.pk.buf, segment.pk.length)
+                    if ret != 0:
+                        raise RuntimeError("Couldn't merge trace segment")
+
+                    self._retired_count += segment.count
+                    self._count -= segment.count
+                    self._size -= segment.pk.length
+                    segment.count = 0
+                    segment.pk.length = 0
+
+    cdef EncodedPayload flush_retired(self):
+        return EncodedPayload((self.take_retired_chunk(),))
 
     cdef void * get_dd_origin_ref(self, str dd_origin):
         return string_to_buff(dd_origin)
 
-    cdef inline int _pack_links(self, object span_links):
-        ret = msgpack_pack_array(&self.pk, len(span_links))
+    cdef inline int _pack_link_attributes(self, msgpack_packer *pk, object attributes) except? -1:
+        cdef int ret
+
+        # Attributes with sequences of values are flattened to one attribute per value, like SpanLink.to_dict()
+        for v in attributes.values():
+            if isinstance(v, (list, tuple, set, frozenset)):
+                attributes = {
+                    k1: v1 for key, value in attributes.items() for k1, v1 in flatten_key_value(key, value).items()
+                }
+                break
+
+        ret = msgpack_pack_map(pk, len(attributes))
+        for k, v in attributes.items():
+            if ret != 0:
+                return ret
+            ret = pack_text(pk, k)
+            if ret != 0:
+                return ret
+            # The values are all serialized as strings, with the booleans in lowercase as in JSON
+            if PyUnicode_Check(v):
+                ret = pack_text(pk, v)
+            elif v is True:
+                ret = pack_bytes(pk, <char *> b"true", 4)
+            elif v is False:
+                ret = pack_bytes(pk, <char *> b"false", 5)
+            else:
+                ret = pack_text(pk, str(v))
+        return ret
+
+    cdef inline int _pack_links(self, msgpack_packer *pk, object span_links) except? -1:
+        cdef int ret
+        cdef int L
+
+        ret = msgpack_pack_array(pk, len(span_links))
         if ret != 0:
             return ret
 
-        for _, link in span_links.items():
-            # SpanLink.to_dict() returns all serializable span link fields
-            # v0.4 encoding is disabled by default. SpanLinks.to_dict() is optimizied for the v0.5 format.
-            d = link.to_dict()
-            # Encode 128 bit trace ids usings two 64bit integers
-            tid = int(d["trace_id"][:16], 16)
-            if tid > 0:
-                d["trace_id_high"] = tid
-            d["trace_id"] = int(d["trace_id"][16:], 16)
-            # span id should be uint64 in v0.4 (it is hex in v0.5)
-            d["span_id"] = int(d["span_id"], 16)
-            if "flags" in d:
+        # The fields of the links are packed in the order of SpanLink.to_dict(), which v0.5 uses, with the 128 bit
+        # trace ids split in two 64 bit integers
+        for link in span_links.values():
+            trace_id = link.trace_id
+            trace_id_high = trace_id >> 64
+            attributes = link.attributes
+            dropped_attributes = link._dropped_attributes
+            tracestate = link.tracestate
+            flags = link.flags
+
+            L = (
+                2
+                + (len(attributes) > 0)
+                + (dropped_attributes > 0)
+                + (tracestate is not None and len(tracestate) > 0)
+                + (flags is not None)
+                + (trace_id_high > 0)
+            )
+            ret = msgpack_pack_map(pk, L)
+            if ret != 0:
+                return ret
+
+            ret = pack_bytes(pk, <char *> b"trace_id", 8)
+            if ret == 0:
+                ret = msgpack_pack_uint64(pk, <stdint.uint64_t> (trace_id & MAX_UINT_64BITS))
+            if ret == 0:
+                ret = pack_bytes(pk, <char *> b"span_id", 7)
+            if ret == 0:
+                ret = msgpack_pack_uint64(pk, <stdint.uint64_t> link.span_id)
+            if ret == 0 and attributes:
+                ret = pack_bytes(pk, <char *> b"attributes", 10)
+                if ret == 0:
+                    ret = self._pack_link_attributes(pk, attributes)
+            if ret == 0 and dropped_attributes > 0:
+                ret = pack_bytes(pk, <char *> b"dropped_attributes_count", 24)
+                if ret == 0:
+                    ret = pack_number(pk, dropped_attributes)
+            if ret == 0 and tracestate:
+                ret = pack_bytes(pk, <char *> b"tracestate", 10)
+                if ret == 0:
+                    ret = pack_text(pk, tracestate)
+            if ret == 0 and flags is not None:
                 # If traceflags set, the high bit (bit 31) should be set to 1 (uint32).
                 # This helps us distinguish between when the sample decision is zero or not set
-                d["flags"] = d["flags"] | (1 << 31)
-
-            ret = msgpack_pack_map(&self.pk, len(d))
+                ret = pack_bytes(pk, <char *> b"flags", 5)
+                if ret == 0:
+                    ret = pack_number(pk, flags | (1 << 31))
+            if ret == 0 and trace_id_high > 0:
+                ret = pack_bytes(pk, <char *> b"trace_id_high", 13)
+                if ret == 0:
+                    ret = msgpack_pack_uint64(pk, <stdint.uint64_t> trace_id_high)
             if ret != 0:
                 return ret
-
-            for k, v in d.items():
-                # pack the name of a span link field (ex: trace_id, span_id, flags, ...)
-                ret = pack_text(&self.pk, k)
-                if ret != 0:
-                    return ret
-                # pack the value of a span link field (values can be number, string or dict)
-                if isinstance(v, (int, float)):
-                    ret = pack_number(&self.pk, v)
-                elif isinstance(v, str):
-                    ret = pack_text(&self.pk, v)
-                elif k == "attributes":
-                    # span links can contain attributes, this is analougous to span tags
-                    # attributes are serialized as a nested dict with string keys and values
-                    attributes = v.items()
-                    ret = msgpack_pack_map(&self.pk, len(attributes))
-                    for attr_k, attr_v in attributes:
-                        ret = pack_text(&self.pk, attr_k)
-                        if ret != 0:
-                            return ret
-                        ret = pack_text(&self.pk, attr_v)
-                        if ret != 0:
-                            return ret
-                else:
-                    raise ValueError(f"Failed to encode SpanLink. {k}={v} contains an unsupported type, {type(v)}")
-                if ret != 0:
-                    return ret
         return 0
 
-    cdef inline int _pack_meta(self, object meta, char *dd_origin, str span_events) except? -1:
+    cdef inline int _pack_meta(self, msgpack_packer *pk, object meta, char *dd_origin, str span_events) except? -1:
         cdef Py_ssize_t L
+        cdef Py_ssize_t i
         cdef int ret
         cdef dict d
+        cdef TagMap tags
 
-        if PyDict_CheckExact(meta):
+        meta = _tags_dict(meta)
+        if type(meta) is TagMap:
+            tags = <TagMap> meta
+            ret = msgpack_pack_map(pk, tags._len + (dd_origin is not NULL) + (len(span_events) > 0))
+            for i in range(tags._len):
+                if ret != 0:
+                    return ret
+                ret = pack_text(pk, <object> tags._entries[i].key)
+                if ret == 0:
+                    ret = pack_text(pk, <object> tags._entries[i].value)
+        elif PyDict_CheckExact(meta):
             d = <dict> meta
             L = len(d) + (dd_origin is not NULL) + (len(span_events) > 0)
             if L > ITEM_LIMIT:
                 raise ValueError("dict is too large")
 
-            ret = msgpack_pack_map(&self.pk, L)
+            ret = msgpack_pack_map(pk, L)
             if ret == 0:
                 for k, v in d.items():
-                    ret = pack_text(&self.pk, k)
+                    ret = pack_text(pk, k)
                     if ret != 0:
                         break
-                    ret = pack_text(&self.pk, v)
+                    ret = pack_text(pk, v)
                     if ret != 0:
                         break
-                if dd_origin is not NULL:
-                    ret = pack_bytes(&self.pk, _ORIGIN_KEY, _ORIGIN_KEY_LEN)
-                    if ret == 0:
-                        ret = pack_bytes(&self.pk, dd_origin, strlen(dd_origin))
-                    if ret != 0:
-                        return ret
-                if span_events:
-                    ret = pack_text(&self.pk, SPAN_EVENTS_KEY)
-                    if ret == 0:
-                        ret = pack_text(&self.pk, span_events)
-            return ret
+        else:
+            raise TypeError("Unhandled meta type: %r" % type(meta))
 
-        raise TypeError("Unhandled meta type: %r" % type(meta))
+        if ret != 0:
+            return ret
+        if dd_origin is not NULL:
+            ret = pack_bytes(pk, _ORIGIN_KEY, _ORIGIN_KEY_LEN)
+            if ret == 0:
+                ret = pack_bytes(pk, dd_origin, strlen(dd_origin))
+            if ret != 0:
+                return ret
+        if span_events:
+            ret = pack_text(pk, SPAN_EVENTS_KEY)
+            if ret == 0:
+                ret = pack_text(pk, span_events)
+        return ret
 
-    cdef inline int _pack_metrics(self, object metrics) except? -1:
+    cdef inline int _pack_metrics(self, msgpack_packer *pk, object metrics) except? -1:
         cdef Py_ssize_t L
+        cdef Py_ssize_t i
         cdef int ret
         cdef dict d
+        cdef TagMap tags
+
+        metrics = _tags_dict(metrics)
+        if type(metrics) is TagMap:
+            tags = <TagMap> metrics
+            ret = msgpack_pack_map(pk, tags._len)
+            for i in range(tags._len):
+                if ret != 0:
+                    break
+                ret = pack_text(pk, <object> tags._entries[i].key)
+                if ret == 0:
+                    ret = pack_number(pk, <object> tags._entries[i].value)
+            return ret
 
         if PyDict_CheckExact(metrics):
             d = <dict> metrics
@@ -661,179 +2035,329 @@ cdef class MsgpackEncoderV03(MsgpackEncoderBase):
             if L > ITEM_LIMIT:
                 raise ValueError("dict is too large")
 
-            ret = msgpack_pack_map(&self.pk, L)
+            ret = msgpack_pack_map(pk, L)
             if ret == 0:
                 for k, v in d.items():
-                    ret = pack_text(&self.pk, k)
+                    ret = pack_text(pk, k)
                     if ret != 0:
                         break
-                    ret = pack_number(&self.pk, v)
+                    ret = pack_number(pk, v)
                     if ret != 0:
                         break
             return ret
 
         raise TypeError("Unhandled metrics type: %r" % type(metrics))
 
-    cdef int pack_span(self, object span, void *dd_origin) except? -1:
+    cdef int pack_span(self, msgpack_packer *pk, object span, void *dd_origin) except? -1:
         cdef int ret
         cdef Py_ssize_t L
         cdef int has_span_type
         cdef int has_meta
         cdef int has_metrics
-
-        has_error = <bint> (span.error != 0)
-        has_span_type = <bint> (span.span_type is not None)
-        has_span_events = <bint> (len(span._events) > 0)
-        has_meta = <bint> (len(span._meta) > 0 or dd_origin is not NULL or has_span_events)
-        has_metrics = <bint> (len(span._metrics) > 0)
-        has_parent_id = <bint> (span.parent_id is not None)
-        has_links = <bint> (len(span._links) > 0)
-        has_meta_struct = <bint> (len(span._meta_struct) > 0)
+        cdef bint is_span = type(span) is _Span
+
+        error = _span_field(span, is_span, _span_slots.error, "error")
+        span_type = _span_field(span, is_span, _span_slots.span_type, "span_type")
+        parent_id = _span_field(span, is_span, _span_slots.parent_id, "parent_id")
+        meta = _span_field(span, is_span, _span_slots.meta, "_meta")
+        meta_struct = _span_field(span, is_span, _span_slots.meta_struct, "_meta_struct")
+        metrics = _span_field(span, is_span, _span_slots.metrics, "_metrics")
+        links = _span_field(span, is_span, _span_slots.links, "_links")
+        events = _span_field(span, is_span, _span_slots.events, "_events")
+
+        has_error = <bint> (error != 0)
+        has_span_type = <bint> (span_type is not None)
+        has_span_events = <bint> (len(events) > 0)
+        has_meta = <bint> (len(meta) > 0 or dd_origin is not NULL or has_span_events)
+        has_metrics = <bint> (len(metrics) > 0)
+        has_parent_id = <bint> (parent_id is not None)
+        has_links = <bint> (len(links) > 0)
+        has_meta_struct = <bint> (len(meta_struct) > 0)
 
         L = 7 + has_span_type + has_meta + has_metrics + has_error + has_parent_id + has_links + has_meta_struct
 
-        ret = msgpack_pack_map(&self.pk, L)
+        ret = msgpack_pack_map(pk, L)
 
         if ret == 0:
-            ret = pack_bytes(&self.pk, <char *> b"trace_id", 8)
+            ret = pack_bytes(pk, <char *> b"trace_id", 8)
             if ret != 0:
                 return ret
-            ret = pack_number(&self.pk, span._trace_id_64bits)
+            ret = pack_number(pk, _span_trace_id_64bits(span, is_span))
             if ret != 0:
                 return ret
 
             if has_parent_id:
-                ret = pack_bytes(&self.pk, <char *> b"parent_id", 9)
+                ret = pack_bytes(pk, <char *> b"parent_id", 9)
                 if ret != 0:
                     return ret
-                ret = pack_number(&self.pk, span.parent_id)
+                ret = pack_number(pk, parent_id)
                 if ret != 0:
                     return ret
 
-            ret = pack_bytes(&self.pk, <char *> b"span_id", 7)
+            ret = pack_bytes(pk, <char *> b"span_id", 7)
             if ret != 0:
                 return ret
-            ret = pack_number(&self.pk, span.span_id)
+            ret = pack_number(pk, _span_field(span, is_span, _span_slots.span_id, "span_id"))
             if ret != 0:
                 return ret
 
-            ret = pack_bytes(&self.pk, <char *> b"service", 7)
+            ret = pack_bytes(pk, <char *> b"service", 7)
             if ret != 0:
                 return ret
-            ret = pack_text(&self.pk, span.service)
+            ret = pack_text(pk, _span_field(span, is_span, _span_slots.service, "service"))
             if ret != 0:
                 return ret
 
-            ret = pack_bytes(&self.pk, <char *> b"resource", 8)
+            ret = pack_bytes(pk, <char *> b"resource", 8)
             if ret != 0:
                 return ret
-            ret = pack_text(&self.pk, span.resource)
+            ret = pack_text(pk, _span_resource(span, is_span))
             if ret != 0:
                 return ret
 
-            ret = pack_bytes(&self.pk, <char *> b"name", 4)
+            ret = pack_bytes(pk, <char *> b"name", 4)
             if ret != 0:
                 return ret
-            ret = pack_text(&self.pk, span.name)
+            ret = pack_text(pk, _span_field(span, is_span, _span_slots.name, "name"))
             if ret != 0:
                 return ret
 
-            ret = pack_bytes(&self.pk, <char *> b"start", 5)
+            ret = pack_bytes(pk, <char *> b"start", 5)
             if ret != 0:
                 return ret
-            ret = pack_number(&self.pk, span.start_ns)
+            ret = pack_number(pk, _span_field(span, is_span, _span_slots.start_ns, "start_ns"))
             if ret != 0:
                 return ret
 
-            ret = pack_bytes(&self.pk, <char *> b"duration", 8)
+            ret = pack_bytes(pk, <char *> b"duration", 8)
             if ret != 0:
                 return ret
-            ret = pack_number(&self.pk, span.duration_ns)
+            ret = pack_number(pk, _span_field(span, is_span, _span_slots.duration_ns, "duration_ns"))
             if ret != 0:
                 return ret
 
             if has_error:
-                ret = pack_bytes(&self.pk, <char *> b"error", 5)
+                ret = pack_bytes(pk, <char *> b"error", 5)
                 if ret != 0:
                     return ret
-                ret = msgpack_pack_long(&self.pk, <long> 1)
+                ret = msgpack_pack_long(pk, <long> 1)
                 if ret != 0:
                     return ret
 
             if has_span_type:
-                ret = pack_bytes(&self.pk, <char *> b"type", 4)
+                ret = pack_bytes(pk, <char *> b"type", 4)
                 if ret != 0:
                     return ret
-                ret = pack_text(&self.pk, span.span_type)
+                ret = pack_text(pk, span_type)
                 if ret != 0:
                     return ret
 
             if has_links:
-                ret = pack_bytes(&self.pk, <char *> b"span_links", 10)
+                ret = pack_bytes(pk, <char *> b"span_links", 10)
                 if ret != 0:
                     return ret
-                ret = self._pack_links(span._links)
+                ret = self._pack_links(pk, links)
                 if ret != 0:
                     return ret
 
             if has_meta:
-                ret = pack_bytes(&self.pk, <char *> b"meta", 4)
+                ret = pack_bytes(pk, <char *> b"meta", 4)
                 if ret != 0:
                     return ret
 
                 span_events = ""
                 if has_span_events:
-                    span_events = json_dumps([vars(event)()  for event in span._events])
-                ret = self._pack_meta(span._meta, <char *> dd_origin, span_events)
+                    span_events = json_dumps([vars(event)()  for event in events])
+                ret = self._pack_meta(pk, meta, <char *> dd_origin, span_events)
                 if ret != 0:
                     return ret
 
             if has_meta_struct:
-                ret = pack_bytes(&self.pk, <char *> b"meta_struct", 11)
+                ret = pack_bytes(pk, <char *> b"meta_struct", 11)
                 if ret != 0:
                     return ret
 
-                ret = msgpack_pack_map(&self.pk, len(span._meta_struct))
+                ret = msgpack_pack_map(pk, len(meta_struct))
                 if ret != 0:
                     return ret
-                for k, v in span._meta_struct.items():
-                    ret = pack_text(&self.pk, k)
+                for k, v in meta_struct.items():
+                    ret = pack_text(pk, k)
                     if ret != 0:
                         return ret
-                    value_packed = packb(v)
-                    ret = msgpack_pack_bin(&self.pk, len(value_packed))
-                    if ret == 0:
-                        ret = msgpack_pack_raw_body(&self.pk, <char *> value_packed, len(value_packed))
+                    ret = pack_object_bin(pk, v)
                     if ret != 0:
                         return ret
 
             if has_metrics:
-                ret = pack_bytes(&self.pk, <char *> b"metrics", 7)
+                ret = pack_bytes(pk, <char *> b"metrics", 7)
                 if ret != 0:
                     return ret
-                ret = self._pack_metrics(span._metrics)
+                ret = self._pack_metrics(pk, metrics)
+                if ret != 0:
+                    return ret
+
+        return ret
+
+    cdef Py_ssize_t min_span_size(self, object span, bint is_span) except -1:
+        # The map header, and the keys of the fields which are always packed with a value of one byte at least:
+        # trace_id, span_id, service, resource, name, start and duration
+        cdef Py_ssize_t size = 1 + 54 + 7
+
+        if not is_span:
+            return size
+
+        size += _min_text_size(_span_slot(span, _span_slots.service)) - 1
+        size += _min_text_size(_span_resource(span, is_span)) - 1
+        size += _min_text_size(_span_slot(span, _span_slots.name)) - 1
+
+        meta = _span_slot(span, _span_slots.meta)
+        if PyDict_CheckExact(meta) and meta:
+            # The meta key and the map header
+            size += 5 + 1
+            for k, v in (<dict> meta).items():
+                size += _min_text_size(k) + _min_text_size(v)
+
+        metrics = _span_slot(span, _span_slots.metrics)
+        if PyDict_CheckExact(metrics) and metrics:
+            size += 8 + 1
+            for k in <dict> metrics:
+                size += _min_text_size(k) + 1
+        return size
+
+    cdef inline int _pack_stored_text(self, msgpack_packer *pk, SpanStore store, stdint.uint32_t _id) except? -1:
+        if _id == 0:
+            return msgpack_pack_nil(pk)
+        return pack_text(pk, store._string(_id))
+
+    cdef int pack_store(self, msgpack_packer *pk, SpanStore store) except? -1:
+        cdef StoredSpanFields *span
+        cdef StoredTag *tag
+        cdef stdint.uint32_t t
+        cdef size_t i
+        cdef int ret
+        cdef char *dst
+        cdef char *end
+
+        if store._len > ITEM_LIMIT:
+            raise ValueError("span store is too large")
+        ret = msgpack_pack_array(pk, store._len)
+
+        for i in range(store._len):
+            if ret != 0:
+                return ret
+            span = &store._spans[i]
+
+            ret = msgpack_pack_map(
+                pk,
+                7
+                + (span.parent_id != 0)
+                + (span.error != 0)
+                + (span.span_type != 0)
+                + (span.meta_count > 0)
+                + (span.metrics_count > 0),
+            )
+            if ret != 0:
+                return ret
+
+            # The ids and their keys
+            dst = msgpack_pack_reserve(pk, 3 * MSGPACK_MAX_NUMBER_SIZE + 9 + 10 + 8)
+            if dst == NULL:
+                return -1
+            end = msgpack_put_fixstr(dst, b"trace_id", 8)
+            end = msgpack_put_uint64(end, store.trace_id)
+            if span.parent_id != 0:
+                end = msgpack_put_fixstr(end, b"parent_id", 9)
+                end = msgpack_put_uint64(end, span.parent_id)
+            end = msgpack_put_fixstr(end, b"span_id", 7)
+            end = msgpack_put_uint64(end, span.span_id)
+            pk.length += end - dst
+
+            ret = pack_bytes(pk, <char *> b"service", 7)
+            if ret == 0:
+                ret = self._pack_stored_text(pk, store, span.service)
+            if ret == 0:
+                ret = pack_bytes(pk, <char *> b"resource", 8)
+            if ret == 0:
+                ret = self._pack_stored_text(pk, store, span.resource)
+            if ret == 0:
+                ret = pack_bytes(pk, <char *> b"name", 4)
+            if ret == 0:
+                ret = self._pack_stored_text(pk, store, span.name)
+            if ret != 0:
+                return ret
+
+            # The times and their keys
+            dst = msgpack_pack_reserve(pk, 2 * MSGPACK_MAX_NUMBER_SIZE + 6 + 9)
+            if dst == NULL:
+                return -1
+            end = msgpack_put_fixstr(dst, b"start", 5)
+            end = msgpack_put_int64(end, span.start_ns)
+            end = msgpack_put_fixstr(end, b"duration", 8)
+            end = msgpack_put_int64(end, span.duration_ns)
+            pk.length += end - dst
+
+            if ret == 0 and span.error != 0:
+                ret = pack_bytes(pk, <char *> b"error", 5)
+                if ret == 0:
+                    ret = msgpack_pack_long(pk, <long> 1)
+            if ret == 0 and span.span_type != 0:
+                ret = pack_bytes(pk, <char *> b"type", 4)
+                if ret == 0:
+                    ret = self._pack_stored_text(pk, store, span.span_type)
+            if ret != 0:
+                return ret
+
+            if span.meta_count > 0:
+                ret = pack_bytes(pk, <char *> b"meta", 4)
+                if ret == 0:
+                    ret = msgpack_pack_map(pk, span.meta_count)
+                t = span.meta
+                while ret == 0 and t != NO_TAG:
+                    tag = &store._tags[t]
+                    ret = pack_text(pk, store._string(tag.key))
+                    if ret == 0:
+                        ret = pack_text(pk, store._string(tag.value))
+                    t = tag.next
                 if ret != 0:
                     return ret
 
+            if span.metrics_count > 0:
+                ret = pack_bytes(pk, <char *> b"metrics", 7)
+                if ret == 0:
+                    ret = msgpack_pack_map(pk, span.metrics_count)
+                t = span.metrics
+                while ret == 0 and t != NO_TAG:
+                    tag = &store._tags[t]
+                    ret = pack_text(pk, store._string(tag.key))
+                    if ret == 0:
+                        ret = msgpack_pack_double(pk, tag.number)
+                    t = tag.next
         return ret
 
 
 cdef class MsgpackEncoderV05(MsgpackEncoderBase):
     cdef MsgpackStringTable _st
+    cdef MsgpackStringTable _retired_st
 
     def __cinit__(self, size_t max_size, size_t max_item_size):
         self._st = MsgpackStringTable(max_size)
+        self._retired_st = MsgpackStringTable(max_size)
 
-    cpdef flush(self):
+    cdef _swap_buffers(self):
+        # The string table indices are only valid within the payload of the traces which use them
         with self._lock:
-            try:
-                self._st.append_raw(
-                    PyLong_FromLong(<long> self.get_buffer()),
-                    <Py_ssize_t> super(MsgpackEncoderV05, self).size,
-                )
-                return self._st.flush()
-            finally:
-                self._reset_buffer()
+            MsgpackEncoderBase._swap_buffers(self)
+            self._st, self._retired_st = self._retired_st, self._st
+
+    cdef _reset_retired_buffer(self):
+        MsgpackEncoderBase._reset_retired_buffer(self)
+        # The base class resets its buffer before the string tables are created
+        if self._retired_st is not None:
+            self._retired_st.reset()
+
+    cdef EncodedPayload flush_retired(self):
+        # The string table and the traces are the two items of the root array, which are sent one after the other
+        return EncodedPayload((self._retired_st.take_chunk(), self.take_retired_chunk()))
 
     @property
     def size(self):
@@ -841,130 +2365,249 @@ cdef class MsgpackEncoderV05(MsgpackEncoderBase):
         with self._lock:
             return self._st.size + super(MsgpackEncoderV05, self).size
 
-    cpdef put(self, list trace):
+    cdef _put(self, object item):
         with self._lock:
             try:
                 self._st.savepoint()
-                super(MsgpackEncoderV05, self).put(trace)
+                MsgpackEncoderBase._put(self, item)
             except Exception:
                 self._st.rollback()
                 raise
 
-    cdef inline int _pack_string(self, object string) except? -1:
-        return msgpack_pack_uint32(&self.pk, self._st._index(string))
+    cdef inline int _pack_string(self, msgpack_packer *pk, object string) except? -1:
+        return msgpack_pack_uint32(pk, self._st._index(string))
 
     cdef void * get_dd_origin_ref(self, str dd_origin):
         return <void *> PyLong_AsLong(self._st._index(dd_origin))
 
-    cdef int pack_span(self, object span, void *dd_origin) except? -1:
+    cdef int pack_span(self, msgpack_packer *pk, object span, void *dd_origin) except? -1:
         cdef int ret
+        cdef bint is_span = type(span) is _Span
+        cdef TagMap tags
+        cdef Py_ssize_t i
 
-        ret = msgpack_pack_array(&self.pk, 12)
+        ret = msgpack_pack_array(pk, 12)
         if ret != 0:
             return ret
 
-        ret = self._pack_string(span.service)
+        ret = self._pack_string(pk, _span_field(span, is_span, _span_slots.service, "service"))
         if ret != 0:
             return ret
-        ret = self._pack_string(span.name)
+        ret = self._pack_string(pk, _span_field(span, is_span, _span_slots.name, "name"))
         if ret != 0:
             return ret
-        ret = self._pack_string(span.resource)
+        ret = self._pack_string(pk, _span_resource(span, is_span))
         if ret != 0:
             return ret
 
-        _ = span._trace_id_64bits
-        ret = msgpack_pack_uint64(&self.pk, _ if _ is not None else 0)
+        _ = _span_trace_id_64bits(span, is_span)
+        ret = msgpack_pack_uint64(pk, _ if _ is not None else 0)
         if ret != 0:
             return ret
 
-        _ = span.span_id
-        ret = msgpack_pack_uint64(&self.pk, _ if _ is not None else 0)
+        _ = _span_field(span, is_span, _span_slots.span_id, "span_id")
+        ret = msgpack_pack_uint64(pk, _ if _ is not None else 0)
         if ret != 0:
             return ret
 
-        _ = span.parent_id
-        ret = msgpack_pack_uint64(&self.pk, _ if _ is not None else 0)
+        _ = _span_field(span, is_span, _span_slots.parent_id, "parent_id")
+        ret = msgpack_pack_uint64(pk, _ if _ is not None else 0)
         if ret != 0:
             return ret
 
-        _ = span.start_ns
-        ret = msgpack_pack_int64(&self.pk, _ if _ is not None else 0)
+        _ = _span_field(span, is_span, _span_slots.start_ns, "start_ns")
+        ret = msgpack_pack_int64(pk, _ if _ is not None else 0)
         if ret != 0:
             return ret
 
-        _ = span.duration_ns
-        ret = msgpack_pack_int64(&self.pk, _ if _ is not None else 0)
+        _ = _span_field(span, is_span, _span_slots.duration_ns, "duration_ns")
+        ret = msgpack_pack_int64(pk, _ if _ is not None else 0)
         if ret != 0:
             return ret
 
-        _ = span.error
-        ret = msgpack_pack_int32(&self.pk, _ if _ is not None else 0)
+        _ = _span_field(span, is_span, _span_slots.error, "error")
+        ret = msgpack_pack_int32(pk, _ if _ is not None else 0)
         if ret != 0:
             return ret
 
+        meta = _tags_dict(_span_field(span, is_span, _span_slots.meta, "_meta"))
+        metrics = _tags_dict(_span_field(span, is_span, _span_slots.metrics, "_metrics"))
+        links = _span_field(span, is_span, _span_slots.links, "_links")
+        events = _span_field(span, is_span, _span_slots.events, "_events")
+
         span_links = ""
-        if span._links:
-            span_links = json_dumps([link.to_dict() for _, link in span._links.items()])
+        if links:
+            span_links = json_dumps([link.to_dict() for _, link in links.items()])
 
         span_events = ""
-        if span._events:
-            span_events = json_dumps([vars(event)() for event in span._events])
+        if events:
+            span_events = json_dumps([vars(event)() for event in events])
 
         ret = msgpack_pack_map(
-            &self.pk,
-            len(span._meta) + (dd_origin is not NULL) + (len(span_links) > 0) + (len(span_events) > 0)
+            pk,
+            len(meta) + (dd_origin is not NULL) + (len(span_links) > 0) + (len(span_events) > 0)
         )
         if ret != 0:
             return ret
-        if span._meta:
-            for k, v in span._meta.items():
-                ret = self._pack_string(k)
+        if type(meta) is TagMap:
+            tags = <TagMap> meta
+            for i in range(tags._len):
+                ret = self._pack_string(pk, <object> tags._entries[i].key)
+                if ret != 0:
+                    return ret
+                ret = self._pack_string(pk, <object> tags._entries[i].value)
                 if ret != 0:
                     return ret
-                ret = self._pack_string(v)
+        elif meta:
+            for k, v in meta.items():
+                ret = self._pack_string(pk, k)
+                if ret != 0:
+                    return ret
+                ret = self._pack_string(pk, v)
                 if ret != 0:
                     return ret
         if dd_origin is not NULL:
-            ret = msgpack_pack_uint32(&self.pk, <stdint.uint32_t> 1)
+            ret = msgpack_pack_uint32(pk, <stdint.uint32_t> 1)
             if ret != 0:
                 return ret
-            ret = msgpack_pack_uint32(&self.pk, <stdint.uint32_t> dd_origin)
+            ret = msgpack_pack_uint32(pk, <stdint.uint32_t> dd_origin)
             if ret != 0:
                 return ret
         if span_links:
-            ret = self._pack_string(SPAN_LINKS_KEY)
+            ret = self._pack_string(pk, SPAN_LINKS_KEY)
             if ret != 0:
                 return ret
-            ret = self._pack_string(span_links)
+            ret = self._pack_string(pk, span_links)
             if ret != 0:
                 return ret
         if span_events:
-            ret = self._pack_string(SPAN_EVENTS_KEY)
+            ret = self._pack_string(pk, SPAN_EVENTS_KEY)
             if ret != 0:
                 return ret
-            ret = self._pack_string(span_events)
+            ret = self._pack_string(pk, span_events)
             if ret != 0:
                 return ret
 
-        ret = msgpack_pack_map(&self.pk, len(span._metrics))
+        ret = msgpack_pack_map(pk, len(metrics))
         if ret != 0:
             return ret
-        if span._metrics:
-            for k, v in span._metrics.items():
-                ret = self._pack_string(k)
+        if type(metrics) is TagMap:
+            tags = <TagMap> metrics
+            for i in range(tags._len):
+                ret = self._pack_string(pk, <object> tags._entries[i].key)
                 if ret != 0:
                     return ret
-                ret = pack_number(&self.pk, v)
+                ret = pack_number(pk, <object> tags._entries[i].value)
+                if ret != 0:
+                    return ret
+        elif metrics:
+            for k, v in metrics.items():
+                ret = self._pack_string(pk, k)
+                if ret != 0:
+                    return ret
+                ret = pack_number(pk, v)
                 if ret != 0:
                     return ret
 
-        ret = self._pack_string(span.span_type)
+        ret = self._pack_string(pk, _span_field(span, is_span, _span_slots.span_type, "span_type"))
         if ret != 0:
             return ret
 
         return 0
 
+    cdef Py_ssize_t min_span_size(self, object span, bint is_span) except -1:
+        # The strings are packed as indices in the string table, which may already have them. The array header and
+        # the 12 fields take one byte at least, and so do the keys and values of the tags and metrics.
+        cdef Py_ssize_t size = 1 + 12
+
+        if not is_span:
+            return size
+
+        meta = _span_slot(span, _span_slots.meta)
+        if PyDict_CheckExact(meta) or type(meta) is TagMap:
+            size += 2 * len(meta)
+        metrics = _span_slot(span, _span_slots.metrics)
+        if PyDict_CheckExact(metrics) or type(metrics) is TagMap:
+            size += 2 * len(metrics)
+        return size
+
+    cdef int pack_store(self, msgpack_packer *pk, SpanStore store) except? -1:
+        cdef StoredSpanFields *span
+        cdef StoredTag *tag
+        cdef stdint.uint32_t t
+        cdef size_t i
+        cdef size_t n_strings = store._strings._next_id
+        cdef int ret
+        cdef char *dst
+        cdef char *end
+        # Ids of the strings of the store in the string table of the payload, which are all indexed before
+        # packing the spans, the only part which doesn't run any Python code.
+        cdef stdint.uint32_t *ids
+
+        if store._len > ITEM_LIMIT:
+            raise ValueError("span store is too large")
+
+        ids = <stdint.uint32_t *> PyMem_Malloc(n_strings * sizeof(stdint.uint32_t))
+        if ids == NULL:
+            raise MemoryError("Unable to allocate string ids.")
+        try:
+            for i in range(n_strings):
+                ids[i] = self._st._index(store._string(i))
+
+            ret = msgpack_pack_array(pk, store._len)
+            for i in range(store._len):
+                if ret != 0:
+                    return ret
+                span = &store._spans[i]
+
+                ret = msgpack_pack_array(pk, 12)
+                if ret == 0:
+                    ret = msgpack_pack_uint32(pk, ids[span.service])
+                if ret == 0:
+                    ret = msgpack_pack_uint32(pk, ids[span.name])
+                if ret == 0:
+                    ret = msgpack_pack_uint32(pk, ids[span.resource])
+                if ret != 0:
+                    return ret
+
+                # The ids, the times and the error
+                dst = msgpack_pack_reserve(pk, 6 * MSGPACK_MAX_NUMBER_SIZE)
+                if dst == NULL:
+                    return -1
+                end = msgpack_put_uint64(dst, store.trace_id)
+                end = msgpack_put_uint64(end, span.span_id)
+                end = msgpack_put_uint64(end, span.parent_id)
+                end = msgpack_put_int64(end, span.start_ns)
+                end = msgpack_put_int64(end, span.duration_ns)
+                end = msgpack_put_int64(end, span.error)
+                pk.length += end - dst
+
+                if ret == 0:
+                    ret = msgpack_pack_map(pk, span.meta_count)
+                t = span.meta
+                while ret == 0 and t != NO_TAG:
+                    tag = &store._tags[t]
+                    ret = msgpack_pack_uint32(pk, ids[tag.key])
+                    if ret == 0:
+                        ret = msgpack_pack_uint32(pk, ids[tag.value])
+                    t = tag.next
+
+                if ret == 0:
+                    ret = msgpack_pack_map(pk, span.metrics_count)
+                t = span.metrics
+                while ret == 0 and t != NO_TAG:
+                    tag = &store._tags[t]
+                    ret = msgpack_pack_uint32(pk, ids[tag.key])
+                    if ret == 0:
+                        ret = msgpack_pack_double(pk, tag.number)
+                    t = tag.next
+
+                if ret == 0:
+                    ret = msgpack_pack_uint32(pk, ids[span.span_type])
+            return ret
+        finally:
+            PyMem_Free(ids)
+
 
 cdef class Packer(object):
     """Slightly modified version of the v0.6.2 msgpack Packer
@@ -983,8 +2626,6 @@ cdef class Packer(object):
     cdef msgpack_packer pk
     cdef object _default
     cdef object _berrors
-    cdef const char *encoding
-    cdef const char *unicode_errors
 
     def __cinit__(self):
         cdef int buf_size = 1024*1024
@@ -1000,106 +2641,12 @@ cdef class Packer(object):
                 raise TypeError("default must be a callable.")
         self._default = default
 
-        if PY_MAJOR_VERSION < 3:
-            self.encoding = "utf-8"
-        else:
-            self.encoding = NULL
-
     def __dealloc__(self):
         PyMem_Free(self.pk.buf)
         self.pk.buf = NULL
 
     cdef int _pack(self, object o) except -1:
-        cdef long long llval
-        cdef unsigned long long ullval
-        cdef long longval
-        cdef double dval
-        cdef char* rawval
-        cdef int ret
-        cdef dict d
-        cdef Py_ssize_t L
-        cdef int default_used = 0
-
-        while True:
-            if o is None:
-                ret = msgpack_pack_nil(&self.pk)
-            elif PyLong_CheckExact(o):
-                # PyInt_Check(long) is True for Python 3.
-                # So we should test long before int.
-                try:
-                    if o > 0:
-                        ullval = o
-                        ret = msgpack_pack_unsigned_long_long(&self.pk, ullval)
-                    else:
-                        llval = o
-                        ret = msgpack_pack_long_long(&self.pk, llval)
-                except OverflowError as oe:
-                    if not default_used and self._default is not None:
-                        o = self._default(o)
-                        default_used = True
-                        continue
-                    else:
-                        raise OverflowError("Integer value out of range")
-            elif PyInt_CheckExact(o):
-                longval = o
-                ret = msgpack_pack_long(&self.pk, longval)
-            elif PyFloat_CheckExact(o):
-                dval = o
-                ret = msgpack_pack_double(&self.pk, dval)
-            elif PyBytesLike_CheckExact(o):
-                L = len(o)
-                if L > ITEM_LIMIT:
-                    PyErr_Format(ValueError, b"%.200s object is too large", Py_TYPE(o).tp_name)
-                rawval = o
-                ret = msgpack_pack_bin(&self.pk, L)
-                if ret == 0:
-                    ret = msgpack_pack_raw_body(&self.pk, rawval, L)
-            elif PyUnicode_CheckExact(o):
-                if self.encoding == NULL:
-                    ret = msgpack_pack_unicode(&self.pk, o, ITEM_LIMIT)
-                    if ret == -2:
-                        raise ValueError("unicode string is too large")
-                else:
-                    o = PyUnicode_AsEncodedString(o, self.encoding, self.unicode_errors)
-                    L = len(o)
-                    if L > ITEM_LIMIT:
-                        raise ValueError("unicode string is too large")
-                    ret = msgpack_pack_raw(&self.pk, L)
-                    if ret == 0:
-                        rawval = o
-                        ret = msgpack_pack_raw_body(&self.pk, rawval, L)
-            elif PyDict_CheckExact(o):
-                d = <dict>o
-                L = len(d)
-                if L > ITEM_LIMIT:
-                    raise ValueError("dict is too large")
-                ret = msgpack_pack_map(&self.pk, L)
-                if ret == 0:
-                    for k, v in d.items():
-                        ret = self._pack(k)
-                        if ret != 0:
-                            break
-                        ret = self._pack(v)
-                        if ret != 0:
-                            break
-            elif PyList_CheckExact(o):
-                L = Py_SIZE(o)
-                if L > ITEM_LIMIT:
-                    raise ValueError("list is too large")
-                ret = msgpack_pack_array(&self.pk, L)
-                if ret == 0:
-                    for v in o:
-                        ret = self._pack(v)
-                        if ret != 0:
-                            break
-            elif PyBool_Check(o):
-                if o:
-                    ret = msgpack_pack_true(&self.pk)
-                else:
-                    ret = msgpack_pack_false(&self.pk)
-            else:
-                PyErr_Format(TypeError, b"can not serialize '%.200s' object", Py_TYPE(o).tp_name)
-            return ret
+        return pack_object(&self.pk, o, self._default)
 
     cpdef pack(self, object obj):
         cdef int ret
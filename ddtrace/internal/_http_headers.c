@@ -0,0 +1,283 @@
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+/* Storage of the traced HTTP headers as tags of spans.
+
+   The names of the headers are normalized as normalize_header_name does, stripped and lowercased, without allocating
+   for the names which already are, and looked up in the header tags of the integration then in the global ones. The
+   dictionaries are the live ones of the configuration, so there is nothing to invalidate when headers are traced
+   later. The default tag of a header, when its configured tag is empty, is formatted once per header and kept for
+   the life of the process; there are as many as configured headers at most.
+
+   The values are written straight into the tags of the span, as Span.set_tag_str does, which is only called for
+   the values which are neither str nor bytes. */
+
+static PyObject* str_meta = NULL;
+static PyObject* str_set_tag_str = NULL;
+static PyObject* str_strip = NULL;
+static PyObject* str_lower = NULL;
+
+/* The default tags by prefix, then by normalized header name */
+static PyObject* default_tags = NULL;
+
+/* The same as str.isspace for ASCII characters */
+static inline int
+is_ascii_space(Py_UCS1 c)
+{
+    return c == ' ' || (c >= '\t' && c <= '\r') || (c >= 0x1c && c <= 0x1f);
+}
+
+/* The name stripped and lowercased, as a new reference */
+static PyObject*
+normalize_header_name(PyObject* name)
+{
+    const Py_UCS1* data;
+    Py_ssize_t start, end, i;
+    int lower = 1;
+    PyObject* normalized;
+    Py_UCS1* out;
+
+    if (!PyUnicode_IS_ASCII(name)) {
+        PyObject* stripped = PyObject_CallMethodObjArgs(name, str_strip, NULL);
+        if (stripped == NULL)
+            return NULL;
+        normalized = PyObject_CallMethodObjArgs(stripped, str_lower, NULL);
+        Py_DECREF(stripped);
+        return normalized;
+    }
+
+    data = PyUnicode_1BYTE_DATA(name);
+    start = 0;
+    end = PyUnicode_GET_LENGTH(name);
+    while (start < end && is_ascii_space(data[start]))
+        start++;
+    while (end > start && is_ascii_space(data[end - 1]))
+        end--;
+    for (i = start; i < end && lower; i++)
+        lower = !(data[i] >= 'A' && data[i] <= 'Z');
+
+    if (lower && start == 0 && end == PyUnicode_GET_LENGTH(name) && PyUnicode_CheckExact(name)) {
+        Py_INCREF(name);
+        return name;
+    }
+
+    normalized = PyUnicode_New(end - start, 127);
+    if (normalized == NULL)
+        return NULL;
+    out = PyUnicode_1BYTE_DATA(normalized);
+    for (i = start; i < end; i++)
+        out[i - start] = (data[i] >= 'A' && data[i] <= 'Z') ? (Py_UCS1)(data[i] + ('a' - 'A')) : data[i];
+    return normalized;
+}
+
+/* The prefix followed by the normalized name where the characters other than [a-z0-9_\-:/] are replaced by '_', as
+   trace_utils._normalize_tag_name, as a borrowed reference */
+static PyObject*
+default_tag_name(PyObject* prefix, PyObject* normalized)
+{
+    PyObject* cache;
+    PyObject* tag;
+    Py_ssize_t length, prefix_length, i;
+    Py_UCS1* out;
+    int kind;
+    const void* data;
+
+    cache = PyDict_GetItemWithError(default_tags, prefix);
+    if (cache == NULL) {
+        if (PyErr_Occurred())
+            return NULL;
+        cache = PyDict_New();
+        if (cache == NULL)
+            return NULL;
+        if (PyDict_SetItem(default_tags, prefix, cache) < 0) {
+            Py_DECREF(cache);
+            return NULL;
+        }
+        /* The dictionary of the prefixes keeps it */
+        Py_DECREF(cache);
+    }
+
+    tag = PyDict_GetItemWithError(cache, normalized);
+    if (tag != NULL || PyErr_Occurred())
+        return tag;
+
+    /* The prefixes are ASCII, and the normalized names become so */
+    if (!PyUnicode_IS_ASCII(prefix)) {
+        PyErr_SetString(PyExc_ValueError, "the prefix of the header tags must be ASCII");
+        return NULL;
+    }
+    prefix_length = PyUnicode_GET_LENGTH(prefix);
+    length = PyUnicode_GET_LENGTH(normalized);
+    tag = PyUnicode_New(prefix_length + length, 127);
+    if (tag == NULL)
+        return NULL;
+    out = PyUnicode_1BYTE_DATA(tag);
+    memcpy(out, PyUnicode_1BYTE_DATA(prefix), prefix_length);
+    out += prefix_length;
+
+    kind = PyUnicode_KIND(normalized);
+    data = PyUnicode_DATA(normalized);
+    for (i = 0; i < length; i++) {
+        Py_UCS4 c = PyUnicode_READ(kind, data, i);
+        int allowed = (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '_' || c == '-' || c == ':' || c == '/';
+        out[i] = allowed ? (Py_UCS1)c : '_';
+    }
+
+    if (PyDict_SetItem(cache, normalized, tag) < 0) {
+        Py_DECREF(tag);
+        return NULL;
+    }
+    /* The cache keeps it */
+    Py_DECREF(tag);
+    return tag;
+}
+
+/* The tag of the header, or NULL without an exception when it is not traced, as a borrowed reference */
+static PyObject*
+header_tag_name(PyObject* name, PyObject* tags, PyObject* global_tags, PyObject* prefix)
+{
+    PyObject* normalized;
+    PyObject* tag;
+    int truth;
+
+    normalized = normalize_header_name(name);
+    if (normalized == NULL)
+        return NULL;
+
+    /* The tags of the integration take precedence, a None tag being the same as a missing one */
+    tag = PyDict_GetItemWithError(tags, normalized);
+    if ((tag == NULL || tag == Py_None) && !PyErr_Occurred())
+        tag = PyDict_GetItemWithError(global_tags, normalized);
+    if (tag == Py_None)
+        tag = NULL;
+
+    /* An empty tag defaults to a http.<request or response>.headers.<header name> tag */
+    if (tag != NULL) {
+        truth = PyObject_IsTrue(tag);
+        if (truth < 0)
+            tag = NULL;
+        else if (!truth)
+            tag = default_tag_name(prefix, normalized);
+    }
+
+    Py_DECREF(normalized);
+    return tag;
+}
+
+static int
+store_header(PyObject* span, PyObject* meta, PyObject* tag, PyObject* value)
+{
+    PyObject* text;
+    int result;
+
+    if (PyUnicode_Check(value)) {
+        Py_INCREF(value);
+        text = value;
+    } else if (PyBytes_Check(value)) {
+        text = PyUnicode_DecodeUTF8(PyBytes_AS_STRING(value), PyBytes_GET_SIZE(value), "replace");
+        if (text == NULL)
+            return -1;
+    } else {
+        /* Let the span convert, or report, anything else */
+        PyObject* none = PyObject_CallMethodObjArgs(span, str_set_tag_str, tag, value, NULL);
+        Py_XDECREF(none);
+        return none == NULL ? -1 : 0;
+    }
+
+    result = PyDict_CheckExact(meta) ? PyDict_SetItem(meta, tag, text) : PyObject_SetItem(meta, tag, text);
+    Py_DECREF(text);
+    return result;
+}
+
+static PyObject*
+http_headers_store(PyObject* Py_UNUSED(module), PyObject* const* args, Py_ssize_t nargs)
+{
+    PyObject *span, *headers, *tags, *global_tags, *prefix;
+    PyObject* meta;
+    PyObject *name, *value;
+    Py_ssize_t pos = 0;
+    int result = 0;
+
+    if (nargs != 5) {
+        PyErr_Format(PyExc_TypeError, "store expected 5 arguments, got %zd", nargs);
+        return NULL;
+    }
+    span = args[0];
+    headers = args[1];
+    tags = args[2];
+    global_tags = args[3];
+    prefix = args[4];
+    if (!PyDict_Check(headers) || !PyDict_Check(tags) || !PyDict_Check(global_tags) || !PyUnicode_Check(prefix)) {
+        PyErr_SetString(PyExc_TypeError, "store expected the headers and the tags as dicts and the prefix as a str");
+        return NULL;
+    }
+
+    /* No header is traced */
+    if (PyDict_GET_SIZE(tags) == 0 && PyDict_GET_SIZE(global_tags) == 0)
+        Py_RETURN_NONE;
+
+    meta = PyObject_GetAttr(span, str_meta);
+    if (meta == NULL)
+        return NULL;
+
+    while (PyDict_Next(headers, &pos, &name, &value)) {
+        PyObject* tag;
+
+        /* Header names which are not str can't be configured */
+        if (!PyUnicode_Check(name))
+            continue;
+
+        /* Keep the header alive while the span and the tags run code */
+        Py_INCREF(name);
+        Py_INCREF(value);
+        tag = header_tag_name(name, tags, global_tags, prefix);
+        if (tag != NULL) {
+            Py_INCREF(tag);
+            result = store_header(span, meta, tag, value);
+            Py_DECREF(tag);
+        } else if (PyErr_Occurred()) {
+            result = -1;
+        }
+        Py_DECREF(name);
+        Py_DECREF(value);
+        if (result < 0)
+            break;
+    }
+
+    Py_DECREF(meta);
+    if (result < 0)
+        return NULL;
+
+    Py_RETURN_NONE;
+}
+
+static PyMethodDef http_headers_methods[] = {
+    { "store",
+      (PyCFunction)(void (*)(void))http_headers_store,
+      METH_FASTCALL,
+      "Set the headers traced by the tags of the integration, then the global ones, as tags of the span, the empty "
+      "tags defaulting to the prefix followed by the normalized header name" },
+    { NULL, NULL, 0, NULL }
+};
+
+static struct PyModuleDef http_headers_module = {
+    PyModuleDef_HEAD_INIT, "ddtrace.internal._http_headers", "native header tags", -1, http_headers_methods
+};
+
+PyMODINIT_FUNC
+PyInit__http_headers(void)
+{
+#define INTERN(name, value)                                                                                            \
+    if (name == NULL && (name = PyUnicode_InternFromString(value)) == NULL)                                            \
+        return NULL;
+    INTERN(str_meta, "_meta");
+    INTERN(str_set_tag_str, "set_tag_str");
+    INTERN(str_strip, "strip");
+    INTERN(str_lower, "lower");
+#undef INTERN
+
+    if (default_tags == NULL && (default_tags = PyDict_New()) == NULL)
+        return NULL;
+
+    return PyModule_Create(&http_headers_module);
+}
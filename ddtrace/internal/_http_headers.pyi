@@ -0,0 +1,9 @@
+import typing as t
+
+def store(
+    span: t.Any,
+    headers: t.Dict[t.Any, t.Any],
+    tags: t.Dict[str, t.Optional[str]],
+    global_tags: t.Dict[str, t.Optional[str]],
+    prefix: str,
+) -> None: ...
@@ -0,0 +1,1745 @@
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <limits.h>
+#include <stdint.h>
+#include <string.h>
+
+/* Native injection of hook calls into code objects.
+
+   The instructions of a code object are decoded from its bytecode, the hook calls are spliced in before the first
+   instruction of their lines (or the injected calls are taken out), and the bytecode is assembled again: the jumps,
+   the line (or location) table, the exception table, the EXTENDED_ARG prefixes and the stack size are all fixed up
+   for the version of CPython, as the compiler would have produced them. The opcodes come from the opcode module of
+   the interpreter at import time. */
+
+#define SUPPORTED_VERSION (PY_VERSION_HEX >= 0x03090000 && PY_VERSION_HEX < 0x030e0000)
+
+#if SUPPORTED_VERSION
+
+/* Opcode properties */
+#define F_JREL 1
+#define F_JABS 2
+#define F_CONST 4
+#define F_BACKWARD 8
+#define F_NO_FALLTHROUGH 16
+
+static uint8_t op_flags[256];
+static uint8_t op_caches[256];
+
+static int OP_EXTENDED_ARG = -1;
+static int OP_LOAD_CONST = -1;
+static int OP_POP_TOP = -1;
+static int OP_NOP = -1;
+static int OP_CALL = -1;
+static int OP_PUSH_NULL = -1;
+static int OP_PRECALL = -1;
+static int OP_RESUME = -1;
+static int OP_END_FOR = -1;
+
+/* The stack slots taken by a hook call */
+#if PY_VERSION_HEX >= 0x030b0000
+#define HOOK_STACK 3
+#else
+#define HOOK_STACK 2
+#endif
+
+/* Positions of the constants in the hook call */
+#if PY_VERSION_HEX >= 0x030d0000
+#define HOOK_SIZE 5
+#define HOOK_POS 0
+#define ARG_POS 2
+#elif PY_VERSION_HEX >= 0x030c0000
+#define HOOK_SIZE 5
+#define HOOK_POS 1
+#define ARG_POS 2
+#elif PY_VERSION_HEX >= 0x030b0000
+#define HOOK_SIZE 6
+#define HOOK_POS 1
+#define ARG_POS 2
+#else
+#define HOOK_SIZE 4
+#define HOOK_POS 0
+#define ARG_POS 1
+#endif
+
+typedef struct
+{
+    int line;
+    int end_line;
+    int col;
+    int end_col;
+} Loc;
+
+static const Loc NO_LOC = { -1, -1, -1, -1 };
+
+typedef struct
+{
+    int opcode;
+    int oparg;
+    /* Number of EXTENDED_ARG prefixes */
+    int ext;
+    int caches;
+    /* Instruction jumped to, in the original instructions */
+    Py_ssize_t target;
+    /* Instruction jumped to, in the instructions of the same sequence */
+    Py_ssize_t jump;
+    Loc loc;
+} Instr;
+
+typedef struct
+{
+    Py_ssize_t start;
+    Py_ssize_t end;
+    Py_ssize_t target;
+    int depth;
+    int lasti;
+} Handler;
+
+/* Growable buffers */
+typedef struct
+{
+    unsigned char* data;
+    Py_ssize_t size;
+    Py_ssize_t capacity;
+} Buffer;
+
+static int
+buffer_put(Buffer* buffer, unsigned char byte)
+{
+    if (buffer->size == buffer->capacity) {
+        Py_ssize_t capacity = buffer->capacity ? buffer->capacity * 2 : 256;
+        unsigned char* data = PyMem_Realloc(buffer->data, capacity);
+
+        if (data == NULL) {
+            PyErr_NoMemory();
+            return -1;
+        }
+        buffer->data = data;
+        buffer->capacity = capacity;
+    }
+    buffer->data[buffer->size++] = byte;
+    return 0;
+}
+
+static PyObject*
+buffer_finish(Buffer* buffer)
+{
+    PyObject* bytes = PyBytes_FromStringAndSize((const char*)buffer->data, buffer->size);
+
+    PyMem_Free(buffer->data);
+    buffer->data = NULL;
+    return bytes;
+}
+
+#define GROW(array, count, capacity, type)                                                                             \
+    ((count) < (capacity) || grow_array((void**)&(array), &(capacity), sizeof(type)) == 0)
+
+static int
+grow_array(void** array, Py_ssize_t* capacity, size_t item_size)
+{
+    Py_ssize_t new_capacity = *capacity ? *capacity * 2 : 64;
+    void* grown = PyMem_Realloc(*array, new_capacity * item_size);
+
+    if (grown == NULL) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    *array = grown;
+    *capacity = new_capacity;
+    return 0;
+}
+
+static inline int
+loc_equal(const Loc* a, const Loc* b)
+{
+    return a->line == b->line && a->end_line == b->end_line && a->col == b->col && a->end_col == b->end_col;
+}
+
+// ----------------------------------------------------------------------------
+// Line tables
+
+#if PY_VERSION_HEX >= 0x030b0000
+static int
+read_varint(const unsigned char** p, const unsigned char* end, unsigned int* value)
+{
+    unsigned int read;
+    unsigned int shift = 0;
+
+    if (*p >= end)
+        return -1;
+    read = *(*p)++;
+    *value = read & 63;
+    while (read & 64) {
+        if (*p >= end)
+            return -1;
+        read = *(*p)++;
+        shift += 6;
+        *value |= (read & 63) << shift;
+    }
+    return 0;
+}
+
+static int
+read_svarint(const unsigned char** p, const unsigned char* end, int* value)
+{
+    unsigned int uval;
+
+    if (read_varint(p, end, &uval) < 0)
+        return -1;
+    *value = (uval & 1) ? -(int)(uval >> 1) : (int)(uval >> 1);
+    return 0;
+}
+
+static int
+write_varint(Buffer* buffer, unsigned int value)
+{
+    while (value >= 64) {
+        if (buffer_put(buffer, (unsigned char)((value & 63) | 64)) < 0)
+            return -1;
+        value >>= 6;
+    }
+    return buffer_put(buffer, (unsigned char)value);
+}
+
+static int
+write_svarint(Buffer* buffer, int value)
+{
+    return write_varint(buffer, value < 0 ? ((unsigned int)(-value) << 1) | 1 : (unsigned int)value << 1);
+}
+#endif
+
+/* Fill the location of each code unit */
+static int
+decode_locations(PyObject* table, int first_line, Loc* locs, Py_ssize_t n_units)
+{
+    const unsigned char* p = (const unsigned char*)PyBytes_AS_STRING(table);
+    const unsigned char* end = p + PyBytes_GET_SIZE(table);
+    int line = first_line;
+    Py_ssize_t unit = 0;
+    Py_ssize_t i;
+
+    for (i = 0; i < n_units; i++)
+        locs[i] = NO_LOC;
+
+#if PY_VERSION_HEX >= 0x030b0000
+    while (p < end && unit < n_units) {
+        unsigned char first = *p++;
+        int code = (first >> 3) & 15;
+        Py_ssize_t length = (first & 7) + 1;
+        Loc loc = NO_LOC;
+
+        if (!(first & 128))
+            goto invalid;
+
+        if (code == 15) {
+            /* No location */
+        } else if (code == 14) {
+            int delta;
+            unsigned int end_delta, col, end_col;
+
+            if (read_svarint(&p, end, &delta) < 0 || read_varint(&p, end, &end_delta) < 0 ||
+                read_varint(&p, end, &col) < 0 || read_varint(&p, end, &end_col) < 0)
+                goto invalid;
+            line += delta;
+            loc.line = line;
+            loc.end_line = line + (int)end_delta;
+            loc.col = (int)col - 1;
+            loc.end_col = (int)end_col - 1;
+        } else if (code == 13) {
+            int delta;
+
+            if (read_svarint(&p, end, &delta) < 0)
+                goto invalid;
+            line += delta;
+            loc.line = loc.end_line = line;
+        } else if (code >= 10) {
+            if (end - p < 2)
+                goto invalid;
+            line += code - 10;
+            loc.line = loc.end_line = line;
+            loc.col = *p++;
+            loc.end_col = *p++;
+        } else {
+            int second;
+
+            if (p >= end)
+                goto invalid;
+            second = *p++;
+            loc.line = loc.end_line = line;
+            loc.col = code * 8 + ((second >> 4) & 7);
+            loc.end_col = loc.col + (second & 15);
+        }
+
+        for (i = 0; i < length && unit < n_units; i++)
+            locs[unit++] = loc;
+    }
+#elif PY_VERSION_HEX >= 0x030a0000
+    /* Ranges of bytes, and how the line changes for them */
+    Py_ssize_t start = 0;
+
+    for (; end - p >= 2; p += 2) {
+        Py_ssize_t stop = start + p[0];
+        int delta = (signed char)p[1];
+        int range_line = -1;
+
+        if (delta != -128) {
+            line += delta;
+            range_line = line;
+        }
+        for (unit = start / 2; unit < stop / 2 && unit < n_units; unit++)
+            locs[unit].line = locs[unit].end_line = range_line;
+        start = stop;
+    }
+#else
+    /* Increments of the offset, and then of the line */
+    Py_ssize_t offset = 0;
+
+    for (; end - p >= 2; p += 2) {
+        Py_ssize_t stop = offset + p[0];
+
+        for (unit = offset / 2; unit < stop / 2 && unit < n_units; unit++)
+            locs[unit].line = locs[unit].end_line = line;
+        offset = stop;
+        line += (signed char)p[1];
+    }
+    for (unit = offset / 2; unit < n_units; unit++)
+        locs[unit].line = locs[unit].end_line = line;
+#endif
+    return 0;
+
+#if PY_VERSION_HEX >= 0x030b0000
+invalid:
+    PyErr_SetString(PyExc_ValueError, "invalid location table");
+    return -1;
+#endif
+}
+
+#if PY_VERSION_HEX >= 0x030b0000
+static int
+write_location_entry(Buffer* buffer, const Loc* loc, int length, int* prev_line)
+{
+    int delta;
+
+    if (loc->line < 0)
+        return buffer_put(buffer, (unsigned char)(0x80 | (15 << 3) | (length - 1)));
+
+    delta = loc->line - *prev_line;
+    *prev_line = loc->line;
+
+    if (loc->col < 0 || loc->end_col < 0) {
+        if (loc->end_line == loc->line || loc->end_line < 0) {
+            if (buffer_put(buffer, (unsigned char)(0x80 | (13 << 3) | (length - 1))) < 0)
+                return -1;
+            return write_svarint(buffer, delta);
+        }
+    } else if (loc->end_line == loc->line) {
+        if (delta == 0 && loc->col < 80 && loc->end_col - loc->col < 16 && loc->end_col >= loc->col) {
+            if (buffer_put(buffer, (unsigned char)(0x80 | ((loc->col / 8) << 3) | (length - 1))) < 0)
+                return -1;
+            return buffer_put(buffer, (unsigned char)(((loc->col % 8) << 4) | (loc->end_col - loc->col)));
+        }
+        if (delta >= 0 && delta < 3 && loc->col < 128 && loc->end_col < 128) {
+            if (buffer_put(buffer, (unsigned char)(0x80 | ((10 + delta) << 3) | (length - 1))) < 0 ||
+                buffer_put(buffer, (unsigned char)loc->col) < 0)
+                return -1;
+            return buffer_put(buffer, (unsigned char)loc->end_col);
+        }
+    }
+
+    if (buffer_put(buffer, (unsigned char)(0x80 | (14 << 3) | (length - 1))) < 0 || write_svarint(buffer, delta) < 0 ||
+        write_varint(buffer, loc->end_line > loc->line ? (unsigned int)(loc->end_line - loc->line) : 0) < 0 ||
+        write_varint(buffer, (unsigned int)(loc->col + 1)) < 0)
+        return -1;
+    return write_varint(buffer, (unsigned int)(loc->end_col + 1));
+}
+#else
+static int
+put_pair(Buffer* buffer, int first, int second)
+{
+    if (buffer_put(buffer, (unsigned char)first) < 0)
+        return -1;
+    return buffer_put(buffer, (unsigned char)(second & 0xff));
+}
+#endif
+
+/* Encode the line table of the instructions, taking up the units of their sizes */
+static PyObject*
+encode_locations(Instr* instrs, Py_ssize_t count, int first_line)
+{
+    Buffer buffer = { NULL, 0, 0 };
+    Py_ssize_t i = 0;
+    int prev_line = first_line;
+
+#if PY_VERSION_HEX >= 0x030a0000
+    while (i < count) {
+        /* A run of instructions at the same location */
+        Loc loc = instrs[i].loc;
+        Py_ssize_t units = 0;
+
+#if PY_VERSION_HEX >= 0x030b0000
+#if PY_VERSION_HEX < 0x030c0000
+        /* One entry for each instruction, as the compiler writes them */
+        units = instrs[i].ext + 1 + instrs[i].caches;
+        i++;
+#else
+        for (; i < count && loc_equal(&instrs[i].loc, &loc); i++)
+            units += instrs[i].ext + 1 + instrs[i].caches;
+#endif
+
+        while (units > 0) {
+            int length = units > 8 ? 8 : (int)units;
+
+            if (write_location_entry(&buffer, &loc, length, &prev_line) < 0)
+                goto error;
+            units -= length;
+        }
+#else
+        Py_ssize_t bdelta;
+        int ldelta = -128;
+
+        for (; i < count && instrs[i].loc.line == loc.line; i++)
+            units += instrs[i].ext + 1 + instrs[i].caches;
+        bdelta = units * 2;
+
+        if (loc.line >= 0) {
+            ldelta = loc.line - prev_line;
+            prev_line = loc.line;
+            for (; ldelta > 127; ldelta -= 127)
+                if (put_pair(&buffer, 0, 127) < 0)
+                    goto error;
+            for (; ldelta < -127; ldelta += 127)
+                if (put_pair(&buffer, 0, -127) < 0)
+                    goto error;
+        }
+        for (; bdelta > 254; bdelta -= 254) {
+            if (put_pair(&buffer, 254, ldelta) < 0)
+                goto error;
+            ldelta = loc.line < 0 ? -128 : 0;
+        }
+        if (put_pair(&buffer, (int)bdelta, ldelta) < 0)
+            goto error;
+#endif
+    }
+#else
+    /* The offsets where the lines change, and by how much */
+    Py_ssize_t offset = 0;
+    Py_ssize_t last_offset = 0;
+
+    for (; i < count; i++) {
+        int line = instrs[i].loc.line;
+
+        if (line >= 0 && line != prev_line) {
+            Py_ssize_t bdelta = offset - last_offset;
+            int ldelta = line - prev_line;
+
+            for (; bdelta > 255; bdelta -= 255)
+                if (put_pair(&buffer, 255, 0) < 0)
+                    goto error;
+            for (; ldelta > 127; ldelta -= 127, bdelta = 0)
+                if (put_pair(&buffer, (int)bdelta, 127) < 0)
+                    goto error;
+            for (; ldelta < -128; ldelta += 128, bdelta = 0)
+                if (put_pair(&buffer, (int)bdelta, -128) < 0)
+                    goto error;
+            if ((bdelta || ldelta) && put_pair(&buffer, (int)bdelta, ldelta) < 0)
+                goto error;
+            last_offset = offset;
+            prev_line = line;
+        }
+        offset += (instrs[i].ext + 1 + instrs[i].caches) * 2;
+    }
+#endif
+
+    return buffer_finish(&buffer);
+
+error:
+    PyMem_Free(buffer.data);
+    return NULL;
+}
+
+// ----------------------------------------------------------------------------
+// Exception table
+
+#if PY_VERSION_HEX >= 0x030b0000
+static int
+read_exception_varint(const unsigned char** p, const unsigned char* end, Py_ssize_t* value)
+{
+    unsigned int read;
+
+    if (*p >= end)
+        return -1;
+    read = *(*p)++;
+    *value = read & 63;
+    while (read & 64) {
+        if (*p >= end)
+            return -1;
+        read = *(*p)++;
+        *value = (*value << 6) | (read & 63);
+    }
+    return 0;
+}
+
+static int
+write_exception_varint(Buffer* buffer, Py_ssize_t value, int msb)
+{
+    int shift;
+
+    for (shift = 24; shift > 0; shift -= 6)
+        if (value >= ((Py_ssize_t)1 << shift)) {
+            if (buffer_put(buffer, (unsigned char)(((value >> shift) & 63) | 64 | msb)) < 0)
+                return -1;
+            msb = 0;
+        }
+    return buffer_put(buffer, (unsigned char)((value & 63) | msb));
+}
+#endif
+
+// ----------------------------------------------------------------------------
+// Stack depth
+
+/* The maximum depth of the stack of the instructions, as the compiler computes it, or -1 if that's not possible */
+static int
+stack_depth(Instr* instrs, Py_ssize_t count, Handler* handlers, Py_ssize_t n_handlers)
+{
+    /* The deepest stack each instruction is reached with */
+    int* depths = PyMem_Malloc(sizeof(int) * (count + 1));
+    Py_ssize_t* pending = NULL;
+    int* pending_depths = NULL;
+    Py_ssize_t n_pending = 0;
+    Py_ssize_t capacity = 0;
+    Py_ssize_t depths_capacity = 0;
+    int max_depth = 0;
+    Py_ssize_t i;
+
+    if (depths == NULL)
+        return -1;
+    for (i = 0; i <= count; i++)
+        depths[i] = -1;
+
+    for (i = -1; i < n_handlers; i++) {
+        /* The code starts with an empty stack, the handlers with the exception */
+        Py_ssize_t start = i < 0 ? 0 : handlers[i].target;
+        int depth = i < 0 ? 0 : handlers[i].depth + handlers[i].lasti + 1;
+
+        if (start >= count || depths[start] >= depth)
+            continue;
+        if (!GROW(pending, n_pending, capacity, Py_ssize_t) ||
+            !GROW(pending_depths, n_pending, depths_capacity, int))
+            goto error;
+        depths[start] = depth;
+        pending[n_pending] = start;
+        pending_depths[n_pending++] = depth;
+    }
+
+    while (n_pending > 0) {
+        Py_ssize_t index = pending[--n_pending];
+        int depth = pending_depths[n_pending];
+
+        /* Reached with a deeper stack since */
+        if (depths[index] > depth)
+            continue;
+        if (depth > max_depth)
+            max_depth = depth;
+
+        for (; index < count; index++) {
+            Instr* instr = &instrs[index];
+            int flags = op_flags[instr->opcode];
+            int effect;
+
+            if (depths[index] > depth)
+                break;
+            depths[index] = depth;
+
+            if (flags & (F_JREL | F_JABS)) {
+                int target_depth = PyCompile_OpcodeStackEffectWithJump(instr->opcode, instr->oparg, 1);
+
+                if (target_depth == PY_INVALID_STACK_EFFECT)
+                    goto invalid;
+                target_depth += depth;
+                if (target_depth > max_depth)
+                    max_depth = target_depth;
+                if (instr->jump < count && depths[instr->jump] < target_depth) {
+                    if (!GROW(pending, n_pending, capacity, Py_ssize_t) ||
+                        !GROW(pending_depths, n_pending, depths_capacity, int))
+                        goto error;
+                    depths[instr->jump] = target_depth;
+                    pending[n_pending] = instr->jump;
+                    pending_depths[n_pending++] = target_depth;
+                }
+            }
+
+            effect = PyCompile_OpcodeStackEffectWithJump(instr->opcode, instr->oparg, 0);
+            if (effect == PY_INVALID_STACK_EFFECT)
+                goto invalid;
+            depth += effect;
+            if (depth > max_depth)
+                max_depth = depth;
+            if (flags & F_NO_FALLTHROUGH)
+                break;
+            /* Reached with at least as deep a stack already */
+            if (index + 1 < count && depths[index + 1] >= depth)
+                break;
+        }
+    }
+
+    PyMem_Free(depths);
+    PyMem_Free(pending);
+    PyMem_Free(pending_depths);
+    return max_depth;
+
+invalid:
+    PyErr_Clear();
+error:
+    PyErr_Clear();
+    PyMem_Free(depths);
+    PyMem_Free(pending);
+    PyMem_Free(pending_depths);
+    return -1;
+}
+
+// ----------------------------------------------------------------------------
+// Code objects
+
+typedef struct
+{
+    PyObject* code;
+    int first_line;
+    Py_ssize_t n_units;
+    Instr* instrs;
+    Py_ssize_t count;
+    /* Index of the instruction of each unit, count for the end */
+    Py_ssize_t* unit_instrs;
+    Handler* handlers;
+    Py_ssize_t n_handlers;
+    PyObject* consts;
+    /* Number of constants of the code object */
+    Py_ssize_t n_consts;
+    int stacksize;
+} Code;
+
+static void
+code_clear(Code* code)
+{
+    PyMem_Free(code->instrs);
+    PyMem_Free(code->unit_instrs);
+    PyMem_Free(code->handlers);
+    Py_XDECREF(code->consts);
+    memset(code, 0, sizeof(*code));
+}
+
+static int
+get_int_attr(PyObject* object, const char* name, int* value)
+{
+    PyObject* attr = PyObject_GetAttrString(object, name);
+
+    if (attr == NULL)
+        return -1;
+    *value = (int)PyLong_AsLong(attr);
+    Py_DECREF(attr);
+    return *value == -1 && PyErr_Occurred() ? -1 : 0;
+}
+
+static int
+code_decode(Code* code, PyObject* code_object)
+{
+    PyObject* bytecode = NULL;
+    PyObject* table = NULL;
+    PyObject* consts = NULL;
+    Loc* locs = NULL;
+    const unsigned char* raw;
+    Py_ssize_t unit;
+    Py_ssize_t i;
+    int ext_arg = 0;
+    int ext = 0;
+
+    memset(code, 0, sizeof(*code));
+    code->code = code_object;
+
+    if (!PyCode_Check(code_object)) {
+        PyErr_SetString(PyExc_TypeError, "expected a code object");
+        return -1;
+    }
+
+    if (get_int_attr(code_object, "co_firstlineno", &code->first_line) < 0 ||
+        get_int_attr(code_object, "co_stacksize", &code->stacksize) < 0)
+        return -1;
+
+    bytecode = PyObject_GetAttrString(code_object, "co_code");
+    if (bytecode == NULL)
+        goto error;
+    if (!PyBytes_Check(bytecode) || PyBytes_GET_SIZE(bytecode) % 2) {
+        PyErr_SetString(PyExc_ValueError, "invalid bytecode");
+        goto error;
+    }
+    raw = (const unsigned char*)PyBytes_AS_STRING(bytecode);
+    code->n_units = PyBytes_GET_SIZE(bytecode) / 2;
+
+#if PY_VERSION_HEX >= 0x030a0000
+    table = PyObject_GetAttrString(code_object, "co_linetable");
+#else
+    table = PyObject_GetAttrString(code_object, "co_lnotab");
+#endif
+    if (table == NULL)
+        goto error;
+    if (!PyBytes_Check(table)) {
+        PyErr_SetString(PyExc_ValueError, "invalid line table");
+        goto error;
+    }
+
+    locs = PyMem_Malloc(sizeof(Loc) * (code->n_units + 1));
+    code->instrs = PyMem_Malloc(sizeof(Instr) * (code->n_units + 1));
+    code->unit_instrs = PyMem_Malloc(sizeof(Py_ssize_t) * (code->n_units + 1));
+    if (locs == NULL || code->instrs == NULL || code->unit_instrs == NULL) {
+        PyErr_NoMemory();
+        goto error;
+    }
+    if (decode_locations(table, code->first_line, locs, code->n_units) < 0)
+        goto error;
+
+    for (unit = 0; unit < code->n_units;) {
+        int opcode = raw[2 * unit];
+        int oparg = raw[2 * unit + 1] | ext_arg;
+        Instr* instr;
+
+        code->unit_instrs[unit] = code->count;
+        if (opcode == OP_EXTENDED_ARG) {
+            ext_arg = oparg << 8;
+            ext++;
+            unit++;
+            continue;
+        }
+        instr = &code->instrs[code->count++];
+        instr->opcode = opcode;
+        instr->oparg = oparg;
+        instr->ext = ext;
+        instr->caches = op_caches[opcode];
+        instr->target = -1;
+        instr->jump = -1;
+        instr->loc = locs[unit];
+
+        /* The target is resolved into an instruction once they are all known */
+        if (op_flags[opcode] & (F_JREL | F_JABS)) {
+            Py_ssize_t next = unit + 1 + instr->caches;
+
+#if PY_VERSION_HEX >= 0x030b0000
+            instr->target = (op_flags[opcode] & F_BACKWARD) ? next - oparg : next + oparg;
+#elif PY_VERSION_HEX >= 0x030a0000
+            instr->target = (op_flags[opcode] & F_JABS) ? oparg : next + oparg;
+#else
+            instr->target = (op_flags[opcode] & F_JABS) ? oparg / 2 : next + oparg / 2;
+#endif
+        }
+
+        for (i = 1; i <= instr->caches && unit + i < code->n_units; i++)
+            code->unit_instrs[unit + i] = code->count - 1;
+        unit += 1 + instr->caches;
+        ext_arg = 0;
+        ext = 0;
+    }
+    if (ext) {
+        PyErr_SetString(PyExc_ValueError, "invalid bytecode");
+        goto error;
+    }
+    code->unit_instrs[code->n_units] = code->count;
+
+    for (i = 0; i < code->count; i++) {
+        Instr* instr = &code->instrs[i];
+
+        if (instr->target >= 0) {
+            if (instr->target > code->n_units) {
+                PyErr_SetString(PyExc_ValueError, "invalid jump target");
+                goto error;
+            }
+            instr->target = code->unit_instrs[instr->target];
+            instr->jump = instr->target;
+        } else if (op_flags[instr->opcode] & (F_JREL | F_JABS)) {
+            PyErr_SetString(PyExc_ValueError, "invalid jump target");
+            goto error;
+        }
+    }
+
+#if PY_VERSION_HEX >= 0x030b0000
+    {
+        PyObject* exceptions = PyObject_GetAttrString(code_object, "co_exceptiontable");
+        const unsigned char* p;
+        const unsigned char* end;
+        Py_ssize_t capacity = 0;
+
+        if (exceptions == NULL)
+            goto error;
+        if (!PyBytes_Check(exceptions)) {
+            Py_DECREF(exceptions);
+            PyErr_SetString(PyExc_ValueError, "invalid exception table");
+            goto error;
+        }
+        p = (const unsigned char*)PyBytes_AS_STRING(exceptions);
+        end = p + PyBytes_GET_SIZE(exceptions);
+        while (p < end) {
+            Py_ssize_t entry_start, size, target, depth_lasti;
+            Handler* handler;
+
+            if (read_exception_varint(&p, end, &entry_start) < 0 || read_exception_varint(&p, end, &size) < 0 ||
+                read_exception_varint(&p, end, &target) < 0 || read_exception_varint(&p, end, &depth_lasti) < 0 ||
+                entry_start + size > code->n_units || target >= code->n_units) {
+                Py_DECREF(exceptions);
+                PyErr_SetString(PyExc_ValueError, "invalid exception table");
+                goto error;
+            }
+            if (!GROW(code->handlers, code->n_handlers, capacity, Handler)) {
+                Py_DECREF(exceptions);
+                goto error;
+            }
+            handler = &code->handlers[code->n_handlers++];
+            handler->start = code->unit_instrs[entry_start];
+            handler->end = code->unit_instrs[entry_start + size];
+            handler->target = code->unit_instrs[target];
+            handler->depth = (int)(depth_lasti >> 1);
+            handler->lasti = (int)(depth_lasti & 1);
+        }
+        Py_DECREF(exceptions);
+    }
+#endif
+
+    consts = PyObject_GetAttrString(code_object, "co_consts");
+    if (consts == NULL)
+        goto error;
+    code->consts = PySequence_List(consts);
+    Py_DECREF(consts);
+    if (code->consts == NULL)
+        goto error;
+    code->n_consts = PyList_GET_SIZE(code->consts);
+
+    Py_DECREF(bytecode);
+    Py_DECREF(table);
+    PyMem_Free(locs);
+    return 0;
+
+error:
+    Py_XDECREF(bytecode);
+    Py_XDECREF(table);
+    PyMem_Free(locs);
+    code_clear(code);
+    return -1;
+}
+
+static inline int
+ext_needed(int oparg)
+{
+    return oparg > 0xffffff ? 3 : oparg > 0xffff ? 2 : oparg > 0xff ? 1 : 0;
+}
+
+/* Assemble the new instructions into a new code object. Each original instruction starts at slots[index] in them:
+   the jumps to it, and the handlers, go to the hook calls injected before it, or to the instruction that follows
+   when it was taken out. */
+static PyObject*
+code_assemble(Code* code, Instr* instrs, Py_ssize_t count, Py_ssize_t* slots)
+{
+    Py_ssize_t* positions = NULL;
+    Handler* handlers = NULL;
+    Buffer bytecode = { NULL, 0, 0 };
+    PyObject* code_bytes = NULL;
+    PyObject* line_table = NULL;
+    PyObject* consts = NULL;
+    PyObject* kwargs = NULL;
+    PyObject* replace = NULL;
+    PyObject* empty = NULL;
+    PyObject* result = NULL;
+    int stacksize;
+    int old_depth;
+    int new_depth;
+    int changed;
+    Py_ssize_t i;
+
+    positions = PyMem_Malloc(sizeof(Py_ssize_t) * (count + 1));
+    handlers = PyMem_Malloc(sizeof(Handler) * (code->n_handlers + 1));
+    if (positions == NULL || handlers == NULL) {
+        PyErr_NoMemory();
+        goto done;
+    }
+
+    for (i = 0; i < count; i++) {
+        /* The prefixes of the jumps grow from none as they need them */
+        instrs[i].ext = instrs[i].target < 0 ? ext_needed(instrs[i].oparg) : 0;
+        if (instrs[i].target >= 0)
+            instrs[i].jump = slots[instrs[i].target];
+    }
+    for (i = 0; i < code->n_handlers; i++) {
+        handlers[i] = code->handlers[i];
+        handlers[i].start = slots[handlers[i].start];
+        handlers[i].end = slots[handlers[i].end];
+        handlers[i].target = slots[handlers[i].target];
+    }
+
+    /* The jumps may need more EXTENDED_ARG prefixes as the instructions move, which moves them further */
+    do {
+        Py_ssize_t position = 0;
+
+        changed = 0;
+        for (i = 0; i < count; i++) {
+            positions[i] = position;
+            position += instrs[i].ext + 1 + instrs[i].caches;
+        }
+        positions[count] = position;
+
+        for (i = 0; i < count; i++) {
+            Instr* instr = &instrs[i];
+            Py_ssize_t target;
+            Py_ssize_t arg;
+
+            if (instr->target < 0)
+                continue;
+
+            target = positions[instr->jump];
+#if PY_VERSION_HEX >= 0x030b0000
+            arg = (op_flags[instr->opcode] & F_BACKWARD) ? positions[i + 1] - target : target - positions[i + 1];
+#elif PY_VERSION_HEX >= 0x030a0000
+            arg = (op_flags[instr->opcode] & F_JABS) ? target : target - positions[i + 1];
+#else
+            arg = ((op_flags[instr->opcode] & F_JABS) ? target : target - positions[i + 1]) * 2;
+#endif
+            if (arg < 0 || arg > INT_MAX) {
+                PyErr_SetString(PyExc_ValueError, "invalid jump");
+                goto done;
+            }
+            instr->oparg = (int)arg;
+            if (ext_needed(instr->oparg) > instr->ext) {
+                instr->ext = ext_needed(instr->oparg);
+                changed = 1;
+            }
+        }
+    } while (changed);
+
+    for (i = 0; i < count; i++) {
+        Instr* instr = &instrs[i];
+        int e;
+        int c;
+
+        for (e = instr->ext; e > 0; e--)
+            if (buffer_put(&bytecode, (unsigned char)OP_EXTENDED_ARG) < 0 ||
+                buffer_put(&bytecode, (unsigned char)((instr->oparg >> (8 * e)) & 0xff)) < 0)
+                goto done;
+        if (buffer_put(&bytecode, (unsigned char)instr->opcode) < 0 ||
+            buffer_put(&bytecode, (unsigned char)(instr->oparg & 0xff)) < 0)
+            goto done;
+        for (c = 0; c < instr->caches; c++)
+            if (buffer_put(&bytecode, 0) < 0 || buffer_put(&bytecode, 0) < 0)
+                goto done;
+    }
+    code_bytes = buffer_finish(&bytecode);
+    if (code_bytes == NULL)
+        goto done;
+
+    line_table = encode_locations(instrs, count, code->first_line);
+    if (line_table == NULL)
+        goto done;
+
+    /* The stack size grows (or shrinks) as much as the depth of the stack, which accounts for the flaws there may be
+       in computing it as the compiler does the same way in both */
+    old_depth = stack_depth(code->instrs, code->count, code->handlers, code->n_handlers);
+    new_depth = stack_depth(instrs, count, handlers, code->n_handlers);
+    if (PyErr_Occurred())
+        goto done;
+    if (old_depth < 0 || new_depth < 0)
+        stacksize = code->stacksize + HOOK_STACK;
+    else
+        stacksize = code->stacksize + new_depth - old_depth;
+    if (stacksize < new_depth)
+        stacksize = new_depth;
+
+    consts = PyList_AsTuple(code->consts);
+    kwargs = Py_BuildValue("{sOsOsi}", "co_code", code_bytes, "co_consts", consts, "co_stacksize", stacksize);
+    if (kwargs == NULL)
+        goto done;
+#if PY_VERSION_HEX >= 0x030a0000
+    if (PyDict_SetItemString(kwargs, "co_linetable", line_table) < 0)
+        goto done;
+#else
+    if (PyDict_SetItemString(kwargs, "co_lnotab", line_table) < 0)
+        goto done;
+#endif
+
+#if PY_VERSION_HEX >= 0x030b0000
+    {
+        Buffer exceptions = { NULL, 0, 0 };
+        PyObject* exception_table;
+
+        for (i = 0; i < code->n_handlers; i++) {
+            Handler* handler = &handlers[i];
+            Py_ssize_t start = positions[handler->start];
+            Py_ssize_t end = positions[handler->end];
+
+            if (end <= start)
+                continue;
+            if (write_exception_varint(&exceptions, start, 128) < 0 ||
+                write_exception_varint(&exceptions, end - start, 0) < 0 ||
+                write_exception_varint(&exceptions, positions[handler->target], 0) < 0 ||
+                write_exception_varint(&exceptions, ((Py_ssize_t)handler->depth << 1) | handler->lasti, 0) < 0) {
+                PyMem_Free(exceptions.data);
+                goto done;
+            }
+        }
+        exception_table = buffer_finish(&exceptions);
+        if (exception_table == NULL || PyDict_SetItemString(kwargs, "co_exceptiontable", exception_table) < 0) {
+            Py_XDECREF(exception_table);
+            goto done;
+        }
+        Py_DECREF(exception_table);
+    }
+#endif
+
+    replace = PyObject_GetAttrString(code->code, "replace");
+    empty = PyTuple_New(0);
+    if (replace == NULL || empty == NULL)
+        goto done;
+    result = PyObject_Call(replace, empty, kwargs);
+
+done:
+    PyMem_Free(positions);
+    PyMem_Free(handlers);
+    PyMem_Free(bytecode.data);
+    Py_XDECREF(code_bytes);
+    Py_XDECREF(line_table);
+    Py_XDECREF(consts);
+    Py_XDECREF(kwargs);
+    Py_XDECREF(replace);
+    Py_XDECREF(empty);
+    return result;
+}
+
+// ----------------------------------------------------------------------------
+// Injection
+
+/* The index of the constant, added if it wasn't already for another hook call. The constants of the code are not
+   shared, since the ones which are no longer used are removed along with the hook calls. */
+static Py_ssize_t
+add_const(Code* code, PyObject* value)
+{
+    Py_ssize_t n = PyList_GET_SIZE(code->consts);
+    Py_ssize_t i;
+
+    for (i = code->n_consts; i < n; i++)
+        if (PyList_GET_ITEM(code->consts, i) == value)
+            return i;
+    if (PyList_Append(code->consts, value) < 0)
+        return -1;
+    return n;
+}
+
+static void
+hook_call(Instr* call, int hook_index, int arg_index, int line)
+{
+    Loc loc = { line, line, -1, -1 };
+    int opcodes[HOOK_SIZE];
+    int opargs[HOOK_SIZE];
+    int i;
+
+#if PY_VERSION_HEX >= 0x030d0000
+    opcodes[0] = OP_LOAD_CONST;
+    opcodes[1] = OP_PUSH_NULL;
+    opcodes[2] = OP_LOAD_CONST;
+    opcodes[3] = OP_CALL;
+    opcodes[4] = OP_POP_TOP;
+#elif PY_VERSION_HEX >= 0x030c0000
+    opcodes[0] = OP_PUSH_NULL;
+    opcodes[1] = OP_LOAD_CONST;
+    opcodes[2] = OP_LOAD_CONST;
+    opcodes[3] = OP_CALL;
+    opcodes[4] = OP_POP_TOP;
+#elif PY_VERSION_HEX >= 0x030b0000
+    opcodes[0] = OP_PUSH_NULL;
+    opcodes[1] = OP_LOAD_CONST;
+    opcodes[2] = OP_LOAD_CONST;
+    opcodes[3] = OP_PRECALL;
+    opcodes[4] = OP_CALL;
+    opcodes[5] = OP_POP_TOP;
+#else
+    opcodes[0] = OP_LOAD_CONST;
+    opcodes[1] = OP_LOAD_CONST;
+    opcodes[2] = OP_CALL;
+    opcodes[3] = OP_POP_TOP;
+#endif
+
+    for (i = 0; i < HOOK_SIZE; i++)
+        opargs[i] = opcodes[i] == OP_CALL || opcodes[i] == OP_PRECALL ? 1 : 0;
+    opargs[HOOK_POS] = hook_index;
+    opargs[ARG_POS] = arg_index;
+
+    for (i = 0; i < HOOK_SIZE; i++) {
+        call[i].opcode = opcodes[i];
+        call[i].oparg = opargs[i];
+        call[i].ext = 0;
+        call[i].caches = op_caches[opcodes[i]];
+        call[i].target = -1;
+        call[i].jump = -1;
+        call[i].loc = loc;
+    }
+}
+
+/* Whether the instruction can have hook calls before it */
+static inline int
+can_inject_before(Instr* instr)
+{
+    /* The loops which are done skip it */
+    return instr->opcode != OP_END_FOR;
+}
+
+typedef struct
+{
+    /* Index of the instruction the call is injected before */
+    Py_ssize_t index;
+    int hook_index;
+    int arg_index;
+    int line;
+} Injection;
+
+/* Inject the hook calls, in the order of the injections on each instruction */
+static PyObject*
+inject(Code* code, Injection* injections, Py_ssize_t n_injections)
+{
+    Instr* instrs = NULL;
+    Py_ssize_t* slots = NULL;
+    Py_ssize_t* firsts = NULL;
+    Injection** sorted = NULL;
+    Py_ssize_t count = 0;
+    PyObject* result = NULL;
+    Py_ssize_t i;
+
+    instrs = PyMem_Malloc(sizeof(Instr) * (code->count + n_injections * HOOK_SIZE + 1));
+    slots = PyMem_Malloc(sizeof(Py_ssize_t) * (code->count + 1));
+    firsts = PyMem_Calloc(code->count + 2, sizeof(Py_ssize_t));
+    sorted = PyMem_Malloc(sizeof(Injection*) * (n_injections + 1));
+    if (instrs == NULL || slots == NULL || firsts == NULL || sorted == NULL) {
+        PyErr_NoMemory();
+        goto done;
+    }
+
+    /* Group the injections by instruction */
+    for (i = 0; i < n_injections; i++)
+        firsts[injections[i].index + 2]++;
+    for (i = 2; i <= code->count + 1; i++)
+        firsts[i] += firsts[i - 1];
+    for (i = 0; i < n_injections; i++)
+        sorted[firsts[injections[i].index + 1]++] = &injections[i];
+
+    for (i = 0; i < code->count; i++) {
+        Py_ssize_t j;
+
+        slots[i] = count;
+        /* The hooks injected last on an instruction are called first */
+        for (j = firsts[i + 1]; j > firsts[i]; j--) {
+            Injection* injection = sorted[j - 1];
+
+            hook_call(&instrs[count], injection->hook_index, injection->arg_index, injection->line);
+            count += HOOK_SIZE;
+        }
+        instrs[count++] = code->instrs[i];
+    }
+    slots[code->count] = count;
+
+    result = code_assemble(code, instrs, count, slots);
+
+done:
+    PyMem_Free(instrs);
+    PyMem_Free(slots);
+    PyMem_Free(firsts);
+    PyMem_Free(sorted);
+    return result;
+}
+
+/* The line of each instruction which starts a line, -1 for the others */
+static int*
+line_starts(Code* code, int all_lines)
+{
+    int* starts = PyMem_Malloc(sizeof(int) * (code->count + 1));
+    int last_line = -1;
+    Py_ssize_t i;
+
+    if (starts == NULL) {
+        PyErr_NoMemory();
+        return NULL;
+    }
+
+    for (i = 0; i < code->count; i++) {
+        Instr* instr = &code->instrs[i];
+        int line = instr->loc.line;
+
+        starts[i] = -1;
+        if (all_lines && line < 0)
+            continue;
+        if (line == last_line)
+            continue;
+        last_line = line;
+
+        if (line < 0 || !can_inject_before(instr))
+            continue;
+        /* The hooks of the lines are not called by their first NOP, nor on their way into the frame */
+        if (all_lines ? instr->opcode == OP_RESUME : instr->opcode == OP_NOP)
+            continue;
+        starts[i] = line;
+    }
+    return starts;
+}
+
+static int
+parse_hook(PyObject* item, PyObject** hook, int* line, PyObject** arg)
+{
+    if (!PyTuple_Check(item) || PyTuple_GET_SIZE(item) != 3) {
+        PyErr_SetString(PyExc_TypeError, "hooks must be tuples of a hook, a line and an argument");
+        return -1;
+    }
+    *hook = PyTuple_GET_ITEM(item, 0);
+    *arg = PyTuple_GET_ITEM(item, 2);
+    *line = (int)PyLong_AsLong(PyTuple_GET_ITEM(item, 1));
+    return *line == -1 && PyErr_Occurred() ? -1 : 0;
+}
+
+static PyObject*
+inject_hooks(PyObject* Py_UNUSED(module), PyObject* args)
+{
+    PyObject* code_object;
+    PyObject* hooks;
+    PyObject* seq = NULL;
+    PyObject* failed = NULL;
+    PyObject* new_code = NULL;
+    PyObject* result = NULL;
+    Injection* injections = NULL;
+    Py_ssize_t n_injections = 0;
+    Py_ssize_t capacity = 0;
+    int* starts = NULL;
+    Code code;
+    Py_ssize_t h;
+    Py_ssize_t i;
+
+    if (!PyArg_ParseTuple(args, "OO:inject_hooks", &code_object, &hooks))
+        return NULL;
+    if (code_decode(&code, code_object) < 0)
+        return NULL;
+
+    seq = PySequence_Fast(hooks, "hooks must be a sequence");
+    failed = PyList_New(0);
+    if (seq == NULL || failed == NULL)
+        goto done;
+    starts = line_starts(&code, 0);
+    if (starts == NULL)
+        goto done;
+
+    for (h = 0; h < PySequence_Fast_GET_SIZE(seq); h++) {
+        PyObject* item = PySequence_Fast_GET_ITEM(seq, h);
+        PyObject* hook;
+        PyObject* arg;
+        Py_ssize_t hook_index = -1;
+        Py_ssize_t arg_index = -1;
+        int line;
+        int found = 0;
+
+        if (parse_hook(item, &hook, &line, &arg) < 0)
+            goto done;
+
+        for (i = 0; i < code.count; i++) {
+            if (starts[i] != line)
+                continue;
+            if (!found) {
+                if ((hook_index = add_const(&code, hook)) < 0 || (arg_index = add_const(&code, arg)) < 0)
+                    goto done;
+                found = 1;
+            }
+            if (!GROW(injections, n_injections, capacity, Injection))
+                goto done;
+            injections[n_injections].index = i;
+            injections[n_injections].hook_index = (int)hook_index;
+            injections[n_injections].arg_index = (int)arg_index;
+            injections[n_injections].line = line;
+            n_injections++;
+        }
+
+        if (!found && PyList_Append(failed, item) < 0)
+            goto done;
+    }
+
+    if (n_injections) {
+        new_code = inject(&code, injections, n_injections);
+        if (new_code == NULL)
+            goto done;
+    } else {
+        Py_INCREF(code_object);
+        new_code = code_object;
+    }
+
+    result = PyTuple_Pack(2, new_code, failed);
+
+done:
+    Py_XDECREF(seq);
+    Py_XDECREF(failed);
+    Py_XDECREF(new_code);
+    PyMem_Free(injections);
+    PyMem_Free(starts);
+    code_clear(&code);
+    return result;
+}
+
+static PyObject*
+instrument_all_lines(PyObject* Py_UNUSED(module), PyObject* args)
+{
+    PyObject* code_object;
+    PyObject* hook;
+    PyObject* key;
+    PyObject* lines = NULL;
+    PyObject* new_code = NULL;
+    PyObject* result = NULL;
+    Injection* injections = NULL;
+    Py_ssize_t n_injections = 0;
+    int* starts = NULL;
+    Code code;
+    Py_ssize_t hook_index;
+    Py_ssize_t i;
+
+    if (!PyArg_ParseTuple(args, "OOO:instrument_all_lines", &code_object, &hook, &key))
+        return NULL;
+    if (code_decode(&code, code_object) < 0)
+        return NULL;
+
+    lines = PySet_New(NULL);
+    starts = line_starts(&code, 1);
+    injections = PyMem_Malloc(sizeof(Injection) * (code.count + 1));
+    if (lines == NULL || starts == NULL || injections == NULL) {
+        if (injections == NULL)
+            PyErr_NoMemory();
+        goto done;
+    }
+    if ((hook_index = add_const(&code, hook)) < 0)
+        goto done;
+
+    for (i = 0; i < code.count; i++) {
+        PyObject* line;
+        PyObject* arg;
+        Py_ssize_t arg_index;
+
+        if (starts[i] < 0)
+            continue;
+
+        line = PyLong_FromLong(starts[i]);
+        if (line == NULL)
+            goto done;
+        arg = PyNumber_Or(key, line);
+        if (arg == NULL || PySet_Add(lines, line) < 0) {
+            Py_DECREF(line);
+            Py_XDECREF(arg);
+            goto done;
+        }
+        Py_DECREF(line);
+        arg_index = add_const(&code, arg);
+        Py_DECREF(arg);
+        if (arg_index < 0)
+            goto done;
+
+        injections[n_injections].index = i;
+        injections[n_injections].hook_index = (int)hook_index;
+        injections[n_injections].arg_index = (int)arg_index;
+        injections[n_injections].line = starts[i];
+        n_injections++;
+    }
+
+    new_code = inject(&code, injections, n_injections);
+    if (new_code == NULL)
+        goto done;
+    result = PyTuple_Pack(2, new_code, lines);
+
+done:
+    Py_XDECREF(lines);
+    Py_XDECREF(new_code);
+    PyMem_Free(injections);
+    PyMem_Free(starts);
+    code_clear(&code);
+    return result;
+}
+
+static PyObject*
+instrumentable_lines(PyObject* Py_UNUSED(module), PyObject* code_object)
+{
+    PyObject* lines = NULL;
+    int* starts = NULL;
+    Code code;
+    Py_ssize_t i;
+
+    if (code_decode(&code, code_object) < 0)
+        return NULL;
+
+    lines = PySet_New(NULL);
+    starts = line_starts(&code, 1);
+    if (lines == NULL || starts == NULL)
+        goto error;
+    for (i = 0; i < code.count; i++) {
+        PyObject* line;
+
+        if (starts[i] < 0)
+            continue;
+        line = PyLong_FromLong(starts[i]);
+        if (line == NULL || PySet_Add(lines, line) < 0) {
+            Py_XDECREF(line);
+            goto error;
+        }
+        Py_DECREF(line);
+    }
+
+    PyMem_Free(starts);
+    code_clear(&code);
+    return lines;
+
+error:
+    Py_XDECREF(lines);
+    PyMem_Free(starts);
+    code_clear(&code);
+    return NULL;
+}
+
+// ----------------------------------------------------------------------------
+// Ejection
+
+static int
+is_hook_call(Code* code, char* removed, Py_ssize_t index, PyObject* hook, PyObject* arg)
+{
+    Instr call[HOOK_SIZE];
+    Py_ssize_t n_consts = PyList_GET_SIZE(code->consts);
+    int hook_index = code->instrs[index + HOOK_POS].oparg;
+    int arg_index = code->instrs[index + ARG_POS].oparg;
+    int i;
+
+    if (index + HOOK_SIZE > code->count)
+        return 0;
+
+    hook_call(call, hook_index, arg_index, 0);
+    for (i = 0; i < HOOK_SIZE; i++)
+        if (removed[index + i] || code->instrs[index + i].opcode != call[i].opcode ||
+            code->instrs[index + i].oparg != call[i].oparg)
+            return 0;
+
+    if (hook_index >= n_consts || arg_index >= n_consts || PyList_GET_ITEM(code->consts, arg_index) != arg)
+        return 0;
+    /* Bound methods are equal without being the same */
+    return PyObject_RichCompareBool(PyList_GET_ITEM(code->consts, hook_index), hook, Py_EQ);
+}
+
+static PyObject*
+eject_hooks(PyObject* Py_UNUSED(module), PyObject* args)
+{
+    PyObject* code_object;
+    PyObject* hooks;
+    PyObject* seq = NULL;
+    PyObject* failed = NULL;
+    PyObject* new_code = NULL;
+    PyObject* result = NULL;
+    Instr* instrs = NULL;
+    Py_ssize_t* slots = NULL;
+    Py_ssize_t* const_map = NULL;
+    char* removed = NULL;
+    char* used = NULL;
+    Py_ssize_t count;
+    Code code;
+    Py_ssize_t h;
+    Py_ssize_t i;
+    int any = 0;
+
+    if (!PyArg_ParseTuple(args, "OO:eject_hooks", &code_object, &hooks))
+        return NULL;
+    if (code_decode(&code, code_object) < 0)
+        return NULL;
+
+    seq = PySequence_Fast(hooks, "hooks must be a sequence");
+    failed = PyList_New(0);
+    removed = PyMem_Calloc(code.count + 1, 1);
+    if (seq == NULL || failed == NULL || removed == NULL) {
+        if (removed == NULL)
+            PyErr_NoMemory();
+        goto done;
+    }
+
+    for (h = 0; h < PySequence_Fast_GET_SIZE(seq); h++) {
+        PyObject* item = PySequence_Fast_GET_ITEM(seq, h);
+        PyObject* hook;
+        PyObject* arg;
+        int line;
+        int found = 0;
+
+        if (parse_hook(item, &hook, &line, &arg) < 0)
+            goto done;
+
+        for (i = 0; i + HOOK_SIZE <= code.count; i++) {
+            int match;
+
+            if (code.instrs[i].loc.line != line)
+                continue;
+            match = is_hook_call(&code, removed, i, hook, arg);
+            if (match < 0)
+                goto done;
+            if (match) {
+                memset(removed + i, 1, HOOK_SIZE);
+                found = any = 1;
+            }
+        }
+
+        if (!found && PyList_Append(failed, item) < 0)
+            goto done;
+    }
+
+    if (!any) {
+        Py_INCREF(code_object);
+        new_code = code_object;
+        result = PyTuple_Pack(2, new_code, failed);
+        goto done;
+    }
+
+    /* The constants of the hooks which are no longer used are removed */
+    used = PyMem_Calloc(PyList_GET_SIZE(code.consts) + 1, 1);
+    const_map = PyMem_Malloc(sizeof(Py_ssize_t) * (PyList_GET_SIZE(code.consts) + 1));
+    instrs = PyMem_Malloc(sizeof(Instr) * (code.count + 1));
+    slots = PyMem_Malloc(sizeof(Py_ssize_t) * (code.count + 1));
+    if (used == NULL || const_map == NULL || instrs == NULL || slots == NULL) {
+        PyErr_NoMemory();
+        goto done;
+    }
+    for (i = 0; i < code.count; i++)
+        if (op_flags[code.instrs[i].opcode] & F_CONST && code.instrs[i].oparg < PyList_GET_SIZE(code.consts))
+            used[code.instrs[i].oparg] |= removed[i] ? 2 : 1;
+    {
+        Py_ssize_t n_consts = PyList_GET_SIZE(code.consts);
+        Py_ssize_t kept = 0;
+        PyObject* consts = PyList_New(0);
+
+        if (consts == NULL)
+            goto done;
+        for (i = 0; i < n_consts; i++) {
+            const_map[i] = kept;
+            if (used[i] == 2)
+                continue;
+            if (PyList_Append(consts, PyList_GET_ITEM(code.consts, i)) < 0) {
+                Py_DECREF(consts);
+                goto done;
+            }
+            kept++;
+        }
+        Py_SETREF(code.consts, consts);
+    }
+
+    count = 0;
+    for (i = 0; i < code.count; i++) {
+        slots[i] = count;
+        if (removed[i])
+            continue;
+        instrs[count] = code.instrs[i];
+        if (op_flags[instrs[count].opcode] & F_CONST)
+            instrs[count].oparg = (int)const_map[instrs[count].oparg];
+        count++;
+    }
+    slots[code.count] = count;
+
+    new_code = code_assemble(&code, instrs, count, slots);
+    if (new_code == NULL)
+        goto done;
+    result = PyTuple_Pack(2, new_code, failed);
+
+done:
+    Py_XDECREF(seq);
+    Py_XDECREF(failed);
+    Py_XDECREF(new_code);
+    PyMem_Free(instrs);
+    PyMem_Free(slots);
+    PyMem_Free(const_map);
+    PyMem_Free(removed);
+    PyMem_Free(used);
+    code_clear(&code);
+    return result;
+}
+
+// ----------------------------------------------------------------------------
+// Opcodes
+
+static int
+opcode_number(PyObject* opmap, const char* name)
+{
+    PyObject* value = PyDict_GetItemString(opmap, name);
+
+    return value == NULL ? -1 : (int)PyLong_AsLong(value);
+}
+
+static int
+set_flags(PyObject* opcode, const char* name, uint8_t flag)
+{
+    PyObject* opcodes = PyObject_GetAttrString(opcode, name);
+    PyObject* seq;
+    Py_ssize_t i;
+
+    if (opcodes == NULL)
+        return -1;
+    seq = PySequence_Fast(opcodes, "expected a sequence of opcodes");
+    Py_DECREF(opcodes);
+    if (seq == NULL)
+        return -1;
+    for (i = 0; i < PySequence_Fast_GET_SIZE(seq); i++) {
+        long op = PyLong_AsLong(PySequence_Fast_GET_ITEM(seq, i));
+
+        if (op == -1 && PyErr_Occurred()) {
+            Py_DECREF(seq);
+            return -1;
+        }
+        /* The pseudo instructions never show up in code objects */
+        if (op >= 0 && op < 256)
+            op_flags[op] |= flag;
+    }
+    Py_DECREF(seq);
+    return 0;
+}
+
+static int
+load_opcodes(void)
+{
+    static const char* no_fallthrough[] = {
+        "RETURN_VALUE", "RETURN_CONST",  "RAISE_VARARGS", "RERAISE", "JUMP_ABSOLUTE",
+        "JUMP_FORWARD", "JUMP_BACKWARD", "JUMP_BACKWARD_NO_INTERRUPT", NULL,
+    };
+    PyObject* opcode = PyImport_ImportModule("opcode");
+    PyObject* opmap = NULL;
+    PyObject* opname = NULL;
+    PyObject* caches = NULL;
+    int result = -1;
+    Py_ssize_t i;
+
+    if (opcode == NULL)
+        return -1;
+    opmap = PyObject_GetAttrString(opcode, "opmap");
+    opname = PyObject_GetAttrString(opcode, "opname");
+    if (opmap == NULL || opname == NULL || !PyDict_Check(opmap) || !PyList_Check(opname))
+        goto done;
+
+    OP_EXTENDED_ARG = opcode_number(opmap, "EXTENDED_ARG");
+    OP_LOAD_CONST = opcode_number(opmap, "LOAD_CONST");
+    OP_POP_TOP = opcode_number(opmap, "POP_TOP");
+    OP_NOP = opcode_number(opmap, "NOP");
+    OP_PUSH_NULL = opcode_number(opmap, "PUSH_NULL");
+    OP_PRECALL = opcode_number(opmap, "PRECALL");
+    OP_RESUME = opcode_number(opmap, "RESUME");
+    OP_END_FOR = opcode_number(opmap, "END_FOR");
+#if PY_VERSION_HEX >= 0x030b0000
+    OP_CALL = opcode_number(opmap, "CALL");
+#else
+    OP_CALL = opcode_number(opmap, "CALL_FUNCTION");
+#endif
+    if (PyErr_Occurred())
+        goto done;
+
+    if (set_flags(opcode, "hasjrel", F_JREL) < 0 || set_flags(opcode, "hasjabs", F_JABS) < 0 ||
+        set_flags(opcode, "hasconst", F_CONST) < 0)
+        goto done;
+
+    for (i = 0; i < PyList_GET_SIZE(opname) && i < 256; i++) {
+        const char* name = PyUnicode_AsUTF8(PyList_GET_ITEM(opname, i));
+        int n;
+
+        if (name == NULL)
+            goto done;
+        if (strstr(name, "JUMP_BACKWARD") != NULL)
+            op_flags[i] |= F_BACKWARD;
+        for (n = 0; no_fallthrough[n] != NULL; n++)
+            if (strcmp(name, no_fallthrough[n]) == 0)
+                op_flags[i] |= F_NO_FALLTHROUGH;
+    }
+
+#if PY_VERSION_HEX >= 0x030b0000
+    caches = PyObject_GetAttrString(opcode, "_inline_cache_entries");
+    if (caches == NULL)
+        goto done;
+    if (PyDict_Check(caches)) {
+        PyObject* name;
+        PyObject* value;
+        Py_ssize_t pos = 0;
+
+        while (PyDict_Next(caches, &pos, &name, &value)) {
+            PyObject* op = PyDict_GetItem(opmap, name);
+            long n = PyLong_AsLong(value);
+            long number = op == NULL ? -1 : PyLong_AsLong(op);
+
+            if (PyErr_Occurred())
+                goto done;
+            if (number >= 0 && number < 256)
+                op_caches[number] = (uint8_t)n;
+        }
+    } else {
+        PyObject* seq = PySequence_Fast(caches, "expected a sequence of cache sizes");
+
+        if (seq == NULL)
+            goto done;
+        for (i = 0; i < PySequence_Fast_GET_SIZE(seq) && i < 256; i++) {
+            long n = PyLong_AsLong(PySequence_Fast_GET_ITEM(seq, i));
+
+            if (n == -1 && PyErr_Occurred()) {
+                Py_DECREF(seq);
+                goto done;
+            }
+            op_caches[i] = (uint8_t)n;
+        }
+        Py_DECREF(seq);
+    }
+#endif
+
+    if (OP_EXTENDED_ARG < 0 || OP_LOAD_CONST < 0 || OP_POP_TOP < 0 || OP_CALL < 0)
+        goto unexpected;
+#if PY_VERSION_HEX >= 0x030b0000
+    if (OP_PUSH_NULL < 0)
+        goto unexpected;
+#endif
+#if PY_VERSION_HEX >= 0x030b0000 && PY_VERSION_HEX < 0x030c0000
+    if (OP_PRECALL < 0)
+        goto unexpected;
+#endif
+    result = 0;
+    goto done;
+
+unexpected:
+    PyErr_SetString(PyExc_ImportError, "unexpected opcodes");
+
+done:
+    Py_DECREF(opcode);
+    Py_XDECREF(opmap);
+    Py_XDECREF(opname);
+    Py_XDECREF(caches);
+    return result;
+}
+
+static PyMethodDef InjectionMethods[] = {
+    { "inject_hooks",
+      (PyCFunction)inject_hooks,
+      METH_VARARGS,
+      "Inject the (hook, line, arg) calls into the code, return the new code and the hooks whose lines it lacks" },
+    { "eject_hooks",
+      (PyCFunction)eject_hooks,
+      METH_VARARGS,
+      "Eject the (hook, line, arg) calls from the code, return the new code and the hooks it doesn't call" },
+    { "instrument_all_lines",
+      (PyCFunction)instrument_all_lines,
+      METH_VARARGS,
+      "Call the hook with the key ORed with the line at the start of every line, return the new code and the lines" },
+    { "instrumentable_lines",
+      (PyCFunction)instrumentable_lines,
+      METH_O,
+      "Return the lines that instrument_all_lines instruments" },
+    { NULL, NULL, 0, NULL }
+};
+
+static struct PyModuleDef injection_module = {
+    PyModuleDef_HEAD_INIT, "ddtrace.internal._injection", "native injection of hook calls into bytecode", -1,
+    InjectionMethods
+};
+#endif
+
+PyMODINIT_FUNC
+PyInit__injection(void)
+{
+#if SUPPORTED_VERSION
+    if (load_opcodes() < 0)
+        return NULL;
+    return PyModule_Create(&injection_module);
+#else
+    PyErr_SetString(PyExc_ImportError, "the native injection does not support this version of Python");
+    return NULL;
+#endif
+}
@@ -0,0 +1,14 @@
+from types import CodeType
+from typing import Any
+from typing import Callable
+from typing import List
+from typing import Sequence
+from typing import Set
+from typing import Tuple
+
+_HookInfo = Tuple[Callable[[Any], Any], int, Any]
+
+def inject_hooks(code: CodeType, hooks: Sequence[_HookInfo]) -> Tuple[CodeType, List[_HookInfo]]: ...
+def eject_hooks(code: CodeType, hooks: Sequence[_HookInfo]) -> Tuple[CodeType, List[_HookInfo]]: ...
+def instrument_all_lines(code: CodeType, hook: Callable[[Any], Any], key: int) -> Tuple[CodeType, Set[int]]: ...
+def instrumentable_lines(code: CodeType) -> Set[int]: ...
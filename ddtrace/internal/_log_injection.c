@@ -0,0 +1,216 @@
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+/* Injection of the trace correlation attributes into the records of the logging module.
+
+   The attributes are set straight into the dictionary of the record when it uses the generic attribute setter, as
+   LogRecord does. The ids of a span are formatted once: each thread keeps the strings of the ids it formatted last,
+   along with the ids, which are compared by identity. The cache holds references to the ids, so that they can't be
+   freed and another integer allocated at the same address, and a thread which stops logging keeps them until it
+   logs again or exits. */
+
+#ifdef _MSC_VER
+#define LOG_INJECTION_THREAD_LOCAL __declspec(thread)
+#else
+#define LOG_INJECTION_THREAD_LOCAL __thread
+#endif
+
+typedef struct
+{
+    PyObject* trace_id;
+    PyObject* span_id;
+    int trace_id_64bits;
+    PyObject* trace_id_str;
+    PyObject* span_id_str;
+} ids_cache_t;
+
+static LOG_INJECTION_THREAD_LOCAL ids_cache_t ids_cache = { NULL, NULL, 0, NULL, NULL };
+
+static PyObject* str_trace_id = NULL;
+static PyObject* str_span_id = NULL;
+static PyObject* attr_trace_id = NULL;
+static PyObject* attr_span_id = NULL;
+static PyObject* attr_service = NULL;
+static PyObject* attr_version = NULL;
+static PyObject* attr_env = NULL;
+static PyObject* value_zero = NULL;
+static PyObject* value_empty = NULL;
+
+static PyObject*
+format_trace_id(PyObject* trace_id, int trace_id_64bits)
+{
+    unsigned long long lower;
+
+    if (!trace_id_64bits || !PyLong_Check(trace_id))
+        return PyObject_Str(trace_id);
+
+    /* The 64 lowest order bits, as Span._trace_id_64bits */
+    lower = PyLong_AsUnsignedLongLongMask(trace_id);
+    if (lower == (unsigned long long)-1 && PyErr_Occurred())
+        return NULL;
+    return PyUnicode_FromFormat("%llu", lower);
+}
+
+/* Update the cache of the thread with the ids of the span, which return new references */
+static int
+span_ids_strings(PyObject* span, int trace_id_64bits, PyObject** trace_id_str, PyObject** span_id_str)
+{
+    PyObject* trace_id;
+    PyObject* span_id;
+    PyObject* new_trace_id_str;
+    PyObject* new_span_id_str;
+
+    trace_id = PyObject_GetAttr(span, str_trace_id);
+    if (trace_id == NULL)
+        return -1;
+    span_id = PyObject_GetAttr(span, str_span_id);
+    if (span_id == NULL) {
+        Py_DECREF(trace_id);
+        return -1;
+    }
+
+    if (trace_id == ids_cache.trace_id && span_id == ids_cache.span_id &&
+        trace_id_64bits == ids_cache.trace_id_64bits) {
+        Py_DECREF(trace_id);
+        Py_DECREF(span_id);
+        Py_INCREF(ids_cache.trace_id_str);
+        Py_INCREF(ids_cache.span_id_str);
+        *trace_id_str = ids_cache.trace_id_str;
+        *span_id_str = ids_cache.span_id_str;
+        return 0;
+    }
+
+    new_trace_id_str = format_trace_id(trace_id, trace_id_64bits);
+    new_span_id_str = new_trace_id_str == NULL ? NULL : PyObject_Str(span_id);
+    if (new_span_id_str == NULL) {
+        Py_XDECREF(new_trace_id_str);
+        Py_DECREF(trace_id);
+        Py_DECREF(span_id);
+        return -1;
+    }
+
+    /* The cache takes the references to the ids */
+    Py_XSETREF(ids_cache.trace_id, trace_id);
+    Py_XSETREF(ids_cache.span_id, span_id);
+    ids_cache.trace_id_64bits = trace_id_64bits;
+    Py_INCREF(new_trace_id_str);
+    Py_XSETREF(ids_cache.trace_id_str, new_trace_id_str);
+    Py_INCREF(new_span_id_str);
+    Py_XSETREF(ids_cache.span_id_str, new_span_id_str);
+
+    *trace_id_str = new_trace_id_str;
+    *span_id_str = new_span_id_str;
+    return 0;
+}
+
+static int
+set_attributes(PyObject* record, PyObject* const* names, PyObject* const* values, Py_ssize_t count)
+{
+    if (Py_TYPE(record)->tp_setattro == PyObject_GenericSetAttr) {
+        PyObject* dict = PyObject_GenericGetDict(record, NULL);
+
+        if (dict != NULL) {
+            for (Py_ssize_t i = 0; i < count; i++) {
+                if (PyDict_SetItem(dict, names[i], values[i]) < 0) {
+                    Py_DECREF(dict);
+                    return -1;
+                }
+            }
+            Py_DECREF(dict);
+            return 0;
+        }
+        /* Without a dictionary, the attributes are set through the type of the record */
+        if (!PyErr_ExceptionMatches(PyExc_AttributeError))
+            return -1;
+        PyErr_Clear();
+    }
+
+    for (Py_ssize_t i = 0; i < count; i++) {
+        if (PyObject_SetAttr(record, names[i], values[i]) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+static PyObject*
+log_injection_inject(PyObject* Py_UNUSED(module), PyObject* const* args, Py_ssize_t nargs)
+{
+    PyObject *record, *span, *service, *version, *env;
+    PyObject* trace_id_str;
+    PyObject* span_id_str;
+    int trace_id_64bits;
+    int result;
+
+    if (nargs != 6) {
+        PyErr_Format(PyExc_TypeError, "inject expected 6 arguments, got %zd", nargs);
+        return NULL;
+    }
+    record = args[0];
+    span = args[1];
+    service = args[2];
+    version = args[3];
+    env = args[4];
+    trace_id_64bits = PyObject_IsTrue(args[5]);
+    if (trace_id_64bits < 0)
+        return NULL;
+
+    if (span == Py_None) {
+        Py_INCREF(value_zero);
+        Py_INCREF(value_zero);
+        trace_id_str = span_id_str = value_zero;
+    } else if (span_ids_strings(span, trace_id_64bits, &trace_id_str, &span_id_str) < 0) {
+        return NULL;
+    }
+
+    {
+        PyObject* const names[] = { attr_version, attr_env, attr_service, attr_trace_id, attr_span_id };
+        PyObject* const values[] = { version == Py_None ? value_empty : version,
+                                     env == Py_None ? value_empty : env,
+                                     service == Py_None ? value_empty : service,
+                                     trace_id_str,
+                                     span_id_str };
+
+        result = set_attributes(record, names, values, 5);
+    }
+
+    Py_DECREF(trace_id_str);
+    Py_DECREF(span_id_str);
+    if (result < 0)
+        return NULL;
+
+    Py_RETURN_NONE;
+}
+
+static PyMethodDef log_injection_methods[] = {
+    { "inject",
+      (PyCFunction)(void (*)(void))log_injection_inject,
+      METH_FASTCALL,
+      "Set the trace correlation attributes of a log record, from the given span, or None, and the service, version "
+      "and environment, with 64-bit trace ids if trace_id_64bits is true" },
+    { NULL, NULL, 0, NULL }
+};
+
+static struct PyModuleDef log_injection_module = {
+    PyModuleDef_HEAD_INIT, "ddtrace.internal._log_injection", "native log correlation", -1, log_injection_methods
+};
+
+PyMODINIT_FUNC
+PyInit__log_injection(void)
+{
+#define INTERN(name, value)                                                                                            \
+    if (name == NULL && (name = PyUnicode_InternFromString(value)) == NULL)                                            \
+        return NULL;
+    INTERN(str_trace_id, "trace_id");
+    INTERN(str_span_id, "span_id");
+    /* The same as in ddtrace.contrib.logging.constants */
+    INTERN(attr_trace_id, "dd.trace_id");
+    INTERN(attr_span_id, "dd.span_id");
+    INTERN(attr_service, "dd.service");
+    INTERN(attr_version, "dd.version");
+    INTERN(attr_env, "dd.env");
+    INTERN(value_zero, "0");
+    INTERN(value_empty, "");
+#undef INTERN
+
+    return PyModule_Create(&log_injection_module);
+}
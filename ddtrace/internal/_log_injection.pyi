@@ -0,0 +1,10 @@
+import typing as t
+
+def inject(
+    record: t.Any,
+    span: t.Any,
+    service: t.Optional[str],
+    version: t.Optional[str],
+    env: t.Optional[str],
+    trace_id_64bits: bool,
+) -> None: ...
@@ -0,0 +1,12 @@
+from typing import Any
+from typing import Dict
+from typing import Mapping
+from typing import Optional
+from typing import Tuple
+
+def collect_headers(headers: Mapping[str, Any], names: Dict[str, str], baggage_prefix: str) -> Dict[str, Any]: ...
+def parse_traceparent(traceparent: str) -> Optional[Tuple[str, int, int, int, bool]]: ...
+def is_valid_tracestate(tracestate: str) -> bool: ...
+def format_hex_id(dd_id: int) -> str: ...
+def format_b3_single(trace_id: int, span_id: int, sampling_priority: Optional[int]) -> str: ...
+def format_traceparent(trace_id_hex: Optional[str], trace_id: int, span_id: int, sampled: bool) -> str: ...
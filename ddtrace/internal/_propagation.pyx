@@ -0,0 +1,256 @@
+"""
+Parsing and formatting of the distributed tracing headers.
+
+Extracting a context used to lowercase every header of a request into a new
+dict, which each configured propagation style then searched for its own
+headers, and the ``traceparent`` header was validated with a regular
+expression. Instead, the trace headers are collected from the mapping in a
+single pass, under their canonical name, and the fixed-length formats are
+parsed and formatted here, reading and writing the digits directly.
+"""
+from libc.stdint cimport uint64_t
+
+from ddtrace.internal.compat import ensure_text
+
+
+cdef extern from "Python.h":
+    bint PyUnicode_IS_ASCII(object o)
+    const char* PyUnicode_AsUTF8AndSize(object o, Py_ssize_t* size) except NULL
+    str PyUnicode_FromStringAndSize(const char* u, Py_ssize_t size)
+
+
+# Length of a version 00 traceparent, e.g. 00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01
+DEF _TRACEPARENT_SIZE = 55
+# Large enough for a traceparent, and for a b3 header with 128-bit span ids
+DEF _HEADER_BUFFER_SIZE = 96
+
+cdef const char* _HEX_DIGITS = b"0123456789abcdef"
+
+cdef object _MAX_UINT_64BITS = (1 << 64) - 1
+cdef object _MAX_UINT_128BITS = (1 << 128) - 1
+
+
+cpdef dict collect_headers(object headers, dict names, str baggage_prefix):
+    # type: (Mapping[str, Any], Dict[str, str], str) -> Dict[str, Any]
+    """Collect the trace and baggage headers of ``headers`` in a single pass over it
+
+    ``names`` maps the lowercased names of the trace headers, including their WSGI
+    variants, to their canonical name, under which their value is collected as text.
+    When a request has both variants of a header, the canonical one is used. Header
+    names are matched case-insensitively, and the baggage headers are collected
+    under their lowercased name, with their value as is.
+
+    Example::
+
+        >>> collect_headers({"X-Datadog-Trace-Id": "1", "Accept": "*/*"}, names, "ot-baggage-")
+        {"x-datadog-trace-id": "1"}
+    """
+    cdef dict collected = {}
+    cdef dict wsgi = None
+    cdef str lname
+    cdef object canonical
+
+    for name, value in headers.items():
+        if not isinstance(name, str):
+            continue
+        lname = name.lower()
+        canonical = names.get(lname)
+        if canonical is not None:
+            if type(value) is not str:
+                value = ensure_text(value, errors="backslashreplace")
+            if lname == canonical:
+                collected[canonical] = value
+            else:
+                if wsgi is None:
+                    wsgi = {}
+                wsgi[canonical] = value
+        elif lname.startswith(baggage_prefix):
+            collected[lname] = value
+
+    if wsgi is not None:
+        for canonical, value in wsgi.items():
+            if canonical not in collected:
+                collected[canonical] = value
+    return collected
+
+
+cdef inline int _lower_hex_value(Py_UCS4 c):
+    """Value of the lowercase hex digit ``c``, or -1 if it is not one"""
+    # "0" to "9", then "a" to "f"
+    if 48 <= c <= 57:
+        return c - 48
+    if 97 <= c <= 102:
+        return c - 87
+    return -1
+
+
+cdef inline bint _parse_lower_hex(str s, Py_ssize_t start, Py_ssize_t digits, uint64_t* value):
+    cdef Py_ssize_t i
+    cdef int digit
+
+    value[0] = 0
+    for i in range(start, start + digits):
+        digit = _lower_hex_value(s[i])
+        if digit < 0:
+            return False
+        value[0] = (value[0] << 4) | <uint64_t>digit
+    return True
+
+
+cpdef object parse_traceparent(str traceparent):
+    # type: (str) -> Optional[Tuple[str, int, int, int, bool]]
+    """Parse the version, trace id, span id and trace flags of a traceparent header
+
+    Surrounding whitespace is ignored, and the header may have more values than
+    these four, which is flagged by the last item of the result. ``None`` is returned
+    when the header does not have the format of a traceparent.
+
+    Example::
+
+        >>> parse_traceparent("00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01")
+        ("00", 0x4bf92f3577b34da6a3ce929d0e0e4736, 0xf067aa0ba902b7, 1, False)
+    """
+    cdef str tp = traceparent.strip()
+    cdef Py_ssize_t size = len(tp)
+    cdef uint64_t version
+    cdef uint64_t trace_id_high
+    cdef uint64_t trace_id_low
+    cdef uint64_t span_id
+    cdef uint64_t trace_flags
+
+    if size < _TRACEPARENT_SIZE or tp[2] != u"-" or tp[35] != u"-" or tp[52] != u"-":
+        return None
+    if not (
+        _parse_lower_hex(tp, 0, 2, &version)
+        and _parse_lower_hex(tp, 3, 16, &trace_id_high)
+        and _parse_lower_hex(tp, 19, 16, &trace_id_low)
+        and _parse_lower_hex(tp, 36, 16, &span_id)
+        and _parse_lower_hex(tp, 53, 2, &trace_flags)
+    ):
+        return None
+
+    # Any additional values are a dash followed by at least one character which is not a line break
+    if size > _TRACEPARENT_SIZE and (
+        tp[_TRACEPARENT_SIZE] != u"-" or size == _TRACEPARENT_SIZE + 1 or u"\n" in tp[_TRACEPARENT_SIZE + 1 :]
+    ):
+        return None
+
+    return (
+        tp[:2],
+        (<object>trace_id_high << 64) | <object>trace_id_low,
+        <object>span_id,
+        <int>trace_flags,
+        size > _TRACEPARENT_SIZE,
+    )
+
+
+cpdef bint is_valid_tracestate(str tracestate):
+    # type: (str) -> bool
+    """Whether the tracestate header only has ASCII characters in the range 0x20 to 0x7E"""
+    cdef Py_ssize_t size
+    cdef const char* buf
+    cdef Py_ssize_t i
+
+    if not PyUnicode_IS_ASCII(tracestate):
+        return False
+    buf = PyUnicode_AsUTF8AndSize(tracestate, &size)
+    for i in range(size):
+        if not (0x20 <= buf[i] <= 0x7E):
+            return False
+    return True
+
+
+cdef inline char* _write_hex(char* buf, uint64_t value, int digits):
+    """Write the ``digits`` lowest digits of ``value`` at ``buf``, return the end of the written digits"""
+    cdef int i
+
+    for i in range(digits - 1, -1, -1):
+        buf[i] = _HEX_DIGITS[value & 0xF]
+        value >>= 4
+    return buf + digits
+
+
+cdef inline char* _write_id(char* buf, object dd_id):
+    """Write a 64-bit id as 16 hex digits and a 128-bit one as 32, which must be in range"""
+    if dd_id > _MAX_UINT_64BITS:
+        buf = _write_hex(buf, <uint64_t>(dd_id >> 64), 16)
+        return _write_hex(buf, <uint64_t>(dd_id & _MAX_UINT_64BITS), 16)
+    return _write_hex(buf, <uint64_t>dd_id, 16)
+
+
+cdef inline bint _fits_id(object dd_id):
+    return 0 <= dd_id <= _MAX_UINT_128BITS
+
+
+cpdef str format_hex_id(object dd_id):
+    # type: (int) -> str
+    """Format a trace or span id as 16 lowercase hex digits, or 32 above 64 bits"""
+    cdef char buf[32]
+
+    if not _fits_id(dd_id):
+        return "{:032x}".format(dd_id) if dd_id > _MAX_UINT_64BITS else "{:016x}".format(dd_id)
+    return PyUnicode_FromStringAndSize(buf, _write_id(buf, dd_id) - buf)
+
+
+cpdef str format_b3_single(object trace_id, object span_id, object sampling_priority):
+    # type: (int, int, Optional[int]) -> str
+    """Format the value of a b3 single header, with the sampling state when there is a sampling priority"""
+    cdef char buf[_HEADER_BUFFER_SIZE]
+    cdef char* end
+
+    if not (_fits_id(trace_id) and _fits_id(span_id)):
+        value = "{}-{}".format(format_hex_id(trace_id), format_hex_id(span_id))
+        if sampling_priority is not None:
+            value += "-0" if sampling_priority <= 0 else "-1" if sampling_priority == 1 else "-d"
+        return value
+
+    end = _write_id(buf, trace_id)
+    end[0] = c'-'
+    end = _write_id(end + 1, span_id)
+    if sampling_priority is not None:
+        end[0] = c'-'
+        end[1] = c'0' if sampling_priority <= 0 else c'1' if sampling_priority == 1 else c'd'
+        end += 2
+    return PyUnicode_FromStringAndSize(buf, end - buf)
+
+
+cpdef str format_traceparent(str trace_id_hex, object trace_id, object span_id, bint sampled):
+    # type: (Optional[str], int, int, bool) -> str
+    """Format a version 00 traceparent header
+
+    The trace id is given by ``trace_id_hex`` as is when it is not ``None``, which keeps
+    the trace id of an extracted traceparent unchanged.
+    """
+    cdef char buf[_HEADER_BUFFER_SIZE]
+    cdef char* end
+    cdef const char* hex_buf
+    cdef Py_ssize_t hex_size = 0
+    cdef Py_ssize_t i
+    cdef uint64_t value
+
+    if trace_id_hex is not None:
+        hex_buf = NULL
+        if PyUnicode_IS_ASCII(trace_id_hex):
+            hex_buf = PyUnicode_AsUTF8AndSize(trace_id_hex, &hex_size)
+        if hex_buf == NULL or hex_size != 32 or not 0 <= span_id <= _MAX_UINT_64BITS:
+            return "00-{}-{:016x}-{}".format(trace_id_hex, span_id, "01" if sampled else "00")
+    elif not (0 <= trace_id <= _MAX_UINT_128BITS and 0 <= span_id <= _MAX_UINT_64BITS):
+        return "00-{:032x}-{:016x}-{}".format(trace_id, span_id, "01" if sampled else "00")
+
+    buf[0] = c'0'
+    buf[1] = c'0'
+    buf[2] = c'-'
+    if trace_id_hex is not None:
+        for i in range(32):
+            buf[3 + i] = hex_buf[i]
+    else:
+        value = <uint64_t>(trace_id >> 64)
+        _write_hex(buf + 3, value, 16)
+        value = <uint64_t>(trace_id & _MAX_UINT_64BITS)
+        _write_hex(buf + 19, value, 16)
+    buf[35] = c'-'
+    end = _write_hex(buf + 36, <uint64_t>span_id, 16)
+    end[0] = c'-'
+    end[1] = c'0'
+    end[2] = c'1' if sampled else c'0'
+    return PyUnicode_FromStringAndSize(buf, _TRACEPARENT_SIZE)
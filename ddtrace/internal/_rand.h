@@ -0,0 +1,122 @@
+#ifndef DDTRACE_RAND_H
+#define DDTRACE_RAND_H
+
+#include "_stdint.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#define inline __inline
+#define RAND_THREAD_LOCAL __declspec(thread)
+#define RAND_FETCH_ADD(p, v) ((uint64_t)_InterlockedExchangeAdd64((volatile __int64*)(p), (__int64)(v)))
+#define RAND_LOAD(p) ((uint64_t)_InterlockedOr64((volatile __int64*)(p), 0))
+#else
+#define RAND_THREAD_LOCAL __thread
+#define RAND_FETCH_ADD(p, v) __atomic_fetch_add((p), (v), __ATOMIC_RELAXED)
+#define RAND_LOAD(p) __atomic_load_n((p), __ATOMIC_RELAXED)
+#endif
+
+/*
+ * Every thread runs RAND_LANES independent xorshift* generators and keeps a buffer of RAND_BATCH numbers drawn
+ * from them. The lanes have no dependency on each other, so the refill loop vectorizes, and taking a number is a
+ * pointer bump into the buffer of the calling thread.
+ */
+#define RAND_LANES 4
+#define RAND_BATCH 64
+
+#define RAND_MULTIPLIER ((uint64_t)2685821657736338717ULL)
+
+typedef struct rand_thread_state
+{
+    uint64_t lanes[RAND_LANES];
+    uint64_t buffer[RAND_BATCH];
+    unsigned int next;
+    uint64_t generation; // 0 until the state of the thread is seeded
+} rand_thread_state;
+
+// Set by rand_seed, every thread mixes it with its own index to seed its lanes
+static uint64_t rand_global_seed;
+// Bumped by rand_seed so that threads drop the numbers drawn from the previous seed, i.e. on fork
+static uint64_t rand_generation;
+// Index of the next thread to seed its state
+static uint64_t rand_threads;
+
+static RAND_THREAD_LOCAL rand_thread_state rand_state;
+
+static inline uint64_t
+rand_splitmix64(uint64_t* x)
+{
+    uint64_t z = (*x += (uint64_t)0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * (uint64_t)0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * (uint64_t)0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+// Called with the GIL held, so that no thread draws numbers while the seed changes
+static inline void
+rand_seed(uint64_t seed)
+{
+    rand_global_seed = seed;
+    RAND_FETCH_ADD(&rand_generation, 1);
+}
+
+static inline void
+rand_seed_thread(rand_thread_state* st, uint64_t generation)
+{
+    uint64_t x = rand_global_seed ^ (RAND_FETCH_ADD(&rand_threads, 1) * (uint64_t)0xD1B54A32D192ED03ULL);
+    int i;
+
+    for (i = 0; i < RAND_LANES; i++) {
+        st->lanes[i] = rand_splitmix64(&x);
+        if (st->lanes[i] == 0) // the only state xorshift never leaves
+            st->lanes[i] = (uint64_t)4101842887655102017ULL;
+    }
+    st->next = RAND_BATCH;
+    st->generation = generation;
+}
+
+static inline void
+rand_refill(rand_thread_state* st)
+{
+    uint64_t lanes[RAND_LANES];
+    int i, j;
+
+    for (j = 0; j < RAND_LANES; j++)
+        lanes[j] = st->lanes[j];
+
+    for (i = 0; i < RAND_BATCH; i += RAND_LANES) {
+        for (j = 0; j < RAND_LANES; j++) {
+            uint64_t s = lanes[j];
+            s ^= s >> 21;
+            s ^= s << 35;
+            s ^= s >> 4;
+            lanes[j] = s;
+            st->buffer[i + j] = s * RAND_MULTIPLIER;
+        }
+    }
+
+    for (j = 0; j < RAND_LANES; j++)
+        st->lanes[j] = lanes[j];
+    st->next = 0;
+}
+
+static inline uint64_t
+rand_next(void)
+{
+    rand_thread_state* st = &rand_state;
+    uint64_t generation = RAND_LOAD(&rand_generation);
+
+    if (st->generation != generation)
+        rand_seed_thread(st, generation);
+    if (st->next == RAND_BATCH)
+        rand_refill(st);
+    return st->buffer[st->next++];
+}
+
+// Current state of the first lane of the calling thread, for introspection only
+static inline uint64_t
+rand_getstate(void)
+{
+    return rand_state.lanes[0];
+}
+
+#endif
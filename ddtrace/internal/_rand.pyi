@@ -1,3 +1,14 @@
+import typing
+
 def seed() -> None: ...
 def rand64bits(check_pid: bool = True) -> int: ...
 def rand128bits(check_pid: bool = True) -> int: ...
+def span_start(
+    span: object,
+    trace_id: typing.Optional[int],
+    span_id: typing.Optional[int],
+    parent_id: typing.Optional[int],
+    start: typing.Optional[float],
+    trace_id_128bit: bool,
+) -> None: ...
+def span_finish(span: object, finish_time_ns: typing.Optional[int]) -> bool: ...
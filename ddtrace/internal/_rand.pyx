@@ -18,10 +18,11 @@ That's 10,000,000 seconds until we hit the period. That's 115 days of
 100k spans/second (with no application restart) until the period is reached.
 
 
-rand64bits() is thread-safe as it is compiled and is interfaced with via a
-single Python step. This is the same mechanism in which CPython achieves
-thread-safety:
-https://github.com/python/cpython/blob/8d21aa21f2cbc6d50aab3f420bb23be1d081dac4/Lib/random.py#L37-L38
+Every thread draws its numbers from its own generators, seeded from the
+global seed and the index of the thread, so rand64bits() does not share any
+mutable state between threads and stays thread-safe without the GIL. The
+numbers are generated in batches into a buffer of the thread (see _rand.h),
+so most calls only take the next number from the buffer.
 
 
 Warning: this RNG needs to be reseeded on fork() if collisions are to be
@@ -53,6 +54,11 @@ test_rand64bits_pid_check     121.8156 (2.03)     168.9837 (1.71)     130.3854 (
 """  # noqa: E501
 import random
 
+from cpython.object cimport PyObject
+from cpython.object cimport PyTypeObject
+from cpython.object cimport Py_TYPE
+from cpython.ref cimport Py_INCREF
+from cpython.ref cimport Py_XDECREF
 from libc.time cimport time
 
 from ddtrace.internal import forksafe
@@ -61,17 +67,34 @@ from ddtrace.internal import forksafe
 cdef extern from "_stdint.h" nogil:
     ctypedef unsigned long long uint64_t
 
-cdef uint64_t state
+
+cdef extern from "_rand.h" nogil:
+    void rand_seed(uint64_t seed)
+    uint64_t rand_next()
+    uint64_t rand_getstate()
+
+
+cdef extern from "_clock.h" nogil:
+    uint64_t clock_wall_ns()
+
+
+cdef extern from "Python.h":
+    ctypedef struct PyMemberDef:
+        Py_ssize_t offset
+
+    ctypedef struct PyMemberDescrObject:
+        PyMemberDef *d_member
+
+    PyTypeObject PyMemberDescr_Type
 
 
 cpdef _getstate():
-    return state
+    return rand_getstate()
 
 
 cpdef seed():
-    global state
     random.seed()
-    state = <uint64_t>random.getrandbits(64) ^ <uint64_t>4101842887655102017
+    rand_seed(<uint64_t>random.getrandbits(64) ^ <uint64_t>4101842887655102017)
 
 
 # We have to reseed the RNG or we will get collisions between the processes as
@@ -80,16 +103,131 @@ forksafe.register(seed)
 
 
 cpdef rand64bits():
-    global state
-    state ^= state >> 21
-    state ^= state << 35
-    state ^= state >> 4
-    return <uint64_t>(state * <uint64_t>2685821657736338717)
+    return rand_next()
 
 
 cpdef rand128bits():
     # Returns a 128bit integer with the following format -> <32-bit unix seconds><32 bits of zero><64 random bits>
-    return int(time(NULL)) << 96 | rand64bits()
+    return int(time(NULL)) << 96 | rand_next()
+
+
+# Offsets of the slots of Span set when a span starts and finishes, which are written directly instead of being set
+# by name, as the encoders read them. Instances of other types, like subclasses of Span which may override some of
+# the attributes, still get them set through their attributes.
+cdef struct SpanSlots:
+    Py_ssize_t trace_id
+    Py_ssize_t span_id
+    Py_ssize_t parent_id
+    Py_ssize_t start_ns
+    Py_ssize_t duration_ns
+
+
+cdef SpanSlots _span_slots
+cdef object _Span = None
+
+
+cdef inline Py_ssize_t _slot_offset(object cls_dict, str name) except -1:
+    descr = cls_dict[name]
+    if Py_TYPE(descr) != &PyMemberDescr_Type:
+        raise TypeError("Span.%s is not a slot" % name)
+    return (<PyMemberDescrObject *> descr).d_member.offset
+
+
+cdef inline bint _is_span(object span) except -1:
+    global _Span
+
+    if _Span is None:
+        # Imported on first use, as the spans call into this module
+        from ddtrace._trace.span import Span
+
+        cls_dict = Span.__dict__
+        _span_slots.trace_id = _slot_offset(cls_dict, "trace_id")
+        _span_slots.span_id = _slot_offset(cls_dict, "span_id")
+        _span_slots.parent_id = _slot_offset(cls_dict, "parent_id")
+        _span_slots.start_ns = _slot_offset(cls_dict, "start_ns")
+        _span_slots.duration_ns = _slot_offset(cls_dict, "duration_ns")
+        _Span = Span
+
+    return type(span) is _Span
+
+
+cdef inline object _get_span_slot(object span, Py_ssize_t offset):
+    cdef PyObject *value = (<PyObject **> (<char *> <PyObject *> span + offset))[0]
+    if value is NULL:
+        raise AttributeError("span slot at offset %d is not set" % offset)
+    return <object> value
+
+
+cdef inline void _set_span_slot(object span, Py_ssize_t offset, object value):
+    cdef PyObject **slot = <PyObject **> (<char *> <PyObject *> span + offset)
+    cdef PyObject *old = slot[0]
+    Py_INCREF(value)
+    slot[0] = <PyObject *> value
+    Py_XDECREF(old)
+
+
+cpdef span_start(object span, object trace_id, object span_id, object parent_id, object start, bint trace_id_128bit):
+    """Set the ids and the start time of a new span.
+
+    The ids which are not given are taken from the numbers of the calling thread. The start time, when not given,
+    and the timestamp of a new 128-bit trace id come from a single read of the clock.
+    """
+    cdef uint64_t now_ns = 0
+
+    if start is None:
+        now_ns = clock_wall_ns()
+        start_ns = now_ns
+    else:
+        start_ns = int(start * 1e9)
+
+    if trace_id is None:
+        if trace_id_128bit:
+            if now_ns == 0:
+                now_ns = clock_wall_ns()
+            trace_id = int(now_ns // 1000000000) << 96 | rand_next()
+        else:
+            trace_id = rand_next()
+
+    if not span_id:
+        span_id = rand_next()
+
+    if _is_span(span):
+        _set_span_slot(span, _span_slots.trace_id, trace_id)
+        _set_span_slot(span, _span_slots.span_id, span_id)
+        _set_span_slot(span, _span_slots.parent_id, parent_id)
+        _set_span_slot(span, _span_slots.start_ns, start_ns)
+        _set_span_slot(span, _span_slots.duration_ns, None)
+    else:
+        span.trace_id = trace_id
+        span.span_id = span_id
+        span.parent_id = parent_id
+        span.start_ns = start_ns
+        span.duration_ns = None
+
+
+cpdef bint span_finish(object span, object finish_time_ns) except -1:
+    """Set the duration of a span which isn't finished yet, ending at finish_time_ns or now if it is None.
+
+    Returns whether the span was finished by this call.
+    """
+    cdef bint is_span = _is_span(span)
+
+    duration_ns = _get_span_slot(span, _span_slots.duration_ns) if is_span else span.duration_ns
+    if duration_ns is not None:
+        return False
+
+    if finish_time_ns is None:
+        finish_time_ns = clock_wall_ns()
+
+    start_ns = _get_span_slot(span, _span_slots.start_ns) if is_span else span.start_ns
+    # Be defensive, so that a span whose start isn't set doesn't break its finish
+    duration_ns = finish_time_ns - (start_ns or finish_time_ns)
+
+    if is_span:
+        _set_span_slot(span, _span_slots.duration_ns, duration_ns)
+    else:
+        span.duration_ns = duration_ns
+    return True
 
 
 seed()
@@ -0,0 +1,477 @@
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <structmember.h>
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+/* The state of the buckets is only changed with compare-and-swap operations, so that a decision takes neither a
+   lock nor the GIL to stay consistent */
+#if defined(_MSC_VER)
+#include <intrin.h>
+
+static inline int64_t
+atomic_load64(int64_t* p)
+{
+    return _InterlockedCompareExchange64((volatile long long*)p, 0, 0);
+}
+
+static inline int
+atomic_cas64(int64_t* p, int64_t* expected, int64_t desired)
+{
+    int64_t previous = _InterlockedCompareExchange64((volatile long long*)p, desired, *expected);
+    if (previous == *expected)
+        return 1;
+    *expected = previous;
+    return 0;
+}
+#else
+static inline int64_t
+atomic_load64(int64_t* p)
+{
+    return __atomic_load_n(p, __ATOMIC_RELAXED);
+}
+
+static inline int
+atomic_cas64(int64_t* p, int64_t* expected, int64_t desired)
+{
+    return __atomic_compare_exchange_n(p, expected, desired, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+#endif
+
+static inline void
+atomic_store64(int64_t* p, int64_t value)
+{
+    int64_t current = atomic_load64(p);
+    while (!atomic_cas64(p, &current, value))
+        ;
+}
+
+static inline int64_t
+atomic_exchange64(int64_t* p, int64_t value)
+{
+    int64_t current = atomic_load64(p);
+    while (!atomic_cas64(p, &current, value))
+        ;
+    return current;
+}
+
+static inline void
+atomic_add64(int64_t* p, int64_t value)
+{
+    int64_t current = atomic_load64(p);
+    while (!atomic_cas64(p, &current, current + value))
+        ;
+}
+
+/* The doubles are stored by their bits to be swapped as integers */
+static inline int64_t
+double_bits(double value)
+{
+    int64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+static inline double
+bits_double(int64_t bits)
+{
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+/* For the monotonic clock the buckets start from */
+static PyObject* time_module = NULL;
+
+/* A token bucket tracked by the time at which it is full again (its theoretical arrival time, as the generic cell
+   rate algorithm calls it): taking a token pushes it an interval further, and a token is available as long as it is
+   at most time_window ahead of the time of the request. This is the same as replenishing the rate_limit tokens of
+   the bucket continuously over time_window, with a single value to update. */
+
+typedef struct
+{
+    PyObject_HEAD
+
+    PyObject* rate_limit;
+    double rate;
+    double time_window;
+    double interval;
+    /* Bits of the double time at which the bucket is full, relative to the first request so that the doubles keep
+       a precision well under the nanosecond */
+    int64_t full_at;
+    int64_t origin_ns;
+    int64_t last_update_ns;
+    /* Window of the effective rate */
+    int64_t current_window_ns;
+    int64_t tokens_allowed;
+    int64_t tokens_total;
+    /* Bits of the double rate of the previous window, NaN while there is none */
+    int64_t prev_window_rate;
+} TokenBucket;
+
+static int
+TokenBucket_init(TokenBucket* self, PyObject* args, PyObject* kwargs)
+{
+    static char* kwlist[] = { "rate_limit", "time_window", NULL };
+    PyObject* rate_limit;
+    double time_window = 1e9;
+    double rate;
+    PyObject* now;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|d:RateLimiter", kwlist, &rate_limit, &time_window))
+        return -1;
+
+    rate = PyFloat_AsDouble(rate_limit);
+    if (rate == -1.0 && PyErr_Occurred())
+        return -1;
+
+    if (time_window <= 0) {
+        PyErr_SetString(PyExc_ValueError, "time_window must be positive");
+        return -1;
+    }
+
+    now = PyObject_CallMethod(time_module, "monotonic_ns", NULL);
+    if (now == NULL)
+        return -1;
+    self->last_update_ns = PyLong_AsLongLong(now);
+    Py_DECREF(now);
+    if (self->last_update_ns == -1 && PyErr_Occurred())
+        return -1;
+
+    Py_INCREF(rate_limit);
+    Py_XSETREF(self->rate_limit, rate_limit);
+    self->rate = rate;
+    self->time_window = time_window;
+    self->interval = rate > 0 ? time_window / rate : 0;
+    /* Full whatever the clock of the first requests */
+    self->full_at = double_bits(-INFINITY);
+    self->origin_ns = INT64_MIN;
+    self->current_window_ns = 0;
+    self->tokens_allowed = 0;
+    self->tokens_total = 0;
+    self->prev_window_rate = double_bits(NAN);
+
+    return 0;
+}
+
+static int
+TokenBucket_traverse(TokenBucket* self, visitproc visit, void* arg)
+{
+    Py_VISIT(self->rate_limit);
+    return 0;
+}
+
+static int
+TokenBucket_clear(TokenBucket* self)
+{
+    Py_CLEAR(self->rate_limit);
+    return 0;
+}
+
+static void
+TokenBucket_dealloc(TokenBucket* self)
+{
+    PyObject_GC_UnTrack(self);
+    TokenBucket_clear(self);
+    Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+/* Timestamps are taken as integers, or as floats which are split into the nanoseconds in the range of the integers
+   and what is left */
+static int
+parse_timestamp(PyObject* timestamp, int64_t* timestamp_ns, double* excess)
+{
+    double value;
+
+    *excess = 0;
+    if (PyLong_Check(timestamp)) {
+        *timestamp_ns = PyLong_AsLongLong(timestamp);
+        return *timestamp_ns == -1 && PyErr_Occurred() ? -1 : 0;
+    }
+
+    value = PyFloat_AsDouble(timestamp);
+    if (value == -1.0 && PyErr_Occurred())
+        return -1;
+    if (isnan(value)) {
+        PyErr_SetString(PyExc_ValueError, "timestamp must be a number");
+        return -1;
+    }
+
+    if (value >= 0x1p63)
+        *timestamp_ns = INT64_MAX;
+    else if (value <= -0x1p63)
+        *timestamp_ns = INT64_MIN + 1;
+    else
+        *timestamp_ns = (int64_t)value;
+    *excess = value - (double)*timestamp_ns;
+    return 0;
+}
+
+/* Nanoseconds from start to end, without overflowing */
+static double
+elapsed(int64_t start, int64_t end)
+{
+    if (end >= start)
+        return (double)((uint64_t)end - (uint64_t)start);
+    return -(double)((uint64_t)start - (uint64_t)end);
+}
+
+static int
+take_token(TokenBucket* self, int64_t timestamp_ns, double excess)
+{
+    int64_t full_at;
+    int64_t next_full_at;
+    int64_t origin_ns;
+    double timestamp;
+
+    /* Rate limit of 0 blocks everything, and a negative one disables rate limiting */
+    if (self->rate == 0)
+        return 0;
+    else if (self->rate < 0)
+        return 1;
+
+    atomic_store64(&self->last_update_ns, timestamp_ns);
+
+    /* A bucket which holds less than a token never has one */
+    if (self->rate < 1)
+        return 0;
+
+    origin_ns = atomic_load64(&self->origin_ns);
+    if (origin_ns == INT64_MIN && atomic_cas64(&self->origin_ns, &origin_ns, timestamp_ns))
+        origin_ns = timestamp_ns;
+    timestamp = elapsed(origin_ns, timestamp_ns) + excess;
+
+    full_at = atomic_load64(&self->full_at);
+    do {
+        double next = fmax(bits_double(full_at), timestamp) + self->interval;
+
+        /* A tiny fraction of an interval of slack absorbs the rounding of the times */
+        if (next - timestamp > self->time_window + self->interval * 1e-6)
+            return 0;
+        next_full_at = double_bits(next);
+    } while (!atomic_cas64(&self->full_at, &full_at, next_full_at));
+
+    return 1;
+}
+
+static double
+window_rate(int64_t allowed, int64_t total)
+{
+    /* No tokens have been seen, effectively 100% sample rate */
+    return total ? (double)allowed / (double)total : 1.0;
+}
+
+static void
+update_rate_counts(TokenBucket* self, int allowed, int64_t timestamp_ns)
+{
+    int64_t window = atomic_load64(&self->current_window_ns);
+
+    /* No tokens have been seen yet, start a new window */
+    if (window == 0) {
+        atomic_cas64(&self->current_window_ns, &window, timestamp_ns);
+    } else if (elapsed(window, timestamp_ns) >= self->time_window) {
+        /* Only the request which moves the window on keeps the rate of the previous one */
+        if (atomic_cas64(&self->current_window_ns, &window, timestamp_ns)) {
+            int64_t window_allowed = atomic_exchange64(&self->tokens_allowed, 0);
+            int64_t window_total = atomic_exchange64(&self->tokens_total, 0);
+
+            atomic_store64(&self->prev_window_rate, double_bits(window_rate(window_allowed, window_total)));
+        }
+    }
+
+    if (allowed)
+        atomic_add64(&self->tokens_allowed, 1);
+    atomic_add64(&self->tokens_total, 1);
+}
+
+static PyObject*
+TokenBucket_is_allowed(TokenBucket* self, PyObject* timestamp)
+{
+    int64_t timestamp_ns;
+    double excess;
+    int allowed;
+
+    if (parse_timestamp(timestamp, &timestamp_ns, &excess) < 0)
+        return NULL;
+
+    allowed = take_token(self, timestamp_ns, excess);
+    update_rate_counts(self, allowed, timestamp_ns);
+
+    return PyBool_FromLong(allowed);
+}
+
+static PyObject*
+TokenBucket_take_token(TokenBucket* self, PyObject* timestamp)
+{
+    int64_t timestamp_ns;
+    double excess;
+
+    if (parse_timestamp(timestamp, &timestamp_ns, &excess) < 0)
+        return NULL;
+
+    return PyBool_FromLong(take_token(self, timestamp_ns, excess));
+}
+
+static PyObject*
+TokenBucket_get_max_tokens(TokenBucket* self, void* Py_UNUSED(closure))
+{
+    PyObject* max_tokens = self->rate_limit ? self->rate_limit : Py_None;
+
+    Py_INCREF(max_tokens);
+    return max_tokens;
+}
+
+static PyObject*
+TokenBucket_get_tokens(TokenBucket* self, void* Py_UNUSED(closure))
+{
+    int64_t origin_ns;
+    double tokens;
+
+    if (self->rate_limit == NULL || self->rate <= 0)
+        return TokenBucket_get_max_tokens(self, NULL);
+
+    /* Full until the first request */
+    origin_ns = atomic_load64(&self->origin_ns);
+    if (origin_ns == INT64_MIN)
+        return PyFloat_FromDouble(self->rate);
+
+    /* The tokens at the time of the last request */
+    tokens = elapsed(origin_ns, atomic_load64(&self->last_update_ns)) + self->time_window;
+    tokens = (tokens - bits_double(atomic_load64(&self->full_at))) / self->interval;
+    return PyFloat_FromDouble(tokens > self->rate ? self->rate : (tokens < 0 ? 0 : tokens));
+}
+
+static PyObject*
+TokenBucket_get_last_update_ns(TokenBucket* self, void* Py_UNUSED(closure))
+{
+    return PyLong_FromLongLong(atomic_load64(&self->last_update_ns));
+}
+
+static PyObject*
+TokenBucket_get_current_window_ns(TokenBucket* self, void* Py_UNUSED(closure))
+{
+    return PyLong_FromLongLong(atomic_load64(&self->current_window_ns));
+}
+
+static PyObject*
+TokenBucket_get_tokens_allowed(TokenBucket* self, void* Py_UNUSED(closure))
+{
+    return PyLong_FromLongLong(atomic_load64(&self->tokens_allowed));
+}
+
+static PyObject*
+TokenBucket_get_tokens_total(TokenBucket* self, void* Py_UNUSED(closure))
+{
+    return PyLong_FromLongLong(atomic_load64(&self->tokens_total));
+}
+
+static PyObject*
+TokenBucket_get_prev_window_rate(TokenBucket* self, void* Py_UNUSED(closure))
+{
+    double rate = bits_double(atomic_load64(&self->prev_window_rate));
+
+    if (isnan(rate))
+        Py_RETURN_NONE;
+    return PyFloat_FromDouble(rate);
+}
+
+static PyObject*
+TokenBucket_get_effective_rate(TokenBucket* self, void* Py_UNUSED(closure))
+{
+    double rate = window_rate(atomic_load64(&self->tokens_allowed), atomic_load64(&self->tokens_total));
+    double prev_rate = bits_double(atomic_load64(&self->prev_window_rate));
+
+    /* If we have not had a previous window yet, return current rate */
+    if (isnan(prev_rate))
+        return PyFloat_FromDouble(rate);
+    return PyFloat_FromDouble((rate + prev_rate) / 2.0);
+}
+
+static PyMethodDef TokenBucket_methods[] = {
+    { "is_allowed",
+      (PyCFunction)TokenBucket_is_allowed,
+      METH_O,
+      "Take a token for a request at the timestamp in nanoseconds, returns whether there was one" },
+    { "_is_allowed",
+      (PyCFunction)TokenBucket_take_token,
+      METH_O,
+      "Take a token like is_allowed, without counting the request in the effective rate" },
+    { NULL, NULL, 0, NULL }
+};
+
+static PyMemberDef TokenBucket_members[] = {
+    { "rate_limit", T_OBJECT, offsetof(TokenBucket, rate_limit), READONLY, NULL },
+    { "time_window", T_DOUBLE, offsetof(TokenBucket, time_window), READONLY, NULL },
+    { NULL, 0, 0, 0, NULL }
+};
+
+static PyGetSetDef TokenBucket_getset[] = {
+    { "tokens", (getter)TokenBucket_get_tokens, NULL, "Tokens left at the time of the last request", NULL },
+    { "max_tokens", (getter)TokenBucket_get_max_tokens, NULL, "Size of the bucket", NULL },
+    { "last_update_ns", (getter)TokenBucket_get_last_update_ns, NULL, "Timestamp of the last request", NULL },
+    { "current_window_ns",
+      (getter)TokenBucket_get_current_window_ns,
+      NULL,
+      "Start of the window of the effective rate, 0 before the first request",
+      NULL },
+    { "tokens_allowed", (getter)TokenBucket_get_tokens_allowed, NULL, "Requests allowed in the window", NULL },
+    { "tokens_total", (getter)TokenBucket_get_tokens_total, NULL, "Requests seen in the window", NULL },
+    { "prev_window_rate",
+      (getter)TokenBucket_get_prev_window_rate,
+      NULL,
+      "Rate of the requests allowed in the previous window, None if there was none",
+      NULL },
+    { "effective_rate",
+      (getter)TokenBucket_get_effective_rate,
+      NULL,
+      "Rate of the requests allowed in the current and previous windows, between 0.0 and 1.0",
+      NULL },
+    { NULL, NULL, NULL, NULL, NULL }
+};
+
+static PyTypeObject TokenBucketType = {
+    PyVarObject_HEAD_INIT(NULL, 0).tp_name = "ddtrace.internal._rate_limiter.TokenBucket",
+    .tp_doc = "A token bucket rate limiter",
+    .tp_basicsize = sizeof(TokenBucket),
+    .tp_itemsize = 0,
+    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE | Py_TPFLAGS_HAVE_GC,
+    .tp_new = PyType_GenericNew,
+    .tp_init = (initproc)TokenBucket_init,
+    .tp_dealloc = (destructor)TokenBucket_dealloc,
+    .tp_traverse = (traverseproc)TokenBucket_traverse,
+    .tp_clear = (inquiry)TokenBucket_clear,
+    .tp_methods = TokenBucket_methods,
+    .tp_members = TokenBucket_members,
+    .tp_getset = TokenBucket_getset,
+};
+
+static struct PyModuleDef rate_limiter_module = {
+    PyModuleDef_HEAD_INIT, "ddtrace.internal._rate_limiter", "lock-free token bucket rate limiter", -1, NULL
+};
+
+PyMODINIT_FUNC
+PyInit__rate_limiter(void)
+{
+    PyObject* m;
+
+    if (PyType_Ready(&TokenBucketType) < 0)
+        return NULL;
+
+    if (time_module == NULL && (time_module = PyImport_ImportModule("time")) == NULL)
+        return NULL;
+
+    m = PyModule_Create(&rate_limiter_module);
+    if (m == NULL)
+        return NULL;
+
+    Py_INCREF(&TokenBucketType);
+    if (PyModule_AddObject(m, "TokenBucket", (PyObject*)&TokenBucketType) < 0) {
+        Py_DECREF(&TokenBucketType);
+        Py_DECREF(m);
+        return NULL;
+    }
+
+    return m;
+}
@@ -0,0 +1,10 @@
+import typing as t
+
+from ddtrace._trace.span import Span
+from ddtrace.sampling_rule import SamplingRule
+
+class RuleMatcher:
+    rules: t.List[SamplingRule]
+    def __init__(self, rules: t.List[SamplingRule]) -> None: ...
+    def compiled_for(self, rules: t.List[SamplingRule]) -> bool: ...
+    def match(self, span: Span) -> t.Optional[SamplingRule]: ...
@@ -0,0 +1,266 @@
+"""
+Matcher of the glob patterns of a list of sampling rules.
+
+The rules are compiled into one table per span property (service, name and
+resource), which gives the set of rules matching a value of the property as a
+bit mask: the rules whose pattern is a literal are looked up in a dict, and
+only the prefix, suffix and glob patterns are matched one by one. The masks
+are cached by value, so finding the first rule matching a span usually takes
+three dict lookups, after which only the tags of the candidate rules are
+matched.
+
+Rules which use a function or a regular expression, which are deprecated,
+can't be compiled, and neither can instances of subclasses of SamplingRule.
+They are candidates for every span, and are matched by their matches()
+method.
+"""
+from ddtrace.internal.glob_matching import GlobMatcher
+from ddtrace.sampling_rule import SamplingRule
+
+
+# Number of distinct values of each property the masks are cached for
+DEF _MASK_CACHE_SIZE = 1024
+
+DEF _KIND_ANY = 0
+DEF _KIND_EXACT = 1
+DEF _KIND_PREFIX = 2
+DEF _KIND_SUFFIX = 3
+DEF _KIND_GLOB = 4
+
+
+cdef bint _glob_match(str pattern, str subject):
+    # Same backtracking algorithm as GlobMatcher.match, on lowercased values
+    cdef Py_ssize_t plen = len(pattern)
+    cdef Py_ssize_t slen = len(subject)
+    cdef Py_ssize_t px = 0
+    cdef Py_ssize_t sx = 0
+    cdef Py_ssize_t next_px = 0
+    cdef Py_ssize_t next_sx = 0
+    cdef Py_UCS4 c
+
+    while px < plen or sx < slen:
+        if px < plen:
+            c = pattern[px]
+
+            if c == u"?":
+                if sx < slen:
+                    px += 1
+                    sx += 1
+                    continue
+
+            elif c == u"*":
+                next_px = px
+                next_sx = sx + 1
+                px += 1
+                continue
+
+            elif sx < slen and subject[sx] == c:
+                px += 1
+                sx += 1
+                continue
+
+        if 0 < next_sx <= slen:
+            px = next_px
+            sx = next_sx
+            continue
+
+        return False
+    return True
+
+
+cdef class _Glob:
+    """A glob pattern, with the literal ones and the ones with a single leading or trailing ``*`` set apart"""
+
+    cdef readonly str pattern
+    cdef int kind
+    cdef str literal
+
+    def __cinit__(self, str pattern):
+        self.pattern = pattern.lower()
+        self.literal = self.pattern
+
+        if self.pattern and self.pattern.strip(u"*") == u"":
+            self.kind = _KIND_ANY
+        elif u"*" not in self.pattern and u"?" not in self.pattern:
+            self.kind = _KIND_EXACT
+        else:
+            stripped = self.pattern.strip(u"*")
+            if u"*" in stripped or u"?" in stripped or (self.pattern[0] == u"*" and self.pattern[-1] == u"*"):
+                self.kind = _KIND_GLOB
+            elif self.pattern[-1] == u"*":
+                self.kind = _KIND_PREFIX
+                self.literal = stripped
+            else:
+                self.kind = _KIND_SUFFIX
+                self.literal = stripped
+
+    cdef bint match(self, str subject):
+        # The subject is lowercased already
+        if self.kind == _KIND_ANY:
+            return True
+        if self.kind == _KIND_EXACT:
+            return subject == self.literal
+        if self.kind == _KIND_PREFIX:
+            return subject.startswith(self.literal)
+        if self.kind == _KIND_SUFFIX:
+            return subject.endswith(self.literal)
+        return _glob_match(self.pattern, subject)
+
+
+cdef class _PropertyTable:
+    """The rules matching each value of a span property, as a bit mask"""
+
+    # Rules which match any value, including the ones without a pattern for the property
+    cdef object any_mask
+    # Lowercased literal value -> rules
+    cdef dict exact
+    # (rule bit, _Glob) of the other patterns
+    cdef list globs
+    cdef dict cache
+
+    def __cinit__(self):
+        self.any_mask = 0
+        self.exact = {}
+        self.globs = []
+        self.cache = {}
+
+    cdef add(self, object bit, object pattern):
+        cdef _Glob glob
+
+        if pattern is None:
+            self.any_mask |= bit
+            return
+
+        glob = _Glob(pattern)
+        if glob.kind == _KIND_ANY:
+            self.any_mask |= bit
+        elif glob.kind == _KIND_EXACT:
+            self.exact[glob.literal] = self.exact.get(glob.literal, 0) | bit
+        else:
+            self.globs.append((bit, glob))
+
+    cdef object mask(self, object value):
+        cdef _Glob glob
+        # Values which aren't strings may compare equal without being formatted the same, e.g. 1 and True
+        cdef bint cached = type(value) is str
+
+        if cached:
+            mask = self.cache.get(value)
+            if mask is not None:
+                return mask
+
+        subject = str(value).lower()
+        mask = self.any_mask | self.exact.get(subject, 0)
+        for bit, glob in self.globs:
+            if glob.match(subject):
+                mask |= bit
+
+        if cached:
+            if len(self.cache) >= _MASK_CACHE_SIZE:
+                # Cheaper than tracking which values are used the most, and the masks are quickly recomputed
+                self.cache.clear()
+            self.cache[value] = mask
+        return mask
+
+
+cdef bint _tags_match(list tag_globs, dict meta, dict metrics):
+    # Same as SamplingRule.check_tags
+    cdef _Glob glob
+    cdef bint tag_match = False
+
+    for key, glob in tag_globs:
+        tag_match = glob.match(str(meta.get(key)).lower())
+        if tag_match:
+            continue
+
+        value = metrics.get(key)
+        # Floats with a non-zero decimal part only match the "*" pattern
+        if isinstance(value, float):
+            if not value.is_integer():
+                if glob.pattern == u"*":
+                    tag_match = True
+                    continue
+                return False
+            value = int(value)
+
+        tag_match = glob.match(str(value).lower())
+        if not tag_match:
+            return False
+
+    return tag_match
+
+
+cdef class RuleMatcher:
+    """Finds the first of a list of sampling rules which matches a span"""
+
+    cdef readonly object rules
+    cdef tuple _compiled_rules
+    cdef _PropertyTable _service
+    cdef _PropertyTable _name
+    cdef _PropertyTable _resource
+    # Index of each rule -> list of (tag, _Glob), or None if the rule has no tags
+    cdef list _tag_globs
+    # Rules which are matched by their matches() method
+    cdef object _opaque_mask
+
+    def __cinit__(self, rules):
+        self.rules = rules
+        self._compiled_rules = tuple(rules)
+        self._service = _PropertyTable()
+        self._name = _PropertyTable()
+        self._resource = _PropertyTable()
+        self._tag_globs = []
+        self._opaque_mask = 0
+
+        for i, rule in enumerate(self._compiled_rules):
+            bit = 1 << i
+            patterns = (rule.service, rule.name, rule.resource)
+            if type(rule) is not SamplingRule or not all(
+                p is rule.NO_RULE or isinstance(p, GlobMatcher) for p in patterns
+            ):
+                for table in (self._service, self._name, self._resource):
+                    (<_PropertyTable>table).add(bit, None)
+                self._opaque_mask |= bit
+                self._tag_globs.append(None)
+                continue
+
+            for table, pattern in zip((self._service, self._name, self._resource), patterns):
+                (<_PropertyTable>table).add(bit, None if pattern is rule.NO_RULE else pattern.pattern)
+            self._tag_globs.append(
+                [(key, _Glob(matcher.pattern)) for key, matcher in rule._tag_value_matchers.items()] or None
+            )
+
+    cpdef bint compiled_for(self, object rules):
+        """Whether this matcher was compiled for the given list of rules, which may have been changed since"""
+        cdef Py_ssize_t i
+
+        if rules is not self.rules or len(rules) != len(self._compiled_rules):
+            return False
+        for i in range(len(self._compiled_rules)):
+            if rules[i] is not self._compiled_rules[i]:
+                return False
+        return True
+
+    def match(self, span):
+        """Return the first rule which matches the span, or None"""
+        cdef list tag_globs
+
+        candidates = (
+            self._service.mask(span.service) & self._name.mask(span.name) & self._resource.mask(span.resource)
+        )
+        while candidates:
+            low = candidates & -candidates
+            candidates ^= low
+            i = low.bit_length() - 1
+            rule = self._compiled_rules[i]
+
+            if low & self._opaque_mask:
+                if rule.matches(span):
+                    return rule
+                continue
+
+            tag_globs = self._tag_globs[i]
+            if tag_globs is None or _tags_match(tag_globs, span._meta, span._metrics):
+                return rule
+
+        return None
@@ -8,6 +8,24 @@ Tagset eBNF::
     equal or comma = "=" | ",";
     space = " ";
 """
+from cpython.dict cimport PyDict_CheckExact
+from cpython.dict cimport PyDict_Copy
+from cpython.dict cimport PyDict_Next
+from cpython.mem cimport PyMem_Free
+from cpython.mem cimport PyMem_Malloc
+from cpython.object cimport PyObject
+from cpython.ref cimport Py_INCREF
+from cpython.ref cimport Py_XDECREF
+from cpython.unicode cimport PyUnicode_CheckExact
+from libc.string cimport memchr
+from libc.string cimport memcpy
+from libc.string cimport memmove
+
+
+cdef extern from "Python.h":
+    bint PyUnicode_IS_ASCII(object o)
+    const char* PyUnicode_AsUTF8AndSize(object o, Py_ssize_t* size) except NULL
+    str PyUnicode_FromStringAndSize(const char* u, Py_ssize_t size)
 
 
 class TagsetEncodeError(ValueError):
@@ -83,6 +101,11 @@ cdef inline int is_comma(int c):
     return c == 44
 
 
+cdef inline int is_space(int c):
+    # ' '
+    return c == 32
+
+
 cdef inline int is_valid_key_char(int c):
     # string.printable - " ,="
     # 32 = " "
@@ -95,7 +118,119 @@ cdef inline int is_valid_key_char(int c):
 cdef inline int is_valid_value_char(int c):
     # string.printable - ","
     # 44 = ",""
-    return c == 32 or is_equal(c) or is_valid_key_char(c)
+    return is_space(c) or is_equal(c) or is_valid_key_char(c)
+
+
+cdef inline const char* _find(const char* start, const char* end, int c):
+    """Pointer to the first ``c`` character in ``[start, end)``, or ``end`` if none"""
+    cdef const char* found = <const char*>memchr(start, c, end - start)
+    return end if found == NULL else found
+
+
+cdef inline const char* _invalid_key_char(const char* start, const char* end):
+    """Pointer to the first character of ``[start, end)`` not allowed in keys, or ``NULL`` if none"""
+    while start < end:
+        if not is_valid_key_char(<unsigned char>start[0]):
+            return start
+        start += 1
+    return NULL
+
+
+cdef inline const char* _invalid_value_char(const char* start, const char* end):
+    """Pointer to the first character of ``[start, end)`` not allowed in values, or ``NULL`` if none"""
+    while start < end:
+        if not is_valid_value_char(<unsigned char>start[0]):
+            return start
+        start += 1
+    return NULL
+
+
+cdef inline const char* _lstrip(const char* start, const char* end):
+    while start < end and is_space(start[0]):
+        start += 1
+    return start
+
+
+cdef inline const char* _rstrip(const char* start, const char* end):
+    while end > start and is_space(end[-1]):
+        end -= 1
+    return end
+
+
+cdef inline str _str(const char* start, const char* end):
+    return PyUnicode_FromStringAndSize(start, end - start)
+
+
+cdef inline const char* _ascii(str s, Py_ssize_t* size):
+    """UTF-8 buffer of ``s``, or ``NULL`` when ``s`` is not ASCII as none of its characters could be valid"""
+    if not PyUnicode_IS_ASCII(s):
+        return NULL
+    return PyUnicode_AsUTF8AndSize(s, size)
+
+
+# DEV: Most requests carry one of a handful of tagsets, so the last ones decoded and encoded are kept
+#      in these caches, from the most recently used one to the least recently used one
+DEF TAGSET_CACHE_SIZE = 16
+
+
+cdef struct TagsetCacheEntry:
+    # Hash of the decoded string, or length of the encoded dict
+    Py_hash_t hash
+    int max_size
+    PyObject* key
+    PyObject* value
+
+
+cdef TagsetCacheEntry _decode_cache[TAGSET_CACHE_SIZE]
+cdef TagsetCacheEntry _encode_cache[TAGSET_CACHE_SIZE]
+
+
+cdef inline void _cache_use(TagsetCacheEntry* cache, int i):
+    """Move the entry ``i`` of ``cache`` to its front"""
+    cdef TagsetCacheEntry entry = cache[i]
+    memmove(cache + 1, cache, i * sizeof(TagsetCacheEntry))
+    cache[0] = entry
+
+
+cdef inline void _cache_add(TagsetCacheEntry* cache, Py_hash_t hash, int max_size, object key, object value):
+    """Add an entry to the front of ``cache``, in place of its least recently used one"""
+    cdef TagsetCacheEntry evicted = cache[TAGSET_CACHE_SIZE - 1]
+
+    memmove(cache + 1, cache, (TAGSET_CACHE_SIZE - 1) * sizeof(TagsetCacheEntry))
+    Py_INCREF(key)
+    Py_INCREF(value)
+    cache[0].hash = hash
+    cache[0].max_size = max_size
+    cache[0].key = <PyObject*>key
+    cache[0].value = <PyObject*>value
+
+    # DEV: Released last, as it could run code which uses the cache
+    Py_XDECREF(evicted.key)
+    Py_XDECREF(evicted.value)
+
+
+cdef inline bint _same_str(PyObject* a, PyObject* b):
+    if a == b:
+        return True
+    return PyUnicode_CheckExact(<object>a) and PyUnicode_CheckExact(<object>b) and <object>a == <object>b
+
+
+cdef inline bint _same_items(dict a, dict b):
+    """Whether the dicts of strings ``a`` and ``b`` have the same items in the same order"""
+    cdef Py_ssize_t i = 0
+    cdef Py_ssize_t j = 0
+    cdef PyObject* a_key
+    cdef PyObject* a_value
+    cdef PyObject* b_key
+    cdef PyObject* b_value
+
+    if len(a) != len(b):
+        return False
+    while PyDict_Next(a, &i, &a_key, &a_value):
+        PyDict_Next(b, &j, &b_key, &b_value)
+        if not _same_str(a_key, b_key) or not _same_str(a_value, b_value):
+            return False
+    return True
 
 
 cpdef dict decode_tagset_string(str tagset, int max_size=512):
@@ -116,11 +251,16 @@ cpdef dict decode_tagset_string(str tagset, int max_size=512):
     :raises TagsetDecodeError: When the provided format is not valid
     """
     cdef dict res = {}
-    cdef str c
-    cdef int o
-    cdef str cur_val = ""
-    cdef str cur_key = ""
-    cdef int is_parsing_key = 1
+    cdef Py_ssize_t size
+    cdef const char* buf
+    cdef const char* end
+    cdef const char* key
+    cdef const char* key_end
+    cdef const char* val
+    cdef const char* val_end
+    cdef const char* invalid
+    cdef Py_hash_t tagset_hash = 0
+    cdef int i
 
     # No tagset provided, short circuit the response
     if not tagset:
@@ -130,67 +270,65 @@ cpdef dict decode_tagset_string(str tagset, int max_size=512):
     if len(tagset) > max_size:
         raise TagsetMaxSizeDecodeError(tagset, max_size)
 
-    # DEV: Parse in a single pass of `tagset`
-    #      `is_parsing_key` is used to know if we are on
-    #      right or left side of an `=`
-    for c in tagset:
-        o = ord(c)
-        if is_parsing_key:
-            if is_equal(o):
-                if not cur_key:
-                    raise TagsetDecodeError("Empty keys are not allowed: {!r}".format(tagset))
-                is_parsing_key = 0
-                continue
-
-            if not is_valid_key_char(o):
-                raise TagsetDecodeError("Unexpected {!r} character for key {}: {!r}".format(c, cur_key, tagset))
-            cur_key += c
-        else:
-            if is_comma(o):
-                cur_val = cur_val.strip(" ")
-                if not cur_val:
-                    raise TagsetDecodeError("Empty values are not allowed: {!r}".format(tagset))
-                res[cur_key] = cur_val
-                cur_key, cur_val, is_parsing_key = "", "", 1
-                continue
-
-            if not is_valid_value_char(o):
+    # Return a copy of the dict of the same tagset if it was decoded recently
+    if PyUnicode_CheckExact(tagset):
+        tagset_hash = hash(tagset)
+        for i in range(TAGSET_CACHE_SIZE):
+            if _decode_cache[i].key == NULL:
+                break
+            if _decode_cache[i].hash == tagset_hash and _same_str(_decode_cache[i].key, <PyObject*>tagset):
+                _cache_use(_decode_cache, i)
+                cached = <object>_decode_cache[0].value
+                return PyDict_Copy(cached)
+
+    buf = _ascii(tagset, &size)
+    if buf == NULL:
+        raise TagsetDecodeError("Unexpected non-ASCII character: {!r}".format(tagset))
+    end = buf + size
+
+    # DEV: Parse in a single pass over the UTF-8 buffer of `tagset`, every
+    #      key ends at the next `=` and every value at the next `,`
+    key = buf
+    while key < end:
+        key_end = _find(key, end, 61)
+        invalid = _invalid_key_char(key, key_end)
+        if invalid != NULL:
+            raise TagsetDecodeError(
+                "Unexpected {!r} character for key {}: {!r}".format(chr(invalid[0]), _str(key, invalid), tagset)
+            )
+        if key_end == key:
+            raise TagsetDecodeError("Empty keys are not allowed: {!r}".format(tagset))
+        if key_end == end:
+            raise TagsetDecodeError(
+                "Expected value for key {!r} instead got EOF: {!r}".format(_str(key, key_end), tagset)
+            )
+
+        val = key_end + 1
+        val_end = _find(val, end, 44)
+        invalid = _invalid_value_char(val, val_end)
+        if invalid != NULL:
+            raise TagsetDecodeError(
+                "Unexpected character {!r} for value {}={}: {!r}".format(
+                    chr(invalid[0]), _str(key, key_end), _str(val, invalid), tagset
+                ),
+            )
+
+        # Remove leading/trailing spaces from the value
+        val = _lstrip(val, val_end)
+        if val == val_end:
+            if val_end == end:
                 raise TagsetDecodeError(
-                    "Unexpected character {!r} for value {}={}: {!r}".format(c, cur_key, cur_val, tagset),
+                    "Expected value for key {!r} instead got EOF: {!r}".format(_str(key, key_end), tagset)
                 )
-            cur_val += c
+            raise TagsetDecodeError("Empty values are not allowed: {!r}".format(tagset))
 
-    # Reached EOF, do we have a key/value pair we need to save?
-    if cur_key:
-        cur_val = cur_val.strip(" ")
-        if cur_val:
-            res[cur_key] = cur_val
-        else:
-            raise TagsetDecodeError("Expected value for key {!r} instead got EOF: {!r}".format(cur_key, tagset))
+        res[_str(key, key_end)] = _str(val, _rstrip(val, val_end))
+        key = val_end + 1
 
+    if PyUnicode_CheckExact(tagset):
+        _cache_add(_decode_cache, tagset_hash, 0, tagset, PyDict_Copy(res))
     return res
 
-cdef bint _key_is_valid(str key):
-    """Helper to ensure a key's characters are all valid"""
-    if not key:
-        return 0
-
-    for c in key:
-        if not is_valid_key_char(ord(c)):
-            return 0
-    return 1
-
-
-cdef bint _value_is_valid(str value):
-    """Helper to ensure a values's characters are all valid"""
-    if not value:
-        return 0
-
-    for c in value:
-        if not is_valid_value_char(ord(c)):
-            return 0
-    return 1
-
 
 cpdef str encode_tagset_values(object values, int max_size=512):
     # type: (Dict[str, str], int) -> str
@@ -210,31 +348,79 @@ cpdef str encode_tagset_values(object values, int max_size=512):
     :raises TagsetMaxSizeEncodeError: Raised when we will exceed the provided max size
     :raises TagsetEncodeError: Raised when we encounter an exception character in a key or value
     """
-    cdef str res = ""
+    # DEV: Tagsets are ASCII, so the result is written into a buffer of `max_size` bytes
+    #      and only turned into a string once
+    cdef char small[512]
+    cdef char* buf = small
+    cdef Py_ssize_t length = 0
+    cdef Py_ssize_t size
+    cdef const char* key_start
+    cdef const char* key_end
+    cdef const char* val_start
+    cdef const char* val_end
     cdef str key
     cdef str value
+    cdef bint cacheable = PyDict_CheckExact(values)
     cdef int i
 
-    for i, (key, value) in enumerate(values.items()):
-        # Strip any leading/trailing spaces
-        key = key.strip(" ")
-        value = value.strip(" ")
-
-        if not _key_is_valid(key):
-            raise TagsetEncodeError("Key is not valid: {!r}".format(key))
-        if not _value_is_valid(value):
-            raise TagsetEncodeError("Value is not valid: {!r}".format(value))
-
-        encoded = "{}={}".format(key, value)
-        # Prefix every item except the first with `,` for separator
-        if i > 0:
-            encoded = "," + encoded
-
-        # Raise an exception that we will exceed the max size
-        # The exception has the value up until now if the caller
-        # wants to use the partially encoded value
-        if len(res) + len(encoded) > max_size:
-            raise TagsetMaxSizeEncodeError(values, max_size, res)
-
-        res += encoded
-    return res
+    # Return the string of the same items if they were encoded recently
+    if cacheable:
+        for i in range(TAGSET_CACHE_SIZE):
+            if _encode_cache[i].key == NULL:
+                break
+            if (
+                _encode_cache[i].hash == len(values)
+                and _encode_cache[i].max_size == max_size
+                and _same_items(<dict><object>_encode_cache[i].key, <dict>values)
+            ):
+                _cache_use(_encode_cache, i)
+                return <str><object>_encode_cache[0].value
+
+    if max_size > <int>sizeof(small):
+        buf = <char*>PyMem_Malloc(max_size)
+        if buf == NULL:
+            raise MemoryError()
+
+    try:
+        for key, value in values.items():
+            # Strip any leading/trailing spaces
+            key_start = _ascii(key, &size)
+            if key_start != NULL:
+                key_end = _rstrip(key_start, key_start + size)
+                key_start = _lstrip(key_start, key_end)
+            if key_start == NULL or key_start == key_end or _invalid_key_char(key_start, key_end) != NULL:
+                raise TagsetEncodeError("Key is not valid: {!r}".format(key.strip(" ")))
+
+            val_start = _ascii(value, &size)
+            if val_start != NULL:
+                val_end = _rstrip(val_start, val_start + size)
+                val_start = _lstrip(val_start, val_end)
+            if val_start == NULL or val_start == val_end or _invalid_value_char(val_start, val_end) != NULL:
+                raise TagsetEncodeError("Value is not valid: {!r}".format(value.strip(" ")))
+
+            # Prefix every item except the first with `,` for separator
+            size = (length > 0) + (key_end - key_start) + 1 + (val_end - val_start)
+
+            # Raise an exception that we will exceed the max size
+            # The exception has the value up until now if the caller
+            # wants to use the partially encoded value
+            if length + size > max_size:
+                raise TagsetMaxSizeEncodeError(values, max_size, PyUnicode_FromStringAndSize(buf, length))
+
+            if length > 0:
+                buf[length] = 44
+                length += 1
+            memcpy(buf + length, key_start, key_end - key_start)
+            length += key_end - key_start
+            buf[length] = 61
+            length += 1
+            memcpy(buf + length, val_start, val_end - val_start)
+            length += val_end - val_start
+
+        result = PyUnicode_FromStringAndSize(buf, length)
+        if cacheable:
+            _cache_add(_encode_cache, len(values), max_size, PyDict_Copy(values), result)
+        return result
+    finally:
+        if buf != small:
+            PyMem_Free(buf)
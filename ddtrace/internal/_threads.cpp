@@ -5,11 +5,26 @@
 
 #include <stddef.h>
 
+#include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <condition_variable>
 #include <memory>
 #include <mutex>
 #include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <errno.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#endif
 
 // ----------------------------------------------------------------------------
 /**
@@ -52,7 +67,7 @@ class AllowThreads
     }
 
   private:
-    PyThreadState* _state;
+    PyThreadState* _state = NULL;
 };
 
 // ----------------------------------------------------------------------------
@@ -71,6 +86,118 @@ class PyRef
 };
 
 // ----------------------------------------------------------------------------
+#ifdef __linux__
+/**
+ * Event waited on with a futex on its flag, so that setting an event nobody
+ * waits on is a single atomic operation, and waiting on one that is already
+ * set, or about to be, doesn't go through the kernel either.
+ *
+ * Waits without a timeout, which are the round trips of the callers of the
+ * periodic threads, first spin for a little while, since the other side is
+ * often about to answer. Timed waits are those of the periodic threads for
+ * their next run, which are not worth spinning for.
+ */
+class Event
+{
+  public:
+    void set()
+    {
+        // Both this and the registration of the waiters are sequentially
+        // consistent, so that either the waiter sees the flag, or this sees
+        // the waiter.
+        if (_set.exchange(1) == 0 && _waiters.load() > 0)
+            futex(FUTEX_WAKE_PRIVATE, INT_MAX, NULL);
+    }
+
+    void wait()
+    {
+        if (spin())
+            return;
+
+        block(NULL);
+    }
+
+    bool wait(std::chrono::milliseconds timeout)
+    {
+        return wait(std::chrono::steady_clock::now() + timeout);
+    }
+
+    bool wait(std::chrono::steady_clock::time_point deadline)
+    {
+        if (is_set())
+            return true;
+
+        // FUTEX_WAIT_BITSET takes an absolute time on CLOCK_MONOTONIC, which is
+        // that of the steady clock
+        auto since_epoch = deadline.time_since_epoch();
+        if (since_epoch.count() < 0)
+            since_epoch = since_epoch.zero();
+
+        auto seconds = std::chrono::duration_cast<std::chrono::seconds>(since_epoch);
+        struct timespec abs_timeout;
+        abs_timeout.tv_sec = (time_t)seconds.count();
+        abs_timeout.tv_nsec = (long)std::chrono::duration_cast<std::chrono::nanoseconds>(since_epoch - seconds).count();
+
+        return block(&abs_timeout);
+    }
+
+    void clear() { _set.store(0, std::memory_order_relaxed); }
+
+  private:
+    // Number of attempts to see the event set before blocking
+    static constexpr int SPIN_COUNT = 1000;
+
+    inline bool is_set() { return _set.load(std::memory_order_acquire) != 0; }
+
+    long futex(int op, uint32_t value, const struct timespec* abs_timeout)
+    {
+        static_assert(sizeof(_set) == sizeof(uint32_t), "futexes are 32-bit");
+
+        return syscall(
+          SYS_futex, reinterpret_cast<uint32_t*>(&_set), op, value, abs_timeout, NULL, FUTEX_BITSET_MATCH_ANY);
+    }
+
+    bool spin()
+    {
+        // Nobody else could set the event while we spin on a single CPU
+        static const bool multi_cpu = std::thread::hardware_concurrency() > 1;
+
+        if (multi_cpu) {
+            for (int i = 0; i < SPIN_COUNT; i++) {
+                if (is_set())
+                    return true;
+#if defined(__x86_64__) || defined(__i386__)
+                __builtin_ia32_pause();
+#elif defined(__aarch64__)
+                asm volatile("yield");
+#endif
+            }
+        }
+
+        return is_set();
+    }
+
+    // Returns false if the absolute timeout, if any, expired first
+    bool block(const struct timespec* abs_timeout)
+    {
+        bool set = true;
+
+        _waiters.fetch_add(1);
+        while (_set.load() == 0) {
+            if (futex(FUTEX_WAIT_BITSET_PRIVATE, 0, abs_timeout) < 0 && errno == ETIMEDOUT) {
+                set = is_set();
+                break;
+            }
+        }
+        _waiters.fetch_sub(1);
+
+        return set;
+    }
+
+    std::atomic<uint32_t> _set{ 0 };
+    std::atomic<uint32_t> _waiters{ 0 };
+};
+#else
 class Event
 {
   public:
@@ -93,6 +220,12 @@ class Event
         return _cond.wait_for(lock, timeout, [this]() { return _set; });
     }
 
+    bool wait(std::chrono::steady_clock::time_point deadline)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        return _cond.wait_until(lock, deadline, [this]() { return _set; });
+    }
+
     void clear()
     {
         std::lock_guard<std::mutex> lock(_mutex);
@@ -104,6 +237,86 @@ class Event
     std::mutex _mutex;
     bool _set = false;
 };
+#endif
+
+// ----------------------------------------------------------------------------
+/**
+ * Let the kernel delay the timers of the current thread by up to the given
+ * slack, so that their expiries can be coalesced with other wakeups. A slack
+ * of zero restores the default one.
+ */
+static inline void
+set_timer_slack(std::chrono::nanoseconds slack)
+{
+#ifdef __linux__
+    prctl(PR_SET_TIMERSLACK, (unsigned long)slack.count(), 0, 0, 0);
+#else
+    (void)slack;
+#endif
+}
+
+// ----------------------------------------------------------------------------
+/**
+ * Where the periodic threads run, as set by set_thread_placement(). This only
+ * applies to the threads started afterwards.
+ */
+#ifdef __linux__
+#define MAX_PLACEMENT_CPUS CPU_SETSIZE
+#else
+#define MAX_PLACEMENT_CPUS 1024
+#endif
+
+static std::mutex _placement_mutex;
+static std::vector<int> _placement_cpus;
+static bool _placement_idle = false;
+
+/**
+ * Move the current thread to the CPUs and scheduling policy of the placement.
+ * The thread keeps running as it is if that fails, e.g. because the CPUs are
+ * not allowed by its cgroup.
+ */
+static inline void
+apply_thread_placement()
+{
+#ifdef __linux__
+    std::vector<int> cpus;
+    bool idle;
+    {
+        std::lock_guard<std::mutex> lock(_placement_mutex);
+        cpus = _placement_cpus;
+        idle = _placement_idle;
+    }
+
+    if (!cpus.empty()) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu : cpus)
+            CPU_SET(cpu, &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+
+    if (idle) {
+        sched_param param = {};
+        pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+    }
+#endif
+}
+
+// ----------------------------------------------------------------------------
+/**
+ * Native target of a periodic thread, called without the GIL with the context
+ * of its capsule. Returns a non-zero value on error, which stops the thread
+ * like an exception raised by a Python target.
+ *
+ * Native targets are passed as capsules named NATIVE_TARGET_CAPSULE holding
+ * a pointer to the function, and the argument of the function as context.
+ */
+typedef int (*PeriodicThreadNativeTarget)(void* context);
+
+#define NATIVE_TARGET_CAPSULE "ddtrace.internal._threads.native_target"
+
+// ----------------------------------------------------------------------------
+typedef struct periodic_scheduler PeriodicScheduler;
 
 // ----------------------------------------------------------------------------
 typedef struct periodic_thread
@@ -111,17 +324,23 @@ typedef struct periodic_thread
     PyObject_HEAD
 
       double interval;
+    double tolerance;
     PyObject* name;
     PyObject* ident;
 
     PyObject* _target;
     PyObject* _on_shutdown;
 
+    PeriodicThreadNativeTarget _native_target;
+    void* _native_context;
+
     PyObject* _ddtrace_profiling_ignore;
 
     bool _stopping;
     bool _atexit;
     bool _after_fork;
+    // Started while starts were deferred, and not launched yet
+    bool _deferred;
 
     std::unique_ptr<Event> _started;
     std::unique_ptr<Event> _stopped;
@@ -131,8 +350,64 @@ typedef struct periodic_thread
     std::unique_ptr<std::mutex> _awake_mutex;
 
     std::unique_ptr<std::thread> _thread;
+
+    // Shared periodic threads run on the thread of the scheduler instead of
+    // their own. Their scheduling state is guarded by the mutex of the
+    // scheduler.
+    bool _shared;
+    PeriodicScheduler* _scheduler;
+    std::chrono::steady_clock::time_point _deadline;
+    bool _awake_pending;
 } PeriodicThread;
 
+// ----------------------------------------------------------------------------
+/**
+ * Native thread running the targets of the shared periodic threads.
+ *
+ * The targets are called one after the other, each one once its interval has
+ * elapsed since its previous call returned, so a slow target delays the
+ * others. The scheduler is created by the first shared periodic thread that
+ * starts and runs until exit.
+ */
+struct periodic_scheduler
+{
+    PyObject_HEAD
+
+      PyObject* name;
+    PyObject* ident;
+
+    PyObject* _ddtrace_profiling_ignore;
+
+    bool _stopping;
+    bool _after_fork;
+
+    std::unique_ptr<Event> _started;
+    std::unique_ptr<Event> _stopped;
+
+    std::unique_ptr<std::mutex> _mutex;
+    std::unique_ptr<std::condition_variable> _cond;
+
+    // The scheduled periodic threads, each one holding a reference to itself
+    std::unique_ptr<std::vector<PeriodicThread*>> _tasks;
+    // The periodic thread whose target is running, and the timer slack of the
+    // thread, only used by the thread of the scheduler
+    PeriodicThread* _current;
+    std::chrono::nanoseconds _slack;
+
+    std::unique_ptr<std::thread> _thread;
+    std::thread::id _thread_id;
+};
+
+static PeriodicScheduler* _scheduler = NULL;
+
+// ----------------------------------------------------------------------------
+// While the after-fork hooks of a child process restart the periodic services,
+// the threads they start are only launched once all of the hooks have run, all
+// together, and then waited for at once rather than one after the other. The
+// deferred threads hold a reference to themselves until they are launched.
+static bool _deferring_starts = false;
+static std::vector<PeriodicThread*>* _deferred_starts = NULL;
+
 // ----------------------------------------------------------------------------
 // Maintain a mapping of thread ID to PeriodicThread objects. This is similar
 // to threading._active.
@@ -141,6 +416,7 @@ static PyObject* _periodic_threads = NULL;
 // ----------------------------------------------------------------------------
 static PyMemberDef PeriodicThread_members[] = {
     { "interval", T_DOUBLE, offsetof(PeriodicThread, interval), 0, "thread interval" },
+    { "tolerance", T_DOUBLE, offsetof(PeriodicThread, tolerance), 0, "thread wakeup tolerance" },
 
     { "name", T_OBJECT_EX, offsetof(PeriodicThread, name), 0, "thread name" },
     { "ident", T_OBJECT_EX, offsetof(PeriodicThread, ident), 0, "thread ID" },
@@ -154,23 +430,63 @@ static PyMemberDef PeriodicThread_members[] = {
     { NULL } /* Sentinel */
 };
 
+// ----------------------------------------------------------------------------
+static PyMemberDef PeriodicScheduler_members[] = {
+    { "name", T_OBJECT_EX, offsetof(PeriodicScheduler, name), READONLY, "thread name" },
+    { "ident", T_OBJECT_EX, offsetof(PeriodicScheduler, ident), READONLY, "thread ID" },
+
+    { "_ddtrace_profiling_ignore",
+      T_OBJECT_EX,
+      offsetof(PeriodicScheduler, _ddtrace_profiling_ignore),
+      0,
+      "whether to ignore the thread for profiling" },
+
+    { NULL } /* Sentinel */
+};
+
 // ----------------------------------------------------------------------------
 static int
 PeriodicThread_init(PeriodicThread* self, PyObject* args, PyObject* kwargs)
 {
-    static const char* kwlist[] = { "interval", "target", "name", "on_shutdown", NULL };
+    static const char* kwlist[] = { "interval", "target", "name", "on_shutdown", "shared", "tolerance", NULL };
 
     self->name = Py_None;
     self->_on_shutdown = Py_None;
-
-    if (!PyArg_ParseTupleAndKeywords(
-          args, kwargs, "dO|OO", (char**)kwlist, &self->interval, &self->_target, &self->name, &self->_on_shutdown))
+    self->tolerance = 0.0;
+
+    int shared = 0;
+
+    if (!PyArg_ParseTupleAndKeywords(args,
+                                     kwargs,
+                                     "dO|OOpd",
+                                     (char**)kwlist,
+                                     &self->interval,
+                                     &self->_target,
+                                     &self->name,
+                                     &self->_on_shutdown,
+                                     &shared,
+                                     &self->tolerance))
         return -1;
 
     Py_INCREF(self->_target);
     Py_INCREF(self->name);
     Py_INCREF(self->_on_shutdown);
 
+    self->_native_target = NULL;
+    self->_native_context = NULL;
+
+    if (PyCapsule_CheckExact(self->_target)) {
+        void* target = PyCapsule_GetPointer(self->_target, NATIVE_TARGET_CAPSULE);
+        if (target == NULL)
+            return -1;
+
+        self->_native_context = PyCapsule_GetContext(self->_target);
+        if (self->_native_context == NULL && PyErr_Occurred())
+            return -1;
+
+        self->_native_target = reinterpret_cast<PeriodicThreadNativeTarget>(target);
+    }
+
     Py_INCREF(Py_None);
     self->ident = Py_None;
 
@@ -180,6 +496,7 @@ PeriodicThread_init(PeriodicThread* self, PyObject* args, PyObject* kwargs)
     self->_stopping = false;
     self->_atexit = false;
     self->_after_fork = false;
+    self->_deferred = false;
 
     self->_started = std::make_unique<Event>();
     self->_stopped = std::make_unique<Event>();
@@ -188,9 +505,57 @@ PeriodicThread_init(PeriodicThread* self, PyObject* args, PyObject* kwargs)
 
     self->_awake_mutex = std::make_unique<std::mutex>();
 
+    self->_shared = shared;
+    self->_scheduler = NULL;
+    self->_awake_pending = false;
+
     return 0;
 }
 
+// ----------------------------------------------------------------------------
+static inline bool
+PeriodicThread__started(PeriodicThread* self)
+{
+    return self->_thread != nullptr || self->_scheduler != NULL || self->_deferred;
+}
+
+// ----------------------------------------------------------------------------
+static inline std::chrono::milliseconds
+PeriodicThread__interval(PeriodicThread* self)
+{
+    return std::chrono::milliseconds((long long)(self->interval * 1000));
+}
+
+// ----------------------------------------------------------------------------
+// The periodic thread may run up to this long after its interval has elapsed,
+// which is capped to a fraction of the interval to keep its rate.
+static inline std::chrono::nanoseconds
+PeriodicThread__tolerance(PeriodicThread* self)
+{
+    double tolerance = std::min(self->tolerance, self->interval * 0.1);
+
+    return std::chrono::nanoseconds(tolerance > 0.0 ? (long long)(tolerance * 1e9) : 0);
+}
+
+// ----------------------------------------------------------------------------
+// The deadline of the next run of the periodic thread, when its interval has
+// elapsed from now. With a tolerance, it is rounded up to the next multiple of
+// the tolerance on the monotonic clock, so that the periodic threads wake up
+// together rather than each at its own time.
+static inline std::chrono::steady_clock::time_point
+PeriodicThread__next_deadline(PeriodicThread* self)
+{
+    auto deadline = std::chrono::steady_clock::now() + PeriodicThread__interval(self);
+    auto tolerance = std::chrono::duration_cast<std::chrono::steady_clock::duration>(PeriodicThread__tolerance(self));
+
+    if (tolerance.count() > 0) {
+        auto ticks = (deadline.time_since_epoch() + tolerance - std::chrono::steady_clock::duration(1)) / tolerance;
+        deadline = std::chrono::steady_clock::time_point(ticks * tolerance);
+    }
+
+    return deadline;
+}
+
 // ----------------------------------------------------------------------------
 static inline bool
 PeriodicThread__periodic(PeriodicThread* self)
@@ -206,6 +571,15 @@ PeriodicThread__periodic(PeriodicThread* self)
     return result == NULL;
 }
 
+// ----------------------------------------------------------------------------
+// Call the native target of the periodic thread, without the GIL. Returns
+// true on error.
+static inline bool
+PeriodicThread__periodic_native(PeriodicThread* self)
+{
+    return self->_native_target(self->_native_context) != 0;
+}
+
 // ----------------------------------------------------------------------------
 static inline void
 PeriodicThread__on_shutdown(PeriodicThread* self)
@@ -219,11 +593,335 @@ PeriodicThread__on_shutdown(PeriodicThread* self)
     Py_XDECREF(result);
 }
 
+// ----------------------------------------------------------------------------
+// Wait for the next periodic thread to run, which is either stopping or due.
+// Returns NULL once the scheduler has stopped all of them.
+static PeriodicThread*
+PeriodicScheduler__next(PeriodicScheduler* self, std::unique_lock<std::mutex>& lock)
+{
+    while (true) {
+        auto now = std::chrono::steady_clock::now();
+        PeriodicThread* next = NULL;
+        auto slack = std::chrono::nanoseconds::max();
+
+        for (auto task : *self->_tasks) {
+            auto tolerance = PeriodicThread__tolerance(task);
+
+            // The periodic threads due within their tolerance run in the same
+            // wakeup as the one that is due.
+            if (task->_stopping || task->_deadline - tolerance <= now) {
+                // Serve any awake request from this point
+                task->_awake_pending = false;
+                task->_served->set();
+                return task;
+            }
+
+            if (next == NULL || task->_deadline < next->_deadline)
+                next = task;
+            slack = std::min(slack, tolerance);
+        }
+
+        if (next == NULL) {
+            if (self->_stopping)
+                return NULL;
+
+            self->_cond->wait(lock);
+            continue;
+        }
+
+        // The thread may wake up as late as the least tolerant periodic thread
+        // allows.
+        if (slack != self->_slack) {
+            set_timer_slack(slack);
+            self->_slack = slack;
+        }
+
+        self->_cond->wait_until(lock, next->_deadline);
+    }
+}
+
+// ----------------------------------------------------------------------------
+// Schedule the next run of a periodic thread whose target has returned. The
+// mutex of the scheduler must be held.
+static inline void
+PeriodicScheduler__reschedule(PeriodicThread* task)
+{
+    // An awake request made while the target was running has already made the
+    // periodic thread due again.
+    if (!task->_awake_pending)
+        task->_deadline = PeriodicThread__next_deadline(task);
+}
+
+// ----------------------------------------------------------------------------
+static void
+PeriodicScheduler__finish(PeriodicScheduler* self, PeriodicThread* task, bool error)
+{
+    {
+        std::lock_guard<std::mutex> lock(*self->_mutex);
+
+        self->_tasks->erase(std::find(self->_tasks->begin(), self->_tasks->end(), task));
+    }
+
+    // Same as the end of the thread of a periodic thread that is not shared
+    if (!task->_atexit && !error && task->_on_shutdown != Py_None && !_Py_IsFinalizing())
+        PeriodicThread__on_shutdown(task);
+
+    self->_current = NULL;
+
+    // Release the awake requests made since the periodic thread was picked
+    task->_served->set();
+    task->_stopped->set();
+
+    Py_DECREF(task);
+}
+
+// ----------------------------------------------------------------------------
+static void
+PeriodicScheduler__run(PeriodicScheduler* self)
+{
+    GILGuard _gil;
+
+    PyRef _((PyObject*)self);
+
+    self->_thread_id = std::this_thread::get_id();
+    apply_thread_placement();
+
+    // Retrieve the thread ID
+    {
+        Py_DECREF(self->ident);
+        self->ident = PyLong_FromLong((long)PyThreadState_Get()->thread_id);
+
+        // Map the scheduler to its thread ID, like the periodic threads
+        PyDict_SetItem(_periodic_threads, self->ident, (PyObject*)self);
+    }
+
+    self->_started->set();
+
+    while (true) {
+        PeriodicThread* task = NULL;
+        bool error = false;
+
+        {
+            AllowThreads _;
+            std::unique_lock<std::mutex> lock(*self->_mutex);
+
+            // Native targets run without the GIL, which is only taken back for
+            // the Python targets and for stopping periodic threads.
+            while (true) {
+                task = PeriodicScheduler__next(self, lock);
+                if (task == NULL || task->_stopping || task->_native_target == NULL)
+                    break;
+
+                lock.unlock();
+
+                self->_current = task;
+                error = PeriodicThread__periodic_native(task);
+                self->_current = NULL;
+
+                lock.lock();
+
+                if (error)
+                    break;
+
+                PeriodicScheduler__reschedule(task);
+            }
+        }
+
+        if (task == NULL || _Py_IsFinalizing())
+            break;
+
+        self->_current = task;
+
+        if (error) {
+            PeriodicScheduler__finish(self, task, true);
+            continue;
+        }
+
+        if (task->_stopping) {
+            PeriodicScheduler__finish(self, task, false);
+            continue;
+        }
+
+        if (PeriodicThread__periodic(task)) {
+            // Error
+            PeriodicScheduler__finish(self, task, true);
+            continue;
+        }
+
+        self->_current = NULL;
+
+        {
+            std::lock_guard<std::mutex> lock(*self->_mutex);
+
+            PeriodicScheduler__reschedule(task);
+        }
+    }
+
+    // Notify the exit handler that the scheduler has stopped
+    self->_stopped->set();
+}
+
+// ----------------------------------------------------------------------------
+static PyObject*
+PeriodicScheduler__atexit(PeriodicScheduler* self, PyObject* args)
+{
+    // Stop all the shared periodic threads without running their shutdown
+    // callbacks, like the periodic threads that are not shared.
+    {
+        std::lock_guard<std::mutex> lock(*self->_mutex);
+
+        for (auto task : *self->_tasks) {
+            task->_atexit = true;
+            task->_stopping = true;
+        }
+        self->_stopping = true;
+        self->_cond->notify_all();
+    }
+
+    if (self->_after_fork || self->_thread_id == std::this_thread::get_id())
+        Py_RETURN_NONE;
+
+    {
+        AllowThreads _;
+
+        self->_stopped->wait();
+    }
+
+    Py_RETURN_NONE;
+}
+
+// ----------------------------------------------------------------------------
+static PyObject*
+PeriodicScheduler__after_fork(PeriodicScheduler* self, PyObject* args)
+{
+    self->_after_fork = true;
+
+    // The thread of the scheduler is gone, and it might have been holding the
+    // mutex at the time of the fork, so the state is not touched beyond
+    // marking the periodic threads. The references held by the thread are
+    // leaked with it, and the periodic threads started from now on get a new
+    // scheduler.
+    for (auto task : *self->_tasks)
+        task->_after_fork = true;
+
+    if (_scheduler == self)
+        _scheduler = NULL;
+
+    Py_RETURN_NONE;
+}
+
+// ----------------------------------------------------------------------------
+static PyMethodDef PeriodicScheduler_methods[] = {
+    /* Private */
+    { "_atexit", (PyCFunction)PeriodicScheduler__atexit, METH_NOARGS, "Stop the scheduler at exit" },
+    { "_after_fork", (PyCFunction)PeriodicScheduler__after_fork, METH_NOARGS, "Mark the scheduler as after fork" },
+    { NULL } /* Sentinel */
+};
+
+// ----------------------------------------------------------------------------
+static PyTypeObject PeriodicSchedulerType = {
+    .ob_base = PyVarObject_HEAD_INIT(NULL, 0).tp_name = "ddtrace.internal._threads.PeriodicScheduler",
+    .tp_basicsize = sizeof(PeriodicScheduler),
+    .tp_itemsize = 0,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_doc = PyDoc_STR("Native thread calling the targets of the shared periodic threads"),
+    .tp_methods = PeriodicScheduler_methods,
+    .tp_members = PeriodicScheduler_members,
+};
+
+// ----------------------------------------------------------------------------
+// Get the scheduler of the shared periodic threads, starting it if needed.
+static PeriodicScheduler*
+PeriodicScheduler__get()
+{
+    if (_scheduler == NULL) {
+        PeriodicScheduler* self = (PeriodicScheduler*)PyType_GenericNew(&PeriodicSchedulerType, NULL, NULL);
+        if (self == NULL)
+            return NULL;
+
+        self->name = PyUnicode_FromString("ddtrace.internal._threads:PeriodicScheduler");
+        if (self->name == NULL) {
+            Py_DECREF(self);
+            return NULL;
+        }
+
+        Py_INCREF(Py_None);
+        self->ident = Py_None;
+
+        Py_INCREF(Py_True);
+        self->_ddtrace_profiling_ignore = Py_True;
+
+        self->_stopping = false;
+        self->_after_fork = false;
+
+        self->_started = std::make_unique<Event>();
+        self->_stopped = std::make_unique<Event>();
+
+        self->_mutex = std::make_unique<std::mutex>();
+        self->_cond = std::make_unique<std::condition_variable>();
+
+        self->_tasks = std::make_unique<std::vector<PeriodicThread*>>();
+        self->_current = NULL;
+
+        // The module keeps the reference returned by PyType_GenericNew
+        _scheduler = self;
+
+        self->_thread = std::make_unique<std::thread>([self]() { PeriodicScheduler__run(self); });
+        self->_thread->detach();
+    }
+
+    // Wait for the scheduler to start, so that its thread ID is known
+    {
+        AllowThreads _;
+
+        _scheduler->_started->wait();
+    }
+
+    return _scheduler;
+}
+
+// ----------------------------------------------------------------------------
+static PyObject*
+PeriodicThread__start_shared(PeriodicThread* self)
+{
+    PeriodicScheduler* scheduler = PeriodicScheduler__get();
+    if (scheduler == NULL)
+        return NULL;
+
+    Py_INCREF(scheduler);
+    self->_scheduler = scheduler;
+
+    // The target is called from the thread of the scheduler
+    Py_DECREF(self->ident);
+    Py_INCREF(scheduler->ident);
+    self->ident = scheduler->ident;
+
+    std::lock_guard<std::mutex> lock(*scheduler->_mutex);
+
+    if (scheduler->_stopping) {
+        // We are at exit and the scheduler no longer runs anything
+        self->_stopped->set();
+        Py_RETURN_NONE;
+    }
+
+    // The scheduler holds a reference while the periodic thread is scheduled
+    Py_INCREF(self);
+    self->_deadline = PeriodicThread__next_deadline(self);
+    scheduler->_tasks->push_back(self);
+    scheduler->_cond->notify_all();
+
+    Py_RETURN_NONE;
+}
+
+// ----------------------------------------------------------------------------
+static void
+PeriodicThread__launch(PeriodicThread* self);
+
 // ----------------------------------------------------------------------------
 static PyObject*
 PeriodicThread_start(PeriodicThread* self, PyObject* args)
 {
-    if (self->_thread != nullptr) {
+    if (PeriodicThread__started(self)) {
         PyErr_SetString(PyExc_RuntimeError, "Thread already started");
         return NULL;
     }
@@ -231,7 +929,49 @@ PeriodicThread_start(PeriodicThread* self, PyObject* args)
     if (self->_stopping)
         Py_RETURN_NONE;
 
-    // Start the thread
+    if (self->_shared)
+        return PeriodicThread__start_shared(self);
+
+    if (_deferring_starts) {
+        Py_INCREF(self);
+        self->_deferred = true;
+        _deferred_starts->push_back(self);
+
+        Py_RETURN_NONE;
+    }
+
+    PeriodicThread__launch(self);
+
+    // Wait for the thread to start
+    {
+        AllowThreads _;
+
+        self->_started->wait();
+    }
+
+    Py_RETURN_NONE;
+}
+
+// ----------------------------------------------------------------------------
+// Launch a deferred periodic thread ahead of the others, without waiting for
+// it to start.
+static void
+PeriodicThread__launch_deferred(PeriodicThread* self)
+{
+    auto it = std::find(_deferred_starts->begin(), _deferred_starts->end(), self);
+    if (it != _deferred_starts->end())
+        _deferred_starts->erase(it);
+
+    self->_deferred = false;
+    PeriodicThread__launch(self);
+
+    Py_DECREF(self);
+}
+
+// ----------------------------------------------------------------------------
+static void
+PeriodicThread__launch(PeriodicThread* self)
+{
     self->_thread = std::make_unique<std::thread>([self]() {
         GILGuard _gil;
 
@@ -249,14 +989,42 @@ PeriodicThread_start(PeriodicThread* self, PyObject* args)
         // Mark the thread as started from this point.
         self->_started->set();
 
+        apply_thread_placement();
+
+        auto tolerance = PeriodicThread__tolerance(self);
+        if (tolerance.count() > 0)
+            set_timer_slack(tolerance);
+
         bool error = false;
-        auto interval = std::chrono::milliseconds((long long)(self->interval * 1000));
 
-        while (!self->_stopping) {
+        if (self->_native_target != NULL) {
+            // The native target runs without the GIL for the whole life of
+            // the thread.
+            AllowThreads _;
+
+            while (!self->_stopping) {
+                if (self->_request->wait(PeriodicThread__next_deadline(self))) {
+                    if (self->_stopping)
+                        break;
+
+                    // Awake signal
+                    self->_request->clear();
+                    self->_served->set();
+                }
+
+                if (PeriodicThread__periodic_native(self)) {
+                    // Error
+                    error = true;
+                    break;
+                }
+            }
+        }
+
+        while (!self->_stopping && self->_native_target == NULL) {
             {
                 AllowThreads _;
 
-                if (self->_request->wait(interval)) {
+                if (self->_request->wait(PeriodicThread__next_deadline(self))) {
                     if (self->_stopping)
                         break;
 
@@ -287,26 +1055,56 @@ PeriodicThread_start(PeriodicThread* self, PyObject* args)
 
     // Detach the thread. We will make our own joinable mechanism.
     self->_thread->detach();
-
-    // Wait for the thread to start
-    {
-        AllowThreads _;
-
-        self->_started->wait();
-    }
-
-    Py_RETURN_NONE;
 }
 
 // ----------------------------------------------------------------------------
 static PyObject*
 PeriodicThread_awake(PeriodicThread* self, PyObject* args)
 {
-    if (self->_thread == nullptr) {
+    if (!PeriodicThread__started(self)) {
         PyErr_SetString(PyExc_RuntimeError, "Thread not started");
         return NULL;
     }
 
+    if (self->_shared) {
+        PeriodicScheduler* scheduler = self->_scheduler;
+
+        // The scheduler cannot serve the request while it is running the
+        // target that makes it.
+        bool wait = scheduler->_thread_id != std::this_thread::get_id();
+
+        AllowThreads _;
+        std::lock_guard<std::mutex> awake_lock(*self->_awake_mutex);
+
+        self->_served->clear();
+        {
+            std::lock_guard<std::mutex> lock(*scheduler->_mutex);
+
+            auto tasks = scheduler->_tasks.get();
+            if (std::find(tasks->begin(), tasks->end(), self) == tasks->end()) {
+                // The periodic thread has stopped
+                wait = false;
+            } else {
+                self->_awake_pending = true;
+                self->_deadline = std::chrono::steady_clock::now();
+                scheduler->_cond->notify_all();
+            }
+        }
+
+        if (wait)
+            self->_served->wait();
+
+        Py_RETURN_NONE;
+    }
+
+    if (self->_deferred) {
+        // The thread serves the request as soon as it is launched, which is
+        // not until the caller is done
+        self->_request->set();
+
+        Py_RETURN_NONE;
+    }
+
     {
         AllowThreads _;
         std::lock_guard<std::mutex> lock(*self->_awake_mutex);
@@ -323,11 +1121,20 @@ PeriodicThread_awake(PeriodicThread* self, PyObject* args)
 static PyObject*
 PeriodicThread_stop(PeriodicThread* self, PyObject* args)
 {
-    if (self->_thread == nullptr) {
+    if (!PeriodicThread__started(self)) {
         PyErr_SetString(PyExc_RuntimeError, "Thread not started");
         return NULL;
     }
 
+    if (self->_shared) {
+        std::lock_guard<std::mutex> lock(*self->_scheduler->_mutex);
+
+        self->_stopping = true;
+        self->_scheduler->_cond->notify_all();
+
+        Py_RETURN_NONE;
+    }
+
     self->_stopping = true;
     self->_request->set();
 
@@ -338,12 +1145,23 @@ PeriodicThread_stop(PeriodicThread* self, PyObject* args)
 static PyObject*
 PeriodicThread_join(PeriodicThread* self, PyObject* args, PyObject* kwargs)
 {
-    if (self->_thread == nullptr) {
+    if (!PeriodicThread__started(self)) {
         PyErr_SetString(PyExc_RuntimeError, "Periodic thread not started");
         return NULL;
     }
 
-    if (self->_thread->get_id() == std::this_thread::get_id()) {
+    if (self->_shared && self->_scheduler->_thread_id == std::this_thread::get_id()) {
+        if (self->_scheduler->_current == self) {
+            PyErr_SetString(PyExc_RuntimeError, "Cannot join the current periodic thread");
+            return NULL;
+        }
+
+        // The scheduler stops the periodic thread once the running target
+        // returns, so there is nothing to wait for here.
+        Py_RETURN_NONE;
+    }
+
+    if (self->_thread != nullptr && self->_thread->get_id() == std::this_thread::get_id()) {
         PyErr_SetString(PyExc_RuntimeError, "Cannot join the current periodic thread");
         return NULL;
     }
@@ -353,6 +1171,10 @@ PeriodicThread_join(PeriodicThread* self, PyObject* args, PyObject* kwargs)
         Py_RETURN_NONE;
     }
 
+    // There would be nothing to stop the thread otherwise
+    if (self->_deferred)
+        PeriodicThread__launch_deferred(self);
+
     PyObject* timeout = Py_None;
 
     if (args != NULL && kwargs != NULL) {
@@ -428,8 +1250,10 @@ PeriodicThread_dealloc(PeriodicThread* self)
     if (self->_thread != NULL && self->_thread->get_id() == std::this_thread::get_id())
         return;
 
-    // Unmap the PeriodicThread
-    if (self->ident != NULL && PyDict_Contains(_periodic_threads, self->ident))
+    // Unmap the PeriodicThread, unless its thread ID has been reused by another
+    // thread since. Shared ones have the thread ID of the scheduler, which stays
+    // mapped to it.
+    if (self->ident != NULL && PyDict_GetItem(_periodic_threads, self->ident) == (PyObject*)self)
         PyDict_DelItem(_periodic_threads, self->ident);
 
     Py_XDECREF(self->name);
@@ -439,6 +1263,8 @@ PeriodicThread_dealloc(PeriodicThread* self)
     Py_XDECREF(self->ident);
     Py_XDECREF(self->_ddtrace_profiling_ignore);
 
+    Py_XDECREF(self->_scheduler);
+
     self->_thread = nullptr;
 
     self->_started = nullptr;
@@ -477,8 +1303,104 @@ static PyTypeObject PeriodicThreadType = {
     .tp_new = PyType_GenericNew,
 };
 
+// ----------------------------------------------------------------------------
+static PyObject*
+_threads_set_thread_placement(PyObject* Py_UNUSED(module), PyObject* args, PyObject* kwargs)
+{
+    static const char* kwlist[] = { "cpus", "idle", NULL };
+    PyObject* cpus_obj = Py_None;
+    int idle = 0;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|Op", (char**)kwlist, &cpus_obj, &idle))
+        return NULL;
+
+    std::vector<int> cpus;
+    if (cpus_obj != Py_None) {
+        PyObject* seq = PySequence_Fast(cpus_obj, "cpus must be a sequence of integers");
+        if (seq == NULL)
+            return NULL;
+
+        for (Py_ssize_t i = 0; i < PySequence_Fast_GET_SIZE(seq); i++) {
+            long cpu = PyLong_AsLong(PySequence_Fast_GET_ITEM(seq, i));
+            if (cpu == -1 && PyErr_Occurred()) {
+                Py_DECREF(seq);
+                return NULL;
+            }
+            if (cpu < 0 || cpu >= MAX_PLACEMENT_CPUS) {
+                PyErr_Format(PyExc_ValueError, "invalid CPU %ld", cpu);
+                Py_DECREF(seq);
+                return NULL;
+            }
+            cpus.push_back((int)cpu);
+        }
+
+        Py_DECREF(seq);
+    }
+
+    std::lock_guard<std::mutex> lock(_placement_mutex);
+    _placement_cpus = std::move(cpus);
+    _placement_idle = idle;
+
+    Py_RETURN_NONE;
+}
+
+// ----------------------------------------------------------------------------
+static PyObject*
+_threads_begin_deferred_starts(PyObject* Py_UNUSED(module), PyObject* Py_UNUSED(args))
+{
+    if (_deferred_starts == NULL)
+        _deferred_starts = new std::vector<PeriodicThread*>();
+
+    _deferring_starts = true;
+
+    Py_RETURN_NONE;
+}
+
+// ----------------------------------------------------------------------------
+static PyObject*
+_threads_end_deferred_starts(PyObject* Py_UNUSED(module), PyObject* Py_UNUSED(args))
+{
+    if (!_deferring_starts)
+        Py_RETURN_NONE;
+
+    _deferring_starts = false;
+
+    std::vector<PeriodicThread*> deferred;
+    deferred.swap(*_deferred_starts);
+
+    for (auto thread : deferred) {
+        thread->_deferred = false;
+        PeriodicThread__launch(thread);
+    }
+
+    // The threads start concurrently, so this only waits for the slowest one
+    {
+        AllowThreads _;
+
+        for (auto thread : deferred)
+            thread->_started->wait();
+    }
+
+    for (auto thread : deferred)
+        Py_DECREF(thread);
+
+    Py_RETURN_NONE;
+}
+
 // ----------------------------------------------------------------------------
 static PyMethodDef _threads_methods[] = {
+    { "set_thread_placement",
+      (PyCFunction)_threads_set_thread_placement,
+      METH_VARARGS | METH_KEYWORDS,
+      "Set the CPUs and the scheduling policy of the periodic threads started from now on" },
+    { "begin_deferred_starts",
+      (PyCFunction)_threads_begin_deferred_starts,
+      METH_NOARGS,
+      "Defer launching the periodic threads started from now on until end_deferred_starts is called" },
+    { "end_deferred_starts",
+      (PyCFunction)_threads_end_deferred_starts,
+      METH_NOARGS,
+      "Launch the deferred periodic threads together, and wait for all of them to start" },
     { NULL, NULL, 0, NULL } /* Sentinel */
 };
 
@@ -501,6 +1423,9 @@ PyInit__threads(void)
     if (PyType_Ready(&PeriodicThreadType) < 0)
         return NULL;
 
+    if (PyType_Ready(&PeriodicSchedulerType) < 0)
+        return NULL;
+
     _periodic_threads = PyDict_New();
     if (_periodic_threads == NULL)
         return NULL;
@@ -515,6 +1440,15 @@ PyInit__threads(void)
         goto error;
     }
 
+    Py_INCREF(&PeriodicSchedulerType);
+    if (PyModule_AddObject(m, "PeriodicScheduler", (PyObject*)&PeriodicSchedulerType) < 0) {
+        Py_DECREF(&PeriodicSchedulerType);
+        goto error;
+    }
+
+    if (PyModule_AddStringConstant(m, "NATIVE_TARGET_CAPSULE", NATIVE_TARGET_CAPSULE) < 0)
+        goto error;
+
     if (PyModule_AddObject(m, "periodic_threads", _periodic_threads) < 0)
         goto error;
 
@@ -3,13 +3,19 @@ import typing as t
 class PeriodicThread:
     name: str
     ident: int
+    interval: float
+    tolerance: float
 
     def __init__(
         self,
         interval: float,
-        target: t.Callable,
+        # Or a capsule named NATIVE_TARGET_CAPSULE holding an int (*)(void*)
+        # function, which is called without the GIL.
+        target: t.Union[t.Callable, t.Any],
         name: t.Optional[str] = None,
         on_shutdown: t.Optional[t.Callable] = None,
+        shared: bool = False,
+        tolerance: float = 0.0,
     ) -> None: ...
     def start(self) -> None: ...
     def stop(self) -> None: ...
@@ -18,4 +24,17 @@ class PeriodicThread:
     def _atexit(self) -> None: ...
     def _after_fork(self) -> None: ...
 
-periodic_threads: t.Dict[int, PeriodicThread]
+class PeriodicScheduler:
+    name: str
+    ident: int
+
+    def _atexit(self) -> None: ...
+    def _after_fork(self) -> None: ...
+
+def set_thread_placement(cpus: t.Optional[t.Sequence[int]] = None, idle: bool = False) -> None: ...
+def begin_deferred_starts() -> None: ...
+def end_deferred_starts() -> None: ...
+
+NATIVE_TARGET_CAPSULE: str
+
+periodic_threads: t.Dict[int, t.Union[PeriodicThread, PeriodicScheduler]]
@@ -1,5 +1,8 @@
 #define PY_SSIZE_T_CLEAN
 #include <Python.h>
+#include <structmember.h>
+
+#include <string.h>
 
 #if PY_VERSION_HEX < 0x030c0000
 #if defined __GNUC__ && defined HAVE_STD_ATOMIC
@@ -31,6 +34,449 @@ replace_in_tuple(PyObject* m, PyObject* args)
     Py_RETURN_NONE;
 }
 
+// ----------------------------------------------------------------------------
+// Line collector
+//
+// Every instrumented code object gets a slot with two bitmaps of the lines it
+// spans, indexed by the offset of the line from the first one: one for the
+// lines covered while the collector is started and one for the lines covered
+// in the current context (e.g. a test). The instrumentation hook receives the
+// slot and the line packed into a single int, so recording a hit is a couple
+// of bit operations. Switching context bumps an epoch instead of clearing the
+// context bitmaps, which are cleared lazily on their first hit in the new
+// context.
+//
+// On Python 3.12+ the collector can also be the sys.monitoring LINE callback
+// of the code objects registered with it. The callback disables the event of
+// every line after its first hit, so that the lines only cost a callback once
+// until the events are restarted, e.g. on context switch.
+// ----------------------------------------------------------------------------
+#define LINE_BITS 32
+#define LINE_MASK ((1ULL << LINE_BITS) - 1)
+
+typedef struct
+{
+    PyObject* path;
+    long first_line;
+    size_t n_bytes;
+    unsigned char* covered;     // n_bytes bits for the lines covered while started
+    unsigned char* ctx_covered; // n_bytes bits for the lines covered in the context
+    unsigned long long ctx_epoch;
+} code_lines_t;
+
+typedef struct
+{
+    PyObject_HEAD code_lines_t* slots;
+    PyObject* codes; // code object -> key of its slot, for the monitoring callback
+    size_t n_slots;
+    size_t size;
+    int started;
+    int ctx_started;
+    unsigned long long ctx_epoch;
+} LineCollector;
+
+// ----------------------------------------------------------------------------
+static int
+code_lines__resize(code_lines_t* code_lines, long first_line, long last_line)
+{
+    size_t n_bytes = (size_t)(last_line - first_line) / 8 + 1;
+    size_t shift = (size_t)(code_lines->first_line - first_line);
+    unsigned char* bits = PyMem_Calloc(2 * n_bytes, 1);
+
+    if (bits == NULL)
+        return -1;
+
+    if (code_lines->covered != NULL) {
+        // Only ever called to add whole bytes of lines before the current first line
+        memcpy(bits + shift / 8, code_lines->covered, code_lines->n_bytes);
+        memcpy(bits + n_bytes + shift / 8, code_lines->ctx_covered, code_lines->n_bytes);
+        PyMem_Free(code_lines->covered);
+    }
+
+    code_lines->first_line = first_line;
+    code_lines->n_bytes = n_bytes;
+    code_lines->covered = bits;
+    code_lines->ctx_covered = bits + n_bytes;
+
+    return 0;
+}
+
+// ----------------------------------------------------------------------------
+// Grow the bitmaps of a slot to cover a line it was not registered with
+static int
+code_lines__extend(code_lines_t* code_lines, long line)
+{
+    long first_line = code_lines->first_line;
+    long last_line = first_line + (long)code_lines->n_bytes * 8 - 1;
+
+    if (line < first_line)
+        // Keep the offsets of the current lines byte-aligned
+        first_line -= ((first_line - line + 7) / 8) * 8;
+    else
+        last_line = line;
+
+    return code_lines__resize(code_lines, first_line, last_line);
+}
+
+// ----------------------------------------------------------------------------
+static void
+LineCollector_dealloc(LineCollector* self)
+{
+    for (size_t i = 0; i < self->n_slots; i++) {
+        Py_DECREF(self->slots[i].path);
+        PyMem_Free(self->slots[i].covered);
+    }
+    PyMem_Free(self->slots);
+    Py_XDECREF(self->codes);
+
+    Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+// ----------------------------------------------------------------------------
+static PyObject*
+LineCollector_register(LineCollector* self, PyObject* args, PyObject* kwargs)
+{
+    static char* kwlist[] = { "path", "first_line", "last_line", "code", NULL };
+    PyObject* path = NULL;
+    long first_line = 0, last_line = 0;
+    PyObject* code = Py_None;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "Ull|O", kwlist, &path, &first_line, &last_line, &code))
+        return NULL;
+
+    if (last_line < first_line) {
+        PyErr_SetString(PyExc_ValueError, "last line is before the first line");
+        return NULL;
+    }
+
+    if (self->n_slots == self->size) {
+        size_t size = self->size ? self->size * 2 : 64;
+        code_lines_t* slots = PyMem_Realloc(self->slots, size * sizeof(code_lines_t));
+        if (slots == NULL)
+            return PyErr_NoMemory();
+        self->slots = slots;
+        self->size = size;
+    }
+
+    code_lines_t* code_lines = &self->slots[self->n_slots];
+    memset(code_lines, 0, sizeof(code_lines_t));
+    code_lines->first_line = first_line;
+    if (code_lines__resize(code_lines, first_line, last_line) < 0)
+        return PyErr_NoMemory();
+    code_lines->ctx_epoch = self->ctx_epoch;
+
+    PyObject* key = PyLong_FromUnsignedLongLong((unsigned long long)self->n_slots << LINE_BITS);
+    if (key == NULL)
+        goto error;
+
+    if (code != Py_None) {
+        if (self->codes == NULL && (self->codes = PyDict_New()) == NULL)
+            goto error;
+        if (PyDict_SetItem(self->codes, code, key) < 0)
+            goto error;
+    }
+
+    Py_INCREF(path);
+    code_lines->path = path;
+    self->n_slots++;
+
+    return key;
+
+error:
+    Py_XDECREF(key);
+    PyMem_Free(code_lines->covered);
+    return NULL;
+}
+
+// ----------------------------------------------------------------------------
+static int
+LineCollector__mark(LineCollector* self, unsigned long long key)
+{
+    size_t slot = (size_t)(key >> LINE_BITS);
+    if (slot >= self->n_slots) {
+        PyErr_SetString(PyExc_ValueError, "unknown code slot");
+        return -1;
+    }
+
+    code_lines_t* code_lines = &self->slots[slot];
+    long line = (long)(key & LINE_MASK);
+    if (line < code_lines->first_line || (size_t)(line - code_lines->first_line) >= code_lines->n_bytes * 8) {
+        if (code_lines__extend(code_lines, line) < 0) {
+            PyErr_NoMemory();
+            return -1;
+        }
+    }
+
+    size_t offset = (size_t)(line - code_lines->first_line);
+    unsigned char bit = (unsigned char)(1 << (offset & 7));
+
+    if (self->started)
+        code_lines->covered[offset >> 3] |= bit;
+
+    if (self->ctx_started) {
+        if (code_lines->ctx_epoch != self->ctx_epoch) {
+            memset(code_lines->ctx_covered, 0, code_lines->n_bytes);
+            code_lines->ctx_epoch = self->ctx_epoch;
+        }
+        code_lines->ctx_covered[offset >> 3] |= bit;
+    }
+
+    return 0;
+}
+
+// ----------------------------------------------------------------------------
+static PyObject*
+LineCollector_hit(LineCollector* self, PyObject* arg)
+{
+    if (!self->started && !self->ctx_started)
+        Py_RETURN_NONE;
+
+    unsigned long long key = PyLong_AsUnsignedLongLong(arg);
+    if (key == (unsigned long long)-1 && PyErr_Occurred())
+        return NULL;
+
+    if (LineCollector__mark(self, key) < 0)
+        return NULL;
+
+    Py_RETURN_NONE;
+}
+
+// ----------------------------------------------------------------------------
+// sys.monitoring.DISABLE, when available
+static PyObject* monitoring_disable = NULL;
+
+static PyObject*
+LineCollector__disable(void)
+{
+    if (monitoring_disable == NULL)
+        Py_RETURN_NONE;
+    Py_INCREF(monitoring_disable);
+    return monitoring_disable;
+}
+
+// ----------------------------------------------------------------------------
+static PyObject*
+LineCollector_line(LineCollector* self, PyObject* const* args, Py_ssize_t nargs)
+{
+    if (nargs != 2) {
+        PyErr_SetString(PyExc_TypeError, "line() takes exactly 2 arguments");
+        return NULL;
+    }
+
+    // The line is marked in the bitmaps of the collector when it is started,
+    // from then on until the events are restarted the callback is not needed
+    if (!self->started && !self->ctx_started)
+        return LineCollector__disable();
+
+    PyObject* key = self->codes != NULL ? PyDict_GetItemWithError(self->codes, args[0]) : NULL; // borrowed
+    if (key == NULL) {
+        if (PyErr_Occurred())
+            return NULL;
+        // Not a code object registered with this collector
+        return LineCollector__disable();
+    }
+
+    long line = PyLong_AsLong(args[1]);
+    if (line == -1 && PyErr_Occurred())
+        return NULL;
+
+    if (LineCollector__mark(self, PyLong_AsUnsignedLongLong(key) | (unsigned long long)line) < 0)
+        return NULL;
+
+    return LineCollector__disable();
+}
+
+// ----------------------------------------------------------------------------
+static PyObject*
+LineCollector_start(LineCollector* self, PyObject* Py_UNUSED(args))
+{
+    self->started = 1;
+    Py_RETURN_NONE;
+}
+
+// ----------------------------------------------------------------------------
+static PyObject*
+LineCollector_stop(LineCollector* self, PyObject* Py_UNUSED(args))
+{
+    self->started = 0;
+    Py_RETURN_NONE;
+}
+
+// ----------------------------------------------------------------------------
+static PyObject*
+LineCollector_switch_context(LineCollector* self, PyObject* Py_UNUSED(args))
+{
+    self->ctx_epoch++;
+    self->ctx_started = 1;
+    Py_RETURN_NONE;
+}
+
+// ----------------------------------------------------------------------------
+static PyObject*
+LineCollector_stop_context(LineCollector* self, PyObject* Py_UNUSED(args))
+{
+    self->ctx_started = 0;
+    Py_RETURN_NONE;
+}
+
+// ----------------------------------------------------------------------------
+static PyObject*
+LineCollector_covered(LineCollector* self, PyObject* args, PyObject* kwargs)
+{
+    static char* kwlist[] = { "context", NULL };
+    int context = 0;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|p", kwlist, &context))
+        return NULL;
+
+    PyObject* result = PyDict_New();
+    if (result == NULL)
+        return NULL;
+
+    for (size_t i = 0; i < self->n_slots; i++) {
+        code_lines_t* code_lines = &self->slots[i];
+        unsigned char* bits = code_lines->covered;
+
+        if (context) {
+            if (code_lines->ctx_epoch != self->ctx_epoch)
+                // Nothing covered in the current context
+                continue;
+            bits = code_lines->ctx_covered;
+        }
+
+        PyObject* lines = NULL;
+        for (size_t b = 0; b < code_lines->n_bytes; b++) {
+            unsigned char byte = bits[b];
+            for (int bit = 0; byte; bit++, byte >>= 1) {
+                if (!(byte & 1))
+                    continue;
+
+                if (lines == NULL) {
+                    lines = PyDict_GetItem(result, code_lines->path); // borrowed
+                    if (lines == NULL) {
+                        lines = PySet_New(NULL);
+                        if (lines == NULL || PyDict_SetItem(result, code_lines->path, lines) < 0) {
+                            Py_XDECREF(lines);
+                            goto error;
+                        }
+                        Py_DECREF(lines); // the result owns it
+                    }
+                }
+
+                PyObject* line = PyLong_FromLong(code_lines->first_line + (long)(b * 8 + bit));
+                if (line == NULL || PySet_Add(lines, line) < 0) {
+                    Py_XDECREF(line);
+                    goto error;
+                }
+                Py_DECREF(line);
+            }
+        }
+    }
+
+    // Export every path with the sorted list of its covered lines
+    PyObject *path, *lines;
+    Py_ssize_t pos = 0;
+    while (PyDict_Next(result, &pos, &path, &lines)) {
+        PyObject* sorted = PySequence_List(lines);
+        if (sorted == NULL || PyList_Sort(sorted) < 0) {
+            Py_XDECREF(sorted);
+            goto error;
+        }
+        // Replacing the value of an existing key does not change the dict size
+        if (PyDict_SetItem(result, path, sorted) < 0) {
+            Py_DECREF(sorted);
+            goto error;
+        }
+        Py_DECREF(sorted);
+    }
+
+    return result;
+
+error:
+    Py_DECREF(result);
+    return NULL;
+}
+
+// ----------------------------------------------------------------------------
+static PyMethodDef LineCollector_methods[] = {
+    { "register",
+      (PyCFunction)(void (*)(void))LineCollector_register,
+      METH_VARARGS | METH_KEYWORDS,
+      "Register the path and the range of lines of a code object and return the key of its first hook argument." },
+    { "hit", (PyCFunction)LineCollector_hit, METH_O, "Record the hit of the line of a code object." },
+    { "line",
+      (PyCFunction)(void (*)(void))LineCollector_line,
+      METH_FASTCALL,
+      "sys.monitoring LINE callback for the registered code objects." },
+    { "start", (PyCFunction)LineCollector_start, METH_NOARGS, "Start collecting the covered lines." },
+    { "stop", (PyCFunction)LineCollector_stop, METH_NOARGS, "Stop collecting the covered lines." },
+    { "switch_context",
+      (PyCFunction)LineCollector_switch_context,
+      METH_NOARGS,
+      "Start collecting the covered lines in a new context." },
+    { "stop_context",
+      (PyCFunction)LineCollector_stop_context,
+      METH_NOARGS,
+      "Stop collecting the covered lines in the current context." },
+    { "covered",
+      (PyCFunction)(void (*)(void))LineCollector_covered,
+      METH_VARARGS | METH_KEYWORDS,
+      "Export the sorted covered lines of every path, in the current context if requested." },
+    { NULL } /* Sentinel */
+};
+
+// ----------------------------------------------------------------------------
+static PyMemberDef LineCollector_members[] = {
+    { "started", T_INT, offsetof(LineCollector, started), READONLY, "Whether the collector is started." },
+    { "context_started",
+      T_INT,
+      offsetof(LineCollector, ctx_started),
+      READONLY,
+      "Whether the collector is collecting in a context." },
+    { NULL } /* Sentinel */
+};
+
+// ----------------------------------------------------------------------------
+static PyTypeObject LineCollectorType = {
+    PyVarObject_HEAD_INIT(NULL, 0) "ddtrace.internal.coverage._native.LineCollector", /* tp_name */
+    sizeof(LineCollector),                                                            /* tp_basicsize */
+    0,                                                                                /* tp_itemsize */
+    (destructor)LineCollector_dealloc,                                                /* tp_dealloc */
+    0,                                                                                /* tp_vectorcall_offset */
+    0,                                                                                /* tp_getattr */
+    0,                                                                                /* tp_setattr */
+    0,                                                                                /* tp_as_async */
+    0,                                                                                /* tp_repr */
+    0,                                                                                /* tp_as_number */
+    0,                                                                                /* tp_as_sequence */
+    0,                                                                                /* tp_as_mapping */
+    0,                                                                                /* tp_hash */
+    0,                                                                                /* tp_call */
+    0,                                                                                /* tp_str */
+    0,                                                                                /* tp_getattro */
+    0,                                                                                /* tp_setattro */
+    0,                                                                                /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT,                                                               /* tp_flags */
+    "Collector of the lines covered by instrumented code objects.",                  /* tp_doc */
+    0,                                                                                /* tp_traverse */
+    0,                                                                                /* tp_clear */
+    0,                                                                                /* tp_richcompare */
+    0,                                                                                /* tp_weaklistoffset */
+    0,                                                                                /* tp_iter */
+    0,                                                                                /* tp_iternext */
+    LineCollector_methods,                                                            /* tp_methods */
+    LineCollector_members,                                                            /* tp_members */
+    0,                                                                                /* tp_getset */
+    0,                                                                                /* tp_base */
+    0,                                                                                /* tp_dict */
+    0,                                                                                /* tp_descr_get */
+    0,                                                                                /* tp_descr_set */
+    0,                                                                                /* tp_dictoffset */
+    0,                                                                                /* tp_init */
+    0,                                                                                /* tp_alloc */
+    PyType_GenericNew,                                                                /* tp_new */
+};
+
 // ----------------------------------------------------------------------------
 static PyMethodDef native_methods[] = {
     { "replace_in_tuple", replace_in_tuple, METH_VARARGS, "Replace an item in a tuple." },
@@ -57,5 +503,23 @@ PyInit__native(void)
     if (m == NULL)
         return NULL;
 
+#if PY_VERSION_HEX >= 0x030c0000
+    PyObject* monitoring = PySys_GetObject("monitoring"); // borrowed
+    if (monitoring != NULL && (monitoring_disable = PyObject_GetAttrString(monitoring, "DISABLE")) == NULL)
+        goto error;
+#endif
+
+    if (PyType_Ready(&LineCollectorType) < 0)
+        goto error;
+    Py_INCREF(&LineCollectorType);
+    if (PyModule_AddObject(m, "LineCollector", (PyObject*)&LineCollectorType) < 0) {
+        Py_DECREF(&LineCollectorType);
+        goto error;
+    }
+
     return m;
+
+error:
+    Py_DECREF(m);
+    return NULL;
 }
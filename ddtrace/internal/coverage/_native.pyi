@@ -1,3 +1,16 @@
+from types import CodeType
 import typing as t
 
 def replace_in_tuple(tup: tuple, item: t.Any, replacement: t.Any) -> None: ...
+
+class LineCollector:
+    started: int
+    context_started: int
+    def register(self, path: str, first_line: int, last_line: int, code: t.Optional[CodeType] = None) -> int: ...
+    def line(self, code: CodeType, line: int) -> t.Any: ...
+    def hit(self, key: int) -> None: ...
+    def start(self) -> None: ...
+    def stop(self) -> None: ...
+    def switch_context(self) -> None: ...
+    def stop_context(self) -> None: ...
+    def covered(self, context: bool = False) -> t.Dict[str, t.List[int]]: ...
@@ -1,24 +1,29 @@
 from collections import defaultdict
 from collections import deque
+from dis import findlinestarts
 import os
+import sys
 from types import CodeType
 from types import ModuleType
 import typing as t
 
+from ddtrace.internal.compat import PYTHON_VERSION_INFO
 from ddtrace.internal.compat import Path
+from ddtrace.internal.coverage._native import LineCollector
 from ddtrace.internal.coverage._native import replace_in_tuple
 from ddtrace.internal.coverage.instrumentation import instrument_all_lines
+from ddtrace.internal.coverage.instrumentation import monitor_all_lines
 from ddtrace.internal.coverage.report import get_json_report
 from ddtrace.internal.coverage.report import print_coverage_report
 from ddtrace.internal.coverage.util import collapse_ranges
+from ddtrace.internal.logger import get_logger
 from ddtrace.internal.module import BaseModuleWatchdog
-from ddtrace.vendor.contextvars import ContextVar
 
 
-_original_exec = exec
+log = get_logger(__name__)
+
 
-ctx_covered = ContextVar("ctx_covered", default=None)
-ctx_coverage_enabed = ContextVar("ctx_coverage_enabled", default=False)
+_original_exec = exec
 
 
 def collect_code_objects(code: CodeType) -> t.Iterator[t.Tuple[CodeType, t.Optional[CodeType]]]:
@@ -57,11 +62,27 @@ class ModuleCodeCollector(BaseModuleWatchdog):
     def __init__(self):
         super().__init__()
         self.seen = set()
-        self.coverage_enabled = False
         self.lines = defaultdict(set)
-        self.covered = defaultdict(set)
+        # The covered lines are recorded natively, the instrumented code calls
+        # its hit method directly
+        self._collector = LineCollector()
         self._include_paths: t.List[Path] = []
 
+        # On Python 3.12+ the lines are collected by the LINE events of
+        # sys.monitoring instead of injecting the hook into the code objects.
+        # The callback disables the event of every line after its first hit,
+        # and the events are restarted whenever the collection (re)starts.
+        self._monitoring_tool_id: t.Optional[int] = None
+        if PYTHON_VERSION_INFO >= (3, 12):
+            monitoring = sys.monitoring  # type: ignore[attr-defined]
+            try:
+                monitoring.use_tool_id(monitoring.COVERAGE_ID, "datadog")
+            except ValueError:
+                log.debug("sys.monitoring coverage tool already in use, injecting the coverage hook instead")
+            else:
+                self._monitoring_tool_id = monitoring.COVERAGE_ID
+                monitoring.register_callback(self._monitoring_tool_id, monitoring.events.LINE, self._collector.line)
+
         # Replace the built-in exec function with our own in the pytest globals
         try:
             import _pytest.assertion.rewrite as par
@@ -83,19 +104,6 @@ class ModuleCodeCollector(BaseModuleWatchdog):
         if cls._instance is not None:
             cls._instance._include_paths = include_paths
 
-    def hook(self, arg):
-        path, line = arg
-        if self.coverage_enabled:
-            lines = self.covered[path]
-            if line not in lines:
-                # This line has already been covered
-                lines.add(line)
-
-        if ctx_coverage_enabed.get():
-            ctx_lines = ctx_covered.get()[path]
-            if line not in ctx_lines:
-                ctx_lines.add(line)
-
     @classmethod
     def report(cls, workspace_path: Path, ignore_nocover: bool = False):
         if cls._instance is None:
@@ -120,37 +128,48 @@ class ModuleCodeCollector(BaseModuleWatchdog):
             f.write(get_json_report(executable_lines, covered_lines, workspace_path, ignore_nocover=ignore_nocover))
 
     def _get_covered_lines(self) -> t.Dict[str, t.Set[int]]:
-        if ctx_coverage_enabed.get(False):
-            return ctx_covered.get()
-        return self.covered
+        return defaultdict(set, {path: set(lines) for path, lines in self._get_sorted_covered_lines().items()})
+
+    def _get_sorted_covered_lines(self) -> t.Dict[str, t.List[int]]:
+        collector = self._collector
+        return collector.covered(context=collector.context_started)
+
+    def _restart_line_events(self) -> None:
+        if self._monitoring_tool_id is not None:
+            sys.monitoring.restart_events()  # type: ignore[attr-defined]
 
     class CollectInContext:
         def __enter__(self):
-            ctx_covered.set(defaultdict(set))
-            ctx_coverage_enabed.set(True)
+            instance = ModuleCodeCollector._instance
+            if instance is not None:
+                instance._collector.switch_context()
+                # The lines already hit are disabled, they need to be seen
+                # again in the new context
+                instance._restart_line_events()
 
         def __exit__(self, *args, **kwargs):
-            ctx_coverage_enabed.set(False)
+            if ModuleCodeCollector._instance is not None:
+                ModuleCodeCollector._instance._collector.stop_context()
 
     @classmethod
     def start_coverage(cls):
         if cls._instance is None:
             return
-        cls._instance.coverage_enabled = True
+        cls._instance._collector.start()
+        cls._instance._restart_line_events()
 
     @classmethod
     def stop_coverage(cls):
         if cls._instance is None:
             return
-        cls._instance.coverage_enabled = False
+        cls._instance._collector.stop()
 
     @classmethod
     def coverage_enabled(cls):
-        if ctx_coverage_enabed.get():
-            return True
         if cls._instance is None:
             return False
-        return cls._instance.coverage_enabled
+        collector = cls._instance._collector
+        return bool(collector.started or collector.context_started)
 
     @classmethod
     def report_seen_lines(cls):
@@ -171,10 +190,9 @@ class ModuleCodeCollector(BaseModuleWatchdog):
         if cls._instance is None:
             return []
         files = []
-        covered = cls._instance._get_covered_lines()
+        covered = cls._instance._get_sorted_covered_lines()
 
-        for path, lines in covered.items():
-            sorted_lines = sorted(lines)
+        for path, sorted_lines in covered.items():
             collapsed_ranges = collapse_ranges(sorted_lines)
             file_segments = []
             for file_segment in collapsed_ranges:
@@ -200,7 +218,7 @@ class ModuleCodeCollector(BaseModuleWatchdog):
 
             # If it has a parent, update the parent's co_consts to point to the
             # new code object.
-            if parent_code is not None:
+            if parent_code is not None and new_code is not nested_code:
                 replace_in_tuple(parent_code.co_consts, nested_code, new_code)
 
         return new_code
@@ -214,7 +232,19 @@ class ModuleCodeCollector(BaseModuleWatchdog):
             return code
         self.seen.add(code)
 
-        new_code, lines = instrument_all_lines(code, self.hook, code.co_filename)
+        # Size the bitmaps of the code object in the collector after the range
+        # of its lines. The collector grows them if the instrumentation finds
+        # lines outside of it.
+        line_numbers = [line for _, line in findlinestarts(code) if line is not None]
+        first_line = min(line_numbers, default=code.co_firstlineno)
+        last_line = max(line_numbers, default=code.co_firstlineno)
+
+        if self._monitoring_tool_id is not None:
+            self._collector.register(code.co_filename, first_line, last_line, code)
+            new_code, lines = code, monitor_all_lines(code, self._monitoring_tool_id)
+        else:
+            key = self._collector.register(code.co_filename, first_line, last_line)
+            new_code, lines = instrument_all_lines(code, self._collector.hit, key)
 
         # Keep note of all the lines that have been instrumented. These will be
         # the ones that can be covered.
@@ -245,4 +275,11 @@ class ModuleCodeCollector(BaseModuleWatchdog):
         except ImportError:
             pass
 
+        # Release the sys.monitoring tool
+        if cls._instance is not None and cls._instance._monitoring_tool_id is not None:
+            monitoring = sys.monitoring  # type: ignore[attr-defined]
+            monitoring.register_callback(cls._instance._monitoring_tool_id, monitoring.events.LINE, None)
+            monitoring.free_tool_id(cls._instance._monitoring_tool_id)
+            cls._instance._monitoring_tool_id = None
+
         return super().uninstall()
@@ -1,3 +1,4 @@
+import sys
 from types import CodeType
 import typing as t
 
@@ -5,9 +6,14 @@ from bytecode import Bytecode
 
 from ddtrace.internal.injection import INJECTION_ASSEMBLY
 from ddtrace.internal.injection import HookType
+from ddtrace.internal.injection import _injection
 
 
-def instrument_all_lines(code: CodeType, hook: HookType, path: str) -> t.Tuple[CodeType, t.Set[int]]:
+def instrument_all_lines(code: CodeType, hook: HookType, key: int) -> t.Tuple[CodeType, t.Set[int]]:
+    """Call the hook at the beginning of every line with the key of the code object and the line number"""
+    if _injection is not None:
+        return _injection.instrument_all_lines(code, hook, key)
+
     abstract_code = Bytecode.from_code(code)
 
     lines = set()
@@ -27,7 +33,7 @@ def instrument_all_lines(code: CodeType, hook: HookType, path: str) -> t.Tuple[C
                 continue
 
             # Inject the hook at the beginning of the line
-            abstract_code[i:i] = INJECTION_ASSEMBLY.bind(dict(hook=hook, arg=(path, last_lineno)), lineno=last_lineno)
+            abstract_code[i:i] = INJECTION_ASSEMBLY.bind(dict(hook=hook, arg=key | last_lineno), lineno=last_lineno)
 
             # Track the line number
             lines.add(last_lineno)
@@ -36,3 +42,39 @@ def instrument_all_lines(code: CodeType, hook: HookType, path: str) -> t.Tuple[C
             pass
 
     return abstract_code.to_code(), lines
+
+
+def monitor_all_lines(code: CodeType, tool_id: int) -> t.Set[int]:
+    """Enable the sys.monitoring LINE events of the code object for the tool (Python 3.12+)
+
+    The events fire on the same lines that instrument_all_lines would inject
+    the hook into.
+    """
+    if _injection is not None:
+        lines = _injection.instrumentable_lines(code)
+    else:
+        lines = set()
+
+        last_lineno = None
+        for instr in Bytecode.from_code(code):
+            try:
+                if instr.lineno is None:
+                    continue
+
+                if instr.lineno == last_lineno:
+                    continue
+
+                last_lineno = instr.lineno
+
+                if instr.name == "RESUME":
+                    continue
+
+                # Track the line number
+                lines.add(last_lineno)
+            except AttributeError:
+                # pseudo-instruction (e.g. label)
+                pass
+
+    sys.monitoring.set_local_events(tool_id, code, sys.monitoring.events.LINE)  # type: ignore[attr-defined]
+
+    return lines
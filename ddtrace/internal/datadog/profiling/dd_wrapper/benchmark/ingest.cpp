@@ -0,0 +1,64 @@
+#include "interface.hpp"
+#include "perf_counters.h"
+#include "test_utils.hpp"
+#include <benchmark/benchmark.h>
+
+#include <array>
+#include <string_view>
+
+// Measures the path taken by every sample: start, fill in, flush.  The frames come from a small, fixed set of
+// names, which is representative of a steady-state application where the string table is warm.
+
+namespace {
+
+constexpr std::array<std::string_view, 8> function_names = {
+    "handle_request", "dispatch", "render", "query", "serialize", "validate", "wrapper", "<module>",
+};
+constexpr std::array<std::string_view, 4> file_names = {
+    "app/views.py",
+    "app/models.py",
+    "lib/framework/core.py",
+    "lib/framework/middleware.py",
+};
+
+void
+setup_ingest(const benchmark::State&)
+{
+    // The url doesn't matter, since nothing is uploaded here
+    configure("bench_service", "bench_env", "0.0.1", "http://localhost:8126", "cpython", "3.12.0", "3.100", 512);
+}
+
+void
+BM_SampleLifecycle(benchmark::State& state)
+{
+    const auto nframes = static_cast<size_t>(state.range(0));
+    const int64_t thread_id = state.thread_index();
+    bench::PerfCountersScope perf_counters(state);
+    for (auto _ : state) {
+        auto* sample = ddup_start_sample();
+        ddup_push_walltime(sample, 10'000'000, 1);
+        ddup_push_cputime(sample, 1'000'000, 1);
+        ddup_push_threadinfo(sample, thread_id, thread_id, "MainThread");
+        for (size_t i = 0; i < nframes; i++) {
+            ddup_push_frame(sample,
+                            function_names[i % function_names.size()],
+                            file_names[i % file_names.size()],
+                            0,
+                            static_cast<int64_t>(i));
+        }
+        ddup_flush_sample(sample);
+        ddup_drop_sample(sample);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+} // namespace
+
+BENCHMARK(BM_SampleLifecycle)
+  ->Setup(setup_ingest)
+  ->Arg(1)
+  ->Arg(16)
+  ->Arg(64)
+  ->Arg(256)
+  ->ThreadRange(1, 8)
+  ->UseRealTime();
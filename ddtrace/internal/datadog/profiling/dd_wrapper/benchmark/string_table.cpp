@@ -0,0 +1,81 @@
+#include "perf_counters.h"
+#include "string_table.hpp"
+#include <benchmark/benchmark.h>
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Measures `insert_or_get()` with every thread hammering the same table, which is what happens when several
+// samplers run concurrently.
+
+namespace {
+
+std::unique_ptr<Datadog::StringTable> shared_table;
+
+std::vector<std::string>
+make_strings(size_t count, std::string_view prefix)
+{
+    std::vector<std::string> strings;
+    strings.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        strings.emplace_back(std::string(prefix) + "_function_name_" + std::to_string(i));
+    }
+    return strings;
+}
+
+void
+setup_table(const benchmark::State&)
+{
+    shared_table = std::make_unique<Datadog::StringTable>();
+}
+
+void
+teardown_table(const benchmark::State&)
+{
+    shared_table.reset();
+}
+
+// Strings which are already interned; this is the common case
+void
+BM_StringTableHit(benchmark::State& state)
+{
+    const auto strings = make_strings(1024, "hit");
+    for (const auto& str : strings) {
+        shared_table->insert_or_get(str);
+    }
+
+    size_t i = 0;
+    bench::PerfCountersScope perf_counters(state);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(shared_table->insert_or_get(strings[i++ % strings.size()]));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+// Strings which are new to the table, so every lookup inserts.  The iteration count is fixed, so that the table
+// stays well under its memory cap.
+void
+BM_StringTableMiss(benchmark::State& state)
+{
+    const std::string prefix = "miss" + std::to_string(state.thread_index());
+    const auto strings = make_strings(static_cast<size_t>(state.max_iterations), prefix);
+
+    size_t i = 0;
+    bench::PerfCountersScope perf_counters(state);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(shared_table->insert_or_get(strings[i++]));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+} // namespace
+
+BENCHMARK(BM_StringTableHit)->Setup(setup_table)->Teardown(teardown_table)->ThreadRange(1, 16)->UseRealTime();
+BENCHMARK(BM_StringTableMiss)
+  ->Setup(setup_table)
+  ->Teardown(teardown_table)
+  ->Iterations(20'000)
+  ->ThreadRange(1, 16)
+  ->UseRealTime();
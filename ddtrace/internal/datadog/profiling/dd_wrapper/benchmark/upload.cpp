@@ -0,0 +1,102 @@
+#include "interface.hpp"
+#include "perf_counters.h"
+#include "sample.hpp"
+#include "test_utils.hpp"
+#include "uploader_builder.hpp"
+#include <benchmark/benchmark.h>
+
+#include <cstdlib>
+#include <optional>
+#include <string>
+#include <utility>
+#include <variant>
+
+// Measures the cost of serializing (and optionally sending) a profile, depending on how many distinct samples it
+// holds.  Sending needs somewhere to send to, so it is only measured when DD_BENCH_UPLOAD_URL points to an agent
+// (or anything else which accepts profiles).
+
+namespace {
+
+void
+fill_profile(int64_t nsamples)
+{
+    for (int64_t i = 0; i < nsamples; i++) {
+        auto* sample = ddup_start_sample();
+        ddup_push_walltime(sample, 10'000'000, 1);
+        ddup_push_threadinfo(sample, i % 16, i % 16, "Worker");
+        ddup_push_frame(sample, "leaf", "app/leaf.py", 0, i);
+        ddup_push_frame(sample, "caller", "app/caller.py", 0, i % 100);
+        ddup_push_frame(sample, "<module>", "app/main.py", 0, 1);
+        ddup_flush_sample(sample);
+        ddup_drop_sample(sample);
+    }
+}
+
+std::optional<Datadog::Uploader>
+make_uploader(benchmark::State& state, const char* url)
+{
+    configure("bench_service", "bench_env", "0.0.1", url, "cpython", "3.12.0", "3.100", 512);
+    auto result = Datadog::UploaderBuilder::build();
+    if (std::holds_alternative<std::string>(result)) {
+        state.SkipWithError(std::get<std::string>(result).c_str());
+        return std::nullopt;
+    }
+    return std::move(std::get<Datadog::Uploader>(result));
+}
+
+void
+BM_Serialize(benchmark::State& state)
+{
+    auto uploader = make_uploader(state, "http://localhost:8126");
+    if (!uploader.has_value()) {
+        return;
+    }
+
+    bench::PerfCountersScope perf_counters(state);
+    for (auto _ : state) {
+        state.PauseTiming();
+        fill_profile(state.range(0));
+        Datadog::Sample::profile_clear_state();
+        state.ResumeTiming();
+
+        ddog_prof_EncodedProfile encoded{};
+        if (uploader->serialize(Datadog::Sample::profile_last_borrow(), encoded)) {
+            state.counters["bytes"] = static_cast<double>(encoded.buffer.len);
+            ddog_prof_EncodedProfile_drop(&encoded);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+void
+BM_Upload(benchmark::State& state)
+{
+    const char* url = std::getenv("DD_BENCH_UPLOAD_URL");
+    if (url == nullptr) {
+        state.SkipWithError("DD_BENCH_UPLOAD_URL is not set");
+        return;
+    }
+    auto uploader = make_uploader(state, url);
+    if (!uploader.has_value()) {
+        return;
+    }
+
+    bench::PerfCountersScope perf_counters(state);
+    for (auto _ : state) {
+        state.PauseTiming();
+        fill_profile(state.range(0));
+        Datadog::Sample::profile_clear_state();
+        state.ResumeTiming();
+
+        if (!uploader->upload(Datadog::Sample::profile_last_borrow())) {
+            state.SkipWithError("upload failed");
+            break;
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+} // namespace
+
+BENCHMARK(BM_Serialize)->RangeMultiplier(10)->Range(10, 100'000)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Upload)->RangeMultiplier(10)->Range(10, 100'000)->Unit(benchmark::kMillisecond)->Iterations(5);
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+
+extern "C"
+{
+#include "datadog/profiling.h"
+}
+
+namespace Datadog {
+
+// A profile of its own for a short, high-rate capture (a "burst"), typically requested during an incident.  The
+// samples of a burst are collected straight into this profile rather than into the double buffer of the Sample,
+// so the regular profile, and whatever is computed from it, is left exactly as it would have been.  When the burst
+// ends, the profile is handed to the UploadWorker, which uploads it (or writes it to the file sink) with the
+// `profile_mode:burst` tag.
+//
+// Samples are routed here by the thread which produces them: while a Scope is alive, every sample its thread
+// flushes goes to the burst.  There is at most one burst at a time.
+class BurstProfile
+{
+  private:
+    static inline std::mutex mtx{};
+    static inline bool active{ false }; // Guarded by mtx
+    static inline ddog_prof_Profile profile{};
+    static inline thread_local bool routing{ false };
+
+  public:
+    // Returns false if a burst is already running, or if ddup hasn't been started yet
+    static bool start();
+
+    // Ends the burst and schedules its profile for upload.  Returns false if no burst was running or if the
+    // profile could not be scheduled.
+    static bool finish();
+    static bool is_active();
+
+    static bool collect(const ddog_prof_Sample& sample, int64_t timestamp_ns);
+
+    class Scope
+    {
+      public:
+        Scope() { routing = true; }
+        ~Scope() { routing = false; }
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+    };
+    static bool routed() { return routing; }
+
+    static void prefork();
+    static void postfork_parent();
+    static void postfork_child();
+};
+
+} // namespace Datadog
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+extern "C"
+{
+#include "datadog/profiling.h"
+}
+
+namespace Datadog {
+
+enum class CompressionCodec
+{
+    lz4,
+    gzip,
+    zstd,
+};
+
+// Lets the encoded profiles be sent with another codec than the LZ4 frames libdatadog serializes them to.  LZ4 is
+// the cheapest on CPU, so it is the default, and the profile is then sent exactly as serialized.  Otherwise, the
+// upload thread decodes the LZ4 frame and compresses the pprof again with zlib or zstd, at the given level, which
+// trades CPU for bandwidth.  The codecs other than LZ4 are only available when dd_wrapper was built with them.
+//
+// Profiles which can't be recompressed are sent as they were serialized.
+class Compression
+{
+  private:
+    static inline std::mutex mtx{};
+    static inline CompressionCodec codec{ CompressionCodec::lz4 };
+    static inline int level{ 0 };
+
+    static bool gzip(const std::vector<uint8_t>& pprof, int level, std::vector<uint8_t>& out);
+    static bool zstd(const std::vector<uint8_t>& pprof, int level, std::vector<uint8_t>& out);
+
+  public:
+    // The codec is one of "lz4", "gzip" or "zstd"; a level of 0 is the default of the codec.  Returns false, and
+    // keeps LZ4, if the codec is unknown or wasn't built in.
+    static bool configure(std::string_view _codec, int _level);
+    static bool available(CompressionCodec _codec);
+
+    // Returns the profile as it should be sent: either `serialized` itself, or `out` holding it recompressed
+    static ddog_ByteSlice apply(ddog_ByteSlice serialized, std::vector<uint8_t>& out);
+
+    // Appends the content of an LZ4 frame (as written by libdatadog) to `out`
+    static bool lz4_frame_decode(ddog_ByteSlice frame, std::vector<uint8_t>& out);
+};
+
+} // namespace Datadog
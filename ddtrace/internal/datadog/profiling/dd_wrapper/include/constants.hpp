@@ -1,5 +1,8 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+
 // Default value for the max frames; this number will always be overridden by whatever the default
 // is for ddtrace/settings/profiling.py:ProfilingConfig.max_frames, but should conform
 constexpr unsigned int g_default_max_nframes = 64;
@@ -7,3 +10,60 @@ constexpr unsigned int g_default_max_nframes = 64;
 // Maximum number of frames admissible in the Profiling backend.  If a user exceeds this number, then
 // their stacks may be silently truncated, which is unfortunate.
 constexpr unsigned int g_backend_max_nframes = 512;
+
+// The string table keeps strings used during the last few profiles, up to a memory cap
+constexpr size_t g_default_string_table_generations = 2;
+constexpr size_t g_default_string_table_max_bytes = 32 * 1024 * 1024;
+
+// Number of idle Sample objects kept around for reuse.  Most samplers produce one sample at a time from a single
+// thread, so a small pool is enough to avoid allocations in the steady state.
+constexpr size_t g_default_sample_pool_capacity = 4;
+
+// Finished samples are staged per-thread before being added to the profile.  Once a thread has this many samples
+// staged, it tries to move them into the profile; if the profile is busy, it keeps staging until the buffer is full.
+constexpr size_t g_default_staging_capacity = 64;
+constexpr size_t g_default_staging_drain_threshold = 32;
+
+// Number of serialized profiles which may be waiting to be sent.  If the intake is slower than the upload interval,
+// the oldest one is discarded rather than letting the backlog grow.
+constexpr size_t g_default_upload_queue_depth = 2;
+
+// Upper bound on the disk space used by profiles which are spooled while the intake is unreachable
+constexpr uint64_t g_default_spool_max_bytes = 64 * 1024 * 1024;
+
+// The endpoint summary keeps the heaviest stacks of each endpoint over a sliding window.  The window is divided into
+// a few slots, the oldest of which is recycled as time moves on, and only so many endpoints are tracked at a time.
+constexpr size_t g_default_endpoint_summary_stacks = 16;
+constexpr int64_t g_default_endpoint_summary_window_ns = 60LL * 1000 * 1000 * 1000;
+constexpr size_t g_endpoint_summary_slots = 6;
+constexpr size_t g_endpoint_summary_max_endpoints = 256;
+
+// Profiles which are written to files rather than uploaded go to a ring of this many files per process, each of
+// which is bounded in size; a profile which doesn't fit is discarded.
+constexpr uint64_t g_default_file_sink_max_files = 16;
+constexpr uint64_t g_default_file_sink_max_bytes = 16 * 1024 * 1024;
+
+// Heap samples which are exported as deltas are kept alive natively, aggregated by stack, and re-added to every
+// profile.  Past this many distinct stacks, new ones are dropped until some of the old ones are freed.
+constexpr size_t g_heap_live_set_max_stacks = 64 * 1024;
+
+// The segment shared by the workers of a prefork server is sized by its number of distinct stacks, with room for
+// this many frames, bytes of frame strings and workers per stack, on average.  An uploader which hasn't uploaded for
+// a while is replaced by the next process which tries to upload.
+constexpr size_t g_shared_aggregation_frames_per_stack = 32;
+constexpr size_t g_shared_aggregation_string_bytes_per_stack = 256;
+constexpr size_t g_shared_aggregation_entries_per_stack = 4;
+constexpr size_t g_shared_aggregation_max_values = 16;
+constexpr int64_t g_shared_aggregation_stale_ns = 3LL * 60 * 1000 * 1000 * 1000;
+
+// Addresses outside of every known mapping rebuild the table of native mappings, in case an object was loaded since,
+// but only so often
+constexpr int64_t g_native_mappings_refresh_ns = 1000LL * 1000 * 1000;
+
+// Requests are counted per endpoint natively, in a table of counters which is registered into but never shrinks, so
+// that the index of an endpoint can be cached by the tracer.  Endpoints past this many aren't counted.
+constexpr size_t g_endpoint_counts_max_endpoints = 4096;
+
+// Samples without timestamps are aggregated by stack and labels before they are added to the profile, see
+// sample_aggregator.hpp.  Once this many distinct ones are pending, they are added to the profile early.
+constexpr size_t g_default_sample_aggregator_max_entries = 16 * 1024;
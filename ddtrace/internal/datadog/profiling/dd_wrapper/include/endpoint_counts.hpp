@@ -0,0 +1,59 @@
+#pragma once
+
+#include "constants.hpp"
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+extern "C"
+{
+#include "datadog/profiling.h"
+}
+
+namespace Datadog {
+
+// Counts the requests served by every endpoint (as given by the trace resource container label), which the backend
+// uses to normalize the endpoint profiles.  The counts are added to the profile when it is cycled out, so they cover
+// exactly the same period of time as its samples.
+//
+// An endpoint is registered once, under a lock, and is then counted by its index with a single atomic increment.
+// Registered endpoints are never forgotten, not even across forks, so their indices remain valid for as long as the
+// process lives.
+class EndpointCounts
+{
+  private:
+    static inline std::mutex mtx{};
+    static inline std::unordered_map<std::string_view, size_t> indices{};
+    static inline std::deque<std::string> names{}; // keeps the keys of `indices` alive
+    static inline std::atomic<size_t> size{ 0 };
+    static inline std::array<std::atomic<int64_t>, g_endpoint_counts_max_endpoints> counts{};
+
+  public:
+    static constexpr size_t invalid_index = SIZE_MAX;
+
+    // Returns the index of the endpoint, or `invalid_index` if there is no room left for it
+    static size_t intern(std::string_view endpoint);
+    static void add(size_t index, int64_t count = 1);
+
+    // The counts since the last time they were taken, which are reset.  Endpoints which weren't hit aren't given.
+    static std::vector<std::pair<std::string_view, int64_t>> take();
+
+    // Takes the counts and adds them to the profile
+    static void flush(ddog_prof_Profile& profile);
+
+    static void reset();
+    static void prefork();
+    static void postfork_parent();
+    static void postfork_child();
+};
+
+} // namespace Datadog
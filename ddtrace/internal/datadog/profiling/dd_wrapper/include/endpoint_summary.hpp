@@ -0,0 +1,93 @@
+#pragma once
+
+#include "constants.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+extern "C"
+{
+#include "datadog/profiling.h"
+}
+
+namespace Datadog {
+
+struct SummaryFrame
+{
+    std::string name;
+    std::string filename;
+    int64_t line;
+};
+
+// One of the heaviest stacks of an endpoint.  Stacks which are seen rarely may be evicted to make room for new
+// ones; a stack which takes the place of an evicted one inherits its count, and `error` bounds how much of
+// `samples` may have been inherited that way.
+struct SummaryStack
+{
+    std::vector<SummaryFrame> frames; // leaf first
+    uint64_t samples = 0;
+    uint64_t error = 0;
+    int64_t cpu_time_ns = 0;
+    int64_t wall_time_ns = 0;
+};
+
+// Keeps the heaviest stacks of every endpoint (as given by the trace resource container label) over a sliding
+// window, so they can be looked at from the process itself, without waiting for the profile to be uploaded.
+//
+// Every endpoint has a fixed number of stacks, which are maintained with the Space-Saving algorithm: a new stack
+// replaces the one with the fewest samples.  This bounds memory regardless of how many distinct stacks there are,
+// and guarantees that a stack which has more than 1/N of the samples of its endpoint is kept.  The window is
+// divided in g_endpoint_summary_slots slots, each with its own tables; queries merge the slots of the window.
+class EndpointSummary
+{
+  private:
+    struct Entry
+    {
+        uint64_t key;
+        SummaryStack stack;
+    };
+
+    struct Slot
+    {
+        int64_t index = -1; // of the period of time the slot holds, or -1 if it is empty
+        std::unordered_map<std::string, std::vector<Entry>> endpoints;
+    };
+
+    static inline std::mutex mtx{};
+    static inline std::atomic<bool> is_enabled{ false };
+    static inline size_t max_stacks{ g_default_endpoint_summary_stacks };
+    static inline int64_t slot_ns{ g_default_endpoint_summary_window_ns / g_endpoint_summary_slots };
+    static inline std::vector<Slot> slots{};
+
+    static uint64_t hash_stack(const ddog_prof_Location* locations, size_t num_locations);
+
+  public:
+    // A window of 0 uses the default
+    static void configure(size_t _max_stacks, int64_t window_ns);
+    static bool enabled();
+
+    // Accounts for one sample.  Times are taken from CLOCK_MONOTONIC, see Sample::monotonic_now_ns().
+    static void record(std::string_view endpoint,
+                       const ddog_prof_Location* locations,
+                       size_t num_locations,
+                       int64_t cpu_time_ns,
+                       int64_t wall_time_ns,
+                       int64_t now_ns);
+
+    // The endpoints which have samples in the window, and the heaviest stacks of one of them, heaviest first
+    static std::vector<std::string> endpoints(int64_t now_ns);
+    static std::vector<SummaryStack> top(std::string_view endpoint, int64_t now_ns);
+
+    static void reset();
+    static void prefork();
+    static void postfork_parent();
+    static void postfork_child();
+};
+
+} // namespace Datadog
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+extern "C"
+{
+#include "datadog/profiling.h"
+}
+
+namespace Datadog {
+
+// The live heap samples reported by the heap tracker in delta mode.  Rather than having the whole sampled heap
+// exported again for every profile, the tracker only reports the samples allocated and freed since its previous
+// export, and this keeps the result: the live samples by id, aggregated by stack (and labels).  Every profile gets
+// one heap sample per live stack when it is cycled, so the cost of the export scales with the churn of the heap
+// rather than with its size, and the cost of the profile with the number of distinct stacks.
+//
+// Strings are owned here, since the live samples outlast the string table generations.
+class HeapLiveSet
+{
+  private:
+    struct Frame
+    {
+        std::string name;
+        std::string filename;
+        uint64_t address;
+        int64_t line;
+    };
+
+    struct Label
+    {
+        std::string key;
+        std::string str;
+        int64_t num;
+    };
+
+    struct Stack
+    {
+        std::vector<Frame> frames;
+        std::vector<Label> labels;
+        int64_t size = 0;
+        uint64_t count = 0;
+    };
+
+    struct LiveSample
+    {
+        uint64_t stack_key;
+        int64_t size;
+    };
+
+    static inline std::mutex mtx{};
+    static inline std::unordered_map<uint64_t, Stack> stacks{};
+    static inline std::unordered_map<uint64_t, LiveSample> live{};
+    static inline int64_t live_bytes{ 0 };
+
+    static uint64_t hash_sample(const ddog_prof_Location* locations,
+                                size_t num_locations,
+                                const ddog_prof_Label* labels,
+                                size_t num_labels);
+    static bool same_sample(const Stack& stack,
+                            const ddog_prof_Location* locations,
+                            size_t num_locations,
+                            const ddog_prof_Label* labels,
+                            size_t num_labels);
+    static void update_stats();
+
+  public:
+    // Adds a live sample, unless its id is already live.  Returns false if it was dropped because there are too
+    // many distinct stacks.
+    static bool add(uint64_t id,
+                    const ddog_prof_Location* locations,
+                    size_t num_locations,
+                    const ddog_prof_Label* labels,
+                    size_t num_labels,
+                    int64_t size);
+
+    // Unknown ids, such as those of samples which were left out when they were added, are ignored
+    static void remove(uint64_t id);
+    static void clear();
+
+    // Pushes one heap sample per live stack into the current profile
+    static void flush();
+
+    static size_t num_samples();
+    static size_t num_stacks();
+    static int64_t num_bytes();
+
+    static void prefork();
+    static void postfork_parent();
+    static void postfork_child();
+};
+
+} // namespace Datadog
@@ -2,11 +2,14 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <string>
 #include <string_view>
+#include <vector>
 
 // Forward decl of the return pointer
 namespace Datadog {
 class Sample;
+struct SummaryStack;
 }
 
 #ifdef __cplusplus
@@ -21,6 +24,28 @@ extern "C"
     void ddup_config_profiler_version(std::string_view profiler_version);
     void ddup_config_url(std::string_view url);
     void ddup_config_max_nframes(int max_nframes);
+    void ddup_config_type_max_nframes(unsigned int type, int max_nframes); // type is a mask of SampleType
+    void ddup_config_sample_pool_capacity(uint64_t sample_pool_capacity);
+    void ddup_config_timeline(bool enabled);
+    void ddup_config_string_table_max_bytes(uint64_t max_bytes);
+    void ddup_config_spool(std::string_view dir, uint64_t max_bytes);
+    void ddup_config_output_pprof(std::string_view prefix, uint64_t max_files, uint64_t max_bytes);
+    bool ddup_config_compression(std::string_view codec, int level); // see compression.hpp
+    void ddup_config_endpoint_summary(uint64_t max_stacks, int64_t window_ns);
+    void ddup_config_shared_aggregation(std::string_view name, uint64_t max_stacks); // see shared_aggregation.hpp
+
+    // The endpoint summary, see endpoint_summary.hpp.  The results are appended to `out`.
+    void ddup_endpoint_summary_endpoints(std::vector<std::string>* out);
+    void ddup_endpoint_summary_top(std::string_view endpoint, std::vector<Datadog::SummaryStack>* out);
+
+    // The requests served by every endpoint, see endpoint_counts.hpp.  An endpoint is counted by the index it was
+    // interned at, which stays valid for the life of the process; endpoints which can't be interned aren't counted.
+    size_t ddup_endpoint_count_intern(std::string_view endpoint);
+    void ddup_endpoint_count_add(size_t index);
+
+    // Self-telemetry.  Stats are addressed by index, from 0 up to ddup_stats_size().
+    size_t ddup_stats_size();
+    bool ddup_stats_get(size_t index, std::string_view* name, uint64_t* value);
 
     void ddup_config_user_tag(std::string_view key, std::string_view val);
     void ddup_config_sample_type(unsigned int type);
@@ -38,6 +63,7 @@ extern "C"
     void ddup_push_release(Datadog::Sample* sample, int64_t release_time, int64_t count);
     void ddup_push_alloc(Datadog::Sample* sample, int64_t size, int64_t count);
     void ddup_push_heap(Datadog::Sample* sample, int64_t size);
+    void ddup_push_monotonic_ns(Datadog::Sample* sample, int64_t monotonic_ns);
     void ddup_push_lock_name(Datadog::Sample* sample, std::string_view lock_name);
     void ddup_push_threadinfo(Datadog::Sample* sample,
                               int64_t thread_id,
@@ -51,14 +77,21 @@ extern "C"
     void ddup_push_trace_resource_container(Datadog::Sample* sample, std::string_view trace_resource_container);
     void ddup_push_exceptioninfo(Datadog::Sample* sample, std::string_view exception_type, int64_t count);
     void ddup_push_class_name(Datadog::Sample* sample, std::string_view class_name);
+    void ddup_push_allocation_domain(Datadog::Sample* sample, std::string_view allocation_domain);
     void ddup_push_frame(Datadog::Sample* sample,
                          std::string_view _name,
                          std::string_view _filename,
                          uint64_t address,
                          int64_t line);
+    void ddup_push_native_frame(Datadog::Sample* sample, uint64_t address, std::string_view _name);
     void ddup_flush_sample(Datadog::Sample* sample);
     void ddup_drop_sample(Datadog::Sample* sample);
 
+    // The live heap samples exported as deltas, see heap_live_set.hpp
+    void ddup_heap_live_add(Datadog::Sample* sample, uint64_t id);
+    void ddup_heap_live_remove(uint64_t id);
+    void ddup_heap_live_clear();
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
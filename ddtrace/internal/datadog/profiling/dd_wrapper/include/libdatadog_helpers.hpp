@@ -27,7 +27,8 @@ namespace Datadog {
     X(runtime, "runtime")                                                                                              \
     X(runtime_id, "runtime-id")                                                                                        \
     X(profiler_version, "profiler_version")                                                                            \
-    X(profile_seq, "profile_seq")
+    X(profile_seq, "profile_seq")                                                                                      \
+    X(profile_mode, "profile_mode")
 
 // Here there are two columns because the Datadog backend expects these labels
 // to have spaces in the names.
@@ -44,7 +45,13 @@ namespace Datadog {
     X(trace_resource_container, "trace resource container")                                                            \
     X(trace_endpoint, "trace endpoint")                                                                                \
     X(class_name, "class name")                                                                                        \
-    X(lock_name, "lock name")
+    X(lock_name, "lock name")                                                                                          \
+    X(interpreter_id, "interpreter id")                                                                                \
+    X(process_id, "process id")                                                                                        \
+    X(gil_state, "gil state")                                                                                          \
+    X(thread_state, "thread state")                                                                                    \
+    X(off_cpu_reason, "off cpu reason")                                                                                \
+    X(allocation_domain, "allocation domain")
 
 #define X_ENUM(a, b) a,
 #define X_STR(a, b) b,
@@ -65,6 +72,12 @@ to_slice(std::string_view str)
     return { .ptr = str.data(), .len = str.size() };
 }
 
+inline std::string_view
+to_string_view(ddog_CharSlice slice)
+{
+    return { slice.ptr, slice.len };
+}
+
 inline std::string
 err_to_msg(const ddog_Error* err, std::string_view msg)
 {
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "constants.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+extern "C"
+{
+#include "datadog/profiling.h"
+}
+
+namespace Datadog {
+
+// The executable segments of the objects loaded in the process, with the build id of each object, so that native
+// frames can be exported as raw addresses and symbolized by the backend rather than in the process.
+//
+// The table is built from dl_iterate_phdr(), which walks the same objects as /proc/self/maps, but gives their
+// program headers (and with them the build id notes) straight from memory, without reading any file.  Objects
+// loaded after the table was built (e.g., with dlopen) are picked up when an address falls outside of every known
+// segment, at most once per refresh interval, and when the loader reports that objects have been added or removed
+// since.  Filenames and build ids are kept for the lifetime of the process; there are only as many as there are
+// objects.
+class NativeMappings
+{
+  private:
+    static inline std::mutex mtx{};
+    static inline std::vector<ddog_prof_Mapping> mappings{}; // Sorted by memory_start
+    static inline std::unordered_set<std::string> strings{};
+    static inline std::chrono::steady_clock::time_point last_refresh{};
+    static inline uint64_t loaded_adds = 0; // As reported by the loader when the table was built
+    static inline uint64_t loaded_subs = 0;
+
+    // Assume mtx is held
+    static std::string_view keep(std::string_view str);
+    static void build();
+    static bool changed();
+    static const ddog_prof_Mapping* find(uint64_t address);
+
+  public:
+    // Returns the mapping of the address, or an empty mapping if it isn't in a loaded object
+    static ddog_prof_Mapping lookup(uint64_t address);
+
+    // Rebuilds the table if objects were loaded or unloaded since it was built
+    static void refresh();
+
+    static void postfork_child();
+
+    // Only for tests
+    static size_t size();
+    static void reset();
+};
+
+} // namespace Datadog
@@ -1,15 +1,17 @@
 #pragma once
 
 #include "constants.hpp"
+#include "profiler_stats.hpp"
+#include "sample_aggregator.hpp"
+#include "staging_buffer.hpp"
+#include "string_table.hpp"
 #include "types.hpp"
 
 #include <atomic>
-#include <deque>
 #include <memory>
 #include <mutex>
 #include <string>
 #include <string_view>
-#include <unordered_set>
 #include <vector>
 
 extern "C"
@@ -19,10 +21,6 @@ extern "C"
 
 namespace Datadog {
 
-// Unordered containers don't get heterogeneous lookup until gcc-10, so for now use this
-// strategy to dedup + store strings.
-using StringTable = std::unordered_set<std::string_view>;
-
 // Serves to collect individual samples, as well as lengthen the scope of string data
 class Profile
 {
@@ -34,9 +32,22 @@ class Profile
     std::mutex profile_mtx{};
 
     // Storage for strings
-    std::deque<std::string> string_storage{};
     StringTable strings{};
-    std::mutex string_table_mtx{};
+
+    // Finished samples are staged in per-thread buffers, then added to the profile in batches.  The list of
+    // buffers has its own lock, since it is only modified when threads register or exit.
+    std::vector<std::shared_ptr<StagingBuffer>> staging_buffers{};
+    std::mutex staging_buffers_mtx{};
+    StagingBuffer& get_staging_buffer();
+    void drain_staging_buffers(); // Assumes profile_mtx is held
+    bool add_sample(const ddog_prof_Sample& sample, int64_t timestamp_ns); // Assumes profile_mtx is held
+
+    // Samples without timestamps are summed up here first, and only added to the profile when it is cycled or
+    // borrowed (or when there are too many of them).  Protected by profile_mtx.
+    SampleAggregator aggregator{ g_default_sample_aggregator_max_entries };
+    size_t distinct_samples = 0; // Drained from the aggregator since the last cycle
+    void drain_aggregator();     // Assumes profile_mtx is held
+    bool add_to_profile(const ddog_prof_Sample& sample, int64_t timestamp_ns); // Assumes profile_mtx is held
 
     // Configuration
     SampleType type_mask{ 0 };
@@ -62,6 +73,11 @@ class Profile
     void one_time_init(SampleType type, unsigned int _max_nframes);
     bool cycle_buffers();
     void reset();
+
+    // Everything but the samples themselves (string table, sample types) is kept in the child, which makes
+    // restarting the profiler after fork() cheap.  prefork() takes every lock so the child sees consistent state.
+    void prefork();
+    void postfork_parent();
     void postfork_child();
 
     // Getters
@@ -69,13 +85,23 @@ class Profile
     ddog_prof_Profile& profile_borrow();
     void profile_release();
 
+    // The stale half of the double buffer, as of the last `cycle_buffers()`.  This is not protected by the
+    // profile lock; the caller must ensure it isn't used concurrently with `cycle_buffers()`.
+    ddog_prof_Profile& last_profile_borrow();
+
+    // Initializes a profile of its own with the same sample types, for samples which don't belong to the double
+    // buffer (see BurstProfile).  Returns false if this profile wasn't initialized yet.
+    bool new_profile(ddog_prof_Profile& profile);
+
     // String table manipulation
     std::string_view insert_or_get(std::string_view str);
+    const StringTable& string_table();
+    void set_string_table_max_bytes(size_t max_bytes);
 
     // constref getters
     const ValueIndex& val();
 
-    // collect
-    bool collect(const ddog_prof_Sample& sample);
+    // collect.  A timestamp of 0 means the sample only contributes to the aggregate, which is more compact.
+    bool collect(const ddog_prof_Sample& sample, int64_t timestamp_ns);
 };
 } // namespace Datadog
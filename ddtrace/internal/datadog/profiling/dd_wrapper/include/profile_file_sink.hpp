@@ -0,0 +1,43 @@
+#pragma once
+
+#include "constants.hpp"
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+extern "C"
+{
+#include "datadog/profiling.h"
+}
+
+namespace Datadog {
+
+// Writes encoded profiles to local files instead of uploading them, for environments without an agent (load
+// tests, air-gapped hosts).  The files are named `<prefix>.<pid>.<n>`, like those of the legacy exporter, but `n`
+// wraps around after `max_files` files, so the disk space used by a process is bounded by `max_files` times
+// `max_bytes`.  Each file holds the profile exactly as it would have been uploaded.
+//
+// Profiles are written by the upload thread, never by the samplers.  Files are written to a temporary name and
+// then renamed into place, so a reader never sees a partial profile; nothing is fsync'd.
+class ProfileFileSink
+{
+  private:
+    static inline std::mutex mtx{};
+    static inline std::string prefix{};
+    static inline uint64_t max_files{ g_default_file_sink_max_files };
+    static inline uint64_t max_bytes{ g_default_file_sink_max_bytes };
+    static inline uint64_t seq{ 0 };
+
+  public:
+    // An empty prefix disables the sink
+    static void configure(std::string_view _prefix, uint64_t _max_files, uint64_t _max_bytes);
+    static bool enabled();
+
+    static bool write(ddog_ByteSlice data);
+
+    static void postfork_child();
+};
+
+} // namespace Datadog
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "constants.hpp"
+
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+extern "C"
+{
+#include "datadog/profiling.h"
+}
+
+namespace Datadog {
+
+// A profile which was read back from the spool.  Until it is released, the file is claimed by this process.
+struct SpooledProfile
+{
+    std::string path;
+    ddog_Timespec start{};
+    ddog_Timespec end{};
+    std::vector<uint8_t> data;
+};
+
+// Keeps encoded profiles which could not be sent (typically because the agent is restarting) in a directory on
+// disk, so they can be sent once the intake is reachable again.  The spool is bounded; when it is full, the oldest
+// profiles are discarded first.
+//
+// The encoded profiles are already compressed by libdatadog, so they are stored as-is.  Each one is written to a
+// temporary file which is then renamed into place, so a reader never sees a partial profile, even if the writer
+// crashes or another process shares the directory.
+class ProfileSpool
+{
+  private:
+    static inline std::mutex mtx{};
+    static inline std::string dir{};
+    static inline uint64_t max_bytes{ g_default_spool_max_bytes };
+    static inline uint64_t seq{ 0 };
+
+    // Spooled files, oldest first, along with their sizes.  Assumes mtx is held.
+    static std::vector<std::pair<std::string, uint64_t>> list();
+
+    // Discards the oldest files until `incoming` more bytes fit.  Assumes mtx is held.
+    static bool make_room(uint64_t incoming);
+
+  public:
+    // An empty directory disables the spool
+    static void configure(std::string_view _dir, uint64_t _max_bytes);
+    static bool enabled();
+
+    static bool store(const ddog_Timespec& start, const ddog_Timespec& end, ddog_ByteSlice data);
+
+    // Claims the oldest spooled profile, if there is one.  It must be handed back with `release()`: if it was sent,
+    // it is deleted, otherwise it is returned to the spool.
+    static std::optional<SpooledProfile> take();
+    static void release(const SpooledProfile& profile, bool sent);
+
+    static void postfork_child();
+};
+
+} // namespace Datadog
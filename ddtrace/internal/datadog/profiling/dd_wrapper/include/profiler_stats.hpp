@@ -0,0 +1,149 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace Datadog {
+
+// Self-telemetry for the profiler.  Everything here is a relaxed atomic, so it is cheap enough to update on the
+// hot paths; a Python-side reader only ever sees approximate, but monotonic, values.
+//
+// Counters are plain totals.  Gauges are overwritten with the latest value.  Timers accumulate a count, a total
+// and a maximum, from which an average can be derived.
+
+// clang-format off
+#define PROFILER_COUNTERS(X)                                                                                           \
+    X(samples_collected)                                                                                               \
+    X(samples_dropped)                                                                                                 \
+    X(samples_lost)                                                                                                    \
+    X(samples_collapsed)                                                                                               \
+    X(frames_truncated)                                                                                                \
+    X(profile_lock_contended)                                                                                          \
+    X(serialize_failures)                                                                                              \
+    X(uploads)                                                                                                         \
+    X(upload_failures)                                                                                                 \
+    X(uploads_dropped)                                                                                                 \
+    X(uploads_spooled)                                                                                                 \
+    X(spooled_uploads_sent)                                                                                            \
+    X(spooled_uploads_discarded)                                                                                       \
+    X(file_sink_writes)                                                                                                \
+    X(file_sink_failures)                                                                                              \
+    X(sampler_missed_deadlines)                                                                                        \
+    X(span_captures)                                                                                                   \
+    X(span_captures_rate_limited)                                                                                      \
+    X(endpoint_summary_dropped)                                                                                        \
+    X(endpoint_counts_dropped)                                                                                         \
+    X(heap_live_dropped)                                                                                               \
+    X(shared_aggregation_dropped)                                                                                      \
+    X(fast_memory_read_faults)                                                                                         \
+    X(frame_cache_hits)                                                                                                \
+    X(frame_cache_misses)                                                                                              \
+    X(cpu_timer_events_dropped)                                                                                        \
+    X(compression_failures)                                                                                            \
+    X(upload_bytes)
+
+#define PROFILER_GAUGES(X)                                                                                             \
+    X(string_table_bytes)                                                                                              \
+    X(string_table_hits)                                                                                               \
+    X(string_table_misses)                                                                                             \
+    X(string_table_rejected)                                                                                           \
+    X(string_table_strings)                                                                                            \
+    X(profile_distinct_samples)                                                                                        \
+    X(sampler_requested_period_us)                                                                                     \
+    X(sampler_actual_period_us)                                                                                        \
+    X(heap_live_samples)                                                                                               \
+    X(heap_live_stacks)                                                                                                \
+    X(frame_cache_capacity)                                                                                            \
+    X(profile_uncompressed_bytes)                                                                                      \
+    X(profile_compressed_bytes)
+
+#define PROFILER_TIMERS(X)                                                                                             \
+    X(flush_sample)                                                                                                    \
+    X(profile_lock_wait)                                                                                               \
+    X(profile_reset)                                                                                                   \
+    X(serialize)                                                                                                       \
+    X(compress)                                                                                                        \
+    X(aggregator_drain)                                                                                                \
+    X(upload)
+// clang-format on
+
+#define X_STAT_ENUM(a) a,
+#define X_STAT_STR(a) #a,
+
+enum class ProfilerCounter
+{
+    PROFILER_COUNTERS(X_STAT_ENUM) Length_
+};
+
+enum class ProfilerGauge
+{
+    PROFILER_GAUGES(X_STAT_ENUM) Length_
+};
+
+enum class ProfilerTimer
+{
+    PROFILER_TIMERS(X_STAT_ENUM) Length_
+};
+
+struct ProfilerTimerStats
+{
+    std::atomic<uint64_t> count{ 0 };
+    std::atomic<uint64_t> total_ns{ 0 };
+    std::atomic<uint64_t> max_ns{ 0 };
+};
+
+class ProfilerStats
+{
+  private:
+    static constexpr size_t num_counters = static_cast<size_t>(ProfilerCounter::Length_);
+    static constexpr size_t num_gauges = static_cast<size_t>(ProfilerGauge::Length_);
+    static constexpr size_t num_timers = static_cast<size_t>(ProfilerTimer::Length_);
+
+    static inline std::array<std::atomic<uint64_t>, num_counters> counters{};
+    static inline std::array<std::atomic<uint64_t>, num_gauges> gauges{};
+    static inline std::array<ProfilerTimerStats, num_timers> timers{};
+
+  public:
+    static inline void add(ProfilerCounter counter, uint64_t value = 1)
+    {
+        counters[static_cast<size_t>(counter)].fetch_add(value, std::memory_order_relaxed);
+    }
+
+    static inline void set(ProfilerGauge gauge, uint64_t value)
+    {
+        gauges[static_cast<size_t>(gauge)].store(value, std::memory_order_relaxed);
+    }
+
+    static void record(ProfilerTimer timer, std::chrono::nanoseconds duration);
+
+    // Measures the lifetime of the object
+    class ScopedTimer
+    {
+        ProfilerTimer timer;
+        std::chrono::steady_clock::time_point start;
+
+      public:
+        explicit ScopedTimer(ProfilerTimer _timer)
+          : timer{ _timer }
+          , start{ std::chrono::steady_clock::now() }
+        {
+        }
+        ~ScopedTimer() { record(timer, std::chrono::steady_clock::now() - start); }
+        ScopedTimer(const ScopedTimer&) = delete;
+        ScopedTimer& operator=(const ScopedTimer&) = delete;
+    };
+
+    // Flattened view, for exporting.  Timers are exported as `<name>_count`, `<name>_total_ns` and
+    // `<name>_max_ns`.  Returns false when `index` is past the end.
+    static size_t size();
+    static bool get(size_t index, std::string_view& name, uint64_t& value);
+
+    // Only for tests
+    static void reset();
+};
+
+} // namespace Datadog
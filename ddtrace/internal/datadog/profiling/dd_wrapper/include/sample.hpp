@@ -4,6 +4,7 @@
 #include "profile.hpp"
 #include "types.hpp"
 
+#include <array>
 #include <string>
 #include <string_view>
 #include <vector>
@@ -17,33 +18,95 @@ namespace Datadog {
 
 class SampleManager; // friend
 
+// A frame whose strings are already owned by the profile's string table (see Sample::intern_string())
+struct InternedFrame
+{
+    std::string_view name;
+    std::string_view filename;
+    uint64_t address;
+    int64_t line;
+};
+
+// A block of labels whose strings are already owned by the profile's string table.  Producers which emit the same
+// labels over and over (e.g., thread info) can build one of these once and add it to each sample wholesale.
+using LabelSet = std::vector<ddog_prof_Label>;
+
+// Native producers in the same process (stack_v2, memalloc) use this class directly, rather than the C interface
+// in interface.hpp.  The frame-pushing methods are defined here so they can be inlined into the caller.
 class Sample
 {
   private:
     static inline Profile profile_state{}; // TODO pointer to global state?
+    static inline bool timeline_enabled = false;
     unsigned int max_nframes;
     SampleType type_mask;
     std::string errmsg;
 
+    // The frame limit of each sample type, indexed by bit; a sample keeps as many frames as the deepest type it has
+    // values for.  Set by the SampleManager, which sizes every sample for the deepest type.
+    static inline std::array<unsigned int, num_sample_types> type_max_nframes = [] {
+        std::array<unsigned int, num_sample_types> limits{};
+        limits.fill(g_default_max_nframes);
+        return limits;
+    }();
+    unsigned int pushed_types = 0;
+    size_t frame_limit() const;
+
+    // Truncated stacks tend to drop the same few numbers of frames, so the names of the virtual frames which stand
+    // for them are interned once
+    static std::string_view omitted_frames_name(size_t count);
+
     // Keeps temporary buffer of frames in the stack
     std::vector<ddog_prof_Location> locations;
     size_t dropped_frames = 0;
     uint64_t samples = 0;
 
     // Storage for labels
-    std::vector<ddog_prof_Label> labels{};
+    LabelSet labels{};
 
-    // Storage for values
-    std::vector<int64_t> values = {};
+    static void append_label(LabelSet& dest, ExportLabelKey key, std::string_view val);
+    static void append_label(LabelSet& dest, ExportLabelKey key, int64_t val);
+    static void append_threadinfo_labels(LabelSet& dest,
+                                         int64_t thread_id,
+                                         int64_t thread_native_id,
+                                         std::string_view thread_name);
+
+    // Storage for values.  There are never more than one per field of ValueIndex, so they needn't be allocated;
+    // only the first num_values are part of the sample.
+    static constexpr size_t max_values = sizeof(ValueIndex) / sizeof(unsigned short);
+    std::array<int64_t, max_values> values{};
+    size_t num_values = 0;
+
+    // The layout of the values, which is fixed once the profile is initialized.  Kept here by the SampleManager so
+    // that pushing a value doesn't have to ask the profile for it.
+    static inline ValueIndex value_index{};
+
+    // When the sample was taken, as nanoseconds since the epoch; 0 if not given
+    int64_t endtime_ns = 0;
+
+    // The trace resource container label, as interned by the profile, for the endpoint summary
+    std::string_view endpoint{};
 
   public:
     // Helpers
     bool push_label(ExportLabelKey key, std::string_view val);
     bool push_label(ExportLabelKey key, int64_t val);
     void push_frame_impl(std::string_view name, std::string_view filename, uint64_t address, int64_t line);
+    inline void push_interned_frame_impl(std::string_view name,
+                                         std::string_view filename,
+                                         uint64_t address,
+                                         int64_t line);
     void clear_buffers();
 
     // Add values
+    //
+    // Producers with a fixed set of sample types (e.g., CPU and wall time for stack_v2) can check once per sample
+    // that it has all of them with has_types(), and then use push_value(), which is resolved when compiling for the
+    // given type.  The other pushes check the sample types first, since the C and Python callers can't.
+    template<unsigned int Mask>
+    bool has_types() const;
+    template<SampleType Type>
+    inline void push_value(int64_t value, int64_t count); // Assumes has_types<Type>()
     bool push_walltime(int64_t walltime, int64_t count);
     bool push_cputime(int64_t cputime, int64_t count);
     bool push_acquire(int64_t acquire_time, int64_t count);
@@ -54,6 +117,13 @@ class Sample
     // Adds metadata to sample
     bool push_lock_name(std::string_view lock_name);
     bool push_threadinfo(int64_t thread_id, int64_t thread_native_id, std::string_view thread_name);
+    bool push_interpreter_id(int64_t interpreter_id);
+
+    // What the thread was doing when it was sampled; empty values are left out
+    bool push_thread_state(std::string_view gil_state, std::string_view thread_state, std::string_view off_cpu_reason);
+
+    // Adds labels built by one of the make_*_labels() functions
+    inline void push_label_set(const LabelSet& label_set);
     bool push_task_id(int64_t task_id);
     bool push_task_name(std::string_view task_name);
     bool push_span_id(uint64_t span_id);
@@ -62,6 +132,13 @@ class Sample
     bool push_trace_resource_container(std::string_view trace_resource_container);
     bool push_exceptioninfo(std::string_view exception_type, int64_t count);
     bool push_class_name(std::string_view class_name);
+    bool push_allocation_domain(std::string_view allocation_domain);
+
+    // Timestamps are only kept when timeline support is enabled.  They're given in terms of CLOCK_MONOTONIC, which
+    // is also what time.monotonic_ns() uses.  A sample without a timestamp is stamped when it is flushed.
+    bool push_monotonic_ns(int64_t monotonic_ns);
+    static int64_t monotonic_now_ns(); // Coarse, but cheap
+    static bool is_timeline_enabled();
 
     // Assumes frames are pushed in leaf-order
     void push_frame(std::string_view name,     // for ddog_prof_Function
@@ -70,17 +147,151 @@ class Sample
                     int64_t line               // for ddog_prof_Location
     );
 
+    // Same as push_frame(), but the caller guarantees that the strings were returned by intern_string(), which
+    // skips the string table lookups.
+    inline void push_interned_frame(std::string_view name,
+                                    std::string_view filename,
+                                    uint64_t address,
+                                    int64_t line);
+
+    // Pushes a native frame as its address, along with the mapping of the object it belongs to, so that it can be
+    // symbolized by the backend rather than in the process.  The name is optional.
+    void push_native_frame(uint64_t address, std::string_view name = {});
+
+    // Bulk version of push_interned_frame(), for callers which have the whole stack at hand
+    inline void push_interned_frames(const InternedFrame* frames, size_t count);
+
     // Flushes the current buffer, clearing it
     bool flush_sample();
 
+    // Adds the values of another sample to the ones of this sample, for producers which collapse identical
+    // samples before flushing them.  Neither the frames nor the labels of the other sample are looked at.
+    inline void add_values(const Sample& other);
+
+    // Hands the frames, labels and heap value of the sample over to the HeapLiveSet, as the live sample `id`,
+    // instead of flushing it.  The sample still has to be dropped.
+    bool add_to_heap_live_set(uint64_t id);
+
+    // Returns a copy of the string which lives until the profile has been cycled twice.  Callers which keep
+    // interned strings (or LabelSets) around for longer should drop them when string_generation() changes.
+    static std::string_view intern_string(std::string_view str);
+    static uint64_t string_generation();
+
+    // Builds the labels push_threadinfo() would have added, for use with push_label_set().  Threads which belong to
+    // a subinterpreter are also labeled with its id; the main interpreter (id 0) isn't, so that profiles of
+    // single-interpreter applications are unchanged.
+    static LabelSet make_threadinfo_labels(int64_t thread_id,
+                                           int64_t thread_native_id,
+                                           std::string_view thread_name,
+                                           int64_t interpreter_id = 0);
+
     static ddog_prof_Profile& profile_borrow();
     static void profile_release();
-    static void profile_clear_state();
+    static ddog_prof_Profile& profile_last_borrow();
+    static bool profile_new(ddog_prof_Profile& profile);
+    static bool profile_clear_state();
+    static void prefork();
+    static void postfork_parent();
     static void postfork_child();
     Sample(SampleType _type_mask, unsigned int _max_nframes);
 
     // friend class SampleManager;
     friend class SampleManager;
+    friend class SharedAggregation;
 };
 
+inline void
+Sample::push_interned_frame_impl(std::string_view name, std::string_view filename, uint64_t address, int64_t line)
+{
+    static const ddog_prof_Mapping null_mapping = { 0, 0, 0, to_slice(""), to_slice("") };
+    locations.push_back({
+      .mapping = null_mapping, // No support for mappings in Python
+      .function = {
+        .name = to_slice(name),
+        .system_name = {}, // No support for system_name in Python
+        .filename = to_slice(filename),
+        .start_line = 0, // We don't know the start_line for the function
+      },
+      .address = address,
+      .line = line,
+    });
+}
+
+template<unsigned int Mask>
+bool
+Sample::has_types() const
+{
+    static_assert(Mask != 0 && (Mask & ~SampleType::All) == 0, "Not a mask of sample types");
+    return (type_mask & Mask) == Mask;
+}
+
+// Times are weighted by the count, except for locks, whose callers already give the total
+template<SampleType Type>
+inline void
+Sample::push_value(int64_t value, int64_t count)
+{
+    if constexpr (Type == SampleType::CPU) {
+        values[value_index.cpu_time] += value * count;
+        values[value_index.cpu_count] += count;
+    } else if constexpr (Type == SampleType::Wall) {
+        values[value_index.wall_time] += value * count;
+        values[value_index.wall_count] += count;
+    } else if constexpr (Type == SampleType::Exception) {
+        (void)value;
+        values[value_index.exception_count] += count;
+    } else if constexpr (Type == SampleType::LockAcquire) {
+        values[value_index.lock_acquire_time] += value;
+        values[value_index.lock_acquire_count] += count;
+    } else if constexpr (Type == SampleType::LockRelease) {
+        values[value_index.lock_release_time] += value;
+        values[value_index.lock_release_count] += count;
+    } else if constexpr (Type == SampleType::Allocation) {
+        values[value_index.alloc_space] += value;
+        values[value_index.alloc_count] += count;
+    } else if constexpr (Type == SampleType::Heap) {
+        (void)count;
+        values[value_index.heap_space] += value;
+    } else {
+        static_assert(Type != Type, "push_value() takes a single sample type");
+    }
+    pushed_types |= Type;
+}
+
+inline void
+Sample::add_values(const Sample& other)
+{
+    for (size_t i = 0; i < num_values; ++i) {
+        values[i] += other.values[i];
+    }
+    pushed_types |= other.pushed_types;
+}
+
+inline void
+Sample::push_label_set(const LabelSet& label_set)
+{
+    labels.insert(labels.end(), label_set.begin(), label_set.end());
+}
+
+inline void
+Sample::push_interned_frame(std::string_view name, std::string_view filename, uint64_t address, int64_t line)
+{
+    if (locations.size() < max_nframes) {
+        push_interned_frame_impl(name, filename, address, line);
+    } else {
+        ++dropped_frames;
+    }
+}
+
+inline void
+Sample::push_interned_frames(const InternedFrame* frames, size_t count)
+{
+    // Everything past the limit is just counted, so only the part which fits needs to be copied
+    const size_t room = locations.size() < max_nframes ? max_nframes - locations.size() : 0;
+    const size_t accepted = count < room ? count : room;
+    for (size_t i = 0; i < accepted; ++i) {
+        push_interned_frame_impl(frames[i].name, frames[i].filename, frames[i].address, frames[i].line);
+    }
+    dropped_frames += count - accepted;
+}
+
 } // namespace Datadog
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "staging_buffer.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+extern "C"
+{
+#include "datadog/profiling.h"
+}
+
+namespace Datadog {
+
+// Sums up the values of identical samples before they are added to the profile.  libdatadog hashes the strings,
+// functions, locations and labels of every sample it is given, while the samples of a busy process repeat the same
+// few stacks over and over.  The strings of the samples are owned by the profile's string table, so a sample is
+// instead identified by the addresses of its strings (and its numbers), which is far cheaper to hash and compare.
+// Two samples with equal strings at different addresses are kept apart, which libdatadog then aggregates; that only
+// costs the extra add.
+//
+// Only samples without timestamps can be aggregated, since libdatadog keeps the others individually.  The pending
+// samples must be drained into the profile before its strings age out, i.e. when the profile is cycled.  This is
+// not synchronized; the profile operates it under its lock.
+class SampleAggregator
+{
+  private:
+    // Entries are reused from one drain to the next, so that they stop allocating once they've seen their largest
+    // sample
+    std::vector<StagedSample> entries{};
+    size_t used = 0;
+    std::unordered_multimap<uint64_t, size_t> index{};
+    size_t max_entries;
+
+    static uint64_t hash(const ddog_prof_Sample& sample);
+    static bool same_key(const StagedSample& entry, const ddog_prof_Sample& sample);
+
+  public:
+    // Returns false if the sample is new and there is no room left for it, in which case the caller should drain
+    // the pending samples and try again
+    bool add(const ddog_prof_Sample& sample);
+    size_t size() const;
+
+    // Calls the visitor on every pending sample, then forgets them
+    void drain(const std::function<void(const ddog_prof_Sample&)>& visitor);
+    void clear();
+
+    SampleAggregator(size_t _max_entries);
+};
+
+} // namespace Datadog
@@ -0,0 +1,57 @@
+#pragma once
+
+// Plain C view of the sample API, for native extensions which are built separately from dd_wrapper (such as the
+// memalloc collector) and can't use the C++ types of interface.hpp.  They don't link against dd_wrapper either; the
+// ddup module hands the table out as a capsule named DDUP_SAMPLE_CAPI_NAME, and the functions are called through it.
+// The functions have the same semantics as their ddup_* counterparts.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define DDUP_SAMPLE_CAPI_NAME "ddtrace.internal.datadog.profiling.ddup._ddup.sample_capi"
+
+// Bumped whenever the table changes in a way that isn't backward compatible
+#define DDUP_SAMPLE_CAPI_VERSION 4
+
+    // Opaque handle to a Datadog::Sample
+    typedef struct ddup_sample ddup_sample_t;
+
+    typedef struct
+    {
+        unsigned int version;
+        ddup_sample_t* (*start_sample)(void);
+        void (*push_alloc)(ddup_sample_t* sample, int64_t size, int64_t count);
+        void (*push_heap)(ddup_sample_t* sample, int64_t size);
+        void (*push_threadinfo)(ddup_sample_t* sample,
+                                int64_t thread_id,
+                                int64_t thread_native_id,
+                                const char* thread_name,
+                                size_t thread_name_len);
+        void (*push_class_name)(ddup_sample_t* sample, const char* class_name, size_t class_name_len);
+        void (*push_allocation_domain)(ddup_sample_t* sample,
+                                       const char* allocation_domain,
+                                       size_t allocation_domain_len);
+        void (*push_frame)(ddup_sample_t* sample,
+                           const char* name,
+                           size_t name_len,
+                           const char* filename,
+                           size_t filename_len,
+                           uint64_t address,
+                           int64_t line);
+        void (*flush_sample)(ddup_sample_t* sample);
+        void (*drop_sample)(ddup_sample_t* sample);
+        void (*heap_live_add)(ddup_sample_t* sample, uint64_t id);
+        void (*heap_live_remove)(uint64_t id);
+        void (*heap_live_clear)(void);
+    } ddup_sample_capi_t;
+
+    const ddup_sample_capi_t* ddup_sample_capi_get(void);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -2,10 +2,12 @@
 
 #include "constants.hpp"
 #include "sample.hpp"
+#include "synchronized_sample_pool.hpp"
 #include "types.hpp"
 
 #include <array>
 #include <atomic>
+#include <memory>
 #include <mutex>
 #include <optional>
 
@@ -17,19 +19,32 @@ class SampleManager
 {
   private:
     static inline unsigned int max_nframes{ g_default_max_nframes };
+
+    // Limits for specific sample types, 0 where max_nframes applies.  Samples are sized for the deepest one.
+    static inline std::array<unsigned int, num_sample_types> type_max_nframes{};
+    static inline unsigned int sample_nframes{ g_default_max_nframes };
+    static void update_frame_limits();
     static inline SampleType type_mask{ SampleType::All };
     static inline std::mutex init_mutex{};
+    static inline size_t sample_pool_capacity{ g_default_sample_pool_capacity };
+    static inline std::unique_ptr<SynchronizedSamplePool> sample_pool{ nullptr };
 
   public:
     // Configuration
     static void add_type(unsigned int type);
     static void set_max_nframes(unsigned int _max_nframes);
+    static void set_type_max_nframes(unsigned int type, unsigned int _max_nframes); // for every type in the mask
+    static void set_sample_pool_capacity(size_t _sample_pool_capacity);
+    static void set_timeline(bool _timeline_enabled);
+    static void set_string_table_max_bytes(size_t max_bytes);
 
     // Sampling entrypoint (this could also be called `build_ptr()`)
     static Sample* start_sample();
     static void drop_sample(Sample* sample);
 
-    // Handles state management after forks
+    // Handles state management around forks
+    static void prefork();
+    static void postfork_parent();
     static void postfork_child();
 
     // Initialization
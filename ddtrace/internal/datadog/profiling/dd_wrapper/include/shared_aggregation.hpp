@@ -0,0 +1,132 @@
+#pragma once
+
+#include "constants.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <sys/types.h>
+
+extern "C"
+{
+#include "datadog/profiling.h"
+}
+
+namespace Datadog {
+
+struct SharedFrame
+{
+    std::string name;
+    std::string filename;
+    int64_t line;
+};
+
+// The values of one stack, as accumulated by one process
+struct SharedStack
+{
+    pid_t pid;
+    std::vector<SharedFrame> frames; // leaf first
+    std::vector<int64_t> values;
+};
+
+// Aggregates the samples of every process of a prefork server (e.g., gunicorn or uwsgi workers) in a segment of
+// shared memory, so that a single profile is uploaded for all of them instead of one per worker.
+//
+// Samples are reduced to their stack and values, keyed by the interned stack and the pid of the worker, which is
+// exported as a label.  Other labels and timestamps are dropped, since they would defeat the aggregation.  When it
+// is time to upload, one process is elected to merge the segment into its own profile and to upload it; the others
+// discard their profiles.  The uploader is whichever process claims the segment first, and is replaced if it exits
+// or stops uploading for a while.
+//
+// The segment is either anonymous, in which case it is shared with the processes forked after it is configured (the
+// workers forked by the master), or named, in which case it is shared with any process which configures the same
+// name (e.g., workers which load the application after they are forked).  Everything in it is addressed by offset,
+// since it may be mapped at different addresses, and it is guarded by a spinlock which can be taken over from a
+// process which died while holding it.  When the segment is full, samples are dropped until the next upload.
+class SharedAggregation
+{
+  private:
+    struct Header;
+    struct StringSlot;
+    struct StackSlot;
+    struct FrameRecord;
+    struct EntrySlot;
+
+    struct Layout
+    {
+        size_t max_stacks;
+        size_t string_slots;
+        size_t string_bytes;
+        size_t stack_slots;
+        size_t max_frames;
+        size_t entry_slots;
+        size_t strings_offset;
+        size_t string_bytes_offset;
+        size_t stacks_offset;
+        size_t frames_offset;
+        size_t entries_offset;
+        size_t size;
+    };
+
+    static inline std::mutex mtx{};
+    static inline std::atomic<bool> is_enabled{ false };
+    static inline std::string name{};
+    static inline Layout layout{};
+    static inline char* segment{ nullptr };
+    static inline pid_t pid{ 0 };
+
+    // Set while merging the segment into the profile, so the merged samples aren't recorded again
+    static inline thread_local bool merging{ false };
+
+    static Layout make_layout(size_t max_stacks);
+    static bool map_anonymous(const Layout& _layout);
+    static bool map_named(std::string_view _name, const Layout& _layout);
+    static void unmap();
+    static void init_segment(char* base, const Layout& _layout);
+
+    static Header& header();
+    static void lock();
+    static void unlock();
+
+    // Assume the lock is held.  Return false when the segment is full.
+    static bool intern(std::string_view str, uint32_t& slot_index);
+    static bool intern_stack(const ddog_prof_Location* locations, size_t num_locations, uint32_t& stack);
+    static void clear();
+
+  public:
+    // A max_stacks of 0 disables the aggregation.  An empty name maps an anonymous segment.  Configuring the segment
+    // it already uses is a no-op, which keeps a forked worker on the segment of its parent.
+    static bool configure(std::string_view _name, size_t max_stacks);
+    static bool enabled();
+
+    // Accounts for one sample, unless the aggregation is disabled, in which case false is returned and the sample
+    // belongs to the profile of the process
+    static bool record(const ddog_prof_Location* locations,
+                       size_t num_locations,
+                       const int64_t* values,
+                       size_t num_values);
+
+    // Whether this process is the one which uploads, claiming the segment if nobody else does.  `now_ns` is taken
+    // from CLOCK_MONOTONIC, which is shared by every process on the host.
+    static bool elect(int64_t now_ns);
+
+    // Takes everything accumulated so far out of the segment
+    static std::vector<SharedStack> take();
+
+    // Moves everything accumulated so far into the current profile
+    static void merge();
+
+    static void prefork();
+    static void postfork_parent();
+    static void postfork_child();
+
+    // Only for tests
+    static void reset();
+};
+
+} // namespace Datadog
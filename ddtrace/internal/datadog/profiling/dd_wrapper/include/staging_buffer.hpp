@@ -0,0 +1,60 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <thread>
+#include <vector>
+
+extern "C"
+{
+#include "datadog/profiling.h"
+}
+
+namespace Datadog {
+
+// A finished sample, copied out of the Sample object which produced it.  String data is owned by the profile's
+// string table, so only the slices need to be kept here.
+struct StagedSample
+{
+    std::vector<ddog_prof_Location> locations{};
+    std::vector<ddog_prof_Label> labels{};
+    std::vector<int64_t> values{};
+    int64_t timestamp_ns = 0;
+
+    void assign(const ddog_prof_Sample& sample, int64_t _timestamp_ns);
+    ddog_prof_Sample as_sample() const;
+};
+
+// A single-producer, single-consumer ring of finished samples.  Each producer thread owns one of these, and
+// pushes into it without taking any locks.  The consumer side is only ever operated while holding the profile
+// lock, which guarantees there is at most one consumer at a time.
+class StagingBuffer
+{
+  private:
+    std::vector<StagedSample> slots;
+    std::atomic<uint64_t> head{ 0 }; // Next slot to be consumed
+    std::atomic<uint64_t> tail{ 0 }; // Next slot to be produced
+
+  public:
+    // Identifies the producer, so that buffers belonging to threads which didn't survive a fork can be found
+    const std::thread::id owner;
+
+    // Set once the producer thread has exited; such buffers are released after their last drain
+    std::atomic<bool> orphaned{ false };
+
+    // Producer side.  Returns false if the ring is full.
+    bool push(const ddog_prof_Sample& sample, int64_t timestamp_ns);
+    size_t size() const;
+    size_t capacity() const;
+
+    // Consumer side.  Calls the visitor on each staged sample (and its timestamp) in order, then releases them.
+    size_t drain(const std::function<void(const ddog_prof_Sample&, int64_t)>& visitor);
+
+    // Drops everything that was staged.  Only safe when there is no concurrent producer.
+    void discard();
+
+    StagingBuffer(size_t capacity, std::thread::id _owner);
+};
+
+} // namespace Datadog
@@ -0,0 +1,106 @@
+#pragma once
+
+#include "constants.hpp"
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+namespace Datadog {
+
+// Backing storage for interned strings.  Strings are copied into large chunks which are never moved or freed
+// (until the arena itself is destroyed), so handing out views into the arena is always safe.
+class StringArena
+{
+  private:
+    static constexpr size_t chunk_size = 64 * 1024;
+    std::vector<std::unique_ptr<char[]>> chunks{};
+    std::vector<std::unique_ptr<char[]>> large_strings{};
+    size_t chunk_offset{ 0 };
+
+  public:
+    std::string_view insert(std::string_view str);
+};
+
+// A concurrent string table.  Strings are distributed across shards by their hash, and each shard has its own
+// lock and arena, so producers only contend when they intern strings belonging to the same shard at the
+// same time.
+//
+// Storage is generational, so that strings which stop being used are eventually released.  Strings are always
+// returned from the current generation: one which is only found in an older generation is copied forward, so
+// anything still in use survives.  `advance_generation()` starts a new generation and releases the oldest one
+// once more than `num_generations` exist.  This means a view stays valid until the generation has been advanced
+// `num_generations` times after it was returned.
+class StringTable
+{
+  private:
+    static constexpr size_t num_shards = 16;
+
+    struct Generation
+    {
+        std::unordered_set<std::string_view> strings{};
+        StringArena arena{};
+        size_t bytes{ 0 };
+    };
+
+    struct Shard
+    {
+        std::mutex mtx{};
+        std::deque<Generation> generations{ 1 }; // The current generation is at the front
+    };
+    std::array<Shard, num_shards> shards{};
+
+    const size_t num_generations;
+    std::atomic<size_t> max_bytes;
+    std::atomic<size_t> bytes{ 0 };
+    std::atomic<uint64_t> generation{ 0 };
+    std::atomic<size_t> last_generation_strings{ 0 };
+
+    // Counters are only for diagnostics, so they don't need to be synchronized with anything else
+    std::atomic<uint64_t> hits{ 0 };
+    std::atomic<uint64_t> misses{ 0 };
+    std::atomic<uint64_t> rejected{ 0 };
+
+  public:
+    // Returned instead of an interned copy when the table is over its memory cap
+    static constexpr std::string_view overflow_placeholder = "<string table full>";
+
+    // Returns a view of the interned copy of `str`; see above for how long it stays valid
+    std::string_view insert_or_get(std::string_view str);
+
+    // Starts a new generation, releasing the oldest one if needed.  Views returned before this call remain valid
+    // until it has been made `num_generations` times.  The new generation is sized for as many strings as the one
+    // it follows, since the strings still in use are copied forward soon after.
+    void advance_generation();
+
+    // How many strings the generation which was current until the last advance_generation() held
+    size_t get_last_generation_strings() const;
+
+    // Incremented by advance_generation().  Callers which cache views can use this to tell when to drop them.
+    uint64_t get_generation() const;
+
+    // The cap applies to the bytes of string data held across all generations.  Over the cap, new strings are
+    // replaced by `overflow_placeholder` until enough old generations have been released.
+    void set_max_bytes(size_t _max_bytes);
+    size_t get_bytes() const;
+
+    uint64_t get_hits() const;
+    uint64_t get_misses() const;
+    uint64_t get_rejected() const;
+
+    // All shards are locked across fork(), so the child inherits a consistent table it can keep using
+    void prefork();
+    void postfork_parent();
+    void postfork_child();
+
+    StringTable(size_t _num_generations = g_default_string_table_generations,
+                size_t _max_bytes = g_default_string_table_max_bytes);
+};
+
+} // namespace Datadog
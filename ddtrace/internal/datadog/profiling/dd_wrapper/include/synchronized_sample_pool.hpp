@@ -0,0 +1,35 @@
+#pragma once
+
+#include "sample.hpp"
+
+#include <atomic>
+#include <memory>
+#include <optional>
+#include <vector>
+
+namespace Datadog {
+
+// A bounded, lock-free pool of Sample objects.  Samples are expensive to construct (their buffers are sized for
+// the maximum number of frames), so instead of freeing them after every flush we keep a handful around for reuse.
+// Each slot holds either a pointer to an idle Sample or nullptr; producers and consumers claim slots with atomic
+// exchanges, so no thread ever blocks on the pool.
+class SynchronizedSamplePool
+{
+  private:
+    std::vector<std::atomic<Sample*>> pool;
+
+  public:
+    // Returns an idle Sample if one is available
+    std::optional<Sample*> take_sample();
+
+    // Returns the given Sample if the pool is full; the caller retains ownership in that case
+    std::optional<Sample*> return_sample(Sample* sample);
+
+    SynchronizedSamplePool(size_t capacity);
+    ~SynchronizedSamplePool();
+
+    SynchronizedSamplePool(const SynchronizedSamplePool&) = delete;
+    SynchronizedSamplePool& operator=(const SynchronizedSamplePool&) = delete;
+};
+
+} // namespace Datadog
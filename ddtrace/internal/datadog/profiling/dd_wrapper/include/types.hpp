@@ -14,6 +14,9 @@ enum SampleType : unsigned int
     All = CPU | Wall | Exception | LockAcquire | LockRelease | Allocation | Heap
 };
 
+// One per bit of SampleType::All
+constexpr unsigned int num_sample_types = 7;
+
 // Every Sample object has a corresponding `values` vector, since libdatadog expects contiguous values per sample.
 // The index into that vector is determined by the configured sample types, which is encoded below.
 struct ValueIndex
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "uploader.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <utility>
+
+extern "C"
+{
+#include "datadog/profiling.h"
+}
+
+namespace Datadog {
+
+// Serializes and sends profiles on a dedicated thread, so neither the caller of `ddup_upload()` nor the sample
+// producers have to wait on either step.
+//
+// The profile is double-buffered: `submit()` swaps the buffers (which only briefly takes the profile lock) and
+// hands the stale buffer to the worker.  The stale buffer can't be reused until the worker has serialized it, so
+// a subsequent `submit()` waits for that to happen.  Serialized profiles are queued for sending; if the intake
+// is slow and the queue is full, the oldest one is dropped.  Profiles which could not be sent at all are left in
+// the ProfileSpool, and drained once an upload goes through again.  Bursts, which aren't part of the double
+// buffer, are queued on their own and serialized after the stale buffer.
+class UploadWorker
+{
+  private:
+    static inline std::mutex mtx{};
+    static inline std::condition_variable cv{};
+
+    // The Uploader (and its exporter, which holds the HTTP connection) is kept across upload cycles.  It is only
+    // rebuilt when the configuration changes or after a fork.
+    static inline std::shared_ptr<Uploader> uploader{};
+    static inline uint64_t uploader_config_seq{ 0 };
+    static std::shared_ptr<Uploader> get_uploader(); // Assumes mtx is held
+
+    // The Uploader which should serialize the stale buffer, if there is one pending
+    static inline std::shared_ptr<Uploader> pending_serialize{};
+    static inline std::deque<std::pair<std::shared_ptr<Uploader>, ddog_prof_EncodedProfile>> pending_send{};
+    static void queue_send(std::shared_ptr<Uploader> cur_uploader, ddog_prof_EncodedProfile encoded); // Ditto
+
+    // Finished bursts, which are serialized with an Uploader of their own, see burst_profile.hpp
+    static inline std::deque<ddog_prof_Profile> pending_burst{};
+    static void serialize_burst(ddog_prof_Profile& burst);
+    static inline bool stop_requested{ false };
+
+    // Set after a successful upload, while there may be spooled profiles left to send
+    static inline bool drain_spool{ false };
+    static inline std::shared_ptr<Uploader> spool_uploader{};
+
+    // Lazily (re)started, since threads don't survive a fork
+    static inline std::thread worker{};
+    static inline bool running{ false };
+
+    static void loop();
+    static void ensure_running(); // Assumes mtx is held
+
+  public:
+    // Swaps the profile buffers and schedules the stale one for upload.  Returns false if the upload could not be
+    // scheduled.
+    static bool submit();
+
+    // Schedules the profile of a burst for upload, taking ownership of it.  Returns false if it was dropped
+    // instead.
+    static bool submit_burst(ddog_prof_Profile& burst);
+
+    // Stops the worker after it has finished with everything that was already submitted
+    static void shutdown();
+
+    static void prefork();
+    static void postfork_parent();
+    static void postfork_child();
+};
+
+} // namespace Datadog
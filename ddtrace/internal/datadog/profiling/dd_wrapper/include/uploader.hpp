@@ -1,5 +1,6 @@
 #pragma once
 
+#include "profile_spool.hpp"
 #include "sample.hpp"
 #include "types.hpp"
 
@@ -30,11 +31,38 @@ class Uploader
     std::string errmsg;
     static inline std::unique_ptr<ddog_CancellationToken, DdogCancellationTokenDeleter> cancel;
     std::string runtime_id;
+    std::string profile_mode; // Tags the profiles which don't come from the regular cycle, e.g. bursts
     std::string url;
     std::unique_ptr<ddog_prof_Exporter, DdogProfExporterDeleter> ddog_exporter;
 
+    // Whether a failed upload is worth retrying later
+    enum class SendStatus
+    {
+        ok,
+        retry,
+        error,
+    };
+
+    // Sending is split in two steps, since the request holds its own copy of the profile: the caller may release
+    // its copy in between.  `build_request()` returns nullptr on failure; the endpoint counts are optional.
+    ddog_prof_Exporter_Request* build_request(const ddog_Timespec& start,
+                                              const ddog_Timespec& end,
+                                              ddog_ByteSlice data,
+                                              const ddog_prof_ProfiledEndpointsStats* endpoints_stats);
+    SendStatus send_request(ddog_prof_Exporter_Request* req);
+
   public:
+    // Serializes the profile and sends it in one step
     bool upload(ddog_prof_Profile& profile);
+
+    // The same, split into two steps.  `send()` takes ownership of the encoded profile.  If the intake can't be
+    // reached, the profile is kept in the spool (when it is enabled) for a later attempt.  When the file sink is
+    // enabled, profiles are written to it rather than sent.
+    bool serialize(ddog_prof_Profile& profile, ddog_prof_EncodedProfile& encoded);
+    bool send(ddog_prof_EncodedProfile& encoded);
+
+    // Sends a profile which was read back from the spool
+    bool send(const SpooledProfile& spooled);
     static void cancel_inflight();
     static void lock();
     static void unlock();
@@ -42,7 +70,13 @@ class Uploader
     static void postfork_parent();
     static void postfork_child();
 
-    Uploader(std::string_view _url, ddog_prof_Exporter* ddog_exporter);
+    // The exporter can't be safely torn down in the child of a fork, since it owns threads which only existed in
+    // the parent.  This gives up ownership of it instead.
+    void release_exporter();
+
+    void set_profile_mode(std::string_view _profile_mode);
+
+    Uploader(std::string_view _url, std::string_view _runtime_id, ddog_prof_Exporter* ddog_exporter);
 };
 
 } // namespace Datadog
@@ -2,6 +2,7 @@
 
 #include "uploader.hpp"
 
+#include <atomic>
 #include <mutex>
 #include <string>
 #include <string_view>
@@ -30,6 +31,11 @@ class UploaderBuilder
     static constexpr std::string_view language{ "python" };
     static constexpr std::string_view family{ "python" };
 
+    // Incremented whenever the configuration changes, so that users of a built Uploader can tell whether it is
+    // still current
+    static inline std::atomic<uint64_t> config_seq{ 0 };
+    static void update_config(std::string_view src, std::string& dest);
+
   public:
     static void set_env(std::string_view _dd_env);
     static void set_service(std::string_view _service);
@@ -41,6 +47,7 @@ class UploaderBuilder
     static void set_url(std::string_view _url);
     static void set_tag(std::string_view _key, std::string_view _val);
 
+    static uint64_t get_config_seq();
     static std::variant<Uploader, std::string> build();
 };
 
@@ -0,0 +1,94 @@
+#include "burst_profile.hpp"
+#include "libdatadog_helpers.hpp"
+#include "profiler_stats.hpp"
+#include "sample.hpp"
+#include "upload_worker.hpp"
+
+#include <iostream>
+#include <new>
+
+bool
+Datadog::BurstProfile::start()
+{
+    const std::lock_guard<std::mutex> lock(mtx);
+    if (active) {
+        return false;
+    }
+    if (!Sample::profile_new(profile)) {
+        std::cerr << "Could not initialize the profile of the burst" << std::endl;
+        return false;
+    }
+    active = true;
+    return true;
+}
+
+bool
+Datadog::BurstProfile::finish()
+{
+    ddog_prof_Profile finished{};
+    {
+        const std::lock_guard<std::mutex> lock(mtx);
+        if (!active) {
+            return false;
+        }
+        finished = profile;
+        profile = {};
+        active = false;
+    }
+
+    // The worker owns the profile from now on, whether it could be scheduled or not
+    return UploadWorker::submit_burst(finished);
+}
+
+bool
+Datadog::BurstProfile::is_active()
+{
+    const std::lock_guard<std::mutex> lock(mtx);
+    return active;
+}
+
+bool
+Datadog::BurstProfile::collect(const ddog_prof_Sample& sample, int64_t timestamp_ns)
+{
+    // Bursts are produced by a single thread, so there's nothing to gain from staging the samples
+    const std::lock_guard<std::mutex> lock(mtx);
+    if (!active) {
+        ProfilerStats::add(ProfilerCounter::samples_dropped);
+        return false;
+    }
+    auto res = ddog_prof_Profile_add(&profile, sample, timestamp_ns);
+    if (!res.ok) {          // NOLINT (cppcoreguidelines-pro-type-union-access)
+        auto err = res.err; // NOLINT (cppcoreguidelines-pro-type-union-access)
+        const std::string errmsg = err_to_msg(&err, "Error adding sample to the profile of the burst");
+        std::cerr << errmsg << std::endl;
+        ddog_Error_drop(&err);
+        ProfilerStats::add(ProfilerCounter::samples_dropped);
+        return false;
+    }
+    ProfilerStats::add(ProfilerCounter::samples_collected);
+    return true;
+}
+
+void
+Datadog::BurstProfile::prefork()
+{
+    mtx.lock();
+}
+
+void
+Datadog::BurstProfile::postfork_parent()
+{
+    mtx.unlock();
+}
+
+void
+Datadog::BurstProfile::postfork_child()
+{
+    // The burst was requested for the parent, whose sampling thread doesn't exist in the child
+    new (&mtx) std::mutex();
+    if (active) {
+        ddog_prof_Profile_drop(&profile);
+        profile = {};
+        active = false;
+    }
+}
@@ -0,0 +1,280 @@
+#include "compression.hpp"
+#include "profiler_stats.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#ifdef DD_WRAPPER_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef DD_WRAPPER_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace {
+
+constexpr uint32_t lz4_frame_magic = 0x184D2204;
+
+inline uint32_t
+read_le32(const uint8_t* ptr)
+{
+    return static_cast<uint32_t>(ptr[0]) | (static_cast<uint32_t>(ptr[1]) << 8) |
+           (static_cast<uint32_t>(ptr[2]) << 16) | (static_cast<uint32_t>(ptr[3]) << 24);
+}
+
+// Decodes one LZ4 block, whose matches may refer to anything decoded since `base` (the start of the frame), which
+// is how linked blocks are decoded
+bool
+lz4_block_decode(const uint8_t* ip, const uint8_t* end, size_t base, std::vector<uint8_t>& out)
+{
+    auto read_length = [&](size_t length) -> size_t {
+        if (length != 15) {
+            return length;
+        }
+        uint8_t byte = 0;
+        do {
+            if (ip >= end) {
+                return SIZE_MAX;
+            }
+            byte = *ip++;
+            length += byte;
+        } while (byte == 255);
+        return length;
+    };
+
+    while (ip < end) {
+        const uint8_t token = *ip++;
+        const size_t literals = read_length(token >> 4);
+        if (literals == SIZE_MAX || literals > static_cast<size_t>(end - ip)) {
+            return false;
+        }
+        out.insert(out.end(), ip, ip + literals);
+        ip += literals;
+
+        // The last sequence of a block only has literals
+        if (ip == end) {
+            return true;
+        }
+        if (end - ip < 2) {
+            return false;
+        }
+        const size_t offset = static_cast<size_t>(ip[0]) | (static_cast<size_t>(ip[1]) << 8);
+        ip += 2;
+        size_t match = read_length(token & 15);
+        if (match == SIZE_MAX || offset == 0 || offset > out.size() - base) {
+            return false;
+        }
+        match += 4;
+
+        // Matches may overlap with what they produce, in which case they have to be copied byte by byte
+        size_t from = out.size() - offset;
+        const size_t to = out.size();
+        out.resize(to + match);
+        if (offset >= match) {
+            std::memcpy(out.data() + to, out.data() + from, match);
+        } else {
+            for (size_t i = 0; i < match; ++i) {
+                out[to + i] = out[from++];
+            }
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+bool
+Datadog::Compression::lz4_frame_decode(ddog_ByteSlice frame, std::vector<uint8_t>& out)
+{
+    const uint8_t* ip = frame.ptr;
+    const uint8_t* end = frame.ptr + frame.len;
+
+    // Frames may be concatenated
+    while (ip < end) {
+        if (end - ip < 7 || read_le32(ip) != lz4_frame_magic) {
+            return false;
+        }
+        const uint8_t flags = ip[4];
+        if ((flags >> 6) != 1) {
+            return false;
+        }
+        const bool block_checksum = (flags & 0x10) != 0;
+        const bool content_size = (flags & 0x08) != 0;
+        const bool content_checksum = (flags & 0x04) != 0;
+        const bool dict_id = (flags & 0x01) != 0;
+        if (dict_id) {
+            return false; // libdatadog doesn't use dictionaries, and we don't have theirs anyway
+        }
+
+        // Magic, flags, block descriptor, optional content size, header checksum
+        const size_t header = 4 + 2 + (content_size ? 8 : 0) + 1;
+        if (static_cast<size_t>(end - ip) < header) {
+            return false;
+        }
+        ip += header;
+
+        const size_t base = out.size();
+        while (true) {
+            if (end - ip < 4) {
+                return false;
+            }
+            const uint32_t block = read_le32(ip);
+            ip += 4;
+            if (block == 0) {
+                break; // End mark
+            }
+            const bool uncompressed = (block & 0x80000000U) != 0;
+            const size_t size = block & 0x7FFFFFFFU;
+            if (static_cast<size_t>(end - ip) < size + (block_checksum ? 4 : 0)) {
+                return false;
+            }
+            if (uncompressed) {
+                out.insert(out.end(), ip, ip + size);
+            } else if (!lz4_block_decode(ip, ip + size, base, out)) {
+                return false;
+            }
+            ip += size + (block_checksum ? 4 : 0);
+        }
+        if (content_checksum) {
+            if (end - ip < 4) {
+                return false;
+            }
+            ip += 4;
+        }
+    }
+    return true;
+}
+
+bool
+Datadog::Compression::gzip(const std::vector<uint8_t>& pprof, int level, std::vector<uint8_t>& out)
+{
+#ifdef DD_WRAPPER_HAVE_ZLIB
+    z_stream strm{};
+    level = level == 0 ? Z_DEFAULT_COMPRESSION : std::clamp(level, 1, 9);
+
+    // 16 more bits of window ask zlib for a gzip header and trailer
+    if (deflateInit2(&strm, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return false;
+    }
+    out.resize(deflateBound(&strm, pprof.size()));
+    strm.next_in = const_cast<Bytef*>(pprof.data()); // NOLINT (cppcoreguidelines-pro-type-const-cast)
+    strm.avail_in = static_cast<uInt>(pprof.size());
+    strm.next_out = out.data();
+    strm.avail_out = static_cast<uInt>(out.size());
+    const int ret = deflate(&strm, Z_FINISH);
+    out.resize(strm.total_out);
+    deflateEnd(&strm);
+    return ret == Z_STREAM_END;
+#else
+    (void)pprof;
+    (void)level;
+    (void)out;
+    return false;
+#endif
+}
+
+bool
+Datadog::Compression::zstd(const std::vector<uint8_t>& pprof, int level, std::vector<uint8_t>& out)
+{
+#ifdef DD_WRAPPER_HAVE_ZSTD
+    // A level of 0 is already zstd's default
+    level = std::min(level, ZSTD_maxCLevel());
+    out.resize(ZSTD_compressBound(pprof.size()));
+    const size_t size = ZSTD_compress(out.data(), out.size(), pprof.data(), pprof.size(), level);
+    if (ZSTD_isError(size) != 0U) {
+        return false;
+    }
+    out.resize(size);
+    return true;
+#else
+    (void)pprof;
+    (void)level;
+    (void)out;
+    return false;
+#endif
+}
+
+bool
+Datadog::Compression::available(CompressionCodec _codec)
+{
+    switch (_codec) {
+        case CompressionCodec::lz4:
+            return true;
+        case CompressionCodec::gzip:
+#ifdef DD_WRAPPER_HAVE_ZLIB
+            return true;
+#else
+            return false;
+#endif
+        case CompressionCodec::zstd:
+#ifdef DD_WRAPPER_HAVE_ZSTD
+            return true;
+#else
+            return false;
+#endif
+    }
+    return false;
+}
+
+bool
+Datadog::Compression::configure(std::string_view _codec, int _level)
+{
+    CompressionCodec new_codec = CompressionCodec::lz4;
+    bool ok = true;
+    if (_codec == "gzip") {
+        new_codec = CompressionCodec::gzip;
+    } else if (_codec == "zstd") {
+        new_codec = CompressionCodec::zstd;
+    } else if (!_codec.empty() && _codec != "lz4") {
+        std::cerr << "Unknown compression codec " << _codec << ", profiles will be compressed with lz4" << std::endl;
+        ok = false;
+    }
+    if (!available(new_codec)) {
+        std::cerr << "Compression codec " << _codec << " is not available, profiles will be compressed with lz4"
+                  << std::endl;
+        new_codec = CompressionCodec::lz4;
+        ok = false;
+    }
+
+    const std::lock_guard<std::mutex> lock(mtx);
+    codec = new_codec;
+    level = std::max(_level, 0);
+    return ok;
+}
+
+ddog_ByteSlice
+Datadog::Compression::apply(ddog_ByteSlice serialized, std::vector<uint8_t>& out)
+{
+    CompressionCodec cur_codec = CompressionCodec::lz4;
+    int cur_level = 0;
+    {
+        const std::lock_guard<std::mutex> lock(mtx);
+        cur_codec = codec;
+        cur_level = level;
+    }
+    if (cur_codec == CompressionCodec::lz4) {
+        ProfilerStats::set(ProfilerGauge::profile_compressed_bytes, serialized.len);
+        return serialized;
+    }
+
+    bool compressed = false;
+    {
+        const ProfilerStats::ScopedTimer timer(ProfilerTimer::compress);
+        std::vector<uint8_t> pprof;
+        pprof.reserve(serialized.len * 4);
+        if (lz4_frame_decode(serialized, pprof)) {
+            ProfilerStats::set(ProfilerGauge::profile_uncompressed_bytes, pprof.size());
+            compressed =
+              cur_codec == CompressionCodec::gzip ? gzip(pprof, cur_level, out) : zstd(pprof, cur_level, out);
+        }
+    }
+    if (!compressed) {
+        ProfilerStats::add(ProfilerCounter::compression_failures);
+        ProfilerStats::set(ProfilerGauge::profile_compressed_bytes, serialized.len);
+        out.clear();
+        return serialized;
+    }
+    ProfilerStats::set(ProfilerGauge::profile_compressed_bytes, out.size());
+    return { .ptr = out.data(), .len = out.size() };
+}
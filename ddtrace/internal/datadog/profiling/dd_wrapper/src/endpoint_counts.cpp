@@ -0,0 +1,99 @@
+#include "endpoint_counts.hpp"
+#include "libdatadog_helpers.hpp"
+#include "profiler_stats.hpp"
+
+#include <iostream>
+#include <new>
+
+size_t
+Datadog::EndpointCounts::intern(std::string_view endpoint)
+{
+    const std::lock_guard<std::mutex> lock(mtx);
+    auto it = indices.find(endpoint);
+    if (it != indices.end()) {
+        return it->second;
+    }
+    const size_t index = names.size();
+    if (index >= counts.size()) {
+        ProfilerStats::add(ProfilerCounter::endpoint_counts_dropped);
+        return invalid_index;
+    }
+    indices.emplace(names.emplace_back(endpoint), index);
+
+    // The counter must be visible to take() before its endpoint is hit
+    size.store(index + 1, std::memory_order_release);
+    return index;
+}
+
+void
+Datadog::EndpointCounts::add(size_t index, int64_t count)
+{
+    if (index < counts.size()) {
+        counts[index].fetch_add(count, std::memory_order_relaxed);
+    }
+}
+
+std::vector<std::pair<std::string_view, int64_t>>
+Datadog::EndpointCounts::take()
+{
+    std::vector<std::pair<std::string_view, int64_t>> result;
+
+    // Names are only ever appended, so the ones seen here stay where they are while the lock isn't held
+    const size_t cur_size = size.load(std::memory_order_acquire);
+    std::vector<std::string_view> cur_names;
+    {
+        const std::lock_guard<std::mutex> lock(mtx);
+        cur_names.assign(names.begin(), names.begin() + static_cast<std::ptrdiff_t>(cur_size));
+    }
+    for (size_t i = 0; i < cur_size; ++i) {
+        const int64_t count = counts[i].exchange(0, std::memory_order_relaxed);
+        if (count > 0) {
+            result.emplace_back(cur_names[i], count);
+        }
+    }
+    return result;
+}
+
+void
+Datadog::EndpointCounts::flush(ddog_prof_Profile& profile)
+{
+    for (const auto& [endpoint, count] : take()) {
+        auto res = ddog_prof_Profile_add_endpoint_count(&profile, to_slice(endpoint), count);
+        if (!res.ok) {          // NOLINT (cppcoreguidelines-pro-type-union-access)
+            auto err = res.err; // NOLINT (cppcoreguidelines-pro-type-union-access)
+            const std::string errmsg = err_to_msg(&err, "Error adding endpoint count to profile");
+            std::cerr << errmsg << std::endl;
+            ddog_Error_drop(&err);
+            return;
+        }
+    }
+}
+
+void
+Datadog::EndpointCounts::reset()
+{
+    for (auto& count : counts) {
+        count.store(0, std::memory_order_relaxed);
+    }
+}
+
+void
+Datadog::EndpointCounts::prefork()
+{
+    mtx.lock();
+}
+
+void
+Datadog::EndpointCounts::postfork_parent()
+{
+    mtx.unlock();
+}
+
+void
+Datadog::EndpointCounts::postfork_child()
+{
+    // The requests counted so far were served by the parent, but the endpoints stay registered, since the tracer of
+    // the child inherits their indices
+    new (&mtx) std::mutex();
+    reset();
+}
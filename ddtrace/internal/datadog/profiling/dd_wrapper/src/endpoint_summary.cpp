@@ -0,0 +1,228 @@
+#include "endpoint_summary.hpp"
+#include "libdatadog_helpers.hpp"
+#include "profiler_stats.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <new>
+
+namespace {
+
+inline void
+hash_combine(uint64_t& seed, uint64_t value)
+{
+    seed ^= value + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2);
+}
+
+} // namespace
+
+uint64_t
+Datadog::EndpointSummary::hash_stack(const ddog_prof_Location* locations, size_t num_locations)
+{
+    const std::hash<std::string_view> hasher{};
+    uint64_t seed = num_locations;
+    for (size_t i = 0; i < num_locations; ++i) {
+        hash_combine(seed, hasher(to_string_view(locations[i].function.name)));
+        hash_combine(seed, hasher(to_string_view(locations[i].function.filename)));
+        hash_combine(seed, static_cast<uint64_t>(locations[i].line));
+    }
+    return seed;
+}
+
+void
+Datadog::EndpointSummary::configure(size_t _max_stacks, int64_t window_ns)
+{
+    const std::lock_guard<std::mutex> lock(mtx);
+    if (window_ns <= 0) {
+        window_ns = g_default_endpoint_summary_window_ns;
+    }
+    max_stacks = _max_stacks;
+    slot_ns = std::max<int64_t>(window_ns / static_cast<int64_t>(g_endpoint_summary_slots), 1);
+    slots.assign(g_endpoint_summary_slots, Slot{});
+    is_enabled.store(max_stacks > 0, std::memory_order_relaxed);
+}
+
+bool
+Datadog::EndpointSummary::enabled()
+{
+    return is_enabled.load(std::memory_order_relaxed);
+}
+
+void
+Datadog::EndpointSummary::record(std::string_view endpoint,
+                                 const ddog_prof_Location* locations,
+                                 size_t num_locations,
+                                 int64_t cpu_time_ns,
+                                 int64_t wall_time_ns,
+                                 int64_t now_ns)
+{
+    if (endpoint.empty()) {
+        return;
+    }
+
+    // Everything which doesn't need the tables is done before taking the lock.  The key is kept around so that
+    // looking up the endpoint doesn't allocate.
+    const uint64_t key = hash_stack(locations, num_locations);
+    static thread_local std::string endpoint_key;
+    endpoint_key.assign(endpoint);
+
+    const std::lock_guard<std::mutex> lock(mtx);
+    if (slots.empty() || max_stacks == 0) {
+        return;
+    }
+    const int64_t index = now_ns / slot_ns;
+    Slot& slot = slots[static_cast<size_t>(index) % slots.size()];
+    if (slot.index != index) {
+        slot.index = index;
+        slot.endpoints.clear();
+    }
+
+    auto it = slot.endpoints.find(endpoint_key);
+    if (it == slot.endpoints.end()) {
+        if (slot.endpoints.size() >= g_endpoint_summary_max_endpoints) {
+            ProfilerStats::add(ProfilerCounter::endpoint_summary_dropped);
+            return;
+        }
+        it = slot.endpoints.emplace(endpoint_key, std::vector<Entry>{}).first;
+        it->second.reserve(max_stacks);
+    }
+
+    auto& table = it->second;
+    Entry* found = nullptr;
+    Entry* smallest = nullptr;
+    for (auto& entry : table) {
+        if (entry.key == key) {
+            found = &entry;
+            break;
+        }
+        if (smallest == nullptr || entry.stack.samples < smallest->stack.samples) {
+            smallest = &entry;
+        }
+    }
+
+    if (found == nullptr) {
+        if (table.size() < max_stacks) {
+            found = &table.emplace_back();
+        } else {
+            // The new stack takes over the count of the one it evicts, which is what bounds its error
+            found = smallest;
+            found->stack.error = found->stack.samples;
+            found->stack.cpu_time_ns = 0;
+            found->stack.wall_time_ns = 0;
+        }
+        found->key = key;
+        found->stack.frames.clear();
+        found->stack.frames.reserve(num_locations);
+        for (size_t i = 0; i < num_locations; ++i) {
+            found->stack.frames.push_back({ std::string(to_string_view(locations[i].function.name)),
+                                            std::string(to_string_view(locations[i].function.filename)),
+                                            locations[i].line });
+        }
+    }
+
+    found->stack.samples += 1;
+    found->stack.cpu_time_ns += cpu_time_ns;
+    found->stack.wall_time_ns += wall_time_ns;
+}
+
+std::vector<std::string>
+Datadog::EndpointSummary::endpoints(int64_t now_ns)
+{
+    std::vector<std::string> result;
+    const std::lock_guard<std::mutex> lock(mtx);
+    if (slots.empty()) {
+        return result;
+    }
+    const int64_t current = now_ns / slot_ns;
+    for (const auto& slot : slots) {
+        if (slot.index < 0 || slot.index > current || current - slot.index >= static_cast<int64_t>(slots.size())) {
+            continue;
+        }
+        for (const auto& [endpoint, table] : slot.endpoints) {
+            if (std::find(result.begin(), result.end(), endpoint) == result.end()) {
+                result.push_back(endpoint);
+            }
+        }
+    }
+    return result;
+}
+
+std::vector<Datadog::SummaryStack>
+Datadog::EndpointSummary::top(std::string_view endpoint, int64_t now_ns)
+{
+    std::vector<SummaryStack> result;
+    size_t limit = 0;
+    {
+        const std::lock_guard<std::mutex> lock(mtx);
+        if (slots.empty()) {
+            return result;
+        }
+        limit = max_stacks;
+        const std::string endpoint_key(endpoint);
+        const int64_t current = now_ns / slot_ns;
+        std::unordered_map<uint64_t, size_t> positions;
+        for (const auto& slot : slots) {
+            if (slot.index < 0 || slot.index > current ||
+                current - slot.index >= static_cast<int64_t>(slots.size())) {
+                continue;
+            }
+            auto it = slot.endpoints.find(endpoint_key);
+            if (it == slot.endpoints.end()) {
+                continue;
+            }
+            for (const auto& entry : it->second) {
+                auto [position, inserted] = positions.emplace(entry.key, result.size());
+                if (inserted) {
+                    result.push_back(entry.stack);
+                    continue;
+                }
+                SummaryStack& merged = result[position->second];
+                merged.samples += entry.stack.samples;
+                merged.error += entry.stack.error;
+                merged.cpu_time_ns += entry.stack.cpu_time_ns;
+                merged.wall_time_ns += entry.stack.wall_time_ns;
+            }
+        }
+    }
+
+    std::sort(result.begin(), result.end(), [](const SummaryStack& a, const SummaryStack& b) {
+        return a.samples > b.samples;
+    });
+    if (result.size() > limit) {
+        result.resize(limit);
+    }
+    return result;
+}
+
+void
+Datadog::EndpointSummary::reset()
+{
+    const std::lock_guard<std::mutex> lock(mtx);
+    for (auto& slot : slots) {
+        slot.index = -1;
+        slot.endpoints.clear();
+    }
+}
+
+void
+Datadog::EndpointSummary::prefork()
+{
+    mtx.lock();
+}
+
+void
+Datadog::EndpointSummary::postfork_parent()
+{
+    mtx.unlock();
+}
+
+void
+Datadog::EndpointSummary::postfork_child()
+{
+    // The child starts with empty profiles, so it starts with an empty summary as well
+    new (&mtx) std::mutex();
+    for (auto& slot : slots) {
+        slot.index = -1;
+        slot.endpoints.clear();
+    }
+}
@@ -0,0 +1,233 @@
+#include "heap_live_set.hpp"
+#include "constants.hpp"
+#include "libdatadog_helpers.hpp"
+#include "profiler_stats.hpp"
+#include "sample.hpp"
+#include "sample_manager.hpp"
+
+#include <functional>
+#include <new>
+#include <string_view>
+
+namespace {
+
+inline void
+hash_combine(uint64_t& seed, uint64_t value)
+{
+    seed ^= value + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2);
+}
+
+} // namespace
+
+uint64_t
+Datadog::HeapLiveSet::hash_sample(const ddog_prof_Location* locations,
+                                  size_t num_locations,
+                                  const ddog_prof_Label* labels,
+                                  size_t num_labels)
+{
+    const std::hash<std::string_view> hasher{};
+    uint64_t seed = num_locations;
+    for (size_t i = 0; i < num_locations; ++i) {
+        hash_combine(seed, hasher(to_string_view(locations[i].function.name)));
+        hash_combine(seed, hasher(to_string_view(locations[i].function.filename)));
+        hash_combine(seed, locations[i].address);
+        hash_combine(seed, static_cast<uint64_t>(locations[i].line));
+    }
+    for (size_t i = 0; i < num_labels; ++i) {
+        hash_combine(seed, hasher(to_string_view(labels[i].key)));
+        hash_combine(seed, hasher(to_string_view(labels[i].str)));
+        hash_combine(seed, static_cast<uint64_t>(labels[i].num));
+    }
+    return seed;
+}
+
+bool
+Datadog::HeapLiveSet::same_sample(const Stack& stack,
+                                  const ddog_prof_Location* locations,
+                                  size_t num_locations,
+                                  const ddog_prof_Label* labels,
+                                  size_t num_labels)
+{
+    if (stack.frames.size() != num_locations || stack.labels.size() != num_labels) {
+        return false;
+    }
+    for (size_t i = 0; i < num_locations; ++i) {
+        const auto& frame = stack.frames[i];
+        if (frame.name != to_string_view(locations[i].function.name) ||
+            frame.filename != to_string_view(locations[i].function.filename) ||
+            frame.address != locations[i].address || frame.line != locations[i].line) {
+            return false;
+        }
+    }
+    for (size_t i = 0; i < num_labels; ++i) {
+        const auto& label = stack.labels[i];
+        if (label.key != to_string_view(labels[i].key) || label.str != to_string_view(labels[i].str) ||
+            label.num != labels[i].num) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void
+Datadog::HeapLiveSet::update_stats()
+{
+    ProfilerStats::set(ProfilerGauge::heap_live_samples, live.size());
+    ProfilerStats::set(ProfilerGauge::heap_live_stacks, stacks.size());
+}
+
+bool
+Datadog::HeapLiveSet::add(uint64_t id,
+                          const ddog_prof_Location* locations,
+                          size_t num_locations,
+                          const ddog_prof_Label* labels,
+                          size_t num_labels,
+                          int64_t size)
+{
+    const uint64_t hash = hash_sample(locations, num_locations, labels, num_labels);
+
+    const std::lock_guard<std::mutex> lock(mtx);
+    if (live.find(id) != live.end()) {
+        return true;
+    }
+
+    // Collisions are resolved by probing the next keys
+    uint64_t key = hash;
+    auto it = stacks.find(key);
+    while (it != stacks.end() && !same_sample(it->second, locations, num_locations, labels, num_labels)) {
+        it = stacks.find(++key);
+    }
+
+    if (it == stacks.end()) {
+        if (stacks.size() >= g_heap_live_set_max_stacks) {
+            ProfilerStats::add(ProfilerCounter::heap_live_dropped);
+            return false;
+        }
+        it = stacks.emplace(key, Stack{}).first;
+        auto& stack = it->second;
+        stack.frames.reserve(num_locations);
+        for (size_t i = 0; i < num_locations; ++i) {
+            stack.frames.push_back({ std::string(to_string_view(locations[i].function.name)),
+                                     std::string(to_string_view(locations[i].function.filename)),
+                                     locations[i].address,
+                                     locations[i].line });
+        }
+        stack.labels.reserve(num_labels);
+        for (size_t i = 0; i < num_labels; ++i) {
+            stack.labels.push_back({ std::string(to_string_view(labels[i].key)),
+                                     std::string(to_string_view(labels[i].str)),
+                                     labels[i].num });
+        }
+    }
+
+    it->second.size += size;
+    it->second.count += 1;
+    live.emplace(id, LiveSample{ key, size });
+    live_bytes += size;
+    update_stats();
+    return true;
+}
+
+void
+Datadog::HeapLiveSet::remove(uint64_t id)
+{
+    const std::lock_guard<std::mutex> lock(mtx);
+    auto it = live.find(id);
+    if (it == live.end()) {
+        return;
+    }
+
+    auto stack = stacks.find(it->second.stack_key);
+    if (stack != stacks.end()) {
+        stack->second.size -= it->second.size;
+        if (--stack->second.count == 0) {
+            stacks.erase(stack);
+        }
+    }
+    live_bytes -= it->second.size;
+    live.erase(it);
+    update_stats();
+}
+
+void
+Datadog::HeapLiveSet::clear()
+{
+    const std::lock_guard<std::mutex> lock(mtx);
+    stacks.clear();
+    live.clear();
+    live_bytes = 0;
+    update_stats();
+}
+
+void
+Datadog::HeapLiveSet::flush()
+{
+    const std::lock_guard<std::mutex> lock(mtx);
+    if (stacks.empty()) {
+        return;
+    }
+
+    Sample* sample = SampleManager::start_sample();
+    if (sample == nullptr) {
+        return;
+    }
+
+    // The strings go through the string table like those of any other sample, since the profile only keeps views
+    LabelSet label_set;
+    for (const auto& [key, stack] : stacks) {
+        label_set.clear();
+        for (const auto& label : stack.labels) {
+            auto& interned = label_set.emplace_back();
+            interned.key = to_slice(Sample::intern_string(label.key));
+            interned.str = to_slice(Sample::intern_string(label.str));
+            interned.num = label.num;
+        }
+        sample->push_label_set(label_set);
+        for (const auto& frame : stack.frames) {
+            sample->push_frame(frame.name, frame.filename, frame.address, frame.line);
+        }
+        sample->push_heap(stack.size);
+        sample->flush_sample();
+    }
+    SampleManager::drop_sample(sample);
+}
+
+size_t
+Datadog::HeapLiveSet::num_samples()
+{
+    const std::lock_guard<std::mutex> lock(mtx);
+    return live.size();
+}
+
+size_t
+Datadog::HeapLiveSet::num_stacks()
+{
+    const std::lock_guard<std::mutex> lock(mtx);
+    return stacks.size();
+}
+
+int64_t
+Datadog::HeapLiveSet::num_bytes()
+{
+    const std::lock_guard<std::mutex> lock(mtx);
+    return live_bytes;
+}
+
+void
+Datadog::HeapLiveSet::prefork()
+{
+    mtx.lock();
+}
+
+void
+Datadog::HeapLiveSet::postfork_parent()
+{
+    mtx.unlock();
+}
+
+void
+Datadog::HeapLiveSet::postfork_child()
+{
+    // The heap tracker of the child inherits the live samples, so they are kept
+    new (&mtx) std::mutex();
+}
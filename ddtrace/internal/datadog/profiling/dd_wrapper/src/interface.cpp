@@ -1,13 +1,25 @@
 #include "interface.hpp"
+#include "burst_profile.hpp"
+#include "compression.hpp"
+#include "endpoint_counts.hpp"
+#include "endpoint_summary.hpp"
+#include "heap_live_set.hpp"
 #include "libdatadog_helpers.hpp"
+#include "native_mappings.hpp"
 #include "profile.hpp"
+#include "profile_file_sink.hpp"
+#include "profile_spool.hpp"
+#include "profiler_stats.hpp"
 #include "sample.hpp"
 #include "sample_manager.hpp"
+#include "shared_aggregation.hpp"
+#include "upload_worker.hpp"
 #include "uploader.hpp"
 #include "uploader_builder.hpp"
 
 #include <cstdlib>
 #include <iostream>
+#include <iterator>
 #include <unistd.h>
 
 // State
@@ -20,23 +32,50 @@ void
 ddup_postfork_child()
 {
     Datadog::Uploader::postfork_child();
+    Datadog::UploadWorker::postfork_child();
+    Datadog::HeapLiveSet::postfork_child();
     Datadog::SampleManager::postfork_child();
+    Datadog::EndpointCounts::postfork_child();
+    Datadog::EndpointSummary::postfork_child();
+    Datadog::SharedAggregation::postfork_child();
+    Datadog::NativeMappings::postfork_child();
+    Datadog::BurstProfile::postfork_child();
 }
 
 void
 ddup_postfork_parent()
 {
+    Datadog::BurstProfile::postfork_parent();
+    Datadog::SharedAggregation::postfork_parent();
+    Datadog::EndpointSummary::postfork_parent();
+    Datadog::EndpointCounts::postfork_parent();
+    Datadog::SampleManager::postfork_parent();
+    Datadog::HeapLiveSet::postfork_parent();
     Datadog::Uploader::postfork_parent();
+    Datadog::UploadWorker::postfork_parent();
 }
 
-// Since we don't control the internal state of libdatadog's exporter and we want to prevent state-tearing
-// after a `fork()`, we just outright prevent uploads from happening during a `fork()` operation.  Since a
-// new upload may be scheduled _just_ as `fork()` is entered, we also need to prevent new uploads from happening.
-// This mutex is released in both the child and the parent.
+// Since we don't control the internal state of libdatadog's exporter, the child never reuses it.  Everything
+// else is locked across the `fork()`, so that the child inherits consistent state it can keep using (notably, the
+// string table).  The locks are released in both the child and the parent.
 void
 ddup_prefork()
 {
+    Datadog::UploadWorker::prefork();
     Datadog::Uploader::prefork();
+    Datadog::HeapLiveSet::prefork();
+    Datadog::SampleManager::prefork();
+    Datadog::EndpointCounts::prefork();
+    Datadog::EndpointSummary::prefork();
+    Datadog::SharedAggregation::prefork();
+    Datadog::BurstProfile::prefork();
+}
+
+// Give the upload thread a chance to send whatever was already submitted before the process goes away
+void
+ddup_shutdown()
+{
+    Datadog::UploadWorker::shutdown();
 }
 
 // Configuration
@@ -105,6 +144,105 @@ ddup_config_max_nframes(int max_nframes) // cppcheck-suppress unusedFunction
     Datadog::SampleManager::set_max_nframes(max_nframes);
 }
 
+void
+ddup_config_type_max_nframes(unsigned int type, int max_nframes) // cppcheck-suppress unusedFunction
+{
+    if (max_nframes > 0) {
+        Datadog::SampleManager::set_type_max_nframes(type, static_cast<unsigned int>(max_nframes));
+    }
+}
+
+void
+ddup_config_sample_pool_capacity(uint64_t sample_pool_capacity) // cppcheck-suppress unusedFunction
+{
+    Datadog::SampleManager::set_sample_pool_capacity(sample_pool_capacity);
+}
+
+void
+ddup_config_timeline(bool enabled) // cppcheck-suppress unusedFunction
+{
+    Datadog::SampleManager::set_timeline(enabled);
+}
+
+void
+ddup_config_string_table_max_bytes(uint64_t max_bytes) // cppcheck-suppress unusedFunction
+{
+    Datadog::SampleManager::set_string_table_max_bytes(max_bytes);
+}
+
+void
+ddup_config_spool(std::string_view dir, uint64_t max_bytes) // cppcheck-suppress unusedFunction
+{
+    Datadog::ProfileSpool::configure(dir, max_bytes);
+}
+
+void
+ddup_config_output_pprof(std::string_view prefix,
+                         uint64_t max_files,
+                         uint64_t max_bytes) // cppcheck-suppress unusedFunction
+{
+    Datadog::ProfileFileSink::configure(prefix, max_files, max_bytes);
+}
+
+bool
+ddup_config_compression(std::string_view codec, int level) // cppcheck-suppress unusedFunction
+{
+    return Datadog::Compression::configure(codec, level);
+}
+
+void
+ddup_config_endpoint_summary(uint64_t max_stacks, int64_t window_ns) // cppcheck-suppress unusedFunction
+{
+    Datadog::EndpointSummary::configure(max_stacks, window_ns);
+}
+
+void
+ddup_config_shared_aggregation(std::string_view name, uint64_t max_stacks) // cppcheck-suppress unusedFunction
+{
+    if (!Datadog::SharedAggregation::configure(name, max_stacks)) {
+        std::cerr << "Could not map the shared aggregation segment, each process uploads its own profile" << std::endl;
+    }
+}
+
+void
+ddup_endpoint_summary_endpoints(std::vector<std::string>* out) // cppcheck-suppress unusedFunction
+{
+    auto endpoints = Datadog::EndpointSummary::endpoints(Datadog::Sample::monotonic_now_ns());
+    out->insert(out->end(), std::make_move_iterator(endpoints.begin()), std::make_move_iterator(endpoints.end()));
+}
+
+void
+ddup_endpoint_summary_top(std::string_view endpoint,
+                          std::vector<Datadog::SummaryStack>* out) // cppcheck-suppress unusedFunction
+{
+    auto stacks = Datadog::EndpointSummary::top(endpoint, Datadog::Sample::monotonic_now_ns());
+    out->insert(out->end(), std::make_move_iterator(stacks.begin()), std::make_move_iterator(stacks.end()));
+}
+
+size_t
+ddup_endpoint_count_intern(std::string_view endpoint) // cppcheck-suppress unusedFunction
+{
+    return Datadog::EndpointCounts::intern(endpoint);
+}
+
+void
+ddup_endpoint_count_add(size_t index) // cppcheck-suppress unusedFunction
+{
+    Datadog::EndpointCounts::add(index);
+}
+
+size_t
+ddup_stats_size() // cppcheck-suppress unusedFunction
+{
+    return Datadog::ProfilerStats::size();
+}
+
+bool
+ddup_stats_get(size_t index, std::string_view* name, uint64_t* value) // cppcheck-suppress unusedFunction
+{
+    return Datadog::ProfilerStats::get(index, *name, *value);
+}
+
 bool
 ddup_is_initialized() // cppcheck-suppress unusedFunction
 {
@@ -121,6 +259,7 @@ ddup_init() // cppcheck-suppress unusedFunction
         // install the ddup_fork_handler for pthread_atfork
         // Right now, only do things in the child _after_ fork
         pthread_atfork(ddup_prefork, ddup_postfork_parent, ddup_postfork_child);
+        std::atexit(ddup_shutdown);
 
         // Set the global initialization flag
         is_ddup_initialized = true;
@@ -171,6 +310,12 @@ ddup_push_heap(Datadog::Sample* sample, int64_t size) // cppcheck-suppress unuse
     sample->push_heap(size);
 }
 
+void
+ddup_push_monotonic_ns(Datadog::Sample* sample, int64_t monotonic_ns) // cppcheck-suppress unusedFunction
+{
+    sample->push_monotonic_ns(monotonic_ns);
+}
+
 void
 ddup_push_lock_name(Datadog::Sample* sample, std::string_view lock_name) // cppcheck-suppress unusedFunction
 {
@@ -237,6 +382,13 @@ ddup_push_class_name(Datadog::Sample* sample, std::string_view class_name) // cp
     sample->push_class_name(class_name);
 }
 
+void
+ddup_push_allocation_domain(Datadog::Sample* sample, // cppcheck-suppress unusedFunction
+                            std::string_view allocation_domain)
+{
+    sample->push_allocation_domain(allocation_domain);
+}
+
 void
 ddup_push_frame(Datadog::Sample* sample, // cppcheck-suppress unusedFunction
                 std::string_view _name,
@@ -247,6 +399,14 @@ ddup_push_frame(Datadog::Sample* sample, // cppcheck-suppress unusedFunction
     sample->push_frame(_name, _filename, address, line);
 }
 
+void
+ddup_push_native_frame(Datadog::Sample* sample, // cppcheck-suppress unusedFunction
+                       uint64_t address,
+                       std::string_view _name)
+{
+    sample->push_native_frame(address, _name);
+}
+
 void
 ddup_flush_sample(Datadog::Sample* sample) // cppcheck-suppress unusedFunction
 {
@@ -259,6 +419,24 @@ ddup_drop_sample(Datadog::Sample* sample) // cppcheck-suppress unusedFunction
     Datadog::SampleManager::drop_sample(sample);
 }
 
+void
+ddup_heap_live_add(Datadog::Sample* sample, uint64_t id) // cppcheck-suppress unusedFunction
+{
+    sample->add_to_heap_live_set(id);
+}
+
+void
+ddup_heap_live_remove(uint64_t id) // cppcheck-suppress unusedFunction
+{
+    Datadog::HeapLiveSet::remove(id);
+}
+
+void
+ddup_heap_live_clear() // cppcheck-suppress unusedFunction
+{
+    Datadog::HeapLiveSet::clear();
+}
+
 bool
 ddup_upload() // cppcheck-suppress unusedFunction
 {
@@ -267,25 +445,7 @@ ddup_upload() // cppcheck-suppress unusedFunction
         return false;
     }
 
-    bool success = false;
-    {
-        // There are a few things going on here.
-        //   * profile_borrow takes a reference in a way that locks the areas where the profile might
-        //     be modified.  It gets released and cleared after uploading.
-        //   * Uploading cancels inflight uploads. There are better ways to do this, but this is what
-        //     we have for now.
-        auto uploader = Datadog::UploaderBuilder::build();
-        struct
-        {
-            void operator()(Datadog::Uploader& uploader)
-            {
-                uploader.upload(Datadog::Sample::profile_borrow());
-                Datadog::Sample::profile_release();
-                Datadog::Sample::profile_clear_state();
-            }
-            void operator()(const std::string& err) { std::cerr << "Failed to create uploader: " << err << std::endl; }
-        } visitor;
-        std::visit(visitor, uploader);
-    }
-    return success;
+    // Serialization and sending happen on the upload thread.  Here, we only need to swap the
+    // profile buffers, which is quick.
+    return Datadog::UploadWorker::submit();
 }
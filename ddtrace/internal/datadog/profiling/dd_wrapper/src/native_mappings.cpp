@@ -0,0 +1,235 @@
+#include "native_mappings.hpp"
+
+#include "libdatadog_helpers.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <new>
+
+#include <elf.h>
+#include <link.h>
+#include <unistd.h>
+
+namespace {
+
+struct LoadedCounts
+{
+    uint64_t adds;
+    uint64_t subs;
+};
+
+// Older loaders don't report the counts, in which case the table is rebuilt every time it is found wanting
+bool
+read_counts(const dl_phdr_info* info, size_t size, LoadedCounts& counts)
+{
+    if (size < offsetof(dl_phdr_info, dlpi_subs) + sizeof(info->dlpi_subs)) {
+        return false;
+    }
+    counts = { info->dlpi_adds, info->dlpi_subs };
+    return true;
+}
+
+std::string
+read_build_id(const dl_phdr_info* info)
+{
+    static constexpr char hex[] = "0123456789abcdef";
+    for (ElfW(Half) i = 0; i < info->dlpi_phnum; i++) {
+        const ElfW(Phdr)& phdr = info->dlpi_phdr[i];
+        if (phdr.p_type != PT_NOTE) {
+            continue;
+        }
+
+        // Notes are padded to 4 bytes, which is also how they are aligned in 64-bit objects
+        const char* note = reinterpret_cast<const char*>(info->dlpi_addr + phdr.p_vaddr);
+        const char* end = note + phdr.p_memsz;
+        while (note + sizeof(ElfW(Nhdr)) <= end) {
+            const auto* nhdr = reinterpret_cast<const ElfW(Nhdr)*>(note);
+            const char* name = note + sizeof(ElfW(Nhdr));
+            const char* desc = name + ((nhdr->n_namesz + 3) & ~3U);
+            const char* next = desc + ((nhdr->n_descsz + 3) & ~3U);
+            if (next > end) {
+                break;
+            }
+            if (nhdr->n_type == NT_GNU_BUILD_ID && nhdr->n_namesz == 4 && std::memcmp(name, "GNU", 4) == 0) {
+                std::string build_id;
+                build_id.reserve(2 * nhdr->n_descsz);
+                for (ElfW(Word) j = 0; j < nhdr->n_descsz; j++) {
+                    const auto byte = static_cast<unsigned char>(desc[j]);
+                    build_id.push_back(hex[byte >> 4]);
+                    build_id.push_back(hex[byte & 0xf]);
+                }
+                return build_id;
+            }
+            note = next;
+        }
+    }
+    return {};
+}
+
+std::string
+main_executable()
+{
+    char path[4096];
+    const ssize_t len = readlink("/proc/self/exe", path, sizeof(path));
+    return len > 0 ? std::string(path, static_cast<size_t>(len)) : std::string();
+}
+
+} // namespace
+
+std::string_view
+Datadog::NativeMappings::keep(std::string_view str)
+{
+    return *strings.emplace(str).first;
+}
+
+void
+Datadog::NativeMappings::build()
+{
+    struct Object
+    {
+        std::string filename;
+        std::string build_id;
+        std::vector<ddog_prof_Mapping> segments;
+    };
+    struct State
+    {
+        std::vector<Object> objects;
+        LoadedCounts counts;
+        bool has_counts;
+        bool first;
+    };
+    State state{ {}, { 0, 0 }, false, true };
+
+    // The main executable comes first, without a name
+    dl_iterate_phdr(
+      [](dl_phdr_info* info, size_t size, void* data) -> int {
+          auto& st = *static_cast<State*>(data);
+          st.has_counts = read_counts(info, size, st.counts);
+          auto& object = st.objects.emplace_back();
+          object.filename = info->dlpi_name != nullptr ? info->dlpi_name : "";
+          if (object.filename.empty() && st.first) {
+              object.filename = main_executable();
+          }
+          st.first = false;
+          object.build_id = read_build_id(info);
+          for (ElfW(Half) i = 0; i < info->dlpi_phnum; i++) {
+              const ElfW(Phdr)& phdr = info->dlpi_phdr[i];
+              if (phdr.p_type != PT_LOAD || (phdr.p_flags & PF_X) == 0) {
+                  continue;
+              }
+              const uint64_t start = info->dlpi_addr + phdr.p_vaddr;
+              object.segments.push_back({ start, start + phdr.p_memsz, phdr.p_offset, {}, {} });
+          }
+          return 0;
+      },
+      &state);
+
+    mappings.clear();
+    for (auto& object : state.objects) {
+        const std::string_view filename = keep(object.filename);
+        const std::string_view build_id = keep(object.build_id);
+        for (auto& segment : object.segments) {
+            segment.filename = to_slice(filename);
+            segment.build_id = to_slice(build_id);
+            mappings.push_back(segment);
+        }
+    }
+    std::sort(mappings.begin(), mappings.end(), [](const auto& a, const auto& b) {
+        return a.memory_start < b.memory_start;
+    });
+
+    loaded_adds = state.has_counts ? state.counts.adds : 0;
+    loaded_subs = state.has_counts ? state.counts.subs : 0;
+    last_refresh = std::chrono::steady_clock::now();
+}
+
+bool
+Datadog::NativeMappings::changed()
+{
+    LoadedCounts counts{ 0, 0 };
+    bool has_counts = false;
+    struct State
+    {
+        LoadedCounts* counts;
+        bool* has_counts;
+    } state{ &counts, &has_counts };
+
+    // The counts are the same for every object, so the first one is enough
+    dl_iterate_phdr(
+      [](dl_phdr_info* info, size_t size, void* data) -> int {
+          auto& st = *static_cast<State*>(data);
+          *st.has_counts = read_counts(info, size, *st.counts);
+          return 1;
+      },
+      &state);
+    return !has_counts || counts.adds != loaded_adds || counts.subs != loaded_subs;
+}
+
+const ddog_prof_Mapping*
+Datadog::NativeMappings::find(uint64_t address)
+{
+    auto it = std::upper_bound(mappings.begin(), mappings.end(), address, [](uint64_t addr, const auto& mapping) {
+        return addr < mapping.memory_start;
+    });
+    if (it == mappings.begin()) {
+        return nullptr;
+    }
+    --it;
+    return address < it->memory_limit ? &*it : nullptr;
+}
+
+ddog_prof_Mapping
+Datadog::NativeMappings::lookup(uint64_t address)
+{
+    const std::lock_guard<std::mutex> lock(mtx);
+    if (mappings.empty()) {
+        build();
+    }
+
+    const ddog_prof_Mapping* mapping = find(address);
+    if (mapping == nullptr) {
+        const auto elapsed = std::chrono::steady_clock::now() - last_refresh;
+        if (elapsed >= std::chrono::nanoseconds(g_native_mappings_refresh_ns) && changed()) {
+            build();
+            mapping = find(address);
+        }
+    }
+    if (mapping == nullptr) {
+        return { 0, 0, 0, to_slice(""), to_slice("") };
+    }
+    return *mapping;
+}
+
+void
+Datadog::NativeMappings::refresh()
+{
+    const std::lock_guard<std::mutex> lock(mtx);
+    if (!mappings.empty() && changed()) {
+        build();
+    }
+}
+
+void
+Datadog::NativeMappings::postfork_child()
+{
+    // The child has the same objects loaded, at the same addresses
+    new (&mtx) std::mutex();
+}
+
+size_t
+Datadog::NativeMappings::size()
+{
+    const std::lock_guard<std::mutex> lock(mtx);
+    return mappings.size();
+}
+
+void
+Datadog::NativeMappings::reset()
+{
+    const std::lock_guard<std::mutex> lock(mtx);
+    mappings.clear();
+    last_refresh = {};
+    loaded_adds = 0;
+    loaded_subs = 0;
+}
@@ -1,8 +1,11 @@
 #include "profile.hpp"
+#include "endpoint_counts.hpp"
 #include "libdatadog_helpers.hpp"
 
 #include <functional>
 #include <iostream>
+#include <new>
+#include <thread>
 
 #include <fcntl.h>
 #include <sys/stat.h>
@@ -35,12 +38,37 @@ make_profile(const ddog_prof_Slice_ValueType& sample_types,
 bool
 Datadog::Profile::cycle_buffers()
 {
-    const std::lock_guard<std::mutex> lock(profile_mtx);
+    std::unique_lock<std::mutex> lock(profile_mtx, std::defer_lock);
+    {
+        const ProfilerStats::ScopedTimer timer(ProfilerTimer::profile_lock_wait);
+        lock.lock();
+    }
 
+    // Staged samples belong to the profile being cycled out, and so do the requests served in the meantime
+    drain_staging_buffers();
+    drain_aggregator();
+    EndpointCounts::flush(cur_profile);
     std::swap(last_profile, cur_profile);
 
-    // Clear the profile before using it
-    auto res = ddog_prof_Profile_reset(&cur_profile, nullptr);
+    // Everything added so far has been copied into the profile by libdatadog, so strings which don't get used
+    // again can start aging out.  Samples still being built keep working, since their strings live on until the
+    // next cycle.
+    strings.advance_generation();
+    ProfilerStats::set(ProfilerGauge::string_table_strings, strings.get_last_generation_strings());
+    ProfilerStats::set(ProfilerGauge::profile_distinct_samples, distinct_samples);
+    distinct_samples = 0;
+    ProfilerStats::set(ProfilerGauge::string_table_bytes, strings.get_bytes());
+    ProfilerStats::set(ProfilerGauge::string_table_hits, strings.get_hits());
+    ProfilerStats::set(ProfilerGauge::string_table_misses, strings.get_misses());
+    ProfilerStats::set(ProfilerGauge::string_table_rejected, strings.get_rejected());
+
+    // Clear the profile before using it.  libdatadog rebuilds its tables from scratch when resetting, and doesn't
+    // take any hint as to how large they should be, which is why this is timed.
+    ddog_prof_Profile_Result res{};
+    {
+        const ProfilerStats::ScopedTimer timer(ProfilerTimer::profile_reset);
+        res = ddog_prof_Profile_reset(&cur_profile, nullptr);
+    }
     if (!res.ok) {          // NOLINT (cppcoreguidelines-pro-type-union-access)
         auto err = res.err; // NOLINT (cppcoreguidelines-pro-type-union-access)
         const std::string errmsg = err_to_msg(&err, "Error resetting profile");
@@ -108,7 +136,14 @@ Datadog::Profile::profile_borrow()
 {
     // We could wrap this in an object for better RAII, but since this
     // sequence is only used in a single place, we'll hold off on that sidequest.
-    profile_mtx.lock();
+    {
+        const ProfilerStats::ScopedTimer timer(ProfilerTimer::profile_lock_wait);
+        profile_mtx.lock();
+    }
+
+    // Whoever borrows the profile expects to see every sample collected so far
+    drain_staging_buffers();
+    drain_aggregator();
     return cur_profile;
 }
 
@@ -118,6 +153,23 @@ Datadog::Profile::profile_release()
     profile_mtx.unlock();
 }
 
+ddog_prof_Profile&
+Datadog::Profile::last_profile_borrow()
+{
+    return last_profile;
+}
+
+bool
+Datadog::Profile::new_profile(ddog_prof_Profile& profile)
+{
+    // The sample types are fixed once the profile is initialized, so they can be read without the lock
+    if (first_time.load()) {
+        return false;
+    }
+    const ddog_prof_Slice_ValueType sample_types = { .ptr = samplers.data(), .len = samplers.size() };
+    return make_profile(sample_types, &default_period, profile);
+}
+
 void
 Datadog::Profile::one_time_init(SampleType type, unsigned int _max_nframes)
 {
@@ -165,16 +217,19 @@ Datadog::Profile::one_time_init(SampleType type, unsigned int _max_nframes)
 std::string_view
 Datadog::Profile::insert_or_get(std::string_view str)
 {
-    const std::lock_guard<std::mutex> lock(string_table_mtx); // Serialize access
+    return strings.insert_or_get(str);
+}
 
-    auto str_it = strings.find(str);
-    if (str_it != strings.end()) {
-        return *str_it;
-    }
+const Datadog::StringTable&
+Datadog::Profile::string_table()
+{
+    return strings;
+}
 
-    string_storage.emplace_back(str);
-    strings.insert(string_storage.back());
-    return string_storage.back();
+void
+Datadog::Profile::set_string_table_max_bytes(size_t max_bytes)
+{
+    strings.set_max_bytes(max_bytes);
 }
 
 const Datadog::ValueIndex&
@@ -183,12 +238,102 @@ Datadog::Profile::val()
     return val_idx;
 }
 
+Datadog::StagingBuffer&
+Datadog::Profile::get_staging_buffer()
+{
+    // Each thread registers its own buffer on first use.  When the thread exits, the buffer is marked as orphaned
+    // and the consumer releases it after its final drain.
+    struct StagingBufferHandle
+    {
+        std::shared_ptr<StagingBuffer> buffer;
+        ~StagingBufferHandle()
+        {
+            if (buffer != nullptr) {
+                buffer->orphaned.store(true);
+            }
+        }
+    };
+    thread_local StagingBufferHandle handle{};
+
+    if (handle.buffer == nullptr) {
+        handle.buffer = std::make_shared<StagingBuffer>(g_default_staging_capacity, std::this_thread::get_id());
+        const std::lock_guard<std::mutex> lock(staging_buffers_mtx);
+        staging_buffers.push_back(handle.buffer);
+    }
+    return *handle.buffer;
+}
+
+void
+Datadog::Profile::drain_staging_buffers()
+{
+    const std::lock_guard<std::mutex> lock(staging_buffers_mtx);
+    for (auto it = staging_buffers.begin(); it != staging_buffers.end();) {
+        // Check for orphaning before draining, since the producer may still push in between otherwise
+        const bool orphaned = (*it)->orphaned.load();
+        (*it)->drain(
+          [this](const ddog_prof_Sample& sample, int64_t timestamp_ns) { add_sample(sample, timestamp_ns); });
+        if (orphaned) {
+            it = staging_buffers.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
 bool
-Datadog::Profile::collect(const ddog_prof_Sample& sample)
+Datadog::Profile::collect(const ddog_prof_Sample& sample, int64_t timestamp_ns)
 {
-    // TODO this should propagate some kind of timestamp for timeline support
-    const std::lock_guard<std::mutex> lock(profile_mtx);
-    auto res = ddog_prof_Profile_add(&cur_profile, sample, 0);
+    auto& buffer = get_staging_buffer();
+    bool staged = buffer.push(sample, timestamp_ns);
+
+    // Move staged samples into the profile in a batch, but only if nobody else is using it.  If the buffer is
+    // already full, the sample is dropped rather than waiting on the lock.
+    if (buffer.size() >= g_default_staging_drain_threshold || !staged) {
+        std::unique_lock<std::mutex> lock(profile_mtx, std::try_to_lock);
+        if (!lock.owns_lock()) {
+            ProfilerStats::add(ProfilerCounter::profile_lock_contended);
+        } else {
+            buffer.drain([this](const ddog_prof_Sample& staged_sample, int64_t staged_timestamp_ns) {
+                add_sample(staged_sample, staged_timestamp_ns);
+            });
+            if (!staged) {
+                staged = add_sample(sample, timestamp_ns);
+            }
+        }
+    }
+
+    ProfilerStats::add(staged ? ProfilerCounter::samples_collected : ProfilerCounter::samples_dropped);
+    return staged;
+}
+
+void
+Datadog::Profile::drain_aggregator()
+{
+    if (aggregator.size() == 0) {
+        return;
+    }
+    const ProfilerStats::ScopedTimer timer(ProfilerTimer::aggregator_drain);
+    distinct_samples += aggregator.size();
+    aggregator.drain([this](const ddog_prof_Sample& sample) { add_to_profile(sample, 0); });
+}
+
+bool
+Datadog::Profile::add_sample(const ddog_prof_Sample& sample, int64_t timestamp_ns)
+{
+    if (timestamp_ns != 0) {
+        return add_to_profile(sample, timestamp_ns);
+    }
+    if (!aggregator.add(sample)) {
+        drain_aggregator();
+        aggregator.add(sample);
+    }
+    return true;
+}
+
+bool
+Datadog::Profile::add_to_profile(const ddog_prof_Sample& sample, int64_t timestamp_ns)
+{
+    auto res = ddog_prof_Profile_add(&cur_profile, sample, timestamp_ns);
     if (!res.ok) {          // NOLINT (cppcoreguidelines-pro-type-union-access)
         auto err = res.err; // NOLINT (cppcoreguidelines-pro-type-union-access)
         const std::string errmsg = err_to_msg(&err, "Error adding sample to profile");
@@ -199,9 +344,54 @@ Datadog::Profile::collect(const ddog_prof_Sample& sample)
     return true;
 }
 
+void
+Datadog::Profile::prefork()
+{
+    // Same order as collect() and profile_borrow(), so this can't deadlock against them
+    profile_mtx.lock();
+    staging_buffers_mtx.lock();
+    strings.prefork();
+}
+
+void
+Datadog::Profile::postfork_parent()
+{
+    strings.postfork_parent();
+    staging_buffers_mtx.unlock();
+    profile_mtx.unlock();
+}
+
 void
 Datadog::Profile::postfork_child()
 {
+    strings.postfork_child();
+    aggregator.clear();
+
+    // Only the forking thread survives in the child, so every other thread's buffer is orphaned.  Staged
+    // samples belong to the parent's profile, so they're dropped along with it.
+    for (auto& buffer : staging_buffers) {
+        buffer->discard();
+        if (buffer->owner != std::this_thread::get_id()) {
+            buffer->orphaned.store(true);
+        }
+    }
+    staging_buffers_mtx.unlock();
+
+    // The samples collected so far belong to the parent, which will upload them itself
+    auto res = ddog_prof_Profile_reset(&cur_profile, nullptr);
+    if (!res.ok) {          // NOLINT (cppcoreguidelines-pro-type-union-access)
+        auto err = res.err; // NOLINT (cppcoreguidelines-pro-type-union-access)
+        const std::string errmsg = err_to_msg(&err, "Error resetting profile after fork");
+        std::cerr << errmsg << std::endl;
+        ddog_Error_drop(&err);
+    }
+
+    // The stale half may have been in the middle of being serialized by the upload thread, which doesn't exist in
+    // the child.  Rather than touching it, leave it to the parent (its pages are shared until written) and start a
+    // new one.
+    const ddog_prof_Slice_ValueType sample_types = { .ptr = samplers.data(), .len = samplers.size() };
+    if (!make_profile(sample_types, &default_period, last_profile)) {
+        std::cerr << "Error initializing bottom half of profile storage after fork" << std::endl;
+    }
     profile_mtx.unlock();
-    cycle_buffers();
 }
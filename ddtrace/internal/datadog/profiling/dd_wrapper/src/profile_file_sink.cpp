@@ -0,0 +1,83 @@
+#include "profile_file_sink.hpp"
+#include "profiler_stats.hpp"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <new>
+#include <unistd.h>
+
+void
+Datadog::ProfileFileSink::configure(std::string_view _prefix, uint64_t _max_files, uint64_t _max_bytes)
+{
+    const std::lock_guard<std::mutex> lock(mtx);
+    prefix = _prefix;
+    max_files = _max_files > 0 ? _max_files : g_default_file_sink_max_files;
+    max_bytes = _max_bytes > 0 ? _max_bytes : g_default_file_sink_max_bytes;
+    seq = 0;
+}
+
+bool
+Datadog::ProfileFileSink::enabled()
+{
+    const std::lock_guard<std::mutex> lock(mtx);
+    return !prefix.empty();
+}
+
+bool
+Datadog::ProfileFileSink::write(ddog_ByteSlice data)
+{
+    const std::lock_guard<std::mutex> lock(mtx);
+    if (prefix.empty()) {
+        return false;
+    }
+    if (data.len > max_bytes) {
+        std::cerr << "Discarding profile of " << data.len << " bytes, which is over the file size limit" << std::endl;
+        ProfilerStats::add(ProfilerCounter::file_sink_failures);
+        return false;
+    }
+
+    // Numbered from 1, like the files of the legacy exporter
+    const std::string path = prefix + "." + std::to_string(getpid()) + "." + std::to_string(seq % max_files + 1);
+    const std::string tmp_path = path + ".tmp";
+    ++seq;
+
+    const int fd = open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        std::cerr << "Error writing profile to " << tmp_path << ": " << std::strerror(errno) << std::endl;
+        ProfilerStats::add(ProfilerCounter::file_sink_failures);
+        return false;
+    }
+    const auto* ptr = data.ptr;
+    size_t len = data.len;
+    while (len > 0) {
+        const ssize_t ret = ::write(fd, ptr, len);
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ret < 0) {
+            break;
+        }
+        ptr += ret;
+        len -= static_cast<size_t>(ret);
+    }
+    close(fd);
+    if (len > 0 || rename(tmp_path.c_str(), path.c_str()) != 0) {
+        std::cerr << "Error writing profile to " << path << ": " << std::strerror(errno) << std::endl;
+        unlink(tmp_path.c_str());
+        ProfilerStats::add(ProfilerCounter::file_sink_failures);
+        return false;
+    }
+    ProfilerStats::add(ProfilerCounter::file_sink_writes);
+    return true;
+}
+
+void
+Datadog::ProfileFileSink::postfork_child()
+{
+    // The lock may have been held by the parent's upload thread.  The child has its own pid, hence its own ring.
+    new (&mtx) std::mutex();
+    seq = 0;
+}
@@ -0,0 +1,272 @@
+#include "profile_spool.hpp"
+#include "profiler_stats.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <iostream>
+#include <new>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr std::string_view spool_suffix = ".pprof";
+constexpr std::string_view claimed_suffix = ".claimed";
+constexpr std::array<char, 8> spool_magic = { 'D', 'D', 'S', 'P', 'O', 'O', 'L', '1' };
+
+// Laid out so there is no padding, since it is written to disk verbatim
+struct SpoolHeader
+{
+    std::array<char, 8> magic;
+    int64_t start_seconds;
+    int64_t end_seconds;
+    uint64_t size;
+    uint32_t start_nanoseconds;
+    uint32_t end_nanoseconds;
+};
+
+bool
+ends_with(std::string_view str, std::string_view suffix)
+{
+    return str.size() >= suffix.size() && str.substr(str.size() - suffix.size()) == suffix;
+}
+
+bool
+make_dirs(const std::string& path)
+{
+    for (size_t pos = path.find('/', 1); pos != std::string::npos; pos = path.find('/', pos + 1)) {
+        if (mkdir(path.substr(0, pos).c_str(), 0700) != 0 && errno != EEXIST) {
+            return false;
+        }
+    }
+    return mkdir(path.c_str(), 0700) == 0 || errno == EEXIST;
+}
+
+bool
+write_all(int fd, const void* buf, size_t len)
+{
+    const auto* ptr = static_cast<const uint8_t*>(buf);
+    while (len > 0) {
+        const ssize_t ret = write(fd, ptr, len);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        ptr += ret;
+        len -= static_cast<size_t>(ret);
+    }
+    return true;
+}
+
+bool
+read_all(int fd, void* buf, size_t len)
+{
+    auto* ptr = static_cast<uint8_t*>(buf);
+    while (len > 0) {
+        const ssize_t ret = read(fd, ptr, len);
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ret <= 0) {
+            return false;
+        }
+        ptr += ret;
+        len -= static_cast<size_t>(ret);
+    }
+    return true;
+}
+
+bool
+read_spooled(const std::string& path, Datadog::SpooledProfile& profile)
+{
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+
+    SpoolHeader header{};
+    struct stat st = {};
+    bool ok = read_all(fd, &header, sizeof(header)) && header.magic == spool_magic && fstat(fd, &st) == 0 &&
+              static_cast<uint64_t>(st.st_size) == sizeof(header) + header.size;
+    if (ok) {
+        profile.start = { .seconds = header.start_seconds, .nanoseconds = header.start_nanoseconds };
+        profile.end = { .seconds = header.end_seconds, .nanoseconds = header.end_nanoseconds };
+        profile.data.resize(header.size);
+        ok = read_all(fd, profile.data.data(), profile.data.size());
+    }
+    close(fd);
+    return ok;
+}
+
+} // namespace
+
+std::vector<std::pair<std::string, uint64_t>>
+Datadog::ProfileSpool::list()
+{
+    std::vector<std::pair<std::string, uint64_t>> files;
+    DIR* dirp = opendir(dir.c_str());
+    if (dirp == nullptr) {
+        return files;
+    }
+
+    // Temporary files start with a dot, and claimed files have a different suffix, so neither is listed
+    while (const dirent* entry = readdir(dirp)) {
+        const std::string_view name = entry->d_name;
+        if (name.empty() || name.front() == '.' || !ends_with(name, spool_suffix)) {
+            continue;
+        }
+        std::string path = dir + "/" + std::string(name);
+        struct stat st = {};
+        if (stat(path.c_str(), &st) == 0) {
+            files.emplace_back(std::move(path), static_cast<uint64_t>(st.st_size));
+        }
+    }
+    closedir(dirp);
+
+    // File names begin with the zero-padded start time, so this sorts them oldest first
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+bool
+Datadog::ProfileSpool::make_room(uint64_t incoming)
+{
+    auto files = list();
+    uint64_t total = 0;
+    for (const auto& [path, size] : files) {
+        total += size;
+    }
+    for (auto it = files.begin(); it != files.end() && total + incoming > max_bytes; ++it) {
+        if (unlink(it->first.c_str()) == 0) {
+            total -= it->second;
+            ProfilerStats::add(ProfilerCounter::spooled_uploads_discarded);
+        }
+    }
+    return total + incoming <= max_bytes;
+}
+
+void
+Datadog::ProfileSpool::configure(std::string_view _dir, uint64_t _max_bytes)
+{
+    const std::lock_guard<std::mutex> lock(mtx);
+    dir = _dir;
+    while (dir.size() > 1 && dir.back() == '/') {
+        dir.pop_back();
+    }
+    max_bytes = _max_bytes;
+}
+
+bool
+Datadog::ProfileSpool::enabled()
+{
+    const std::lock_guard<std::mutex> lock(mtx);
+    return !dir.empty();
+}
+
+bool
+Datadog::ProfileSpool::store(const ddog_Timespec& start, const ddog_Timespec& end, ddog_ByteSlice data)
+{
+    const std::lock_guard<std::mutex> lock(mtx);
+    if (dir.empty()) {
+        return false;
+    }
+
+    const SpoolHeader header = {
+        .magic = spool_magic,
+        .start_seconds = start.seconds,
+        .end_seconds = end.seconds,
+        .size = data.len,
+        .start_nanoseconds = start.nanoseconds,
+        .end_nanoseconds = end.nanoseconds,
+    };
+    const uint64_t size = sizeof(header) + data.len;
+    if (size > max_bytes || !make_dirs(dir) || !make_room(size)) {
+        ProfilerStats::add(ProfilerCounter::spooled_uploads_discarded);
+        return false;
+    }
+
+    // The name has to be unique across every process which may share the directory
+    std::array<char, 64> name{};
+    const int64_t start_ns = start.seconds * 1'000'000'000 + start.nanoseconds;
+    std::snprintf(name.data(),
+                  name.size(),
+                  "%020lld-%d-%llu",
+                  static_cast<long long>(start_ns),
+                  getpid(),
+                  static_cast<unsigned long long>(seq++));
+    const std::string tmp_path = dir + "/." + name.data() + ".tmp";
+    const std::string path = dir + "/" + name.data() + std::string(spool_suffix);
+
+    const int fd = open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        std::cerr << "Error spooling profile to " << tmp_path << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    const bool written = write_all(fd, &header, sizeof(header)) && write_all(fd, data.ptr, data.len);
+    close(fd);
+    if (!written || rename(tmp_path.c_str(), path.c_str()) != 0) {
+        std::cerr << "Error spooling profile to " << path << ": " << std::strerror(errno) << std::endl;
+        unlink(tmp_path.c_str());
+        return false;
+    }
+    ProfilerStats::add(ProfilerCounter::uploads_spooled);
+    return true;
+}
+
+std::optional<Datadog::SpooledProfile>
+Datadog::ProfileSpool::take()
+{
+    const std::lock_guard<std::mutex> lock(mtx);
+    if (dir.empty()) {
+        return std::nullopt;
+    }
+
+    for (auto& [path, size] : list()) {
+        // Renaming the file claims it; if that fails, another process got to it first
+        SpooledProfile profile;
+        profile.path = path + "." + std::to_string(getpid()) + std::string(claimed_suffix);
+        if (rename(path.c_str(), profile.path.c_str()) != 0) {
+            continue;
+        }
+        if (read_spooled(profile.path, profile)) {
+            return profile;
+        }
+        std::cerr << "Discarding unreadable spooled profile " << path << std::endl;
+        unlink(profile.path.c_str());
+        ProfilerStats::add(ProfilerCounter::spooled_uploads_discarded);
+    }
+    return std::nullopt;
+}
+
+void
+Datadog::ProfileSpool::release(const SpooledProfile& profile, bool sent)
+{
+    if (sent) {
+        unlink(profile.path.c_str());
+        ProfilerStats::add(ProfilerCounter::spooled_uploads_sent);
+        return;
+    }
+
+    // Drop the ".<pid>.claimed" suffix to put the file back where it was
+    const std::string_view claimed = profile.path;
+    const size_t pos = claimed.rfind('.', claimed.size() - claimed_suffix.size() - 1);
+    const std::string path(claimed.substr(0, pos));
+    if (rename(profile.path.c_str(), path.c_str()) != 0) {
+        unlink(profile.path.c_str());
+    }
+}
+
+void
+Datadog::ProfileSpool::postfork_child()
+{
+    // The lock may have been held by the parent's upload thread.  The spool itself lives on disk, and file names
+    // include the pid, so the child can keep using it as-is.
+    new (&mtx) std::mutex();
+}
@@ -0,0 +1,90 @@
+#include "profiler_stats.hpp"
+
+namespace {
+
+constexpr std::array<std::string_view, static_cast<size_t>(Datadog::ProfilerCounter::Length_)> counter_names = {
+    PROFILER_COUNTERS(X_STAT_STR)
+};
+constexpr std::array<std::string_view, static_cast<size_t>(Datadog::ProfilerGauge::Length_)> gauge_names = {
+    PROFILER_GAUGES(X_STAT_STR)
+};
+
+#define X_TIMER_STRS(a) #a "_count", #a "_total_ns", #a "_max_ns",
+constexpr std::array<std::string_view, 3 * static_cast<size_t>(Datadog::ProfilerTimer::Length_)> timer_names = {
+    PROFILER_TIMERS(X_TIMER_STRS)
+};
+#undef X_TIMER_STRS
+
+} // namespace
+
+void
+Datadog::ProfilerStats::record(ProfilerTimer timer, std::chrono::nanoseconds duration)
+{
+    const auto ns = static_cast<uint64_t>(duration.count() > 0 ? duration.count() : 0);
+    auto& cur = timers[static_cast<size_t>(timer)];
+    cur.count.fetch_add(1, std::memory_order_relaxed);
+    cur.total_ns.fetch_add(ns, std::memory_order_relaxed);
+
+    // There's no atomic max, so retry until either we win or someone else recorded something larger
+    uint64_t prev_max = cur.max_ns.load(std::memory_order_relaxed);
+    while (prev_max < ns && !cur.max_ns.compare_exchange_weak(prev_max, ns, std::memory_order_relaxed)) {
+    }
+}
+
+size_t
+Datadog::ProfilerStats::size()
+{
+    return num_counters + num_gauges + 3 * num_timers;
+}
+
+bool
+Datadog::ProfilerStats::get(size_t index, std::string_view& name, uint64_t& value)
+{
+    if (index < num_counters) {
+        name = counter_names[index];
+        value = counters[index].load(std::memory_order_relaxed);
+        return true;
+    }
+    index -= num_counters;
+
+    if (index < num_gauges) {
+        name = gauge_names[index];
+        value = gauges[index].load(std::memory_order_relaxed);
+        return true;
+    }
+    index -= num_gauges;
+
+    if (index < 3 * num_timers) {
+        name = timer_names[index];
+        const auto& timer = timers[index / 3];
+        switch (index % 3) {
+            case 0:
+                value = timer.count.load(std::memory_order_relaxed);
+                break;
+            case 1:
+                value = timer.total_ns.load(std::memory_order_relaxed);
+                break;
+            default:
+                value = timer.max_ns.load(std::memory_order_relaxed);
+                break;
+        }
+        return true;
+    }
+    return false;
+}
+
+void
+Datadog::ProfilerStats::reset()
+{
+    for (auto& counter : counters) {
+        counter.store(0, std::memory_order_relaxed);
+    }
+    for (auto& gauge : gauges) {
+        gauge.store(0, std::memory_order_relaxed);
+    }
+    for (auto& timer : timers) {
+        timer.count.store(0, std::memory_order_relaxed);
+        timer.total_ns.store(0, std::memory_order_relaxed);
+        timer.max_ns.store(0, std::memory_order_relaxed);
+    }
+}
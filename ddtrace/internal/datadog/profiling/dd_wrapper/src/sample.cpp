@@ -1,60 +1,91 @@
 #include "sample.hpp"
 
+#include "burst_profile.hpp"
+#include "endpoint_summary.hpp"
+#include "heap_live_set.hpp"
+#include "native_mappings.hpp"
+#include "shared_aggregation.hpp"
+
+#include <algorithm>
 #include <thread>
 
+#include <time.h>
+
+namespace {
+
+// Samples are timestamped with CLOCK_MONOTONIC, since it's cheap and immune to clock adjustments while the sample
+// is in flight, but the backend expects wall-clock timestamps.  The offset between the two is computed once.
+int64_t
+monotonic_to_epoch_offset_ns()
+{
+    static const int64_t offset = []() {
+        struct timespec realtime;
+        struct timespec monotonic;
+        clock_gettime(CLOCK_REALTIME, &realtime);
+        clock_gettime(CLOCK_MONOTONIC, &monotonic);
+        return (static_cast<int64_t>(realtime.tv_sec) - static_cast<int64_t>(monotonic.tv_sec)) * 1000000000LL +
+               (static_cast<int64_t>(realtime.tv_nsec) - static_cast<int64_t>(monotonic.tv_nsec));
+    }();
+    return offset;
+}
+
+} // namespace
+
 Datadog::Sample::Sample(SampleType _type_mask, unsigned int _max_nframes)
   : max_nframes{ _max_nframes }
   , type_mask{ _type_mask }
 {
     // Initialize values
-    values.resize(profile_state.get_sample_type_length());
-    std::fill(values.begin(), values.end(), 0);
+    num_values = std::min(profile_state.get_sample_type_length(), max_values);
 
     // Initialize other state
     locations.reserve(max_nframes + 1); // +1 for a "truncated frames" virtual frame
 }
 
-void
+bool
 Datadog::Sample::profile_clear_state()
 {
-    profile_state.cycle_buffers();
+    return profile_state.cycle_buffers();
 }
 
 void
 Datadog::Sample::push_frame_impl(std::string_view name, std::string_view filename, uint64_t address, int64_t line)
 {
-    static const ddog_prof_Mapping null_mapping = { 0, 0, 0, to_slice(""), to_slice("") };
     name = profile_state.insert_or_get(name);
     filename = profile_state.insert_or_get(filename);
-
-    const ddog_prof_Location loc = {
-        .mapping = null_mapping, // No support for mappings in Python
-        .function = {
-          .name = to_slice(name),
-          .system_name = {}, // No support for system_name in Python
-          .filename = to_slice(filename),
-          .start_line = 0, // We don't know the start_line for the function
-        },
-        .address = address,
-        .line = line,
-    };
-
-    locations.emplace_back(loc);
+    push_interned_frame_impl(name, filename, address, line);
 }
 
 void
 Datadog::Sample::push_frame(std::string_view name, std::string_view filename, uint64_t address, int64_t line)
 {
 
-    if (locations.size() <= max_nframes) {
+    if (locations.size() < max_nframes) {
         push_frame_impl(name, filename, address, line);
     } else {
         ++dropped_frames;
     }
 }
 
-bool
-Datadog::Sample::push_label(const ExportLabelKey key, std::string_view val)
+void
+Datadog::Sample::push_native_frame(uint64_t address, std::string_view name)
+{
+    if (locations.size() >= max_nframes) {
+        ++dropped_frames;
+        return;
+    }
+    push_interned_frame_impl(profile_state.insert_or_get(name), "", address, 0);
+    locations.back().mapping = NativeMappings::lookup(address);
+}
+
+std::string_view
+Datadog::Sample::intern_string(std::string_view str)
+{
+    return profile_state.insert_or_get(str);
+}
+
+void
+Datadog::Sample::append_label(LabelSet& dest, const ExportLabelKey key, std::string_view val)
 {
     // Get the sv for the key
     const std::string_view key_sv = to_string(key);
@@ -63,73 +94,240 @@ Datadog::Sample::push_label(const ExportLabelKey key, std::string_view val)
     // we don't return error
     // TODO is this what we want?
     if (val.empty() || key_sv.empty()) {
-        return true;
+        return;
     }
 
     // Otherwise, persist the val string and add the label
     val = profile_state.insert_or_get(val);
-    auto& label = labels.emplace_back();
+    auto& label = dest.emplace_back();
     label.key = to_slice(key_sv);
     label.str = to_slice(val);
-    return true;
 }
 
-bool
-Datadog::Sample::push_label(const ExportLabelKey key, int64_t val)
+void
+Datadog::Sample::append_label(LabelSet& dest, const ExportLabelKey key, int64_t val)
 {
     // Get the sv for the key.  If there is no key, then there
     // is no label.  Right now this is OK.
     // TODO make this not OK
     const std::string_view key_sv = to_string(key);
     if (key_sv.empty()) {
-        return true;
+        return;
     }
 
-    auto& label = labels.emplace_back();
+    auto& label = dest.emplace_back();
     label.key = to_slice(key_sv);
     label.str = to_slice("");
     label.num = val;
     label.num_unit = to_slice("");
+}
+
+void
+Datadog::Sample::append_threadinfo_labels(LabelSet& dest,
+                                          int64_t thread_id,
+                                          int64_t thread_native_id,
+                                          std::string_view thread_name)
+{
+    std::string temp_string;
+    if (thread_name.empty()) {
+        temp_string = std::to_string(thread_id);
+        thread_name = temp_string;
+    }
+    append_label(dest, ExportLabelKey::thread_id, thread_id);
+    append_label(dest, ExportLabelKey::thread_native_id, thread_native_id);
+    append_label(dest, ExportLabelKey::thread_name, thread_name);
+}
+
+uint64_t
+Datadog::Sample::string_generation()
+{
+    return profile_state.string_table().get_generation();
+}
+
+bool
+Datadog::Sample::push_label(const ExportLabelKey key, std::string_view val)
+{
+    append_label(labels, key, val);
+    return true;
+}
+
+bool
+Datadog::Sample::push_label(const ExportLabelKey key, int64_t val)
+{
+    append_label(labels, key, val);
     return true;
 }
 
+Datadog::LabelSet
+Datadog::Sample::make_threadinfo_labels(int64_t thread_id,
+                                        int64_t thread_native_id,
+                                        std::string_view thread_name,
+                                        int64_t interpreter_id)
+{
+    LabelSet label_set;
+    append_threadinfo_labels(label_set, thread_id, thread_native_id, thread_name);
+    if (interpreter_id != 0) {
+        append_label(label_set, ExportLabelKey::interpreter_id, interpreter_id);
+    }
+    return label_set;
+}
+
 void
 Datadog::Sample::clear_buffers()
 {
-    std::fill(values.begin(), values.end(), 0);
+    std::fill_n(values.begin(), num_values, 0);
     labels.clear();
     locations.clear();
     dropped_frames = 0;
+    endtime_ns = 0;
+    endpoint = {};
+    pushed_types = 0;
+}
+
+size_t
+Datadog::Sample::frame_limit() const
+{
+    if (pushed_types == 0) {
+        return max_nframes;
+    }
+    unsigned int limit = 0;
+    for (unsigned int i = 0; i < num_sample_types; ++i) {
+        if (0U != (pushed_types & (1U << i)) && type_max_nframes[i] > limit) {
+            limit = type_max_nframes[i];
+        }
+    }
+    return std::min(limit, max_nframes);
+}
+
+std::string_view
+Datadog::Sample::omitted_frames_name(size_t count)
+{
+    // Counts beyond this are rare enough that they are formatted every time
+    constexpr size_t max_cached = 256;
+
+    // Kept per thread, so there's no locking; the names are dropped along with the generation of the string table
+    // which holds them.
+    struct Cache
+    {
+        uint64_t generation = 0;
+        std::vector<std::string_view> names;
+    };
+    static thread_local Cache cache;
+
+    const auto format = [](size_t n) {
+        return "<" + std::to_string(n) + " frame" + (1 == n ? "" : "s") + " omitted>";
+    };
+    if (count >= max_cached) {
+        return profile_state.insert_or_get(format(count));
+    }
+
+    const uint64_t generation = string_generation();
+    if (cache.generation != generation) {
+        cache.generation = generation;
+        cache.names.clear();
+    }
+    if (cache.names.size() <= count) {
+        cache.names.resize(count + 1);
+    }
+    std::string_view& name = cache.names[count];
+    if (name.empty()) {
+        name = profile_state.insert_or_get(format(count));
+    }
+    return name;
 }
 
 bool
 Datadog::Sample::flush_sample()
 {
+    const ProfilerStats::ScopedTimer timer(ProfilerTimer::flush_sample);
+    const size_t limit = frame_limit();
+    if (locations.size() > limit) {
+        dropped_frames += locations.size() - limit;
+        locations.resize(limit);
+    }
     if (dropped_frames > 0) {
-        const std::string name =
-          "<" + std::to_string(dropped_frames) + " frame" + (1 == dropped_frames ? "" : "s") + " omitted>";
-        Sample::push_frame_impl(name, "", 0, 0);
+        ProfilerStats::add(ProfilerCounter::frames_truncated, dropped_frames);
+        push_interned_frame_impl(omitted_frames_name(dropped_frames), "", 0, 0);
     }
 
     const ddog_prof_Sample sample = {
         .locations = { locations.data(), locations.size() },
-        .values = { values.data(), values.size() },
+        .values = { values.data(), num_values },
         .labels = { labels.data(), labels.size() },
     };
 
-    const bool ret = profile_state.collect(sample);
+    // Without timeline support, a timestamp of 0 keeps the sample in the aggregate-only path
+    int64_t timestamp_ns = 0;
+    if (timeline_enabled) {
+        timestamp_ns = endtime_ns != 0 ? endtime_ns : monotonic_now_ns() + monotonic_to_epoch_offset_ns();
+    }
+
+    // Samples of a burst go to its own profile, and nowhere else
+    if (BurstProfile::routed()) {
+        const bool ret = BurstProfile::collect(sample, timestamp_ns);
+        clear_buffers();
+        return ret;
+    }
+
+    if (!endpoint.empty() && EndpointSummary::enabled()) {
+        const int64_t cpu_time_ns = has_types<SampleType::CPU>() ? values[value_index.cpu_time] : 0;
+        const int64_t wall_time_ns = has_types<SampleType::Wall>() ? values[value_index.wall_time] : 0;
+        EndpointSummary::record(
+          endpoint, locations.data(), locations.size(), cpu_time_ns, wall_time_ns, monotonic_now_ns());
+    }
+
+    // Behind a prefork server, the sample may go to the segment shared by all of the workers instead
+    if (SharedAggregation::record(locations.data(), locations.size(), values.data(), num_values)) {
+        clear_buffers();
+        return true;
+    }
+
+    const bool ret = profile_state.collect(sample, timestamp_ns);
     clear_buffers();
     return ret;
 }
 
+bool
+Datadog::Sample::add_to_heap_live_set(uint64_t id)
+{
+    const int64_t size = has_types<SampleType::Heap>() ? values[value_index.heap_space] : 0;
+    return HeapLiveSet::add(id, locations.data(), locations.size(), labels.data(), labels.size(), size);
+}
+
+bool
+Datadog::Sample::push_monotonic_ns(int64_t monotonic_ns)
+{
+    if (timeline_enabled && monotonic_ns > 0) {
+        endtime_ns = monotonic_ns + monotonic_to_epoch_offset_ns();
+    }
+    return true;
+}
+
+int64_t
+Datadog::Sample::monotonic_now_ns()
+{
+    struct timespec ts;
+#ifdef CLOCK_MONOTONIC_COARSE
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+#else
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+#endif
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000LL + static_cast<int64_t>(ts.tv_nsec);
+}
+
+bool
+Datadog::Sample::is_timeline_enabled()
+{
+    return timeline_enabled;
+}
+
 bool
 Datadog::Sample::push_cputime(int64_t cputime, int64_t count)
 {
     // NB all push-type operations return bool for semantic uniformity,
     // even if they can't error.  This should promote generic code.
-    if (0U != (type_mask & SampleType::CPU)) {
-        values[profile_state.val().cpu_time] += cputime * count;
-        values[profile_state.val().cpu_count] += count;
+    if (has_types<SampleType::CPU>()) {
+        push_value<SampleType::CPU>(cputime, count);
         return true;
     }
     std::cout << "bad push cpu" << std::endl;
@@ -139,9 +337,8 @@ Datadog::Sample::push_cputime(int64_t cputime, int64_t count)
 bool
 Datadog::Sample::push_walltime(int64_t walltime, int64_t count)
 {
-    if (0U != (type_mask & SampleType::Wall)) {
-        values[profile_state.val().wall_time] += walltime * count;
-        values[profile_state.val().wall_count] += count;
+    if (has_types<SampleType::Wall>()) {
+        push_value<SampleType::Wall>(walltime, count);
         return true;
     }
     std::cout << "bad push wall" << std::endl;
@@ -151,9 +348,9 @@ Datadog::Sample::push_walltime(int64_t walltime, int64_t count)
 bool
 Datadog::Sample::push_exceptioninfo(std::string_view exception_type, int64_t count)
 {
-    if (0U != (type_mask & SampleType::Exception)) {
+    if (has_types<SampleType::Exception>()) {
         push_label(ExportLabelKey::exception_type, exception_type);
-        values[profile_state.val().exception_count] += count;
+        push_value<SampleType::Exception>(0, count);
         return true;
     }
     std::cout << "bad push except" << std::endl;
@@ -163,9 +360,8 @@ Datadog::Sample::push_exceptioninfo(std::string_view exception_type, int64_t cou
 bool
 Datadog::Sample::push_acquire(int64_t acquire_time, int64_t count) // NOLINT (bugprone-easily-swappable-parameters)
 {
-    if (0U != (type_mask & SampleType::LockAcquire)) {
-        values[profile_state.val().lock_acquire_time] += acquire_time;
-        values[profile_state.val().lock_acquire_count] += count;
+    if (has_types<SampleType::LockAcquire>()) {
+        push_value<SampleType::LockAcquire>(acquire_time, count);
         return true;
     }
     std::cout << "bad push acquire" << std::endl;
@@ -175,9 +371,8 @@ Datadog::Sample::push_acquire(int64_t acquire_time, int64_t count) // NOLINT (bu
 bool
 Datadog::Sample::push_release(int64_t lock_time, int64_t count) // NOLINT (bugprone-easily-swappable-parameters)
 {
-    if (0U != (type_mask & SampleType::LockRelease)) {
-        values[profile_state.val().lock_release_time] += lock_time;
-        values[profile_state.val().lock_release_count] += count;
+    if (has_types<SampleType::LockRelease>()) {
+        push_value<SampleType::LockRelease>(lock_time, count);
         return true;
     }
     std::cout << "bad push release" << std::endl;
@@ -192,9 +387,8 @@ Datadog::Sample::push_alloc(int64_t size, int64_t count) // NOLINT (bugprone-eas
         return false;
     }
 
-    if (0U != (type_mask & SampleType::Allocation)) {
-        values[profile_state.val().alloc_space] += size;
-        values[profile_state.val().alloc_count] += count;
+    if (has_types<SampleType::Allocation>()) {
+        push_value<SampleType::Allocation>(size, count);
         return true;
     }
     std::cout << "bad push alloc" << std::endl;
@@ -209,8 +403,8 @@ Datadog::Sample::push_heap(int64_t size)
         return false;
     }
 
-    if (0U != (type_mask & SampleType::Heap)) {
-        values[profile_state.val().heap_space] += size;
+    if (has_types<SampleType::Heap>()) {
+        push_value<SampleType::Heap>(size, 1);
         return true;
     }
     std::cout << "bad push heap" << std::endl;
@@ -227,17 +421,24 @@ Datadog::Sample::push_lock_name(std::string_view lock_name)
 bool
 Datadog::Sample::push_threadinfo(int64_t thread_id, int64_t thread_native_id, std::string_view thread_name)
 {
-    std::string temp_string;
-    if (thread_name.empty()) {
-        temp_string = std::to_string(thread_id);
-        thread_name = temp_string;
-    }
-    if (!push_label(ExportLabelKey::thread_id, thread_id) ||
-        !push_label(ExportLabelKey::thread_native_id, thread_native_id) ||
-        !push_label(ExportLabelKey::thread_name, thread_name)) {
-        std::cout << "bad push" << std::endl;
-        return false;
-    }
+    append_threadinfo_labels(labels, thread_id, thread_native_id, thread_name);
+    return true;
+}
+
+bool
+Datadog::Sample::push_interpreter_id(int64_t interpreter_id)
+{
+    return push_label(ExportLabelKey::interpreter_id, interpreter_id);
+}
+
+bool
+Datadog::Sample::push_thread_state(std::string_view gil_state,
+                                   std::string_view thread_state,
+                                   std::string_view off_cpu_reason)
+{
+    push_label(ExportLabelKey::gil_state, gil_state);
+    push_label(ExportLabelKey::thread_state, thread_state);
+    push_label(ExportLabelKey::off_cpu_reason, off_cpu_reason);
     return true;
 }
 
@@ -303,6 +504,9 @@ Datadog::Sample::push_trace_resource_container(std::string_view trace_resource_c
         std::cout << "bad push" << std::endl;
         return false;
     }
+    if (!trace_resource_container.empty()) {
+        endpoint = to_string_view(labels.back().str);
+    }
     return true;
 }
 
@@ -316,6 +520,12 @@ Datadog::Sample::push_class_name(std::string_view class_name)
     return true;
 }
 
+bool
+Datadog::Sample::push_allocation_domain(std::string_view allocation_domain)
+{
+    return push_label(ExportLabelKey::allocation_domain, allocation_domain);
+}
+
 ddog_prof_Profile&
 Datadog::Sample::profile_borrow()
 {
@@ -328,6 +538,30 @@ Datadog::Sample::profile_release()
     profile_state.profile_release();
 }
 
+ddog_prof_Profile&
+Datadog::Sample::profile_last_borrow()
+{
+    return profile_state.last_profile_borrow();
+}
+
+bool
+Datadog::Sample::profile_new(ddog_prof_Profile& profile)
+{
+    return profile_state.new_profile(profile);
+}
+
+void
+Datadog::Sample::prefork()
+{
+    profile_state.prefork();
+}
+
+void
+Datadog::Sample::postfork_parent()
+{
+    profile_state.postfork_parent();
+}
+
 void
 Datadog::Sample::postfork_child()
 {
@@ -0,0 +1,136 @@
+#include "sample_aggregator.hpp"
+
+namespace {
+
+inline void
+hash_combine(uint64_t& seed, uint64_t value)
+{
+    seed ^= value + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2);
+}
+
+inline void
+hash_combine(uint64_t& seed, ddog_CharSlice slice)
+{
+    hash_combine(seed, reinterpret_cast<uintptr_t>(slice.ptr));
+    hash_combine(seed, slice.len);
+}
+
+inline bool
+same_slice(ddog_CharSlice a, ddog_CharSlice b)
+{
+    return a.ptr == b.ptr && a.len == b.len;
+}
+
+inline bool
+same_location(const ddog_prof_Location& a, const ddog_prof_Location& b)
+{
+    return a.address == b.address && a.line == b.line && same_slice(a.function.name, b.function.name) &&
+           same_slice(a.function.filename, b.function.filename) &&
+           same_slice(a.function.system_name, b.function.system_name) &&
+           a.function.start_line == b.function.start_line && a.mapping.memory_start == b.mapping.memory_start &&
+           a.mapping.memory_limit == b.mapping.memory_limit && a.mapping.file_offset == b.mapping.file_offset &&
+           same_slice(a.mapping.filename, b.mapping.filename) && same_slice(a.mapping.build_id, b.mapping.build_id);
+}
+
+inline bool
+same_label(const ddog_prof_Label& a, const ddog_prof_Label& b)
+{
+    return a.num == b.num && same_slice(a.key, b.key) && same_slice(a.str, b.str) &&
+           same_slice(a.num_unit, b.num_unit);
+}
+
+} // namespace
+
+Datadog::SampleAggregator::SampleAggregator(size_t _max_entries)
+  : max_entries{ _max_entries }
+{}
+
+uint64_t
+Datadog::SampleAggregator::hash(const ddog_prof_Sample& sample)
+{
+    // The mappings and the other fields which are hardly ever set only take part in the comparison
+    uint64_t seed = sample.locations.len;
+    for (size_t i = 0; i < sample.locations.len; ++i) {
+        const ddog_prof_Location& location = sample.locations.ptr[i];
+        hash_combine(seed, location.function.name);
+        hash_combine(seed, location.function.filename);
+        hash_combine(seed, location.address);
+        hash_combine(seed, static_cast<uint64_t>(location.line));
+    }
+    for (size_t i = 0; i < sample.labels.len; ++i) {
+        const ddog_prof_Label& label = sample.labels.ptr[i];
+        hash_combine(seed, label.key);
+        hash_combine(seed, label.str);
+        hash_combine(seed, static_cast<uint64_t>(label.num));
+    }
+    return seed;
+}
+
+bool
+Datadog::SampleAggregator::same_key(const StagedSample& entry, const ddog_prof_Sample& sample)
+{
+    if (entry.locations.size() != sample.locations.len || entry.labels.size() != sample.labels.len ||
+        entry.values.size() != sample.values.len) {
+        return false;
+    }
+    for (size_t i = 0; i < sample.locations.len; ++i) {
+        if (!same_location(entry.locations[i], sample.locations.ptr[i])) {
+            return false;
+        }
+    }
+    for (size_t i = 0; i < sample.labels.len; ++i) {
+        if (!same_label(entry.labels[i], sample.labels.ptr[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool
+Datadog::SampleAggregator::add(const ddog_prof_Sample& sample)
+{
+    const uint64_t key = hash(sample);
+    auto [first, last] = index.equal_range(key);
+    for (auto it = first; it != last; ++it) {
+        StagedSample& entry = entries[it->second];
+        if (same_key(entry, sample)) {
+            for (size_t i = 0; i < sample.values.len; ++i) {
+                entry.values[i] += sample.values.ptr[i];
+            }
+            return true;
+        }
+    }
+
+    if (used >= max_entries) {
+        return false;
+    }
+    if (used == entries.size()) {
+        entries.emplace_back();
+    }
+    entries[used].assign(sample, 0);
+    index.emplace(key, used);
+    ++used;
+    return true;
+}
+
+size_t
+Datadog::SampleAggregator::size() const
+{
+    return used;
+}
+
+void
+Datadog::SampleAggregator::drain(const std::function<void(const ddog_prof_Sample&)>& visitor)
+{
+    for (size_t i = 0; i < used; ++i) {
+        visitor(entries[i].as_sample());
+    }
+    clear();
+}
+
+void
+Datadog::SampleAggregator::clear()
+{
+    used = 0;
+    index.clear();
+}
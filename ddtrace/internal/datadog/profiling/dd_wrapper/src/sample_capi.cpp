@@ -0,0 +1,126 @@
+#include "sample_capi.h"
+
+#include "interface.hpp"
+#include "sample.hpp"
+
+#include <string_view>
+
+// ddup_sample_t is never defined; it only stands for a Datadog::Sample on the C side
+namespace {
+
+Datadog::Sample*
+to_sample(ddup_sample_t* sample)
+{
+    return reinterpret_cast<Datadog::Sample*>(sample); // NOLINT (cppcoreguidelines-pro-type-reinterpret-cast)
+}
+
+ddup_sample_t*
+capi_start_sample()
+{
+    return reinterpret_cast<ddup_sample_t*>(ddup_start_sample()); // NOLINT (cppcoreguidelines-pro-type-reinterpret-cast)
+}
+
+void
+capi_push_alloc(ddup_sample_t* sample, int64_t size, int64_t count)
+{
+    ddup_push_alloc(to_sample(sample), size, count);
+}
+
+void
+capi_push_heap(ddup_sample_t* sample, int64_t size)
+{
+    ddup_push_heap(to_sample(sample), size);
+}
+
+void
+capi_push_threadinfo(ddup_sample_t* sample,
+                     int64_t thread_id,
+                     int64_t thread_native_id,
+                     const char* thread_name,
+                     size_t thread_name_len)
+{
+    ddup_push_threadinfo(
+      to_sample(sample), thread_id, thread_native_id, std::string_view(thread_name, thread_name_len));
+}
+
+void
+capi_push_class_name(ddup_sample_t* sample, const char* class_name, size_t class_name_len)
+{
+    ddup_push_class_name(to_sample(sample), std::string_view(class_name, class_name_len));
+}
+
+void
+capi_push_allocation_domain(ddup_sample_t* sample, const char* allocation_domain, size_t allocation_domain_len)
+{
+    ddup_push_allocation_domain(to_sample(sample), std::string_view(allocation_domain, allocation_domain_len));
+}
+
+void
+capi_push_frame(ddup_sample_t* sample,
+                const char* name,
+                size_t name_len,
+                const char* filename,
+                size_t filename_len,
+                uint64_t address,
+                int64_t line)
+{
+    ddup_push_frame(to_sample(sample),
+                    std::string_view(name, name_len),
+                    std::string_view(filename, filename_len),
+                    address,
+                    line);
+}
+
+void
+capi_flush_sample(ddup_sample_t* sample)
+{
+    ddup_flush_sample(to_sample(sample));
+}
+
+void
+capi_drop_sample(ddup_sample_t* sample)
+{
+    ddup_drop_sample(to_sample(sample));
+}
+
+void
+capi_heap_live_add(ddup_sample_t* sample, uint64_t id)
+{
+    ddup_heap_live_add(to_sample(sample), id);
+}
+
+void
+capi_heap_live_remove(uint64_t id)
+{
+    ddup_heap_live_remove(id);
+}
+
+void
+capi_heap_live_clear()
+{
+    ddup_heap_live_clear();
+}
+
+constexpr ddup_sample_capi_t sample_capi = {
+    DDUP_SAMPLE_CAPI_VERSION,
+    capi_start_sample,
+    capi_push_alloc,
+    capi_push_heap,
+    capi_push_threadinfo,
+    capi_push_class_name,
+    capi_push_allocation_domain,
+    capi_push_frame,
+    capi_flush_sample,
+    capi_drop_sample,
+    capi_heap_live_add,
+    capi_heap_live_remove,
+    capi_heap_live_clear,
+};
+
+} // namespace
+
+const ddup_sample_capi_t*
+ddup_sample_capi_get() // cppcheck-suppress unusedFunction
+{
+    return &sample_capi;
+}
@@ -1,6 +1,8 @@
 #include "sample_manager.hpp"
 #include "types.hpp"
 
+#include <algorithm>
+
 void
 Datadog::SampleManager::add_type(unsigned int type)
 {
@@ -19,20 +21,97 @@ Datadog::SampleManager::set_max_nframes(unsigned int _max_nframes)
         // We don't emit an error here for now.
         max_nframes = g_backend_max_nframes;
     }
+    update_frame_limits();
+}
+
+void
+Datadog::SampleManager::set_type_max_nframes(unsigned int type, unsigned int _max_nframes)
+{
+    for (unsigned int i = 0; i < num_sample_types; ++i) {
+        if (0U != (type & (1U << i))) {
+            type_max_nframes[i] = std::min(_max_nframes, g_backend_max_nframes);
+        }
+    }
+    update_frame_limits();
+}
+
+void
+Datadog::SampleManager::update_frame_limits()
+{
+    // Like the rest of the configuration, this is only expected to change before samples are taken
+    sample_nframes = 0;
+    for (unsigned int i = 0; i < num_sample_types; ++i) {
+        const unsigned int limit = type_max_nframes[i] > 0 ? type_max_nframes[i] : max_nframes;
+        Datadog::Sample::type_max_nframes[i] = limit;
+        sample_nframes = std::max(sample_nframes, limit);
+    }
+}
+
+void
+Datadog::SampleManager::set_sample_pool_capacity(size_t _sample_pool_capacity)
+{
+    // The pool is built during init(), so this only has an effect before then
+    if (_sample_pool_capacity > 0) {
+        sample_pool_capacity = _sample_pool_capacity;
+    }
+}
+
+void
+Datadog::SampleManager::set_timeline(bool _timeline_enabled)
+{
+    Datadog::Sample::timeline_enabled = _timeline_enabled;
+}
+
+void
+Datadog::SampleManager::set_string_table_max_bytes(size_t max_bytes)
+{
+    if (max_bytes > 0) {
+        Datadog::Sample::profile_state.set_string_table_max_bytes(max_bytes);
+    }
 }
 
 Datadog::Sample*
 Datadog::SampleManager::start_sample()
 {
-    return new Datadog::Sample(type_mask, max_nframes); // NOLINT(cppcoreguidelines-owning-memory)
+    if (sample_pool != nullptr) {
+        auto sample_opt = sample_pool->take_sample();
+        if (sample_opt.has_value()) {
+            return sample_opt.value();
+        }
+    }
+    return new Datadog::Sample(type_mask, sample_nframes); // NOLINT(cppcoreguidelines-owning-memory)
 }
 
 void
 Datadog::SampleManager::drop_sample(Datadog::Sample* sample)
 {
+    if (sample == nullptr) {
+        return;
+    }
+
+    // Samples may be dropped without having been flushed, so make sure they're clean before reuse
+    sample->clear_buffers();
+    if (sample_pool != nullptr) {
+        auto sample_opt = sample_pool->return_sample(sample);
+        if (!sample_opt.has_value()) {
+            return;
+        }
+    }
     delete sample; // NOLINT(cppcoreguidelines-owning-memory)
 }
 
+void
+Datadog::SampleManager::prefork()
+{
+    Datadog::Sample::prefork();
+}
+
+void
+Datadog::SampleManager::postfork_parent()
+{
+    Datadog::Sample::postfork_parent();
+}
+
 void
 Datadog::SampleManager::postfork_child()
 {
@@ -42,5 +121,11 @@ Datadog::SampleManager::postfork_child()
 void
 Datadog::SampleManager::init()
 {
-    Datadog::Sample::profile_state.one_time_init(type_mask, max_nframes);
+    Datadog::Sample::profile_state.one_time_init(type_mask, sample_nframes);
+    Datadog::Sample::value_index = Datadog::Sample::profile_state.val();
+
+    // Samples are sized according to the configuration above, so the pool can only be created afterward
+    if (sample_pool == nullptr) {
+        sample_pool = std::make_unique<SynchronizedSamplePool>(sample_pool_capacity);
+    }
 }
@@ -0,0 +1,571 @@
+#include "shared_aggregation.hpp"
+#include "libdatadog_helpers.hpp"
+#include "profiler_stats.hpp"
+#include "sample.hpp"
+#include "sample_manager.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <new>
+#include <thread>
+
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr uint64_t segment_magic = 0x6464707368616767ULL; // "ddpshagg"
+constexpr unsigned int lock_spins = 1024;
+constexpr size_t min_stacks = 16;
+constexpr size_t max_stacks_limit = size_t{ 1 } << 20; // keeps the string offsets within 32 bits
+constexpr auto attach_timeout = std::chrono::seconds(1);
+
+inline void
+hash_combine(uint64_t& seed, uint64_t value)
+{
+    seed ^= value + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2);
+}
+
+// Zero marks an empty slot in the hash tables of the segment
+inline uint64_t
+slot_hash(uint64_t hash)
+{
+    return hash | 1U;
+}
+
+inline size_t
+align_up(size_t value)
+{
+    constexpr size_t alignment = alignof(std::max_align_t);
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+inline bool
+is_alive(pid_t pid)
+{
+    return kill(pid, 0) == 0 || errno != ESRCH;
+}
+
+} // namespace
+
+struct Datadog::SharedAggregation::Header
+{
+    std::atomic<uint64_t> magic;
+    std::atomic<pid_t> lock_owner;
+    std::atomic<pid_t> uploader;
+    std::atomic<int64_t> last_upload_ns;
+    uint64_t max_stacks;
+    uint32_t num_values;
+    uint32_t num_strings;
+    uint32_t string_bytes_used;
+    uint32_t num_stacks;
+    uint32_t num_frames;
+    uint32_t num_entries;
+};
+
+struct Datadog::SharedAggregation::StringSlot
+{
+    uint64_t hash;
+    uint32_t offset;
+    uint32_t size;
+};
+
+struct Datadog::SharedAggregation::StackSlot
+{
+    uint64_t hash;
+    uint32_t first_frame;
+    uint32_t num_frames;
+};
+
+// Strings are referred to by the index of their slot, so interned frames can be compared directly
+struct Datadog::SharedAggregation::FrameRecord
+{
+    uint32_t name;
+    uint32_t filename;
+    int64_t line;
+};
+
+struct Datadog::SharedAggregation::EntrySlot
+{
+    uint64_t hash;
+    uint32_t stack;
+    pid_t pid;
+    int64_t values[g_shared_aggregation_max_values];
+};
+
+static_assert(std::atomic<pid_t>::is_always_lock_free && std::atomic<int64_t>::is_always_lock_free &&
+                std::atomic<uint64_t>::is_always_lock_free,
+              "The atomics of the shared segment must be lock-free to work across processes");
+
+Datadog::SharedAggregation::Layout
+Datadog::SharedAggregation::make_layout(size_t max_stacks)
+{
+    // Every table is a power of two, and is kept at most half full so that probing stays short
+    size_t stacks = min_stacks;
+    while (stacks < std::min(max_stacks, max_stacks_limit)) {
+        stacks <<= 1;
+    }
+
+    Layout result{};
+    result.max_stacks = stacks;
+    result.string_slots = 4 * stacks;
+    result.string_bytes = stacks * g_shared_aggregation_string_bytes_per_stack;
+    result.stack_slots = 2 * stacks;
+    result.max_frames = stacks * g_shared_aggregation_frames_per_stack;
+    result.entry_slots = 2 * stacks * g_shared_aggregation_entries_per_stack;
+
+    result.strings_offset = align_up(sizeof(Header));
+    result.string_bytes_offset = align_up(result.strings_offset + result.string_slots * sizeof(StringSlot));
+    result.stacks_offset = align_up(result.string_bytes_offset + result.string_bytes);
+    result.frames_offset = align_up(result.stacks_offset + result.stack_slots * sizeof(StackSlot));
+    result.entries_offset = align_up(result.frames_offset + result.max_frames * sizeof(FrameRecord));
+    result.size = align_up(result.entries_offset + result.entry_slots * sizeof(EntrySlot));
+    return result;
+}
+
+void
+Datadog::SharedAggregation::init_segment(char* base, const Layout& _layout)
+{
+    auto* hdr = new (base) Header{};
+    hdr->max_stacks = _layout.max_stacks;
+
+    // Whoever attaches to a named segment waits for this, so it goes last
+    hdr->magic.store(segment_magic, std::memory_order_release);
+}
+
+bool
+Datadog::SharedAggregation::map_anonymous(const Layout& _layout)
+{
+    void* mapped = mmap(nullptr, _layout.size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (mapped == MAP_FAILED) {
+        return false;
+    }
+    segment = static_cast<char*>(mapped);
+    init_segment(segment, _layout);
+    return true;
+}
+
+bool
+Datadog::SharedAggregation::map_named(std::string_view _name, const Layout& _layout)
+{
+    std::string path(_name);
+    if (path.front() != '/') {
+        path.insert(path.begin(), '/');
+    }
+
+    // The first process to get there creates and initializes the segment, the others wait until it is ready
+    bool created = true;
+    int fd = shm_open(path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0 && errno == EEXIST) {
+        created = false;
+        fd = shm_open(path.c_str(), O_RDWR, 0600);
+    }
+    if (fd < 0) {
+        return false;
+    }
+
+    const auto deadline = std::chrono::steady_clock::now() + attach_timeout;
+    if (created) {
+        if (ftruncate(fd, static_cast<off_t>(_layout.size)) != 0) {
+            close(fd);
+            shm_unlink(path.c_str());
+            return false;
+        }
+    } else {
+        struct stat st = {};
+        while (fstat(fd, &st) == 0 && st.st_size == 0 && std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        if (static_cast<size_t>(st.st_size) != _layout.size) {
+            // Configured with another size by someone else, or never initialized
+            close(fd);
+            return false;
+        }
+    }
+
+    void* mapped = mmap(nullptr, _layout.size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        return false;
+    }
+    segment = static_cast<char*>(mapped);
+
+    if (created) {
+        init_segment(segment, _layout);
+        return true;
+    }
+    auto& hdr = header();
+    while (hdr.magic.load(std::memory_order_acquire) != segment_magic && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    if (hdr.magic.load(std::memory_order_acquire) != segment_magic || hdr.max_stacks != _layout.max_stacks) {
+        unmap();
+        return false;
+    }
+    return true;
+}
+
+void
+Datadog::SharedAggregation::unmap()
+{
+    // A named segment outlives the processes using it, so the next server to start may reuse it
+    if (segment != nullptr) {
+        munmap(segment, layout.size);
+        segment = nullptr;
+    }
+}
+
+Datadog::SharedAggregation::Header&
+Datadog::SharedAggregation::header()
+{
+    return *std::launder(reinterpret_cast<Header*>(segment)); // NOLINT (cppcoreguidelines-pro-type-reinterpret-cast)
+}
+
+void
+Datadog::SharedAggregation::lock()
+{
+    auto& owner = header().lock_owner;
+    for (unsigned int spins = 0;; ++spins) {
+        pid_t expected = 0;
+        if (owner.compare_exchange_weak(expected, pid, std::memory_order_acquire, std::memory_order_relaxed)) {
+            return;
+        }
+        if (spins < lock_spins) {
+            continue;
+        }
+        spins = 0;
+
+        // A process which died while holding the lock may have left the tables half-updated, so they are cleared
+        if (expected != 0 && expected != pid && !is_alive(expected) &&
+            owner.compare_exchange_strong(expected, pid, std::memory_order_acquire, std::memory_order_relaxed)) {
+            clear();
+            return;
+        }
+        sched_yield();
+    }
+}
+
+void
+Datadog::SharedAggregation::unlock()
+{
+    header().lock_owner.store(0, std::memory_order_release);
+}
+
+bool
+Datadog::SharedAggregation::intern(std::string_view str, uint32_t& slot_index)
+{
+    auto& hdr = header();
+    auto* slots = reinterpret_cast<StringSlot*>(segment + layout.strings_offset); // NOLINT
+    char* bytes = segment + layout.string_bytes_offset;
+
+    const uint64_t hash = slot_hash(std::hash<std::string_view>{}(str));
+    const size_t mask = layout.string_slots - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        StringSlot& slot = slots[i];
+        if (slot.hash == 0) {
+            if (hdr.num_strings >= layout.string_slots / 2 ||
+                hdr.string_bytes_used + str.size() > layout.string_bytes) {
+                return false;
+            }
+            std::memcpy(bytes + hdr.string_bytes_used, str.data(), str.size());
+            slot.hash = hash;
+            slot.offset = hdr.string_bytes_used;
+            slot.size = static_cast<uint32_t>(str.size());
+            hdr.string_bytes_used += slot.size;
+            hdr.num_strings += 1;
+            slot_index = static_cast<uint32_t>(i);
+            return true;
+        }
+        if (slot.hash == hash && std::string_view(bytes + slot.offset, slot.size) == str) {
+            slot_index = static_cast<uint32_t>(i);
+            return true;
+        }
+    }
+}
+
+bool
+Datadog::SharedAggregation::intern_stack(const ddog_prof_Location* locations, size_t num_locations, uint32_t& stack)
+{
+    // Frames are interned first, so that stacks can be compared by the indices of their strings
+    static thread_local std::vector<FrameRecord> interned;
+    interned.clear();
+    uint64_t hash = num_locations;
+    for (size_t i = 0; i < num_locations; ++i) {
+        auto& frame = interned.emplace_back();
+        if (!intern(to_string_view(locations[i].function.name), frame.name) ||
+            !intern(to_string_view(locations[i].function.filename), frame.filename)) {
+            return false;
+        }
+        frame.line = locations[i].line;
+        hash_combine(hash, frame.name);
+        hash_combine(hash, frame.filename);
+        hash_combine(hash, static_cast<uint64_t>(frame.line));
+    }
+    hash = slot_hash(hash);
+
+    auto& hdr = header();
+    auto* slots = reinterpret_cast<StackSlot*>(segment + layout.stacks_offset);   // NOLINT
+    auto* frames = reinterpret_cast<FrameRecord*>(segment + layout.frames_offset); // NOLINT
+    const auto same_frame = [](const FrameRecord& a, const FrameRecord& b) {
+        return a.name == b.name && a.filename == b.filename && a.line == b.line;
+    };
+
+    const size_t mask = layout.stack_slots - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        StackSlot& slot = slots[i];
+        if (slot.hash == 0) {
+            if (hdr.num_stacks >= layout.max_stacks || hdr.num_frames + num_locations > layout.max_frames) {
+                return false;
+            }
+            std::copy(interned.begin(), interned.end(), frames + hdr.num_frames);
+            slot.hash = hash;
+            slot.first_frame = hdr.num_frames;
+            slot.num_frames = static_cast<uint32_t>(num_locations);
+            hdr.num_frames += slot.num_frames;
+            hdr.num_stacks += 1;
+            stack = static_cast<uint32_t>(i);
+            return true;
+        }
+        if (slot.hash == hash && slot.num_frames == num_locations &&
+            std::equal(interned.begin(), interned.end(), frames + slot.first_frame, same_frame)) {
+            stack = static_cast<uint32_t>(i);
+            return true;
+        }
+    }
+}
+
+void
+Datadog::SharedAggregation::clear()
+{
+    auto& hdr = header();
+    std::memset(segment + layout.strings_offset, 0, layout.string_slots * sizeof(StringSlot));
+    std::memset(segment + layout.stacks_offset, 0, layout.stack_slots * sizeof(StackSlot));
+    std::memset(segment + layout.entries_offset, 0, layout.entry_slots * sizeof(EntrySlot));
+    hdr.num_strings = 0;
+    hdr.string_bytes_used = 0;
+    hdr.num_stacks = 0;
+    hdr.num_frames = 0;
+    hdr.num_entries = 0;
+}
+
+bool
+Datadog::SharedAggregation::configure(std::string_view _name, size_t max_stacks)
+{
+    const std::lock_guard<std::mutex> guard(mtx);
+    if (max_stacks == 0) {
+        is_enabled.store(false, std::memory_order_relaxed);
+        unmap();
+        name.clear();
+        return true;
+    }
+
+    const Layout new_layout = make_layout(max_stacks);
+    if (segment != nullptr && name == _name && layout.max_stacks == new_layout.max_stacks) {
+        is_enabled.store(true, std::memory_order_relaxed);
+        return true;
+    }
+
+    is_enabled.store(false, std::memory_order_relaxed);
+    unmap();
+    pid = getpid();
+    layout = new_layout;
+    const bool mapped = _name.empty() ? map_anonymous(layout) : map_named(_name, layout);
+    name = mapped ? std::string(_name) : std::string();
+    is_enabled.store(mapped, std::memory_order_relaxed);
+    return mapped;
+}
+
+bool
+Datadog::SharedAggregation::enabled()
+{
+    return is_enabled.load(std::memory_order_relaxed);
+}
+
+bool
+Datadog::SharedAggregation::record(const ddog_prof_Location* locations,
+                                   size_t num_locations,
+                                   const int64_t* values,
+                                   size_t num_values)
+{
+    if (!enabled() || merging) {
+        return false;
+    }
+
+    const std::lock_guard<std::mutex> guard(mtx);
+    if (segment == nullptr) {
+        return false;
+    }
+
+    bool recorded = false;
+    lock();
+    auto& hdr = header();
+
+    // Every process is expected to collect the same sample types, and the first one to record decides which
+    if (hdr.num_values == 0 && num_values <= g_shared_aggregation_max_values) {
+        hdr.num_values = static_cast<uint32_t>(num_values);
+    }
+    uint32_t stack = 0;
+    if (num_values == hdr.num_values && intern_stack(locations, num_locations, stack)) {
+        auto* slots = reinterpret_cast<EntrySlot*>(segment + layout.entries_offset); // NOLINT
+        uint64_t hash = stack;
+        hash_combine(hash, static_cast<uint64_t>(pid));
+        hash = slot_hash(hash);
+
+        const size_t mask = layout.entry_slots - 1;
+        for (size_t i = hash & mask;; i = (i + 1) & mask) {
+            EntrySlot& slot = slots[i];
+            if (slot.hash == 0) {
+                if (hdr.num_entries >= layout.entry_slots / 2) {
+                    break;
+                }
+                slot.hash = hash;
+                slot.stack = stack;
+                slot.pid = pid;
+                hdr.num_entries += 1;
+            } else if (slot.hash != hash || slot.stack != stack || slot.pid != pid) {
+                continue;
+            }
+            for (size_t v = 0; v < num_values; ++v) {
+                slot.values[v] += values[v];
+            }
+            recorded = true;
+            break;
+        }
+    }
+    unlock();
+
+    ProfilerStats::add(recorded ? ProfilerCounter::samples_collected : ProfilerCounter::shared_aggregation_dropped);
+    return true;
+}
+
+bool
+Datadog::SharedAggregation::elect(int64_t now_ns)
+{
+    const std::lock_guard<std::mutex> guard(mtx);
+    if (segment == nullptr) {
+        return true;
+    }
+
+    auto& hdr = header();
+    pid_t current = hdr.uploader.load(std::memory_order_relaxed);
+    if (current != pid) {
+        const bool stale = current == 0 || !is_alive(current) ||
+                           now_ns - hdr.last_upload_ns.load(std::memory_order_relaxed) > g_shared_aggregation_stale_ns;
+        if (!stale || !hdr.uploader.compare_exchange_strong(current, pid, std::memory_order_relaxed)) {
+            return false;
+        }
+    }
+    hdr.last_upload_ns.store(now_ns, std::memory_order_relaxed);
+    return true;
+}
+
+std::vector<Datadog::SharedStack>
+Datadog::SharedAggregation::take()
+{
+    std::vector<SharedStack> result;
+    const std::lock_guard<std::mutex> guard(mtx);
+    if (segment == nullptr) {
+        return result;
+    }
+
+    lock();
+    auto& hdr = header();
+    const auto* strings = reinterpret_cast<const StringSlot*>(segment + layout.strings_offset); // NOLINT
+    const char* bytes = segment + layout.string_bytes_offset;
+    const auto* stacks = reinterpret_cast<const StackSlot*>(segment + layout.stacks_offset);    // NOLINT
+    const auto* frames = reinterpret_cast<const FrameRecord*>(segment + layout.frames_offset);  // NOLINT
+    const auto* entries = reinterpret_cast<const EntrySlot*>(segment + layout.entries_offset);  // NOLINT
+    const auto string_at = [&](uint32_t index) {
+        return std::string(bytes + strings[index].offset, strings[index].size);
+    };
+
+    result.reserve(hdr.num_entries);
+    for (size_t i = 0; i < layout.entry_slots; ++i) {
+        const EntrySlot& entry = entries[i];
+        if (entry.hash == 0) {
+            continue;
+        }
+        auto& shared = result.emplace_back();
+        shared.pid = entry.pid;
+        shared.values.assign(entry.values, entry.values + hdr.num_values);
+        const StackSlot& stack = stacks[entry.stack];
+        shared.frames.reserve(stack.num_frames);
+        for (uint32_t f = 0; f < stack.num_frames; ++f) {
+            const FrameRecord& frame = frames[stack.first_frame + f];
+            shared.frames.push_back({ string_at(frame.name), string_at(frame.filename), frame.line });
+        }
+    }
+    clear();
+    unlock();
+    return result;
+}
+
+void
+Datadog::SharedAggregation::merge()
+{
+    const auto stacks = take();
+    if (stacks.empty()) {
+        return;
+    }
+
+    Sample* sample = SampleManager::start_sample();
+    if (sample == nullptr) {
+        return;
+    }
+
+    merging = true;
+    for (const auto& stack : stacks) {
+        if (stack.values.size() != sample->num_values) {
+            continue;
+        }
+        sample->push_label(ExportLabelKey::process_id, static_cast<int64_t>(stack.pid));
+        for (const auto& frame : stack.frames) {
+            sample->push_frame(frame.name, frame.filename, 0, frame.line);
+        }
+        std::copy(stack.values.begin(), stack.values.end(), sample->values.begin());
+        sample->flush_sample();
+    }
+    merging = false;
+    SampleManager::drop_sample(sample);
+}
+
+void
+Datadog::SharedAggregation::prefork()
+{
+    mtx.lock();
+}
+
+void
+Datadog::SharedAggregation::postfork_parent()
+{
+    mtx.unlock();
+}
+
+void
+Datadog::SharedAggregation::postfork_child()
+{
+    // The segment is kept, that's the point.  Only the identity of the process changes.
+    new (&mtx) std::mutex();
+    pid = getpid();
+}
+
+void
+Datadog::SharedAggregation::reset()
+{
+    const std::lock_guard<std::mutex> guard(mtx);
+    if (segment == nullptr) {
+        return;
+    }
+    lock();
+    clear();
+    header().num_values = 0;
+    unlock();
+    header().uploader.store(0, std::memory_order_relaxed);
+}
@@ -0,0 +1,72 @@
+#include "staging_buffer.hpp"
+
+void
+Datadog::StagedSample::assign(const ddog_prof_Sample& sample, int64_t _timestamp_ns)
+{
+    // assign() reuses existing capacity, so a slot stops allocating once it has seen its largest sample
+    locations.assign(sample.locations.ptr, sample.locations.ptr + sample.locations.len);
+    labels.assign(sample.labels.ptr, sample.labels.ptr + sample.labels.len);
+    values.assign(sample.values.ptr, sample.values.ptr + sample.values.len);
+    timestamp_ns = _timestamp_ns;
+}
+
+ddog_prof_Sample
+Datadog::StagedSample::as_sample() const
+{
+    return {
+        .locations = { locations.data(), locations.size() },
+        .values = { values.data(), values.size() },
+        .labels = { labels.data(), labels.size() },
+    };
+}
+
+Datadog::StagingBuffer::StagingBuffer(size_t capacity, std::thread::id _owner)
+  : slots(capacity)
+  , owner{ _owner }
+{}
+
+bool
+Datadog::StagingBuffer::push(const ddog_prof_Sample& sample, int64_t timestamp_ns)
+{
+    const uint64_t cur_tail = tail.load(std::memory_order_relaxed);
+    if (cur_tail - head.load(std::memory_order_acquire) >= slots.size()) {
+        return false;
+    }
+
+    slots[cur_tail % slots.size()].assign(sample, timestamp_ns);
+    tail.store(cur_tail + 1, std::memory_order_release);
+    return true;
+}
+
+size_t
+Datadog::StagingBuffer::size() const
+{
+    return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+}
+
+size_t
+Datadog::StagingBuffer::capacity() const
+{
+    return slots.size();
+}
+
+size_t
+Datadog::StagingBuffer::drain(const std::function<void(const ddog_prof_Sample&, int64_t)>& visitor)
+{
+    const uint64_t cur_head = head.load(std::memory_order_relaxed);
+    const uint64_t cur_tail = tail.load(std::memory_order_acquire);
+    for (uint64_t i = cur_head; i < cur_tail; ++i) {
+        const auto& slot = slots[i % slots.size()];
+        visitor(slot.as_sample(), slot.timestamp_ns);
+    }
+
+    // Releasing the slots only after they've been visited prevents the producer from overwriting them mid-read
+    head.store(cur_tail, std::memory_order_release);
+    return cur_tail - cur_head;
+}
+
+void
+Datadog::StagingBuffer::discard()
+{
+    head.store(tail.load(std::memory_order_acquire), std::memory_order_release);
+}
@@ -0,0 +1,155 @@
+#include "string_table.hpp"
+
+#include <cstring>
+#include <functional>
+#include <new>
+
+std::string_view
+Datadog::StringArena::insert(std::string_view str)
+{
+    // Very long strings get their own allocation, rather than wasting the tail of the current chunk
+    if (str.size() > chunk_size / 4) {
+        auto& storage = large_strings.emplace_back(std::make_unique<char[]>(str.size()));
+        std::memcpy(storage.get(), str.data(), str.size());
+        return { storage.get(), str.size() };
+    }
+
+    if (chunks.empty() || chunk_offset + str.size() > chunk_size) {
+        chunks.emplace_back(std::make_unique<char[]>(chunk_size));
+        chunk_offset = 0;
+    }
+
+    char* dest = chunks.back().get() + chunk_offset;
+    std::memcpy(dest, str.data(), str.size());
+    chunk_offset += str.size();
+    return { dest, str.size() };
+}
+
+Datadog::StringTable::StringTable(size_t _num_generations, size_t _max_bytes)
+  : num_generations{ _num_generations < 2 ? 2 : _num_generations } // A single generation could never be released
+  , max_bytes{ _max_bytes }
+{}
+
+std::string_view
+Datadog::StringTable::insert_or_get(std::string_view str)
+{
+    const size_t hash = std::hash<std::string_view>{}(str);
+    auto& shard = shards[hash % num_shards];
+    const std::lock_guard<std::mutex> lock(shard.mtx);
+
+    auto& current = shard.generations.front();
+    auto str_it = current.strings.find(str);
+    if (str_it != current.strings.end()) {
+        hits.fetch_add(1, std::memory_order_relaxed);
+        return *str_it;
+    }
+
+    // Strings which were used in a previous generation are copied forward.  This isn't counted as a miss, since
+    // it only happens once per string per generation.
+    bool seen = false;
+    for (size_t i = 1; i < shard.generations.size() && !seen; ++i) {
+        seen = shard.generations[i].strings.count(str) > 0;
+    }
+    if (seen) {
+        hits.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        misses.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    if (bytes.load(std::memory_order_relaxed) + str.size() > max_bytes.load(std::memory_order_relaxed)) {
+        rejected.fetch_add(1, std::memory_order_relaxed);
+        return overflow_placeholder;
+    }
+
+    const std::string_view stored = current.arena.insert(str);
+    current.strings.insert(stored);
+    current.bytes += stored.size();
+    bytes.fetch_add(stored.size(), std::memory_order_relaxed);
+    return stored;
+}
+
+void
+Datadog::StringTable::advance_generation()
+{
+    size_t strings = 0;
+    for (auto& shard : shards) {
+        const std::lock_guard<std::mutex> lock(shard.mtx);
+        const size_t hint = shard.generations.front().strings.size();
+        strings += hint;
+        shard.generations.emplace_front();
+        shard.generations.front().strings.reserve(hint);
+        while (shard.generations.size() > num_generations) {
+            bytes.fetch_sub(shard.generations.back().bytes, std::memory_order_relaxed);
+            shard.generations.pop_back();
+        }
+    }
+    last_generation_strings.store(strings, std::memory_order_relaxed);
+    generation.fetch_add(1, std::memory_order_release);
+}
+
+size_t
+Datadog::StringTable::get_last_generation_strings() const
+{
+    return last_generation_strings.load(std::memory_order_relaxed);
+}
+
+uint64_t
+Datadog::StringTable::get_generation() const
+{
+    return generation.load(std::memory_order_acquire);
+}
+
+void
+Datadog::StringTable::set_max_bytes(size_t _max_bytes)
+{
+    max_bytes.store(_max_bytes, std::memory_order_relaxed);
+}
+
+size_t
+Datadog::StringTable::get_bytes() const
+{
+    return bytes.load(std::memory_order_relaxed);
+}
+
+uint64_t
+Datadog::StringTable::get_rejected() const
+{
+    return rejected.load(std::memory_order_relaxed);
+}
+
+uint64_t
+Datadog::StringTable::get_hits() const
+{
+    return hits.load(std::memory_order_relaxed);
+}
+
+uint64_t
+Datadog::StringTable::get_misses() const
+{
+    return misses.load(std::memory_order_relaxed);
+}
+
+void
+Datadog::StringTable::prefork()
+{
+    for (auto& shard : shards) {
+        shard.mtx.lock();
+    }
+}
+
+void
+Datadog::StringTable::postfork_parent()
+{
+    for (auto& shard : shards) {
+        shard.mtx.unlock();
+    }
+}
+
+void
+Datadog::StringTable::postfork_child()
+{
+    // The locks were taken by the forking thread, which is the one running here
+    for (auto& shard : shards) {
+        shard.mtx.unlock();
+    }
+}
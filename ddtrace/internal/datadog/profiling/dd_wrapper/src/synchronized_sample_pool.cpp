@@ -0,0 +1,46 @@
+#include "synchronized_sample_pool.hpp"
+
+Datadog::SynchronizedSamplePool::SynchronizedSamplePool(size_t capacity)
+  : pool(capacity)
+{
+    for (auto& slot : pool) {
+        slot.store(nullptr);
+    }
+}
+
+Datadog::SynchronizedSamplePool::~SynchronizedSamplePool()
+{
+    for (auto& slot : pool) {
+        delete slot.exchange(nullptr); // NOLINT(cppcoreguidelines-owning-memory)
+    }
+}
+
+std::optional<Datadog::Sample*>
+Datadog::SynchronizedSamplePool::take_sample()
+{
+    for (auto& slot : pool) {
+        // Cheap check first, so empty slots don't bounce the cache line around
+        if (slot.load(std::memory_order_relaxed) == nullptr) {
+            continue;
+        }
+        Sample* sample = slot.exchange(nullptr, std::memory_order_acquire);
+        if (sample != nullptr) {
+            return sample;
+        }
+    }
+    return std::nullopt;
+}
+
+std::optional<Datadog::Sample*>
+Datadog::SynchronizedSamplePool::return_sample(Sample* sample)
+{
+    for (auto& slot : pool) {
+        Sample* expected = nullptr;
+        if (slot.compare_exchange_strong(expected, sample, std::memory_order_release, std::memory_order_relaxed)) {
+            return std::nullopt;
+        }
+    }
+
+    // No room, so give it back to the caller
+    return sample;
+}
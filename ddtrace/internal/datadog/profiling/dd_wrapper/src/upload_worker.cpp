@@ -0,0 +1,275 @@
+#include "upload_worker.hpp"
+#include "constants.hpp"
+#include "heap_live_set.hpp"
+#include "native_mappings.hpp"
+#include "profile_file_sink.hpp"
+#include "profile_spool.hpp"
+#include "profiler_stats.hpp"
+#include "sample.hpp"
+#include "shared_aggregation.hpp"
+#include "uploader_builder.hpp"
+
+#include <iostream>
+#include <new>
+
+void
+Datadog::UploadWorker::ensure_running()
+{
+    if (!running) {
+        stop_requested = false;
+        worker = std::thread(&UploadWorker::loop);
+        running = true;
+    }
+}
+
+void
+Datadog::UploadWorker::loop()
+{
+    std::unique_lock<std::mutex> lock(mtx);
+    while (true) {
+        cv.wait(lock, [] {
+            return pending_serialize != nullptr || !pending_burst.empty() || !pending_send.empty() || drain_spool ||
+                   stop_requested;
+        });
+
+        // Serialization goes first, since it frees the stale buffer for the next cycle
+        if (pending_serialize != nullptr) {
+            auto cur_uploader = pending_serialize;
+            lock.unlock();
+
+            // The stale buffer belongs to this thread until pending_serialize is cleared
+            ddog_prof_EncodedProfile encoded{};
+            const bool serialized = cur_uploader->serialize(Sample::profile_last_borrow(), encoded);
+
+            lock.lock();
+            pending_serialize.reset();
+            if (serialized) {
+                queue_send(std::move(cur_uploader), encoded);
+            }
+            cv.notify_all();
+            continue;
+        }
+
+        if (!pending_burst.empty()) {
+            ddog_prof_Profile burst = pending_burst.front();
+            pending_burst.pop_front();
+            lock.unlock();
+            serialize_burst(burst);
+            lock.lock();
+            continue;
+        }
+
+        if (!pending_send.empty()) {
+            auto [cur_uploader, encoded] = std::move(pending_send.front());
+            pending_send.pop_front();
+            lock.unlock();
+            const bool sent = cur_uploader->send(encoded);
+            lock.lock();
+
+            // The intake is reachable again, so whatever was spooled in the meantime can go out too
+            drain_spool = sent && ProfileSpool::enabled();
+            if (drain_spool) {
+                spool_uploader = std::move(cur_uploader);
+            }
+            continue;
+        }
+
+        // Spooled profiles are sent one at a time, and only while there's nothing more recent to do
+        if (drain_spool && !stop_requested) {
+            auto cur_uploader = spool_uploader;
+            lock.unlock();
+            auto spooled = ProfileSpool::take();
+            const bool sent = spooled.has_value() && cur_uploader->send(*spooled);
+            if (spooled.has_value()) {
+                ProfileSpool::release(*spooled, sent);
+            }
+            lock.lock();
+            drain_spool = sent;
+            if (!drain_spool) {
+                spool_uploader.reset();
+            }
+            continue;
+        }
+
+        // Only stop once everything has been flushed out
+        if (stop_requested) {
+            return;
+        }
+    }
+}
+
+void
+Datadog::UploadWorker::queue_send(std::shared_ptr<Uploader> cur_uploader, ddog_prof_EncodedProfile encoded)
+{
+    if (pending_send.size() >= g_default_upload_queue_depth) {
+        ddog_prof_EncodedProfile_drop(&pending_send.front().second);
+        pending_send.pop_front();
+        ProfilerStats::add(ProfilerCounter::uploads_dropped);
+    }
+    pending_send.emplace_back(std::move(cur_uploader), encoded);
+}
+
+void
+Datadog::UploadWorker::serialize_burst(ddog_prof_Profile& burst)
+{
+    // Bursts are rare, so rather than sharing the regular Uploader and its tags, each one gets its own
+    auto result = UploaderBuilder::build();
+    std::shared_ptr<Uploader> burst_uploader;
+    ddog_prof_EncodedProfile encoded{};
+    bool serialized = false;
+    if (std::holds_alternative<std::string>(result)) {
+        std::cerr << "Failed to create the uploader of a burst: " << std::get<std::string>(result) << std::endl;
+    } else {
+        burst_uploader = std::make_shared<Uploader>(std::move(std::get<Uploader>(result)));
+        burst_uploader->set_profile_mode("burst");
+        serialized = burst_uploader->serialize(burst, encoded);
+    }
+    ddog_prof_Profile_drop(&burst);
+
+    const std::lock_guard<std::mutex> lock(mtx);
+    if (serialized) {
+        queue_send(std::move(burst_uploader), encoded);
+    }
+}
+
+std::shared_ptr<Datadog::Uploader>
+Datadog::UploadWorker::get_uploader()
+{
+    const uint64_t config_seq = UploaderBuilder::get_config_seq();
+    if (uploader != nullptr && uploader_config_seq == config_seq) {
+        return uploader;
+    }
+
+    // Uploads which were already scheduled keep their own reference to the old uploader
+    auto result = UploaderBuilder::build();
+    if (std::holds_alternative<std::string>(result)) {
+        std::cerr << "Failed to create uploader: " << std::get<std::string>(result) << std::endl;
+        return nullptr;
+    }
+    uploader = std::make_shared<Uploader>(std::move(std::get<Uploader>(result)));
+    uploader_config_seq = config_seq;
+    return uploader;
+}
+
+bool
+Datadog::UploadWorker::submit()
+{
+    std::unique_lock<std::mutex> lock(mtx);
+
+    // Objects which were unloaded since mustn't be given the addresses of the next profile's native frames
+    NativeMappings::refresh();
+
+    // Behind a prefork server, only the elected process uploads, and the others only contribute their samples
+    const bool shared = SharedAggregation::enabled();
+    if (shared && !SharedAggregation::elect(Sample::monotonic_now_ns())) {
+        HeapLiveSet::flush();
+        return Sample::profile_clear_state();
+    }
+
+    auto cur_uploader = get_uploader();
+    if (cur_uploader == nullptr) {
+        return false;
+    }
+    ensure_running();
+
+    // Wait for the previous stale buffer to be serialized before recycling it
+    cv.wait(lock, [] { return pending_serialize == nullptr; });
+
+    // The live heap is re-added to every profile, right before it is cycled
+    HeapLiveSet::flush();
+    if (shared) {
+        SharedAggregation::merge();
+    }
+    if (!Sample::profile_clear_state()) {
+        return false;
+    }
+    pending_serialize = std::move(cur_uploader);
+    cv.notify_all();
+    return true;
+}
+
+bool
+Datadog::UploadWorker::submit_burst(ddog_prof_Profile& burst)
+{
+    const std::lock_guard<std::mutex> lock(mtx);
+    if (pending_burst.size() >= g_default_upload_queue_depth) {
+        ddog_prof_Profile_drop(&burst);
+        ProfilerStats::add(ProfilerCounter::uploads_dropped);
+        return false;
+    }
+    ensure_running();
+    pending_burst.push_back(burst);
+    cv.notify_all();
+    return true;
+}
+
+void
+Datadog::UploadWorker::shutdown()
+{
+    std::unique_lock<std::mutex> lock(mtx);
+    if (!running) {
+        return;
+    }
+    stop_requested = true;
+    cv.notify_all();
+    lock.unlock();
+
+    worker.join();
+
+    lock.lock();
+    running = false;
+}
+
+void
+Datadog::UploadWorker::prefork()
+{
+    // Holding the lock through the fork keeps new work from being scheduled.  A serialization in progress is left
+    // alone, since the child doesn't reuse the buffer being serialized (see Profile::postfork_child()).
+    mtx.lock();
+}
+
+void
+Datadog::UploadWorker::postfork_parent()
+{
+    mtx.unlock();
+}
+
+void
+Datadog::UploadWorker::postfork_child()
+{
+    // The worker thread doesn't exist in the child, and whatever it was going to send belongs to the parent.
+    // The std::thread object still refers to the parent's thread, so it is detached rather than destroyed.
+    new (&mtx) std::mutex();
+    new (&cv) std::condition_variable();
+    if (running) {
+        worker.detach();
+        running = false;
+    }
+    for (auto& [cur_uploader, encoded] : pending_send) {
+        cur_uploader->release_exporter();
+        ddog_prof_EncodedProfile_drop(&encoded);
+    }
+    pending_send.clear();
+    for (auto& burst : pending_burst) {
+        ddog_prof_Profile_drop(&burst);
+    }
+    pending_burst.clear();
+    if (pending_serialize != nullptr) {
+        pending_serialize->release_exporter();
+        pending_serialize.reset();
+    }
+    if (spool_uploader != nullptr) {
+        spool_uploader->release_exporter();
+        spool_uploader.reset();
+    }
+    drain_spool = false;
+    stop_requested = false;
+    ProfileSpool::postfork_child();
+    ProfileFileSink::postfork_child();
+
+    // The exporter's connections and runtime belong to the parent, so the child has to build its own
+    if (uploader != nullptr) {
+        uploader->release_exporter();
+        uploader.reset();
+    }
+}
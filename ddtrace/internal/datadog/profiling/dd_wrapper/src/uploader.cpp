@@ -1,5 +1,11 @@
 #include "uploader.hpp"
+#include "compression.hpp"
 #include "libdatadog_helpers.hpp"
+#include "profile_file_sink.hpp"
+#include "profile_spool.hpp"
+#include "profiler_stats.hpp"
+
+#include <vector>
 
 using namespace Datadog;
 
@@ -20,45 +26,135 @@ DdogCancellationTokenDeleter::operator()(ddog_CancellationToken* ptr) const
     }
 }
 
-Datadog::Uploader::Uploader(std::string_view _url, ddog_prof_Exporter* _ddog_exporter)
-  : url{ _url }
+Datadog::Uploader::Uploader(std::string_view _url, std::string_view _runtime_id, ddog_prof_Exporter* _ddog_exporter)
+  : runtime_id{ _runtime_id }
+  , url{ _url }
   , ddog_exporter{ _ddog_exporter }
 {}
 
+void
+Datadog::Uploader::release_exporter()
+{
+    (void)ddog_exporter.release(); // NOLINT (bugprone-unused-return-value)
+}
+
+void
+Datadog::Uploader::set_profile_mode(std::string_view _profile_mode)
+{
+    profile_mode = _profile_mode;
+}
+
 bool
-Datadog::Uploader::upload(ddog_prof_Profile& profile)
+Datadog::Uploader::serialize(ddog_prof_Profile& profile, ddog_prof_EncodedProfile& encoded)
 {
-    // Serialize the profile
+    const ProfilerStats::ScopedTimer timer(ProfilerTimer::serialize);
     ddog_prof_Profile_SerializeResult result = ddog_prof_Profile_serialize(&profile, nullptr, nullptr, nullptr);
     if (result.tag != DDOG_PROF_PROFILE_SERIALIZE_RESULT_OK) { // NOLINT (cppcoreguidelines-pro-type-union-access)
         auto err = result.err;                                 // NOLINT (cppcoreguidelines-pro-type-union-access)
         errmsg = err_to_msg(&err, "Error serializing pprof");
         std::cerr << errmsg << std::endl;
         ddog_Error_drop(&err);
+        ProfilerStats::add(ProfilerCounter::serialize_failures);
+        return false;
+    }
+    encoded = result.ok; // NOLINT (cppcoreguidelines-pro-type-union-access)
+    return true;
+}
+
+bool
+Datadog::Uploader::upload(ddog_prof_Profile& profile)
+{
+    ddog_prof_EncodedProfile encoded{};
+    if (!serialize(profile, encoded)) {
+        return false;
+    }
+    return send(encoded);
+}
+
+bool
+Datadog::Uploader::send(ddog_prof_EncodedProfile& encoded)
+{
+    // Recompressing (if another codec than libdatadog's was configured) happens here, on the upload thread
+    std::vector<uint8_t> recompressed;
+    const ddog_ByteSlice data = Compression::apply(ddog_Vec_U8_as_slice(&encoded.buffer), recompressed);
+    if (ProfileFileSink::enabled()) {
+        const bool written = ProfileFileSink::write(data);
+        ddog_prof_EncodedProfile_drop(&encoded);
+        return written;
+    }
+
+    // The request holds its own copy of the profile.  Unless the profile may have to be spooled, it is released
+    // before the upload rather than after, so that only one copy of it is alive while waiting on the intake.
+    const ProfilerStats::ScopedTimer timer(ProfilerTimer::upload);
+    ddog_prof_Exporter_Request* req = build_request(encoded.start, encoded.end, data, encoded.endpoints_stats);
+    const bool keep = req != nullptr && ProfileSpool::enabled();
+    if (!keep) {
+        ddog_prof_EncodedProfile_drop(&encoded);
+        std::vector<uint8_t>().swap(recompressed);
+    }
+    if (req == nullptr) {
         return false;
     }
-    ddog_prof_EncodedProfile* encoded = &result.ok; // NOLINT (cppcoreguidelines-pro-type-union-access)
+
+    const SendStatus status = send_request(req);
+
+    // Keep the profile around if it is worth trying again later
+    if (keep) {
+        if (status == SendStatus::retry) {
+            ProfileSpool::store(encoded.start, encoded.end, data);
+        }
+        ddog_prof_EncodedProfile_drop(&encoded);
+    }
+    return status == SendStatus::ok;
+}
+
+bool
+Datadog::Uploader::send(const SpooledProfile& spooled)
+{
+    const ddog_ByteSlice data = { .ptr = spooled.data.data(), .len = spooled.data.size() };
+
+    // Without an agent, profiles may be written to local files instead
+    if (ProfileFileSink::enabled()) {
+        return ProfileFileSink::write(data);
+    }
+
+    const ProfilerStats::ScopedTimer timer(ProfilerTimer::upload);
+    // The endpoint counts aren't spooled, as they are only a hint for the normalization of the endpoint profiles
+    ddog_prof_Exporter_Request* req = build_request(spooled.start, spooled.end, data, nullptr);
+    return req != nullptr && send_request(req) == SendStatus::ok;
+}
+
+ddog_prof_Exporter_Request*
+Datadog::Uploader::build_request(const ddog_Timespec& start,
+                                 const ddog_Timespec& end,
+                                 ddog_ByteSlice data,
+                                 const ddog_prof_ProfiledEndpointsStats* endpoints_stats)
+{
+    ProfilerStats::add(ProfilerCounter::upload_bytes, data.len);
 
     // If we have any custom tags, set them now
     ddog_Vec_Tag tags = ddog_Vec_Tag_new();
     add_tag(tags, ExportTagKey::runtime_id, runtime_id, errmsg);
+    if (!profile_mode.empty()) {
+        add_tag(tags, ExportTagKey::profile_mode, profile_mode, errmsg);
+    }
 
     // Build the request object
     const ddog_prof_Exporter_File file = {
         .name = to_slice("auto.pprof"),
-        .file = ddog_Vec_U8_as_slice(&encoded->buffer),
+        .file = data,
     };
     const uint64_t max_timeout_ms = 5000; // 5s is a common timeout parameter for Datadog profilers
     auto build_res = ddog_prof_Exporter_Request_build(ddog_exporter.get(),
-                                                      encoded->start,
-                                                      encoded->end,
+                                                      start,
+                                                      end,
                                                       ddog_prof_Exporter_Slice_File_empty(),
                                                       { .ptr = &file, .len = 1 },
                                                       &tags,
-                                                      nullptr,
+                                                      endpoints_stats,
                                                       nullptr,
                                                       max_timeout_ms);
-    ddog_prof_EncodedProfile_drop(encoded);
+    ddog_Vec_Tag_drop(tags);
 
     if (build_res.tag ==
         DDOG_PROF_EXPORTER_REQUEST_BUILD_RESULT_ERR) { // NOLINT (cppcoreguidelines-pro-type-union-access)
@@ -66,15 +162,20 @@ Datadog::Uploader::upload(ddog_prof_Profile& profile)
         errmsg = err_to_msg(&err, "Error building request");
         std::cerr << errmsg << std::endl;
         ddog_Error_drop(&err);
-        ddog_Vec_Tag_drop(tags);
-        return false;
+        ProfilerStats::add(ProfilerCounter::upload_failures);
+        return nullptr;
     }
+    return build_res.ok; // NOLINT (cppcoreguidelines-pro-type-union-access)
+}
 
+Datadog::Uploader::SendStatus
+Datadog::Uploader::send_request(ddog_prof_Exporter_Request* req)
+{
     // If we're here, we're about to create a new upload, so cancel any inflight ones
     cancel_inflight();
 
-    // Create a new cancellation token.  Maybe we can get away without doing this, but
-    // since we're recreating the uploader fresh every time anyway, we recreate one more thing.
+    // Create a new cancellation token.  The exporter is reused across uploads, but the token is what
+    // allows a single request to be cancelled, so it is per-request.
     // NB wrapping this in a unique_ptr to easily add RAII semantics; maybe should just wrap it in a
     // class instead
     cancel.reset(ddog_CancellationToken_new());
@@ -83,11 +184,11 @@ Datadog::Uploader::upload(ddog_prof_Profile& profile)
 
     // The upload operation sets up some global state in libdatadog (the tokio runtime), so
     // we ensure exclusivity here.
+    uint16_t status_code = 0;
     {
         const std::lock_guard<std::mutex> lock_guard(upload_lock);
 
-        // Build and check the response object
-        ddog_prof_Exporter_Request* req = build_res.ok; // NOLINT (cppcoreguidelines-pro-type-union-access)
+        // Send the request and check the response object
         ddog_prof_Exporter_SendResult res =
           ddog_prof_Exporter_send(ddog_exporter.get(), &req, cancel_for_request.get());
         if (res.tag == DDOG_PROF_EXPORTER_SEND_RESULT_ERR) { // NOLINT (cppcoreguidelines-pro-type-union-access)
@@ -95,15 +196,25 @@ Datadog::Uploader::upload(ddog_prof_Profile& profile)
             errmsg = err_to_msg(&err, "Error uploading");
             std::cerr << errmsg << std::endl;
             ddog_Error_drop(&err);
-            ddog_Vec_Tag_drop(tags);
-            return false;
+            ProfilerStats::add(ProfilerCounter::upload_failures);
+
+            // Most likely, the agent couldn't be reached or didn't answer in time
+            return SendStatus::retry;
         }
         ddog_prof_Exporter_Request_drop(&req);
+        status_code = res.http_response.code; // NOLINT (cppcoreguidelines-pro-type-union-access)
     }
 
-    // Cleanup
-    ddog_Vec_Tag_drop(tags);
-    return true;
+    if (status_code >= 400) {
+        std::cerr << "Error uploading: intake responded with HTTP " << status_code << std::endl;
+        ProfilerStats::add(ProfilerCounter::upload_failures);
+
+        // Server-side errors and throttling are transient, anything else would fail again
+        return status_code >= 500 || status_code == 408 || status_code == 429 ? SendStatus::retry
+                                                                               : SendStatus::error;
+    }
+    ProfilerStats::add(ProfilerCounter::uploads);
+    return SendStatus::ok;
 }
 
 void
@@ -127,18 +238,19 @@ Datadog::Uploader::cancel_inflight()
 void
 Datadog::Uploader::prefork()
 {
-    lock();
-    cancel_inflight();
+    // The child never uses the parent's exporter (see UploadWorker::postfork_child()), so an upload in the parent
+    // can carry on right through the fork.
 }
 
 void
 Datadog::Uploader::postfork_parent()
-{
-    unlock();
-}
+{}
 
 void
 Datadog::Uploader::postfork_child()
 {
-    unlock();
+    // The lock may have been held by the parent's upload thread.  Likewise, the cancellation token belongs to the
+    // parent's request, so it is leaked rather than dropped.
+    new (&upload_lock) std::mutex();
+    (void)cancel.release();
 }
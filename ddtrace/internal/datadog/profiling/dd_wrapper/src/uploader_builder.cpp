@@ -9,53 +9,55 @@
 #include <vector>
 
 void
-Datadog::UploaderBuilder::set_env(std::string_view _dd_env)
+Datadog::UploaderBuilder::update_config(std::string_view src, std::string& dest)
 {
-    if (!_dd_env.empty()) {
-        dd_env = _dd_env;
+    // Empty values are ignored, and only actual changes count as new configuration
+    if (!src.empty() && src != dest) {
+        dest = src;
+        ++config_seq;
     }
 }
+
+uint64_t
+Datadog::UploaderBuilder::get_config_seq()
+{
+    return config_seq.load();
+}
+
+void
+Datadog::UploaderBuilder::set_env(std::string_view _dd_env)
+{
+    update_config(_dd_env, dd_env);
+}
 void
 Datadog::UploaderBuilder::set_service(std::string_view _service)
 {
-    if (!_service.empty()) {
-        service = _service;
-    }
+    update_config(_service, service);
 }
 void
 Datadog::UploaderBuilder::set_version(std::string_view _version)
 {
-    if (!_version.empty()) {
-        version = _version;
-    }
+    update_config(_version, version);
 }
 void
 Datadog::UploaderBuilder::set_runtime(std::string_view _runtime)
 {
-    if (!_runtime.empty()) {
-        runtime = _runtime;
-    }
+    update_config(_runtime, runtime);
 }
 void
 Datadog::UploaderBuilder::set_runtime_version(std::string_view _runtime_version)
 {
-    if (!_runtime_version.empty()) {
-        runtime_version = _runtime_version;
-    }
+    update_config(_runtime_version, runtime_version);
 }
 void
 Datadog::UploaderBuilder::set_profiler_version(std::string_view _profiler_version)
 {
-    if (!_profiler_version.empty()) {
-        profiler_version = _profiler_version;
-    }
+    update_config(_profiler_version, profiler_version);
 }
 void
 Datadog::UploaderBuilder::set_url(std::string_view _url)
 {
-    if (!_url.empty()) {
-        url = _url;
-    }
+    update_config(_url, url);
 }
 void
 Datadog::UploaderBuilder::set_tag(std::string_view _key, std::string_view _val)
@@ -63,16 +65,18 @@ Datadog::UploaderBuilder::set_tag(std::string_view _key, std::string_view _val)
 
     if (!_key.empty() && !_val.empty()) {
         const std::lock_guard<std::mutex> lock(tag_mutex);
-        user_tags[std::string(_key)] = std::string(_val);
+        auto& val = user_tags[std::string(_key)];
+        if (val != _val) {
+            val = std::string(_val);
+            ++config_seq;
+        }
     }
 }
 
 void
 Datadog::UploaderBuilder::set_runtime_id(std::string_view _runtime_id)
 {
-    if (!_runtime_id.empty()) {
-        runtime_id = _runtime_id;
-    }
+    update_config(_runtime_id, runtime_id);
 }
 
 std::string
@@ -151,5 +155,5 @@ Datadog::UploaderBuilder::build()
         return errmsg;
     }
 
-    return Datadog::Uploader{ url, ddog_exporter };
+    return Datadog::Uploader{ url, runtime_id, ddog_exporter };
 }
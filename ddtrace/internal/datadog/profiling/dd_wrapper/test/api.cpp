@@ -1,7 +1,12 @@
 #include "interface.hpp"
+#include "sample_capi.h"
 #include "test_utils.hpp"
+#include "types.hpp"
 #include <gtest/gtest.h>
 
+#include <chrono>
+#include <string>
+
 // NOTE: cmake gives us an old gtest, and rather than update I just use the
 //       "workaround" in the following link
 //       https://stackoverflow.com/a/71257678
@@ -118,6 +123,66 @@ TEST(UploadDeathTest, SingleSampleTooManyFrames)
     EXPECT_EXIT(single_toomanyframes_sample(), ::testing::ExitedWithCode(0), "");
 }
 
+static uint64_t
+frames_truncated()
+{
+    std::string_view name;
+    uint64_t value = 0;
+    for (size_t i = 0; ddup_stats_get(i, &name, &value); i++) {
+        if (name == "frames_truncated") {
+            return value;
+        }
+    }
+    return 0;
+}
+
+static void
+push_stack(Datadog::Sample* h, int depth)
+{
+    for (int i = 0; i < depth; i++) {
+        const std::string name = "my_function_" + std::to_string(i);
+        ddup_push_frame(h, name.c_str(), "my_file", 1, 1);
+    }
+}
+
+void
+type_frame_limits()
+{
+    // Deep stacks for CPU time, shallow ones for allocations, and the default limit for everything else
+    ddup_config_type_max_nframes(Datadog::SampleType::CPU, 128);
+    ddup_config_type_max_nframes(Datadog::SampleType::Allocation, 8);
+    configure("my_test_service", "my_test_env", "0.0.1", "https://localhost:8126", "cpython", "3.10.6", "3.100", 64);
+    const uint64_t before = frames_truncated();
+
+    for (int i = 0; i < 10; i++) {
+        auto h = ddup_start_sample();
+        ddup_push_cputime(h, 1, 1);
+        push_stack(h, 100);
+        ddup_flush_sample(h);
+        ddup_drop_sample(h);
+
+        h = ddup_start_sample();
+        ddup_push_alloc(h, 100, 1);
+        push_stack(h, 100);
+        ddup_flush_sample(h);
+        ddup_drop_sample(h);
+
+        h = ddup_start_sample();
+        ddup_push_walltime(h, 1, 1);
+        push_stack(h, 100);
+        ddup_flush_sample(h);
+        ddup_drop_sample(h);
+    }
+
+    // 92 frames dropped from every allocation sample, and 36 from every wall time sample
+    std::exit(frames_truncated() - before == 10 * (92 + 36) ? 0 : 1);
+}
+
+TEST(UploadDeathTest, TypeFrameLimits)
+{
+    EXPECT_EXIT(type_frame_limits(), ::testing::ExitedWithCode(0), "");
+}
+
 void
 lotsa_frames_lotsa_samples()
 {
@@ -162,6 +227,117 @@ TEST(UploadDeathTest, LotsaSamplesLotsaFrames)
     EXPECT_EXIT(lotsa_frames_lotsa_samples(), ::testing::ExitedWithCode(0), "");
 }
 
+void
+reused_samples()
+{
+    configure("my_test_service", "my_test_env", "0.0.1", "https://localhost:8126", "cpython", "3.10.6", "3.100", 256);
+
+    // Samples are returned to a pool when dropped, so make sure a sample which was dropped without
+    // being flushed doesn't leak its state into the next one.
+    for (int i = 0; i < 100; i++) {
+        auto h = ddup_start_sample();
+        ddup_push_walltime(h, 1.0, 1);
+        ddup_push_threadinfo(h, i, i, "MyFavoriteThreadEver");
+        ddup_push_frame(h, "my_test_frame", "my_test_file", 1, 1);
+        if (i % 2 == 0) {
+            ddup_flush_sample(h);
+        }
+        ddup_drop_sample(h);
+        h = nullptr;
+    }
+
+    // Hold more samples than the pool can contain at once, then release them all
+    std::vector<Datadog::Sample*> handles;
+    for (int i = 0; i < 64; i++) {
+        handles.push_back(ddup_start_sample());
+    }
+    for (auto h : handles) {
+        ddup_push_cputime(h, 1.0, 1);
+        ddup_flush_sample(h);
+        ddup_drop_sample(h);
+    }
+
+    // Upload.  It'll fail, but whatever
+    ddup_upload();
+
+    std::exit(0);
+}
+
+TEST(UploadDeathTest, ReusedSamples)
+{
+    EXPECT_EXIT(reused_samples(), ::testing::ExitedWithCode(0), "");
+}
+
+void
+timeline_samples()
+{
+    ddup_config_timeline(true);
+    configure("my_test_service", "my_test_env", "0.0.1", "https://localhost:8126", "cpython", "3.10.6", "3.100", 256);
+
+    // Samples with a timestamp keep it, the others are stamped when flushed
+    for (int i = 0; i < 10; i++) {
+        auto h = ddup_start_sample();
+        ddup_push_walltime(h, 1.0, 1);
+        if (i % 2 == 0) {
+            auto now = std::chrono::steady_clock::now().time_since_epoch();
+            ddup_push_monotonic_ns(h, std::chrono::duration_cast<std::chrono::nanoseconds>(now).count());
+        }
+        ddup_push_frame(h, "my_test_frame", "my_test_file", 1, 1);
+        ddup_flush_sample(h);
+        ddup_drop_sample(h);
+        h = nullptr;
+    }
+
+    // Upload.  It'll fail, but whatever
+    ddup_upload();
+
+    std::exit(0);
+}
+
+TEST(UploadDeathTest, TimelineSamples)
+{
+    EXPECT_EXIT(timeline_samples(), ::testing::ExitedWithCode(0), "");
+}
+
+void
+capi_samples()
+{
+    configure("my_test_service", "my_test_env", "0.0.1", "https://localhost:8126", "cpython", "3.10.6", "3.100", 256);
+
+    // The strings handed to the C API are sized rather than NUL-terminated
+    const ddup_sample_capi_t* capi = ddup_sample_capi_get();
+    if (capi->version != DDUP_SAMPLE_CAPI_VERSION) {
+        std::exit(1);
+    }
+    const char thread_name[] = "MyFavoriteThreadEverXXX";
+    const char frame_name[] = "my_test_frameXXX";
+    const char file_name[] = "my_test_fileXXX";
+    const char class_name[] = "MyFavoriteClassXXX";
+    const char allocation_domain[] = "objectXXX";
+    for (int i = 0; i < 100; i++) {
+        auto h = capi->start_sample();
+        capi->push_heap(h, 100);
+        capi->push_alloc(h, 100, 1);
+        capi->push_threadinfo(h, i, i, thread_name, sizeof(thread_name) - 4);
+        capi->push_class_name(h, class_name, sizeof(class_name) - 4);
+        capi->push_allocation_domain(h, allocation_domain, sizeof(allocation_domain) - 4);
+        capi->push_frame(h, frame_name, sizeof(frame_name) - 4, file_name, sizeof(file_name) - 4, 0, i);
+        capi->flush_sample(h);
+        capi->drop_sample(h);
+        h = nullptr;
+    }
+
+    // Upload.  It'll fail, but whatever
+    ddup_upload();
+
+    std::exit(0);
+}
+
+TEST(UploadDeathTest, CapiSamples)
+{
+    EXPECT_EXIT(capi_samples(), ::testing::ExitedWithCode(0), "");
+}
+
 int
 main(int argc, char** argv)
 {
@@ -0,0 +1,68 @@
+#include "burst_profile.hpp"
+#include "interface.hpp"
+#include "sample.hpp"
+#include "test_utils.hpp"
+#include <gtest/gtest.h>
+
+#include <cstdlib>
+
+void
+burst_before_init()
+{
+    // There are no sample types to build the profile with yet
+    EXPECT_FALSE(Datadog::BurstProfile::start());
+    EXPECT_FALSE(Datadog::BurstProfile::is_active());
+    EXPECT_FALSE(Datadog::BurstProfile::finish());
+    std::exit(0);
+}
+
+TEST(BurstProfileDeathTest, BeforeInit)
+{
+    EXPECT_EXIT(burst_before_init(), ::testing::ExitedWithCode(0), "");
+}
+
+void
+burst_lifecycle()
+{
+    configure("my_test_service", "my_test_env", "0.0.1", "https://localhost:8126", "cpython", "3.10.6", "3.100", 256);
+
+    // One burst at a time
+    EXPECT_TRUE(Datadog::BurstProfile::start());
+    EXPECT_TRUE(Datadog::BurstProfile::is_active());
+    EXPECT_FALSE(Datadog::BurstProfile::start());
+
+    // Only the samples flushed within a scope go to the burst
+    EXPECT_FALSE(Datadog::BurstProfile::routed());
+    {
+        const Datadog::BurstProfile::Scope scope;
+        EXPECT_TRUE(Datadog::BurstProfile::routed());
+        send_sample(1);
+    }
+    EXPECT_FALSE(Datadog::BurstProfile::routed());
+    send_sample(1);
+
+    // The upload will fail, but the profile is handed over either way
+    EXPECT_TRUE(Datadog::BurstProfile::finish());
+    EXPECT_FALSE(Datadog::BurstProfile::is_active());
+    EXPECT_FALSE(Datadog::BurstProfile::finish());
+
+    // Once the burst is over, its samples are dropped
+    {
+        const Datadog::BurstProfile::Scope scope;
+        auto* sample = ddup_start_sample();
+        ddup_push_walltime(sample, 1.0, 1);
+        EXPECT_FALSE(sample->flush_sample());
+        ddup_drop_sample(sample);
+    }
+
+    // Another burst can start
+    EXPECT_TRUE(Datadog::BurstProfile::start());
+    EXPECT_TRUE(Datadog::BurstProfile::finish());
+    ddup_upload();
+    std::exit(0);
+}
+
+TEST(BurstProfileDeathTest, Lifecycle)
+{
+    EXPECT_EXIT(burst_lifecycle(), ::testing::ExitedWithCode(0), "");
+}
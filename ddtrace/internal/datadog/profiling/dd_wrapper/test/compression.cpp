@@ -0,0 +1,103 @@
+#include "compression.hpp"
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+// An LZ4 frame with a single block: "abc", then a match of 9 bytes 3 bytes back, then "xxxxx"
+static std::vector<uint8_t>
+make_frame()
+{
+    const std::vector<uint8_t> block = { 0x35, 'a', 'b', 'c', 0x03, 0x00, 0x50, 'x', 'x', 'x', 'x', 'x' };
+    std::vector<uint8_t> frame = { 0x04, 0x22, 0x4D, 0x18, 0x60, 0x40, 0x82 };
+    for (int i = 0; i < 4; i++) {
+        frame.push_back(static_cast<uint8_t>(block.size() >> (8 * i)));
+    }
+    frame.insert(frame.end(), block.begin(), block.end());
+    frame.insert(frame.end(), { 0, 0, 0, 0 });
+    return frame;
+}
+
+static std::string
+decode(const std::vector<uint8_t>& frame)
+{
+    std::vector<uint8_t> out;
+    if (!Datadog::Compression::lz4_frame_decode({ .ptr = frame.data(), .len = frame.size() }, out)) {
+        return "<error>";
+    }
+    return { out.begin(), out.end() };
+}
+
+TEST(CompressionTest, DecodeFrame)
+{
+    EXPECT_EQ(decode(make_frame()), "abcabcabcabcxxxxx");
+
+    // Frames may be concatenated
+    auto frames = make_frame();
+    const auto frame = make_frame();
+    frames.insert(frames.end(), frame.begin(), frame.end());
+    EXPECT_EQ(decode(frames), "abcabcabcabcxxxxxabcabcabcabcxxxxx");
+}
+
+TEST(CompressionTest, DecodeInvalidFrames)
+{
+    auto frame = make_frame();
+    frame[0] = 0;
+    EXPECT_EQ(decode(frame), "<error>");
+
+    // Truncated
+    frame = make_frame();
+    frame.resize(frame.size() - 6);
+    EXPECT_EQ(decode(frame), "<error>");
+
+    // A match before the start of the frame
+    frame = make_frame();
+    frame[15] = 0x04;
+    EXPECT_EQ(decode(frame), "<error>");
+}
+
+TEST(CompressionTest, Lz4IsSentAsSerialized)
+{
+    EXPECT_TRUE(Datadog::Compression::configure("lz4", 0));
+    const auto frame = make_frame();
+    std::vector<uint8_t> out;
+    const auto data = Datadog::Compression::apply({ .ptr = frame.data(), .len = frame.size() }, out);
+    EXPECT_EQ(data.ptr, frame.data());
+    EXPECT_EQ(data.len, frame.size());
+}
+
+TEST(CompressionTest, UnknownCodec)
+{
+    EXPECT_FALSE(Datadog::Compression::configure("brotli", 0));
+    const auto frame = make_frame();
+    std::vector<uint8_t> out;
+    EXPECT_EQ(Datadog::Compression::apply({ .ptr = frame.data(), .len = frame.size() }, out).ptr, frame.data());
+}
+
+TEST(CompressionTest, Recompress)
+{
+    const auto frame = make_frame();
+    for (const auto codec : { Datadog::CompressionCodec::gzip, Datadog::CompressionCodec::zstd }) {
+        if (!Datadog::Compression::available(codec)) {
+            continue;
+        }
+        ASSERT_TRUE(Datadog::Compression::configure(codec == Datadog::CompressionCodec::gzip ? "gzip" : "zstd", 1));
+        std::vector<uint8_t> out;
+        const auto data = Datadog::Compression::apply({ .ptr = frame.data(), .len = frame.size() }, out);
+        EXPECT_EQ(data.ptr, out.data());
+        ASSERT_GE(data.len, 4);
+        if (codec == Datadog::CompressionCodec::gzip) {
+            EXPECT_EQ(out[0], 0x1f);
+            EXPECT_EQ(out[1], 0x8b);
+        } else {
+            EXPECT_EQ(out[0], 0x28);
+            EXPECT_EQ(out[1], 0xb5);
+        }
+
+        // Whatever can't be decoded is sent as it is
+        std::vector<uint8_t> garbage = { 1, 2, 3 };
+        EXPECT_EQ(Datadog::Compression::apply({ .ptr = garbage.data(), .len = garbage.size() }, out).ptr,
+                  garbage.data());
+    }
+    Datadog::Compression::configure("lz4", 0);
+}
@@ -0,0 +1,101 @@
+#include "endpoint_counts.hpp"
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <vector>
+
+using Counts = std::vector<std::pair<std::string, int64_t>>;
+
+static Counts
+take()
+{
+    Counts result;
+    for (const auto& [endpoint, count] : Datadog::EndpointCounts::take()) {
+        result.emplace_back(endpoint, count);
+    }
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+TEST(EndpointCountsTest, InternIsStable)
+{
+    const size_t users = Datadog::EndpointCounts::intern("GET /users");
+    const size_t items = Datadog::EndpointCounts::intern("GET /items");
+    EXPECT_NE(users, items);
+    EXPECT_EQ(Datadog::EndpointCounts::intern("GET /users"), users);
+    EXPECT_EQ(Datadog::EndpointCounts::intern(std::string("GET /items")), items);
+}
+
+TEST(EndpointCountsTest, TakeResets)
+{
+    const size_t users = Datadog::EndpointCounts::intern("GET /users");
+    const size_t items = Datadog::EndpointCounts::intern("GET /items");
+    Datadog::EndpointCounts::intern("GET /idle");
+    Datadog::EndpointCounts::add(users);
+    Datadog::EndpointCounts::add(users);
+    Datadog::EndpointCounts::add(items, 3);
+
+    // Endpoints which weren't hit aren't given
+    EXPECT_EQ(take(), Counts({ { "GET /items", 3 }, { "GET /users", 2 } }));
+    EXPECT_TRUE(take().empty());
+
+    Datadog::EndpointCounts::add(items);
+    EXPECT_EQ(take(), Counts({ { "GET /items", 1 } }));
+}
+
+TEST(EndpointCountsTest, InvalidIndexIsIgnored)
+{
+    Datadog::EndpointCounts::add(Datadog::EndpointCounts::invalid_index);
+    Datadog::EndpointCounts::add(g_endpoint_counts_max_endpoints);
+    EXPECT_TRUE(take().empty());
+}
+
+TEST(EndpointCountsTest, ResetKeepsEndpoints)
+{
+    const size_t users = Datadog::EndpointCounts::intern("GET /users");
+    Datadog::EndpointCounts::add(users);
+    Datadog::EndpointCounts::reset();
+    EXPECT_TRUE(take().empty());
+    EXPECT_EQ(Datadog::EndpointCounts::intern("GET /users"), users);
+}
+
+TEST(EndpointCountsTest, ConcurrentAdds)
+{
+    constexpr int num_threads = 8;
+    constexpr int num_adds = 10000;
+    const size_t index = Datadog::EndpointCounts::intern("POST /orders");
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < num_threads; i++) {
+        threads.emplace_back([index] {
+            for (int j = 0; j < num_adds; j++) {
+                Datadog::EndpointCounts::add(index);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    EXPECT_EQ(take(), Counts({ { "POST /orders", num_threads * num_adds } }));
+}
+
+TEST(EndpointCountsTest, Capacity)
+{
+    // Whatever the previous tests registered counts against the capacity too
+    size_t last = 0;
+    for (size_t i = 0; i < g_endpoint_counts_max_endpoints; i++) {
+        const size_t index = Datadog::EndpointCounts::intern("GET /" + std::to_string(i));
+        if (index == Datadog::EndpointCounts::invalid_index) {
+            break;
+        }
+        last = index;
+    }
+    EXPECT_EQ(last, g_endpoint_counts_max_endpoints - 1);
+    EXPECT_EQ(Datadog::EndpointCounts::intern("GET /overflow"), Datadog::EndpointCounts::invalid_index);
+
+    // Endpoints registered before the table filled up keep being counted
+    Datadog::EndpointCounts::add(Datadog::EndpointCounts::intern("GET /users"));
+    EXPECT_EQ(take(), Counts({ { "GET /users", 1 } }));
+}
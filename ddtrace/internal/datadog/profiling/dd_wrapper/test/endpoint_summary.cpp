@@ -0,0 +1,123 @@
+#include "endpoint_summary.hpp"
+#include "libdatadog_helpers.hpp"
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+static constexpr int64_t window_ns = 60LL * 1000 * 1000 * 1000;
+static constexpr int64_t slot_ns = window_ns / g_endpoint_summary_slots;
+
+static std::vector<ddog_prof_Location>
+make_stack(const std::vector<std::string>& names)
+{
+    std::vector<ddog_prof_Location> locations;
+    for (const auto& name : names) {
+        auto& location = locations.emplace_back();
+        location.function.name = Datadog::to_slice(name);
+        location.function.filename = Datadog::to_slice("app.py");
+        location.line = static_cast<int64_t>(name.size());
+    }
+    return locations;
+}
+
+static void
+record(std::string_view endpoint, const std::vector<std::string>& names, int64_t now_ns, int64_t wall_time_ns = 0)
+{
+    const auto locations = make_stack(names);
+    Datadog::EndpointSummary::record(endpoint, locations.data(), locations.size(), 0, wall_time_ns, now_ns);
+}
+
+TEST(EndpointSummaryTest, DisabledByDefault)
+{
+    EXPECT_FALSE(Datadog::EndpointSummary::enabled());
+    record("GET /", { "handler" }, 1);
+    EXPECT_TRUE(Datadog::EndpointSummary::endpoints(1).empty());
+    EXPECT_TRUE(Datadog::EndpointSummary::top("GET /", 1).empty());
+}
+
+TEST(EndpointSummaryTest, HeaviestStacksFirst)
+{
+    Datadog::EndpointSummary::configure(4, window_ns);
+    ASSERT_TRUE(Datadog::EndpointSummary::enabled());
+    for (int i = 0; i < 3; i++) {
+        record("GET /users", { "query", "handler" }, 10, 100);
+    }
+    record("GET /users", { "render", "handler" }, 10, 50);
+    record("GET /items", { "handler" }, 10);
+
+    auto endpoints = Datadog::EndpointSummary::endpoints(10);
+    std::sort(endpoints.begin(), endpoints.end());
+    EXPECT_EQ(endpoints, std::vector<std::string>({ "GET /items", "GET /users" }));
+
+    const auto stacks = Datadog::EndpointSummary::top("GET /users", 10);
+    ASSERT_EQ(stacks.size(), 2);
+    EXPECT_EQ(stacks[0].samples, 3);
+    EXPECT_EQ(stacks[0].error, 0);
+    EXPECT_EQ(stacks[0].wall_time_ns, 300);
+    ASSERT_EQ(stacks[0].frames.size(), 2);
+    EXPECT_EQ(stacks[0].frames[0].name, "query");
+    EXPECT_EQ(stacks[0].frames[0].filename, "app.py");
+    EXPECT_EQ(stacks[0].frames[0].line, 5);
+    EXPECT_EQ(stacks[0].frames[1].name, "handler");
+    EXPECT_EQ(stacks[1].samples, 1);
+    EXPECT_EQ(stacks[1].frames[0].name, "render");
+
+    EXPECT_TRUE(Datadog::EndpointSummary::top("GET /unknown", 10).empty());
+    Datadog::EndpointSummary::reset();
+}
+
+TEST(EndpointSummaryTest, HeavyHittersSurviveEviction)
+{
+    Datadog::EndpointSummary::configure(2, window_ns);
+    for (int i = 0; i < 100; i++) {
+        record("GET /", { "hot" }, 10);
+        record("GET /", { "cold" + std::to_string(i) }, 10);
+    }
+
+    const auto stacks = Datadog::EndpointSummary::top("GET /", 10);
+    ASSERT_EQ(stacks.size(), 2);
+    EXPECT_EQ(stacks[0].frames[0].name, "hot");
+    EXPECT_EQ(stacks[0].samples, 100);
+    EXPECT_EQ(stacks[0].error, 0);
+
+    // The last cold stack took over the count of the one it replaced
+    EXPECT_EQ(stacks[1].frames[0].name, "cold99");
+    EXPECT_EQ(stacks[1].samples - stacks[1].error, 1);
+    Datadog::EndpointSummary::reset();
+}
+
+TEST(EndpointSummaryTest, SlidingWindow)
+{
+    Datadog::EndpointSummary::configure(4, window_ns);
+    record("GET /", { "old" }, 0);
+    record("GET /", { "old" }, slot_ns);
+    auto stacks = Datadog::EndpointSummary::top("GET /", window_ns - 1);
+    ASSERT_EQ(stacks.size(), 1);
+    EXPECT_EQ(stacks[0].samples, 2);
+
+    // The first slot is recycled, and the samples it held fall out of the window
+    record("GET /", { "new" }, window_ns);
+    stacks = Datadog::EndpointSummary::top("GET /", window_ns);
+    ASSERT_EQ(stacks.size(), 2);
+    EXPECT_EQ(stacks[0].samples, 1);
+    EXPECT_EQ(stacks[1].samples, 1);
+
+    stacks = Datadog::EndpointSummary::top("GET /", window_ns + slot_ns);
+    ASSERT_EQ(stacks.size(), 1);
+    EXPECT_EQ(stacks[0].frames[0].name, "new");
+
+    EXPECT_TRUE(Datadog::EndpointSummary::top("GET /", 2 * window_ns).empty());
+    Datadog::EndpointSummary::reset();
+}
+
+TEST(EndpointSummaryTest, BoundedEndpoints)
+{
+    Datadog::EndpointSummary::configure(1, window_ns);
+    for (size_t i = 0; i < g_endpoint_summary_max_endpoints + 10; i++) {
+        record("GET /" + std::to_string(i), { "handler" }, 10);
+    }
+    EXPECT_EQ(Datadog::EndpointSummary::endpoints(10).size(), g_endpoint_summary_max_endpoints);
+    Datadog::EndpointSummary::reset();
+}
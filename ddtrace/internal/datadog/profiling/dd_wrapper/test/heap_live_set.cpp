@@ -0,0 +1,104 @@
+#include "heap_live_set.hpp"
+#include "constants.hpp"
+#include "libdatadog_helpers.hpp"
+#include "profiler_stats.hpp"
+#include <gtest/gtest.h>
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+static std::vector<ddog_prof_Location>
+make_stack(const std::vector<std::string>& names)
+{
+    std::vector<ddog_prof_Location> locations;
+    for (const auto& name : names) {
+        auto& location = locations.emplace_back();
+        location.function.name = Datadog::to_slice(name);
+        location.function.filename = Datadog::to_slice("app.py");
+        location.line = static_cast<int64_t>(name.size());
+    }
+    return locations;
+}
+
+static bool
+add(uint64_t id, const std::vector<std::string>& names, int64_t size, int64_t thread_id = 1)
+{
+    const auto locations = make_stack(names);
+    ddog_prof_Label label{};
+    label.key = Datadog::to_slice("thread id");
+    label.num = thread_id;
+    return Datadog::HeapLiveSet::add(id, locations.data(), locations.size(), &label, 1, size);
+}
+
+static uint64_t
+stat(std::string_view wanted)
+{
+    std::string_view name;
+    uint64_t value = 0;
+    for (size_t i = 0; Datadog::ProfilerStats::get(i, name, value); i++) {
+        if (name == wanted) {
+            return value;
+        }
+    }
+    return 0;
+}
+
+TEST(HeapLiveSetTest, AggregatesByStack)
+{
+    EXPECT_TRUE(add(1, { "alloc", "main" }, 100));
+    EXPECT_TRUE(add(2, { "alloc", "main" }, 50));
+    EXPECT_TRUE(add(3, { "other", "main" }, 10));
+    EXPECT_TRUE(add(4, { "alloc", "main" }, 1, 2)); // Same frames, different thread
+    EXPECT_EQ(Datadog::HeapLiveSet::num_samples(), 4);
+    EXPECT_EQ(Datadog::HeapLiveSet::num_stacks(), 3);
+    EXPECT_EQ(Datadog::HeapLiveSet::num_bytes(), 161);
+
+    // Adding a live id again doesn't count it twice
+    EXPECT_TRUE(add(1, { "alloc", "main" }, 100));
+    EXPECT_EQ(Datadog::HeapLiveSet::num_samples(), 4);
+    EXPECT_EQ(Datadog::HeapLiveSet::num_bytes(), 161);
+    Datadog::HeapLiveSet::clear();
+}
+
+TEST(HeapLiveSetTest, RemoveFreesStacks)
+{
+    add(1, { "alloc", "main" }, 100);
+    add(2, { "alloc", "main" }, 50);
+    add(3, { "other", "main" }, 10);
+
+    Datadog::HeapLiveSet::remove(1);
+    EXPECT_EQ(Datadog::HeapLiveSet::num_stacks(), 2);
+    EXPECT_EQ(Datadog::HeapLiveSet::num_bytes(), 60);
+
+    Datadog::HeapLiveSet::remove(3);
+    EXPECT_EQ(Datadog::HeapLiveSet::num_stacks(), 1);
+
+    // Unknown and already removed ids are ignored
+    Datadog::HeapLiveSet::remove(3);
+    Datadog::HeapLiveSet::remove(42);
+    EXPECT_EQ(Datadog::HeapLiveSet::num_samples(), 1);
+    EXPECT_EQ(Datadog::HeapLiveSet::num_bytes(), 50);
+
+    Datadog::HeapLiveSet::remove(2);
+    EXPECT_EQ(Datadog::HeapLiveSet::num_samples(), 0);
+    EXPECT_EQ(Datadog::HeapLiveSet::num_stacks(), 0);
+    EXPECT_EQ(Datadog::HeapLiveSet::num_bytes(), 0);
+}
+
+TEST(HeapLiveSetTest, BoundedStacks)
+{
+    Datadog::ProfilerStats::reset();
+    for (size_t i = 0; i < g_heap_live_set_max_stacks; i++) {
+        ASSERT_TRUE(add(i, { "alloc" + std::to_string(i) }, 1));
+    }
+    EXPECT_FALSE(add(g_heap_live_set_max_stacks, { "one too many" }, 1));
+    EXPECT_EQ(stat("heap_live_dropped"), 1);
+    EXPECT_EQ(stat("heap_live_stacks"), g_heap_live_set_max_stacks);
+
+    // Known stacks can still take more samples
+    EXPECT_TRUE(add(g_heap_live_set_max_stacks + 1, { "alloc0" }, 1));
+    EXPECT_EQ(Datadog::HeapLiveSet::num_stacks(), g_heap_live_set_max_stacks);
+    Datadog::HeapLiveSet::clear();
+    EXPECT_EQ(Datadog::HeapLiveSet::num_samples(), 0);
+}
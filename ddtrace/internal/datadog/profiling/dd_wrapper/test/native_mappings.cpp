@@ -0,0 +1,62 @@
+#include "native_mappings.hpp"
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <string_view>
+
+#include <unistd.h>
+
+static int
+local_function()
+{
+    return 42;
+}
+
+static std::string_view
+view(ddog_CharSlice slice)
+{
+    return { slice.ptr, static_cast<size_t>(slice.len) };
+}
+
+TEST(NativeMappingsTest, FindsTheExecutable)
+{
+    const auto address = reinterpret_cast<uint64_t>(&local_function);
+    const ddog_prof_Mapping mapping = Datadog::NativeMappings::lookup(address);
+    EXPECT_LE(mapping.memory_start, address);
+    EXPECT_GT(mapping.memory_limit, address);
+    EXPECT_FALSE(view(mapping.filename).empty());
+    EXPECT_GT(Datadog::NativeMappings::size(), 0);
+    EXPECT_EQ(local_function(), 42);
+}
+
+TEST(NativeMappingsTest, FindsSharedLibraries)
+{
+    const auto address = reinterpret_cast<uint64_t>(&getpid);
+    const ddog_prof_Mapping mapping = Datadog::NativeMappings::lookup(address);
+    EXPECT_LE(mapping.memory_start, address);
+    EXPECT_GT(mapping.memory_limit, address);
+    EXPECT_NE(view(mapping.filename).find("libc"), std::string_view::npos);
+
+    // Build ids are hexadecimal
+    for (const char c : view(mapping.build_id)) {
+        EXPECT_TRUE((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'));
+    }
+}
+
+TEST(NativeMappingsTest, UnknownAddress)
+{
+    const ddog_prof_Mapping mapping = Datadog::NativeMappings::lookup(1);
+    EXPECT_EQ(mapping.memory_start, 0);
+    EXPECT_EQ(mapping.memory_limit, 0);
+    EXPECT_TRUE(view(mapping.filename).empty());
+}
+
+TEST(NativeMappingsTest, Rebuilds)
+{
+    Datadog::NativeMappings::reset();
+    EXPECT_EQ(Datadog::NativeMappings::size(), 0);
+    const auto address = reinterpret_cast<uint64_t>(&local_function);
+    EXPECT_NE(Datadog::NativeMappings::lookup(address).memory_limit, 0);
+    Datadog::NativeMappings::refresh();
+    EXPECT_GT(Datadog::NativeMappings::size(), 0);
+}
@@ -0,0 +1,75 @@
+#include "profile_file_sink.hpp"
+#include <gtest/gtest.h>
+
+#include <array>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+static std::string
+make_prefix()
+{
+    std::array<char, 32> tmpl = { "/tmp/dd_file_sink_test_XXXXXX" };
+    const char* dir = mkdtemp(tmpl.data());
+    EXPECT_NE(dir, nullptr);
+    return std::string(dir) + "/profile";
+}
+
+static bool
+write(const std::vector<uint8_t>& data)
+{
+    return Datadog::ProfileFileSink::write({ .ptr = data.data(), .len = data.size() });
+}
+
+static std::vector<uint8_t>
+read(const std::string& prefix, int n)
+{
+    std::ifstream file(prefix + "." + std::to_string(getpid()) + "." + std::to_string(n), std::ios::binary);
+    return { std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>() };
+}
+
+TEST(ProfileFileSinkTest, DisabledByDefault)
+{
+    EXPECT_FALSE(Datadog::ProfileFileSink::enabled());
+    EXPECT_FALSE(write({ 1, 2, 3 }));
+}
+
+TEST(ProfileFileSinkTest, RingOfFiles)
+{
+    const std::string prefix = make_prefix();
+    Datadog::ProfileFileSink::configure(prefix, 2, 1024);
+    ASSERT_TRUE(Datadog::ProfileFileSink::enabled());
+    EXPECT_TRUE(write({ 1 }));
+    EXPECT_TRUE(write({ 2, 2 }));
+    EXPECT_EQ(read(prefix, 1), std::vector<uint8_t>({ 1 }));
+    EXPECT_EQ(read(prefix, 2), std::vector<uint8_t>({ 2, 2 }));
+
+    // The third profile takes the place of the first one, and nothing else is left behind
+    EXPECT_TRUE(write({ 3, 3, 3 }));
+    EXPECT_EQ(read(prefix, 1), std::vector<uint8_t>({ 3, 3, 3 }));
+    EXPECT_EQ(read(prefix, 2), std::vector<uint8_t>({ 2, 2 }));
+    EXPECT_TRUE(read(prefix, 3).empty());
+    EXPECT_NE(access((prefix + "." + std::to_string(getpid()) + ".1.tmp").c_str(), F_OK), 0);
+    Datadog::ProfileFileSink::configure("", 0, 0);
+}
+
+TEST(ProfileFileSinkTest, DiscardsProfilesOverTheLimit)
+{
+    const std::string prefix = make_prefix();
+    Datadog::ProfileFileSink::configure(prefix, 4, 10);
+    EXPECT_FALSE(write(std::vector<uint8_t>(11, 0)));
+    EXPECT_TRUE(read(prefix, 1).empty());
+    EXPECT_TRUE(write(std::vector<uint8_t>(10, 0)));
+    EXPECT_EQ(read(prefix, 1).size(), 10);
+    Datadog::ProfileFileSink::configure("", 0, 0);
+}
+
+TEST(ProfileFileSinkTest, UnwritableDirectory)
+{
+    Datadog::ProfileFileSink::configure("/nonexistent/dir/profile", 4, 1024);
+    EXPECT_FALSE(write({ 1 }));
+    Datadog::ProfileFileSink::configure("", 0, 0);
+}
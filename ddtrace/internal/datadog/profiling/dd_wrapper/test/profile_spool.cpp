@@ -0,0 +1,105 @@
+#include "profile_spool.hpp"
+#include <gtest/gtest.h>
+
+#include <array>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+static std::string
+make_spool_dir()
+{
+    std::array<char, 32> tmpl = { "/tmp/dd_spool_test_XXXXXX" };
+    const char* dir = mkdtemp(tmpl.data());
+    EXPECT_NE(dir, nullptr);
+    return std::string(dir) + "/spool";
+}
+
+static bool
+store(uint64_t start_seconds, const std::vector<uint8_t>& data)
+{
+    const ddog_Timespec start = { .seconds = static_cast<int64_t>(start_seconds), .nanoseconds = 1 };
+    const ddog_Timespec end = { .seconds = static_cast<int64_t>(start_seconds) + 60, .nanoseconds = 2 };
+    return Datadog::ProfileSpool::store(start, end, { .ptr = data.data(), .len = data.size() });
+}
+
+TEST(ProfileSpoolTest, DisabledByDefault)
+{
+    EXPECT_FALSE(Datadog::ProfileSpool::enabled());
+    EXPECT_FALSE(store(1, { 1, 2, 3 }));
+    EXPECT_FALSE(Datadog::ProfileSpool::take().has_value());
+}
+
+TEST(ProfileSpoolTest, OldestFirst)
+{
+    Datadog::ProfileSpool::configure(make_spool_dir(), 1024 * 1024);
+    ASSERT_TRUE(Datadog::ProfileSpool::enabled());
+    EXPECT_TRUE(store(20, { 2, 2 }));
+    EXPECT_TRUE(store(10, { 1 }));
+
+    auto first = Datadog::ProfileSpool::take();
+    ASSERT_TRUE(first.has_value());
+    EXPECT_EQ(first->start.seconds, 10);
+    EXPECT_EQ(first->start.nanoseconds, 1);
+    EXPECT_EQ(first->end.seconds, 70);
+    EXPECT_EQ(first->end.nanoseconds, 2);
+    EXPECT_EQ(first->data, std::vector<uint8_t>({ 1 }));
+
+    // A profile which couldn't be sent goes back to the spool
+    Datadog::ProfileSpool::release(*first, false);
+    first = Datadog::ProfileSpool::take();
+    ASSERT_TRUE(first.has_value());
+    EXPECT_EQ(first->start.seconds, 10);
+    Datadog::ProfileSpool::release(*first, true);
+
+    auto second = Datadog::ProfileSpool::take();
+    ASSERT_TRUE(second.has_value());
+    EXPECT_EQ(second->data, std::vector<uint8_t>({ 2, 2 }));
+    Datadog::ProfileSpool::release(*second, true);
+
+    EXPECT_FALSE(Datadog::ProfileSpool::take().has_value());
+    Datadog::ProfileSpool::configure("", 0);
+}
+
+TEST(ProfileSpoolTest, DiscardsOldestWhenFull)
+{
+    // Room for two of these profiles, along with their headers
+    const std::vector<uint8_t> data(1000, 42);
+    Datadog::ProfileSpool::configure(make_spool_dir(), 2500);
+    EXPECT_TRUE(store(1, data));
+    EXPECT_TRUE(store(2, data));
+    EXPECT_TRUE(store(3, data));
+
+    // Bigger than the spool altogether
+    EXPECT_FALSE(store(4, std::vector<uint8_t>(4000, 0)));
+
+    std::vector<int64_t> starts;
+    while (auto spooled = Datadog::ProfileSpool::take()) {
+        starts.push_back(spooled->start.seconds);
+        EXPECT_EQ(spooled->data, data);
+        Datadog::ProfileSpool::release(*spooled, true);
+    }
+    EXPECT_EQ(starts, std::vector<int64_t>({ 2, 3 }));
+    Datadog::ProfileSpool::configure("", 0);
+}
+
+TEST(ProfileSpoolTest, SkipsUnreadableFiles)
+{
+    const std::string dir = make_spool_dir();
+    Datadog::ProfileSpool::configure(dir, 1024 * 1024);
+    EXPECT_TRUE(store(2, { 7 }));
+
+    // Sorts before the valid profile, but isn't one
+    FILE* garbage = std::fopen((dir + "/00000000000000000001-1-0.pprof").c_str(), "w");
+    ASSERT_NE(garbage, nullptr);
+    std::fputs("not a profile", garbage);
+    std::fclose(garbage);
+
+    auto spooled = Datadog::ProfileSpool::take();
+    ASSERT_TRUE(spooled.has_value());
+    EXPECT_EQ(spooled->start.seconds, 2);
+    Datadog::ProfileSpool::release(*spooled, true);
+    EXPECT_FALSE(Datadog::ProfileSpool::take().has_value());
+    Datadog::ProfileSpool::configure("", 0);
+}
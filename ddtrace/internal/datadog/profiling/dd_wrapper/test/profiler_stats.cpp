@@ -0,0 +1,74 @@
+#include "profiler_stats.hpp"
+#include <gtest/gtest.h>
+
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+static std::map<std::string, uint64_t>
+snapshot()
+{
+    std::map<std::string, uint64_t> stats;
+    std::string_view name;
+    uint64_t value = 0;
+    for (size_t i = 0; Datadog::ProfilerStats::get(i, name, value); i++) {
+        stats[std::string(name)] = value;
+    }
+    return stats;
+}
+
+TEST(ProfilerStatsTest, EveryStatIsExported)
+{
+    Datadog::ProfilerStats::reset();
+    const auto stats = snapshot();
+    EXPECT_EQ(stats.size(), Datadog::ProfilerStats::size());
+    EXPECT_EQ(stats.count("samples_collected"), 1);
+    EXPECT_EQ(stats.count("string_table_bytes"), 1);
+    EXPECT_EQ(stats.count("serialize_count"), 1);
+    EXPECT_EQ(stats.count("serialize_total_ns"), 1);
+    EXPECT_EQ(stats.count("serialize_max_ns"), 1);
+}
+
+TEST(ProfilerStatsTest, CountersGaugesAndTimers)
+{
+    Datadog::ProfilerStats::reset();
+    Datadog::ProfilerStats::add(Datadog::ProfilerCounter::samples_dropped);
+    Datadog::ProfilerStats::add(Datadog::ProfilerCounter::upload_bytes, 100);
+    Datadog::ProfilerStats::set(Datadog::ProfilerGauge::string_table_bytes, 5);
+    Datadog::ProfilerStats::set(Datadog::ProfilerGauge::string_table_bytes, 3);
+    Datadog::ProfilerStats::record(Datadog::ProfilerTimer::upload, std::chrono::nanoseconds(10));
+    Datadog::ProfilerStats::record(Datadog::ProfilerTimer::upload, std::chrono::nanoseconds(30));
+
+    auto stats = snapshot();
+    EXPECT_EQ(stats["samples_dropped"], 1);
+    EXPECT_EQ(stats["upload_bytes"], 100);
+    EXPECT_EQ(stats["string_table_bytes"], 3);
+    EXPECT_EQ(stats["upload_count"], 2);
+    EXPECT_EQ(stats["upload_total_ns"], 40);
+    EXPECT_EQ(stats["upload_max_ns"], 30);
+}
+
+TEST(ProfilerStatsTest, ConcurrentUpdates)
+{
+    Datadog::ProfilerStats::reset();
+    constexpr int num_threads = 8;
+    constexpr int num_updates = 10000;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; t++) {
+        threads.emplace_back([t]() {
+            for (int i = 0; i < num_updates; i++) {
+                Datadog::ProfilerStats::add(Datadog::ProfilerCounter::samples_collected);
+                Datadog::ProfilerStats::record(Datadog::ProfilerTimer::flush_sample, std::chrono::nanoseconds(t));
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    auto stats = snapshot();
+    EXPECT_EQ(stats["samples_collected"], num_threads * num_updates);
+    EXPECT_EQ(stats["flush_sample_count"], num_threads * num_updates);
+    EXPECT_EQ(stats["flush_sample_max_ns"], num_threads - 1);
+}
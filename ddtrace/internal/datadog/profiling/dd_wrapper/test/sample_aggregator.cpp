@@ -0,0 +1,125 @@
+#include "libdatadog_helpers.hpp"
+#include "sample_aggregator.hpp"
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+// Strings are only compared by address, so every test uses these
+static const std::string handler = "handler";
+static const std::string query = "query";
+static const std::string app = "app.py";
+static const std::string thread_name = "thread name";
+static const std::string main_thread = "MainThread";
+
+static std::vector<ddog_prof_Location>
+make_stack(const std::vector<const std::string*>& names)
+{
+    std::vector<ddog_prof_Location> locations;
+    for (const auto* name : names) {
+        auto& location = locations.emplace_back();
+        location.function.name = Datadog::to_slice(*name);
+        location.function.filename = Datadog::to_slice(app);
+        location.line = static_cast<int64_t>(name->size());
+    }
+    return locations;
+}
+
+static ddog_prof_Sample
+make_sample(const std::vector<ddog_prof_Location>& locations,
+            const std::vector<ddog_prof_Label>& labels,
+            std::vector<int64_t>& values)
+{
+    return {
+        .locations = { locations.data(), locations.size() },
+        .values = { values.data(), values.size() },
+        .labels = { labels.data(), labels.size() },
+    };
+}
+
+static std::vector<std::vector<int64_t>>
+drain(Datadog::SampleAggregator& aggregator)
+{
+    std::vector<std::vector<int64_t>> result;
+    aggregator.drain([&result](const ddog_prof_Sample& sample) {
+        result.emplace_back(sample.values.ptr, sample.values.ptr + sample.values.len);
+    });
+    return result;
+}
+
+TEST(SampleAggregatorTest, IdenticalSamplesAreSummed)
+{
+    Datadog::SampleAggregator aggregator(16);
+    const auto stack = make_stack({ &query, &handler });
+    const std::vector<ddog_prof_Label> labels = { { .key = Datadog::to_slice(thread_name),
+                                                    .str = Datadog::to_slice(main_thread) } };
+    for (int64_t i = 1; i <= 3; i++) {
+        std::vector<int64_t> values = { i * 10, 1 };
+        EXPECT_TRUE(aggregator.add(make_sample(stack, labels, values)));
+    }
+    EXPECT_EQ(aggregator.size(), 1);
+    EXPECT_EQ(drain(aggregator), std::vector<std::vector<int64_t>>({ { 60, 3 } }));
+    EXPECT_EQ(aggregator.size(), 0);
+    EXPECT_TRUE(drain(aggregator).empty());
+}
+
+TEST(SampleAggregatorTest, DifferentSamplesAreKeptApart)
+{
+    Datadog::SampleAggregator aggregator(16);
+    const auto stack = make_stack({ &query, &handler });
+    const auto other_stack = make_stack({ &handler });
+    const std::vector<ddog_prof_Label> no_labels;
+    const std::vector<ddog_prof_Label> labels = { { .key = Datadog::to_slice(thread_name),
+                                                    .str = Datadog::to_slice(main_thread) } };
+    const std::vector<ddog_prof_Label> num_labels = { { .key = Datadog::to_slice(thread_name), .num = 1 } };
+
+    std::vector<int64_t> values = { 1 };
+    aggregator.add(make_sample(stack, no_labels, values));
+    aggregator.add(make_sample(other_stack, no_labels, values));
+    aggregator.add(make_sample(stack, labels, values));
+    aggregator.add(make_sample(stack, num_labels, values));
+    aggregator.add(make_sample(stack, no_labels, values));
+
+    // Other lines make for other locations
+    auto moved_stack = stack;
+    moved_stack[0].line += 1;
+    aggregator.add(make_sample(moved_stack, no_labels, values));
+
+    EXPECT_EQ(aggregator.size(), 5);
+    EXPECT_EQ(drain(aggregator), std::vector<std::vector<int64_t>>({ { 2 }, { 1 }, { 1 }, { 1 }, { 1 } }));
+}
+
+TEST(SampleAggregatorTest, FullTableRejectsNewSamples)
+{
+    Datadog::SampleAggregator aggregator(2);
+    const auto stack = make_stack({ &query });
+    const auto other_stack = make_stack({ &handler });
+    const auto third_stack = make_stack({ &handler, &query });
+    const std::vector<ddog_prof_Label> no_labels;
+    std::vector<int64_t> values = { 1 };
+
+    EXPECT_TRUE(aggregator.add(make_sample(stack, no_labels, values)));
+    EXPECT_TRUE(aggregator.add(make_sample(other_stack, no_labels, values)));
+    EXPECT_FALSE(aggregator.add(make_sample(third_stack, no_labels, values)));
+
+    // Samples which are already pending can still be added to
+    EXPECT_TRUE(aggregator.add(make_sample(stack, no_labels, values)));
+    EXPECT_EQ(drain(aggregator), std::vector<std::vector<int64_t>>({ { 2 }, { 1 } }));
+
+    EXPECT_TRUE(aggregator.add(make_sample(third_stack, no_labels, values)));
+    EXPECT_EQ(drain(aggregator), std::vector<std::vector<int64_t>>({ { 1 } }));
+}
+
+TEST(SampleAggregatorTest, ClearForgetsPendingSamples)
+{
+    Datadog::SampleAggregator aggregator(16);
+    const auto stack = make_stack({ &query });
+    const std::vector<ddog_prof_Label> no_labels;
+    std::vector<int64_t> values = { 5 };
+    aggregator.add(make_sample(stack, no_labels, values));
+    aggregator.clear();
+    EXPECT_EQ(aggregator.size(), 0);
+
+    aggregator.add(make_sample(stack, no_labels, values));
+    EXPECT_EQ(drain(aggregator), std::vector<std::vector<int64_t>>({ { 5 } }));
+}
@@ -0,0 +1,173 @@
+#include "shared_aggregation.hpp"
+#include "constants.hpp"
+#include "libdatadog_helpers.hpp"
+#include "profiler_stats.hpp"
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static std::vector<ddog_prof_Location>
+make_stack(const std::vector<std::string>& names)
+{
+    std::vector<ddog_prof_Location> locations;
+    for (const auto& name : names) {
+        auto& location = locations.emplace_back();
+        location.function.name = Datadog::to_slice(name);
+        location.function.filename = Datadog::to_slice("app.py");
+        location.line = static_cast<int64_t>(name.size());
+    }
+    return locations;
+}
+
+static bool
+record(const std::vector<std::string>& names, std::vector<int64_t> values)
+{
+    const auto locations = make_stack(names);
+    return Datadog::SharedAggregation::record(locations.data(), locations.size(), values.data(), values.size());
+}
+
+static uint64_t
+stat(std::string_view wanted)
+{
+    std::string_view name;
+    uint64_t value = 0;
+    for (size_t i = 0; Datadog::ProfilerStats::get(i, name, value); i++) {
+        if (name == wanted) {
+            return value;
+        }
+    }
+    return 0;
+}
+
+// Runs `fn` in a child process, and returns whether it succeeded
+template<typename F>
+static bool
+in_child(F fn)
+{
+    const pid_t pid = fork();
+    if (pid == 0) {
+        Datadog::SharedAggregation::postfork_child();
+        _exit(fn() ? 0 : 1);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+TEST(SharedAggregationTest, DisabledByDefault)
+{
+    EXPECT_FALSE(Datadog::SharedAggregation::enabled());
+    EXPECT_FALSE(record({ "handler" }, { 1, 10 }));
+    EXPECT_TRUE(Datadog::SharedAggregation::take().empty());
+}
+
+TEST(SharedAggregationTest, AggregatesAcrossProcesses)
+{
+    ASSERT_TRUE(Datadog::SharedAggregation::configure("", 64));
+    ASSERT_TRUE(Datadog::SharedAggregation::enabled());
+
+    // Each worker has its own entry for the same stack
+    for (int i = 0; i < 2; i++) {
+        EXPECT_TRUE(in_child([] {
+            bool ok = true;
+            for (int j = 0; j < 3; j++) {
+                ok = record({ "query", "handler" }, { 1, 10 }) && ok;
+            }
+            return ok;
+        }));
+    }
+    EXPECT_TRUE(record({ "query", "handler" }, { 1, 10 }));
+    EXPECT_TRUE(record({ "render", "handler" }, { 2, 20 }));
+
+    auto stacks = Datadog::SharedAggregation::take();
+    ASSERT_EQ(stacks.size(), 4);
+    std::sort(stacks.begin(), stacks.end(), [](const auto& a, const auto& b) { return a.values[0] < b.values[0]; });
+    EXPECT_EQ(stacks[0].pid, getpid());
+    EXPECT_EQ(stacks[0].values, std::vector<int64_t>({ 1, 10 }));
+    EXPECT_EQ(stacks[1].values, std::vector<int64_t>({ 2, 20 }));
+    ASSERT_EQ(stacks[1].frames.size(), 2);
+    EXPECT_EQ(stacks[1].frames[0].name, "render");
+    EXPECT_EQ(stacks[1].frames[0].filename, "app.py");
+    EXPECT_EQ(stacks[1].frames[0].line, 6);
+    EXPECT_EQ(stacks[1].frames[1].name, "handler");
+    for (size_t i = 2; i < stacks.size(); i++) {
+        EXPECT_NE(stacks[i].pid, getpid());
+        EXPECT_EQ(stacks[i].values, std::vector<int64_t>({ 3, 30 }));
+        EXPECT_EQ(stacks[i].frames[0].name, "query");
+    }
+    EXPECT_NE(stacks[2].pid, stacks[3].pid);
+
+    // Taking the stacks empties the segment
+    EXPECT_TRUE(Datadog::SharedAggregation::take().empty());
+    Datadog::SharedAggregation::reset();
+}
+
+TEST(SharedAggregationTest, ReconfiguringKeepsTheSegment)
+{
+    ASSERT_TRUE(Datadog::SharedAggregation::configure("", 64));
+    EXPECT_TRUE(in_child([] { return Datadog::SharedAggregation::configure("", 64) && record({ "child" }, { 1 }); }));
+    const auto stacks = Datadog::SharedAggregation::take();
+    ASSERT_EQ(stacks.size(), 1);
+    EXPECT_EQ(stacks[0].frames[0].name, "child");
+    Datadog::SharedAggregation::reset();
+}
+
+TEST(SharedAggregationTest, OneUploader)
+{
+    ASSERT_TRUE(Datadog::SharedAggregation::configure("", 64));
+    EXPECT_TRUE(Datadog::SharedAggregation::elect(1000));
+    EXPECT_TRUE(Datadog::SharedAggregation::elect(2000));
+
+    // Another process can only take over once the uploader is stale
+    EXPECT_TRUE(in_child([] { return !Datadog::SharedAggregation::elect(3000); }));
+    EXPECT_TRUE(in_child([] { return Datadog::SharedAggregation::elect(3000 + g_shared_aggregation_stale_ns); }));
+
+    // The child which took over is gone, so the next one to try becomes the uploader
+    EXPECT_TRUE(Datadog::SharedAggregation::elect(4000 + g_shared_aggregation_stale_ns));
+    Datadog::SharedAggregation::reset();
+}
+
+TEST(SharedAggregationTest, DropsWhenFull)
+{
+    Datadog::ProfilerStats::reset();
+    ASSERT_TRUE(Datadog::SharedAggregation::configure("", 1));
+    for (int i = 0; i < 100; i++) {
+        EXPECT_TRUE(record({ "frame" + std::to_string(i) }, { 1 }));
+    }
+    const size_t recorded = Datadog::SharedAggregation::take().size();
+    EXPECT_GT(recorded, 0);
+    EXPECT_LT(recorded, 100);
+    EXPECT_EQ(stat("shared_aggregation_dropped"), 100 - recorded);
+
+    // Samples with other sample types than the ones of the segment are dropped too
+    EXPECT_TRUE(record({ "frame" }, { 1 }));
+    EXPECT_TRUE(record({ "frame" }, { 1, 2 }));
+    EXPECT_EQ(stat("shared_aggregation_dropped"), 101 - recorded);
+    Datadog::SharedAggregation::reset();
+}
+
+TEST(SharedAggregationTest, NamedSegment)
+{
+    const std::string name = "/dd-shared-aggregation-test-" + std::to_string(getpid());
+    ASSERT_TRUE(Datadog::SharedAggregation::configure(name, 64));
+
+    // A process which didn't inherit the mapping finds the segment by its name
+    EXPECT_TRUE(in_child([&] {
+        return Datadog::SharedAggregation::configure("", 0) && Datadog::SharedAggregation::configure(name, 64) &&
+               record({ "child" }, { 1 }) && !Datadog::SharedAggregation::configure(name, 1024);
+    }));
+    const auto stacks = Datadog::SharedAggregation::take();
+    ASSERT_EQ(stacks.size(), 1);
+    EXPECT_EQ(stacks[0].frames[0].name, "child");
+
+    EXPECT_TRUE(Datadog::SharedAggregation::configure("", 0));
+    EXPECT_FALSE(Datadog::SharedAggregation::enabled());
+    shm_unlink(name.c_str());
+}
@@ -0,0 +1,79 @@
+#include "staging_buffer.hpp"
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+static ddog_prof_Sample
+make_sample(std::vector<int64_t>& values)
+{
+    return {
+        .locations = { nullptr, 0 },
+        .values = { values.data(), values.size() },
+        .labels = { nullptr, 0 },
+    };
+}
+
+TEST(StagingBufferTest, PushAndDrainInOrder)
+{
+    Datadog::StagingBuffer buffer(8, std::this_thread::get_id());
+    for (int64_t i = 0; i < 5; i++) {
+        std::vector<int64_t> values = { i, i * 2 };
+        EXPECT_TRUE(buffer.push(make_sample(values), 1000 + i));
+    }
+    EXPECT_EQ(buffer.size(), 5);
+
+    int64_t expected = 0;
+    const size_t drained = buffer.drain([&expected](const ddog_prof_Sample& sample, int64_t timestamp_ns) {
+        ASSERT_EQ(sample.values.len, 2);
+        EXPECT_EQ(sample.values.ptr[0], expected);
+        EXPECT_EQ(sample.values.ptr[1], expected * 2);
+        EXPECT_EQ(timestamp_ns, 1000 + expected);
+        ++expected;
+    });
+    EXPECT_EQ(drained, 5);
+    EXPECT_EQ(buffer.size(), 0);
+}
+
+TEST(StagingBufferTest, FullBufferRejectsPush)
+{
+    Datadog::StagingBuffer buffer(4, std::this_thread::get_id());
+    std::vector<int64_t> values = { 1 };
+    for (int i = 0; i < 4; i++) {
+        EXPECT_TRUE(buffer.push(make_sample(values), 0));
+    }
+    EXPECT_FALSE(buffer.push(make_sample(values), 0));
+
+    buffer.discard();
+    EXPECT_EQ(buffer.size(), 0);
+    EXPECT_TRUE(buffer.push(make_sample(values), 0));
+}
+
+TEST(StagingBufferTest, ConcurrentProducerAndConsumer)
+{
+    Datadog::StagingBuffer buffer(16, std::this_thread::get_id());
+    constexpr int64_t num_samples = 100000;
+    std::atomic<bool> done{ false };
+
+    std::thread producer([&buffer, &done]() {
+        for (int64_t i = 0; i < num_samples;) {
+            std::vector<int64_t> values = { i };
+            if (buffer.push(make_sample(values), 0)) {
+                ++i;
+            }
+        }
+        done.store(true);
+    });
+
+    int64_t expected = 0;
+    auto visitor = [&expected](const ddog_prof_Sample& sample, int64_t) {
+        EXPECT_EQ(sample.values.ptr[0], expected++);
+    };
+    while (!done.load()) {
+        buffer.drain(visitor);
+    }
+    producer.join();
+    buffer.drain(visitor);
+    EXPECT_EQ(expected, num_samples);
+}
@@ -0,0 +1,173 @@
+#include "string_table.hpp"
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+TEST(StringTableTest, InsertReturnsEqualView)
+{
+    Datadog::StringTable table;
+    std::string str = "my_function";
+    auto view = table.insert_or_get(str);
+    EXPECT_EQ(view, "my_function");
+
+    // The view must not alias the caller's storage
+    EXPECT_NE(view.data(), str.data());
+    str[0] = 'X';
+    EXPECT_EQ(view, "my_function");
+}
+
+TEST(StringTableTest, RepeatedInsertIsDeduplicated)
+{
+    Datadog::StringTable table;
+    auto first = table.insert_or_get("my_file.py");
+    auto second = table.insert_or_get(std::string("my_file.py"));
+    EXPECT_EQ(first.data(), second.data());
+    EXPECT_EQ(table.get_misses(), 1);
+    EXPECT_EQ(table.get_hits(), 1);
+}
+
+TEST(StringTableTest, LongAndEmptyStrings)
+{
+    Datadog::StringTable table;
+    const std::string long_str(1024 * 1024, 'a');
+    auto view = table.insert_or_get(long_str);
+    EXPECT_EQ(view, long_str);
+    EXPECT_EQ(table.insert_or_get(long_str).data(), view.data());
+
+    auto empty = table.insert_or_get("");
+    EXPECT_TRUE(empty.empty());
+}
+
+TEST(StringTableTest, ViewsSurviveGrowth)
+{
+    Datadog::StringTable table;
+    std::vector<std::string_view> views;
+    for (int i = 0; i < 100000; i++) {
+        views.push_back(table.insert_or_get("string_" + std::to_string(i)));
+    }
+    for (int i = 0; i < 100000; i++) {
+        EXPECT_EQ(views[i], "string_" + std::to_string(i));
+    }
+}
+
+TEST(StringTableTest, LastGenerationStrings)
+{
+    Datadog::StringTable table;
+    EXPECT_EQ(table.get_last_generation_strings(), 0);
+    for (int i = 0; i < 100; i++) {
+        table.insert_or_get("string_" + std::to_string(i));
+    }
+    table.advance_generation();
+    EXPECT_EQ(table.get_last_generation_strings(), 100);
+
+    // Only the strings used again are copied forward
+    for (int i = 0; i < 10; i++) {
+        EXPECT_EQ(table.insert_or_get("string_" + std::to_string(i)), "string_" + std::to_string(i));
+    }
+    table.advance_generation();
+    EXPECT_EQ(table.get_last_generation_strings(), 10);
+}
+
+TEST(StringTableTest, ConcurrentInserts)
+{
+    Datadog::StringTable table;
+    constexpr int num_threads = 8;
+    constexpr int num_strings = 10000;
+    std::vector<std::vector<std::string_view>> results(num_threads);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; t++) {
+        threads.emplace_back([&table, &results, t]() {
+            for (int i = 0; i < num_strings; i++) {
+                results[t].push_back(table.insert_or_get("string_" + std::to_string(i)));
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    // Every thread must have observed the same interned copy of each string
+    for (int t = 1; t < num_threads; t++) {
+        for (int i = 0; i < num_strings; i++) {
+            EXPECT_EQ(results[t][i].data(), results[0][i].data());
+        }
+    }
+    EXPECT_EQ(table.get_misses(), num_strings);
+    EXPECT_EQ(table.get_hits(), (num_threads - 1) * num_strings);
+}
+
+TEST(StringTableTest, StringsInUseSurviveGenerations)
+{
+    Datadog::StringTable table(2, 1024 * 1024);
+    const auto first = table.insert_or_get("still_used");
+    table.insert_or_get("unused");
+
+    // Still valid after one advance; looking it up again copies it into the new generation
+    table.advance_generation();
+    EXPECT_EQ(table.get_generation(), 1);
+    EXPECT_EQ(first, "still_used");
+    const auto second = table.insert_or_get("still_used");
+    EXPECT_EQ(second, "still_used");
+    EXPECT_NE(second.data(), first.data());
+    EXPECT_EQ(table.insert_or_get("still_used").data(), second.data());
+
+    // The first generation is released, taking the unused string with it
+    table.advance_generation();
+    EXPECT_EQ(table.get_bytes(), std::string_view("still_used").size());
+    EXPECT_EQ(second, "still_used");
+
+    table.advance_generation();
+    EXPECT_EQ(table.get_bytes(), 0);
+}
+
+TEST(StringTableTest, MemoryCap)
+{
+    Datadog::StringTable table(2, 16);
+    EXPECT_EQ(table.insert_or_get("0123456789"), "0123456789");
+    EXPECT_EQ(table.insert_or_get("abcdefghij"), Datadog::StringTable::overflow_placeholder);
+    EXPECT_EQ(table.get_rejected(), 1);
+
+    // Room is made once the generation holding the first string is released
+    table.advance_generation();
+    table.advance_generation();
+    EXPECT_EQ(table.insert_or_get("abcdefghij"), "abcdefghij");
+}
+
+TEST(StringTableTest, SurvivesFork)
+{
+    Datadog::StringTable table;
+    const auto before = table.insert_or_get("inherited");
+
+    // Another thread keeps inserting while we fork, so the child is likely to see a shard lock taken
+    std::atomic<bool> done{ false };
+    std::thread inserter([&table, &done]() {
+        for (int i = 0; !done.load(); i++) {
+            table.insert_or_get("busy_" + std::to_string(i % 1000));
+        }
+    });
+
+    table.prefork();
+    const pid_t pid = fork();
+    if (pid == 0) {
+        table.postfork_child();
+
+        // Strings interned before the fork are reused without being copied again
+        const auto hits = table.get_hits();
+        const auto after = table.insert_or_get("inherited");
+        std::_Exit(after.data() == before.data() && table.get_hits() == hits + 1 ? 0 : 1);
+    }
+    table.postfork_parent();
+    done.store(true);
+    inserter.join();
+
+    int status = 0;
+    ASSERT_EQ(waitpid(pid, &status, 0), pid);
+    EXPECT_TRUE(WIFEXITED(status));
+    EXPECT_EQ(WEXITSTATUS(status), 0);
+}
@@ -7,7 +7,9 @@ try:
     is_available = True
 
 except Exception as e:
+    from typing import Any  # noqa:F401
     from typing import Dict  # noqa:F401
+    from typing import List  # noqa:F401
     from typing import Optional  # noqa:F401
 
     from ddtrace.internal.logger import get_logger
@@ -17,6 +19,8 @@ except Exception as e:
 
     is_available = False
 
+    sample_capi = None
+
     # Decorator for not-implemented
     def not_implemented(func):
         def wrapper(*args, **kwargs):
@@ -30,6 +34,17 @@ except Exception as e:
         tags,  # type: Optional[Dict[str, str]]
         max_nframes,  # type: Optional[int]
         url,  # type: Optional[str]
+        sample_pool_capacity,  # type: Optional[int]
+        timeline_enabled,  # type: bool
+        string_table_max_bytes,  # type: Optional[int]
+        spool_dir,  # type: Optional[str]
+        spool_max_bytes,  # type: Optional[int]
+        endpoint_summary_stacks,  # type: Optional[int]
+        endpoint_summary_window,  # type: Optional[float]
+        output_pprof,  # type: Optional[str]
+        output_pprof_max_files,  # type: Optional[int]
+        output_pprof_max_bytes,  # type: Optional[int]
+        type_max_nframes,  # type: Optional[Dict[str, int]]
     ):
         pass
 
@@ -37,6 +52,22 @@ except Exception as e:
     def upload():  # type: () -> None
         pass
 
+    @not_implemented
+    def heap_live_clear():  # type: () -> None
+        pass
+
+    @not_implemented
+    def add_endpoint_count(endpoint):  # type: (Optional[str]) -> None
+        pass
+
+    @not_implemented
+    def get_stats():  # type: () -> Dict[str, int]
+        pass
+
+    @not_implemented
+    def get_endpoint_summary(endpoint=None):  # type: (Optional[str]) -> Dict[str, List[Dict[str, Any]]]
+        pass
+
     class SampleHandle:
         @not_implemented
         def push_cputime(self, value, count):  # type: (int, int) -> None
@@ -62,6 +93,10 @@ except Exception as e:
         def push_heap(self, value):  # type: (int) -> None
             pass
 
+        @not_implemented
+        def push_monotonic_ns(self, monotonic_ns):  # type: (int) -> None
+            pass
+
         @not_implemented
         def push_lock_name(self, lock_name):  # type: (str) -> None
             pass
@@ -70,6 +105,14 @@ except Exception as e:
         def push_frame(self, name, filename, address, line):  # type: (str, str, int, int) -> None
             pass
 
+        @not_implemented
+        def push_frames(self, frames):  # type: (Any) -> None
+            pass
+
+        @not_implemented
+        def push_pyframes(self, frame, max_nframes):  # type: (Any, int) -> int
+            pass
+
         @not_implemented
         def push_threadinfo(self, thread_id, thread_native_id, thread_name):  # type: (int, int, Optional[str]) -> None
             pass
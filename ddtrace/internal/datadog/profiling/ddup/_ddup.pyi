@@ -1,10 +1,16 @@
+from typing import Any
 from typing import Dict
+from typing import Iterable
+from typing import List
 from typing import Optional
+from typing import Tuple
 from typing import Union
 from ddtrace._trace.span import Span
 
 StringType = Union[str, bytes, None]
 
+sample_capi: object
+
 def init(
     env: StringType,
     service: StringType,
@@ -12,8 +18,27 @@ def init(
     tags: Optional[Dict[Union[str, bytes], Union[str, bytes]]],
     max_nframes: Optional[int],
     url: Optional[str],
+    sample_pool_capacity: Optional[int],
+    timeline_enabled: bool,
+    string_table_max_bytes: Optional[int],
+    spool_dir: StringType,
+    spool_max_bytes: Optional[int],
+    endpoint_summary_stacks: Optional[int],
+    endpoint_summary_window: Optional[float],
+    shared_aggregation_stacks: Optional[int],
+    shared_aggregation_name: StringType,
+    output_pprof: StringType,
+    output_pprof_max_files: Optional[int],
+    output_pprof_max_bytes: Optional[int],
+    compression: StringType,
+    compression_level: Optional[int],
+    type_max_nframes: Optional[Dict[str, int]],
 ) -> None: ...
 def upload() -> None: ...
+def heap_live_clear() -> None: ...
+def add_endpoint_count(endpoint: StringType) -> None: ...
+def get_stats() -> Dict[str, int]: ...
+def get_endpoint_summary(endpoint: StringType = None) -> Dict[str, List[Dict[str, Any]]]: ...
 
 class SampleHandle:
     def push_cputime(self, value: int, count: int) -> None: ...
@@ -22,8 +47,11 @@ class SampleHandle:
     def push_release(self, value: int, count: int) -> None: ...
     def push_alloc(self, value: int, count: int) -> None: ...
     def push_heap(self, value: int) -> None: ...
+    def push_monotonic_ns(self, monotonic_ns: int) -> None: ...
     def push_lock_name(self, lock_name: StringType) -> None: ...
     def push_frame(self, name: StringType, filename: StringType, address: int, line: int) -> None: ...
+    def push_frames(self, frames: Iterable[Tuple[StringType, int, StringType, StringType]]) -> None: ...
+    def push_pyframes(self, frame: Any, max_nframes: int) -> int: ...
     def push_threadinfo(self, thread_id: int, thread_native_id: int, thread_name: StringType) -> None: ...
     def push_task_id(self, task_id: Optional[int]) -> None: ...
     def push_task_name(self, task_name: StringType) -> None: ...
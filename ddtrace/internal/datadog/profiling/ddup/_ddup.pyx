@@ -2,7 +2,9 @@
 # cython: language_level=3
 
 import platform
+from typing import Any
 from typing import Dict
+from typing import List
 from typing import Optional
 from typing import Union
 
@@ -13,6 +15,10 @@ from ddtrace.internal.datadog.profiling.ddup.utils import sanitize_string
 from ddtrace.internal.runtime import get_runtime_id
 from ddtrace._trace.span import Span
 
+from cpython.pycapsule cimport PyCapsule_New
+from libcpp.string cimport string
+from libcpp.vector cimport vector
+
 
 StringType = Union[str, bytes, None]
 
@@ -22,15 +28,32 @@ cdef extern from "stdint.h":
     ctypedef long long int64_t
     cdef uint64_t UINT64_MAX
     cdef int64_t INT64_MAX
+    cdef size_t SIZE_MAX
 
 cdef extern from "<string_view>" namespace "std" nogil:
     cdef cppclass string_view:
+        string_view()
         string_view(const char* s, size_t count)
+        const char* data()
+        size_t size()
 
 cdef extern from "sample.hpp" namespace "Datadog":
     ctypedef struct Sample:
         pass
 
+cdef extern from "endpoint_summary.hpp" namespace "Datadog":
+    cdef cppclass SummaryFrame:
+        string name
+        string filename
+        int64_t line
+
+    cdef cppclass SummaryStack:
+        vector[SummaryFrame] frames
+        uint64_t samples
+        uint64_t error
+        int64_t cpu_time_ns
+        int64_t wall_time_ns
+
 cdef extern from "interface.hpp":
     void ddup_config_env(string_view env)
     void ddup_config_service(string_view service)
@@ -40,6 +63,21 @@ cdef extern from "interface.hpp":
     void ddup_config_profiler_version(string_view profiler_version)
     void ddup_config_url(string_view url)
     void ddup_config_max_nframes(int max_nframes)
+    void ddup_config_type_max_nframes(unsigned int type, int max_nframes)
+    void ddup_config_sample_pool_capacity(uint64_t sample_pool_capacity)
+    void ddup_config_timeline(bint enabled)
+    void ddup_config_string_table_max_bytes(uint64_t max_bytes)
+    void ddup_config_spool(string_view dir, uint64_t max_bytes)
+    void ddup_config_output_pprof(string_view prefix, uint64_t max_files, uint64_t max_bytes)
+    bint ddup_config_compression(string_view codec, int level)
+    void ddup_config_endpoint_summary(uint64_t max_stacks, int64_t window_ns)
+    void ddup_config_shared_aggregation(string_view name, uint64_t max_stacks)
+    void ddup_endpoint_summary_endpoints(vector[string] *out)
+    void ddup_endpoint_summary_top(string_view endpoint, vector[SummaryStack] *out)
+    size_t ddup_endpoint_count_intern(string_view endpoint)
+    void ddup_endpoint_count_add(size_t index)
+    size_t ddup_stats_size()
+    bint ddup_stats_get(size_t index, string_view *name, uint64_t *value)
 
     void ddup_config_user_tag(string_view key, string_view val)
     void ddup_config_sample_type(unsigned int type)
@@ -53,6 +91,7 @@ cdef extern from "interface.hpp":
     void ddup_push_release(Sample *sample, int64_t release_time, int64_t count)
     void ddup_push_alloc(Sample *sample, int64_t size, int64_t count)
     void ddup_push_heap(Sample *sample, int64_t size)
+    void ddup_push_monotonic_ns(Sample *sample, int64_t monotonic_ns)
     void ddup_push_lock_name(Sample *sample, string_view lock_name)
     void ddup_push_threadinfo(Sample *sample, int64_t thread_id, int64_t thread_native_id, string_view thread_name)
     void ddup_push_task_id(Sample *sample, int64_t task_id)
@@ -66,9 +105,103 @@ cdef extern from "interface.hpp":
     void ddup_push_frame(Sample *sample, string_view _name, string_view _filename, uint64_t address, int64_t line)
     void ddup_flush_sample(Sample *sample)
     void ddup_drop_sample(Sample *sample)
+    void ddup_heap_live_clear()
     void ddup_set_runtime_id(string_view _id)
     bint ddup_upload() nogil
 
+cdef extern from "sample_capi.h":
+    ctypedef struct ddup_sample_capi_t:
+        pass
+    const char *DDUP_SAMPLE_CAPI_NAME
+    const ddup_sample_capi_t *ddup_sample_capi_get()
+
+# Walks a Python stack and pushes its frames to the sample without building any intermediate object, for the stack
+# collector.  The frame and code objects found while walking are type-checked, since there are reports of Python 3.11
+# returning other objects during unwinding; the walk gives up with -1 when that happens.
+cdef extern from *:
+    """
+    #include <frameobject.h>
+
+    #if PY_VERSION_HEX < 0x03090000
+    static inline PyCodeObject*
+    PyFrame_GetCode(PyFrameObject* frame)
+    {
+        Py_INCREF(frame->f_code);
+        return frame->f_code;
+    }
+
+    static inline PyFrameObject*
+    PyFrame_GetBack(PyFrameObject* frame)
+    {
+        Py_XINCREF(frame->f_back);
+        return frame->f_back;
+    }
+    #endif
+
+    static inline std::string_view
+    pyframes_utf8(PyObject* str)
+    {
+        Py_ssize_t size = 0;
+        const char* data = PyUnicode_Check(str) ? PyUnicode_AsUTF8AndSize(str, &size) : NULL;
+
+        if (data == NULL) {
+            PyErr_Clear();
+            return std::string_view();
+        }
+        return std::string_view(data, size);
+    }
+
+    static Py_ssize_t
+    push_pyframes(Datadog::Sample* sample, PyObject* top, Py_ssize_t max_nframes)
+    {
+        PyFrameObject* frame = (PyFrameObject*)top;
+        Py_ssize_t nframes = 0;
+
+        if (!PyFrame_Check(top))
+            return -1;
+
+        Py_INCREF(frame);
+        while (frame != NULL) {
+            PyFrameObject* back;
+
+            if (nframes < max_nframes) {
+                PyCodeObject* code = PyFrame_GetCode(frame);
+                int line;
+
+                if (!PyCode_Check((PyObject*)code)) {
+                    Py_DECREF(code);
+                    Py_DECREF(frame);
+                    return -1;
+                }
+                line = PyFrame_GetLineNumber(frame);
+                ddup_push_frame(
+                  sample, pyframes_utf8(code->co_name), pyframes_utf8(code->co_filename), 0, line < 0 ? 0 : line);
+                Py_DECREF(code);
+            }
+            nframes++;
+
+            back = PyFrame_GetBack(frame);
+            Py_DECREF(frame);
+            frame = back;
+            if (frame != NULL && !PyFrame_Check((PyObject*)frame)) {
+                Py_DECREF(frame);
+                return -1;
+            }
+        }
+        return nframes;
+    }
+    """
+    string_view pyframes_utf8(object str)
+    Py_ssize_t push_pyframes(Sample *sample, object top, Py_ssize_t max_nframes)
+
+cdef string_view _frame_string_view(object value):
+    # For the str and bytes objects push_frames has at hand, which outlive the view
+    cdef bytes value_bytes
+    if type(value) is bytes:
+        value_bytes = value
+        return string_view(<const char*>value_bytes, len(value_bytes))
+    return pyframes_utf8(value)
+
 # Create wrappers for cython
 cdef call_ddup_config_service(bytes service):
     ddup_config_service(string_view(<const char*>service, len(service)))
@@ -123,6 +256,17 @@ cdef int64_t clamp_to_int64_unsigned(value):
     return value
 
 
+# The bits of the sample types in types.hpp, by the name used to configure their frame limit
+_SAMPLE_TYPE_BITS = {
+    "cpu": 1 << 0,
+    "wall": 1 << 1,
+    "exception": 1 << 2,
+    "lock": (1 << 3) | (1 << 4),
+    "allocation": 1 << 5,
+    "heap": 1 << 6,
+}
+
+
 # Public API
 def init(
         service: StringType = None,
@@ -130,7 +274,22 @@ def init(
         version: StringType = None,
         tags: Optional[Dict[Union[str, bytes], Union[str, bytes]]] = None,
         max_nframes: Optional[int] = None,
-        url: StringType = None) -> None:
+        url: StringType = None,
+        sample_pool_capacity: Optional[int] = None,
+        timeline_enabled: bool = False,
+        string_table_max_bytes: Optional[int] = None,
+        spool_dir: StringType = None,
+        spool_max_bytes: Optional[int] = None,
+        endpoint_summary_stacks: Optional[int] = None,
+        endpoint_summary_window: Optional[float] = None,
+        shared_aggregation_stacks: Optional[int] = None,
+        shared_aggregation_name: StringType = None,
+        output_pprof: StringType = None,
+        output_pprof_max_files: Optional[int] = None,
+        output_pprof_max_bytes: Optional[int] = None,
+        compression: StringType = None,
+        compression_level: Optional[int] = None,
+        type_max_nframes: Optional[Dict[str, int]] = None) -> None:
 
     # Try to provide a ddtrace-specific default service if one is not given
     service = service or DEFAULT_SERVICE_NAME
@@ -152,6 +311,47 @@ def init(
 
     if max_nframes is not None:
         ddup_config_max_nframes(clamp_to_int64_unsigned(max_nframes))
+    if type_max_nframes:
+        for name, nframes in type_max_nframes.items():
+            if nframes and name in _SAMPLE_TYPE_BITS:
+                ddup_config_type_max_nframes(_SAMPLE_TYPE_BITS[name], clamp_to_int64_unsigned(nframes))
+    if sample_pool_capacity:
+        ddup_config_sample_pool_capacity(clamp_to_uint64_unsigned(sample_pool_capacity))
+    if timeline_enabled:
+        ddup_config_timeline(True)
+    if string_table_max_bytes:
+        ddup_config_string_table_max_bytes(clamp_to_uint64_unsigned(string_table_max_bytes))
+    if spool_dir and spool_max_bytes:
+        spool_dir_bytes = ensure_binary_or_empty(spool_dir)
+        ddup_config_spool(
+            string_view(<const char*>spool_dir_bytes, len(spool_dir_bytes)),
+            clamp_to_uint64_unsigned(spool_max_bytes)
+        )
+    if output_pprof:
+        output_pprof_bytes = ensure_binary_or_empty(output_pprof)
+        ddup_config_output_pprof(
+            string_view(<const char*>output_pprof_bytes, len(output_pprof_bytes)),
+            clamp_to_uint64_unsigned(output_pprof_max_files or 0),
+            clamp_to_uint64_unsigned(output_pprof_max_bytes or 0)
+        )
+    if compression:
+        compression_bytes = ensure_binary_or_empty(compression)
+        ddup_config_compression(
+            string_view(<const char*>compression_bytes, len(compression_bytes)),
+            max(0, min(compression_level or 0, 22))
+        )
+    if endpoint_summary_stacks:
+        window_ns = int(endpoint_summary_window * 1e9) if endpoint_summary_window else 0
+        ddup_config_endpoint_summary(
+            clamp_to_uint64_unsigned(endpoint_summary_stacks),
+            clamp_to_int64_unsigned(window_ns)
+        )
+    if shared_aggregation_stacks:
+        shared_aggregation_name_bytes = ensure_binary_or_empty(shared_aggregation_name)
+        ddup_config_shared_aggregation(
+            string_view(<const char*>shared_aggregation_name_bytes, len(shared_aggregation_name_bytes)),
+            clamp_to_uint64_unsigned(shared_aggregation_stacks)
+        )
     if tags is not None:
         for key, val in tags.items():
             if key and val:
@@ -166,6 +366,84 @@ def upload() -> None:
         ddup_upload()
 
 
+# Native collectors push their samples through this rather than SampleHandle, see sample_capi.h
+sample_capi = PyCapsule_New(<void *>ddup_sample_capi_get(), DDUP_SAMPLE_CAPI_NAME, NULL)
+
+
+def heap_live_clear() -> None:
+    # Forget the heap samples exported as deltas, which are otherwise added to every profile
+    ddup_heap_live_clear()
+
+
+# The native index of every endpoint counted so far, see endpoint_counts.hpp.  Indices remain valid across forks.
+cdef dict _endpoint_count_indices = {}
+
+
+def add_endpoint_count(endpoint: StringType) -> None:
+    # Counts one request served by the endpoint, which is added to the next profile
+    cdef size_t index
+    cached = _endpoint_count_indices.get(endpoint)
+    if cached is not None:
+        ddup_endpoint_count_add(<size_t>cached)
+        return
+    endpoint_bytes = ensure_binary_or_empty(endpoint)
+    index = ddup_endpoint_count_intern(string_view(<const char*>endpoint_bytes, len(endpoint_bytes)))
+    if index == SIZE_MAX:
+        return
+    _endpoint_count_indices[endpoint] = index
+    ddup_endpoint_count_add(index)
+
+
+def get_stats() -> Dict[str, int]:
+    cdef string_view name
+    cdef uint64_t value
+    stats = {}
+    for i in range(ddup_stats_size()):
+        if ddup_stats_get(i, &name, &value):
+            stats[name.data()[:name.size()].decode("utf-8")] = value
+    return stats
+
+
+def get_endpoint_summary(endpoint: StringType = None) -> Dict[str, List[Dict[str, Any]]]:
+    # The heaviest stacks of every endpoint (or just the given one) over the configured window, heaviest first.
+    # Frames are given leaf first, as (function name, file name, line) tuples.
+    cdef vector[string] endpoints
+    cdef vector[SummaryStack] stacks
+    cdef size_t i, j
+    names = []
+    if endpoint is None:
+        ddup_endpoint_summary_endpoints(&endpoints)
+        for i in range(endpoints.size()):
+            names.append(<bytes>endpoints[i])
+    else:
+        names = [ensure_binary_or_empty(endpoint)]
+
+    summary = {}
+    for name in names:
+        stacks.clear()
+        ddup_endpoint_summary_top(string_view(<const char*>name, len(name)), &stacks)
+        if stacks.empty():
+            continue
+        entries = []
+        for i in range(stacks.size()):
+            frames = []
+            for j in range(stacks[i].frames.size()):
+                frames.append((
+                    stacks[i].frames[j].name.decode("utf-8", "replace"),
+                    stacks[i].frames[j].filename.decode("utf-8", "replace"),
+                    stacks[i].frames[j].line,
+                ))
+            entries.append({
+                "frames": frames,
+                "samples": stacks[i].samples,
+                "error": stacks[i].error,
+                "cpu_time_ns": stacks[i].cpu_time_ns,
+                "wall_time_ns": stacks[i].wall_time_ns,
+            })
+        summary[name.decode("utf-8", "replace")] = entries
+    return summary
+
+
 cdef class SampleHandle:
     cdef Sample *ptr
 
@@ -201,6 +479,10 @@ cdef class SampleHandle:
         if self.ptr is not NULL:
             ddup_push_heap(self.ptr, clamp_to_int64_unsigned(value))
 
+    def push_monotonic_ns(self, monotonic_ns: int) -> None:
+        if self.ptr is not NULL:
+            ddup_push_monotonic_ns(self.ptr, clamp_to_int64_unsigned(monotonic_ns))
+
     def push_lock_name(self, lock_name: StringType) -> None:
         if self.ptr is not NULL:
             lock_name_bytes = ensure_binary_or_empty(lock_name)
@@ -219,6 +501,34 @@ cdef class SampleHandle:
                     clamp_to_int64_unsigned(line),
             )
 
+    def push_frames(self, frames) -> None:
+        # Pushes (filename, lineno, function_name, class_name) frames, such as DDFrame tuples, with the same
+        # conversions as push_frame but in a single loop; the str objects are pushed without copying them to bytes.
+        if self.ptr is NULL:
+            return
+        for frame in frames:
+            filename = frame[0]
+            lineno = frame[1]
+            name = frame[2]
+            if type(name) is not str:
+                name = ensure_binary_or_empty(sanitize_string(name))
+            if type(filename) is not str:
+                filename = ensure_binary_or_empty(sanitize_string(filename))
+            ddup_push_frame(
+                    self.ptr,
+                    _frame_string_view(name),
+                    _frame_string_view(filename),
+                    0,
+                    clamp_to_int64_unsigned(lineno),
+            )
+
+    def push_pyframes(self, frame, max_nframes: int) -> int:
+        # Pushes at most max_nframes frames of the stack which starts at frame, and returns the depth of the stack.
+        # A negative depth means the stack could not be walked; the sample should be dropped then.
+        if self.ptr is NULL:
+            return 0
+        return push_pyframes(self.ptr, frame, clamp_to_int64_unsigned(max_nframes))
+
     def push_threadinfo(self, thread_id: int, thread_native_id: int, thread_name: StringType) -> None:
         if self.ptr is not NULL:
             thread_id = thread_id if thread_id is not None else 0
@@ -246,7 +556,7 @@ cdef class SampleHandle:
     def push_exceptioninfo(self, exc_type: Union[None, bytes, str, type], count: int) -> None:
         if self.ptr is not NULL:
             exc_name = None
-            if exc_type is type:
+            if isinstance(exc_type, type):
                 exc_name = ensure_binary_or_empty(exc_type.__module__ + "." + exc_type.__name__)
             else:
                 exc_name = ensure_binary_or_empty(exc_type)
@@ -276,10 +586,10 @@ cdef class SampleHandle:
             span_type_bytes = ensure_binary_or_empty(span._local_root.span_type)
             ddup_push_trace_type(self.ptr, string_view(<const char*>span_type_bytes, len(span_type_bytes)))
         if endpoint_collection_enabled:
-            root_service_bytes = ensure_binary_or_empty(span._local_root.service)
+            root_resource_bytes = ensure_binary_or_empty(span._local_root.resource)
             ddup_push_trace_resource_container(
                     self.ptr,
-                    string_view(<const char*>root_service_bytes, len(root_service_bytes))
+                    string_view(<const char*>root_resource_bytes, len(root_resource_bytes))
             )
 
     def flush_sample(self) -> None:
@@ -171,6 +171,7 @@ print_help() {
   echo "  all_test (default)"
   echo "  dd_wrapper"
   echo "  dd_wrapper_test"
+  echo "  dd_wrapper_bench (builds dd_wrapper_bench, does not run it)"
   echo "  stack_v2 (also builds dd_wrapper)"
   echo "  stack_v2_test (also builds dd_wrapper_test)"
   echo "  ddup (also builds dd_wrapper)"
@@ -283,7 +284,11 @@ add_target() {
   if [[ "${arg}" =~ _test$ ]]; then
     cmake_args+=(-DBUILD_TESTING=ON)
   fi
+  if [[ "${arg}" =~ _bench$ ]]; then
+    cmake_args+=(-DBUILD_BENCHMARKS=ON)
+  fi
   target=${arg%_test}
+  target=${target%_bench}
 
   case "${target}" in
     all|--)
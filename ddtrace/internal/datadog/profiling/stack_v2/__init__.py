@@ -17,14 +17,69 @@ def stop(*args, **kwargs):
     pass
 
 
+@not_implemented
+def shutdown(*args, **kwargs):
+    pass
+
+
 @not_implemented
 def set_interval(*args, **kwargs):
     pass
 
 
+@not_implemented
+def get_interval(*args, **kwargs):
+    pass
+
+
+@not_implemented
+def get_actual_interval(*args, **kwargs):
+    pass
+
+
+@not_implemented
+def start_burst(*args, **kwargs):
+    pass
+
+
+@not_implemented
+def stop_burst(*args, **kwargs):
+    pass
+
+
+@not_implemented
+def set_span_capture(*args, **kwargs):
+    pass
+
+
+@not_implemented
+def capture_span(*args, **kwargs):
+    pass
+
+
+@not_implemented
+def init_asyncio(*args, **kwargs):
+    pass
+
+
+@not_implemented
+def track_asyncio_loop(*args, **kwargs):
+    pass
+
+
+@not_implemented
+def link_tasks(*args, **kwargs):
+    pass
+
+
 try:
     from ._stack_v2 import *  # noqa: F401, F403
 
+    # stop() only pauses the sampling thread, so make sure it is gone before the interpreter is torn down
+    from ddtrace.internal import atexit
+
+    atexit.register(shutdown)  # noqa: F405
+
     is_available = True
 except Exception as e:
     from ddtrace.internal.logger import get_logger
@@ -1,8 +1,63 @@
+#pragma once
+
 #include "dd_wrapper/include/constants.hpp"
 
+#include <chrono>
+
 // Default sampling frequency in microseconds.  This will almost certainly be overridden by dynamic sampling.
 constexpr unsigned int g_default_sampling_period_us = 10000; // 100 Hz
 constexpr double g_default_sampling_period_s = g_default_sampling_period_us / 1e6;
 
+// Default overhead budget for the sampling thread, as a percentage of one CPU.  This matches the default for
+// ddtrace/settings/profiling.py:ProfilingConfig.max_time_usage_pct.
+constexpr double g_default_max_time_usage_pct = 1.0;
+
+// By default, every thread is sampled on every pass
+constexpr size_t g_default_max_threads_per_pass = 0;
+
 // Echion maintains a cache of frames--the size of this cache is specified up-front.
 constexpr unsigned int g_default_echion_frame_cache_size = 1024;
+
+// Bounds of the frame cache when it is sized adaptively, see frame_cache_sizer.hpp.  The capacity is re-evaluated once
+// per window, which has to see enough lookups for its hit rate to mean something.
+constexpr size_t g_min_echion_frame_cache_size = 256;
+constexpr size_t g_max_echion_frame_cache_size = 65536;
+constexpr double g_frame_cache_grow_below_hit_rate = 0.95;
+constexpr uint64_t g_frame_cache_window_lookups = 10000;
+constexpr std::chrono::seconds g_frame_cache_window{ 30 };
+
+// Maximum number of distinct frames for which the renderer keeps validated, interned strings.
+constexpr size_t g_default_interned_frame_cache_size = 4096;
+
+// Maximum number of threads for which the renderer keeps prebuilt thread labels.
+constexpr size_t g_default_thread_label_cache_size = 1024;
+
+// Identical stacks of a thread are collapsed into one sample across passes, see stack_collapser.hpp.  A sample is
+// held back for at most this long, and for at most so many stacks at a time.
+constexpr size_t g_default_stack_collapse_max_stacks = 1024;
+constexpr int64_t g_default_stack_collapse_max_age_ns = 1000LL * 1000 * 1000;
+
+// Maximum number of distinct frames each thread keeps interned strings for when capturing stacks at span boundaries.
+// Captures are rate limited, so this can be much smaller than the sampler's cache.
+constexpr size_t g_default_span_capture_frame_cache_size = 512;
+
+// Default rate limit of the captures taken at span boundaries
+constexpr double g_default_span_capture_max_per_second = 10.0;
+
+// Highest CPU number (exclusive) the sampling thread can be pinned to; this is CPU_SETSIZE on Linux
+constexpr int g_max_affinity_cpus = 1024;
+
+// Bounds of the bursts, see Sampler::start_burst().  Bursts aren't part of the overhead budget, so they are kept
+// short and no faster than 10 kHz.
+constexpr unsigned int g_min_burst_interval_us = 100;
+constexpr double g_max_burst_duration_s = 60.0;
+
+// How long shutting down waits for the sampling thread to finish its current pass, in seconds
+constexpr double g_default_shutdown_timeout_s = 1.0;
+
+// Timers on the CPU clock of each thread, see cpu_timers.hpp.  Each thread is interrupted once per interval of CPU
+// it consumes, and keeps at most a ring's worth of interruptions between two passes; the time of any further ones is
+// still accounted for, just not where it was spent.
+constexpr int64_t g_cpu_timer_interval_ns = 10000000; // 100 Hz of CPU time
+constexpr size_t g_cpu_timer_ring_size = 64;
+constexpr int g_cpu_timer_signal_offset = 6; // From SIGRTMIN
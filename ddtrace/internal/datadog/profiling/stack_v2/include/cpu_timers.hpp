@@ -0,0 +1,103 @@
+#pragma once
+
+#include "constants.hpp"
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include <signal.h>
+#include <time.h>
+
+namespace Datadog {
+
+// Where a thread was running when its CPU timer fired, and how much CPU time that stands for
+struct CpuTimerEvent
+{
+    uint64_t pc;
+    int64_t cpu_time_ns;
+};
+
+// What a thread consumed since it was last drained.  Events at the same address are merged.
+struct CpuTimerDrain
+{
+    bool tracked = false;             // Whether the thread has a timer; if not, echion's CPU time stands
+    int64_t unattributed_cpu_ns = 0;  // The CPU time of the events which didn't fit in the ring
+    size_t count = 0;
+    std::array<CpuTimerEvent, g_cpu_timer_ring_size> events{};
+};
+
+// The sampling thread only sees what each thread is doing at the time of the pass, and echion only knows how much
+// CPU each thread consumed in between, so CPU time is attributed to wherever the thread happens to be when it is
+// sampled.  A thread which spins in native code between two passes, and is blocked by the time of the second,
+// charges its CPU time to the wrong stack.
+//
+// This arms a timer on the CPU clock of every sampled thread, which sends a signal to that very thread each time it
+// has consumed another interval of CPU.  The handler only records the address the thread was interrupted at into a
+// ring of its own, which is async-signal-safe; the sampling thread drains the ring when it samples the thread, and
+// the renderer emits one sample per address on top of the Python stack of the thread.  The timers use a realtime
+// signal rather than SIGPROF, which echion unwinds native stacks with.  Linux only; only the sampling thread calls
+// into this.
+class CpuTimers
+{
+  private:
+    // Filled by the handler on the thread, emptied by the sampling thread
+    struct Ring
+    {
+        std::atomic<uint32_t> head{ 0 };
+        std::atomic<uint32_t> tail{ 0 };
+        std::atomic<uint64_t> dropped_ticks{ 0 };
+        std::array<CpuTimerEvent, g_cpu_timer_ring_size> events{};
+    };
+
+    struct Timer
+    {
+        unsigned long native_id;
+        bool armed; // Failed timers are remembered too, so that they aren't retried on every pass
+        timer_t id;
+        std::unique_ptr<Ring> ring;
+        uint64_t pass; // The last pass the thread was seen in
+    };
+
+    static inline std::atomic<bool> installed{ false };
+    static inline int signo = 0;
+    static void handler(int signo, siginfo_t* info, void* context);
+
+    std::unordered_map<uintptr_t, Timer> timers{}; // By thread id
+    uint64_t pass = 0;
+
+    // A handler may still be writing to the ring of a timer which was just deleted, so rings are only freed a pass
+    // after their timer
+    std::vector<std::unique_ptr<Ring>> retired{};
+    std::vector<std::unique_ptr<Ring>> retiring{};
+
+    void disarm(Timer& timer);
+
+  public:
+    // Installs the signal handler.  Returns false if timers aren't supported, or if someone else handles the signal.
+    static bool install();
+
+    // Arms the timer of the thread if it doesn't have one yet.  Called for every thread on every pass, whether it is
+    // sampled or not.
+    void track(uintptr_t thread_id, unsigned long native_id, clockid_t cpu_clock_id);
+
+    // Takes the events of the thread since it was last drained
+    void drain(uintptr_t thread_id, CpuTimerDrain& out);
+
+    // Deletes the timers of the threads which weren't tracked during the pass, which have most likely exited
+    void end_pass();
+
+    // Timers aren't inherited by the child of a fork, and only the forking thread is left there
+    void postfork_child();
+
+    CpuTimers() = default;
+    ~CpuTimers();
+    CpuTimers(const CpuTimers&) = delete;
+    CpuTimers& operator=(const CpuTimers&) = delete;
+};
+
+} // namespace Datadog
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+#include <setjmp.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+namespace Datadog {
+
+// Echion reads the memory of the interpreter with process_vm_readv(), even though the sampled process is the
+// profiler's own, which costs a system call for every frame, code object and string of every stack of every pass.
+// Since these reads never leave the process, they can be plain copies instead, as long as a copy from memory which
+// was unmapped under our feet doesn't crash the process.
+//
+// This installs handlers for SIGSEGV and SIGBUS, which jump out of copies which fault on the sampling thread, and
+// defer to whatever handler was installed before for any other fault.  The process_vm_readv() calls of echion,
+// which is compiled into this extension, are then routed through `read()`; on any other thread, outside of a pass,
+// or when someone else has taken over the signals since, they go to the kernel as before.
+class FastMemoryReads
+{
+  private:
+    static inline std::atomic<bool> installed{ false };
+    static inline struct sigaction previous_segv = {};
+    static inline struct sigaction previous_bus = {};
+
+    // Only touched by the sampling thread, and by the signal handler on that thread
+    static inline thread_local bool in_pass{ false };
+    static inline thread_local pid_t pass_pid{ 0 };
+    static inline thread_local volatile sig_atomic_t in_copy{ 0 };
+    static inline thread_local sigjmp_buf copy_env{};
+
+    static void handler(int signo, siginfo_t* info, void* context);
+    static bool is_current(int signo);
+
+  public:
+    // Installs the signal handlers.  Returns false if they could not be installed, in which case reads keep going
+    // through the kernel.
+    static bool install();
+
+    // Brackets a sampling pass on the calling thread.  Returns whether reads are copies during the pass; checking
+    // the handlers once per pass costs a couple of system calls, rather than one per read.
+    static bool begin_pass();
+    static void end_pass();
+
+    // Whether reads from `pid` on the calling thread are copies
+    static bool active(pid_t pid);
+
+    // Same contract as process_vm_readv() for the calling process: the segments are copied in order, and the
+    // number of bytes copied before the first fault is returned, or -1 with errno set to EFAULT if that's none
+    static ssize_t read(const ::iovec* local_iov,
+                        unsigned long liovcnt,
+                        const ::iovec* remote_iov,
+                        unsigned long riovcnt);
+};
+
+} // namespace Datadog
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <string_view>
+#include <unordered_map>
+
+namespace Datadog {
+
+// Echion keeps the frames it has read in an LRU cache whose capacity is fixed when it is initialized, and which
+// doesn't report how well it does.  A service with more hot frames than that keeps re-reading them from the
+// interpreter, while a small one pays for a cache it never fills.
+//
+// This keeps a shadow LRU of the same capacity over the frames the renderer sees, which only stores a hash of each
+// frame, so its hits and misses follow the ones of echion's cache closely enough to size it.  At the end of every
+// window, the capacity doubles if too many lookups missed, and halves if the window touched only a small fraction
+// of it.  Both thresholds are far enough apart that the capacity doesn't oscillate.  Only the sampling thread
+// touches this.
+class FrameCacheSizer
+{
+  private:
+    struct Entry
+    {
+        std::list<uint64_t>::iterator position;
+        uint64_t window; // The last window this entry was looked up in
+    };
+
+    std::list<uint64_t> lru{}; // Most recently used first
+    std::unordered_map<uint64_t, Entry> index{};
+    size_t capacity;
+    bool adaptive = false;
+
+    // The first window, and the one after each resize, are skipped since they mostly see the misses of filling
+    // the cache
+    uint64_t window = 0;
+    uint64_t settled_window = 1;
+    uint64_t window_hits = 0;
+    uint64_t window_misses = 0;
+    uint64_t window_distinct = 0;
+    std::chrono::steady_clock::time_point window_start{};
+
+    void set_capacity(size_t new_capacity);
+
+  public:
+    // Resets the shadow cache to the given capacity.  Unless adaptive, the capacity never changes afterwards, but
+    // hits and misses are still reported.
+    void configure(size_t _capacity, bool _adaptive);
+
+    // Accounts for one frame handed to the renderer
+    void record(std::string_view name, std::string_view file, uint64_t line);
+
+    // Called after every pass.  Returns the capacity echion's cache should be re-initialized with, or 0 to keep it.
+    size_t end_pass(std::chrono::steady_clock::time_point now);
+
+    size_t get_capacity() const;
+
+    FrameCacheSizer(size_t _capacity);
+};
+
+} // namespace Datadog
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string_view>
+#include <unordered_map>
+
+namespace Datadog {
+
+// Echion hands frames to the renderer as views into its own string storage, which is stable for as long as the
+// underlying code object stays in echion's frame cache.  That means the address of those views is a cheap proxy for
+// the identity of the code object, which lets us skip UTF-8 validation and string table lookups for frames we have
+// already seen.
+//
+// Addresses can be reused after echion evicts an entry, so a hit is only trusted after comparing the bytes against
+// the interned copy.  That comparison is far cheaper than validating and hashing the strings again.
+class InternedFrameCache
+{
+  public:
+    struct InternedFrame
+    {
+        std::string_view name;
+        std::string_view file;
+    };
+
+  private:
+    struct Key
+    {
+        const char* name_ptr;
+        size_t name_len;
+        const char* file_ptr;
+        size_t file_len;
+
+        bool operator==(const Key& other) const
+        {
+            return name_ptr == other.name_ptr && name_len == other.name_len && file_ptr == other.file_ptr &&
+                   file_len == other.file_len;
+        }
+    };
+
+    struct KeyHash
+    {
+        size_t operator()(const Key& key) const
+        {
+            // Pointers are already well-distributed, so just mix them together
+            const auto name_hash = std::hash<const char*>{}(key.name_ptr) ^ key.name_len;
+            const auto file_hash = std::hash<const char*>{}(key.file_ptr) ^ key.file_len;
+            return name_hash ^ (file_hash + 0x9e3779b97f4a7c15ULL + (name_hash << 6) + (name_hash >> 2));
+        }
+    };
+
+    std::unordered_map<Key, InternedFrame, KeyHash> cache{};
+    size_t max_size;
+
+    static InternedFrame intern(std::string_view name, std::string_view file);
+
+  public:
+    // Returns the validated, interned version of the given frame
+    InternedFrame get(std::string_view name, std::string_view file);
+
+    // Drops all cached entries, for instance when the interned strings are no longer valid
+    void clear();
+
+    InternedFrameCache(size_t _max_size);
+};
+
+} // namespace Datadog
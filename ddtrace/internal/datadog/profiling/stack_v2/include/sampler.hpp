@@ -1,8 +1,20 @@
 #pragma once
 #include "constants.hpp"
+#include "cpu_timers.hpp"
 #include "stack_renderer.hpp"
+#include "thread_state.hpp"
 
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Defined by echion/threads.h, which can only be included once
+class ThreadInfo;
 
 namespace Datadog {
 
@@ -14,16 +26,105 @@ class Sampler
   private:
     std::shared_ptr<StackRenderer> renderer_ptr;
 
-    // The sampling interval is atomic because it needs to be safely propagated to the sampling thread
+    // The sampling interval is atomic because it needs to be safely propagated to the sampling thread.
+    // This is the floor; the sampling thread may stretch the interval in order to keep within its overhead budget.
     std::atomic<microsecond_t> sample_interval_us{ g_default_sampling_period_us };
 
-    // This is not a running total of the number of launched threads; it is a sequence for the
-    // transactions upon the sampling threads (usually starts + stops). This allows threads to be
-    // stopped or started in a straightforward manner without finer-grained control (locks)
-    std::atomic<uint64_t> thread_seq_num{ 0 };
+    // Fraction (in percent) of one CPU the sampling thread may spend sampling, and the resulting interval
+    std::atomic<double> max_time_usage_pct{ g_default_max_time_usage_pct };
+    std::atomic<microsecond_t> effective_interval_us{ g_default_sampling_period_us };
+
+    // Updates the effective interval given the CPU cost of the last sampling pass
+    microsecond_t adapt_interval(microsecond_t pass_cpu_time_us);
+    double smoothed_pass_cost_us = 0.0;
+
+    // The period actually observed between passes, which is longer than the effective interval when the sampling
+    // thread wakes up late or can't keep up
+    void record_period(microsecond_t period_us);
+    std::atomic<microsecond_t> actual_interval_us{ 0 };
+    double smoothed_period_us = 0.0;
+
+    // Passes are scheduled on absolute deadlines, so the period doesn't drift with the cost of each pass
+    static std::chrono::steady_clock::time_point next_deadline(std::chrono::steady_clock::time_point deadline,
+                                                               microsecond_t interval_us);
+
+    // Scheduling setup for the sampling thread itself.  The CPUs are guarded by thread_mtx.
+    std::atomic<bool> realtime_priority{ false };
+    std::atomic<bool> idle_priority{ false };
+    std::vector<int> cpu_affinity;
+    void setup_sampling_thread();
+
+    // Thread subsampling.  When there are more candidate threads than max_threads_per_pass, each one is sampled with
+    // probability max_threads_per_pass / candidates, and its wall time is scaled back up by the inverse.  CPU time
+    // needs no such correction, since echion reports the CPU time accrued since the thread was last sampled.
+    // Zero means every thread is sampled on every pass.
+    std::atomic<size_t> max_threads_per_pass{ g_default_max_threads_per_pass };
+    std::atomic<bool> skip_idle_threads{ false };
+    std::atomic<bool> collect_thread_state{ false };
+    ThreadStateReader thread_state_reader; // Only used by the sampling thread
+    CpuTimers cpu_timers;                  // Ditto, when cpu_timers_active
+    CpuTimerDrain cpu_timer_drain;
+    bool cpu_timers_active = false;
+    size_t last_pass_candidate_count = 0;
+    std::minstd_rand thread_rng{ std::random_device{}() };
+
+    // Last observed CPU time for each thread, used to detect idle threads.  Rebuilt every pass so exited threads
+    // don't accumulate.
+    std::unordered_map<uintptr_t, microsecond_t> last_thread_cpu_us;
+    std::unordered_map<uintptr_t, microsecond_t> next_thread_cpu_us;
+    bool is_thread_idle(ThreadInfo& thread);
+
+    // Echion walks the asyncio tasks of the threads which run an event loop, given the loop of each thread and the
+    // task registries of asyncio.  Python threads hand those over here, and the sampling thread applies them to
+    // echion between passes, so that echion's state is only ever touched by the sampling thread.  The task links
+    // go straight into echion, which guards them with its own lock.
+    std::mutex asyncio_mtx;
+    std::unordered_map<uintptr_t, uintptr_t> asyncio_loops; // Thread id to loop; guarded by asyncio_mtx
+    PyObject* asyncio_current_tasks_ptr = nullptr;          // Ditto, for the task registries
+    PyObject* asyncio_scheduled_tasks_ptr = nullptr;
+    PyObject* asyncio_eager_tasks_ptr = nullptr;
+    std::atomic<uint64_t> asyncio_generation{ 0 };
+    uint64_t applied_asyncio_generation = 0; // The fields below are only used by the sampling thread
+    std::unordered_map<uintptr_t, uintptr_t> sampled_asyncio_loops;
+    void apply_asyncio();
+
+    // The sampling thread is launched once, and parked on thread_cv while the sampler is stopped, so toggling the
+    // profiler neither spawns threads nor can leave two of them sampling.  Each thread is launched with the current
+    // sequence number, and exits as soon as it changes; `shutdown()` is the only thing which bumps it.
+    std::mutex thread_mtx;
+    std::condition_variable thread_cv;
+    std::thread sampler_thread;
+    uint64_t thread_seq_num = 0; // The fields below are guarded by thread_mtx
+    bool sampling_enabled = false;
+    bool thread_alive = false;
+    uint64_t alive_thread_seq_num = 0; // The sequence number the live thread, if any, was launched with
+
+    // A burst runs its own passes in between the regular ones, which carry on as usual, see start_burst().  The
+    // fields below are guarded by thread_mtx too; start_burst() and stop_burst() bump burst_seq to wake the thread.
+    bool burst_active = false;
+    uint64_t burst_seq = 0;
+    microsecond_t burst_interval_us = 0;
+    std::chrono::steady_clock::time_point burst_next{};
+    std::chrono::steady_clock::time_point burst_prev{};
+    std::chrono::steady_clock::time_point burst_end{};
+    void burst_pass(microsecond_t wall_time_us);
+    void finish_burst(std::unique_lock<std::mutex>& lock);
+
+    // Waits for the deadline of the next regular pass, running the passes of the burst in the meantime
+    void wait_for_pass(std::unique_lock<std::mutex>& lock,
+                       std::chrono::steady_clock::time_point deadline,
+                       uint64_t seq_num);
+
+    // On free-threaded builds, nothing serializes calls from Python anymore, so starting, stopping and the
+    // parameters which only take effect on start are guarded by this
+    std::mutex lifecycle_mtx;
 
     // Parameters
     uint64_t echion_frame_cache_size = g_default_echion_frame_cache_size;
+    bool adaptive_frame_cache = false;
+    bool native_frames = false;
+    bool fast_memory_reads = false;
+    bool use_cpu_timers = false;
 
     // Helper function; implementation of the echion sampling thread
     void sampling_thread(const uint64_t seq_num);
@@ -34,17 +135,85 @@ class Sampler
     // One-time setup of echion
     void one_time_setup();
 
+    // The sampling thread doesn't exist in the child of a fork
+    static void postfork_child();
+
   public:
     // Singleton instance
     static Sampler& get();
+
+    // Resumes sampling, launching the sampling thread if there isn't one
     void start();
+
+    // Pauses sampling.  The sampling thread finishes its current pass, if any, and then waits for `start()`.
     void stop();
 
+    // Stops the sampling thread altogether, waiting up to `timeout` for it to exit.  Returns false if it didn't, in
+    // which case it is left to exit on its own; it won't sample again either way.
+    bool shutdown(std::chrono::milliseconds timeout);
+
     // The Python side dynamically adjusts the sampling rate based on overhead, so we need to be able to update our own
     // intervals accordingly.  Rather than a preemptive measure, we assume the rate is ~fairly stable and just update
-    // the next rate with the latest interval. This is not perfect because the adjustment is based on self-time, and
-    // we're not currently accounting for the echion self-time.
+    // the next rate with the latest interval.  The Python side can't see the echion self-time, so this is treated
+    // as a minimum: the sampling thread measures the cost of each of its passes and backs off as needed to stay
+    // within max_time_usage_pct.
     void set_interval(double new_interval);
+    void set_max_time_usage_pct(double new_max_time_usage_pct);
+
+    // Samples every thread every `interval_s` seconds for `duration_s` seconds, into a profile of its own which is
+    // uploaded with the `profile_mode:burst` tag once the burst ends (see dd_wrapper's burst_profile.hpp).  The
+    // regular passes, their profile and their overhead accounting are left alone, except for the CPU time the
+    // burst sees, which is still attributed to the next regular sample of each thread.  The burst also ends when
+    // the sampler is stopped.  Returns false if the sampler isn't running, or if there already is a burst.
+    bool start_burst(double interval_s, double duration_s);
+    void stop_burst();
+
+    // The interval actually being used by the sampling thread, and the period actually observed between passes,
+    // in seconds
+    double get_effective_interval();
+    double get_actual_interval();
+
+    // Runs the sampling thread with the lowest realtime priority, so that it keeps its rate on busy systems.  This
+    // is applied when the thread is launched, and typically requires CAP_SYS_NICE.
+    void set_realtime_priority(bool new_realtime_priority);
+
+    // Runs the sampling thread on the given CPUs only (or wherever the scheduler likes if empty), and/or with the
+    // SCHED_IDLE policy, so that it doesn't compete with the application's threads in CPU-limited containers.  Like
+    // the realtime priority, these are applied when the thread is launched; realtime priority wins over idle.
+    void set_cpu_affinity(std::vector<int> new_cpu_affinity);
+    void set_idle_priority(bool new_idle_priority);
+
+    void set_max_threads_per_pass(size_t new_max_threads_per_pass);
+
+    // Native frames have to be requested before the sampler is first started, since that's when echion installs its
+    // signal handlers.  Returns false if this build doesn't support native unwinding.
+    bool set_native_frames(bool new_native_frames);
+
+    // Reads the memory of the interpreter with guarded copies rather than system calls, see fast_memory_reads.hpp.
+    // Like native frames, this has to be requested before the sampler is first started.
+    void set_fast_memory_reads(bool new_fast_memory_reads);
+
+    // Sets the capacity of echion's frame cache, and whether the sampling thread resizes it according to its
+    // estimated hit rate, see frame_cache_sizer.hpp.  Like native frames, this has to be set before the sampler is
+    // first started.  Since echion also reads its cache from its signal handler when unwinding native frames, the
+    // cache is never resized with native frames; hits and misses are reported either way.
+    void set_frame_cache_size(size_t new_frame_cache_size, bool new_adaptive_frame_cache);
+
+    // Attributes CPU time to where each thread was when it consumed it, rather than to where it is when sampled,
+    // see cpu_timers.hpp.  Like native frames, this has to be requested before the sampler is first started.
+    void set_cpu_timers(bool new_cpu_timers);
+
+    // Registers the asyncio state echion needs to sample tasks rather than the threads running the event loops.
+    // The registries are kept alive until the process exits.  A loop of None stops tracking the thread, and the
+    // eager tasks may be None (Python < 3.12).
+    void init_asyncio(PyObject* current_tasks, PyObject* scheduled_tasks, PyObject* eager_tasks);
+    void track_asyncio_loop(uintptr_t thread_id, PyObject* loop);
+    void link_tasks(PyObject* parent, PyObject* child);
+    void set_skip_idle_threads(bool new_skip_idle_threads);
+
+    // Labels every sample with the GIL and scheduler state of its thread, see thread_state.hpp.  This costs a few
+    // system calls per sampled thread, so it is off by default.
+    void set_thread_state(bool new_thread_state);
 };
 
 } // namespace Datadog
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "python_headers.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace Datadog {
+
+// One-shot captures of the stack of the calling thread, requested by the tracer when a span which exceeded its
+// latency threshold finishes.  Time-based sampling rarely lands on short spans, so these give stacks for the slow
+// requests which would otherwise go unsampled, at the cost of a single stack walk.
+//
+// Captures are pushed into the same profile as regular samples, with the span labels, and weighted like one regular
+// sample so they barely skew wall time.  They are rate limited, so a burst of slow spans costs no more than a few
+// stack walks per second.
+class SpanCapture
+{
+  private:
+    static inline std::atomic<int64_t> min_gap_ns{ 0 }; // Zero disables captures
+    static inline std::atomic<int64_t> next_allowed_ns{ 0 };
+
+    // Leading frames from files under this prefix (the tracer itself) are skipped, so the stack starts where the
+    // span was finished from.  Only set before captures are enabled.
+    static inline std::string ignored_prefix{};
+
+    static bool take_token(int64_t now_ns);
+
+  public:
+    // A rate of 0 disables captures
+    static void configure(double max_per_second, std::string_view _ignored_prefix);
+    static bool enabled();
+
+    // Captures the stack of the calling thread, which must hold the GIL.  Returns false if the capture was not
+    // taken, because of the rate limit or because the profiler isn't running.
+    static bool capture(PyThreadState* tstate,
+                        uint64_t span_id,
+                        uint64_t local_root_span_id,
+                        std::string_view trace_type,
+                        std::string_view trace_resource,
+                        std::string_view thread_name);
+};
+
+} // namespace Datadog
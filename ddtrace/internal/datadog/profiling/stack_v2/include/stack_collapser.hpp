@@ -0,0 +1,91 @@
+#pragma once
+
+#include "dd_wrapper/include/sample.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string_view>
+#include <unordered_map>
+
+namespace Datadog {
+
+// Most threads of a worker process sit in the same stack pass after pass, waiting on a lock or a socket.  Rather
+// than flushing an identical sample for each of those every pass, the renderer hands its samples over to this,
+// along with a fingerprint of their frames and labels.  The last sample of each stack of a thread is held back, and
+// the samples which follow it with the same fingerprint are collapsed into it by adding up their values.  A held
+// sample is flushed once a different stack takes its place, or once it has been held for long enough that its
+// weight would otherwise show up in a later profile than the one it belongs to.
+//
+// Since a held sample only stands for its values, this only works for samples without timestamps, i.e. when the
+// timeline is disabled.  Only the sampling thread touches this.
+class StackCollapser
+{
+  private:
+    struct Key
+    {
+        uintptr_t thread_id;
+        size_t stack; // Threads with asyncio tasks have one stack per task, in the order echion renders them
+
+        bool operator==(const Key& other) const { return thread_id == other.thread_id && stack == other.stack; }
+    };
+
+    struct KeyHash
+    {
+        size_t operator()(const Key& key) const { return std::hash<uintptr_t>{}(key.thread_id) ^ (key.stack << 1); }
+    };
+
+    struct Held
+    {
+        uint64_t fingerprint;
+        Sample* sample;
+        int64_t since_ns;
+    };
+
+    std::unordered_map<Key, Held, KeyHash> held{};
+    size_t max_size;
+    int64_t max_age_ns;
+    uint64_t string_generation = 0; // Held samples refer to interned strings of this generation
+
+    static void flush(Held& entry);
+
+  public:
+    // Takes the sample over from the caller, who may not use it anymore.  It is either collapsed into the held
+    // sample of the same stack, or flushed, or held in its place.  Times are taken from CLOCK_MONOTONIC.
+    void collapse(uintptr_t thread_id, size_t stack, uint64_t fingerprint, Sample* sample, int64_t now_ns);
+
+    // Flushes the samples which were held for too long, so that every pass ends up in the profile it belongs to
+    void end_pass(int64_t now_ns);
+
+    // Flushes every held sample if the interned strings changed generation since they were held.  The strings live
+    // on for another generation, so the samples are still valid when this is called once per generation.
+    void check_generation(uint64_t cur_generation);
+
+    // Flushes every held sample, for instance when sampling stops
+    void flush_all();
+
+    // In the child of a fork, the held samples belong to the parent, so they are dropped without being flushed
+    void discard_all();
+
+    StackCollapser(size_t _max_size, int64_t _max_age_ns);
+    ~StackCollapser();
+    StackCollapser(const StackCollapser&) = delete;
+    StackCollapser& operator=(const StackCollapser&) = delete;
+};
+
+// Helpers for the fingerprints, which only need to tell apart the stacks of one thread from one pass to the next.
+// Interned strings are compared by address, which is stable within a string generation.
+inline void
+fingerprint_combine(uint64_t& seed, uint64_t value)
+{
+    seed ^= value + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2);
+}
+
+inline void
+fingerprint_combine(uint64_t& seed, std::string_view str)
+{
+    fingerprint_combine(seed, reinterpret_cast<uintptr_t>(str.data()));
+    fingerprint_combine(seed, str.size());
+}
+
+} // namespace Datadog
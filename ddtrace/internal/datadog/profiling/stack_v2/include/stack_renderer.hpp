@@ -7,11 +7,19 @@
 #include <string>
 #include <string_view>
 #include <thread>
+#include <unordered_map>
 #include <vector>
 
 #include "python_headers.hpp"
 
-#include "dd_wrapper/include/interface.hpp"
+#include "constants.hpp"
+#include "cpu_timers.hpp"
+#include "dd_wrapper/include/sample.hpp"
+#include "frame_cache_sizer.hpp"
+#include "interned_frame_cache.hpp"
+#include "stack_collapser.hpp"
+#include "thread_label_cache.hpp"
+#include "thread_state.hpp"
 #include "echion/render.h"
 
 namespace Datadog {
@@ -20,6 +28,48 @@ class StackRenderer : public RendererInterface
 {
     Sample* sample = nullptr;
 
+    // Only ever used from the sampling thread, so it needs no synchronization
+    InternedFrameCache frame_cache{ g_default_interned_frame_cache_size };
+    ThreadLabelCache thread_label_cache{ g_default_thread_label_cache_size };
+    FrameCacheSizer frame_cache_sizer{ g_default_echion_frame_cache_size };
+    uint64_t string_generation = 0; // The caches above are only valid for this generation of interned strings
+
+    // Unchanged stacks are collapsed into the sample of their previous pass.  The fingerprint of a stack starts
+    // from the one of its thread's labels and state, and takes in its frames as they are rendered.
+    StackCollapser stack_collapser{ g_default_stack_collapse_max_stacks, g_default_stack_collapse_max_age_ns };
+    bool collapse_stacks = false;
+    uint64_t thread_fingerprint = 0;
+    uint64_t stack_fingerprint = 0;
+    size_t thread_stack = 0; // The index of the stack being rendered among the ones of its thread
+    int64_t collapse_now_ns = 0;
+
+    // Echion doesn't pass the interpreter along to the renderer, so the sampler sets it before visiting its threads
+    int64_t interpreter_id = 0;
+
+    // The context of the thread being rendered, which every one of its stacks is sampled with
+    const LabelSet* thread_labels = nullptr;
+    int64_t thread_wall_time_ns = 0;
+    int64_t thread_now_ns = 0;
+    ThreadState thread_state{};
+    bool stack_types = false; // Whether the current sample has both CPU and wall time
+    bool task_named = false; // Whether the current stack was labelled with its asyncio task
+    bool start_thread_sample(bool with_wall_time = true);
+
+    // During a burst pass, the CPU time echion reports for each thread is what it consumed since the last pass of
+    // either kind.  It goes to the burst, but is also held back for the thread's next regular sample, so the
+    // regular profile doesn't lose it.
+    bool burst = false;
+    bool burst_ended = false;
+    uintptr_t rendered_thread_id = 0;
+    std::unordered_map<uintptr_t, int64_t> burst_cpu_time_ns;
+
+    // Where the thread's CPU timer interrupted it since it was last sampled, see cpu_timers.hpp.  Each address is
+    // emitted as a sample of its own on top of the first stack of the thread, whose frames are kept until it ends.
+    const CpuTimerDrain* cpu_timer_drain = nullptr;
+    std::vector<InternedFrame> timer_frames;
+    bool collect_timer_frames = false;
+    void render_cpu_timer_samples();
+
     virtual void render_message(std::string_view msg) override;
     virtual void render_thread_begin(PyThreadState* tstate,
                                      std::string_view name,
@@ -30,9 +80,34 @@ class StackRenderer : public RendererInterface
     virtual void render_stack_begin() override;
     virtual void render_python_frame(std::string_view name, std::string_view file, uint64_t line) override;
     virtual void render_native_frame(std::string_view name, std::string_view file, uint64_t line) override;
+    void fingerprint_frame(std::string_view name, std::string_view file, uint64_t line);
     virtual void render_cpu_time(microsecond_t cpu_time_us) override;
     virtual void render_stack_end() override;
     virtual bool is_valid() override;
+
+  public:
+    void set_interpreter_id(int64_t _interpreter_id);
+
+    // The sampler sets the state of each thread before echion visits it
+    void set_thread_state(const ThreadState& _thread_state);
+
+    // The sampler drains the CPU timer of each thread into this before echion visits it, if timers are enabled
+    void set_cpu_timer_drain(const CpuTimerDrain* _cpu_timer_drain);
+
+    // Whether the threads about to be rendered are for a burst, whose samples go to a profile of their own.  Once
+    // the burst has ended, the CPU time held back for threads which exited in the meantime is dropped after the
+    // next regular pass.
+    void set_burst(bool _burst);
+    void end_burst();
+
+    // Sizes echion's frame cache from the frames rendered so far; same as FrameCacheSizer
+    void configure_frame_cache(size_t capacity, bool adaptive);
+    size_t end_pass(std::chrono::steady_clock::time_point now);
+
+    // Flushes the samples held back for collapsing, when the sampler is about to park or exit.  In the child of a
+    // fork, they belong to the parent, so they are dropped instead.
+    void flush_collapsed();
+    void postfork_child();
 };
 
 } // namespace Datadog
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "dd_wrapper/include/sample.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace Datadog {
+
+// Thread labels hardly ever change between passes, so the renderer keeps a prebuilt LabelSet for each thread
+// rather than rebuilding and re-interning them for every sample.  An entry is rebuilt whenever the thread's native
+// id, name or interpreter no longer match, which covers renamed threads as well as reused thread ids.
+class ThreadLabelCache
+{
+  private:
+    struct Entry
+    {
+        unsigned long native_id;
+        int64_t interpreter_id;
+        std::string name;
+        LabelSet labels;
+    };
+
+    std::unordered_map<uintptr_t, Entry> cache{};
+    size_t max_size;
+
+  public:
+    // Returns the labels for the given thread, building them if needed
+    const LabelSet& get(uintptr_t thread_id, unsigned long native_id, std::string_view name, int64_t interpreter_id);
+
+    // Drops all cached entries, for instance when the interned strings are no longer valid
+    void clear();
+
+    ThreadLabelCache(size_t _max_size);
+};
+
+} // namespace Datadog
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+#include <sys/types.h>
+
+namespace Datadog {
+
+// What a thread was doing when it was sampled.  Every value is a static string, and empty when unknown.
+struct ThreadState
+{
+    std::string_view gil;            // "held" or "released"
+    std::string_view kernel;         // e.g., "running", "sleeping" or "uninterruptible"
+    std::string_view off_cpu_reason; // For threads which are off CPU: e.g., "lock", "io" or "sleep"
+};
+
+// Tells threads which run Python apart from the ones waiting for the GIL and the ones blocked on I/O.
+//
+// Both are only read on Linux.  The GIL holder is only known up to Python 3.11, where the interpreter keeps the
+// thread state of the holder in a global rather than in a thread-local.  It is read again for every thread, since
+// the GIL changes hands several times during a pass.
+//
+// The scheduler state of each thread is read from /proc/self/task/<tid>/stat, and for the threads which
+// are blocked, the system call they are blocked in from /proc/self/task/<tid>/syscall.  Waiting for the GIL shows up
+// as a lock, like waiting on any other lock; combined with the stack, that is usually enough to tell them apart.
+// The task directory is opened once, so each read is relative to it.  Only the sampling thread uses this.
+class ThreadStateReader
+{
+  private:
+    int task_dir_fd = -1;
+    pid_t task_dir_pid = 0; // The process the task directory belongs to, which changes after a fork
+
+    bool open_task_dir();
+    bool read_file(unsigned long native_id, const char* name, char* buf, size_t size);
+
+    static std::string_view gil_state(uintptr_t thread_id);
+    std::string_view kernel_state(unsigned long native_id, std::string_view& off_cpu_reason);
+
+  public:
+    ThreadState read(uintptr_t thread_id, unsigned long native_id);
+
+    ThreadStateReader() = default;
+    ~ThreadStateReader();
+    ThreadStateReader(const ThreadStateReader&) = delete;
+    ThreadStateReader& operator=(const ThreadStateReader&) = delete;
+};
+
+} // namespace Datadog
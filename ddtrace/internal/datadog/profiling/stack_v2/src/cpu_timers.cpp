@@ -0,0 +1,232 @@
+#include "cpu_timers.hpp"
+
+#include "dd_wrapper/include/profiler_stats.hpp"
+
+#include <algorithm>
+
+#include <ucontext.h>
+
+// Older C libraries only expose the target thread of SIGEV_THREAD_ID through the union
+#if defined PL_LINUX && !defined sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+using namespace Datadog;
+
+namespace {
+
+#if defined PL_LINUX
+uint64_t
+interrupted_pc(void* context)
+{
+    const auto* uc = static_cast<const ucontext_t*>(context);
+#if defined __x86_64__
+    return static_cast<uint64_t>(uc->uc_mcontext.gregs[REG_RIP]);
+#elif defined __aarch64__
+    return static_cast<uint64_t>(uc->uc_mcontext.pc);
+#else
+    (void)uc;
+    return 0;
+#endif
+}
+#endif
+
+} // namespace
+
+void
+CpuTimers::handler(int _signo, siginfo_t* info, void* context)
+{
+#if defined PL_LINUX
+    (void)_signo;
+    if (info == nullptr || info->si_code != SI_TIMER || info->si_value.sival_ptr == nullptr) {
+        return;
+    }
+
+    // Expiries which happened while the signal was still pending are reported as overruns of this one
+    auto* ring = static_cast<Ring*>(info->si_value.sival_ptr);
+    const uint64_t ticks = 1 + static_cast<uint64_t>(std::max(info->si_overrun, 0));
+    const uint32_t head = ring->head.load(std::memory_order_relaxed);
+    if (head - ring->tail.load(std::memory_order_acquire) >= g_cpu_timer_ring_size) {
+        ring->dropped_ticks.fetch_add(ticks, std::memory_order_relaxed);
+        return;
+    }
+    ring->events[head % g_cpu_timer_ring_size] = { interrupted_pc(context),
+                                                   static_cast<int64_t>(ticks) * g_cpu_timer_interval_ns };
+    ring->head.store(head + 1, std::memory_order_release);
+#else
+    (void)_signo;
+    (void)info;
+    (void)context;
+#endif
+}
+
+bool
+CpuTimers::install()
+{
+#if defined PL_LINUX
+    if (installed.load()) {
+        return true;
+    }
+
+    // Realtime signals are free for applications to use, so leave this one alone if someone already does
+    const int candidate = SIGRTMIN + g_cpu_timer_signal_offset;
+    if (candidate > SIGRTMAX) {
+        return false;
+    }
+    struct sigaction current = {};
+    if (sigaction(candidate, nullptr, &current) != 0 ||
+        ((current.sa_flags & SA_SIGINFO) == 0 && current.sa_handler != SIG_DFL)) {
+        return false;
+    }
+
+    // Threads are only ever interrupted while on CPU, so this seldom interrupts a system call; SA_RESTART covers
+    // the ones it does
+    struct sigaction action = {};
+    action.sa_sigaction = &CpuTimers::handler;
+    action.sa_flags = SA_SIGINFO | SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    if (sigaction(candidate, &action, nullptr) != 0) {
+        return false;
+    }
+    signo = candidate;
+    installed.store(true);
+    return true;
+#else
+    return false;
+#endif
+}
+
+void
+CpuTimers::disarm(Timer& timer)
+{
+#if defined PL_LINUX
+    if (timer.armed) {
+        timer_delete(timer.id);
+        timer.armed = false;
+    }
+#endif
+    if (timer.ring) {
+        retiring.push_back(std::move(timer.ring));
+    }
+}
+
+void
+CpuTimers::track(uintptr_t thread_id, unsigned long native_id, clockid_t cpu_clock_id)
+{
+#if defined PL_LINUX
+    if (!installed.load()) {
+        return;
+    }
+
+    // Thread ids are reused once a thread exits, and the timer of the previous one is bound to its clock
+    auto it = timers.find(thread_id);
+    if (it != timers.end()) {
+        if (it->second.native_id == native_id) {
+            it->second.pass = pass;
+            return;
+        }
+        disarm(it->second);
+        timers.erase(it);
+    }
+
+    Timer timer{ native_id, false, {}, std::make_unique<Ring>(), pass };
+    struct sigevent event = {};
+    event.sigev_notify = SIGEV_THREAD_ID;
+    event.sigev_signo = signo;
+    event.sigev_value.sival_ptr = timer.ring.get();
+    event.sigev_notify_thread_id = static_cast<pid_t>(native_id);
+    if (timer_create(cpu_clock_id, &event, &timer.id) == 0) {
+        struct itimerspec spec = {};
+        spec.it_interval.tv_sec = g_cpu_timer_interval_ns / 1000000000;
+        spec.it_interval.tv_nsec = g_cpu_timer_interval_ns % 1000000000;
+        spec.it_value = spec.it_interval;
+        timer.armed = timer_settime(timer.id, 0, &spec, nullptr) == 0;
+        if (!timer.armed) {
+            timer_delete(timer.id);
+        }
+    }
+    if (!timer.armed) {
+        timer.ring.reset();
+    }
+    timers.emplace(thread_id, std::move(timer));
+#else
+    (void)thread_id;
+    (void)native_id;
+    (void)cpu_clock_id;
+#endif
+}
+
+void
+CpuTimers::drain(uintptr_t thread_id, CpuTimerDrain& out)
+{
+    out.tracked = false;
+    out.unattributed_cpu_ns = 0;
+    out.count = 0;
+    auto it = timers.find(thread_id);
+    if (it == timers.end() || !it->second.armed) {
+        return;
+    }
+
+    Ring& ring = *it->second.ring;
+    out.tracked = true;
+    const uint64_t dropped_ticks = ring.dropped_ticks.exchange(0, std::memory_order_relaxed);
+    if (dropped_ticks != 0) {
+        out.unattributed_cpu_ns = static_cast<int64_t>(dropped_ticks) * g_cpu_timer_interval_ns;
+        ProfilerStats::add(ProfilerCounter::cpu_timer_events_dropped, dropped_ticks);
+    }
+
+    // Hot loops are interrupted at the same few addresses, so those are merged into one sample each
+    uint32_t tail = ring.tail.load(std::memory_order_relaxed);
+    const uint32_t head = ring.head.load(std::memory_order_acquire);
+    for (; tail != head; ++tail) {
+        const CpuTimerEvent& event = ring.events[tail % g_cpu_timer_ring_size];
+        auto end = out.events.begin() + static_cast<std::ptrdiff_t>(out.count);
+        auto match = std::find_if(out.events.begin(), end, [&](const CpuTimerEvent& e) { return e.pc == event.pc; });
+        if (match != end) {
+            match->cpu_time_ns += event.cpu_time_ns;
+        } else {
+            out.events[out.count++] = event;
+        }
+    }
+    ring.tail.store(tail, std::memory_order_release);
+}
+
+void
+CpuTimers::end_pass()
+{
+    retired.clear();
+    retired.swap(retiring);
+    for (auto it = timers.begin(); it != timers.end();) {
+        if (it->second.pass != pass) {
+            disarm(it->second);
+            it = timers.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    ++pass;
+}
+
+void
+CpuTimers::postfork_child()
+{
+    // The timers are gone along with the threads they were bound to, and no handler can be running in the child
+    timers.clear();
+    retiring.clear();
+    retired.clear();
+}
+
+CpuTimers::~CpuTimers()
+{
+    // This only runs as the process exits, while the other threads may still be taking signals, so the rings are
+    // left behind
+    for (auto& [thread_id, timer] : timers) {
+        (void)thread_id;
+#if defined PL_LINUX
+        if (timer.armed) {
+            timer_delete(timer.id);
+        }
+#endif
+        (void)timer.ring.release();
+    }
+}
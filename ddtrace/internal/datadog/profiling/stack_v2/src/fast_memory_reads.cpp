@@ -0,0 +1,157 @@
+#include "fast_memory_reads.hpp"
+
+#include "dd_wrapper/include/profiler_stats.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+using namespace Datadog;
+
+void
+FastMemoryReads::handler(int signo, siginfo_t* info, void* context)
+{
+    if (in_copy != 0) {
+        in_copy = 0;
+        siglongjmp(copy_env, 1);
+    }
+
+    // Not ours: behave as if this handler had never been installed
+    const struct sigaction& previous = signo == SIGBUS ? previous_bus : previous_segv;
+    if ((previous.sa_flags & SA_SIGINFO) != 0) {
+        previous.sa_sigaction(signo, info, context);
+        return;
+    }
+    if (previous.sa_handler == SIG_IGN) {
+        return;
+    }
+    if (previous.sa_handler == SIG_DFL) {
+        // Returning re-executes the faulting instruction, which then gets the default action
+        signal(signo, SIG_DFL);
+        return;
+    }
+    previous.sa_handler(signo);
+}
+
+bool
+FastMemoryReads::is_current(int signo)
+{
+    struct sigaction current = {};
+    return sigaction(signo, nullptr, &current) == 0 && (current.sa_flags & SA_SIGINFO) != 0 &&
+           current.sa_sigaction == &FastMemoryReads::handler;
+}
+
+bool
+FastMemoryReads::install()
+{
+    if (installed.load()) {
+        return true;
+    }
+
+    // SA_NODEFER, since the handler jumps out rather than returning, which would leave the signal blocked
+    struct sigaction action = {};
+    action.sa_sigaction = &FastMemoryReads::handler;
+    action.sa_flags = SA_SIGINFO | SA_NODEFER | SA_ONSTACK;
+    sigemptyset(&action.sa_mask);
+    if (sigaction(SIGSEGV, &action, &previous_segv) != 0) {
+        return false;
+    }
+    if (sigaction(SIGBUS, &action, &previous_bus) != 0) {
+        sigaction(SIGSEGV, &previous_segv, nullptr);
+        return false;
+    }
+    installed.store(true);
+    return true;
+}
+
+bool
+FastMemoryReads::begin_pass()
+{
+    // Someone may have installed their own handlers since (e.g., faulthandler), and theirs would see our faults
+    // first.  The thread-locals are touched here so that the first fault doesn't have to allocate them.
+    in_copy = 0;
+    in_pass = installed.load() && is_current(SIGSEGV) && is_current(SIGBUS);
+    pass_pid = in_pass ? getpid() : 0;
+    return in_pass;
+}
+
+void
+FastMemoryReads::end_pass()
+{
+    in_pass = false;
+}
+
+bool
+FastMemoryReads::active(pid_t pid)
+{
+    return in_pass && pid == pass_pid;
+}
+
+ssize_t
+FastMemoryReads::read(const ::iovec* local_iov,
+                      unsigned long liovcnt,
+                      const ::iovec* remote_iov,
+                      unsigned long riovcnt)
+{
+    // Locals are volatile, since they are read again after jumping out of a faulting copy
+    volatile size_t copied = 0;
+    volatile unsigned long l = 0;
+    volatile unsigned long r = 0;
+    volatile size_t l_off = 0;
+    volatile size_t r_off = 0;
+
+    if (sigsetjmp(copy_env, 0) == 0) {
+        in_copy = 1;
+        while (l < liovcnt && r < riovcnt) {
+            const size_t l_left = local_iov[l].iov_len - l_off;
+            const size_t r_left = remote_iov[r].iov_len - r_off;
+            const size_t len = std::min(l_left, r_left);
+            std::memcpy(static_cast<char*>(local_iov[l].iov_base) + l_off,
+                        static_cast<const char*>(remote_iov[r].iov_base) + r_off,
+                        len);
+            copied = copied + len;
+            l_off = l_off + len;
+            r_off = r_off + len;
+            if (l_off == local_iov[l].iov_len) {
+                l = l + 1;
+                l_off = 0;
+            }
+            if (r_off == remote_iov[r].iov_len) {
+                r = r + 1;
+                r_off = 0;
+            }
+        }
+        in_copy = 0;
+        return static_cast<ssize_t>(copied);
+    }
+
+    // The copy faulted: like the kernel, report whatever was copied before that
+    ProfilerStats::add(ProfilerCounter::fast_memory_read_faults);
+    if (copied == 0) {
+        errno = EFAULT;
+        return -1;
+    }
+    return static_cast<ssize_t>(copied);
+}
+
+#if defined PL_LINUX
+// Echion calls process_vm_readv() from this extension; with hidden visibility, those calls are bound to this
+// definition when the extension is linked, rather than to the C library.  Nothing else in the process is affected.
+extern "C" __attribute__((visibility("hidden"))) ssize_t
+process_vm_readv(pid_t pid,
+                 const struct iovec* local_iov,
+                 unsigned long liovcnt,
+                 const struct iovec* remote_iov,
+                 unsigned long riovcnt,
+                 unsigned long flags) noexcept
+{
+    if (flags == 0 && FastMemoryReads::active(pid)) {
+        return FastMemoryReads::read(local_iov, liovcnt, remote_iov, riovcnt);
+    }
+    return syscall(SYS_process_vm_readv, pid, local_iov, liovcnt, remote_iov, riovcnt, flags);
+}
+#endif
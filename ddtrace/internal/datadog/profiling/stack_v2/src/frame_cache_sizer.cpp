@@ -0,0 +1,119 @@
+#include "frame_cache_sizer.hpp"
+
+#include "constants.hpp"
+#include "dd_wrapper/include/profiler_stats.hpp"
+
+#include <algorithm>
+#include <functional>
+
+using namespace Datadog;
+
+FrameCacheSizer::FrameCacheSizer(size_t _capacity)
+  : capacity{ _capacity }
+{}
+
+void
+FrameCacheSizer::configure(size_t _capacity, bool _adaptive)
+{
+    adaptive = _adaptive;
+    if (adaptive) {
+        _capacity = std::clamp(_capacity, g_min_echion_frame_cache_size, g_max_echion_frame_cache_size);
+    }
+    lru.clear();
+    index.clear();
+    capacity = _capacity;
+    window = 0;
+    settled_window = 1;
+    window_hits = 0;
+    window_misses = 0;
+    window_distinct = 0;
+    window_start = {};
+    ProfilerStats::set(ProfilerGauge::frame_cache_capacity, capacity);
+}
+
+void
+FrameCacheSizer::set_capacity(size_t new_capacity)
+{
+    capacity = new_capacity;
+    while (lru.size() > capacity) {
+        index.erase(lru.back());
+        lru.pop_back();
+    }
+    ProfilerStats::set(ProfilerGauge::frame_cache_capacity, capacity);
+}
+
+void
+FrameCacheSizer::record(std::string_view name, std::string_view file, uint64_t line)
+{
+    // Echion keys its cache by code object and instruction, which the name, file and line stand in for.  Collisions
+    // only skew the estimate a little.
+    const uint64_t name_hash = std::hash<std::string_view>{}(name);
+    const uint64_t file_hash = std::hash<std::string_view>{}(file);
+    const uint64_t key = name_hash ^ (file_hash + 0x9e3779b97f4a7c15ULL + (name_hash << 6) + (name_hash >> 2)) ^
+                         (line * 0xff51afd7ed558ccdULL);
+
+    auto it = index.find(key);
+    if (it != index.end()) {
+        ++window_hits;
+        if (it->second.window != window) {
+            it->second.window = window;
+            ++window_distinct;
+        }
+        lru.splice(lru.begin(), lru, it->second.position);
+        return;
+    }
+
+    ++window_misses;
+    ++window_distinct;
+    if (capacity == 0) {
+        return;
+    }
+    if (lru.size() >= capacity) {
+        index.erase(lru.back());
+        lru.pop_back();
+    }
+    lru.push_front(key);
+    index.emplace(key, Entry{ lru.begin(), window });
+}
+
+size_t
+FrameCacheSizer::end_pass(std::chrono::steady_clock::time_point now)
+{
+    if (window_start == std::chrono::steady_clock::time_point{}) {
+        window_start = now;
+    }
+    const uint64_t lookups = window_hits + window_misses;
+    if (lookups < g_frame_cache_window_lookups || now - window_start < g_frame_cache_window) {
+        return 0;
+    }
+
+    ProfilerStats::add(ProfilerCounter::frame_cache_hits, window_hits);
+    ProfilerStats::add(ProfilerCounter::frame_cache_misses, window_misses);
+
+    size_t new_capacity = 0;
+    if (adaptive && window >= settled_window) {
+        const double hit_rate = static_cast<double>(window_hits) / static_cast<double>(lookups);
+        if (hit_rate < g_frame_cache_grow_below_hit_rate && capacity < g_max_echion_frame_cache_size) {
+            new_capacity = std::min(capacity * 2, g_max_echion_frame_cache_size);
+        } else if (window_distinct * 4 < capacity && capacity > g_min_echion_frame_cache_size) {
+            new_capacity = std::max(capacity / 2, g_min_echion_frame_cache_size);
+        }
+        if (new_capacity != 0) {
+            set_capacity(new_capacity);
+            settled_window = window + 2;
+        }
+    }
+
+    ++window;
+    window_hits = 0;
+    window_misses = 0;
+    window_distinct = 0;
+    window_start = now;
+    return new_capacity;
+}
+
+size_t
+FrameCacheSizer::get_capacity() const
+{
+    return capacity;
+}
@@ -0,0 +1,62 @@
+#include "interned_frame_cache.hpp"
+#include "utf8_validate.hpp"
+
+#include "dd_wrapper/include/sample.hpp"
+
+#include <cstring>
+
+using namespace Datadog;
+
+InternedFrameCache::InternedFrameCache(size_t _max_size)
+  : max_size{ _max_size }
+{
+    cache.reserve(max_size);
+}
+
+InternedFrameCache::InternedFrame
+InternedFrameCache::intern(std::string_view name, std::string_view file)
+{
+    // Normally, further utf-8 validation would be pointless here, but we may be reading data where the
+    // string pointer was valid, but the string is actually garbage data at the exact time of the read.
+    // This is rare, but blowing some cycles on early validation allows the sample to be retained by
+    // libdatadog, so we can evaluate the actual impact of this scenario in live scenarios.
+    static const std::string_view invalid = "<invalid_utf8>";
+    if (!utf8_check_is_valid(name.data(), name.size())) {
+        name = invalid;
+    }
+    if (!utf8_check_is_valid(file.data(), file.size())) {
+        file = invalid;
+    }
+    return { Sample::intern_string(name), Sample::intern_string(file) };
+}
+
+InternedFrameCache::InternedFrame
+InternedFrameCache::get(std::string_view name, std::string_view file)
+{
+    const Key key{ name.data(), name.size(), file.data(), file.size() };
+    auto it = cache.find(key);
+    if (it != cache.end()) {
+        // Invalid strings are interned as a placeholder, so those never pass this check and always get revalidated
+        const auto& frame = it->second;
+        if (frame.name.size() == name.size() && frame.file.size() == file.size() &&
+            std::memcmp(frame.name.data(), name.data(), name.size()) == 0 &&
+            std::memcmp(frame.file.data(), file.data(), file.size()) == 0) {
+            return frame;
+        }
+    }
+
+    auto frame = intern(name, file);
+
+    // There's no need for anything smarter than starting over; the cache refills within a few samples
+    if (it == cache.end() && cache.size() >= max_size) {
+        cache.clear();
+    }
+    cache[key] = frame;
+    return frame;
+}
+
+void
+InternedFrameCache::clear()
+{
+    cache.clear();
+}
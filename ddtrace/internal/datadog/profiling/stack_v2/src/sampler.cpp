@@ -1,42 +1,398 @@
 #include "sampler.hpp"
+#include "fast_memory_reads.hpp"
+#include "dd_wrapper/include/burst_profile.hpp"
+#include "dd_wrapper/include/profiler_stats.hpp"
 
 #include "echion/interp.h"
 #include "echion/tasks.h"
 #include "echion/threads.h"
+#ifndef UNWIND_NATIVE_DISABLE
+#include "echion/signals.h"
+#endif
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <pthread.h>
+#include <sched.h>
+#if defined PL_LINUX
+#include <sys/prctl.h>
+#endif
+#include <time.h>
 
 using namespace Datadog;
 
+namespace {
+
+// CPU time consumed by the calling thread.  This is what the overhead budget is measured against, since wall time
+// would also count the time the sampler spends descheduled.
+inline microsecond_t
+current_thread_cpu_time_us()
+{
+    struct timespec ts;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0) {
+        return 0;
+    }
+    return static_cast<microsecond_t>(ts.tv_sec) * 1000000 + static_cast<microsecond_t>(ts.tv_nsec) / 1000;
+}
+
+} // namespace
+
+microsecond_t
+Sampler::adapt_interval(microsecond_t pass_cpu_time_us)
+{
+    // Smooth the cost a bit, so a single slow pass (e.g., a burst of new threads) doesn't stall sampling for long
+    constexpr double alpha = 0.25;
+    smoothed_pass_cost_us = alpha * static_cast<double>(pass_cpu_time_us) + (1.0 - alpha) * smoothed_pass_cost_us;
+
+    // Same calculation as the Python-side StackCollector: spending `cost` every `interval` should amount to at most
+    // max_time_usage_pct of the time.
+    const double budget = max_time_usage_pct.load() / 100.0;
+    const double wanted_us = smoothed_pass_cost_us / budget - smoothed_pass_cost_us;
+    const auto interval_us = std::max(static_cast<microsecond_t>(wanted_us), sample_interval_us.load());
+    effective_interval_us.store(interval_us);
+    return interval_us;
+}
+
+bool
+Sampler::is_thread_idle(ThreadInfo& thread)
+{
+#if defined PL_LINUX
+    struct timespec ts;
+    if (clock_gettime(thread.cpu_clock_id, &ts) != 0) {
+        // The thread may have exited; let echion sort it out
+        return false;
+    }
+    const auto cpu_time_us =
+      static_cast<microsecond_t>(ts.tv_sec) * 1000000 + static_cast<microsecond_t>(ts.tv_nsec) / 1000;
+    next_thread_cpu_us[thread.thread_id] = cpu_time_us;
+
+    // Threads we haven't seen before are never considered idle
+    auto it = last_thread_cpu_us.find(thread.thread_id);
+    return it != last_thread_cpu_us.end() && it->second == cpu_time_us;
+#else
+    // No cheap per-thread CPU clock, so nothing is considered idle
+    (void)thread;
+    return false;
+#endif
+}
+
+void
+Sampler::setup_sampling_thread()
+{
+#if defined PL_LINUX
+    // The default timer slack lets the kernel delay wakeups by up to 50us, which is a sizeable fraction of short
+    // intervals.  Only this thread is affected.
+    prctl(PR_SET_TIMERSLACK, 1UL, 0UL, 0UL, 0UL);
+
+    std::vector<int> cpus;
+    {
+        const std::lock_guard<std::mutex> lock(thread_mtx);
+        cpus = cpu_affinity;
+    }
+    if (!cpus.empty()) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (const int cpu : cpus) {
+            CPU_SET(cpu, &set);
+        }
+        // CPUs outside of the cgroup's cpuset are refused; the thread then runs wherever it was allowed to
+        const int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        if (err != 0) {
+            std::cerr << "Could not set the CPU affinity of the stack v2 sampling thread: " << std::strerror(err)
+                      << std::endl;
+        }
+    }
+
+    if (idle_priority.load() && !realtime_priority.load()) {
+        sched_param param = {};
+        const int err = pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+        if (err != 0) {
+            std::cerr << "Could not give the stack v2 sampling thread idle priority: " << std::strerror(err)
+                      << std::endl;
+        }
+    }
+#endif
+
+    if (realtime_priority.load()) {
+        // The lowest realtime priority is enough to be scheduled ahead of every regular thread.  This usually needs
+        // CAP_SYS_NICE, so failing is expected and not fatal.
+        sched_param param = {};
+        param.sched_priority = sched_get_priority_min(SCHED_FIFO);
+        const int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+        if (err != 0) {
+            std::cerr << "Could not give the stack v2 sampling thread realtime priority: " << std::strerror(err)
+                      << std::endl;
+        }
+    }
+}
+
+std::chrono::steady_clock::time_point
+Sampler::next_deadline(std::chrono::steady_clock::time_point deadline, microsecond_t interval_us)
+{
+    using namespace std::chrono;
+
+    // Deadlines are absolute, so the time spent sampling (or waking up late) doesn't push every subsequent pass
+    // back.  If a whole interval has been missed, there's no point in catching up with back-to-back passes: skip to
+    // the next deadline on the same grid instead.
+    const auto interval = microseconds(std::max<microsecond_t>(interval_us, 1));
+    deadline += interval;
+    const auto now = steady_clock::now();
+    if (deadline <= now) {
+        const auto missed = (now - deadline) / interval + 1;
+        ProfilerStats::add(ProfilerCounter::sampler_missed_deadlines, static_cast<uint64_t>(missed));
+        deadline += missed * interval;
+    }
+    return deadline;
+}
+
 void
 Sampler::sampling_thread(const uint64_t seq_num)
 {
     using namespace std::chrono;
+    setup_sampling_thread();
     auto sample_time_prev = steady_clock::now();
+    auto deadline = sample_time_prev;
+    bool resumed = true;
+
+    std::unique_lock<std::mutex> lock(thread_mtx);
+    while (true) {
+        // Park while the sampler is stopped.  The time spent parked isn't wall time which should be attributed to
+        // the threads, so the clock restarts when sampling resumes.
+        if (!sampling_enabled) {
+            if (burst_active) {
+                finish_burst(lock);
+            }
 
-    while (seq_num == thread_seq_num.load()) {
+            // Stacks held back for collapsing belong to the profile being collected now, not to the one sampling
+            // resumes in
+            lock.unlock();
+            renderer_ptr->flush_collapsed();
+            lock.lock();
+            thread_cv.wait(lock, [&] { return sampling_enabled || seq_num != thread_seq_num; });
+            sample_time_prev = steady_clock::now();
+            deadline = sample_time_prev;
+            resumed = true;
+        }
+        if (seq_num != thread_seq_num) {
+            break;
+        }
+        lock.unlock();
+
+        // The wall time is whatever actually elapsed since the last pass, however late this one is, so the weights
+        // stay accurate even when the requested period can't be met
         auto sample_time_now = steady_clock::now();
         auto wall_time_us = duration_cast<microseconds>(sample_time_now - sample_time_prev).count();
         sample_time_prev = sample_time_now;
+        if (!resumed) {
+            record_period(wall_time_us);
+        }
+        resumed = false;
+
+        // Since the number of threads is only known once they've all been visited, the sampling probability is
+        // based on the previous pass.
+        const size_t max_threads = max_threads_per_pass.load();
+        const bool skip_idle = skip_idle_threads.load();
+        const bool with_thread_state = collect_thread_state.load();
+        double keep_probability = 1.0;
+        if (max_threads > 0 && last_pass_candidate_count > max_threads) {
+            keep_probability = static_cast<double>(max_threads) / static_cast<double>(last_pass_candidate_count);
+        }
+        const auto scaled_wall_time_us =
+          static_cast<microsecond_t>(static_cast<double>(wall_time_us) / keep_probability);
+        std::uniform_real_distribution<double> coin(0.0, 1.0);
+        size_t candidates = 0;
 
         // Perform the sample
+        const auto pass_start_cpu_us = current_thread_cpu_time_us();
+        apply_asyncio();
+        FastMemoryReads::begin_pass();
         for_each_interp([&](PyInterpreterState* interp) -> void {
+            renderer_ptr->set_interpreter_id(interp->id);
             for_each_thread(interp, [&](PyThreadState* tstate, ThreadInfo& thread) {
-                thread.sample(interp->id, tstate, wall_time_us);
+#if defined PL_LINUX
+                // Even threads which aren't sampled keep their timer, and their events until they are
+                if (cpu_timers_active) {
+                    cpu_timers.track(thread.thread_id, thread.native_id, thread.cpu_clock_id);
+                }
+#endif
+                if (skip_idle && is_thread_idle(thread)) {
+                    return;
+                }
+                ++candidates;
+                if (keep_probability < 1.0 && coin(thread_rng) >= keep_probability) {
+                    return;
+                }
+                auto loop = sampled_asyncio_loops.find(thread.thread_id);
+                thread.asyncio_loop = loop != sampled_asyncio_loops.end() ? loop->second : 0;
+                renderer_ptr->set_thread_state(with_thread_state
+                                                 ? thread_state_reader.read(thread.thread_id, thread.native_id)
+                                                 : ThreadState{});
+                if (cpu_timers_active) {
+                    cpu_timers.drain(thread.thread_id, cpu_timer_drain);
+                }
+                thread.sample(interp->id, tstate, scaled_wall_time_us);
             });
         });
+        FastMemoryReads::end_pass();
+        if (cpu_timers_active) {
+            cpu_timers.end_pass();
+        }
+        if (const size_t capacity = renderer_ptr->end_pass(steady_clock::now()); capacity != 0) {
+            init_frame_cache(capacity);
+        }
+        const auto interval_us = adapt_interval(current_thread_cpu_time_us() - pass_start_cpu_us);
+        last_pass_candidate_count = candidates;
+        if (skip_idle) {
+            last_thread_cpu_us.swap(next_thread_cpu_us);
+            next_thread_cpu_us.clear();
+        }
 
-        // Before sleeping, check whether the user has called for this thread to die.
-        if (seq_num != thread_seq_num.load()) {
-            break;
+        // Sleep until the next deadline, waking up early if the sampler is stopped or shut down.  The wait is on
+        // CLOCK_MONOTONIC with an absolute deadline, so it doesn't drift; waking up may still be late on busy
+        // systems, which record_period() accounts for.
+        deadline = next_deadline(deadline, interval_us);
+        lock.lock();
+        wait_for_pass(lock, deadline, seq_num);
+    }
+    if (burst_active) {
+        finish_burst(lock);
+    }
+    lock.unlock();
+    renderer_ptr->flush_collapsed();
+    lock.lock();
+
+    // A thread which was abandoned by `shutdown()` may only get here after a new one has been launched
+    if (alive_thread_seq_num == seq_num) {
+        thread_alive = false;
+    }
+    thread_cv.notify_all();
+}
+
+void
+Sampler::wait_for_pass(std::unique_lock<std::mutex>& lock,
+                       std::chrono::steady_clock::time_point deadline,
+                       const uint64_t seq_num)
+{
+    using namespace std::chrono;
+    while (sampling_enabled && seq_num == thread_seq_num) {
+        const uint64_t seen_burst_seq = burst_seq;
+        const auto wake = burst_active ? std::min({ deadline, burst_next, burst_end }) : deadline;
+        thread_cv.wait_until(lock, wake, [&] {
+            return !sampling_enabled || seq_num != thread_seq_num || burst_seq != seen_burst_seq;
+        });
+        if (!sampling_enabled || seq_num != thread_seq_num) {
+            return;
         }
 
-        // Sleep for the remainder of the interval, get it atomically
-        // Generally speaking system "sleep" times will wait _at least_ as long as the specified time, so
-        // in actual fact the duration may be more than we indicated.  This tends to be more true on busy
-        // systems.
-        std::this_thread::sleep_until(sample_time_now + microseconds(sample_interval_us.load()));
+        const auto now = steady_clock::now();
+        if (burst_active && now >= burst_end) {
+            finish_burst(lock);
+            continue;
+        }
+        if (now >= deadline) {
+            return;
+        }
+        if (burst_active && now >= burst_next) {
+            // Unlike the regular passes, missed burst passes aren't worth reporting; the wall time still covers
+            // whatever actually elapsed
+            const auto wall_time_us = duration_cast<microseconds>(now - burst_prev).count();
+            burst_prev = now;
+            burst_next += microseconds(burst_interval_us);
+            if (burst_next <= now) {
+                burst_next = now + microseconds(burst_interval_us);
+            }
+            lock.unlock();
+            burst_pass(wall_time_us);
+            lock.lock();
+        }
     }
 }
 
+void
+Sampler::burst_pass(microsecond_t wall_time_us)
+{
+    // Every thread is sampled, since the subsampling and the idle detection keep state across the regular passes
+    // which the burst mustn't disturb.  For the same reason, the CPU timers are left to the regular passes.
+    const bool with_thread_state = collect_thread_state.load();
+    const BurstProfile::Scope scope;
+    renderer_ptr->set_burst(true);
+    apply_asyncio();
+    FastMemoryReads::begin_pass();
+    for_each_interp([&](PyInterpreterState* interp) -> void {
+        renderer_ptr->set_interpreter_id(interp->id);
+        for_each_thread(interp, [&](PyThreadState* tstate, ThreadInfo& thread) {
+            auto loop = sampled_asyncio_loops.find(thread.thread_id);
+            thread.asyncio_loop = loop != sampled_asyncio_loops.end() ? loop->second : 0;
+            renderer_ptr->set_thread_state(with_thread_state
+                                             ? thread_state_reader.read(thread.thread_id, thread.native_id)
+                                             : ThreadState{});
+            thread.sample(interp->id, tstate, wall_time_us);
+        });
+    });
+    FastMemoryReads::end_pass();
+    renderer_ptr->set_burst(false);
+}
+
+void
+Sampler::finish_burst(std::unique_lock<std::mutex>& lock)
+{
+    burst_active = false;
+    renderer_ptr->end_burst();
+    lock.unlock();
+    BurstProfile::finish();
+    lock.lock();
+}
+
+bool
+Sampler::start_burst(double interval_s, double duration_s)
+{
+    using namespace std::chrono;
+    const auto interval_us =
+      std::max(static_cast<microsecond_t>(interval_s * 1e6), static_cast<microsecond_t>(g_min_burst_interval_us));
+    duration_s = std::clamp(duration_s, 0.0, g_max_burst_duration_s);
+
+    const std::lock_guard<std::mutex> lock(lifecycle_mtx);
+    const std::lock_guard<std::mutex> thread_lock(thread_mtx);
+    if (!sampling_enabled || !thread_alive || burst_active || !BurstProfile::start()) {
+        return false;
+    }
+    const auto now = steady_clock::now();
+    burst_active = true;
+    burst_interval_us = interval_us;
+    burst_next = now + microseconds(interval_us);
+    burst_prev = now;
+    burst_end = now + duration_cast<steady_clock::duration>(duration<double>(duration_s));
+    ++burst_seq;
+    thread_cv.notify_all();
+    return true;
+}
+
+void
+Sampler::stop_burst()
+{
+    // The sampling thread finishes the burst, since it may be in the middle of one of its passes
+    const std::lock_guard<std::mutex> thread_lock(thread_mtx);
+    if (burst_active) {
+        burst_end = std::chrono::steady_clock::now();
+        ++burst_seq;
+        thread_cv.notify_all();
+    }
+}
+
+void
+Sampler::record_period(microsecond_t period_us)
+{
+    constexpr double alpha = 0.1;
+    smoothed_period_us = smoothed_period_us == 0.0
+                           ? static_cast<double>(period_us)
+                           : alpha * static_cast<double>(period_us) + (1.0 - alpha) * smoothed_period_us;
+    actual_interval_us.store(static_cast<microsecond_t>(smoothed_period_us));
+    ProfilerStats::set(ProfilerGauge::sampler_requested_period_us, effective_interval_us.load());
+    ProfilerStats::set(ProfilerGauge::sampler_actual_period_us, static_cast<uint64_t>(smoothed_period_us));
+}
+
 void
 Sampler::set_interval(double new_interval_s)
 {
@@ -44,6 +400,166 @@ Sampler::set_interval(double new_interval_s)
     sample_interval_us.store(new_interval_us);
 }
 
+void
+Sampler::set_max_time_usage_pct(double new_max_time_usage_pct)
+{
+    // Same bounds as the Python-side validation; silently ignore anything else
+    if (new_max_time_usage_pct > 0.0 && new_max_time_usage_pct <= 100.0) {
+        max_time_usage_pct.store(new_max_time_usage_pct);
+    }
+}
+
+void
+Sampler::set_max_threads_per_pass(size_t new_max_threads_per_pass)
+{
+    max_threads_per_pass.store(new_max_threads_per_pass);
+}
+
+void
+Sampler::set_skip_idle_threads(bool new_skip_idle_threads)
+{
+    skip_idle_threads.store(new_skip_idle_threads);
+}
+
+void
+Sampler::set_thread_state(bool new_thread_state)
+{
+    collect_thread_state.store(new_thread_state);
+}
+
+void
+Sampler::init_asyncio(PyObject* current_tasks, PyObject* scheduled_tasks, PyObject* eager_tasks)
+{
+    // Asyncio only creates these once, so the references are never released
+    Py_XINCREF(current_tasks);
+    Py_XINCREF(scheduled_tasks);
+    if (eager_tasks == Py_None) {
+        eager_tasks = nullptr;
+    }
+    Py_XINCREF(eager_tasks);
+
+    const std::lock_guard<std::mutex> lock(asyncio_mtx);
+    asyncio_current_tasks_ptr = current_tasks;
+    asyncio_scheduled_tasks_ptr = scheduled_tasks;
+    asyncio_eager_tasks_ptr = eager_tasks;
+    asyncio_generation.fetch_add(1);
+}
+
+void
+Sampler::track_asyncio_loop(uintptr_t thread_id, PyObject* loop)
+{
+    // Echion only compares the address of the loop with the one the running tasks refer to
+    const std::lock_guard<std::mutex> lock(asyncio_mtx);
+    if (loop == nullptr || loop == Py_None) {
+        asyncio_loops.erase(thread_id);
+    } else {
+        asyncio_loops[thread_id] = reinterpret_cast<uintptr_t>(loop);
+    }
+    asyncio_generation.fetch_add(1);
+}
+
+void
+Sampler::link_tasks(PyObject* parent, PyObject* child)
+{
+    // Tasks gathered or awaited by another one are rendered below it.  Echion drops the links of tasks which are
+    // gone when it walks them.
+    const std::lock_guard<std::mutex> lock(task_link_map_lock);
+    task_link_map[child] = parent;
+}
+
+void
+Sampler::apply_asyncio()
+{
+    const uint64_t generation = asyncio_generation.load();
+    if (generation == applied_asyncio_generation) {
+        return;
+    }
+    const std::lock_guard<std::mutex> lock(asyncio_mtx);
+    sampled_asyncio_loops = asyncio_loops;
+    asyncio_current_tasks = asyncio_current_tasks_ptr;
+    asyncio_scheduled_tasks = asyncio_scheduled_tasks_ptr;
+    asyncio_eager_tasks = asyncio_eager_tasks_ptr;
+    applied_asyncio_generation = generation;
+}
+
+void
+Sampler::set_fast_memory_reads(bool new_fast_memory_reads)
+{
+    const std::lock_guard<std::mutex> lock(lifecycle_mtx);
+    fast_memory_reads = new_fast_memory_reads;
+}
+
+void
+Sampler::set_frame_cache_size(size_t new_frame_cache_size, bool new_adaptive_frame_cache)
+{
+    const std::lock_guard<std::mutex> lock(lifecycle_mtx);
+    echion_frame_cache_size = new_frame_cache_size > 0 ? new_frame_cache_size : g_default_echion_frame_cache_size;
+    adaptive_frame_cache = new_adaptive_frame_cache;
+    if (adaptive_frame_cache) {
+        echion_frame_cache_size =
+          std::clamp<uint64_t>(echion_frame_cache_size, g_min_echion_frame_cache_size, g_max_echion_frame_cache_size);
+    }
+}
+
+void
+Sampler::set_cpu_timers(bool new_cpu_timers)
+{
+    const std::lock_guard<std::mutex> lock(lifecycle_mtx);
+    use_cpu_timers = new_cpu_timers;
+}
+
+bool
+Sampler::set_native_frames(bool new_native_frames)
+{
+#ifdef UNWIND_NATIVE_DISABLE
+    if (new_native_frames) {
+        std::cerr << "Native frames were requested, but stack_v2 was built without native unwinding" << std::endl;
+        return false;
+    }
+    return true;
+#else
+    const std::lock_guard<std::mutex> lock(lifecycle_mtx);
+    native_frames = new_native_frames;
+    return true;
+#endif
+}
+
+double
+Sampler::get_effective_interval()
+{
+    return static_cast<double>(effective_interval_us.load()) / 1e6;
+}
+
+double
+Sampler::get_actual_interval()
+{
+    return static_cast<double>(actual_interval_us.load()) / 1e6;
+}
+
+void
+Sampler::set_realtime_priority(bool new_realtime_priority)
+{
+    realtime_priority.store(new_realtime_priority);
+}
+
+void
+Sampler::set_cpu_affinity(std::vector<int> new_cpu_affinity)
+{
+    // Only CPUs which fit in a cpu_set_t can be pinned to
+    new_cpu_affinity.erase(std::remove_if(new_cpu_affinity.begin(),
+                                          new_cpu_affinity.end(),
+                                          [](int cpu) { return cpu < 0 || cpu >= g_max_affinity_cpus; }),
+                           new_cpu_affinity.end());
+    const std::lock_guard<std::mutex> lock(thread_mtx);
+    cpu_affinity = std::move(new_cpu_affinity);
+}
+
+void
+Sampler::set_idle_priority(bool new_idle_priority)
+{
+    idle_priority.store(new_idle_priority);
+}
+
 Sampler::Sampler()
   : renderer_ptr{ std::make_shared<StackRenderer>() }
 {}
@@ -60,29 +576,116 @@ Sampler::one_time_setup()
 {
     _set_cpu(true);
     init_frame_cache(echion_frame_cache_size);
+    renderer_ptr->configure_frame_cache(echion_frame_cache_size, adaptive_frame_cache && !native_frames);
     _set_pid(getpid());
 
+#ifndef UNWIND_NATIVE_DISABLE
+    // Native stacks are unwound by the sampled thread itself, from echion's signal handler
+    if (native_frames) {
+        _set_native(true);
+        install_signals();
+    }
+#endif
+
+    if (fast_memory_reads && !FastMemoryReads::install()) {
+        std::cerr << "Could not install the signal handlers for fast memory reads, echion will use system calls"
+                  << std::endl;
+    }
+
+    if (use_cpu_timers) {
+        cpu_timers_active = CpuTimers::install();
+        if (cpu_timers_active) {
+            renderer_ptr->set_cpu_timer_drain(&cpu_timer_drain);
+        } else {
+            std::cerr << "Could not install the signal handler for CPU timers, CPU time will be attributed when "
+                         "threads are sampled"
+                      << std::endl;
+        }
+    }
+
     // Register our rendering callbacks with echion's Renderer singleton
     Renderer::get().set_renderer(renderer_ptr);
+
+    pthread_atfork(nullptr, nullptr, Sampler::postfork_child);
 }
 
 void
 Sampler::start()
 {
+    const std::lock_guard<std::mutex> lock(lifecycle_mtx);
     static std::once_flag once;
     std::call_once(once, [this]() { this->one_time_setup(); });
 
-    // Launch the sampling thread.
-    // Thread lifetime is bounded by the value of the sequence number.  When it is changed from the value the thread was
-    // launched with, the thread will exit.
-    std::thread t(&Sampler::sampling_thread, this, ++thread_seq_num);
-    t.detach();
+    const std::lock_guard<std::mutex> thread_lock(thread_mtx);
+    sampling_enabled = true;
+    if (thread_alive) {
+        thread_cv.notify_all();
+        return;
+    }
+
+    // A thread which was given up on by `shutdown()` was detached, so this only reaps one which exited
+    if (sampler_thread.joinable()) {
+        sampler_thread.join();
+    }
+    sampler_thread = std::thread(&Sampler::sampling_thread, this, thread_seq_num);
+    alive_thread_seq_num = thread_seq_num;
+    thread_alive = true;
 }
 
 void
 Sampler::stop()
 {
-    // Modifying the thread sequence number will cause the sampling thread to exit when it completes
-    // a sampling loop.  Currently there is no mechanism to force stuck threads, should they get locked.
+    const std::lock_guard<std::mutex> lock(lifecycle_mtx);
+    const std::lock_guard<std::mutex> thread_lock(thread_mtx);
+    sampling_enabled = false;
+    thread_cv.notify_all();
+}
+
+bool
+Sampler::shutdown(std::chrono::milliseconds timeout)
+{
+    const std::lock_guard<std::mutex> lock(lifecycle_mtx);
+    std::unique_lock<std::mutex> thread_lock(thread_mtx);
+    sampling_enabled = false;
+    if (!sampler_thread.joinable()) {
+        return true;
+    }
+
+    // Bumping the sequence number tells the current thread to exit, and keeps it from ever sampling again
     ++thread_seq_num;
+    thread_cv.notify_all();
+    const bool exited = thread_cv.wait_for(thread_lock, timeout, [this] { return !thread_alive; });
+    thread_lock.unlock();
+    if (exited) {
+        sampler_thread.join();
+        return true;
+    }
+
+    // Most likely stuck reading the memory of a thread; there's no way to interrupt that safely
+    std::cerr << "The stack v2 sampling thread did not stop in time, and has been abandoned" << std::endl;
+    sampler_thread.detach();
+    thread_lock.lock();
+    thread_alive = false;
+    return false;
+}
+
+void
+Sampler::postfork_child()
+{
+    // The sampling thread only exists in the parent, and may have held the lock when the fork happened.  A
+    // subsequent `start()` launches a new one.
+    auto& sampler = get();
+    new (&sampler.lifecycle_mtx) std::mutex();
+    new (&sampler.asyncio_mtx) std::mutex();
+    new (&sampler.thread_mtx) std::mutex();
+    new (&sampler.thread_cv) std::condition_variable();
+    sampler.cpu_timers.postfork_child();
+    sampler.renderer_ptr->postfork_child();
+    if (sampler.sampler_thread.joinable()) {
+        sampler.sampler_thread.detach();
+    }
+    ++sampler.thread_seq_num;
+    sampler.sampling_enabled = false;
+    sampler.thread_alive = false;
+    sampler.burst_active = false; // dd_wrapper drops the profile of the burst
 }
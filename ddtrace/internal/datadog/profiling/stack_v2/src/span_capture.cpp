@@ -0,0 +1,189 @@
+#include "span_capture.hpp"
+#include "interned_frame_cache.hpp"
+#include "sampler.hpp"
+
+#include "dd_wrapper/include/profiler_stats.hpp"
+#include "dd_wrapper/include/sample_manager.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace Datadog;
+
+namespace {
+
+// The frame accessors of 3.9+ return new references; 3.8 only has the fields, which are borrowed
+#if PY_VERSION_HEX >= 0x03090000
+inline PyFrameObject*
+current_frame(PyThreadState* tstate)
+{
+    return PyThreadState_GetFrame(tstate);
+}
+
+inline PyFrameObject*
+next_frame(PyFrameObject* frame)
+{
+    PyFrameObject* back = PyFrame_GetBack(frame);
+    Py_DECREF(frame);
+    return back;
+}
+
+inline PyCodeObject*
+frame_code(PyFrameObject* frame)
+{
+    return PyFrame_GetCode(frame);
+}
+#else
+inline PyFrameObject*
+current_frame(PyThreadState* tstate)
+{
+    Py_XINCREF(tstate->frame);
+    return tstate->frame;
+}
+
+inline PyFrameObject*
+next_frame(PyFrameObject* frame)
+{
+    PyFrameObject* back = frame->f_back;
+    Py_XINCREF(back);
+    Py_DECREF(frame);
+    return back;
+}
+
+inline PyCodeObject*
+frame_code(PyFrameObject* frame)
+{
+    Py_INCREF(frame->f_code);
+    return frame->f_code;
+}
+#endif
+
+// The UTF-8 buffer is cached by the string object, so the view is stable for as long as the code object lives, which
+// is all the frame cache needs
+inline std::string_view
+unicode_view(PyObject* str)
+{
+    Py_ssize_t size = 0;
+    const char* data = str != nullptr ? PyUnicode_AsUTF8AndSize(str, &size) : nullptr;
+    if (data == nullptr) {
+        PyErr_Clear();
+        return {};
+    }
+    return { data, static_cast<size_t>(size) };
+}
+
+// Captures happen on the application threads, so each one keeps its own cache
+struct ThreadFrameCache
+{
+    InternedFrameCache frames{ g_default_span_capture_frame_cache_size };
+    uint64_t string_generation = 0;
+};
+
+} // namespace
+
+void
+SpanCapture::configure(double max_per_second, std::string_view _ignored_prefix)
+{
+    // The prefix goes first, since captures may start as soon as the rate is set
+    min_gap_ns.store(0);
+    ignored_prefix = _ignored_prefix;
+    if (max_per_second > 0.0 && std::isfinite(max_per_second)) {
+        min_gap_ns.store(std::max<int64_t>(static_cast<int64_t>(1e9 / max_per_second), 1));
+    }
+}
+
+bool
+SpanCapture::enabled()
+{
+    return min_gap_ns.load(std::memory_order_relaxed) > 0;
+}
+
+bool
+SpanCapture::take_token(int64_t now_ns)
+{
+    // At most one capture every min_gap_ns.  There is no burst allowance, so this is a single compare-and-swap.
+    const int64_t gap_ns = min_gap_ns.load(std::memory_order_relaxed);
+    int64_t allowed_ns = next_allowed_ns.load(std::memory_order_relaxed);
+    do {
+        if (gap_ns <= 0 || now_ns < allowed_ns) {
+            return false;
+        }
+    } while (!next_allowed_ns.compare_exchange_weak(allowed_ns, now_ns + gap_ns, std::memory_order_relaxed));
+    return true;
+}
+
+bool
+SpanCapture::capture(PyThreadState* tstate,
+                     uint64_t span_id,
+                     uint64_t local_root_span_id,
+                     std::string_view trace_type,
+                     std::string_view trace_resource,
+                     std::string_view thread_name)
+{
+    if (tstate == nullptr || !enabled()) {
+        return false;
+    }
+    if (!take_token(Sample::monotonic_now_ns())) {
+        ProfilerStats::add(ProfilerCounter::span_captures_rate_limited);
+        return false;
+    }
+
+    Sample* sample = SampleManager::start_sample();
+    if (sample == nullptr) {
+        return false;
+    }
+
+    static thread_local ThreadFrameCache cache;
+    const uint64_t cur_generation = Sample::string_generation();
+    if (cur_generation != cache.string_generation) {
+        cache.frames.clear();
+        cache.string_generation = cur_generation;
+    }
+
+    // One regular sample's worth of wall time, so that captures stand out in the span's profile without inflating
+    // the overall wall time
+    const auto interval_ns = static_cast<int64_t>(Sampler::get().get_effective_interval() * 1e9);
+    sample->push_walltime(interval_ns, 1);
+    sample->push_threadinfo(static_cast<int64_t>(PyThread_get_thread_ident()),
+                            static_cast<int64_t>(PyThread_get_thread_native_id()),
+                            thread_name);
+    if (span_id != 0) {
+        sample->push_span_id(span_id);
+    }
+    if (local_root_span_id != 0) {
+        sample->push_local_root_span_id(local_root_span_id);
+    }
+    if (!trace_type.empty()) {
+        sample->push_trace_type(trace_type);
+    }
+    if (!trace_resource.empty()) {
+        sample->push_trace_resource_container(trace_resource);
+    }
+    if (Sample::is_timeline_enabled()) {
+        sample->push_monotonic_ns(Sample::monotonic_now_ns());
+    }
+
+    bool skipping = !ignored_prefix.empty();
+    for (PyFrameObject* frame = current_frame(tstate); frame != nullptr; frame = next_frame(frame)) {
+        PyCodeObject* code = frame_code(frame);
+#if PY_VERSION_HEX >= 0x030b0000
+        const auto name = unicode_view(code->co_qualname);
+#else
+        const auto name = unicode_view(code->co_name);
+#endif
+        const auto file = unicode_view(code->co_filename);
+        Py_DECREF(code);
+        if (skipping && file.substr(0, ignored_prefix.size()) == ignored_prefix) {
+            continue;
+        }
+        skipping = false;
+
+        const auto interned = cache.frames.get(name, file);
+        sample->push_interned_frame(interned.name, interned.file, 0, PyFrame_GetLineNumber(frame));
+    }
+
+    sample->flush_sample();
+    SampleManager::drop_sample(sample);
+    ProfilerStats::add(ProfilerCounter::span_captures);
+    return true;
+}
@@ -0,0 +1,98 @@
+#include "stack_collapser.hpp"
+
+#include "dd_wrapper/include/profiler_stats.hpp"
+#include "dd_wrapper/include/sample_manager.hpp"
+
+using namespace Datadog;
+
+StackCollapser::StackCollapser(size_t _max_size, int64_t _max_age_ns)
+  : max_size{ _max_size }
+  , max_age_ns{ _max_age_ns }
+{
+    held.reserve(max_size);
+}
+
+StackCollapser::~StackCollapser()
+{
+    discard_all();
+}
+
+void
+StackCollapser::flush(Held& entry)
+{
+    entry.sample->flush_sample();
+    SampleManager::drop_sample(entry.sample);
+    entry.sample = nullptr;
+}
+
+void
+StackCollapser::collapse(uintptr_t thread_id, size_t stack, uint64_t fingerprint, Sample* sample, int64_t now_ns)
+{
+    const Key key{ thread_id, stack };
+    auto it = held.find(key);
+    if (it != held.end() && it->second.fingerprint == fingerprint) {
+        it->second.sample->add_values(*sample);
+        SampleManager::drop_sample(sample);
+        ProfilerStats::add(ProfilerCounter::samples_collapsed);
+        if (now_ns - it->second.since_ns >= max_age_ns) {
+            flush(it->second);
+            held.erase(it);
+        }
+        return;
+    }
+
+    if (it != held.end()) {
+        flush(it->second);
+        it->second = { fingerprint, sample, now_ns };
+        return;
+    }
+
+    // Past the limit, samples are flushed as they come, like they would be without collapsing
+    if (held.size() >= max_size) {
+        sample->flush_sample();
+        SampleManager::drop_sample(sample);
+        return;
+    }
+    held.emplace(key, Held{ fingerprint, sample, now_ns });
+}
+
+void
+StackCollapser::end_pass(int64_t now_ns)
+{
+    for (auto it = held.begin(); it != held.end();) {
+        if (now_ns - it->second.since_ns >= max_age_ns) {
+            flush(it->second);
+            it = held.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void
+StackCollapser::check_generation(uint64_t cur_generation)
+{
+    if (cur_generation != string_generation) {
+        flush_all();
+        string_generation = cur_generation;
+    }
+}
+
+void
+StackCollapser::flush_all()
+{
+    for (auto& [key, entry] : held) {
+        flush(entry);
+    }
+    held.clear();
+}
+
+void
+StackCollapser::discard_all()
+{
+    // Samples are usually returned to the pool of the SampleManager, whose lock may have been held during the fork
+    for (auto& [key, entry] : held) {
+        delete entry.sample; // NOLINT(cppcoreguidelines-owning-memory)
+    }
+    held.clear();
+}
@@ -1,5 +1,8 @@
 #include "stack_renderer.hpp"
-#include "utf8_validate.hpp"
+#include "dd_wrapper/include/profiler_stats.hpp"
+#include "dd_wrapper/include/sample_manager.hpp"
+
+#include <functional>
 
 using namespace Datadog;
 
@@ -22,22 +25,84 @@ StackRenderer::render_thread_begin(PyThreadState* tstate,
     if (failed) {
         return;
     }
-    sample = ddup_start_sample();
-    if (sample == nullptr) {
+    // Interned strings age out as profiles are cycled, so whatever the caches hold is dropped once that happens
+    const uint64_t cur_generation = Sample::string_generation();
+    if (cur_generation != string_generation) {
+        frame_cache.clear();
+        thread_label_cache.clear();
+        string_generation = cur_generation;
+    }
+
+    // Samples of a burst go to a profile of their own, so they are neither collapsed nor flush the held ones
+    collapse_stacks = !burst && !Sample::is_timeline_enabled();
+    if (collapse_stacks) {
+        stack_collapser.check_generation(cur_generation);
+        collapse_now_ns = Sample::monotonic_now_ns();
+    }
+
+    // Echion renders every asyncio task of the thread as a stack of its own, so the thread's context is kept around
+    // for the samples of the tasks after the first one
+    thread_labels = &thread_label_cache.get(thread_id, native_id, name, interpreter_id);
+    rendered_thread_id = thread_id;
+    thread_stack = 0;
+    thread_fingerprint = 0;
+    if (collapse_stacks) {
+        for (const auto& label : *thread_labels) {
+            fingerprint_combine(thread_fingerprint, to_string_view(label.key));
+            fingerprint_combine(thread_fingerprint, to_string_view(label.str));
+            fingerprint_combine(thread_fingerprint, static_cast<uint64_t>(label.num));
+        }
+        fingerprint_combine(thread_fingerprint, thread_state.gil);
+        fingerprint_combine(thread_fingerprint, thread_state.kernel);
+        fingerprint_combine(thread_fingerprint, thread_state.off_cpu_reason);
+    }
+    thread_wall_time_ns = 1000 * wall_time_us;
+    thread_now_ns = Sample::is_timeline_enabled() ? Sample::monotonic_now_ns() : 0;
+    timer_frames.clear();
+    collect_timer_frames = !burst && cpu_timer_drain != nullptr && cpu_timer_drain->count != 0;
+    if (!start_thread_sample()) {
         std::cerr << "Failed to create a sample.  Stack v2 sampler will be disabled." << std::endl;
         failed = true;
-        return;
+        thread_labels = nullptr;
     }
+}
 
-    //#warning stack_v2 should use a C++ interface instead of re-converting intermediates
-    ddup_push_threadinfo(sample, static_cast<int64_t>(thread_id), static_cast<int64_t>(native_id), name);
-    ddup_push_walltime(sample, 1000 * wall_time_us, 1);
+bool
+StackRenderer::start_thread_sample(bool with_wall_time)
+{
+    sample = SampleManager::start_sample();
+    if (sample == nullptr) {
+        return false;
+    }
+    stack_fingerprint = thread_fingerprint;
+
+    // The stack profiler enables both CPU and wall time, so once that's checked, the values are pushed unchecked
+    stack_types = sample->has_types<SampleType::CPU | SampleType::Wall>();
+    sample->push_label_set(*thread_labels);
+    // Samples of CPU timers only carry CPU time
+    if (with_wall_time && stack_types) {
+        sample->push_value<SampleType::Wall>(thread_wall_time_ns, 1);
+    } else if (with_wall_time) {
+        sample->push_walltime(thread_wall_time_ns, 1);
+    }
+    sample->push_thread_state(thread_state.gil, thread_state.kernel, thread_state.off_cpu_reason);
+
+    // Stamp the sample with the time the thread was observed, rather than when unwinding finished
+    if (thread_now_ns != 0) {
+        sample->push_monotonic_ns(thread_now_ns);
+    }
+    return true;
 }
 
 void
 StackRenderer::render_stack_begin()
 {
-    // This function is part of the necessary API, but it is unused by the Datadog profiler for now.
+    // Each task gets the whole wall time of the thread, like with the stack collector.  The CPU time was already
+    // accounted for with the first stack.
+    task_named = false;
+    if (sample == nullptr && thread_labels != nullptr) {
+        start_thread_sample();
+    }
 }
 
 void
@@ -48,27 +113,56 @@ StackRenderer::render_python_frame(std::string_view name, std::string_view file,
         return;
     }
 
-    // Normally, further utf-8 validation would be pointless here, but we may be reading data where the
-    // string pointer was valid, but the string is actually garbage data at the exact time of the read.
-    // This is rare, but blowing some cycles on early validation allows the sample to be retained by
-    // libdatadog, so we can evaluate the actual impact of this scenario in live scenarios.
-    static const std::string_view invalid = "<invalid_utf8>";
-    if (!utf8_check_is_valid(name.data(), name.size())) {
-        name = invalid;
+    // Echion renders the name of each task as a frame without a file, below the coroutines it runs.  The leaf-most
+    // one is the task the stack belongs to.  Echion doesn't hand the task over, so its id is derived from its name,
+    // which asyncio makes unique unless the application names its tasks itself.
+    if (file.empty() && line == 0 && !task_named) {
+        task_named = true;
+        sample->push_task_name(name);
+        sample->push_task_id(static_cast<int64_t>(std::hash<std::string_view>{}(name) >> 1));
     }
-    if (!utf8_check_is_valid(file.data(), file.size())) {
-        file = invalid;
+
+    frame_cache_sizer.record(name, file, line);
+    const auto frame = frame_cache.get(name, file);
+    sample->push_interned_frame(frame.name, frame.file, 0, line);
+    if (collect_timer_frames) {
+        timer_frames.push_back({ frame.name, frame.file, 0, static_cast<int64_t>(line) });
+    }
+    if (collapse_stacks) {
+        fingerprint_frame(frame.name, frame.file, line);
     }
-    ddup_push_frame(sample, name, file, 0, line);
 }
 
 void
 StackRenderer::render_native_frame(std::string_view name, std::string_view file, uint64_t line)
 {
-    // This function is part of the necessary API, but it is unused by the Datadog profiler for now.
-    (void)name;
-    (void)file;
-    (void)line;
+    if (sample == nullptr) {
+        std::cerr << "Received a new native frame without sample storage.  Some profiling data has been lost."
+                  << std::endl;
+        return;
+    }
+
+    // Echion symbolizes each program counter once and keeps the result in its frame cache, handing us views into
+    // that storage.  The frame cache then turns those views into interned strings once, so neither symbolization
+    // nor interning scales with the number of samples.
+    frame_cache_sizer.record(name, file, line);
+    const auto frame = frame_cache.get(name, file);
+    sample->push_interned_frame(frame.name, frame.file, 0, line);
+    if (collect_timer_frames) {
+        timer_frames.push_back({ frame.name, frame.file, 0, static_cast<int64_t>(line) });
+    }
+    if (collapse_stacks) {
+        fingerprint_frame(frame.name, frame.file, line);
+    }
+}
+
+void
+StackRenderer::fingerprint_frame(std::string_view name, std::string_view file, uint64_t line)
+{
+    // The frame cache returns the same interned strings for the same frame, so their addresses stand for them
+    fingerprint_combine(stack_fingerprint, name);
+    fingerprint_combine(stack_fingerprint, file);
+    fingerprint_combine(stack_fingerprint, line);
 }
 
 void
@@ -79,8 +173,24 @@ StackRenderer::render_cpu_time(microsecond_t cpu_time_us)
         return;
     }
 
-    // ddup is configured to expect nanoseconds
-    ddup_push_cputime(sample, 1000 * cpu_time_us, 1);
+    // ddup is configured to expect nanoseconds.  With a CPU timer, the time goes to the samples of each address the
+    // thread was interrupted at instead, except for what didn't fit in its ring.
+    int64_t cpu_time_ns = 1000 * cpu_time_us;
+    if (burst) {
+        burst_cpu_time_ns[rendered_thread_id] += cpu_time_ns;
+    } else if (cpu_timer_drain != nullptr && cpu_timer_drain->tracked) {
+        // The timer accounts for whatever the bursts saw, too
+        cpu_time_ns = cpu_timer_drain->unattributed_cpu_ns;
+        burst_cpu_time_ns.erase(rendered_thread_id);
+    } else if (auto it = burst_cpu_time_ns.find(rendered_thread_id); it != burst_cpu_time_ns.end()) {
+        cpu_time_ns += it->second;
+        burst_cpu_time_ns.erase(it);
+    }
+    if (stack_types) {
+        sample->push_value<SampleType::CPU>(cpu_time_ns, 1);
+    } else {
+        sample->push_cputime(cpu_time_ns, 1);
+    }
 }
 
 void
@@ -88,12 +198,115 @@ StackRenderer::render_stack_end()
 {
     if (sample == nullptr) {
         std::cerr << "Ending a stack without any context.  Some profiling data has been lost." << std::endl;
+        ProfilerStats::add(ProfilerCounter::samples_lost);
         return;
     }
 
-    ddup_flush_sample(sample);
-    ddup_drop_sample(sample);
+    if (collapse_stacks) {
+        stack_collapser.collapse(rendered_thread_id, thread_stack, stack_fingerprint, sample, collapse_now_ns);
+    } else {
+        sample->flush_sample();
+        SampleManager::drop_sample(sample);
+    }
     sample = nullptr;
+    ++thread_stack;
+
+    // Only the first stack of the thread is what its timer interrupted; the others are those of suspended tasks
+    if (collect_timer_frames) {
+        collect_timer_frames = false;
+        render_cpu_timer_samples();
+    }
+}
+
+void
+StackRenderer::render_cpu_timer_samples()
+{
+    for (size_t i = 0; i < cpu_timer_drain->count; ++i) {
+        const CpuTimerEvent& event = cpu_timer_drain->events[i];
+        if (!start_thread_sample(false)) {
+            ProfilerStats::add(ProfilerCounter::samples_lost);
+            return;
+        }
+
+        // The address is symbolized after upload, from the mapping it falls in
+        if (event.pc != 0) {
+            sample->push_native_frame(event.pc);
+        }
+        sample->push_interned_frames(timer_frames.data(), timer_frames.size());
+        if (stack_types) {
+            sample->push_value<SampleType::CPU>(event.cpu_time_ns, 1);
+        } else {
+            sample->push_cputime(event.cpu_time_ns, 1);
+        }
+        sample->flush_sample();
+        SampleManager::drop_sample(sample);
+        sample = nullptr;
+    }
+}
+
+void
+StackRenderer::set_interpreter_id(int64_t _interpreter_id)
+{
+    interpreter_id = _interpreter_id;
+}
+
+void
+StackRenderer::configure_frame_cache(size_t capacity, bool adaptive)
+{
+    frame_cache_sizer.configure(capacity, adaptive);
+}
+
+size_t
+StackRenderer::end_pass(std::chrono::steady_clock::time_point now)
+{
+    if (burst_ended) {
+        burst_cpu_time_ns.clear();
+        burst_ended = false;
+    }
+    stack_collapser.end_pass(Sample::monotonic_now_ns());
+
+    // Echion frees its frames when its cache is re-initialized, so this also drops the views we keyed on them
+    const size_t capacity = frame_cache_sizer.end_pass(now);
+    if (capacity != 0) {
+        frame_cache.clear();
+    }
+    return capacity;
+}
+
+void
+StackRenderer::flush_collapsed()
+{
+    stack_collapser.flush_all();
+}
+
+void
+StackRenderer::postfork_child()
+{
+    stack_collapser.discard_all();
+}
+
+void
+StackRenderer::set_thread_state(const ThreadState& _thread_state)
+{
+    thread_state = _thread_state;
+}
+
+void
+StackRenderer::set_cpu_timer_drain(const CpuTimerDrain* _cpu_timer_drain)
+{
+    cpu_timer_drain = _cpu_timer_drain;
+}
+
+void
+StackRenderer::set_burst(bool _burst)
+{
+    burst = _burst;
+}
+
+void
+StackRenderer::end_burst()
+{
+    burst_ended = true;
 }
 
 bool
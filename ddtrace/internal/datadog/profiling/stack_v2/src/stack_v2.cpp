@@ -1,6 +1,7 @@
 #include "cast_to_pyfunc.hpp"
 #include "python_headers.hpp"
 #include "sampler.hpp"
+#include "span_capture.hpp"
 
 using namespace Datadog;
 
@@ -8,15 +9,76 @@ static PyObject*
 _stack_v2_start(PyObject* self, PyObject* args, PyObject* kwargs)
 {
     (void)self;
-    static const char* const_kwlist[] = { "min_interval", NULL };
+    static const char* const_kwlist[] = { "min_interval",      "max_time_usage_pct",   "max_threads_per_pass",
+                                          "skip_idle_threads", "native_frames",        "realtime_priority",
+                                          "cpus",              "idle_priority",        "fast_memory_reads",
+                                          "frame_cache_size",  "adaptive_frame_cache", "thread_state",
+                                          "cpu_timers",        NULL };
     static char** kwlist = const_cast<char**>(const_kwlist);
     double min_interval_s = g_default_sampling_period_s;
+    double max_time_usage_pct = g_default_max_time_usage_pct;
+    Py_ssize_t max_threads_per_pass = g_default_max_threads_per_pass;
+    int skip_idle_threads = 0;
+    int native_frames = 0;
+    int realtime_priority = 0;
+    PyObject* cpus_obj = Py_None;
+    int idle_priority = 0;
+    int fast_memory_reads = 0;
+    Py_ssize_t frame_cache_size = g_default_echion_frame_cache_size;
+    int adaptive_frame_cache = 0;
+    int thread_state = 0;
+    int cpu_timers = 0;
 
-    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|d", kwlist, &min_interval_s)) {
+    if (!PyArg_ParseTupleAndKeywords(args,
+                                     kwargs,
+                                     "|ddnpppOppnppp",
+                                     kwlist,
+                                     &min_interval_s,
+                                     &max_time_usage_pct,
+                                     &max_threads_per_pass,
+                                     &skip_idle_threads,
+                                     &native_frames,
+                                     &realtime_priority,
+                                     &cpus_obj,
+                                     &idle_priority,
+                                     &fast_memory_reads,
+                                     &frame_cache_size,
+                                     &adaptive_frame_cache,
+                                     &thread_state,
+                                     &cpu_timers)) {
         return NULL; // If an error occurs during argument parsing
     }
 
+    std::vector<int> cpus;
+    if (cpus_obj != Py_None) {
+        PyObject* seq = PySequence_Fast(cpus_obj, "cpus must be a sequence of integers");
+        if (seq == NULL) {
+            return NULL;
+        }
+        for (Py_ssize_t i = 0; i < PySequence_Fast_GET_SIZE(seq); i++) {
+            const long cpu = PyLong_AsLong(PySequence_Fast_GET_ITEM(seq, i));
+            if (cpu == -1 && PyErr_Occurred()) {
+                Py_DECREF(seq);
+                return NULL;
+            }
+            cpus.push_back(static_cast<int>(cpu));
+        }
+        Py_DECREF(seq);
+    }
+
     Sampler::get().set_interval(min_interval_s);
+    Sampler::get().set_max_time_usage_pct(max_time_usage_pct);
+    Sampler::get().set_max_threads_per_pass(max_threads_per_pass > 0 ? static_cast<size_t>(max_threads_per_pass) : 0);
+    Sampler::get().set_skip_idle_threads(skip_idle_threads != 0);
+    Sampler::get().set_native_frames(native_frames != 0);
+    Sampler::get().set_realtime_priority(realtime_priority != 0);
+    Sampler::get().set_cpu_affinity(std::move(cpus));
+    Sampler::get().set_idle_priority(idle_priority != 0);
+    Sampler::get().set_fast_memory_reads(fast_memory_reads != 0);
+    Sampler::get().set_frame_cache_size(frame_cache_size > 0 ? static_cast<size_t>(frame_cache_size) : 0,
+                                        adaptive_frame_cache != 0);
+    Sampler::get().set_thread_state(thread_state != 0);
+    Sampler::get().set_cpu_timers(cpu_timers != 0);
     Sampler::get().start();
     Py_RETURN_NONE;
 }
@@ -33,6 +95,24 @@ stack_v2_stop(PyObject* self, PyObject* args)
     Py_RETURN_NONE;
 }
 
+static PyObject*
+stack_v2_shutdown(PyObject* self, PyObject* args)
+{
+    // Assumes the timeout is given in fractional seconds
+    (void)self;
+    double timeout_s = g_default_shutdown_timeout_s;
+    if (!PyArg_ParseTuple(args, "|d", &timeout_s)) {
+        return NULL; // If an error occurs during argument parsing
+    }
+
+    // Waiting for the sampling thread doesn't need the GIL, and the thread may be waiting on it
+    bool stopped = false;
+    Py_BEGIN_ALLOW_THREADS;
+    stopped = Sampler::get().shutdown(std::chrono::milliseconds(static_cast<int64_t>(timeout_s * 1000)));
+    Py_END_ALLOW_THREADS;
+    return PyBool_FromLong(stopped);
+}
+
 static PyObject*
 stack_v2_set_interval(PyObject* self, PyObject* args)
 {
@@ -46,10 +126,141 @@ stack_v2_set_interval(PyObject* self, PyObject* args)
     Py_RETURN_NONE;
 }
 
+static PyObject*
+stack_v2_get_interval(PyObject* self, PyObject* args)
+{
+    // Returns the interval currently used by the sampling thread, in fractional seconds
+    (void)self;
+    (void)args;
+    return PyFloat_FromDouble(Sampler::get().get_effective_interval());
+}
+
+static PyObject*
+stack_v2_get_actual_interval(PyObject* self, PyObject* args)
+{
+    // Returns the period actually observed between sampling passes, in fractional seconds
+    (void)self;
+    (void)args;
+    return PyFloat_FromDouble(Sampler::get().get_actual_interval());
+}
+
+static PyObject*
+stack_v2_start_burst(PyObject* self, PyObject* args)
+{
+    // Assumes the interval and the duration are given in fractional seconds
+    (void)self;
+    double interval;
+    double duration;
+    if (!PyArg_ParseTuple(args, "dd", &interval, &duration)) {
+        return NULL; // If an error occurs during argument parsing
+    }
+    return PyBool_FromLong(Sampler::get().start_burst(interval, duration));
+}
+
+static PyObject*
+stack_v2_stop_burst(PyObject* self, PyObject* args)
+{
+    (void)self;
+    (void)args;
+    Sampler::get().stop_burst();
+    Py_RETURN_NONE;
+}
+
+static PyObject*
+stack_v2_set_span_capture(PyObject* self, PyObject* args)
+{
+    // Assumes the rate is given in captures per second; 0 disables them
+    (void)self;
+    double max_per_second = g_default_span_capture_max_per_second;
+    const char* ignored_prefix = "";
+    Py_ssize_t ignored_prefix_len = 0;
+    if (!PyArg_ParseTuple(args, "d|s#", &max_per_second, &ignored_prefix, &ignored_prefix_len)) {
+        return NULL; // If an error occurs during argument parsing
+    }
+    SpanCapture::configure(max_per_second,
+                           std::string_view(ignored_prefix, static_cast<size_t>(ignored_prefix_len)));
+    Py_RETURN_NONE;
+}
+
+static PyObject*
+stack_v2_capture_span(PyObject* self, PyObject* args)
+{
+    // Captures the stack of the calling thread with the given span labels; strings may be None
+    (void)self;
+    unsigned long long span_id = 0;
+    unsigned long long local_root_span_id = 0;
+    const char* trace_type = nullptr;
+    const char* trace_resource = nullptr;
+    const char* thread_name = nullptr;
+    if (!PyArg_ParseTuple(args, "KK|zzz", &span_id, &local_root_span_id, &trace_type, &trace_resource, &thread_name)) {
+        return NULL; // If an error occurs during argument parsing
+    }
+    const bool captured = SpanCapture::capture(PyThreadState_Get(),
+                                               span_id,
+                                               local_root_span_id,
+                                               trace_type != nullptr ? trace_type : "",
+                                               trace_resource != nullptr ? trace_resource : "",
+                                               thread_name != nullptr ? thread_name : "");
+    return PyBool_FromLong(captured);
+}
+
+static PyObject*
+stack_v2_init_asyncio(PyObject* self, PyObject* args)
+{
+    // Takes asyncio's current tasks, scheduled tasks and eager tasks, which may be None
+    (void)self;
+    PyObject* current_tasks = nullptr;
+    PyObject* scheduled_tasks = nullptr;
+    PyObject* eager_tasks = nullptr;
+    if (!PyArg_ParseTuple(args, "OOO", &current_tasks, &scheduled_tasks, &eager_tasks)) {
+        return NULL; // If an error occurs during argument parsing
+    }
+    Sampler::get().init_asyncio(current_tasks, scheduled_tasks, eager_tasks);
+    Py_RETURN_NONE;
+}
+
+static PyObject*
+stack_v2_track_asyncio_loop(PyObject* self, PyObject* args)
+{
+    // Takes the id of a thread (as in threading.get_ident()) and the loop it runs, or None
+    (void)self;
+    unsigned long long thread_id = 0;
+    PyObject* loop = nullptr;
+    if (!PyArg_ParseTuple(args, "KO", &thread_id, &loop)) {
+        return NULL; // If an error occurs during argument parsing
+    }
+    Sampler::get().track_asyncio_loop(static_cast<uintptr_t>(thread_id), loop);
+    Py_RETURN_NONE;
+}
+
+static PyObject*
+stack_v2_link_tasks(PyObject* self, PyObject* args)
+{
+    // Takes the task which awaits and the task it waits on
+    (void)self;
+    PyObject* parent = nullptr;
+    PyObject* child = nullptr;
+    if (!PyArg_ParseTuple(args, "OO", &parent, &child)) {
+        return NULL; // If an error occurs during argument parsing
+    }
+    Sampler::get().link_tasks(parent, child);
+    Py_RETURN_NONE;
+}
+
 static PyMethodDef _stack_v2_methods[] = {
     { "start", reinterpret_cast<PyCFunction>(stack_v2_start), METH_VARARGS | METH_KEYWORDS, "Start the sampler" },
-    { "stop", stack_v2_stop, METH_VARARGS, "Stop the sampler" },
+    { "stop", stack_v2_stop, METH_VARARGS, "Pause the sampler" },
+    { "shutdown", stack_v2_shutdown, METH_VARARGS, "Stop the sampling thread, waiting for it to exit" },
     { "set_interval", stack_v2_set_interval, METH_VARARGS, "Set the sampling interval" },
+    { "get_interval", stack_v2_get_interval, METH_NOARGS, "Get the effective sampling interval" },
+    { "get_actual_interval", stack_v2_get_actual_interval, METH_NOARGS, "Get the observed sampling period" },
+    { "start_burst", stack_v2_start_burst, METH_VARARGS, "Sample at a high rate into a separate profile for a while" },
+    { "stop_burst", stack_v2_stop_burst, METH_NOARGS, "End the current burst early" },
+    { "set_span_capture", stack_v2_set_span_capture, METH_VARARGS, "Configure the captures at span boundaries" },
+    { "capture_span", stack_v2_capture_span, METH_VARARGS, "Capture the stack of the current thread for a span" },
+    { "init_asyncio", stack_v2_init_asyncio, METH_VARARGS, "Register the task registries of asyncio" },
+    { "track_asyncio_loop", stack_v2_track_asyncio_loop, METH_VARARGS, "Set the event loop run by a thread" },
+    { "link_tasks", stack_v2_link_tasks, METH_VARARGS, "Link a task to the task which awaits it" },
     { NULL, NULL, 0, NULL }
 };
 
@@ -65,5 +276,12 @@ PyInit__stack_v2(void)
     if (!m)
         return NULL;
 
+#ifdef Py_GIL_DISABLED
+    // Nothing here relies on the GIL: the sampler runs on its own native thread, the configuration is atomic, and
+    // the sample storage in dd_wrapper is safe to use from any number of threads.  Without this, importing the
+    // module would re-enable the GIL on free-threaded builds.
+    PyUnstable_Module_SetGIL(m, Py_MOD_GIL_NOT_USED);
+#endif
+
     return m;
 }
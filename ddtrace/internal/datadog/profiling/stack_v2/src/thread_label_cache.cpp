@@ -0,0 +1,35 @@
+#include "thread_label_cache.hpp"
+
+using namespace Datadog;
+
+ThreadLabelCache::ThreadLabelCache(size_t _max_size)
+  : max_size{ _max_size }
+{}
+
+const LabelSet&
+ThreadLabelCache::get(uintptr_t thread_id, unsigned long native_id, std::string_view name, int64_t interpreter_id)
+{
+    auto it = cache.find(thread_id);
+    if (it != cache.end() && it->second.native_id == native_id && it->second.interpreter_id == interpreter_id &&
+        it->second.name == name) {
+        return it->second.labels;
+    }
+
+    // Same policy as the frame cache: threads which have gone away are forgotten by starting over
+    if (it == cache.end() && cache.size() >= max_size) {
+        cache.clear();
+    }
+    auto& entry = cache[thread_id];
+    entry.native_id = native_id;
+    entry.interpreter_id = interpreter_id;
+    entry.name = name;
+    entry.labels = Sample::make_threadinfo_labels(
+      static_cast<int64_t>(thread_id), static_cast<int64_t>(native_id), name, interpreter_id);
+    return entry.labels;
+}
+
+void
+ThreadLabelCache::clear()
+{
+    cache.clear();
+}
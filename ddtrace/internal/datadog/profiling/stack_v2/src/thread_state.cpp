@@ -0,0 +1,242 @@
+#include "thread_state.hpp"
+
+#include "python_headers.hpp"
+
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+using namespace Datadog;
+
+namespace {
+
+#if defined PL_LINUX
+std::string_view
+off_cpu_reason_for(long syscall_nr)
+{
+    switch (syscall_nr) {
+#ifdef SYS_futex
+        case SYS_futex:
+#endif
+#ifdef SYS_futex_waitv
+        case SYS_futex_waitv:
+#endif
+            return "lock";
+#ifdef SYS_read
+        case SYS_read:
+#endif
+#ifdef SYS_write
+        case SYS_write:
+#endif
+#ifdef SYS_readv
+        case SYS_readv:
+#endif
+#ifdef SYS_writev
+        case SYS_writev:
+#endif
+#ifdef SYS_pread64
+        case SYS_pread64:
+#endif
+#ifdef SYS_pwrite64
+        case SYS_pwrite64:
+#endif
+#ifdef SYS_recvfrom
+        case SYS_recvfrom:
+#endif
+#ifdef SYS_recvmsg
+        case SYS_recvmsg:
+#endif
+#ifdef SYS_sendto
+        case SYS_sendto:
+#endif
+#ifdef SYS_sendmsg
+        case SYS_sendmsg:
+#endif
+#ifdef SYS_accept
+        case SYS_accept:
+#endif
+#ifdef SYS_accept4
+        case SYS_accept4:
+#endif
+#ifdef SYS_connect
+        case SYS_connect:
+#endif
+#ifdef SYS_poll
+        case SYS_poll:
+#endif
+#ifdef SYS_ppoll
+        case SYS_ppoll:
+#endif
+#ifdef SYS_select
+        case SYS_select:
+#endif
+#ifdef SYS_pselect6
+        case SYS_pselect6:
+#endif
+#ifdef SYS_epoll_wait
+        case SYS_epoll_wait:
+#endif
+#ifdef SYS_epoll_pwait
+        case SYS_epoll_pwait:
+#endif
+#ifdef SYS_epoll_pwait2
+        case SYS_epoll_pwait2:
+#endif
+#ifdef SYS_io_getevents
+        case SYS_io_getevents:
+#endif
+#ifdef SYS_io_uring_enter
+        case SYS_io_uring_enter:
+#endif
+            return "io";
+#ifdef SYS_nanosleep
+        case SYS_nanosleep:
+#endif
+#ifdef SYS_clock_nanosleep
+        case SYS_clock_nanosleep:
+#endif
+            return "sleep";
+#ifdef SYS_wait4
+        case SYS_wait4:
+#endif
+#ifdef SYS_waitid
+        case SYS_waitid:
+#endif
+            return "wait";
+        default:
+            return "syscall";
+    }
+}
+#endif
+
+} // namespace
+
+ThreadStateReader::~ThreadStateReader()
+{
+    if (task_dir_fd >= 0) {
+        close(task_dir_fd);
+    }
+}
+
+std::string_view
+ThreadStateReader::gil_state(uintptr_t thread_id)
+{
+#if defined PL_LINUX && PY_VERSION_HEX < 0x030c0000
+    // This doesn't need the GIL: it's a relaxed load of the global the interpreter updates when the GIL changes
+    // hands.  The holder may exit at any time, so its id is read like any other memory of the interpreter.
+    PyThreadState* holder = _PyThreadState_UncheckedGet();
+    if (holder == nullptr) {
+        return "released";
+    }
+    unsigned long holder_id = 0;
+    struct iovec local = { &holder_id, sizeof(holder_id) };
+    struct iovec remote = { reinterpret_cast<char*>(holder) + offsetof(PyThreadState, thread_id), sizeof(holder_id) };
+    if (process_vm_readv(getpid(), &local, 1, &remote, 1, 0) != static_cast<ssize_t>(sizeof(holder_id))) {
+        return {};
+    }
+    return holder_id == thread_id ? "held" : "released";
+#else
+    (void)thread_id;
+    return {};
+#endif
+}
+
+bool
+ThreadStateReader::open_task_dir()
+{
+    const pid_t pid = getpid();
+    if (task_dir_fd >= 0 && task_dir_pid == pid) {
+        return true;
+    }
+    if (task_dir_fd >= 0) {
+        close(task_dir_fd);
+    }
+    task_dir_fd = open("/proc/self/task", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    task_dir_pid = pid;
+    return task_dir_fd >= 0;
+}
+
+bool
+ThreadStateReader::read_file(unsigned long native_id, const char* name, char* buf, size_t size)
+{
+    char path[64];
+    std::snprintf(path, sizeof(path), "%lu/%s", native_id, name);
+    const int fd = openat(task_dir_fd, path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    const ssize_t len = ::read(fd, buf, size - 1);
+    close(fd);
+    if (len <= 0) {
+        return false;
+    }
+    buf[len] = '\0';
+    return true;
+}
+
+std::string_view
+ThreadStateReader::kernel_state(unsigned long native_id, std::string_view& off_cpu_reason)
+{
+#if defined PL_LINUX
+    if (!open_task_dir()) {
+        return {};
+    }
+
+    // The name of the thread is in parentheses and may itself contain some, so the state follows the last one
+    char stat[512];
+    if (!read_file(native_id, "stat", stat, sizeof(stat))) {
+        return {};
+    }
+    const char* end = std::strrchr(stat, ')');
+    if (end == nullptr || end[1] != ' ') {
+        return {};
+    }
+
+    std::string_view state;
+    switch (end[2]) {
+        case 'R':
+            return "running";
+        case 'S':
+            state = "sleeping";
+            break;
+        case 'D':
+            state = "uninterruptible";
+            break;
+        case 'T':
+        case 't':
+            return "stopped";
+        default:
+            return "other";
+    }
+
+    // Either the number of the system call, or -1 when blocked elsewhere (e.g., on a page fault)
+    char syscall_buf[128];
+    if (read_file(native_id, "syscall", syscall_buf, sizeof(syscall_buf))) {
+        char* num_end = nullptr;
+        const long syscall_nr = std::strtol(syscall_buf, &num_end, 10);
+        if (num_end != syscall_buf) {
+            off_cpu_reason = syscall_nr < 0 ? "fault" : off_cpu_reason_for(syscall_nr);
+        }
+    }
+    return state;
+#else
+    (void)native_id;
+    (void)off_cpu_reason;
+    return {};
+#endif
+}
+
+ThreadState
+ThreadStateReader::read(uintptr_t thread_id, unsigned long native_id)
+{
+    ThreadState state;
+    state.gil = gil_state(thread_id);
+    state.kernel = kernel_state(native_id, state.off_cpu_reason);
+    return state;
+}
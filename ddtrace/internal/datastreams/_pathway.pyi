@@ -0,0 +1,15 @@
+from typing import List
+from typing import Tuple
+
+from ddtrace.internal.processor._stats import DDSketch
+
+def fnv1_64(data: bytes) -> int: ...
+def compute_pathway_hash(service: str, env: str, tags: List[str], parent_hash: int) -> int: ...
+def encode_pathway_ctx(hash_value: int, pathway_start_ms: int, current_edge_start_ms: int) -> bytes: ...
+def decode_pathway_ctx(data: bytes) -> Tuple[int, int, int]: ...
+
+class PathwayStats(object):
+    full_pathway_latency: DDSketch
+    edge_latency: DDSketch
+    payload_size: DDSketch
+    def add(self, edge_latency_sec: float, full_pathway_latency_sec: float, payload_size: float) -> None: ...
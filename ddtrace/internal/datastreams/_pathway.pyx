@@ -0,0 +1,151 @@
+"""
+Native hashing, encoding and aggregation of the checkpoints of data streams pathways.
+
+The hashes are the FNV-1 64 bits hashes of ``fnv.py`` and the pathway contexts
+are encoded like with ``encoding.py``, which remain the reference of the formats:
+the 8 bytes of the little-endian hash, followed by the zigzag variable length
+encodings of the start of the pathway and of the current edge in milliseconds.
+
+The latencies are aggregated in the native DDSketches of the span stats.
+"""
+from cpython.bytes cimport PyBytes_AS_STRING
+from cpython.bytes cimport PyBytes_FromStringAndSize
+from cpython.bytes cimport PyBytes_GET_SIZE
+from libc.stdint cimport int64_t
+from libc.stdint cimport uint64_t
+
+from ddtrace.internal.processor._stats cimport DDSketch
+
+
+DEF MAX_VAR_LEN_64 = 9
+# The hash, and the two variable length integers, which take up to one more byte as the encoding in Python does
+DEF MAX_PATHWAY_SIZE = 8 + 2 * (MAX_VAR_LEN_64 + 1)
+
+cdef uint64_t _FNV_64_PRIME = 0x100000001B3ULL
+cdef uint64_t _FNV1_64_INIT = 0xCBF29CE484222325ULL
+
+
+cdef inline uint64_t _fnv1_64_update(uint64_t hval, const unsigned char* data, Py_ssize_t size):
+    cdef Py_ssize_t i
+
+    for i in range(size):
+        hval = (hval * _FNV_64_PRIME) ^ data[i]
+    return hval
+
+
+cdef inline uint64_t _fnv1_64_update_text(uint64_t hval, str text):
+    cdef bytes data = text.encode("utf-8")
+
+    return _fnv1_64_update(hval, <const unsigned char*>PyBytes_AS_STRING(data), PyBytes_GET_SIZE(data))
+
+
+cdef inline void _write_uint64_le(unsigned char* buf, uint64_t value):
+    cdef int i
+
+    for i in range(8):
+        buf[i] = <unsigned char>(value >> (8 * i))
+
+
+cpdef uint64_t fnv1_64(const unsigned char[::1] data not None):
+    """Return the 64 bits FNV-1 hash value of the data"""
+    if data.shape[0] == 0:
+        return _FNV1_64_INIT
+    return _fnv1_64_update(_FNV1_64_INIT, &data[0], data.shape[0])
+
+
+cpdef uint64_t compute_pathway_hash(str service, str env, list tags, uint64_t parent_hash):
+    """Return the hash of the checkpoint of the service with the edge tags, following the parent checkpoint"""
+    cdef uint64_t node_hash = _fnv1_64_update_text(_fnv1_64_update_text(_FNV1_64_INIT, service), env)
+    cdef unsigned char hashes[16]
+
+    for tag in tags:
+        node_hash = _fnv1_64_update_text(node_hash, tag)
+
+    _write_uint64_le(hashes, node_hash)
+    _write_uint64_le(hashes + 8, parent_hash)
+    return _fnv1_64_update(_FNV1_64_INIT, hashes, 16)
+
+
+cdef inline unsigned char* _write_var_int_64(unsigned char* buf, int64_t value):
+    # Zigzag encoding, so that the small negative values are short too
+    cdef uint64_t v = (<uint64_t>value << 1) ^ <uint64_t>(value >> 63)
+    cdef int i
+
+    for i in range(MAX_VAR_LEN_64):
+        if v < 0x80:
+            break
+        buf[0] = <unsigned char>((v & 0xFF) | 0x80)
+        v >>= 7
+        buf += 1
+    buf[0] = <unsigned char>(v & 0xFF)
+    return buf + 1
+
+
+cdef Py_ssize_t _read_var_int_64(const unsigned char[::1] data, Py_ssize_t start, int64_t* value) except -1:
+    """Decode the variable length integer at the start of the data, return where it ends"""
+    cdef uint64_t x = 0
+    cdef int s = 0
+    cdef uint64_t n
+    cdef int i
+
+    for i in range(MAX_VAR_LEN_64):
+        if data.shape[0] <= start + i:
+            raise EOFError()
+        n = data[start + i]
+        if n < 0x80 or i == MAX_VAR_LEN_64 - 1:
+            x |= n << s
+            value[0] = <int64_t>(x >> 1) ^ -<int64_t>(x & 1)
+            return start + i + 1
+        x |= (n & 0x7F) << s
+        s += 7
+    raise EOFError()
+
+
+cpdef bytes encode_pathway_ctx(uint64_t hash_value, int64_t pathway_start_ms, int64_t current_edge_start_ms):
+    """Encode the pathway context propagated with the messages"""
+    cdef unsigned char buf[MAX_PATHWAY_SIZE]
+    cdef unsigned char* end
+
+    _write_uint64_le(buf, hash_value)
+    end = _write_var_int_64(_write_var_int_64(buf + 8, pathway_start_ms), current_edge_start_ms)
+    return PyBytes_FromStringAndSize(<char*>buf, end - buf)
+
+
+cpdef tuple decode_pathway_ctx(const unsigned char[::1] data not None):
+    """Decode the hash, and the starts of the pathway and of the current edge in milliseconds of a pathway context
+
+    Raises ``EOFError`` when the data is truncated.
+    """
+    cdef uint64_t hash_value = 0
+    cdef int64_t pathway_start_ms
+    cdef int64_t current_edge_start_ms
+    cdef Py_ssize_t end
+    cdef int i
+
+    if data.shape[0] < 8:
+        raise EOFError()
+    for i in range(8):
+        hash_value |= (<uint64_t>data[i]) << (8 * i)
+
+    end = _read_var_int_64(data, 8, &pathway_start_ms)
+    _read_var_int_64(data, end, &current_edge_start_ms)
+    return hash_value, pathway_start_ms, current_edge_start_ms
+
+
+cdef class PathwayStats(object):
+    """Aggregated pathway statistics."""
+
+    cdef readonly DDSketch full_pathway_latency
+    cdef readonly DDSketch edge_latency
+    cdef readonly DDSketch payload_size
+
+    def __cinit__(self):
+        self.full_pathway_latency = DDSketch()
+        self.edge_latency = DDSketch()
+        self.payload_size = DDSketch()
+
+    cpdef add(self, double edge_latency_sec, double full_pathway_latency_sec, double payload_size):
+        """Account for a checkpoint on the pathway"""
+        self.full_pathway_latency.add(full_pathway_latency_sec)
+        self.edge_latency.add(edge_latency_sec)
+        self.payload_size.add(payload_size)
@@ -4,7 +4,6 @@ from collections import defaultdict
 from functools import partial
 import gzip
 import os
-import struct
 import threading
 import time
 import typing
@@ -15,9 +14,6 @@ from typing import NamedTuple  # noqa:F401
 from typing import Optional  # noqa:F401
 from typing import Union  # noqa:F401
 
-from ddsketch import LogCollapsingLowestDenseDDSketch
-from ddsketch.pb.proto import DDSketchProto
-
 import ddtrace
 from ddtrace import config
 from ddtrace.internal import compat
@@ -33,9 +29,10 @@ from ..hostname import get_hostname
 from ..logger import get_logger
 from ..periodic import PeriodicService
 from ..writer import _human_size
-from .encoding import decode_var_int_64
-from .encoding import encode_var_int_64
-from .fnv import fnv1_64
+from ._pathway import PathwayStats
+from ._pathway import compute_pathway_hash
+from ._pathway import decode_pathway_ctx
+from ._pathway import encode_pathway_ctx
 
 
 def gzip_compress(payload):
@@ -70,17 +67,6 @@ PathwayAggrKey = typing.Tuple[
 ]
 
 
-class PathwayStats(object):
-    """Aggregated pathway statistics."""
-
-    __slots__ = ("full_pathway_latency", "edge_latency", "payload_size")
-
-    def __init__(self):
-        self.full_pathway_latency = LogCollapsingLowestDenseDDSketch(0.00775, bin_limit=2048)
-        self.edge_latency = LogCollapsingLowestDenseDDSketch(0.00775, bin_limit=2048)
-        self.payload_size = LogCollapsingLowestDenseDDSketch(0.00775, bin_limit=2048)
-
-
 PartitionKey = NamedTuple("PartitionKey", [("topic", str), ("partition", int)])
 ConsumerPartitionKey = NamedTuple("ConsumerPartitionKey", [("group", str), ("topic", str), ("partition", int)])
 Bucket = NamedTuple(
@@ -158,11 +144,9 @@ class DataStreamsProcessor(PeriodicService):
             # Align the span into the corresponding stats bucket
             bucket_time_ns = now_ns - (now_ns % self._bucket_size_ns)
             aggr_key = (",".join(edge_tags), hash_value, parent_hash)
-            stats = self._buckets[bucket_time_ns].pathway_stats[aggr_key]
-            stats.full_pathway_latency.add(full_pathway_latency_sec)
-            stats.edge_latency.add(edge_latency_sec)
-            stats.payload_size.add(payload_size)
-            self._buckets[bucket_time_ns].pathway_stats[aggr_key] = stats
+            self._buckets[bucket_time_ns].pathway_stats[aggr_key].add(
+                edge_latency_sec, full_pathway_latency_sec, payload_size
+            )
 
     def track_kafka_produce(self, topic, partition, offset, now_sec):
         now_ns = int(now_sec * 1e9)
@@ -198,8 +182,8 @@ class DataStreamsProcessor(PeriodicService):
                     "EdgeTags": [compat.ensure_text(tag) for tag in edge_tags.split(",")],
                     "Hash": hash_value,
                     "ParentHash": parent_hash,
-                    "PathwayLatency": DDSketchProto.to_proto(stat_aggr.full_pathway_latency).SerializeToString(),
-                    "EdgeLatency": DDSketchProto.to_proto(stat_aggr.edge_latency).SerializeToString(),
+                    "PathwayLatency": stat_aggr.full_pathway_latency.to_proto(),
+                    "EdgeLatency": stat_aggr.edge_latency.to_proto(),
                 }
                 bucket_aggr_stats.append(serialized_bucket)
             for consumer_key, offset in bucket.latest_commit_offsets.items():
@@ -304,10 +288,7 @@ class DataStreamsProcessor(PeriodicService):
     def decode_pathway(self, data):
         # type: (bytes) -> DataStreamsCtx
         try:
-            hash_value = struct.unpack("<Q", data[:8])[0]
-            data = data[8:]
-            pathway_start_ms, data = decode_var_int_64(data)
-            current_edge_start_ms, data = decode_var_int_64(data)
+            hash_value, pathway_start_ms, current_edge_start_ms = decode_pathway_ctx(data)
             ctx = DataStreamsCtx(self, hash_value, float(pathway_start_ms) / 1e3, float(current_edge_start_ms) / 1e3)
             # reset context of current thread every time we decode
             self._current_context.value = ctx
@@ -380,11 +361,7 @@ class DataStreamsCtx:
 
     def encode(self):
         # type: () -> bytes
-        return (
-            struct.pack("<Q", self.hash)
-            + encode_var_int_64(int(self.pathway_start_sec * 1e3))
-            + encode_var_int_64(int(self.current_edge_start_sec * 1e3))
-        )
+        return encode_pathway_ctx(self.hash, int(self.pathway_start_sec * 1e3), int(self.current_edge_start_sec * 1e3))
 
     def encode_b64(self):
         # type: () -> str
@@ -394,14 +371,7 @@ class DataStreamsCtx:
         return data_streams_context
 
     def _compute_hash(self, tags, parent_hash):
-        def get_bytes(s):
-            return bytes(s, encoding="utf-8")
-
-        b = get_bytes(self.service) + get_bytes(self.env)
-        for t in tags:
-            b += get_bytes(t)
-        node_hash = fnv1_64(b)
-        return fnv1_64(struct.pack("<Q", node_hash) + struct.pack("<Q", parent_hash))
+        return compute_pathway_hash(self.service, self.env, tags, parent_hash)
 
     def set_checkpoint(
         self,
@@ -1,12 +1,207 @@
+from threading import RLock
+import time
+from typing import Dict
 from typing import List
 from typing import Optional
+from typing import Tuple
+from typing import Union
+import weakref
 
+from ddtrace.internal import forksafe
+from ddtrace.internal import periodic
 from ddtrace.internal.compat import parse
 from ddtrace.vendor.dogstatsd import DogStatsd
 from ddtrace.vendor.dogstatsd import base
 
 
-def get_dogstatsd_client(url: str, namespace: Optional[str] = None, tags: Optional[List[str]] = None) -> DogStatsd:
+try:
+    from ddtrace.internal._dogstatsd import send_datagrams
+except ImportError:
+    # Only built on Linux, the payloads are then sent one by one
+    send_datagrams = None
+
+
+# Seconds during which the counters and gauges are aggregated before being sent
+AGGREGATION_INTERVAL = 2.0
+
+_MetricKey = Tuple[str, Tuple[str, ...]]
+_Number = Union[int, float]
+
+
+class AggregatingDogStatsd(DogStatsd):
+    """DogStatsD client aggregating its metrics before sending them.
+
+    The counters are summed up and the gauges keep their last value until the
+    next flush, when they are sent along with the other metrics packed into as
+    few datagrams as the maximum payload size allows, which are all handed to
+    the kernel at once where it is possible. The clients are flushed every
+    AGGREGATION_INTERVAL seconds, at exit, and when leaving a
+    ``with client:`` block.
+    """
+
+    def __init__(self, *args, **kwargs):
+        # The vendored buffering is handled here, without its flush thread
+        super(AggregatingDogStatsd, self).__init__(*args, disable_buffering=True, **kwargs)
+        self._send = self._send_to_buffer
+        self._counters = {}  # type: Dict[_MetricKey, _Number]
+        self._gauges = {}  # type: Dict[_MetricKey, _Number]
+        self._scheduled = False
+
+    def open_buffer(self, max_buffer_size=None):
+        # The metrics sent so far are all buffered already, and must not be
+        # discarded like the vendored client does
+        self._buffering_toggle_lock.acquire()
+
+    def close_buffer(self):
+        try:
+            self.flush()
+        finally:
+            self._buffering_toggle_lock.release()
+
+    def _send_to_buffer(self, packet):
+        if not self._scheduled:
+            _Flusher.schedule(self)
+        super(AggregatingDogStatsd, self)._send_to_buffer(packet)
+
+    def _report(self, metric, metric_type, value, tags, sample_rate):
+        if sample_rate is None:
+            sample_rate = self.default_sample_rate
+
+        # Sampled metrics are sent with their rate for the agent to scale them
+        if metric_type not in ("c", "g") or sample_rate != 1 or value is None or self._enabled is not True:
+            return super(AggregatingDogStatsd, self)._report(metric, metric_type, value, tags, sample_rate)
+
+        if not self._scheduled:
+            _Flusher.schedule(self)
+
+        if self._telemetry:
+            self.metrics_count += 1
+
+        key = (metric, tuple(tags) if tags else ())
+        with self._buffer_lock:
+            if metric_type == "c":
+                self._counters[key] = self._counters.get(key, 0) + value
+            else:
+                self._gauges[key] = value
+
+    def _after_fork(self):
+        # type: () -> None
+        # The lock may have been held by another thread of the parent
+        self._buffer_lock = RLock()
+        self._counters = {}
+        self._gauges = {}
+        self._reset_buffer()
+        self._scheduled = False
+
+    def flush(self):
+        # type: () -> None
+        with self._buffer_lock:
+            packets = self._buffer
+            counters, self._counters = self._counters, {}
+            gauges, self._gauges = self._gauges, {}
+            self._reset_buffer()
+
+        for metric_type, aggregates in (("c", counters), ("g", gauges)):
+            for (metric, tags), value in aggregates.items():
+                packets.append(
+                    self._serialize_metric(metric, metric_type, value, self._add_constant_tags(list(tags) or None))
+                )
+
+        if packets:
+            self._send_payloads(self._pack(packets))
+
+    def _pack(self, packets):
+        # type: (List[str]) -> List[str]
+        """Join the packets into payloads of at most the maximum payload size, but for the packets larger than it."""
+        payloads = []
+        payload = []  # type: List[str]
+        size = 0
+        for packet in packets:
+            if payload and size + len(packet) + 1 > self._max_payload_size:
+                payloads.append("\n".join(payload))
+                payload = []
+                size = 0
+            payload.append(packet)
+            size += len(packet) + 1
+        if payload:
+            payloads.append("\n".join(payload))
+        return payloads
+
+    def _send_payloads(self, payloads):
+        # type: (List[str]) -> None
+        sent = 0
+        if send_datagrams is not None and self._queue is None:
+            datagrams = [(payload + "\n").encode(self.encoding) for payload in payloads]
+            try:
+                sent = send_datagrams((self.socket or self.get_socket()).fileno(), datagrams)
+            except Exception:
+                # Sending them one by one handles and reports the errors
+                sent = 0
+            if sent and self._telemetry:
+                self.packets_sent += sent
+                self.bytes_sent += sum(len(datagram) for datagram in datagrams[:sent])
+
+        for payload in payloads[sent:-1]:
+            self._send_to_server(payload)
+        if sent < len(payloads):
+            # Sent last to report the telemetry of the client when it's due, like the vendored client does
+            self._send_to_server(payloads[-1])
+        elif self._is_telemetry_flush_time():
+            self._xmit_telemetry()
+
+    def _xmit_telemetry(self):
+        # type: () -> None
+        telemetry = self._flush_telemetry()
+        if self._xmit_packet(telemetry, True):
+            self._reset_telemetry()
+            self.packets_sent += 1
+            self.bytes_sent += len(telemetry)
+        else:
+            # Kept for the next flush
+            self._last_flush_time = time.time()
+            self.bytes_dropped_writer += len(telemetry)
+            self.packets_dropped_writer += 1
+
+
+class _Flusher(periodic.PeriodicService):
+    """Flushes the aggregating clients periodically, from a single thread."""
+
+    _instance = None  # type: Optional[_Flusher]
+    _lock = forksafe.Lock()
+    _clients = weakref.WeakSet()  # type: weakref.WeakSet[AggregatingDogStatsd]
+
+    @classmethod
+    def schedule(cls, client):
+        # type: (AggregatingDogStatsd) -> None
+        with cls._lock:
+            client._scheduled = True
+            cls._clients.add(client)
+            if cls._instance is None:
+                cls._instance = cls(AGGREGATION_INTERVAL)
+                cls._instance.start()
+
+    def periodic(self):
+        # type: () -> None
+        for client in list(self._clients):
+            client.flush()
+
+    on_shutdown = periodic
+
+
+@forksafe.register
+def _reset_after_fork():
+    # type: () -> None
+    # The parent sends the metrics aggregated so far, and no thread flushes the
+    # clients in the child until they aggregate metrics again
+    _Flusher._instance = None
+    for client in list(_Flusher._clients):
+        client._after_fork()
+    _Flusher._clients = weakref.WeakSet()
+
+
+def get_dogstatsd_client(
+    url: str, namespace: Optional[str] = None, tags: Optional[List[str]] = None
+) -> AggregatingDogStatsd:
     # url can be either of the form `udp://<host>:<port>` or `unix://<path>`
     # also support without url scheme included
     if url.startswith("/"):
@@ -17,9 +212,9 @@ def get_dogstatsd_client(url: str, namespace: Optional[str] = None, tags: Option
     parsed = parse.urlparse(url)
 
     if parsed.scheme == "unix":
-        return DogStatsd(socket_path=parsed.path, namespace=namespace, constant_tags=tags)
+        return AggregatingDogStatsd(socket_path=parsed.path, namespace=namespace, constant_tags=tags)
     elif parsed.scheme == "udp":
-        return DogStatsd(
+        return AggregatingDogStatsd(
             host=parsed.hostname or "",
             port=base.DEFAULT_PORT if parsed.port is None else parsed.port,
             namespace=namespace,
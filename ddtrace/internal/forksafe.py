@@ -16,6 +16,8 @@ log = logging.getLogger(__name__)
 
 _registry = []  # type: typing.List[typing.Callable[[], None]]
 _registry_before_fork = []  # type: typing.List[typing.Callable[[], None]]
+# Run in the child once all the hooks of _registry have run
+_registry_after_hooks = []  # type: typing.List[typing.Callable[[], None]]
 
 # Some integrations might require after-fork hooks to be executed after the
 # actual call to os.fork with earlier versions of Python (<= 3.6), else issues
@@ -49,7 +51,12 @@ def run_hooks(registry):
 
 
 ddtrace_before_fork = functools.partial(run_hooks, _registry_before_fork)
-ddtrace_after_in_child = functools.partial(run_hooks, _registry)
+
+
+def ddtrace_after_in_child():
+    # type: () -> None
+    run_hooks(_registry)
+    run_hooks(_registry_after_hooks)
 
 
 def register_hook(registry, hook):
@@ -59,6 +66,7 @@ def register_hook(registry, hook):
 
 register_before_fork = functools.partial(register_hook, _registry_before_fork)
 register = functools.partial(register_hook, _registry)
+register_after_hooks = functools.partial(register_hook, _registry_after_hooks)
 
 
 def unregister(after_in_child):
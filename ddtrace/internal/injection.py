@@ -13,6 +13,13 @@ from ddtrace.internal.assembly import Assembly
 from .compat import PYTHON_VERSION_INFO as PY
 
 
+try:
+    # The native injection fixes up the jumps and the line and exception tables
+    # of the code objects itself, for the versions of CPython it supports.
+    from ddtrace.internal import _injection
+except ImportError:
+    _injection = None  # type: ignore[assignment]
+
 HookType = Callable[[Any], Any]
 HookInfoType = Tuple[HookType, int, Any]
 
@@ -142,6 +149,12 @@ def inject_hooks(f: FunctionType, hooks: List[HookInfoType]) -> List[HookInfoTyp
 
     Returns the list of hooks that failed to be injected.
     """
+    if _injection is not None:
+        code, failed = _injection.inject_hooks(f.__code__, hooks)
+        if len(failed) < len(hooks):
+            f.__code__ = code
+        return failed
+
     abstract_code = Bytecode.from_code(f.__code__)
 
     failed = []
@@ -165,6 +178,12 @@ def eject_hooks(f: FunctionType, hooks: List[HookInfoType]) -> List[HookInfoType
 
     Returns the list of hooks that failed to be ejected.
     """
+    if _injection is not None:
+        code, failed = _injection.eject_hooks(f.__code__, hooks)
+        if len(failed) < len(hooks):
+            f.__code__ = code
+        return failed
+
     abstract_code = Bytecode.from_code(f.__code__)
 
     failed = []
@@ -187,6 +206,13 @@ def inject_hook(f: FunctionType, hook: HookType, line: int, arg: Any) -> Functio
     argument. The latter is also used as an identifier for the hook. This should
     be kept in case the hook needs to be removed.
     """
+    if _injection is not None:
+        code, failed = _injection.inject_hooks(f.__code__, [(hook, line, arg)])
+        if failed:
+            raise InvalidLine("Line %d does not exist or is either blank or a comment" % line)
+        f.__code__ = code
+        return f
+
     abstract_code = Bytecode.from_code(f.__code__)
 
     _inject_hook(abstract_code, hook, line, arg)
@@ -202,6 +228,13 @@ def eject_hook(f: FunctionType, hook: HookType, line: int, arg: Any) -> Function
     The hook is identified by its line number and the argument passed to the
     hook.
     """
+    if _injection is not None:
+        code, failed = _injection.eject_hooks(f.__code__, [(hook, line, arg)])
+        if failed:
+            raise InvalidLine("Line %d does not contain a hook" % line)
+        f.__code__ = code
+        return f
+
     abstract_code = Bytecode.from_code(f.__code__)
 
     _eject_hook(abstract_code, hook, line, arg)
@@ -35,34 +35,140 @@ typedef struct msgpack_packer
 
 typedef struct Packer Packer;
 
-static inline int
-msgpack_pack_write(msgpack_packer* pk, const char* data, size_t l)
+// Make room for l more bytes and return where to write them, or NULL when out of memory
+static inline char*
+msgpack_pack_reserve(msgpack_packer* pk, size_t l)
 {
-    char* buf = pk->buf;
     size_t bs = pk->buf_size;
     size_t len = pk->length;
 
     if (len + l > bs) {
-        bs = (len + l) * 2;
-        buf = (char*)PyMem_Realloc(buf, bs);
+        // Doubling keeps the buffers allocated with a power of two size in the size classes of the encoders pool
+        do {
+            bs = bs ? bs * 2 : 1;
+        } while (bs < len + l);
+        char* buf = (char*)PyMem_Realloc(pk->buf, bs);
         if (!buf) {
             PyErr_NoMemory();
-            return -1;
+            return NULL;
         }
+        pk->buf = buf;
+        pk->buf_size = bs;
     }
-    memcpy(buf + len, data, l);
-    len += l;
+    return pk->buf + len;
+}
+
+static inline int
+msgpack_pack_write(msgpack_packer* pk, const char* data, size_t l)
+{
+    char* dst = msgpack_pack_reserve(pk, l);
+    if (!dst)
+        return -1;
 
-    pk->buf = buf;
-    pk->buf_size = bs;
-    pk->length = len;
+    memcpy(dst, data, l);
+    pk->length += l;
     return 0;
 }
 
 #define msgpack_pack_append_buffer(user, buf, len) return msgpack_pack_write(user, (const char*)buf, len)
 
+// Write a number at the end of the buffer with one of the msgpack_put_*() functions of pack_template.h
+#define msgpack_pack_put_number(user, put, d)                                                                          \
+    do {                                                                                                               \
+        char* dst = msgpack_pack_reserve(user, MSGPACK_MAX_NUMBER_SIZE);                                               \
+        if (!dst)                                                                                                      \
+            return -1;                                                                                                 \
+        user->length += put(dst, d) - dst;                                                                             \
+        return 0;                                                                                                      \
+    } while (0)
+
 #include "pack_template.h"
 
+#if PY_MAJOR_VERSION >= 3
+#define MSGPACK_HIGH_BITS 0x8080808080808080ULL
+#define MSGPACK_LOW_BITS 0x0101010101010101ULL
+
+// Number of bytes of s with their high bit set, which take two bytes once encoded to UTF-8
+static inline size_t
+msgpack_ucs1_count_high(const Py_UCS1* s, size_t n)
+{
+    size_t count = 0;
+    size_t i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        uint64_t w;
+        memcpy(&w, s + i, 8);
+        // Sum the high bits of the 8 bytes into the top byte
+        count += (size_t)((((w & MSGPACK_HIGH_BITS) >> 7) * MSGPACK_LOW_BITS) >> 56);
+    }
+    for (; i < n; i++) {
+        count += s[i] >> 7;
+    }
+    return count;
+}
+
+static inline void
+msgpack_ucs1_to_utf8(const Py_UCS1* s, size_t n, char* dst)
+{
+    size_t i = 0;
+
+    while (i < n) {
+        // Copy the runs of ASCII characters 8 bytes at a time
+        if (i + 8 <= n) {
+            uint64_t w;
+            memcpy(&w, s + i, 8);
+            if ((w & MSGPACK_HIGH_BITS) == 0) {
+                memcpy(dst, &w, 8);
+                dst += 8;
+                i += 8;
+                continue;
+            }
+        }
+        Py_UCS1 c = s[i++];
+        if (c < 0x80) {
+            *dst++ = (char)c;
+        } else {
+            *dst++ = (char)(0xc0 | (c >> 6));
+            *dst++ = (char)(0x80 | (c & 0x3f));
+        }
+    }
+}
+
+// Length of s once encoded to UTF-8, or -1 when s holds a surrogate, which UTF-8 can't encode
+static inline Py_ssize_t
+msgpack_ucs2_utf8_length(const Py_UCS2* s, size_t n)
+{
+    size_t len = n;
+    unsigned int surrogates = 0;
+
+    // Branchless, so that the compiler can vectorize the loop
+    for (size_t i = 0; i < n; i++) {
+        Py_UCS2 c = s[i];
+        len += (c >= 0x80) + (c >= 0x800);
+        surrogates |= (Py_UCS2)(c - 0xd800) < 0x800;
+    }
+    return surrogates ? -1 : (Py_ssize_t)len;
+}
+
+static inline void
+msgpack_ucs2_to_utf8(const Py_UCS2* s, size_t n, char* dst)
+{
+    for (size_t i = 0; i < n; i++) {
+        Py_UCS2 c = s[i];
+        if (c < 0x80) {
+            *dst++ = (char)c;
+        } else if (c < 0x800) {
+            *dst++ = (char)(0xc0 | (c >> 6));
+            *dst++ = (char)(0x80 | (c & 0x3f));
+        } else {
+            *dst++ = (char)(0xe0 | (c >> 12));
+            *dst++ = (char)(0x80 | ((c >> 6) & 0x3f));
+            *dst++ = (char)(0x80 | (c & 0x3f));
+        }
+    }
+}
+#endif
+
 // return -2 when o is too long
 static inline int
 msgpack_pack_unicode(msgpack_packer* pk, PyObject* o, long long limit)
@@ -71,9 +177,56 @@ msgpack_pack_unicode(msgpack_packer* pk, PyObject* o, long long limit)
     assert(PyUnicode_Check(o));
 
     Py_ssize_t len;
-    const char* buf = PyUnicode_AsUTF8AndSize(o, &len);
-    if (buf == NULL)
+    const char* buf;
+
+#if PY_VERSION_HEX < 0x030C0000
+    if (PyUnicode_READY(o) == -1)
         return -1;
+#endif
+
+    const Py_ssize_t n = PyUnicode_GET_LENGTH(o);
+    const int kind = PyUnicode_KIND(o);
+
+    if (PyUnicode_IS_COMPACT_ASCII(o)) {
+        // The characters are their own UTF-8 encoding
+        buf = (const char*)PyUnicode_DATA(o);
+        len = n;
+    } else {
+        len = -1;
+        if (kind == PyUnicode_1BYTE_KIND) {
+            len = n + (Py_ssize_t)msgpack_ucs1_count_high(PyUnicode_1BYTE_DATA(o), (size_t)n);
+        } else if (kind == PyUnicode_2BYTE_KIND) {
+            len = msgpack_ucs2_utf8_length(PyUnicode_2BYTE_DATA(o), (size_t)n);
+        }
+
+        if (len >= 0) {
+            // Encode the characters straight into the buffer rather than creating the UTF-8 cache of the string,
+            // which would stay with it after it was packed once.
+            if (len > limit) {
+                return -2;
+            }
+
+            int ret = msgpack_pack_raw(pk, len);
+            if (ret)
+                return ret;
+
+            char* dst = msgpack_pack_reserve(pk, (size_t)len);
+            if (!dst)
+                return -1;
+            if (kind == PyUnicode_1BYTE_KIND) {
+                msgpack_ucs1_to_utf8(PyUnicode_1BYTE_DATA(o), (size_t)n, dst);
+            } else {
+                msgpack_ucs2_to_utf8(PyUnicode_2BYTE_DATA(o), (size_t)n, dst);
+            }
+            pk->length += (size_t)len;
+            return 0;
+        }
+
+        // Characters outside of the BMP, or surrogates for the codec to raise its error on
+        buf = PyUnicode_AsUTF8AndSize(o, &len);
+        if (buf == NULL)
+            return -1;
+    }
 
     if (len > limit) {
         return -2;
@@ -32,6 +32,95 @@
 #error msgpack_pack_append_buffer callback is not defined
 #endif
 
+#ifndef msgpack_pack_put_number
+#error msgpack_pack_put_number callback is not defined
+#endif
+
+/*
+ * Numbers written straight to a buffer with room for MSGPACK_MAX_NUMBER_SIZE bytes, returning where the next value
+ * goes. Their format is picked from their bit length rather than by comparing them with each bound, so that a group
+ * of them, like the ids and the times of a span, can be written after reserving its worst case size once.
+ */
+
+#define MSGPACK_MAX_NUMBER_SIZE 9
+
+// Number of significant bits of d, which isn't 0
+static inline unsigned int
+msgpack_bit_length(uint64_t d)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return 64 - (unsigned int)__builtin_clzll(d);
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))
+    unsigned long index;
+    _BitScanReverse64(&index, d);
+    return (unsigned int)index + 1;
+#else
+    unsigned int bits = 0;
+    while (d) {
+        bits++;
+        d >>= 1;
+    }
+    return bits;
+#endif
+}
+
+// Write the header of the size class (1, 2, 4 or 8 bytes) and the low bytes of d in big endian
+static inline char*
+msgpack_put_sized(char* dst, unsigned char header, unsigned int size_class, uint64_t d)
+{
+    const unsigned int size = 1u << size_class;
+    // All the 8 bytes are written, the ones past the value are overwritten by the next one
+    const uint64_t be = _msgpack_be64(d << (64 - 8 * size));
+
+    dst[0] = (char)(header + size_class);
+    memcpy(dst + 1, &be, 8);
+    return dst + 1 + size;
+}
+
+static inline char*
+msgpack_put_uint64(char* dst, uint64_t d)
+{
+    if (d < (1ULL << 7)) {
+        /* fixnum */
+        dst[0] = (char)d;
+        return dst + 1;
+    }
+
+    /* unsigned 8, 16, 32 or 64 */
+    const unsigned int bits = msgpack_bit_length(d);
+    return msgpack_put_sized(dst, 0xcc, (bits > 8) + (bits > 16) + (bits > 32), d);
+}
+
+static inline char*
+msgpack_put_int64(char* dst, int64_t d)
+{
+    if (d >= 0)
+        return msgpack_put_uint64(dst, (uint64_t)d);
+
+    if (d >= -(1LL << 5)) {
+        /* fixnum */
+        dst[0] = (char)d;
+        return dst + 1;
+    }
+
+    /* signed 8, 16, 32 or 64, from the bits of the magnitude of d + 1 */
+    const unsigned int bits = msgpack_bit_length(~(uint64_t)d);
+    return msgpack_put_sized(dst, 0xd0, (bits > 7) + (bits > 15) + (bits > 31), (uint64_t)d);
+}
+
+// CPython requires IEEE 754 doubles, so their bits are copied as they are in big endian
+static inline char*
+msgpack_put_double(char* dst, double d)
+{
+    uint64_t bits;
+
+    memcpy(&bits, &d, 8);
+    bits = _msgpack_be64(bits);
+    dst[0] = (char)0xcb;
+    memcpy(dst + 1, &bits, 8);
+    return dst + 9;
+}
+
 /*
  * Integer
  */
@@ -96,36 +185,7 @@
 
 #define msgpack_pack_real_uint64(x, d)                                                                                 \
     do {                                                                                                               \
-        if (d < (1ULL << 8)) {                                                                                         \
-            if (d < (1ULL << 7)) {                                                                                     \
-                /* fixnum */                                                                                           \
-                msgpack_pack_append_buffer(x, &TAKE8_64(d), 1);                                                        \
-            } else {                                                                                                   \
-                /* unsigned 8 */                                                                                       \
-                unsigned char buf[2] = { 0xcc, TAKE8_64(d) };                                                          \
-                msgpack_pack_append_buffer(x, buf, 2);                                                                 \
-            }                                                                                                          \
-        } else {                                                                                                       \
-            if (d < (1ULL << 16)) {                                                                                    \
-                /* unsigned 16 */                                                                                      \
-                unsigned char buf[3];                                                                                  \
-                buf[0] = 0xcd;                                                                                         \
-                _msgpack_store16(&buf[1], (uint16_t)d);                                                                \
-                msgpack_pack_append_buffer(x, buf, 3);                                                                 \
-            } else if (d < (1ULL << 32)) {                                                                             \
-                /* unsigned 32 */                                                                                      \
-                unsigned char buf[5];                                                                                  \
-                buf[0] = 0xce;                                                                                         \
-                _msgpack_store32(&buf[1], (uint32_t)d);                                                                \
-                msgpack_pack_append_buffer(x, buf, 5);                                                                 \
-            } else {                                                                                                   \
-                /* unsigned 64 */                                                                                      \
-                unsigned char buf[9];                                                                                  \
-                buf[0] = 0xcf;                                                                                         \
-                _msgpack_store64(&buf[1], d);                                                                          \
-                msgpack_pack_append_buffer(x, buf, 9);                                                                 \
-            }                                                                                                          \
-        }                                                                                                              \
+        msgpack_pack_put_number(x, msgpack_put_uint64, d);                                                             \
     } while (0)
 
 #define msgpack_pack_real_int8(x, d)                                                                                   \
@@ -218,66 +278,7 @@
 
 #define msgpack_pack_real_int64(x, d)                                                                                  \
     do {                                                                                                               \
-        if (d < -(1LL << 5)) {                                                                                         \
-            if (d < -(1LL << 15)) {                                                                                    \
-                if (d < -(1LL << 31)) {                                                                                \
-                    /* signed 64 */                                                                                    \
-                    unsigned char buf[9];                                                                              \
-                    buf[0] = 0xd3;                                                                                     \
-                    _msgpack_store64(&buf[1], d);                                                                      \
-                    msgpack_pack_append_buffer(x, buf, 9);                                                             \
-                } else {                                                                                               \
-                    /* signed 32 */                                                                                    \
-                    unsigned char buf[5];                                                                              \
-                    buf[0] = 0xd2;                                                                                     \
-                    _msgpack_store32(&buf[1], (int32_t)d);                                                             \
-                    msgpack_pack_append_buffer(x, buf, 5);                                                             \
-                }                                                                                                      \
-            } else {                                                                                                   \
-                if (d < -(1 << 7)) {                                                                                   \
-                    /* signed 16 */                                                                                    \
-                    unsigned char buf[3];                                                                              \
-                    buf[0] = 0xd1;                                                                                     \
-                    _msgpack_store16(&buf[1], (int16_t)d);                                                             \
-                    msgpack_pack_append_buffer(x, buf, 3);                                                             \
-                } else {                                                                                               \
-                    /* signed 8 */                                                                                     \
-                    unsigned char buf[2] = { 0xd0, TAKE8_64(d) };                                                      \
-                    msgpack_pack_append_buffer(x, buf, 2);                                                             \
-                }                                                                                                      \
-            }                                                                                                          \
-        } else if (d < (1 << 7)) {                                                                                     \
-            /* fixnum */                                                                                               \
-            msgpack_pack_append_buffer(x, &TAKE8_64(d), 1);                                                            \
-        } else {                                                                                                       \
-            if (d < (1LL << 16)) {                                                                                     \
-                if (d < (1 << 8)) {                                                                                    \
-                    /* unsigned 8 */                                                                                   \
-                    unsigned char buf[2] = { 0xcc, TAKE8_64(d) };                                                      \
-                    msgpack_pack_append_buffer(x, buf, 2);                                                             \
-                } else {                                                                                               \
-                    /* unsigned 16 */                                                                                  \
-                    unsigned char buf[3];                                                                              \
-                    buf[0] = 0xcd;                                                                                     \
-                    _msgpack_store16(&buf[1], (uint16_t)d);                                                            \
-                    msgpack_pack_append_buffer(x, buf, 3);                                                             \
-                }                                                                                                      \
-            } else {                                                                                                   \
-                if (d < (1LL << 32)) {                                                                                 \
-                    /* unsigned 32 */                                                                                  \
-                    unsigned char buf[5];                                                                              \
-                    buf[0] = 0xce;                                                                                     \
-                    _msgpack_store32(&buf[1], (uint32_t)d);                                                            \
-                    msgpack_pack_append_buffer(x, buf, 5);                                                             \
-                } else {                                                                                               \
-                    /* unsigned 64 */                                                                                  \
-                    unsigned char buf[9];                                                                              \
-                    buf[0] = 0xcf;                                                                                     \
-                    _msgpack_store64(&buf[1], d);                                                                      \
-                    msgpack_pack_append_buffer(x, buf, 9);                                                             \
-                }                                                                                                      \
-            }                                                                                                          \
-        }                                                                                                              \
+        msgpack_pack_put_number(x, msgpack_put_int64, d);                                                              \
     } while (0)
 
 static inline int
@@ -587,15 +588,7 @@ msgpack_pack_unsigned_long_long(msgpack_packer* x, unsigned long long d)
 static inline int
 msgpack_pack_double(msgpack_packer* x, double d)
 {
-    unsigned char buf[9];
-    buf[0] = 0xcb;
-// Python 3.11 introduced PyFloat_Pack8() to the public C API and moved _PyFloat_Pack8() to the internal C API
-#if PY_VERSION_HEX <= 0x030B0000
-    _PyFloat_Pack8(d, &buf[1], 0);
-#else
-    PyFloat_Pack8(d, &buf[1], 0);
-#endif
-    msgpack_pack_append_buffer(x, buf, 9);
+    msgpack_pack_put_number(x, msgpack_put_double, d);
 }
 
 /*
@@ -677,6 +670,15 @@ msgpack_pack_map(msgpack_packer* x, unsigned int n)
  * Raw
  */
 
+// Write a string shorter than 32 bytes and its header, like the keys of the span maps, to a buffer with room for them
+static inline char*
+msgpack_put_fixstr(char* dst, const char* b, size_t l)
+{
+    dst[0] = (char)(0xa0 | (uint8_t)l);
+    memcpy(dst + 1, b, l);
+    return dst + 1 + l;
+}
+
 static inline int
 msgpack_pack_raw(msgpack_packer* x, size_t l)
 {
@@ -728,6 +730,7 @@ msgpack_pack_raw_body(msgpack_packer* x, const void* b, size_t l)
 }
 
 #undef msgpack_pack_append_buffer
+#undef msgpack_pack_put_number
 
 #undef TAKE8_8
 #undef TAKE8_16
@@ -1,13 +1,27 @@
 # -*- encoding: utf-8 -*-
 import atexit
+import os
 import typing  # noqa:F401
 
 import attr
 
 from ddtrace.internal import forksafe
 from ddtrace.internal import service
+from ddtrace.internal._threads import PeriodicScheduler  # noqa:F401
 from ddtrace.internal._threads import PeriodicThread
+from ddtrace.internal._threads import begin_deferred_starts
+from ddtrace.internal._threads import end_deferred_starts
 from ddtrace.internal._threads import periodic_threads
+from ddtrace.internal.utils.formats import asbool
+
+
+# Run the periodic services from a single native thread rather than from one
+# thread each.
+SHARED_THREADS = asbool(os.getenv("DD_PERIODIC_THREADS_SHARED", default=False))
+
+# Let the periodic services run up to this many seconds late, so that their
+# wakeups are grouped together.
+WAKEUP_TOLERANCE = float(os.getenv("DD_PERIODIC_THREADS_WAKEUP_TOLERANCE", default=0.0))
 
 
 @atexit.register
@@ -29,6 +43,13 @@ def _():
         thread._after_fork()
     periodic_threads.clear()
 
+    # The services restarted by the other hooks get their threads launched
+    # together once the hooks are done, rather than one after the other.
+    begin_deferred_starts()
+
+
+forksafe.register_after_hooks(end_deferred_starts)
+
 
 @attr.s(eq=False)
 class PeriodicService(service.Service):
@@ -61,6 +82,8 @@ class PeriodicService(service.Service):
             target=self.periodic,
             name="%s:%s" % (self.__class__.__module__, self.__class__.__name__),
             on_shutdown=self.on_shutdown,
+            shared=SHARED_THREADS,
+            tolerance=WAKEUP_TOLERANCE,
         )
         self._worker.start()
 
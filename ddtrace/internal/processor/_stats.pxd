@@ -0,0 +1,25 @@
+from libc.stdint cimport int64_t
+
+
+cdef struct _Store:
+    # Dense counts of the keys from offset to offset + length - 1
+    double* bins
+    Py_ssize_t length
+    int64_t offset
+    # Range of the keys added, only valid once there are bins
+    int64_t min_key
+    int64_t max_key
+    double count
+    bint collapsed
+    # Whether the highest bins are collapsed rather than the lowest ones, for the negative values
+    bint collapse_highest
+
+
+cdef class DDSketch(object):
+    cdef _Store _positive
+    cdef _Store _negative
+    cdef double _zero_count
+
+    cpdef add(self, double value)
+    cdef size_t _proto_size(self)
+    cdef char* _write_proto(self, char* buf)
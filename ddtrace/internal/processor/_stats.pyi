@@ -0,0 +1,17 @@
+from typing import Optional
+
+from ddtrace._trace.span import Span
+
+class DDSketch(object):
+    @property
+    def count(self) -> float: ...
+    def add(self, value: float) -> None: ...
+    def get_quantile_value(self, quantile: float) -> Optional[float]: ...
+    def to_proto(self) -> bytes: ...
+
+class SpanStatsConcentrator(object):
+    bucket_size_ns: int
+    def __init__(self, bucket_size_ns: int) -> None: ...
+    def __len__(self) -> int: ...
+    def add_span(self, span: Span, is_top_level: bool) -> None: ...
+    def flush(self, hostname: str, env: Optional[str], version: Optional[str]) -> Optional[bytes]: ...
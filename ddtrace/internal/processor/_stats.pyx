@@ -0,0 +1,557 @@
+"""
+Native aggregation of the span stats computed by the tracer.
+
+The spans are aggregated by the end of their bucket of time and by a key made of
+their primary and secondary attributes, which identifies similar spans as best as
+possible::
+
+    (name, service, resource, type, http status code, synthetics request)
+
+The distributions of the durations are DDSketches with the same logarithmic
+mapping and the same collapsing dense stores as ``LogCollapsingLowestDenseDDSketch``
+of the ``ddsketch`` package, so that they give the same protobuf message, and the
+payload of the stats is packed directly from the aggregated stats.
+"""
+from cpython.bytes cimport PyBytes_FromStringAndSize
+from cpython.mem cimport PyMem_Free
+from cpython.mem cimport PyMem_Malloc
+from cpython.mem cimport PyMem_Realloc
+from libc.math cimport ceil
+from libc.math cimport log
+from libc.math cimport log1p
+from libc.math cimport pow
+from libc.stdint cimport int32_t
+from libc.stdint cimport int64_t
+from libc.stdint cimport uint32_t
+from libc.stdint cimport uint64_t
+from libc.string cimport memcpy
+from libc.string cimport memmove
+from libc.string cimport memset
+
+from ddtrace.internal.compat import ensure_text
+
+
+cdef extern from "float.h":
+    double DBL_MIN
+
+
+cdef extern from "pack.h":
+    struct msgpack_packer:
+        char* buf
+        size_t length
+        size_t buf_size
+
+    # All of them fail with -1 and an exception set when out of memory
+    char* msgpack_pack_reserve(msgpack_packer* pk, size_t l) except NULL
+    int msgpack_pack_long_long(msgpack_packer* pk, long long d) except -1
+    int msgpack_pack_unsigned_long_long(msgpack_packer* pk, unsigned long long d) except -1
+    int msgpack_pack_array(msgpack_packer* pk, size_t l) except -1
+    int msgpack_pack_map(msgpack_packer* pk, size_t l) except -1
+    int msgpack_pack_bin(msgpack_packer* pk, size_t l) except -1
+    # Also fails with -2 and no exception set when the string is too large
+    int msgpack_pack_unicode(msgpack_packer* pk, object o, long long limit) except? -1
+    int msgpack_pack_true(msgpack_packer* pk) except -1
+    int msgpack_pack_false(msgpack_packer* pk) except -1
+
+
+# Match the relative accuracy of the sketch implementation used in the backend, which is 0.775%
+DEF RELATIVE_ACCURACY = 0.00775
+# Number of bins of a store, above which its lowest (or highest) bins are collapsed
+DEF BIN_LIMIT = 2048
+# Number of bins the stores grow by
+DEF CHUNK_SIZE = 128
+DEF PAYLOAD_BUFFER_SIZE = 64*1024
+
+cdef long long ITEM_LIMIT = (2**32)-1
+
+cdef double _GAMMA_MANTISSA = 2 * RELATIVE_ACCURACY / (1 - RELATIVE_ACCURACY)
+cdef double _GAMMA = 1 + _GAMMA_MANTISSA
+cdef double _MULTIPLIER = (1 / log1p(_GAMMA_MANTISSA)) * log(2.0)
+cdef double _LOG_2 = log(2.0)
+# Values with a lower magnitude are counted as zeros
+cdef double _MIN_POSSIBLE = DBL_MIN * _GAMMA
+
+
+cdef inline int64_t _key(double value):
+    return <int64_t>ceil(log(value) / _LOG_2 * _MULTIPLIER)
+
+
+cdef inline double _value(int64_t key):
+    # The middle of the bin of the key, in terms of relative error
+    return pow(2.0, key / _MULTIPLIER) * (2.0 / (1 + _GAMMA))
+
+
+cdef int _store_resize(_Store* store, Py_ssize_t length) except -1:
+    """Change the number of bins, the new ones are zeros"""
+    cdef double* bins = <double*>PyMem_Realloc(store.bins, length * sizeof(double))
+    if bins == NULL:
+        raise MemoryError()
+    if length > store.length:
+        memset(bins + store.length, 0, (length - store.length) * sizeof(double))
+    store.bins = bins
+    store.length = length
+    return 0
+
+
+cdef int _store_shift_bins(_Store* store, Py_ssize_t shift) except -1:
+    """Move the bins by ``shift`` to the right (or to the left when negative), which may only add bins"""
+    cdef Py_ssize_t size = shift if shift > 0 else -shift
+    cdef Py_ssize_t kept = store.length - size if store.length > size else 0
+
+    if size > store.length:
+        _store_resize(store, size)
+    if shift > 0:
+        memmove(store.bins + shift, store.bins, kept * sizeof(double))
+        memset(store.bins, 0, shift * sizeof(double))
+    elif shift < 0:
+        memmove(store.bins, store.bins + size, kept * sizeof(double))
+        memset(store.bins + kept, 0, (store.length - kept) * sizeof(double))
+    store.offset -= shift
+    return 0
+
+
+cdef int _store_center_bins(_Store* store, int64_t new_min_key, int64_t new_max_key) except -1:
+    cdef int64_t middle_key = new_min_key + (new_max_key - new_min_key + 1) // 2
+    _store_shift_bins(store, <Py_ssize_t>(store.offset + store.length // 2 - middle_key))
+    store.min_key = new_min_key
+    store.max_key = new_max_key
+    return 0
+
+
+cdef inline Py_ssize_t _store_new_length(int64_t new_min_key, int64_t new_max_key):
+    cdef int64_t desired_length = new_max_key - new_min_key + 1
+    cdef int64_t length = (desired_length + CHUNK_SIZE - 1) // CHUNK_SIZE * CHUNK_SIZE
+    return <Py_ssize_t>(length if length < BIN_LIMIT else BIN_LIMIT)
+
+
+cdef inline double _store_sum(_Store* store, Py_ssize_t start, Py_ssize_t end):
+    cdef double total = 0.0
+    cdef Py_ssize_t i
+
+    for i in range(start, end):
+        total += store.bins[i]
+        store.bins[i] = 0.0
+    return total
+
+
+cdef int _store_adjust(_Store* store, int64_t new_min_key, int64_t new_max_key) except -1:
+    """Fit the range of keys in the bins, collapsing the bins of the keys which don't fit"""
+    cdef int64_t shift
+
+    if new_max_key - new_min_key + 1 <= store.length:
+        return _store_center_bins(store, new_min_key, new_max_key)
+
+    if not store.collapse_highest:
+        new_min_key = new_max_key - store.length + 1
+        if new_min_key >= store.max_key:
+            # Everything ends up in the first bin
+            store.offset = new_min_key
+            store.min_key = new_min_key
+            memset(store.bins, 0, store.length * sizeof(double))
+            store.bins[0] = store.count
+        else:
+            shift = store.offset - new_min_key
+            if shift < 0:
+                store.bins[new_min_key - store.offset] += _store_sum(
+                    store, store.min_key - store.offset, new_min_key - store.offset
+                )
+            store.min_key = new_min_key
+            _store_shift_bins(store, <Py_ssize_t>shift)
+        store.max_key = new_max_key
+    else:
+        new_max_key = new_min_key + store.length - 1
+        if new_max_key <= store.min_key:
+            # Everything ends up in the last bin
+            store.offset = new_min_key
+            store.max_key = new_max_key
+            memset(store.bins, 0, store.length * sizeof(double))
+            store.bins[store.length - 1] = store.count
+        else:
+            shift = store.offset - new_min_key
+            if shift > 0:
+                store.bins[new_max_key - store.offset] += _store_sum(
+                    store, new_max_key - store.offset + 1, store.max_key - store.offset + 1
+                )
+            store.max_key = new_max_key
+            _store_shift_bins(store, <Py_ssize_t>shift)
+        store.min_key = new_min_key
+    store.collapsed = True
+    return 0
+
+
+cdef int _store_extend_range(_Store* store, int64_t key) except -1:
+    cdef int64_t new_min_key
+    cdef int64_t new_max_key
+    cdef Py_ssize_t new_length
+
+    if store.length == 0:
+        _store_resize(store, _store_new_length(key, key))
+        store.offset = key
+        return _store_adjust(store, key, key)
+
+    new_min_key = key if key < store.min_key else store.min_key
+    new_max_key = key if key > store.max_key else store.max_key
+    if new_min_key >= store.min_key and new_max_key < store.offset + store.length:
+        store.min_key = new_min_key
+        store.max_key = new_max_key
+        return 0
+
+    new_length = _store_new_length(new_min_key, new_max_key)
+    if new_length > store.length:
+        _store_resize(store, new_length)
+    return _store_adjust(store, new_min_key, new_max_key)
+
+
+cdef Py_ssize_t _store_index(_Store* store, int64_t key) except -1:
+    cdef bint empty = store.length == 0
+
+    if not store.collapse_highest:
+        if empty or key < store.min_key:
+            if store.collapsed:
+                return 0
+            _store_extend_range(store, key)
+            if store.collapsed:
+                return 0
+        elif key > store.max_key:
+            _store_extend_range(store, key)
+    else:
+        if empty or key > store.max_key:
+            if store.collapsed:
+                return store.length - 1
+            _store_extend_range(store, key)
+            if store.collapsed:
+                return store.length - 1
+        elif key < store.min_key:
+            _store_extend_range(store, key)
+    return <Py_ssize_t>(key - store.offset)
+
+
+cdef int _store_add(_Store* store, int64_t key) except -1:
+    # Finding the index may reallocate the bins
+    cdef Py_ssize_t index = _store_index(store, key)
+
+    store.bins[index] += 1.0
+    store.count += 1.0
+    return 0
+
+
+cdef int64_t _store_key_at_rank(_Store* store, double rank, bint lower):
+    cdef double running_count = 0.0
+    cdef Py_ssize_t i
+
+    for i in range(store.length):
+        running_count += store.bins[i]
+        if (lower and running_count > rank) or (not lower and running_count >= rank + 1):
+            return i + store.offset
+    return store.max_key
+
+
+# Protobuf encoding, see https://github.com/DataDog/sketches-go/blob/master/ddsketch/pb/ddsketch.proto
+cdef inline size_t _varint_size(uint64_t value):
+    cdef size_t size = 1
+
+    while value >= 0x80:
+        value >>= 7
+        size += 1
+    return size
+
+
+cdef inline char* _write_varint(char* buf, uint64_t value):
+    while value >= 0x80:
+        buf[0] = <char>((value & 0x7F) | 0x80)
+        value >>= 7
+        buf += 1
+    buf[0] = <char>value
+    return buf + 1
+
+
+cdef inline char* _write_double(char* buf, double value):
+    # Little-endian, whatever the byte order of the platform
+    cdef uint64_t bits
+    cdef int i
+
+    memcpy(&bits, &value, sizeof(bits))
+    for i in range(8):
+        buf[i] = <char>(bits >> (8 * i))
+    return buf + 8
+
+
+cdef inline uint32_t _zigzag(int32_t value):
+    return (<uint32_t>value << 1) ^ <uint32_t>(value >> 31)
+
+
+cdef size_t _store_proto_size(_Store* store):
+    cdef size_t size = 0
+    cdef size_t bins_size = store.length * 8
+
+    if store.length > 0:
+        # contiguousBinCounts, packed
+        size += 1 + _varint_size(bins_size) + bins_size
+    if store.offset != 0:
+        # contiguousBinIndexOffset
+        size += 1 + _varint_size(_zigzag(<int32_t>store.offset))
+    return size
+
+
+cdef char* _write_store_proto(char* buf, _Store* store):
+    cdef Py_ssize_t i
+
+    if store.length > 0:
+        buf[0] = 0x12
+        buf = _write_varint(buf + 1, store.length * 8)
+        for i in range(store.length):
+            buf = _write_double(buf, store.bins[i])
+    if store.offset != 0:
+        buf[0] = 0x18
+        buf = _write_varint(buf + 1, _zigzag(<int32_t>store.offset))
+    return buf
+
+
+cdef class DDSketch(object):
+    """DDSketch with a relative accuracy of 0.775% and at most 2048 bins per store"""
+
+    def __cinit__(self):
+        memset(&self._positive, 0, sizeof(_Store))
+        memset(&self._negative, 0, sizeof(_Store))
+        self._negative.collapse_highest = True
+        self._zero_count = 0.0
+
+    def __dealloc__(self):
+        PyMem_Free(self._positive.bins)
+        PyMem_Free(self._negative.bins)
+
+    cpdef add(self, double value):
+        if value > _MIN_POSSIBLE:
+            _store_add(&self._positive, _key(value))
+        elif value < -_MIN_POSSIBLE:
+            _store_add(&self._negative, _key(-value))
+        else:
+            self._zero_count += 1.0
+
+    @property
+    def count(self):
+        return self._positive.count + self._negative.count + self._zero_count
+
+    def get_quantile_value(self, double quantile):
+        # type: (float) -> Optional[float]
+        """Return the approximate value at the quantile, ``None`` when there are no values or it is not in [0, 1]"""
+        cdef double count = self._positive.count + self._negative.count + self._zero_count
+        cdef double rank
+
+        if quantile < 0 or quantile > 1 or count == 0:
+            return None
+
+        rank = quantile * (count - 1)
+        if rank < self._negative.count:
+            return -_value(_store_key_at_rank(&self._negative, self._negative.count - rank - 1, False))
+        elif rank < self._zero_count + self._negative.count:
+            return 0.0
+        return _value(_store_key_at_rank(&self._positive, rank - self._zero_count - self._negative.count, True))
+
+    cdef size_t _proto_size(self):
+        cdef size_t positive_size = _store_proto_size(&self._positive)
+        cdef size_t negative_size = _store_proto_size(&self._negative)
+
+        # mapping, with the gamma only as the offset is 0 and there is no interpolation
+        return (
+            11
+            + 1 + _varint_size(positive_size) + positive_size
+            + 1 + _varint_size(negative_size) + negative_size
+            + (9 if self._zero_count != 0.0 else 0)
+        )
+
+    cdef char* _write_proto(self, char* buf):
+        buf[0] = 0x0A
+        buf[1] = 9
+        buf[2] = 0x09
+        buf = _write_double(buf + 3, _GAMMA)
+
+        buf[0] = 0x12
+        buf = _write_store_proto(_write_varint(buf + 1, _store_proto_size(&self._positive)), &self._positive)
+        buf[0] = 0x1A
+        buf = _write_store_proto(_write_varint(buf + 1, _store_proto_size(&self._negative)), &self._negative)
+
+        if self._zero_count != 0.0:
+            buf[0] = 0x21
+            buf = _write_double(buf + 1, self._zero_count)
+        return buf
+
+    def to_proto(self):
+        # type: () -> bytes
+        """Serialize the sketch to a DDSketch protobuf message"""
+        cdef size_t size = self._proto_size()
+        cdef bytes proto = PyBytes_FromStringAndSize(NULL, size)
+
+        self._write_proto(<char*>proto)
+        return proto
+
+
+cdef class _SpanAggrStats(object):
+    cdef uint64_t hits
+    cdef uint64_t top_level_hits
+    cdef uint64_t errors
+    cdef int64_t duration
+    cdef DDSketch ok_distribution
+    cdef DDSketch err_distribution
+
+    def __cinit__(self):
+        self.ok_distribution = DDSketch()
+        self.err_distribution = DDSketch()
+
+
+cdef inline int _pack_text(msgpack_packer* pk, object text) except -1:
+    if type(text) is not str:
+        text = ensure_text(text)
+    if msgpack_pack_unicode(pk, text, ITEM_LIMIT) == -2:
+        raise ValueError("unicode string is too large")
+    return 0
+
+
+# Numbers are packed like with Packer, which packs the positive ones as unsigned
+cdef inline int _pack_uint(msgpack_packer* pk, uint64_t value) except -1:
+    if value > 0:
+        return msgpack_pack_unsigned_long_long(pk, value)
+    return msgpack_pack_long_long(pk, 0)
+
+
+cdef inline int _pack_int(msgpack_packer* pk, int64_t value) except -1:
+    if value > 0:
+        return msgpack_pack_unsigned_long_long(pk, <unsigned long long>value)
+    return msgpack_pack_long_long(pk, value)
+
+
+cdef int _pack_sketch(msgpack_packer* pk, DDSketch sketch) except -1:
+    cdef size_t size = sketch._proto_size()
+
+    msgpack_pack_bin(pk, size)
+    sketch._write_proto(msgpack_pack_reserve(pk, size))
+    pk.length += size
+    return 0
+
+
+cdef int _pack_stats(msgpack_packer* pk, tuple key, _SpanAggrStats stats) except -1:
+    name, service, resource, span_type, http_status_code, synthetics = key
+
+    msgpack_pack_map(pk, 10 + (1 if service else 0) + (1 if span_type else 0))
+    _pack_text(pk, "Name")
+    _pack_text(pk, name)
+    _pack_text(pk, "Resource")
+    _pack_text(pk, resource)
+    _pack_text(pk, "Synthetics")
+    if synthetics:
+        msgpack_pack_true(pk)
+    else:
+        msgpack_pack_false(pk)
+    _pack_text(pk, "HTTPStatusCode")
+    _pack_int(pk, http_status_code)
+    _pack_text(pk, "Hits")
+    _pack_uint(pk, stats.hits)
+    _pack_text(pk, "TopLevelHits")
+    _pack_uint(pk, stats.top_level_hits)
+    _pack_text(pk, "Duration")
+    _pack_int(pk, stats.duration)
+    _pack_text(pk, "Errors")
+    _pack_uint(pk, stats.errors)
+    _pack_text(pk, "OkSummary")
+    _pack_sketch(pk, stats.ok_distribution)
+    _pack_text(pk, "ErrorSummary")
+    _pack_sketch(pk, stats.err_distribution)
+    if service:
+        _pack_text(pk, "Service")
+        _pack_text(pk, service)
+    if span_type:
+        _pack_text(pk, "Type")
+        _pack_text(pk, span_type)
+    return 0
+
+
+cdef class SpanStatsConcentrator(object):
+    """Aggregates the stats of spans by buckets of time, and packs them into v0.6 stats payloads"""
+
+    cdef readonly int64_t bucket_size_ns
+    # Start of the bucket -> aggregation key -> _SpanAggrStats
+    cdef dict _buckets
+
+    def __cinit__(self, int64_t bucket_size_ns):
+        if bucket_size_ns <= 0:
+            raise ValueError("bucket_size_ns must be positive")
+        self.bucket_size_ns = bucket_size_ns
+        self._buckets = {}
+
+    def __len__(self):
+        return len(self._buckets)
+
+    cpdef add_span(self, object span, bint is_top_level):
+        """Account for a finished span, which is either a top level or a measured span"""
+        cdef int64_t duration_ns = span.duration_ns
+        cdef int64_t end_ns = span.start_ns + duration_ns
+        # Align the span into the bucket of its end
+        cdef int64_t bucket_time_ns = end_ns - end_ns % self.bucket_size_ns
+        cdef _SpanAggrStats stats
+
+        key = (
+            span.name,
+            span.service or "",
+            span.resource or "",
+            span.span_type or "",
+            int(span.get_tag("http.status_code") or 0),
+            span.context.dd_origin == "synthetics",
+        )
+        bucket = self._buckets.get(bucket_time_ns)
+        if bucket is None:
+            bucket = self._buckets[bucket_time_ns] = {}
+        stats = bucket.get(key)
+        if stats is None:
+            stats = bucket[key] = _SpanAggrStats()
+
+        stats.hits += 1
+        stats.duration += duration_ns
+        if is_top_level:
+            stats.top_level_hits += 1
+        if span.error:
+            stats.errors += 1
+            stats.err_distribution.add(duration_ns)
+        else:
+            stats.ok_distribution.add(duration_ns)
+
+    cpdef object flush(self, str hostname, object env, object version):
+        # type: (str, Optional[str], Optional[str]) -> Optional[bytes]
+        """Pack the stats of all the buckets into a payload and clear them, return ``None`` if there are no stats"""
+        cdef msgpack_packer pk
+        cdef dict buckets = self._buckets
+
+        if not buckets:
+            return None
+        self._buckets = {}
+
+        pk.buf = <char*>PyMem_Malloc(PAYLOAD_BUFFER_SIZE)
+        if pk.buf == NULL:
+            raise MemoryError()
+        pk.buf_size = PAYLOAD_BUFFER_SIZE
+        pk.length = 0
+
+        try:
+            msgpack_pack_map(&pk, 2 + (1 if env else 0) + (1 if version else 0))
+            _pack_text(&pk, "Stats")
+            msgpack_pack_array(&pk, len(buckets))
+            for bucket_time_ns, bucket in buckets.items():
+                msgpack_pack_map(&pk, 3)
+                _pack_text(&pk, "Start")
+                _pack_int(&pk, bucket_time_ns)
+                _pack_text(&pk, "Duration")
+                _pack_int(&pk, self.bucket_size_ns)
+                _pack_text(&pk, "Stats")
+                msgpack_pack_array(&pk, len(bucket))
+                for key, stats in bucket.items():
+                    _pack_stats(&pk, key, stats)
+            _pack_text(&pk, "Hostname")
+            _pack_text(&pk, hostname)
+            if env:
+                _pack_text(&pk, "Env")
+                _pack_text(&pk, env)
+            if version:
+                _pack_text(&pk, "Version")
+                _pack_text(&pk, version)
+            return PyBytes_FromStringAndSize(pk.buf, pk.length)
+        finally:
+            PyMem_Free(pk.buf)
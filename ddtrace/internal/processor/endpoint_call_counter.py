@@ -17,11 +17,18 @@ class EndpointCallCounterProcessor(SpanProcessor):
     endpoint_counts = attr.ib(init=False, repr=False, type=EndpointCountsType, factory=lambda: {}, eq=False)
     _endpoint_counts_lock = attr.ib(init=False, repr=False, factory=forksafe.Lock, eq=False)
     _enabled = attr.ib(default=False, repr=False, eq=False)
+    _native_counter = attr.ib(default=None, repr=False, eq=False, type=typing.Optional[typing.Callable[[str], None]])
 
     def enable(self):
         # type: () -> None
         self._enabled = True
 
+    def count_natively(self, counter):
+        # type: (typing.Callable[[str], None]) -> None
+        """Count the requests with the given native counter, which adds them to the profiles, rather than in
+        ``endpoint_counts``."""
+        self._native_counter = counter
+
     def on_span_start(self, span):
         # type: (Span) -> None
         pass
@@ -32,6 +39,9 @@ class EndpointCallCounterProcessor(SpanProcessor):
             return
         if span._local_root == span and span.span_type == SpanTypes.WEB:
             resource = ensure_text(span.resource, errors="backslashreplace")
+            if self._native_counter is not None:
+                self._native_counter(resource)
+                return
             with self._endpoint_counts_lock:
                 self.endpoint_counts[resource] = self.endpoint_counts.get(resource, 0) + 1
 
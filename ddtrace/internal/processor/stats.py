@@ -1,20 +1,14 @@
 # coding: utf-8
-from collections import defaultdict
 import os
 import typing
 
-from ddsketch import LogCollapsingLowestDenseDDSketch
-from ddsketch.pb.proto import DDSketchProto
-
 import ddtrace
 from ddtrace import config
 from ddtrace._trace.processor import SpanProcessor
 from ddtrace._trace.span import _is_top_level
-from ddtrace.internal import compat
 from ddtrace.internal.utils.retry import fibonacci_backoff_with_jitter
 
 from ...constants import SPAN_MEASURED_KEY
-from .._encoding import packb
 from ..agent import get_connection
 from ..compat import get_connection_response
 from ..forksafe import Lock
@@ -23,14 +17,12 @@ from ..logger import get_logger
 from ..periodic import PeriodicService
 from ..runtime import container
 from ..writer import _human_size
+from ._stats import SpanStatsConcentrator
 
 
 if typing.TYPE_CHECKING:  # pragma: no cover
-    from typing import DefaultDict  # noqa:F401
     from typing import Dict  # noqa:F401
-    from typing import List  # noqa:F401
     from typing import Optional  # noqa:F401
-    from typing import Union  # noqa:F401
 
     from ddtrace import Span  # noqa:F401
 
@@ -44,50 +36,6 @@ def _is_measured(span):
     return span._metrics.get(SPAN_MEASURED_KEY) == 1
 
 
-"""
-To aggregate metrics for spans they need to be "uniquely" identified (as
-best as possible). This enables the compression of stat points.
-
-Aggregation can be done using primary and secondary attributes from the span
-stored in a tuple which is hashable in Python.
-"""
-SpanAggrKey = typing.Tuple[
-    str,  # name
-    str,  # service
-    str,  # resource
-    str,  # type
-    int,  # http status code
-    bool,  # synthetics request
-]
-
-
-class SpanAggrStats(object):
-    """Aggregated span statistics."""
-
-    __slots__ = ("hits", "top_level_hits", "errors", "duration", "ok_distribution", "err_distribution")
-
-    def __init__(self):
-        self.hits = 0
-        self.top_level_hits = 0
-        self.errors = 0
-        self.duration = 0
-        # Match the relative accuracy of the sketch implementation used in the backend
-        # which is 0.775%.
-        self.ok_distribution = LogCollapsingLowestDenseDDSketch(0.00775, bin_limit=2048)
-        self.err_distribution = LogCollapsingLowestDenseDDSketch(0.00775, bin_limit=2048)
-
-
-def _span_aggr_key(span):
-    # type: (Span) -> SpanAggrKey
-    """Return a hashable key that can be used to aggregate similar spans."""
-    service = span.service or ""
-    resource = span.resource or ""
-    _type = span.span_type or ""
-    status_code = span.get_tag("http.status_code") or 0
-    synthetics = span.context.dd_origin == "synthetics"
-    return span.name, service, resource, _type, int(status_code), synthetics
-
-
 class SpanStatsProcessorV06(PeriodicService, SpanProcessor):
     """SpanProcessor for computing, collecting and submitting span metrics to the Datadog Agent."""
 
@@ -102,9 +50,8 @@ class SpanStatsProcessorV06(PeriodicService, SpanProcessor):
         self._timeout = timeout
         # Have the bucket size match the interval in which flushes occur.
         self._bucket_size_ns = int(interval * 1e9)  # type: int
-        self._buckets = defaultdict(
-            lambda: defaultdict(SpanAggrStats)
-        )  # type: DefaultDict[int, DefaultDict[SpanAggrKey, SpanAggrStats]]
+        # The stats of the spans, aggregated by bucket and by the attributes of the spans
+        self._concentrator = SpanStatsConcentrator(self._bucket_size_ns)
         self._headers = {
             "Datadog-Meta-Lang": "python",
             "Datadog-Meta-Tracer-Version": ddtrace.__version__,
@@ -137,68 +84,9 @@ class SpanStatsProcessorV06(PeriodicService, SpanProcessor):
         if not is_top_level and not _is_measured(span):
             return
 
+        assert span.duration_ns is not None
         with self._lock:
-            # Align the span into the corresponding stats bucket
-            assert span.duration_ns is not None
-            span_end_ns = span.start_ns + span.duration_ns
-            bucket_time_ns = span_end_ns - (span_end_ns % self._bucket_size_ns)
-            aggr_key = _span_aggr_key(span)
-            stats = self._buckets[bucket_time_ns][aggr_key]
-
-            stats.hits += 1
-            stats.duration += span.duration_ns
-            if is_top_level:
-                stats.top_level_hits += 1
-            if span.error:
-                stats.errors += 1
-                stats.err_distribution.add(span.duration_ns)
-            else:
-                stats.ok_distribution.add(span.duration_ns)
-
-    def _serialize_buckets(self):
-        # type: () -> List[Dict]
-        """Serialize and update the buckets.
-
-        The current bucket is left in case any other spans are added.
-        """
-        serialized_buckets = []
-        serialized_bucket_keys = []
-        for bucket_time_ns, bucket in self._buckets.items():
-            bucket_aggr_stats = []
-            serialized_bucket_keys.append(bucket_time_ns)
-
-            for aggr_key, stat_aggr in bucket.items():
-                name, service, resource, _type, http_status, synthetics = aggr_key
-                serialized_bucket = {
-                    "Name": compat.ensure_text(name),
-                    "Resource": compat.ensure_text(resource),
-                    "Synthetics": synthetics,
-                    "HTTPStatusCode": http_status,
-                    "Hits": stat_aggr.hits,
-                    "TopLevelHits": stat_aggr.top_level_hits,
-                    "Duration": stat_aggr.duration,
-                    "Errors": stat_aggr.errors,
-                    "OkSummary": DDSketchProto.to_proto(stat_aggr.ok_distribution).SerializeToString(),
-                    "ErrorSummary": DDSketchProto.to_proto(stat_aggr.err_distribution).SerializeToString(),
-                }
-                if service:
-                    serialized_bucket["Service"] = compat.ensure_text(service)
-                if _type:
-                    serialized_bucket["Type"] = compat.ensure_text(_type)
-                bucket_aggr_stats.append(serialized_bucket)
-            serialized_buckets.append(
-                {
-                    "Start": bucket_time_ns,
-                    "Duration": self._bucket_size_ns,
-                    "Stats": bucket_aggr_stats,
-                }
-            )
-
-        # Clear out buckets that have been serialized
-        for key in serialized_bucket_keys:
-            del self._buckets[key]
-
-        return serialized_buckets
+            self._concentrator.add_span(span, is_top_level)
 
     def _flush_stats(self, payload):
         # type: (bytes) -> None
@@ -231,21 +119,11 @@ class SpanStatsProcessorV06(PeriodicService, SpanProcessor):
         # type: (...) -> None
 
         with self._lock:
-            serialized_stats = self._serialize_buckets()
+            payload = self._concentrator.flush(self._hostname, config.env, config.version)
 
-        if not serialized_stats:
+        if payload is None:
             # No stats to report, short-circuit.
             return
-        raw_payload = {
-            "Stats": serialized_stats,
-            "Hostname": self._hostname,
-        }  # type: Dict[str, Union[List[Dict], str]]
-        if config.env:
-            raw_payload["Env"] = compat.ensure_text(config.env)
-        if config.version:
-            raw_payload["Version"] = compat.ensure_text(config.version)
-
-        payload = packb(raw_payload)
         try:
             self._flush_stats_with_backoff(payload)
         except Exception:
@@ -0,0 +1,299 @@
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if PY_VERSION_HEX >= 0x030B0000
+/* Still exported, but only declared by the internal headers since Python 3.11 */
+PyAPI_FUNC(int) _PyObject_DebugMallocStats(FILE* out);
+#endif
+
+/* The pauses are counted by the power of 2 of their duration in microseconds: the bucket i holds the pauses shorter
+   than 2^i us, and the last one the longer ones too */
+#define GCSTATS_BUCKETS 24
+#define GCSTATS_GENERATIONS 3
+
+/* The statistics are only updated by the callback of the collections, which run one at a time with the GIL held,
+   and are taken by collect(), with atomics so that neither has to lock the other out */
+typedef struct
+{
+    uint64_t count;
+    uint64_t total_ns;
+    uint64_t max_ns;
+    uint64_t buckets[GCSTATS_BUCKETS];
+} gcstats_generation_t;
+
+static gcstats_generation_t gcstats[GCSTATS_GENERATIONS];
+
+/* Start of the current collection, 0 outside of them */
+static uint64_t gc_start_ns = 0;
+
+/* The callback registered in gc.callbacks, and the key of the generations in the info it gets */
+static PyObject* gc_callback = NULL;
+static PyObject* generation_key = NULL;
+
+static inline uint64_t
+monotonic_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+static inline unsigned int
+pause_bucket(uint64_t duration_ns)
+{
+    uint64_t us = duration_ns / 1000;
+    unsigned int bucket = 0;
+
+    while (us && bucket < GCSTATS_BUCKETS - 1) {
+        us >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+static void
+record_pause(long generation, uint64_t duration_ns)
+{
+    gcstats_generation_t* stats = &gcstats[generation];
+    uint64_t max_ns = __atomic_load_n(&stats->max_ns, __ATOMIC_RELAXED);
+
+    __atomic_fetch_add(&stats->count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&stats->total_ns, duration_ns, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&stats->buckets[pause_bucket(duration_ns)], 1, __ATOMIC_RELAXED);
+    while (duration_ns > max_ns &&
+           !__atomic_compare_exchange_n(&stats->max_ns, &max_ns, duration_ns, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+/* Called with ("start", info) and ("stop", info) around each collection */
+static PyObject*
+on_gc(PyObject* Py_UNUSED(module), PyObject* const* args, Py_ssize_t nargs)
+{
+    if (nargs != 2 || !PyUnicode_Check(args[0]))
+        Py_RETURN_NONE;
+
+    if (PyUnicode_CompareWithASCIIString(args[0], "start") == 0) {
+        gc_start_ns = monotonic_ns();
+    } else if (gc_start_ns != 0 && PyDict_Check(args[1])) {
+        uint64_t duration_ns = monotonic_ns() - gc_start_ns;
+        PyObject* generation = PyDict_GetItemWithError(args[1], generation_key);
+
+        gc_start_ns = 0;
+        if (generation != NULL && PyLong_Check(generation)) {
+            long gen = PyLong_AsLong(generation);
+
+            if (gen >= 0 && gen < GCSTATS_GENERATIONS)
+                record_pause(gen, duration_ns);
+        }
+        PyErr_Clear();
+    }
+
+    Py_RETURN_NONE;
+}
+
+static PyMethodDef on_gc_def = { "on_gc", (PyCFunction)(void (*)(void))on_gc, METH_FASTCALL, NULL };
+
+static PyObject*
+gc_callbacks(void)
+{
+    PyObject* callbacks;
+    PyObject* gc = PyImport_ImportModule("gc");
+
+    if (gc == NULL)
+        return NULL;
+
+    callbacks = PyObject_GetAttrString(gc, "callbacks");
+    Py_DECREF(gc);
+    if (callbacks != NULL && !PyList_Check(callbacks)) {
+        PyErr_SetString(PyExc_TypeError, "gc.callbacks is not a list");
+        Py_CLEAR(callbacks);
+    }
+    return callbacks;
+}
+
+static PyObject*
+start(PyObject* Py_UNUSED(module), PyObject* Py_UNUSED(args))
+{
+    PyObject* callbacks = gc_callbacks();
+    int found;
+
+    if (callbacks == NULL)
+        return NULL;
+
+    found = PySequence_Contains(callbacks, gc_callback);
+    if (found == 0 && PyList_Append(callbacks, gc_callback) < 0)
+        found = -1;
+
+    Py_DECREF(callbacks);
+    if (found < 0)
+        return NULL;
+    Py_RETURN_NONE;
+}
+
+static PyObject*
+stop(PyObject* Py_UNUSED(module), PyObject* Py_UNUSED(args))
+{
+    PyObject* callbacks = gc_callbacks();
+    Py_ssize_t i;
+
+    if (callbacks == NULL)
+        return NULL;
+
+    for (i = PyList_GET_SIZE(callbacks) - 1; i >= 0; i--) {
+        if (PyList_GET_ITEM(callbacks, i) == gc_callback && PySequence_DelItem(callbacks, i) < 0) {
+            Py_DECREF(callbacks);
+            return NULL;
+        }
+    }
+
+    Py_DECREF(callbacks);
+    gc_start_ns = 0;
+    Py_RETURN_NONE;
+}
+
+/* Smallest bucket bound under which are 99% of the pauses, in nanoseconds */
+static uint64_t
+pause_p99_ns(const uint64_t* buckets, uint64_t count, uint64_t max_ns)
+{
+    uint64_t rank = count - count / 100;
+    uint64_t seen = 0;
+
+    for (unsigned int i = 0; i < GCSTATS_BUCKETS - 1; i++) {
+        seen += buckets[i];
+        if (seen >= rank) {
+            uint64_t bound_ns = ((uint64_t)1 << i) * 1000;
+            return bound_ns < max_ns ? bound_ns : max_ns;
+        }
+    }
+    return max_ns;
+}
+
+static PyObject*
+collect(PyObject* Py_UNUSED(module), PyObject* Py_UNUSED(args))
+{
+    PyObject* result = PyTuple_New(GCSTATS_GENERATIONS);
+
+    if (result == NULL)
+        return NULL;
+
+    for (int gen = 0; gen < GCSTATS_GENERATIONS; gen++) {
+        gcstats_generation_t* stats = &gcstats[gen];
+        uint64_t buckets[GCSTATS_BUCKETS];
+        uint64_t count = __atomic_exchange_n(&stats->count, 0, __ATOMIC_RELAXED);
+        uint64_t total_ns = __atomic_exchange_n(&stats->total_ns, 0, __ATOMIC_RELAXED);
+        uint64_t max_ns = __atomic_exchange_n(&stats->max_ns, 0, __ATOMIC_RELAXED);
+        PyObject* item;
+
+        for (int i = 0; i < GCSTATS_BUCKETS; i++)
+            buckets[i] = __atomic_exchange_n(&stats->buckets[i], 0, __ATOMIC_RELAXED);
+
+        item = Py_BuildValue("(Kddd)",
+                             (unsigned long long)count,
+                             total_ns / 1e9,
+                             max_ns / 1e9,
+                             count ? pause_p99_ns(buckets, count, max_ns) / 1e9 : 0.0);
+        if (item == NULL) {
+            Py_DECREF(result);
+            return NULL;
+        }
+        PyTuple_SET_ITEM(result, gen, item);
+    }
+
+    return result;
+}
+
+/* Value of the statistic `name` of the lines "<name> = <value>" of the pymalloc statistics, -1 if it isn't there */
+static long long
+pymalloc_stat(const char* stats, const char* name)
+{
+    const char* line = strstr(stats, name);
+    long long value = 0;
+
+    if (line == NULL || (line = strchr(line, '=')) == NULL)
+        return -1;
+
+    /* The values are printed with separators of thousands */
+    for (line++; *line == ' '; line++)
+        ;
+    for (; (*line >= '0' && *line <= '9') || *line == ','; line++) {
+        if (*line != ',')
+            value = value * 10 + (*line - '0');
+    }
+    return value;
+}
+
+/* Reads the pymalloc statistics the interpreter prints with sys._debugmallocstats(), as it keeps its arenas to
+   itself. This walks the arenas and their pools, which only costs something once per collection of the metrics. */
+static PyObject*
+pymalloc_stats(PyObject* Py_UNUSED(module), PyObject* Py_UNUSED(args))
+{
+    char* stats = NULL;
+    size_t size = 0;
+    FILE* out = open_memstream(&stats, &size);
+    int enabled;
+    PyObject* result;
+
+    if (out == NULL)
+        return PyErr_SetFromErrno(PyExc_OSError);
+
+    enabled = _PyObject_DebugMallocStats(out);
+    fclose(out);
+
+    if (!enabled || stats == NULL) {
+        /* Another allocator is used, e.g. with PYTHONMALLOC=malloc */
+        free(stats);
+        Py_RETURN_NONE;
+    }
+
+    result = Py_BuildValue("(LL)",
+                           pymalloc_stat(stats, "# arenas allocated current"),
+                           pymalloc_stat(stats, "# bytes in allocated blocks"));
+    free(stats);
+    return result;
+}
+
+static PyMethodDef GCStatsMethods[] = {
+    { "start", (PyCFunction)start, METH_NOARGS, "Measure the pauses of the garbage collector" },
+    { "stop", (PyCFunction)stop, METH_NOARGS, "Stop measuring the pauses of the garbage collector" },
+    { "collect",
+      (PyCFunction)collect,
+      METH_NOARGS,
+      "(count, total, max, p99) of the pauses of each generation since the previous call, in seconds" },
+    { "pymalloc_stats",
+      (PyCFunction)pymalloc_stats,
+      METH_NOARGS,
+      "(arenas, bytes in allocated blocks) of pymalloc, or None if it isn't used" },
+    { NULL, NULL, 0, NULL }
+};
+
+static struct PyModuleDef gcstats_module = { PyModuleDef_HEAD_INIT,
+                                             "ddtrace.internal.runtime._gcstats",
+                                             "garbage collector and allocator statistics",
+                                             -1,
+                                             GCStatsMethods };
+
+PyMODINIT_FUNC
+PyInit__gcstats(void)
+{
+    PyObject* m = PyModule_Create(&gcstats_module);
+    if (m == NULL)
+        return NULL;
+
+    if (gc_callback == NULL) {
+        generation_key = PyUnicode_InternFromString("generation");
+        gc_callback = generation_key ? PyCFunction_New(&on_gc_def, NULL) : NULL;
+        if (gc_callback == NULL) {
+            Py_CLEAR(generation_key);
+            Py_DECREF(m);
+            return NULL;
+        }
+    }
+    return m;
+}
@@ -2,6 +2,23 @@ GC_COUNT_GEN0 = "runtime.python.gc.count.gen0"
 GC_COUNT_GEN1 = "runtime.python.gc.count.gen1"
 GC_COUNT_GEN2 = "runtime.python.gc.count.gen2"
 
+# Pauses of the garbage collector by generation, since the previous collection of the metrics
+GC_PAUSE_COUNT_GEN0 = "runtime.python.gc.pause.count.gen0"
+GC_PAUSE_COUNT_GEN1 = "runtime.python.gc.pause.count.gen1"
+GC_PAUSE_COUNT_GEN2 = "runtime.python.gc.pause.count.gen2"
+GC_PAUSE_TIME_GEN0 = "runtime.python.gc.pause.time.gen0"
+GC_PAUSE_TIME_GEN1 = "runtime.python.gc.pause.time.gen1"
+GC_PAUSE_TIME_GEN2 = "runtime.python.gc.pause.time.gen2"
+GC_PAUSE_MAX_GEN0 = "runtime.python.gc.pause.max.gen0"
+GC_PAUSE_MAX_GEN1 = "runtime.python.gc.pause.max.gen1"
+GC_PAUSE_MAX_GEN2 = "runtime.python.gc.pause.max.gen2"
+GC_PAUSE_P99_GEN0 = "runtime.python.gc.pause.p99.gen0"
+GC_PAUSE_P99_GEN1 = "runtime.python.gc.pause.p99.gen1"
+GC_PAUSE_P99_GEN2 = "runtime.python.gc.pause.p99.gen2"
+
+MEM_PYMALLOC_ARENAS = "runtime.python.mem.pymalloc.arenas"
+MEM_PYMALLOC_ALLOCATED = "runtime.python.mem.pymalloc.allocated"
+
 THREAD_COUNT = "runtime.python.thread_count"
 MEM_RSS = "runtime.python.mem.rss"
 # `runtime.python.cpu.time.sys` metric is used to auto-enable runtime metrics dashboards in DD backend
@@ -13,11 +30,32 @@ CTX_SWITCH_INVOLUNTARY = "runtime.python.cpu.ctx_switch.involuntary"
 
 GC_RUNTIME_METRICS = set([GC_COUNT_GEN0, GC_COUNT_GEN1, GC_COUNT_GEN2])
 
+GC_PAUSE_RUNTIME_METRICS = set(
+    [
+        GC_PAUSE_COUNT_GEN0,
+        GC_PAUSE_COUNT_GEN1,
+        GC_PAUSE_COUNT_GEN2,
+        GC_PAUSE_TIME_GEN0,
+        GC_PAUSE_TIME_GEN1,
+        GC_PAUSE_TIME_GEN2,
+        GC_PAUSE_MAX_GEN0,
+        GC_PAUSE_MAX_GEN1,
+        GC_PAUSE_MAX_GEN2,
+        GC_PAUSE_P99_GEN0,
+        GC_PAUSE_P99_GEN1,
+        GC_PAUSE_P99_GEN2,
+    ]
+)
+
+PYMALLOC_RUNTIME_METRICS = set([MEM_PYMALLOC_ARENAS, MEM_PYMALLOC_ALLOCATED])
+
 PSUTIL_RUNTIME_METRICS = set(
     [THREAD_COUNT, MEM_RSS, CTX_SWITCH_VOLUNTARY, CTX_SWITCH_INVOLUNTARY, CPU_TIME_SYS, CPU_TIME_USER, CPU_PERCENT]
 )
 
-DEFAULT_RUNTIME_METRICS = GC_RUNTIME_METRICS | PSUTIL_RUNTIME_METRICS
+NATIVE_GC_RUNTIME_METRICS = GC_PAUSE_RUNTIME_METRICS | PYMALLOC_RUNTIME_METRICS
+
+DEFAULT_RUNTIME_METRICS = GC_RUNTIME_METRICS | PSUTIL_RUNTIME_METRICS | NATIVE_GC_RUNTIME_METRICS
 
 SERVICE = "service"
 ENV = "env"
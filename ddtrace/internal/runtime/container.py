@@ -130,6 +130,53 @@ def get_container_info(pid="self"):
     return None
 
 
+def get_cpu_quota(cgroup_root="/sys/fs/cgroup"):
+    # type: (str) -> Optional[float]
+    """
+    Helper to fetch the number of CPUs the cgroup of the current process may use
+
+    Both the unified hierarchy (``cpu.max``) and the v1 CFS controller
+    (``cpu.cfs_quota_us`` and ``cpu.cfs_period_us``) are looked up.
+
+    :param cgroup_root: The mount point of the cgroup file system (default: '/sys/fs/cgroup')
+    :type cgroup_root: str
+    :returns: The CPU quota, as a number of CPUs, or None if there is none
+    :rtype: float | None
+    """
+    try:
+        with open(os.path.join(cgroup_root, "cpu.max"), mode="r") as fp:
+            quota, period = fp.read().split()[:2]
+        if quota == "max":
+            return None
+        return int(quota) / int(period)
+    except IOError as e:
+        if e.errno != errno.ENOENT:
+            log.debug("Failed to open cgroup cpu.max file", exc_info=True)
+    except Exception:
+        log.debug("Failed to parse cgroup cpu.max file", exc_info=True)
+        return None
+
+    for controller in ("cpu", "cpu,cpuacct"):
+        try:
+            with open(os.path.join(cgroup_root, controller, "cpu.cfs_quota_us"), mode="r") as fp:
+                quota_us = int(fp.read())
+            with open(os.path.join(cgroup_root, controller, "cpu.cfs_period_us"), mode="r") as fp:
+                period_us = int(fp.read())
+        except IOError as e:
+            if e.errno != errno.ENOENT:
+                log.debug("Failed to open cgroup CFS files of controller %r", controller, exc_info=True)
+            continue
+        except Exception:
+            log.debug("Failed to parse cgroup CFS files of controller %r", controller, exc_info=True)
+            return None
+        # A quota of -1 means there is none
+        if quota_us <= 0 or period_us <= 0:
+            return None
+        return quota_us / period_us
+
+    return None
+
+
 def update_headers_with_container_info(headers: Dict, container_info: Optional[CGroupInfo]) -> None:
     if container_info is None:
         return
@@ -1,5 +1,7 @@
 import os
+import time
 from typing import List  # noqa:F401
+from typing import Optional  # noqa:F401
 from typing import Tuple  # noqa:F401
 
 from .collector import ValueCollector
@@ -11,7 +13,22 @@ from .constants import CTX_SWITCH_VOLUNTARY
 from .constants import GC_COUNT_GEN0
 from .constants import GC_COUNT_GEN1
 from .constants import GC_COUNT_GEN2
+from .constants import GC_PAUSE_COUNT_GEN0
+from .constants import GC_PAUSE_COUNT_GEN1
+from .constants import GC_PAUSE_COUNT_GEN2
+from .constants import GC_PAUSE_MAX_GEN0
+from .constants import GC_PAUSE_MAX_GEN1
+from .constants import GC_PAUSE_MAX_GEN2
+from .constants import GC_PAUSE_P99_GEN0
+from .constants import GC_PAUSE_P99_GEN1
+from .constants import GC_PAUSE_P99_GEN2
+from .constants import GC_PAUSE_TIME_GEN0
+from .constants import GC_PAUSE_TIME_GEN1
+from .constants import GC_PAUSE_TIME_GEN2
+from .constants import MEM_PYMALLOC_ALLOCATED
+from .constants import MEM_PYMALLOC_ARENAS
 from .constants import MEM_RSS
+from .constants import PYMALLOC_RUNTIME_METRICS
 from .constants import THREAD_COUNT
 
 
@@ -41,10 +58,54 @@ class GCRuntimeMetricCollector(RuntimeMetricCollector):
         return metrics
 
 
+class NativeGCRuntimeMetricCollector(RuntimeMetricCollector):
+    """Collector for the pauses of the garbage collector and the pymalloc statistics
+
+    The pauses are measured by a native callback of ``gc.callbacks``, which
+    keeps a histogram of their durations for each generation, so nothing is
+    done on allocations. The pymalloc statistics are read once per collection.
+    """
+
+    required_modules = ["ddtrace.internal.runtime._gcstats"]
+    pause_metrics = (
+        (GC_PAUSE_COUNT_GEN0, GC_PAUSE_TIME_GEN0, GC_PAUSE_MAX_GEN0, GC_PAUSE_P99_GEN0),
+        (GC_PAUSE_COUNT_GEN1, GC_PAUSE_TIME_GEN1, GC_PAUSE_MAX_GEN1, GC_PAUSE_P99_GEN1),
+        (GC_PAUSE_COUNT_GEN2, GC_PAUSE_TIME_GEN2, GC_PAUSE_MAX_GEN2, GC_PAUSE_P99_GEN2),
+    )
+
+    def _on_modules_load(self):
+        self._gcstats = self.modules["ddtrace.internal.runtime._gcstats"]
+        self._gcstats.start()
+
+    def stop(self):
+        if self.enabled:
+            self._gcstats.stop()
+
+    def collect_fn(self, keys):
+        metrics = []
+        for names, values in zip(self.pause_metrics, self._gcstats.collect()):
+            metrics.extend(zip(names, values))
+
+        # Walking the arenas isn't free, so they are only walked for their metrics
+        if not keys or PYMALLOC_RUNTIME_METRICS.intersection(keys):
+            stats = self._gcstats.pymalloc_stats()
+            if stats is not None:
+                arenas, allocated = stats
+                if arenas >= 0:
+                    metrics.append((MEM_PYMALLOC_ARENAS, arenas))
+                if allocated >= 0:
+                    metrics.append((MEM_PYMALLOC_ALLOCATED, allocated))
+
+        return metrics
+
+
 class PSUtilRuntimeMetricCollector(RuntimeMetricCollector):
     """Collector for psutil metrics.
 
-    Performs batched operations via proc.oneshot() to optimize the calls.
+    On Linux all the metrics come from a single native call that reads
+    /proc/self/stat and /proc/self/status through descriptors kept open
+    between collections. Elsewhere, or if that call fails, it performs batched
+    operations via proc.oneshot() to optimize the calls.
     See https://psutil.readthedocs.io/en/latest/#psutil.Process.oneshot
     for more information.
     """
@@ -65,8 +126,48 @@ class PSUtilRuntimeMetricCollector(RuntimeMetricCollector):
     def _on_modules_load(self):
         self.proc = self.modules["ddtrace.vendor.psutil"].Process(os.getpid())
         self.stored_values = {key: 0 for key in self.delta_funs.keys()}
+        try:
+            from ddtrace.vendor.psutil._psutil_linux import proc_runtime_metrics
+        except ImportError:
+            proc_runtime_metrics = None
+        self._proc_runtime_metrics = proc_runtime_metrics
+        # CPU time and wall time of the previous reading, for the CPU percent
+        self._last_cpu_time = None  # type: Optional[Tuple[float, float]]
+
+    def _collect_native(self):
+        user, system, rss, num_threads, voluntary, involuntary = self._proc_runtime_metrics()
+        now = time.monotonic()
+
+        # Same as psutil's cpu_percent(): the CPU usage since the previous reading, 0.0 on the first one
+        cpu_percent = 0.0
+        if self._last_cpu_time is not None:
+            last_cpu, last_now = self._last_cpu_time
+            if now > last_now:
+                cpu_percent = round((user + system - last_cpu) / (now - last_now) * 100, 1)
+        self._last_cpu_time = (user + system, now)
+
+        metrics = {}
+        for metric, value in (
+            (CPU_TIME_SYS, system),
+            (CPU_TIME_USER, user),
+            (CTX_SWITCH_VOLUNTARY, voluntary),
+            (CTX_SWITCH_INVOLUNTARY, involuntary),
+        ):
+            metrics[metric] = value - self.stored_values.get(metric, 0)
+            self.stored_values[metric] = value
+        metrics[THREAD_COUNT] = num_threads
+        metrics[MEM_RSS] = rss
+        metrics[CPU_PERCENT] = cpu_percent
+        return list(metrics.items())
 
     def collect_fn(self, keys):
+        if self._proc_runtime_metrics is not None:
+            try:
+                return self._collect_native()
+            except Exception:
+                # Keep to the portable path from now on
+                self._proc_runtime_metrics = None
+
         with self.proc.oneshot():
             metrics = {}
 
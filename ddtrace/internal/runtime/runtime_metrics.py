@@ -16,6 +16,7 @@ from ..dogstatsd import get_dogstatsd_client
 from ..logger import get_logger
 from .constants import DEFAULT_RUNTIME_METRICS
 from .metric_collectors import GCRuntimeMetricCollector
+from .metric_collectors import NativeGCRuntimeMetricCollector
 from .metric_collectors import PSUtilRuntimeMetricCollector
 from .tag_collectors import PlatformTagCollector
 from .tag_collectors import TracerTagCollector
@@ -38,6 +39,10 @@ class RuntimeCollectorsIterable(object):
         collected = (collector.collect(self._enabled) for collector in self._collectors)
         return itertools.chain.from_iterable(collected)
 
+    def stop(self):
+        for collector in self._collectors:
+            collector.stop()
+
     def __repr__(self):
         return "{}(enabled={})".format(
             self.__class__.__name__,
@@ -58,6 +63,7 @@ class RuntimeMetrics(RuntimeCollectorsIterable):
     ENABLED = DEFAULT_RUNTIME_METRICS
     COLLECTORS = [
         GCRuntimeMetricCollector,
+        NativeGCRuntimeMetricCollector,
         PSUtilRuntimeMetricCollector,
     ]
 
@@ -159,6 +165,7 @@ class RuntimeWorker(periodic.PeriodicService):
         # type: (...) -> None
         # De-register span hook
         super(RuntimeWorker, self)._stop_service()
+        self._runtime_metrics.stop()
 
     def update_runtime_tags(self):
         # type: () -> None
@@ -0,0 +1,238 @@
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <stdint.h>
+
+/* Native scan of the code objects for the symbol database.
+
+   The line numbers of the code objects and the fields that the __init__ methods set on the instances are found by
+   walking the line tables and the bytecode directly, rather than through the Instruction objects of dis, with the
+   same results as linenos and the bytecode inspection of get_fields in symbols.py. */
+
+/* The opcodes, which change between the Python versions, are looked up in dis when the module is initialized */
+static int op_load_fast = -1;
+static int op_store_attr = -1;
+static int op_extended_arg = -1;
+
+/* The inline caches of the instructions, which dis skips, are CACHE instructions in co_code since Python 3.11 */
+#define OP_CACHE 0
+
+static int
+lookup_opcode(PyObject* opmap, const char* name, int* opcode)
+{
+    PyObject* value = PyDict_GetItemString(opmap, name);
+
+    if (value == NULL) {
+        PyErr_Format(PyExc_ImportError, "unknown opcode %s", name);
+        return -1;
+    }
+    *opcode = (int)PyLong_AsLong(value);
+    return *opcode == -1 && PyErr_Occurred() ? -1 : 0;
+}
+
+static int
+load_opcodes(void)
+{
+    PyObject* dis = PyImport_ImportModule("dis");
+    PyObject* opmap = dis == NULL ? NULL : PyObject_GetAttrString(dis, "opmap");
+    int result = -1;
+
+    Py_XDECREF(dis);
+    if (opmap == NULL)
+        return -1;
+    if (!PyDict_Check(opmap))
+        PyErr_SetString(PyExc_ImportError, "dis.opmap is not a dictionary");
+    else if (lookup_opcode(opmap, "LOAD_FAST", &op_load_fast) == 0 &&
+             lookup_opcode(opmap, "STORE_ATTR", &op_store_attr) == 0 &&
+             lookup_opcode(opmap, "EXTENDED_ARG", &op_extended_arg) == 0)
+        result = 0;
+    Py_DECREF(opmap);
+    return result;
+}
+
+static PyObject*
+get_code_attr(PyObject* code, const char* name, int (*check)(PyObject*))
+{
+    PyObject* value;
+
+    if (!PyCode_Check(code)) {
+        PyErr_SetString(PyExc_TypeError, "expected a code object");
+        return NULL;
+    }
+    value = PyObject_GetAttrString(code, name);
+    if (value != NULL && !check(value)) {
+        PyErr_Format(PyExc_TypeError, "unexpected type of %s", name);
+        Py_CLEAR(value);
+    }
+    return value;
+}
+
+static inline void
+add_line(long line, long first_line, long* start, long* end)
+{
+    /* The first line of the code objects is the one of their definitions */
+    if (line == first_line)
+        return;
+    if (*start < 0 || line < *start)
+        *start = line;
+    if (line > *end)
+        *end = line;
+}
+
+static int
+is_long(PyObject* o)
+{
+    return PyLong_Check(o);
+}
+
+static int
+is_bytes(PyObject* o)
+{
+    return PyBytes_Check(o);
+}
+
+static int
+is_tuple(PyObject* o)
+{
+    return PyTuple_Check(o);
+}
+
+static PyObject*
+line_range(PyObject* Py_UNUSED(module), PyObject* code)
+{
+    PyObject* first = get_code_attr(code, "co_firstlineno", is_long);
+    long first_line;
+    long start = -1;
+    long end = -1;
+
+    if (first == NULL)
+        return NULL;
+    first_line = PyLong_AsLong(first);
+    Py_DECREF(first);
+    if (first_line == -1 && PyErr_Occurred())
+        return NULL;
+
+#if PY_VERSION_HEX >= 0x030a0000
+    {
+        /* The (start, end, line) entries of co_lines, with None for the instructions without a line */
+        PyObject* lines = PyObject_CallMethod(code, "co_lines", NULL);
+        PyObject* iterator = lines == NULL ? NULL : PyObject_GetIter(lines);
+        PyObject* entry;
+
+        Py_XDECREF(lines);
+        if (iterator == NULL)
+            return NULL;
+        while ((entry = PyIter_Next(iterator)) != NULL) {
+            if (PyTuple_Check(entry) && PyTuple_GET_SIZE(entry) == 3 && PyTuple_GET_ITEM(entry, 2) != Py_None) {
+                long line = PyLong_AsLong(PyTuple_GET_ITEM(entry, 2));
+                if (line == -1 && PyErr_Occurred()) {
+                    Py_DECREF(entry);
+                    Py_DECREF(iterator);
+                    return NULL;
+                }
+                add_line(line, first_line, &start, &end);
+            }
+            Py_DECREF(entry);
+        }
+        Py_DECREF(iterator);
+        if (PyErr_Occurred())
+            return NULL;
+    }
+#else
+    {
+        /* The (address increment, signed line increment) pairs of co_lnotab, as decoded by dis.findlinestarts */
+        PyObject* lnotab = get_code_attr(code, "co_lnotab", is_bytes);
+        const unsigned char* table;
+        Py_ssize_t size;
+        Py_ssize_t i;
+        long line = first_line;
+
+        if (lnotab == NULL)
+            return NULL;
+        table = (const unsigned char*)PyBytes_AS_STRING(lnotab);
+        size = PyBytes_GET_SIZE(lnotab) & ~(Py_ssize_t)1;
+        for (i = 0; i < size; i += 2) {
+            if (table[i])
+                add_line(line, first_line, &start, &end);
+            line += (signed char)table[i + 1];
+        }
+        add_line(line, first_line, &start, &end);
+        Py_DECREF(lnotab);
+    }
+#endif
+
+    if (start < 0)
+        Py_RETURN_NONE;
+    return Py_BuildValue("(ll)", start, end);
+}
+
+static PyObject*
+self_fields(PyObject* Py_UNUSED(module), PyObject* code)
+{
+    PyObject* bytecode;
+    PyObject* names;
+    PyObject* fields = NULL;
+    const unsigned char* units;
+    Py_ssize_t size;
+    Py_ssize_t i;
+    unsigned long ext = 0;
+    int loaded_self = 0;
+
+    if ((bytecode = get_code_attr(code, "co_code", is_bytes)) == NULL)
+        return NULL;
+    if ((names = get_code_attr(code, "co_names", is_tuple)) == NULL)
+        goto done;
+    if ((fields = PySet_New(NULL)) == NULL)
+        goto done;
+
+    /* The attributes stored right after loading the first argument, which is self */
+    units = (const unsigned char*)PyBytes_AS_STRING(bytecode);
+    size = PyBytes_GET_SIZE(bytecode) & ~(Py_ssize_t)1;
+    for (i = 0; i < size; i += 2) {
+        int opcode = units[i];
+        unsigned long arg = (ext << 8) | units[i + 1];
+
+#if PY_VERSION_HEX >= 0x030b0000
+        if (opcode == OP_CACHE)
+            continue;
+#endif
+        if (opcode == op_store_attr && loaded_self && arg < (unsigned long)PyTuple_GET_SIZE(names)) {
+            if (PySet_Add(fields, PyTuple_GET_ITEM(names, arg)) < 0) {
+                Py_CLEAR(fields);
+                goto done;
+            }
+        }
+        loaded_self = opcode == op_load_fast && arg == 0;
+        ext = opcode == op_extended_arg ? arg : 0;
+    }
+
+done:
+    Py_XDECREF(names);
+    Py_DECREF(bytecode);
+    return fields;
+}
+
+static PyMethodDef ScanMethods[] = {
+    { "line_range",
+      (PyCFunction)line_range,
+      METH_O,
+      "(first, last) line numbers of the code after the line of its definition, or None if it has no other lines" },
+    { "self_fields",
+      (PyCFunction)self_fields,
+      METH_O,
+      "Names of the attributes that the code stores on its first argument right after loading it" },
+    { NULL, NULL, 0, NULL }
+};
+
+static struct PyModuleDef scan_module = {
+    PyModuleDef_HEAD_INIT, "ddtrace.internal.symbol_db._scan", "native scan of the code objects", -1, ScanMethods
+};
+
+PyMODINIT_FUNC
+PyInit__scan(void)
+{
+    if (op_load_fast < 0 && load_opcodes() < 0)
+        return NULL;
+
+    return PyModule_Create(&scan_module);
+}
@@ -0,0 +1,7 @@
+from types import CodeType
+from typing import Optional
+from typing import Set
+from typing import Tuple
+
+def line_range(code: CodeType) -> Optional[Tuple[int, int]]: ...
+def self_fields(code: CodeType) -> Set[str]: ...
@@ -1,3 +1,4 @@
+from collections import deque
 from dataclasses import asdict
 from dataclasses import dataclass
 from dataclasses import field
@@ -17,6 +18,8 @@ import json
 import os
 from pathlib import Path
 import sys
+from threading import Lock
+from time import monotonic
 from types import CodeType
 from types import FunctionType
 from types import ModuleType
@@ -24,6 +27,7 @@ import typing as t
 
 from ddtrace import config
 from ddtrace.internal import compat
+from ddtrace.internal import forksafe
 from ddtrace.internal import packages
 from ddtrace.internal.agent import get_trace_url
 from ddtrace.internal.compat import singledispatchmethod
@@ -31,6 +35,7 @@ from ddtrace.internal.constants import DEFAULT_SERVICE_NAME
 from ddtrace.internal.logger import get_logger
 from ddtrace.internal.module import BaseModuleWatchdog
 from ddtrace.internal.module import origin
+from ddtrace.internal.periodic import PeriodicService
 from ddtrace.internal.runtime import get_runtime_id
 from ddtrace.internal.safety import _isinstance
 from ddtrace.internal.utils.cache import cached
@@ -42,12 +47,34 @@ from ddtrace.internal.utils.inspection import undecorated
 from ddtrace.settings.symbol_db import config as symdb_config
 
 
+try:
+    from ddtrace.internal.symbol_db._scan import line_range
+    from ddtrace.internal.symbol_db._scan import self_fields
+except ImportError:
+
+    def line_range(code: CodeType) -> t.Optional[t.Tuple[int, int]]:
+        ls = linenos(code)
+        return (min(ls), max(ls)) if ls else None
+
+    def self_fields(code: CodeType) -> t.Set[str]:
+        return {
+            code.co_names[b.arg]
+            for a, b in zip(*(islice(t, i, None) for i, t in enumerate(tee(dis.get_instructions(code), 2))))
+            if a.opname == "LOAD_FAST" and a.arg == 0 and b.opname == "STORE_ATTR"
+        }
+
+
 log = get_logger(__name__)
 
 SOF = 0
 EOF = 2147483647
 
 
+@cached()
+def resolved(filename: str) -> Path:
+    return Path(filename).resolve()
+
+
 @cached()
 def is_from_user_code(obj: t.Any) -> t.Optional[bool]:
     try:
@@ -89,13 +116,7 @@ def get_fields(cls: type) -> t.Set[str]:
 
     # Otherwise, look at the bytecode for the __init__ method.
     try:
-        code = object.__getattribute__(cls, "__init__").__code__
-
-        return {
-            code.co_names[b.arg]
-            for a, b in zip(*(islice(t, i, None) for i, t in enumerate(tee(dis.get_instructions(code), 2))))
-            if a.opname == "LOAD_FAST" and a.arg == 0 and b.opname == "STORE_ATTR"
-        }
+        return self_fields(object.__getattribute__(cls, "__init__").__code__)
     except AttributeError:
         return set()
 
@@ -117,12 +138,16 @@ class Symbol:
     type: t.Optional[str] = None
 
     @classmethod
-    def from_code(cls, code: CodeType) -> t.List["Symbol"]:
+    def from_code(cls, code: CodeType, start_line: t.Optional[int] = None) -> t.List["Symbol"]:
         nargs = code.co_argcount + bool(code.co_flags & CO_VARARGS) + bool(code.co_flags & CO_VARKEYWORDS)
         arg_names = code.co_varnames[:nargs]
         locals_names = code.co_varnames[nargs:]
 
-        start_line = min(linenos(code))
+        if start_line is None:
+            lines = line_range(code)
+            if lines is None:
+                raise ValueError(f"No line numbers for code object {code.co_name}")
+            start_line = lines[0]
 
         return list(
             chain(
@@ -313,24 +338,24 @@ class Scope:
             return None
         data.seen.add(code_id)
 
-        if Path(code.co_filename).resolve() != data.origin:
+        code_origin = resolved(code.co_filename)
+        if code_origin != data.origin:
             # Comes from another module.
             return None
 
-        ls = linenos(code)
-        if not ls:
+        lines = line_range(code)
+        if lines is None:
             return None
 
-        start_line = min(ls)
-        end_line = max(ls)
+        start_line, end_line = lines
 
         return Scope(
             scope_type=ScopeType.CLOSURE,  # DEV: Not in the sense of a Python closure.
             name=code.co_name,
-            source_file=str(Path(code.co_filename).resolve()),
+            source_file=str(code_origin),
             start_line=start_line,
             end_line=end_line,
-            symbols=Symbol.from_code(code),
+            symbols=Symbol.from_code(code, start_line),
             scopes=[
                 _ for _ in (cls._get_from(_, data) for _ in code.co_consts if isinstance(_, CodeType)) if _ is not None
             ],
@@ -525,57 +550,116 @@ def is_module_included(module: ModuleType) -> bool:
     return False
 
 
+class SymbolScanner(PeriodicService):
+    """Scan the modules queued by the uploader in the background.
+
+    The modules are scanned for about ``budget`` seconds every ``interval``,
+    so that the extraction of the symbols of large applications is spread over
+    time instead of taking a burst of CPU right after startup.
+    """
+
+    def __init__(self, uploader: "SymbolDatabaseUploader", interval: float, budget: float) -> None:
+        super().__init__(interval)
+
+        self._uploader = uploader
+        self._budget = budget
+
+    def periodic(self) -> None:
+        self._uploader._scan(monotonic() + self._budget)
+
+
 class SymbolDatabaseUploader(BaseModuleWatchdog):
     __scope_limit__ = 100
+    __scan_interval__ = 0.1  # seconds
+    __scan_budget__ = 0.01  # seconds
 
     def __init__(self) -> None:
         super().__init__()
 
         # Look for all the modules that are already imported when this is
-        # installed and upload the symbols that are marked for inclusion.
-        context = ScopeContext()
-        for module in (_ for _ in list(sys.modules.values()) if is_module_included(_)):
-            try:
-                scope = Scope.from_module(module)
-            except Exception:
-                log.debug("Cannot get symbol scope for module %s", module.__name__, exc_info=True)
-                continue
+        # installed and upload the symbols that are marked for inclusion. The
+        # modules are scanned in the background, as well as those imported
+        # later on.
+        self._pending: t.Deque[ModuleType] = deque(sys.modules.values())
+        self._context = ScopeContext()
+        # The modification times of the files of the modules already scanned,
+        # which are not scanned again unless they change.
+        self._scanned: t.Dict[t.Tuple[str, Path], t.Optional[int]] = {}
+        self._lock = Lock()
+
+        self._scanner = SymbolScanner(self, self.__scan_interval__, self.__scan_budget__)
+        self._scanner.start()
+        forksafe.register(self._restart_scanner)
+
+    def _restart_scanner(self) -> None:
+        # The scanning thread does not survive a fork, and might have held the
+        # lock when it happened.
+        self._lock = Lock()
+        self._scanner = SymbolScanner(self, self.__scan_interval__, self.__scan_budget__)
+        self._scanner.start()
+
+    def _module_scope(self, module: ModuleType) -> t.Optional[Scope]:
+        if not is_module_included(module):
+            return None
 
-            if scope is not None:
-                log.debug("[PID %d] SymDB: Adding Symbol DB module scope %r", os.getpid(), scope.name)
-                context.add_scope(scope)
+        module_origin = origin(module)
+        if module_origin is None:
+            return None
+
+        try:
+            mtime: t.Optional[int] = module_origin.stat().st_mtime_ns
+        except OSError:
+            mtime = None
+        key = (module.__name__, module_origin)
+        if key in self._scanned and self._scanned[key] == mtime:
+            log.debug("[PID %d] SymDB: Module %s already scanned", os.getpid(), module.__name__)
+            return None
+        self._scanned[key] = mtime
+
+        return Scope.from_module(module)
 
-            # Batching: send at most 100 module scopes at a time
-            n = len(context)
-            if n >= self.__scope_limit__:
-                log.debug("[PID %d] SymDB: Flushing batch of %d module scopes", os.getpid(), n)
+    def _scan(self, deadline: float) -> None:
+        """Scan the pending modules until the deadline, on the monotonic clock."""
+        with self._lock:
+            while self._pending and monotonic() < deadline:
+                module = self._pending.popleft()
                 try:
-                    self._upload_context(context)
+                    scope = self._module_scope(module)
                 except Exception:
-                    log.error(
-                        "[PID %d] SymDB: Failed to upload symbols context with %d scopes", os.getpid(), n, exc_info=True
-                    )
-                    return
-                context = ScopeContext()
+                    log.debug("Cannot get symbol scope for module %s", module.__name__, exc_info=True)
+                    continue
 
-        try:
-            self._upload_context(context)
-        except Exception:
-            log.error(
-                "[PID %d] SymDB: Failed to upload symbols context with %d scopes",
-                os.getpid(),
-                len(context),
-                exc_info=True,
-            )
+                if scope is not None:
+                    log.debug("[PID %d] SymDB: Adding Symbol DB module scope %r", os.getpid(), scope.name)
+                    self._context.add_scope(scope)
+
+                # Batching: send at most 100 module scopes at a time
+                n = len(self._context)
+                if n >= self.__scope_limit__:
+                    log.debug("[PID %d] SymDB: Flushing batch of %d module scopes", os.getpid(), n)
+                    self._flush()
+
+            # Upload the scopes collected so far once all the modules have been
+            # scanned.
+            if not self._pending:
+                self._flush()
+
+    def _flush(self) -> None:
+        context, self._context = self._context, ScopeContext()
+        self._upload_context(context)
 
     def after_import(self, module: ModuleType) -> None:
-        if not is_module_included(module):
-            log.debug("[PID %d] SymDB: Excluding imported module %s from symbol database", os.getpid(), module.__name__)
-            return
+        self._pending.append(module)
 
-        scope = Scope.from_module(module)
-        if scope is not None:
-            self._upload_context(ScopeContext([scope]))
+    @classmethod
+    def uninstall(cls) -> None:
+        uploader = t.cast(SymbolDatabaseUploader, cls._instance)
+
+        super().uninstall()
+
+        if uploader is not None:
+            forksafe.unregister(uploader._restart_scanner)
+            uploader._scanner.stop()
 
     @staticmethod
     def _upload_context(context: ScopeContext) -> None:
@@ -0,0 +1,118 @@
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+/* Native counters of the telemetry count metrics.
+
+   A counter accumulates the values added to a count metric between two flushes of the telemetry writer. Adding to
+   it is a C call that doesn't release the GIL, so it needs no lock, and the flush takes the total and resets the
+   counter in the same way. The counter also remembers when the first value of the interval was added, which is the
+   timestamp of the point of the metric. */
+
+typedef struct
+{
+    PyObject_HEAD
+
+    double total;
+    /* What time.time() returned when the first value since the last take was added, or NULL if none was */
+    PyObject* first;
+} Counter;
+
+static PyObject* time_module = NULL;
+
+static PyObject*
+Counter_add(Counter* self, PyObject* const* args, Py_ssize_t nargs)
+{
+    double value = 1.0;
+
+    if (nargs > 1) {
+        PyErr_Format(PyExc_TypeError, "add expected at most 1 argument, got %zd", nargs);
+        return NULL;
+    }
+    if (nargs == 1) {
+        value = PyFloat_AsDouble(args[0]);
+        if (value == -1.0 && PyErr_Occurred())
+            return NULL;
+    }
+
+    /* time.time() is looked up on each call, as the telemetry tests mock it */
+    if (self->first == NULL && (self->first = PyObject_CallMethod(time_module, "time", NULL)) == NULL)
+        return NULL;
+    self->total += value;
+
+    Py_RETURN_NONE;
+}
+
+static PyObject*
+Counter_take(Counter* self, PyObject* Py_UNUSED(args))
+{
+    PyObject* result;
+
+    if (self->first == NULL)
+        Py_RETURN_NONE;
+
+    result = Py_BuildValue("(Od)", self->first, self->total);
+    if (result == NULL)
+        return NULL;
+
+    Py_CLEAR(self->first);
+    self->total = 0.0;
+
+    return result;
+}
+
+static void
+Counter_dealloc(Counter* self)
+{
+    Py_XDECREF(self->first);
+    Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+static PyMethodDef Counter_methods[] = {
+    { "add", (PyCFunction)(void (*)(void))Counter_add, METH_FASTCALL, "Add a value to the counter" },
+    { "take",
+      (PyCFunction)Counter_take,
+      METH_NOARGS,
+      "Return the time of the first value added and the total since the last take, or None if there was none, and "
+      "reset the counter" },
+    { NULL, NULL, 0, NULL }
+};
+
+static PyTypeObject CounterType = {
+    PyVarObject_HEAD_INIT(NULL, 0).tp_name = "ddtrace.internal.telemetry._counters.Counter",
+    .tp_doc = "The counter of a telemetry count metric",
+    .tp_basicsize = sizeof(Counter),
+    .tp_itemsize = 0,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_new = PyType_GenericNew,
+    .tp_dealloc = (destructor)Counter_dealloc,
+    .tp_methods = Counter_methods,
+};
+
+static struct PyModuleDef counters_module = {
+    PyModuleDef_HEAD_INIT, "ddtrace.internal.telemetry._counters", "native telemetry counters", -1, NULL
+};
+
+PyMODINIT_FUNC
+PyInit__counters(void)
+{
+    PyObject* m;
+
+    if (PyType_Ready(&CounterType) < 0)
+        return NULL;
+
+    if (time_module == NULL && (time_module = PyImport_ImportModule("time")) == NULL)
+        return NULL;
+
+    m = PyModule_Create(&counters_module);
+    if (m == NULL)
+        return NULL;
+
+    Py_INCREF(&CounterType);
+    if (PyModule_AddObject(m, "Counter", (PyObject*)&CounterType) < 0) {
+        Py_DECREF(&CounterType);
+        Py_DECREF(m);
+        return NULL;
+    }
+
+    return m;
+}
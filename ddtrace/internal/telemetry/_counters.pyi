@@ -0,0 +1,5 @@
+import typing as t
+
+class Counter:
+    def add(self, value: float = 1.0) -> None: ...
+    def take(self) -> t.Optional[t.Tuple[float, float]]: ...
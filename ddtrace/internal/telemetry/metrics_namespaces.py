@@ -1,45 +1,118 @@
 from collections import defaultdict
+import time
 from typing import Any  # noqa:F401
 from typing import Dict  # noqa:F401
 from typing import Optional  # noqa:F401
+from typing import Tuple  # noqa:F401
 from typing import Type  # noqa:F401
 
 from ddtrace.internal import forksafe
 from ddtrace.internal.telemetry.constants import TELEMETRY_TYPE_DISTRIBUTION
 from ddtrace.internal.telemetry.constants import TELEMETRY_TYPE_GENERATE_METRICS
+from ddtrace.internal.telemetry.metrics import CountMetric
 from ddtrace.internal.telemetry.metrics import DistributionMetric
 from ddtrace.internal.telemetry.metrics import Metric
 from ddtrace.internal.telemetry.metrics import MetricTagType  # noqa:F401
 
 
+try:
+    from ddtrace.internal.telemetry._counters import Counter
+except ImportError:
+
+    class Counter:  # type: ignore[no-redef]
+        __slots__ = ["_lock", "_point"]
+
+        def __init__(self):
+            # type: () -> None
+            self._lock = forksafe.Lock()
+            self._point = None  # type: Optional[Tuple[float, float]]
+
+        def add(self, value=1.0):
+            # type: (float) -> None
+            with self._lock:
+                self._point = (self._point[0], self._point[1] + value) if self._point else (time.time(), value)
+
+        def take(self):
+            # type: () -> Optional[Tuple[float, float]]
+            with self._lock:
+                point, self._point = self._point, None
+                return point
+
+
 NamespaceMetricType = Dict[str, Dict[str, Dict[str, Any]]]
 
 
 class MetricNamespace:
+    """
+    The count metrics are accumulated in counters, which are registered once per metric and then added to without
+    taking the lock of the namespace. They are collected into the metrics data when it is read or flushed.
+    """
+
     def __init__(self):
         # type: () -> None
         self._lock = forksafe.Lock()  # type: forksafe.ResetObject
-        self._metrics_data = {
+        self._data = {
             TELEMETRY_TYPE_GENERATE_METRICS: defaultdict(dict),
             TELEMETRY_TYPE_DISTRIBUTION: defaultdict(dict),
         }  # type: Dict[str, Dict[str, Dict[int, Metric]]]
+        self._counters = {}  # type: Dict[int, Tuple[Counter, str, str, MetricTagType]]
+
+    @property
+    def _metrics_data(self):
+        # type: () -> Dict[str, Dict[str, Dict[int, Metric]]]
+        with self._lock:
+            self._collect_counters()
+            return self._data
+
+    def _collect_counters(self):
+        # type: () -> None
+        metrics = self._data[TELEMETRY_TYPE_GENERATE_METRICS]
+        for metric_id, (counter, namespace, name, tags) in self._counters.items():
+            point = counter.take()
+            if point is None:
+                continue
+            metric = metrics[namespace].get(metric_id)
+            if metric is None:
+                metric = metrics[namespace][metric_id] = CountMetric(namespace, name, tags=tags, common=True)
+                metric._points = [list(point)]
+            else:
+                metric.add_point(point[1])
 
     def flush(self):
         # type: () -> Dict
         with self._lock:
-            namespace_metrics = self._metrics_data
-            self._metrics_data = {
+            self._collect_counters()
+            namespace_metrics = self._data
+            self._data = {
                 TELEMETRY_TYPE_GENERATE_METRICS: defaultdict(dict),
                 TELEMETRY_TYPE_DISTRIBUTION: defaultdict(dict),
             }
             return namespace_metrics
 
+    def counter(self, namespace, name, tags=None):
+        # type: (str, str, MetricTagType) -> Counter
+        """
+        Return the counter of a count metric, which can be kept to add to the metric without looking it up again.
+        """
+        metric_id = Metric.get_id(name, namespace, tags, CountMetric.metric_type)
+        try:
+            return self._counters[metric_id][0]
+        except KeyError:
+            with self._lock:
+                if metric_id not in self._counters:
+                    self._counters[metric_id] = (Counter(), namespace, name, tags)
+                return self._counters[metric_id][0]
+
     def add_metric(self, metric_class, namespace, name, value=1.0, tags=None, interval=None):
         # type: (Type[Metric], str, str, float, MetricTagType, Optional[float]) -> None
         """
         Telemetry Metrics are stored in DD dashboards, check the metrics in datadoghq.com/metric/explorer.
         The metric will store in dashboard as "dd.instrumentation_telemetry_data." + namespace + "." + name
         """
+        if metric_class is CountMetric:
+            self.counter(namespace, name, tags).add(value)
+            return
+
         metric_id = Metric.get_id(name, namespace, tags, metric_class.metric_type)
         if metric_class is DistributionMetric:
             metrics_type_payload = TELEMETRY_TYPE_DISTRIBUTION
@@ -47,10 +120,10 @@ class MetricNamespace:
             metrics_type_payload = TELEMETRY_TYPE_GENERATE_METRICS
 
         with self._lock:
-            existing_metric = self._metrics_data[metrics_type_payload][namespace].get(metric_id)
+            existing_metric = self._data[metrics_type_payload][namespace].get(metric_id)
             if existing_metric:
                 existing_metric.add_point(value)
             else:
                 new_metric = metric_class(namespace, name, tags=tags, common=True, interval=interval)
                 new_metric.add_point(value)
-                self._metrics_data[metrics_type_payload][namespace][metric_id] = new_metric
+                self._data[metrics_type_payload][namespace][metric_id] = new_metric
@@ -100,6 +100,7 @@ from .metrics import DistributionMetric
 from .metrics import GaugeMetric
 from .metrics import MetricTagType  # noqa:F401
 from .metrics import RateMetric
+from .metrics_namespaces import Counter  # noqa:F401
 from .metrics_namespaces import MetricNamespace
 from .metrics_namespaces import NamespaceMetricType  # noqa:F401
 
@@ -687,6 +688,15 @@ class TelemetryWriter(PeriodicService):
                 tags,
             )
 
+    def count_metric(self, namespace, name, tags=None):
+        # type: (str, str, MetricTagType) -> Counter
+        """
+        Returns the counter of a count metric, which can be kept and added to without looking the metric up again
+        """
+        if self.status != ServiceStatus.RUNNING:
+            self.enable()
+        return self._namespace.counter(namespace, name, tags)
+
     def add_distribution_metric(self, namespace, name, value=1.0, tags=None):
         # type: (str,str, float, MetricTagType) -> None
         """
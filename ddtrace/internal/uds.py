@@ -1,10 +1,22 @@
+import os
 import socket
+import sys
 from typing import Any  # noqa:F401
+from typing import List  # noqa:F401
+from typing import Optional  # noqa:F401
+from typing import Union  # noqa:F401
 
 from .compat import httplib
 from .http import BasePathMixin
 
 
+try:
+    # Maximum number of buffers a single sendmsg can take
+    IOV_MAX = os.sysconf("SC_IOV_MAX")
+except (AttributeError, ValueError, OSError):
+    IOV_MAX = 1024
+
+
 class UDSHTTPConnection(BasePathMixin, httplib.HTTPConnection):
     """An HTTP connection established over a Unix Domain Socket."""
 
@@ -25,3 +37,70 @@ class UDSHTTPConnection(BasePathMixin, httplib.HTTPConnection):
         sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
         sock.connect(self.path)
         self.sock = sock
+
+    def _send_output(self, message_body=None, encode_chunked=False):
+        # type: (Any, bool) -> None
+        """Send the request headers and body with as few system calls as possible.
+
+        http.client sends the headers and each chunk of the body separately,
+        and copies the chunks to frame them with chunked transfer encoding.
+        The headers and the chunks of bytes-like bodies and of iterables of
+        them, like the chunks of an encoded payload, are gathered here in
+        sendmsg calls straight from their memory instead.
+        """
+        if not hasattr(socket.socket, "sendmsg") or isinstance(message_body, str) or hasattr(message_body, "read"):
+            return super(UDSHTTPConnection, self)._send_output(message_body, encode_chunked)
+
+        if message_body is None:
+            chunks = ()  # type: Any
+        else:
+            try:
+                memoryview(message_body)
+            except TypeError:
+                chunks = message_body
+            else:
+                chunks = (message_body,)
+
+        self._buffer.extend((b"", b""))
+        buffers = [b"\r\n".join(self._buffer)]  # type: List[Union[bytes, memoryview]]
+        del self._buffer[:]
+
+        encode_chunked = encode_chunked and self._http_vsn == 11
+        for chunk in chunks:
+            if not chunk:
+                continue
+            if encode_chunked:
+                buffers.append(b"%X\r\n" % len(chunk))
+                buffers.append(chunk)
+                buffers.append(b"\r\n")
+            else:
+                buffers.append(chunk)
+        if encode_chunked:
+            buffers.append(b"0\r\n\r\n")
+
+        self._sendmsg_all(buffers)
+
+    def _sendmsg_all(self, buffers):
+        # type: (List[Union[bytes, memoryview]]) -> None
+        if self.sock is None:
+            if self.auto_open:
+                self.connect()
+            else:
+                raise httplib.NotConnected()
+
+        if hasattr(sys, "audit"):
+            for data in buffers:
+                sys.audit("http.client.send", self, data)
+
+        views = [memoryview(data).cast("B") for data in buffers]
+        first = 0
+        while first < len(views):
+            sent = self.sock.sendmsg(views[first : first + IOV_MAX])
+            # Skip what was sent; a stream socket can take only part of the data
+            while sent:
+                size = len(views[first])
+                if sent < size:
+                    views[first] = views[first][sent:]
+                    break
+                sent -= size
+                first += 1
@@ -0,0 +1,313 @@
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+/* Native dispatch of the wrapping contexts.
+
+   The bytecode of a function wrapped by a _UniversalWrappingContext calls into the dispatcher of the context on entry,
+   on return and on exit, which then calls the methods of the registered contexts, as the Python methods of the
+   universal context do. The dispatcher methods are C functions, called through vectorcall, so no Python frame is
+   pushed for them, and the frame of the wrapped function is the one executing when they are called. The storage of the
+   universal context is shared with the Python methods, which get() and set() keep using. */
+
+typedef struct
+{
+    PyObject_HEAD
+
+    /* The ContextVar of the storage stack of the universal context */
+    PyObject* storage_stack;
+    /* The list of the registered contexts, ordered by priority */
+    PyObject* contexts;
+} Dispatcher;
+
+static PyObject* enter_str = NULL;
+static PyObject* return_str = NULL;
+static PyObject* exit_str = NULL;
+static PyObject* frame_str = NULL;
+
+static inline int
+check_init(Dispatcher* self)
+{
+    if (self->contexts == NULL) {
+        PyErr_SetString(PyExc_RuntimeError, "dispatcher not initialized");
+        return -1;
+    }
+    return 0;
+}
+
+static PyObject*
+storage(Dispatcher* self)
+{
+    PyObject* stack = NULL;
+
+    if (PyContextVar_Get(self->storage_stack, NULL, &stack) < 0)
+        return NULL;
+
+    if (stack == NULL || !PyList_Check(stack)) {
+        PyErr_SetString(PyExc_RuntimeError, "wrapping context storage stack is not set");
+        Py_XDECREF(stack);
+        return NULL;
+    }
+
+    return stack;
+}
+
+static int
+pop_storage(Dispatcher* self)
+{
+    PyObject* stack = storage(self);
+    Py_ssize_t size;
+    int result;
+
+    if (stack == NULL)
+        return -1;
+
+    size = PyList_GET_SIZE(stack);
+    if (size == 0) {
+        PyErr_SetString(PyExc_IndexError, "pop from empty list");
+        Py_DECREF(stack);
+        return -1;
+    }
+
+    result = PyList_SetSlice(stack, size - 1, size, NULL);
+    Py_DECREF(stack);
+    return result;
+}
+
+/* Call the named method of every context, in reverse order of priority if reverse is set */
+static int
+call_contexts(Dispatcher* self, PyObject* name, int reverse, PyObject* const* args, Py_ssize_t nargs)
+{
+    Py_ssize_t i;
+
+    /* The list can change while the contexts are called, so it is indexed afresh each time */
+    for (i = 0; i < PyList_GET_SIZE(self->contexts); i++) {
+        Py_ssize_t size = PyList_GET_SIZE(self->contexts);
+        PyObject* context = PyList_GET_ITEM(self->contexts, reverse ? size - 1 - i : i);
+        PyObject* result;
+
+        Py_INCREF(context);
+        switch (nargs) {
+            case 0:
+                result = PyObject_CallMethodObjArgs(context, name, NULL);
+                break;
+            case 1:
+                result = PyObject_CallMethodObjArgs(context, name, args[0], NULL);
+                break;
+            default:
+                result = PyObject_CallMethodObjArgs(context, name, args[0], args[1], args[2], NULL);
+                break;
+        }
+        Py_DECREF(context);
+
+        if (result == NULL)
+            return -1;
+        Py_DECREF(result);
+    }
+
+    return 0;
+}
+
+static PyObject*
+Dispatcher_enter(Dispatcher* self, PyObject* Py_UNUSED(args))
+{
+    PyObject* frame = (PyObject*)PyEval_GetFrame();
+    PyObject* stack;
+    PyObject* store;
+    int result;
+
+    if (check_init(self) < 0 || (stack = storage(self)) == NULL)
+        return NULL;
+
+    if ((store = PyDict_New()) == NULL) {
+        Py_DECREF(stack);
+        return NULL;
+    }
+
+    /* Make the frame of the wrapped function available to the contexts */
+    result = PyDict_SetItem(store, frame_str, frame != NULL ? frame : Py_None);
+    if (result == 0)
+        result = PyList_Append(stack, store);
+    Py_DECREF(store);
+    Py_DECREF(stack);
+    if (result < 0)
+        return NULL;
+
+    if (call_contexts(self, enter_str, 0, NULL, 0) < 0)
+        return NULL;
+
+    Py_INCREF(self);
+    return (PyObject*)self;
+}
+
+static PyObject*
+Dispatcher_return(Dispatcher* self, PyObject* value)
+{
+    if (check_init(self) < 0 || call_contexts(self, return_str, 1, &value, 1) < 0 || pop_storage(self) < 0)
+        return NULL;
+
+    Py_INCREF(value);
+    return value;
+}
+
+static PyObject*
+dispatch_exit(Dispatcher* self, PyObject* const* exc)
+{
+    /* The with statement of Python 3.7 exits the context this way when the function returns */
+    if (exc[0] == Py_None && exc[1] == Py_None && exc[2] == Py_None)
+        Py_RETURN_NONE;
+
+    if (check_init(self) < 0 || call_contexts(self, exit_str, 1, exc, 3) < 0 || pop_storage(self) < 0)
+        return NULL;
+
+    Py_RETURN_NONE;
+}
+
+static PyObject*
+Dispatcher_exit(Dispatcher* self, PyObject* const* args, Py_ssize_t nargs)
+{
+    PyObject* exc[3] = { Py_None, Py_None, Py_None };
+    Py_ssize_t i;
+
+    if (nargs > 3) {
+        PyErr_Format(PyExc_TypeError, "__exit__ expected at most 3 arguments, got %zd", nargs);
+        return NULL;
+    }
+    for (i = 0; i < nargs; i++)
+        exc[i] = args[i];
+
+    return dispatch_exit(self, exc);
+}
+
+/* Exit with the exception being handled, as the with statement would */
+static PyObject*
+Dispatcher__exit(Dispatcher* self, PyObject* Py_UNUSED(args))
+{
+    PyObject *type, *value, *traceback;
+    PyObject* result;
+
+    PyErr_GetExcInfo(&type, &value, &traceback);
+    {
+        PyObject* exc[3] = { type != NULL ? type : Py_None,
+                             value != NULL ? value : Py_None,
+                             traceback != NULL ? traceback : Py_None };
+
+        result = dispatch_exit(self, exc);
+    }
+    Py_XDECREF(type);
+    Py_XDECREF(value);
+    Py_XDECREF(traceback);
+
+    return result;
+}
+
+static int
+Dispatcher_init(Dispatcher* self, PyObject* args, PyObject* kwargs)
+{
+    static char* kwlist[] = { "storage_stack", "contexts", NULL };
+    PyObject* storage_stack = NULL;
+    PyObject* contexts = NULL;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OO!", kwlist, &storage_stack, &PyList_Type, &contexts))
+        return -1;
+
+    if (!PyContextVar_CheckExact(storage_stack)) {
+        PyErr_SetString(PyExc_TypeError, "storage_stack must be a ContextVar");
+        return -1;
+    }
+
+    Py_INCREF(storage_stack);
+    Py_XSETREF(self->storage_stack, storage_stack);
+    Py_INCREF(contexts);
+    Py_XSETREF(self->contexts, contexts);
+
+    return 0;
+}
+
+static int
+Dispatcher_traverse(Dispatcher* self, visitproc visit, void* arg)
+{
+    Py_VISIT(self->storage_stack);
+    Py_VISIT(self->contexts);
+    return 0;
+}
+
+static int
+Dispatcher_clear(Dispatcher* self)
+{
+    Py_CLEAR(self->storage_stack);
+    Py_CLEAR(self->contexts);
+    return 0;
+}
+
+static void
+Dispatcher_dealloc(Dispatcher* self)
+{
+    PyObject_GC_UnTrack(self);
+    Dispatcher_clear(self);
+    Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+static PyMethodDef Dispatcher_methods[] = {
+    { "__enter__", (PyCFunction)Dispatcher_enter, METH_NOARGS, "Enter the registered contexts" },
+    { "__return__",
+      (PyCFunction)Dispatcher_return,
+      METH_O,
+      "Pass the return value to the registered contexts and return it" },
+    { "__exit__",
+      (PyCFunction)(void (*)(void))Dispatcher_exit,
+      METH_FASTCALL,
+      "Exit the registered contexts with the given exception" },
+    { "_exit",
+      (PyCFunction)Dispatcher__exit,
+      METH_NOARGS,
+      "Exit the registered contexts with the exception being handled" },
+    { NULL, NULL, 0, NULL }
+};
+
+static PyTypeObject DispatcherType = {
+    PyVarObject_HEAD_INIT(NULL, 0).tp_name = "ddtrace.internal.wrapping._context.Dispatcher",
+    .tp_doc = "The native entry, return and exit points of a universal wrapping context",
+    .tp_basicsize = sizeof(Dispatcher),
+    .tp_itemsize = 0,
+    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_GC,
+    .tp_new = PyType_GenericNew,
+    .tp_init = (initproc)Dispatcher_init,
+    .tp_dealloc = (destructor)Dispatcher_dealloc,
+    .tp_traverse = (traverseproc)Dispatcher_traverse,
+    .tp_clear = (inquiry)Dispatcher_clear,
+    .tp_methods = Dispatcher_methods,
+};
+
+static struct PyModuleDef context_module = {
+    PyModuleDef_HEAD_INIT, "ddtrace.internal.wrapping._context", "native dispatch of the wrapping contexts", -1, NULL
+};
+
+PyMODINIT_FUNC
+PyInit__context(void)
+{
+    PyObject* m;
+
+    if (PyType_Ready(&DispatcherType) < 0)
+        return NULL;
+
+    if (enter_str == NULL) {
+        if ((enter_str = PyUnicode_InternFromString("__enter__")) == NULL ||
+            (return_str = PyUnicode_InternFromString("__return__")) == NULL ||
+            (exit_str = PyUnicode_InternFromString("__exit__")) == NULL ||
+            (frame_str = PyUnicode_InternFromString("__frame__")) == NULL)
+            return NULL;
+    }
+
+    m = PyModule_Create(&context_module);
+    if (m == NULL)
+        return NULL;
+
+    Py_INCREF(&DispatcherType);
+    if (PyModule_AddObject(m, "Dispatcher", (PyObject*)&DispatcherType) < 0) {
+        Py_DECREF(&DispatcherType);
+        Py_DECREF(m);
+        return NULL;
+    }
+
+    return m;
+}
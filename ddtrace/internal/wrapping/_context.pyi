@@ -0,0 +1,17 @@
+from contextvars import ContextVar
+from types import TracebackType
+import typing as t
+
+T = t.TypeVar("T")
+
+class Dispatcher:
+    def __init__(self, storage_stack: ContextVar, contexts: t.List[t.Any]) -> None: ...
+    def __enter__(self) -> "Dispatcher": ...
+    def __return__(self, value: T) -> T: ...
+    def __exit__(
+        self,
+        exc_type: t.Optional[t.Type[BaseException]],
+        exc_val: t.Optional[BaseException],
+        exc_tb: t.Optional[TracebackType],
+    ) -> None: ...
+    def _exit(self) -> None: ...
@@ -18,6 +18,12 @@ from bytecode import Bytecode
 from ddtrace.internal.assembly import Assembly
 
 
+try:
+    from ddtrace.internal.wrapping._context import Dispatcher
+except ImportError:
+    Dispatcher = None  # type: ignore[assignment,misc]
+
+
 T = t.TypeVar("T")
 
 # This module implements utilities for wrapping a function with a context
@@ -46,6 +52,10 @@ T = t.TypeVar("T")
 # - No intermediate function calls that pollute the call stack.
 # - No need to call the wrapped function manually.
 #
+# The calls on entry, return and exit are made to the dispatcher of the context,
+# which is native when the extension is available, so that no Python frame is
+# pushed for them. Otherwise the dispatcher is the context itself.
+#
 # The actual bytecode wrapping is performed once on a target function via a
 # universal wrapping context. Multiple context wrapping of a function is allowed
 # and it is virtually implemented on top of the concrete universal wrapping
@@ -370,6 +380,8 @@ class _UniversalWrappingContext(BaseWrappingContext):
 
         self._contexts: t.List[WrappingContext] = []
 
+        self._dispatcher: t.Any = Dispatcher(self._storage_stack, self._contexts) if Dispatcher is not None else self
+
     def register(self, context: WrappingContext) -> None:
         _type = type(context)
         if any(isinstance(c, _type) for c in self._contexts):
@@ -453,10 +465,12 @@ class _UniversalWrappingContext(BaseWrappingContext):
                 instr = bc[i]
                 try:
                     if instr.name == "RETURN_VALUE":
-                        return_code = CONTEXT_RETURN.bind({"context_return": self.__return__}, lineno=instr.lineno)
+                        return_code = CONTEXT_RETURN.bind(
+                            {"context_return": self._dispatcher.__return__}, lineno=instr.lineno
+                        )
                     elif sys.version_info >= (3, 12) and instr.name == "RETURN_CONST":  # Python 3.12+
                         return_code = CONTEXT_RETURN_CONST.bind(
-                            {"context_return": self.__return__, "value": instr.arg}, lineno=instr.lineno
+                            {"context_return": self._dispatcher.__return__, "value": instr.arg}, lineno=instr.lineno
                         )
                     else:
                         return_code = []
@@ -479,7 +493,9 @@ class _UniversalWrappingContext(BaseWrappingContext):
             else:
                 i = 0
 
-            bc[i:i] = CONTEXT_HEAD.bind({"context_enter": self.__enter__}, lineno=f.__code__.co_firstlineno)
+            bc[i:i] = CONTEXT_HEAD.bind(
+                {"context_enter": self._dispatcher.__enter__}, lineno=f.__code__.co_firstlineno
+            )
 
             # Wrap every line outside a try block
             except_label = bytecode.Label()
@@ -507,7 +523,7 @@ class _UniversalWrappingContext(BaseWrappingContext):
 
             bc.append(bytecode.TryEnd(last_try_begin))
             bc.append(except_label)
-            bc.extend(CONTEXT_FOOT.bind({"context_exit": self._exit}))
+            bc.extend(CONTEXT_FOOT.bind({"context_exit": self._dispatcher._exit}))
 
             # Mark the function as wrapped by a wrapping context
             t.cast(ContextWrappedFunction, f).__dd_context_wrapped__ = self
@@ -544,10 +560,10 @@ class _UniversalWrappingContext(BaseWrappingContext):
                     i += 1
 
             # Remove the head of the try block
-            wc = wrapped.__dd_context_wrapped__
+            dispatcher = t.cast(_UniversalWrappingContext, wrapped.__dd_context_wrapped__)._dispatcher
             for i, instr in enumerate(bc):
                 try:
-                    if instr.name == "LOAD_CONST" and instr.arg is wc:
+                    if instr.name == "LOAD_CONST" and instr.arg is dispatcher:
                         break
                 except AttributeError:
                     # Not an instruction
@@ -608,7 +624,7 @@ class _UniversalWrappingContext(BaseWrappingContext):
                 instr = bc[i]
                 try:
                     if instr.name == "RETURN_VALUE":
-                        return_code = CONTEXT_RETURN.bind({"context": self}, lineno=instr.lineno)
+                        return_code = CONTEXT_RETURN.bind({"context": self._dispatcher}, lineno=instr.lineno)
                     else:
                         return_code = []
 
@@ -630,7 +646,7 @@ class _UniversalWrappingContext(BaseWrappingContext):
                         # Not an instruction
                         pass
 
-            *bc[i:i], except_label = CONTEXT_HEAD.bind({"context": self}, lineno=f.__code__.co_firstlineno)
+            *bc[i:i], except_label = CONTEXT_HEAD.bind({"context": self._dispatcher}, lineno=f.__code__.co_firstlineno)
 
             bc.append(except_label)
             bc.extend(CONTEXT_FOOT.bind())
@@ -656,10 +672,10 @@ class _UniversalWrappingContext(BaseWrappingContext):
             bc.pop()
 
             # Remove the head of the try block
-            wc = wrapped.__dd_context_wrapped__
+            dispatcher = t.cast(_UniversalWrappingContext, wrapped.__dd_context_wrapped__)._dispatcher
             for i, instr in enumerate(bc):
                 try:
-                    if instr.name == "LOAD_CONST" and instr.arg is wc:
+                    if instr.name == "LOAD_CONST" and instr.arg is dispatcher:
                         break
                 except AttributeError:
                     # Not an instruction
@@ -11,6 +11,8 @@ from typing import Dict  # noqa:F401
 from typing import List  # noqa:F401
 from typing import Optional  # noqa:F401
 from typing import TextIO  # noqa:F401
+from typing import Union  # noqa:F401
+import zlib
 
 import ddtrace
 from ddtrace.internal.utils.retry import fibonacci_backoff_with_jitter
@@ -27,6 +29,8 @@ from .. import periodic
 from .. import service
 from .._encoding import BufferFull
 from .._encoding import BufferItemTooLarge
+from .._encoding import EncodedPayload
+from .._encoding import TraceQueue
 from ..agent import get_connection
 from ..constants import _HTTPLIB_NO_TRACE_REQUEST
 from ..encoding import JSONEncoderV2
@@ -65,6 +69,22 @@ class NoEncodableSpansError(Exception):
 # to 10 buckets of 1s duration.
 DEFAULT_SMA_WINDOW = 10
 
+# Size of the chunks payloads are streamed in with chunked transfer encoding
+STREAMED_CHUNK_SIZE = 64 << 10
+
+# Payloads are compressed on the thread of the writer, the fastest level already removes most of the repeated strings
+GZIP_COMPRESSION_LEVEL = 1
+
+
+def _gzip_chunks(chunks):
+    # A window of 31 bits makes zlib write the gzip container expected with Content-Encoding: gzip
+    compressor = zlib.compressobj(GZIP_COMPRESSION_LEVEL, zlib.DEFLATED, 31)
+    for chunk in chunks:
+        compressed = compressor.compress(chunk)
+        if compressed:
+            yield compressed
+    yield compressor.flush()
+
 
 def _human_size(nbytes):
     """Return a human-readable size."""
@@ -140,6 +160,8 @@ class HTTPWriter(periodic.PeriodicService, TraceWriter):
     """Writer to an arbitrary HTTP intake endpoint."""
 
     RETRY_ATTEMPTS = 3
+    # Number of traces queued before the thread writing the next one encodes them
+    TRACE_QUEUE_SIZE = 1024
     HTTP_METHOD = "PUT"
     STATSD_NAMESPACE = "tracer"
 
@@ -181,6 +203,9 @@ class HTTPWriter(periodic.PeriodicService, TraceWriter):
         # the periodic thread of HTTPWriter and other threads that might
         # force a flush with `flush_queue()`.
         self._conn_lck = threading.RLock()  # type: threading.RLock
+        # Finished traces are queued so that the threads writing them don't wait for the encoders
+        self._trace_queue = TraceQueue(self.TRACE_QUEUE_SIZE)
+        self._trace_queue_lck = threading.Lock()
 
         self._send_payload_with_backoff = fibonacci_backoff_with_jitter(  # type ignore[assignment]
             attempts=self.RETRY_ATTEMPTS,
@@ -191,6 +216,8 @@ class HTTPWriter(periodic.PeriodicService, TraceWriter):
         self._reuse_connections = (
             config._trace_writer_connection_reuse if reuse_connections is None else reuse_connections
         )
+        self._chunked_transfer = config._trace_writer_chunked_transfer
+        self._compression = config._trace_writer_compression
 
     def _intake_endpoint(self, client=None):
         return "{}/{}".format(self._intake_url(client), client.ENDPOINT if client else self._endpoint)
@@ -237,7 +264,7 @@ class HTTPWriter(periodic.PeriodicService, TraceWriter):
                 self._conn = None
 
     def _put(self, data, headers, client, no_trace):
-        # type: (bytes, Dict[str, str], WriterClientBase, bool) -> Response
+        # type: (Union[bytes, EncodedPayload], Dict[str, str], WriterClientBase, bool) -> Response
         sw = StopWatch()
         sw.start()
         with self._conn_lck:
@@ -247,10 +274,25 @@ class HTTPWriter(periodic.PeriodicService, TraceWriter):
                 setattr(self._conn, _HTTPLIB_NO_TRACE_REQUEST, no_trace)
             try:
                 log.debug("Sending request: %s %s %s", self.HTTP_METHOD, client.ENDPOINT, headers)
+                body = data
+                if self._compression:
+                    headers = dict(headers, **{"Content-Encoding": "gzip"})
+                    chunks = data.chunks(STREAMED_CHUNK_SIZE) if isinstance(data, EncodedPayload) else (data,)
+                    body = _gzip_chunks(chunks)
+                    if not self._chunked_transfer:
+                        body = b"".join(body)
+                elif isinstance(data, EncodedPayload):
+                    # Send the chunks of the payload one after the other rather than joining them. Without a
+                    # Content-Length header, http.client streams them with chunked transfer encoding.
+                    if self._chunked_transfer:
+                        body = data.chunks(STREAMED_CHUNK_SIZE)
+                    else:
+                        headers = dict(headers, **{"Content-Length": str(len(data))})
+                        body = data.chunks()
                 self._conn.request(
                     self.HTTP_METHOD,
                     client.ENDPOINT,
-                    data,
+                    body,
                     headers,
                 )
                 resp = compat.get_connection_response(self._conn)
@@ -287,6 +329,15 @@ class HTTPWriter(periodic.PeriodicService, TraceWriter):
         self._metrics_dist("http.requests")
 
         response = self._put(payload, headers, client, no_trace=True)
+        if self._compression and response.status in (400, 415):
+            # Intakes that don't decode compressed payloads either reject them or fail to decode them
+            log.warning(
+                "intake at %s rejected a compressed payload with HTTP status %s, sending uncompressed payloads",
+                self._intake_endpoint(client),
+                response.status,
+            )
+            self._compression = False
+            response = self._put(payload, headers, client, no_trace=True)
 
         if response.status >= 400:
             self._metrics_dist("http.errors", tags=["type:%s" % response.status])
@@ -305,7 +356,7 @@ class HTTPWriter(periodic.PeriodicService, TraceWriter):
             if config._trace_writer_log_err_payload:
                 msg += ", payload %s"
                 # If the payload is bytes then hex encode the value before logging
-                if isinstance(payload, bytes):
+                if isinstance(payload, (bytes, EncodedPayload)):
                     log_args += (binascii.hexlify(payload).decode(),)  # type: ignore
                 else:
                     log_args += (payload,)  # type: ignore
@@ -316,13 +367,6 @@ class HTTPWriter(periodic.PeriodicService, TraceWriter):
         return response
 
     def write(self, spans=None):
-        for client in self._clients:
-            self._write_with_client(client, spans=spans)
-        if self._sync_mode:
-            self.flush_queue()
-
-    def _write_with_client(self, client, spans=None):
-        # type: (WriterClientBase, Optional[List[Span]]) -> None
         if spans is None:
             return
 
@@ -335,10 +379,32 @@ class HTTPWriter(periodic.PeriodicService, TraceWriter):
             except service.ServiceStatusError:
                 pass
 
-        self._metrics_dist("writer.accepted.traces")
-        self._metrics["accepted_traces"] += 1
+        for _ in self._clients:
+            self._metrics_dist("writer.accepted.traces")
+            self._metrics["accepted_traces"] += 1
         self._set_keep_rate(spans)
 
+        # The trace is encoded by the next flush. When the queue is full, the thread writing the trace
+        # encodes the queued ones instead, which only happens once per TRACE_QUEUE_SIZE traces at most.
+        if not self._trace_queue.put(spans):
+            self._drain_trace_queue(spans)
+
+        if self._sync_mode:
+            self.flush_queue()
+
+    def _drain_trace_queue(self, spans=None):
+        # type: (Optional[List[Span]]) -> None
+        """Encode the queued traces, followed by ``spans`` if given"""
+        with self._trace_queue_lck:
+            traces = self._trace_queue.drain()
+            if spans is not None:
+                traces.append(spans)
+            for client in self._clients:
+                for trace in traces:
+                    self._write_with_client(client, trace)
+
+    def _write_with_client(self, client, spans):
+        # type: (WriterClientBase, List[Span]) -> None
         try:
             client.encoder.put(spans)
         except BufferItemTooLarge as e:
@@ -370,6 +436,7 @@ class HTTPWriter(periodic.PeriodicService, TraceWriter):
 
     def flush_queue(self, raise_exc=False):
         try:
+            self._drain_trace_queue()
             for client in self._clients:
                 self._flush_queue_with_client(client, raise_exc=raise_exc)
         finally:
@@ -379,7 +446,7 @@ class HTTPWriter(periodic.PeriodicService, TraceWriter):
         # type: (WriterClientBase, bool) -> None
         n_traces = len(client.encoder)
         try:
-            encoded = client.encoder.encode()
+            encoded = client.encoder.encode_payload()
             if encoded is None:
                 return
         except Exception:
@@ -4,9 +4,12 @@ import sys
 from types import ModuleType  # noqa:F401
 import typing  # noqa:F401
 
+from ddtrace.internal._unpatched import _threading as ddtrace_threading
+from ddtrace.internal.datadog.profiling import stack_v2
 from ddtrace.internal.module import ModuleWatchdog
 from ddtrace.internal.utils import get_argument_value
 from ddtrace.internal.wrapping import wrap
+from ddtrace.settings.profiling import config
 
 from . import _threading
 
@@ -48,6 +51,8 @@ def _(asyncio):
     if THREAD_LINK is None:
         THREAD_LINK = _threading._ThreadLink()
 
+    init_stack_v2 = config.stack.v2.enabled and stack_v2.is_available
+
     @partial(wrap, sys.modules["asyncio.events"].BaseDefaultEventLoopPolicy.set_event_loop)
     def _(f, args, kwargs):
         try:
@@ -57,6 +62,54 @@ def _(asyncio):
             loop = get_argument_value(args, kwargs, 1, "loop")
             if loop is not None:
                 THREAD_LINK.link_object(loop)
+            if init_stack_v2:
+                stack_v2.track_asyncio_loop(ddtrace_threading.get_ident(), loop)
+
+    if init_stack_v2 and _init_stack_v2_asyncio(asyncio):
+        # Tasks which are gathered or waited on are rendered below the task which awaits them
+        @partial(wrap, sys.modules["asyncio.tasks"]._GatheringFuture.__init__)
+        def _(f, args, kwargs):
+            try:
+                return f(*args, **kwargs)
+            finally:
+                _link_tasks(get_argument_value(args, kwargs, 1, "children"))
+
+        @partial(wrap, sys.modules["asyncio.tasks"]._wait)
+        def _(f, args, kwargs):
+            try:
+                return f(*args, **kwargs)
+            finally:
+                _link_tasks(get_argument_value(args, kwargs, 0, "fs"))
+
+
+def _init_stack_v2_asyncio(asyncio):
+    # type: (ModuleType) -> bool
+    # The v2 stack profiler reads the task registries of asyncio directly
+    tasks = sys.modules["asyncio.tasks"]
+    current_tasks = getattr(tasks, "_current_tasks", None)
+    if sys.hexversion >= 0x030C0000:
+        scheduled_tasks = getattr(tasks, "_scheduled_tasks", None)
+        eager_tasks = getattr(tasks, "_eager_tasks", None)
+    else:
+        scheduled_tasks = getattr(tasks, "_all_tasks", None)
+        eager_tasks = None
+    if current_tasks is None or scheduled_tasks is None:
+        return False
+    stack_v2.init_asyncio(current_tasks, scheduled_tasks.data, eager_tasks)
+    return True
+
+
+def _link_tasks(children):
+    # type: (typing.Iterable[typing.Any]) -> None
+    try:
+        parent = globals()["current_task"]()
+    except RuntimeError:
+        # Not called from a running loop
+        return
+    if parent is None:
+        return
+    for child in children:
+        stack_v2.link_tasks(parent, child)
 
 
 def get_event_loop_for_thread(thread_id):
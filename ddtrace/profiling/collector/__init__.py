@@ -8,6 +8,7 @@ from ddtrace.internal import service
 from ddtrace.settings.profiling import config
 
 from .. import event  # noqa:F401
+from ._sampler import CaptureSampler
 
 
 class CollectorError(Exception):
@@ -51,26 +52,6 @@ class PeriodicCollector(Collector, periodic.PeriodicService):
         raise NotImplementedError
 
 
-@attr.s
-class CaptureSampler(object):
-    """Determine the events that should be captured based on a sampling percentage."""
-
-    capture_pct = attr.ib(default=100)
-    _counter = attr.ib(default=0, init=False)
-
-    @capture_pct.validator
-    def capture_pct_validator(self, attribute, value):
-        if value < 0 or value > 100:
-            raise ValueError("Capture percentage should be between 0 and 100 included")
-
-    def capture(self):
-        self._counter += self.capture_pct
-        if self._counter >= 100:
-            self._counter -= 100
-            return True
-        return False
-
-
 def _create_capture_sampler(collector):
     return CaptureSampler(collector.capture_pct)
 
@@ -0,0 +1,12 @@
+import types
+import typing
+
+class RaiseSampler(object):
+    interval: int
+    max_nframes: int
+    tracer: typing.Any
+    endpoint_collection_enabled: bool
+    def __init__(
+        self, interval: int, max_nframes: int, tracer: typing.Any = ..., endpoint_collection_enabled: bool = ...
+    ) -> None: ...
+    def __call__(self, code: types.CodeType, instruction_offset: int, exception: BaseException) -> None: ...
@@ -0,0 +1,91 @@
+from cpython.object cimport PyObject
+from cpython.pythread cimport PyThread_get_thread_ident
+from libc.stdint cimport uint64_t
+
+from ddtrace.internal import compat
+from ddtrace.internal.datadog.profiling import ddup
+from ddtrace.profiling import _threading
+from ddtrace.profiling.collector import _task
+from ddtrace.profiling.collector import _traceback
+
+
+cdef extern from "_utils.h":
+    uint64_t random_exponential(uint64_t mean)
+
+
+cdef extern from "Python.h":
+    PyObject* PyEval_GetFrame()
+
+
+cdef class RaiseSampler(object):
+    """Callback of the ``sys.monitoring`` RAISE event which samples the exceptions raised.
+
+    The number of raises between two samples follows an exponential distribution of mean ``interval``, so that
+    exception-heavy code paths can't line up with the sampling, and each sample accounts for ``interval`` raises.
+    Unsampled raises only decrement a counter.
+    """
+
+    cdef readonly uint64_t interval
+    cdef readonly int max_nframes
+    cdef readonly object tracer
+    cdef readonly bint endpoint_collection_enabled
+    cdef uint64_t _countdown
+
+    def __init__(self, interval, max_nframes, tracer=None, endpoint_collection_enabled=True):
+        if interval < 1:
+            raise ValueError("The sampling interval should be at least 1")
+        self.interval = interval
+        self.max_nframes = max_nframes
+        self.tracer = tracer
+        self.endpoint_collection_enabled = endpoint_collection_enabled
+        self._countdown = self._next_countdown()
+
+    cdef uint64_t _next_countdown(self):
+        return 1 + random_exponential(self.interval)
+
+    def __call__(self, code, instruction_offset, exception):
+        # The RAISE event is also emitted in every frame the exception propagates to, with the frames it went
+        # through already in its traceback: only count the frame which raised it.
+        traceback = exception.__traceback__
+        if traceback is not None and traceback.tb_next is not None:
+            return
+
+        if self._countdown > 1:
+            self._countdown -= 1
+            return
+
+        self._countdown = self._next_countdown()
+
+        # sys.monitoring emits no events while the callback runs, but the exceptions of the sampling itself must not
+        # reach the code which raised.
+        try:
+            self._sample(exception)
+        except Exception:
+            pass  # nosec
+
+    cdef _sample(self, exception):
+        cdef PyObject* frame_ptr = PyEval_GetFrame()
+        if frame_ptr is NULL:
+            return
+
+        # The callback is compiled and does not get a frame of its own, so the current frame is the one raising.
+        frame = <object>frame_ptr
+
+        thread_id = PyThread_get_thread_ident()
+        task_id, task_name, _ = _task.get_task(thread_id)
+
+        handle = ddup.SampleHandle()
+        if handle.push_pyframes(frame, self.max_nframes) <= 0:
+            # The handle drops the sample when it is not flushed
+            return
+        handle.push_exceptioninfo(type(exception), self.interval)
+        handle.push_monotonic_ns(compat.monotonic_ns())
+        handle.push_threadinfo(
+            thread_id, _threading.get_thread_native_id(thread_id), _threading.get_thread_name(thread_id)
+        )
+        handle.push_task_id(task_id)
+        handle.push_task_name(task_name)
+        handle.push_class_name(_traceback._extract_class_name(frame))
+        if self.tracer is not None:
+            handle.push_span(self.tracer.current_span(), self.endpoint_collection_enabled)
+        handle.flush_sample()
@@ -112,24 +112,24 @@ class _ProfiledLock(wrapt.ObjectProxy):
                 else:
                     frame = task_frame
 
-                frames, nframes = _traceback.pyframe_to_frames(frame, self._self_max_nframes)
-
                 if self._self_export_libdd_enabled:
                     thread_native_id = _threading.get_thread_native_id(thread_id)
 
                     handle = ddup.SampleHandle()
                     handle.push_lock_name(self._self_name)
                     handle.push_acquire(end - start, 1)  # AFAICT, capture_pct does not adjust anything here
+                    handle.push_monotonic_ns(end)
                     handle.push_threadinfo(thread_id, thread_native_id, thread_name)
                     handle.push_task_id(task_id)
                     handle.push_task_name(task_name)
 
                     if self._self_tracer is not None:
                         handle.push_span(self._self_tracer.current_span(), self._self_endpoint_collection_enabled)
-                    for frame in frames:
-                        handle.push_frame(frame.function_name, frame.file_name, 0, frame.lineno)
+                    # The stack is walked straight into the sample, without building the frames of the events
+                    handle.push_pyframes(frame, self._self_max_nframes)
                     handle.flush_sample()
                 else:
+                    frames, nframes = _traceback.pyframe_to_frames(frame, self._self_max_nframes)
                     event = self.ACQUIRE_EVENT_CLASS(
                         lock_name=self._self_name,
                         frames=frames,
@@ -166,8 +166,6 @@ class _ProfiledLock(wrapt.ObjectProxy):
                         else:
                             frame = task_frame
 
-                        frames, nframes = _traceback.pyframe_to_frames(frame, self._self_max_nframes)
-
                         if self._self_export_libdd_enabled:
                             thread_native_id = _threading.get_thread_native_id(thread_id)
 
@@ -176,6 +174,7 @@ class _ProfiledLock(wrapt.ObjectProxy):
                             handle.push_release(
                                 end - self._self_acquired_at, 1
                             )  # AFAICT, capture_pct does not adjust anything here
+                            handle.push_monotonic_ns(end)
                             handle.push_threadinfo(thread_id, thread_native_id, thread_name)
                             handle.push_task_id(task_id)
                             handle.push_task_name(task_name)
@@ -184,10 +183,10 @@ class _ProfiledLock(wrapt.ObjectProxy):
                                 handle.push_span(
                                     self._self_tracer.current_span(), self._self_endpoint_collection_enabled
                                 )
-                            for frame in frames:
-                                handle.push_frame(frame.function_name, frame.file_name, 0, frame.lineno)
+                            handle.push_pyframes(frame, self._self_max_nframes)
                             handle.flush_sample()
                         else:
+                            frames, nframes = _traceback.pyframe_to_frames(frame, self._self_max_nframes)
                             event = self.RELEASE_EVENT_CLASS(
                                 lock_name=self._self_name,
                                 frames=frames,
@@ -226,7 +225,7 @@ class FunctionWrapper(wrapt.FunctionWrapper):
 class LockCollector(collector.CaptureSamplerCollector):
     """Record lock usage."""
 
-    nframes = attr.ib(type=int, default=config.max_frames)
+    nframes = attr.ib(type=int, default=config.lock.max_frames or config.max_frames)
     endpoint_collection_enabled = attr.ib(type=bool, default=config.endpoint_collection)
     export_libdd_enabled = attr.ib(type=bool, default=config.export.libdd_enabled)
 
@@ -5,21 +5,44 @@
 #define PY_SSIZE_T_CLEAN
 #include <Python.h>
 
+#include "_memalloc_export.h"
 #include "_memalloc_heap.h"
+#include "_memalloc_lifetime.h"
+#include "_memalloc_native.h"
+#include "_memalloc_raw.h"
 #include "_memalloc_reentrant.h"
 #include "_memalloc_tb.h"
+#include "_memalloc_types.h"
 #include "_pymacro.h"
 #include "_utils.h"
 
+/* The number of Python's memory domains: raw, mem and object, which is also
+   the value of MEMALLOC_DOMAIN_NATIVE */
+#define MEMALLOC_PYMEM_DOMAINS 3
+
+/* The allocator hooked into one of Python's memory domains */
 typedef struct
 {
-    PyMemAllocatorEx pymem_allocator_obj;
-    /* The domain we are tracking */
+    /* The allocator it replaced, which it calls */
+    PyMemAllocatorEx pymem_allocator;
     PyMemAllocatorDomain domain;
+    /* True if the domain is tracked */
+    bool tracked;
+} memalloc_domain_t;
+
+typedef struct
+{
+    /* The domains, by PyMemAllocatorDomain, which all feed the same trackers */
+    memalloc_domain_t domains[MEMALLOC_PYMEM_DOMAINS];
     /* The maximum number of events for allocation tracking */
     uint16_t max_events;
+    /* The average number of bytes between two sampled allocation events, or 0
+       to consider every allocation */
+    uint32_t sample_size;
     /* The maximum number of frames collected in stack traces */
     uint16_t max_nframe;
+    /* True if the allocations made through the C allocator are tracked too */
+    bool native;
 } memalloc_context_t;
 
 /* We only support being started once, so we use a global context for the whole
@@ -28,6 +51,8 @@ typedef struct
 */
 static memalloc_context_t global_memalloc_ctx;
 
+PyMemAllocatorEx memalloc_raw_allocator;
+
 /* Allocation tracker */
 typedef struct
 {
@@ -37,68 +62,188 @@ typedef struct
     uint64_t alloc_count;
 } alloc_tracker_t;
 
-/* A string containing "object" */
-static PyObject* object_string = NULL;
+/* The names of the domains, by PyMemAllocatorDomain, and then the native one */
+static PyObject* domain_strings[MEMALLOC_PYMEM_DOMAINS + 1];
 
 #define ALLOC_TRACKER_MAX_COUNT UINT64_MAX
 
-static alloc_tracker_t* global_alloc_tracker;
+/* The maximum number of events kept between two collections, which fits in memalloc_context_t.max_events */
+#define ALLOC_TRACKER_MAX_EVENTS UINT16_MAX
+
+/* The maximum average number of bytes between two sampled allocations */
+#define MAX_ALLOC_SAMPLE_SIZE UINT32_MAX
+
+/* Allocation events are recorded in one of several shards, picked by thread,
+   each with its own reservoir, so that threads allocating concurrently don't
+   all contend on the same tracker. The reservoirs are merged back into a
+   single sample when the events are collected. */
+#define ALLOC_TRACKER_SHARDS_BITS 4
+#define ALLOC_TRACKER_SHARDS (1 << ALLOC_TRACKER_SHARDS_BITS)
+
+typedef struct
+{
+#ifdef Py_GIL_DISABLED
+    /* Without the GIL, nothing else serializes the allocators */
+    PyMutex lock;
+#endif
+    alloc_tracker_t* alloc_tracker;
+    /* Number of bytes left to allocate before the next sampled allocation, when sampling by size */
+    uint64_t bytes_until_sample;
+} alloc_tracker_shard_t;
+
+static alloc_tracker_shard_t global_alloc_tracker_shards[ALLOC_TRACKER_SHARDS];
+
+/* True between start() and stop() */
+static bool global_memalloc_started = false;
+
+#ifdef Py_GIL_DISABLED
+#define ALLOC_TRACKER_SHARD_LOCK(shard) PyMutex_Lock(&(shard)->lock)
+#define ALLOC_TRACKER_SHARD_UNLOCK(shard) PyMutex_Unlock(&(shard)->lock)
+#else
+#define ALLOC_TRACKER_SHARD_LOCK(shard)
+#define ALLOC_TRACKER_SHARD_UNLOCK(shard)
+#endif
+
+static inline alloc_tracker_shard_t*
+alloc_tracker_current_shard(void)
+{
+    /* Thread identifiers are usually aligned addresses, so mix them before
+       keeping the top bits */
+    uint64_t hash = (uint64_t)PyThread_get_thread_ident() * UINT64_C(0x9E3779B97F4A7C15);
+    return &global_alloc_tracker_shards[hash >> (64 - ALLOC_TRACKER_SHARDS_BITS)];
+}
+
+#ifdef MEMALLOC_TYPES
+/* The last allocation event captured in the object domain. The object isn't
+   initialized until the allocator returns, so its type is resolved on the
+   next call to the allocator, which the GIL serializes, or when the events
+   are collected, whichever comes first. */
+static traceback_t* pending_type_tb = NULL;
+
+static inline void
+memalloc_resolve_pending_type(void)
+{
+    if (pending_type_tb) {
+        traceback_resolve_type(pending_type_tb);
+        pending_type_tb = NULL;
+    }
+}
+#else
+#define memalloc_resolve_pending_type()
+#endif
 
 static void
-memalloc_add_event(memalloc_context_t* ctx, void* ptr, size_t size)
+memalloc_add_event(memalloc_context_t* ctx, void* ptr, size_t size, PyMemAllocatorDomain domain)
 {
-    /* Do not overflow; just ignore the new events if we ever reach that point */
-    if (global_alloc_tracker->alloc_count >= ALLOC_TRACKER_MAX_COUNT)
+    /* Avoid loops; this also keeps the allocations made while capturing a
+       traceback out of the count, since they come from the profiler itself.
+       This has to be checked first: the shard is locked while capturing. */
+    if (memalloc_get_reentrant())
         return;
 
-    global_alloc_tracker->alloc_count++;
+    alloc_tracker_shard_t* shard = alloc_tracker_current_shard();
+    traceback_t* replaced_tb = NULL;
+    traceback_t* captured_tb = NULL;
 
-    /* Avoid loops */
-    if (memalloc_get_reentrant())
+    ALLOC_TRACKER_SHARD_LOCK(shard);
+
+    alloc_tracker_t* alloc_tracker = shard->alloc_tracker;
+
+    /* When sampling by size, the allocations are sampled as a Poisson process
+       over the allocated bytes: an allocation of size s is considered with
+       probability 1 - exp(-s / sample_size), and most don't get past this. */
+    if (ctx->sample_size > 0) {
+        if (size < shard->bytes_until_sample) {
+            shard->bytes_until_sample -= size;
+            ALLOC_TRACKER_SHARD_UNLOCK(shard);
+            return;
+        }
+        shard->bytes_until_sample = random_exponential(ctx->sample_size);
+    }
+
+    /* Do not overflow; just ignore the new events if we ever reach that point */
+    if (alloc_tracker->alloc_count >= ALLOC_TRACKER_MAX_COUNT) {
+        ALLOC_TRACKER_SHARD_UNLOCK(shard);
         return;
+    }
+
+    alloc_tracker->alloc_count++;
 
     /* Determine if we can capture or if we need to sample */
-    if (global_alloc_tracker->allocs.count < ctx->max_events) {
+    if (alloc_tracker->allocs.count < ctx->max_events) {
         /* set a barrier so we don't loop as getting a traceback allocates memory */
         memalloc_set_reentrant(true);
         /* Buffer is not full, fill it */
-        traceback_t* tb = memalloc_get_traceback(ctx->max_nframe, ptr, size, ctx->domain);
+        traceback_t* tb = memalloc_get_traceback(ctx->max_nframe, ptr, size, domain);
         memalloc_set_reentrant(false);
-        if (tb)
-            traceback_array_append(&global_alloc_tracker->allocs, tb);
+        if (tb) {
+            traceback_array_append(&alloc_tracker->allocs, tb);
+            captured_tb = tb;
+        }
     } else {
         /* Sampling mode using a reservoir sampling algorithm: replace a random
          * traceback with this one */
-        uint64_t r = random_range(global_alloc_tracker->alloc_count);
+        uint64_t r = random_range(alloc_tracker->alloc_count);
 
         if (r < ctx->max_events) {
             /* set a barrier so we don't loop as getting a traceback allocates memory */
             memalloc_set_reentrant(true);
             /* Replace a random traceback with this one */
-            traceback_t* tb = memalloc_get_traceback(ctx->max_nframe, ptr, size, ctx->domain);
+            traceback_t* tb = memalloc_get_traceback(ctx->max_nframe, ptr, size, domain);
             memalloc_set_reentrant(false);
             if (tb) {
-                traceback_free(global_alloc_tracker->allocs.tab[r]);
-                global_alloc_tracker->allocs.tab[r] = tb;
+                replaced_tb = alloc_tracker->allocs.tab[r];
+                alloc_tracker->allocs.tab[r] = tb;
+                captured_tb = tb;
             }
         }
     }
+
+    ALLOC_TRACKER_SHARD_UNLOCK(shard);
+
+#ifdef MEMALLOC_TYPES
+    if (captured_tb && domain == PYMEM_DOMAIN_OBJ)
+        pending_type_tb = captured_tb;
+    else if (replaced_tb == pending_type_tb)
+        pending_type_tb = NULL;
+#endif
+
+    /* Releasing the frames may free memory, so keep it out of the lock */
+    if (replaced_tb)
+        traceback_free(replaced_tb);
+}
+
+/* True if the allocations of the domain can be tracked from this thread. The
+   raw domain is also used by threads which don't hold the GIL, which is
+   needed to capture a traceback. */
+static inline bool
+memalloc_domain_trackable(const memalloc_domain_t* domain)
+{
+    return domain->domain != PYMEM_DOMAIN_RAW || memalloc_native_holds_gil();
 }
 
 static void
 memalloc_free(void* ctx, void* ptr)
 {
-    PyMemAllocatorEx* alloc = (PyMemAllocatorEx*)ctx;
+    memalloc_domain_t* domain = (memalloc_domain_t*)ctx;
 
     if (ptr == NULL)
         return;
 
-    memalloc_heap_untrack(ptr);
+    if (memalloc_domain_trackable(domain)) {
+        /* That may be the object being freed, which is still whole */
+        memalloc_resolve_pending_type();
+        memalloc_heap_untrack(ptr);
+    } else {
+        memalloc_heap_untrack_without_gil(ptr);
+    }
 
-    alloc->free(alloc->ctx, ptr);
+    domain->pymem_allocator.free(domain->pymem_allocator.ctx, ptr);
 }
 
-#ifdef _PY37_AND_LATER
+#ifdef MEMALLOC_THREAD_LOCAL
+MEMALLOC_THREAD_LOCAL bool memalloc_reentrant = false;
+#elif defined(_PY37_AND_LATER)
 Py_tss_t memalloc_reentrant_key = Py_tss_NEEDS_INIT;
 #else
 int memalloc_reentrant_key = -1;
@@ -108,16 +253,20 @@ static void*
 memalloc_alloc(int use_calloc, void* ctx, size_t nelem, size_t elsize)
 {
     void* ptr;
-    memalloc_context_t* memalloc_ctx = (memalloc_context_t*)ctx;
+    memalloc_domain_t* domain = (memalloc_domain_t*)ctx;
+    bool trackable = memalloc_domain_trackable(domain);
+
+    if (trackable)
+        memalloc_resolve_pending_type();
 
     if (use_calloc)
-        ptr = memalloc_ctx->pymem_allocator_obj.calloc(memalloc_ctx->pymem_allocator_obj.ctx, nelem, elsize);
+        ptr = domain->pymem_allocator.calloc(domain->pymem_allocator.ctx, nelem, elsize);
     else
-        ptr = memalloc_ctx->pymem_allocator_obj.malloc(memalloc_ctx->pymem_allocator_obj.ctx, nelem * elsize);
+        ptr = domain->pymem_allocator.malloc(domain->pymem_allocator.ctx, nelem * elsize);
 
-    if (ptr) {
-        memalloc_add_event(memalloc_ctx, ptr, nelem * elsize);
-        memalloc_heap_track(memalloc_ctx->max_nframe, ptr, nelem * elsize, memalloc_ctx->domain);
+    if (ptr && trackable) {
+        memalloc_add_event(&global_memalloc_ctx, ptr, nelem * elsize, domain->domain);
+        memalloc_heap_track(global_memalloc_ctx.max_nframe, ptr, nelem * elsize, domain->domain);
     }
 
     return ptr;
@@ -138,22 +287,55 @@ memalloc_calloc(void* ctx, size_t nelem, size_t elsize)
 static void*
 memalloc_realloc(void* ctx, void* ptr, size_t new_size)
 {
-    memalloc_context_t* memalloc_ctx = (memalloc_context_t*)ctx;
-    void* ptr2 = memalloc_ctx->pymem_allocator_obj.realloc(memalloc_ctx->pymem_allocator_obj.ctx, ptr, new_size);
+    memalloc_domain_t* domain = (memalloc_domain_t*)ctx;
+
+    if (!memalloc_domain_trackable(domain)) {
+        /* The block may move, and its sample can't follow it from here */
+        if (ptr)
+            memalloc_heap_untrack_without_gil(ptr);
+        return domain->pymem_allocator.realloc(domain->pymem_allocator.ctx, ptr, new_size);
+    }
+
+    memalloc_resolve_pending_type();
+
+    void* ptr2 = domain->pymem_allocator.realloc(domain->pymem_allocator.ctx, ptr, new_size);
 
     if (ptr2) {
-        memalloc_add_event(memalloc_ctx, ptr2, new_size);
-        memalloc_heap_untrack(ptr);
-        memalloc_heap_track(memalloc_ctx->max_nframe, ptr2, new_size, memalloc_ctx->domain);
+        memalloc_add_event(&global_memalloc_ctx, ptr2, new_size, domain->domain);
+        memalloc_heap_realloc(global_memalloc_ctx.max_nframe, ptr, ptr2, new_size, domain->domain);
     }
 
     return ptr2;
 }
 
+/* The allocations made by native code are reported as their own domain */
+static void
+memalloc_native_track(void* ptr, size_t size)
+{
+    /* A traceback can't be captured without the GIL, so those allocations are
+       not sampled, nor counted */
+    if (!memalloc_native_holds_gil())
+        return;
+
+    memalloc_add_event(&global_memalloc_ctx, ptr, size, MEMALLOC_DOMAIN_NATIVE);
+    memalloc_heap_track(global_memalloc_ctx.max_nframe, ptr, size, MEMALLOC_DOMAIN_NATIVE);
+}
+
+static void
+memalloc_native_untrack(void* ptr)
+{
+    if (memalloc_native_holds_gil())
+        memalloc_heap_untrack(ptr);
+    else
+        memalloc_heap_untrack_without_gil(ptr);
+}
+
+static const memalloc_native_hooks_t memalloc_native_hooks = { memalloc_native_track, memalloc_native_untrack };
+
 static alloc_tracker_t*
 alloc_tracker_new()
 {
-    alloc_tracker_t* alloc_tracker = PyMem_RawMalloc(sizeof(alloc_tracker_t));
+    alloc_tracker_t* alloc_tracker = memalloc_raw_malloc(sizeof(alloc_tracker_t));
     alloc_tracker->alloc_count = 0;
     traceback_array_init(&alloc_tracker->allocs);
     return alloc_tracker;
@@ -163,11 +345,129 @@ static void
 alloc_tracker_free(alloc_tracker_t* alloc_tracker)
 {
     traceback_array_wipe(&alloc_tracker->allocs);
-    PyMem_RawFree(alloc_tracker);
+    memalloc_raw_free(alloc_tracker);
+}
+
+/* Replace the tracker of every shard with a new one, and merge the previous
+   ones into a single tracker holding at most `max_events` tracebacks.
+
+   Each shard holds a uniform sample of the allocations of its threads, so a
+   uniform sample of all of them is drawn by picking, for each event, a shard
+   with a probability proportional to its share of the allocations left, and
+   then one of the tracebacks of that shard at random. */
+static alloc_tracker_t*
+alloc_tracker_collect(uint16_t max_events)
+{
+    alloc_tracker_t* shard_trackers[ALLOC_TRACKER_SHARDS];
+    uint64_t shard_alloc_counts[ALLOC_TRACKER_SHARDS];
+    alloc_tracker_t* merged = alloc_tracker_new();
+
+    memalloc_resolve_pending_type();
+
+    for (size_t i = 0; i < ALLOC_TRACKER_SHARDS; i++) {
+        alloc_tracker_shard_t* shard = &global_alloc_tracker_shards[i];
+        alloc_tracker_t* alloc_tracker = alloc_tracker_new();
+
+        ALLOC_TRACKER_SHARD_LOCK(shard);
+        shard_trackers[i] = shard->alloc_tracker;
+        shard->alloc_tracker = alloc_tracker;
+        ALLOC_TRACKER_SHARD_UNLOCK(shard);
+
+        shard_alloc_counts[i] = shard_trackers[i]->alloc_count;
+        if (merged->alloc_count > ALLOC_TRACKER_MAX_COUNT - shard_alloc_counts[i])
+            merged->alloc_count = ALLOC_TRACKER_MAX_COUNT;
+        else
+            merged->alloc_count += shard_alloc_counts[i];
+    }
+
+    uint64_t remaining = merged->alloc_count;
+    traceback_array_grow(&merged->allocs, (TRACEBACK_ARRAY_COUNT_TYPE)Py_MIN(remaining, max_events));
+
+    for (uint16_t event = 0; event < max_events && remaining > 0; event++) {
+        uint64_t r = random_range(remaining);
+        size_t i = 0;
+
+        while (i < ALLOC_TRACKER_SHARDS - 1 && r >= shard_alloc_counts[i])
+            r -= shard_alloc_counts[i++];
+
+        shard_alloc_counts[i]--;
+        remaining--;
+
+        /* The traceback may have failed to be captured */
+        traceback_array_t* allocs = &shard_trackers[i]->allocs;
+        if (allocs->count > 0) {
+            TRACEBACK_ARRAY_COUNT_TYPE pick = (TRACEBACK_ARRAY_COUNT_TYPE)random_range(allocs->count);
+            traceback_array_append(&merged->allocs, allocs->tab[pick]);
+            allocs->tab[pick] = allocs->tab[--allocs->count];
+        }
+    }
+
+    /* Drop the tracebacks which were not picked */
+    for (size_t i = 0; i < ALLOC_TRACKER_SHARDS; i++)
+        alloc_tracker_free(shard_trackers[i]);
+
+    return merged;
+}
+
+/* Set which domains are tracked from a sequence of their names, or just the
+   object one if there is none.
+
+   Returns false, with an exception set, if the names are not valid. */
+static bool
+memalloc_set_domains(PyObject* names)
+{
+    bool tracked[MEMALLOC_PYMEM_DOMAINS] = { false, false, false };
+
+    if (names == NULL) {
+        tracked[PYMEM_DOMAIN_OBJ] = true;
+    } else {
+        PyObject* seq = PySequence_Fast(names, "the domains must be a sequence of names");
+        if (seq == NULL)
+            return false;
+
+        for (Py_ssize_t i = 0; i < PySequence_Fast_GET_SIZE(seq); i++) {
+            PyObject* name = PySequence_Fast_GET_ITEM(seq, i);
+            int found = -1;
+
+            for (int d = 0; d < MEMALLOC_PYMEM_DOMAINS && found < 0 && PyUnicode_Check(name); d++)
+                if (PyUnicode_CompareWithASCIIString(name, memalloc_domain_name((PyMemAllocatorDomain)d)) == 0)
+                    found = d;
+
+            if (found < 0) {
+                PyErr_Format(PyExc_ValueError, "unknown memory domain %R, expected object, mem or raw", name);
+                Py_DECREF(seq);
+                return false;
+            }
+            tracked[found] = true;
+        }
+
+        Py_DECREF(seq);
+    }
+
+    if (!tracked[PYMEM_DOMAIN_RAW] && !tracked[PYMEM_DOMAIN_MEM] && !tracked[PYMEM_DOMAIN_OBJ]) {
+        PyErr_SetString(PyExc_ValueError, "at least one memory domain must be tracked");
+        return false;
+    }
+
+#ifndef MEMALLOC_NATIVE
+    /* Its blocks are freed without the GIL, which needs the heap tracker to be locked */
+    if (tracked[PYMEM_DOMAIN_RAW]) {
+        PyErr_SetString(PyExc_ValueError, "the raw domain can't be tracked on this platform");
+        return false;
+    }
+#endif
+
+    for (int d = 0; d < MEMALLOC_PYMEM_DOMAINS; d++) {
+        global_memalloc_ctx.domains[d].domain = (PyMemAllocatorDomain)d;
+        global_memalloc_ctx.domains[d].tracked = tracked[d];
+    }
+
+    return true;
 }
 
 PyDoc_STRVAR(memalloc_start__doc__,
-             "start($module, max_nframe, max_events, heap_sample_size)\n"
+             "start($module, max_nframe, max_events, heap_sample_size, alloc_sample_size=0, heap_lifetime=False,\n"
+             "      native=False, domains=(\"object\",))\n"
              "--\n"
              "\n"
              "Start tracing Python memory allocations.\n"
@@ -175,20 +475,43 @@ PyDoc_STRVAR(memalloc_start__doc__,
              "Sets the maximum number of frames stored in the traceback of a\n"
              "trace to max_nframe and the maximum number of events to max_events.\n"
              "Set heap_sample_size to the granularity of the heap profiler, in bytes.\n"
-             "If heap_sample_size is set to 0, it is disabled entirely.\n");
+             "If heap_sample_size is set to 0, it is disabled entirely.\n"
+             "Set alloc_sample_size to the average number of bytes between two\n"
+             "allocation events, in which case the event count of iter_events() is\n"
+             "the number of sampled allocations. If alloc_sample_size is set to 0,\n"
+             "every allocation is considered.\n"
+             "Set heap_lifetime to also record how long the allocations sampled by\n"
+             "the heap profiler live, see heap_lifetimes().\n"
+             "Set native to also trace the memory allocated through the C allocator\n"
+             "by the loaded libraries, see native_patch(). This is only supported if\n"
+             "native_supported is true.\n"
+             "Set domains to the names of the Python memory domains to trace, among\n"
+             "object, mem and raw. They share the same samplers, and their samples\n"
+             "are labeled with the domain they were allocated from. The raw domain\n"
+             "can only be traced if native_supported is true.\n");
 static PyObject*
 memalloc_start(PyObject* Py_UNUSED(module), PyObject* args)
 {
-    if (global_alloc_tracker) {
+    if (global_memalloc_started) {
         PyErr_SetString(PyExc_RuntimeError, "the memalloc module is already started");
         return NULL;
     }
 
     long max_nframe, max_events;
-    long long int heap_sample_size;
+    long long int heap_sample_size, alloc_sample_size = 0;
+    int heap_lifetime = 0, native = 0;
+    PyObject* domains = NULL;
 
     /* Store short ints in ints so we're sure they fit */
-    if (!PyArg_ParseTuple(args, "llL", &max_nframe, &max_events, &heap_sample_size))
+    if (!PyArg_ParseTuple(args,
+                          "llL|LppO",
+                          &max_nframe,
+                          &max_events,
+                          &heap_sample_size,
+                          &alloc_sample_size,
+                          &heap_lifetime,
+                          &native,
+                          &domains))
         return NULL;
 
     if (max_nframe < 1 || max_nframe > TRACEBACK_MAX_NFRAME) {
@@ -198,8 +521,8 @@ memalloc_start(PyObject* Py_UNUSED(module), PyObject* args)
 
     global_memalloc_ctx.max_nframe = (uint16_t)max_nframe;
 
-    if (max_events < 1 || max_events > TRACEBACK_ARRAY_MAX_COUNT) {
-        PyErr_Format(PyExc_ValueError, "the number of events must be in range [1; %lu]", TRACEBACK_ARRAY_MAX_COUNT);
+    if (max_events < 1 || max_events > ALLOC_TRACKER_MAX_EVENTS) {
+        PyErr_Format(PyExc_ValueError, "the number of events must be in range [1; %lu]", ALLOC_TRACKER_MAX_EVENTS);
         return NULL;
     }
 
@@ -210,33 +533,62 @@ memalloc_start(PyObject* Py_UNUSED(module), PyObject* args)
         return NULL;
     }
 
-    if (memalloc_tb_init(global_memalloc_ctx.max_nframe) < 0)
+    if (alloc_sample_size < 0 || alloc_sample_size > MAX_ALLOC_SAMPLE_SIZE) {
+        PyErr_Format(PyExc_ValueError, "the allocation sample size must be in range [0; %lu]", MAX_ALLOC_SAMPLE_SIZE);
         return NULL;
+    }
 
-    if (object_string == NULL) {
-        object_string = PyUnicode_FromString("object");
-        if (object_string == NULL)
-            return NULL;
-        PyUnicode_InternInPlace(&object_string);
+    global_memalloc_ctx.sample_size = (uint32_t)alloc_sample_size;
+
+#ifndef MEMALLOC_NATIVE
+    if (native) {
+        PyErr_SetString(PyExc_ValueError, "native allocations can't be tracked on this platform");
+        return NULL;
     }
+#endif
 
-    memalloc_heap_tracker_init((uint32_t)heap_sample_size);
+    global_memalloc_ctx.native = native;
+
+    if (!memalloc_set_domains(domains))
+        return NULL;
+
+    if (memalloc_tb_init(global_memalloc_ctx.max_nframe) < 0)
+        return NULL;
+
+    for (int d = 0; d <= MEMALLOC_PYMEM_DOMAINS; d++) {
+        if (domain_strings[d] == NULL) {
+            domain_strings[d] = PyUnicode_InternFromString(memalloc_domain_name((PyMemAllocatorDomain)d));
+            if (domain_strings[d] == NULL)
+                return NULL;
+        }
+    }
 
-    PyMemAllocatorEx alloc;
+    /* The blocks of the raw domain are freed without the GIL, as the native ones */
+    memalloc_heap_tracker_init(
+      (uint32_t)heap_sample_size, heap_lifetime, native || global_memalloc_ctx.domains[PYMEM_DOMAIN_RAW].tracked);
 
-    alloc.malloc = memalloc_malloc;
-    alloc.calloc = memalloc_calloc;
-    alloc.realloc = memalloc_realloc;
-    alloc.free = memalloc_free;
+    for (size_t i = 0; i < ALLOC_TRACKER_SHARDS; i++) {
+        global_alloc_tracker_shards[i].alloc_tracker = alloc_tracker_new();
+        global_alloc_tracker_shards[i].bytes_until_sample = random_exponential(global_memalloc_ctx.sample_size);
+    }
+    global_memalloc_started = true;
 
-    alloc.ctx = &global_memalloc_ctx;
+    for (int d = 0; d < MEMALLOC_PYMEM_DOMAINS; d++) {
+        memalloc_domain_t* domain = &global_memalloc_ctx.domains[d];
+        PyMemAllocatorEx alloc = { domain, memalloc_malloc, memalloc_calloc, memalloc_realloc, memalloc_free };
 
-    global_memalloc_ctx.domain = PYMEM_DOMAIN_OBJ;
+        if (!domain->tracked)
+            continue;
 
-    global_alloc_tracker = alloc_tracker_new();
+        PyMem_GetAllocator(domain->domain, &domain->pymem_allocator);
+        /* Kept after stop(), as that allocator stays the one underneath */
+        if (domain->domain == PYMEM_DOMAIN_RAW)
+            memalloc_raw_allocator = domain->pymem_allocator;
+        PyMem_SetAllocator(domain->domain, &alloc);
+    }
 
-    PyMem_GetAllocator(PYMEM_DOMAIN_OBJ, &global_memalloc_ctx.pymem_allocator_obj);
-    PyMem_SetAllocator(PYMEM_DOMAIN_OBJ, &alloc);
+    if (native)
+        memalloc_native_start(&memalloc_native_hooks);
 
     Py_RETURN_NONE;
 }
@@ -251,15 +603,25 @@ PyDoc_STRVAR(memalloc_stop__doc__,
 static PyObject*
 memalloc_stop(PyObject* Py_UNUSED(module), PyObject* Py_UNUSED(args))
 {
-    if (!global_alloc_tracker) {
+    if (!global_memalloc_started) {
         PyErr_SetString(PyExc_RuntimeError, "the memalloc module was not started");
         return NULL;
     }
 
-    PyMem_SetAllocator(PYMEM_DOMAIN_OBJ, &global_memalloc_ctx.pymem_allocator_obj);
+    if (global_memalloc_ctx.native)
+        memalloc_native_stop();
+    for (int d = MEMALLOC_PYMEM_DOMAINS - 1; d >= 0; d--)
+        if (global_memalloc_ctx.domains[d].tracked)
+            PyMem_SetAllocator((PyMemAllocatorDomain)d, &global_memalloc_ctx.domains[d].pymem_allocator);
     memalloc_tb_deinit();
-    alloc_tracker_free(global_alloc_tracker);
-    global_alloc_tracker = NULL;
+#ifdef MEMALLOC_TYPES
+    pending_type_tb = NULL;
+#endif
+    for (size_t i = 0; i < ALLOC_TRACKER_SHARDS; i++) {
+        alloc_tracker_free(global_alloc_tracker_shards[i].alloc_tracker);
+        global_alloc_tracker_shards[i].alloc_tracker = NULL;
+    }
+    global_memalloc_started = false;
 
     memalloc_heap_tracker_deinit();
 
@@ -274,7 +636,7 @@ PyDoc_STRVAR(memalloc_heap_py__doc__,
 static PyObject*
 memalloc_heap_py(PyObject* Py_UNUSED(module), PyObject* Py_UNUSED(args))
 {
-    if (!global_alloc_tracker) {
+    if (!global_memalloc_started) {
         PyErr_SetString(PyExc_RuntimeError, "the memalloc module was not started");
         return NULL;
     }
@@ -282,6 +644,219 @@ memalloc_heap_py(PyObject* Py_UNUSED(module), PyObject* Py_UNUSED(args))
     return memalloc_heap();
 }
 
+PyDoc_STRVAR(memalloc_heap_lifetimes__doc__,
+             "heap_lifetimes($module, /)\n"
+             "--\n"
+             "\n"
+             "Get how long the allocations sampled by the heap profiler lived,\n"
+             "since the last call, and reset them.\n"
+             "\n"
+             "Returns a list of (traceback, freed, live) tuples, one per stack and\n"
+             "thread. freed holds the number of allocations freed in each lifetime\n"
+             "bucket, the bounds of which are in heap_lifetime_bounds, and live is\n"
+             "the number of allocations still alive.\n"
+             "\n"
+             "The list is empty unless start() was called with heap_lifetime set.\n");
+static PyObject*
+memalloc_heap_lifetimes_py(PyObject* Py_UNUSED(module), PyObject* Py_UNUSED(args))
+{
+    if (!global_memalloc_started) {
+        PyErr_SetString(PyExc_RuntimeError, "the memalloc module was not started");
+        return NULL;
+    }
+
+    return memalloc_heap_lifetimes();
+}
+
+PyDoc_STRVAR(memalloc_native_patch_py__doc__,
+             "native_patch($module, /)\n"
+             "--\n"
+             "\n"
+             "Also trace the memory allocated by the libraries loaded since start(),\n"
+             "or since the last call, if native allocations are traced.\n"
+             "\n"
+             "Returns the number of call sites redirected to the profiler.\n");
+static PyObject*
+memalloc_native_patch_py(PyObject* Py_UNUSED(module), PyObject* Py_UNUSED(args))
+{
+    if (!global_memalloc_started) {
+        PyErr_SetString(PyExc_RuntimeError, "the memalloc module was not started");
+        return NULL;
+    }
+
+    return PyLong_FromSize_t(global_memalloc_ctx.native ? memalloc_native_patch() : 0);
+}
+
+PyDoc_STRVAR(memalloc_random_samples__doc__,
+             "_random_samples($module, exponential, parameter, count, /)\n"
+             "--\n"
+             "\n"
+             "Draw count numbers with the generator of the sampling decisions, for\n"
+             "testing: either from the exponential distribution of the given mean,\n"
+             "or uniformly between [0, parameter[.\n");
+static PyObject*
+memalloc_random_samples(PyObject* Py_UNUSED(module), PyObject* args)
+{
+    int exponential;
+    unsigned long long parameter;
+    Py_ssize_t count;
+
+    if (!PyArg_ParseTuple(args, "pKn", &exponential, &parameter, &count))
+        return NULL;
+
+    if (parameter == 0 || count < 0) {
+        PyErr_SetString(PyExc_ValueError, "the parameter must be positive and the count non-negative");
+        return NULL;
+    }
+
+    PyObject* samples = PyList_New(count);
+    if (samples == NULL)
+        return NULL;
+
+    for (Py_ssize_t i = 0; i < count; i++) {
+        uint64_t sample = exponential ? random_exponential(parameter) : random_range(parameter);
+        PyObject* item = PyLong_FromUnsignedLongLong(sample);
+        if (item == NULL) {
+            Py_DECREF(samples);
+            return NULL;
+        }
+        PyList_SET_ITEM(samples, i, item);
+    }
+
+    return samples;
+}
+
+PyDoc_STRVAR(memalloc_heap_types_py__doc__,
+             "_heap_types($module, /)\n"
+             "--\n"
+             "\n"
+             "Get the type of the object of each sample of heap(), or None, for\n"
+             "testing. The types are exported as the class name of the samples.\n");
+static PyObject*
+memalloc_heap_types_py(PyObject* Py_UNUSED(module), PyObject* Py_UNUSED(args))
+{
+    if (!global_memalloc_started) {
+        PyErr_SetString(PyExc_RuntimeError, "the memalloc module was not started");
+        return NULL;
+    }
+
+    return memalloc_heap_types();
+}
+
+PyDoc_STRVAR(memalloc_export_heap__doc__,
+             "export_heap($module, sample_capi, thread_info, delta=False, /)\n"
+             "--\n"
+             "\n"
+             "Push the sampled heap to ddup through its C API, sample_capi.\n"
+             "\n"
+             "thread_info is called once per thread with its id, and returns either\n"
+             "(native_id, name) or None to leave the samples of the thread out.\n"
+             "\n"
+             "If delta is true, only the allocations sampled and freed since the\n"
+             "previous delta export are pushed, to the live set ddup keeps and adds\n"
+             "to every profile.\n");
+static PyObject*
+memalloc_export_heap(PyObject* Py_UNUSED(module), PyObject* args)
+{
+    PyObject *sample_capi, *thread_info;
+    int delta = 0;
+
+    if (!PyArg_ParseTuple(args, "OO|p", &sample_capi, &thread_info, &delta))
+        return NULL;
+
+    if (!global_memalloc_started) {
+        PyErr_SetString(PyExc_RuntimeError, "the memalloc module was not started");
+        return NULL;
+    }
+
+    memalloc_exporter_t exporter;
+    if (!memalloc_exporter_init(&exporter, sample_capi, thread_info))
+        return NULL;
+
+    bool exported = delta ? memalloc_heap_export_delta(&exporter) : memalloc_heap_export(&exporter);
+    memalloc_exporter_wipe(&exporter);
+
+    if (!exported)
+        return NULL;
+
+    Py_RETURN_NONE;
+}
+
+/* Clamp a weighted value to what ddup takes */
+static inline int64_t
+alloc_event_value(double value)
+{
+    if (!(value >= 0))
+        return 0;
+    if (value >= (double)INT64_MAX)
+        return INT64_MAX;
+    return (int64_t)value;
+}
+
+PyDoc_STRVAR(memalloc_export_events__doc__,
+             "export_events($module, sample_capi, thread_info, /)\n"
+             "--\n"
+             "\n"
+             "Push the memory allocations traced so far to ddup through its C API,\n"
+             "sample_capi, and reset them, like iter_events().\n"
+             "\n"
+             "thread_info is called once per thread with its id, and returns either\n"
+             "(native_id, name) or None to leave the samples of the thread out.\n"
+             "\n"
+             "Returns a tuple with the number of events and the total number of\n"
+             "allocations since last reset.\n");
+static PyObject*
+memalloc_export_events(PyObject* Py_UNUSED(module), PyObject* args)
+{
+    PyObject *sample_capi, *thread_info;
+
+    if (!PyArg_ParseTuple(args, "OO", &sample_capi, &thread_info))
+        return NULL;
+
+    if (!global_memalloc_started) {
+        PyErr_SetString(PyExc_RuntimeError, "the memalloc module was not started");
+        return NULL;
+    }
+
+    memalloc_exporter_t exporter;
+    if (!memalloc_exporter_init(&exporter, sample_capi, thread_info))
+        return NULL;
+
+    alloc_tracker_t* alloc_tracker = alloc_tracker_collect(global_memalloc_ctx.max_events);
+    TRACEBACK_ARRAY_COUNT_TYPE count = alloc_tracker->allocs.count;
+    uint64_t alloc_count = alloc_tracker->alloc_count;
+    /* Each event stands for this many allocations */
+    double scale = count ? (double)alloc_count / count : 0;
+
+    for (TRACEBACK_ARRAY_COUNT_TYPE i = 0; i < count && !exporter.failed; i++) {
+        traceback_t* tb = alloc_tracker->allocs.tab[i];
+        ddup_sample_t* sample = memalloc_exporter_start_sample(&exporter, tb);
+
+        if (sample == NULL)
+            continue;
+
+        if (global_memalloc_ctx.sample_size) {
+            /* An allocation of `size` bytes is sampled with probability 1 - exp(-size / sample_size) */
+            double weight = tb->size ? 1.0 / -expm1(-(double)tb->size / global_memalloc_ctx.sample_size) : 1.0;
+            weight *= scale;
+            exporter.capi->push_alloc(
+              sample, alloc_event_value(round(tb->size * weight)), alloc_event_value(round(weight)));
+        } else {
+            exporter.capi->push_alloc(sample, alloc_event_value(tb->size * scale), count);
+        }
+
+        memalloc_exporter_flush_sample(&exporter, sample, tb);
+    }
+
+    alloc_tracker_free(alloc_tracker);
+    memalloc_exporter_wipe(&exporter);
+
+    if (exporter.failed)
+        return NULL;
+
+    return Py_BuildValue("(kK)", (unsigned long)count, (unsigned long long)alloc_count);
+}
+
 typedef struct
 {
     PyObject_HEAD alloc_tracker_t* alloc_tracker;
@@ -301,7 +876,7 @@ PyDoc_STRVAR(iterevents__doc__,
 static PyObject*
 iterevents_new(PyTypeObject* type, PyObject* Py_UNUSED(args), PyObject* Py_UNUSED(kwargs))
 {
-    if (!global_alloc_tracker) {
+    if (!global_memalloc_started) {
         PyErr_SetString(PyExc_RuntimeError, "the memalloc module was not started");
         return NULL;
     }
@@ -310,9 +885,8 @@ iterevents_new(PyTypeObject* type, PyObject* Py_UNUSED(args), PyObject* Py_UNUSE
     if (!iestate)
         return NULL;
 
-    iestate->alloc_tracker = global_alloc_tracker;
-    /* reset the current traceback list */
-    global_alloc_tracker = alloc_tracker_new();
+    /* reset the current traceback lists */
+    iestate->alloc_tracker = alloc_tracker_collect(global_memalloc_ctx.max_events);
     iestate->seq_index = 0;
 
     PyObject* iter_and_count = PyTuple_New(3);
@@ -342,13 +916,9 @@ iterevents_next(IterEventsState* iestate)
         PyTuple_SET_ITEM(tb_size_domain, 1, PyLong_FromSize_t(tb->size));
 
         /* Domain name */
-        if (tb->domain == PYMEM_DOMAIN_OBJ) {
-            PyTuple_SET_ITEM(tb_size_domain, 2, object_string);
-            Py_INCREF(object_string);
-        } else {
-            PyTuple_SET_ITEM(tb_size_domain, 2, Py_None);
-            Py_INCREF(Py_None);
-        }
+        PyObject* domain = (unsigned int)tb->domain <= MEMALLOC_PYMEM_DOMAINS ? domain_strings[tb->domain] : Py_None;
+        Py_INCREF(domain);
+        PyTuple_SET_ITEM(tb_size_domain, 2, domain);
 
         return tb_size_domain;
     }
@@ -418,6 +988,30 @@ static PyTypeObject MemallocIterEvents_Type = {
 static PyMethodDef module_methods[] = { { "start", (PyCFunction)memalloc_start, METH_VARARGS, memalloc_start__doc__ },
                                         { "stop", (PyCFunction)memalloc_stop, METH_NOARGS, memalloc_stop__doc__ },
                                         { "heap", (PyCFunction)memalloc_heap_py, METH_NOARGS, memalloc_heap_py__doc__ },
+                                        { "heap_lifetimes",
+                                          (PyCFunction)memalloc_heap_lifetimes_py,
+                                          METH_NOARGS,
+                                          memalloc_heap_lifetimes__doc__ },
+                                        { "native_patch",
+                                          (PyCFunction)memalloc_native_patch_py,
+                                          METH_NOARGS,
+                                          memalloc_native_patch_py__doc__ },
+                                        { "export_heap",
+                                          (PyCFunction)memalloc_export_heap,
+                                          METH_VARARGS,
+                                          memalloc_export_heap__doc__ },
+                                        { "export_events",
+                                          (PyCFunction)memalloc_export_events,
+                                          METH_VARARGS,
+                                          memalloc_export_events__doc__ },
+                                        { "_random_samples",
+                                          (PyCFunction)memalloc_random_samples,
+                                          METH_VARARGS,
+                                          memalloc_random_samples__doc__ },
+                                        { "_heap_types",
+                                          (PyCFunction)memalloc_heap_types_py,
+                                          METH_NOARGS,
+                                          memalloc_heap_types_py__doc__ },
                                         /* sentinel */
                                         { NULL, NULL, 0, NULL } };
 
@@ -442,6 +1036,7 @@ PyInit__memalloc(void)
         return NULL;
     }
 
+#ifndef MEMALLOC_THREAD_LOCAL
 #ifdef _PY37_AND_LATER
     if (PyThread_tss_create(&memalloc_reentrant_key) != 0) {
 #else
@@ -455,6 +1050,19 @@ PyInit__memalloc(void)
 #endif
         return NULL;
     }
+#endif
+
+    if (PyModule_AddObject(m, "heap_lifetime_bounds", lifetime_bounds_to_tuple()) < 0)
+        return NULL;
+
+#ifdef MEMALLOC_NATIVE
+    PyObject* native_supported = Py_True;
+#else
+    PyObject* native_supported = Py_False;
+#endif
+    Py_INCREF(native_supported);
+    if (PyModule_AddObject(m, "native_supported", native_supported) < 0)
+        return NULL;
 
     if (PyType_Ready(&MemallocIterEvents_Type) < 0)
         return NULL;
@@ -9,7 +9,32 @@ StackType = event.StackTraceType
 # (stack, nframe, thread_id)
 TracebackType = typing.Tuple[StackType, int, int]
 
-def start(max_nframe: int, max_events: int, heap_sample_size: int) -> None: ...
+# Upper bounds of the lifetime buckets of heap_lifetimes(), in nanoseconds
+heap_lifetime_bounds: typing.Tuple[int, ...]
+# Whether the allocations of native libraries can be tracked
+native_supported: bool
+
+def start(
+    max_nframe: int,
+    max_events: int,
+    heap_sample_size: int,
+    alloc_sample_size: int = ...,
+    heap_lifetime: bool = ...,
+    native: bool = ...,
+    domains: typing.Sequence[str] = ...,
+) -> None: ...
 def stop() -> None: ...
+def native_patch() -> int: ...
 def heap() -> typing.List[typing.Tuple[TracebackType, int]]: ...
+def heap_lifetimes() -> typing.List[typing.Tuple[TracebackType, typing.Tuple[int, ...], int]]: ...
+def export_heap(
+    sample_capi: object,
+    thread_info: typing.Callable[[int], typing.Optional[typing.Tuple[int, typing.Optional[str]]]],
+    delta: bool = ...,
+) -> None: ...
+def export_events(
+    sample_capi: object, thread_info: typing.Callable[[int], typing.Optional[typing.Tuple[int, typing.Optional[str]]]]
+) -> typing.Tuple[int, int]: ...
 def iter_events() -> typing.Iterator[typing.Tuple[TracebackType, int]]: ...
+def _random_samples(exponential: bool, parameter: int, count: int) -> typing.List[int]: ...
+def _heap_types() -> typing.List[typing.Optional[type]]: ...
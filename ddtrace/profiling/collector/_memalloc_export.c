@@ -0,0 +1,140 @@
+#define PY_SSIZE_T_CLEAN
+#include "_memalloc_export.h"
+
+bool
+memalloc_exporter_init(memalloc_exporter_t* exporter, PyObject* capsule, PyObject* thread_info)
+{
+    const ddup_sample_capi_t* capi = PyCapsule_GetPointer(capsule, DDUP_SAMPLE_CAPI_NAME);
+
+    if (capi == NULL)
+        return false;
+
+    if (capi->version != DDUP_SAMPLE_CAPI_VERSION) {
+        PyErr_Format(PyExc_RuntimeError,
+                     "the ddup sample API version %u is not supported, expected %u",
+                     capi->version,
+                     DDUP_SAMPLE_CAPI_VERSION);
+        return false;
+    }
+
+    if (!PyCallable_Check(thread_info)) {
+        PyErr_SetString(PyExc_TypeError, "thread_info must be callable");
+        return false;
+    }
+
+    exporter->capi = capi;
+    exporter->thread_info = thread_info;
+    export_thread_array_init(&exporter->threads);
+    exporter->failed = false;
+
+    return true;
+}
+
+void
+memalloc_exporter_wipe(memalloc_exporter_t* exporter)
+{
+    export_thread_array_wipe(&exporter->threads);
+}
+
+static int64_t
+memalloc_exporter_as_int64(PyObject* value)
+{
+    int overflow = 0;
+    long long result = PyLong_Check(value) ? PyLong_AsLongLongAndOverflow(value, &overflow) : 0;
+
+    /* Same as what ddup does for values out of range */
+    if (PyErr_Occurred()) {
+        PyErr_Clear();
+        return 0;
+    }
+    if (overflow > 0)
+        return INT64_MAX;
+    if (overflow < 0 || result < 0)
+        return 0;
+
+    return result;
+}
+
+/* Look up a thread, calling thread_info the first time it shows up */
+static export_thread_t*
+memalloc_exporter_get_thread(memalloc_exporter_t* exporter, unsigned long thread_id)
+{
+    /* There are few threads compared to samples, so a linear search is fine */
+    for (uint32_t i = 0; i < exporter->threads.count; i++)
+        if (exporter->threads.tab[i].thread_id == thread_id)
+            return &exporter->threads.tab[i];
+
+    export_thread_t thread = { thread_id, true, 0, NULL, "", 0 };
+
+    PyObject* info = PyObject_CallFunction(exporter->thread_info, "k", thread_id);
+
+    if (info == NULL) {
+        exporter->failed = true;
+        return NULL;
+    }
+
+    if (PyTuple_Check(info) && PyTuple_GET_SIZE(info) == 2) {
+        thread.skip = false;
+        thread.native_id = memalloc_exporter_as_int64(PyTuple_GET_ITEM(info, 0));
+
+        PyObject* name = PyTuple_GET_ITEM(info, 1);
+        if (PyUnicode_Check(name)) {
+            const char* utf8 = PyUnicode_AsUTF8AndSize(name, &thread.name_len);
+            if (utf8) {
+                Py_INCREF(name);
+                thread.name_object = name;
+                thread.name = utf8;
+            } else {
+                PyErr_Clear();
+                thread.name_len = 0;
+            }
+        }
+    } else if (info != Py_None) {
+        PyErr_SetString(PyExc_TypeError, "thread_info must return a (native_id, name) tuple or None");
+        Py_DECREF(info);
+        exporter->failed = true;
+        return NULL;
+    }
+
+    Py_DECREF(info);
+
+    export_thread_array_append(&exporter->threads, thread);
+
+    return &exporter->threads.tab[exporter->threads.count - 1];
+}
+
+ddup_sample_t*
+memalloc_exporter_start_sample(memalloc_exporter_t* exporter, traceback_t* tb)
+{
+    export_thread_t* thread = memalloc_exporter_get_thread(exporter, tb->thread_id);
+
+    if (thread == NULL || thread->skip)
+        return NULL;
+
+    ddup_sample_t* sample = exporter->capi->start_sample();
+
+    if (sample == NULL)
+        return NULL;
+
+    exporter->capi->push_threadinfo(sample,
+                                    (int64_t)Py_MIN(tb->thread_id, (unsigned long)INT64_MAX),
+                                    thread->native_id,
+                                    thread->name,
+                                    (size_t)thread->name_len);
+
+    if (tb->type)
+        exporter->capi->push_class_name(sample, tb->type->tp_name, strlen(tb->type->tp_name));
+
+    const char* domain = memalloc_domain_name(tb->domain);
+    exporter->capi->push_allocation_domain(sample, domain, strlen(domain));
+
+    return sample;
+}
+
+void
+memalloc_exporter_flush_sample(memalloc_exporter_t* exporter, ddup_sample_t* sample, traceback_t* tb)
+{
+    traceback_push_frames(tb, exporter->capi, sample);
+    exporter->capi->flush_sample(sample);
+    exporter->capi->drop_sample(sample);
+}
@@ -0,0 +1,56 @@
+#ifndef _DDTRACE_MEMALLOC_EXPORT_H
+#define _DDTRACE_MEMALLOC_EXPORT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <Python.h>
+
+#include "_memalloc_tb.h"
+#include "_utils.h"
+#include "sample_capi.h"
+
+/* What is pushed for the samples of a thread, looked up once per export */
+typedef struct
+{
+    unsigned long thread_id;
+    /* True if the samples of this thread are left out */
+    bool skip;
+    int64_t native_id;
+    /* Reference keeping name alive */
+    PyObject* name_object;
+    const char* name;
+    Py_ssize_t name_len;
+} export_thread_t;
+
+#define EXPORT_THREAD_DTOR(thread) Py_XDECREF((thread).name_object)
+
+DO_ARRAY(export_thread_t, export_thread, uint32_t, EXPORT_THREAD_DTOR)
+
+/* Pushes samples straight to ddup through its C API, without going through Python objects */
+typedef struct
+{
+    const ddup_sample_capi_t* capi;
+    /* Called with a thread id, returns either (native id, name) or None to leave the thread out */
+    PyObject* thread_info;
+    export_thread_array_t threads;
+    /* Set, along with the Python error, if a thread could not be looked up */
+    bool failed;
+} memalloc_exporter_t;
+
+/* Returns false, with an exception set, if capsule is not the ddup C API */
+bool
+memalloc_exporter_init(memalloc_exporter_t* exporter, PyObject* capsule, PyObject* thread_info);
+void
+memalloc_exporter_wipe(memalloc_exporter_t* exporter);
+
+/* Start the sample of a traceback, with its thread already pushed.
+
+   Returns NULL if the sample is left out, or on error (see memalloc_exporter_t.failed). */
+ddup_sample_t*
+memalloc_exporter_start_sample(memalloc_exporter_t* exporter, traceback_t* tb);
+/* Push the frames of the traceback, flush the sample and give it back */
+void
+memalloc_exporter_flush_sample(memalloc_exporter_t* exporter, ddup_sample_t* sample, traceback_t* tb);
+
+#endif
@@ -1,127 +1,587 @@
-#include <math.h>
 #include <stdlib.h>
+#include <string.h>
 
 #define PY_SSIZE_T_CLEAN
 #include "_memalloc_heap.h"
+#include "_memalloc_lifetime.h"
+#include "_memalloc_native.h"
+#include "_memalloc_raw.h"
 #include "_memalloc_reentrant.h"
 #include "_memalloc_tb.h"
+#include "_memalloc_types.h"
+
+#ifdef MEMALLOC_NATIVE
+#include <pthread.h>
+#endif
+
+/* Marks an empty slot in heap_index_t */
+#define HEAP_INDEX_EMPTY UINT32_MAX
+#define HEAP_INDEX_MIN_CAPACITY 64
+
+/* The maximum number of tracked allocations. The capacity of the index, twice
+   this, has to fit in 32 bits. */
+#define HEAP_TRACKER_MAX_COUNT ((uint32_t)1 << 30)
+
+/* Open-addressing (linear probing) index of the tracked allocations by pointer.
+
+   Each slot holds the position of a traceback in heap_tracker_t.allocs, the
+   key being that traceback's ptr, so the slots stay small and the table can be
+   rebuilt from the arrays alone. The table is kept at most half full, so that
+   looking up an untracked pointer (which is what most frees are) only probes a
+   couple of slots. */
+typedef struct
+{
+    uint32_t* slots;
+    /* Number of slots: either 0 or a power of 2 */
+    uint32_t capacity;
+} heap_index_t;
+
+/* A traceback removed by a thread which did not hold the GIL, which is needed
+   to release it, along with how long its allocation lived */
+typedef struct
+{
+    traceback_t* tb;
+    uint64_t lifetime_ns;
+} heap_removed_t;
+
+DO_ARRAY(heap_removed_t, heap_removed, uint32_t, DO_NOTHING)
+DO_ARRAY(uint64_t, heap_id, TRACEBACK_ARRAY_COUNT_TYPE, DO_NOTHING)
 
 typedef struct
 {
     /* Granularity of the heap profiler in bytes */
     uint32_t sample_size;
     /* Current sample size of the heap profiler in bytes */
-    uint32_t current_sample_size;
+    uint64_t current_sample_size;
     /* Tracked allocations */
     traceback_array_t allocs;
+    /* Index of the tracked allocations by pointer */
+    heap_index_t index;
     /* Allocated memory counter in bytes */
-    uint32_t allocated_memory;
-    /* True if the heap tracker is frozen */
-    bool frozen;
-    /* Contains the ongoing heap allocation/deallocation while frozen */
-    struct
-    {
-        traceback_array_t allocs;
-        ptr_array_t frees;
-    } freezer;
+    uint64_t allocated_memory;
+    /* True if the lifetime of the tracked allocations is recorded */
+    bool lifetime;
+    /* When the tracked allocations were made, in the same order as allocs; only kept if lifetime is true */
+    timestamp_array_t alloc_times;
+    /* How long the tracked allocations lived, since the last collection */
+    lifetime_table_t lifetimes;
+    /* Tracebacks left to release by the next thread holding the GIL */
+    heap_removed_array_t removed;
+    /* The ids under which the tracked allocations were exported to ddup's
+       live set, see memalloc_heap_export_delta(). The exported allocations
+       are kept at the front of allocs, so this has one id for each of the
+       first exported_ids.count of them. */
+    heap_id_array_t exported_ids;
+    /* Ids of the exported allocations freed since the last delta export */
+    heap_id_array_t freed_ids;
+    uint64_t next_id;
+    /* True until the first delta export, which starts the live set over */
+    bool delta_reset;
 } heap_tracker_t;
 
+/* A copy of the tracked allocations, sharing their stacks.
+
+   Exporting runs Python code, which allocates and frees, so it reads from a
+   snapshot rather than from the tracker, which keeps being updated directly. */
+typedef struct
+{
+    traceback_t* tab;
+    TRACEBACK_ARRAY_COUNT_TYPE count;
+} heap_snapshot_t;
+
 static heap_tracker_t global_heap_tracker;
 
-static uint32_t
+#ifdef MEMALLOC_NATIVE
+/* Native allocations, and those of the raw domain, can be freed by threads
+   which do not hold the GIL. Once they are tracked, the tracked allocations
+   are also protected by this lock, which is never held while calling into
+   Python or capturing a traceback. */
+static pthread_mutex_t heap_tracker_lock = PTHREAD_MUTEX_INITIALIZER;
+/* Only ever set, so that a native free still in flight when the tracker is
+   stopped keeps locking */
+static bool heap_tracker_locked = false;
+
+static void
+heap_tracker_lock_reinit(void)
+{
+    /* The lock may have been held by another thread at fork time */
+    pthread_mutex_init(&heap_tracker_lock, NULL);
+}
+
+#define HEAP_TRACKER_LOCK()                                                                                            \
+    do {                                                                                                               \
+        if (heap_tracker_locked)                                                                                       \
+            pthread_mutex_lock(&heap_tracker_lock);                                                                    \
+    } while (0)
+#define HEAP_TRACKER_UNLOCK()                                                                                          \
+    do {                                                                                                               \
+        if (heap_tracker_locked)                                                                                       \
+            pthread_mutex_unlock(&heap_tracker_lock);                                                                  \
+    } while (0)
+#else
+#define HEAP_TRACKER_LOCK()
+#define HEAP_TRACKER_UNLOCK()
+#endif
+
+static uint64_t
 heap_tracker_next_sample_size(uint32_t sample_size)
 {
-    /* Get a value between [0, 1[ */
-    double q = (double)rand() / ((double)RAND_MAX + 1);
-    /* Get a value between ]-inf, 0[, more likely close to 0 */
-    double log_val = log2(q);
-    return (uint32_t)(log_val * (-log(2) * (sample_size + 1)));
+    return random_exponential((uint64_t)sample_size + 1);
+}
+
+/* The sizes of the blocks this thread allocated or reallocated last, by pointer.
+
+   The allocators aren't told the size of the block being reallocated, which
+   is needed to only count the bytes a realloc adds. Tracked allocations know
+   theirs; the others are found here if they are recent enough, which covers
+   buffers grown one realloc at a time. A block freed by another thread
+   may linger, and mislead the count of one allocated at the same address
+   later on, which is no worse than not knowing its size at all. */
+#ifdef MEMALLOC_THREAD_LOCAL
+#define HEAP_REALLOC_CACHE_BITS 4
+
+typedef struct
+{
+    void* ptr;
+    size_t size;
+} heap_realloc_entry_t;
+
+static MEMALLOC_THREAD_LOCAL heap_realloc_entry_t heap_realloc_cache[1 << HEAP_REALLOC_CACHE_BITS];
+
+static inline heap_realloc_entry_t*
+heap_realloc_cache_entry(void* ptr)
+{
+    uint64_t hash = (uint64_t)(uintptr_t)ptr * UINT64_C(0x9E3779B97F4A7C15);
+    return &heap_realloc_cache[hash >> (64 - HEAP_REALLOC_CACHE_BITS)];
 }
 
+/* Returns the size of the block, or 0 if it isn't known */
+static inline size_t
+heap_realloc_cache_take(void* ptr)
+{
+    heap_realloc_entry_t* entry = heap_realloc_cache_entry(ptr);
+
+    if (entry->ptr != ptr)
+        return 0;
+
+    entry->ptr = NULL;
+    return entry->size;
+}
+
+static inline void
+heap_realloc_cache_put(void* ptr, size_t size)
+{
+    heap_realloc_entry_t* entry = heap_realloc_cache_entry(ptr);
+
+    entry->ptr = ptr;
+    entry->size = size;
+}
+#else
+#define heap_realloc_cache_take(ptr) ((size_t)0)
+#define heap_realloc_cache_put(ptr, size)
+#endif
+
 static void
 heap_tracker_init(heap_tracker_t* heap_tracker)
 {
     traceback_array_init(&heap_tracker->allocs);
-    traceback_array_init(&heap_tracker->freezer.allocs);
-    ptr_array_init(&heap_tracker->freezer.frees);
+    heap_tracker->index.slots = NULL;
+    heap_tracker->index.capacity = 0;
     heap_tracker->allocated_memory = 0;
-    heap_tracker->frozen = false;
     heap_tracker->sample_size = 0;
     heap_tracker->current_sample_size = 0;
+    heap_tracker->lifetime = false;
+    timestamp_array_init(&heap_tracker->alloc_times);
+    lifetime_table_init(&heap_tracker->lifetimes);
+    heap_removed_array_init(&heap_tracker->removed);
+    heap_id_array_init(&heap_tracker->exported_ids);
+    heap_id_array_init(&heap_tracker->freed_ids);
+    heap_tracker->next_id = 1;
+    heap_tracker->delta_reset = true;
+}
+
+/* Record the lifetime of a removed traceback, if needed, and free it */
+static void
+heap_tracker_release(heap_tracker_t* heap_tracker, traceback_t* tb, uint64_t lifetime_ns)
+{
+    if (heap_tracker->lifetime)
+        lifetime_table_add_freed(&heap_tracker->lifetimes, tb, lifetime_ns);
+
+    traceback_free(tb);
+}
+
+/* Release the tracebacks removed by the threads which did not hold the GIL */
+static void
+heap_tracker_release_removed(heap_tracker_t* heap_tracker)
+{
+    HEAP_TRACKER_LOCK();
+    heap_removed_array_t removed = heap_tracker->removed;
+    heap_removed_array_init(&heap_tracker->removed);
+    HEAP_TRACKER_UNLOCK();
+
+    for (uint32_t i = 0; i < removed.count; i++)
+        heap_tracker_release(heap_tracker, removed.tab[i].tb, removed.tab[i].lifetime_ns);
+
+    heap_removed_array_wipe(&removed);
 }
 
 static void
 heap_tracker_wipe(heap_tracker_t* heap_tracker)
 {
-    traceback_array_wipe(&heap_tracker->allocs);
-    traceback_array_wipe(&heap_tracker->freezer.allocs);
-    ptr_array_wipe(&heap_tracker->freezer.frees);
+    heap_tracker_release_removed(heap_tracker);
+
+    /* Detach everything first, so that a native free still in flight finds
+       an empty tracker */
+    HEAP_TRACKER_LOCK();
+    heap_tracker_t wiped = *heap_tracker;
+    traceback_array_init(&heap_tracker->allocs);
+    heap_tracker->index.slots = NULL;
+    heap_tracker->index.capacity = 0;
+    timestamp_array_init(&heap_tracker->alloc_times);
+    heap_id_array_init(&heap_tracker->exported_ids);
+    heap_id_array_init(&heap_tracker->freed_ids);
+    HEAP_TRACKER_UNLOCK();
+
+    traceback_array_wipe(&wiped.allocs);
+    memalloc_raw_free(wiped.index.slots);
+    timestamp_array_wipe(&wiped.alloc_times);
+    heap_id_array_wipe(&wiped.exported_ids);
+    heap_id_array_wipe(&wiped.freed_ids);
+    lifetime_table_wipe(&heap_tracker->lifetimes);
+}
+
+/* Returns false if the memory could not be allocated */
+static bool
+heap_tracker_snapshot(heap_tracker_t* heap_tracker, heap_snapshot_t* snapshot)
+{
+    heap_tracker_release_removed(heap_tracker);
+
+    HEAP_TRACKER_LOCK();
+
+    snapshot->count = heap_tracker->allocs.count;
+    snapshot->tab = memalloc_raw_malloc(sizeof(traceback_t) * Py_MAX(snapshot->count, 1));
+
+    if (snapshot->tab != NULL) {
+        for (TRACEBACK_ARRAY_COUNT_TYPE i = 0; i < snapshot->count; i++) {
+            /* The objects are initialized by now, and can't be freed while
+               the snapshot is taken */
+            traceback_resolve_type(heap_tracker->allocs.tab[i]);
+            traceback_copy(&snapshot->tab[i], heap_tracker->allocs.tab[i]);
+        }
+    }
+
+    HEAP_TRACKER_UNLOCK();
+
+    return snapshot->tab != NULL;
+}
+
+/* Take a snapshot of the allocations tracked since the last delta export,
+   which are given the ids following *first_id, along with the ids of the
+   exported ones which were freed since.
+
+   Returns false if the memory could not be allocated. */
+static bool
+heap_tracker_delta(heap_tracker_t* heap_tracker, heap_snapshot_t* added, heap_id_array_t* freed, uint64_t* first_id)
+{
+    heap_tracker_release_removed(heap_tracker);
+
+    HEAP_TRACKER_LOCK();
+
+    TRACEBACK_ARRAY_COUNT_TYPE exported = heap_tracker->exported_ids.count;
+
+    added->count = heap_tracker->allocs.count - exported;
+    added->tab = memalloc_raw_malloc(sizeof(traceback_t) * Py_MAX(added->count, 1));
+    *first_id = heap_tracker->next_id;
+
+    if (added->tab != NULL) {
+        for (TRACEBACK_ARRAY_COUNT_TYPE i = 0; i < added->count; i++) {
+            traceback_resolve_type(heap_tracker->allocs.tab[exported + i]);
+            traceback_copy(&added->tab[i], heap_tracker->allocs.tab[exported + i]);
+            heap_id_array_append(&heap_tracker->exported_ids, heap_tracker->next_id++);
+        }
+
+        *freed = heap_tracker->freed_ids;
+        heap_id_array_init(&heap_tracker->freed_ids);
+    }
+
+    HEAP_TRACKER_UNLOCK();
+
+    return added->tab != NULL;
+}
+
+static void
+heap_snapshot_release(heap_snapshot_t* snapshot)
+{
+    for (TRACEBACK_ARRAY_COUNT_TYPE i = 0; i < snapshot->count; i++)
+        traceback_release(&snapshot->tab[i]);
+
+    memalloc_raw_free(snapshot->tab);
+}
+
+static inline uint32_t
+heap_index_home(const heap_index_t* index, void* ptr)
+{
+    /* Fibonacci hashing: pointers are aligned, so their low bits carry little
+       information, while the high bits of the product mix all of them. */
+    uint64_t hash = (uint64_t)(uintptr_t)ptr * UINT64_C(0x9E3779B97F4A7C15);
+    return (uint32_t)(hash >> 32) & (index->capacity - 1);
+}
+
+static inline traceback_t*
+heap_tracker_index_get(heap_tracker_t* heap_tracker, uint32_t value)
+{
+    return heap_tracker->allocs.tab[value];
+}
+
+static void
+heap_tracker_index_insert(heap_tracker_t* heap_tracker, uint32_t value)
+{
+    heap_index_t* index = &heap_tracker->index;
+    uint32_t slot = heap_index_home(index, heap_tracker_index_get(heap_tracker, value)->ptr);
+
+    while (index->slots[slot] != HEAP_INDEX_EMPTY)
+        slot = (slot + 1) & (index->capacity - 1);
+
+    index->slots[slot] = value;
+}
+
+/* Return the slot holding `value`, which must be in the index */
+static uint32_t
+heap_tracker_index_slot_of(heap_tracker_t* heap_tracker, uint32_t value)
+{
+    heap_index_t* index = &heap_tracker->index;
+    uint32_t slot = heap_index_home(index, heap_tracker_index_get(heap_tracker, value)->ptr);
+
+    while (index->slots[slot] != value)
+        slot = (slot + 1) & (index->capacity - 1);
+
+    return slot;
+}
+
+/* Return the slot referencing the traceback tracking `ptr`, or HEAP_INDEX_EMPTY */
+static uint32_t
+heap_tracker_index_find(heap_tracker_t* heap_tracker, void* ptr)
+{
+    heap_index_t* index = &heap_tracker->index;
+
+    if (index->capacity == 0)
+        return HEAP_INDEX_EMPTY;
+
+    for (uint32_t slot = heap_index_home(index, ptr); index->slots[slot] != HEAP_INDEX_EMPTY;
+         slot = (slot + 1) & (index->capacity - 1)) {
+        if (heap_tracker_index_get(heap_tracker, index->slots[slot])->ptr == ptr)
+            return slot;
+    }
+
+    return HEAP_INDEX_EMPTY;
+}
+
+static void
+heap_tracker_index_delete(heap_tracker_t* heap_tracker, uint32_t slot)
+{
+    heap_index_t* index = &heap_tracker->index;
+    uint32_t mask = index->capacity - 1;
+
+    /* Shift the following entries of the probe sequence back, rather than
+       leaving a tombstone, so that lookups never get slower over time. */
+    for (uint32_t next = (slot + 1) & mask; index->slots[next] != HEAP_INDEX_EMPTY; next = (next + 1) & mask) {
+        uint32_t home = heap_index_home(index, heap_tracker_index_get(heap_tracker, index->slots[next])->ptr);
+
+        /* The entry at `next` can move to `slot` unless its home lies
+           cyclically in ]slot, next] */
+        if (((next - home) & mask) >= ((next - slot) & mask)) {
+            index->slots[slot] = index->slots[next];
+            slot = next;
+        }
+    }
+
+    index->slots[slot] = HEAP_INDEX_EMPTY;
+}
+
+static void
+heap_tracker_index_rebuild(heap_tracker_t* heap_tracker)
+{
+    /* Every byte of HEAP_INDEX_EMPTY is 0xFF */
+    memset(heap_tracker->index.slots, 0xFF, sizeof(uint32_t) * heap_tracker->index.capacity);
+
+    for (TRACEBACK_ARRAY_COUNT_TYPE i = 0; i < heap_tracker->allocs.count; i++)
+        heap_tracker_index_insert(heap_tracker, i);
+}
+
+/* Make room in the index for `count` tracked allocations.
+
+   Returns false if the memory could not be allocated. */
+static bool
+heap_tracker_index_reserve(heap_tracker_t* heap_tracker, uint32_t count)
+{
+    heap_index_t* index = &heap_tracker->index;
+
+    if ((uint64_t)count * 2 <= index->capacity)
+        return true;
+
+    uint32_t capacity = index->capacity ? index->capacity : HEAP_INDEX_MIN_CAPACITY;
+    while ((uint64_t)count * 2 > capacity)
+        capacity *= 2;
+
+    uint32_t* slots = memalloc_raw_malloc(sizeof(uint32_t) * capacity);
+    if (slots == NULL)
+        return false;
+
+    memalloc_raw_free(index->slots);
+    index->slots = slots;
+    index->capacity = capacity;
+
+    heap_tracker_index_rebuild(heap_tracker);
+
+    return true;
 }
 
+/* Move the tracked allocation at `from` to `to`, which is free */
 static void
-heap_tracker_freeze(heap_tracker_t* heap_tracker)
+heap_tracker_move(heap_tracker_t* heap_tracker, TRACEBACK_ARRAY_COUNT_TYPE from, TRACEBACK_ARRAY_COUNT_TYPE to)
 {
-    heap_tracker->frozen = true;
+    heap_tracker->index.slots[heap_tracker_index_slot_of(heap_tracker, from)] = to;
+    heap_tracker->allocs.tab[to] = heap_tracker->allocs.tab[from];
+    if (heap_tracker->lifetime)
+        heap_tracker->alloc_times.tab[to] = heap_tracker->alloc_times.tab[from];
+    if (from < heap_tracker->exported_ids.count)
+        heap_tracker->exported_ids.tab[to] = heap_tracker->exported_ids.tab[from];
 }
 
+/* Remove the traceback referenced by `slot`, moving the last one in its place
+   so nothing else has to move. If the allocation was exported, the last
+   exported one takes its place instead, and the last one the place that one
+   leaves, so that the exported allocations stay at the front.
+
+   Returns the traceback, which is left to release with heap_tracker_release()
+   along with how long its allocation lived. */
+static traceback_t*
+heap_tracker_remove(heap_tracker_t* heap_tracker, uint32_t slot, uint64_t* lifetime_ns)
+{
+    traceback_array_t* allocs = &heap_tracker->allocs;
+    TRACEBACK_ARRAY_COUNT_TYPE i = heap_tracker->index.slots[slot];
+    TRACEBACK_ARRAY_COUNT_TYPE last = allocs->count - 1;
+    traceback_t* tb = allocs->tab[i];
+
+    *lifetime_ns = 0;
+    if (heap_tracker->lifetime) {
+        uint64_t now = lifetime_now_ns();
+
+        *lifetime_ns = now - Py_MIN(heap_tracker->alloc_times.tab[i], now);
+    }
+
+    heap_tracker_index_delete(heap_tracker, slot);
+    if (i < heap_tracker->exported_ids.count) {
+        TRACEBACK_ARRAY_COUNT_TYPE last_exported = heap_tracker->exported_ids.count - 1;
+
+        heap_id_array_append(&heap_tracker->freed_ids, heap_tracker->exported_ids.tab[i]);
+        if (i != last_exported)
+            heap_tracker_move(heap_tracker, last_exported, i);
+        heap_tracker->exported_ids.count--;
+        i = last_exported;
+    }
+    if (i != last)
+        heap_tracker_move(heap_tracker, last, i);
+    allocs->count--;
+    if (heap_tracker->lifetime)
+        heap_tracker->alloc_times.count--;
+
+    return tb;
+}
+
+/* Put the allocation at `i` back with the ones left to export, if it was
+   exported, so that the next delta export replaces it in ddup's live set */
 static void
-heap_tracker_untrack_thawed(heap_tracker_t* heap_tracker, void* ptr)
-{
-    /* This search is O(n) where `n` is the number of tracked traceback,
-       which is linearly linked to the heap size. This search could probably be
-       optimized in a couple of ways:
-
-       - sort the traceback in allocs by ptr so we can find the ptr in O(log2 n)
-       - use a Bloom filter?
-
-       That being said, we start iterating at the end of the array because most
-       of the time this is where the untracked ptr is (the most recent object
-       get de-allocated first usually). This might be a good enough
-       trade-off. */
-    for (TRACEBACK_ARRAY_COUNT_TYPE i = heap_tracker->allocs.count; i > 0; i--) {
-        traceback_t** tb = &heap_tracker->allocs.tab[i - 1];
-
-        if (ptr == (*tb)->ptr) {
-            /* Free the traceback */
-            traceback_free(*tb);
-            traceback_array_remove(&heap_tracker->allocs, tb);
-            break;
+heap_tracker_unexport(heap_tracker_t* heap_tracker, TRACEBACK_ARRAY_COUNT_TYPE i)
+{
+    if (i >= heap_tracker->exported_ids.count)
+        return;
+
+    TRACEBACK_ARRAY_COUNT_TYPE last_exported = heap_tracker->exported_ids.count - 1;
+
+    heap_id_array_append(&heap_tracker->freed_ids, heap_tracker->exported_ids.tab[i]);
+    if (i != last_exported) {
+        /* Swap it with the last exported one */
+        uint32_t slot = heap_tracker_index_slot_of(heap_tracker, i);
+        uint32_t last_slot = heap_tracker_index_slot_of(heap_tracker, last_exported);
+        traceback_t* tb = heap_tracker->allocs.tab[i];
+
+        heap_tracker->allocs.tab[i] = heap_tracker->allocs.tab[last_exported];
+        heap_tracker->allocs.tab[last_exported] = tb;
+        if (heap_tracker->lifetime) {
+            uint64_t alloc_time = heap_tracker->alloc_times.tab[i];
+
+            heap_tracker->alloc_times.tab[i] = heap_tracker->alloc_times.tab[last_exported];
+            heap_tracker->alloc_times.tab[last_exported] = alloc_time;
         }
+        heap_tracker->exported_ids.tab[i] = heap_tracker->exported_ids.tab[last_exported];
+        heap_tracker->index.slots[slot] = last_exported;
+        heap_tracker->index.slots[last_slot] = i;
     }
+    heap_tracker->exported_ids.count--;
+}
+
+/* Count `size` more bytes allocated. Returns true if the next sample is due,
+   in which case the caller consumes it with heap_tracker_consume_sample(). */
+static inline bool
+heap_tracker_count(heap_tracker_t* heap_tracker, size_t size)
+{
+    /* Check for overflow */
+    if (heap_tracker->allocated_memory > UINT64_MAX - size)
+        heap_tracker->allocated_memory = UINT64_MAX;
+    else
+        heap_tracker->allocated_memory += size;
+
+    return heap_tracker->allocated_memory >= heap_tracker->current_sample_size;
+}
+
+static inline void
+heap_tracker_consume_sample(heap_tracker_t* heap_tracker)
+{
+    /* Reset the counter to 0 */
+    heap_tracker->allocated_memory = 0;
+
+    /* Compute the new target sample size */
+    heap_tracker->current_sample_size = heap_tracker_next_sample_size(heap_tracker->sample_size);
 }
 
 static void
-heap_tracker_thaw(heap_tracker_t* heap_tracker)
+heap_tracker_untrack(heap_tracker_t* heap_tracker, void* ptr)
 {
-    /* Add the frozen allocs at the end */
-    traceback_array_splice(&heap_tracker->allocs,
-                           heap_tracker->allocs.count,
-                           0,
-                           heap_tracker->freezer.allocs.tab,
-                           heap_tracker->freezer.allocs.count);
+    HEAP_TRACKER_LOCK();
 
-    /* Handle the frees: we need to handle the frees after we merge the allocs
-       array together to be sure that there's no free in the freezer matching
-       an alloc that is also in the freezer; heap_tracker_untrack_thawed does
-       not care about the freezer, by definition. */
-    for (MEMALLOC_HEAP_PTR_ARRAY_COUNT_TYPE i = 0; i < heap_tracker->freezer.frees.count; i++)
-        heap_tracker_untrack_thawed(heap_tracker, heap_tracker->freezer.frees.tab[i]);
+    uint32_t slot = heap_tracker_index_find(heap_tracker, ptr);
+    traceback_t* tb = NULL;
+    uint64_t lifetime_ns;
 
-    /* Reset the count to zero so we can reused the array and overwrite previous values */
-    heap_tracker->freezer.allocs.count = 0;
-    heap_tracker->freezer.frees.count = 0;
+    if (slot != HEAP_INDEX_EMPTY)
+        tb = heap_tracker_remove(heap_tracker, slot, &lifetime_ns);
 
-    heap_tracker->frozen = false;
+    HEAP_TRACKER_UNLOCK();
+
+    /* Out of the lock, since releasing the frames may free memory, and get back here */
+    if (tb)
+        heap_tracker_release(heap_tracker, tb, lifetime_ns);
 }
 
 /* Public API */
 
 void
-memalloc_heap_tracker_init(uint32_t sample_size)
+memalloc_heap_tracker_init(uint32_t sample_size, bool lifetime, bool locked)
 {
     heap_tracker_init(&global_heap_tracker);
     global_heap_tracker.sample_size = sample_size;
+    global_heap_tracker.lifetime = lifetime;
     global_heap_tracker.current_sample_size = heap_tracker_next_sample_size(sample_size);
+
+#ifdef MEMALLOC_NATIVE
+    if (locked && !heap_tracker_locked) {
+        pthread_atfork(NULL, NULL, heap_tracker_lock_reinit);
+        heap_tracker_locked = true;
+    }
+#else
+    (void)locked;
+#endif
 }
 
 void
@@ -133,40 +593,44 @@ memalloc_heap_tracker_deinit(void)
 void
 memalloc_heap_untrack(void* ptr)
 {
-    if (global_heap_tracker.frozen) {
-        /* Check that we still have space to store the free. If we don't have
-           enough space, we ignore the untrack. That's sad as there is a change
-           the heap profile won't be valid anymore. However, that's the best we
-           can do since reporting an error is not an option here. What's gonna
-           free more than 2^64 pointers anyway?!
-        */
-        if (global_heap_tracker.freezer.frees.count < MEMALLOC_HEAP_PTR_ARRAY_MAX_COUNT)
-            ptr_array_append(&global_heap_tracker.freezer.frees, ptr);
-    } else
-        heap_tracker_untrack_thawed(&global_heap_tracker, ptr);
+    /* The block may be handed out again by a malloc, whose size isn't known */
+    heap_realloc_cache_take(ptr);
+    heap_tracker_untrack(&global_heap_tracker, ptr);
 }
 
-/* Track a memory allocation in the heap profiler.
+void
+memalloc_heap_untrack_without_gil(void* ptr)
+{
+    HEAP_TRACKER_LOCK();
+
+    uint32_t slot = heap_tracker_index_find(&global_heap_tracker, ptr);
+
+    if (slot != HEAP_INDEX_EMPTY) {
+        heap_removed_t removed;
+        removed.tb = heap_tracker_remove(&global_heap_tracker, slot, &removed.lifetime_ns);
+        heap_removed_array_append(&global_heap_tracker.removed, removed);
+    }
+
+    HEAP_TRACKER_UNLOCK();
+}
+
+/* Track an allocation of `size` bytes with a new traceback, if counting
+   `counted` more bytes makes the next sample due.
 
    Returns true if the allocation was tracked, false otherwise. */
-bool
-memalloc_heap_track(uint16_t max_nframe, void* ptr, size_t size, PyMemAllocatorDomain domain)
+static bool
+heap_tracker_track(uint16_t max_nframe, void* ptr, size_t counted, size_t size, PyMemAllocatorDomain domain)
 {
     /* Heap tracking is disabled */
     if (global_heap_tracker.sample_size == 0)
         return false;
 
-    /* Check for overflow */
-    global_heap_tracker.allocated_memory = Py_MIN(global_heap_tracker.allocated_memory + size, MAX_HEAP_SAMPLE_SIZE);
-
     /* Check if we have enough sample or not */
-    if (global_heap_tracker.allocated_memory < global_heap_tracker.current_sample_size)
+    if (!heap_tracker_count(&global_heap_tracker, counted))
         return false;
 
-    /* Check if we can add more samples: the sum of the freezer + alloc tracker
-     cannot be greater than what the alloc tracker can handle: when the alloc
-     tracker is thawed, all the allocs in the freezer will be moved there!*/
-    if ((global_heap_tracker.freezer.allocs.count + global_heap_tracker.allocs.count) >= TRACEBACK_ARRAY_MAX_COUNT)
+    /* Check if we can add more samples */
+    if (global_heap_tracker.allocs.count >= HEAP_TRACKER_MAX_COUNT)
         return false;
 
     /* Avoid loops */
@@ -174,44 +638,233 @@ memalloc_heap_track(uint16_t max_nframe, void* ptr, size_t size, PyMemAllocatorD
         return false;
 
     memalloc_set_reentrant(true);
-    traceback_t* tb = memalloc_get_traceback(max_nframe, ptr, global_heap_tracker.allocated_memory, domain);
+    traceback_t* tb = memalloc_get_traceback(
+      max_nframe, ptr, (size_t)Py_MIN(global_heap_tracker.allocated_memory, SIZE_MAX), domain);
     memalloc_set_reentrant(false);
 
-    if (tb) {
-        if (global_heap_tracker.frozen)
-            traceback_array_append(&global_heap_tracker.freezer.allocs, tb);
-        else
-            traceback_array_append(&global_heap_tracker.allocs, tb);
+    if (tb == NULL)
+        return false;
 
-        /* Reset the counter to 0 */
-        global_heap_tracker.allocated_memory = 0;
+    tb->alloc_size = size;
 
-        /* Compute the new target sample size */
-        global_heap_tracker.current_sample_size = heap_tracker_next_sample_size(global_heap_tracker.sample_size);
+    HEAP_TRACKER_LOCK();
 
-        return true;
+    bool tracked = heap_tracker_index_reserve(&global_heap_tracker, global_heap_tracker.allocs.count + 1);
+
+    if (tracked) {
+        traceback_array_append(&global_heap_tracker.allocs, tb);
+        if (global_heap_tracker.lifetime)
+            timestamp_array_append(&global_heap_tracker.alloc_times, lifetime_now_ns());
+        heap_tracker_index_insert(&global_heap_tracker, global_heap_tracker.allocs.count - 1);
+    }
+
+    HEAP_TRACKER_UNLOCK();
+
+    if (!tracked) {
+        traceback_free(tb);
+        return false;
     }
 
-    return false;
+    heap_tracker_consume_sample(&global_heap_tracker);
+
+    /* This is the slow path already, so take the chance to catch up */
+    heap_tracker_release_removed(&global_heap_tracker);
+
+    return true;
+}
+
+/* Track a memory allocation in the heap profiler.
+
+   Returns true if the allocation was tracked, false otherwise. */
+bool
+memalloc_heap_track(uint16_t max_nframe, void* ptr, size_t size, PyMemAllocatorDomain domain)
+{
+    heap_realloc_cache_put(ptr, size);
+    return heap_tracker_track(max_nframe, ptr, size, size, domain);
+}
+
+void
+memalloc_heap_realloc(uint16_t max_nframe, void* old_ptr, void* new_ptr, size_t new_size, PyMemAllocatorDomain domain)
+{
+    if (old_ptr == NULL) {
+        memalloc_heap_track(max_nframe, new_ptr, new_size, domain);
+        return;
+    }
+
+    size_t old_size = heap_realloc_cache_take(old_ptr);
+    heap_realloc_cache_put(new_ptr, new_size);
+
+    HEAP_TRACKER_LOCK();
+
+    uint32_t slot = heap_tracker_index_find(&global_heap_tracker, old_ptr);
+
+    if (slot != HEAP_INDEX_EMPTY) {
+        /* The sample follows the block, and its traceback is kept, rather than
+           being released and maybe captured again */
+        TRACEBACK_ARRAY_COUNT_TYPE i = global_heap_tracker.index.slots[slot];
+        traceback_t* tb = global_heap_tracker.allocs.tab[i];
+        size_t grown = new_size > tb->alloc_size ? new_size - tb->alloc_size : 0;
+
+        if (new_ptr != old_ptr) {
+            heap_tracker_index_delete(&global_heap_tracker, slot);
+            tb->ptr = new_ptr;
+            heap_tracker_index_insert(&global_heap_tracker, i);
+        }
+        tb->alloc_size = new_size;
+
+        /* The bytes it grew by are sampled like any others, and when that's
+           their turn, the sample stands for them too. Shrinking keeps the
+           weight: the sample is for the bytes allocated at the time. */
+        if (heap_tracker_count(&global_heap_tracker, grown)) {
+            tb->size = (size_t)Py_MIN((uint64_t)tb->size + global_heap_tracker.allocated_memory, SIZE_MAX);
+            heap_tracker_unexport(&global_heap_tracker, i);
+            heap_tracker_consume_sample(&global_heap_tracker);
+        }
+
+        HEAP_TRACKER_UNLOCK();
+        return;
+    }
+
+    HEAP_TRACKER_UNLOCK();
+
+    /* Only the bytes the realloc added are new, if the old size is known */
+    heap_tracker_track(max_nframe, new_ptr, new_size > old_size ? new_size - old_size : 0, new_size, domain);
 }
 
 PyObject*
 memalloc_heap()
 {
-    heap_tracker_freeze(&global_heap_tracker);
+    heap_snapshot_t snapshot;
 
-    PyObject* heap_list = PyList_New(global_heap_tracker.allocs.count);
+    if (!heap_tracker_snapshot(&global_heap_tracker, &snapshot))
+        return PyErr_NoMemory();
 
-    for (TRACEBACK_ARRAY_COUNT_TYPE i = 0; i < global_heap_tracker.allocs.count; i++) {
-        traceback_t* tb = global_heap_tracker.allocs.tab[i];
+    PyObject* heap_list = PyList_New(snapshot.count);
+
+    if (heap_list) {
+        for (TRACEBACK_ARRAY_COUNT_TYPE i = 0; i < snapshot.count; i++) {
+            traceback_t* tb = &snapshot.tab[i];
 
-        PyObject* tb_and_size = PyTuple_New(2);
-        PyTuple_SET_ITEM(tb_and_size, 0, traceback_to_tuple(tb));
-        PyTuple_SET_ITEM(tb_and_size, 1, PyLong_FromSize_t(tb->size));
-        PyList_SET_ITEM(heap_list, i, tb_and_size);
+            PyObject* tb_and_size = PyTuple_New(2);
+            PyTuple_SET_ITEM(tb_and_size, 0, traceback_to_tuple(tb));
+            PyTuple_SET_ITEM(tb_and_size, 1, PyLong_FromSize_t(tb->size));
+            PyList_SET_ITEM(heap_list, i, tb_and_size);
+        }
     }
 
-    heap_tracker_thaw(&global_heap_tracker);
+    heap_snapshot_release(&snapshot);
 
     return heap_list;
 }
+
+PyObject*
+memalloc_heap_types()
+{
+    heap_snapshot_t snapshot;
+
+    if (!heap_tracker_snapshot(&global_heap_tracker, &snapshot))
+        return PyErr_NoMemory();
+
+    PyObject* types = PyList_New(snapshot.count);
+
+    if (types) {
+        for (TRACEBACK_ARRAY_COUNT_TYPE i = 0; i < snapshot.count; i++) {
+            PyObject* type = snapshot.tab[i].type ? (PyObject*)snapshot.tab[i].type : Py_None;
+            Py_INCREF(type);
+            PyList_SET_ITEM(types, i, type);
+        }
+    }
+
+    heap_snapshot_release(&snapshot);
+
+    return types;
+}
+
+bool
+memalloc_heap_export(memalloc_exporter_t* exporter)
+{
+    heap_snapshot_t snapshot;
+
+    if (!heap_tracker_snapshot(&global_heap_tracker, &snapshot)) {
+        PyErr_NoMemory();
+        return false;
+    }
+
+    for (TRACEBACK_ARRAY_COUNT_TYPE i = 0; i < snapshot.count && !exporter->failed; i++) {
+        traceback_t* tb = &snapshot.tab[i];
+        ddup_sample_t* sample = memalloc_exporter_start_sample(exporter, tb);
+
+        if (sample) {
+            exporter->capi->push_heap(sample, (int64_t)Py_MIN(tb->size, (size_t)INT64_MAX));
+            memalloc_exporter_flush_sample(exporter, sample, tb);
+        }
+    }
+
+    heap_snapshot_release(&snapshot);
+
+    return !exporter->failed;
+}
+
+bool
+memalloc_heap_export_delta(memalloc_exporter_t* exporter)
+{
+    heap_snapshot_t added;
+    heap_id_array_t freed;
+    uint64_t first_id;
+
+    if (!heap_tracker_delta(&global_heap_tracker, &added, &freed, &first_id)) {
+        PyErr_NoMemory();
+        return false;
+    }
+
+    /* Whatever the live set holds comes from a previous tracker */
+    if (global_heap_tracker.delta_reset) {
+        exporter->capi->heap_live_clear();
+        global_heap_tracker.delta_reset = false;
+    }
+
+    for (TRACEBACK_ARRAY_COUNT_TYPE i = 0; i < freed.count; i++)
+        exporter->capi->heap_live_remove(freed.tab[i]);
+
+    /* The allocations are exported either way: if this fails, the remaining
+       ones are left out of the live set until they are freed */
+    for (TRACEBACK_ARRAY_COUNT_TYPE i = 0; i < added.count && !exporter->failed; i++) {
+        traceback_t* tb = &added.tab[i];
+        ddup_sample_t* sample = memalloc_exporter_start_sample(exporter, tb);
+
+        if (sample) {
+            exporter->capi->push_heap(sample, (int64_t)Py_MIN(tb->size, (size_t)INT64_MAX));
+            traceback_push_frames(tb, exporter->capi, sample);
+            exporter->capi->heap_live_add(sample, first_id + i);
+            exporter->capi->drop_sample(sample);
+        }
+    }
+
+    heap_id_array_wipe(&freed);
+    heap_snapshot_release(&added);
+
+    return !exporter->failed;
+}
+
+PyObject*
+memalloc_heap_lifetimes()
+{
+    lifetime_table_t* lifetimes = &global_heap_tracker.lifetimes;
+
+    heap_tracker_release_removed(&global_heap_tracker);
+
+    HEAP_TRACKER_LOCK();
+    for (TRACEBACK_ARRAY_COUNT_TYPE i = 0; i < global_heap_tracker.allocs.count; i++)
+        lifetime_table_add_live(lifetimes, global_heap_tracker.allocs.tab[i]);
+    HEAP_TRACKER_UNLOCK();
+
+    /* Building the list allocates and frees, so take the histograms out of the
+       tracker first, which starts over with an empty table */
+    lifetime_table_t collected = *lifetimes;
+    lifetime_table_init(lifetimes);
+
+    PyObject* list = lifetime_table_to_list(&collected);
+    lifetime_table_wipe(&collected);
+
+    return list;
+}
@@ -7,26 +7,57 @@
 
 #include <Python.h>
 
+#include "_memalloc_export.h"
 #include "_utils.h"
 
-/* The maximum heap sample size is the maximum value we can store in a heap_tracker_t.allocated_memory */
+/* The maximum heap sample size is the maximum value we can store in a heap_tracker_t.sample_size */
 #define MAX_HEAP_SAMPLE_SIZE UINT32_MAX
 
+/* If lifetime is true, also record how long the tracked allocations live. If
+   locked is true, the tracker can be updated by threads which do not hold the
+   GIL, with memalloc_heap_untrack_without_gil(). */
 void
-memalloc_heap_tracker_init(uint32_t sample_size);
+memalloc_heap_tracker_init(uint32_t sample_size, bool lifetime, bool locked);
 void
 memalloc_heap_tracker_deinit(void);
 
 PyObject*
 memalloc_heap();
+/* The types of the objects of the sampled heap, in the same order as memalloc_heap() */
+PyObject*
+memalloc_heap_types();
+/* Returns false, with an exception set, if the export failed */
+bool
+memalloc_heap_export(memalloc_exporter_t* exporter);
+/* Same as memalloc_heap_export(), but only reports the allocations tracked
+   and freed since the previous call to ddup's live set, which adds the live
+   heap to every profile by itself */
+bool
+memalloc_heap_export_delta(memalloc_exporter_t* exporter);
+
+/* Returns the lifetime histograms recorded since the last call, see
+   lifetime_table_to_list(), counting the allocations tracked at the time of
+   the call as alive */
+PyObject*
+memalloc_heap_lifetimes();
 
 bool
 memalloc_heap_track(uint16_t max_nframe, void* ptr, size_t size, PyMemAllocatorDomain domain);
+/* Track the reallocation of old_ptr (which may be NULL) to new_ptr. A tracked
+   allocation keeps its traceback, and otherwise, only the bytes it grew by are
+   counted towards the next sample, when its previous size is known. */
+void
+memalloc_heap_realloc(uint16_t max_nframe, void* old_ptr, void* new_ptr, size_t new_size, PyMemAllocatorDomain domain);
 void
 memalloc_heap_untrack(void* ptr);
+/* Same as memalloc_heap_untrack(), from a thread which may not hold the GIL:
+   the traceback is released later on by one which does */
+void
+memalloc_heap_untrack_without_gil(void* ptr);
 
 #define MEMALLOC_HEAP_PTR_ARRAY_COUNT_TYPE uint64_t
 #define MEMALLOC_HEAP_PTR_ARRAY_MAX_COUNT UINT64_MAX
 DO_ARRAY(void*, ptr, MEMALLOC_HEAP_PTR_ARRAY_COUNT_TYPE, DO_NOTHING)
+DO_ARRAY(uint64_t, timestamp, uint32_t, DO_NOTHING)
 
 #endif
@@ -0,0 +1,210 @@
+#include <string.h>
+
+#ifdef MS_WINDOWS
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#define PY_SSIZE_T_CLEAN
+#include "_memalloc_lifetime.h"
+#include "_memalloc_raw.h"
+
+#define LIFETIME_TABLE_MIN_CAPACITY 64
+
+/* Upper bounds of the buckets, in nanoseconds: 1ms, 10ms, 100ms, 1s, 10s, 1min */
+static const uint64_t lifetime_bounds_ns[LIFETIME_HISTOGRAM_BUCKETS - 1] = {
+    UINT64_C(1000000),     UINT64_C(10000000),    UINT64_C(100000000),
+    UINT64_C(1000000000),  UINT64_C(10000000000), UINT64_C(60000000000),
+};
+
+uint64_t
+lifetime_now_ns(void)
+{
+#ifdef MS_WINDOWS
+    static LARGE_INTEGER frequency = { 0 };
+    LARGE_INTEGER counter;
+
+    if (frequency.QuadPart == 0)
+        QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+
+    /* Split the conversion so that it does not overflow */
+    uint64_t seconds = (uint64_t)(counter.QuadPart / frequency.QuadPart);
+    uint64_t rest = (uint64_t)(counter.QuadPart % frequency.QuadPart);
+    return seconds * UINT64_C(1000000000) + rest * UINT64_C(1000000000) / (uint64_t)frequency.QuadPart;
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * UINT64_C(1000000000) + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+static inline uint32_t
+lifetime_bucket(uint64_t lifetime_ns)
+{
+    uint32_t bucket = 0;
+
+    while (bucket < LIFETIME_HISTOGRAM_BUCKETS - 1 && lifetime_ns >= lifetime_bounds_ns[bucket])
+        bucket++;
+
+    return bucket;
+}
+
+static inline uint32_t
+lifetime_table_home(const lifetime_table_t* table, const traceback_t* tb)
+{
+    /* Same Fibonacci hashing as the heap index, over both parts of the key */
+    uint64_t key = (uint64_t)(uintptr_t)tb->stack ^ ((uint64_t)tb->thread_id * UINT64_C(0xFF51AFD7ED558CCD));
+    uint64_t hash = key * UINT64_C(0x9E3779B97F4A7C15);
+    return (uint32_t)(hash >> 32) & (table->capacity - 1);
+}
+
+void
+lifetime_table_init(lifetime_table_t* table)
+{
+    table->tab = NULL;
+    table->capacity = 0;
+    table->count = 0;
+}
+
+void
+lifetime_table_wipe(lifetime_table_t* table)
+{
+    /* Detach the entries first: releasing a stack may free memory, and get back
+       to the heap tracker which records into this table */
+    lifetime_entry_t* tab = table->tab;
+    uint32_t capacity = table->capacity;
+
+    lifetime_table_init(table);
+
+    for (uint32_t i = 0; i < capacity; i++)
+        if (tab[i].tb.stack)
+            traceback_release(&tab[i].tb);
+
+    memalloc_raw_free(tab);
+}
+
+/* Return the entry of the stack and thread of tb, or an empty one where to add them */
+static lifetime_entry_t*
+lifetime_table_slot(lifetime_table_t* table, const traceback_t* tb)
+{
+    uint32_t slot = lifetime_table_home(table, tb);
+
+    while (table->tab[slot].tb.stack != NULL &&
+           (table->tab[slot].tb.stack != tb->stack || table->tab[slot].tb.thread_id != tb->thread_id))
+        slot = (slot + 1) & (table->capacity - 1);
+
+    return &table->tab[slot];
+}
+
+/* Make room for one more entry. Returns false if the memory could not be allocated. */
+static bool
+lifetime_table_reserve(lifetime_table_t* table)
+{
+    if ((uint64_t)(table->count + 1) * 2 <= table->capacity)
+        return true;
+
+    /* Stacks are interned, so there are never close to 2^31 distinct ones */
+    uint32_t capacity = table->capacity ? table->capacity * 2 : LIFETIME_TABLE_MIN_CAPACITY;
+    lifetime_entry_t* tab = memalloc_raw_calloc(capacity, sizeof(lifetime_entry_t));
+
+    if (tab == NULL)
+        return false;
+
+    lifetime_table_t grown = { tab, capacity, table->count };
+
+    for (uint32_t i = 0; i < table->capacity; i++)
+        if (table->tab[i].tb.stack)
+            *lifetime_table_slot(&grown, &table->tab[i].tb) = table->tab[i];
+
+    memalloc_raw_free(table->tab);
+    *table = grown;
+
+    return true;
+}
+
+/* Return the entry of the stack and thread of tb, adding it if needed, or NULL
+   if the memory could not be allocated */
+static lifetime_entry_t*
+lifetime_table_get(lifetime_table_t* table, const traceback_t* tb)
+{
+    if (!lifetime_table_reserve(table))
+        return NULL;
+
+    lifetime_entry_t* entry = lifetime_table_slot(table, tb);
+
+    if (entry->tb.stack == NULL) {
+        traceback_copy(&entry->tb, tb);
+        table->count++;
+    }
+
+    return entry;
+}
+
+void
+lifetime_table_add_freed(lifetime_table_t* table, const traceback_t* tb, uint64_t lifetime_ns)
+{
+    lifetime_entry_t* entry = lifetime_table_get(table, tb);
+
+    if (entry)
+        entry->freed[lifetime_bucket(lifetime_ns)]++;
+}
+
+void
+lifetime_table_add_live(lifetime_table_t* table, const traceback_t* tb)
+{
+    lifetime_entry_t* entry = lifetime_table_get(table, tb);
+
+    if (entry)
+        entry->live++;
+}
+
+PyObject*
+lifetime_table_to_list(lifetime_table_t* table)
+{
+    PyObject* list = PyList_New(table->count);
+
+    if (list == NULL)
+        return NULL;
+
+    Py_ssize_t n = 0;
+    for (uint32_t i = 0; i < table->capacity; i++) {
+        lifetime_entry_t* entry = &table->tab[i];
+
+        if (entry->tb.stack == NULL)
+            continue;
+
+        PyObject* freed = PyTuple_New(LIFETIME_HISTOGRAM_BUCKETS);
+        if (freed == NULL) {
+            Py_DECREF(list);
+            return NULL;
+        }
+        for (uint32_t bucket = 0; bucket < LIFETIME_HISTOGRAM_BUCKETS; bucket++)
+            PyTuple_SET_ITEM(freed, bucket, PyLong_FromUnsignedLongLong(entry->freed[bucket]));
+
+        PyObject* item = Py_BuildValue("(NNK)", traceback_to_tuple(&entry->tb), freed, entry->live);
+        if (item == NULL) {
+            Py_DECREF(list);
+            return NULL;
+        }
+        PyList_SET_ITEM(list, n++, item);
+    }
+
+    return list;
+}
+
+PyObject*
+lifetime_bounds_to_tuple(void)
+{
+    PyObject* bounds = PyTuple_New(LIFETIME_HISTOGRAM_BUCKETS - 1);
+
+    if (bounds == NULL)
+        return NULL;
+
+    for (uint32_t bucket = 0; bucket < LIFETIME_HISTOGRAM_BUCKETS - 1; bucket++)
+        PyTuple_SET_ITEM(bounds, bucket, PyLong_FromUnsignedLongLong(lifetime_bounds_ns[bucket]));
+
+    return bounds;
+}
@@ -0,0 +1,65 @@
+#ifndef _DDTRACE_MEMALLOC_LIFETIME_H
+#define _DDTRACE_MEMALLOC_LIFETIME_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <Python.h>
+
+#include "_memalloc_tb.h"
+
+/* Number of buckets of the lifetime histogram: one per bound of
+   lifetime_bounds_ns in _memalloc_lifetime.c, plus one for the longer lifetimes */
+#define LIFETIME_HISTOGRAM_BUCKETS 7
+
+/* How long the sampled allocations of a stack, made by a thread, lived */
+typedef struct
+{
+    /* Holds a reference to the stack; its ptr and size are those of the first allocation recorded */
+    traceback_t tb;
+    /* Number of sampled allocations freed, by lifetime bucket */
+    uint64_t freed[LIFETIME_HISTOGRAM_BUCKETS];
+    /* Number of sampled allocations still alive */
+    uint64_t live;
+} lifetime_entry_t;
+
+/* Lifetime histograms by stack and thread.
+
+   Open-addressing (linear probing) table, kept at most half full. Entries are
+   never removed one by one: the whole table is handed out at once. Recording
+   does not call into Python, so it can be done from the allocator hooks. */
+typedef struct
+{
+    /* Entries with a NULL stack are empty */
+    lifetime_entry_t* tab;
+    /* Number of entries: either 0 or a power of 2 */
+    uint32_t capacity;
+    uint32_t count;
+} lifetime_table_t;
+
+/* Monotonic clock used to time allocations, in nanoseconds */
+uint64_t
+lifetime_now_ns(void);
+
+void
+lifetime_table_init(lifetime_table_t* table);
+void
+lifetime_table_wipe(lifetime_table_t* table);
+
+/* Record a sampled allocation freed after lifetime_ns nanoseconds */
+void
+lifetime_table_add_freed(lifetime_table_t* table, const traceback_t* tb, uint64_t lifetime_ns);
+/* Record a sampled allocation that is still alive */
+void
+lifetime_table_add_live(lifetime_table_t* table, const traceback_t* tb);
+
+/* Returns a list of (traceback, freed, live) tuples, freed being a tuple with
+   the counts of each bucket, or NULL with an exception set. */
+PyObject*
+lifetime_table_to_list(lifetime_table_t* table);
+
+/* Returns the upper bounds of the buckets, in nanoseconds, as a tuple */
+PyObject*
+lifetime_bounds_to_tuple(void);
+
+#endif
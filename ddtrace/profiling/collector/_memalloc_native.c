@@ -0,0 +1,396 @@
+#define PY_SSIZE_T_CLEAN
+#include "_memalloc_native.h"
+
+#ifdef MEMALLOC_NATIVE
+
+#include <link.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#if defined(__x86_64__)
+#define NATIVE_R_JUMP_SLOT R_X86_64_JUMP_SLOT
+#define NATIVE_R_GLOB_DAT R_X86_64_GLOB_DAT
+#elif defined(__aarch64__)
+#define NATIVE_R_JUMP_SLOT R_AARCH64_JUMP_SLOT
+#define NATIVE_R_GLOB_DAT R_AARCH64_GLOB_DAT
+#endif
+
+static memalloc_native_hooks_t native_hooks;
+
+/* Read on every call of the replacements, from any thread. The replacements
+   stay in place for a while after being disabled, since other threads may
+   have loaded them already. */
+static bool native_enabled = false;
+
+/* Value of dlpi_adds at the last patch, to skip walking the same libraries again */
+static unsigned long long native_patched_adds = 0;
+
+static inline bool
+native_is_enabled(void)
+{
+    return __atomic_load_n(&native_enabled, __ATOMIC_RELAXED);
+}
+
+/* The replacements call the C allocator through the GOT of this module, which
+   is never rewritten */
+
+static void*
+native_malloc(size_t size)
+{
+    void* ptr = malloc(size);
+
+    if (ptr && native_is_enabled())
+        native_hooks.track(ptr, size);
+
+    return ptr;
+}
+
+static void*
+native_calloc(size_t nelem, size_t elsize)
+{
+    void* ptr = calloc(nelem, elsize);
+
+    /* calloc fails if the size overflows */
+    if (ptr && native_is_enabled())
+        native_hooks.track(ptr, nelem * elsize);
+
+    return ptr;
+}
+
+static void*
+native_realloc(void* ptr, size_t new_size)
+{
+    /* Before reallocating, since another thread can get the same address as
+       soon as it is released */
+    if (ptr && native_is_enabled())
+        native_hooks.untrack(ptr);
+
+    void* ptr2 = realloc(ptr, new_size);
+
+    if (ptr2 && native_is_enabled())
+        native_hooks.track(ptr2, new_size);
+
+    return ptr2;
+}
+
+static void
+native_free(void* ptr)
+{
+    if (ptr && native_is_enabled())
+        native_hooks.untrack(ptr);
+
+    free(ptr);
+}
+
+static int
+native_posix_memalign(void** memptr, size_t alignment, size_t size)
+{
+    int ret = posix_memalign(memptr, alignment, size);
+
+    if (ret == 0 && *memptr && native_is_enabled())
+        native_hooks.track(*memptr, size);
+
+    return ret;
+}
+
+static void*
+native_aligned_alloc(size_t alignment, size_t size)
+{
+    void* ptr = aligned_alloc(alignment, size);
+
+    if (ptr && native_is_enabled())
+        native_hooks.track(ptr, size);
+
+    return ptr;
+}
+
+typedef struct
+{
+    const char* name;
+    void* replacement;
+    /* What the GOT entries hold once resolved */
+    void* original;
+} native_function_t;
+
+static native_function_t native_functions[] = {
+    { "malloc", (void*)native_malloc, (void*)malloc },
+    { "calloc", (void*)native_calloc, (void*)calloc },
+    { "realloc", (void*)native_realloc, (void*)realloc },
+    { "free", (void*)native_free, (void*)free },
+    { "posix_memalign", (void*)native_posix_memalign, (void*)posix_memalign },
+    { "aligned_alloc", (void*)native_aligned_alloc, (void*)aligned_alloc },
+};
+
+#define NATIVE_FUNCTIONS_COUNT (sizeof(native_functions) / sizeof(native_functions[0]))
+
+/* Prefixes of the file names of the libraries left alone: the ones which
+   either implement the allocator, or only allocate through PyMem */
+static const char* const native_skipped_prefixes[] = {
+    "ld-linux",   "ld-musl",  "libc.so", "libc-",     "libpthread", "libdl.",      "libpython",   "linux-vdso",
+    "linux-gate", "libasan",  "libtsan", "liblsan",   "libhwasan",  "libubsan",    "libjemalloc", "libtcmalloc",
+    "libmimalloc",
+};
+
+static bool
+native_is_skipped(const char* path)
+{
+    /* The main program, which is the interpreter */
+    if (path == NULL || path[0] == '\0')
+        return true;
+
+    /* The profiler's own libraries */
+    if (strstr(path, "/ddtrace/"))
+        return true;
+
+    const char* name = strrchr(path, '/');
+    name = name ? name + 1 : path;
+
+    for (size_t i = 0; i < sizeof(native_skipped_prefixes) / sizeof(native_skipped_prefixes[0]); i++)
+        if (strncmp(name, native_skipped_prefixes[i], strlen(native_skipped_prefixes[i])) == 0)
+            return true;
+
+    return false;
+}
+
+/* Everything needed to rewrite the GOT entries of a library */
+typedef struct
+{
+    ElfW(Addr) base;
+    /* Range of the loaded segments */
+    uintptr_t low, high;
+    /* Range made read-only once relocated */
+    uintptr_t relro_start, relro_end;
+    const ElfW(Sym) * symtab;
+    const char* strtab;
+    size_t strsz;
+} native_object_t;
+
+/* Whether to install the replacements or remove them */
+typedef struct
+{
+    bool restore;
+    size_t count;
+} native_walk_t;
+
+static inline uintptr_t
+native_dynamic_address(const native_object_t* object, ElfW(Addr) ptr)
+{
+    /* glibc relocates the addresses of the dynamic section, musl does not */
+    return ptr < object->base ? object->base + ptr : ptr;
+}
+
+static bool
+native_write_slot(const native_object_t* object, void** slot, void* value)
+{
+    uintptr_t address = (uintptr_t)slot;
+
+    if (address >= object->relro_start && address < object->relro_end) {
+        uintptr_t page_size = (uintptr_t)sysconf(_SC_PAGESIZE);
+        void* page = (void*)(address & ~(page_size - 1));
+
+        if (mprotect(page, page_size, PROT_READ | PROT_WRITE) != 0)
+            return false;
+        __atomic_store_n(slot, value, __ATOMIC_RELEASE);
+        mprotect(page, page_size, PROT_READ);
+    } else {
+        __atomic_store_n(slot, value, __ATOMIC_RELEASE);
+    }
+
+    return true;
+}
+
+static void
+native_walk_relocations(const native_object_t* object, const ElfW(Rela) * relas, size_t size, native_walk_t* walk)
+{
+    for (size_t i = 0; i < size / sizeof(ElfW(Rela)); i++) {
+        const ElfW(Rela)* rela = &relas[i];
+        uint32_t type = ELF64_R_TYPE(rela->r_info);
+
+        if (type != NATIVE_R_JUMP_SLOT && type != NATIVE_R_GLOB_DAT)
+            continue;
+
+        ElfW(Word) name_offset = object->symtab[ELF64_R_SYM(rela->r_info)].st_name;
+        if (name_offset >= object->strsz)
+            continue;
+
+        const char* name = object->strtab + name_offset;
+        native_function_t* function = NULL;
+
+        for (size_t f = 0; f < NATIVE_FUNCTIONS_COUNT; f++) {
+            if (strcmp(name, native_functions[f].name) == 0) {
+                function = &native_functions[f];
+                break;
+            }
+        }
+
+        if (function == NULL)
+            continue;
+
+        void** slot = (void**)(object->base + rela->r_offset);
+        void* current = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+
+        if (walk->restore) {
+            if (current == function->replacement && native_write_slot(object, slot, function->original))
+                walk->count++;
+        } else if (current != function->replacement) {
+            /* Either resolved to the C allocator, or not resolved yet and
+               pointing to the PLT of the library. Anything else is another
+               allocator, which the replacements must not forward to libc. */
+            bool lazy = (uintptr_t)current >= object->low && (uintptr_t)current < object->high;
+
+            if ((current == function->original || lazy) && native_write_slot(object, slot, function->replacement))
+                walk->count++;
+        }
+    }
+}
+
+static int
+native_walk_object(struct dl_phdr_info* info, size_t Py_UNUSED(size), void* data)
+{
+    native_walk_t* walk = (native_walk_t*)data;
+
+    if (native_is_skipped(info->dlpi_name))
+        return 0;
+
+    native_object_t object = { info->dlpi_addr, UINTPTR_MAX, 0, 0, 0, NULL, NULL, 0 };
+    const ElfW(Dyn)* dynamic = NULL;
+
+    for (ElfW(Half) i = 0; i < info->dlpi_phnum; i++) {
+        const ElfW(Phdr)* phdr = &info->dlpi_phdr[i];
+        uintptr_t start = info->dlpi_addr + phdr->p_vaddr;
+
+        if (phdr->p_type == PT_DYNAMIC) {
+            dynamic = (const ElfW(Dyn)*)start;
+        } else if (phdr->p_type == PT_LOAD) {
+            object.low = Py_MIN(object.low, start);
+            object.high = Py_MAX(object.high, start + phdr->p_memsz);
+        } else if (phdr->p_type == PT_GNU_RELRO) {
+            object.relro_start = start;
+            object.relro_end = start + phdr->p_memsz;
+        }
+    }
+
+    /* This module, the GOT of which the replacements call through */
+    uintptr_t self = (uintptr_t)&native_walk_object;
+    if (dynamic == NULL || (self >= object.low && self < object.high))
+        return 0;
+
+    const ElfW(Rela)* jmprel = NULL;
+    const ElfW(Rela)* rela = NULL;
+    size_t pltrelsz = 0, relasz = 0;
+    ElfW(Sxword) pltrel = DT_RELA;
+
+    for (const ElfW(Dyn)* dyn = dynamic; dyn->d_tag != DT_NULL; dyn++) {
+        switch (dyn->d_tag) {
+            case DT_SYMTAB:
+                object.symtab = (const ElfW(Sym)*)native_dynamic_address(&object, dyn->d_un.d_ptr);
+                break;
+            case DT_STRTAB:
+                object.strtab = (const char*)native_dynamic_address(&object, dyn->d_un.d_ptr);
+                break;
+            case DT_STRSZ:
+                object.strsz = dyn->d_un.d_val;
+                break;
+            case DT_JMPREL:
+                jmprel = (const ElfW(Rela)*)native_dynamic_address(&object, dyn->d_un.d_ptr);
+                break;
+            case DT_PLTRELSZ:
+                pltrelsz = dyn->d_un.d_val;
+                break;
+            case DT_PLTREL:
+                pltrel = (ElfW(Sxword))dyn->d_un.d_val;
+                break;
+            case DT_RELA:
+                rela = (const ElfW(Rela)*)native_dynamic_address(&object, dyn->d_un.d_ptr);
+                break;
+            case DT_RELASZ:
+                relasz = dyn->d_un.d_val;
+                break;
+        }
+    }
+
+    if (object.symtab == NULL || object.strtab == NULL)
+        return 0;
+
+    /* Both x86_64 and aarch64 only use RELA relocations */
+    if (jmprel && pltrel == DT_RELA)
+        native_walk_relocations(&object, jmprel, pltrelsz, walk);
+    if (rela)
+        native_walk_relocations(&object, rela, relasz, walk);
+
+    return 0;
+}
+
+static int
+native_get_adds(struct dl_phdr_info* info, size_t size, void* data)
+{
+    if (size >= offsetof(struct dl_phdr_info, dlpi_adds) + sizeof(info->dlpi_adds))
+        *(unsigned long long*)data = info->dlpi_adds;
+
+    /* Every object has the same counters */
+    return 1;
+}
+
+void
+memalloc_native_start(const memalloc_native_hooks_t* hooks)
+{
+    native_hooks = *hooks;
+    __atomic_store_n(&native_enabled, true, __ATOMIC_RELEASE);
+
+    native_patched_adds = 0;
+    memalloc_native_patch();
+}
+
+size_t
+memalloc_native_patch(void)
+{
+    unsigned long long adds = 0;
+
+    if (!native_is_enabled())
+        return 0;
+
+    /* Nothing was loaded since the last time */
+    dl_iterate_phdr(native_get_adds, &adds);
+    if (adds != 0 && adds == native_patched_adds)
+        return 0;
+
+    native_walk_t walk = { false, 0 };
+    dl_iterate_phdr(native_walk_object, &walk);
+    native_patched_adds = adds;
+
+    return walk.count;
+}
+
+void
+memalloc_native_stop(void)
+{
+    __atomic_store_n(&native_enabled, false, __ATOMIC_RELEASE);
+
+    /* Only the libraries still loaded can be restored, and the others have
+       no call sites left anyway */
+    native_walk_t walk = { true, 0 };
+    dl_iterate_phdr(native_walk_object, &walk);
+}
+
+#else
+
+void
+memalloc_native_start(const memalloc_native_hooks_t* Py_UNUSED(hooks))
+{
+}
+
+size_t
+memalloc_native_patch(void)
+{
+    return 0;
+}
+
+void
+memalloc_native_stop(void)
+{
+}
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef _DDTRACE_MEMALLOC_NATIVE_H
+#define _DDTRACE_MEMALLOC_NATIVE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <Python.h>
+
+/* The allocations made by native code through the C allocator are found by
+   rewriting the GOT entries of the loaded ELF objects, so this is only
+   available on 64-bit Linux. It also relies on the GIL to tell which threads
+   can capture a traceback. */
+#if defined(__linux__) && (defined(__x86_64__) || defined(__aarch64__)) && !defined(Py_GIL_DISABLED)
+#define MEMALLOC_NATIVE
+#endif
+
+typedef struct
+{
+    /* Called after each successful allocation */
+    void (*track)(void* ptr, size_t size);
+    /* Called before each free, and before each reallocation */
+    void (*untrack)(void* ptr);
+} memalloc_native_hooks_t;
+
+/* Redirect the calls to the C allocator of the loaded libraries to the hooks.
+
+   The Python interpreter itself, the C library, the dynamic loader and the
+   allocators replacing the C one are left alone. This does nothing unless
+   MEMALLOC_NATIVE is defined. */
+void
+memalloc_native_start(const memalloc_native_hooks_t* hooks);
+/* Redirect the calls of the libraries loaded since the last call. Returns the
+   number of call sites redirected. */
+size_t
+memalloc_native_patch(void);
+/* Restore the calls of the libraries still loaded */
+void
+memalloc_native_stop(void);
+
+/* True if the current thread holds the GIL, without relying on
+   PyGILState_Check(), which always succeeds once subinterpreters exist */
+static inline bool
+memalloc_native_holds_gil(void)
+{
+#if PY_VERSION_HEX >= 0x030D0000
+    PyThreadState* tstate = PyThreadState_GetUnchecked();
+#else
+    PyThreadState* tstate = _PyThreadState_UncheckedGet();
+#endif
+    return tstate != NULL && tstate == PyGILState_GetThisThreadState();
+}
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef _DDTRACE_MEMALLOC_RAW_H
+#define _DDTRACE_MEMALLOC_RAW_H
+
+#include <stddef.h>
+
+#include <Python.h>
+
+/* The memory of the profiler itself comes from the raw domain. When that
+   domain is tracked as well, the profiler allocates from the allocator it
+   replaced instead, so that its own memory is neither sampled nor tracked
+   from within the trackers, which may be in the middle of an update, or
+   locked, when they allocate. The blocks don't need to be freed the same way
+   they were allocated: the tracking allocator hands them over to this one. */
+extern PyMemAllocatorEx memalloc_raw_allocator;
+
+static inline void*
+memalloc_raw_malloc(size_t size)
+{
+    if (memalloc_raw_allocator.malloc == NULL)
+        return PyMem_RawMalloc(size);
+    if (size > (size_t)PY_SSIZE_T_MAX)
+        return NULL;
+    return memalloc_raw_allocator.malloc(memalloc_raw_allocator.ctx, size);
+}
+
+static inline void*
+memalloc_raw_calloc(size_t nelem, size_t elsize)
+{
+    if (memalloc_raw_allocator.calloc == NULL)
+        return PyMem_RawCalloc(nelem, elsize);
+    if (elsize != 0 && nelem > (size_t)PY_SSIZE_T_MAX / elsize)
+        return NULL;
+    return memalloc_raw_allocator.calloc(memalloc_raw_allocator.ctx, nelem, elsize);
+}
+
+static inline void*
+memalloc_raw_realloc(void* ptr, size_t new_size)
+{
+    if (memalloc_raw_allocator.realloc == NULL)
+        return PyMem_RawRealloc(ptr, new_size);
+    if (new_size > (size_t)PY_SSIZE_T_MAX)
+        return NULL;
+    return memalloc_raw_allocator.realloc(memalloc_raw_allocator.ctx, ptr, new_size);
+}
+
+static inline void
+memalloc_raw_free(void* ptr)
+{
+    if (memalloc_raw_allocator.free == NULL)
+        PyMem_RawFree(ptr);
+    else
+        memalloc_raw_allocator.free(memalloc_raw_allocator.ctx, ptr);
+}
+
+#endif
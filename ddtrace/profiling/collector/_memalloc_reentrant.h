@@ -4,6 +4,35 @@
 #include "_pymacro.h"
 #include <stdbool.h>
 
+/* The reentrancy flag is checked on every allocation, so use a native
+   thread-local variable where the compiler has them; a load from it is much
+   cheaper than a call to the thread-specific storage API. */
+#if defined(__GNUC__) || defined(__clang__)
+#define MEMALLOC_THREAD_LOCAL __thread
+#elif defined(_MSC_VER)
+#define MEMALLOC_THREAD_LOCAL __declspec(thread)
+#elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L && !defined(__STDC_NO_THREADS__)
+#define MEMALLOC_THREAD_LOCAL _Thread_local
+#endif
+
+#ifdef MEMALLOC_THREAD_LOCAL
+
+extern MEMALLOC_THREAD_LOCAL bool memalloc_reentrant;
+
+static inline void
+memalloc_set_reentrant(bool reentrant)
+{
+    memalloc_reentrant = reentrant;
+}
+
+static inline bool
+memalloc_get_reentrant(void)
+{
+    return memalloc_reentrant;
+}
+
+#else
+
 #ifndef _PY37_AND_LATER
 #include <pythread.h>
 #endif
@@ -48,3 +77,5 @@ memalloc_get_reentrant(void)
 }
 
 #endif
+
+#endif
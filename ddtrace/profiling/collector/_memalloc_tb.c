@@ -4,11 +4,82 @@
 #include <Python.h>
 #include <frameobject.h>
 
+#include "_memalloc_raw.h"
 #include "_memalloc_tb.h"
 #include "_pymacro.h"
 
-/* Temporary traceback buffer to store new traceback */
-static traceback_t* traceback_buffer = NULL;
+/* Tracebacks captured at the same place have the same frames, and there are
+   usually far fewer distinct places than samples.  So the frames are interned
+   into stacks, which are shared by the tracebacks referencing them, and
+   counted so that they are freed along with the last one.  A stack also caches
+   its conversion to Python, which is built at most once however many times the
+   samples referencing it are exported.
+
+   Capturing a frame only reads its code object and the offset of its last
+   instruction.  The names come from the code object, and the line number from
+   its line table, when the stack is first exported; the line numbers are then
+   kept in the stack too.  The stack holds a reference to each code object,
+   rather than to its file and function names as it used to, since no Python
+   object (such as a weak reference) can be created from the allocator hooks. */
+struct memalloc_stack_s
+{
+    /* Hash of the frames and of the number of frames */
+    uint64_t hash;
+    /* Number of tracebacks referencing this stack */
+    uint64_t refcount;
+    /* The frames as a tuple of DDFrame, or NULL until first converted */
+    PyObject* frames_tuple;
+    /* The line number of each frame, or NULL until first exported */
+    unsigned int* linenos;
+    /* Total number of frames in the traceback */
+    uint16_t total_nframe;
+    /* Number of frames in the traceback */
+    uint16_t nframe;
+    /* List of frames, top frame first */
+    frame_t frames[1];
+};
+
+#define STACK_SIZE(NFRAME) (sizeof(memalloc_stack_t) + sizeof(frame_t) * (NFRAME - 1))
+
+#define STACK_TABLE_MIN_CAPACITY 64
+
+/* Open-addressing (linear probing) set of the live stacks, kept at most half full */
+static struct
+{
+    memalloc_stack_t** slots;
+    /* Number of slots: either 0 or a power of 2 */
+    size_t capacity;
+    /* Number of stacks in the table */
+    size_t count;
+} stack_table = { NULL, 0, 0 };
+
+/* Tracebacks are all the same size, and there are as many of them as there
+   are heap samples, so rather than each going through malloc, they are carved
+   out of chunks and recycled through a free list. */
+#define TRACEBACK_CHUNK_COUNT 4096
+
+typedef union traceback_slot_u
+{
+    traceback_t traceback;
+    union traceback_slot_u* next_free;
+} traceback_slot_t;
+
+typedef struct traceback_chunk_s
+{
+    struct traceback_chunk_s* next;
+    traceback_slot_t slots[TRACEBACK_CHUNK_COUNT];
+} traceback_chunk_t;
+
+static struct
+{
+    traceback_chunk_t* chunks;
+    traceback_slot_t* free_list;
+    /* Number of tracebacks handed out */
+    size_t count;
+} traceback_pool = { NULL, NULL, 0 };
+
+/* Temporary stack buffer to store new stacks */
+static memalloc_stack_t* stack_buffer = NULL;
 
 /* A string containing "<unknown>" just in case we can't store the real function
  * or file name. */
@@ -16,8 +87,6 @@ static PyObject* unknown_name = NULL;
 /* A string containing "" */
 static PyObject* empty_string = NULL;
 
-#define TRACEBACK_SIZE(NFRAME) (sizeof(traceback_t) + sizeof(frame_t) * (NFRAME - 1))
-
 static PyObject* ddframe_class = NULL;
 
 bool
@@ -68,91 +137,352 @@ memalloc_tb_init(uint16_t max_nframe)
         PyUnicode_InternInPlace(&empty_string);
     }
 
-    /* Allocate a buffer that can handle the largest traceback possible.
+    /* Allocate a buffer that can handle the largest stack possible.
        This will be used a temporary buffer when converting stack traces. */
-    traceback_buffer = PyMem_RawMalloc(TRACEBACK_SIZE(max_nframe));
+    stack_buffer = memalloc_raw_malloc(STACK_SIZE(max_nframe));
 
-    if (traceback_buffer == NULL)
+    if (stack_buffer == NULL)
         return -1;
 
     return 0;
 }
 
+/* Tracebacks may outlive the profiler (e.g. the events being iterated), so
+   the pool and the stack table only go away once the profiler is stopped and
+   all the tracebacks are gone, whichever comes last. */
+static void
+memalloc_tb_release(void)
+{
+    /* Copies of tracebacks hold stacks without holding tracebacks */
+    if (stack_buffer != NULL || traceback_pool.count > 0 || stack_table.count > 0)
+        return;
+
+    while (traceback_pool.chunks) {
+        traceback_chunk_t* next = traceback_pool.chunks->next;
+        memalloc_raw_free(traceback_pool.chunks);
+        traceback_pool.chunks = next;
+    }
+    traceback_pool.free_list = NULL;
+
+    memalloc_raw_free(stack_table.slots);
+    stack_table.slots = NULL;
+    stack_table.capacity = 0;
+}
+
 void
 memalloc_tb_deinit(void)
 {
-    PyMem_RawFree(traceback_buffer);
+    memalloc_raw_free(stack_buffer);
+    stack_buffer = NULL;
+
+    memalloc_tb_release();
 }
 
-void
-traceback_free(traceback_t* tb)
+static traceback_t*
+traceback_alloc(void)
 {
-    for (uint16_t nframe = 0; nframe < tb->nframe; nframe++) {
-        Py_DECREF(tb->frames[nframe].filename);
-        Py_DECREF(tb->frames[nframe].name);
+    if (traceback_pool.free_list == NULL) {
+        traceback_chunk_t* chunk = memalloc_raw_malloc(sizeof(traceback_chunk_t));
+
+        if (chunk == NULL)
+            return NULL;
+
+        chunk->next = traceback_pool.chunks;
+        traceback_pool.chunks = chunk;
+
+        for (size_t i = 0; i < TRACEBACK_CHUNK_COUNT; i++) {
+            chunk->slots[i].next_free = traceback_pool.free_list;
+            traceback_pool.free_list = &chunk->slots[i];
+        }
     }
-    PyMem_RawFree(tb);
+
+    traceback_slot_t* slot = traceback_pool.free_list;
+    traceback_pool.free_list = slot->next_free;
+    traceback_pool.count++;
+
+    return &slot->traceback;
 }
 
-/* Convert PyFrameObject to a frame_t that we can store in memory */
 static void
-memalloc_convert_frame(PyFrameObject* pyframe, frame_t* frame)
+traceback_dealloc(traceback_t* tb)
+{
+    /* The traceback is the first member of its slot */
+    traceback_slot_t* slot = (traceback_slot_t*)tb;
+
+    slot->next_free = traceback_pool.free_list;
+    traceback_pool.free_list = slot;
+    traceback_pool.count--;
+
+    memalloc_tb_release();
+}
+
+static inline size_t
+stack_table_home(uint64_t hash)
+{
+    return (size_t)hash & (stack_table.capacity - 1);
+}
+
+static uint64_t
+stack_hash(const memalloc_stack_t* stack)
+{
+    /* FNV-1a over the frames, the identity of the code objects being good enough */
+    uint64_t hash = UINT64_C(0xCBF29CE484222325) ^ ((uint64_t)stack->total_nframe << 16 | stack->nframe);
+
+    for (uint16_t i = 0; i < stack->nframe; i++) {
+        hash = (hash ^ (uint64_t)(uintptr_t)stack->frames[i].code) * UINT64_C(0x100000001B3);
+        hash = (hash ^ (uint32_t)stack->frames[i].lasti) * UINT64_C(0x100000001B3);
+    }
+
+    /* The low bits are used to index the table, so make sure they depend on all the others */
+    return (hash ^ (hash >> 32)) * UINT64_C(0x9E3779B97F4A7C15);
+}
+
+static inline bool
+stack_equal(const memalloc_stack_t* a, const memalloc_stack_t* b)
+{
+    /* frame_t is packed, so it can be compared as a whole */
+    return a->hash == b->hash && a->total_nframe == b->total_nframe && a->nframe == b->nframe &&
+           memcmp(a->frames, b->frames, sizeof(frame_t) * a->nframe) == 0;
+}
+
+static void
+stack_table_insert(memalloc_stack_t* stack)
+{
+    size_t slot = stack_table_home(stack->hash);
+
+    while (stack_table.slots[slot] != NULL)
+        slot = (slot + 1) & (stack_table.capacity - 1);
+
+    stack_table.slots[slot] = stack;
+    stack_table.count++;
+}
+
+/* Make room in the table for one more stack.
+
+   Returns false if the memory could not be allocated. */
+static bool
+stack_table_reserve(void)
+{
+    if ((stack_table.count + 1) * 2 <= stack_table.capacity)
+        return true;
+
+    size_t capacity = stack_table.capacity ? stack_table.capacity * 2 : STACK_TABLE_MIN_CAPACITY;
+    memalloc_stack_t** slots = memalloc_raw_calloc(capacity, sizeof(memalloc_stack_t*));
+
+    if (slots == NULL)
+        return false;
+
+    memalloc_stack_t** old_slots = stack_table.slots;
+    size_t old_capacity = stack_table.capacity;
+
+    stack_table.slots = slots;
+    stack_table.capacity = capacity;
+    stack_table.count = 0;
+
+    for (size_t i = 0; i < old_capacity; i++)
+        if (old_slots[i])
+            stack_table_insert(old_slots[i]);
+
+    memalloc_raw_free(old_slots);
+
+    return true;
+}
+
+static void
+stack_table_remove(memalloc_stack_t* stack)
+{
+    size_t mask = stack_table.capacity - 1;
+    size_t slot = stack_table_home(stack->hash);
+
+    while (stack_table.slots[slot] != stack)
+        slot = (slot + 1) & mask;
+
+    /* Shift the following entries of the probe sequence back, rather than
+       leaving a tombstone, so that lookups never get slower over time. */
+    for (size_t next = (slot + 1) & mask; stack_table.slots[next] != NULL; next = (next + 1) & mask) {
+        size_t home = stack_table_home(stack_table.slots[next]->hash);
+
+        /* The entry at `next` can move to `slot` unless its home lies
+           cyclically in ]slot, next] */
+        if (((next - home) & mask) >= ((next - slot) & mask)) {
+            stack_table.slots[slot] = stack_table.slots[next];
+            slot = next;
+        }
+    }
+
+    stack_table.slots[slot] = NULL;
+    stack_table.count--;
+}
+
+/* Return the interned copy of the stack in stack_buffer, with a new reference */
+static memalloc_stack_t*
+stack_intern(void)
+{
+    stack_buffer->hash = stack_hash(stack_buffer);
+
+    if (stack_table.capacity) {
+        for (size_t slot = stack_table_home(stack_buffer->hash); stack_table.slots[slot] != NULL;
+             slot = (slot + 1) & (stack_table.capacity - 1)) {
+            memalloc_stack_t* stack = stack_table.slots[slot];
+            if (stack_equal(stack, stack_buffer)) {
+                stack->refcount++;
+                return stack;
+            }
+        }
+    }
+
+    if (!stack_table_reserve())
+        return NULL;
+
+    size_t stack_size = STACK_SIZE(stack_buffer->nframe);
+    memalloc_stack_t* stack = memalloc_raw_malloc(stack_size);
+
+    if (stack == NULL)
+        return NULL;
+
+    memcpy(stack, stack_buffer, stack_size);
+    stack->refcount = 1;
+    stack->frames_tuple = NULL;
+    stack->linenos = NULL;
+
+    /* The buffer only borrows the code objects from the frames */
+    for (uint16_t nframe = 0; nframe < stack->nframe; nframe++)
+        Py_XINCREF(stack->frames[nframe].code);
+
+    stack_table_insert(stack);
+
+    return stack;
+}
+
+static void
+stack_decref(memalloc_stack_t* stack)
 {
-    int lineno = PyFrame_GetLineNumber(pyframe);
-    if (lineno < 0)
-        lineno = 0;
+    if (--stack->refcount > 0)
+        return;
 
-    frame->lineno = (unsigned int)lineno;
+    /* Remove it from the table first: freeing the Python objects below may
+       sample new allocations, which must not find this stack. */
+    stack_table_remove(stack);
 
-    PyObject *filename, *name;
+    for (uint16_t nframe = 0; nframe < stack->nframe; nframe++)
+        Py_XDECREF(stack->frames[nframe].code);
+    Py_XDECREF(stack->frames_tuple);
+    memalloc_raw_free(stack->linenos);
+    memalloc_raw_free(stack);
 
+    memalloc_tb_release();
+}
+
+void
+traceback_free(traceback_t* tb)
+{
+    memalloc_stack_t* stack = tb->stack;
+    stack_decref(stack);
+    Py_XDECREF(tb->type);
+    traceback_dealloc(tb);
+}
+
+void
+traceback_copy(traceback_t* copy, const traceback_t* tb)
+{
+    *copy = *tb;
+    copy->stack->refcount++;
+    Py_XINCREF(copy->type);
+}
+
+void
+traceback_release(traceback_t* copy)
+{
+    stack_decref(copy->stack);
+    Py_XDECREF(copy->type);
+}
+
+/* Convert PyFrameObject to a frame_t that we can store in memory.
+
+   The code object is borrowed from the frame, which outlives the capture. */
+static void
+memalloc_convert_frame(PyFrameObject* pyframe, frame_t* frame)
+{
 #ifdef _PY39_AND_LATER
     PyCodeObject* code = PyFrame_GetCode(pyframe);
+    /* The frame holds a reference to its code object */
+    Py_XDECREF(code);
 #else
     PyCodeObject* code = pyframe->f_code;
 #endif
 
-    if (code == NULL) {
-        filename = unknown_name;
-        name = unknown_name;
-    } else {
-        filename = code->co_filename;
-        name = code->co_name;
-    }
+    frame->code = code;
 
-    if (name)
-        frame->name = name;
-    else
-        frame->name = unknown_name;
+#if defined(_PY311_AND_LATER)
+    frame->lasti = PyFrame_GetLasti(pyframe);
+#elif defined(_PY310_AND_LATER)
+    /* In code units rather than bytes */
+    frame->lasti = pyframe->f_lasti < 0 ? -1 : pyframe->f_lasti * (int)sizeof(_Py_CODEUNIT);
+#else
+    frame->lasti = pyframe->f_lasti;
+#endif
+}
 
-    Py_INCREF(frame->name);
+/* Resolve the line number of a frame, like PyFrame_GetLineNumber() does */
+static unsigned int
+frame_lineno(const frame_t* frame)
+{
+    if (frame->code == NULL)
+        return 0;
 
-    if (filename)
-        frame->filename = filename;
-    else
-        frame->filename = unknown_name;
+    int lineno = frame->lasti < 0 ? frame->code->co_firstlineno : PyCode_Addr2Line(frame->code, frame->lasti);
 
-    Py_INCREF(frame->filename);
+    return lineno < 0 ? 0 : (unsigned int)lineno;
+}
 
-#ifdef _PY39_AND_LATER
-    Py_XDECREF(code);
-#endif
+/* The line numbers of the frames of the stack, resolved on first use, or NULL
+   if they could not be stored */
+static const unsigned int*
+stack_linenos(memalloc_stack_t* stack)
+{
+    if (stack->linenos == NULL && stack->nframe > 0) {
+        stack->linenos = memalloc_raw_malloc(sizeof(unsigned int) * stack->nframe);
+
+        if (stack->linenos != NULL)
+            for (uint16_t nframe = 0; nframe < stack->nframe; nframe++)
+                stack->linenos[nframe] = frame_lineno(&stack->frames[nframe]);
+    }
+
+    return stack->linenos;
 }
 
-static traceback_t*
-memalloc_frame_to_traceback(PyFrameObject* pyframe, uint16_t max_nframe)
+static inline unsigned int
+stack_lineno(memalloc_stack_t* stack, const unsigned int* linenos, uint16_t nframe)
 {
-    traceback_buffer->total_nframe = 0;
-    traceback_buffer->nframe = 0;
+    return linenos != NULL ? linenos[nframe] : frame_lineno(&stack->frames[nframe]);
+}
+
+static inline PyObject*
+frame_filename(const frame_t* frame)
+{
+    return frame->code != NULL && frame->code->co_filename != NULL ? frame->code->co_filename : unknown_name;
+}
+
+static inline PyObject*
+frame_name(const frame_t* frame)
+{
+    return frame->code != NULL && frame->code->co_name != NULL ? frame->code->co_name : unknown_name;
+}
+
+static memalloc_stack_t*
+memalloc_frame_to_stack(PyFrameObject* pyframe, uint16_t max_nframe)
+{
+    stack_buffer->total_nframe = 0;
+    stack_buffer->nframe = 0;
 
     for (; pyframe != NULL;) {
-        if (traceback_buffer->nframe < max_nframe) {
-            memalloc_convert_frame(pyframe, &traceback_buffer->frames[traceback_buffer->nframe]);
-            traceback_buffer->nframe++;
+        if (stack_buffer->nframe < max_nframe) {
+            memalloc_convert_frame(pyframe, &stack_buffer->frames[stack_buffer->nframe]);
+            stack_buffer->nframe++;
         }
         /* Make sure we don't overflow */
-        if (traceback_buffer->total_nframe < UINT16_MAX)
-            traceback_buffer->total_nframe++;
+        if (stack_buffer->total_nframe < UINT16_MAX)
+            stack_buffer->total_nframe++;
 
 #ifdef _PY39_AND_LATER
         PyFrameObject* back = PyFrame_GetBack(pyframe);
@@ -163,13 +493,22 @@ memalloc_frame_to_traceback(PyFrameObject* pyframe, uint16_t max_nframe)
 #endif
     }
 
-    size_t traceback_size = TRACEBACK_SIZE(traceback_buffer->nframe);
-    traceback_t* traceback = PyMem_RawMalloc(traceback_size);
-
-    if (traceback)
-        memcpy(traceback, traceback_buffer, traceback_size);
+    return stack_intern();
+}
 
-    return traceback;
+const char*
+memalloc_domain_name(PyMemAllocatorDomain domain)
+{
+    switch ((int)domain) {
+        case PYMEM_DOMAIN_RAW:
+            return "raw";
+        case PYMEM_DOMAIN_MEM:
+            return "mem";
+        case PYMEM_DOMAIN_OBJ:
+            return "object";
+        default:
+            return "native";
+    }
 }
 
 traceback_t*
@@ -189,12 +528,24 @@ memalloc_get_traceback(uint16_t max_nframe, void* ptr, size_t size, PyMemAllocat
     if (pyframe == NULL)
         return NULL;
 
-    traceback_t* traceback = memalloc_frame_to_traceback(pyframe, max_nframe);
+    traceback_t* traceback = traceback_alloc();
 
-    if (traceback == NULL)
+    if (traceback == NULL) {
+#ifdef _PY39_AND_LATER
+        Py_DECREF(pyframe);
+#endif
+        return NULL;
+    }
+
+    traceback->stack = memalloc_frame_to_stack(pyframe, max_nframe);
+
+    if (traceback->stack == NULL) {
+        traceback_dealloc(traceback);
         return NULL;
+    }
 
     traceback->size = size;
+    traceback->alloc_size = size;
     traceback->ptr = ptr;
 
 #ifdef _PY37_AND_LATER
@@ -204,26 +555,31 @@ memalloc_get_traceback(uint16_t max_nframe, void* ptr, size_t size, PyMemAllocat
 #endif
 
     traceback->domain = domain;
+    traceback->type = NULL;
+    traceback->type_resolved = false;
 
     return traceback;
 }
 
-PyObject*
-traceback_to_tuple(traceback_t* tb)
+static PyObject*
+stack_to_tuple(memalloc_stack_t* stack)
 {
     /* Convert stack into a tuple of tuple */
-    PyObject* stack = PyTuple_New(tb->nframe);
+    PyObject* frames = PyTuple_New(stack->nframe);
+    const unsigned int* linenos = stack_linenos(stack);
 
-    for (uint16_t nframe = 0; nframe < tb->nframe; nframe++) {
+    for (uint16_t nframe = 0; nframe < stack->nframe; nframe++) {
         PyObject* frame_tuple = PyTuple_New(4);
 
-        frame_t* frame = &tb->frames[nframe];
+        frame_t* frame = &stack->frames[nframe];
+        PyObject* filename = frame_filename(frame);
+        PyObject* name = frame_name(frame);
 
-        PyTuple_SET_ITEM(frame_tuple, 0, frame->filename);
-        Py_INCREF(frame->filename);
-        PyTuple_SET_ITEM(frame_tuple, 1, PyLong_FromUnsignedLong(frame->lineno));
-        PyTuple_SET_ITEM(frame_tuple, 2, frame->name);
-        Py_INCREF(frame->name);
+        PyTuple_SET_ITEM(frame_tuple, 0, filename);
+        Py_INCREF(filename);
+        PyTuple_SET_ITEM(frame_tuple, 1, PyLong_FromUnsignedLong(stack_lineno(stack, linenos, nframe)));
+        PyTuple_SET_ITEM(frame_tuple, 2, name);
+        Py_INCREF(name);
         /* Class name */
         PyTuple_SET_ITEM(frame_tuple, 3, empty_string);
         Py_INCREF(empty_string);
@@ -240,12 +596,57 @@ traceback_to_tuple(traceback_t* tb)
             Py_INCREF(ddframe_class);
         }
 
-        PyTuple_SET_ITEM(stack, nframe, frame_tuple);
+        PyTuple_SET_ITEM(frames, nframe, frame_tuple);
     }
 
+    return frames;
+}
+
+PyObject*
+traceback_to_tuple(traceback_t* tb)
+{
+    memalloc_stack_t* stack = tb->stack;
+
+    /* The frames are immutable, so the same tuple is handed out to all the
+       samples sharing this stack */
+    if (stack->frames_tuple == NULL)
+        stack->frames_tuple = stack_to_tuple(stack);
+
     PyObject* tuple = PyTuple_New(3);
-    PyTuple_SET_ITEM(tuple, 0, stack);
-    PyTuple_SET_ITEM(tuple, 1, PyLong_FromUnsignedLong(tb->total_nframe));
+    Py_XINCREF(stack->frames_tuple);
+    PyTuple_SET_ITEM(tuple, 0, stack->frames_tuple);
+    PyTuple_SET_ITEM(tuple, 1, PyLong_FromUnsignedLong(stack->total_nframe));
     PyTuple_SET_ITEM(tuple, 2, PyLong_FromUnsignedLong(tb->thread_id));
     return tuple;
 }
+
+/* Return the UTF-8 representation of a name, which Python caches in the string */
+static const char*
+frame_name_as_utf8(PyObject* name, Py_ssize_t* len)
+{
+    const char* utf8 = PyUnicode_Check(name) ? PyUnicode_AsUTF8AndSize(name, len) : NULL;
+
+    if (utf8 == NULL) {
+        PyErr_Clear();
+        utf8 = PyUnicode_AsUTF8AndSize(unknown_name, len);
+    }
+
+    return utf8;
+}
+
+void
+traceback_push_frames(traceback_t* tb, const ddup_sample_capi_t* capi, ddup_sample_t* sample)
+{
+    memalloc_stack_t* stack = tb->stack;
+    const unsigned int* linenos = stack_linenos(stack);
+
+    for (uint16_t nframe = 0; nframe < stack->nframe; nframe++) {
+        frame_t* frame = &stack->frames[nframe];
+        Py_ssize_t name_len, filename_len;
+        const char* name = frame_name_as_utf8(frame_name(frame), &name_len);
+        const char* filename = frame_name_as_utf8(frame_filename(frame), &filename_len);
+
+        capi->push_frame(
+          sample, name, (size_t)name_len, filename, (size_t)filename_len, 0, stack_lineno(stack, linenos, nframe));
+    }
+}
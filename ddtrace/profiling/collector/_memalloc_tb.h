@@ -7,6 +7,7 @@
 #include <Python.h>
 
 #include "_utils.h"
+#include "sample_capi.h"
 
 typedef struct
 #ifdef __GNUC__
@@ -15,30 +16,46 @@ typedef struct
 #pragma pack(push, 4)
 #endif
 {
-    PyObject* filename;
-    PyObject* name;
-    unsigned int lineno;
+    /* Code object of the frame, or NULL if unknown; the names and the line
+       number are only resolved from it when the frame is exported */
+    PyCodeObject* code;
+    /* Offset in bytes of the last instruction executed, or -1 if none was */
+    int lasti;
 } frame_t;
 #if defined(_MSC_VER)
 #pragma pack(pop)
 #endif
 
+/* The domain of the allocations made through the C allocator, which comes
+   after Python's raw (0), mem (1) and object (2) ones */
+#define MEMALLOC_DOMAIN_NATIVE ((PyMemAllocatorDomain)3)
+
+/* The name of a domain, which labels its samples: "raw", "mem", "object" or "native" */
+const char*
+memalloc_domain_name(PyMemAllocatorDomain domain);
+
+/* A stack shared by all the tracebacks captured at the same place, see _memalloc_tb.c */
+typedef struct memalloc_stack_s memalloc_stack_t;
+
 typedef struct
 {
-    /* Total number of frames in the traceback */
-    uint16_t total_nframe;
-    /* Number of frames in the traceback */
-    uint16_t nframe;
+    /* Interned stack: tracebacks only hold a reference to it */
+    memalloc_stack_t* stack;
     /* Memory pointer allocated */
     void* ptr;
     /* Memory size allocated in bytes */
     size_t size;
-    /* Domain allocated */
+    /* Size of the allocation itself, which `size` exceeds when the traceback
+       stands for everything allocated since the previous sample */
+    size_t alloc_size;
+    /* Domain allocated, which may be MEMALLOC_DOMAIN_NATIVE */
     PyMemAllocatorDomain domain;
     /* Thread ID */
     unsigned long thread_id;
-    /* List of frames, top frame first */
-    frame_t frames[1];
+    /* Type of the object allocated, if any, with a reference to it; only set
+       once type_resolved is, see _memalloc_types.h */
+    PyTypeObject* type;
+    bool type_resolved;
 } traceback_t;
 
 /* The maximum number of frames we can store in `traceback_t.nframe` */
@@ -55,15 +72,26 @@ memalloc_tb_deinit();
 void
 traceback_free(traceback_t* tb);
 
+/* Copy a traceback into memory owned by the caller, sharing its stack. The
+   copy must be released with traceback_release(), and not traceback_free(). */
+void
+traceback_copy(traceback_t* copy, const traceback_t* tb);
+void
+traceback_release(traceback_t* copy);
+
 traceback_t*
 memalloc_get_traceback(uint16_t max_nframe, void* ptr, size_t size, PyMemAllocatorDomain domain);
 
 PyObject*
 traceback_to_tuple(traceback_t* tb);
 
-/* The maximum number of events we can store in `traceback_array_t.count` */
-#define TRACEBACK_ARRAY_MAX_COUNT UINT16_MAX
-#define TRACEBACK_ARRAY_COUNT_TYPE uint16_t
+/* Push the frames of the traceback to a ddup sample, top frame first */
+void
+traceback_push_frames(traceback_t* tb, const ddup_sample_capi_t* capi, ddup_sample_t* sample);
+
+/* The maximum number of tracebacks we can store in `traceback_array_t.count` */
+#define TRACEBACK_ARRAY_MAX_COUNT UINT32_MAX
+#define TRACEBACK_ARRAY_COUNT_TYPE uint32_t
 
 DO_ARRAY(traceback_t*, traceback, TRACEBACK_ARRAY_COUNT_TYPE, traceback_free)
 
@@ -0,0 +1,188 @@
+#define PY_SSIZE_T_CLEAN
+#include "_memalloc_types.h"
+
+#ifdef MEMALLOC_TYPES
+
+#include <errno.h>
+#include <stdint.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+/* The garbage collector's header which precedes the objects of the types
+   supporting it; PyGC_Head is only public up to Python 3.8 */
+#define TYPES_GC_HEAD_SIZE (2 * sizeof(uintptr_t))
+
+/* Set when process_vm_readv() isn't allowed here, e.g. by a seccomp filter */
+static bool types_unavailable = false;
+
+/* Copy memory which may not be mapped. Returns false if it couldn't be read. */
+static bool
+types_read(void* dest, const void* src, size_t size)
+{
+    struct iovec local = { dest, size };
+    struct iovec remote = { (void*)src, size };
+
+    if (process_vm_readv(getpid(), &local, 1, &remote, 1, 0) == (ssize_t)size)
+        return true;
+
+    if (errno == ENOSYS || errno == EPERM)
+        types_unavailable = true;
+
+    return false;
+}
+
+/* Size of the headers allocated before the objects of a type */
+static size_t
+types_pre_header_size(unsigned long flags)
+{
+    size_t size = (flags & Py_TPFLAGS_HAVE_GC) ? TYPES_GC_HEAD_SIZE : 0;
+
+#if defined(Py_TPFLAGS_PREHEADER)
+    if (flags & Py_TPFLAGS_PREHEADER)
+        size += 2 * sizeof(PyObject*);
+#elif defined(Py_TPFLAGS_MANAGED_DICT)
+    if (flags & Py_TPFLAGS_MANAGED_DICT)
+        size += 2 * sizeof(PyObject*);
+#endif
+
+    return size;
+}
+
+/* The maximum depth of the hierarchy of the types which are resolved */
+#define TYPES_MAX_DEPTH 64
+
+/* Check that the type read from `tp` is its own first base in its MRO, and
+   that its bases lead to object */
+static bool
+types_is_consistent(PyTypeObject* tp, const PyTypeObject* type)
+{
+#ifdef _Py_TPFLAGS_STATIC_BUILTIN
+    /* The MRO of the builtin types is kept by each interpreter */
+    if (!(type->tp_flags & _Py_TPFLAGS_STATIC_BUILTIN))
+#endif
+    {
+        PyTupleObject mro;
+        PyObject* first;
+
+        if (type->tp_mro == NULL || !types_read(&mro, type->tp_mro, sizeof(mro)) ||
+            Py_TYPE((PyObject*)&mro) != &PyTuple_Type || Py_SIZE((PyObject*)&mro) < 1 ||
+            !types_read(&first, (char*)type->tp_mro + offsetof(PyTupleObject, ob_item), sizeof(first)) ||
+            first != (PyObject*)tp)
+            return false;
+    }
+
+    PyTypeObject* base = type->tp_base;
+
+    if (tp == &PyBaseObject_Type)
+        return base == NULL;
+
+    for (int depth = 0; depth < TYPES_MAX_DEPTH; depth++) {
+        if (base == &PyBaseObject_Type)
+            return true;
+
+        if (base == NULL || (uintptr_t)base % sizeof(void*) ||
+            !types_read(&base, (char*)base + offsetof(PyTypeObject, tp_base), sizeof(base)))
+            return false;
+    }
+
+    return false;
+}
+
+/* Returns the type of the object `offset` bytes into the block, or NULL if
+   there isn't one there */
+static PyTypeObject*
+types_object_type_at(char* ptr, size_t size, size_t offset)
+{
+    if (offset + sizeof(PyObject) > size)
+        return NULL;
+
+    PyObject* op = (PyObject*)(ptr + offset);
+
+    /* The block is live, so it can be read directly */
+    if (Py_REFCNT(op) <= 0)
+        return NULL;
+
+    PyTypeObject* tp = Py_TYPE(op);
+
+    if (tp == NULL || (uintptr_t)tp % sizeof(void*))
+        return NULL;
+
+    /* Whatever is there isn't necessarily a pointer though */
+    PyTypeObject type;
+
+    if (!types_read(&type, tp, sizeof(type)))
+        return NULL;
+
+    if (!(type.tp_flags & Py_TPFLAGS_READY) || type.tp_name == NULL)
+        return NULL;
+
+    PyTypeObject* metatype = Py_TYPE((PyObject*)&type);
+
+    if (metatype != &PyType_Type) {
+        unsigned long metatype_flags;
+
+        if (metatype == NULL || (uintptr_t)metatype % sizeof(void*) ||
+            !types_read(&metatype_flags, (char*)metatype + offsetof(PyTypeObject, tp_flags), sizeof(metatype_flags)) ||
+            !(metatype_flags & Py_TPFLAGS_TYPE_SUBCLASS))
+            return NULL;
+    }
+
+    /* The object has to be where the type puts it in its block */
+    if (types_pre_header_size(type.tp_flags) != offset)
+        return NULL;
+
+    /* Memory which happens to look like a type this far, such as a type read
+       from the wrong offset, is unlikely to be consistent with itself too */
+    if (!types_is_consistent(tp, &type))
+        return NULL;
+
+    return tp;
+}
+
+PyTypeObject*
+memalloc_object_type(void* ptr, size_t size)
+{
+    static const size_t offsets[] = {
+        0,
+        TYPES_GC_HEAD_SIZE,
+        TYPES_GC_HEAD_SIZE + 2 * sizeof(PyObject*),
+    };
+
+    if (types_unavailable || ptr == NULL)
+        return NULL;
+
+    for (size_t i = 0; i < sizeof(offsets) / sizeof(offsets[0]); i++) {
+        PyTypeObject* tp = types_object_type_at(ptr, size, offsets[i]);
+
+        if (tp) {
+            Py_INCREF(tp);
+            return tp;
+        }
+    }
+
+    return NULL;
+}
+
+#else
+
+PyTypeObject*
+memalloc_object_type(void* ptr, size_t size)
+{
+    (void)ptr;
+    (void)size;
+    return NULL;
+}
+
+#endif
+
+void
+traceback_resolve_type(traceback_t* tb)
+{
+    if (tb->type_resolved)
+        return;
+
+    tb->type_resolved = true;
+
+    if (tb->domain == PYMEM_DOMAIN_OBJ)
+        tb->type = memalloc_object_type(tb->ptr, tb->alloc_size);
+}
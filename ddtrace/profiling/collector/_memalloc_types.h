@@ -0,0 +1,31 @@
+#ifndef _DDTRACE_MEMALLOC_TYPES_H
+#define _DDTRACE_MEMALLOC_TYPES_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <Python.h>
+
+#include "_memalloc_tb.h"
+
+/* The blocks of the object domain don't say whether they hold an object, and
+   the type of an object is only set once the allocator has returned, so types
+   are resolved afterwards, from the block itself. Candidate type pointers are
+   read with process_vm_readv(), which fails rather than crashes on memory
+   which isn't mapped, so this is only available on Linux. It also relies on
+   the GIL to keep the blocks from being freed while they are looked at. */
+#if defined(__linux__) && !defined(Py_GIL_DISABLED)
+#define MEMALLOC_TYPES
+#endif
+
+/* Returns a new reference to the type of the object held by the block `ptr`
+   of `size` bytes, allocated in the object domain, or NULL if it doesn't look
+   like one. The block must be live, and the GIL held. */
+PyTypeObject*
+memalloc_object_type(void* ptr, size_t size);
+
+/* Resolve the type of the allocation of the traceback, once */
+void
+traceback_resolve_type(traceback_t* tb);
+
+#endif
@@ -0,0 +1,5 @@
+class CaptureSampler(object):
+    capture_pct: float
+    _counter: float
+    def __init__(self, capture_pct: float = ...) -> None: ...
+    def capture(self) -> bool: ...
@@ -0,0 +1,24 @@
+cdef class CaptureSampler(object):
+    """Determine the events that should be captured based on a sampling percentage.
+
+    The lock collector asks it on every acquire, so that the unsampled path is a counter bump in compiled code.
+    """
+
+    cdef readonly double capture_pct
+    cdef public double _counter
+
+    def __init__(self, capture_pct=100):
+        if capture_pct < 0 or capture_pct > 100:
+            raise ValueError("Capture percentage should be between 0 and 100 included")
+        self.capture_pct = capture_pct
+        self._counter = 0
+
+    cpdef bint capture(self):
+        self._counter += self.capture_pct
+        if self._counter >= 100:
+            self._counter -= 100
+            return True
+        return False
+
+    def __repr__(self):
+        return "%s(capture_pct=%r)" % (self.__class__.__name__, self.capture_pct)
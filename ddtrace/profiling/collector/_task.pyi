@@ -4,4 +4,6 @@ import typing
 def get_task(
     thread_id: int,
 ) -> typing.Tuple[typing.Optional[int], typing.Optional[str], typing.Optional[types.FrameType]]: ...
-def list_tasks() -> typing.List[typing.Tuple[int, str, types.FrameType]]: ...
+def list_tasks(
+    thread_id: int, scheduled_only: bool = False
+) -> typing.List[typing.Tuple[int, str, types.FrameType]]: ...
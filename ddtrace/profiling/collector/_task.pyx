@@ -1,5 +1,4 @@
-import sys
-from types import ModuleType
+from functools import partial
 import weakref
 
 from ddtrace.vendor.wrapt.importer import when_imported
@@ -11,6 +10,54 @@ from .. import _threading
 _gevent_tracer = None
 
 
+def _forget_greenlet(greenlets, greenlet_id, ref):
+    # The id may have been taken by another greenlet already
+    if greenlets.get(greenlet_id) is ref:
+        del greenlets[greenlet_id]
+
+
+cdef class _GreenletTracer(object):
+    """Track the active greenlet, and the greenlets that were ever switched to.
+
+    This runs on every greenlet switch, so it only does the bookkeeping the first time it sees a greenlet; the
+    other switches only update the active greenlet."""
+
+    cdef readonly object gevent
+    cdef readonly object active_greenlet
+    # Weak references to the greenlets by their id, which is what gevent.thread.get_ident returns for them
+    cdef readonly dict greenlets
+    cdef object _hub_type
+    cdef object _previous_trace_function
+
+    def __init__(self, gevent, getcurrent, settrace):
+        self.gevent = gevent
+        self.greenlets = {}
+        self._hub_type = gevent.hub.Hub
+
+        self._previous_trace_function = settrace(self)
+        self.active_greenlet = getcurrent()
+        self._store_greenlet(self.active_greenlet)
+
+    cdef _store_greenlet(self, greenlet):
+        greenlet_id = id(greenlet)
+        ref = self.greenlets.get(greenlet_id)
+        if ref is None or ref() is not greenlet:
+            self.greenlets[greenlet_id] = weakref.ref(greenlet, partial(_forget_greenlet, self.greenlets, greenlet_id))
+
+    def __call__(self, event, args):
+        if event == "switch" or event == "throw":
+            # Do not trace gevent Hub: the Hub is a greenlet but we want to know the latest active greenlet *before*
+            # the application yielded back to the Hub. There's no point showing the Hub most of the time to the
+            # users as that does not give any information about user code.
+            target = args[1]
+            if not isinstance(target, self._hub_type):
+                self.active_greenlet = target
+                self._store_greenlet(target)
+
+        if self._previous_trace_function is not None:
+            self._previous_trace_function(event, args)
+
+
 @when_imported("gevent")
 def install_greenlet_tracer(gevent):
     global _gevent_tracer
@@ -19,59 +66,66 @@ def install_greenlet_tracer(gevent):
         import gevent.hub
         import gevent.thread
         from greenlet import getcurrent
-        from greenlet import greenlet
         from greenlet import settrace
     except ImportError:
         # We don't seem to have the required dependencies.
-        return 
-
-    class DDGreenletTracer(object):
-        def __init__(self, gevent):
-            # type: (ModuleType) -> None
-            self.gevent = gevent
-
-            self.previous_trace_function = settrace(self)
-            self.greenlets = weakref.WeakValueDictionary()
-            self.active_greenlet = getcurrent()
-            self._store_greenlet(self.active_greenlet)
-
-        def _store_greenlet(
-                self,
-                greenlet,  # type: greenlet.greenlet
-        ):
-            # type: (...) -> None
-            self.greenlets[gevent.thread.get_ident(greenlet)] = greenlet
+        return
 
-        def __call__(self, event, args):
-            if event in ('switch', 'throw'):
-                # Do not trace gevent Hub: the Hub is a greenlet but we want to know the latest active greenlet *before*
-                # the application yielded back to the Hub. There's no point showing the Hub most of the time to the
-                # users as that does not give any information about user code.
-                if not isinstance(args[1], gevent.hub.Hub):
-                    self.active_greenlet = args[1]
-                    self._store_greenlet(args[1])
+    _gevent_tracer = _GreenletTracer(gevent, getcurrent, settrace)
 
-            if self.previous_trace_function is not None:
-                self.previous_trace_function(event, args)
 
-    _gevent_tracer = DDGreenletTracer(gevent)
+cdef extern from "Python.h":
+    bint PyCoro_CheckExact(object)
+    bint PyGen_Check(object)
+    bint PyAsyncGen_CheckExact(object)
 
 
 cdef _asyncio_task_get_frame(task):
     coro = task._coro
-    if hasattr(coro, "cr_frame"):
+    # The built-in types are told apart without the attribute lookups, and the AttributeError, of hasattr
+    if PyCoro_CheckExact(coro):
         # async def
         return coro.cr_frame
-    elif hasattr(coro, "gi_frame"):
+    elif PyGen_Check(coro):
         # legacy coroutines
         return coro.gi_frame
-    elif hasattr(coro, "ag_frame"):
+    elif PyAsyncGen_CheckExact(coro):
         # async generators
         return coro.ag_frame
+    elif hasattr(coro, "cr_frame"):
+        return coro.cr_frame
+    elif hasattr(coro, "gi_frame"):
+        return coro.gi_frame
+    elif hasattr(coro, "ag_frame"):
+        return coro.ag_frame
     # unknown
     return None
 
 
+cdef list _scheduled_tasks(loop):
+    """Return the task running on the loop and the tasks that are ready to run on its next iteration.
+
+    These are found from the handles of the ready queue, whose callbacks are bound to the task they step or wake up.
+    Return None for the loops without such a queue, e.g. uvloop."""
+    ready = getattr(loop, "_ready", None)
+    if ready is None:
+        return None
+
+    cdef dict tasks = {}
+
+    task = _asyncio.current_task(loop)
+    if task is not None:
+        tasks[id(task)] = task
+
+    # Copy the queue, which we don't want to see change under us
+    for handle in list(ready):
+        task = getattr(getattr(handle, "_callback", None), "__self__", None)
+        if task is not None and hasattr(task, "_coro"):
+            tasks[id(task)] = task
+
+    return list(tasks.values())
+
+
 cpdef get_task(thread_id):
     """Return the task id and name for a thread."""
     task_id = None
@@ -99,13 +153,15 @@ cpdef get_task(thread_id):
     return task_id, task_name, frame
 
 
-cpdef list_tasks(thread_id):
+cpdef list_tasks(thread_id, scheduled_only=False):
     # type: (...) -> typing.List[typing.Tuple[int, str, types.FrameType]]
     """Return the list of running tasks.
 
     This is computed for gevent by taking the list of existing threading.Thread object and removing if any real OS
     thread that might be running.
 
+    :param scheduled_only: Only return the asyncio tasks that are running or ready to run, rather than all the pending
+        ones, when the event loop allows to tell them apart.
     :return: [(task_id, task_name, task_frame), ...]"""
 
     tasks = []
@@ -122,18 +178,23 @@ cpdef list_tasks(thread_id):
                         _threading.get_thread_name(greenlet_id),
                         greenlet.gr_frame
                     )
-                    for greenlet_id, greenlet in dict(_gevent_tracer.greenlets).items()
-                    if not greenlet.dead
+                    for greenlet_id, greenlet in [
+                        (greenlet_id, ref()) for greenlet_id, ref in list(_gevent_tracer.greenlets.items())
+                    ]
+                    if greenlet is not None and not greenlet.dead
                 ]
             )
 
     loop = _asyncio.get_event_loop_for_thread(thread_id)
     if loop is not None:
+        loop_tasks = _scheduled_tasks(loop) if scheduled_only else None
+        if loop_tasks is None:
+            loop_tasks = _asyncio.all_tasks(loop)
         tasks.extend([
             (id(task),
                 _asyncio._task_get_name(task),
                 _asyncio_task_get_frame(task))
-            for task in _asyncio.all_tasks(loop)
+            for task in loop_tasks
         ])
 
     return tasks
@@ -8,29 +8,51 @@ from ddtrace.profiling.event import DDFrame
 log = get_logger(__name__)
 
 
+# The name of the first argument of every code object seen so far when it is one that tells the class of the frame,
+# keyed by the id of the code object.  The entries hold the code object too, so that its id can't be reused while the
+# entry is around.  The cache is cleared when it grows too big, not to keep too many dynamically created code objects.
+cdef dict _class_argnames = {}
+cdef Py_ssize_t _CLASS_ARGNAMES_MAX_SIZE = 4096
+
+
+cdef _class_argname(code):
+    entry = _class_argnames.get(id(code))
+    if entry is not None and entry[0] is code:
+        return entry[1]
+
+    argname = None
+    # Retrieve the name of the first argument, if the code object has any
+    if code.co_argcount > 0 and code.co_varnames[0] in ("self", "cls"):
+        argname = code.co_varnames[0]
+
+    if len(_class_argnames) >= _CLASS_ARGNAMES_MAX_SIZE:
+        _class_argnames.clear()
+    _class_argnames[id(code)] = (code, argname)
+    return argname
+
+
 cpdef _extract_class_name(frame):
     # type: (...) -> str
     """Extract class name from a frame, if possible.
 
     :param frame: The frame object.
     """
-    code = frame.f_code
-    if code.co_argcount > 0:
-        # Retrieve the name of the first argument, if the code object has any
-        argname = code.co_varnames[0]
-        try:
-            value = frame.f_locals[argname]
-        except Exception:
-            log.debug("Unable to extract class name from frame %r", frame, exc_info=True)
-            return ""
-        try:
-            if argname == "self":
-                return object.__getattribute__(type(value), "__name__")  # use type() and object.__getattribute__ to avoid side-effects
-            if argname == "cls":
-                return object.__getattribute__(value, "__name__")
-        except AttributeError:
-            return ""
-    return ""
+    # The class name depends on the value of the first argument, so only what the code object says about it is
+    # cached; the locals of the frame, which can be costly to materialize, are only looked at when they can tell.
+    argname = _class_argname(frame.f_code)
+    if argname is None:
+        return ""
+    try:
+        value = frame.f_locals[argname]
+    except Exception:
+        log.debug("Unable to extract class name from frame %r", frame, exc_info=True)
+        return ""
+    try:
+        if argname == "self":
+            return object.__getattribute__(type(value), "__name__")  # use type() and object.__getattribute__ to avoid side-effects
+        return object.__getattribute__(value, "__name__")
+    except AttributeError:
+        return ""
 
 
 cpdef traceback_to_frames(traceback, max_nframes):
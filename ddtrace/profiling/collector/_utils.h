@@ -2,24 +2,155 @@
 #define _DDTRACE_UTILS_H
 
 #include <Python.h>
+#include <stdint.h>
 #include <stdlib.h>
+#ifdef _WIN32
+#include <process.h>
+#define random_getpid() ((uint64_t)_getpid())
+#else
+#include <unistd.h>
+#define random_getpid() ((uint64_t)getpid())
+#endif
+
+#include "_memalloc_raw.h"
+#include "_memalloc_reentrant.h"
+
+/* Random numbers are drawn on every sampled allocation, from whichever
+   thread allocates.  rand() serializes every caller on a lock in glibc, and
+   the logarithm of the exponential distribution is far from free, so each
+   thread gets a xorshift64* generator of its own, and the logarithm is read
+   from a table.  Each translation unit has its own generators, which is fine
+   since they are all seeded differently. */
+#ifdef MEMALLOC_THREAD_LOCAL
+static MEMALLOC_THREAD_LOCAL uint64_t random_state = 0;
+#else
+/* Races only lose draws, which doesn't bias anything */
+static uint64_t random_state = 0;
+#endif
+/* Threads which reuse the stack of one which exited, and children of forks,
+   would otherwise start from the same seed */
+static uint64_t random_seeds = 0;
+
+static inline uint64_t
+random_next(void)
+{
+    uint64_t x = random_state;
+    if (x == 0) {
+        /* splitmix64 of an address on the stack of the thread, the process id
+           and the number of generators seeded so far */
+        char anchor;
+#if defined(__GNUC__) || defined(__clang__)
+        uint64_t seeds = __atomic_fetch_add(&random_seeds, 1, __ATOMIC_RELAXED);
+#else
+        uint64_t seeds = random_seeds++;
+#endif
+        x = (uint64_t)(uintptr_t)&anchor ^ (random_getpid() << 32) ^ (seeds * 0x9e3779b97f4a7c15ULL);
+        x += 0x9e3779b97f4a7c15ULL;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+        x ^= x >> 31;
+        if (x == 0)
+            x = 1;
+    }
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    random_state = x;
+    return x * 0x2545f4914f6cdd1dULL;
+}
 
 static inline uint64_t
 random_range(uint64_t max)
 {
-    /* Return a random number between [0, max[ */
-    return (uint64_t)((double)rand() / ((double)RAND_MAX + 1) * max);
+    /* Return a random number between [0, max[.  Scaling rather than taking
+       the modulo biases the result by at most max / 2^32, which no sampling
+       decision can tell. */
+    uint64_t r = random_next();
+    if (max <= UINT32_MAX)
+        return ((r >> 32) * max) >> 32;
+#ifdef __SIZEOF_INT128__
+    return (uint64_t)(((unsigned __int128)r * max) >> 64);
+#else
+    return r % max;
+#endif
+}
+
+/* log2(1 + (i + 0.5) / 256) for the 8 bits i following the leading one of a
+   mantissa, in 1/65536th */
+static const uint16_t random_log2_table[256] = {
+    184, 552, 919, 1284, 1648, 2010, 2371, 2730, 3088, 3445, 3801, 4155,
+    4507, 4859, 5209, 5558, 5906, 6252, 6597, 6941, 7283, 7625, 7965, 8304,
+    8641, 8978, 9313, 9647, 9980, 10312, 10642, 10972, 11300, 11627, 11953, 12278,
+    12602, 12925, 13246, 13567, 13886, 14205, 14522, 14838, 15153, 15467, 15781, 16093,
+    16404, 16714, 17023, 17331, 17637, 17943, 18248, 18552, 18856, 19158, 19459, 19759,
+    20058, 20356, 20654, 20950, 21245, 21540, 21834, 22126, 22418, 22709, 22999, 23288,
+    23577, 23864, 24150, 24436, 24721, 25005, 25288, 25570, 25852, 26132, 26412, 26691,
+    26969, 27246, 27523, 27798, 28073, 28347, 28620, 28893, 29164, 29435, 29706, 29975,
+    30244, 30511, 30778, 31045, 31310, 31575, 31839, 32103, 32365, 32627, 32888, 33149,
+    33409, 33668, 33926, 34184, 34441, 34697, 34952, 35207, 35461, 35715, 35968, 36220,
+    36471, 36722, 36972, 37222, 37470, 37719, 37966, 38213, 38459, 38705, 38950, 39194,
+    39438, 39681, 39923, 40165, 40406, 40647, 40887, 41126, 41365, 41603, 41841, 42077,
+    42314, 42550, 42785, 43019, 43253, 43487, 43720, 43952, 44184, 44415, 44646, 44876,
+    45105, 45334, 45562, 45790, 46018, 46244, 46471, 46696, 46921, 47146, 47370, 47593,
+    47816, 48039, 48261, 48482, 48703, 48924, 49143, 49363, 49582, 49800, 50018, 50235,
+    50452, 50668, 50884, 51100, 51315, 51529, 51743, 51956, 52169, 52382, 52594, 52805,
+    53016, 53227, 53437, 53647, 53856, 54064, 54273, 54481, 54688, 54895, 55101, 55307,
+    55513, 55718, 55922, 56127, 56330, 56534, 56737, 56939, 57141, 57343, 57544, 57745,
+    57945, 58145, 58344, 58543, 58742, 58940, 59138, 59335, 59532, 59729, 59925, 60121,
+    60316, 60511, 60706, 60900, 61094, 61287, 61480, 61672, 61865, 62056, 62248, 62439,
+    62629, 62820, 63010, 63199, 63388, 63577, 63765, 63953, 64141, 64328, 64515, 64701,
+    64887, 65073, 65259, 65444,
+};
+
+/* ln(2) in 1/65536th */
+#define RANDOM_LN2_Q16 45426
+
+static inline unsigned
+random_clz64(uint64_t x)
+{
+    /* x is never 0 */
+#if defined(__GNUC__) || defined(__clang__)
+    return (unsigned)__builtin_clzll(x);
+#else
+    unsigned n = 0;
+    for (unsigned shift = 32; shift > 0; shift /= 2) {
+        if ((x >> (64 - shift)) == 0) {
+            n += shift;
+            x <<= shift;
+        }
+    }
+    return n;
+#endif
+}
+
+static inline uint64_t
+random_exponential(uint64_t mean)
+{
+    /* Return a random number following an exponential distribution of average mean.
+
+       That's -ln(q) * mean for q uniform in ]0, 1].  Given q = r / 2^64, the
+       leading zeros of r are the integer part of -log2(q), and the bits which
+       follow the leading one are its mantissa, whose logarithm is in the table.
+       Using the middle of each of the 256 ranges of the table keeps the
+       average within a millionth of the mean. */
+    uint64_t r = random_next() | 1;
+    unsigned lz = random_clz64(r);
+    unsigned index = (unsigned)((r << lz) >> 55) & 0xFF;
+    uint64_t neg_log2_q16 = ((uint64_t)(lz + 1) << 16) - random_log2_table[index];
+    uint64_t neg_ln_q16 = (neg_log2_q16 * RANDOM_LN2_Q16) >> 16;
+    /* Split so that large means don't overflow */
+    return (mean >> 16) * neg_ln_q16 + (((mean & 0xFFFF) * neg_ln_q16) >> 16);
 }
 
 #define DO_NOTHING(...)
 
-#define p_new(type, count) PyMem_RawMalloc(sizeof(type) * (count))
-#define p_delete(mem_p) PyMem_Free(mem_p);
+#define p_new(type, count) memalloc_raw_malloc(sizeof(type) * (count))
+#define p_delete(mem_p) memalloc_raw_free(mem_p);
 // Allocate at least 16 and 50% more than requested to avoid allocating items one by one.
 #define p_alloc_nr(x) (((x) + 16) * 3 / 2)
 #define p_realloc(p, count)                                                                                            \
     do {                                                                                                               \
-        (p) = PyMem_RawRealloc((p), sizeof(*p) * (count));                                                             \
+        (p) = memalloc_raw_realloc((p), sizeof(*p) * (count));                                                         \
     } while (0)
 
 #define p_grow(p, goalnb, allocnb)                                                                                     \
@@ -29,6 +160,9 @@ random_range(uint64_t max)
                 *(allocnb) = (goalnb);                                                                                 \
             } else {                                                                                                   \
                 *(allocnb) = p_alloc_nr(*(allocnb));                                                                   \
+                /* The growth may not fit in a narrow size type */                                                     \
+                if (*(allocnb) < (goalnb))                                                                             \
+                    *(allocnb) = (goalnb);                                                                             \
             }                                                                                                          \
             p_realloc(p, *(allocnb));                                                                                  \
         }                                                                                                              \
@@ -0,0 +1,68 @@
+# -*- encoding: utf-8 -*-
+import logging
+import sys
+import typing  # noqa:F401
+
+import attr
+
+from ddtrace.profiling import collector
+from ddtrace.settings.profiling import config
+
+
+try:
+    from ddtrace.profiling.collector import _exception
+except ImportError:
+    _exception = None  # type: ignore[assignment]
+
+
+LOG = logging.getLogger(__name__)
+
+
+@attr.s
+class ExceptionCollector(collector.Collector):
+    """Sample the exceptions as they are raised.
+
+    Exceptions are sampled through the ``sys.monitoring`` RAISE event, so this collector needs Python 3.12 or later
+    and the native exporter, which receives the samples straight from the event callback.
+    """
+
+    sampling_interval = attr.ib(type=int, default=config.exception.sampling_interval)
+    nframes = attr.ib(type=int, default=config.exception.max_frames or config.max_frames)
+    endpoint_collection_enabled = attr.ib(type=bool, default=config.endpoint_collection)
+    tracer = attr.ib(default=None)
+    _export_libdd_enabled = attr.ib(type=bool, default=config.export.libdd_enabled)
+
+    _tool_id = attr.ib(init=False, default=None, repr=False)
+
+    def _start_service(self):
+        # type: (...) -> None
+        """Start sampling the exceptions raised."""
+        if _exception is None or sys.version_info < (3, 12) or not self._export_libdd_enabled:
+            raise collector.CollectorUnavailable
+
+        monitoring = sys.monitoring  # type: ignore[attr-defined]
+        tool_id = monitoring.PROFILER_ID
+        try:
+            monitoring.use_tool_id(tool_id, "datadog")
+        except ValueError:
+            LOG.debug("sys.monitoring profiler tool already in use, exceptions won't be profiled")
+            raise collector.CollectorUnavailable
+
+        sampler = _exception.RaiseSampler(
+            self.sampling_interval, self.nframes, self.tracer, self.endpoint_collection_enabled
+        )
+        monitoring.register_callback(tool_id, monitoring.events.RAISE, sampler)
+        monitoring.set_events(tool_id, monitoring.events.RAISE)
+        self._tool_id = tool_id
+
+    def _stop_service(self):
+        # type: (...) -> None
+        """Stop sampling the exceptions raised."""
+        if self._tool_id is None:
+            return
+
+        monitoring = sys.monitoring  # type: ignore[attr-defined]
+        monitoring.set_events(self._tool_id, monitoring.events.NO_EVENTS)
+        monitoring.register_callback(self._tool_id, monitoring.events.RAISE, None)
+        monitoring.free_tool_id(self._tool_id)
+        self._tool_id = None
@@ -1,6 +1,6 @@
 # -*- encoding: utf-8 -*-
 import logging
-from math import ceil
+from math import expm1
 import os
 import threading
 import typing  # noqa:F401
@@ -48,6 +48,34 @@ class MemoryHeapSampleEvent(event.StackBasedEvent):
     """The sampling size."""
 
 
+@event.event_class
+class MemoryHeapLifetimeEvent(event.StackBasedEvent):
+    """A number of heap samples which lived for about as long."""
+
+    lifetime = attr.ib(default="", type=str)
+    """The lifetime bucket, such as "<10ms", or "live" for the samples which are still alive."""
+
+    count = attr.ib(default=0, type=int)
+    """The number of heap samples."""
+
+
+def _format_lifetime_bound(bound_ns):
+    # type: (int) -> str
+    if bound_ns < 1000000000:
+        return "%dms" % (bound_ns // 1000000)
+    if bound_ns < 60000000000:
+        return "%ds" % (bound_ns // 1000000000)
+    return "%dmin" % (bound_ns // 60000000000)
+
+
+def _heap_lifetime_labels(bounds):
+    # type: (typing.Sequence[int]) -> typing.Tuple[str, ...]
+    """Return the labels of the lifetime buckets delimited by `bounds`."""
+    return tuple("<" + _format_lifetime_bound(bound) for bound in bounds) + (
+        ">=" + _format_lifetime_bound(bounds[-1]),
+    )
+
+
 @attr.s
 class MemoryCollector(collector.PeriodicCollector):
     """Memory allocation collector."""
@@ -60,8 +88,17 @@ class MemoryCollector(collector.PeriodicCollector):
 
     # TODO make this dynamic based on the 1. interval and 2. the max number of events allowed in the Recorder
     _max_events = attr.ib(type=int, default=config.memory.events_buffer)
-    max_nframe = attr.ib(default=config.max_frames, type=int)
+    # Allocation and heap samples share the traceback, which is captured as deep as the deepest of the two
+    max_nframe = attr.ib(
+        default=max(config.memory.max_frames or config.max_frames, config.heap.max_frames or config.max_frames),
+        type=int,
+    )
     heap_sample_size = attr.ib(type=int, default=config.heap.sample_size)
+    alloc_sample_size = attr.ib(type=int, default=config.memory.sample_size)
+    heap_lifetime = attr.ib(type=bool, default=config.heap.lifetime_enabled)
+    heap_delta_export = attr.ib(type=bool, default=config.heap.delta_export)
+    native = attr.ib(type=bool, default=config.memory.native_enabled)
+    domains = attr.ib(type=typing.Tuple[str, ...], default=tuple(config.memory.domains), converter=tuple)
     ignore_profiler = attr.ib(default=config.ignore_profiler, type=bool)
     _export_libdd_enabled = attr.ib(type=bool, default=config.export.libdd_enabled)
 
@@ -71,17 +108,42 @@ class MemoryCollector(collector.PeriodicCollector):
         if _memalloc is None:
             raise collector.CollectorUnavailable
 
+        if self.native and not _memalloc.native_supported:
+            LOG.warning("Native memory allocations can't be profiled on this platform")
+            self.native = False
+
+        if "raw" in self.domains and not _memalloc.native_supported:
+            LOG.warning("The raw memory domain can't be profiled on this platform")
+            self.domains = tuple(domain for domain in self.domains if domain != "raw") or ("object",)
+
+        args = (
+            self.max_nframe,
+            self._max_events,
+            self.heap_sample_size,
+            self.alloc_sample_size,
+            self._heap_lifetime_recorded(),
+            self.native,
+            self.domains,
+        )
+
         try:
-            _memalloc.start(self.max_nframe, self._max_events, self.heap_sample_size)
+            _memalloc.start(*args)
         except RuntimeError:
             # This happens on fork because we don't call the shutdown hook since
             # the thread responsible for doing so is not running in the child
             # process. Therefore we stop and restart the collector instead.
             _memalloc.stop()
-            _memalloc.start(self.max_nframe, self._max_events, self.heap_sample_size)
+            _memalloc.start(*args)
 
         super(MemoryCollector, self)._start_service()
 
+    def _stop_service(self):
+        # type: (...) -> None
+        super(MemoryCollector, self)._stop_service()
+        if self._libdd_export() and self.heap_delta_export:
+            # Otherwise the last live heap would keep being added to the profiles
+            ddup.heap_live_clear()
+
     @staticmethod
     def on_shutdown():
         # type: () -> None
@@ -101,9 +163,68 @@ class MemoryCollector(collector.PeriodicCollector):
             if getattr(thread, "_ddtrace_profiling_ignore", False) and thread.ident is not None
         }
 
+    @staticmethod
+    def _export_thread_info(thread_id_ignore_set):
+        # type: (typing.Set[int]) -> typing.Callable[[int], typing.Optional[typing.Tuple[int, typing.Optional[str]]]]
+        def thread_info(thread_id):
+            if thread_id in thread_id_ignore_set:
+                return None
+            return _threading.get_thread_native_id(thread_id), _threading.get_thread_name(thread_id)
+
+        return thread_info
+
+    def _libdd_export(self):
+        # type: () -> bool
+        return self._export_libdd_enabled and ddup.sample_capi is not None
+
+    def _heap_lifetime_recorded(self):
+        # type: () -> bool
+        # DEV: libdatadog has no sample type for lifetimes, so they are only exported through pprof events
+        return self.heap_lifetime and self.heap_sample_size > 0 and not self._libdd_export()
+
+    def _heap_lifetime_events(self, thread_id_ignore_set):
+        # type: (typing.Set[int]) -> typing.Tuple[MemoryHeapLifetimeEvent, ...]
+        try:
+            lifetimes = _memalloc.heap_lifetimes()
+        except RuntimeError:
+            # DEV: This can happen if either _memalloc has not been started or has been stopped.
+            LOG.debug("Unable to collect heap lifetimes from process %d", os.getpid(), exc_info=True)
+            return tuple()
+
+        labels = _heap_lifetime_labels(_memalloc.heap_lifetime_bounds) + ("live",)
+
+        return tuple(
+            MemoryHeapLifetimeEvent(
+                thread_id=thread_id,
+                thread_name=_threading.get_thread_name(thread_id),
+                thread_native_id=_threading.get_thread_native_id(thread_id),
+                frames=frames,
+                nframes=nframes,
+                lifetime=label,
+                count=count,
+            )
+            for (frames, nframes, thread_id), freed, live in lifetimes
+            if not self.ignore_profiler or thread_id not in thread_id_ignore_set
+            for label, count in zip(labels, freed + (live,))
+            if count
+        )
+
     def snapshot(self):
         thread_id_ignore_set = self._get_thread_id_ignore_set()
 
+        if self._libdd_export():
+            # The samples go straight from the heap tracker to libdatadog
+            try:
+                _memalloc.export_heap(
+                    ddup.sample_capi,
+                    self._export_thread_info(thread_id_ignore_set if self.ignore_profiler else set()),
+                    self.heap_delta_export,
+                )
+            except RuntimeError:
+                # DEV: This can happen if either _memalloc has not been started or has been stopped.
+                LOG.debug("Unable to collect heap events from process %d", os.getpid(), exc_info=True)
+            return tuple()
+
         try:
             events = _memalloc.heap()
         except RuntimeError:
@@ -111,44 +232,56 @@ class MemoryCollector(collector.PeriodicCollector):
             LOG.debug("Unable to collect heap events from process %d", os.getpid(), exc_info=True)
             return tuple()
 
-        if self._export_libdd_enabled:
-            for (frames, nframes, thread_id), size in events:
-                if not self.ignore_profiler or thread_id not in thread_id_ignore_set:
-                    handle = ddup.SampleHandle()
-                    handle.push_heap(size)
-                    handle.push_threadinfo(
-                        thread_id, _threading.get_thread_native_id(thread_id), _threading.get_thread_name(thread_id)
-                    )
-                    try:
-                        for frame in frames:
-                            handle.push_frame(frame.function_name, frame.file_name, 0, frame.lineno)
-                        handle.flush_sample()
-                    except AttributeError:
-                        # DEV: This might happen if the memalloc sofile is unlinked and relinked without module
-                        #      re-initialization.
-                        LOG.debug("Invalid state detected in memalloc module, suppressing profile")
-            return tuple()
-        else:
-            return (
-                tuple(
-                    MemoryHeapSampleEvent(
-                        thread_id=thread_id,
-                        thread_name=_threading.get_thread_name(thread_id),
-                        thread_native_id=_threading.get_thread_native_id(thread_id),
-                        frames=frames,
-                        nframes=nframes,
-                        size=size,
-                        sample_size=self.heap_sample_size,
-                    )
-                    for (frames, nframes, thread_id), size in events
-                    if not self.ignore_profiler or thread_id not in thread_id_ignore_set
-                ),
-            )
+        heap_events = (
+            tuple(
+                MemoryHeapSampleEvent(
+                    thread_id=thread_id,
+                    thread_name=_threading.get_thread_name(thread_id),
+                    thread_native_id=_threading.get_thread_native_id(thread_id),
+                    frames=frames,
+                    nframes=nframes,
+                    size=size,
+                    sample_size=self.heap_sample_size,
+                )
+                for (frames, nframes, thread_id), size in events
+                if not self.ignore_profiler or thread_id not in thread_id_ignore_set
+            ),
+        )
+
+        if self._heap_lifetime_recorded():
+            return heap_events + (self._heap_lifetime_events(thread_id_ignore_set),)
+
+        return heap_events
+    def _sampled_alloc_weight(self, size):
+        # type: (int) -> float
+        """Return the number of allocations of `size` bytes a sampled allocation stands for.
+
+        When sampling by size, an allocation of `size` bytes is sampled with probability
+        1 - exp(-size / alloc_sample_size).
+        """
+        return 1.0 / -expm1(-size / self.alloc_sample_size) if size > 0 else 1.0
 
     def collect(self):
+        if self.native:
+            # Also track the libraries loaded since the last collection
+            try:
+                _memalloc.native_patch()
+            except RuntimeError:
+                # DEV: This can happen if either _memalloc has not been started or has been stopped.
+                LOG.debug("Unable to track native allocations in process %d", os.getpid(), exc_info=True)
+
         # TODO: The event timestamp is slightly off since it's going to be the time we copy the data from the
         # _memalloc buffer to our Recorder. This is fine for now, but we might want to store the nanoseconds
         # timestamp in C and then return it via iter_events.
+        if self._libdd_export():
+            # The events go straight from the allocation tracker to libdatadog, weighted the same way
+            try:
+                _memalloc.export_events(ddup.sample_capi, self._export_thread_info(self._get_thread_id_ignore_set()))
+            except RuntimeError:
+                # DEV: This can happen if either _memalloc has not been started or has been stopped.
+                LOG.debug("Unable to collect memory events from process %d", os.getpid(), exc_info=True)
+            return tuple()
+
         try:
             events_iter, count, alloc_count = _memalloc.iter_events()
         except RuntimeError:
@@ -156,44 +289,25 @@ class MemoryCollector(collector.PeriodicCollector):
             LOG.debug("Unable to collect memory events from process %d", os.getpid(), exc_info=True)
             return tuple()
 
-        # `events_iter` is a consumable view into `iter_events()`; copy it so we can send it to both pyprof
-        # and libdatadog. This will be changed if/when we ever return to only a single possible exporter
         events = list(events_iter)
         capture_pct = 100 * count / alloc_count
         thread_id_ignore_set = self._get_thread_id_ignore_set()
 
-        if self._export_libdd_enabled:
-            for (frames, nframes, thread_id), size, _domain in events:
-                if thread_id in thread_id_ignore_set:
-                    continue
-                handle = ddup.SampleHandle()
-                handle.push_alloc(int((ceil(size) * alloc_count) / count), count)  # Roundup to help float precision
-                handle.push_threadinfo(
-                    thread_id, _threading.get_thread_native_id(thread_id), _threading.get_thread_name(thread_id)
+        return (
+            tuple(
+                MemoryAllocSampleEvent(
+                    thread_id=thread_id,
+                    thread_name=_threading.get_thread_name(thread_id),
+                    thread_native_id=_threading.get_thread_native_id(thread_id),
+                    frames=frames,
+                    nframes=nframes,
+                    size=size,
+                    capture_pct=(
+                        capture_pct / self._sampled_alloc_weight(size) if self.alloc_sample_size else capture_pct
+                    ),
+                    nevents=alloc_count,
                 )
-                try:
-                    for frame in frames:
-                        handle.push_frame(frame.function_name, frame.file_name, 0, frame.lineno)
-                    handle.flush_sample()
-                except AttributeError:
-                    # DEV: This might happen if the memalloc sofile is unlinked and relinked without module
-                    #      re-initialization.
-                    LOG.debug("Invalid state detected in memalloc module, suppressing profile")
-            return tuple()
-        else:
-            return (
-                tuple(
-                    MemoryAllocSampleEvent(
-                        thread_id=thread_id,
-                        thread_name=_threading.get_thread_name(thread_id),
-                        thread_native_id=_threading.get_thread_native_id(thread_id),
-                        frames=frames,
-                        nframes=nframes,
-                        size=size,
-                        capture_pct=capture_pct,
-                        nevents=alloc_count,
-                    )
-                    for (frames, nframes, thread_id), size, domain in events
-                    if not self.ignore_profiler or thread_id not in thread_id_ignore_set
-                ),
-            )
+                for (frames, nframes, thread_id), size, domain in events
+                if not self.ignore_profiler or thread_id not in thread_id_ignore_set
+            ),
+        )
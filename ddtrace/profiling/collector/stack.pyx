@@ -3,15 +3,20 @@ from __future__ import absolute_import
 
 from itertools import chain
 import logging
+import os
 import sys
 import typing
+import weakref
 
 import attr
 import six
 
+import ddtrace
 from ddtrace.internal._unpatched import _threading as ddtrace_threading
 from ddtrace._trace import context
 from ddtrace._trace import span as ddspan
+from ddtrace._trace.processor import SpanProcessor
+from ddtrace.internal import _active
 from ddtrace.internal import compat
 from ddtrace.internal._threads import periodic_threads
 from ddtrace.internal.datadog.profiling import ddup
@@ -50,7 +55,9 @@ IF UNAME_SYSNAME == "Linux":
     from posix.time cimport timespec
     from posix.types cimport clockid_t
 
-    from cpython.exc cimport PyErr_SetFromErrno
+    from cpython.mem cimport PyMem_Free
+    from cpython.mem cimport PyMem_Malloc
+    from libc.stdint cimport int64_t
 
     cdef extern from "<pthread.h>":
         # POSIX says this might be a struct, but CPython relies on it being an unsigned long.
@@ -61,18 +68,18 @@ IF UNAME_SYSNAME == "Linux":
         # We pay this with a warning at compilation time, but it works anyhow.
         int pthread_getcpuclockid(unsigned long thread, clockid_t *clock_id)
 
-    cdef p_pthread_getcpuclockid(tid):
+    cdef void read_cpu_times(const unsigned long *pthread_ids, int64_t *cpu_times, Py_ssize_t n):
+        # Reads the CPU clocks of all the threads in one go, without going back to Python in between.
         cdef clockid_t clock_id
-        if pthread_getcpuclockid(tid, &clock_id) == 0:
-            return clock_id
-        PyErr_SetFromErrno(OSError)
-
-    # Python < 3.3 does not have `time.clock_gettime`
-    cdef p_clock_gettime_ns(clk_id):
         cdef timespec tp
-        if clock_gettime(clk_id, &tp) == 0:
-            return int(tp.tv_nsec + tp.tv_sec * 10e8)
-        PyErr_SetFromErrno(OSError)
+        cdef Py_ssize_t i
+        for i in range(n):
+            if pthread_getcpuclockid(pthread_ids[i], &clock_id) == 0 and clock_gettime(clock_id, &tp) == 0:
+                cpu_times[i] = tp.tv_sec * <int64_t>1000000000 + tp.tv_nsec
+            else:
+                # Just in case it fails, set it to 0
+                # (Note that glibc never fails, it segfaults instead)
+                cpu_times[i] = 0
 
     cdef class _ThreadTime(object):
         cdef dict _last_thread_time
@@ -87,40 +94,53 @@ IF UNAME_SYSNAME == "Linux":
             return dict(self._last_thread_time)
 
         def __call__(self, pthread_ids):
-            cdef list cpu_times = []
-            for pthread_id in pthread_ids:
+            cdef list ids = list(pthread_ids)
+            cdef Py_ssize_t n = len(ids)
+            cdef Py_ssize_t i
+            cdef unsigned long *c_pthread_ids
+            cdef int64_t *cpu_times
+            cdef dict pthread_cpu_time = {}
+            cdef dict last_thread_time = {}
+
+            if n == 0:
+                self._last_thread_time = last_thread_time
+                return pthread_cpu_time
+
+            # A single buffer holds the CPU times, then the ids
+            cpu_times = <int64_t *>PyMem_Malloc(n * (sizeof(int64_t) + sizeof(unsigned long)))
+            if cpu_times is NULL:
+                raise MemoryError()
+            c_pthread_ids = <unsigned long *>(cpu_times + n)
+
+            try:
+                for i in range(n):
+                    c_pthread_ids[i] = ids[i]
+
                 # TODO: Use QueryThreadCycleTime on Windows?
                 # ⚠ WARNING ⚠
                 # `pthread_getcpuclockid` can make Python segfault if the thread is does not exist anymore.
                 # In order avoid this, this function must be called with the GIL being held the entire time.
                 # This is why this whole file is compiled down to C: we make sure we never release the GIL between
                 # calling sys._current_frames() and pthread_getcpuclockid, making sure no thread disappeared.
-                try:
-                    cpu_time = p_clock_gettime_ns(p_pthread_getcpuclockid(pthread_id))
-                except OSError:
-                    # Just in case it fails, set it to 0
-                    # (Note that glibc never fails, it segfaults instead)
-                    cpu_time = 0
-                cpu_times.append(cpu_time)
-
-            cdef dict pthread_cpu_time = {}
+                read_cpu_times(c_pthread_ids, cpu_times, n)
+
+                # We should now be safe doing more Pythonic stuff and maybe releasing the GIL
+                for i in range(n):
+                    pthread_id = ids[i]
+                    cpu_time = cpu_times[i]
+                    thread_native_id = _threading.get_thread_native_id(pthread_id)
+                    key = pthread_id, thread_native_id
+                    # Do a max(0, …) here just in case the result is < 0:
+                    # This should never happen, but it can happen if the one chance in a billion happens:
+                    # - A new thread has been created and has the same native id and the same pthread_id.
+                    # - We got an error reading the CPU clock
+                    pthread_cpu_time[key] = max(0, cpu_time - self._last_thread_time.get(key, cpu_time))
+                    last_thread_time[key] = cpu_time
+            finally:
+                PyMem_Free(cpu_times)
 
-            # We should now be safe doing more Pythonic stuff and maybe releasing the GIL
-            for pthread_id, cpu_time in zip(pthread_ids, cpu_times):
-                thread_native_id = _threading.get_thread_native_id(pthread_id)
-                key = pthread_id, thread_native_id
-                # Do a max(0, …) here just in case the result is < 0:
-                # This should never happen, but it can happen if the one chance in a billion happens:
-                # - A new thread has been created and has the same native id and the same pthread_id.
-                # - We got an OSError with clock_gettime_ns
-                pthread_cpu_time[key] = max(0, cpu_time - self._last_thread_time.get(key, cpu_time))
-                self._last_thread_time[key] = cpu_time
-
-            # Clear cache
-            keys = list(pthread_cpu_time.keys())
-            for key in list(self._last_thread_time.keys()):
-                if key not in keys:
-                    del self._last_thread_time[key]
+            # Only the threads seen this time are kept
+            self._last_thread_time = last_thread_time
 
             return pthread_cpu_time
 ELSE:
@@ -151,6 +171,7 @@ ELSE:
 
 
 from cpython.object cimport PyObject
+from cpython.pythread cimport PyThread_get_thread_ident
 from cpython.ref cimport Py_DECREF
 
 cdef extern from "<pystate.h>":
@@ -223,7 +244,69 @@ ELSE:
     FEATURES['stack-exceptions'] = False
 
 
-cdef collect_threads(thread_id_ignore_list, thread_time, thread_span_links) with gil:
+cdef class _ThreadSpanLinks(object):
+    """Link the threads with the span last activated on them.
+
+    The tracer updates the link on every span activation, and the sampler reads it for every thread on every pass,
+    so this is a plain dict of weak references with C-level accessors rather than a generic _threading._ThreadLink.
+    """
+
+    # Key is a thread_id
+    # Value is a weakref to a span
+    cdef dict _thread_id_to_span
+
+    def __init__(self):
+        self._thread_id_to_span = {}
+
+    def link_span(
+            self,
+            span # type: typing.Optional[typing.Union[context.Context, ddspan.Span]]
+    ):
+        # type: (...) -> None
+        """Link a span to its running environment.
+
+        Track threads, tasks, etc.
+        """
+        if isinstance(span, ddspan.Span):
+            # Because threads might become tasks with some frameworks (e.g. gevent),
+            # we retrieve the thread ID using the C API instead of the Python API.
+            self._thread_id_to_span[PyThread_get_thread_ident()] = weakref.ref(span)
+
+    def clear_threads(self,
+                      existing_thread_ids,  # type: typing.Set[int]
+                      ):
+        """Clean up the thread linking map.
+
+        We remove all threads that are not in the existing thread IDs.
+
+        :param existing_thread_ids: A set of thread ids to keep.
+        """
+        self._thread_id_to_span = {
+            k: v for k, v in self._thread_id_to_span.items() if k in existing_thread_ids
+        }
+
+    cdef _get_active_span(self, thread_id):
+        span_ref = self._thread_id_to_span.get(thread_id)
+        if span_ref is not None:
+            active_span = span_ref()
+            if active_span is not None and not active_span.finished:
+                return active_span
+        return None
+
+    def get_active_span_from_thread_id(
+            self,
+            thread_id # type: int
+    ):
+        # type: (...) -> typing.Optional[ddspan.Span]
+        """Return the latest active span for a thread.
+
+        :param thread_id: The thread id.
+        :return: A set with the active spans.
+        """
+        return self._get_active_span(thread_id)
+
+
+cdef collect_threads(thread_id_ignore_list, thread_time, _ThreadSpanLinks thread_span_links) with gil:
     cdef dict running_threads = <dict>_PyThread_CurrentFrames()
     Py_DECREF(running_threads)
 
@@ -282,7 +365,7 @@ cdef collect_threads(thread_id_ignore_list, thread_time, thread_span_links) with
             _threading.get_thread_name(pthread_id),
             running_threads[pthread_id],
             current_exceptions.get(pthread_id),
-            thread_span_links.get_active_span_from_thread_id(pthread_id) if thread_span_links else None,
+            thread_span_links._get_active_span(pthread_id) if thread_span_links is not None else None,
             cpu_time,
         )
         for (pthread_id, native_thread_id), cpu_time in cpu_times.items()
@@ -290,7 +373,20 @@ cdef collect_threads(thread_id_ignore_list, thread_time, thread_span_links) with
     )
 
 
-cdef stack_collect(ignore_profiler, thread_time, max_nframes, interval, wall_time, thread_span_links, collect_endpoint):
+cdef bint _push_pyframes(handle, pyframes, max_nframes):
+    # The libdd exporter takes the frames as they are walked, rather than through the DDFrame objects of the event
+    # exporter; only the top frame needs a class name, and it is looked up once the stack turned out to be walkable.
+    nframes = handle.push_pyframes(pyframes, max_nframes)
+    if nframes < 0:
+        LOG.warning("Got an object other than a frame or code object during stack unwinding")
+        return False
+    return nframes > 0
+
+
+cdef stack_collect(
+    ignore_profiler, thread_time, max_nframes, interval, wall_time, thread_span_links, collect_endpoint,
+    scheduled_tasks_only,
+):
     # Do not use `threading.enumerate` to not mess with locking (gevent!)
     # Also collect the native threads, that are not registered with the built-in
     # threading module, to keep backward compatibility with the previous
@@ -305,7 +401,10 @@ cdef stack_collect(ignore_profiler, thread_time, max_nframes, interval, wall_tim
 
     if thread_span_links:
         # FIXME also use native thread id
-        thread_span_links.clear_threads(set(thread[0] for thread in running_threads))
+        running_thread_ids = set(thread[0] for thread in running_threads)
+        thread_span_links.clear_threads(running_thread_ids)
+        # The tracer records the ids of the spans activated on each thread natively as well
+        _active.clear_threads(running_thread_ids)
 
     stack_events = []
     exc_events = []
@@ -317,7 +416,7 @@ cdef stack_collect(ignore_profiler, thread_time, max_nframes, interval, wall_tim
             # Effectively we would be discarding a negligible number of samples.
             continue
 
-        tasks = _task.list_tasks(thread_id)
+        tasks = _task.list_tasks(thread_id, scheduled_tasks_only)
 
         # Inject wall time for all running tasks
         for task_id, task_name, task_pyframes in tasks:
@@ -326,20 +425,19 @@ cdef stack_collect(ignore_profiler, thread_time, max_nframes, interval, wall_tim
             if task_pyframes is None:
                 continue
 
-            frames, nframes = _traceback.pyframe_to_frames(task_pyframes, max_nframes)
-
-            if nframes:
-                if use_libdd:
-                    handle = ddup.SampleHandle()
+            if use_libdd:
+                handle = ddup.SampleHandle()
+                if _push_pyframes(handle, task_pyframes, max_nframes):
                     handle.push_walltime(wall_time, 1)
                     handle.push_threadinfo(thread_id, thread_native_id, thread_name)
                     handle.push_task_id(task_id)
                     handle.push_task_name(task_name)
-                    handle.push_class_name(frames[0].class_name)
-                    for frame in frames:
-                        handle.push_frame(frame.function_name, frame.file_name, 0, frame.lineno)
+                    handle.push_class_name(_traceback._extract_class_name(task_pyframes))
                     handle.flush_sample()
-                else:
+            else:
+                frames, nframes = _traceback.pyframe_to_frames(task_pyframes, max_nframes)
+
+                if nframes:
                     stack_events.append(
                         stack_event.StackSampleEvent(
                             thread_id=thread_id,
@@ -353,20 +451,19 @@ cdef stack_collect(ignore_profiler, thread_time, max_nframes, interval, wall_tim
                         )
                     )
 
-        frames, nframes = _traceback.pyframe_to_frames(thread_pyframes, max_nframes)
-
-        if nframes:
-            if use_libdd:
-                handle = ddup.SampleHandle()
+        if use_libdd:
+            handle = ddup.SampleHandle()
+            if _push_pyframes(handle, thread_pyframes, max_nframes):
                 handle.push_cputime( cpu_time, 1)
                 handle.push_walltime( wall_time, 1)
                 handle.push_threadinfo(thread_id, thread_native_id, thread_name)
-                handle.push_class_name(frames[0].class_name)
-                for frame in frames:
-                    handle.push_frame(frame.function_name, frame.file_name, 0, frame.lineno)
+                handle.push_class_name(_traceback._extract_class_name(thread_pyframes))
                 handle.push_span(span, collect_endpoint)
                 handle.flush_sample()
-            else:
+        else:
+            frames, nframes = _traceback.pyframe_to_frames(thread_pyframes, max_nframes)
+
+            if nframes:
                 event = stack_event.StackSampleEvent(
                     thread_id=thread_id,
                     thread_native_id=thread_native_id,
@@ -393,8 +490,7 @@ cdef stack_collect(ignore_profiler, thread_time, max_nframes, interval, wall_tim
                     handle.push_threadinfo(thread_id, thread_native_id, thread_name)
                     handle.push_exceptioninfo(exc_type, 1)
                     handle.push_class_name(frames[0].class_name)
-                    for frame in frames:
-                        handle.push_frame(frame.function_name, frame.file_name, 0, frame.lineno)
+                    handle.push_frames(frames)
                     handle.push_span(span, collect_endpoint)
                     handle.flush_sample()
                 else:
@@ -415,46 +511,33 @@ cdef stack_collect(ignore_profiler, thread_time, max_nframes, interval, wall_tim
     return stack_events, exc_events
 
 
-if typing.TYPE_CHECKING:
-    _thread_span_links_base = _threading._ThreadLink[ddspan.Span]
-else:
-    _thread_span_links_base = _threading._ThreadLink
-
-
-@attr.s(slots=True, eq=False)
-class _ThreadSpanLinks(_thread_span_links_base):
-
-    def link_span(
-            self,
-            span # type: typing.Optional[typing.Union[context.Context, ddspan.Span]]
-    ):
-        # type: (...) -> None
-        """Link a span to its running environment.
-
-        Track threads, tasks, etc.
-        """
-        # Since we're going to iterate over the set, make sure it's locked
-        if isinstance(span, ddspan.Span):
-            self.link_object(span)
+def _default_min_interval_time():
+    return sys.getswitchinterval() * 2
 
-    def get_active_span_from_thread_id(
-            self,
-            thread_id # type: int
-    ):
-        # type: (...) -> typing.Optional[ddspan.Span]
-        """Return the latest active span for a thread.
 
-        :param thread_id: The thread id.
-        :return: A set with the active spans.
-        """
-        active_span = self.get_object(thread_id)
-        if active_span is not None and not active_span.finished:
-            return active_span
-        return None
+@attr.s(eq=False)
+class _SpanCaptureProcessor(SpanProcessor):
+    """Have the stack v2 sampler capture the stack of the current thread when a slow span finishes."""
 
+    threshold_ns = attr.ib(type=int)
+    endpoint_collection_enabled = attr.ib(default=None)
 
-def _default_min_interval_time():
-    return sys.getswitchinterval() * 2
+    def on_span_start(self, span):
+        pass
+
+    def on_span_finish(self, span):
+        duration_ns = span.duration_ns
+        if duration_ns is None or duration_ns < self.threshold_ns:
+            return
+
+        # Same labels as push_span(), so the captures land in the span's code hotspots
+        root = span._local_root
+        root_span_id = root.span_id if root is not None else 0
+        trace_type = root.span_type if root is not None else None
+        resource = root.resource if root is not None and self.endpoint_collection_enabled else None
+        stack_v2.capture_span(
+            span.span_id, root_span_id, trace_type, resource, ddtrace_threading.current_thread().name
+        )
 
 
 @attr.s(slots=True)
@@ -467,8 +550,8 @@ class StackCollector(collector.PeriodicCollector):
     # no matter how fast the computer is.
     min_interval_time = attr.ib(factory=_default_min_interval_time, init=False)
 
-    max_time_usage_pct = attr.ib(type=float, default=config.max_time_usage_pct)
-    nframes = attr.ib(type=int, default=config.max_frames)
+    max_time_usage_pct = attr.ib(type=float, default=config.effective_max_time_usage_pct)
+    nframes = attr.ib(type=int, default=config.stack.max_frames or config.max_frames)
     ignore_profiler = attr.ib(type=bool, default=config.ignore_profiler)
     endpoint_collection_enabled = attr.ib(default=None)
     tracer = attr.ib(default=None)
@@ -476,6 +559,8 @@ class StackCollector(collector.PeriodicCollector):
     _last_wall_time = attr.ib(init=False, repr=False, eq=False, type=int)
     _thread_span_links = attr.ib(default=None, init=False, repr=False, eq=False)
     _stack_collector_v2_enabled = attr.ib(type=bool, default=config.stack.v2.enabled)
+    _scheduled_tasks_only = attr.ib(type=bool, default=config.stack.scheduled_tasks_only)
+    _span_capture_processor = attr.ib(default=None, init=False, repr=False, eq=False)
 
     @max_time_usage_pct.validator
     def _check_max_time_usage(self, attribute, value):
@@ -497,7 +582,32 @@ class StackCollector(collector.PeriodicCollector):
         # If at the end of things, stack v2 is still enabled, then start the native thread running the v2 sampler
         if self._stack_collector_v2_enabled:
             LOG.debug("Starting the stack v2 sampler")
-            stack_v2.start()
+            stack_v2.start(
+                min_interval=self.min_interval_time,
+                max_time_usage_pct=self.max_time_usage_pct,
+                max_threads_per_pass=config.stack.v2.max_threads_per_pass,
+                skip_idle_threads=config.stack.v2.skip_idle_threads,
+                native_frames=config.stack.v2.native_frames,
+                realtime_priority=config.stack.v2.realtime_priority,
+                cpus=config.thread_cpus or None,
+                idle_priority=config.thread_idle_priority,
+                fast_memory_reads=config.stack.v2.fast_memory_reads,
+                frame_cache_size=config.stack.v2.frame_cache_size,
+                adaptive_frame_cache=config.stack.v2.adaptive_frame_cache,
+                thread_state=config.stack.v2.thread_state,
+                cpu_timers=config.stack.v2.cpu_timers,
+            )
+
+            # Stacks at span boundaries only make sense when there are spans to label them with
+            if self.tracer is not None and config.stack.v2.span_capture_threshold > 0:
+                stack_v2.set_span_capture(
+                    config.stack.v2.span_capture_max_per_second, os.path.dirname(ddtrace.__file__) + os.sep
+                )
+                self._span_capture_processor = _SpanCaptureProcessor(
+                    threshold_ns=int(config.stack.v2.span_capture_threshold * 1e9),
+                    endpoint_collection_enabled=self.endpoint_collection_enabled,
+                )
+                self._span_capture_processor.register()
 
 
     def _start_service(self):
@@ -518,6 +628,10 @@ class StackCollector(collector.PeriodicCollector):
 
         # Also tell the native thread running the v2 sampler to stop, if needed
         if self._stack_collector_v2_enabled:
+            if self._span_capture_processor is not None:
+                self._span_capture_processor.unregister()
+                self._span_capture_processor = None
+                stack_v2.set_span_capture(0)
             stack_v2.stop()
 
     def _compute_new_interval(self, used_wall_time_ns):
@@ -541,6 +655,7 @@ class StackCollector(collector.PeriodicCollector):
                 wall_time,
                 self._thread_span_links,
                 self.endpoint_collection_enabled,
+                self._scheduled_tasks_only,
             )
 
         used_wall_time_ns = compat.monotonic_ns() - now
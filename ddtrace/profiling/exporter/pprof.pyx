@@ -8,6 +8,14 @@ import typing
 import attr
 import six
 
+from cpython.bytes cimport PyBytes_FromStringAndSize
+from cpython.mem cimport PyMem_Free
+from cpython.mem cimport PyMem_Realloc
+from cpython.unicode cimport PyUnicode_AsUTF8String
+from libc.stdint cimport int64_t
+from libc.stdint cimport uint64_t
+from libc.string cimport memcpy
+
 from ddtrace import ext
 from ddtrace.internal import packages
 from ddtrace.internal._encoding import ListStringTable as _StringTable
@@ -114,6 +122,235 @@ else:
     from ddtrace.profiling.exporter import pprof_3_pb2 as pprof_pb2  # type: ignore[no-redef]
 
 
+# Plain counterparts of the pprof_pb2 messages the exporter builds, with the same field names.  Building protobuf
+# objects for every sample and serializing them through the protobuf runtime dominated the cost of the export, so
+# the profile is encoded directly from these by _Profile.SerializeToString instead.
+_ValueType = collections.namedtuple("ValueType", ("type", "unit"))
+_Label = collections.namedtuple("Label", ("key", "str"))
+_Sample = collections.namedtuple("Sample", ("location_id", "value", "label"))
+_Mapping = collections.namedtuple("Mapping", ("id", "filename"))
+_Line = collections.namedtuple("Line", ("function_id", "line"))
+_Location = collections.namedtuple("Location", ("id", "line"))
+_Function = collections.namedtuple("Function", ("id", "name", "filename"))
+
+
+cdef struct _pb_buffer:
+    char *data
+    size_t length
+    size_t capacity
+
+
+cdef int _pb_reserve(_pb_buffer *buf, size_t size) except -1:
+    cdef size_t capacity
+    cdef char *data
+
+    if buf.length + size <= buf.capacity:
+        return 0
+
+    capacity = buf.capacity * 2 if buf.capacity else 65536
+    while capacity < buf.length + size:
+        capacity *= 2
+    data = <char *>PyMem_Realloc(buf.data, capacity)
+    if data is NULL:
+        raise MemoryError()
+    buf.data = data
+    buf.capacity = capacity
+    return 0
+
+
+cdef inline size_t _pb_varint_size(uint64_t value):
+    cdef size_t size = 1
+    while value >= 0x80:
+        value >>= 7
+        size += 1
+    return size
+
+
+cdef int _pb_varint(_pb_buffer *buf, uint64_t value) except -1:
+    _pb_reserve(buf, 10)
+    while value >= 0x80:
+        buf.data[buf.length] = <char>((value & 0x7F) | 0x80)
+        buf.length += 1
+        value >>= 7
+    buf.data[buf.length] = <char>value
+    buf.length += 1
+    return 0
+
+
+# Proto3 leaves the scalar fields with a zero value out.  All the field numbers used here fit the single byte keys.
+cdef inline size_t _pb_int_size(int64_t value):
+    return 1 + _pb_varint_size(<uint64_t>value) if value else 0
+
+
+cdef int _pb_int(_pb_buffer *buf, int field, int64_t value) except -1:
+    if value:
+        _pb_varint(buf, <uint64_t>(field << 3))
+        _pb_varint(buf, <uint64_t>value)
+    return 0
+
+
+cdef inline size_t _pb_message_size(size_t size):
+    return 1 + _pb_varint_size(size) + size
+
+
+cdef int _pb_message(_pb_buffer *buf, int field, size_t size) except -1:
+    # Only writes the key and the length: the fields of the message follow
+    _pb_varint(buf, <uint64_t>((field << 3) | 2))
+    _pb_varint(buf, size)
+    return 0
+
+
+cdef int _pb_bytes(_pb_buffer *buf, int field, bytes value) except -1:
+    cdef size_t size = len(value)
+    _pb_message(buf, field, size)
+    _pb_reserve(buf, size)
+    memcpy(buf.data + buf.length, <const char *>value, size)
+    buf.length += size
+    return 0
+
+
+cdef Py_ssize_t _pb_pair_size(pair) except -1:
+    # ValueType, Label and Line are all a pair of integer fields numbered 1 and 2
+    return _pb_int_size(pair[0]) + _pb_int_size(pair[1])
+
+
+cdef int _pb_pair(_pb_buffer *buf, int field, pair) except -1:
+    _pb_message(buf, field, _pb_pair_size(pair))
+    _pb_int(buf, 1, pair[0])
+    _pb_int(buf, 2, pair[1])
+    return 0
+
+
+cdef int _pb_sample(_pb_buffer *buf, sample) except -1:
+    cdef size_t locations_size = 0
+    cdef size_t values_size = 0
+    cdef size_t labels_size = 0
+    cdef size_t size = 0
+    cdef uint64_t location_id
+    cdef int64_t value
+
+    for location_id in sample[0]:
+        locations_size += _pb_varint_size(location_id)
+    for value in sample[1]:
+        values_size += _pb_varint_size(<uint64_t>value)
+    for label in sample[2]:
+        labels_size += _pb_message_size(_pb_pair_size(label))
+
+    # The repeated integer fields are packed
+    if locations_size:
+        size += _pb_message_size(locations_size)
+    if values_size:
+        size += _pb_message_size(values_size)
+    size += labels_size
+
+    _pb_message(buf, 2, size)
+    if locations_size:
+        _pb_message(buf, 1, locations_size)
+        for location_id in sample[0]:
+            _pb_varint(buf, location_id)
+    if values_size:
+        _pb_message(buf, 2, values_size)
+        for value in sample[1]:
+            _pb_varint(buf, <uint64_t>value)
+    for label in sample[2]:
+        _pb_pair(buf, 3, label)
+    return 0
+
+
+cdef int _pb_location(_pb_buffer *buf, location) except -1:
+    cdef size_t size = _pb_int_size(location[0])
+
+    for line in location[1]:
+        size += _pb_message_size(_pb_pair_size(line))
+
+    _pb_message(buf, 4, size)
+    _pb_int(buf, 1, location[0])
+    for line in location[1]:
+        _pb_pair(buf, 4, line)
+    return 0
+
+
+cdef int _pb_function(_pb_buffer *buf, function) except -1:
+    _pb_message(buf, 5, _pb_int_size(function[0]) + _pb_int_size(function[1]) + _pb_int_size(function[2]))
+    _pb_int(buf, 1, function[0])
+    _pb_int(buf, 2, function[1])
+    _pb_int(buf, 4, function[2])
+    return 0
+
+
+cdef bytes _pb_profile(profile):
+    cdef _pb_buffer buf
+    cdef bytes string_bytes
+
+    buf.data = NULL
+    buf.length = 0
+    buf.capacity = 0
+
+    try:
+        for sample_type in profile.sample_type:
+            _pb_pair(&buf, 1, sample_type)
+        for sample in profile.sample:
+            _pb_sample(&buf, sample)
+        for mapping in profile.mapping:
+            _pb_message(&buf, 3, _pb_int_size(mapping.id) + _pb_int_size(mapping.filename))
+            _pb_int(&buf, 1, mapping.id)
+            _pb_int(&buf, 5, mapping.filename)
+        for location in profile.location:
+            _pb_location(&buf, location)
+        for function in profile.function:
+            _pb_function(&buf, function)
+        for string in profile.string_table:
+            try:
+                string_bytes = PyUnicode_AsUTF8String(string)
+            except UnicodeEncodeError:
+                string_bytes = string.encode("utf-8", "backslashreplace")
+            _pb_bytes(&buf, 6, string_bytes)
+        _pb_int(&buf, 9, profile.time_nanos)
+        _pb_int(&buf, 10, profile.duration_nanos)
+        if profile.period_type is not None:
+            _pb_pair(&buf, 11, profile.period_type)
+        _pb_int(&buf, 12, profile.period or 0)
+
+        return PyBytes_FromStringAndSize(buf.data, buf.length)
+    finally:
+        PyMem_Free(buf.data)
+
+
+class _Profile(object):
+    """The counterpart of pprof_pb2.Profile for the fields the exporter sets."""
+
+    __slots__ = (
+        "sample_type",
+        "sample",
+        "mapping",
+        "location",
+        "function",
+        "string_table",
+        "time_nanos",
+        "duration_nanos",
+        "period_type",
+        "period",
+    )
+
+    def __init__(
+        self, sample_type, sample, mapping, location, function, string_table, time_nanos, duration_nanos, period_type,
+        period,
+    ):
+        self.sample_type = sample_type
+        self.sample = sample
+        self.mapping = mapping
+        self.location = location
+        self.function = function
+        self.string_table = string_table
+        self.time_nanos = time_nanos
+        self.duration_nanos = duration_nanos
+        self.period_type = period_type
+        self.period = period
+
+    def SerializeToString(self) -> bytes:
+        return _pb_profile(self)
+
+
 _ITEMGETTER_ZERO = operator.itemgetter(0)
 _ITEMGETTER_ONE = operator.itemgetter(1)
 _ATTRGETTER_ID = operator.attrgetter("id")
@@ -209,7 +446,7 @@ class _PprofConverter(object):
         try:
             return self._functions[(filename, funcname)]
         except KeyError:
-            func = pprof_pb2.Function(
+            func = _Function(
                 id=next(self._last_func_id),
                 name=self._str(funcname),
                 filename=self._str(filename),
@@ -231,14 +468,14 @@ class _PprofConverter(object):
         try:
             return self._locations[(filename, lineno, funcname)]
         except KeyError:
-            location = pprof_pb2.Location(
+            location = _Location(
                 id=next(self._last_location_id),
-                line=[
-                    pprof_pb2.Line(
+                line=(
+                    _Line(
                         function_id=self._to_Function(filename, funcname).id,
                         line=lineno,
                     ),
-                ],
+                ),
             )
             self._locations[(filename, lineno, funcname)] = location
             return location
@@ -339,6 +576,19 @@ class _PprofConverter(object):
 
         self._location_values[location_key]["heap-space"] += event.size
 
+    def convert_memalloc_heap_lifetime_event(self, event: memalloc.MemoryHeapLifetimeEvent) -> None:
+        location_key = (
+            self._to_locations(tuple(event.frames), event.nframes),
+            (
+                ("thread id", _none_to_str(event.thread_id)),
+                ("thread native id", _none_to_str(event.thread_native_id)),
+                ("thread name", _get_thread_name(event.thread_id, event.thread_name)),
+                ("lifetime", event.lifetime),
+            ),
+        )
+
+        self._location_values[location_key]["heap-lifetime-samples"] += event.count
+
     def convert_lock_acquire_event(
         self,
         lock_name,  # type: str
@@ -477,34 +727,36 @@ class _PprofConverter(object):
         program_name: str,
     ) -> pprof_ProfileType:
         pprof_sample_type = [
-            pprof_pb2.ValueType(type=self._str(type_), unit=self._str(unit)) for type_, unit in sample_types
+            _ValueType(type=self._str(type_), unit=self._str(unit)) for type_, unit in sample_types
         ]
 
         sample = [
-            pprof_pb2.Sample(
+            _Sample(
                 location_id=locations,
                 value=[values.get(sample_type_name, 0) for sample_type_name, unit in sample_types],
-                label=[pprof_pb2.Label(key=self._str(key), str=self._str(s)) for key, s in labels],
+                label=[_Label(key=self._str(key), str=self._str(s)) for key, s in labels],
             )
             for (locations, labels), values in six.iteritems(self._location_values)
         ]
 
-        period_type = pprof_pb2.ValueType(type=self._str("time"), unit=self._str("nanoseconds"))
+        period_type = _ValueType(type=self._str("time"), unit=self._str("nanoseconds"))
+
+        mapping = [
+            _Mapping(
+                id=1,
+                filename=self._str(program_name),
+            ),
+        ]
 
-        # WARNING: no code should use _str() here as once the _string_table is serialized below,
+        # WARNING: no code should use _str() here as once the _string_table is copied below,
         # it won't be updated if you call _str later in the code here
-        return pprof_pb2.Profile(
+        return _Profile(
             sample_type=pprof_sample_type,
             sample=sample,
-            mapping=[
-                pprof_pb2.Mapping(
-                    id=1,
-                    filename=self._str(program_name),
-                ),
-            ],
-            location=self._locations.values(),
-            function=self._functions.values(),
-            string_table=self._string_table,
+            mapping=mapping,
+            location=list(self._locations.values()),
+            function=list(self._functions.values()),
+            string_table=list(self._string_table),
             time_nanos=start_time_ns,
             duration_nanos=duration_ns,
             period=period,
@@ -806,6 +1058,12 @@ class PprofExporter(exporter.Exporter):
             for event in events.get(memalloc.MemoryHeapSampleEvent, []):  # type: ignore[call-overload]
                 converter.convert_memalloc_heap_event(event)
 
+            heap_lifetime_events = events.get(memalloc.MemoryHeapLifetimeEvent, [])  # type: ignore[call-overload]
+            for event in heap_lifetime_events:
+                converter.convert_memalloc_heap_lifetime_event(event)
+        else:
+            heap_lifetime_events = []
+
         # Compute some metadata
         period = None  # type: typing.Optional[int]
         if nb_event:
@@ -827,6 +1085,10 @@ class PprofExporter(exporter.Exporter):
             ("heap-space", "bytes"),
         )
 
+        # Only there when lifetimes are recorded, which they are not by default
+        if heap_lifetime_events:
+            sample_types += (("heap-lifetime-samples", "count"),)
+
         profile = converter._build_profile(
             start_time_ns=start_time_ns,
             duration_ns=duration_ns,
@@ -16,6 +16,7 @@ from ddtrace.internal import forksafe
 from ddtrace.internal import service
 from ddtrace.internal import uwsgi
 from ddtrace.internal import writer
+from ddtrace.internal._threads import set_thread_placement
 from ddtrace.internal.datadog.profiling import ddup
 from ddtrace.internal.module import ModuleWatchdog
 from ddtrace.profiling import collector
@@ -23,6 +24,7 @@ from ddtrace.profiling import exporter  # noqa:F401
 from ddtrace.profiling import recorder
 from ddtrace.profiling import scheduler
 from ddtrace.profiling.collector import asyncio
+from ddtrace.profiling.collector import exception
 from ddtrace.profiling.collector import memalloc
 from ddtrace.profiling.collector import stack
 from ddtrace.profiling.collector import stack_event
@@ -117,6 +119,7 @@ class _ProfilerInstance(service.Service):
     _memory_collector_enabled = attr.ib(type=bool, default=config.memory.enabled)
     _stack_collector_enabled = attr.ib(type=bool, default=config.stack.enabled)
     _lock_collector_enabled = attr.ib(type=bool, default=config.lock.enabled)
+    _exception_collector_enabled = attr.ib(type=bool, default=config.exception.enabled)
     enable_code_provenance = attr.ib(type=bool, default=config.code_provenance)
     endpoint_collection_enabled = attr.ib(type=bool, default=config.endpoint_collection)
 
@@ -186,6 +189,8 @@ class _ProfilerInstance(service.Service):
                 configured_features.append("stack")
         if self._lock_collector_enabled:
             configured_features.append("lock")
+        if self._exception_collector_enabled:
+            configured_features.append("exc")
         if self._memory_collector_enabled:
             configured_features.append("mem")
         if config.heap.sample_size > 0:
@@ -217,7 +222,32 @@ class _ProfilerInstance(service.Service):
                     tags=self.tags,  # type: ignore
                     max_nframes=config.max_frames,
                     url=endpoint,
+                    sample_pool_capacity=config.sample_pool_capacity,
+                    timeline_enabled=config.timeline_enabled,
+                    string_table_max_bytes=config.string_table_max_bytes,
+                    spool_dir=config.spool_dir,
+                    spool_max_bytes=config.spool_max_bytes,
+                    endpoint_summary_stacks=config.endpoint_summary_stacks,
+                    endpoint_summary_window=config.endpoint_summary_window,
+                    shared_aggregation_stacks=config.shared_aggregation_stacks,
+                    shared_aggregation_name=config.shared_aggregation_name,
+                    output_pprof=config.output_pprof,
+                    output_pprof_max_files=config.output_pprof_max_files,
+                    output_pprof_max_bytes=config.output_pprof_max_bytes,
+                    compression=config.compression,
+                    compression_level=config.compression_level,
+                    type_max_nframes={
+                        "cpu": config.stack.max_frames,
+                        "wall": config.stack.max_frames,
+                        "exception": config.exception.max_frames,
+                        "lock": config.lock.max_frames,
+                        "allocation": config.memory.max_frames,
+                        "heap": config.heap.max_frames,
+                    },
                 )
+                if self.endpoint_collection_enabled:
+                    # The requests are counted along with the samples, and sent with the same profile
+                    endpoint_call_counter_span_processor.count_natively(ddup.add_endpoint_count)
                 return []
             except Exception as e:
                 LOG.error("Failed to initialize libdd collector (%s), falling back to the legacy collector", e)
@@ -267,6 +297,7 @@ class _ProfilerInstance(service.Service):
                 ),
                 # Do not limit the heap sample size as the number of events is relative to allocated memory anyway
                 memalloc.MemoryHeapSampleEvent: None,
+                memalloc.MemoryHeapLifetimeEvent: None,
             },
             default_max_events=config.max_events,
         )
@@ -316,6 +347,16 @@ class _ProfilerInstance(service.Service):
             for module, hook in self._collectors_on_import:
                 ModuleWatchdog.register_module_hook(module, hook)
 
+        if self._exception_collector_enabled:
+            LOG.debug("Profiling collector (exception) enabled")
+            self._collectors.append(
+                exception.ExceptionCollector(
+                    r,
+                    tracer=self.tracer,
+                    endpoint_collection_enabled=self.endpoint_collection_enabled,
+                )  # type: ignore[call-arg]
+            )
+
         if self._memory_collector_enabled:
             self._collectors.append(memalloc.MemoryCollector(r))
 
@@ -356,6 +397,10 @@ class _ProfilerInstance(service.Service):
     def _start_service(self):
         # type: (...) -> None
         """Start the profiler."""
+        if config.thread_cpus or config.thread_idle_priority:
+            # This applies to the threads started from now on, which include the ones of the collectors below
+            set_thread_placement(config.thread_cpus or None, config.thread_idle_priority)
+
         collectors = []
         for col in self._collectors:
             try:
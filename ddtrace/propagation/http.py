@@ -1,4 +1,3 @@
-import re
 import sys
 from typing import Any  # noqa:F401
 from typing import Dict  # noqa:F401
@@ -29,6 +28,11 @@ from ddtrace._trace.span import _MetaDictType
 from ..constants import AUTO_KEEP
 from ..constants import AUTO_REJECT
 from ..constants import USER_KEEP
+from ..internal._propagation import collect_headers
+from ..internal._propagation import format_b3_single
+from ..internal._propagation import format_hex_id
+from ..internal._propagation import is_valid_tracestate
+from ..internal._propagation import parse_traceparent
 from ..internal._tagset import TagsetDecodeError
 from ..internal._tagset import TagsetEncodeError
 from ..internal._tagset import TagsetMaxSizeDecodeError
@@ -95,22 +99,25 @@ _POSSIBLE_HTTP_HEADER_B3_FLAGS = _possible_header(_HTTP_HEADER_B3_FLAGS)
 _POSSIBLE_HTTP_HEADER_TRACEPARENT = _possible_header(_HTTP_HEADER_TRACEPARENT)
 _POSSIBLE_HTTP_HEADER_TRACESTATE = _possible_header(_HTTP_HEADER_TRACESTATE)
 
-
-# https://www.w3.org/TR/trace-context/#traceparent-header-field-values
-# Future proofing: The traceparent spec is additive, future traceparent versions may contain more than 4 values
-# The regex below matches the version, trace id, span id, sample flag, and end-string/future values (if version>00)
-_TRACEPARENT_HEX_REGEX = re.compile(
-    r"""
-     ^                  # Start of string
-     ([a-f0-9]{2})-     # 2 character hex version
-     ([a-f0-9]{32})-    # 32 character hex trace id
-     ([a-f0-9]{16})-    # 16 character hex span id
-     ([a-f0-9]{2})      # 2 character hex sample flag
-     (-.+)?             # optional, start of any additional values
-     $                  # end of string
-     """,
-    re.VERBOSE,
-)
+# Lowercased name of every trace header and of its WSGI variant -> the name extracted contexts look up
+_EXTRACTED_HEADER_NAMES = {
+    name: header
+    for header in (
+        HTTP_HEADER_TRACE_ID,
+        HTTP_HEADER_PARENT_ID,
+        HTTP_HEADER_SAMPLING_PRIORITY,
+        HTTP_HEADER_ORIGIN,
+        _HTTP_HEADER_TAGS,
+        _HTTP_HEADER_B3_SINGLE,
+        _HTTP_HEADER_B3_TRACE_ID,
+        _HTTP_HEADER_B3_SPAN_ID,
+        _HTTP_HEADER_B3_SAMPLED,
+        _HTTP_HEADER_B3_FLAGS,
+        _HTTP_HEADER_TRACEPARENT,
+        _HTTP_HEADER_TRACESTATE,
+    )
+    for name in _possible_header(header)
+}
 
 
 def _extract_header_value(possible_header_names, headers, default=None):
@@ -141,11 +148,9 @@ _b3_id_to_dd_id = _hex_id_to_dd_id
 def _dd_id_to_b3_id(dd_id):
     # type: (int) -> str
     """Helper to convert Datadog trace/span int ids into lower case hex values"""
-    if dd_id > _MAX_UINT_64BITS:
-        # b3 trace ids can have the length of 16 or 32 characters:
-        # https://github.com/openzipkin/b3-propagation#traceid
-        return "{:032x}".format(dd_id)
-    return "{:016x}".format(dd_id)
+    # b3 trace ids can have the length of 16 or 32 characters:
+    # https://github.com/openzipkin/b3-propagation#traceid
+    return format_hex_id(dd_id)
 
 
 class _DatadogMultiHeader:
@@ -531,16 +536,9 @@ class _B3SingleHeader:
             log.debug("tried to inject invalid context %r", span_context)
             return
 
-        single_header = "{}-{}".format(_dd_id_to_b3_id(span_context.trace_id), _dd_id_to_b3_id(span_context.span_id))
-        sampling_priority = span_context.sampling_priority
-        if sampling_priority is not None:
-            if sampling_priority <= 0:
-                single_header += "-0"
-            elif sampling_priority == 1:
-                single_header += "-1"
-            elif sampling_priority > 1:
-                single_header += "-d"
-        headers[_HTTP_HEADER_B3_SINGLE] = single_header
+        headers[_HTTP_HEADER_B3_SINGLE] = format_b3_single(
+            span_context.trace_id, span_context.span_id, span_context.sampling_priority
+        )
 
     @staticmethod
     def _extract(headers):
@@ -660,17 +658,13 @@ class _TraceContext:
         Otherwise we extract the trace-id, span-id, and sampling priority from the
         traceparent header.
         """
-        valid_tp_values = _TRACEPARENT_HEX_REGEX.match(tp.strip())
-        if valid_tp_values is None:
+        # https://www.w3.org/TR/trace-context/#traceparent-header-field-values
+        # Future proofing: The traceparent spec is additive, future traceparent versions may contain more than 4 values
+        tp_values = parse_traceparent(tp)
+        if tp_values is None:
             raise ValueError("Invalid traceparent version: %s" % tp)
 
-        (
-            version,
-            trace_id_hex,
-            span_id_hex,
-            trace_flags_hex,
-            future_vals,
-        ) = valid_tp_values.groups()  # type: Tuple[str, str, str, str, Optional[str]]
+        version, trace_id, span_id, trace_flags, has_future_vals = tp_values
 
         if version == "ff":
             # https://www.w3.org/TR/trace-context/#version
@@ -678,19 +672,15 @@ class _TraceContext:
         elif version != "00":
             # currently 00 is the only version format, but if future versions come up we may need to add changes
             log.warning("unsupported traceparent version:%r, still attempting to parse", version)
-        elif version == "00" and future_vals is not None:
+        elif version == "00" and has_future_vals:
             raise ValueError("Traceparents with the version `00` should contain 4 values delimited by a dash: %s" % tp)
 
-        trace_id = _hex_id_to_dd_id(trace_id_hex)
-        span_id = _hex_id_to_dd_id(span_id_hex)
-
         # All 0s are invalid values
         if trace_id == 0:
             raise ValueError("0 value for trace_id is invalid")
         if span_id == 0:
             raise ValueError("0 value for span_id is invalid")
 
-        trace_flags = _hex_id_to_dd_id(trace_flags_hex)
         # there's currently only one trace flag, which denotes sampling priority
         # was set to keep "01" or drop "00"
         # trace flags is a bit field: https://www.w3.org/TR/trace-context/#trace-flags
@@ -807,7 +797,7 @@ class _TraceContext:
             ts = ",".join(ts_l)
             # the value MUST contain only ASCII characters in the
             # range of 0x20 to 0x7E
-            if re.search(r"[^\x20-\x7E]+", ts):
+            if not is_valid_tracestate(ts):
                 log.debug("received invalid tracestate header: %r", ts)
             else:
                 # store tracestate so we keep other vendor data for injection, even if dd ends up being invalid
@@ -1030,7 +1020,7 @@ class HTTPPropagator(object):
         if not headers:
             return Context()
         try:
-            normalized_headers = {name.lower(): v for name, v in headers.items()}
+            normalized_headers = collect_headers(headers, _EXTRACTED_HEADER_NAMES, _HTTP_BAGGAGE_PREFIX)
 
             # tracer configured to extract first only
             if config._propagation_extract_first:
@@ -13,11 +13,11 @@ from typing import Tuple  # noqa:F401
 from .constants import ENV_KEY
 from .internal.constants import _PRIORITY_CATEGORY
 from .internal.constants import DEFAULT_SAMPLING_RATE_LIMIT
+from .internal._rule_matcher import RuleMatcher
 from .internal.constants import MAX_UINT_64BITS as _MAX_UINT_64BITS
 from .internal.logger import get_logger
 from .internal.rate_limiter import RateLimiter
 from .internal.sampling import _apply_rate_limit
-from .internal.sampling import _get_highest_precedence_rule_matching
 from .internal.sampling import _set_sampling_tags
 from .sampling_rule import SamplingRule
 from .settings import _config as ddconfig
@@ -206,7 +206,7 @@ class DatadogSampler(RateByServiceSampler):
     per second.
     """
 
-    __slots__ = ("limiter", "rules", "default_sample_rate")
+    __slots__ = ("limiter", "rules", "default_sample_rate", "_rule_matcher")
 
     NO_RATE_LIMIT = -1
     # deprecate and remove the DEFAULT_RATE_LIMIT field from DatadogSampler
@@ -260,6 +260,9 @@ class DatadogSampler(RateByServiceSampler):
         # Configure rate limiter
         self.limiter = RateLimiter(rate_limit)
 
+        # Compiled from the rules on first use, and again whenever they change
+        self._rule_matcher = None  # type: Optional[RuleMatcher]
+
         log.debug("initialized %r", self)
 
     def __str__(self):
@@ -307,7 +310,10 @@ class DatadogSampler(RateByServiceSampler):
     def sample(self, span):
         span.context._update_tags(span)
 
-        matched_rule = _get_highest_precedence_rule_matching(span, self.rules)
+        matcher = self._rule_matcher
+        if matcher is None or not matcher.compiled_for(self.rules):
+            matcher = self._rule_matcher = RuleMatcher(self.rules)
+        matched_rule = matcher.match(span)
 
         sampler = self._default_sampler  # type: BaseSampler
         sample_rate = self.sample_rate
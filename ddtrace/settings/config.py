@@ -412,7 +412,11 @@ class Config(object):
         self._trace_writer_connection_reuse = asbool(
             os.getenv("DD_TRACE_WRITER_REUSE_CONNECTIONS", DEFAULT_REUSE_CONNECTIONS)
         )
+        self._trace_writer_chunked_transfer = asbool(os.getenv("DD_TRACE_WRITER_CHUNKED_TRANSFER", default=False))
+        self._trace_writer_compression = asbool(os.getenv("DD_TRACE_WRITER_COMPRESSION", default=False))
         self._trace_writer_log_err_payload = asbool(os.environ.get("_DD_TRACE_WRITER_LOG_ERROR_PAYLOADS", False))
+        # Store the tags and metrics of the spans in native maps rather than in dicts
+        self._trace_native_tag_maps = asbool(os.getenv("_DD_TRACE_NATIVE_TAG_MAPS", default=False))
 
         self._trace_agent_hostname = os.environ.get("DD_AGENT_HOST", os.environ.get("DD_TRACE_AGENT_HOSTNAME"))
         self._trace_agent_port = os.environ.get("DD_AGENT_PORT", os.environ.get("DD_TRACE_AGENT_PORT"))
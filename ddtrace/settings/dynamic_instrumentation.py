@@ -71,6 +71,14 @@ class DynamicInstrumentationConfig(En):
         help="Enable Dynamic Instrumentation diagnostic metrics",
     )
 
+    monitoring = En.v(
+        bool,
+        "monitoring.enabled",
+        default=True,
+        help_type="Boolean",
+        help="Call the line probes from sys.monitoring events instead of injecting them (Python 3.12+)",
+    )
+
     max_payload_size = En.v(
         int,
         "max_payload_size",
@@ -62,6 +62,54 @@ def _check_for_stack_v2_available():
     return stack_v2_is_available
 
 
+def _parse_thread_cpus(config):
+    # type: (ProfilingConfig) -> t.List[int]
+    # A list of CPUs and ranges of CPUs, like "0-1,3", as in a cpuset
+    cpus = []  # type: t.List[int]
+    for part in config._thread_cpus.split(","):
+        part = part.strip()
+        if not part:
+            continue
+        try:
+            first, _, last = part.partition("-")
+            cpus.extend(range(int(first), int(last or first) + 1))
+        except ValueError:
+            logger.warning("Ignoring invalid CPU range %r in DD_PROFILING_THREAD_CPUS", part)
+    return sorted(set(cpu for cpu in cpus if cpu >= 0))
+
+
+_MEMORY_DOMAINS = ("object", "mem", "raw")
+
+
+def _parse_memory_domains(config):
+    # type: (ProfilingConfig.Memory) -> t.List[str]
+    # The Python memory domains to track, like "object,mem"
+    domains = []  # type: t.List[str]
+    for part in config._domains.split(","):
+        domain = part.strip().lower()
+        if not domain:
+            continue
+        if domain not in _MEMORY_DOMAINS:
+            logger.warning("Ignoring unknown memory domain %r in DD_PROFILING_MEMORY_DOMAINS", part)
+        elif domain not in domains:
+            domains.append(domain)
+    return domains or ["object"]
+
+
+def _derive_max_time_usage_pct(config):
+    # type: (ProfilingConfig) -> float
+    # The budget is a share of one CPU, which is more than the process gets when its cgroup quota is lower
+    if not config.cgroup_aware:
+        return config.max_time_usage_pct
+
+    from ddtrace.internal.runtime.container import get_cpu_quota
+
+    quota = get_cpu_quota()
+    if quota is None or quota >= 1.0:
+        return config.max_time_usage_pct
+    return config.max_time_usage_pct * quota
+
+
 # We don't check for the availability of the ddup module when determining whether libdd is _required_,
 # since it's up to the application code to determine what happens in that failure case.
 def _is_libdd_required(config):
@@ -108,7 +156,26 @@ class ProfilingConfig(En):
         "output_pprof",
         default=None,
         help_type="String",
-        help="",
+        help="A path prefix for files where profiles are written instead of being uploaded. The process id and"
+        " a sequence number are appended to it.",
+    )
+
+    output_pprof_max_files = En.v(
+        int,
+        "output_pprof_max_files",
+        default=16,
+        help_type="Integer",
+        help="The number of files each process writes to ``DD_PROFILING_OUTPUT_PPROF`` through the native exporter;"
+        " after that, the oldest ones are overwritten.",
+    )
+
+    output_pprof_max_bytes = En.v(
+        int,
+        "output_pprof_max_bytes",
+        default=16 * 1024 * 1024,
+        help_type="Integer",
+        help="The maximum size, in bytes, of each file written to ``DD_PROFILING_OUTPUT_PPROF`` through the native"
+        " exporter. Larger profiles are discarded.",
     )
 
     max_events = En.v(
@@ -145,6 +212,112 @@ class ProfilingConfig(En):
         help="The maximum number of frames to capture in stack execution tracing",
     )
 
+    sample_pool_capacity = En.v(
+        int,
+        "sample_pool_capacity",
+        default=4,
+        help_type="Integer",
+        help="The number of Sample objects to keep in the pool for reuse. Increasing this can reduce the overhead"
+        " of frequently allocating Sample objects.",
+    )
+
+    timeline_enabled = En.v(
+        bool,
+        "timeline_enabled",
+        default=False,
+        help_type="Boolean",
+        help="Whether to add timestamps to samples collected through the native exporter, so that they can be"
+        " shown on a timeline. Without this, samples are only aggregated, which results in smaller profiles.",
+    )
+
+    string_table_max_bytes = En.v(
+        int,
+        "string_table_max_bytes",
+        default=32 * 1024 * 1024,
+        help_type="Integer",
+        help="The maximum amount of memory, in bytes, used to hold the function names, file names and labels of"
+        " the samples collected through the native exporter. Strings which are no longer used are released as"
+        " profiles are uploaded.",
+    )
+
+    spool_dir = En.v(
+        str,
+        "spool_dir",
+        default="",
+        help_type="String",
+        help="A directory where profiles which could not be uploaded through the native exporter (for instance,"
+        " while the agent restarts) are kept, and sent once the agent is reachable again. The directory should"
+        " not be shared by different services. Leave empty to disable.",
+    )
+
+    spool_max_bytes = En.v(
+        int,
+        "spool_max_bytes",
+        default=64 * 1024 * 1024,
+        help_type="Integer",
+        help="The maximum amount of disk space, in bytes, used by the profiles kept in ``DD_PROFILING_SPOOL_DIR``."
+        " The oldest profiles are discarded first.",
+    )
+
+    compression = En.v(
+        str,
+        "compression",
+        default="lz4",
+        help_type="String",
+        help="The codec of the profiles uploaded through the native exporter: ``lz4`` (the cheapest on CPU),"
+        " ``gzip`` or ``zstd``, which compress better at the cost of recompressing each profile on the upload"
+        " thread. Codecs which are not available in the build fall back to ``lz4``.",
+    )
+
+    compression_level = En.v(
+        int,
+        "compression_level",
+        default=0,
+        help_type="Integer",
+        help="The level of ``DD_PROFILING_COMPRESSION``, or 0 for the default of the codec. Ignored with ``lz4``.",
+    )
+
+    endpoint_summary_stacks = En.v(
+        int,
+        "endpoint_summary_stacks",
+        default=0,
+        help_type="Integer",
+        help="The number of stacks to keep for each endpoint in an in-process summary of the samples collected"
+        " through the native exporter, which can be queried at any time without waiting for the profile to be"
+        " uploaded. Requires endpoint collection. Leave at 0 to disable.",
+    )
+
+    endpoint_summary_window = En.v(
+        float,
+        "endpoint_summary_window",
+        default=60.0,
+        help_type="Float",
+        help="The span of time, in seconds, covered by the endpoint summary enabled with"
+        " ``DD_PROFILING_ENDPOINT_SUMMARY_STACKS``.",
+    )
+
+    shared_aggregation_stacks = En.v(
+        int,
+        "shared_aggregation_stacks",
+        default=0,
+        help_type="Integer",
+        help="With a prefork server such as gunicorn or uwsgi, aggregate the samples of all of the workers in shared"
+        " memory, with room for this many distinct stacks, and upload a single profile for all of them, in which"
+        " the samples of each worker are labeled with its process id. Only the stacks and the values of the samples"
+        " are kept. Leave at 0 to have every process upload its own profile.",
+    )
+
+    shared_aggregation_name = En.v(
+        str,
+        "shared_aggregation_name",
+        default="",
+        help_type="String",
+        help="The name of the shared memory segment enabled with ``DD_PROFILING_SHARED_AGGREGATION_STACKS``. By"
+        " default, the segment is shared with the processes forked after the profiler starts, which requires the"
+        " profiler to be started in the master process. Give a name to share it with the workers which start their"
+        " own profiler.",
+    )
+
     ignore_profiler = En.v(
         bool,
         "ignore_profiler",
@@ -162,6 +335,37 @@ class ProfilingConfig(En):
         "statistics. Must be greater than 0 and lesser or equal to 100",
     )
 
+    cgroup_aware = En.v(
+        bool,
+        "cgroup_aware",
+        default=False,
+        help_type="Boolean",
+        help="Whether to scale DD_PROFILING_MAX_TIME_USAGE_PCT down by the cgroup CPU quota of the process when it"
+        " is allowed less than one CPU, so that the profiler's overhead stays the same share of what it may use",
+    )
+
+    effective_max_time_usage_pct = En.d(float, _derive_max_time_usage_pct)
+
+    _thread_cpus = En.v(
+        str,
+        "thread_cpus",
+        default="",
+        help_type="String",
+        help="The CPUs to run the profiler's sampling thread and ddtrace's periodic worker threads on, as a list"
+        ' of CPUs and ranges of CPUs like "0-1,3". By default, they run on any CPU.',
+    )
+
+    thread_cpus = En.d(list, _parse_thread_cpus)
+
+    thread_idle_priority = En.v(
+        bool,
+        "thread_idle_priority",
+        default=False,
+        help_type="Boolean",
+        help="Whether to run the profiler's sampling thread and ddtrace's periodic worker threads with the"
+        " SCHED_IDLE scheduling policy, so that they only use CPU time the application leaves. Linux only.",
+    )
+
     api_timeout = En.v(
         float,
         "api_timeout",
@@ -190,6 +394,25 @@ class ProfilingConfig(En):
             help="Whether to enable the stack profiler",
         )
 
+        max_frames = En.v(
+            int,
+            "max_frames",
+            default=0,
+            help_type="Integer",
+            help="The maximum number of frames to capture in the CPU and wall time samples."
+            " 0 uses DD_PROFILING_MAX_FRAMES.",
+        )
+
+        scheduled_tasks_only = En.v(
+            bool,
+            "scheduled_tasks_only",
+            default=False,
+            help_type="Boolean",
+            help="Whether the stack profiler should only sample the asyncio tasks that are running or ready to run,"
+            " rather than every pending task. This reduces overhead with many concurrent tasks, but the tasks that are"
+            " waiting no longer contribute wall time.",
+        )
+
         class V2(En):
             __item__ = __prefix__ = "v2"
 
@@ -203,6 +426,111 @@ class ProfilingConfig(En):
 
             enabled = En.d(bool, lambda c: _check_for_stack_v2_available() and c._enabled)
 
+            max_threads_per_pass = En.v(
+                int,
+                "max_threads_per_pass",
+                default=0,
+                help_type="Integer",
+                help="The approximate maximum number of threads the v2 stack profiler samples on each pass. When there"
+                " are more threads, a random subset is sampled and weighted accordingly. 0 samples every thread.",
+            )
+
+            skip_idle_threads = En.v(
+                bool,
+                "skip_idle_threads",
+                default=False,
+                help_type="Boolean",
+                help="Whether the v2 stack profiler should skip threads which have used no CPU time since the"
+                " previous pass. This reduces overhead, but idle threads no longer contribute wall time.",
+            )
+
+            native_frames = En.v(
+                bool,
+                "native_frames",
+                default=False,
+                help_type="Boolean",
+                help="Whether the v2 stack profiler should also collect native (e.g., C extension) frames. Requires a"
+                " build with native unwinding support.",
+            )
+
+            fast_memory_reads = En.v(
+                bool,
+                "fast_memory_reads",
+                default=False,
+                help_type="Boolean",
+                help="Whether the v2 stack profiler should read the stacks of the interpreter with plain memory copies,"
+                " guarded by SIGSEGV and SIGBUS handlers, rather than with one system call per read. This makes deep"
+                " stacks much cheaper to sample. Reads go back to system calls while other handlers are installed"
+                " for these signals, e.g. by faulthandler.",
+            )
+
+            frame_cache_size = En.v(
+                int,
+                "frame_cache_size",
+                default=1024,
+                help_type="Integer",
+                help="The number of frames the v2 stack profiler keeps in its frame cache. Services with many hot"
+                " frames sample faster with a larger cache, at the cost of memory.",
+            )
+
+            adaptive_frame_cache = En.v(
+                bool,
+                "adaptive_frame_cache",
+                default=False,
+                help_type="Boolean",
+                help="Whether the v2 stack profiler should grow and shrink its frame cache, within 256 and 65536"
+                " frames, according to its observed hit rate. The cache isn't resized when native frames are"
+                " collected.",
+            )
+
+            thread_state = En.v(
+                bool,
+                "thread_state",
+                default=False,
+                help_type="Boolean",
+                help="Whether the v2 stack profiler should label samples with the state of their thread: whether it"
+                " held the GIL (up to Python 3.11), its scheduler state and, when it was blocked, the kind of system"
+                " call it was blocked in. Only available on Linux. This costs a few system calls per sampled thread.",
+            )
+
+            cpu_timers = En.v(
+                bool,
+                "cpu_timers",
+                default=False,
+                help_type="Boolean",
+                help="Whether the v2 stack profiler should arm a timer on the CPU clock of each thread, so that CPU"
+                " time is attributed to the native code each thread was running when it consumed it, rather than to"
+                " wherever the thread is when it is sampled. Only available on Linux. Each thread is interrupted with"
+                " a signal for every 10ms of CPU it consumes.",
+            )
+
+            realtime_priority = En.v(
+                bool,
+                "realtime_priority",
+                default=False,
+                help_type="Boolean",
+                help="Whether to run the v2 stack profiler's sampling thread with realtime priority, so that it keeps"
+                " its sampling rate on heavily loaded systems. This usually requires the CAP_SYS_NICE capability.",
+            )
+
+            span_capture_threshold = En.v(
+                float,
+                "span_capture_threshold",
+                default=0.0,
+                help_type="Float",
+                help="When set, the v2 stack profiler also captures the stack of the thread which finishes a span"
+                " that took at least this many seconds, labeled with the span. Short spans are rarely sampled"
+                " otherwise. 0 disables these captures.",
+            )
+
+            span_capture_max_per_second = En.v(
+                float,
+                "span_capture_max_per_second",
+                default=10.0,
+                help_type="Float",
+                help="The maximum number of stacks the v2 stack profiler captures per second when spans finish.",
+            )
+
     class Lock(En):
         __item__ = __prefix__ = "lock"
 
@@ -214,6 +542,43 @@ class ProfilingConfig(En):
             help="Whether to enable the lock profiler",
         )
 
+        max_frames = En.v(
+            int,
+            "max_frames",
+            default=0,
+            help_type="Integer",
+            help="The maximum number of frames to capture in the lock samples. 0 uses DD_PROFILING_MAX_FRAMES.",
+        )
+
+    class Exceptions(En):
+        __item__ = __prefix__ = "exception"
+
+        enabled = En.v(
+            bool,
+            "enabled",
+            default=False,
+            help_type="Boolean",
+            help="Whether to enable the exception profiler, which samples the exceptions as they are raised. Requires"
+            " Python 3.12 or later and the native exporter.",
+        )
+
+        sampling_interval = En.v(
+            int,
+            "sampling_interval",
+            default=100,
+            help_type="Integer",
+            help="Average number of exceptions raised between two sampled exceptions. Lower values give a more"
+            " accurate profile at the cost of more overhead.",
+        )
+
+        max_frames = En.v(
+            int,
+            "max_frames",
+            default=0,
+            help_type="Integer",
+            help="The maximum number of frames to capture in the exception samples. 0 uses DD_PROFILING_MAX_FRAMES.",
+        )
+
     class Memory(En):
         __item__ = __prefix__ = "memory"
 
@@ -233,6 +598,45 @@ class ProfilingConfig(En):
             help="",
         )
 
+        sample_size = En.v(
+            int,
+            "sample_size",
+            default=0,
+            help_type="Integer",
+            help="Average number of bytes allocated between two sampled allocation events. "
+            "When 0, every allocation is considered until the event buffer is full.",
+        )
+
+        native_enabled = En.v(
+            bool,
+            "native_enabled",
+            default=False,
+            help_type="Boolean",
+            help="Whether to also profile the memory allocated by native libraries through the C allocator, "
+            "such as the one of C extensions. Only supported on 64-bit Linux.",
+        )
+
+        _domains = En.v(
+            str,
+            "domains",
+            default="object",
+            help_type="String",
+            help="The Python memory domains to profile, as a comma-separated list of ``object`` (the Python objects),"
+            " ``mem`` (the buffers allocated with ``PyMem_Malloc``, such as those of lists and bytearrays) and"
+            " ``raw`` (the buffers allocated with ``PyMem_RawMalloc``, such as those of numpy arrays). The samples"
+            " are labeled with their domain. The raw domain is only supported on 64-bit Linux.",
+        )
+
+        domains = En.d(list, _parse_memory_domains)
+
+        max_frames = En.v(
+            int,
+            "max_frames",
+            default=0,
+            help_type="Integer",
+            help="The maximum number of frames to capture in the allocation samples. 0 uses DD_PROFILING_MAX_FRAMES.",
+        )
+
     class Heap(En):
         __item__ = __prefix__ = "heap"
 
@@ -253,6 +657,33 @@ class ProfilingConfig(En):
         )
         sample_size = En.d(int, _derive_default_heap_sample_size)
 
+        lifetime_enabled = En.v(
+            bool,
+            "lifetime_enabled",
+            default=False,
+            help_type="Boolean",
+            help="Whether to record how long the allocations sampled by the heap profiler live, by allocation site",
+        )
+
+        delta_export = En.v(
+            bool,
+            "delta_export",
+            default=False,
+            help_type="Boolean",
+            help=(
+                "Whether the native exporter only receives the heap samples allocated and freed since the last"
+                " profile, and keeps the live heap itself, rather than receiving the whole heap every time"
+            ),
+        )
+
+        max_frames = En.v(
+            int,
+            "max_frames",
+            default=0,
+            help_type="Integer",
+            help="The maximum number of frames to capture in the heap samples. 0 uses DD_PROFILING_MAX_FRAMES.",
+        )
+
     class Export(En):
         __item__ = __prefix__ = "export"
 
@@ -2,6 +2,7 @@ import hashlib
 import os
 import platform
 import re
+import runpy
 import shutil
 import subprocess
 import sys
@@ -40,6 +41,9 @@ HERE = Path(__file__).resolve().parent
 
 DEBUG_COMPILE = "DD_COMPILE_DEBUG" in os.environ
 
+# Link the C and Cython extensions which allow it into a single shared object, which is faster to load
+BUNDLE_EXTENSIONS = "DD_BUNDLE_EXTENSIONS" in os.environ
+
 # stack_v2 profiling extensions are optional, unless they are made explicitly required by this environment variable
 STACK_V2_REQUIRED = "DD_STACK_V2_REQUIRED" in os.environ
 
@@ -382,6 +386,38 @@ def get_exts_for(name):
         return []
 
 
+def bundle_extensions(extensions):
+    """Replace the extensions listed in ddtrace/internal/_bundle.py with a single one built from all their sources.
+
+    The extensions keep their own entry points in the bundle, where ddtrace.internal._bundle finds them.
+    """
+    if not BUNDLE_EXTENSIONS or CURRENT_OS == "Windows":
+        return extensions
+
+    bundle = runpy.run_path(str(HERE / "ddtrace" / "internal" / "_bundle.py"))
+    modules = bundle["MODULES"]
+    entry_points = [name.rpartition(".")[-1] for name in modules]
+    assert len(set(entry_points)) == len(entry_points), "The bundled extensions must have unique entry points"
+
+    bundled = [ext for ext in extensions if ext.name in modules]
+    if len(bundled) < 2:
+        return extensions
+
+    def union(values):
+        return [v for i, v in enumerate(values) if v not in values[:i]]
+
+    return [ext for ext in extensions if ext.name not in modules] + [
+        Extension(
+            bundle["BUNDLE"],
+            sources=[source for ext in bundled for source in ext.sources],
+            include_dirs=union([d for ext in bundled for d in ext.include_dirs]),
+            define_macros=union([m for ext in bundled for m in ext.define_macros]),
+            libraries=union([lib for ext in bundled for lib in ext.libraries]),
+            extra_compile_args=debug_compile_args,
+        )
+    ]
+
+
 if sys.byteorder == "big":
     encoding_macros = [("__BIG_ENDIAN__", "1")]
 else:
@@ -420,7 +456,13 @@ if not IS_PYSTON:
                 "ddtrace/profiling/collector/_memalloc.c",
                 "ddtrace/profiling/collector/_memalloc_tb.c",
                 "ddtrace/profiling/collector/_memalloc_heap.c",
+                "ddtrace/profiling/collector/_memalloc_export.c",
+                "ddtrace/profiling/collector/_memalloc_lifetime.c",
+                "ddtrace/profiling/collector/_memalloc_native.c",
+                "ddtrace/profiling/collector/_memalloc_types.c",
             ],
+            # For the C API of ddup, which memalloc uses without linking against it
+            include_dirs=["ddtrace/internal/datadog/profiling/dd_wrapper/include"],
             extra_compile_args=debug_compile_args,
         ),
         Extension(
@@ -447,9 +489,25 @@ if not IS_PYSTON:
                 extra_compile_args=debug_compile_args,
             )
         )
+        ext_modules.append(
+            Extension(
+                "ddtrace.internal.runtime._gcstats",
+                sources=["ddtrace/internal/runtime/_gcstats.c"],
+                extra_compile_args=debug_compile_args,
+            )
+        )
 
         ext_modules.append(CMakeExtension("ddtrace.appsec._iast._taint_tracking._native", source_dir=IAST_DIR))
 
+    if platform.system() == "Linux":
+        ext_modules.append(
+            Extension(
+                "ddtrace.internal._dogstatsd",
+                sources=["ddtrace/internal/_dogstatsd.c"],
+                extra_compile_args=debug_compile_args,
+            )
+        )
+
     if platform.system() == "Linux" and is_64_bit_python():
         ext_modules.append(
             CMakeExtension(
@@ -497,67 +555,156 @@ setup(
         "clean": CleanLibraries,
     },
     setup_requires=["setuptools_scm[toml]>=4", "cython", "cmake>=3.24.2,<3.28"],
-    ext_modules=ext_modules
-    + cythonize(
-        [
-            Cython.Distutils.Extension(
-                "ddtrace.internal._rand",
-                sources=["ddtrace/internal/_rand.pyx"],
-                language="c",
-            ),
-            Cython.Distutils.Extension(
-                "ddtrace.internal._tagset",
-                sources=["ddtrace/internal/_tagset.pyx"],
-                language="c",
-            ),
-            Extension(
-                "ddtrace.internal._encoding",
-                ["ddtrace/internal/_encoding.pyx"],
-                include_dirs=["."],
-                libraries=encoding_libraries,
-                define_macros=encoding_macros,
-            ),
-            Cython.Distutils.Extension(
-                "ddtrace.profiling.collector.stack",
-                sources=["ddtrace/profiling/collector/stack.pyx"],
-                language="c",
-                extra_compile_args=extra_compile_args,
-            ),
-            Cython.Distutils.Extension(
-                "ddtrace.profiling.collector._traceback",
-                sources=["ddtrace/profiling/collector/_traceback.pyx"],
-                language="c",
-            ),
-            Cython.Distutils.Extension(
-                "ddtrace.profiling._threading",
-                sources=["ddtrace/profiling/_threading.pyx"],
-                language="c",
-            ),
-            Cython.Distutils.Extension(
-                "ddtrace.profiling.collector._task",
-                sources=["ddtrace/profiling/collector/_task.pyx"],
-                language="c",
-            ),
-            Cython.Distutils.Extension(
-                "ddtrace.profiling.exporter.pprof",
-                sources=["ddtrace/profiling/exporter/pprof.pyx"],
-                language="c",
-            ),
-            Cython.Distutils.Extension(
-                "ddtrace.profiling._build",
-                sources=["ddtrace/profiling/_build.pyx"],
-                language="c",
-            ),
-        ],
-        compile_time_env={
-            "PY_MAJOR_VERSION": sys.version_info.major,
-            "PY_MINOR_VERSION": sys.version_info.minor,
-            "PY_MICRO_VERSION": sys.version_info.micro,
-            "PY_VERSION_HEX": sys.hexversion,
-        },
-        force=True,
-        annotate=os.getenv("_DD_CYTHON_ANNOTATE") == "1",
-        compiler_directives={"language_level": "3"},
+    ext_modules=bundle_extensions(
+        ext_modules
+        + cythonize(
+            [
+                Cython.Distutils.Extension(
+                    "ddtrace.internal._rand",
+                    sources=["ddtrace/internal/_rand.pyx"],
+                    language="c",
+                ),
+                Cython.Distutils.Extension(
+                    "ddtrace.internal._tagset",
+                    sources=["ddtrace/internal/_tagset.pyx"],
+                    language="c",
+                ),
+                Cython.Distutils.Extension(
+                    "ddtrace.internal._propagation",
+                    sources=["ddtrace/internal/_propagation.pyx"],
+                    language="c",
+                ),
+                Cython.Distutils.Extension(
+                    "ddtrace.internal._rule_matcher",
+                    sources=["ddtrace/internal/_rule_matcher.pyx"],
+                    language="c",
+                ),
+                Extension(
+                    "ddtrace.internal._rate_limiter",
+                    sources=["ddtrace/internal/_rate_limiter.c"],
+                    extra_compile_args=debug_compile_args,
+                ),
+                Extension(
+                    "ddtrace.internal._active",
+                    sources=["ddtrace/internal/_active.c"],
+                    extra_compile_args=debug_compile_args,
+                ),
+                Extension(
+                    "ddtrace.internal._log_injection",
+                    sources=["ddtrace/internal/_log_injection.c"],
+                    extra_compile_args=debug_compile_args,
+                ),
+                Extension(
+                    "ddtrace.internal._http_headers",
+                    sources=["ddtrace/internal/_http_headers.c"],
+                    extra_compile_args=debug_compile_args,
+                ),
+                Extension(
+                    "ddtrace.internal._injection",
+                    sources=["ddtrace/internal/_injection.c"],
+                    extra_compile_args=debug_compile_args,
+                ),
+                Extension(
+                    "ddtrace.debugging._function._monitor",
+                    sources=["ddtrace/debugging/_function/_monitor.c"],
+                    extra_compile_args=debug_compile_args,
+                ),
+                Extension(
+                    "ddtrace.internal.symbol_db._scan",
+                    sources=["ddtrace/internal/symbol_db/_scan.c"],
+                    extra_compile_args=debug_compile_args,
+                ),
+                Extension(
+                    "ddtrace.internal.wrapping._context",
+                    sources=["ddtrace/internal/wrapping/_context.c"],
+                    extra_compile_args=debug_compile_args,
+                ),
+                Extension(
+                    "ddtrace.internal.telemetry._counters",
+                    sources=["ddtrace/internal/telemetry/_counters.c"],
+                    extra_compile_args=debug_compile_args,
+                ),
+                Extension(
+                    "ddtrace.appsec._ddwaf._arena",
+                    sources=["ddtrace/appsec/_ddwaf/_arena.c"],
+                    extra_compile_args=debug_compile_args,
+                ),
+                Extension(
+                    "ddtrace.debugging._signal._capture",
+                    sources=["ddtrace/debugging/_signal/_capture.c"],
+                    extra_compile_args=debug_compile_args,
+                ),
+                Extension(
+                    "ddtrace.internal._encoding",
+                    ["ddtrace/internal/_encoding.pyx"],
+                    include_dirs=["."],
+                    libraries=encoding_libraries,
+                    define_macros=encoding_macros,
+                ),
+                Extension(
+                    "ddtrace.internal.processor._stats",
+                    ["ddtrace/internal/processor/_stats.pyx"],
+                    include_dirs=["ddtrace/internal"],
+                    libraries=encoding_libraries,
+                    define_macros=encoding_macros,
+                ),
+                Cython.Distutils.Extension(
+                    "ddtrace.internal.datastreams._pathway",
+                    sources=["ddtrace/internal/datastreams/_pathway.pyx"],
+                    language="c",
+                ),
+                Cython.Distutils.Extension(
+                    "ddtrace.profiling.collector.stack",
+                    sources=["ddtrace/profiling/collector/stack.pyx"],
+                    language="c",
+                    extra_compile_args=extra_compile_args,
+                ),
+                Cython.Distutils.Extension(
+                    "ddtrace.profiling.collector._traceback",
+                    sources=["ddtrace/profiling/collector/_traceback.pyx"],
+                    language="c",
+                ),
+                Cython.Distutils.Extension(
+                    "ddtrace.profiling._threading",
+                    sources=["ddtrace/profiling/_threading.pyx"],
+                    language="c",
+                ),
+                Cython.Distutils.Extension(
+                    "ddtrace.profiling.collector._exception",
+                    sources=["ddtrace/profiling/collector/_exception.pyx"],
+                    language="c",
+                ),
+                Cython.Distutils.Extension(
+                    "ddtrace.profiling.collector._sampler",
+                    sources=["ddtrace/profiling/collector/_sampler.pyx"],
+                    language="c",
+                ),
+                Cython.Distutils.Extension(
+                    "ddtrace.profiling.collector._task",
+                    sources=["ddtrace/profiling/collector/_task.pyx"],
+                    language="c",
+                ),
+                Cython.Distutils.Extension(
+                    "ddtrace.profiling.exporter.pprof",
+                    sources=["ddtrace/profiling/exporter/pprof.pyx"],
+                    language="c",
+                ),
+                Cython.Distutils.Extension(
+                    "ddtrace.profiling._build",
+                    sources=["ddtrace/profiling/_build.pyx"],
+                    language="c",
+                ),
+            ],
+            compile_time_env={
+                "PY_MAJOR_VERSION": sys.version_info.major,
+                "PY_MINOR_VERSION": sys.version_info.minor,
+                "PY_MICRO_VERSION": sys.version_info.micro,
+                "PY_VERSION_HEX": sys.hexversion,
+            },
+            force=True,
+            annotate=os.getenv("_DD_CYTHON_ANNOTATE") == "1",
+            compiler_directives={"language_level": "3"},
+        )
     )
     + get_exts_for("wrapt")
     + get_exts_for("psutil"),
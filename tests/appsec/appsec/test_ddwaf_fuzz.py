@@ -1,11 +1,14 @@
+import ctypes
 import sys
 
 from hypothesis import given
 from hypothesis import strategies as st
 import pytest
 
+from ddtrace.appsec._ddwaf.ddwaf_types import Arena
 from ddtrace.appsec._ddwaf.ddwaf_types import _observator
 from ddtrace.appsec._ddwaf.ddwaf_types import ddwaf_object
+from ddtrace.appsec._ddwaf.ddwaf_types import to_python
 
 
 SCALAR_OBJECTS = st.one_of(st.none(), st.booleans(), st.integers(), st.floats(), st.characters())
@@ -80,6 +83,55 @@ def test_limits(obj, res, trunc):
     assert obs.truncation == trunc
 
 
+@pytest.mark.skipif(Arena is None, reason="native conversion not available")
+@given(obj=PYTHON_OBJECTS, kwargs=st.fixed_dictionaries(WRAPPER_KWARGS))
+def test_native_objects_match_wrapper(obj, kwargs):
+    obs = _observator()
+    expected = ddwaf_object(obj, observator=obs, **kwargs).struct
+
+    address, truncation = Arena().convert(obj, kwargs["max_objects"], 20, 4096)
+    # compared through repr, as nan is not equal to itself
+    assert repr(ddwaf_object.from_address(address).struct) == repr(expected)
+    assert truncation == obs.truncation
+
+
+@pytest.mark.skipif(Arena is None, reason="native conversion not available")
+@pytest.mark.parametrize(
+    "obj, res, trunc",
+    [
+        (324, 324, 0),
+        (True, True, 0),
+        ("toast", "to", 1),
+        (b"toast", "to", 1),
+        (1.034, 1.034, 0),
+        ([1, 2], [1], 2),
+        ({"toast": "touch", "tomato": "tommy"}, {"to": "to"}, 3),
+        (None, None, 0),
+        (_AnyObject(), _AnyObject.cst[:2], 1),
+        ([[[1, 2], 3], 4], [[]], 6),
+        ((1 << 64) - 1, -1, 0),
+    ],
+)
+def test_native_limits(obj, res, trunc):
+    arena = Arena()
+    address, truncation = arena.convert(obj, 1, 1, 3)
+    assert ddwaf_object.from_address(address).struct == res
+    assert truncation == trunc
+
+    arena.reset()
+    assert arena.allocated <= 16 * 1024
+
+
+@pytest.mark.skipif(to_python is None, reason="native conversion not available")
+def test_native_read_depth():
+    dd_obj = ddwaf_object([[1], {"a": [2]}, 3])
+    address = ctypes.addressof(dd_obj)
+
+    assert to_python(address, 1) == [None, None, 3]
+    assert to_python(address, 2) == [[1], {"a": None}, 3]
+    assert to_python(address, 3) == dd_obj.struct == [[1], {"a": [2]}, 3]
+
+
 if __name__ == "__main__":
     import atheris
 
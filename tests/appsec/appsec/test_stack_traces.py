@@ -0,0 +1,29 @@
+import pytest
+
+from ddtrace.appsec._exploit_prevention import stack_traces
+from tests.utils import override_global_config
+
+
+def _capture(crop_stack, depth):
+    # Both on the same line, so that they see the same frames
+    return stack_traces.get_stack_frames(crop_stack, depth), stack_traces._stack_frames(crop_stack)
+
+
+def _nested(n, crop_stack, depth):
+    if n == 0:
+        return _capture(crop_stack, depth)
+    return _nested(n - 1, crop_stack, depth)
+
+
+@pytest.mark.skipif(stack_traces.get_stack_frames is None, reason="native stack frames not available")
+@pytest.mark.parametrize("crop_stack", [None, "_nested", "not_on_the_stack"])
+@pytest.mark.parametrize("depth", [0, 3, 8])
+def test_native_stack_frames_match_inspect(crop_stack, depth):
+    with override_global_config(dict(_ep_max_stack_trace_depth=depth)):
+        native, expected = _nested(10, crop_stack, depth)
+
+    assert [
+        {"id": i, "function": function, "file": filename, "line": line} for i, filename, function, line in native
+    ] == expected
+    if depth:
+        assert len(native) <= depth
@@ -144,12 +144,13 @@ def test_add_aspect_tainting_add_itself(obj1):
     assert result == obj1 + obj1
 
     assert is_pyobject_tainted(result) is True
+    # Contiguous ranges of the same source are coalesced
     ranges_result = get_tainted_ranges(result)
-    assert len(ranges_result) == 2
+    assert len(ranges_result) == 1
     assert ranges_result[0].start == 0
-    assert ranges_result[0].length == 3
-    assert ranges_result[1].start == 3
-    assert ranges_result[1].length == 3
+    assert ranges_result[0].length == 6
+    # The ranges of the operand are left as they are
+    assert [(r.start, r.length) for r in get_tainted_ranges(obj1)] == [(0, 3)]
 
 
 @pytest.mark.parametrize(
@@ -173,11 +174,34 @@ def test_add_aspect_tainting_add_itself_twice(obj1):
 
     assert is_pyobject_tainted(result) is True
     ranges_result = get_tainted_ranges(result)
-    assert len(ranges_result) == 2
+    assert len(ranges_result) == 1
     assert ranges_result[0].start == 0
-    assert ranges_result[0].length == 3
-    assert ranges_result[1].start == 3
-    assert ranges_result[1].length == 3
+    assert ranges_result[0].length == 6
+
+
+def test_add_aspect_coalesces_repeated_concatenation():
+    part = taint_pyobject(
+        pyobject="abc",
+        source_name="test_add_aspect_coalesces_repeated_concatenation",
+        source_value="abc",
+        source_origin=OriginType.PARAMETER,
+    )
+    other = taint_pyobject(
+        pyobject="xyz",
+        source_name="test_add_aspect_coalesces_repeated_concatenation_other",
+        source_value="xyz",
+        source_origin=OriginType.PARAMETER,
+    )
+
+    result = part
+    for _ in range(200):
+        result = ddtrace_aspects.add_aspect(result, part)
+    assert [(r.start, r.length) for r in get_tainted_ranges(result)] == [(0, 603)]
+
+    # Ranges of another source, or which are not contiguous, are kept apart
+    result = ddtrace_aspects.add_aspect(ddtrace_aspects.add_aspect(result, other), part)
+    result = ddtrace_aspects.add_aspect(ddtrace_aspects.add_aspect(result, "-"), part)
+    assert [(r.start, r.length) for r in get_tainted_ranges(result)] == [(0, 603), (603, 3), (606, 3), (610, 3)]
 
 
 @pytest.mark.parametrize(
@@ -232,6 +256,41 @@ def test_add_aspect_tainting_add_left_twice(obj1, obj2):
     assert ranges_result[0].length == 3
 
 
+@pytest.mark.parametrize(
+    "obj1, obj2",
+    [
+        ("abc", "de"),
+        (b"abc", b"de"),
+    ],
+)
+def test_add_aspect_tainting_in_loop(obj1, obj2):
+    obj1 = taint_pyobject(
+        pyobject=obj1,
+        source_name="test_add_aspect_tainting_in_loop",
+        source_value=obj1,
+        source_origin=OriginType.PARAMETER,
+    )
+
+    results = []
+    result = obj1[:0]
+    for _ in range(10):
+        result = ddtrace_aspects.add_aspect(result, obj1)
+        result = ddtrace_aspects.add_aspect(result, obj2)
+        results.append(result)
+
+    # Appending to a result doesn't change the ranges of the previous ones
+    for i, result in enumerate(results):
+        ranges_result = get_tainted_ranges(result)
+        assert [(r.start, r.length) for r in ranges_result] == [(j * 5, 3) for j in range(i + 1)]
+
+    # Neither does appending twice to the same result
+    result_1 = ddtrace_aspects.add_aspect(results[0], obj1)
+    result_2 = ddtrace_aspects.add_aspect(results[0], ddtrace_aspects.add_aspect(obj2, obj1))
+    assert [(r.start, r.length) for r in get_tainted_ranges(result_1)] == [(0, 3), (5, 3)]
+    assert [(r.start, r.length) for r in get_tainted_ranges(result_2)] == [(0, 3), (7, 3)]
+    assert [(r.start, r.length) for r in get_tainted_ranges(results[0])] == [(0, 3)]
+
+
 @pytest.mark.skip_iast_check_logs
 @pytest.mark.parametrize(
     "log_level, iast_debug, expected_log_msg",
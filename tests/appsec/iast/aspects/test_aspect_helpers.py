@@ -4,12 +4,14 @@ import pytest
 
 from ddtrace.appsec._iast._taint_tracking import OriginType
 from ddtrace.appsec._iast._taint_tracking import Source
+from ddtrace.appsec._iast._taint_tracking import SqlDialect
 from ddtrace.appsec._iast._taint_tracking import TaintRange
 from ddtrace.appsec._iast._taint_tracking import as_formatted_evidence
 from ddtrace.appsec._iast._taint_tracking import common_replace
 from ddtrace.appsec._iast._taint_tracking import get_ranges
 from ddtrace.appsec._iast._taint_tracking import set_ranges
 from ddtrace.appsec._iast._taint_tracking import set_ranges_on_splitted
+from ddtrace.appsec._iast._taint_tracking import sql_tokenize
 from ddtrace.appsec._iast._taint_tracking.aspects import _convert_escaped_text_to_tainted_text
 
 
@@ -110,6 +112,20 @@ def test_as_formatted_evidence_convert_escaped_text_to_tainted_text():  # type:
     assert _convert_escaped_text_to_tainted_text(":+-<1750328947>abcde<1750328947>-+:fgh", [ranges]) == "abcdefgh"
 
 
+def test_convert_escaped_text_to_tainted_text_large_payload():  # type: () -> None
+    from ddtrace.appsec._iast._taint_tracking import TagMappingMode
+
+    s = "abcde+:fgh<99>" * 1000
+    ranges = [_build_sample_range(i * 14, 5, "2") for i in range(1000)]
+    set_ranges(s, ranges)
+    escaped = as_formatted_evidence(s, tag_mapping_function=TagMappingMode.Mapper)
+    assert escaped.count(":+-<") == escaped.count(">-+:") == 1000
+
+    result = _convert_escaped_text_to_tainted_text(escaped, ranges)
+    assert result == s
+    assert [(r.start, r.length) for r in get_ranges(result)] == [(i * 14, 5) for i in range(1000)]
+
+
 def test_set_ranges_on_splitted_str() -> None:
     s = "abc|efgh"
     range1 = _build_sample_range(0, 2, "first")
@@ -444,3 +460,19 @@ def test_set_ranges_on_splitted_wrong_args():
     set_ranges_on_splitted(s, ranges, parts)
     ranges = get_ranges(parts[0])
     assert ranges == [TaintRange(1, 3, Source("123", "sample_value", OriginType.PARAMETER))]
+
+
+@pytest.mark.parametrize(
+    "query,dialect,expected",
+    [
+        ("SELECT * FROM users WHERE name = 'john' AND id = 42", SqlDialect.MYSQL, ["john", "42"]),
+        ('SELECT "a\\\\"b" -- note\nFROM t /* c */', SqlDialect.MYSQL, ['a\\\\"b', " note", " c "]),
+        ("SELECT -1.5, 0x1F, x'ab', id2 FROM t", SqlDialect.MYSQL, ["-1.5", "0x1F", "x'ab'"]),
+        ("SELECT 'it''s', $tag$secret$tag$ FROM t", SqlDialect.POSTGRESQL, ["it''s", "secret"]),
+        ("SELECT $tag$secret$tag$", SqlDialect.MYSQL, []),
+        ('SELECT "name" FROM t', SqlDialect.POSTGRESQL, []),
+        ("SELECT 'unclosed", SqlDialect.MYSQL, []),
+    ],
+)
+def test_sql_tokenize(query, dialect, expected):
+    assert [query[start:end] for start, end in sql_tokenize(query, dialect)] == expected
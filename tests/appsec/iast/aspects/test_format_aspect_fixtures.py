@@ -217,14 +217,28 @@ class TestOperatorFormatReplacement(BaseReplacement):
         )
 
     def test_format_when_tainted_template_range_special_template_then_tainted_result(self):  # type: () -> None
-        # TODO format with params doesn't work correctly
-        # self._assert_format_result(
-        #     taint_escaped_template="{:<25s} parameter",
-        #     taint_escaped_parameter="a:+-<input2>aaaa<input2>-+:a",
-        #     expected_result="aaaaaa                    parameter",
-        #     escaped_expected_result="a:+-<input2>aaaa<input2>-+:a parameter",
-        # )
-        pass
+        self._assert_format_result(
+            taint_escaped_template="{:<25s} parameter",
+            taint_escaped_parameter="a:+-<input2>aaaa<input2>-+:a",
+            expected_result="aaaaaa                    parameter",
+            escaped_expected_result="a:+-<input2>aaaa<input2>-+:a                    parameter",
+        )
+
+    def test_format_when_tainted_parameter_padded_and_cut_then_tainted_result(self):  # type: () -> None
+        self._assert_format_result(
+            taint_escaped_template="[{:>8.4}]",
+            taint_escaped_parameter=":+-<input1>parameter<input1>-+:",
+            expected_result="[    para]",
+            escaped_expected_result="[    :+-<input1>para<input1>-+:]",
+        )
+
+    def test_format_when_tainted_parameter_with_conversion_then_tainted_result(self):  # type: () -> None
+        self._assert_format_result(
+            taint_escaped_template="{!r}",
+            taint_escaped_parameter=":+-<input1>parameter<input1>-+:",
+            expected_result="'parameter'",
+            escaped_expected_result="':+-<input1>parameter<input1>-+:'",
+        )
 
     def test_format_key_error_and_no_log_metric(self, telemetry_writer):
         with pytest.raises(KeyError):
@@ -243,10 +243,10 @@ class TestOperatorJoinReplacement(object):
         result = mod.do_join_generator(tainted_base_string)
         assert result == "abcdeabcdeabcde"
 
+        # The contiguous ranges of the same source are coalesced
         ranges = get_tainted_ranges(result)
-        assert result[ranges[0].start : (ranges[0].start + ranges[0].length)] == "abcde"
-        assert result[ranges[1].start : (ranges[1].start + ranges[1].length)] == "abcde"
-        assert result[ranges[2].start : (ranges[2].start + ranges[2].length)] == "abcde"
+        assert len(ranges) == 1
+        assert result[ranges[0].start : (ranges[0].start + ranges[0].length)] == "abcdeabcdeabcde"
 
     def test_string_join_args_kwargs(self):
         # type: () -> None
@@ -437,6 +437,41 @@ class TestOperatorJoinReplacement(object):
         assert result[ranges[5].start : (ranges[5].start + ranges[5].length)] == "+abcde-"
         assert result[ranges[6].start : (ranges[6].start + ranges[6].length)] == "i"
 
+    def test_string_join_many_elements(self):
+        # type: () -> None
+        tainted = [
+            taint_pyobject(
+                pyobject="t%d" % i, source_name="t%d" % i, source_value="foo", source_origin=OriginType.PARAMETER
+            )
+            for i in range(10)
+        ]
+        it = ["x"] * 1000
+        for i, t in enumerate(tainted):
+            it[i * 97 + 5] = t
+        result = mod.do_join(",", it)
+        assert result == ",".join(it)
+
+        # Each "x" takes one character and a comma, each tainted element two characters and a comma
+        ranges = get_tainted_ranges(result)
+        assert [(r.start, r.length) for r in ranges] == [((i * 97 + 5) * 2 + i, 2) for i in range(10)]
+        assert [r.source.name for r in ranges] == ["t%d" % i for i in range(10)]
+
+    def test_string_join_many_elements_and_joiner_tainted(self):
+        # type: () -> None
+        tainted_base_string = taint_pyobject(
+            pyobject="+", source_name="joiner", source_value="foo", source_origin=OriginType.PARAMETER
+        )
+        first = taint_pyobject(
+            pyobject="ab", source_name="first", source_value="foo", source_origin=OriginType.PARAMETER
+        )
+        result = mod.do_join(tainted_base_string, [first] + ["x"] * 500)
+
+        # The ranges of a tainted object are limited, the ones of the first elements are kept
+        ranges = get_tainted_ranges(result)
+        assert len(ranges) == 100
+        assert (ranges[0].start, ranges[0].length, ranges[0].source.name) == (0, 2, "first")
+        assert [(r.start, r.length) for r in ranges[1:]] == [(2 + i * 2, 1) for i in range(99)]
+
 
 @pytest.mark.skip_iast_check_logs
 def test_propagate_ranges_with_no_context(caplog):
@@ -223,6 +223,41 @@ def test_ospathjoin_noparams():
         _ = ospathjoin_aspect()
 
 
+@pytest.mark.parametrize(
+    "parts, expected, start",
+    [
+        (("root/", "TAINTED"), "root/foo", 5),
+        (("root", "", "TAINTED"), "root/foo", 5),
+        (("", "TAINTED", ""), "foo/", 0),
+        (("root//", "TAINTED", "bar/"), "root//foo/bar/", 6),
+    ],
+)
+def test_ospathjoin_separators_and_empty_parts(parts, expected, start):
+    tainted_foo = taint_pyobject(
+        pyobject="foo",
+        source_name="test_ospath",
+        source_value="foo",
+        source_origin=OriginType.PARAMETER,
+    )
+    res = ospathjoin_aspect(*[tainted_foo if part == "TAINTED" else part for part in parts])
+    assert res == expected
+    assert get_tainted_ranges(res) == [TaintRange(start, 3, Source("test_ospath", "foo", OriginType.PARAMETER))]
+
+
+def test_ospathbasename_single_char_tainted():
+    tainted_slasha = taint_pyobject(
+        pyobject="/foo/a",
+        source_name="test_ospath",
+        source_value="/foo/a",
+        source_origin=OriginType.PARAMETER,
+    )
+
+    res = ospathbasename_aspect(tainted_slasha)
+    assert res == "a"
+    assert get_tainted_ranges(res) == [TaintRange(0, 1, Source("test_ospath", "/foo/a", OriginType.PARAMETER))]
+    assert not get_tainted_ranges("a")
+
+
 def test_ospathbasename_tainted_normal():
     tainted_foobarbaz = taint_pyobject(
         pyobject="/foo/bar/baz",
@@ -0,0 +1,119 @@
+import re
+
+import pytest
+
+from ddtrace.appsec._iast._taint_tracking import TaintRange
+from ddtrace.appsec._iast._taint_tracking import is_pyobject_tainted
+from ddtrace.appsec._iast._taint_tracking._native.taint_tracking import get_ranges
+from ddtrace.appsec._iast._taint_tracking._native.taint_tracking import set_ranges
+from ddtrace.appsec._iast._taint_tracking.aspects import re_group_aspect
+from ddtrace.appsec._iast._taint_tracking.aspects import re_groupdict_aspect
+from ddtrace.appsec._iast._taint_tracking.aspects import re_groups_aspect
+from ddtrace.appsec._iast._taint_tracking.aspects import re_sub_aspect
+from ddtrace.appsec._iast._taint_tracking.aspects import re_subn_aspect
+from ddtrace.appsec._iast._taint_tracking.aspects import split_aspect
+from tests.appsec.iast.aspects.test_aspect_helpers import _build_sample_range
+
+
+# The ranges of the results follow from the spans of the matches, the pieces are not searched back in the text
+def test_re_sub_module():
+    s = "hello world foo"
+    range1 = _build_sample_range(0, 15, s)
+    set_ranges(s, (range1,))
+
+    res = re_sub_aspect(None, 1, re, r"o", "0", s)
+    assert res == "hell0 w0rld f00"
+    assert get_ranges(res) == [
+        TaintRange(0, 4, range1.source),
+        TaintRange(5, 2, range1.source),
+        TaintRange(8, 5, range1.source),
+    ]
+
+    res, count = re_subn_aspect(None, 1, re, r"o", "0", s)
+    assert (res, count) == ("hell0 w0rld f00", 4)
+    assert len(get_ranges(res)) == 3
+
+
+def test_re_sub_pattern_template():
+    s = "hello world foo"
+    range1 = _build_sample_range(0, 15, s)
+    set_ranges(s, (range1,))
+
+    res = re_sub_aspect(None, 1, re.compile(r"(\w+) (\w+)"), r"\2 \1", s)
+    assert res == "world hello foo"
+    assert get_ranges(res) == [TaintRange(0, 11, range1.source), TaintRange(11, 4, range1.source)]
+
+
+def test_re_sub_tainted_repl():
+    repl = "XX"
+    range1 = _build_sample_range(0, 2, repl)
+    set_ranges(repl, (range1,))
+
+    res = re_sub_aspect(None, 1, re, r"o", repl, "fo bo")
+    assert res == "fXX bXX"
+    assert get_ranges(res) == [TaintRange(1, 2, range1.source), TaintRange(5, 2, range1.source)]
+
+
+def test_re_sub_callable_and_bytes():
+    s = "a,b"
+    range1 = _build_sample_range(0, 3, s)
+    set_ranges(s, (range1,))
+    res = re_sub_aspect(None, 1, re, ",", lambda m: ";", s)
+    assert res == "a;b"
+    assert get_ranges(res) == [TaintRange(0, 1, range1.source), TaintRange(2, 1, range1.source)]
+
+    b = b"ab,cd"
+    range2 = _build_sample_range(0, 5, "ab,cd")
+    set_ranges(b, (range2,))
+    res = re_sub_aspect(None, 1, re, rb",", b";", b)
+    assert res == b"ab;cd"
+    assert get_ranges(res) == [TaintRange(0, 2, range2.source), TaintRange(3, 2, range2.source)]
+
+
+def test_re_sub_untainted_and_errors():
+    res = re_sub_aspect(None, 1, re, r"o", "0", "foo")
+    assert res == "f00"
+    assert not is_pyobject_tainted(res)
+
+    with pytest.raises(re.error):
+        re_sub_aspect(None, 1, re, r"(", "0", "foo")
+    with pytest.raises(AttributeError):
+        re_sub_aspect(None, 1, "foo", "o", "0")
+
+
+def test_re_match_groups():
+    s = "hello world"
+    range1 = _build_sample_range(6, 5, "world")
+    set_ranges(s, (range1,))
+    match = re.compile(r"(?P<first>\w+) (?P<second>\w+)").match(s)
+
+    assert re_group_aspect(None, 1, match, 2) == "world"
+    assert get_ranges(re_group_aspect(None, 1, match, "second")) == [TaintRange(0, 5, range1.source)]
+    assert not is_pyobject_tainted(re_group_aspect(None, 1, match, 1))
+
+    groups = re_groups_aspect(None, 1, match)
+    assert groups == ("hello", "world")
+    assert not is_pyobject_tainted(groups[0])
+    assert get_ranges(groups[1]) == [TaintRange(0, 5, range1.source)]
+
+    groupdict = re_groupdict_aspect(None, 1, match)
+    assert groupdict == {"first": "hello", "second": "world"}
+    assert get_ranges(groupdict["second"]) == [TaintRange(0, 5, range1.source)]
+
+
+def test_re_split():
+    s = "abc def"
+    range1 = _build_sample_range(0, 7, s)
+    set_ranges(s, (range1,))
+
+    res = split_aspect(None, 1, re.compile(r"( )"), s)
+    assert res == ["abc", " ", "def"]
+    assert [get_ranges(part) for part in res] == [
+        [TaintRange(0, 3, range1.source)],
+        [TaintRange(0, 1, range1.source)],
+        [TaintRange(0, 3, range1.source)],
+    ]
+
+    res = split_aspect(None, 1, re, r"b", s, maxsplit=1)
+    assert res == ["a", "c def"]
+    assert get_ranges(res[1]) == [TaintRange(0, 5, range1.source)]
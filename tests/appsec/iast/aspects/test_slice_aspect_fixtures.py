@@ -234,6 +234,59 @@ def test_string_slice_2_and_two_strings_two_tainted_overlap_tained(
     assert tainted_ranges[1].length == 3
 
 
+@pytest.mark.skipif(sys.version_info < (3, 9, 0), reason="Python version not supported by IAST")
+@pytest.mark.parametrize(
+    "start_pos, end_pos, step, expected_result, expected_ranges",
+    [
+        (None, None, -1, "edcbajihgf", [(0, 5, "input_str_tainted2"), (5, 5, "input_str_tainted1")]),
+        (None, None, -2, "ecaig", [(0, 3, "input_str_tainted2"), (3, 2, "input_str_tainted1")]),
+        (7, 2, -1, "cbaji", [(0, 3, "input_str_tainted2"), (3, 2, "input_str_tainted1")]),
+        (-2, None, -3, "dah", [(0, 2, "input_str_tainted2"), (2, 1, "input_str_tainted1")]),
+        (3, None, -1, "ihgf", [(0, 4, "input_str_tainted1")]),
+    ],
+)
+def test_string_slice_2_and_two_strings_two_tainted_negative_step(
+    start_pos, end_pos, step, expected_result, expected_ranges
+):
+    tainted_input1 = taint_pyobject(
+        pyobject="fghij",
+        source_name="input_str_tainted1",
+        source_value="fghij",
+        source_origin=OriginType.PARAMETER,
+    )
+    tainted_input2 = taint_pyobject(
+        pyobject="abcde",
+        source_name="input_str_tainted2",
+        source_value="abcde",
+        source_origin=OriginType.PARAMETER,
+    )
+
+    result = mod.do_slice_2_and_two_strings(
+        tainted_input1, tainted_input2, start_pos, end_pos, step
+    )  # pylint: disable=no-member
+    assert result == expected_result
+    tainted_ranges = get_tainted_ranges(result)
+    assert [(r.start, r.length, r.source.name) for r in tainted_ranges] == expected_ranges
+
+
+def test_string_slice_long_text():
+    tainted = taint_pyobject(
+        pyobject="abcde",
+        source_name="input_str",
+        source_value="abcde",
+        source_origin=OriginType.PARAMETER,
+    )
+    text = mod.do_join("", ["x" * 1000, tainted] * 50)  # pylint: disable=no-member
+
+    result = mod.do_slice_2(text, 25 * 1005 + 995, 27 * 1005 + 2, None)  # pylint: disable=no-member
+    assert result == "x" * 5 + "abcde" + "x" * 1000 + "abcde" + "xx"
+    tainted_ranges = get_tainted_ranges(result)
+    assert [(r.start, r.length) for r in tainted_ranges] == [(5, 5), (1010, 5)]
+
+    result = mod.do_slice_2(text, 1002, 2010, 5)  # pylint: disable=no-member
+    assert [(r.start, r.length) for r in get_tainted_ranges(result)] == [(0, 1), (201, 1)]
+
+
 @pytest.mark.skipif(sys.version_info < (3, 9, 0), reason="Python version not supported by IAST")
 @pytest.mark.parametrize(
     "input_str, start_pos, end_pos, step, expected_result, tainted",
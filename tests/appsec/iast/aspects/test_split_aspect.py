@@ -15,13 +15,14 @@ from ddtrace.appsec._iast._taint_tracking._native.taint_tracking import OriginTy
 from ddtrace.appsec._iast._taint_tracking._native.taint_tracking import Source
 from ddtrace.appsec._iast._taint_tracking._native.taint_tracking import get_ranges
 from ddtrace.appsec._iast._taint_tracking._native.taint_tracking import set_ranges
+from ddtrace.appsec._iast._taint_tracking.aspects import rsplit_aspect
+from ddtrace.appsec._iast._taint_tracking.aspects import split_aspect
 from tests.appsec.iast.aspects.test_aspect_helpers import _build_sample_range
 from tests.utils import override_env
 
 
-# These tests are simple ones testing the calls and replacements since most of the
-# actual testing is in test_aspect_helpers' test for set_ranges_on_splitted which these
-# functions call internally.
+# The parts of a split text are not searched back in the text: their position follows from the separators, so
+# these tests cover the different separators (whitespace runs, multi-character separators, line breaks).
 def test_aspect_split_simple():
     s = "abc def"
     range1 = _build_sample_range(0, 3, "abc")
@@ -155,6 +156,84 @@ def test_aspect_splitlines_keepend_true():
     assert get_ranges(res[2]) == [TaintRange(0, 4, Source("hij\n", "sample_value", OriginType.PARAMETER))]
 
 
+def test_aspect_split_whitespace_runs():
+    s = "  abc \t\n déf  ghi "
+    range1 = _build_sample_range(2, 5, "abc \t")
+    range2 = _build_sample_range(9, 4, "déf ")
+    range3 = _build_sample_range(14, 2, "gh")
+    set_ranges(s, (range1, range2, range3))
+    res = _aspect_split(s)
+    assert res == ["abc", "déf", "ghi"]
+    assert get_ranges(res[0]) == [TaintRange(0, 3, range1.source)]
+    assert get_ranges(res[1]) == [TaintRange(0, 3, range2.source)]
+    assert get_ranges(res[2]) == [TaintRange(0, 2, range3.source)]
+
+    res = _aspect_split(s, maxsplit=1)
+    assert res == ["abc", "déf  ghi "]
+    assert get_ranges(res[1]) == [TaintRange(0, 4, range2.source), TaintRange(5, 2, range3.source)]
+
+    res = _aspect_rsplit(s, maxsplit=1)
+    assert res == ["  abc \t\n déf", "ghi"]
+    assert get_ranges(res[0]) == [range1, TaintRange(9, 3, range2.source)]
+    assert get_ranges(res[1]) == [TaintRange(0, 2, range3.source)]
+
+
+def test_aspect_split_multicharacter_separator():
+    s = "ab::cd::::ef"
+    range1 = _build_sample_range(1, 4, "b::c")
+    range2 = _build_sample_range(8, 4, "::ef")
+    set_ranges(s, (range1, range2))
+    res = _aspect_split(s, "::")
+    assert res == ["ab", "cd", "", "ef"]
+    assert get_ranges(res[0]) == [TaintRange(1, 1, range1.source)]
+    assert get_ranges(res[1]) == [TaintRange(0, 1, range1.source)]
+    assert get_ranges(res[3]) == [TaintRange(0, 2, range2.source)]
+
+    res = _aspect_rsplit(s, "::", 2)
+    assert res == ["ab::cd", "", "ef"]
+    assert get_ranges(res[0]) == [TaintRange(1, 4, range1.source)]
+    assert get_ranges(res[2]) == [TaintRange(0, 2, range2.source)]
+
+
+def test_aspect_splitlines_crlf():
+    s = "abc\r\ndéf\rghi\n"
+    range1 = _build_sample_range(2, 4, "c\r\nd")
+    range2 = _build_sample_range(8, 3, "\rgh")
+    set_ranges(s, (range1, range2))
+    res = _aspect_splitlines(s)
+    assert res == ["abc", "déf", "ghi"]
+    assert get_ranges(res[0]) == [TaintRange(2, 1, range1.source)]
+    assert get_ranges(res[1]) == [TaintRange(0, 1, range1.source)]
+    assert get_ranges(res[2]) == [TaintRange(0, 2, range2.source)]
+
+    res = _aspect_splitlines(s, True)
+    assert res == ["abc\r\n", "déf\r", "ghi\n"]
+    assert get_ranges(res[0]) == [TaintRange(2, 3, range1.source)]
+    assert get_ranges(res[1]) == [TaintRange(0, 1, range1.source), TaintRange(3, 1, range2.source)]
+    assert get_ranges(res[2]) == [TaintRange(0, 2, range2.source)]
+
+
+def test_split_aspect_arguments():
+    s = "abc,def ghi"
+    range1 = _build_sample_range(0, 11, "abc,def ghi")
+    set_ranges(s, (range1,))
+
+    res = split_aspect(None, 0, s, sep=",")
+    assert res == ["abc", "def ghi"]
+    assert get_ranges(res[0]) == [TaintRange(0, 3, range1.source)]
+    assert get_ranges(res[1]) == [TaintRange(0, 7, range1.source)]
+
+    res = rsplit_aspect(None, 0, s, maxsplit=1)
+    assert res == ["abc,def", "ghi"]
+    assert get_ranges(res[0]) == [TaintRange(0, 7, range1.source)]
+    assert get_ranges(res[1]) == [TaintRange(0, 3, range1.source)]
+
+    # Not a method of a text, nothing to propagate
+    assert split_aspect(lambda *args, **kwargs: (args, kwargs), 1, "added", s, maxsplit=1) == ((s,), {"maxsplit": 1})
+    with pytest.raises(TypeError):
+        split_aspect(None, 0, s, 1)
+
+
 @pytest.mark.skip_iast_check_logs
 @pytest.mark.skipif(sys.version_info < (3, 9, 0), reason="Python version not supported by IAST")
 def test_propagate_ranges_with_no_context(caplog):
@@ -3,6 +3,7 @@ from ast import literal_eval
 import random
 import re
 import sys
+import threading
 
 import pytest
 
@@ -354,6 +355,79 @@ def test_shift_taint_ranges():
     assert r3_shifted == TaintRange(6, 6, _SOURCE1)
 
 
+def test_ranges_keep_source_after_reset_context():
+    s1 = "abcdef"
+    set_ranges(s1, [_RANGE1, _RANGE2])
+    ranges = get_ranges(s1)
+    assert ranges[0].source == _SOURCE1
+    assert ranges[1].source == _SOURCE2
+
+    reset_context()
+    create_context()
+
+    assert ranges[0].source == _SOURCE1
+    assert ranges[1].source == _SOURCE2
+    assert hash(ranges[0]) == hash(_RANGE1)
+
+    s2 = "ghijkl"
+    set_ranges(s2, ranges)
+    assert [r.source for r in get_ranges(s2)] == [_SOURCE1, _SOURCE2]
+
+
+def test_ranges_of_many_sources_keep_their_source_and_hash():
+    # Enough sources to grow the source table of the context a few times
+    sources = [Source(name="name%d" % (i % 7), value="value%d" % i, origin=OriginType.PARAMETER) for i in range(300)]
+    texts = ["text%d" % i for i in range(300)]
+    for text, source in zip(texts, sources):
+        set_ranges(text, [TaintRange(0, 2, source)])
+    for text, source in zip(texts, sources):
+        (range_,) = get_ranges(text)
+        assert range_.source == source
+        assert hash(range_) == hash(TaintRange(0, 2, source))
+        assert get_range_by_hash(hash(range_), [range_]) == range_
+
+
+def test_propagated_ranges_share_source():
+    tainted = taint_pyobject(
+        "abcdef", source_name="request_body", source_value="abcdef", source_origin=OriginType.PARAMETER
+    )
+    result = add_aspect(add_aspect(add_aspect("xyz", tainted), "-"), tainted)
+    ranges = get_ranges(result)
+    assert [(r.start, r.length) for r in ranges] == [(3, 6), (10, 6)]
+    for r in ranges:
+        assert r.source == Source(name="request_body", value="abcdef", origin=OriginType.PARAMETER)
+
+
+def test_propagation_in_threads():
+    errors = []
+
+    def propagate(thread_id):
+        # Contexts are per thread, so tainting in a new thread needs its own
+        create_context()
+        try:
+            for i in range(1000):
+                prefix = taint_pyobject(
+                    "T%d_%04d" % (thread_id, i),
+                    source_name="request_body",
+                    source_value="hello",
+                    source_origin=OriginType.PARAMETER,
+                )
+                result = add_aspect(add_aspect(prefix, "-"), prefix)
+                expected = [(0, len(prefix)), (len(prefix) + 1, len(prefix))]
+                if [(r.start, r.length) for r in get_ranges(result)] != expected:
+                    errors.append((thread_id, i))
+        except Exception as e:
+            errors.append(e)
+
+    threads = [threading.Thread(target=propagate, args=(thread_id,)) for thread_id in range(8)]
+    for thread in threads:
+        thread.start()
+    for thread in threads:
+        thread.join()
+
+    assert errors == []
+
+
 def test_are_all_text_all_ranges():
     s1 = "abcdef"
     s2 = "ghijk"
@@ -441,3 +515,126 @@ def test_reset_objects():
     create_context()
 
     assert num_objects_tainted() == 0
+
+
+def test_propagation_across_contexts():
+    for i in range(20):
+        reset_context()
+        create_context()
+        tainted = [
+            taint_pyobject(
+                "value%d_%d" % (i, j),
+                source_name="test_propagation_across_contexts",
+                source_value="value%d_%d" % (i, j),
+                source_origin=OriginType.PARAMETER,
+            )
+            for j in range(200)
+        ]
+        result = tainted[0]
+        for obj in tainted[1:50]:
+            result = add_aspect(result, obj)
+        assert len(get_ranges(result)) == 50
+
+
+@pytest.mark.subprocess(
+    env=dict(
+        DD_IAST_ENABLED="True",
+        DD_IAST_MAX_TAINTED_OBJECTS_PER_REQUEST="10",
+        DD_IAST_MAX_TAINT_RANGES_PER_REQUEST="15",
+    )
+)
+def test_taint_budget():
+    from ddtrace.appsec._iast._taint_tracking import OriginType
+    from ddtrace.appsec._iast._taint_tracking import create_context
+    from ddtrace.appsec._iast._taint_tracking import is_pyobject_tainted
+    from ddtrace.appsec._iast._taint_tracking import num_objects_tainted
+    from ddtrace.appsec._iast._taint_tracking import reset_context
+    from ddtrace.appsec._iast._taint_tracking import taint_budget_exceeded
+    from ddtrace.appsec._iast._taint_tracking import taint_pyobject
+    from ddtrace.appsec._iast._taint_tracking.aspects import add_aspect
+
+    create_context()
+    tainted = [
+        taint_pyobject("value%d" % i, source_name="name", source_value="value", source_origin=OriginType.PARAMETER)
+        for i in range(20)
+    ]
+    assert num_objects_tainted() == 10
+    assert all(is_pyobject_tainted(value) for value in tainted[:10])
+    assert not any(is_pyobject_tainted(value) for value in tainted[10:])
+    assert taint_budget_exceeded()
+
+    reset_context()
+    create_context()
+    assert not taint_budget_exceeded()
+    a = taint_pyobject("a" * 10, source_name="a", source_value="value", source_origin=OriginType.PARAMETER)
+    b = taint_pyobject("b" * 10, source_name="b", source_value="value", source_origin=OriginType.PARAMETER)
+    results = [a]
+    for i in range(4):
+        # Alternate the sources so that the added ranges are not coalesced with the last one
+        results.append(add_aspect(results[-1], b if i % 2 == 0 else a))
+    # Past a and b, results have 2, 3, 4 and 5 ranges: the last one doesn't fit in the 15 ranges of the budget
+    assert [is_pyobject_tainted(result) for result in results] == [True] * 4 + [False]
+    assert taint_budget_exceeded()
+    reset_context()
+
+
+@pytest.mark.subprocess(env=dict(DD_IAST_ENABLED="True", DD_IAST_MAX_RETAINED_TAINT_MEMORY="0"))
+def test_taint_memory_not_retained():
+    from ddtrace.appsec._iast._taint_tracking import OriginType
+    from ddtrace.appsec._iast._taint_tracking import create_context
+    from ddtrace.appsec._iast._taint_tracking import get_ranges
+    from ddtrace.appsec._iast._taint_tracking import num_objects_tainted
+    from ddtrace.appsec._iast._taint_tracking import reset_context
+    from ddtrace.appsec._iast._taint_tracking import taint_pyobject
+    from ddtrace.appsec._iast._taint_tracking.aspects import add_aspect
+
+    # Each context allocates its memory again from scratch
+    for i in range(3):
+        create_context()
+        tainted = [
+            taint_pyobject("value%d" % j, source_name="name", source_value="value", source_origin=OriginType.PARAMETER)
+            for j in range(1000)
+        ]
+        result = tainted[0]
+        for obj in tainted[1:100]:
+            result = add_aspect(result, obj)
+        assert num_objects_tainted() >= 1000
+        assert len(get_ranges(result)) == 100
+        reset_context()
+
+
+@pytest.mark.skipif(not sys.platform.startswith("linux"), reason="Stale entries are only swept on Linux")
+@pytest.mark.subprocess(
+    env=dict(
+        DD_IAST_ENABLED="True",
+        DD_IAST_MAX_TAINTED_OBJECTS_PER_REQUEST="0",
+        DD_IAST_MAX_TAINT_RANGES_PER_REQUEST="0",
+    )
+)
+def test_stale_entries_are_swept():
+    from ddtrace.appsec._iast._taint_tracking import OriginType
+    from ddtrace.appsec._iast._taint_tracking import create_context
+    from ddtrace.appsec._iast._taint_tracking import is_pyobject_tainted
+    from ddtrace.appsec._iast._taint_tracking import num_objects_tainted
+    from ddtrace.appsec._iast._taint_tracking import reset_context
+    from ddtrace.appsec._iast._taint_tracking import taint_pyobject
+
+    create_context()
+    kept = []
+    others = []
+    for i in range(100):
+        tainted = [
+            taint_pyobject(
+                "value%d_%d" % (i, j), source_name="name", source_value="value", source_origin=OriginType.PARAMETER
+            )
+            for j in range(1000)
+        ]
+        kept.append(tainted[0])
+        del tainted
+        # The memory of the tainted objects goes to objects which aren't tainted
+        others.append(["other%d_%d" % (i, j) for j in range(1000)])
+
+    # Without sweeping, the entries of all the objects which are gone would still be there
+    assert num_objects_tainted() < 10000
+    assert all(is_pyobject_tainted(value) for value in kept)
+    reset_context()
@@ -1,4 +1,5 @@
 #!/usr/bin/env python3
+from concurrent.futures import ThreadPoolExecutor
 import logging
 
 import pytest
@@ -13,11 +14,20 @@ from tests.utils import override_env
 with override_env({"DD_IAST_ENABLED": "True"}):
     from ddtrace.appsec._iast._taint_tracking import OriginType
     from ddtrace.appsec._iast._taint_tracking import TaintRange
+    from ddtrace.appsec._iast._taint_tracking import attach_context
+    from ddtrace.appsec._iast._taint_tracking import create_context
+    from ddtrace.appsec._iast._taint_tracking import detach_context
+    from ddtrace.appsec._iast._taint_tracking import get_context
+    from ddtrace.appsec._iast._taint_tracking import get_tainted_ranges
+    from ddtrace.appsec._iast._taint_tracking import new_pyobject_id
     from ddtrace.appsec._iast._taint_tracking import num_objects_tainted
     from ddtrace.appsec._iast._taint_tracking import reset_context
     from ddtrace.appsec._iast._taint_tracking import set_ranges
     from ddtrace.appsec._iast._taint_tracking import taint_pyobject
+    from ddtrace.appsec._iast._taint_tracking import taint_pyobjects
+    from ddtrace.appsec._iast._taint_tracking import is_pyobject_tainted
     from ddtrace.appsec._iast._taint_tracking.aspects import add_aspect
+    from ddtrace.contrib.futures.threading import _wrap_execution
 
 
 def setup():
@@ -49,6 +59,71 @@ def test_taint_object_with_no_context_should_be_noop():
     assert num_objects_tainted() == 0
 
 
+def test_taint_pyobjects():
+    items = [
+        ("header value", "Header-Name", OriginType.HEADER),
+        (b"bytes value \xff", b"bytes-name", OriginType.PARAMETER),
+        ("path", OriginType.PATH, OriginType.PATH),
+        ("", "empty", OriginType.PARAMETER),
+        (42, "not text", OriginType.PARAMETER),
+    ]
+    results = taint_pyobjects(items)
+    assert results == [item[0] for item in items]
+    assert [bool(get_tainted_ranges(result)) for result in results] == [True, True, True, False, False]
+
+    (range_,) = get_tainted_ranges(results[0])
+    assert (range_.start, range_.length) == (0, 12)
+    assert (range_.source.name, range_.source.value, range_.source.origin) == (
+        "Header-Name",
+        "header value",
+        OriginType.HEADER,
+    )
+    (range_,) = get_tainted_ranges(results[1])
+    assert (range_.start, range_.length) == (0, 13)
+    assert (range_.source.name, range_.source.value) == ("bytes-name", "bytes value ")
+    (range_,) = get_tainted_ranges(results[2])
+    assert (range_.source.name, range_.source.origin) == ("http.request.path", OriginType.PATH)
+
+
+@pytest.mark.skip_iast_check_logs
+def test_taint_pyobjects_with_no_context():
+    reset_context()
+    items = [("abcde", "abcde", OriginType.PARAMETER), ("fghij", "fghij", OriginType.HEADER)]
+    assert taint_pyobjects(items) == ["abcde", "fghij"]
+    assert num_objects_tainted() == 0
+    create_context()
+
+
+def test_context_shared_with_worker_thread():
+    create_context()
+    tainted = taint_pyobject(
+        pyobject="request value", source_name="name", source_value="request value", source_origin=OriginType.PARAMETER
+    )
+    context = get_context()
+    assert context is not None
+
+    def work():
+        untracked = is_pyobject_tainted(tainted)
+        attach_context(context)
+        try:
+            return untracked, is_pyobject_tainted(tainted), add_aspect(tainted, " from a worker")
+        finally:
+            detach_context()
+
+    with ThreadPoolExecutor(max_workers=1) as executor:
+        untracked, tracked, result = executor.submit(work).result()
+        assert not untracked
+        assert tracked
+        assert [(range_.start, range_.length) for range_ in get_tainted_ranges(result)] == [(0, 13)]
+        # The worker is out of the context once detached
+        assert not executor.submit(is_pyobject_tainted, tainted).result()
+        # The futures integration attaches the workers to the context of the request
+        assert executor.submit(_wrap_execution, None, context, is_pyobject_tainted, (tainted,), {}).result()
+
+    reset_context()
+    assert get_context() is None
+
+
 @pytest.mark.skip_iast_check_logs
 def test_propagate_ranges_with_no_context(caplog):
     reset_context()
@@ -142,3 +217,26 @@ def test_taint_ranges_as_evidence_info_different_tainted_op1_and_op3_add():
         {"end": 44, "length": 14, "source": input_info2, "start": 30},
     ]
     assert sources == [input_info1, input_info2]
+
+
+@pytest.mark.parametrize(
+    "value",
+    [
+        "a",
+        "ascii text",
+        "latin-1 text: \xe9",
+        "UCS-2 text: \u65e5\u672c",
+        "UCS-4 text: \U0001f600",
+        b"a",
+        b"bytes text",
+        bytearray(b""),
+        bytearray(b"bytearray text"),
+    ],
+)
+def test_new_pyobject_id(value):
+    new_value = new_pyobject_id(value)
+    assert new_value == value
+    assert type(new_value) is type(value)
+    assert new_value is not value
+    if isinstance(value, str):
+        assert new_value.isascii() == value.isascii()
@@ -6,6 +6,8 @@ from pytest_memray import Stack
 
 from ddtrace.appsec._constants import IAST
 from ddtrace.appsec._iast._stacktrace import get_info_frame
+from ddtrace.appsec._iast._stacktrace import get_info_frame_if_not_reported
+from ddtrace.appsec._iast._stacktrace import reset_reported_locations
 from ddtrace.internal import core
 from tests.appsec.iast.aspects.conftest import _iast_patched_module
 from tests.appsec.iast_memcheck._stacktrace_py import get_info_frame as get_info_frame_py
@@ -134,6 +136,25 @@ def test_stacktrace_memory_check_direct_call():
         assert line_number > 0
 
 
+@flaky(1735812000)
+@pytest.mark.limit_leaks("460 B", filter_fn=IASTFilter())
+def test_stacktrace_memory_check_if_not_reported():
+    reset_reported_locations()
+    try:
+        for i in range(LOOPS):
+            frame_info = get_info_frame_if_not_reported(CWD, "WEAK_HASH", 3600.0)
+            if i == 0:
+                file_name, line_number = frame_info
+                assert file_name
+                assert line_number > 0
+            else:
+                assert frame_info is None
+
+        assert get_info_frame_if_not_reported(CWD, "WEAK_CIPHER", 3600.0)
+    finally:
+        reset_reported_locations()
+
+
 @flaky(1735812000)
 @pytest.mark.limit_leaks("460 KB", filter_fn=IASTFilter())
 def test_stacktrace_memory_check_no_native():
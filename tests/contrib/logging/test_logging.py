@@ -188,6 +188,50 @@ class LoggingTestCase(TracerTestCase):
             )
         ), output
 
+    def test_log_trace_ids_cached(self):
+        """
+        Check the ids of a span are formatted once for all its records, and follow the active span
+        """
+        records = []
+
+        class RecordFilter(logging.Filter):
+            def filter(self, record):
+                records.append(record)
+                return True
+
+        with self.override_config("logging", dict(tracer=self.tracer)):
+            record_filter = RecordFilter()
+            logger.addFilter(record_filter)
+            try:
+                with self.tracer.trace("parent") as parent:
+                    logger.info("first")
+                    with self.tracer.trace("child") as child:
+                        logger.info("child")
+                    logger.info("second")
+                logger.info("none")
+            finally:
+                logger.removeFilter(record_filter)
+
+            ids = [(getattr(r, RECORD_ATTR_TRACE_ID), getattr(r, RECORD_ATTR_SPAN_ID)) for r in records]
+            assert ids == [
+                (str(parent._trace_id_64bits), str(parent.span_id)),
+                (str(child._trace_id_64bits), str(child.span_id)),
+                (str(parent._trace_id_64bits), str(parent.span_id)),
+                ("0", "0"),
+            ]
+
+            del records[:]
+            logger.addFilter(record_filter)
+            try:
+                with self.tracer.trace("span"):
+                    logger.info("first")
+                    logger.info("second")
+            finally:
+                logger.removeFilter(record_filter)
+            # The same strings are set on the records of the same span
+            assert getattr(records[0], RECORD_ATTR_TRACE_ID) is getattr(records[1], RECORD_ATTR_TRACE_ID)
+            assert getattr(records[0], RECORD_ATTR_SPAN_ID) is getattr(records[1], RECORD_ATTR_SPAN_ID)
+
     def test_log_trace_service(self):
         def create_span():
             return self.tracer.trace("test.logging", service="logging")
@@ -1,5 +1,14 @@
+import struct
+
+import pytest
+
+from ddtrace.internal.datastreams._pathway import compute_pathway_hash
+from ddtrace.internal.datastreams._pathway import decode_pathway_ctx
+from ddtrace.internal.datastreams._pathway import encode_pathway_ctx
+from ddtrace.internal.datastreams._pathway import fnv1_64 as native_fnv1_64
 from ddtrace.internal.datastreams.encoding import decode_var_int_64
 from ddtrace.internal.datastreams.encoding import encode_var_int_64
+from ddtrace.internal.datastreams.fnv import fnv1_64
 from ddtrace.internal.datastreams.processor import DataStreamsProcessor
 
 
@@ -30,3 +39,31 @@ def test_pathway_encoding():
     decoded = processor.decode_pathway(data)
     decoded.set_checkpoint(["direction:in", "type:kafka", "topic:topic1"])
     assert abs(decoded.pathway_start_sec - expected_pathway_start) <= 1e-3
+
+
+@pytest.mark.parametrize("data", [b"", b"a", b"service-a" + b"none" + b"direction:out", "é€".encode("utf-8") * 10])
+def test_native_fnv1_64(data):
+    assert native_fnv1_64(data) == fnv1_64(data)
+
+
+@pytest.mark.parametrize("parent_hash", [0, 1, 2**63, 2**64 - 1])
+def test_native_pathway_hash(parent_hash):
+    tags = ["direction:out", "topic:topicé", "type:kafka"]
+    node_hash = fnv1_64(("service" + "env" + "".join(tags)).encode("utf-8"))
+
+    assert compute_pathway_hash("service", "env", tags, parent_hash) == fnv1_64(
+        struct.pack("<Q", node_hash) + struct.pack("<Q", parent_hash)
+    )
+
+
+@pytest.mark.parametrize("hash_value", [0, 12345, 2**64 - 1])
+@pytest.mark.parametrize("start_ms", [0, 1, -1, 1679672748, 1679672748123, -(2**40), 2**50])
+def test_native_pathway_ctx_encoding(hash_value, start_ms):
+    edge_start_ms = start_ms + 1000
+    data = encode_pathway_ctx(hash_value, start_ms, edge_start_ms)
+
+    assert data == struct.pack("<Q", hash_value) + encode_var_int_64(start_ms) + encode_var_int_64(edge_start_ms)
+    assert decode_pathway_ctx(data) == (hash_value, start_ms, edge_start_ms)
+    for size in range(len(data)):
+        with pytest.raises(EOFError):
+            decode_pathway_ctx(data[:size])
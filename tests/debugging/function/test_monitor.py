@@ -0,0 +1,165 @@
+import sys
+
+import pytest
+
+from ddtrace.debugging._expressions import DDExpression
+from ddtrace.debugging._function.monitor import LineMonitor
+from ddtrace.debugging._function.monitor import _monitor
+
+
+pytestmark = pytest.mark.skipif(_monitor is None, reason="sys.monitoring is not available")
+
+
+class MockProbe:
+    def __init__(self, probe_id, condition=None):
+        self.probe_id = probe_id
+        self.condition = condition
+
+
+def target(a, b):
+    c = a + b  # line 1
+    return c  # line 2
+
+
+def target_line(n):
+    return target.__code__.co_firstlineno + n
+
+
+def condition(dsl, ast):
+    return DDExpression.compile({"dsl": dsl, "json": ast})
+
+
+@pytest.fixture
+def monitor():
+    monitor = LineMonitor.acquire()
+    assert monitor is not None
+    monitor.start()
+    try:
+        yield monitor
+    finally:
+        monitor.stop()
+        monitor.join()
+
+
+def test_line_monitor_hooks(monitor):
+    calls = []
+
+    def hook(probe):
+        calls.append((probe.probe_id, sys._getframe(1).f_locals.copy()))
+
+    probe = MockProbe("probe")
+    assert monitor.inject_hooks(target.__code__, [(hook, target_line(1), probe), (hook, 0, probe)]) == [
+        (hook, 0, probe)
+    ]
+
+    assert target(1, 2) == 3
+    assert calls == [("probe", {"a": 1, "b": 2})]
+
+    assert monitor.eject_hooks(target.__code__, [(hook, target_line(1), probe), (hook, target_line(2), probe)]) == [
+        (hook, target_line(2), probe)
+    ]
+
+    target(1, 2)
+    assert len(calls) == 1
+
+
+@pytest.mark.parametrize(
+    "ast,called",
+    [
+        ({"eq": [{"ref": "a"}, 1]}, [1]),
+        # The comparisons which raise are left to the hook
+        ({"gt": [{"ref": "a"}, 1]}, [2, None]),
+        ({"and": [{"ne": [{"ref": "b"}, "x"]}, {"le": [{"ref": "a"}, 1.5]}]}, [1, None]),
+        ({"or": [{"not": {"ref": "a"}}, {"eq": [{"ref": "b"}, None]}]}, [None, 0]),
+        ({"isDefined": "c"}, []),
+        ({"isDefined": "a"}, [1, 2, None, 0]),
+        # Not simple conditions, which the hook evaluates
+        ({"gt": [{"len": {"ref": "b"}}, 0]}, [1, 2, None, 0]),
+        ({"lt": [{"ref": "a"}, "x"]}, [1, 2, None, 0]),
+    ],
+)
+def test_line_monitor_conditions(monitor, ast, called):
+    values = []
+
+    def hook(probe):
+        values.append(sys._getframe(1).f_locals["a"])
+
+    probe = MockProbe("probe", condition(str(ast), ast))
+    assert not monitor.inject_hooks(target.__code__, [(hook, target_line(1), probe)])
+    try:
+        for a, b in ((1, "a"), (2, "x"), (None, None), (0, "x")):
+            try:
+                target(a, b)
+            except TypeError:
+                pass
+    finally:
+        monitor.eject_hooks(target.__code__, [(hook, target_line(1), probe)])
+
+    assert values == called
+
+
+def test_line_monitor_update(monitor):
+    calls = []
+
+    def hook(probe):
+        calls.append(probe.probe_id)
+
+    probe = MockProbe("probe", condition("a == 0", {"eq": [{"ref": "a"}, 0]}))
+    assert not monitor.inject_hooks(target.__code__, [(hook, target_line(1), probe)])
+    try:
+        target(1, 2)
+        assert calls == []
+
+        probe.condition = condition("a == 1", {"eq": [{"ref": "a"}, 1]})
+        monitor.update_hooks(probe)
+
+        target(1, 2)
+        assert calls == ["probe"]
+    finally:
+        monitor.eject_hooks(target.__code__, [(hook, target_line(1), probe)])
+
+
+def test_line_monitor_hold_off(monitor):
+    calls = []
+    other_calls = []
+
+    def hook(probe):
+        calls.append(probe.probe_id)
+        return 3600.0
+
+    def other_hook(probe):
+        other_calls.append(probe.probe_id)
+
+    probe = MockProbe("probe")
+    other = MockProbe("other")
+    hooks = [(hook, target_line(1), probe), (other_hook, target_line(2), other)]
+    assert not monitor.inject_hooks(target.__code__, hooks)
+    try:
+        for _ in range(10):
+            target(1, 2)
+
+        # The line of the probe holding off is disabled, the others are not
+        assert calls == ["probe"]
+        assert other_calls == ["other"] * 10
+        assert not monitor._lines.rearm()
+
+        # A new version of the probe is ready again
+        monitor.update_hooks(probe)
+        target(1, 2)
+        assert calls == ["probe"] * 2
+    finally:
+        monitor.eject_hooks(target.__code__, hooks)
+
+
+def test_line_monitor_restore_all(monitor):
+    calls = []
+
+    def hook(probe):
+        calls.append(probe.probe_id)
+
+    assert not monitor.inject_hooks(target.__code__, [(hook, target_line(1), MockProbe("probe"))])
+    monitor.restore_all()
+
+    target(1, 2)
+    assert calls == []
+    assert not monitor._lines.lines(target.__code__)
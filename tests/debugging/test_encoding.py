@@ -1,5 +1,6 @@
 # -*- coding: utf-8 -*-
 
+import collections
 import inspect
 import json
 import sys
@@ -12,6 +13,7 @@ from ddtrace.debugging._encoding import LogSignalJsonEncoder
 from ddtrace.debugging._encoding import SignalQueue
 from ddtrace.debugging._probe.model import MAXSIZE
 from ddtrace.debugging._probe.model import CaptureLimits
+from ddtrace.debugging._redaction import redact
 from ddtrace.debugging._signal import utils
 from ddtrace.debugging._signal.snapshot import Snapshot
 from ddtrace.debugging._signal.snapshot import _capture_context
@@ -647,3 +649,71 @@ def test_capture_value_sequence_type(_type):
         ],
         "size": 1,
     }
+
+
+class Fields:
+    def __init__(self, n):
+        self.password = "hunter2"
+        self.nested = {"api_key": n, "values": [n, str(n) * 300, None, (1.5, b"x")]}
+        for i in range(n):
+            setattr(self, "field%d" % i, i)
+
+
+class Slots:
+    __slots__ = ("token", "value")
+
+    def __init__(self):
+        self.token = "secret"
+        self.value = Fields(2)
+
+
+@pytest.mark.skipif(utils.capturer is None, reason="the native capture is not available")
+@pytest.mark.parametrize(
+    "value",
+    [
+        42,
+        None,
+        "x" * 300,
+        b"bytes",
+        complex(1, 2),
+        int,
+        [Fields(1), Fields(30), Slots()],
+        {"Pass_Word": 1, " Secret ": 2, 42: 3, "other": {"nonce": [Fields(0)]}},
+        {i: list(range(i)) for i in range(150)},
+        set(range(10)),
+        frozenset("abc"),
+        tuple(range(200)),
+        *(_type({"cookie": 1, "value": Fields(3)}) for _type in BUILTIN_MAPPNG_TYPES - {collections.defaultdict}),
+        collections.defaultdict(int, {"cookie": 1}),
+        collections.deque(range(5)),
+    ],
+)
+@pytest.mark.parametrize("level", [0, 1, 2, 5])
+@pytest.mark.parametrize("maxlen,maxsize,maxfields", [(255, 100, 20), (4, 3, 2)])
+def test_capture_value_native(value, level, maxlen, maxsize, maxfields):
+    limits = (level, maxlen, maxsize, maxfields)
+
+    assert utils.capturer.capture_value(value, *limits) == utils.capture_value(value, *limits)
+    assert utils.capturer.capture_pairs([("value", value), ("_token", value)], *limits) == utils.capture_pairs(
+        [("value", value), ("_token", value)], *limits
+    )
+
+
+@pytest.mark.skipif(utils.capturer is None, reason="the native capture is not available")
+@pytest.mark.parametrize(
+    "ident", ["password", "PASSWORD", "pass_word", " password\t", "__password__", "passwords", "pass", "", "пароль"]
+)
+def test_capture_redact_native(ident):
+    assert utils.capturer.redact(ident) is redact(ident)
+
+
+@pytest.mark.skipif(utils.capturer is None, reason="the native capture is not available")
+def test_capture_value_native_deadline():
+    def timeout(_):
+        return True
+
+    value = [Fields(1), {"a": 1}, "a"]
+
+    # A deadline in the past is a timeout, like a stopping condition that always holds
+    assert utils.capturer.capture_value(value, deadline=0) == utils.capture_value(value, stopping_cond=timeout)
+    assert utils.capturer.capture_value(value, deadline=-1) == utils.capture_value(value)
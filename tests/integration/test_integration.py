@@ -198,6 +198,7 @@ def test_resource_name_too_large():
         s.finish()
     except ValueError:
         pytest.fail()
+    t._writer._drain_trace_queue()
     encoded_spans = t._writer._encoder.encode()
     assert b"<dropped string of length 410 because it's too long (max allowed length 409)>" in encoded_spans
 
@@ -1,15 +1,21 @@
 from importlib.machinery import ModuleSpec
 from pathlib import Path
+from types import CodeType
 from types import ModuleType
+import dis
+import os
 import typing as t
 
 import pytest
 
+from ddtrace.internal.symbol_db import symbols
 from ddtrace.internal.symbol_db.symbols import Scope
 from ddtrace.internal.symbol_db.symbols import ScopeData
 from ddtrace.internal.symbol_db.symbols import ScopeType
 from ddtrace.internal.symbol_db.symbols import Symbol
+from ddtrace.internal.symbol_db.symbols import SymbolDatabaseUploader
 from ddtrace.internal.symbol_db.symbols import SymbolType
+from ddtrace.internal.utils.inspection import linenos
 
 
 def test_symbol_from_code():
@@ -194,6 +200,77 @@ def test_symbols_to_json():
     }
 
 
+class Fields:
+    __attrs__ = None
+
+    def __init__(self, a, *args, **kwargs):
+        self.a = a
+        self.b, self.c = args[:2]
+        other = Fields
+        other.d = None
+        self.e = [self for _ in range(a)]
+        if not self.a:
+            self.f = kwargs
+
+        def nested():
+            self.g = 42
+
+        nested()
+
+
+def no_lines():
+    pass
+
+
+@pytest.mark.parametrize(
+    "code",
+    [
+        Fields.__init__.__code__,
+        next(_ for _ in Fields.__init__.__code__.co_consts if isinstance(_, CodeType)),
+        no_lines.__code__,
+        test_symbol_from_code.__code__,
+        compile("x = 1\n\n\ny = 2\n", "<test>", "exec"),
+        compile("", "<test>", "exec"),
+    ],
+)
+def test_symbols_scan_code(code):
+    ls = linenos(code)
+    assert symbols.line_range(code) == ((min(ls), max(ls)) if ls else None)
+
+    instructions = list(dis.get_instructions(code))
+    assert symbols.self_fields(code) == {
+        code.co_names[b.arg]
+        for a, b in zip(instructions, instructions[1:])
+        if a.opname == "LOAD_FAST" and a.arg == 0 and b.opname == "STORE_ATTR"
+    }
+
+
+def test_symbols_scan_once(tmp_path, monkeypatch):
+    monkeypatch.setattr(symbols, "is_module_included", lambda _: True)
+    monkeypatch.setattr(SymbolDatabaseUploader, "_upload_context", staticmethod(lambda _: None))
+
+    path = tmp_path / "scanned.py"
+    path.write_text("def foo():\n    return 42\n")
+
+    module = ModuleType("scanned")
+    module.__spec__ = ModuleSpec("scanned", None)
+    module.__spec__.origin = str(path)
+
+    SymbolDatabaseUploader.install()
+    try:
+        uploader = t.cast(SymbolDatabaseUploader, SymbolDatabaseUploader._instance)
+
+        assert uploader._module_scope(module) is not None
+        # The module file did not change since it was scanned
+        assert uploader._module_scope(module) is None
+
+        stat = path.stat()
+        os.utime(path, ns=(stat.st_atime_ns, stat.st_mtime_ns + 1_000_000_000))
+        assert uploader._module_scope(module) is not None
+    finally:
+        SymbolDatabaseUploader.uninstall()
+
+
 @pytest.mark.subprocess(ddtrace_run=True, env=dict(DD_SYMBOL_DATABASE_UPLOAD_ENABLED="1"))
 def test_symbols_upload_enabled():
     from ddtrace.internal.remoteconfig.worker import remoteconfig_poller
@@ -205,6 +282,8 @@ def test_symbols_upload_enabled():
 
 @pytest.mark.subprocess(ddtrace_run=True, env=dict(DD_SYMBOL_DATABASE_INCLUDES="tests.submod.stuff"))
 def test_symbols_force_upload():
+    from time import sleep
+
     from ddtrace.internal.symbol_db.symbols import ScopeType
     from ddtrace.internal.symbol_db.symbols import SymbolDatabaseUploader
 
@@ -227,6 +306,15 @@ def test_symbols_force_upload():
     import tests.submod.stuff  # noqa
     import tests.submod.traced_stuff  # noqa
 
-    scope = get_scope(contexts, "tests.submod.stuff")
+    # The modules are scanned in the background
+    for _ in range(100):
+        try:
+            scope = get_scope(contexts, "tests.submod.stuff")
+            break
+        except ValueError:
+            sleep(0.1)
+    else:
+        scope = get_scope(contexts, "tests.submod.stuff")
+
     assert scope["scope_type"] == ScopeType.MODULE
     assert scope["name"] == "tests.submod.stuff"
@@ -0,0 +1,72 @@
+import contextvars
+import threading
+
+from ddtrace._trace.provider import _DD_CONTEXTVAR
+from ddtrace._trace.provider import DefaultContextProvider
+from ddtrace._trace.span import Span
+from ddtrace.internal import _active
+
+
+def _span(name, parent=None):
+    span = Span(name, parent_id=parent.span_id if parent is not None else None)
+    span._parent = parent
+    span._local_root = parent._local_root if parent is not None else span
+    return span
+
+
+def test_active_contextvar():
+    assert _active.contextvar is _DD_CONTEXTVAR
+
+    span = _span("s")
+    ctx = contextvars.copy_context()
+    ctx.run(_active.set, span)
+    assert ctx[_DD_CONTEXTVAR] is span
+    assert ctx.run(_active.get) is span
+    assert _active.get() is not span
+
+
+def test_active_update_finished():
+    provider = DefaultContextProvider()
+    activated = []
+    provider._on_activate(activated.append)
+
+    def run():
+        root = _span("root")
+        child = _span("child", root)
+        provider.activate(child)
+        assert provider.active() is child
+
+        child.finish()
+        assert provider.active() is root
+        assert _active.get() is root
+
+        root.finish()
+        assert provider.active() is None
+        assert not provider._has_active_context()
+
+        assert activated == [child, root, None]
+
+    contextvars.copy_context().run(run)
+
+
+def test_active_thread_span_ids():
+    root = _span("root")
+    child = _span("child", root)
+    ids = {}
+
+    def run():
+        _active.set(child)
+        ids["set"] = _active.thread_span_ids(threading.get_ident())
+        _active.set(None)
+        ids["unset"] = _active.thread_span_ids(threading.get_ident())
+        _active.set(root)
+
+    thread = threading.Thread(target=run)
+    thread.start()
+    thread.join()
+
+    assert ids == {"set": (child.span_id, root.span_id), "unset": None}
+    assert _active.thread_span_ids(thread.ident) == (root.span_id, root.span_id)
+
+    _active.clear_threads({threading.get_ident()})
+    assert _active.thread_span_ids(thread.ident) is None
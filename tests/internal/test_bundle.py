@@ -0,0 +1,38 @@
+import importlib
+import sys
+
+from ddtrace.internal import _bundle
+
+
+def test_bundle_entry_points_unique():
+    entry_points = [name.rpartition(".")[-1] for name in _bundle.MODULES]
+    assert len(set(entry_points)) == len(entry_points)
+
+
+def test_bundle_finder_spec():
+    finder = _bundle.BundleFinder("/path/to/_native_bundle.so")
+
+    spec = finder.find_spec("ddtrace.internal._rand")
+    assert spec is not None
+    assert spec.name == "ddtrace.internal._rand"
+    assert spec.origin == "/path/to/_native_bundle.so"
+    assert spec.has_location
+    assert spec.loader.name == "ddtrace.internal._rand"
+    assert spec.loader.path == "/path/to/_native_bundle.so"
+
+    assert finder.find_spec("ddtrace.internal._threads") is None
+    assert finder.find_spec("json") is None
+
+
+def test_bundle_modules_importable():
+    # The extensions are found whether or not ddtrace was built with a bundle
+    _bundle.install()
+
+    for name in ("ddtrace.internal._rand", "ddtrace.internal._tagset", "ddtrace.internal._encoding"):
+        module = importlib.import_module(name)
+        assert module.__name__ == name
+
+    finders = [finder for finder in sys.meta_path if isinstance(finder, _bundle.BundleFinder)]
+    assert len(finders) == (1 if _bundle.bundle_path() is not None else 0)
+    for finder in finders:
+        assert sys.modules["ddtrace.internal._rand"].__file__ == finder.path
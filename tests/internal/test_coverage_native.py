@@ -0,0 +1,122 @@
+import sys
+
+import pytest
+
+from ddtrace.internal.coverage._native import LineCollector
+
+
+def test_line_collector_started():
+    collector = LineCollector()
+    key = collector.register("a.py", 10, 20)
+
+    # Hits are ignored until the collector is started
+    collector.hit(key | 10)
+    assert collector.covered() == {}
+
+    collector.start()
+    assert collector.started
+    collector.hit(key | 12)
+    collector.hit(key | 10)
+    collector.hit(key | 12)
+    collector.stop()
+    collector.hit(key | 20)
+
+    assert collector.covered() == {"a.py": [10, 12]}
+
+
+def test_line_collector_merges_code_objects_of_path():
+    collector = LineCollector()
+    module = collector.register("a.py", 1, 30)
+    function = collector.register("a.py", 10, 12)
+    other = collector.register("b.py", 1, 2)
+
+    collector.start()
+    for key in (module | 1, function | 11, module | 30, other | 2, function | 10):
+        collector.hit(key)
+
+    assert collector.covered() == {"a.py": [1, 10, 11, 30], "b.py": [2]}
+
+
+def test_line_collector_outside_registered_lines():
+    collector = LineCollector()
+    key = collector.register("a.py", 100, 101)
+
+    collector.start()
+    for line in (100, 250, 3, 101):
+        collector.hit(key | line)
+
+    assert collector.covered() == {"a.py": [3, 100, 101, 250]}
+
+
+def test_line_collector_context():
+    collector = LineCollector()
+    a = collector.register("a.py", 1, 10)
+    b = collector.register("b.py", 1, 10)
+
+    collector.start()
+    collector.switch_context()
+    assert collector.context_started
+    collector.hit(a | 1)
+    collector.hit(b | 2)
+    assert collector.covered(context=True) == {"a.py": [1], "b.py": [2]}
+
+    # A new context starts empty, the lines covered while started accumulate
+    collector.switch_context()
+    collector.hit(a | 3)
+    assert collector.covered(context=True) == {"a.py": [3]}
+
+    collector.stop_context()
+    collector.hit(b | 4)
+    assert collector.covered(context=True) == {"a.py": [3]}
+    assert collector.covered() == {"a.py": [1, 3], "b.py": [2, 4]}
+
+
+@pytest.mark.skipif(sys.version_info < (3, 12), reason="sys.monitoring is available from Python 3.12")
+def test_line_collector_monitoring():
+    monitoring = sys.monitoring
+    tool_id = monitoring.PROFILER_ID
+    collector = LineCollector()
+
+    def target(n):
+        total = 0
+        for i in range(n):
+            total += i
+        return total
+
+    code = target.__code__
+    first_line = code.co_firstlineno
+    collector.register(code.co_filename, first_line, first_line + 4, code)
+
+    calls = []
+
+    def line(code, line):
+        calls.append(line)
+        return collector.line(code, line)
+
+    monitoring.use_tool_id(tool_id, "test")
+    try:
+        monitoring.register_callback(tool_id, monitoring.events.LINE, line)
+        monitoring.set_local_events(tool_id, code, monitoring.events.LINE)
+
+        collector.start()
+        collector.switch_context()
+        target(100)
+
+        # The callback disables the events after their first hit, so the
+        # lines of the loop are not seen on every iteration
+        assert set(calls) == {first_line + 1, first_line + 2, first_line + 3, first_line + 4}
+        assert len(calls) < 10
+        assert collector.covered(context=True) == {code.co_filename: sorted(set(calls))}
+
+        # The lines are seen again in a new context once the events are restarted
+        del calls[:]
+        collector.switch_context()
+        monitoring.restart_events()
+        target(0)
+        assert set(calls) == {first_line + 1, first_line + 2, first_line + 4}
+        assert collector.covered(context=True) == {code.co_filename: sorted(set(calls))}
+        assert collector.covered() == {code.co_filename: list(range(first_line + 1, first_line + 5))}
+    finally:
+        monitoring.set_local_events(tool_id, code, 0)
+        monitoring.register_callback(tool_id, monitoring.events.LINE, None)
+        monitoring.free_tool_id(tool_id)
@@ -0,0 +1,103 @@
+import socket
+
+import pytest
+
+from ddtrace.internal import dogstatsd
+from ddtrace.internal.dogstatsd import get_dogstatsd_client
+
+
+@pytest.fixture
+def server():
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.bind(("127.0.0.1", 0))
+    sock.settimeout(1)
+    try:
+        yield sock
+    finally:
+        sock.close()
+
+
+@pytest.fixture
+def client(server):
+    client = get_dogstatsd_client("udp://127.0.0.1:%d" % server.getsockname()[1], namespace="ns", tags=["a:b"])
+    client.disable_telemetry()
+    try:
+        yield client
+    finally:
+        client.close_socket()
+
+
+def receive(server):
+    datagrams = []
+    try:
+        while True:
+            datagrams.append(server.recv(65536).decode())
+            server.settimeout(0.1)
+    except socket.timeout:
+        return datagrams
+
+
+def test_aggregate_counters_and_gauges(server, client):
+    for _ in range(5):
+        client.increment("hits", tags=["x:y"])
+    client.increment("hits")
+    client.decrement("hits")
+    client.gauge("gauge", 1)
+    client.gauge("gauge", 3)
+    client.distribution("dist", 2.5)
+    client.distribution("dist", 1)
+
+    assert receive(server) == []
+
+    client.flush()
+    assert receive(server) == [
+        "ns.dist:2.5|d|#a:b\nns.dist:1|d|#a:b\nns.hits:5|c|#x:y,a:b\nns.hits:0|c|#a:b\nns.gauge:3|g|#a:b\n"
+    ]
+
+    # Nothing is left to send
+    client.flush()
+    assert receive(server) == []
+
+
+def test_sampled_counters_not_aggregated(server, client):
+    client.increment("sampled", sample_rate=0.99999999)
+    client.increment("sampled", sample_rate=0.99999999)
+    client.flush()
+
+    assert receive(server) == ["ns.sampled:1|c|@0.99999999|#a:b\nns.sampled:1|c|@0.99999999|#a:b\n"]
+
+
+def test_pack_payloads(server, client):
+    client._max_payload_size = 40
+    for i in range(6):
+        client.gauge("gauge%d" % i, i)
+    client.flush()
+
+    assert receive(server) == [
+        "ns.gauge0:0|g|#a:b\nns.gauge1:1|g|#a:b\n",
+        "ns.gauge2:2|g|#a:b\nns.gauge3:3|g|#a:b\n",
+        "ns.gauge4:4|g|#a:b\nns.gauge5:5|g|#a:b\n",
+    ]
+
+
+def test_flush_on_leaving_batch(server, client):
+    client.increment("before")
+    with client:
+        client.distribution("dist", 1)
+    assert receive(server) == ["ns.dist:1|d|#a:b\nns.before:1|c|#a:b\n"]
+
+
+@pytest.mark.skipif(dogstatsd.send_datagrams is None, reason="Only built on Linux")
+def test_send_datagrams(server):
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.connect(server.getsockname())
+    try:
+        datagrams = [b"datagram%d" % i for i in range(100)]
+        assert dogstatsd.send_datagrams(sock.fileno(), datagrams) == 100
+    finally:
+        sock.close()
+
+    assert receive(server) == [datagram.decode() for datagram in datagrams]
+
+    with pytest.raises(TypeError):
+        dogstatsd.send_datagrams(0, ["not bytes"])
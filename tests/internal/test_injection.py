@@ -1,9 +1,11 @@
 from contextlib import contextmanager
+import dis
 
 import mock
 import pytest
 
 from ddtrace.internal.injection import InvalidLine
+from ddtrace.internal.injection import _injection
 from ddtrace.internal.injection import eject_hook
 from ddtrace.internal.injection import eject_hooks
 from ddtrace.internal.injection import inject_hook
@@ -251,3 +253,48 @@ def test_finally():
     f()
 
     hook.assert_called_once_with(arg)
+
+
+def long_jumps_target():
+    # Enough code for the jumps to need EXTENDED_ARG prefixes
+    exec_globals = {}
+    exec(
+        "def f(n):\n    x = 0\n"
+        + "".join("    if n == %d:\n        x += %d\n    else:\n        x -= 1\n" % (i, i) for i in range(200))
+        + "    return x\n",
+        exec_globals,
+    )
+    return exec_globals["f"]
+
+
+def test_inject_hooks_long_jumps():
+    f = long_jumps_target()
+    expected = [f(n) for n in (0, 100, 199, 500)]
+
+    hook = mock.Mock()
+    hooks = [(hook, line, line) for line in sorted(linenos(f))]
+    assert inject_hooks(f, hooks) == []
+
+    assert [f(n) for n in (0, 100, 199, 500)] == expected
+    # Every line runs, but only one of the branches of each if statement
+    assert hook.call_count == 4 * (2 + 2 * 200)
+
+    assert eject_hooks(f, hooks) == []
+    assert [f(n) for n in (0, 100, 199, 500)] == expected
+    assert hook.call_count == 4 * (2 + 2 * 200)
+
+
+@pytest.mark.skipif(_injection is None, reason="requires the native injection")
+def test_eject_hooks_restores_code():
+    f = long_jumps_target()
+    code = f.__code__
+
+    hooks = [(mock.Mock(), line, object()) for line in sorted(linenos(f))]
+    inject_hooks(f, hooks)
+    assert f.__code__.co_code != code.co_code
+
+    eject_hooks(f, hooks)
+    assert f.__code__.co_code == code.co_code
+    assert f.__code__.co_consts == code.co_consts
+    assert f.__code__.co_stacksize == code.co_stacksize
+    assert list(dis.findlinestarts(f.__code__)) == list(dis.findlinestarts(code))
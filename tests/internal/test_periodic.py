@@ -1,13 +1,20 @@
+import ctypes
+import os
+import sys
 from threading import Event
+from threading import get_ident
+from time import monotonic
 from time import sleep
 
 import pytest
 
+from ddtrace.internal import _threads
 from ddtrace.internal import periodic
 from ddtrace.internal import service
 
 
-def test_periodic():
+@pytest.mark.parametrize("shared", (False, True))
+def test_periodic(shared):
     x = {"OK": False}
 
     thread_started = Event()
@@ -21,7 +28,7 @@ def test_periodic():
     def _on_shutdown():
         x["DOWN"] = True
 
-    t = periodic.PeriodicThread(0.001, _run_periodic, on_shutdown=_on_shutdown)
+    t = periodic.PeriodicThread(0.001, _run_periodic, on_shutdown=_on_shutdown, shared=shared)
     t.start()
     thread_started.wait()
     thread_continue.set()
@@ -31,11 +38,12 @@ def test_periodic():
     assert x["DOWN"]
 
 
-def test_periodic_double_start():
+@pytest.mark.parametrize("shared", (False, True))
+def test_periodic_double_start(shared):
     def _run_periodic():
         pass
 
-    t = periodic.PeriodicThread(0.1, _run_periodic)
+    t = periodic.PeriodicThread(0.1, _run_periodic, shared=shared)
     t.start()
     with pytest.raises(RuntimeError):
         t.start()
@@ -43,7 +51,8 @@ def test_periodic_double_start():
     t.join()
 
 
-def test_periodic_error():
+@pytest.mark.parametrize("shared", (False, True))
+def test_periodic_error(shared):
     x = {"OK": False}
 
     thread_started = Event()
@@ -57,7 +66,7 @@ def test_periodic_error():
     def _on_shutdown():
         x["DOWN"] = True
 
-    t = periodic.PeriodicThread(0.001, _run_periodic, on_shutdown=_on_shutdown)
+    t = periodic.PeriodicThread(0.001, _run_periodic, on_shutdown=_on_shutdown, shared=shared)
     t.start()
     thread_started.wait()
     thread_continue.set()
@@ -66,6 +75,168 @@ def test_periodic_error():
     assert "DOWN" not in x
 
 
+def test_periodic_shared():
+    idents = [set() for _ in range(5)]
+
+    def _target(i):
+        def _run_periodic():
+            idents[i].add(get_ident())
+
+        return _run_periodic
+
+    threads = [periodic.PeriodicThread(0.001, _target(i), shared=True) for i in range(len(idents))]
+    for t in threads:
+        t.start()
+    sleep(0.1)
+    for t in threads:
+        t.stop()
+    for t in threads:
+        t.join()
+
+    # All the targets ran, and all from the thread of the scheduler
+    assert set.union(*idents) == {threads[0].ident}
+    assert isinstance(periodic.periodic_threads[threads[0].ident], periodic.PeriodicScheduler)
+
+
+def test_periodic_shared_stop_from_target():
+    x = {}
+
+    other = periodic.PeriodicThread(60, lambda: None, on_shutdown=lambda: x.setdefault("DOWN", True), shared=True)
+    other.start()
+
+    def _run_periodic():
+        if "JOINED" in x:
+            return
+        other.awake()
+        other.stop()
+        # The thread of the scheduler cannot wait for the other target, nor for the current one
+        other.join()
+        x["JOINED"] = True
+        with pytest.raises(RuntimeError):
+            t.join()
+
+    t = periodic.PeriodicThread(0.001, _run_periodic, shared=True)
+    t.start()
+    other.join()
+    t.stop()
+    t.join()
+    assert x == {"JOINED": True, "DOWN": True}
+
+
+@pytest.mark.parametrize("shared", (False, True))
+def test_periodic_tolerance(shared):
+    runs = [[], []]
+
+    def _target(i):
+        def _run_periodic():
+            runs[i].append(monotonic())
+
+        return _run_periodic
+
+    threads = [periodic.PeriodicThread(0.3, _target(i), shared=shared, tolerance=0.03) for i in range(2)]
+    threads[0].start()
+    sleep(0.02)
+    threads[1].start()
+    sleep(0.5)
+    for t in threads:
+        t.stop()
+    for t in threads:
+        t.join()
+
+    assert runs[0] and runs[1]
+    if shared:
+        # The second thread, due within its tolerance when the first one runs, runs in the same wakeup
+        assert abs(runs[0][0] - runs[1][0]) < 0.01
+
+
+@pytest.mark.skipif(not sys.platform.startswith("linux"), reason="CPU affinity is only set on Linux")
+def test_periodic_thread_placement():
+    main_affinity = os.sched_getaffinity(0)
+    cpu = min(main_affinity)
+    affinities = []
+
+    def _run_periodic():
+        affinities.append(os.sched_getaffinity(0))
+        t.stop()
+
+    _threads.set_thread_placement([cpu])
+    try:
+        t = periodic.PeriodicThread(0.001, _run_periodic)
+        t.start()
+        t.join()
+    finally:
+        _threads.set_thread_placement()
+
+    assert affinities == [{cpu}]
+    # Only the periodic thread is moved
+    assert os.sched_getaffinity(0) == main_affinity
+
+    with pytest.raises(ValueError):
+        _threads.set_thread_placement([-1])
+
+
+@pytest.mark.parametrize("shared", (False, True))
+def test_periodic_native_target(shared):
+    PyCapsule_New = ctypes.pythonapi.PyCapsule_New
+    PyCapsule_New.restype = ctypes.py_object
+    PyCapsule_New.argtypes = (ctypes.c_void_p, ctypes.c_char_p, ctypes.c_void_p)
+    PyCapsule_SetContext = ctypes.pythonapi.PyCapsule_SetContext
+    PyCapsule_SetContext.argtypes = (ctypes.py_object, ctypes.c_void_p)
+
+    contexts = []
+    x = {}
+
+    # Fails on the fifth call, which stops the thread without calling the shutdown callback
+    @ctypes.CFUNCTYPE(ctypes.c_int, ctypes.c_void_p)
+    def _run_periodic(context):
+        contexts.append(context)
+        return len(contexts) == 5
+
+    def _on_shutdown():
+        x["DOWN"] = True
+
+    capsule_name = _threads.NATIVE_TARGET_CAPSULE.encode()
+    target = PyCapsule_New(ctypes.cast(_run_periodic, ctypes.c_void_p), capsule_name, None)
+    PyCapsule_SetContext(target, 42)
+
+    t = periodic.PeriodicThread(0.001, target, on_shutdown=_on_shutdown, shared=shared)
+    t.start()
+    t.join(1)
+    t.stop()
+    t.join()
+    assert contexts == [42] * 5
+    assert "DOWN" not in x
+
+    with pytest.raises(ValueError):
+        periodic.PeriodicThread(0.001, PyCapsule_New(ctypes.cast(_run_periodic, ctypes.c_void_p), b"other", None))
+
+
+def test_periodic_deferred_starts():
+    runs = []
+
+    _threads.begin_deferred_starts()
+    try:
+        threads = [periodic.PeriodicThread(0.001, lambda name=name: runs.append(name)) for name in ("a", "b")]
+        for t in threads:
+            t.start()
+
+        # The threads are not launched until the deferred starts end
+        sleep(0.05)
+        assert runs == []
+        assert all(t.ident is None for t in threads)
+    finally:
+        _threads.end_deferred_starts()
+
+    assert all(t.ident is not None for t in threads)
+
+    sleep(0.05)
+    for t in threads:
+        t.stop()
+        t.join()
+
+    assert set(runs) == {"a", "b"}
+
+
 def test_periodic_service_start_stop():
     t = periodic.PeriodicService(1)
     t.start()
@@ -95,7 +266,10 @@ def test_periodic_join_stop_no_start():
         t.stop()
 
 
-def test_awakeable_periodic_service():
+@pytest.mark.parametrize("shared", (False, True))
+def test_awakeable_periodic_service(shared, monkeypatch):
+    monkeypatch.setattr(periodic, "SHARED_THREADS", shared)
+
     queue = []
 
     class AwakeMe(periodic.AwakeablePeriodicService):
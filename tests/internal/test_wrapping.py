@@ -690,6 +690,33 @@ def test_wrapping_context_recursive():
     assert values == [5, 4, 3, 2, 1, 0, 0, 1, 2, 3, 4, 5]
 
 
+def test_wrapping_context_native_dispatch():
+    pytest.importorskip("ddtrace.internal.wrapping._context")
+
+    callers = []
+
+    class CallerWrappingContext(DummyWrappingContext):
+        def __enter__(self):
+            callers.append(sys._getframe(1).f_code.co_name)
+            return super().__enter__()
+
+        def __return__(self, value):
+            callers.append(sys._getframe(1).f_code.co_name)
+            return super().__return__(value)
+
+    def foo():
+        return 42
+
+    wc = CallerWrappingContext(foo)
+    wc.wrap()
+
+    assert foo() == 42
+
+    # The contexts are called straight from the wrapped function
+    assert callers == ["foo", "foo"]
+    assert wc.frame.f_code.co_name == "foo"
+
+
 def test_wrapping_context_generator():
     def foo():
         yield from range(10)
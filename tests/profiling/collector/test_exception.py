@@ -0,0 +1,67 @@
+import sys
+
+import pytest
+
+from ddtrace.internal.datadog.profiling import ddup
+from ddtrace.profiling import collector
+from ddtrace.profiling import recorder
+from ddtrace.profiling.collector import exception
+
+
+def _raise_and_catch(n):
+    for _ in range(n):
+        try:
+            raise ValueError("control flow")
+        except ValueError:
+            pass
+
+
+def test_unavailable_without_libdd():
+    r = recorder.Recorder()
+    c = exception.ExceptionCollector(r, export_libdd_enabled=False)
+    with pytest.raises(collector.CollectorUnavailable):
+        c.start()
+
+
+@pytest.mark.skipif(sys.version_info >= (3, 12), reason="sys.monitoring is available")
+def test_unavailable_without_sys_monitoring():
+    r = recorder.Recorder()
+    c = exception.ExceptionCollector(r, export_libdd_enabled=True)
+    with pytest.raises(collector.CollectorUnavailable):
+        c.start()
+
+
+@pytest.mark.skipif(sys.version_info < (3, 12), reason="sys.monitoring is not available")
+@pytest.mark.skipif(not ddup.is_available, reason="ddup is not available")
+def test_start_stop():
+    r = recorder.Recorder()
+    c = exception.ExceptionCollector(r, sampling_interval=1, export_libdd_enabled=True)
+    c.start()
+    try:
+        assert sys.monitoring.get_tool(sys.monitoring.PROFILER_ID) == "datadog"
+        # Sampling must not get in the way of the exceptions raised
+        _raise_and_catch(100)
+        with pytest.raises(KeyError):
+            {}["missing"]
+    finally:
+        c.stop()
+    assert sys.monitoring.get_tool(sys.monitoring.PROFILER_ID) is None
+
+
+@pytest.mark.skipif(sys.version_info < (3, 12), reason="sys.monitoring is not available")
+@pytest.mark.skipif(not ddup.is_available, reason="ddup is not available")
+def test_profiler_tool_in_use():
+    sys.monitoring.use_tool_id(sys.monitoring.PROFILER_ID, "other")
+    try:
+        r = recorder.Recorder()
+        c = exception.ExceptionCollector(r, export_libdd_enabled=True)
+        with pytest.raises(collector.CollectorUnavailable):
+            c.start()
+    finally:
+        sys.monitoring.free_tool_id(sys.monitoring.PROFILER_ID)
+
+
+def test_sampler_bad_interval():
+    _exception = pytest.importorskip("ddtrace.profiling.collector._exception")
+    with pytest.raises(ValueError):
+        _exception.RaiseSampler(0, 64)
@@ -1,11 +1,17 @@
 # -*- encoding: utf-8 -*-
 import gc
+import hashlib
+import itertools
+import math
 import os
 import sys
 import threading
+import time
+import zlib
 
 import pytest
 
+from ddtrace.internal.datadog.profiling import ddup
 from ddtrace.profiling.event import DDFrame
 from ddtrace.settings.profiling import ProfilingConfig
 from ddtrace.settings.profiling import _derive_default_heap_sample_size
@@ -29,7 +35,7 @@ def test_start_twice():
 
 
 def test_start_wrong_arg():
-    with pytest.raises(TypeError, match="function takes exactly 3 arguments \\(1 given\\)"):
+    with pytest.raises(TypeError, match="function takes at least 3 arguments \\(1 given\\)"):
         _memalloc.start(2)
 
     with pytest.raises(ValueError, match="the number of frames must be in range \\[1; 65535\\]"):
@@ -47,6 +53,9 @@ def test_start_wrong_arg():
     with pytest.raises(ValueError, match="the heap sample size must be in range \\[0; 4294967295\\]"):
         _memalloc.start(64, 1000, 345678909876)
 
+    with pytest.raises(ValueError, match="the allocation sample size must be in range \\[0; 4294967295\\]"):
+        _memalloc.start(64, 1000, 1, -1)
+
 
 def test_start_stop():
     _memalloc.start(1, 1, 1)
@@ -106,6 +115,43 @@ def test_iter_events_dropped():
     assert alloc_count >= 1000
 
 
+@pytest.mark.skipif(os.getenv("DD_PROFILE_TEST_GEVENT", False), reason="Test not compatible with gevent")
+def test_iter_events_dropped_multi_thread():
+    # Events are recorded per thread, and must still be sampled down to max_events overall
+    max_nframe = 32
+    threads = [threading.Thread(target=_allocate_1k) for _ in range(4)]
+    _memalloc.start(max_nframe, 100, 512 * 1024)
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+    events, count, alloc_count = _memalloc.iter_events()
+    _memalloc.stop()
+
+    assert count == 100
+    assert alloc_count >= 4000
+
+    thread_ids = {thread_id for (_stack, _nframe, thread_id), _size, _domain in events}
+    assert {t.ident for t in threads} <= thread_ids
+
+
+def test_iter_events_sample_size():
+    sample_size = 4096
+    _memalloc.start(32, 10000, 0, sample_size)
+    x = [bytearray(1000) for _ in range(1000)]
+    events, count, alloc_count = _memalloc.iter_events()
+    _memalloc.stop()
+    del x
+
+    # Only the allocations crossing a sampling point were considered, and none was dropped
+    assert 0 < count < 1000
+    assert count == alloc_count
+
+    # Each sampled allocation stands for 1 / (1 - exp(-size / sample_size)) allocations of its size
+    estimated = sum(size / -math.expm1(-size / sample_size) for _tb, size, _domain in events)
+    assert 1000 * 1000 * 0.8 < estimated < 1000 * 1000 * 2
+
+
 def test_iter_events_not_started():
     with pytest.raises(RuntimeError, match="the memalloc module was not started"):
         _memalloc.iter_events()
@@ -328,6 +374,491 @@ def test_heap_stress():
     _memalloc.stop()
 
 
+def _allocate_objects(x, n):
+    for _ in range(n):
+        x.append(object())
+
+
+def test_heap_many_samples():
+    # Enough samples to grow the tracker well past its initial size, freed in an order unrelated to allocation's.
+    _memalloc.start(4, 64, 16)
+    x = []
+    _allocate_objects(x, 40000)
+
+    def count_samples():
+        return sum(
+            1
+            for (stack, _nframe, _thread_id), _size in _memalloc.heap()
+            if any(frame.function_name == "_allocate_objects" for frame in stack)
+        )
+
+    assert count_samples() > 10000
+
+    y = x[::2]
+    del x
+    gc.collect()
+    assert count_samples() > 5000
+
+    del y
+    gc.collect()
+    assert count_samples() == 0
+    _memalloc.stop()
+
+
+def test_heap_many_more_samples():
+    # More live samples than fit in 16 bits
+    _memalloc.start(4, 64, 16)
+    x = []
+    _allocate_objects(x, 150000)
+    samples = sum(
+        1
+        for (stack, _nframe, _thread_id), _size in _memalloc.heap()
+        if any(frame.function_name == "_allocate_objects" for frame in stack)
+    )
+    _memalloc.stop()
+    del x
+
+    assert samples > 65535
+
+
+def test_heap_shared_stacks():
+    # Samples taken at the same place share their stack, down to the exported frames
+    _memalloc.start(4, 64, 16)
+    x = []
+    _allocate_objects(x, 10000)
+    stacks = [
+        stack
+        for (stack, _nframe, _thread_id), _size in _memalloc.heap()
+        if any(frame.function_name == "_allocate_objects" for frame in stack)
+    ]
+    _memalloc.stop()
+    del x
+
+    assert len(stacks) > 1000
+    assert len({id(stack) for stack in stacks}) == 1
+
+
+def _allocate_buffers(n):
+    return [bytearray(4096) for _ in range(n)]
+
+
+def _grow_buffers(buffers):
+    for buf in buffers:
+        buf += b"x"
+
+
+def _grow_buffer(chunk, n):
+    buf = bytearray()
+    for _ in itertools.repeat(None, n):
+        buf += chunk
+    return buf
+
+
+def test_heap_realloc():
+    # Reallocated samples keep their traceback, and follow their block until it is freed
+    _memalloc.start(8, 64, 65536)
+
+    def count_samples(function_name):
+        return sum(
+            1
+            for (stack, _nframe, _thread_id), _size in _memalloc.heap()
+            if any(frame.function_name == function_name for frame in stack)
+        )
+
+    try:
+        buffers = _allocate_buffers(1000)
+        samples = count_samples("_allocate_buffers")
+        assert samples > 0
+
+        _grow_buffers(buffers)
+        assert count_samples("_allocate_buffers") == samples
+
+        del buffers
+        gc.collect()
+        assert count_samples("_allocate_buffers") == 0
+        assert count_samples("_grow_buffers") == 0
+    finally:
+        _memalloc.stop()
+
+
+def test_heap_realloc_grown():
+    # Only the bytes a realloc adds are counted, so a buffer grown one realloc at a time weighs what it ends up as
+    _memalloc.start(8, 64, 1024)
+    try:
+        buf = _grow_buffer(b"x" * 64, 16384)
+        sizes = [
+            size
+            for (stack, _nframe, _thread_id), size in _memalloc.heap()
+            if stack[0].function_name == "_grow_buffer"
+        ]
+    finally:
+        _memalloc.stop()
+
+    assert len(buf) < sum(sizes) < 2 * len(buf)
+
+
+class _Allocated(object):
+    pass
+
+
+class _AllocatedSlots(object):
+    __slots__ = ("value",)
+
+
+@pytest.mark.skipif(not sys.platform.startswith("linux"), reason="Object types are only resolved on Linux")
+def test_heap_types():
+    # The samples are labeled with the type of the objects, with or without a garbage collector header
+    _memalloc.start(8, 64, 16)
+    try:
+        x = [_Allocated() for _ in range(2000)]
+        x += [_AllocatedSlots() for _ in range(2000)]
+        x += [bytes(100) for _ in range(2000)]
+        types = _memalloc._heap_types()
+    finally:
+        _memalloc.stop()
+    del x
+
+    found = {t for t in types if t is not None}
+    assert {_Allocated, _AllocatedSlots, bytes} <= found
+    assert all(isinstance(t, type) for t in found)
+
+
+def test_export_wrong_capi():
+    _memalloc.start(32, 64, 1024)
+    try:
+        with pytest.raises(ValueError):
+            _memalloc.export_heap(object(), lambda thread_id: None)
+        with pytest.raises(ValueError):
+            _memalloc.export_events(object(), lambda thread_id: None)
+    finally:
+        _memalloc.stop()
+
+
+@pytest.mark.skipif(not ddup.is_available, reason="ddup is not available")
+def test_export_thread_info():
+    # Threads are looked up once per export, and the ones thread_info returns None for are left out
+    _memalloc.start(32, 1000, 16)
+    x = _allocate_1k()
+    thread_ids = []
+
+    def thread_info(thread_id):
+        thread_ids.append(thread_id)
+        return None
+
+    try:
+        _memalloc.export_heap(ddup.sample_capi, thread_info)
+        assert threading.main_thread().ident in thread_ids
+        assert len(set(thread_ids)) == len(thread_ids)
+
+        del thread_ids[:]
+        count, alloc_count = _memalloc.export_events(ddup.sample_capi, thread_info)
+        assert 0 < count <= alloc_count
+        assert len(set(thread_ids)) == len(thread_ids)
+
+        with pytest.raises(KeyError):
+            _memalloc.export_heap(ddup.sample_capi, lambda thread_id: {}[thread_id])
+    finally:
+        _memalloc.stop()
+    del x
+
+
+@pytest.mark.skipif(not ddup.is_available, reason="ddup is not available")
+def test_export_heap_while_freeing():
+    # The export reads a snapshot, so the heap can change under it
+    _memalloc.start(8, 64, 16)
+    x = []
+    _allocate_objects(x, 20000)
+
+    def thread_info(thread_id):
+        del x[:]
+        gc.collect()
+        _allocate_objects([], 5000)
+        return None
+
+    try:
+        _memalloc.export_heap(ddup.sample_capi, thread_info)
+        assert not any(
+            frame.function_name == "_allocate_objects"
+            for (stack, _nframe, _thread_id), _size in _memalloc.heap()
+            for frame in stack
+        )
+    finally:
+        _memalloc.stop()
+
+
+@pytest.mark.skipif(not ddup.is_available, reason="ddup is not available")
+def test_export_heap_delta():
+    # Only the samples allocated and freed since the previous delta export are pushed to ddup's live set
+    _memalloc.start(32, 64, 16)
+    x = []
+    _allocate_objects(x, 20000)
+
+    def thread_info(thread_id):
+        return 0, "main"
+
+    try:
+        _memalloc.export_heap(ddup.sample_capi, thread_info, True)
+        live = ddup.get_stats()["heap_live_samples"]
+        assert live > 0
+
+        # Nothing changed, so nothing is added
+        _memalloc.export_heap(ddup.sample_capi, thread_info, True)
+        assert ddup.get_stats()["heap_live_samples"] == live
+
+        del x[:]
+        gc.collect()
+        _memalloc.export_heap(ddup.sample_capi, thread_info, True)
+        assert ddup.get_stats()["heap_live_samples"] < live
+    finally:
+        _memalloc.stop()
+        ddup.heap_live_clear()
+    assert ddup.get_stats()["heap_live_samples"] == 0
+
+
+def _allocate_short_lived(n):
+    for _ in range(n):
+        object()
+
+
+def _lifetimes_of(lifetimes, function_name):
+    freed = [0] * (len(_memalloc.heap_lifetime_bounds) + 1)
+    live = 0
+    for (stack, _nframe, _thread_id), stack_freed, stack_live in lifetimes:
+        if stack[0].function_name == function_name:
+            freed = [a + b for a, b in zip(freed, stack_freed)]
+            live += stack_live
+    return freed, live
+
+
+def test_heap_lifetimes():
+    _memalloc.start(8, 64, 16, 0, True)
+    try:
+        x = []
+        _allocate_short_lived(20000)
+        _allocate_objects(x, 20000)
+        time.sleep(0.02)
+        del x[:10000]
+
+        short_freed, short_live = _lifetimes_of(_memalloc.heap_lifetimes(), "_allocate_short_lived")
+        assert short_freed[0] > 1000
+        assert short_live == 0
+
+        # The histograms start over, while the allocations still alive are counted again
+        lifetimes = _memalloc.heap_lifetimes()
+        assert sum(_lifetimes_of(lifetimes, "_allocate_short_lived")[0]) == 0
+        long_freed, long_live = _lifetimes_of(lifetimes, "_allocate_objects")
+        assert sum(long_freed) == 0
+        assert long_live > 1000
+        del x
+    finally:
+        _memalloc.stop()
+
+
+def test_heap_lifetimes_disabled():
+    _memalloc.start(8, 64, 16)
+    try:
+        _allocate_short_lived(1000)
+        assert _memalloc.heap_lifetimes() == []
+    finally:
+        _memalloc.stop()
+
+
+def test_heap_lifetime_labels():
+    assert memalloc._heap_lifetime_labels(_memalloc.heap_lifetime_bounds) == (
+        "<1ms",
+        "<10ms",
+        "<100ms",
+        "<1s",
+        "<10s",
+        "<1min",
+        ">=1min",
+    )
+
+
+def test_heap_lifetime_collector():
+    r = recorder.Recorder()
+    mc = memalloc.MemoryCollector(r, heap_sample_size=16, heap_lifetime=True, export_libdd_enabled=False)
+    with mc:
+        _allocate_short_lived(10000)
+        keep_me = _allocate_1k()
+        events = mc.snapshot()
+
+    assert len(events) == 2
+    del keep_me
+
+    lifetimes = {event.lifetime for event in events[1]}
+    assert "<1ms" in lifetimes
+    assert "live" in lifetimes
+    for event in events[1]:
+        assert event.count > 0
+        assert 0 < len(event.frames) <= mc.max_nframe
+        assert event.thread_id > 0
+
+
+def _allocate_hashes(x, n):
+    # The hash contexts are allocated by OpenSSL, through the C allocator
+    for _ in range(n):
+        x.append(hashlib.sha256())
+
+
+def test_native_events():
+    if not _memalloc.native_supported:
+        pytest.skip("native allocations can't be tracked on this platform")
+
+    _memalloc.start(16, 1000, 0, 0, False, True)
+    try:
+        x = []
+        _allocate_hashes(x, 10000)
+        events, _count, _alloc_count = _memalloc.iter_events()
+        assert any(
+            domain == "native" and any(frame.function_name == "_allocate_hashes" for frame in stack)
+            for (stack, _nframe, _thread_id), _size, domain in events
+        )
+        assert _memalloc.native_patch() == 0
+    finally:
+        _memalloc.stop()
+    del x
+
+
+def test_native_heap():
+    if not _memalloc.native_supported:
+        pytest.skip("native allocations can't be tracked on this platform")
+
+    def heap_samples():
+        return sum(
+            1
+            for (stack, _nframe, _thread_id), _size in _memalloc.heap()
+            if any(frame.function_name == "_allocate_hashes" for frame in stack)
+        )
+
+    counts = []
+    for native in (False, True):
+        _memalloc.start(16, 64, 512, 0, False, native)
+        try:
+            x = []
+            _allocate_hashes(x, 10000)
+            counts.append(heap_samples())
+            del x
+            assert heap_samples() == 0
+        finally:
+            _memalloc.stop()
+
+    # The hash contexts come on top of the Python objects
+    assert counts[1] > counts[0] * 1.5
+
+
+def test_start_native_unsupported():
+    if _memalloc.native_supported:
+        pytest.skip("native allocations can be tracked on this platform")
+
+    with pytest.raises(ValueError, match="native allocations can't be tracked on this platform"):
+        _memalloc.start(16, 64, 512, 0, False, True)
+
+
+def _allocate_lists(x, count):
+    for _ in range(count):
+        x.append([None] * 100)
+
+
+def _stack_domains(events, function_name):
+    return {
+        domain
+        for (stack, _nframe, _thread_id), _size, domain in events
+        if any(frame.function_name == function_name for frame in stack)
+    }
+
+
+def test_domain_events():
+    # The items of the lists are allocated in the mem domain, and the lists in the object one
+    for domains, expected in (
+        (("object",), {"object"}),
+        (("mem",), {"mem"}),
+        (("object", "mem"), {"object", "mem"}),
+    ):
+        _memalloc.start(16, 1000, 0, 0, False, False, domains)
+        try:
+            x = []
+            _allocate_lists(x, 1000)
+            events, _count, _alloc_count = _memalloc.iter_events()
+            assert _stack_domains(events, "_allocate_lists") == expected
+        finally:
+            _memalloc.stop()
+        del x
+
+
+def test_domain_heap():
+    counts = []
+    for domains in (("object",), ("object", "mem")):
+        _memalloc.start(16, 64, 512, 0, False, False, domains)
+        try:
+            x = []
+            _allocate_lists(x, 1000)
+            counts.append(
+                sum(
+                    1
+                    for (stack, _nframe, _thread_id), _size in _memalloc.heap()
+                    if any(frame.function_name == "_allocate_lists" for frame in stack)
+                )
+            )
+            del x
+        finally:
+            _memalloc.stop()
+
+    # The items of the lists come on top of the lists themselves
+    assert counts[1] > counts[0] * 1.5
+
+
+def _allocate_compressors(x, count):
+    for _ in range(count):
+        x.append(zlib.compressobj())
+
+
+def test_raw_domain_events():
+    if not _memalloc.native_supported:
+        pytest.skip("the raw domain can't be tracked on this platform")
+
+    _memalloc.start(16, 1000, 512, 0, False, False, ("object", "raw"))
+    try:
+        x = []
+        _allocate_compressors(x, 100)
+        events, _count, _alloc_count = _memalloc.iter_events()
+        # zlib allocates its streams from the raw domain
+        assert _stack_domains(events, "_allocate_compressors") == {"object", "raw"}
+        assert _memalloc.heap()
+        del x
+    finally:
+        _memalloc.stop()
+
+
+def test_start_wrong_domains():
+    with pytest.raises(ValueError, match="at least one memory domain must be tracked"):
+        _memalloc.start(16, 64, 512, 0, False, False, ())
+
+    with pytest.raises(ValueError, match="unknown memory domain 'native', expected object, mem or raw"):
+        _memalloc.start(16, 64, 512, 0, False, False, ("object", "native"))
+
+    with pytest.raises(TypeError, match="the domains must be a sequence of names"):
+        _memalloc.start(16, 64, 512, 0, False, False, 1)
+
+    if not _memalloc.native_supported:
+        with pytest.raises(ValueError, match="the raw domain can't be tracked on this platform"):
+            _memalloc.start(16, 64, 512, 0, False, False, ("raw",))
+
+
+@pytest.mark.parametrize(
+    "domains,expected",
+    (
+        ("", ["object"]),
+        ("mem", ["mem"]),
+        ("Object, mem,raw", ["object", "mem", "raw"]),
+        ("mem,native,mem", ["mem"]),
+    ),
+)
+def test_memory_domains_config(domains, expected, monkeypatch):
+    monkeypatch.setenv("DD_PROFILING_MEMORY_DOMAINS", domains)
+    assert ProfilingConfig().memory.domains == expected
+
+
 @pytest.mark.parametrize("heap_sample_size", (0, 512 * 1024, 1024 * 1024, 2048 * 1024, 4096 * 1024))
 def test_memalloc_speed(benchmark, heap_sample_size):
     if heap_sample_size:
@@ -355,3 +886,43 @@ def test_memalloc_sample_size(enabled, predicates, monkeypatch):
         assert predicate(_derive_default_heap_sample_size(config.heap, default)), _derive_default_heap_sample_size(
             config.heap
         )
+
+
+def test_random_exponential_unbiased():
+    mean = 512 * 1024
+    samples = _memalloc._random_samples(True, mean, 200000)
+    average = sum(samples) / len(samples)
+    # The standard error of the average is mean / sqrt(200000), below 0.25%
+    assert average == pytest.approx(mean, rel=0.01)
+    stddev = math.sqrt(sum((s - average) ** 2 for s in samples) / len(samples))
+    assert stddev == pytest.approx(mean, rel=0.02)
+    # An exponential distribution has a fraction 1 - 1/e of its values below its mean
+    below = sum(1 for s in samples if s < mean) / len(samples)
+    assert below == pytest.approx(1 - math.exp(-1), abs=0.01)
+
+
+@pytest.mark.parametrize("upper", (3, 10, 1 << 40))
+def test_random_range_uniform(upper):
+    buckets = min(upper, 10)
+    samples = _memalloc._random_samples(False, upper, 100000)
+    assert all(0 <= s < upper for s in samples)
+    counts = [0] * buckets
+    for s in samples:
+        counts[s * buckets // upper] += 1
+    for count in counts:
+        assert count / len(samples) == pytest.approx(1 / buckets, abs=0.01)
+
+
+def test_random_samples_per_thread():
+    # Each thread has a generator of its own, so they don't all draw the same numbers
+    results = []
+
+    def draw():
+        results.append(_memalloc._random_samples(False, 1 << 32, 8))
+
+    threads = [threading.Thread(target=draw) for _ in range(4)]
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+    assert len(set(tuple(r) for r in results)) == len(results)
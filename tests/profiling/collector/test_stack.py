@@ -5,18 +5,22 @@ import sys
 import threading
 import time
 import timeit
+import traceback
 from types import FrameType
 import typing  # noqa:F401
 import uuid
 
+import mock
 import pytest
 from six.moves import _thread
 
 import ddtrace  # noqa:F401
+from ddtrace.internal.datadog.profiling import ddup
 from ddtrace.profiling import _threading
 from ddtrace.profiling import recorder
 from ddtrace.profiling.collector import stack
 from ddtrace.profiling.collector import stack_event
+from ddtrace.profiling.event import DDFrame
 from tests.utils import flaky
 
 from . import test_collector
@@ -785,3 +789,54 @@ def test_collect_ensure_all_frames_gc():
 
     gc.collect()  # Make sure we don't race with gc when we check frame objects
     assert sum(isinstance(_, FrameType) for _ in gc.get_objects()) == 0
+
+
+@pytest.mark.skipif(not ddup.is_available, reason="ddup is not available")
+def test_push_pyframes():
+    # The libdd exporter walks the frames natively, up to max_nframes of them, but reports the depth of the stack
+    def _foo():
+        return sys._getframe()
+
+    frame = _foo()
+    depth = len(traceback.extract_stack(frame))
+
+    handle = ddup.SampleHandle()
+    assert handle.push_pyframes(frame, 128) == depth
+    assert handle.push_pyframes(frame, 1) == depth
+    assert handle.push_pyframes(object(), 128) < 0
+
+
+@pytest.mark.skipif(not ddup.is_available, reason="ddup is not available")
+def test_push_frames():
+    # The frames can be DDFrame tuples, or have bytes or unexpected objects where strings are expected
+    handle = ddup.SampleHandle()
+    handle.push_frames(
+        [
+            DDFrame(__file__, 1, "test_push_frames", ""),
+            (b"file.py", 2, b"function", ""),
+            (None, 3, 42, ""),
+            ("\udcff", 4, "surrogate", ""),
+        ]
+    )
+
+
+def test_span_capture_processor(tracer):
+    # Only spans which took at least the threshold are captured, with the labels of their local root
+    processor = stack._SpanCaptureProcessor(threshold_ns=int(1e6), endpoint_collection_enabled=True)
+    with mock.patch.object(stack.stack_v2, "capture_span") as capture_span:
+        with tracer.trace("root", resource="GET /slow", span_type="web") as root:
+            with tracer.trace("child") as child:
+                pass
+        child.duration_ns = 10
+        processor.on_span_finish(child)
+        capture_span.assert_not_called()
+
+        child.duration_ns = int(2e6)
+        processor.on_span_finish(child)
+        capture_span.assert_called_once_with(
+            child.span_id, root.span_id, "web", "GET /slow", threading.current_thread().name
+        )
+
+        processor.endpoint_collection_enabled = False
+        processor.on_span_finish(child)
+        assert capture_span.call_args[0][3] is None
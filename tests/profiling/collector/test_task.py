@@ -23,6 +23,43 @@ def test_list_tasks_nogevent():
     assert _task.list_tasks(compat.main_thread.ident) == []
 
 
+@pytest.mark.subprocess
+def test_list_tasks_scheduled_only():
+    import asyncio
+    import threading
+
+    from ddtrace.profiling import _asyncio  # noqa:F401
+    from ddtrace.profiling.collector import _task
+
+    async def wait(future):
+        await future
+
+    async def main():
+        loop = asyncio.get_running_loop()
+        woken = loop.create_future()
+        waiting = asyncio.ensure_future(wait(loop.create_future()))
+        ready = asyncio.ensure_future(wait(woken))
+        await asyncio.sleep(0)
+        # The ready task has a wake up scheduled on the loop, the waiting one has nothing to do
+        woken.set_result(None)
+
+        thread_id = threading.get_ident()
+        all_ids = {task[0] for task in _task.list_tasks(thread_id)}
+        scheduled_ids = {task[0] for task in _task.list_tasks(thread_id, scheduled_only=True)}
+
+        current = id(asyncio.current_task())
+        assert {current, id(waiting), id(ready)} <= all_ids
+        assert scheduled_ids == {current, id(ready)}
+        assert all(frame is not None for _, _, frame in _task.list_tasks(thread_id, scheduled_only=True))
+
+        waiting.cancel()
+        await ready
+
+    loop = asyncio.new_event_loop()
+    asyncio.set_event_loop(loop)
+    loop.run_until_complete(main())
+
+
 @pytest.mark.skipif(not TESTING_GEVENT, reason="only works with gevent")
 @pytest.mark.subprocess(ddtrace_run=True)
 def test_list_tasks_gevent():
@@ -20,3 +20,31 @@ def test_check_traceback_to_frames():
         (this_file, 7, "_x", ""),
         (this_file, 15, "test_check_traceback_to_frames", ""),
     ]
+
+
+class _Base(object):
+    def method(self):
+        return _traceback._extract_class_name(sys._getframe())
+
+    @classmethod
+    def class_method(cls):
+        return _traceback._extract_class_name(sys._getframe())
+
+
+class _Derived(_Base):
+    pass
+
+
+def _function(self):
+    return _traceback._extract_class_name(sys._getframe())
+
+
+def test_extract_class_name():
+    # What the code objects tell is cached, but the class name still comes from the first argument of every call
+    for _ in range(2):
+        assert _Base().method() == "_Base"
+        assert _Derived().method() == "_Derived"
+        assert _Base.class_method() == "_Base"
+        assert _Derived.class_method() == "_Derived"
+        assert _function(_Base()) == "_Base"
+        assert _traceback._extract_class_name(sys._getframe()) == ""
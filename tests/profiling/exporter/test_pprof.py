@@ -790,6 +790,32 @@ def test_pprof_exporter_libs(gan):
     assert not expected_libs
 
 
+@mock.patch("ddtrace.internal.utils.config.get_application_name")
+def test_pprof_exporter_serialize(gan):
+    # The profile is encoded natively, check that protobuf reads back what was exported
+    gan.return_value = "bonjour"
+    exp = pprof.PprofExporter()
+    exports, _ = exp.export(TEST_EVENTS, 1, 7)
+
+    p = pprof.pprof_pb2.Profile()
+    p.ParseFromString(exports.SerializeToString())
+
+    assert list(p.string_table) == exports.string_table
+    assert [(_.type, _.unit) for _ in p.sample_type] == [tuple(_) for _ in exports.sample_type]
+    assert [(tuple(_.location_id), list(_.value), [(label.key, label.str) for label in _.label]) for _ in p.sample] == [
+        (tuple(_.location_id), list(_.value), [tuple(label) for label in _.label]) for _ in exports.sample
+    ]
+    assert [(_.id, [(line.function_id, line.line) for line in _.line]) for _ in p.location] == [
+        (_.id, [tuple(line) for line in _.line]) for _ in exports.location
+    ]
+    assert [(_.id, _.name, _.filename) for _ in p.function] == [tuple(_) for _ in exports.function]
+    assert p.string_table[p.mapping[0].filename] == "bonjour"
+    assert (p.period_type.type, p.period_type.unit) == tuple(exports.period_type)
+    assert p.period == 1000000
+    assert p.time_nanos == 1
+    assert p.duration_nanos == 6
+
+
 def test_pprof_exporter_empty():
     exp = pprof.PprofExporter()
     export, libs = exp.export({}, 0, 1)
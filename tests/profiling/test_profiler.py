@@ -434,3 +434,31 @@ def test_profiler_ddtrace_deprecation():
         from ddtrace.profiling.collector import memalloc  # noqa:F401
         from ddtrace.profiling.collector import stack  # noqa:F401
         from ddtrace.profiling.collector import stack_event  # noqa:F401
+
+
+@pytest.mark.parametrize(
+    "cpus,expected",
+    (
+        ("", []),
+        ("3", [3]),
+        ("0-2,5", [0, 1, 2, 5]),
+        ("4, 1-2 ,x,1", [1, 2, 4]),
+    ),
+)
+def test_thread_cpus(cpus, expected, monkeypatch):
+    from ddtrace.settings.profiling import ProfilingConfig
+
+    monkeypatch.setenv("DD_PROFILING_THREAD_CPUS", cpus)
+    assert ProfilingConfig().thread_cpus == expected
+
+
+def test_cgroup_aware_max_time_usage_pct(monkeypatch):
+    from ddtrace.settings.profiling import ProfilingConfig
+
+    monkeypatch.setenv("DD_PROFILING_MAX_TIME_USAGE_PCT", "2")
+    with mock.patch("ddtrace.internal.runtime.container.get_cpu_quota", return_value=0.5):
+        assert ProfilingConfig().effective_max_time_usage_pct == 2.0
+        monkeypatch.setenv("DD_PROFILING_CGROUP_AWARE", "true")
+        assert ProfilingConfig().effective_max_time_usage_pct == 1.0
+    with mock.patch("ddtrace.internal.runtime.container.get_cpu_quota", return_value=4.0):
+        assert ProfilingConfig().effective_max_time_usage_pct == 2.0
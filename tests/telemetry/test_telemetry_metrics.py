@@ -107,6 +107,29 @@ def test_send_metric_datapoint_equal_type_and_tags_yields_single_series(
     _assert_metric(test_agent_session, expected_series)
 
 
+def test_send_count_metric_counter_aggregates_with_add_count_metric(telemetry_writer, test_agent_session, mock_time):
+    """Check the counters of count metrics add up with the values added by name, and are reset on flush"""
+    counter = telemetry_writer.count_metric(TELEMETRY_NAMESPACE_TAG_TRACER, "test-metric", (("a", "b"),))
+    assert counter is telemetry_writer.count_metric(TELEMETRY_NAMESPACE_TAG_TRACER, "test-metric", (("a", "b"),))
+
+    counter.add()
+    counter.add(2)
+    telemetry_writer.add_count_metric(TELEMETRY_NAMESPACE_TAG_TRACER, "test-metric", 3, (("a", "b"),))
+
+    expected_series = [
+        {
+            "common": True,
+            "metric": "test-metric",
+            "points": [[1642544540, 6.0]],
+            "tags": ["a:b"],
+            "type": "count",
+        },
+    ]
+
+    _assert_metric(test_agent_session, expected_series)
+    assert counter.take() is None
+
+
 def test_send_metric_datapoint_equal_type_different_tags_yields_multiple_series(
     telemetry_writer, test_agent_session, mock_time
 ):
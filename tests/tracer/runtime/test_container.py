@@ -3,6 +3,7 @@ import pytest
 
 from ddtrace.internal.runtime.container import CGroupInfo
 from ddtrace.internal.runtime.container import get_container_info
+from ddtrace.internal.runtime.container import get_cpu_quota
 
 from .utils import cgroup_line_valid_test_cases
 
@@ -346,3 +347,24 @@ def test_get_container_info_exception(mock_log, mock_from_line):
 
         # Ensure we logged the exception
         mock_log.debug.assert_called_once_with("Failed to parse cgroup file for pid %r", "self", exc_info=True)
+
+
+@pytest.mark.parametrize(
+    "files,quota",
+    [
+        ({}, None),
+        ({"cpu.max": "max 100000\n"}, None),
+        ({"cpu.max": "200000 100000\n"}, 2.0),
+        ({"cpu.max": "50000 100000\n"}, 0.5),
+        ({"cpu/cpu.cfs_quota_us": "-1\n", "cpu/cpu.cfs_period_us": "100000\n"}, None),
+        ({"cpu,cpuacct/cpu.cfs_quota_us": "150000\n", "cpu,cpuacct/cpu.cfs_period_us": "100000\n"}, 1.5),
+        ({"cpu.max": "garbage"}, None),
+    ],
+)
+def test_get_cpu_quota(tmp_path, files, quota):
+    for name, contents in files.items():
+        path = tmp_path / name
+        path.parent.mkdir(parents=True, exist_ok=True)
+        path.write_text(contents)
+
+    assert get_cpu_quota(str(tmp_path)) == quota
@@ -1,10 +1,23 @@
+import sys
+
+import pytest
+
 from ddtrace.internal.runtime.constants import CPU_PERCENT
+from ddtrace.internal.runtime.constants import CPU_TIME_USER
 from ddtrace.internal.runtime.constants import GC_COUNT_GEN0
+from ddtrace.internal.runtime.constants import GC_PAUSE_COUNT_GEN2
+from ddtrace.internal.runtime.constants import GC_PAUSE_MAX_GEN2
+from ddtrace.internal.runtime.constants import GC_PAUSE_P99_GEN2
+from ddtrace.internal.runtime.constants import GC_PAUSE_RUNTIME_METRICS
+from ddtrace.internal.runtime.constants import GC_PAUSE_TIME_GEN2
 from ddtrace.internal.runtime.constants import GC_RUNTIME_METRICS
+from ddtrace.internal.runtime.constants import MEM_PYMALLOC_ALLOCATED
+from ddtrace.internal.runtime.constants import MEM_PYMALLOC_ARENAS
 from ddtrace.internal.runtime.constants import MEM_RSS
 from ddtrace.internal.runtime.constants import PSUTIL_RUNTIME_METRICS
 from ddtrace.internal.runtime.constants import THREAD_COUNT
 from ddtrace.internal.runtime.metric_collectors import GCRuntimeMetricCollector
+from ddtrace.internal.runtime.metric_collectors import NativeGCRuntimeMetricCollector
 from ddtrace.internal.runtime.metric_collectors import PSUtilRuntimeMetricCollector
 from ddtrace.internal.runtime.metric_collectors import RuntimeMetricCollector
 from tests.utils import BaseTestCase
@@ -125,6 +138,32 @@ class TestPSUtilRuntimeMetricCollector(BaseTestCase):
         del wasted_memory
         """
 
+    @pytest.mark.skipif(not sys.platform.startswith("linux"), reason="Linux only")
+    def test_native_metrics(self):
+        """The metrics read from /proc match the ones read through psutil"""
+        from ddtrace.vendor import psutil
+
+        collector = PSUtilRuntimeMetricCollector()
+        assert collector._proc_runtime_metrics is not None
+
+        user, system, rss, num_threads, voluntary, involuntary = collector._proc_runtime_metrics()
+        proc = psutil.Process()
+        with proc.oneshot():
+            cpu_times = proc.cpu_times()
+            ctx_switches = proc.num_ctx_switches()
+            assert num_threads == proc.num_threads()
+            assert abs(rss - proc.memory_info().rss) <= 0.25 * rss
+        assert user <= cpu_times.user
+        assert system <= cpu_times.system
+        assert voluntary <= ctx_switches.voluntary
+        assert involuntary <= ctx_switches.involuntary
+
+        # The first reading has no CPU percent and the deltas are the totals
+        metrics = dict(collector.collect_fn(None))
+        assert metrics[CPU_PERCENT] == 0.0
+        assert metrics[CPU_TIME_USER] >= user
+        assert metrics[THREAD_COUNT] == num_threads
+
 
 class TestGCRuntimeMetricCollector(BaseTestCase):
     def test_metrics(self):
@@ -155,3 +194,31 @@ class TestGCRuntimeMetricCollector(BaseTestCase):
         assert len(collected_after) == 1
         assert collected_after[0][0] == "runtime.python.gc.count.gen0"
         assert isinstance(collected_after[0][1], int)
+
+
+@pytest.mark.skipif(sys.platform == "win32", reason="The native collector isn't built on Windows")
+class TestNativeGCRuntimeMetricCollector(BaseTestCase):
+    def test_pauses(self):
+        import gc
+
+        collector = NativeGCRuntimeMetricCollector()
+        try:
+            assert collector.enabled
+            # Only the pauses since the previous collection are counted
+            collector.collect_fn(None)
+            gc.collect()
+            gc.collect()
+
+            metrics = dict(collector.collect_fn(None))
+            assert GC_PAUSE_RUNTIME_METRICS <= set(metrics)
+            assert metrics[GC_PAUSE_COUNT_GEN2] >= 2
+            assert 0 < metrics[GC_PAUSE_MAX_GEN2] <= metrics[GC_PAUSE_TIME_GEN2]
+            assert 0 < metrics[GC_PAUSE_P99_GEN2] <= metrics[GC_PAUSE_MAX_GEN2]
+            assert metrics[MEM_PYMALLOC_ARENAS] > 0
+            assert metrics[MEM_PYMALLOC_ALLOCATED] > 0
+        finally:
+            collector.stop()
+
+        gc.collect()
+        metrics = dict(collector.collect_fn(None))
+        assert metrics[GC_PAUSE_COUNT_GEN2] == 0
@@ -24,8 +24,12 @@ from ddtrace.ext import SpanTypes
 from ddtrace.ext.ci import CI_APP_TEST_ORIGIN
 from ddtrace.internal._encoding import BufferFull
 from ddtrace.internal._encoding import BufferItemTooLarge
+from ddtrace.internal._encoding import EncodedPayload
 from ddtrace.internal._encoding import ListStringTable
 from ddtrace.internal._encoding import MsgpackStringTable
+from ddtrace.internal._encoding import SpanStore
+from ddtrace.internal._encoding import TagMap
+from ddtrace.internal._encoding import TraceQueue
 from ddtrace.internal.encoding import MSGPACK_ENCODERS
 from ddtrace.internal.encoding import JSONEncoder
 from ddtrace.internal.encoding import JSONEncoderV2
@@ -33,6 +37,7 @@ from ddtrace.internal.encoding import MsgpackEncoderV03
 from ddtrace.internal.encoding import MsgpackEncoderV05
 from ddtrace.internal.encoding import _EncoderBase
 from tests.utils import DummyTracer
+from tests.utils import override_global_config
 
 
 _ORIGIN_KEY = ORIGIN_KEY.encode()
@@ -287,6 +292,24 @@ def test_encode_meta_struct(version):
     assert msgpack.unpackb(items[0][0][b"meta_struct"][b"payload"]) == payload
 
 
+@pytest.mark.parametrize("version", ["v0.3", "v0.4"])
+@pytest.mark.parametrize("size", [0, 200, 300, 70000])
+def test_encode_meta_struct_sizes(version, size):
+    # The values are packed with the headers of the bin objects of each size
+    encoder = MSGPACK_ENCODERS[version](2 << 20, 2 << 20)
+    span = Span(name="client.testing", trace_id=1)
+    payload = {"data": "x" * size, "items": list(range(size // 100))}
+    span.set_struct_tag("payload", payload)
+    span.set_struct_tag("other", {"a": 1})
+    encoder.put([span])
+
+    items = decode(encoder.encode())
+    meta_struct = items[0][0][b"meta_struct"]
+    assert msgpack.unpackb(meta_struct[b"payload"]) == payload
+    assert msgpack.unpackb(meta_struct[b"other"]) == {"a": 1}
+    assert meta_struct[b"payload"] == msgpack.packb(payload)
+
+
 def decode(obj, reconstruct=True):
     unpacked = msgpack.unpackb(obj, raw=True, strict_map_key=False)
 
@@ -412,6 +435,56 @@ def test_msgpack_span_property_variations(encoding, span):
     assert decode(refencoder.encode_traces([trace])) == decode(encoder.encode())
 
 
+@allencodings
+@pytest.mark.parametrize(
+    "name",
+    [
+        "ascii-" * 10,
+        "caf\xe9 r\xe9sum\xe9 " * 10,
+        "\xe9",
+        "\u4e2d\u6587 span " * 10,
+        "\u07ff\u0800\uffff",
+        "\U0001f600 emoji " * 10,
+    ],
+)
+def test_msgpack_encode_unicode(encoding, name):
+    refencoder = REF_MSGPACK_ENCODERS[encoding]()
+    encoder = MSGPACK_ENCODERS[encoding](1 << 20, 1 << 20)
+
+    span = Span(name, service=name[::-1], resource=name.upper())
+    span.set_tag(name, name * 2)
+    trace = [span]
+    encoder.put(trace)
+    assert decode(refencoder.encode_traces([trace])) == decode(encoder.encode())
+
+
+class RenamedSpan(Span):
+    __slots__ = ()
+
+    @property
+    def name(self):
+        return "renamed"
+
+    @name.setter
+    def name(self, value):
+        pass
+
+
+@allencodings
+def test_msgpack_span_subclass(encoding):
+    refencoder = REF_MSGPACK_ENCODERS[encoding]()
+    encoder = MSGPACK_ENCODERS[encoding](1 << 10, 1 << 10)
+
+    # Subclasses of Span are encoded through their attributes, not through the slots of Span
+    span = RenamedSpan("span_name", service="my-svc", resource="/my-resource")
+    trace = [Span("span_name"), span]
+    for s in trace:
+        s.finish()
+    encoder.put(trace)
+    assert decode(refencoder.encode_traces([trace])) == decode(encoder.encode())
+    assert span.name == "renamed"
+
+
 class SubString(str):
     pass
 
@@ -657,7 +730,13 @@ def test_custom_msgpack_encode_trace_size(encoding, trace_id, name, service, res
     trace = [span, span, span]
 
     encoder.put(trace)
-    assert encoder.size == len(encoder.encode())
+    size = encoder.size
+    assert size == len(encoder.encode())
+
+    # The size checked before packing a trace is a lower bound, which doesn't reject a trace that fits exactly
+    exact_encoder = MSGPACK_ENCODERS[encoding](size, size)
+    exact_encoder.put(trace)
+    assert exact_encoder.size == size
 
 
 def test_encoder_buffer_size_limit_v03():
@@ -799,6 +878,22 @@ def test_list_string_table():
     assert list(t) == ["", "foobar", "foobaz"]
 
 
+def test_list_string_table_growth():
+    t = ListStringTable()
+
+    strings = ["string-%d" % i for i in range(1000)]
+    ids = [t.index(s) for s in strings]
+    assert ids == list(range(1, 1001))
+    assert len(t) == 1001
+
+    # Equal strings which are different objects map to the same index
+    assert [t.index("".join(["string-", str(i)])) for i in range(1000)] == ids
+    assert len(t) == 1001
+    assert all(s in t for s in strings)
+    assert "string-1000" not in t
+    assert list(t) == [""] + strings
+
+
 @contextlib.contextmanager
 def _value():
     yield "value"
@@ -867,6 +962,225 @@ def test_custom_msgpack_encode_thread_safe(encoding):
 
     unpacked = decode(encoder.encode(), reconstruct=True)
     assert unpacked is not None
+    assert sorted(len(t) for t in unpacked) == sorted(len(t._trace) for t in ts for _ in range(t._trace_count))
+
+
+@allencodings
+def test_msgpack_encode_payload(encoding):
+    refencoder = REF_MSGPACK_ENCODERS[encoding]()
+    encoder = MSGPACK_ENCODERS[encoding](1 << 20, 1 << 20)
+
+    trace = [Span("span-%d" % i, service="svc", resource="res") for i in range(10)]
+    encoder.put(trace)
+    size = encoder.size
+
+    payload = encoder.encode_payload()
+    assert isinstance(payload, EncodedPayload)
+    assert len(payload) == size
+    assert sum(len(chunk) for chunk in payload.chunks()) == size
+    # The string table and the traces of a v0.5 payload are separate chunks
+    assert len(payload.chunks()) == (2 if encoding == "v0.5" else 1)
+
+    expected = decode(refencoder.encode_traces([trace]))
+    assert decode(b"".join(payload.chunks())) == expected
+    assert decode(bytes(payload)) == expected
+    assert decode(payload) == expected
+
+    assert encoder.encode_payload() is None
+
+
+@allencodings
+def test_custom_msgpack_encode_while_putting(encoding):
+    THREADS = 8
+    TRACES = 200
+    encoder = MSGPACK_ENCODERS[encoding](2 << 20, 2 << 20)
+    trace = [Span(name="span-{}".format(i), service="threads", resource="TEST") for i in range(5)]
+
+    def put_traces():
+        for _ in range(TRACES):
+            encoder.put(trace)
+
+    ts = [threading.Thread(target=put_traces) for _ in range(THREADS)]
+    for t in ts:
+        t.start()
+
+    # Every payload is encoded from the traces retired by encode(), none is lost or encoded twice
+    traces = []
+    finished = False
+    while not finished:
+        finished = not any(t.is_alive() for t in ts)
+        payload = encoder.encode()
+        if payload is not None:
+            decoded = decode(payload, reconstruct=True)
+            assert all(len(t) == len(trace) for t in decoded)
+            traces.extend(decoded)
+
+    assert len(traces) == THREADS * TRACES
+    assert encoder.encode() is None
+
+
+@pytest.mark.parametrize("n", [0, 3, 16, 17, 40])
+def test_tag_map(n):
+    expected = {"key%d" % i: "value%d" % i for i in range(n)}
+    tags = TagMap()
+    for key, value in expected.items():
+        tags[key] = value
+
+    assert len(tags) == n
+    assert tags == expected and tags == TagMap(expected)
+    assert tags.copy() == expected and type(tags.copy()) is dict
+    assert list(tags) == list(expected) and tags.items() == list(expected.items())
+    assert "key0" in tags if n else "key0" not in tags
+    assert tags.get("missing") is None and tags.get("missing", 1) == 1
+    with pytest.raises(KeyError):
+        tags["missing"]
+
+    tags["first"] = "a"
+    tags["first"] = "b"
+    assert tags["first"] == "b"
+    assert tags.setdefault("first", "c") == "b"
+    assert tags.pop("first") == "b"
+    assert tags.pop("first", None) is None
+    expected.pop("key1", None)
+    if "key1" in tags:
+        del tags["key1"]
+    assert tags == expected
+    assert list(tags.keys()) == list(expected.keys())
+
+    tags.update({"other": "x"}, more="y")
+    assert tags["other"] == "x" and tags["more"] == "y"
+    tags.clear()
+    assert len(tags) == 0 and not tags
+
+
+@allencodings
+def test_tag_map_encoding(encoding):
+    trace = gen_trace(nspans=10, ntags=20, nmetrics=3)
+    with override_global_config(dict(_trace_native_tag_maps=True)):
+        native_trace = [Span(span.name, service=span.service, resource=span.resource) for span in trace]
+    for span, native_span in zip(trace, native_trace):
+        assert type(native_span._meta) is TagMap and type(native_span._metrics) is TagMap
+        for attr in ("trace_id", "span_id", "parent_id", "start_ns", "duration_ns", "span_type"):
+            setattr(native_span, attr, getattr(span, attr))
+        native_span.set_tags(span.get_tags())
+        native_span.set_metrics(span.get_metrics())
+
+    # Both the tags stored inline and the ones which don't fit are packed
+    native_trace[0]._meta = TagMap(list(trace[0].get_tags().items())[:5])
+    trace[0]._meta = dict(native_trace[0]._meta)
+
+    encoder = MSGPACK_ENCODERS[encoding](1 << 20, 1 << 20)
+    encoder.put(trace)
+    native_encoder = MSGPACK_ENCODERS[encoding](1 << 20, 1 << 20)
+    native_encoder.put(native_trace)
+
+    assert decode(native_encoder.encode()) == decode(encoder.encode())
+
+
+def test_span_store():
+    store = SpanStore(1 << 64 | 42)
+    assert store.trace_id == 42
+    root = store.add_span("root", service="svc", span_type="web", span_id=1, start_ns=10)
+    child = store.add_span("child", span_id=2, parent_id=1, start_ns=20)
+    assert len(store) == 2
+    assert store[-1].span_id == 2
+
+    assert (root.name, root.service, root.resource, root.span_type) == ("root", "svc", "root", "web")
+    assert root.parent_id is None
+    assert (child.service, child.span_type, child.parent_id) == (None, None, 1)
+
+    child.set_tag("key", "value")
+    child.set_tag("key", "other")
+    child.set_metric("metric", 1.5)
+    assert child.get_tag("key") == "other"
+    assert child.get_metric("metric") == 1.5
+    assert child.get_tag("metric") is None
+    assert child.get_metric("unknown") is None
+    assert root.get_tag("key") is None
+
+    child.finish(25)
+    child.error = 1
+    assert (child.duration_ns, child.error) == (5, 1)
+
+
+@allencodings
+def test_span_store_encoding(encoding):
+    trace = gen_trace(nspans=20, ntags=5, nmetrics=0)
+    for span in trace:
+        for i in range(3):
+            span.set_metric("metric%d" % i, i + 0.5)
+    trace[1].error = 1
+
+    store = SpanStore(trace[0].trace_id)
+    for span in trace:
+        stored = store.add_span(
+            span.name,
+            service=span.service,
+            resource=span.resource,
+            span_type=span.span_type,
+            span_id=span.span_id,
+            parent_id=span.parent_id,
+            start_ns=span.start_ns,
+        )
+        stored.duration_ns = span.duration_ns
+        stored.error = span.error
+        for key, value in span.get_tags().items():
+            stored.set_tag(key, value)
+        for key, value in span.get_metrics().items():
+            stored.set_metric(key, value)
+
+    encoder = MSGPACK_ENCODERS[encoding](1 << 20, 1 << 20)
+    encoder.put(trace)
+    store_encoder = MSGPACK_ENCODERS[encoding](1 << 20, 1 << 20)
+    store_encoder.put_store(store)
+
+    assert len(store_encoder) == 1
+    assert decode(store_encoder.encode()) == decode(encoder.encode())
+
+
+def test_trace_queue():
+    queue = TraceQueue(3)
+    assert queue.capacity == 4
+    assert queue.drain() == []
+
+    traces = [[Span("span-%d" % i)] for i in range(6)]
+    assert all(queue.put(trace) for trace in traces[:4])
+    assert not queue.put(traces[4])
+    assert len(queue) == 4
+
+    drained = queue.drain()
+    assert len(queue) == 0
+    assert all(a is b for a, b in zip(drained, traces[:4]))
+
+    # The slots are reused once drained
+    assert queue.put(traces[4]) and queue.put(traces[5])
+    assert queue.drain() == traces[4:]
+
+
+def test_trace_queue_while_putting():
+    THREADS = 8
+    TRACES = 200
+    queue = TraceQueue(64)
+
+    def put_traces(n):
+        for i in range(TRACES):
+            while not queue.put([n, i]):
+                pass
+
+    ts = [threading.Thread(target=put_traces, args=(n,)) for n in range(THREADS)]
+    for t in ts:
+        t.start()
+
+    # Every trace is drained once, in the order each thread put them
+    traces = []
+    finished = False
+    while not finished:
+        finished = not any(t.is_alive() for t in ts)
+        traces.extend(queue.drain())
+
+    assert len(traces) == THREADS * TRACES
+    for n in range(THREADS):
+        assert [i for t, i in traces if t == n] == list(range(TRACES))
 
 
 @pytest.mark.subprocess(parametrize={"encoder_cls": ["JSONEncoder", "JSONEncoderV2"]})
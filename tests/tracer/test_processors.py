@@ -621,6 +621,25 @@ def test_endpoint_call_counter_processor():
     assert processor.reset() == {}
 
 
+def test_endpoint_call_counter_processor_native():
+    """The requests are given to the native counter when there is one"""
+    spanA = Span("spanA", resource="a", span_type=SpanTypes.WEB)
+    spanA._local_root = spanA
+    spanNonWeb = Span("spanNonWeb", resource="c", span_type=SpanTypes.WORKER)
+
+    counted = []
+    processor = EndpointCallCounterProcessor()
+    processor.enable()
+    processor.count_natively(counted.append)
+
+    processor.on_span_finish(spanA)
+    processor.on_span_finish(spanA)
+    processor.on_span_finish(spanNonWeb)
+
+    assert counted == ["a", "a"]
+    assert processor.reset() == {}
+
+
 def test_endpoint_call_counter_processor_disabled():
     """ProfilingSpanProcessor is disabled by default"""
     spanA = Span("spanA", resource="a", span_type=SpanTypes.WEB)
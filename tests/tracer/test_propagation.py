@@ -10,6 +10,11 @@ from ddtrace import tracer as ddtracer
 from ddtrace._trace._span_link import SpanLink
 from ddtrace._trace.context import Context
 from ddtrace._trace.span import _get_64_lowest_order_bits_as_int
+from ddtrace.internal._propagation import collect_headers
+from ddtrace.internal._propagation import format_b3_single
+from ddtrace.internal._propagation import format_hex_id
+from ddtrace.internal._propagation import format_traceparent
+from ddtrace.internal._propagation import parse_traceparent
 from ddtrace.internal.constants import _PROPAGATION_STYLE_NONE
 from ddtrace.internal.constants import _PROPAGATION_STYLE_W3C_TRACECONTEXT
 from ddtrace.internal.constants import LAST_DD_PARENT_ID_KEY
@@ -17,6 +22,7 @@ from ddtrace.internal.constants import PROPAGATION_STYLE_B3_MULTI
 from ddtrace.internal.constants import PROPAGATION_STYLE_B3_SINGLE
 from ddtrace.internal.constants import PROPAGATION_STYLE_DATADOG
 from ddtrace.propagation._utils import get_wsgi_header
+from ddtrace.propagation.http import _EXTRACTED_HEADER_NAMES
 from ddtrace.propagation.http import _HTTP_BAGGAGE_PREFIX
 from ddtrace.propagation.http import _HTTP_HEADER_B3_FLAGS
 from ddtrace.propagation.http import _HTTP_HEADER_B3_SAMPLED
@@ -666,6 +672,66 @@ def test_extract_bad_values(trace_id, parent_span_id, sampling_priority, dd_orig
     assert context._meta == {}
 
 
+def test_collect_headers():
+    headers = {
+        "X-Datadog-Trace-Id": b"1234",
+        "HTTP_X_DATADOG_TRACE_ID": "5678",
+        "HTTP_X_DATADOG_PARENT_ID": "5678",
+        "TraceParent": "00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01",
+        "OT-Baggage-Key": "value",
+        "Accept": "*/*",
+        1: "ignored",
+    }
+
+    # The canonical header takes precedence over its WSGI variant, whatever the order of the headers
+    for items in (headers.items(), reversed(list(headers.items()))):
+        assert collect_headers(dict(items), _EXTRACTED_HEADER_NAMES, _HTTP_BAGGAGE_PREFIX) == {
+            HTTP_HEADER_TRACE_ID: "1234",
+            HTTP_HEADER_PARENT_ID: "5678",
+            _HTTP_HEADER_TRACEPARENT: "00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01",
+            "ot-baggage-key": "value",
+        }
+
+
+@pytest.mark.parametrize(
+    "traceparent,expected",
+    [
+        (
+            "00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01",
+            ("00", 0x4BF92F3577B34DA6A3CE929D0E0E4736, 0xF067AA0BA902B7, 1, False),
+        ),
+        (
+            " \t01-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-02-future \n",
+            ("01", 0x4BF92F3577B34DA6A3CE929D0E0E4736, 0xF067AA0BA902B7, 2, True),
+        ),
+        ("00-4BF92F3577B34DA6A3CE929D0E0E4736-00f067aa0ba902b7-01", None),
+        ("00-4bf92f3577b34da6a3ce929d0e0e473-00f067aa0ba902b7-01", None),
+        ("00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01-", None),
+        ("00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01x", None),
+        ("01-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01-a\nb", None),
+        ("00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b\u00e9-01", None),
+        ("", None),
+    ],
+)
+def test_parse_traceparent(traceparent, expected):
+    assert parse_traceparent(traceparent) == expected
+
+
+@pytest.mark.parametrize("dd_id", [0, 1, 2**63, 2**64 - 1, 2**64, 2**128 - 1, 2**128, -1])
+def test_format_ids(dd_id):
+    assert format_hex_id(dd_id) == ("{:032x}" if dd_id > 2**64 - 1 else "{:016x}").format(dd_id)
+    for sampling_priority, state in ((None, ""), (-1, "-0"), (0, "-0"), (1, "-1"), (2, "-d")):
+        assert format_b3_single(dd_id, 1, sampling_priority) == "{}-0000000000000001{}".format(
+            format_hex_id(dd_id), state
+        )
+
+    if dd_id >= 0:
+        assert format_traceparent(None, dd_id, 0xF067AA0BA902B7, True) == "00-{:032x}-00f067aa0ba902b7-01".format(dd_id)
+        assert format_traceparent("4bf92f3577b34da6a3ce929d0e0e4736", 1, dd_id, False) == (
+            "00-4bf92f3577b34da6a3ce929d0e0e4736-{:016x}-00".format(dd_id)
+        )
+
+
 def test_get_wsgi_header(tracer):  # noqa: F811
     assert get_wsgi_header("x-datadog-trace-id") == "HTTP_X_DATADOG_TRACE_ID"
 
@@ -282,3 +282,42 @@ def test_span_api_fork():
             q.put(child_ids)
         finally:
             os._exit(0)
+
+
+class _SubSpan(Span):
+    __slots__ = ["extra"]
+
+
+def test_span_start_finish():
+    for cls in (Span, _SubSpan):
+        s = cls(None)
+        before = time.time_ns()
+        _rand.span_start(s, None, None, 42, None, True)
+        after = time.time_ns()
+
+        assert before <= s.start_ns <= after
+        assert s.duration_ns is None
+        assert s.parent_id == 42
+        assert 0 < s.span_id <= 2**64 - 1
+        # The upper 32 bits of a 128-bit trace id are the start time in seconds
+        assert s.trace_id >> 96 == s.start_ns // 1000000000
+        assert (s.trace_id >> 64) & (2**32 - 1) == 0
+
+        _rand.span_start(s, 1, 2, None, 10, False)
+        assert (s.trace_id, s.span_id, s.parent_id, s.start_ns) == (1, 2, None, 10_000_000_000)
+
+        assert _rand.span_finish(s, 15_000_000_000) is True
+        assert s.duration_ns == 5_000_000_000
+        # A finished span keeps its duration
+        assert _rand.span_finish(s, None) is False
+        assert s.duration_ns == 5_000_000_000
+
+
+def test_span_finish_callbacks_once():
+    finished = []
+    s = Span("s", on_finish=[finished.append])
+    s.finish()
+    s.finish()
+    s._finish_ns(s.start_ns + 1)
+    assert finished == [s]
+    assert s.duration_ns >= 0
@@ -1,5 +1,7 @@
 from __future__ import division
 
+import threading
+
 import mock
 import pytest
 
@@ -196,6 +198,37 @@ def test_rate_limiter_3():
             assert decision is False
 
 
+def test_rate_limiter_fractional_rate_limit():
+    limiter = RateLimiter(rate_limit=2.5)
+    now_ns = compat.monotonic_ns()
+
+    # The bucket holds 2.5 tokens: 2 are taken at once, and the half left is a token again a fifth of a second later
+    assert [limiter.is_allowed(now_ns) for _ in range(3)] == [True, True, False]
+    assert limiter.is_allowed(now_ns + 1e8) is False
+    assert limiter.is_allowed(now_ns + 2e8) is True
+
+
+def test_rate_limiter_threads():
+    limiter = RateLimiter(rate_limit=1000)
+    now_ns = compat.monotonic_ns()
+    allowed = []
+
+    def take_tokens():
+        allowed.append(sum(limiter.is_allowed(now_ns) for _ in range(1000)))
+
+    threads = [threading.Thread(target=take_tokens) for _ in range(8)]
+    for thread in threads:
+        thread.start()
+    for thread in threads:
+        thread.join()
+
+    # Without a lock, the threads still share exactly the tokens of the bucket
+    assert sum(allowed) == 1000
+    assert limiter.tokens_allowed == 1000
+    assert limiter.tokens_total == 8000
+    assert limiter.effective_rate == 0.125
+
+
 @pytest.mark.parametrize("rate_limit", list(range(10)))
 def test_rate_limiter_with_jitter_expected_calls(rate_limit):
     limiter = BudgetRateLimiterWithJitter(limit_rate=rate_limit)
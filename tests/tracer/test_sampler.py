@@ -16,6 +16,7 @@ from ddtrace.constants import SAMPLING_PRIORITY_KEY
 from ddtrace.constants import SAMPLING_RULE_DECISION
 from ddtrace.constants import USER_KEEP
 from ddtrace.constants import USER_REJECT
+from ddtrace.internal._rule_matcher import RuleMatcher
 from ddtrace.internal.rate_limiter import RateLimiter
 from ddtrace.internal.sampling import SAMPLING_DECISION_TRACE_TAG_KEY
 from ddtrace.internal.sampling import SamplingMechanism
@@ -609,6 +610,48 @@ def test_sampling_rule_matches(span, rule, span_expected_to_match_rule):
     )
 
 
+def test_rule_matcher():
+    # The compiled rules find the same first matching rule as SamplingRule.matches
+    rules = [
+        SamplingRule(sample_rate=0.1, service="db-*", tags={"env": "prod"}),
+        SamplingRule(sample_rate=0.2, name="*.Request", resource="GET /?"),
+        SamplingRule(sample_rate=0.3, service="web", name=re.compile(r"^http\.")),
+        SamplingRule(sample_rate=0.4, tags={"count": "3"}),
+        SamplingRule(sample_rate=0.5, service="w*b*", resource="*user*"),
+        SamplingRule(sample_rate=0.6, service=None),
+        SamplingRule(sample_rate=1.0),
+    ]
+    matcher = RuleMatcher(rules)
+
+    def _span(service, name="test.span", resource=None):
+        span = create_span(service=service, name=name)
+        span.resource = resource or name
+        return span
+
+    spans = [
+        _span("db-main", "query"),
+        _span("DB-main", "query"),
+        _span("web", "flask.request", "GET /a"),
+        _span("web", "flask.request", "GET /ab"),
+        _span("web", "http.client"),
+        _span("wab", resource="list users"),
+        _span(None, "anything"),
+        _span("other"),
+    ]
+    spans[0].set_tag("env", "prod")
+    spans[1].set_tag("env", "staging")
+    spans[7].set_metric("count", 3.0)
+
+    for span in spans * 2:
+        assert matcher.match(span) is next((rule for rule in rules if rule.matches(span)), None), span
+
+    assert matcher.compiled_for(rules)
+    assert not matcher.compiled_for(list(rules))
+    rules.insert(0, SamplingRule(sample_rate=0))
+    assert not matcher.compiled_for(rules)
+    assert RuleMatcher([]).match(spans[0]) is None
+
+
 def test_sampling_rule_matches_exception():
     def pattern(prop):
         raise Exception("an error occurred")
@@ -0,0 +1,112 @@
+import random
+
+from ddsketch import LogCollapsingLowestDenseDDSketch
+from ddsketch.pb.proto import DDSketchProto
+import msgpack
+import pytest
+
+from ddtrace._trace.span import Span
+from ddtrace.ext import http
+from ddtrace.internal.processor._stats import DDSketch
+from ddtrace.internal.processor._stats import SpanStatsConcentrator
+
+
+BUCKET_SIZE_NS = 10 * 1000 * 1000 * 1000
+
+
+def _values(seed, count, low, high):
+    rng = random.Random(seed)
+    return [rng.randint(low, high) for _ in range(count)]
+
+
+@pytest.mark.parametrize(
+    "values",
+    [
+        [],
+        [0],
+        [999999999],
+        [1, 10, 100, 1000],
+        [-5, -1000, 0, 3, 10**9],
+        # Ranges of keys which don't fit in the bins, which get collapsed
+        [1, 10**18],
+        _values(0, 1000, 1, 10**6),
+        _values(1, 1000, 1, 10**15),
+        _values(2, 1000, -(10**15), 10**15),
+    ],
+)
+def test_ddsketch_proto(values):
+    """The native sketch serializes to the same protobuf message as the one of the ddsketch package"""
+    sketch = DDSketch()
+    expected = LogCollapsingLowestDenseDDSketch(0.00775, bin_limit=2048)
+    for value in values:
+        sketch.add(value)
+        expected.add(value)
+
+    assert sketch.count == len(values)
+    assert sketch.to_proto() == DDSketchProto.to_proto(expected).SerializeToString()
+    for quantile in (0, 0.25, 0.5, 0.75, 0.99, 1):
+        if values:
+            assert sketch.get_quantile_value(quantile) == pytest.approx(expected.get_quantile_value(quantile))
+        else:
+            assert sketch.get_quantile_value(quantile) is None
+
+
+def _span(name, duration_ns, service="svc", resource="/", span_type="web", error=0, end_ns=BUCKET_SIZE_NS + 1):
+    span = Span(name, service=service, resource=resource, span_type=span_type)
+    span.start_ns = end_ns - duration_ns
+    span.duration_ns = duration_ns
+    span.error = error
+    return span
+
+
+def test_concentrator_flush():
+    concentrator = SpanStatsConcentrator(BUCKET_SIZE_NS)
+    assert concentrator.flush("host", None, None) is None
+
+    concentrator.add_span(_span("op", 10), True)
+    concentrator.add_span(_span("op", 20, error=1), False)
+    status = _span("op", 30, service=None, span_type=None)
+    status.set_tag(http.STATUS_CODE, "200")
+    concentrator.add_span(status, True)
+    concentrator.add_span(_span("op", 40, end_ns=2 * BUCKET_SIZE_NS), True)
+    assert len(concentrator) == 2
+
+    payload = msgpack.unpackb(concentrator.flush("host", "prod", None), raw=False)
+    assert len(concentrator) == 0
+    assert concentrator.flush("host", None, None) is None
+
+    assert payload["Hostname"] == "host"
+    assert payload["Env"] == "prod"
+    assert "Version" not in payload
+
+    buckets = sorted(payload["Stats"], key=lambda bucket: bucket["Start"])
+    assert [(bucket["Start"], bucket["Duration"]) for bucket in buckets] == [
+        (BUCKET_SIZE_NS, BUCKET_SIZE_NS),
+        (2 * BUCKET_SIZE_NS, BUCKET_SIZE_NS),
+    ]
+
+    stats = sorted(buckets[0]["Stats"], key=lambda stat: stat["HTTPStatusCode"])
+    assert len(stats) == 2
+    ok_summary = DDSketch()
+    ok_summary.add(10)
+    err_summary = DDSketch()
+    err_summary.add(20)
+    assert stats[0] == {
+        "Name": "op",
+        "Resource": "/",
+        "Service": "svc",
+        "Type": "web",
+        "Synthetics": False,
+        "HTTPStatusCode": 0,
+        "Hits": 2,
+        "TopLevelHits": 1,
+        "Duration": 30,
+        "Errors": 1,
+        "OkSummary": ok_summary.to_proto(),
+        "ErrorSummary": err_summary.to_proto(),
+    }
+    # The service and the type are left out when the span doesn't have any
+    assert "Service" not in stats[1]
+    assert "Type" not in stats[1]
+    assert stats[1]["HTTPStatusCode"] == 200
+    assert stats[1]["Hits"] == stats[1]["TopLevelHits"] == 1
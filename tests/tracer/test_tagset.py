@@ -77,6 +77,9 @@ def test_decode_tagset_string(header, expected):
         # Non-space whitespace characters are not allowed in key or value
         "key=value\r\n",
         "key\t=value\r\n",
+        # Unicode
+        ensure_text("key=☺️"),
+        ensure_text("☺️=value"),
     ],
 )
 def test_decode_tagset_string_malformed(header):
@@ -166,6 +169,20 @@ def test_encode_tagset_values_max_size():
     assert ex.current_results == "a=1,b=2"
 
 
+def test_encode_tagset_values_large_max_size():
+    """Test that encoding beyond the default max size works when allowed"""
+    values = OrderedDict(("key{}".format(i), "value {}".format(i)) for i in range(100))
+    expected = ",".join("key{}=value {}".format(i, i) for i in range(100))
+    assert len(expected) > 512
+
+    header = encode_tagset_values(values, max_size=len(expected))
+    assert expected == header
+    assert values == decode_tagset_string(header, max_size=len(expected))
+
+    with pytest.raises(TagsetMaxSizeEncodeError):
+        encode_tagset_values(values, max_size=len(expected) - 1)
+
+
 def test_encode_tagset_values_invalid_type():
     """
     encode_tagset_values accepts `values` as an `object` instead of `dict`
@@ -180,3 +197,35 @@ def test_encode_tagset_values_invalid_type():
     for values in (None, True, 10, object(), []):
         with pytest.raises(AttributeError):
             encode_tagset_values(values)
+
+
+def test_decode_tagset_string_cached():
+    """Test that decoding the same tagset again returns a copy of the same dict"""
+    header = "_dd.p.dm=-1,_dd.p.upstream_services=Z3JwYy1jbGllbnQ=|1|0|1.0000"
+    first = decode_tagset_string(header)
+    first["_dd.p.dm"] = "-4"
+
+    # The cached dict is not the one returned, so it isn't changed with it
+    second = decode_tagset_string("".join(header))
+    assert second == {"_dd.p.dm": "-1", "_dd.p.upstream_services": "Z3JwYy1jbGllbnQ=|1|0|1.0000"}
+    assert second is not first
+
+    # Cached tagsets are still limited to the max size
+    with pytest.raises(TagsetDecodeError):
+        decode_tagset_string(header, max_size=10)
+
+
+def test_encode_tagset_values_cached():
+    """Test that encoding the same items again, in the same order, returns the same result"""
+    values = {"a": "1", "b": "2"}
+    assert encode_tagset_values(values) == "a=1,b=2"
+
+    # The cached items are not the ones of the dict
+    values["a"] = "3"
+    assert encode_tagset_values(values) == "a=3,b=2"
+    assert encode_tagset_values({"b": "2", "a": "3"}) == "b=2,a=3"
+    assert encode_tagset_values({"a": "1", "b": "2"}) == "a=1,b=2"
+
+    # Cached items are still limited to the max size
+    with pytest.raises(TagsetMaxSizeEncodeError):
+        encode_tagset_values({"a": "1", "b": "2"}, max_size=4)
@@ -254,6 +254,30 @@ class TestHeaders(object):
         )
         assert span.get_tag("http.response.headers.content-type") == "some;value"
 
+    def test_integration_header_tags_take_precedence(self, span, config, integration_config):
+        """
+        :type span: Span
+        :type integration_config: IntegrationConfig
+        """
+        config.http.trace_headers(["Content-Type", "X-Global"])
+        config.http._header_tags["x-tagged"] = "global.tag"
+        integration_config.http._header_tags["x-tagged"] = "integration.tag"
+        trace_utils._store_request_headers(
+            {
+                " X-Tagged ": "tagged",
+                "Content-Type": b"some;value\xff",
+                "X-Global": "global",
+                "Other": "other",
+            },
+            span,
+            integration_config,
+        )
+        assert span.get_tag("integration.tag") == "tagged"
+        assert span.get_tag("global.tag") is None
+        assert span.get_tag("http.request.headers.content-type") == "some;value\ufffd"
+        assert span.get_tag("http.request.headers.x-global") == "global"
+        assert span.get_tag("http.request.headers.other") is None
+
 
 @pytest.mark.parametrize(
     "pin,config_val,default,global_service,expected",
@@ -778,8 +778,8 @@ def test_tracer_fork():
                 assert t.writer._encoder is not original_writer._encoder
 
         # Assert the trace got written into the correct queue
-        assert len(original_writer._encoder) == 0
-        assert len(t.writer._encoder) == 1
+        assert len(original_writer._trace_queue) == 0
+        assert len(t.writer._trace_queue) == 1
 
     # Assert tracer in a new process correctly recreates the writer
     errors = multiprocessing.Queue()
@@ -798,8 +798,8 @@ def test_tracer_fork():
         assert t._writer._encoder == original_writer._encoder
 
     # Assert the trace got written into the correct queue
-    assert len(original_writer._encoder) == 1
-    assert len(t._writer._encoder) == 1
+    assert len(original_writer._trace_queue) == 1
+    assert len(t._writer._trace_queue) == 1
 
 
 def test_tracer_with_version():
@@ -1,4 +1,5 @@
 import contextlib
+import gzip
 import os
 import socket
 import sys
@@ -16,6 +17,7 @@ import ddtrace
 from ddtrace import config
 from ddtrace._trace.span import Span
 from ddtrace.constants import KEEP_SPANS_RATE_KEY
+from ddtrace.internal._encoding import TraceQueue
 from ddtrace.internal.ci_visibility.writer import CIVisibilityWriter
 from ddtrace.internal.compat import get_connection_response
 from ddtrace.internal.compat import httplib
@@ -276,6 +278,7 @@ class AgentWriterTests(BaseTestCase):
         writer_encoder = mock.Mock()
         writer_encoder.__len__ = (lambda *args: n_traces).__get__(writer_encoder)
         writer_encoder.encode.side_effect = Exception
+        writer_encoder.encode_payload.side_effect = Exception
         with override_global_config(dict(health_metrics_enabled=True)):
             writer = self.WRITER_CLASS("http://asdf:1234", dogstatsd=statsd, sync_mode=False)
             for client in writer._clients:
@@ -626,6 +629,55 @@ def test_flush_connection_uds(endpoint_uds_server, writer_class):
     writer.flush_queue(raise_exc=True)
 
 
+class _RecordingRequestHandlerTest(_BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+    bodies = []
+
+    def do_PUT(self):
+        if self.headers.get("Transfer-Encoding") == "chunked":
+            body = b""
+            while True:
+                size = int(self.rfile.readline().strip(), 16)
+                if size == 0:
+                    self.rfile.readline()
+                    break
+                body += self.rfile.read(size)
+                self.rfile.readline()
+        else:
+            body = self.rfile.read(int(self.headers.get("Content-Length", 0)))
+        self.bodies.append(body)
+        self.send_response(200)
+        self.send_header("Content-Length", "0")
+        self.end_headers()
+
+
+@pytest.mark.parametrize("chunked", (True, False))
+def test_uds_connection_gathered_body(chunked):
+    socket_name = tempfile.mktemp()
+    server, thread = _make_uds_server(socket_name, _RecordingRequestHandlerTest)
+    try:
+        data = os.urandom(1 << 20)
+        chunks = tuple(memoryview(data)[i : i + 4096] for i in range(0, len(data), 4096)) + (b"",)
+        headers = {} if chunked else {"Content-Length": str(len(data))}
+
+        conn = UDSHTTPConnection(server.server_address, _HOST, 2019)
+        try:
+            # The connection is reused for the next requests
+            for body in (chunks, data, None):
+                del _RecordingRequestHandlerTest.bodies[:]
+                conn.request("PUT", "/", body, headers if body is chunks else {})
+                resp = get_connection_response(conn)
+                resp.read()
+                assert resp.status == 200
+                assert _RecordingRequestHandlerTest.bodies == [data if body is not None else b""]
+        finally:
+            conn.close()
+    finally:
+        server.shutdown()
+        thread.join()
+        os.unlink(socket_name)
+
+
 @pytest.mark.parametrize("writer_class", (AgentWriter, CIVisibilityWriter))
 def test_flush_queue_raise(writer_class):
     with override_env(dict(DD_API_KEY="foobar.baz")):
@@ -655,9 +707,26 @@ def test_racing_start(writer_class):
     for t in ts:
         t.join()
 
+    writer._drain_trace_queue()
     assert len(writer._encoder) == 100
 
 
+def test_write_queue_full():
+    writer = AgentWriter("http://dne:1234", sync_mode=True)
+    writer._trace_queue = TraceQueue(4)
+    writer.flush_queue = mock.Mock()
+
+    for i in range(4):
+        writer.write([Span(str(i))])
+    assert len(writer._trace_queue) == 4
+    assert len(writer._encoder) == 0
+
+    # The queued traces are encoded by the thread writing the trace which doesn't fit in the queue
+    writer.write([Span("4")])
+    assert len(writer._trace_queue) == 0
+    assert len(writer._encoder) == 5
+
+
 @pytest.mark.subprocess(
     env={"_DD_TRACE_WRITER_ADDITIONAL_HEADERS": "additional-header:additional-value,header2:value2"}
 )
@@ -823,6 +892,89 @@ def test_writer_reuse_connections_false(writer_class):
         assert writer._conn is conn
 
 
+@pytest.mark.parametrize("chunked_transfer", (False, True))
+def test_writer_chunked_transfer(chunked_transfer):
+    conn = mock.Mock()
+    response = mock.Mock(status=200, reason="OK")
+    response.read.return_value = b""
+    trace = [Span(name="a" * 1000, span_id=i + 1) for i in range(100)]
+
+    with override_global_config({"_trace_writer_chunked_transfer": chunked_transfer}), mock.patch(
+        "ddtrace.internal.writer.writer.get_connection", return_value=conn
+    ), mock.patch("ddtrace.internal.compat.get_connection_response", return_value=response):
+        writer = AgentWriter("http://localhost:9126", api_version="v0.4")
+        writer.run_periodic = mock.Mock()
+        writer.write(trace)
+        writer.flush_queue(raise_exc=True)
+
+    _, _, body, headers = conn.request.call_args.args
+    assert isinstance(body, tuple)
+    payload = b"".join(body)
+    assert len(msgpack.unpackb(payload)[0]) == len(trace)
+    if chunked_transfer:
+        # Without a Content-Length header, http.client uses chunked transfer encoding
+        assert "Content-Length" not in headers
+        assert len(body) > 1
+        assert all(len(chunk) <= 64 << 10 for chunk in body)
+    else:
+        assert headers["Content-Length"] == str(len(payload))
+        assert len(body) == 1
+
+
+@pytest.mark.parametrize("chunked_transfer", (False, True))
+def test_writer_compression(chunked_transfer):
+    conn = mock.Mock()
+    response = mock.Mock(status=200, reason="OK")
+    response.read.return_value = b""
+    trace = [Span(name="a" * 1000, span_id=i + 1) for i in range(100)]
+
+    with override_global_config(
+        {"_trace_writer_chunked_transfer": chunked_transfer, "_trace_writer_compression": True}
+    ), mock.patch("ddtrace.internal.writer.writer.get_connection", return_value=conn), mock.patch(
+        "ddtrace.internal.compat.get_connection_response", return_value=response
+    ):
+        writer = AgentWriter("http://localhost:9126", api_version="v0.4")
+        writer.run_periodic = mock.Mock()
+        writer.write(trace)
+        writer.flush_queue(raise_exc=True)
+
+    _, _, body, headers = conn.request.call_args.args
+    assert headers["Content-Encoding"] == "gzip"
+    if chunked_transfer:
+        assert not isinstance(body, bytes)
+        body = b"".join(body)
+    assert isinstance(body, bytes)
+    payload = gzip.decompress(body)
+    assert len(payload) > len(body)
+    assert len(msgpack.unpackb(payload)[0]) == len(trace)
+
+
+def test_writer_compression_rejected():
+    conn = mock.Mock()
+    rejected = mock.Mock(status=415, reason="Unsupported Media Type")
+    rejected.read.return_value = b""
+    accepted = mock.Mock(status=200, reason="OK")
+    accepted.read.return_value = b""
+
+    with override_global_config({"_trace_writer_compression": True}), mock.patch(
+        "ddtrace.internal.writer.writer.get_connection", return_value=conn
+    ), mock.patch("ddtrace.internal.compat.get_connection_response", side_effect=[rejected, accepted, accepted]):
+        writer = AgentWriter("http://localhost:9126", api_version="v0.4")
+        writer.run_periodic = mock.Mock()
+        writer.write([Span(name="name", span_id=1)])
+        writer.flush_queue(raise_exc=True)
+
+        # The payload is sent again uncompressed, without downgrading the API, and so are the next ones
+        assert writer._endpoint == "v0.4/traces"
+        writer.write([Span(name="name", span_id=2)])
+        writer.flush_queue(raise_exc=True)
+
+    first, retry, sent = [c.args[3] for c in conn.request.call_args_list]
+    assert first["Content-Encoding"] == "gzip"
+    assert "Content-Encoding" not in retry
+    assert "Content-Encoding" not in sent
+
+
 @pytest.mark.subprocess(env=dict(DD_TRACE_128_BIT_TRACEID_GENERATION_ENABLED="true"))
 def test_trace_with_128bit_trace_ids():
     """Ensure 128bit trace ids are correctly encoded"""
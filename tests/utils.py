@@ -134,6 +134,8 @@ def override_global_config(values):
         "_trace_writer_payload_size",
         "_trace_writer_interval_seconds",
         "_trace_writer_connection_reuse",
+        "_trace_writer_chunked_transfer",
+        "_trace_writer_compression",
         "_trace_writer_log_err_payload",
         "_span_traceback_max_size",
         "propagation_http_baggage_enabled",
@@ -1241,6 +1243,7 @@ def check_test_agent_status():
 
 
 def flush_test_tracer_spans(writer):
+    writer._drain_trace_queue()
     client = writer._clients[0]
     n_traces = len(client.encoder)
     try: